@@ -786,6 +786,87 @@ typedef void (*cmp_vfs_read_cb_t)(int error, void *buffer, size_t size,
 int cmp_vfs_read_file_async(cmp_modality_t *mod, const char *virtual_path,
                             cmp_vfs_read_cb_t callback, void *user_data);
 
+/**
+ * @brief Callback receiving successive chunks of a file
+ * @param user_data User data passed to the chunked read
+ * @param chunk Bytes read; only valid for the duration of the call
+ * @param len Number of bytes in chunk
+ * @return 0 to continue, or a non-zero value to stop reading
+ */
+typedef int (*cmp_vfs_chunk_cb_t)(void *user_data, const void *chunk,
+                                  size_t len);
+
+/**
+ * @brief Stream a file from the VFS through a fixed-size buffer instead of
+ * reading it whole.
+ * @param virtual_path The path to the file
+ * @param chunk_size Size of each read
+ * @param callback Callback receiving each chunk in order
+ * @param user_data Optional user data to pass to the callback
+ * @return 0 on success, the callback's non-zero value if it stopped the read,
+ * or an error code.
+ */
+int cmp_vfs_read_file_chunked(const char *virtual_path, size_t chunk_size,
+                              cmp_vfs_chunk_cb_t callback, void *user_data);
+
+/**
+ * @brief Sequential file writer handle.
+ */
+typedef struct cmp_vfs_writer cmp_vfs_writer_t;
+
+/**
+ * @brief Create or truncate a file for sequential writing.
+ * @param virtual_path The virtual path to write.
+ * @param out_writer Pointer to receive the writer.
+ * @return 0 on success, or an error code.
+ */
+int cmp_vfs_writer_open(const char *virtual_path,
+                        cmp_vfs_writer_t **out_writer);
+
+/**
+ * @brief Append bytes to a file opened with cmp_vfs_writer_open.
+ * Once a write fails, every later write returns the same error.
+ * @param writer The writer.
+ * @param data Bytes to append.
+ * @param len Number of bytes.
+ * @return 0 on success, or an error code.
+ */
+int cmp_vfs_writer_write(cmp_vfs_writer_t *writer, const void *data,
+                         size_t len);
+
+/**
+ * @brief Flush and close a writer.
+ * @param writer The writer.
+ * @return 0 if every write and the final flush succeeded, or an error code.
+ */
+int cmp_vfs_writer_close(cmp_vfs_writer_t *writer);
+
+/**
+ * @brief Read-only view of a whole file.
+ */
+typedef struct cmp_vfs_mapping cmp_vfs_mapping_t;
+
+/**
+ * @brief Map a file into memory read-only.
+ * Uses mmap where available, so pages are loaded on first touch and shared
+ * with the page cache; elsewhere the file is read into a buffer.
+ * @param virtual_path The path to the file.
+ * @param out_map Pointer to receive the mapping, released with
+ * cmp_vfs_unmap_file.
+ * @param out_data Pointer to receive the file contents.
+ * @param out_size Pointer to receive the size of the contents.
+ * @return 0 on success, or an error code.
+ */
+int cmp_vfs_map_file(const char *virtual_path, cmp_vfs_mapping_t **out_map,
+                     const void **out_data, size_t *out_size);
+
+/**
+ * @brief Release a mapping made by cmp_vfs_map_file.
+ * @param map The mapping.
+ * @return 0 on success, or an error code.
+ */
+int cmp_vfs_unmap_file(cmp_vfs_mapping_t *map);
+
 /**
  * @brief Callback for file watching events
  * @param path The path of the file that changed
@@ -908,9 +989,47 @@ int cmp_http_send_multi_with_progress(
     size_t num_requests, int (*progress_cb)(float percentage, void *user_data),
     void *user_data, struct HttpResponse **out_responses);
 
+/**
+ * @brief Streaming SHA-256 state
+ */
+typedef struct cmp_sha256 {
+  unsigned long h[8];
+  unsigned long bits_hi, bits_lo;
+  unsigned char block[64];
+  size_t used;
+} cmp_sha256_t;
+
+/**
+ * @brief Start a SHA-256 digest.
+ * @param sha The state to reset
+ */
+void cmp_sha256_init(cmp_sha256_t *sha);
+
+/**
+ * @brief Hash more bytes.
+ * @param sha The digest state
+ * @param data The bytes
+ * @param len Number of bytes
+ */
+void cmp_sha256_update(cmp_sha256_t *sha, const void *data, size_t len);
+
+/**
+ * @brief Finish a digest; the state must be re-initialised before reuse.
+ * @param sha The digest state
+ * @param out_digest Receives the 32-byte digest
+ */
+void cmp_sha256_final(cmp_sha256_t *sha, unsigned char out_digest[32]);
+
+/**
+ * @brief Format a digest as lowercase hex.
+ * @param digest The 32-byte digest
+ * @param out_hex Receives 64 digits and a terminator
+ */
+void cmp_sha256_hex(const unsigned char digest[32], char out_hex[65]);
+
 /**
  * @brief Download a file from a URL, saving it to a virtual or physical path
- * (via VFS).
+ * (via VFS). Uses the cmp_http_download_ex defaults.
  *
  * @param client The HTTP client
  * @param url The URL to download
@@ -941,6 +1060,9 @@ int cmp_http_ws_init(struct HttpRequest *req,
 
 /**
  * @brief Read WebSocket events synchronously or queue to modality.
+ * Outside async modalities the read loop holds a worker for the
+ * connection's lifetime; cmp_net_reactor_add serves many connections from
+ * one thread.
  * @param mod The modality to execute on (if CMP_MODALITY_ASYNC, it registers
  * it).
  * @param client The HTTP client.
@@ -990,6 +1112,9 @@ int cmp_http_sse_init(struct HttpRequest *req,
 
 /**
  * @brief Read SSE events synchronously or queue to modality.
+ * Outside async modalities the read loop holds a worker for the
+ * connection's lifetime; cmp_net_reactor_add serves many connections from
+ * one thread.
  * @param mod The modality to execute on.
  * @param client The HTTP client.
  * @param req The HTTP request.
@@ -1007,6 +1132,594 @@ int cmp_http_sse_run(cmp_modality_t *mod, struct HttpClient *client,
                      c_abstract_http_sse_on_close on_close, void *user_data,
                      volatile int *exit_flag);
 
+/**
+ * @brief Opaque pooled HTTP client: per-origin keep-alive connections,
+ * concurrency limits, priority queues and GET coalescing.
+ */
+typedef struct cmp_http_pool cmp_http_pool_t;
+
+/**
+ * @brief Scheduling classes, most urgent first
+ */
+typedef enum cmp_http_priority {
+  CMP_HTTP_PRIORITY_VISIBLE = 0, /* e.g. images on screen */
+  CMP_HTTP_PRIORITY_HIGH,
+  CMP_HTTP_PRIORITY_NORMAL,
+  CMP_HTTP_PRIORITY_LOW, /* Prefetch */
+  CMP_HTTP_PRIORITY_COUNT
+} cmp_http_priority_t;
+
+/**
+ * @brief Pool limits; fill with cmp_http_pool_config_init
+ */
+typedef struct cmp_http_pool_config {
+  size_t max_per_origin;      /* Connections in use per origin (6) */
+  size_t max_total;           /* Connections in use over all origins (16) */
+  size_t max_idle_per_origin; /* Kept-alive connections per origin (6) */
+  double keep_alive_ms;       /* Idle time before a connection closes */
+  int coalesce_gets;          /* Share identical in-flight GETs (1) */
+  double (*now_ms)(void *user_data); /* Monotonic clock, NULL for the OS */
+  void *now_data;
+} cmp_http_pool_config_t;
+
+/**
+ * @brief Pool counters. Waits are measured from submission (or a retry)
+ * to dispatch.
+ */
+typedef struct cmp_http_pool_stats {
+  size_t requests;           /* Submissions */
+  size_t coalesced;          /* Submissions that joined a pending GET */
+  size_t dispatched;         /* Sends started */
+  size_t completed;          /* Fetches delivered successfully */
+  size_t failed;             /* Fetches delivered with an error */
+  size_t cancelled;          /* Submissions cancelled */
+  size_t retries;            /* Resends after a stale keep-alive failure */
+  size_t pool_hits;          /* Sends on a kept-alive connection */
+  size_t connections_opened; /* Sends that needed a new connection */
+  size_t connections_closed;
+  double queue_wait_total_ms;
+  double queue_wait_max_ms;
+  size_t in_flight;        /* Current */
+  size_t queued;           /* Current */
+  size_t idle_connections; /* Current */
+} cmp_http_pool_stats_t;
+
+/**
+ * @brief Receives a fetch result on the pool's ui modality (or during
+ * cmp_http_pool_poll without workers). Coalesced submissions share the
+ * response, which is only valid during the call. Must not destroy the pool.
+ * @param result 0 on success, or an error code (response is then NULL)
+ */
+typedef void (*cmp_http_pool_cb_t)(int result,
+                                   const struct HttpResponse *response,
+                                   void *user_data);
+
+/**
+ * @brief Opens one connection to an origin ("scheme://host:port")
+ */
+typedef int (*cmp_http_connect_fn_t)(const char *origin,
+                                     struct HttpClient **out_client,
+                                     void *user_data);
+
+/**
+ * @brief Closes a connection opened by the matching connect function
+ */
+typedef void (*cmp_http_disconnect_fn_t)(struct HttpClient *client,
+                                         void *user_data);
+
+/**
+ * @brief Fill a pool configuration with the defaults.
+ * @param config The configuration to fill
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_pool_config_init(cmp_http_pool_config_t *config);
+
+/**
+ * @brief Create a connection pool.
+ * @param config Limits, or NULL for the defaults
+ * @param out_pool Pointer to receive the pool
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_pool_create(const cmp_http_pool_config_t *config,
+                         cmp_http_pool_t **out_pool);
+
+/**
+ * @brief Destroy a pool. Queued submissions are dropped without their
+ * callbacks; with sends in flight the release is deferred to their
+ * delivery on the ui modality.
+ * @param pool The pool to destroy
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_pool_destroy(cmp_http_pool_t *pool);
+
+/**
+ * @brief Replace how connections are opened, e.g. to reuse a configured
+ * transport. Both functions NULL restores c-abstract-http clients. Idle
+ * connections are closed.
+ * @return 0 on success, CMP_ERROR_INVALID_STATE with sends in flight.
+ */
+int cmp_http_pool_set_connector(cmp_http_pool_t *pool,
+                                cmp_http_connect_fn_t connect,
+                                cmp_http_disconnect_fn_t disconnect,
+                                void *user_data);
+
+/**
+ * @brief Send on a worker pool.
+ * @param workers A CMP_MODALITY_THREADED modality, or NULL to send on the
+ * thread calling cmp_http_pool_poll.
+ * @param ui The modality the pool is used from; required with workers.
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_pool_set_workers(cmp_http_pool_t *pool, cmp_modality_t *workers,
+                              cmp_modality_t *ui);
+
+/**
+ * @brief Queue a request. The request is copied (streaming callbacks
+ * excepted). With workers it starts as soon as its origin has capacity;
+ * without, it runs from the next cmp_http_pool_poll. A GET identical to
+ * one queued or in flight joins it instead of being sent again.
+ * @param out_ticket Optional handle for cancel and set_priority
+ * @return 0 on success, CMP_ERROR_INVALID_ARG for URLs without an origin.
+ */
+int cmp_http_pool_submit(cmp_http_pool_t *pool, const struct HttpRequest *req,
+                         cmp_http_priority_t priority, cmp_http_pool_cb_t cb,
+                         void *user_data, size_t *out_ticket);
+
+/**
+ * @brief Drop a submission's callback; a queued fetch nobody waits for is
+ * not sent.
+ * @return 0 on success, CMP_ERROR_NOT_FOUND once delivered.
+ */
+int cmp_http_pool_cancel(cmp_http_pool_t *pool, size_t ticket);
+
+/**
+ * @brief Move a queued submission to another class, e.g. when its image
+ * scrolls into view. It goes behind the ones already in that class.
+ * @return 0 on success, CMP_ERROR_NOT_FOUND once delivered.
+ */
+int cmp_http_pool_set_priority(cmp_http_pool_t *pool, size_t ticket,
+                               cmp_http_priority_t priority);
+
+/**
+ * @brief Close connections idle past keep_alive_ms and start queued
+ * submissions; without workers they run to completion on this thread.
+ * @param pool The pool
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_pool_poll(cmp_http_pool_t *pool);
+
+/**
+ * @brief Read the pool counters.
+ * @param pool The pool
+ * @param out_stats Receives the counters
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_pool_get_stats(const cmp_http_pool_t *pool,
+                            cmp_http_pool_stats_t *out_stats);
+
+/**
+ * @brief Ranged download options; fill with cmp_http_download_config_init.
+ * Ranges beyond the first go out on extra connections from connect; NULL
+ * for both functions opens c-abstract-http clients.
+ */
+typedef struct cmp_http_download_config {
+  size_t parallel;             /* Connections fetching ranges at once (4) */
+  size_t range_size;           /* Bytes per range request (1 MiB) */
+  double progress_interval_ms; /* Least time between progress reports (100) */
+  int resume;            /* Continue from a matching sidecar manifest (1) */
+  const char *sha256;    /* Expected digest in hex, or NULL */
+  cmp_modality_t *workers; /* CMP_MODALITY_THREADED, NULL for a private one */
+  cmp_http_connect_fn_t connect;
+  cmp_http_disconnect_fn_t disconnect;
+  void *connect_data;
+  double (*now_ms)(void *user_data); /* Monotonic clock, NULL for the OS */
+  void *now_data;
+} cmp_http_download_config_t;
+
+/**
+ * @brief What a download did
+ */
+typedef struct cmp_http_download_stats {
+  size_t total;          /* Content length, 0 when the server sent none */
+  size_t fetched;        /* Body bytes received by this call */
+  size_t resumed;        /* Bytes kept from an earlier call */
+  size_t ranges;         /* Ranges the file was split into, 0 if streamed */
+  size_t requests;       /* GETs sent, the HEAD probe excluded */
+  size_t retries;        /* Range requests repeated after a failure */
+  size_t connections;    /* Extra connections opened */
+  size_t progress_calls; /* Progress callbacks made */
+} cmp_http_download_stats_t;
+
+/**
+ * @brief Fill a download configuration with the defaults.
+ * @param config The configuration to fill
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_download_config_init(cmp_http_download_config_t *config);
+
+/**
+ * @brief Download a file in parallel byte ranges when the server supports
+ * them (HEAD reports a length and "Accept-Ranges: bytes"), writing each
+ * range in place in a preallocated file; otherwise stream it in one GET.
+ *
+ * Progress is the share of bytes on disk, reported on the calling thread
+ * at most once per progress_interval_ms and always at 100 on success; a
+ * non-zero return aborts. Ranged downloads record finished bytes in a
+ * "<path>.cmpdl" manifest, so a later call for the same URL and validator
+ * (ETag or Last-Modified) fetches only what is missing. The manifest is
+ * removed on success, on a checksum mismatch and when the resource changed.
+ *
+ * @param client The HTTP client; also fetches ranges itself
+ * @param url The URL to download
+ * @param save_virtual_path The path to save the downloaded file to
+ * @param config Options, or NULL for the defaults
+ * @param progress_cb Callback to receive progress updates (0 to 100)
+ * @param user_data Data passed to the progress callback
+ * @param out_stats Optional counters
+ * @return 0 on success; CMP_ERROR_NOT_FOUND when a request fails or the
+ * resource changed, CMP_ERROR_INVALID_STATE when aborted, CMP_ERROR_IO on a
+ * write error or checksum mismatch, or another error code.
+ */
+int cmp_http_download_ex(struct HttpClient *client, const char *url,
+                         const char *save_virtual_path,
+                         const cmp_http_download_config_t *config,
+                         int (*progress_cb)(float percentage,
+                                            void *user_data),
+                         void *user_data,
+                         cmp_http_download_stats_t *out_stats);
+
+/**
+ * @brief How a cache answers when a stored response is stale
+ */
+typedef enum cmp_http_cache_mode {
+  CMP_HTTP_CACHE_ONLINE = 0, /* Revalidate with the origin */
+  CMP_HTTP_CACHE_LOW_DATA,   /* Serve stale entries; misses still fetch */
+  CMP_HTTP_CACHE_OFFLINE     /* Never touch the network */
+} cmp_http_cache_mode_t;
+
+/**
+ * @brief Where a cached send's response came from
+ */
+typedef enum cmp_http_cache_result {
+  CMP_HTTP_CACHE_MISS = 0,    /* From the network (stored if cacheable) */
+  CMP_HTTP_CACHE_HIT,         /* Fresh entry, no request sent */
+  CMP_HTTP_CACHE_REVALIDATED, /* Entry confirmed by a 304 */
+  CMP_HTTP_CACHE_STALE        /* Stale entry, see cmp_http_cache_send */
+} cmp_http_cache_result_t;
+
+typedef struct cmp_http_cache cmp_http_cache_t;
+
+/**
+ * @brief Cache options; fill with cmp_http_cache_config_init
+ */
+typedef struct cmp_http_cache_config {
+  const char *directory; /* Virtual path, NULL for the OS cache directory */
+  size_t max_bytes;      /* Body bytes kept before LRU eviction (64 MiB) */
+  size_t max_entries;    /* Responses kept before LRU eviction (4096) */
+  double (*now_s)(void *user_data); /* Wall clock, NULL for time() */
+  void *now_data;
+} cmp_http_cache_config_t;
+
+/**
+ * @brief Cache counters. Entries and bytes survive reopening; the rest
+ * count from cmp_http_cache_open.
+ */
+typedef struct cmp_http_cache_stats {
+  size_t hits;
+  size_t revalidated;
+  size_t stale;     /* Stale responses served */
+  size_t misses;    /* Sends answered by the network alone */
+  size_t stored;    /* Responses written */
+  size_t evictions; /* Entries dropped to stay within the limits */
+  size_t pending;   /* Current queued background revalidations */
+  size_t entries;   /* Current */
+  size_t bytes;     /* Current */
+} cmp_http_cache_stats_t;
+
+/**
+ * @brief Fill a cache configuration with the defaults.
+ * @param config The configuration to fill
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_cache_config_init(cmp_http_cache_config_t *config);
+
+/**
+ * @brief Open (creating if needed) an on-disk response cache.
+ *
+ * The directory holds a fixed-size index that is memory-mapped where the
+ * OS allows, response headers per URL under "h/", and bodies under "b/"
+ * named by their SHA-256 so identical bodies are stored once. An index
+ * written with other limits is discarded.
+ *
+ * @param config Options, or NULL for the defaults
+ * @param out_cache Pointer to receive the cache
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_cache_open(const cmp_http_cache_config_t *config,
+                        cmp_http_cache_t **out_cache);
+
+/**
+ * @brief Flush the index and close a cache. Queued revalidations are
+ * dropped.
+ * @param cache The cache to close
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_cache_close(cmp_http_cache_t *cache);
+
+/**
+ * @brief Execute a request through the cache (RFC 9111, private cache).
+ *
+ * Only GETs without an on_chunk callback, Range or caller conditionals are
+ * served from or stored in the cache; successful unsafe methods invalidate
+ * the URL. Freshness comes from max-age, Expires or 10% of the
+ * Last-Modified age (at most a day). Stale entries with an ETag or
+ * Last-Modified are revalidated with a conditional GET. A stale response
+ * is served (CMP_HTTP_CACHE_STALE) within stale-while-revalidate, which
+ * queues a background revalidation; within stale-if-error when the
+ * origin fails; and in low-data and offline modes. Entries marked
+ * no-cache or must-revalidate are never served stale.
+ *
+ * @param cache The cache
+ * @param client The HTTP client for requests that reach the network
+ * @param req The request to execute
+ * @param out_res Pointer to receive the response (free it with
+ * cmp_http_response_free); cached responses carry an Age header
+ * @param out_result Optional, receives where the response came from
+ * @return 0 on success; CMP_ERROR_NOT_FOUND when the request failed or
+ * nothing usable is stored offline (or for only-if-cached), or another
+ * error code.
+ */
+int cmp_http_cache_send(cmp_http_cache_t *cache, struct HttpClient *client,
+                        const struct HttpRequest *req,
+                        struct HttpResponse **out_res,
+                        cmp_http_cache_result_t *out_result);
+
+/**
+ * @brief Run queued stale-while-revalidate refreshes, e.g. from a worker
+ * or an idle callback.
+ * @param cache The cache
+ * @param client The HTTP client to revalidate with
+ * @param max_count Most refreshes to run, 0 for all
+ * @return The number run (successful or not), or a negative error code.
+ */
+int cmp_http_cache_revalidate(cmp_http_cache_t *cache,
+                              struct HttpClient *client, size_t max_count);
+
+/**
+ * @brief Switch between online, low-data and offline behaviour, e.g. when
+ * cmp_resources_set_low_data_mode changes.
+ * @param cache The cache
+ * @param mode The new mode
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_cache_set_mode(cmp_http_cache_t *cache,
+                            cmp_http_cache_mode_t mode);
+
+/**
+ * @brief Drop every entry and its files.
+ * @param cache The cache
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_cache_clear(cmp_http_cache_t *cache);
+
+/**
+ * @brief Get the cache counters.
+ * @param cache The cache
+ * @param out_stats Receives the counters
+ * @return 0 on success, or an error code.
+ */
+int cmp_http_cache_get_stats(cmp_http_cache_t *cache,
+                             cmp_http_cache_stats_t *out_stats);
+
+/**
+ * @brief WebSocket frame opcodes (RFC 6455 section 5.2)
+ */
+typedef enum cmp_ws_opcode {
+  CMP_WS_OP_CONTINUATION = 0x0,
+  CMP_WS_OP_TEXT = 0x1,
+  CMP_WS_OP_BINARY = 0x2,
+  CMP_WS_OP_CLOSE = 0x8,
+  CMP_WS_OP_PING = 0x9,
+  CMP_WS_OP_PONG = 0xA
+} cmp_ws_opcode_t;
+
+/**
+ * @brief One parsed WebSocket frame. The payload points into the parsed
+ * buffer and is already unmasked.
+ */
+typedef struct cmp_ws_frame {
+  int fin;
+  int compressed; /* RSV1: first frame of a permessage-deflate message */
+  int opcode;
+  unsigned char *payload;
+  size_t payload_len;
+} cmp_ws_frame_t;
+
+/**
+ * @brief Parse one frame in place. A masked payload is unmasked inside the
+ * buffer, so each frame must be parsed once.
+ * @param data Received bytes, starting at a frame boundary
+ * @param len Bytes available
+ * @param out_frame Receives the frame
+ * @param out_consumed Receives the frame size, or 0 while it is incomplete
+ * @return 0 on success, CMP_ERROR_INVALID_ARG on a protocol error,
+ * CMP_ERROR_BOUNDS for a length that does not fit in memory.
+ */
+int cmp_ws_frame_parse(unsigned char *data, size_t len,
+                       cmp_ws_frame_t *out_frame, size_t *out_consumed);
+
+/**
+ * @brief Encode a frame header.
+ * @param out Receives up to 14 bytes
+ * @param mask Masking key of a client frame, or NULL
+ * @return The header size, 0 on invalid arguments.
+ */
+size_t cmp_ws_frame_header(unsigned char *out, int fin, int compressed,
+                           int opcode, size_t payload_len,
+                           const unsigned char *mask);
+
+/**
+ * @brief XOR a payload with a masking key; masking and unmasking are the
+ * same operation. Works a machine word at a time.
+ * @param offset Position of data within the payload, for split payloads
+ */
+void cmp_ws_mask(unsigned char *data, size_t len, const unsigned char *mask,
+                 size_t offset);
+
+/**
+ * @brief Compute the Sec-WebSocket-Accept value for a Sec-WebSocket-Key.
+ * @param key The client's key
+ * @param out Receives 28 characters and a terminator
+ * @return 0 on success, or an error code.
+ */
+int cmp_ws_accept_key(const char *key, char *out);
+
+/**
+ * @brief Opaque I/O thread multiplexing WebSocket and SSE connections over
+ * one epoll (poll(2) off Linux) set, instead of a blocking read loop per
+ * connection. Not available on Windows.
+ */
+typedef struct cmp_net_reactor cmp_net_reactor_t;
+
+/**
+ * @brief One connection attached to a reactor
+ */
+typedef struct cmp_net_stream cmp_net_stream_t;
+
+/**
+ * @brief Protocols a reactor stream speaks
+ */
+typedef enum cmp_net_stream_kind {
+  CMP_NET_STREAM_WEBSOCKET = 0, /* Client side of RFC 6455 */
+  CMP_NET_STREAM_SSE            /* text/event-stream response body */
+} cmp_net_stream_kind_t;
+
+/**
+ * @brief A delivered WebSocket message or SSE event
+ */
+typedef struct cmp_net_message {
+  int opcode;                /* CMP_WS_OP_TEXT or _BINARY; TEXT for SSE */
+  const unsigned char *data; /* Whole message, or the event's data lines */
+  size_t len;
+  const char *event; /* SSE event type ("message"), NULL for WebSocket */
+  const char *id;    /* SSE last event id, NULL for WebSocket */
+} cmp_net_message_t;
+
+/**
+ * @brief Receives the messages one reactor wake read from a stream, on the
+ * delivery modality. The messages are only valid during the call.
+ */
+typedef void (*cmp_net_batch_cb_t)(cmp_net_stream_t *stream,
+                                   const cmp_net_message_t *messages,
+                                   size_t count, void *user_data);
+
+/**
+ * @brief Last callback of a stream, on the delivery modality; the stream is
+ * released after it returns.
+ * @param result 0 for an orderly close, CMP_ERROR_IO for a dropped
+ * connection, CMP_ERROR_INVALID_ARG for a protocol violation,
+ * CMP_ERROR_INVALID_STATE for a refused handshake
+ * @param code WebSocket close code (1005 when none was sent), or the HTTP
+ * status of a refused handshake
+ */
+typedef void (*cmp_net_close_cb_t)(cmp_net_stream_t *stream, int result,
+                                   int code, void *user_data);
+
+/**
+ * @brief How a stream is attached; fill with cmp_net_stream_config_init
+ */
+typedef struct cmp_net_stream_config {
+  cmp_net_stream_kind_t kind;
+  const char *host; /* Send the handshake for this Host; NULL when the
+                       socket is already past it */
+  const char *path; /* Request target, "/" when NULL */
+  int permessage_deflate; /* Offer it; with no host, whether it was agreed */
+  const void *initial;    /* Bytes the caller read past the handshake */
+  size_t initial_len;
+  size_t max_message; /* Largest message or event (16 MiB) */
+  cmp_net_batch_cb_t on_batch;
+  cmp_net_close_cb_t on_close;
+  void *user_data;
+} cmp_net_stream_config_t;
+
+/**
+ * @brief Reactor counters
+ */
+typedef struct cmp_net_reactor_stats {
+  size_t streams;   /* Current */
+  size_t wakeups;   /* Returns from the poller */
+  size_t messages;  /* Messages and events delivered */
+  size_t batches;   /* Delivery tasks queued */
+  size_t bytes_in;  /* Socket bytes read */
+  size_t bytes_out; /* Socket bytes written */
+} cmp_net_reactor_stats_t;
+
+/**
+ * @brief Fill a stream configuration with the defaults.
+ * @param config The configuration to fill
+ * @return 0 on success, or an error code.
+ */
+int cmp_net_stream_config_init(cmp_net_stream_config_t *config);
+
+/**
+ * @brief Start a reactor thread.
+ * @param deliver A serial modality (not CMP_MODALITY_THREADED) that runs
+ * the callbacks, in order per stream
+ * @param out_reactor Pointer to receive the reactor
+ * @return 0 on success, CMP_ERROR_INVALID_STATE where unsupported.
+ */
+int cmp_net_reactor_create(cmp_modality_t *deliver,
+                           cmp_net_reactor_t **out_reactor);
+
+/**
+ * @brief Stop the thread and close every stream without its on_close.
+ * Call from the delivery modality, not from a callback; batches already
+ * queued are dropped as they run.
+ * @param reactor The reactor to destroy
+ * @return 0 on success, or an error code.
+ */
+int cmp_net_reactor_destroy(cmp_net_reactor_t *reactor);
+
+/**
+ * @brief Hand a connected socket to the reactor, which owns (and closes) it
+ * from then on. TLS is not handled; use plain ws:// and http:// sockets.
+ * @param reactor The reactor
+ * @param fd A connected stream socket
+ * @param config Protocol and callbacks
+ * @param out_stream Optional handle for send and close
+ * @return 0 on success, or an error code.
+ */
+int cmp_net_reactor_add(cmp_net_reactor_t *reactor, int fd,
+                        const cmp_net_stream_config_t *config,
+                        cmp_net_stream_t **out_stream);
+
+/**
+ * @brief Read the reactor counters.
+ * @param reactor The reactor
+ * @param out_stats Receives the counters
+ * @return 0 on success, or an error code.
+ */
+int cmp_net_reactor_get_stats(cmp_net_reactor_t *reactor,
+                              cmp_net_reactor_stats_t *out_stats);
+
+/**
+ * @brief Queue a masked WebSocket frame; any thread. Messages of 64 bytes
+ * or more are compressed when permessage-deflate is in use. Frames sent
+ * during the handshake go out once it succeeds.
+ * @param opcode CMP_WS_OP_TEXT, _BINARY or _PING
+ * @return 0 on success, CMP_ERROR_INVALID_STATE once closing or for SSE.
+ */
+int cmp_net_stream_send(cmp_net_stream_t *stream, int opcode,
+                        const void *data, size_t len);
+
+/**
+ * @brief Start closing a stream; any thread. WebSocket streams send a close
+ * frame and wait briefly for the peer's. on_close still follows.
+ * @param code WebSocket close code, 0 for 1000
+ * @return 0 on success, CMP_ERROR_INVALID_STATE if already closing.
+ */
+int cmp_net_stream_close(cmp_net_stream_t *stream, int code);
+
 /**
  * @brief Initialize the global database and state subsystem (wraps c-orm).
  * @return 0 on success, or an error code.
@@ -1067,6 +1780,8 @@ typedef struct cmp_orm_observable cmp_orm_observable_t;
 
 /**
  * @brief Initialize an observable data binding to a database query.
+ * The tables named after FROM and JOIN become its dependencies: writes to
+ * them through cmp_orm_execute (or cmp_orm_notify_changed) mark it stale.
  * @param db The database handle
  * @param query The SQL query representing the observable state
  * @param out_obs Pointer to receive the observable handle
@@ -1082,7 +1797,8 @@ int cmp_orm_observable_create(c_orm_db_t *db, const char *query,
  */
 
 /**
- * @brief Bind a UI node to an observable property.
+ * @brief Bind a UI node to an observable property. An observable may have
+ * many bound nodes; binding a node again replaces its property.
  * @param node The UI node to bind
  * @param obs The observable to bind to
  * @param property_name Name of the UI property (e.g. "text", "value")
@@ -1092,7 +1808,16 @@ int cmp_ui_node_bind(cmp_ui_node_t *node, cmp_orm_observable_t *obs,
                      const char *property_name);
 
 /**
- * @brief Destroy an observable binding.
+ * @brief Remove a node's binding, e.g. before destroying the node.
+ * @param node The bound UI node
+ * @param obs The observable it is bound to
+ * @return 0 on success, CMP_ERROR_NOT_FOUND if the node is not bound.
+ */
+int cmp_ui_node_unbind(cmp_ui_node_t *node, cmp_orm_observable_t *obs);
+
+/**
+ * @brief Destroy an observable binding. With a re-query in flight the
+ * release is deferred to its delivery on the ui modality.
  * @param obs The observable to destroy
  * @return 0 on success, or an error code.
  */
@@ -2603,12 +3328,223 @@ int cmp_date_picker_create(cmp_date_picker_t **out_picker);
 int cmp_date_picker_destroy(cmp_date_picker_t *picker);
 
 /**
- * @brief Opaque Caret Rendering Context
+ * @brief Opaque piece-tree text buffer.
+ *
+ * Stores UTF-8 text as pieces of append-only storage in a balanced tree
+ * that caches byte, line and code point counts per subtree. Inserts,
+ * deletes and position conversions are O(log n) in the number of pieces,
+ * independent of document size. Offsets are byte offsets.
  */
-typedef struct cmp_caret cmp_caret_t;
+typedef struct cmp_text_buffer cmp_text_buffer_t;
 
 /**
- * @brief Create a caret context
+ * @brief Immutable view of a text buffer at one point in time.
+ *
+ * Taking a snapshot is O(1); the buffer copies only the tree nodes that
+ * later edits touch, so snapshots are cheap enough to keep per undo step.
+ */
+typedef struct cmp_text_snapshot cmp_text_snapshot_t;
+
+/**
+ * @brief Create an empty text buffer
+ */
+int cmp_text_buffer_create(cmp_text_buffer_t **out_buffer);
+
+/**
+ * @brief Destroy a text buffer (outstanding snapshots stay valid)
+ */
+int cmp_text_buffer_destroy(cmp_text_buffer_t *buffer);
+
+/**
+ * @brief Replace the whole contents of the buffer
+ */
+int cmp_text_buffer_set_text(cmp_text_buffer_t *buffer, const char *text,
+                             size_t len);
+
+/**
+ * @brief Insert len bytes at a byte offset
+ * @return CMP_ERROR_BOUNDS if offset is past the end
+ */
+int cmp_text_buffer_insert(cmp_text_buffer_t *buffer, size_t offset,
+                           const char *text, size_t len);
+
+/**
+ * @brief Delete len bytes starting at a byte offset
+ * @return CMP_ERROR_BOUNDS if the range is past the end
+ */
+int cmp_text_buffer_delete(cmp_text_buffer_t *buffer, size_t offset,
+                           size_t len);
+
+/**
+ * @brief Get the length of the buffer in bytes
+ */
+int cmp_text_buffer_get_length(const cmp_text_buffer_t *buffer,
+                               size_t *out_len);
+
+/**
+ * @brief Get the number of lines ('\n' count plus one)
+ */
+int cmp_text_buffer_get_line_count(const cmp_text_buffer_t *buffer,
+                                   size_t *out_count);
+
+/**
+ * @brief Get the number of UTF-8 code points
+ */
+int cmp_text_buffer_get_codepoint_count(const cmp_text_buffer_t *buffer,
+                                        size_t *out_count);
+
+/**
+ * @brief Convert a byte offset to a zero-based line and byte column
+ * @param out_column Optional.
+ */
+int cmp_text_buffer_offset_to_line(const cmp_text_buffer_t *buffer,
+                                   size_t offset, size_t *out_line,
+                                   size_t *out_column);
+
+/**
+ * @brief Get the byte offset at which a zero-based line starts
+ */
+int cmp_text_buffer_line_to_offset(const cmp_text_buffer_t *buffer,
+                                   size_t line, size_t *out_offset);
+
+/**
+ * @brief Convert a byte offset to the index of the code point it starts
+ */
+int cmp_text_buffer_offset_to_codepoint(const cmp_text_buffer_t *buffer,
+                                        size_t offset, size_t *out_index);
+
+/**
+ * @brief Convert a code point index to its byte offset
+ */
+int cmp_text_buffer_codepoint_to_offset(const cmp_text_buffer_t *buffer,
+                                        size_t index, size_t *out_offset);
+
+/**
+ * @brief Copy len bytes starting at offset into out (not NUL-terminated)
+ */
+int cmp_text_buffer_read(const cmp_text_buffer_t *buffer, size_t offset,
+                         size_t len, char *out);
+
+/**
+ * @brief Get the contiguous run of stored bytes starting at offset
+ *
+ * Iterates the text without copying: advance offset by *out_len until the
+ * end. The pointer stays valid until the buffer and all of its snapshots
+ * are destroyed.
+ */
+int cmp_text_buffer_get_chunk(const cmp_text_buffer_t *buffer, size_t offset,
+                              const char **out_data, size_t *out_len);
+
+/**
+ * @brief Capture the current contents as a snapshot
+ */
+int cmp_text_buffer_snapshot(const cmp_text_buffer_t *buffer,
+                             cmp_text_snapshot_t **out_snapshot);
+
+/**
+ * @brief Reset the buffer to a snapshot taken from the same buffer
+ * @return CMP_ERROR_INVALID_ARG if the snapshot belongs to another buffer
+ */
+int cmp_text_buffer_restore(cmp_text_buffer_t *buffer,
+                            const cmp_text_snapshot_t *snapshot);
+
+/**
+ * @brief Get the length of a snapshot in bytes
+ */
+int cmp_text_snapshot_get_length(const cmp_text_snapshot_t *snapshot,
+                                 size_t *out_len);
+
+/**
+ * @brief Copy len bytes of a snapshot starting at offset into out
+ */
+int cmp_text_snapshot_read(const cmp_text_snapshot_t *snapshot, size_t offset,
+                           size_t len, char *out);
+
+/**
+ * @brief Release a snapshot
+ */
+int cmp_text_snapshot_release(cmp_text_snapshot_t *snapshot);
+
+/**
+ * @brief Get the length of the longest valid UTF-8 prefix of text.
+ *
+ * Rejects overlong forms, surrogates and code points above U+10FFFF.
+ * Checks 16 bytes per step where SSE2 is available.
+ * @param out_valid_len Set to len when the whole text is valid.
+ */
+int cmp_utf8_validate(const char *text, size_t len, size_t *out_valid_len);
+
+/**
+ * @brief Count the code points of valid UTF-8 text.
+ */
+int cmp_utf8_count_codepoints(const char *text, size_t len,
+                              size_t *out_count);
+
+/**
+ * @brief Decode the code point starting at a byte offset.
+ *
+ * Malformed input decodes as U+FFFD and advances past the bytes that
+ * could have started a valid sequence (at least one).
+ * @return CMP_ERROR_BOUNDS if offset is not before len
+ */
+int cmp_utf8_decode(const char *text, size_t len, size_t offset,
+                    unsigned long *out_codepoint, size_t *out_next);
+
+/**
+ * @brief Get the end of the grapheme cluster starting at offset (UAX #29).
+ *
+ * Carets and deletions should move by clusters so that combining marks,
+ * emoji sequences and flags stay whole. Returns len at the end.
+ */
+int cmp_utf8_next_grapheme(const char *text, size_t len, size_t offset,
+                           size_t *out_offset);
+
+/**
+ * @brief Get the start of the grapheme cluster ending at offset.
+ *
+ * Returns 0 at the start of the text.
+ */
+int cmp_utf8_prev_grapheme(const char *text, size_t len, size_t offset,
+                           size_t *out_offset);
+
+/**
+ * @brief Count the grapheme clusters (user-perceived characters) in text.
+ */
+int cmp_utf8_count_graphemes(const char *text, size_t len,
+                             size_t *out_count);
+
+/**
+ * @brief Get the next word boundary after offset (UAX #29).
+ * @param out_is_word Optional. Set when the segment from offset holds a
+ * word (letters, digits, kana or ideographs) rather than spaces or
+ * punctuation.
+ */
+int cmp_utf8_next_word_boundary(const char *text, size_t len, size_t offset,
+                                size_t *out_offset, int *out_is_word);
+
+/**
+ * @brief Get the last word boundary before offset.
+ */
+int cmp_utf8_prev_word_boundary(const char *text, size_t len, size_t offset,
+                                size_t *out_offset);
+
+/**
+ * @brief Get the next line break opportunity after offset (UAX #14).
+ *
+ * Layout breaks a line at the last opportunity that fits.
+ * @param out_mandatory Optional. Set when the line must end there (after
+ * a newline, and at the end of the text).
+ */
+int cmp_utf8_next_line_break(const char *text, size_t len, size_t offset,
+                             size_t *out_offset, int *out_mandatory);
+
+/**
+ * @brief Opaque Caret Rendering Context
+ */
+typedef struct cmp_caret cmp_caret_t;
+
+/**
+ * @brief Create a caret context
  */
 int cmp_caret_create(cmp_caret_t **out_caret);
 
@@ -2658,6 +3594,12 @@ int cmp_editable_destroy(cmp_editable_t *editable);
  */
 int cmp_editable_insert_text(cmp_editable_t *editable, const char *text);
 
+/**
+ * @brief Get the text buffer backing an editable (owned by the editable)
+ */
+int cmp_editable_get_buffer(cmp_editable_t *editable,
+                            cmp_text_buffer_t **out_buffer);
+
 /**
  * @brief Opaque IME Context
  */
@@ -2680,9 +3622,35 @@ int cmp_ime_update_composition(cmp_ime_t *ime, const char *composition_string);
 
 /**
  * @brief Opaque Spellcheck Context
+ *
+ * Checks words against a compact dictionary automaton that is built from a
+ * word list or mapped from a compiled file. Verification and text checks
+ * may run on worker threads while the owner adds words.
  */
 typedef struct cmp_spellcheck cmp_spellcheck_t;
 
+/**
+ * @brief Longest word handled, in bytes including the terminator; longer
+ * tokens (URLs, hashes) are never flagged.
+ */
+#define CMP_SPELLCHECK_MAX_WORD 64
+
+/**
+ * @brief A misspelled word, as a byte range of the checked text
+ */
+typedef struct cmp_spell_range {
+  size_t offset;
+  size_t length;
+} cmp_spell_range_t;
+
+/**
+ * @brief A dictionary word close to a misspelling
+ */
+typedef struct cmp_spell_suggestion {
+  char word[CMP_SPELLCHECK_MAX_WORD];
+  size_t distance; /**< Edits (insert, delete, replace, swap) away */
+} cmp_spell_suggestion_t;
+
 /**
  * @brief Create a spellcheck context
  */
@@ -2699,8 +3667,65 @@ int cmp_spellcheck_destroy(cmp_spellcheck_t *spellcheck);
 int cmp_spellcheck_verify_word(cmp_spellcheck_t *spellcheck, const char *word,
                                int *out_is_correct);
 
+/**
+ * @brief Replace the dictionary with one built from a word list
+ *
+ * Words are UTF-8, matched byte for byte; capitalized and all-caps forms
+ * of lowercase words are accepted. Must not run while checks are in
+ * flight. Without a dictionary every word is reported correct.
+ * @return CMP_ERROR_BOUNDS if the list is too large for the format
+ */
+int cmp_spellcheck_build_dictionary(cmp_spellcheck_t *spellcheck,
+                                    const char *const *words, size_t count);
+
+/**
+ * @brief Write the dictionary in the compiled format
+ * @return CMP_ERROR_INVALID_STATE if there is no dictionary
+ */
+int cmp_spellcheck_save_dictionary(const cmp_spellcheck_t *spellcheck,
+                                   const char *virtual_path);
+
+/**
+ * @brief Map a compiled dictionary from the VFS and use it in place
+ * @return CMP_ERROR_INVALID_ARG for a malformed file
+ */
+int cmp_spellcheck_load_dictionary(cmp_spellcheck_t *spellcheck,
+                                   const char *virtual_path);
+
+/**
+ * @brief Accept a word on top of the dictionary ("Add to dictionary")
+ */
+int cmp_spellcheck_add_word(cmp_spellcheck_t *spellcheck, const char *word);
+
+/**
+ * @brief Find dictionary words within max_distance edits of a word
+ * @param out_suggestions Receives the closest words, nearest first and in
+ * dictionary order among equals.
+ * @param out_count Number of suggestions written, at most max_results.
+ */
+int cmp_spellcheck_suggest(cmp_spellcheck_t *spellcheck, const char *word,
+                           size_t max_distance,
+                           cmp_spell_suggestion_t *out_suggestions,
+                           size_t max_results, size_t *out_count);
+
+/**
+ * @brief Find the misspelled words of a text
+ *
+ * Stops when out_ranges is full; continue from the end of the last range.
+ * Words containing digits are skipped.
+ * @param out_count Number of ranges written.
+ */
+int cmp_spellcheck_check_text(cmp_spellcheck_t *spellcheck, const char *text,
+                              size_t len, cmp_spell_range_t *out_ranges,
+                              size_t max_ranges, size_t *out_count);
+
 /**
  * @brief Opaque Undo/Redo Stack Context
+ *
+ * History is stored as edit deltas, not document copies, and is bounded by
+ * a byte budget (4 MB by default) instead of a step count. A stack tracks
+ * either pushed states (push/undo/redo) or recorded edits applied to a
+ * cmp_text_buffer_t (record_* / *_edits); the two should not be mixed.
  */
 typedef struct cmp_undo_redo cmp_undo_redo_t;
 
@@ -2716,6 +3741,8 @@ int cmp_undo_redo_destroy(cmp_undo_redo_t *stack);
 
 /**
  * @brief Push a new state onto the undo stack
+ *
+ * Only the span that differs from the previous state is kept.
  */
 int cmp_undo_redo_push(cmp_undo_redo_t *stack, const char *state);
 
@@ -2725,6 +3752,71 @@ int cmp_undo_redo_push(cmp_undo_redo_t *stack, const char *state);
 int cmp_undo_redo_undo(cmp_undo_redo_t *stack, char *out_buffer,
                        size_t out_capacity);
 
+/**
+ * @brief Re-apply the last undone state
+ * @return CMP_ERROR_INVALID_STATE if there is nothing to redo
+ */
+int cmp_undo_redo_redo(cmp_undo_redo_t *stack, char *out_buffer,
+                       size_t out_capacity);
+
+/**
+ * @brief Set the history byte budget; the oldest steps are dropped to fit
+ *
+ * The newest step is always kept, even if it alone exceeds the budget.
+ */
+int cmp_undo_redo_set_budget(cmp_undo_redo_t *stack, size_t max_bytes);
+
+/**
+ * @brief Set the window in which consecutive edits merge into one step
+ *
+ * An edit joins the current step if it arrives within window_ms of the
+ * previous one (default 500 ms).
+ */
+int cmp_undo_redo_set_group_window(cmp_undo_redo_t *stack, double window_ms);
+
+/**
+ * @brief Start a new undo step with the next recorded edit
+ */
+int cmp_undo_redo_break_group(cmp_undo_redo_t *stack);
+
+/**
+ * @brief Record that len bytes of text were inserted at offset
+ * @param time_ms Caller clock, used for grouping.
+ */
+int cmp_undo_redo_record_insert(cmp_undo_redo_t *stack, size_t offset,
+                                const char *text, size_t len, double time_ms);
+
+/**
+ * @brief Record that len bytes (removed) were deleted at offset
+ * @param time_ms Caller clock, used for grouping.
+ */
+int cmp_undo_redo_record_delete(cmp_undo_redo_t *stack, size_t offset,
+                                const char *removed, size_t len,
+                                double time_ms);
+
+/**
+ * @brief Revert the newest step of recorded edits on a text buffer
+ * @param out_caret Optional; receives the caret after the revert.
+ * @return CMP_ERROR_INVALID_STATE if there is nothing to undo
+ */
+int cmp_undo_redo_undo_edits(cmp_undo_redo_t *stack,
+                             cmp_text_buffer_t *buffer, size_t *out_caret);
+
+/**
+ * @brief Re-apply the last undone step of recorded edits on a text buffer
+ * @param out_caret Optional; receives the caret after the edits.
+ * @return CMP_ERROR_INVALID_STATE if there is nothing to redo
+ */
+int cmp_undo_redo_redo_edits(cmp_undo_redo_t *stack,
+                             cmp_text_buffer_t *buffer, size_t *out_caret);
+
+/**
+ * @brief Get the available undo/redo steps and the bytes held by history
+ */
+int cmp_undo_redo_get_stats(const cmp_undo_redo_t *stack,
+                            size_t *out_undo_steps, size_t *out_redo_steps,
+                            size_t *out_bytes);
+
 #ifndef CMP_TEXTURE_T_DEFINED
 #define CMP_TEXTURE_T_DEFINED
 typedef struct cmp_texture cmp_texture_t;
@@ -3025,8 +4117,35 @@ int cmp_router_create(cmp_router_t **out_router);
  */
 int cmp_router_destroy(cmp_router_t *router);
 
+/** Most parameters a route path may declare */
+#define CMP_ROUTE_MAX_PARAMS 8
+
 /**
- * @brief Register a route path with a view builder and optional guard
+ * @brief One extracted route parameter. Both strings are slices and are not
+ * NUL-terminated.
+ */
+typedef struct cmp_route_param {
+  const char *name; /* Points into the registered path */
+  size_t name_len;
+  const char *value; /* Points into the matched URI */
+  size_t value_len;
+} cmp_route_param_t;
+
+/**
+ * @brief Result of matching a URI, small enough to live on the stack
+ */
+typedef struct cmp_route_match {
+  const char *pattern; /* Registered path of the route */
+  cmp_route_param_t params[CMP_ROUTE_MAX_PARAMS];
+  size_t param_count;
+} cmp_route_match_t;
+
+/**
+ * @brief Register a route path with a view builder and optional guard.
+ * Segments are static text, ":name" (any one segment) or a final "*name"
+ * (the rest of the URI, at least one segment). Static segments take
+ * precedence over parameters, and parameters over wildcards. Registering
+ * a path again replaces its route.
  * @param router The router instance
  * @param path The route path (e.g. "/settings/profile/:id")
  * @param builder The callback to construct the view
@@ -3079,6 +4198,31 @@ int cmp_router_pop(cmp_router_t *router);
  */
 int cmp_router_get_current(cmp_router_t *router, cmp_string_t *out_uri);
 
+/**
+ * @brief Resolve a URI without navigating. Costs O(segments) and allocates
+ * nothing; the match points into uri and the router.
+ * @return CMP_ERROR_NOT_FOUND if no route matches
+ */
+int cmp_router_match(const cmp_router_t *router, const char *uri,
+                     cmp_route_match_t *out_match);
+
+/**
+ * @brief Match of the active route, e.g. for a builder to read its
+ * parameters. Valid until the next navigation.
+ * @return CMP_ERROR_NOT_FOUND if no route is active
+ */
+int cmp_router_get_match(const cmp_router_t *router,
+                         const cmp_route_match_t **out_match);
+
+/**
+ * @brief Look up a parameter by name
+ * @param out_value Receives the value slice (not NUL-terminated)
+ * @return CMP_ERROR_NOT_FOUND if the route has no such parameter
+ */
+int cmp_route_match_get_param(const cmp_route_match_t *match,
+                              const char *name, const char **out_value,
+                              size_t *out_len);
+
 /**
  * @brief Register an OS-level URI scheme (e.g. myapp://)
  * @param scheme The custom scheme (e.g. "myapp")
@@ -3211,6 +4355,15 @@ int cmp_layout_node_destroy(cmp_layout_node_t *node);
 int cmp_layout_node_add_child(cmp_layout_node_t *parent,
                               cmp_layout_node_t *child);
 
+/**
+ * @brief Detach a child from a layout node (the child is not destroyed)
+ * @param parent Parent node
+ * @param child Child node
+ * @return 0 on success, CMP_ERROR_NOT_FOUND if child is not a child of parent.
+ */
+int cmp_layout_node_remove_child(cmp_layout_node_t *parent,
+                                 cmp_layout_node_t *child);
+
 /**
  * @brief Execute the Measure & Layout pass on a tree
  * @param root The root node of the tree
@@ -3426,6 +4579,14 @@ int cmp_ui_rich_text_create(cmp_ui_node_t **out_node);
  */
 int cmp_ui_node_add_child(cmp_ui_node_t *parent, cmp_ui_node_t *child);
 
+/**
+ * @brief Detach a UI child (and its layout node) without destroying it
+ * @param parent Parent node
+ * @param child Child node
+ * @return 0 on success, CMP_ERROR_NOT_FOUND if child is not a child of parent.
+ */
+int cmp_ui_node_remove_child(cmp_ui_node_t *parent, cmp_ui_node_t *child);
+
 /**
  * @brief Destroy a UI node and its children
  * @param node Node to destroy
@@ -3489,6 +4650,7 @@ struct cmp_texture {
   int width;
   int height;
   int format;
+  unsigned char *pixels; /* System-memory copy, NULL for GPU-only textures */
 };
 
 /**
@@ -3919,7 +5081,8 @@ typedef struct cmp_msaa cmp_msaa_t;
 
 /**
  * @brief Initialize an MSAA render target
- * @param sample_count Number of samples (e.g., 2, 4, 8, 16)
+ * @param sample_count Number of samples (e.g., 2, 4, 8, 16); rounded down to a
+ * power of two, at most 16. Used by CMP_MSAA_MODE_SPARSE.
  * @param width Width of the render target
  * @param height Height of the render target
  * @param out_msaa Pointer to receive the MSAA context
@@ -3943,6 +5106,97 @@ int cmp_msaa_destroy(cmp_msaa_t *msaa);
  */
 int cmp_msaa_resolve(cmp_msaa_t *msaa, cmp_texture_t *target_texture);
 
+/**
+ * @brief Texture format whose pixels field holds width * height tightly
+ * packed premultiplied RGBA8 pixels. cmp_msaa_resolve writes into such
+ * textures; other formats are left to the GPU backend. The value is kept
+ * clear of the cmp_tex_compression_t values stored in the same field.
+ */
+#define CMP_TEXTURE_FORMAT_RGBA8_PREMULTIPLIED 0x100
+
+/**
+ * @brief Edge anti-aliasing strategy used by the fill functions
+ */
+typedef enum cmp_msaa_mode {
+  CMP_MSAA_MODE_NONE = 0,     /**< One sample at the pixel centre (aliased) */
+  CMP_MSAA_MODE_ANALYTIC = 1, /**< Exact per-pixel area coverage (default) */
+  CMP_MSAA_MODE_SPARSE = 2    /**< sample_count samples, stored for edge
+                                   pixels only */
+} cmp_msaa_mode_t;
+
+/**
+ * @brief Rasterization counters, useful to compare modes
+ */
+typedef struct cmp_msaa_stats {
+  size_t pixels_filled;  /**< Pixel writes performed by fills */
+  size_t edge_pixels;    /**< Pixels holding individual samples */
+  size_t stored_samples; /**< edge_pixels * sample_count */
+} cmp_msaa_stats_t;
+
+/**
+ * @brief Select the anti-aliasing mode for subsequent fills
+ * @param msaa The MSAA context
+ * @param mode The mode
+ * @return 0 on success, or an error code.
+ */
+int cmp_msaa_set_mode(cmp_msaa_t *msaa, cmp_msaa_mode_t mode);
+
+/**
+ * @brief Fill the whole target with a color and drop all stored samples
+ * @param msaa The MSAA context
+ * @param color The clear color (straight alpha)
+ * @return 0 on success, or an error code.
+ */
+int cmp_msaa_clear(cmp_msaa_t *msaa, const cmp_color_t *color);
+
+/**
+ * @brief Fill a polygonal path (source-over)
+ * @param msaa The MSAA context
+ * @param points Flattened contours as x,y pairs in pixels
+ * @param contour_counts Number of points in each contour; contours are
+ * implicitly closed
+ * @param contour_count Number of contours
+ * @param fill_rule 0 = nonzero, 1 = even-odd (matches cmp_svg_fill_rule_t)
+ * @param color The fill color (straight alpha)
+ * @return 0 on success, or an error code.
+ */
+int cmp_msaa_fill_path(cmp_msaa_t *msaa, const float *points,
+                       const size_t *contour_counts, size_t contour_count,
+                       int fill_rule, const cmp_color_t *color);
+
+/**
+ * @brief Fill a rounded rectangle (source-over)
+ * @param msaa The MSAA context
+ * @param x Left edge in pixels
+ * @param y Top edge in pixels
+ * @param width Rectangle width
+ * @param height Rectangle height
+ * @param radius Corner radius, clamped to half the shorter side
+ * @param color The fill color (straight alpha)
+ * @return 0 on success, or an error code.
+ */
+int cmp_msaa_fill_rounded_rect(cmp_msaa_t *msaa, float x, float y, float width,
+                               float height, float radius,
+                               const cmp_color_t *color);
+
+/**
+ * @brief Resolve into caller memory as premultiplied RGBA8
+ * @param msaa The MSAA context
+ * @param pixels Destination, width * height pixels
+ * @param stride Bytes per destination row
+ * @return 0 on success, or an error code.
+ */
+int cmp_msaa_resolve_to_buffer(cmp_msaa_t *msaa, unsigned char *pixels,
+                               size_t stride);
+
+/**
+ * @brief Read the rasterization counters
+ * @param msaa The MSAA context
+ * @param out_stats Receives the counters
+ * @return 0 on success, or an error code.
+ */
+int cmp_msaa_get_stats(const cmp_msaa_t *msaa, cmp_msaa_stats_t *out_stats);
+
 /**
  * @brief Opaque Linear sRGB Blending Context
  */
@@ -6940,46 +8194,170 @@ int cmp_print_ctx_end_page(cmp_print_ctx_t *ctx);
 
 /**
  * @brief Save printed content to a PDF file.
+ * Writes the fonts, page tree, cross-reference table and trailer. When the
+ * document was started with cmp_print_ctx_begin_document, file_path must
+ * name the same file; otherwise the buffered document is written to it.
+ * The context is empty again afterwards; registered fonts stay valid.
  */
 int cmp_print_ctx_save_pdf(cmp_print_ctx_t *ctx, const char *file_path);
 
 /**
- * @brief Network Status API
+ * @brief Print document statistics.
  */
-typedef enum {
-  CMP_NETWORK_STATUS_OFFLINE,
-  CMP_NETWORK_STATUS_ONLINE,
-  CMP_NETWORK_STATUS_METERED
-} cmp_network_status_t;
-
-#ifndef CMP_NETWORK_T_DEFINED
-#define CMP_NETWORK_T_DEFINED
-typedef struct cmp_network cmp_network_t;
-#endif
+typedef struct cmp_print_stats {
+  size_t pages;               /**< Pages finished in the current document */
+  size_t objects;             /**< Indirect objects allocated so far */
+  size_t images_written;      /**< Distinct image XObjects */
+  size_t images_deduplicated; /**< Image draws that reused an XObject */
+  size_t bytes_written;       /**< PDF bytes emitted so far */
+} cmp_print_stats_t;
 
 /**
- * @brief Create a new network context.
+ * @brief Start a document that streams to a file as pages are finished.
+ * Each page's objects are written at cmp_print_ctx_end_page, so memory use
+ * does not grow with the page count. Without this call the document is
+ * buffered in memory until cmp_print_ctx_save_pdf.
+ * @param ctx The print context.
+ * @param file_path Virtual path of the PDF to create.
+ * @return 0 on success, or an error code.
  */
-int cmp_network_create(cmp_network_t **out_network);
+int cmp_print_ctx_begin_document(cmp_print_ctx_t *ctx, const char *file_path);
 
 /**
- * @brief Destroy a network context.
+ * @brief Set the size of pages begun from now on, in points (1/72 inch).
+ * The default is A4 (595 x 842).
  */
-int cmp_network_destroy(cmp_network_t *network);
+int cmp_print_ctx_set_page_size(cmp_print_ctx_t *ctx, float width,
+                                float height);
 
 /**
- * @brief Get the current network status.
+ * @brief Register a TrueType (glyf) font for cmp_print_ctx_draw_text.
+ * The data is copied. Only glyphs that are drawn are embedded.
+ * @param ctx The print context.
+ * @param ttf_data The font file.
+ * @param ttf_size Size of the font file in bytes.
+ * @param out_font_id Receives the font id.
+ * @return 0 on success, or an error code.
  */
-int cmp_network_get_status(const cmp_network_t *network,
-                           cmp_network_status_t *out_status);
+int cmp_print_ctx_add_font(cmp_print_ctx_t *ctx, const void *ttf_data,
+                           size_t ttf_size, int *out_font_id);
 
 /**
- * @brief Set the network status (internal/mock).
+ * @brief Fill a rectangle on the current page.
+ * Coordinates are in points with the origin at the top-left of the page.
  */
-int cmp_network_set_status(cmp_network_t *network, cmp_network_status_t status);
+int cmp_print_ctx_fill_rect(cmp_print_ctx_t *ctx, float x, float y,
+                            float width, float height,
+                            const cmp_color_t *color);
 
 /**
- * @brief I18n API
+ * @brief Fill a polygonal path on the current page.
+ * @param ctx The print context.
+ * @param points Flattened contours as x,y pairs in points
+ * @param contour_counts Number of points in each contour; contours are
+ * implicitly closed
+ * @param contour_count Number of contours
+ * @param fill_rule 0 = nonzero, 1 = even-odd (matches cmp_svg_fill_rule_t)
+ * @param color The fill color (straight alpha)
+ * @return 0 on success, or an error code.
+ */
+int cmp_print_ctx_fill_path(cmp_print_ctx_t *ctx, const float *points,
+                            const size_t *contour_counts,
+                            size_t contour_count, int fill_rule,
+                            const cmp_color_t *color);
+
+/**
+ * @brief Stroke a polyline on the current page.
+ * @param ctx The print context.
+ * @param points Vertices as x,y pairs in points
+ * @param point_count Number of vertices (at least 2)
+ * @param closed Non-zero to close the polyline
+ * @param line_width Stroke width in points
+ * @param color The stroke color (straight alpha)
+ * @return 0 on success, or an error code.
+ */
+int cmp_print_ctx_stroke_path(cmp_print_ctx_t *ctx, const float *points,
+                              size_t point_count, int closed,
+                              float line_width, const cmp_color_t *color);
+
+/**
+ * @brief Draw a line of UTF-8 text on the current page.
+ * Characters the font does not map are drawn as glyph 0.
+ * @param ctx The print context.
+ * @param font_id A font from cmp_print_ctx_add_font.
+ * @param size Font size in points.
+ * @param x Left edge of the text.
+ * @param baseline_y Baseline position (top-left origin).
+ * @param utf8 The text.
+ * @param color The text color (straight alpha)
+ * @return 0 on success, or an error code.
+ */
+int cmp_print_ctx_draw_text(cmp_print_ctx_t *ctx, int font_id, float size,
+                            float x, float baseline_y, const char *utf8,
+                            const cmp_color_t *color);
+
+/**
+ * @brief Draw an RGBA8 (straight alpha) image into a rectangle.
+ * Identical pixel data drawn again anywhere in the document reuses the
+ * image object written the first time.
+ * @param ctx The print context.
+ * @param rgba Pixel data.
+ * @param width Image width in pixels.
+ * @param height Image height in pixels.
+ * @param stride Bytes per row.
+ * @param x Left edge of the destination, in points.
+ * @param y Top edge of the destination, in points.
+ * @param dest_width Destination width in points.
+ * @param dest_height Destination height in points.
+ * @return 0 on success, or an error code.
+ */
+int cmp_print_ctx_draw_image(cmp_print_ctx_t *ctx, const unsigned char *rgba,
+                             int width, int height, size_t stride, float x,
+                             float y, float dest_width, float dest_height);
+
+/**
+ * @brief Read document statistics.
+ */
+int cmp_print_ctx_get_stats(const cmp_print_ctx_t *ctx,
+                            cmp_print_stats_t *out_stats);
+
+/**
+ * @brief Network Status API
+ */
+typedef enum {
+  CMP_NETWORK_STATUS_OFFLINE,
+  CMP_NETWORK_STATUS_ONLINE,
+  CMP_NETWORK_STATUS_METERED
+} cmp_network_status_t;
+
+#ifndef CMP_NETWORK_T_DEFINED
+#define CMP_NETWORK_T_DEFINED
+typedef struct cmp_network cmp_network_t;
+#endif
+
+/**
+ * @brief Create a new network context.
+ */
+int cmp_network_create(cmp_network_t **out_network);
+
+/**
+ * @brief Destroy a network context.
+ */
+int cmp_network_destroy(cmp_network_t *network);
+
+/**
+ * @brief Get the current network status.
+ */
+int cmp_network_get_status(const cmp_network_t *network,
+                           cmp_network_status_t *out_status);
+
+/**
+ * @brief Set the network status (internal/mock).
+ */
+int cmp_network_set_status(cmp_network_t *network, cmp_network_status_t status);
+
+/**
+ * @brief I18n API
  */
 #ifndef CMP_I18N_T_DEFINED
 #define CMP_I18N_T_DEFINED
@@ -6998,16 +8376,47 @@ int cmp_i18n_destroy(cmp_i18n_t *i18n);
 
 /**
  * @brief Add a localized string.
+ * The first value added for a (locale, key) pair is kept.
  */
 int cmp_i18n_add_string(cmp_i18n_t *i18n, const char *locale, const char *key,
                         const char *value);
 
 /**
  * @brief Get a localized string.
+ * @param out_value Receives a copy the caller frees with CMP_FREE.
  */
 int cmp_i18n_get_string(const cmp_i18n_t *i18n, const char *locale,
                         const char *key, char **out_value);
 
+/**
+ * @brief Find a localized string without copying it.
+ * Strings added at runtime are searched first, then compiled catalogs from
+ * the most recently loaded. The lookup is a single hash probe and does not
+ * allocate.
+ * @param out_value Receives a NUL-terminated view owned by the context,
+ * valid until it is destroyed.
+ * @param out_len Optional; receives the length in bytes.
+ * @return 0 on success, CMP_ERROR_NOT_FOUND if no catalog has the key.
+ */
+int cmp_i18n_lookup(const cmp_i18n_t *i18n, const char *locale,
+                    const char *key, const char **out_value,
+                    size_t *out_len);
+
+/**
+ * @brief Write the context's runtime strings as a compiled catalog.
+ * The catalog holds a prebuilt hash index so loading it needs no parsing.
+ * @return 0 on success, or an error code.
+ */
+int cmp_i18n_save_catalog(const cmp_i18n_t *i18n, const char *virtual_path);
+
+/**
+ * @brief Map a compiled catalog from the VFS and add it to the context.
+ * The file is validated once and then used in place.
+ * @return 0 on success, CMP_ERROR_INVALID_ARG for a malformed catalog, or
+ * another error code.
+ */
+int cmp_i18n_load_compiled(cmp_i18n_t *i18n, const char *virtual_path);
+
 /**
  * @brief Content Security Policy (CSP) API
  */
@@ -8467,10 +9876,26 @@ int cmp_text_field_set_input_accessory_view(cmp_text_field_t *field,
 int cmp_text_field_insert_text(cmp_text_field_t *field, const char *text);
 
 /**
- * @brief Delete one UTF-8 character before the caret.
+ * @brief Delete the grapheme cluster before the caret.
  */
 int cmp_text_field_delete_backward(cmp_text_field_t *field);
 
+/**
+ * @brief Caret movements, in logical (storage) order.
+ */
+typedef enum cmp_text_field_move {
+  CMP_TEXT_FIELD_MOVE_BACKWARD = 0, /* One grapheme cluster */
+  CMP_TEXT_FIELD_MOVE_FORWARD,
+  CMP_TEXT_FIELD_MOVE_WORD_BACKWARD, /* To the start of the previous word */
+  CMP_TEXT_FIELD_MOVE_WORD_FORWARD   /* To the end of the next word */
+} cmp_text_field_move_t;
+
+/**
+ * @brief Move the caret by a grapheme cluster or a word.
+ */
+int cmp_text_field_move_caret(cmp_text_field_t *field,
+                              cmp_text_field_move_t move);
+
 /**
  * @brief Set the caret position (byte offset).
  */
@@ -8488,12 +9913,53 @@ int cmp_text_field_get_caret_position(const cmp_text_field_t *field,
 int cmp_text_field_get_text(const cmp_text_field_t *field,
                             const char **out_text);
 
+/**
+ * @brief Get the text buffer backing a field (owned by the field).
+ *
+ * Edits made directly on the buffer must keep the caret in range via
+ * cmp_text_field_set_caret_position.
+ */
+int cmp_text_field_get_buffer(cmp_text_field_t *field,
+                              cmp_text_buffer_t **out_buffer);
+
 /**
  * @brief Handle a keyboard or pointer event for text editing.
  */
 int cmp_text_field_handle_event(cmp_text_field_t *field,
                                 const cmp_event_t *event);
 
+/**
+ * @brief Check spelling as the text is edited.
+ *
+ * Each edit rechecks only the paragraphs it touched. With workers the
+ * check runs there and the results are queued back to ui, so typing never
+ * waits for it; results for a paragraph edited again meanwhile are
+ * dropped. A field destroyed with checks in flight is released by ui.
+ * @param checker NULL to stop checking. Must outlive the field.
+ * @param workers A CMP_MODALITY_THREADED modality, or NULL to check on the
+ * calling thread.
+ * @param ui The modality the field is used from; required with workers.
+ */
+int cmp_text_field_set_spellchecker(cmp_text_field_t *field,
+                                    cmp_spellcheck_t *checker,
+                                    cmp_modality_t *workers,
+                                    cmp_modality_t *ui);
+
+/**
+ * @brief Recheck the whole text (after direct buffer edits or dictionary
+ * changes).
+ */
+int cmp_text_field_recheck_spelling(cmp_text_field_t *field);
+
+/**
+ * @brief Get the misspelled ranges found so far, sorted by offset.
+ * @param out_ranges Owned by the field; valid until its next edit or
+ * delivered check.
+ */
+int cmp_text_field_get_misspellings(const cmp_text_field_t *field,
+                                    const cmp_spell_range_t **out_ranges,
+                                    size_t *out_count);
+
 /**
  * @brief Data Detector Types (for Rich Text Views)
  */
@@ -8607,6 +10073,134 @@ int cmp_list_resolve_metrics(cmp_list_t *list, float *out_margin_horizontal,
                              float *out_corner_radius,
                              float *out_content_offset_x);
 
+/**
+ * @brief Opaque virtualized list/grid. Only rows inside the viewport plus
+ * overscan own cell nodes; cells scrolled out are pooled by cell type and
+ * rebound to the rows scrolled in.
+ */
+typedef struct cmp_virtual_list cmp_virtual_list_t;
+
+/**
+ * @brief Data source for a virtualized list
+ */
+typedef struct cmp_virtual_list_source {
+  /** Number of items */
+  size_t (*count)(void *user_data);
+  /** Creates an unbound cell node of the given type */
+  int (*create_cell)(void *user_data, int cell_type, cmp_ui_node_t **out_cell);
+  /**
+   * Fills a cell with the item's content. io_height holds the current row
+   * height on entry and may be set to the measured height.
+   */
+  int (*bind_cell)(void *user_data, cmp_ui_node_t *cell, size_t index,
+                   float *io_height);
+  /** Optional: cell type of an item (all items are type 0 when NULL) */
+  int (*cell_type)(void *user_data, size_t index);
+  /**
+   * Optional: releases what create_cell or bind_cell attached to a cell.
+   * Called just before the list destroys the cell node.
+   */
+  void (*destroy_cell)(void *user_data, cmp_ui_node_t *cell);
+  /** Height assumed for rows that have not been bound yet */
+  float estimated_height;
+  void *user_data;
+} cmp_virtual_list_source_t;
+
+/**
+ * @brief Create a virtualized list that places its cells in container
+ * (e.g. a node from cmp_ui_list_view_create). The container stays owned by
+ * the caller.
+ * @param columns 1 for a list, more for a grid of equal-width columns
+ */
+int cmp_virtual_list_create(cmp_virtual_list_t **out_list,
+                            cmp_ui_node_t *container,
+                            const cmp_virtual_list_source_t *source,
+                            size_t columns);
+
+/**
+ * @brief Destroy the list and every cell it created
+ */
+int cmp_virtual_list_destroy(cmp_virtual_list_t *list);
+
+/**
+ * @brief Resize the viewport and rebind the visible rows
+ */
+int cmp_virtual_list_set_viewport(cmp_virtual_list_t *list, float width,
+                                  float height);
+
+/**
+ * @brief Number of rows kept bound above and below the viewport (default 2)
+ */
+int cmp_virtual_list_set_overscan(cmp_virtual_list_t *list, size_t rows);
+
+/**
+ * @brief Scroll so that content offset is at the top of the viewport
+ */
+int cmp_virtual_list_scroll_to(cmp_virtual_list_t *list, double offset);
+
+/**
+ * @brief Scroll so that the item's row is at the top of the viewport
+ */
+int cmp_virtual_list_scroll_to_item(cmp_virtual_list_t *list, size_t index);
+
+/**
+ * @brief Current scroll offset. Re-anchored when rows above the viewport
+ * change their measured height.
+ */
+int cmp_virtual_list_get_scroll_offset(const cmp_virtual_list_t *list,
+                                       double *out_offset);
+
+/**
+ * @brief Re-query the item count and rebind all visible cells. Measured
+ * heights are discarded.
+ */
+int cmp_virtual_list_reload(cmp_virtual_list_t *list);
+
+/**
+ * @brief Rebind one item if it is visible
+ */
+int cmp_virtual_list_reload_item(cmp_virtual_list_t *list, size_t index);
+
+/**
+ * @brief Replace items [index, index + removed) with inserted new ones.
+ * Cells of the other visible items keep their nodes and the top visible
+ * item stays in place. Costs O(visible) unless rows have measured heights.
+ * The data source's count must already include the change.
+ */
+int cmp_virtual_list_splice(cmp_virtual_list_t *list, size_t index,
+                            size_t removed, size_t inserted);
+
+/**
+ * @brief Content offset of the top of the item's row, O(log n)
+ */
+int cmp_virtual_list_get_item_offset(const cmp_virtual_list_t *list,
+                                     size_t index, double *out_offset);
+
+/**
+ * @brief First item of the row containing a content offset, O(log n)
+ */
+int cmp_virtual_list_get_item_at(const cmp_virtual_list_t *list,
+                                 double offset, size_t *out_index);
+
+/**
+ * @brief Total content height using measured and estimated row heights
+ */
+int cmp_virtual_list_get_content_height(const cmp_virtual_list_t *list,
+                                        double *out_height);
+
+/**
+ * @brief Range of items that currently have bound cells
+ */
+int cmp_virtual_list_get_visible_range(const cmp_virtual_list_t *list,
+                                       size_t *out_first, size_t *out_count);
+
+/**
+ * @brief Bound cell of a visible item
+ * @return CMP_ERROR_NOT_FOUND if the item is outside the bound range
+ */
+int cmp_virtual_list_get_cell(const cmp_virtual_list_t *list, size_t index,
+                              cmp_ui_node_t **out_cell);
+
 /* Phase 7.2: Scroll Views (Apple HIG specific) */
 
 /**
@@ -8782,15 +10376,111 @@ int cmp_diffable_datasource_create(cmp_diffable_datasource_t **out_ds);
 int cmp_diffable_datasource_destroy(cmp_diffable_datasource_t *ds);
 
 /**
- * @brief Apply a new state snapshot to the Diffable Data Source
- * In reality, this calculates insertions, deletions, and moves based on hash
- * hashes.
+ * @brief Index used in diff results for "no counterpart"
+ */
+#define CMP_DIFF_NONE ((size_t)-1)
+
+/**
+ * @brief Kinds of change in an identifier diff
+ */
+typedef enum cmp_diff_op {
+  CMP_DIFF_DELETE = 0, /* Old item at from is gone */
+  CMP_DIFF_INSERT,     /* New item at to has no old counterpart */
+  CMP_DIFF_MOVE,       /* Old item at from is now at to */
+  CMP_DIFF_RELOAD      /* Item at to kept its identity but changed content */
+} cmp_diff_op_t;
+
+/**
+ * @brief One change in an edit script
+ */
+typedef struct cmp_diff_change {
+  cmp_diff_op_t op;
+  size_t from; /* Old index, CMP_DIFF_NONE for inserts */
+  size_t to;   /* New index, CMP_DIFF_NONE for deletes */
+  uint64_t id;
+} cmp_diff_change_t;
+
+/**
+ * @brief Edit script between two identifier snapshots.
+ * Changes are batched in application order: deletes by descending old
+ * index, inserts by ascending new index, then moves and reloads. Items
+ * matched without a move kept their relative order.
+ */
+typedef struct cmp_diff_result {
+  cmp_diff_change_t *changes;
+  size_t change_count;
+  size_t delete_count;
+  size_t insert_count;
+  size_t move_count;
+  size_t reload_count;
+  size_t *old_to_new; /* New index of each old item, or CMP_DIFF_NONE */
+  size_t old_count;
+  size_t *new_to_old; /* Old index of each new item, or CMP_DIFF_NONE */
+  size_t new_count;
+} cmp_diff_result_t;
+
+/**
+ * @brief Diff two identifier snapshots in O(N) expected time (Heckel's
+ * algorithm) plus O(M log M) for M out-of-order items to pick moves.
+ * Identifiers should be unique; repeated identifiers only match where they
+ * neighbour a matched item and are otherwise deleted and inserted.
+ * @param out_result Release with cmp_diff_result_free
+ */
+int cmp_diff_identifiers(const uint64_t *old_items, size_t old_count,
+                         const uint64_t *new_items, size_t new_count,
+                         cmp_diff_result_t *out_result);
+
+/**
+ * @brief Release the arrays of a diff result
+ */
+int cmp_diff_result_free(cmp_diff_result_t *result);
+
+/**
+ * @brief Receives each batch of changes the data source produces
+ */
+typedef int (*cmp_diffable_update_cb_t)(const cmp_diff_result_t *diff,
+                                        void *user_data);
+
+/**
+ * @brief Apply a new state snapshot to the Diffable Data Source.
+ * When an update handler is set, the diff against the previous snapshot is
+ * passed to it (unless empty) and its result is returned.
  * @param items Array of arbitrary 64-bit identifier hashes representing the new
  * state
  */
 int cmp_diffable_datasource_apply_snapshot(cmp_diffable_datasource_t *ds,
                                            const uint64_t *items, size_t count);
 
+/**
+ * @brief Set the handler that applies change batches (e.g. a list engine)
+ */
+int cmp_diffable_datasource_set_update_handler(
+    cmp_diffable_datasource_t *ds, cmp_diffable_update_cb_t handler,
+    void *user_data);
+
+/**
+ * @brief Emit a reload batch for items whose content changed in place
+ * @return CMP_ERROR_NOT_FOUND if an identifier is not in the snapshot
+ */
+int cmp_diffable_datasource_reload_items(cmp_diffable_datasource_t *ds,
+                                         const uint64_t *items, size_t count);
+
+/**
+ * @brief Current snapshot (owned by the data source)
+ */
+int cmp_diffable_datasource_get_snapshot(const cmp_diffable_datasource_t *ds,
+                                         const uint64_t **out_items,
+                                         size_t *out_count);
+
+/**
+ * @brief Apply a change batch to a virtualized list: cells of surviving
+ * visible items keep their nodes (rebound only for reloads), deleted cells
+ * are recycled and measured heights follow their items.
+ * The data source's count must already return diff->new_count.
+ */
+int cmp_virtual_list_apply_diff(cmp_virtual_list_t *list,
+                                const cmp_diff_result_t *diff);
+
 /**
  * @brief System UI Views
  * Mounts OS-native abstractions seamlessly into the layout tree
@@ -8799,150 +10489,594 @@ int cmp_system_map_view_mount(cmp_ui_node_t *node, float latitude,
                               float longitude);
 int cmp_system_web_view_mount(cmp_ui_node_t *node, const char *url);
 
-/* Phase 8.1: Touch & Multi-Touch Gestures (Apple HIG specific) */
+/* Reactive ORM observables */
 
 /**
- * @brief Gesture Disambiguation Conflict Resolution
- * When two gesture recognizers recognize simultaneously, decide which one
- * fails. E.g., fail a pan-horizontal if a pan-vertical is already tracking.
+ * @brief A steady stream of writes delays a re-query by at most this many
+ * debounce intervals
  */
-int cmp_gesture_require_failure(cmp_gesture_t *primary_gesture,
-                                cmp_gesture_t *other_gesture_to_fail);
+#define CMP_ORM_DEBOUNCE_MAX_INTERVALS 4
 
 /**
- * @brief Configure pinch-to-zoom bounds
+ * @brief Result rows of an observable: an identifier and an opaque payload
+ * per row. Rows are matched across results by identifier and compared by a
+ * hash of their payload.
  */
-int cmp_complex_gesture_set_zoom_limits(cmp_complex_gesture_t *gesture,
-                                        float min_scale, float max_scale);
+typedef struct cmp_orm_rows cmp_orm_rows_t;
 
 /**
- * @brief Retrieve pinch-to-zoom centroid and scaled value
- * @param out_centroid_x Output center X between fingers
- * @param out_centroid_y Output center Y between fingers
- * @param out_scale The calculated scale multiplier, incorporating
- * rubber-banding if past limits
+ * @brief Runs an observable's query into rows. Called on a worker thread
+ * when the observable has workers, so it must only use the connection.
+ * @return 0 on success; on failure the previous rows are kept.
  */
-int cmp_complex_gesture_get_zoom(const cmp_complex_gesture_t *gesture,
-                                 float *out_centroid_x, float *out_centroid_y,
-                                 float *out_scale);
+typedef int (*cmp_orm_fetch_cb_t)(c_orm_db_t *db, const char *query,
+                                  cmp_orm_rows_t *rows, void *user_data);
 
 /**
- * @brief Configure rotation snapping (e.g. snapping to 0, 90, 180 degrees)
+ * @brief Receives the row diff of each result that differs from the one
+ * before: inserts, deletes and moves by identifier, plus reloads for kept
+ * rows whose payload changed. Must not destroy observables.
  */
-int cmp_complex_gesture_set_rotation_snapping(cmp_complex_gesture_t *gesture,
-                                              int enable_snapping);
+typedef void (*cmp_orm_change_cb_t)(cmp_orm_observable_t *obs,
+                                    const cmp_diff_result_t *diff,
+                                    const cmp_orm_rows_t *rows,
+                                    void *user_data);
 
 /**
- * @brief Retrieve rotation angle
+ * @brief Marks a bound node's property for repaint
  */
-int cmp_complex_gesture_get_rotation(const cmp_complex_gesture_t *gesture,
-                                     float *out_radians);
+typedef void (*cmp_orm_invalidate_cb_t)(cmp_ui_node_t *node,
+                                        const char *property_name,
+                                        cmp_orm_observable_t *obs,
+                                        void *user_data);
 
 /**
- * @brief Screen Edge Swipe Back (Navigation Pop)
- * Hooks into the routing engine to tie pop progress to finger position
+ * @brief Append a row to a result being fetched.
+ * @param id Stable row identifier (e.g. the rowid), unique in the result
+ * @param data Payload copied into the result; may be NULL when size is 0
  */
-typedef struct cmp_edge_swipe cmp_edge_swipe_t;
-int cmp_edge_swipe_create(cmp_edge_swipe_t **out_swipe, cmp_router_t *router);
-int cmp_edge_swipe_destroy(cmp_edge_swipe_t *swipe);
-int cmp_edge_swipe_process(cmp_edge_swipe_t *swipe, float touch_x,
-                           float screen_width, cmp_gesture_state_t state);
+int cmp_orm_rows_append(cmp_orm_rows_t *rows, uint64_t id, const void *data,
+                        size_t size);
 
 /**
- * @brief Multi-Touch Override Safe-Guard
- * Cancels active UI gestures if system gestures (3, 4, 5 fingers) are detected.
+ * @brief Number of rows in a result
  */
-int cmp_gesture_cancel_on_system_override(cmp_gesture_t *gesture,
-                                          int active_touches_count);
-
-/* Phase 8.2: Keyboard & Trackpad (Apple HIG specific) */
+int cmp_orm_rows_get_count(const cmp_orm_rows_t *rows, size_t *out_count);
 
 /**
- * @brief iPadOS Pointer Interaction Styles
+ * @brief Read one row; any output may be NULL
  */
-typedef enum cmp_pointer_interaction_style {
-  CMP_POINTER_INTERACTION_AUTOMATIC = 0,
-  CMP_POINTER_INTERACTION_LIFT, /* Pointer morphs into object, lifts it visually
-                                 */
-  CMP_POINTER_INTERACTION_HIGHLIGHT, /* Pointer shrinks, object background
-                                        highlights */
-  CMP_POINTER_INTERACTION_HOVER /* Pointer retains shape but scales up/down */
-} cmp_pointer_interaction_style_t;
+int cmp_orm_rows_get(const cmp_orm_rows_t *rows, size_t index,
+                     uint64_t *out_id, const void **out_data,
+                     size_t *out_size);
 
 /**
- * @brief Represents a system keyboard shortcut (e.g. Cmd-C, Shift-Tab)
+ * @brief Mark the observables of a table stale after a write that did not
+ * go through cmp_orm_execute (e.g. from a driver update hook).
+ * @param table Table name (case-insensitive), or NULL for every observable
+ * of the connection
  */
-typedef struct cmp_keyboard_shortcut cmp_keyboard_shortcut_t;
+int cmp_orm_notify_changed(c_orm_db_t *db, const char *table);
 
 /**
- * @brief Opaque UI Command (maps to UIMenu/UICommand/macOS menu bar)
+ * @brief Add a dependency the query text does not name, e.g. a table that
+ * a view or trigger reads.
  */
-typedef struct cmp_ui_command cmp_ui_command_t;
+int cmp_orm_observable_add_table(cmp_orm_observable_t *obs,
+                                 const char *table);
 
 /**
- * @brief Pointer Region Definition
+ * @brief Set the query runner; the first result loads on the next tick.
  */
-typedef struct cmp_pointer_region cmp_pointer_region_t;
-
-int cmp_pointer_region_create(cmp_pointer_region_t **out_region);
-int cmp_pointer_region_destroy(cmp_pointer_region_t *region);
-int cmp_pointer_region_set_style(cmp_pointer_region_t *region,
-                                 cmp_pointer_interaction_style_t style);
+int cmp_orm_observable_set_fetch(cmp_orm_observable_t *obs,
+                                 cmp_orm_fetch_cb_t fetch, void *user_data);
 
 /**
- * @brief Retrieve computed morphing scales based on interaction style
- * @param out_scale_x Populated with the scale factor for the pointer/element
+ * @brief Set the callback that receives each row diff (on ui).
  */
-int cmp_pointer_region_get_morph_scale(cmp_pointer_region_t *region,
-                                       float *out_scale_x, float *out_scale_y);
+int cmp_orm_observable_set_change_handler(cmp_orm_observable_t *obs,
+                                          cmp_orm_change_cb_t handler,
+                                          void *user_data);
 
 /**
- * @brief Create a Keyboard Shortcut definition
- * @param key The base character (e.g., 'c', 'v')
- * @param modifier_flags Bitmask of modifiers (e.g., Command | Shift)
+ * @brief Re-query only once no write has been seen for debounce_ms
+ * (default 0: on the tick that sees the write).
  */
-int cmp_keyboard_shortcut_create(cmp_keyboard_shortcut_t **out_shortcut,
-                                 char key, uint32_t modifier_flags);
-int cmp_keyboard_shortcut_destroy(cmp_keyboard_shortcut_t *shortcut);
+int cmp_orm_observable_set_debounce(cmp_orm_observable_t *obs,
+                                    double debounce_ms);
 
 /**
- * @brief Create a UI Command node
- * @param title The human-readable string displayed in the menu
- * @param action_id A unique string identifier routed through the event bus
+ * @brief Run re-queries on a worker pool
+ * @param workers A CMP_MODALITY_THREADED modality, or NULL to re-query on
+ * the ticking thread.
+ * @param ui The modality ticks run on; results are delivered there.
  */
-int cmp_ui_command_create(cmp_ui_command_t **out_command, const char *title,
-                          const char *action_id);
-int cmp_ui_command_destroy(cmp_ui_command_t *command);
+int cmp_orm_observable_set_workers(cmp_orm_observable_t *obs,
+                                   cmp_modality_t *workers,
+                                   cmp_modality_t *ui);
 
 /**
- * @brief Bind a shortcut to a UI Command
+ * @brief Current result (owned by the observable, replaced on change)
  */
-int cmp_ui_command_set_shortcut(cmp_ui_command_t *command,
-                                cmp_keyboard_shortcut_t *shortcut);
+int cmp_orm_observable_get_rows(const cmp_orm_observable_t *obs,
+                                const cmp_orm_rows_t **out_rows);
 
 /**
- * @brief Accelerating Key Repeat Logic
- * @param time_held_ms Milliseconds the key has been held down
- * @param out_repeat_interval_ms The calculated delay before firing the next
- * synthetic keypress event
+ * @brief Whether a re-query is in flight
  */
-int cmp_keyboard_calculate_key_repeat(float time_held_ms,
-                                      float *out_repeat_interval_ms);
+int cmp_orm_observable_is_refreshing(const cmp_orm_observable_t *obs,
+                                     int *out_refreshing);
 
 /**
- * @brief Trackpad Specific Gestures
- * Natively supports two-finger semantic intent translations
+ * @brief Per-frame step: start the re-queries whose debounce has elapsed
+ * (at most one in flight per observable) and invalidate, once each, the
+ * bindings of every observable whose result changed since the last tick.
+ * Writes between ticks are coalesced, so a bulk insert costs one re-query.
+ * @param now_ms Monotonic frame time
+ * @param invalidate Called per dirty binding; may be NULL
+ * @return 0, or the last error of a re-query run on this thread
  */
-int cmp_trackpad_evaluate_gesture(float delta_x, float delta_y,
-                                  float *out_pan_x, float *out_pan_y);
+int cmp_orm_tick(double now_ms, cmp_orm_invalidate_cb_t invalidate,
+                 void *user_data);
 
-/* Phase 8.3: Apple Pencil & Stylus (Apple HIG specific) */
+/* Columnar data grid */
 
 /**
- * @brief Stylus Hardware Interaction Events
+ * @brief Opaque column store with filter/sort state and a row view
  */
-typedef enum cmp_stylus_event_type {
-  CMP_STYLUS_EVENT_DOUBLE_TAP = 0, /* Pencil Gen 2 */
+typedef struct cmp_datagrid_model cmp_datagrid_model_t;
+
+/**
+ * @brief Opaque 2D virtualized presentation of a data grid model
+ */
+typedef struct cmp_datagrid_view cmp_datagrid_view_t;
+
+/**
+ * @brief Column storage types
+ */
+typedef enum cmp_column_type {
+  CMP_COLUMN_INT64 = 0,
+  CMP_COLUMN_DOUBLE,
+  CMP_COLUMN_STRING /* Dictionary encoded */
+} cmp_column_type_t;
+
+/**
+ * @brief Filter comparisons (strings support EQ and NE)
+ */
+typedef enum cmp_datagrid_filter_op {
+  CMP_DATAGRID_FILTER_EQ = 0,
+  CMP_DATAGRID_FILTER_NE,
+  CMP_DATAGRID_FILTER_LT,
+  CMP_DATAGRID_FILTER_LE,
+  CMP_DATAGRID_FILTER_GT,
+  CMP_DATAGRID_FILTER_GE
+} cmp_datagrid_filter_op_t;
+
+/**
+ * @brief One key of a multi-column sort
+ */
+typedef struct cmp_datagrid_sort_key {
+  size_t column;
+  int descending;
+} cmp_datagrid_sort_key_t;
+
+/**
+ * @brief Called on the ui modality when a refresh lands (or at once for a
+ * synchronous refresh)
+ */
+typedef void (*cmp_datagrid_refresh_cb_t)(cmp_datagrid_model_t *model,
+                                          int error, void *user_data);
+
+/**
+ * @brief Create an empty data grid model
+ */
+int cmp_datagrid_model_create(cmp_datagrid_model_t **out_model);
+
+/**
+ * @brief Destroy a model. With refreshes in flight the memory is released
+ * once the last one is delivered.
+ */
+int cmp_datagrid_model_destroy(cmp_datagrid_model_t *model);
+
+/**
+ * @brief Add a typed column
+ * @return CMP_ERROR_INVALID_STATE while a refresh is in flight
+ */
+int cmp_datagrid_model_add_column(cmp_datagrid_model_t *model,
+                                  const char *name, cmp_column_type_t type,
+                                  size_t *out_column);
+
+/**
+ * @brief Append values to a column. The model has as many rows as its
+ * shortest column.
+ * @return CMP_ERROR_INVALID_STATE while a refresh is in flight
+ */
+int cmp_datagrid_model_append_int64(cmp_datagrid_model_t *model,
+                                    size_t column, const int64_t *values,
+                                    size_t count);
+int cmp_datagrid_model_append_double(cmp_datagrid_model_t *model,
+                                     size_t column, const double *values,
+                                     size_t count);
+int cmp_datagrid_model_append_strings(cmp_datagrid_model_t *model,
+                                      size_t column,
+                                      const char *const *values,
+                                      size_t count);
+
+int cmp_datagrid_model_get_column_count(const cmp_datagrid_model_t *model,
+                                        size_t *out_count);
+int cmp_datagrid_model_get_column_name(const cmp_datagrid_model_t *model,
+                                       size_t column, const char **out_name);
+int cmp_datagrid_model_get_row_count(const cmp_datagrid_model_t *model,
+                                     size_t *out_rows);
+
+/**
+ * @brief Read a cell by model row (not view position)
+ */
+int cmp_datagrid_model_get_int64(const cmp_datagrid_model_t *model,
+                                 size_t column, size_t row,
+                                 int64_t *out_value);
+int cmp_datagrid_model_get_double(const cmp_datagrid_model_t *model,
+                                  size_t column, size_t row,
+                                  double *out_value);
+int cmp_datagrid_model_get_string(const cmp_datagrid_model_t *model,
+                                  size_t column, size_t row,
+                                  const char **out_value);
+
+/**
+ * @brief Format a cell as display text, truncated to capacity
+ */
+int cmp_datagrid_model_format_cell(const cmp_datagrid_model_t *model,
+                                   size_t column, size_t row, char *buffer,
+                                   size_t capacity);
+
+/**
+ * @brief Add a filter; rows must pass every filter. Takes effect on the
+ * next refresh.
+ */
+int cmp_datagrid_model_add_filter_int64(cmp_datagrid_model_t *model,
+                                        size_t column,
+                                        cmp_datagrid_filter_op_t op,
+                                        int64_t value);
+int cmp_datagrid_model_add_filter_double(cmp_datagrid_model_t *model,
+                                         size_t column,
+                                         cmp_datagrid_filter_op_t op,
+                                         double value);
+int cmp_datagrid_model_add_filter_string(cmp_datagrid_model_t *model,
+                                         size_t column,
+                                         cmp_datagrid_filter_op_t op,
+                                         const char *value);
+int cmp_datagrid_model_clear_filters(cmp_datagrid_model_t *model);
+
+/**
+ * @brief Set the sort keys, most significant first. The sort is stable:
+ * rows equal on every key keep their model order. Strings order by byte
+ * value. Takes effect on the next refresh.
+ */
+int cmp_datagrid_model_set_sort(cmp_datagrid_model_t *model,
+                                const cmp_datagrid_sort_key_t *keys,
+                                size_t count);
+
+/**
+ * @brief Run refreshes on a worker pool
+ * @param workers A CMP_MODALITY_THREADED modality, or NULL to refresh on the
+ * calling thread.
+ * @param ui The modality the model is used from; required with workers.
+ */
+int cmp_datagrid_model_set_workers(cmp_datagrid_model_t *model,
+                                   cmp_modality_t *workers,
+                                   cmp_modality_t *ui);
+
+/**
+ * @brief Recompute the row view from the filters and sort keys. With
+ * workers this returns at once and the view is swapped in on ui; a newer
+ * refresh supersedes older ones still in flight. Columns cannot change
+ * while a refresh is in flight.
+ * @param cb Optional completion callback
+ */
+int cmp_datagrid_model_refresh(cmp_datagrid_model_t *model,
+                               cmp_datagrid_refresh_cb_t cb, void *user_data);
+
+int cmp_datagrid_model_is_refreshing(const cmp_datagrid_model_t *model,
+                                     int *out_refreshing);
+
+/**
+ * @brief Model rows in display order
+ * @param out_rows NULL before the first refresh, meaning every row in order
+ */
+int cmp_datagrid_model_get_view(const cmp_datagrid_model_t *model,
+                                const uint32_t **out_rows,
+                                size_t *out_count);
+
+/**
+ * @brief Create a view that places one text node per visible cell in
+ * container (e.g. the rows container of a datagrid). Cells scrolled out of
+ * the window are recycled.
+ */
+int cmp_datagrid_view_create(cmp_datagrid_view_t **out_view,
+                             cmp_datagrid_model_t *model,
+                             cmp_ui_node_t *container, float row_height);
+
+/**
+ * @brief Destroy a view and its cells (the container is left alone)
+ */
+int cmp_datagrid_view_destroy(cmp_datagrid_view_t *view);
+
+/**
+ * @brief Set a column width (default 120)
+ */
+int cmp_datagrid_view_set_column_width(cmp_datagrid_view_t *view,
+                                       size_t column, float width);
+
+int cmp_datagrid_view_set_viewport(cmp_datagrid_view_t *view, float width,
+                                   float height);
+
+/**
+ * @brief Scroll the content offset to the top-left of the viewport
+ */
+int cmp_datagrid_view_scroll_to(cmp_datagrid_view_t *view, double x,
+                                double y);
+
+/**
+ * @brief Rebind every visible cell, e.g. after a refresh or appends
+ */
+int cmp_datagrid_view_sync(cmp_datagrid_view_t *view);
+
+/**
+ * @brief Window of view rows and columns that currently have cells
+ */
+int cmp_datagrid_view_get_window(const cmp_datagrid_view_t *view,
+                                 size_t *out_first_row, size_t *out_rows,
+                                 size_t *out_first_column,
+                                 size_t *out_columns);
+
+/**
+ * @brief Cell node at a view row and column
+ * @return CMP_ERROR_NOT_FOUND outside the window
+ */
+int cmp_datagrid_view_get_cell(const cmp_datagrid_view_t *view, size_t row,
+                               size_t column, cmp_ui_node_t **out_cell);
+
+int cmp_datagrid_view_get_content_size(const cmp_datagrid_view_t *view,
+                                       double *out_width, double *out_height);
+
+/* Lazy tree model */
+
+/**
+ * @brief Opaque tree flattened into rows. Expanding or collapsing a node
+ * costs O(depth * log children) whatever the size of its subtree, and
+ * children are only loaded when their parent is first expanded.
+ */
+typedef struct cmp_tree_model cmp_tree_model_t;
+
+/** Hidden root; top-level items are its children */
+#define CMP_TREE_ROOT ((size_t)0)
+#define CMP_TREE_NONE ((size_t)-1)
+
+/**
+ * @brief Asks for the children of a node that was expanded for the first
+ * time. Deliver them with cmp_tree_model_set_children, now or later (e.g.
+ * from a ui task once a background read finishes).
+ */
+typedef int (*cmp_tree_load_cb_t)(void *user_data, cmp_tree_model_t *model,
+                                  size_t node);
+
+/**
+ * @brief Rows [at, at + removed) were replaced by inserted rows.
+ * @param parent_row Row of the node whose children changed (its expanded
+ * or loading state changed too), CMP_TREE_NONE for the root
+ */
+typedef void (*cmp_tree_change_cb_t)(cmp_tree_model_t *model,
+                                     size_t parent_row, size_t at,
+                                     size_t removed, size_t inserted,
+                                     void *user_data);
+
+/**
+ * @brief Snapshot of one node
+ */
+typedef struct cmp_tree_node_info {
+  const char *label; /* Owned by the model */
+  size_t parent;
+  size_t depth; /* 0 for top-level items */
+  size_t first_child; /* Children are contiguous ids; CMP_TREE_NONE if none */
+  size_t child_count; /* Loaded children */
+  size_t visible_rows; /* The node's row plus the rows shown under it */
+  int has_children;
+  int is_expanded;
+  int is_loading;
+} cmp_tree_node_info_t;
+
+int cmp_tree_model_create(cmp_tree_model_t **out_model,
+                          cmp_tree_load_cb_t load, void *user_data);
+int cmp_tree_model_destroy(cmp_tree_model_t *model);
+
+/**
+ * @brief Register the callback that keeps a view in step with the rows
+ */
+int cmp_tree_model_set_change_handler(cmp_tree_model_t *model,
+                                      cmp_tree_change_cb_t on_change,
+                                      void *user_data);
+
+/**
+ * @brief Load the children of a node (CMP_TREE_ROOT for the top level).
+ * Each node is loaded once; the children get consecutive ids.
+ * @param has_children Optional; marks children that can be expanded
+ * @param out_first Optional; receives the id of the first child
+ * @return CMP_ERROR_INVALID_STATE if the node was already loaded
+ */
+int cmp_tree_model_set_children(cmp_tree_model_t *model, size_t parent,
+                                const char *const *labels,
+                                const int *has_children, size_t count,
+                                size_t *out_first);
+
+/**
+ * @brief Expand or collapse a node. The first expansion of a node that has
+ * children but none loaded calls the load callback.
+ */
+int cmp_tree_model_set_expanded(cmp_tree_model_t *model, size_t node,
+                                int is_expanded);
+
+/**
+ * @brief Number of rows: nodes whose ancestors are all expanded
+ */
+int cmp_tree_model_get_row_count(const cmp_tree_model_t *model,
+                                 size_t *out_count);
+
+int cmp_tree_model_get_node_at_row(const cmp_tree_model_t *model, size_t row,
+                                   size_t *out_node);
+
+/**
+ * @return CMP_ERROR_NOT_FOUND if an ancestor is collapsed
+ */
+int cmp_tree_model_get_row_of_node(const cmp_tree_model_t *model, size_t node,
+                                   size_t *out_row);
+
+int cmp_tree_model_get_info(const cmp_tree_model_t *model, size_t node,
+                            cmp_tree_node_info_t *out_info);
+
+/* Phase 8.1: Touch & Multi-Touch Gestures (Apple HIG specific) */
+
+/**
+ * @brief Gesture Disambiguation Conflict Resolution
+ * When two gesture recognizers recognize simultaneously, decide which one
+ * fails. E.g., fail a pan-horizontal if a pan-vertical is already tracking.
+ */
+int cmp_gesture_require_failure(cmp_gesture_t *primary_gesture,
+                                cmp_gesture_t *other_gesture_to_fail);
+
+/**
+ * @brief Configure pinch-to-zoom bounds
+ */
+int cmp_complex_gesture_set_zoom_limits(cmp_complex_gesture_t *gesture,
+                                        float min_scale, float max_scale);
+
+/**
+ * @brief Retrieve pinch-to-zoom centroid and scaled value
+ * @param out_centroid_x Output center X between fingers
+ * @param out_centroid_y Output center Y between fingers
+ * @param out_scale The calculated scale multiplier, incorporating
+ * rubber-banding if past limits
+ */
+int cmp_complex_gesture_get_zoom(const cmp_complex_gesture_t *gesture,
+                                 float *out_centroid_x, float *out_centroid_y,
+                                 float *out_scale);
+
+/**
+ * @brief Configure rotation snapping (e.g. snapping to 0, 90, 180 degrees)
+ */
+int cmp_complex_gesture_set_rotation_snapping(cmp_complex_gesture_t *gesture,
+                                              int enable_snapping);
+
+/**
+ * @brief Retrieve rotation angle
+ */
+int cmp_complex_gesture_get_rotation(const cmp_complex_gesture_t *gesture,
+                                     float *out_radians);
+
+/**
+ * @brief Screen Edge Swipe Back (Navigation Pop)
+ * Hooks into the routing engine to tie pop progress to finger position
+ */
+typedef struct cmp_edge_swipe cmp_edge_swipe_t;
+int cmp_edge_swipe_create(cmp_edge_swipe_t **out_swipe, cmp_router_t *router);
+int cmp_edge_swipe_destroy(cmp_edge_swipe_t *swipe);
+int cmp_edge_swipe_process(cmp_edge_swipe_t *swipe, float touch_x,
+                           float screen_width, cmp_gesture_state_t state);
+
+/**
+ * @brief Multi-Touch Override Safe-Guard
+ * Cancels active UI gestures if system gestures (3, 4, 5 fingers) are detected.
+ */
+int cmp_gesture_cancel_on_system_override(cmp_gesture_t *gesture,
+                                          int active_touches_count);
+
+/* Phase 8.2: Keyboard & Trackpad (Apple HIG specific) */
+
+/**
+ * @brief iPadOS Pointer Interaction Styles
+ */
+typedef enum cmp_pointer_interaction_style {
+  CMP_POINTER_INTERACTION_AUTOMATIC = 0,
+  CMP_POINTER_INTERACTION_LIFT, /* Pointer morphs into object, lifts it visually
+                                 */
+  CMP_POINTER_INTERACTION_HIGHLIGHT, /* Pointer shrinks, object background
+                                        highlights */
+  CMP_POINTER_INTERACTION_HOVER /* Pointer retains shape but scales up/down */
+} cmp_pointer_interaction_style_t;
+
+/**
+ * @brief Represents a system keyboard shortcut (e.g. Cmd-C, Shift-Tab)
+ */
+typedef struct cmp_keyboard_shortcut cmp_keyboard_shortcut_t;
+
+/**
+ * @brief Opaque UI Command (maps to UIMenu/UICommand/macOS menu bar)
+ */
+typedef struct cmp_ui_command cmp_ui_command_t;
+
+/**
+ * @brief Pointer Region Definition
+ */
+typedef struct cmp_pointer_region cmp_pointer_region_t;
+
+int cmp_pointer_region_create(cmp_pointer_region_t **out_region);
+int cmp_pointer_region_destroy(cmp_pointer_region_t *region);
+int cmp_pointer_region_set_style(cmp_pointer_region_t *region,
+                                 cmp_pointer_interaction_style_t style);
+
+/**
+ * @brief Retrieve computed morphing scales based on interaction style
+ * @param out_scale_x Populated with the scale factor for the pointer/element
+ */
+int cmp_pointer_region_get_morph_scale(cmp_pointer_region_t *region,
+                                       float *out_scale_x, float *out_scale_y);
+
+/**
+ * @brief Create a Keyboard Shortcut definition
+ * @param key The base character (e.g., 'c', 'v')
+ * @param modifier_flags Bitmask of modifiers (e.g., Command | Shift)
+ */
+int cmp_keyboard_shortcut_create(cmp_keyboard_shortcut_t **out_shortcut,
+                                 char key, uint32_t modifier_flags);
+int cmp_keyboard_shortcut_destroy(cmp_keyboard_shortcut_t *shortcut);
+
+/**
+ * @brief Create a UI Command node
+ * @param title The human-readable string displayed in the menu
+ * @param action_id A unique string identifier routed through the event bus
+ */
+int cmp_ui_command_create(cmp_ui_command_t **out_command, const char *title,
+                          const char *action_id);
+int cmp_ui_command_destroy(cmp_ui_command_t *command);
+
+/**
+ * @brief Bind a shortcut to a UI Command
+ */
+int cmp_ui_command_set_shortcut(cmp_ui_command_t *command,
+                                cmp_keyboard_shortcut_t *shortcut);
+
+/**
+ * @brief Accelerating Key Repeat Logic
+ * @param time_held_ms Milliseconds the key has been held down
+ * @param out_repeat_interval_ms The calculated delay before firing the next
+ * synthetic keypress event
+ */
+int cmp_keyboard_calculate_key_repeat(float time_held_ms,
+                                      float *out_repeat_interval_ms);
+
+/**
+ * @brief Trackpad Specific Gestures
+ * Natively supports two-finger semantic intent translations
+ */
+int cmp_trackpad_evaluate_gesture(float delta_x, float delta_y,
+                                  float *out_pan_x, float *out_pan_y);
+
+/* Phase 8.3: Apple Pencil & Stylus (Apple HIG specific) */
+
+/**
+ * @brief Stylus Hardware Interaction Events
+ */
+typedef enum cmp_stylus_event_type {
+  CMP_STYLUS_EVENT_DOUBLE_TAP = 0, /* Pencil Gen 2 */
   CMP_STYLUS_EVENT_SQUEEZE         /* Pencil Pro */
 } cmp_stylus_event_type_t;
 
@@ -10067,19 +12201,42 @@ int cmp_resources_mark_node_opaque(cmp_resource_manager_t *rm, void *node,
 
 /**
  * @brief Respects the OS "Low Data Mode" flag, preventing large downloads or
- * auto-playing videos
+ * auto-playing videos. HTTP caches follow it through cmp_http_cache_set_mode.
  */
 int cmp_resources_set_low_data_mode(cmp_resource_manager_t *rm,
                                     int is_low_data);
 
 /**
  * @brief Asynchronously decodes and aggressively caches remote images resized
- * to exact display geometry
+ * to exact display geometry.
+ *
+ * The image is fetched and decoded on the loader's workers, downscaled while
+ * it streams to fit target_width x target_height, and inserted into the CPU
+ * pool on the ui modality under the key (url, ceil(width), ceil(height),
+ * sRGB). The payload is a cmp_texture_t whose pixels field holds the RGBA8
+ * result. A resident or in-flight image is only marked recently used, and
+ * Low Data Mode skips http(s) sources.
+ *
+ * @return 0 if the image is cached, queued or skipped;
+ * CMP_ERROR_INVALID_STATE without a loader (or an HTTP client for http(s)
+ * URLs), or another error code.
  */
 int cmp_resources_cache_remote_image(cmp_resource_manager_t *rm,
                                      const char *url, float target_width,
                                      float target_height);
 
+/**
+ * @brief Set where cmp_resources_cache_remote_image fetches and decodes
+ * @param workers A CMP_MODALITY_THREADED modality, or NULL to disable
+ * @param ui The modality the manager is used from; decoded images are
+ * inserted there
+ * @param client HTTP client for http(s) URLs, or NULL to accept only VFS
+ * paths. Workers send on it one request at a time.
+ */
+int cmp_resources_set_image_loader(cmp_resource_manager_t *rm,
+                                   cmp_modality_t *workers, cmp_modality_t *ui,
+                                   struct HttpClient *client);
+
 /**
  * @brief Monitored drawRect equivalent that avoids allocating massive offscreen
  * bitmap contexts unless strictly necessary
@@ -10088,6 +12245,105 @@ int cmp_resources_allocate_offscreen_bitmap(cmp_resource_manager_t *rm,
                                             float width, float height,
                                             void **out_bitmap);
 
+/**
+ * @brief Releases a bitmap returned by cmp_resources_allocate_offscreen_bitmap
+ */
+int cmp_resources_release_offscreen_bitmap(cmp_resource_manager_t *rm,
+                                           void *bitmap);
+
+/**
+ * @brief Budget pools of the decoded resource cache
+ */
+typedef enum cmp_resource_pool {
+  CMP_RESOURCE_POOL_CPU = 0, /**< Decoded bitmaps in system memory */
+  CMP_RESOURCE_POOL_GPU = 1  /**< Uploaded textures */
+} cmp_resource_pool_t;
+
+/**
+ * @brief Identifies a decoded resource: the same source decoded for two
+ * different target sizes or color spaces is two entries
+ */
+typedef struct cmp_resource_key {
+  const char *source; /**< URL or virtual path; copied by the cache */
+  int width;
+  int height;
+  cmp_color_space_t color_space;
+} cmp_resource_key_t;
+
+/**
+ * @brief Called when the cache drops an entry, to free the payload
+ */
+typedef void (*cmp_resource_release_cb_t)(void *user_data, void *payload,
+                                          size_t bytes);
+
+/**
+ * @brief Cache counters for dashboards; budgets are the effective values
+ * after thermal, background and memory pressure scaling
+ */
+typedef struct cmp_resource_cache_stats {
+  size_t cpu_bytes;
+  size_t gpu_bytes;
+  size_t cpu_budget;
+  size_t gpu_budget;
+  size_t offscreen_bytes;
+  size_t entry_count;
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long insertions;
+  unsigned long evictions;
+  unsigned long rejections; /**< Inserts larger than the pool budget */
+  size_t pending_loads;     /**< Remote images being fetched or decoded */
+} cmp_resource_cache_stats_t;
+
+/**
+ * @brief Sets the nominal byte budget of a pool (before scaling)
+ */
+int cmp_resources_set_cache_budget(cmp_resource_manager_t *rm,
+                                   cmp_resource_pool_t pool, size_t bytes);
+
+/**
+ * @brief Responds to OS memory warnings (0=none, 1=warning, 2=critical);
+ * a warning halves both budgets, critical empties the cache
+ */
+int cmp_resources_set_memory_pressure(cmp_resource_manager_t *rm, int level);
+
+/**
+ * @brief Hands a decoded payload to the cache. On success the cache owns it
+ * and calls release when it is evicted, replaced or the manager is
+ * destroyed. An entry larger than the pool budget is refused with
+ * CMP_ERROR_OOM and stays owned by the caller.
+ */
+int cmp_resources_cache_insert(cmp_resource_manager_t *rm,
+                               cmp_resource_pool_t pool,
+                               const cmp_resource_key_t *key, void *payload,
+                               size_t bytes, cmp_resource_release_cb_t release,
+                               void *release_user_data);
+
+/**
+ * @brief Looks up a cached payload; returns CMP_ERROR_NOT_FOUND on a miss
+ */
+int cmp_resources_cache_lookup(cmp_resource_manager_t *rm,
+                               const cmp_resource_key_t *key,
+                               void **out_payload);
+
+/**
+ * @brief Drops a single entry, releasing its payload
+ */
+int cmp_resources_cache_remove(cmp_resource_manager_t *rm,
+                               const cmp_resource_key_t *key);
+
+/**
+ * @brief Evicts entries from a pool until it holds at most target_bytes
+ */
+int cmp_resources_cache_trim(cmp_resource_manager_t *rm,
+                             cmp_resource_pool_t pool, size_t target_bytes);
+
+/**
+ * @brief Reads the cache counters
+ */
+int cmp_resources_get_cache_stats(const cmp_resource_manager_t *rm,
+                                  cmp_resource_cache_stats_t *out_stats);
+
 /* Phase 16.1 & 16.2: Error Handling, Edge Cases & Resilience */
 
 /**
@@ -10562,11 +12818,15 @@ int cmp_command_palette_add_item(cmp_command_palette_t *palette, const char *id,
 
 /**
  * \brief Fuzzy search the registered items.
+ *
+ * Items are indexed when added. A query that extends the previous one only
+ * rescans the previous matches, and the best max_results hits are kept
+ * across the whole match set before sorting.
  * \param query The search string (e.g. "ctmain").
  * \param out_results An array of pointers to the matched items, sorted by
  * score.
  * \param max_results The capacity of out_results array.
- * \param out_count The number of matches found.
+ * \param out_count The number of results written, at most max_results.
  * \return 0 on success.
  */
 int cmp_command_palette_search(cmp_command_palette_t *palette,
@@ -10574,6 +12834,17 @@ int cmp_command_palette_search(cmp_command_palette_t *palette,
                                cmp_command_item_t **out_results,
                                size_t max_results, size_t *out_count);
 
+/**
+ * \brief Split large searches across a threaded modality.
+ * \param workers A CMP_MODALITY_THREADED modality, or NULL to search on the
+ * calling thread only. It must outlive its use by the palette.
+ * \param slices Number of parts a large candidate set is split into; the
+ * calling thread scores one of them.
+ * \return 0 on success, CMP_ERROR_INVALID_ARG for other modality types.
+ */
+int cmp_command_palette_set_workers(cmp_command_palette_t *palette,
+                                    cmp_modality_t *workers, size_t slices);
+
 /* --- From custom_chrome.h --- */
 /**
  * \brief Initialize the custom window chrome regions.
@@ -10751,7 +13022,8 @@ typedef struct cmp_embedded_pty cmp_embedded_pty_t;
 int cmp_embedded_pty_create(cmp_embedded_pty_t **out_pty);
 
 /**
- * \brief Destroy a PTY context.
+ * \brief Destroy a PTY context, hanging up its child. Safe while attached:
+ * a pump still queued on the modality no longer touches the PTY.
  * \return 0 on success.
  */
 int cmp_embedded_pty_destroy(cmp_embedded_pty_t *pty);
@@ -10780,6 +13052,143 @@ int cmp_embedded_pty_write(cmp_embedded_pty_t *pty, const char *input,
 int cmp_embedded_pty_read(cmp_embedded_pty_t *pty, char *out_buffer,
                           size_t max_len, size_t *out_read);
 
+/**
+ * \brief Set the terminal size reported to the child process.
+ * \return 0 on success.
+ */
+int cmp_embedded_pty_resize(cmp_embedded_pty_t *pty, unsigned short cols,
+                            unsigned short rows);
+
+/* --- From terminal.h --- */
+#define CMP_TERM_COLOR_DEFAULT 0ul
+#define CMP_TERM_COLOR_PALETTE 0x01000000ul /**< Low byte is the index */
+#define CMP_TERM_COLOR_RGB 0x02000000ul     /**< Low 24 bits are 0xRRGGBB */
+
+#define CMP_TERM_ATTR_BOLD 0x01
+#define CMP_TERM_ATTR_DIM 0x02
+#define CMP_TERM_ATTR_ITALIC 0x04
+#define CMP_TERM_ATTR_UNDERLINE 0x08
+#define CMP_TERM_ATTR_BLINK 0x10
+#define CMP_TERM_ATTR_INVERSE 0x20
+#define CMP_TERM_ATTR_HIDDEN 0x40
+#define CMP_TERM_ATTR_STRIKETHROUGH 0x80
+
+/**
+ * \brief One character cell of a terminal grid.
+ */
+typedef struct cmp_term_cell {
+  unsigned long codepoint; /**< 0 for an empty cell */
+  unsigned long fg;        /**< CMP_TERM_COLOR_* */
+  unsigned long bg;        /**< CMP_TERM_COLOR_* */
+  unsigned int attrs;      /**< CMP_TERM_ATTR_* flags */
+} cmp_term_cell_t;
+
+/**
+ * \brief VT/ANSI terminal emulator state: parser, screen grid and
+ * compressed scrollback.
+ */
+typedef struct cmp_term cmp_term_t;
+
+/**
+ * \brief Create a terminal grid.
+ * \param scrollback_lines Lines kept after they scroll off the top.
+ * \return 0 on success.
+ */
+int cmp_term_create(cmp_term_t **out_vt, size_t cols, size_t rows,
+                    size_t scrollback_lines);
+
+/**
+ * \brief Destroy a terminal grid.
+ * \return 0 on success.
+ */
+int cmp_term_destroy(cmp_term_t *vt);
+
+/**
+ * \brief Parse terminal output into the grid. Sequences may be split
+ * across calls.
+ * \return 0 on success.
+ */
+int cmp_term_feed(cmp_term_t *vt, const char *data, size_t length);
+
+/**
+ * \brief Resize the screen; rows cut from the top move to scrollback.
+ * \return 0 on success.
+ */
+int cmp_term_resize(cmp_term_t *vt, size_t cols, size_t rows);
+
+/**
+ * \brief Get the cells of a visible row (0 is the top of the screen).
+ * \return 0 on success, CMP_ERROR_BOUNDS past the last row.
+ */
+int cmp_term_get_row(const cmp_term_t *vt, size_t row,
+                     const cmp_term_cell_t **out_cells);
+
+/**
+ * \brief Get the cursor position and visibility.
+ * \return 0 on success.
+ */
+int cmp_term_get_cursor(const cmp_term_t *vt, size_t *out_row, size_t *out_col,
+                        int *out_visible);
+
+/**
+ * \brief Collect and reset the damage since the last call.
+ * After shifting the previous frame up by out_scrolled rows, only rows
+ * flagged in out_dirty need repainting.
+ * \param out_dirty Receives one flag per visible row; may be NULL.
+ * \param out_scrolled Receives the full-screen scroll count; may be NULL.
+ * \return 0 on success.
+ */
+int cmp_term_take_damage(cmp_term_t *vt, unsigned char *out_dirty,
+                         size_t *out_scrolled);
+
+/**
+ * \brief Take pending replies to terminal queries (e.g. cursor position
+ * reports) that should be written back to the child process.
+ * \return 0 on success.
+ */
+int cmp_term_take_response(cmp_term_t *vt, char *out_buffer, size_t max_len,
+                           size_t *out_len);
+
+/**
+ * \brief Number of lines held in scrollback.
+ */
+size_t cmp_term_get_scrollback_count(const cmp_term_t *vt);
+
+/**
+ * \brief Decompress a scrollback line (0 is the oldest).
+ * Trailing blank cells are not stored, so out_count may be below the
+ * screen width.
+ * \return 0 on success, CMP_ERROR_BOUNDS for a missing line.
+ */
+int cmp_term_get_scrollback_line(const cmp_term_t *vt, size_t index,
+                                 cmp_term_cell_t *out_cells, size_t max_cells,
+                                 size_t *out_count);
+
+/**
+ * \brief Called from the modality with PTY output; length 0 means the
+ * child process has exited.
+ */
+typedef void (*cmp_embedded_pty_output_cb)(void *user_data, const char *data,
+                                           size_t length);
+
+/**
+ * \brief Pump PTY output from a modality task until the child exits or the
+ * PTY is detached. Output is parsed into vt when given (query replies are
+ * written back to the child) and then passed to callback when given. The
+ * pump never blocks the modality; while the child is idle it leaves the
+ * queue and a watcher thread requeues it once output arrives.
+ * \return 0 on success.
+ */
+int cmp_embedded_pty_attach(cmp_embedded_pty_t *pty, cmp_modality_t *mod,
+                            cmp_term_t *vt, cmp_embedded_pty_output_cb callback,
+                            void *user_data);
+
+/**
+ * \brief Stop pumping output; the queued pump task retires itself.
+ * \return 0 on success.
+ */
+int cmp_embedded_pty_detach(cmp_embedded_pty_t *pty);
+
 /* --- From emscripten_indexeddb_vfs.h --- */
 /**
  * @brief Context for managing the Emscripten Virtual File System mapped to
@@ -10899,6 +13308,297 @@ int cmp_focus_nav_handle_tab(cmp_focus_nav_t *nav, int is_shift_pressed);
  */
 int cmp_verify_hardware_acceleration(void);
 
+/* --- From inflate.h --- */
+/**
+ * \brief Streaming zlib/DEFLATE decompressor.
+ */
+typedef struct cmp_inflate cmp_inflate_t;
+
+/**
+ * \brief Receives decompressed bytes; return non-zero to abort.
+ */
+typedef int (*cmp_inflate_write_cb_t)(void *user_data,
+                                      const unsigned char *data, size_t len);
+
+/**
+ * \brief Create a streaming decompressor.
+ * \param zlib_wrapped 1 for an RFC 1950 stream (header + Adler-32), 0 for raw
+ * RFC 1951 data.
+ * \param write_cb Output sink, called as data becomes available.
+ * \param user_data Passed to write_cb.
+ * \param out_inflate Pointer to receive the decompressor.
+ * \return 0 on success.
+ */
+int cmp_inflate_create(int zlib_wrapped, cmp_inflate_write_cb_t write_cb,
+                       void *user_data, cmp_inflate_t **out_inflate);
+
+/**
+ * \brief Feed compressed bytes. Input may be split at any byte boundary.
+ * \return 0 on success, CMP_ERROR_INVALID_ARG on malformed data.
+ */
+int cmp_inflate_push(cmp_inflate_t *inf, const void *data, size_t len);
+
+/**
+ * \brief Signal end of input and flush the remaining output.
+ * \return 0 on success, CMP_ERROR_INVALID_STATE if the stream is truncated.
+ */
+int cmp_inflate_finish(cmp_inflate_t *inf);
+
+/**
+ * \brief Decode everything pushed so far without ending the stream, e.g.
+ * per message of a sync-flushed stream. The input must stop at a flush
+ * point (a block boundary such as 00 00 FF FF).
+ * \return 0 on success, CMP_ERROR_INVALID_ARG on malformed data.
+ */
+int cmp_inflate_sync(cmp_inflate_t *inf);
+
+/**
+ * \brief Query whether the final block (and trailer) has been decoded.
+ * \return 0 on success.
+ */
+int cmp_inflate_is_done(const cmp_inflate_t *inf, int *out_done);
+
+/**
+ * \brief Destroy a decompressor.
+ * \return 0 on success.
+ */
+int cmp_inflate_destroy(cmp_inflate_t *inf);
+
+/* --- From deflate.h --- */
+/**
+ * \brief Streaming zlib/DEFLATE compressor.
+ */
+typedef struct cmp_deflate cmp_deflate_t;
+
+/**
+ * \brief Receives compressed bytes; return non-zero to abort.
+ */
+typedef int (*cmp_deflate_write_cb_t)(void *user_data,
+                                      const unsigned char *data, size_t len);
+
+/**
+ * \brief Create a streaming compressor.
+ * \param zlib_wrapped 1 for an RFC 1950 stream (header + Adler-32), 0 for raw
+ * RFC 1951 data.
+ * \param write_cb Output sink, called in small chunks as blocks complete.
+ * \param user_data Passed to write_cb.
+ * \param out_deflate Pointer to receive the compressor.
+ * \return 0 on success.
+ */
+int cmp_deflate_create(int zlib_wrapped, cmp_deflate_write_cb_t write_cb,
+                       void *user_data, cmp_deflate_t **out_deflate);
+
+/**
+ * \brief Start a new stream with the same sink, reusing the buffers.
+ * \return 0 on success.
+ */
+int cmp_deflate_reset(cmp_deflate_t *d);
+
+/**
+ * \brief Feed uncompressed bytes.
+ * \return 0 on success, CMP_ERROR_INVALID_STATE if the sink aborted or the
+ * stream was already finished.
+ */
+int cmp_deflate_push(cmp_deflate_t *d, const void *data, size_t len);
+
+/**
+ * \brief Compress the remaining input and write the final block (and
+ * trailer).
+ * \return 0 on success.
+ */
+int cmp_deflate_finish(cmp_deflate_t *d);
+
+/**
+ * \brief Destroy a compressor.
+ * \return 0 on success.
+ */
+int cmp_deflate_destroy(cmp_deflate_t *d);
+
+/* --- From image_decoder.h --- */
+/**
+ * \brief Container formats recognised by the streaming image decoder.
+ */
+typedef enum cmp_image_format {
+  CMP_IMAGE_FORMAT_UNKNOWN = 0,
+  CMP_IMAGE_FORMAT_PNG = 1,
+  CMP_IMAGE_FORMAT_JPEG = 2,
+  CMP_IMAGE_FORMAT_WEBP = 3
+} cmp_image_format_t;
+
+/**
+ * \brief Geometry of an image being decoded.
+ */
+typedef struct cmp_image_info {
+  cmp_image_format_t format;
+  int native_width;  /**< Size stored in the file. */
+  int native_height;
+  int decode_scale;  /**< Reduction applied inside the codec (1, 2, 4, 8). */
+  int width;         /**< Size written to the output buffer. */
+  int height;
+  int is_progressive; /**< Interlaced PNG or progressive JPEG. */
+  int passes_completed;
+} cmp_image_info_t;
+
+/**
+ * \brief Streaming, downscaling image decoder (PNG, JPEG, WebP lossless).
+ */
+typedef struct cmp_image_decoder cmp_image_decoder_t;
+
+/**
+ * \brief Called once the header is parsed, before any pixels are written.
+ * The callee may point *io_pixels at its own RGBA8 storage (e.g. a mapped
+ * texture upload buffer) of at least info->height rows of *io_stride bytes.
+ * Leaving *io_pixels NULL makes the decoder allocate the buffer.
+ * \return 0 to continue, non-zero to abort decoding.
+ */
+typedef int (*cmp_image_header_cb_t)(void *user_data,
+                                     const cmp_image_info_t *info,
+                                     unsigned char **io_pixels,
+                                     size_t *io_stride);
+
+/**
+ * \brief Called after output rows [first_row, first_row + row_count) have
+ * been written. Progressive images repaint from row 0 once per pass.
+ */
+typedef void (*cmp_image_rows_cb_t)(void *user_data, int first_row,
+                                    int row_count, int pass);
+
+/**
+ * \brief Create a decoder.
+ * \param target_width Pixel width of the destination rect, or 0 for native.
+ * \param target_height Pixel height of the destination rect, or 0 for native.
+ * \param out_decoder Pointer to receive the decoder.
+ * \return 0 on success.
+ *
+ * Output is never larger than the image itself; a target that exceeds it is
+ * shrunk uniformly until it fits. JPEG is reduced in the DCT and interlaced
+ * PNG skips Adam7 passes that fall below the target resolution; the rest is
+ * box-filtered a row at a time, so no full-resolution bitmap is allocated.
+ */
+int cmp_image_decoder_create(int target_width, int target_height,
+                             cmp_image_decoder_t **out_decoder);
+
+/**
+ * \brief Destroy a decoder and any buffer it allocated.
+ * \return 0 on success.
+ */
+int cmp_image_decoder_destroy(cmp_image_decoder_t *dec);
+
+/**
+ * \brief Install header and row callbacks. Must precede the first push.
+ * \return 0 on success.
+ */
+int cmp_image_decoder_set_callbacks(cmp_image_decoder_t *dec,
+                                    cmp_image_header_cb_t header_cb,
+                                    cmp_image_rows_cb_t rows_cb,
+                                    void *user_data);
+
+/**
+ * \brief Decode into caller-owned RGBA8 memory of at least target_height rows.
+ * \return 0 on success.
+ */
+int cmp_image_decoder_set_output(cmp_image_decoder_t *dec,
+                                 unsigned char *pixels, size_t stride);
+
+/**
+ * \brief Feed the next chunk of the encoded file.
+ * \return 0 on success, CMP_ERROR_INVALID_ARG on malformed or unsupported
+ * data.
+ */
+int cmp_image_decoder_push(cmp_image_decoder_t *dec, const void *data,
+                           size_t len);
+
+/**
+ * \brief Signal end of input.
+ * \return 0 on success, CMP_ERROR_INVALID_STATE if the file is truncated.
+ */
+int cmp_image_decoder_finish(cmp_image_decoder_t *dec);
+
+/**
+ * \brief Retrieve geometry.
+ * \return 0 on success, CMP_ERROR_INVALID_STATE before the header is parsed.
+ */
+int cmp_image_decoder_get_info(const cmp_image_decoder_t *dec,
+                               cmp_image_info_t *out_info);
+
+/**
+ * \brief Retrieve the output buffer (decoder-owned or caller-supplied).
+ * \return 0 on success, CMP_ERROR_INVALID_STATE before the header is parsed.
+ */
+int cmp_image_decoder_get_pixels(const cmp_image_decoder_t *dec,
+                                 unsigned char **out_pixels,
+                                 size_t *out_stride);
+
+/**
+ * \brief Adapter matching HttpRequest.on_chunk; pass the decoder as
+ * on_chunk_user_data to decode while downloading.
+ * \return 0 to continue, non-zero to abort the transfer.
+ */
+int cmp_image_decoder_http_on_chunk(void *user_data, const void *chunk,
+                                    size_t chunk_len);
+
+/**
+ * \brief Completion callback for cmp_image_decode_file_async.
+ */
+typedef void (*cmp_image_decode_cb_t)(int error, cmp_image_decoder_t *dec,
+                                      void *user_data);
+
+/**
+ * \brief Stream a VFS file through a decoder on a modality worker.
+ * Decoder callbacks run on that worker; the decoder stays owned by the
+ * caller.
+ * \return 0 if the task was queued.
+ */
+int cmp_image_decode_file_async(cmp_modality_t *mod, const char *virtual_path,
+                                cmp_image_decoder_t *dec,
+                                cmp_image_decode_cb_t callback,
+                                void *user_data);
+
+/**
+ * \brief Format back-ends feed pixels through these three calls.
+ *
+ * begin_frame reports native geometry and returns, via out_scale, the
+ * power-of-two reduction the back-end may apply itself. Rows are then
+ * written at ceil(native / scale) resolution, top to bottom within a pass.
+ */
+int cmp_image_decoder_begin_frame(cmp_image_decoder_t *dec, int native_width,
+                                  int native_height, int is_progressive,
+                                  int max_scale, int *out_scale);
+int cmp_image_decoder_write_rows(cmp_image_decoder_t *dec, int first_row,
+                                 int row_count, const unsigned char *rgba,
+                                 size_t stride);
+int cmp_image_decoder_end_pass(cmp_image_decoder_t *dec);
+
+/** \brief PNG back-end. */
+typedef struct cmp_png_decoder cmp_png_decoder_t;
+int cmp_png_decoder_create(cmp_image_decoder_t *sink,
+                           cmp_png_decoder_t **out_png);
+int cmp_png_decoder_push(cmp_png_decoder_t *png, const unsigned char *data,
+                         size_t len);
+int cmp_png_decoder_finish(cmp_png_decoder_t *png);
+int cmp_png_decoder_destroy(cmp_png_decoder_t *png);
+
+/** \brief Baseline and progressive JPEG back-end. */
+typedef struct cmp_jpeg_decoder cmp_jpeg_decoder_t;
+int cmp_jpeg_decoder_create(cmp_image_decoder_t *sink,
+                            cmp_jpeg_decoder_t **out_jpeg);
+int cmp_jpeg_decoder_push(cmp_jpeg_decoder_t *jpeg, const unsigned char *data,
+                          size_t len);
+int cmp_jpeg_decoder_finish(cmp_jpeg_decoder_t *jpeg);
+int cmp_jpeg_decoder_destroy(cmp_jpeg_decoder_t *jpeg);
+
+/**
+ * \brief WebP lossless (VP8L) back-end. Backward references may span the
+ * whole image, so pixels are produced once the VP8L chunk is complete.
+ */
+typedef struct cmp_webp_decoder cmp_webp_decoder_t;
+int cmp_webp_decoder_create(cmp_image_decoder_t *sink,
+                            cmp_webp_decoder_t **out_webp);
+int cmp_webp_decoder_push(cmp_webp_decoder_t *webp, const unsigned char *data,
+                          size_t len);
+int cmp_webp_decoder_finish(cmp_webp_decoder_t *webp);
+int cmp_webp_decoder_destroy(cmp_webp_decoder_t *webp);
+
 /* --- From image_preview.h --- */
 /**
  * \brief Image Preview Decoder Context.
@@ -11127,7 +13827,13 @@ typedef enum {
   CMP_MD_NODE_BLOCKQUOTE,
   CMP_MD_NODE_TABLE,
   CMP_MD_NODE_TABLE_ROW,
-  CMP_MD_NODE_TABLE_CELL
+  CMP_MD_NODE_TABLE_CELL,
+  CMP_MD_NODE_DOCUMENT,       /* Root returned by the parser */
+  CMP_MD_NODE_LINK,           /* content holds the destination */
+  CMP_MD_NODE_IMAGE,          /* content holds the source, children the alt */
+  CMP_MD_NODE_THEMATIC_BREAK,
+  CMP_MD_NODE_STRIKETHROUGH,
+  CMP_MD_NODE_LINE_BREAK
 } cmp_md_node_type_t;
 
 /**
@@ -11137,7 +13843,7 @@ typedef struct cmp_md_node cmp_md_node_t;
 struct cmp_md_node {
   cmp_md_node_type_t type;
   char *content; /* Text content if applicable, else NULL */
-  int level;     /* For headers (1-6) */
+  int level;     /* For headers (1-6); ordered list start, 0 for bullets */
 
   cmp_md_node_t **children;
   size_t child_count;
@@ -11145,6 +13851,7 @@ struct cmp_md_node {
   uint32_t bg_color;
   uint32_t text_color;
   float font_size;
+  void *arena; /* Set on parser-built roots: storage for the whole tree */
 };
 
 /**
@@ -11166,6 +13873,11 @@ int cmp_markdown_parser_destroy(cmp_markdown_parser_t *parser);
 
 /**
  * \brief Parse raw markdown text into an AST.
+ *
+ * Follows CommonMark block and inline structure plus GFM tables and
+ * strikethrough, in time linear in the input. The root is a
+ * CMP_MD_NODE_DOCUMENT node; the whole tree is released by passing the
+ * root to cmp_md_node_destroy.
  * \param parser The parser context.
  * \param markdown_text The raw text to parse.
  * \param out_root The returned AST root node.
@@ -11181,6 +13893,62 @@ int cmp_markdown_parser_parse(cmp_markdown_parser_t *parser,
  */
 int cmp_md_node_destroy(cmp_md_node_t *node);
 
+/**
+ * \brief Incremental markdown parser fed in chunks.
+ *
+ * Closed top-level blocks are never parsed again; each push only re-parses
+ * the trailing block that is still open. Trees are built on demand per
+ * block, so a view only pays for the blocks it shows.
+ */
+typedef struct cmp_md_stream cmp_md_stream_t;
+
+/**
+ * \brief Create an empty markdown stream.
+ * \return 0 on success.
+ */
+int cmp_md_stream_create(cmp_md_stream_t **out_stream);
+
+/**
+ * \brief Destroy a stream and every tree it handed out.
+ * \return 0 on success.
+ */
+int cmp_md_stream_destroy(cmp_md_stream_t *stream);
+
+/**
+ * \brief Append a chunk of markdown source.
+ * \param stream The stream.
+ * \param chunk Source bytes; chunks may split lines anywhere.
+ * \param len Number of bytes in chunk.
+ * \return 0 on success, CMP_ERROR_INVALID_STATE after finish.
+ */
+int cmp_md_stream_push(cmp_md_stream_t *stream, const char *chunk,
+                       size_t len);
+
+/**
+ * \brief Mark the end of input, closing every open block.
+ * \return 0 on success.
+ */
+int cmp_md_stream_finish(cmp_md_stream_t *stream);
+
+/**
+ * \brief Number of top-level blocks parsed so far, open ones included.
+ * \return 0 on success.
+ */
+int cmp_md_stream_get_block_count(cmp_md_stream_t *stream, size_t *out_count);
+
+/**
+ * \brief Tree for one top-level block, built on first request.
+ * \param stream The stream.
+ * \param index Block index below the block count.
+ * \param out_node Receives the block node, owned by the stream. Trees of
+ * closed blocks stay valid until the stream is destroyed; trees of open
+ * blocks only until the next push or finish.
+ * \param out_closed Optional; set to 1 when the block can no longer change.
+ * \return 0 on success, CMP_ERROR_BOUNDS for an index past the end.
+ */
+int cmp_md_stream_get_block(cmp_md_stream_t *stream, size_t index,
+                            const cmp_md_node_t **out_node, int *out_closed);
+
 /* --- From math_renderer.h --- */
 /**
  * \brief Streaming math rendering context.
@@ -11246,6 +14014,26 @@ int cmp_mermaid_renderer_free_svg(char *svg_xml);
  */
 typedef struct cmp_minimap cmp_minimap_t;
 
+struct cmp_syntax_document;
+
+/** \brief Document lines rasterized, cached and invalidated together. */
+#define CMP_MINIMAP_TILE_LINES 256
+
+/**
+ * \brief Placement of the minimap within its pane, in minimap pixels.
+ *
+ * Tile pixels are one byte each: the high nibble is the ink density (0 for
+ * blank, up to 15) and the low nibble the cmp_token_type_t of the first
+ * inked character, for the renderer to map through a palette.
+ */
+typedef struct cmp_minimap_layout {
+  size_t first_line;   /**< First document line drawn at the top */
+  size_t line_count;   /**< Lines intersecting the pane */
+  float offset_y;      /**< How far first_line is scrolled above the top */
+  float slider_y;      /**< Top of the editor viewport highlight */
+  float slider_height; /**< Height of the editor viewport highlight */
+} cmp_minimap_layout_t;
+
 /**
  * \brief Create an editor minimap context.
  * \return 0 on success.
@@ -11264,6 +14052,42 @@ int cmp_minimap_destroy(cmp_minimap_t *minimap);
  */
 int cmp_minimap_set_text(cmp_minimap_t *minimap, const char *text);
 
+/**
+ * \brief Mirror a text buffer without copying it.
+ * \param buffer Must outlive the minimap or be detached with NULL.
+ * \return 0 on success.
+ */
+int cmp_minimap_set_buffer(cmp_minimap_t *minimap,
+                           const cmp_text_buffer_t *buffer);
+
+/**
+ * \brief Color tokens from a highlighting document over the same buffer.
+ * \param doc NULL to draw everything as CMP_TOKEN_NORMAL.
+ * \return 0 on success.
+ */
+int cmp_minimap_set_syntax(cmp_minimap_t *minimap,
+                           struct cmp_syntax_document *doc);
+
+/**
+ * \brief Report an edit already applied to the buffer.
+ * \param start_line First line touched by the edit.
+ * \param old_end_line Last line of the replaced text, before the edit.
+ * \param new_end_line Last line of the inserted text, after the edit.
+ * \return 0 on success.
+ */
+int cmp_minimap_edit(cmp_minimap_t *minimap, size_t start_line,
+                     size_t old_end_line, size_t new_end_line);
+
+/**
+ * \brief Set the pane size and scale (defaults: 120 px wide, 2 px per line,
+ * 1 character per pixel).
+ * \param line_px Pixel rows per document line, 1 or 2.
+ * \return 0 on success.
+ */
+int cmp_minimap_set_size(cmp_minimap_t *minimap, size_t width_px,
+                         size_t height_px, size_t line_px,
+                         size_t chars_per_px);
+
 /**
  * \brief Update the viewport scroll ratio to map the active minimap highlight.
  * \param minimap The minimap context.
@@ -11277,10 +14101,34 @@ int cmp_minimap_update_viewport(cmp_minimap_t *minimap, float viewport_y,
 
 /**
  * \brief Generate/Calculate the rendering geometry or layout for the minimap.
+ *
+ * Rasterizes the tiles under the pane that are missing or stale; the rest
+ * of the document is not read.
  * \return 0 on success.
  */
 int cmp_minimap_compute_layout(cmp_minimap_t *minimap);
 
+/**
+ * \brief Get the geometry from the last cmp_minimap_compute_layout.
+ * \return 0 on success.
+ */
+int cmp_minimap_get_layout(const cmp_minimap_t *minimap,
+                           cmp_minimap_layout_t *out_layout);
+
+/**
+ * \brief Get the pixels of a tile, rasterizing it if needed.
+ * \param tile_index Tile holding lines from tile_index *
+ * CMP_MINIMAP_TILE_LINES.
+ * \param out_pixels Row-major, width bytes per row; valid until the next
+ * minimap call.
+ * \param out_rows Rows holding data.
+ * \param out_version Optional; changes whenever the tile is redrawn.
+ * \return 0 on success, CMP_ERROR_BOUNDS past the last line.
+ */
+int cmp_minimap_get_tile(cmp_minimap_t *minimap, size_t tile_index,
+                         const unsigned char **out_pixels, size_t *out_rows,
+                         unsigned long *out_version);
+
 /* --- From multi_window.h --- */
 /**
  * @brief Represents an independent OS window created from a torn-off tab.
@@ -11633,7 +14481,10 @@ typedef struct {
 } cmp_highlight_span_t;
 
 /**
- * \brief Syntax highlighter context (wraps Tree-sitter or regex lexer).
+ * \brief Syntax highlighter context.
+ *
+ * Languages: "c"/"h", "js"/"javascript", "json" and "md"/"markdown". Other
+ * identifiers fall back to strings and numbers only.
  */
 typedef struct cmp_syntax_highlighter cmp_syntax_highlighter_t;
 
@@ -11668,6 +14519,79 @@ int cmp_syntax_highlighter_parse(cmp_syntax_highlighter_t *hl,
  */
 int cmp_syntax_highlighter_free_spans(cmp_highlight_span_t *spans);
 
+/**
+ * \brief Incremental highlighting state for a text buffer.
+ *
+ * Caches the lexer state at the start of every line. After an edit only the
+ * edited lines, and successors whose start state changed, are lexed again;
+ * spans are produced only for the lines requested (typically the viewport).
+ */
+typedef struct cmp_syntax_document cmp_syntax_document_t;
+
+/**
+ * \brief Create a highlighting document over a text buffer.
+ * \param buffer The text; must outlive the document.
+ * \param language The language identifier (e.g. "c", "js", "json", "md").
+ * \param out_doc Receives the document.
+ * \return 0 on success.
+ */
+int cmp_syntax_document_create(const cmp_text_buffer_t *buffer,
+                               const char *language,
+                               cmp_syntax_document_t **out_doc);
+
+/**
+ * \brief Destroy a highlighting document.
+ * \return 0 on success.
+ */
+int cmp_syntax_document_destroy(cmp_syntax_document_t *doc);
+
+/**
+ * \brief Report an edit already applied to the buffer.
+ * \param start_line First line touched by the edit.
+ * \param old_end_line Last line of the replaced text, before the edit.
+ * \param new_end_line Last line of the inserted text, after the edit.
+ * \return 0 on success. An edit inconsistent with the buffer's line count
+ * drops the whole cache instead.
+ */
+int cmp_syntax_document_edit(cmp_syntax_document_t *doc, size_t start_line,
+                             size_t old_end_line, size_t new_end_line);
+
+/**
+ * \brief Drop all cached line states (e.g. after replacing the text).
+ * \return 0 on success.
+ */
+int cmp_syntax_document_invalidate(cmp_syntax_document_t *doc);
+
+/**
+ * \brief Highlight a range of lines.
+ * \param first_line First line to highlight.
+ * \param line_count Number of lines (clamped to the document).
+ * \param out_spans Receives spans with document byte offsets. The array
+ * belongs to the document and is reused by the next call.
+ * \param out_count Number of spans.
+ * \return 0 on success, CMP_ERROR_BOUNDS if first_line is past the end.
+ */
+int cmp_syntax_document_highlight(cmp_syntax_document_t *doc,
+                                  size_t first_line, size_t line_count,
+                                  const cmp_highlight_span_t **out_spans,
+                                  size_t *out_count);
+
+/**
+ * \brief Bring line states up to date in the background.
+ * \param max_lines Upper bound on lines lexed by this call (idle budget).
+ * \param out_done Optional; set to 1 once every line state is current.
+ * \return 0 on success.
+ */
+int cmp_syntax_document_advance(cmp_syntax_document_t *doc, size_t max_lines,
+                                int *out_done);
+
+/**
+ * \brief Get how many lines the document has lexed since creation.
+ * \return 0 on success.
+ */
+int cmp_syntax_document_get_lexed_line_count(const cmp_syntax_document_t *doc,
+                                             size_t *out_count);
+
 /* --- From tab_navigation.h --- */
 /**
  * \brief A single editor tab.
@@ -206,6 +206,8 @@ typedef struct cmp_f2_datagrid_s {
   cmp_ui_node_t *header_row_node;
   /** \brief Documented */
   cmp_ui_node_t *rows_container_node;
+  /** \brief Virtualized cells over a columnar model, or NULL */
+  cmp_datagrid_view_t *view;
 } cmp_f2_datagrid_t;
 
 /**
@@ -226,6 +228,23 @@ CMP_API int cmp_f2_datagrid_create(cmp_ui_node_t **out_node);
  * @return 0 on success, or an error code.
  */
 CMP_API int cmp_f2_datagrid_row_create(cmp_ui_node_t **out_node, int is_header);
+/**
+ * @brief Back the datagrid with a columnar model. Only the visible cells
+ * get nodes, in the rows container (created on first use). Pass a NULL
+ * model to drop the view; do so before destroying the grid node.
+ * @param row_height Height of every row.
+ * @return 0 on success, or an error code.
+ */
+CMP_API int cmp_f2_datagrid_set_model(cmp_ui_node_t *node,
+                                      cmp_datagrid_model_t *model,
+                                      float row_height);
+/**
+ * @brief Get the view created by cmp_f2_datagrid_set_model.
+ * @param out_view Receives the view, or NULL without a model.
+ * @return 0 on success, or an error code.
+ */
+CMP_API int cmp_f2_datagrid_get_view(cmp_ui_node_t *node,
+                                     cmp_datagrid_view_t **out_view);
 
 /* 8.7 Tree / TreeView */
 /** \brief Documented */
@@ -241,8 +260,22 @@ typedef struct cmp_f2_tree_item_s {
   cmp_ui_node_t *content_node;
   /** \brief Documented */
   cmp_ui_node_t *children_container_node;
+  /** \brief Model of a virtualized tree the item is bound to, or NULL */
+  cmp_tree_model_t *model;
+  /** \brief Model node the item shows */
+  size_t model_node;
 } cmp_f2_tree_item_t;
 
+/** \brief State of a tree whose rows come from a cmp_tree_model_t */
+typedef struct cmp_f2_tree_s {
+  /** \brief Documented */
+  cmp_tree_model_t *model;
+  /** \brief Binds tree items to the visible rows only */
+  cmp_virtual_list_t *list;
+  /** \brief Leading padding per depth level */
+  float indent;
+} cmp_f2_tree_t;
+
 /**
  * @brief Initialize a Fluent 2 tree_create component.
  * @param out_node Pointer to receive the allocated node.
@@ -266,8 +299,30 @@ CMP_API int cmp_f2_tree_create(cmp_ui_node_t **out_node);
  */
 CMP_API int cmp_f2_tree_item_create(cmp_ui_node_t **out_node,
                                     const char *label);
+/**
+ * @brief Expand or collapse an item. Items bound to a tree model expand the
+ * model node, which splices its rows into the tree.
+ */
 CMP_API int cmp_f2_tree_item_set_expanded(cmp_ui_node_t *node, int is_expanded);
 CMP_API int cmp_f2_tree_item_set_selected(cmp_ui_node_t *node, int is_selected);
+/**
+ * @brief Render the tree from a lazily expanded model. Only visible rows
+ * get tree items, which are recycled while scrolling. The tree takes over
+ * the model's change handler. Pass a NULL model to drop the rows; do so
+ * before destroying the tree or the model.
+ * @param row_height Height of every row.
+ * @return 0 on success, or an error code.
+ */
+CMP_API int cmp_f2_tree_set_model(cmp_ui_node_t *node, cmp_tree_model_t *model,
+                                  float row_height);
+/**
+ * @brief Get the virtualized list behind a tree with a model, e.g. to set
+ * its viewport or scroll it.
+ * @param out_list Receives the list, or NULL without a model.
+ * @return 0 on success, or an error code.
+ */
+CMP_API int cmp_f2_tree_get_list(cmp_ui_node_t *node,
+                                 cmp_virtual_list_t **out_list);
 
 #ifdef __cplusplus
 }
@@ -61,6 +61,120 @@ CMP_API int cmp_m3_scheme_fidelity(float hue, float chroma, float tone,
 CMP_API int cmp_m3_scheme_content(float hue, float chroma, float tone,
                                   int is_dark, cmp_palette_t *out_palette);
 
+/**
+ * @brief Number of colors processed per block by the batch converters.
+ *
+ * Batch kernels operate on structure-of-arrays blocks of this width so the
+ * per-channel loops can be vectorised by the compiler.
+ */
+#define CMP_M3_BATCH_LANES 8
+
+/**
+ * @brief Number of integer tones (0-100 inclusive) held by a tonal palette.
+ */
+#define CMP_M3_TONE_COUNT 101
+
+/**
+ * @brief Memoized tonal palette for a single (hue, chroma) pair.
+ */
+typedef struct cmp_m3_tonal_palette {
+  float hue;
+  float chroma;
+  unsigned char computed[CMP_M3_TONE_COUNT];
+  cmp_color_t tones[CMP_M3_TONE_COUNT];
+} cmp_m3_tonal_palette_t;
+
+/**
+ * @brief Opaque cache of tonal palettes keyed by (hue, chroma).
+ */
+typedef struct cmp_m3_palette_cache cmp_m3_palette_cache_t;
+
+/**
+ * @brief Convert an array of sRGB colors to HCT.
+ * @param in_colors Input colors.
+ * @param count Number of colors.
+ * @param out_hue Receives `count` hues.
+ * @param out_chroma Receives `count` chromas.
+ * @param out_tone Receives `count` tones.
+ * @return 0 on success, or an error code.
+ */
+CMP_API int cmp_m3_srgb_to_hct_batch(const cmp_color_t *in_colors,
+                                     size_t count, float *out_hue,
+                                     float *out_chroma, float *out_tone);
+
+/**
+ * @brief Convert arrays of HCT components to sRGB.
+ * @param hue Input hues.
+ * @param chroma Input chromas.
+ * @param tone Input tones.
+ * @param count Number of colors.
+ * @param out_colors Receives `count` clamped sRGB colors.
+ * @return 0 on success, or an error code.
+ */
+CMP_API int cmp_m3_hct_to_srgb_batch(const float *hue, const float *chroma,
+                                     const float *tone, size_t count,
+                                     cmp_color_t *out_colors);
+
+/**
+ * @brief Fill every integer tone of a tonal palette in one batch pass.
+ * @param hue Palette hue in degrees.
+ * @param chroma Palette chroma.
+ * @param out_palette Palette to fill.
+ * @return 0 on success, or an error code.
+ */
+CMP_API int cmp_m3_tonal_palette_build(float hue, float chroma,
+                                       cmp_m3_tonal_palette_t *out_palette);
+
+/**
+ * @brief Create a tonal palette cache.
+ *
+ * Hue and chroma are quantized to 0.01 to form the key. The cache is
+ * set-associative and evicts the least recently used palette in a set.
+ *
+ * @param capacity Number of palettes to retain (rounded up to a multiple of 4).
+ * @param out_cache Receives the new cache.
+ * @return 0 on success, or an error code.
+ */
+CMP_API int cmp_m3_palette_cache_create(size_t capacity,
+                                        cmp_m3_palette_cache_t **out_cache);
+
+/**
+ * @brief Destroy a tonal palette cache.
+ * @param cache The cache to destroy.
+ * @return 0 on success, or an error code.
+ */
+CMP_API int cmp_m3_palette_cache_destroy(cmp_m3_palette_cache_t *cache);
+
+/**
+ * @brief Resolve a set of tones from the palette for (hue, chroma).
+ *
+ * Integer tones are memoized; only tones not yet computed for the palette are
+ * converted, in a single batch. Fractional tones are converted directly.
+ *
+ * @param cache The cache.
+ * @param hue Palette hue in degrees (any range; normalised to [0, 360)).
+ * @param chroma Palette chroma.
+ * @param tones Tones to resolve.
+ * @param count Number of tones.
+ * @param out_colors Receives `count` colors.
+ * @return 0 on success, or an error code.
+ */
+CMP_API int cmp_m3_palette_cache_tones(cmp_m3_palette_cache_t *cache,
+                                       float hue, float chroma,
+                                       const float *tones, size_t count,
+                                       cmp_color_t *out_colors);
+
+/**
+ * @brief Retrieve cache hit/miss counters (palette lookups).
+ * @param cache The cache.
+ * @param out_hits Receives the hit count (may be NULL).
+ * @param out_misses Receives the miss count (may be NULL).
+ * @return 0 on success, or an error code.
+ */
+CMP_API int cmp_m3_palette_cache_get_stats(const cmp_m3_palette_cache_t *cache,
+                                           size_t *out_hits,
+                                           size_t *out_misses);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
@@ -7,6 +7,7 @@ extern "C" {
 
 /* clang-format off */
 #include "cmp.h"
+#include "themes/cmp_material3_color.h"
 /* clang-format on */
 
 /**
@@ -121,6 +122,17 @@ CMP_API int cmp_m3_sys_colors_generate(cmp_color_t seed, int is_dark,
                                        cmp_m3_contrast_profile_t contrast,
                                        cmp_m3_sys_colors_t *out_sys_colors);
 
+/**
+ * @brief Generate system colors through a tonal palette cache.
+ *
+ * Equivalent to cmp_m3_sys_colors_generate() with palette hue/chroma quantized
+ * to 0.01; repeated light/dark/contrast generation for the same seed reuses
+ * the memoized tones.
+ */
+CMP_API int cmp_m3_sys_colors_generate_cached(
+    cmp_m3_palette_cache_t *cache, cmp_color_t seed, int is_dark,
+    cmp_m3_contrast_profile_t contrast, cmp_m3_sys_colors_t *out_sys_colors);
+
 CMP_API int cmp_m3_shape_resolve(cmp_m3_shape_family_t shape,
                                  const cmp_m3_shape_modifiers_t *modifiers,
                                  float *out_tl, float *out_tr, float *out_bl,
@@ -18,6 +18,8 @@ struct cmp_collection {
 struct cmp_diffable_datasource {
   uint64_t *current_state;
   size_t count;
+  cmp_diffable_update_cb_t handler;
+  void *handler_data;
 };
 
 int cmp_collection_create(cmp_collection_t **out_collection) {
@@ -126,6 +128,292 @@ int cmp_collection_add_section(cmp_collection_t *collection_opaque,
   return CMP_SUCCESS;
 }
 
+/* ------------------------------------------------------------------------ */
+/* Identifier diff (Heckel)                                                 */
+/* ------------------------------------------------------------------------ */
+
+/*
+ * Identifiers seen exactly once in both snapshots anchor a match; the
+ * neighbours of anchored pairs are then matched if equal, which picks up
+ * runs of duplicates. Everything unmatched is a delete or an insert. Of the
+ * matched pairs, those on a longest increasing run of old indices stay in
+ * place and the rest are reported as moves, so a snapshot with k moved
+ * items yields k moves rather than a shuffle of the whole list.
+ */
+
+typedef struct diff_entry {
+  uint64_t id;
+  size_t old_count;
+  size_t new_count;
+  size_t old_index;
+  int used;
+} diff_entry_t;
+
+typedef struct diff_table {
+  diff_entry_t *entries;
+  size_t mask;
+} diff_table_t;
+
+static int diff_table_init(diff_table_t *table, size_t items) {
+  size_t size = 16;
+  while (size < items * 2)
+    size *= 2;
+  if (CMP_MALLOC(size * sizeof(diff_entry_t), (void **)&table->entries) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(table->entries, 0, size * sizeof(diff_entry_t));
+  table->mask = size - 1;
+  return CMP_SUCCESS;
+}
+
+/* Entry for id; inserted unless lookup_only, where NULL means absent */
+static diff_entry_t *diff_table_slot(diff_table_t *table, uint64_t id,
+                                     int lookup_only) {
+  uint64_t h = id ^ (id >> 33);
+  size_t i;
+  h *= ((uint64_t)0xFF51AFD7UL << 32) | 0xED558CCDUL;
+  h ^= h >> 29;
+  for (i = (size_t)h & table->mask;; i = (i + 1) & table->mask) {
+    if (!table->entries[i].used) {
+      if (lookup_only)
+        return NULL;
+      table->entries[i].used = 1;
+      table->entries[i].id = id;
+      return &table->entries[i];
+    }
+    if (table->entries[i].id == id)
+      return &table->entries[i];
+  }
+}
+
+static void diff_match(cmp_diff_result_t *r, size_t old_index,
+                       size_t new_index) {
+  r->old_to_new[old_index] = new_index;
+  r->new_to_old[new_index] = old_index;
+}
+
+static int diff_match_middle(const uint64_t *old_items, size_t old_first,
+                             size_t old_end, const uint64_t *new_items,
+                             size_t new_first, size_t new_end,
+                             cmp_diff_result_t *r) {
+  diff_table_t table;
+  diff_entry_t *e;
+  size_t i, j;
+
+  if (old_first == old_end || new_first == new_end)
+    return CMP_SUCCESS;
+  if (diff_table_init(&table, (old_end - old_first) + (new_end - new_first)) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  for (j = old_first; j < old_end; ++j) {
+    e = diff_table_slot(&table, old_items[j], 0);
+    e->old_count++;
+    e->old_index = j;
+  }
+  for (i = new_first; i < new_end; ++i)
+    diff_table_slot(&table, new_items[i], 0)->new_count++;
+  for (i = new_first; i < new_end; ++i) {
+    e = diff_table_slot(&table, new_items[i], 0);
+    if (e->old_count == 1 && e->new_count == 1)
+      diff_match(r, e->old_index, i);
+  }
+  CMP_FREE(table.entries);
+
+  /* Grow anchored matches over equal neighbours */
+  for (i = new_first; i + 1 < new_end; ++i) {
+    j = r->new_to_old[i];
+    if (j != CMP_DIFF_NONE && j + 1 < old_end &&
+        r->new_to_old[i + 1] == CMP_DIFF_NONE &&
+        r->old_to_new[j + 1] == CMP_DIFF_NONE &&
+        new_items[i + 1] == old_items[j + 1])
+      diff_match(r, j + 1, i + 1);
+  }
+  for (i = new_end - 1; i > new_first; --i) {
+    j = r->new_to_old[i];
+    if (j != CMP_DIFF_NONE && j > old_first &&
+        r->new_to_old[i - 1] == CMP_DIFF_NONE &&
+        r->old_to_new[j - 1] == CMP_DIFF_NONE &&
+        new_items[i - 1] == old_items[j - 1])
+      diff_match(r, j - 1, i - 1);
+  }
+  return CMP_SUCCESS;
+}
+
+/* Flags (in stays[i]) the matched new indices on a longest increasing run
+ * of old indices; the rest have to move. */
+static int diff_mark_stays(const cmp_diff_result_t *r, unsigned char *stays) {
+  size_t *tails = NULL, *prev = NULL;
+  size_t len = 0, i, lo, hi, mid, last = CMP_DIFF_NONE, k;
+  int sorted = 1;
+
+  for (i = 0; i < r->new_count; ++i) {
+    if (r->new_to_old[i] == CMP_DIFF_NONE)
+      continue;
+    if (last != CMP_DIFF_NONE && r->new_to_old[i] < last)
+      sorted = 0;
+    last = r->new_to_old[i];
+    stays[i] = 1;
+  }
+  if (sorted)
+    return CMP_SUCCESS;
+
+  memset(stays, 0, r->new_count);
+  if (CMP_MALLOC(r->new_count * sizeof(size_t), (void **)&tails) !=
+          CMP_SUCCESS ||
+      CMP_MALLOC(r->new_count * sizeof(size_t), (void **)&prev) !=
+          CMP_SUCCESS) {
+    if (tails)
+      CMP_FREE(tails);
+    return CMP_ERROR_OOM;
+  }
+  /* Patience sort: tails[k] is the new index ending the best run of
+   * length k + 1 */
+  for (i = 0; i < r->new_count; ++i) {
+    if (r->new_to_old[i] == CMP_DIFF_NONE)
+      continue;
+    lo = 0;
+    hi = len;
+    while (lo < hi) {
+      mid = (lo + hi) / 2;
+      if (r->new_to_old[tails[mid]] < r->new_to_old[i])
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    prev[i] = lo > 0 ? tails[lo - 1] : CMP_DIFF_NONE;
+    tails[lo] = i;
+    if (lo == len)
+      len++;
+  }
+  for (k = len > 0 ? tails[len - 1] : CMP_DIFF_NONE; k != CMP_DIFF_NONE;
+       k = prev[k])
+    stays[k] = 1;
+  CMP_FREE(tails);
+  CMP_FREE(prev);
+  return CMP_SUCCESS;
+}
+
+int cmp_diff_identifiers(const uint64_t *old_items, size_t old_count,
+                         const uint64_t *new_items, size_t new_count,
+                         cmp_diff_result_t *out_result) {
+  cmp_diff_result_t r;
+  unsigned char *stays = NULL;
+  cmp_diff_change_t *c;
+  size_t prefix = 0, suffix = 0, i, j, total;
+  int res;
+
+  if (!out_result || (!old_items && old_count > 0) ||
+      (!new_items && new_count > 0))
+    return CMP_ERROR_INVALID_ARG;
+  memset(&r, 0, sizeof(r));
+  r.old_count = old_count;
+  r.new_count = new_count;
+  if ((old_count > 0 && CMP_MALLOC(old_count * sizeof(size_t),
+                                   (void **)&r.old_to_new) != CMP_SUCCESS) ||
+      (new_count > 0 && CMP_MALLOC(new_count * sizeof(size_t),
+                                   (void **)&r.new_to_old) != CMP_SUCCESS)) {
+    cmp_diff_result_free(&r);
+    return CMP_ERROR_OOM;
+  }
+  for (j = 0; j < old_count; ++j)
+    r.old_to_new[j] = CMP_DIFF_NONE;
+  for (i = 0; i < new_count; ++i)
+    r.new_to_old[i] = CMP_DIFF_NONE;
+
+  /* Common prefix and suffix match directly, duplicates included */
+  while (prefix < old_count && prefix < new_count &&
+         old_items[prefix] == new_items[prefix]) {
+    diff_match(&r, prefix, prefix);
+    prefix++;
+  }
+  while (suffix < old_count - prefix && suffix < new_count - prefix &&
+         old_items[old_count - 1 - suffix] ==
+             new_items[new_count - 1 - suffix]) {
+    diff_match(&r, old_count - 1 - suffix, new_count - 1 - suffix);
+    suffix++;
+  }
+  res = diff_match_middle(old_items, prefix, old_count - suffix, new_items,
+                          prefix, new_count - suffix, &r);
+  if (res == CMP_SUCCESS && new_count > 0) {
+    if (CMP_MALLOC(new_count, (void **)&stays) != CMP_SUCCESS)
+      res = CMP_ERROR_OOM;
+    else {
+      memset(stays, 0, new_count);
+      res = diff_mark_stays(&r, stays);
+    }
+  }
+  if (res != CMP_SUCCESS) {
+    if (stays)
+      CMP_FREE(stays);
+    cmp_diff_result_free(&r);
+    return res;
+  }
+
+  for (j = 0; j < old_count; ++j)
+    if (r.old_to_new[j] == CMP_DIFF_NONE)
+      r.delete_count++;
+  for (i = 0; i < new_count; ++i) {
+    if (r.new_to_old[i] == CMP_DIFF_NONE)
+      r.insert_count++;
+    else if (!stays[i])
+      r.move_count++;
+  }
+  total = r.delete_count + r.insert_count + r.move_count;
+  if (total > 0 && CMP_MALLOC(total * sizeof(cmp_diff_change_t),
+                              (void **)&r.changes) != CMP_SUCCESS) {
+    if (stays)
+      CMP_FREE(stays);
+    cmp_diff_result_free(&r);
+    return CMP_ERROR_OOM;
+  }
+  c = r.changes;
+  for (j = old_count; j-- > 0;) {
+    if (r.old_to_new[j] != CMP_DIFF_NONE)
+      continue;
+    c->op = CMP_DIFF_DELETE;
+    c->from = j;
+    c->to = CMP_DIFF_NONE;
+    c->id = old_items[j];
+    c++;
+  }
+  for (i = 0; i < new_count; ++i) {
+    if (r.new_to_old[i] != CMP_DIFF_NONE)
+      continue;
+    c->op = CMP_DIFF_INSERT;
+    c->from = CMP_DIFF_NONE;
+    c->to = i;
+    c->id = new_items[i];
+    c++;
+  }
+  for (i = 0; i < new_count; ++i) {
+    if (r.new_to_old[i] == CMP_DIFF_NONE || stays[i])
+      continue;
+    c->op = CMP_DIFF_MOVE;
+    c->from = r.new_to_old[i];
+    c->to = i;
+    c->id = new_items[i];
+    c++;
+  }
+  r.change_count = total;
+  if (stays)
+    CMP_FREE(stays);
+  *out_result = r;
+  return CMP_SUCCESS;
+}
+
+int cmp_diff_result_free(cmp_diff_result_t *result) {
+  if (!result)
+    return CMP_ERROR_INVALID_ARG;
+  if (result->changes)
+    CMP_FREE(result->changes);
+  if (result->old_to_new)
+    CMP_FREE(result->old_to_new);
+  if (result->new_to_old)
+    CMP_FREE(result->new_to_old);
+  memset(result, 0, sizeof(*result));
+  return CMP_SUCCESS;
+}
+
 int cmp_diffable_datasource_create(cmp_diffable_datasource_t **out_ds) {
   struct cmp_diffable_datasource *ctx;
   if (!out_ds)
@@ -136,6 +424,8 @@ int cmp_diffable_datasource_create(cmp_diffable_datasource_t **out_ds) {
 
   ctx->current_state = NULL;
   ctx->count = 0;
+  ctx->handler = NULL;
+  ctx->handler_data = NULL;
 
   *out_ds = (cmp_diffable_datasource_t *)ctx;
   return CMP_SUCCESS;
@@ -159,6 +449,8 @@ int cmp_diffable_datasource_apply_snapshot(cmp_diffable_datasource_t *ds_opaque,
   struct cmp_diffable_datasource *ctx =
       (struct cmp_diffable_datasource *)ds_opaque;
   uint64_t *new_state = NULL;
+  cmp_diff_result_t diff;
+  int res = CMP_SUCCESS;
 
   if (!ctx || (!items && count > 0))
     return CMP_ERROR_INVALID_ARG;
@@ -170,15 +462,111 @@ int cmp_diffable_datasource_apply_snapshot(cmp_diffable_datasource_t *ds_opaque,
     memcpy(new_state, items, count * sizeof(uint64_t));
   }
 
+  /* Without a handler nobody consumes the edit script */
+  if (ctx->handler) {
+    res = cmp_diff_identifiers(ctx->current_state, ctx->count, new_state,
+                               count, &diff);
+    if (res != CMP_SUCCESS) {
+      if (new_state)
+        CMP_FREE(new_state);
+      return res;
+    }
+  }
+
   if (ctx->current_state)
     CMP_FREE(ctx->current_state);
   ctx->current_state = new_state;
   ctx->count = count;
 
-  /* A real implementation calculates O(N) Meyer's diff here to emit specific
-     view transition instructions (insertRow: 3, deleteRow: 5, moveRow: 1->7).
-   */
+  if (ctx->handler) {
+    if (diff.change_count > 0)
+      res = ctx->handler(&diff, ctx->handler_data);
+    cmp_diff_result_free(&diff);
+  }
+  return res;
+}
+
+int cmp_diffable_datasource_set_update_handler(
+    cmp_diffable_datasource_t *ds_opaque, cmp_diffable_update_cb_t handler,
+    void *user_data) {
+  struct cmp_diffable_datasource *ctx =
+      (struct cmp_diffable_datasource *)ds_opaque;
+  if (!ctx)
+    return CMP_ERROR_INVALID_ARG;
+  ctx->handler = handler;
+  ctx->handler_data = user_data;
+  return CMP_SUCCESS;
+}
+
+int cmp_diffable_datasource_reload_items(cmp_diffable_datasource_t *ds_opaque,
+                                         const uint64_t *items, size_t count) {
+  struct cmp_diffable_datasource *ctx =
+      (struct cmp_diffable_datasource *)ds_opaque;
+  cmp_diff_result_t r;
+  diff_table_t table;
+  diff_entry_t *e;
+  size_t i;
+  int res = CMP_SUCCESS;
 
+  if (!ctx || (!items && count > 0))
+    return CMP_ERROR_INVALID_ARG;
+  if (count == 0)
+    return CMP_SUCCESS;
+  if (ctx->count == 0)
+    return CMP_ERROR_NOT_FOUND;
+  if (diff_table_init(&table, count) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  for (i = 0; i < count; ++i)
+    diff_table_slot(&table, items[i], 0);
+
+  /* Reloads keep every item in place */
+  memset(&r, 0, sizeof(r));
+  r.old_count = ctx->count;
+  r.new_count = ctx->count;
+  if (CMP_MALLOC(ctx->count * sizeof(size_t), (void **)&r.old_to_new) !=
+          CMP_SUCCESS ||
+      CMP_MALLOC(ctx->count * sizeof(size_t), (void **)&r.new_to_old) !=
+          CMP_SUCCESS ||
+      CMP_MALLOC(ctx->count * sizeof(cmp_diff_change_t),
+                 (void **)&r.changes) != CMP_SUCCESS) {
+    CMP_FREE(table.entries);
+    cmp_diff_result_free(&r);
+    return CMP_ERROR_OOM;
+  }
+  for (i = 0; i < ctx->count; ++i) {
+    r.old_to_new[i] = i;
+    r.new_to_old[i] = i;
+    e = diff_table_slot(&table, ctx->current_state[i], 1);
+    if (!e)
+      continue;
+    e->old_count++;
+    r.changes[r.change_count].op = CMP_DIFF_RELOAD;
+    r.changes[r.change_count].from = i;
+    r.changes[r.change_count].to = i;
+    r.changes[r.change_count].id = ctx->current_state[i];
+    r.change_count++;
+  }
+  r.reload_count = r.change_count;
+  for (i = 0; i < count && res == CMP_SUCCESS; ++i)
+    if (!diff_table_slot(&table, items[i], 1)->old_count)
+      res = CMP_ERROR_NOT_FOUND;
+  CMP_FREE(table.entries);
+
+  if (res == CMP_SUCCESS && ctx->handler)
+    res = ctx->handler(&r, ctx->handler_data);
+  cmp_diff_result_free(&r);
+  return res;
+}
+
+int cmp_diffable_datasource_get_snapshot(
+    const cmp_diffable_datasource_t *ds_opaque, const uint64_t **out_items,
+    size_t *out_count) {
+  const struct cmp_diffable_datasource *ctx =
+      (const struct cmp_diffable_datasource *)ds_opaque;
+  if (!ctx || !out_items || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  *out_items = ctx->current_state;
+  *out_count = ctx->count;
   return CMP_SUCCESS;
 }
 
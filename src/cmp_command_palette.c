@@ -5,12 +5,127 @@
 #include <string.h>
 /* clang-format on */
 
+/* Candidate counts below this are always scored on the calling thread. */
+#define CMP_PALETTE_PARALLEL_MIN 16384
+
+/* Search index for one item, kept parallel to the items array. Strings and
+ * bitmaps live in the palette's text pool and are addressed by offset so
+ * the pool can grow. */
+typedef struct palette_entry {
+  size_t text; /* Lowercased display text */
+  size_t text_len;
+  size_t text_bounds; /* Word-boundary bitmap, one bit per byte */
+  size_t sub;         /* Lowercased subtext */
+  size_t sub_len;
+  size_t sub_bounds;
+  unsigned long text_mask; /* Character classes present, see class_bit */
+  unsigned long sub_mask;
+} palette_entry_t;
+
+/* A scored hit; ordering is score, then shorter text, then insertion. */
+typedef struct palette_hit {
+  int score;
+  size_t len;
+  size_t index;
+} palette_hit_t;
+
+struct cmp_command_palette;
+
+typedef struct palette_slice {
+  struct cmp_command_palette *palette;
+  size_t begin; /* Range of palette->matches to score */
+  size_t end;
+  size_t kept; /* Surviving matches, compacted to the front of the range */
+  palette_hit_t *heap;
+  size_t heap_count;
+  size_t k;
+  cmp_mutex_t *lock;
+  cmp_cond_t *done;
+  size_t *pending;
+} palette_slice_t;
+
 struct cmp_command_palette {
   cmp_command_item_t **items;
   size_t count;
   size_t capacity;
+
+  palette_entry_t *index;
+  char *pool;
+  size_t pool_len;
+  size_t pool_cap;
+
+  /* Full match set of the last query; a query extending it can only match
+   * a subset, so the next keystroke rescans just these */
+  size_t *matches;
+  size_t match_count;
+  size_t match_cap;
+  int matches_valid;
+  char *last_query; /* Lowercased */
+  size_t last_query_len;
+  size_t last_query_cap;
+
+  /* Query being scored */
+  char *query;
+  const char *query_orig;
+  size_t query_len;
+  unsigned long query_mask;
+
+  cmp_modality_t *workers;
+  size_t slices;
 };
 
+/* Maps a lowercased byte to one of 32 classes for the prefilter mask. */
+static unsigned long class_bit(unsigned char c) {
+  if (c >= 'a' && c <= 'z')
+    return 1ul << (c - 'a');
+  if (c >= '0' && c <= '9')
+    return 1ul << (26 + (c - '0') % 4);
+  if (c >= 0x80)
+    return 1ul << 30;
+  return 1ul << 31;
+}
+
+static int is_boundary_char(char c) {
+  return c == '/' || c == '\\' || c == ' ' || c == '_' || c == '.';
+}
+
+static int pool_reserve(cmp_command_palette_t *palette, size_t extra) {
+  if (!palette->pool || palette->pool_len + extra > palette->pool_cap) {
+    size_t cap = palette->pool_cap ? palette->pool_cap * 2 : 4096;
+    char *pool;
+    while (cap < palette->pool_len + extra)
+      cap *= 2;
+    pool = (char *)realloc(palette->pool, cap);
+    if (!pool)
+      return CMP_ERROR_OOM;
+    palette->pool = pool;
+    palette->pool_cap = cap;
+  }
+  return CMP_SUCCESS;
+}
+
+/* Appends the lowercased text and its boundary bitmap to the pool. */
+static void index_text(cmp_command_palette_t *palette, const char *text,
+                       size_t len, size_t *out_text, size_t *out_bounds,
+                       unsigned long *out_mask) {
+  char *lower = palette->pool + palette->pool_len;
+  unsigned char *bounds = (unsigned char *)lower + len;
+  unsigned long mask = 0;
+  size_t i;
+
+  memset(bounds, 0, (len + 7) / 8);
+  for (i = 0; i < len; ++i) {
+    lower[i] = (char)tolower((unsigned char)text[i]);
+    mask |= class_bit((unsigned char)lower[i]);
+    if (i == 0 || is_boundary_char(text[i - 1]))
+      bounds[i / 8] |= (unsigned char)(1u << (i % 8));
+  }
+  *out_text = palette->pool_len;
+  *out_bounds = palette->pool_len + len;
+  *out_mask = mask;
+  palette->pool_len += len + (len + 7) / 8;
+}
+
 int cmp_command_palette_create(cmp_command_palette_t **out_palette) {
   cmp_command_palette_t *palette;
   if (!out_palette) {
@@ -21,12 +136,17 @@ int cmp_command_palette_create(cmp_command_palette_t **out_palette) {
   if (!palette) {
     return CMP_ERROR_OOM;
   }
+  memset(palette, 0, sizeof(cmp_command_palette_t));
 
   palette->capacity = 64;
   palette->count = 0;
   palette->items = (cmp_command_item_t **)malloc(palette->capacity *
                                                  sizeof(cmp_command_item_t *));
-  if (!palette->items) {
+  palette->index =
+      (palette_entry_t *)malloc(palette->capacity * sizeof(palette_entry_t));
+  if (!palette->items || !palette->index) {
+    free(palette->items);
+    free(palette->index);
     free(palette);
     return CMP_ERROR_OOM;
   }
@@ -45,6 +165,11 @@ int cmp_command_palette_destroy(cmp_command_palette_t *palette) {
     free(palette->items[i]);
   }
   free(palette->items);
+  free(palette->index);
+  free(palette->pool);
+  free(palette->matches);
+  free(palette->last_query);
+  free(palette->query);
   free(palette);
   return CMP_SUCCESS;
 }
@@ -54,19 +179,28 @@ int cmp_command_palette_add_item(cmp_command_palette_t *palette, const char *id,
                                  const char *subtext) {
   cmp_command_item_t *item;
   cmp_command_item_t **new_array;
+  palette_entry_t *entry;
+  size_t text_len, sub_len;
 
   if (!palette || !id || !display_text) {
     return CMP_ERROR_INVALID_ARG;
   }
 
   if (palette->count == palette->capacity) {
-    palette->capacity *= 2;
+    palette_entry_t *new_index;
     new_array = (cmp_command_item_t **)realloc(
-        palette->items, palette->capacity * sizeof(cmp_command_item_t *));
+        palette->items, palette->capacity * 2 * sizeof(cmp_command_item_t *));
     if (!new_array) {
       return CMP_ERROR_OOM;
     }
     palette->items = new_array;
+    new_index = (palette_entry_t *)realloc(
+        palette->index, palette->capacity * 2 * sizeof(palette_entry_t));
+    if (!new_index) {
+      return CMP_ERROR_OOM;
+    }
+    palette->index = new_index;
+    palette->capacity *= 2;
   }
 
   item = (cmp_command_item_t *)malloc(sizeof(cmp_command_item_t));
@@ -87,120 +221,368 @@ int cmp_command_palette_add_item(cmp_command_palette_t *palette, const char *id,
     item->subtext[0] = '\0';
   }
 
+  text_len = strlen(item->display_text);
+  sub_len = strlen(item->subtext);
+  if (pool_reserve(palette, text_len + sub_len + (text_len + 7) / 8 +
+                                (sub_len + 7) / 8) != CMP_SUCCESS) {
+    free(item);
+    return CMP_ERROR_OOM;
+  }
+  entry = &palette->index[palette->count];
+  entry->text_len = text_len;
+  entry->sub_len = sub_len;
+  index_text(palette, item->display_text, text_len, &entry->text,
+             &entry->text_bounds, &entry->text_mask);
+  index_text(palette, item->subtext, sub_len, &entry->sub, &entry->sub_bounds,
+             &entry->sub_mask);
+
   item->score = 0;
   palette->items[palette->count++] = item;
+  palette->matches_valid = 0;
 
   return CMP_SUCCESS;
 }
 
-/* Very basic fuzzy matching score algorithm for strings. */
-static int fuzzy_score(const char *text, const char *query) {
-  const char *t = text;
-  const char *q = query;
+/* Very basic fuzzy matching score algorithm for strings. Query characters
+ * are matched greedily left to right; each jump uses memchr over the
+ * lowercased text, which libc vectorises, instead of a per-byte loop. */
+static int fuzzy_score(const cmp_command_palette_t *palette, const char *orig,
+                       size_t text, size_t len, size_t bounds_at) {
+  const char *lower = palette->pool + text;
+  const unsigned char *bounds =
+      (const unsigned char *)palette->pool + bounds_at;
+  size_t qi, pos = 0;
   int score = 0;
   int consecutive_matches = 0;
-  char t_char, q_char;
 
-  if (!*q) {
+  if (palette->query_len == 0) {
     return 1; /* Empty query matches everything but loosely */
   }
 
   /* Exact match check first */
-  if (strcmp(text, query) == 0) {
+  if (len == palette->query_len &&
+      memcmp(orig, palette->query_orig, len) == 0) {
     return 1000;
   }
 
-  while (*t && *q) {
-    t_char = (char)tolower((unsigned char)*t);
-    q_char = (char)tolower((unsigned char)*q);
-
-    if (t_char == q_char) {
-      score += 10 + (consecutive_matches * 5); /* Bonus for consecutive chars */
-      /* Small bonus if it matches at the beginning of the string or right after
-       * a boundary */
-      if (t == text || *(t - 1) == '/' || *(t - 1) == '\\' || *(t - 1) == ' ' ||
-          *(t - 1) == '_' || *(t - 1) == '.') {
-        score += 20;
-      }
-      consecutive_matches++;
-      q++;
-    } else {
+  for (qi = 0; qi < palette->query_len; ++qi) {
+    const char *hit;
+    size_t j;
+    if (pos >= len) {
+      return 0;
+    }
+    hit = (const char *)memchr(lower + pos, palette->query[qi], len - pos);
+    if (!hit) {
+      return 0; /* Must match all chars in query to be a valid hit */
+    }
+    j = (size_t)(hit - lower);
+    if (j != pos) {
       consecutive_matches = 0;
     }
-    t++;
-  }
-
-  /* Must match all chars in query to be a valid fuzzy hit */
-  if (*q) {
-    return 0;
+    score += 10 + (consecutive_matches * 5); /* Bonus for consecutive chars */
+    /* Small bonus at the beginning of the string or after a boundary */
+    if (bounds[j / 8] & (1u << (j % 8))) {
+      score += 20;
+    }
+    consecutive_matches++;
+    pos = j + 1;
   }
 
-  /* Add a bonus if we matched the whole text string entirely (exact match) */
-  if (!*t) {
-    score += 50;
+  if (pos == len) {
+    score += 50; /* Matched through to the end of the text */
   } else {
-    /* Penalize slightly for leftover characters to push shorter/exact matches
-     * to the top */
-    score -= (int)strlen(t);
+    /* Penalize leftover characters to push shorter matches to the top */
+    score -= (int)(len - pos);
   }
 
   return score > 0 ? score : 1; /* Minimum score of 1 if it matched */
 }
 
-/* Compare func for qsort descending */
-static int compare_items(const void *a, const void *b) {
-  const cmp_command_item_t *item_a = *(const cmp_command_item_t **)a;
-  const cmp_command_item_t *item_b = *(const cmp_command_item_t **)b;
-
-  if (item_a->score < item_b->score)
-    return 1;
-  if (item_a->score > item_b->score)
-    return -1;
+static int score_item(const cmp_command_palette_t *palette, size_t i) {
+  const palette_entry_t *e = &palette->index[i];
+  const cmp_command_item_t *item = palette->items[i];
+  int score = 0;
+  if ((e->text_mask & palette->query_mask) == palette->query_mask) {
+    score =
+        fuzzy_score(palette, item->display_text, e->text, e->text_len,
+                    e->text_bounds);
+  }
+  /* If the score is 0 on text, try the subtext */
+  if (score == 0 && e->sub_len > 0 &&
+      (e->sub_mask & palette->query_mask) == palette->query_mask) {
+    score = fuzzy_score(palette, item->subtext, e->sub, e->sub_len,
+                        e->sub_bounds);
+  }
+  return score;
+}
 
+/* Nonzero when a ranks above b. */
+static int hit_better(const palette_hit_t *a, const palette_hit_t *b) {
+  if (a->score != b->score)
+    return a->score > b->score;
   /* Fallback to length to favor shorter strings */
-  if (strlen(item_a->display_text) > strlen(item_b->display_text))
-    return 1;
-  if (strlen(item_a->display_text) < strlen(item_b->display_text))
-    return -1;
+  if (a->len != b->len)
+    return a->len < b->len;
+  return a->index < b->index;
+}
+
+/* Keeps the k best hits in a heap whose root is the worst of them. */
+static void heap_offer(palette_hit_t *heap, size_t *count, size_t k,
+                       const palette_hit_t *hit) {
+  size_t i, child;
+  palette_hit_t tmp;
+  if (k == 0)
+    return;
+  if (*count < k) {
+    i = (*count)++;
+    heap[i] = *hit;
+    while (i > 0 && hit_better(&heap[(i - 1) / 2], &heap[i])) {
+      tmp = heap[i];
+      heap[i] = heap[(i - 1) / 2];
+      heap[(i - 1) / 2] = tmp;
+      i = (i - 1) / 2;
+    }
+    return;
+  }
+  if (!hit_better(hit, &heap[0]))
+    return;
+  heap[0] = *hit;
+  i = 0;
+  for (;;) {
+    size_t worst = i;
+    child = 2 * i + 1;
+    if (child < *count && hit_better(&heap[worst], &heap[child]))
+      worst = child;
+    if (child + 1 < *count && hit_better(&heap[worst], &heap[child + 1]))
+      worst = child + 1;
+    if (worst == i)
+      break;
+    tmp = heap[i];
+    heap[i] = heap[worst];
+    heap[worst] = tmp;
+    i = worst;
+  }
+}
 
+/* Compare func for qsort descending */
+static int compare_hits(const void *a, const void *b) {
+  const palette_hit_t *hit_a = (const palette_hit_t *)a;
+  const palette_hit_t *hit_b = (const palette_hit_t *)b;
+  if (hit_better(hit_a, hit_b))
+    return -1;
+  if (hit_better(hit_b, hit_a))
+    return 1;
   return 0;
 }
 
+/* Scores palette->matches[begin, end), compacting survivors in place. */
+static void scan_slice(palette_slice_t *slice) {
+  cmp_command_palette_t *palette = slice->palette;
+  size_t i, out = slice->begin;
+  palette_hit_t hit;
+
+  slice->heap_count = 0;
+  for (i = slice->begin; i < slice->end; ++i) {
+    size_t index = palette->matches[i];
+    int score = score_item(palette, index);
+    palette->items[index]->score = score;
+    if (score > 0) {
+      palette->matches[out++] = index;
+      hit.score = score;
+      hit.len = palette->index[index].text_len;
+      hit.index = index;
+      heap_offer(slice->heap, &slice->heap_count, slice->k, &hit);
+    }
+  }
+  slice->kept = out - slice->begin;
+}
+
+static void scan_slice_task(void *arg) {
+  palette_slice_t *slice = (palette_slice_t *)arg;
+  scan_slice(slice);
+  cmp_mutex_lock(slice->lock);
+  (*slice->pending)--;
+  cmp_cond_signal(slice->done);
+  cmp_mutex_unlock(slice->lock);
+}
+
+/* Scores the candidate set, split across the worker modality when it is
+ * large enough; the calling thread always takes the first slice. */
+static int scan_candidates(cmp_command_palette_t *palette, size_t k,
+                           palette_hit_t *heap, size_t *out_heap_count) {
+  size_t n = palette->match_count, slices = 1, s, pending = 0, kept = 0;
+  palette_slice_t *parts;
+  palette_hit_t *heaps;
+  cmp_mutex_t lock;
+  cmp_cond_t done;
+
+  if (palette->workers && palette->slices > 1 &&
+      n >= CMP_PALETTE_PARALLEL_MIN) {
+    slices = palette->slices;
+    if (slices > n / (CMP_PALETTE_PARALLEL_MIN / 4))
+      slices = n / (CMP_PALETTE_PARALLEL_MIN / 4);
+  }
+
+  parts = (palette_slice_t *)malloc(slices * sizeof(palette_slice_t));
+  heaps = (palette_hit_t *)malloc(slices * (k ? k : 1) *
+                                  sizeof(palette_hit_t));
+  if (!parts || !heaps) {
+    free(parts);
+    free(heaps);
+    return CMP_ERROR_OOM;
+  }
+  if (slices > 1) {
+    cmp_mutex_init(&lock);
+    cmp_cond_init(&done);
+  }
+
+  for (s = 0; s < slices; ++s) {
+    parts[s].palette = palette;
+    parts[s].begin = n * s / slices;
+    parts[s].end = n * (s + 1) / slices;
+    parts[s].heap = heaps + s * (k ? k : 1);
+    parts[s].k = k;
+    parts[s].lock = &lock;
+    parts[s].done = &done;
+    parts[s].pending = &pending;
+  }
+
+  for (s = 1; s < slices; ++s) {
+    cmp_mutex_lock(&lock);
+    pending++;
+    cmp_mutex_unlock(&lock);
+    if (cmp_modality_queue_task(palette->workers, scan_slice_task,
+                                &parts[s]) != CMP_SUCCESS) {
+      /* Queue full: score this slice here instead */
+      scan_slice(&parts[s]);
+      cmp_mutex_lock(&lock);
+      pending--;
+      cmp_mutex_unlock(&lock);
+    }
+  }
+  scan_slice(&parts[0]);
+  if (slices > 1) {
+    cmp_mutex_lock(&lock);
+    while (pending > 0)
+      cmp_cond_wait(&done, &lock);
+    cmp_mutex_unlock(&lock);
+    cmp_cond_destroy(&done);
+    cmp_mutex_destroy(&lock);
+  }
+
+  /* Merge slice results in order so the match set stays sorted */
+  *out_heap_count = 0;
+  for (s = 0; s < slices; ++s) {
+    size_t h;
+    if (kept != parts[s].begin && parts[s].kept > 0)
+      memmove(palette->matches + kept, palette->matches + parts[s].begin,
+              parts[s].kept * sizeof(size_t));
+    kept += parts[s].kept;
+    for (h = 0; h < parts[s].heap_count; ++h)
+      heap_offer(heap, out_heap_count, k, &parts[s].heap[h]);
+  }
+  palette->match_count = kept;
+
+  free(parts);
+  free(heaps);
+  return CMP_SUCCESS;
+}
+
+int cmp_command_palette_set_workers(cmp_command_palette_t *palette,
+                                    cmp_modality_t *workers, size_t slices) {
+  if (!palette) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (workers && workers->type != CMP_MODALITY_THREADED) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  palette->workers = workers;
+  palette->slices = workers ? slices : 0;
+  return CMP_SUCCESS;
+}
+
 int cmp_command_palette_search(cmp_command_palette_t *palette,
                                const char *query,
                                cmp_command_item_t **out_results,
                                size_t max_results, size_t *out_count) {
-  size_t i, hits;
+  size_t i, len, heap_count = 0;
+  palette_hit_t *heap;
+  int narrowing, res;
 
   if (!palette || !query || !out_results || !out_count) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  hits = 0;
-  /* Calculate score for all */
-  for (i = 0; i < palette->count; i++) {
-    palette->items[i]->score =
-        fuzzy_score(palette->items[i]->display_text, query);
-
-    /* If the score is 0 on text, maybe try subtext? */
-    if (palette->items[i]->score == 0 &&
-        palette->items[i]->subtext[0] != '\0') {
-      palette->items[i]->score = fuzzy_score(palette->items[i]->subtext, query);
+  len = strlen(query);
+  if (len + 1 > palette->last_query_cap) {
+    size_t cap = len + 1 < 64 ? 64 : len + 1;
+    char *a = (char *)malloc(cap);
+    char *b = (char *)malloc(cap);
+    if (!a || !b) {
+      free(a);
+      free(b);
+      return CMP_ERROR_OOM;
     }
+    if (palette->last_query && palette->last_query_len > 0)
+      memcpy(a, palette->last_query, palette->last_query_len);
+    free(palette->last_query);
+    free(palette->query);
+    palette->last_query = a;
+    palette->query = b;
+    palette->last_query_cap = cap;
   }
-
-  /* Filter and add to results */
-  for (i = 0; i < palette->count; i++) {
-    if (palette->items[i]->score > 0) {
-      if (hits < max_results) {
-        out_results[hits++] = palette->items[i];
+  palette->query_mask = 0;
+  for (i = 0; i < len; ++i) {
+    palette->query[i] = (char)tolower((unsigned char)query[i]);
+    palette->query_mask |= class_bit((unsigned char)palette->query[i]);
+  }
+  palette->query_orig = query;
+  palette->query_len = len;
+
+  /* Typing more characters can only narrow the previous match set */
+  narrowing = palette->matches_valid && len >= palette->last_query_len &&
+              memcmp(palette->query, palette->last_query,
+                     palette->last_query_len) == 0;
+  if (!narrowing) {
+    if (!palette->matches || palette->match_cap < palette->count) {
+      size_t cap = palette->count ? palette->count : 1;
+      size_t *matches =
+          (size_t *)realloc(palette->matches, cap * sizeof(size_t));
+      if (!matches) {
+        return CMP_ERROR_OOM;
       }
+      palette->matches = matches;
+      palette->match_cap = cap;
     }
+    for (i = 0; i < palette->count; ++i) {
+      palette->matches[i] = i;
+    }
+    palette->match_count = palette->count;
   }
 
-  /* Sort the results array descending */
-  qsort(out_results, hits, sizeof(cmp_command_item_t *), compare_items);
+  heap = (palette_hit_t *)malloc((max_results ? max_results : 1) *
+                                 sizeof(palette_hit_t));
+  if (!heap) {
+    palette->matches_valid = 0;
+    return CMP_ERROR_OOM;
+  }
+  res = scan_candidates(palette, max_results, heap, &heap_count);
+  if (res != CMP_SUCCESS) {
+    free(heap);
+    palette->matches_valid = 0;
+    return res;
+  }
+  memcpy(palette->last_query, palette->query, len);
+  palette->last_query_len = len;
+  palette->matches_valid = 1;
+
+  /* Sort the kept hits descending */
+  qsort(heap, heap_count, sizeof(palette_hit_t), compare_hits);
+  for (i = 0; i < heap_count; ++i) {
+    out_results[i] = palette->items[heap[i].index];
+  }
+  free(heap);
 
-  *out_count = hits;
+  *out_count = heap_count;
   return CMP_SUCCESS;
 }
@@ -0,0 +1,1370 @@
+/* clang-format off */
+#include "cmp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GRID_SSE2 1
+#endif
+/* clang-format on */
+
+/*
+ * Columns are stored as flat typed arrays; strings are dictionary encoded
+ * so a column holds one uint32_t code per row. A refresh turns the filters
+ * into a byte mask per row (compare kernels run two doubles or four codes
+ * per SSE2 instruction over the contiguous column), compacts it into row
+ * ids and sorts those with an LSD radix sort per key, last key first,
+ * which keeps equal rows in their previous order. The view only owns text
+ * nodes for the visible rows x columns and recycles them while scrolling.
+ */
+
+typedef struct grid_column {
+  char *name;
+  cmp_column_type_t type;
+  void *data; /* int64_t, double or uint32_t codes */
+  size_t count;
+  size_t cap;
+
+  /* String dictionary */
+  char **dict;
+  size_t dict_count;
+  size_t dict_cap;
+  uint32_t *dict_table; /* Open addressing, code + 1, 0 = empty */
+  size_t dict_mask;
+} grid_column_t;
+
+typedef struct grid_filter {
+  size_t column;
+  cmp_datagrid_filter_op_t op;
+  int64_t i64;
+  double f64;
+  char *str;
+} grid_filter_t;
+
+typedef struct grid_job {
+  struct cmp_datagrid_model *model;
+  struct grid_job *next;
+  unsigned long generation;
+  grid_filter_t *filters;
+  size_t filter_count;
+  cmp_datagrid_sort_key_t *keys;
+  size_t key_count;
+  size_t row_count;
+  uint32_t *rows;
+  size_t rows_count;
+  int res;
+  cmp_datagrid_refresh_cb_t cb;
+  void *user_data;
+} grid_job_t;
+
+struct cmp_datagrid_model {
+  grid_column_t *columns;
+  size_t column_count;
+  size_t column_cap;
+
+  grid_filter_t *filters;
+  size_t filter_count;
+  cmp_datagrid_sort_key_t *keys;
+  size_t key_count;
+
+  /* Rows of the current view, in display order */
+  uint32_t *rows;
+  size_t rows_count;
+  int has_view; /* Without a refresh the view is every row in order */
+
+  cmp_modality_t *workers;
+  cmp_modality_t *ui;
+  grid_job_t *jobs; /* In flight, columns are read-only meanwhile */
+  unsigned long generation;
+  int destroyed;
+};
+
+/* ------------------------------------------------------------------------ */
+/* Columns                                                                  */
+/* ------------------------------------------------------------------------ */
+
+static size_t grid_value_size(cmp_column_type_t type) {
+  if (type == CMP_COLUMN_INT64)
+    return sizeof(int64_t);
+  if (type == CMP_COLUMN_DOUBLE)
+    return sizeof(double);
+  return sizeof(uint32_t);
+}
+
+static int grid_reserve(void **data, size_t *cap, size_t need, size_t size) {
+  void *grown;
+  size_t new_cap = *cap ? *cap : 64;
+  if (need <= *cap)
+    return CMP_SUCCESS;
+  while (new_cap < need)
+    new_cap *= 2;
+  if (CMP_MALLOC(new_cap * size, &grown) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  if (*data) {
+    memcpy(grown, *data, *cap * size);
+    CMP_FREE(*data);
+  }
+  *data = grown;
+  *cap = new_cap;
+  return CMP_SUCCESS;
+}
+
+static uint32_t grid_hash(const char *s) {
+  uint32_t h = 2166136261UL;
+  for (; *s; ++s)
+    h = (h ^ (unsigned char)*s) * 16777619UL;
+  return h;
+}
+
+/* Code of s in the dictionary, or (uint32_t)-1 */
+static uint32_t grid_dict_find(const grid_column_t *col, const char *s) {
+  size_t i;
+  uint32_t code;
+  if (!col->dict_table)
+    return (uint32_t)-1;
+  for (i = grid_hash(s) & col->dict_mask;; i = (i + 1) & col->dict_mask) {
+    code = col->dict_table[i];
+    if (code == 0)
+      return (uint32_t)-1;
+    if (strcmp(col->dict[code - 1], s) == 0)
+      return code - 1;
+  }
+}
+
+static int grid_dict_rehash(grid_column_t *col, size_t size) {
+  uint32_t *table;
+  size_t i, j;
+  if (CMP_MALLOC(size * sizeof(uint32_t), (void **)&table) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(table, 0, size * sizeof(uint32_t));
+  for (i = 0; i < col->dict_count; ++i) {
+    for (j = grid_hash(col->dict[i]) & (size - 1); table[j];
+         j = (j + 1) & (size - 1))
+      ;
+    table[j] = (uint32_t)(i + 1);
+  }
+  if (col->dict_table)
+    CMP_FREE(col->dict_table);
+  col->dict_table = table;
+  col->dict_mask = size - 1;
+  return CMP_SUCCESS;
+}
+
+static int grid_dict_intern(grid_column_t *col, const char *s,
+                            uint32_t *out_code) {
+  uint32_t code = grid_dict_find(col, s);
+  size_t len, i;
+  char *copy;
+  if (code != (uint32_t)-1) {
+    *out_code = code;
+    return CMP_SUCCESS;
+  }
+  if ((col->dict_count + 1) * 2 > col->dict_mask + 1 || !col->dict_table) {
+    if (grid_dict_rehash(col, col->dict_table ? (col->dict_mask + 1) * 2
+                                              : 64) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+  }
+  if (grid_reserve((void **)&col->dict, &col->dict_cap, col->dict_count + 1,
+                   sizeof(char *)) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  len = strlen(s);
+  if (CMP_MALLOC(len + 1, (void **)&copy) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memcpy(copy, s, len + 1);
+  col->dict[col->dict_count] = copy;
+  for (i = grid_hash(s) & col->dict_mask; col->dict_table[i];
+       i = (i + 1) & col->dict_mask)
+    ;
+  col->dict_table[i] = (uint32_t)(++col->dict_count);
+  *out_code = (uint32_t)(col->dict_count - 1);
+  return CMP_SUCCESS;
+}
+
+static void grid_column_free(grid_column_t *col) {
+  size_t i;
+  if (col->name)
+    CMP_FREE(col->name);
+  if (col->data)
+    CMP_FREE(col->data);
+  for (i = 0; i < col->dict_count; ++i)
+    CMP_FREE(col->dict[i]);
+  if (col->dict)
+    CMP_FREE(col->dict);
+  if (col->dict_table)
+    CMP_FREE(col->dict_table);
+}
+
+static size_t grid_row_count(const struct cmp_datagrid_model *model) {
+  size_t i, rows = 0;
+  for (i = 0; i < model->column_count; ++i)
+    if (i == 0 || model->columns[i].count < rows)
+      rows = model->columns[i].count;
+  return rows;
+}
+
+static void grid_filters_free(grid_filter_t *filters, size_t count) {
+  size_t i;
+  for (i = 0; i < count; ++i)
+    if (filters[i].str)
+      CMP_FREE(filters[i].str);
+  if (filters)
+    CMP_FREE(filters);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Filter kernels                                                           */
+/* ------------------------------------------------------------------------ */
+
+#define GRID_SCALAR_LOOP(EXPR)                                                 \
+  for (; i < n; ++i)                                                           \
+  mask[i] &= (unsigned char)(EXPR)
+
+#ifdef GRID_SSE2
+#define GRID_PD_LOOP(CMP)                                                      \
+  for (; i + 2 <= n; i += 2) {                                                 \
+    int m = _mm_movemask_pd(CMP(_mm_loadu_pd(v + i), kk));                     \
+    mask[i] &= (unsigned char)(m & 1);                                         \
+    mask[i + 1] &= (unsigned char)(m >> 1);                                    \
+  }
+#else
+#define GRID_PD_LOOP(CMP)
+#endif
+
+static void grid_filter_double(const double *v, size_t n,
+                               cmp_datagrid_filter_op_t op, double k,
+                               unsigned char *mask) {
+  size_t i = 0;
+#ifdef GRID_SSE2
+  __m128d kk = _mm_set1_pd(k);
+#endif
+  switch (op) {
+  case CMP_DATAGRID_FILTER_EQ:
+    GRID_PD_LOOP(_mm_cmpeq_pd)
+    GRID_SCALAR_LOOP(v[i] == k);
+    break;
+  case CMP_DATAGRID_FILTER_NE:
+    GRID_PD_LOOP(_mm_cmpneq_pd)
+    GRID_SCALAR_LOOP(!(v[i] == k));
+    break;
+  case CMP_DATAGRID_FILTER_LT:
+    GRID_PD_LOOP(_mm_cmplt_pd)
+    GRID_SCALAR_LOOP(v[i] < k);
+    break;
+  case CMP_DATAGRID_FILTER_LE:
+    GRID_PD_LOOP(_mm_cmple_pd)
+    GRID_SCALAR_LOOP(v[i] <= k);
+    break;
+  case CMP_DATAGRID_FILTER_GT:
+    GRID_PD_LOOP(_mm_cmpgt_pd)
+    GRID_SCALAR_LOOP(v[i] > k);
+    break;
+  case CMP_DATAGRID_FILTER_GE:
+    GRID_PD_LOOP(_mm_cmpge_pd)
+    GRID_SCALAR_LOOP(v[i] >= k);
+    break;
+  }
+}
+
+/* SSE2 has no 64-bit integer compare; these branchless loops are left to
+ * the compiler's vectorizer. */
+static void grid_filter_int64(const int64_t *v, size_t n,
+                              cmp_datagrid_filter_op_t op, int64_t k,
+                              unsigned char *mask) {
+  size_t i = 0;
+  switch (op) {
+  case CMP_DATAGRID_FILTER_EQ:
+    GRID_SCALAR_LOOP(v[i] == k);
+    break;
+  case CMP_DATAGRID_FILTER_NE:
+    GRID_SCALAR_LOOP(v[i] != k);
+    break;
+  case CMP_DATAGRID_FILTER_LT:
+    GRID_SCALAR_LOOP(v[i] < k);
+    break;
+  case CMP_DATAGRID_FILTER_LE:
+    GRID_SCALAR_LOOP(v[i] <= k);
+    break;
+  case CMP_DATAGRID_FILTER_GT:
+    GRID_SCALAR_LOOP(v[i] > k);
+    break;
+  case CMP_DATAGRID_FILTER_GE:
+    GRID_SCALAR_LOOP(v[i] >= k);
+    break;
+  }
+}
+
+/* Equality on dictionary codes; ne flips the result */
+static void grid_filter_code(const uint32_t *v, size_t n, uint32_t k, int ne,
+                             unsigned char *mask) {
+  size_t i = 0;
+  unsigned char flip = (unsigned char)(ne ? 1 : 0);
+#ifdef GRID_SSE2
+  __m128i kk = _mm_set1_epi32((int)k);
+  int m, f = ne ? 0xF : 0;
+  for (; i + 4 <= n; i += 4) {
+    m = _mm_movemask_ps(_mm_castsi128_ps(
+            _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)(v + i)), kk))) ^
+        f;
+    mask[i] &= (unsigned char)(m & 1);
+    mask[i + 1] &= (unsigned char)((m >> 1) & 1);
+    mask[i + 2] &= (unsigned char)((m >> 2) & 1);
+    mask[i + 3] &= (unsigned char)(m >> 3);
+  }
+#endif
+  GRID_SCALAR_LOOP((v[i] == k) ^ flip);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Sort                                                                     */
+/* ------------------------------------------------------------------------ */
+
+typedef struct grid_dict_item {
+  const char *s;
+  uint32_t code;
+} grid_dict_item_t;
+
+static int grid_dict_item_cmp(const void *a, const void *b) {
+  return strcmp(((const grid_dict_item_t *)a)->s,
+                ((const grid_dict_item_t *)b)->s);
+}
+
+/* rank[code] orders the dictionary by byte value */
+static int grid_dict_ranks(const grid_column_t *col, uint32_t **out_ranks) {
+  grid_dict_item_t *items;
+  uint32_t *ranks;
+  size_t i, n = col->dict_count ? col->dict_count : 1;
+  if (CMP_MALLOC(n * sizeof(grid_dict_item_t), (void **)&items) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  if (CMP_MALLOC(n * sizeof(uint32_t), (void **)&ranks) != CMP_SUCCESS) {
+    CMP_FREE(items);
+    return CMP_ERROR_OOM;
+  }
+  for (i = 0; i < col->dict_count; ++i) {
+    items[i].s = col->dict[i];
+    items[i].code = (uint32_t)i;
+  }
+  qsort(items, col->dict_count, sizeof(grid_dict_item_t), grid_dict_item_cmp);
+  for (i = 0; i < col->dict_count; ++i)
+    ranks[items[i].code] = (uint32_t)i;
+  CMP_FREE(items);
+  *out_ranks = ranks;
+  return CMP_SUCCESS;
+}
+
+/* Maps a value to an unsigned key with the same order; -0.0 == +0.0 */
+static uint64_t grid_key_double(double d) {
+  uint64_t bits;
+  if (d == 0.0)
+    d = 0.0;
+  memcpy(&bits, &d, sizeof(bits));
+  return (bits >> 63) ? ~bits : bits | ((uint64_t)1 << 63);
+}
+
+static int grid_sort_rows(const grid_column_t *columns,
+                          const cmp_datagrid_sort_key_t *keys,
+                          size_t key_count, uint32_t *rows, size_t n) {
+  uint64_t *k0 = NULL, *k1 = NULL, *kt;
+  uint32_t *r0 = rows, *r1 = NULL, *rt, *ranks = NULL;
+  size_t (*hist)[256] = NULL;
+  size_t i, b, sum, t, k;
+  int res = CMP_ERROR_OOM;
+
+  if (n < 2 || key_count == 0)
+    return CMP_SUCCESS;
+  if (CMP_MALLOC(n * sizeof(uint64_t), (void **)&k0) != CMP_SUCCESS ||
+      CMP_MALLOC(n * sizeof(uint64_t), (void **)&k1) != CMP_SUCCESS ||
+      CMP_MALLOC(n * sizeof(uint32_t), (void **)&r1) != CMP_SUCCESS ||
+      CMP_MALLOC(8 * 256 * sizeof(size_t), (void **)&hist) != CMP_SUCCESS)
+    goto done;
+
+  for (k = key_count; k-- > 0;) {
+    const grid_column_t *col = &columns[keys[k].column];
+    uint64_t flip = keys[k].descending ? ~(uint64_t)0 : 0;
+
+    if (col->type == CMP_COLUMN_INT64) {
+      const int64_t *v = (const int64_t *)col->data;
+      for (i = 0; i < n; ++i)
+        k0[i] = ((uint64_t)v[r0[i]] ^ ((uint64_t)1 << 63)) ^ flip;
+    } else if (col->type == CMP_COLUMN_DOUBLE) {
+      const double *v = (const double *)col->data;
+      for (i = 0; i < n; ++i)
+        k0[i] = grid_key_double(v[r0[i]]) ^ flip;
+    } else {
+      const uint32_t *v = (const uint32_t *)col->data;
+      if (grid_dict_ranks(col, &ranks) != CMP_SUCCESS)
+        goto done;
+      for (i = 0; i < n; ++i)
+        k0[i] = (uint64_t)ranks[v[r0[i]]] ^ flip;
+      CMP_FREE(ranks);
+      ranks = NULL;
+    }
+
+    memset(hist, 0, 8 * 256 * sizeof(size_t));
+    for (i = 0; i < n; ++i)
+      for (b = 0; b < 8; ++b)
+        hist[b][(k0[i] >> (8 * b)) & 0xFF]++;
+    for (b = 0; b < 8; ++b) {
+      /* Every key shares this byte */
+      if (hist[b][(k0[0] >> (8 * b)) & 0xFF] == n)
+        continue;
+      for (i = 0, sum = 0; i < 256; ++i) {
+        t = hist[b][i];
+        hist[b][i] = sum;
+        sum += t;
+      }
+      for (i = 0; i < n; ++i) {
+        t = hist[b][(k0[i] >> (8 * b)) & 0xFF]++;
+        k1[t] = k0[i];
+        r1[t] = r0[i];
+      }
+      kt = k0;
+      k0 = k1;
+      k1 = kt;
+      rt = r0;
+      r0 = r1;
+      r1 = rt;
+    }
+  }
+  if (r0 != rows) {
+    memcpy(rows, r0, n * sizeof(uint32_t));
+    r1 = r0;
+  }
+  res = CMP_SUCCESS;
+
+done:
+  if (k0)
+    CMP_FREE(k0);
+  if (k1)
+    CMP_FREE(k1);
+  if (r1)
+    CMP_FREE(r1);
+  if (hist)
+    CMP_FREE(hist);
+  return res;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Refresh                                                                  */
+/* ------------------------------------------------------------------------ */
+
+static void grid_model_free(struct cmp_datagrid_model *model);
+
+/* Runs filters and sort for a job; reads columns only */
+static void grid_job_run(grid_job_t *job) {
+  const grid_column_t *columns = job->model->columns;
+  unsigned char *mask = NULL;
+  size_t i, n = job->row_count, count = 0;
+
+  if (CMP_MALLOC(n ? n * sizeof(uint32_t) : 1, (void **)&job->rows) !=
+      CMP_SUCCESS) {
+    job->res = CMP_ERROR_OOM;
+    return;
+  }
+  if (job->filter_count > 0) {
+    if (CMP_MALLOC(n ? n : 1, (void **)&mask) != CMP_SUCCESS) {
+      job->res = CMP_ERROR_OOM;
+      return;
+    }
+    memset(mask, 1, n);
+    for (i = 0; i < job->filter_count; ++i) {
+      const grid_filter_t *f = &job->filters[i];
+      const grid_column_t *col = &columns[f->column];
+      uint32_t code;
+      if (col->type == CMP_COLUMN_INT64) {
+        grid_filter_int64((const int64_t *)col->data, n, f->op, f->i64, mask);
+      } else if (col->type == CMP_COLUMN_DOUBLE) {
+        grid_filter_double((const double *)col->data, n, f->op, f->f64,
+                           mask);
+      } else {
+        code = grid_dict_find(col, f->str);
+        if (code != (uint32_t)-1)
+          grid_filter_code((const uint32_t *)col->data, n, code,
+                           f->op == CMP_DATAGRID_FILTER_NE, mask);
+        else if (f->op == CMP_DATAGRID_FILTER_EQ)
+          memset(mask, 0, n);
+      }
+    }
+    for (i = 0; i < n; ++i) {
+      job->rows[count] = (uint32_t)i;
+      count += mask[i];
+    }
+    CMP_FREE(mask);
+  } else {
+    for (i = 0; i < n; ++i)
+      job->rows[i] = (uint32_t)i;
+    count = n;
+  }
+  job->rows_count = count;
+  job->res =
+      grid_sort_rows(columns, job->keys, job->key_count, job->rows, count);
+}
+
+static void grid_job_free(grid_job_t *job) {
+  grid_filters_free(job->filters, job->filter_count);
+  if (job->keys)
+    CMP_FREE(job->keys);
+  if (job->rows)
+    CMP_FREE(job->rows);
+  CMP_FREE(job);
+}
+
+static void grid_job_deliver(void *arg) {
+  grid_job_t *job = (grid_job_t *)arg;
+  struct cmp_datagrid_model *model = job->model;
+  grid_job_t **link = &model->jobs;
+
+  while (*link && *link != job)
+    link = &(*link)->next;
+  if (*link)
+    *link = job->next;
+
+  /* A newer refresh supersedes this one */
+  if (!model->destroyed && job->generation == model->generation) {
+    if (job->res == CMP_SUCCESS) {
+      if (model->rows)
+        CMP_FREE(model->rows);
+      model->rows = job->rows;
+      model->rows_count = job->rows_count;
+      model->has_view = 1;
+      job->rows = NULL;
+    }
+    if (job->cb)
+      job->cb((cmp_datagrid_model_t *)model, job->res, job->user_data);
+  }
+  grid_job_free(job);
+
+  if (model->destroyed && !model->jobs)
+    grid_model_free(model);
+}
+
+static void grid_job_task(void *arg) {
+  grid_job_t *job = (grid_job_t *)arg;
+  grid_job_run(job);
+  cmp_modality_queue_task(job->model->ui, grid_job_deliver, job);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Model API                                                                */
+/* ------------------------------------------------------------------------ */
+
+int cmp_datagrid_model_create(cmp_datagrid_model_t **out_model) {
+  struct cmp_datagrid_model *model;
+  if (!out_model)
+    return CMP_ERROR_INVALID_ARG;
+  if (CMP_MALLOC(sizeof(struct cmp_datagrid_model), (void **)&model) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(model, 0, sizeof(struct cmp_datagrid_model));
+  *out_model = (cmp_datagrid_model_t *)model;
+  return CMP_SUCCESS;
+}
+
+static void grid_model_free(struct cmp_datagrid_model *model) {
+  size_t i;
+  for (i = 0; i < model->column_count; ++i)
+    grid_column_free(&model->columns[i]);
+  if (model->columns)
+    CMP_FREE(model->columns);
+  grid_filters_free(model->filters, model->filter_count);
+  if (model->keys)
+    CMP_FREE(model->keys);
+  if (model->rows)
+    CMP_FREE(model->rows);
+  CMP_FREE(model);
+}
+
+int cmp_datagrid_model_destroy(cmp_datagrid_model_t *model_opaque) {
+  struct cmp_datagrid_model *model =
+      (struct cmp_datagrid_model *)model_opaque;
+  if (!model)
+    return CMP_ERROR_INVALID_ARG;
+  /* Refreshes in flight still read the columns; the last one to be
+   * delivered releases the model */
+  if (model->jobs)
+    model->destroyed = 1;
+  else
+    grid_model_free(model);
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_model_add_column(cmp_datagrid_model_t *model_opaque,
+                                  const char *name, cmp_column_type_t type,
+                                  size_t *out_column) {
+  struct cmp_datagrid_model *model =
+      (struct cmp_datagrid_model *)model_opaque;
+  grid_column_t *col;
+  size_t len;
+  if (!model || !name || type < CMP_COLUMN_INT64 || type > CMP_COLUMN_STRING)
+    return CMP_ERROR_INVALID_ARG;
+  if (model->jobs)
+    return CMP_ERROR_INVALID_STATE;
+  if (grid_reserve((void **)&model->columns, &model->column_cap,
+                   model->column_count + 1,
+                   sizeof(grid_column_t)) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  col = &model->columns[model->column_count];
+  memset(col, 0, sizeof(grid_column_t));
+  len = strlen(name);
+  if (CMP_MALLOC(len + 1, (void **)&col->name) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memcpy(col->name, name, len + 1);
+  col->type = type;
+  if (out_column)
+    *out_column = model->column_count;
+  model->column_count++;
+  return CMP_SUCCESS;
+}
+
+static int grid_append_check(struct cmp_datagrid_model *model, size_t column,
+                             cmp_column_type_t type, const void *values,
+                             size_t count) {
+  if (!model || (!values && count > 0) || column >= model->column_count ||
+      model->columns[column].type != type)
+    return CMP_ERROR_INVALID_ARG;
+  if (model->jobs)
+    return CMP_ERROR_INVALID_STATE;
+  if (model->columns[column].count + count > (uint32_t)-1)
+    return CMP_ERROR_BOUNDS;
+  return grid_reserve(&model->columns[column].data,
+                      &model->columns[column].cap,
+                      model->columns[column].count + count,
+                      grid_value_size(type));
+}
+
+int cmp_datagrid_model_append_int64(cmp_datagrid_model_t *model_opaque,
+                                    size_t column, const int64_t *values,
+                                    size_t count) {
+  struct cmp_datagrid_model *model =
+      (struct cmp_datagrid_model *)model_opaque;
+  grid_column_t *col;
+  int res = grid_append_check(model, column, CMP_COLUMN_INT64, values, count);
+  if (res != CMP_SUCCESS)
+    return res;
+  col = &model->columns[column];
+  memcpy((int64_t *)col->data + col->count, values, count * sizeof(int64_t));
+  col->count += count;
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_model_append_double(cmp_datagrid_model_t *model_opaque,
+                                     size_t column, const double *values,
+                                     size_t count) {
+  struct cmp_datagrid_model *model =
+      (struct cmp_datagrid_model *)model_opaque;
+  grid_column_t *col;
+  int res =
+      grid_append_check(model, column, CMP_COLUMN_DOUBLE, values, count);
+  if (res != CMP_SUCCESS)
+    return res;
+  col = &model->columns[column];
+  memcpy((double *)col->data + col->count, values, count * sizeof(double));
+  col->count += count;
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_model_append_strings(cmp_datagrid_model_t *model_opaque,
+                                      size_t column,
+                                      const char *const *values,
+                                      size_t count) {
+  struct cmp_datagrid_model *model =
+      (struct cmp_datagrid_model *)model_opaque;
+  grid_column_t *col;
+  size_t i;
+  uint32_t code;
+  int res =
+      grid_append_check(model, column, CMP_COLUMN_STRING, values, count);
+  if (res != CMP_SUCCESS)
+    return res;
+  col = &model->columns[column];
+  for (i = 0; i < count; ++i) {
+    res = grid_dict_intern(col, values[i] ? values[i] : "", &code);
+    if (res != CMP_SUCCESS)
+      return res; /* Rows appended so far stay */
+    ((uint32_t *)col->data)[col->count++] = code;
+  }
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_model_get_column_count(
+    const cmp_datagrid_model_t *model_opaque, size_t *out_count) {
+  const struct cmp_datagrid_model *model =
+      (const struct cmp_datagrid_model *)model_opaque;
+  if (!model || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  *out_count = model->column_count;
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_model_get_column_name(
+    const cmp_datagrid_model_t *model_opaque, size_t column,
+    const char **out_name) {
+  const struct cmp_datagrid_model *model =
+      (const struct cmp_datagrid_model *)model_opaque;
+  if (!model || !out_name)
+    return CMP_ERROR_INVALID_ARG;
+  if (column >= model->column_count)
+    return CMP_ERROR_BOUNDS;
+  *out_name = model->columns[column].name;
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_model_get_row_count(const cmp_datagrid_model_t *model_opaque,
+                                     size_t *out_rows) {
+  const struct cmp_datagrid_model *model =
+      (const struct cmp_datagrid_model *)model_opaque;
+  if (!model || !out_rows)
+    return CMP_ERROR_INVALID_ARG;
+  *out_rows = grid_row_count(model);
+  return CMP_SUCCESS;
+}
+
+static int grid_cell_check(const struct cmp_datagrid_model *model,
+                           size_t column, size_t row, cmp_column_type_t type,
+                           const void *out) {
+  if (!model || !out || column >= model->column_count ||
+      model->columns[column].type != type)
+    return CMP_ERROR_INVALID_ARG;
+  if (row >= model->columns[column].count)
+    return CMP_ERROR_BOUNDS;
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_model_get_int64(const cmp_datagrid_model_t *model_opaque,
+                                 size_t column, size_t row,
+                                 int64_t *out_value) {
+  const struct cmp_datagrid_model *model =
+      (const struct cmp_datagrid_model *)model_opaque;
+  int res = grid_cell_check(model, column, row, CMP_COLUMN_INT64, out_value);
+  if (res == CMP_SUCCESS)
+    *out_value = ((const int64_t *)model->columns[column].data)[row];
+  return res;
+}
+
+int cmp_datagrid_model_get_double(const cmp_datagrid_model_t *model_opaque,
+                                  size_t column, size_t row,
+                                  double *out_value) {
+  const struct cmp_datagrid_model *model =
+      (const struct cmp_datagrid_model *)model_opaque;
+  int res = grid_cell_check(model, column, row, CMP_COLUMN_DOUBLE, out_value);
+  if (res == CMP_SUCCESS)
+    *out_value = ((const double *)model->columns[column].data)[row];
+  return res;
+}
+
+int cmp_datagrid_model_get_string(const cmp_datagrid_model_t *model_opaque,
+                                  size_t column, size_t row,
+                                  const char **out_value) {
+  const struct cmp_datagrid_model *model =
+      (const struct cmp_datagrid_model *)model_opaque;
+  const grid_column_t *col;
+  int res = grid_cell_check(model, column, row, CMP_COLUMN_STRING, out_value);
+  if (res == CMP_SUCCESS) {
+    col = &model->columns[column];
+    *out_value = col->dict[((const uint32_t *)col->data)[row]];
+  }
+  return res;
+}
+
+int cmp_datagrid_model_format_cell(const cmp_datagrid_model_t *model_opaque,
+                                   size_t column, size_t row, char *buffer,
+                                   size_t capacity) {
+  const struct cmp_datagrid_model *model =
+      (const struct cmp_datagrid_model *)model_opaque;
+  const grid_column_t *col;
+  char num[40];
+  const char *text = num;
+  size_t len;
+  int64_t v;
+  uint64_t mag;
+  char *p;
+
+  if (!model || !buffer || capacity == 0 || column >= model->column_count)
+    return CMP_ERROR_INVALID_ARG;
+  col = &model->columns[column];
+  if (row >= col->count)
+    return CMP_ERROR_BOUNDS;
+  if (col->type == CMP_COLUMN_INT64) {
+    /* No portable printf length for 64-bit in C89 */
+    v = ((const int64_t *)col->data)[row];
+    mag = v < 0 ? (uint64_t)0 - (uint64_t)v : (uint64_t)v;
+    p = num + sizeof(num) - 1;
+    *p = '\0';
+    do {
+      *--p = (char)('0' + (int)(mag % 10));
+      mag /= 10;
+    } while (mag);
+    if (v < 0)
+      *--p = '-';
+    text = p;
+  } else if (col->type == CMP_COLUMN_DOUBLE) {
+    sprintf(num, "%.6g", ((const double *)col->data)[row]);
+  } else {
+    text = col->dict[((const uint32_t *)col->data)[row]];
+  }
+  len = strlen(text);
+  if (len >= capacity)
+    len = capacity - 1;
+  memcpy(buffer, text, len);
+  buffer[len] = '\0';
+  return CMP_SUCCESS;
+}
+
+/* Takes ownership of filter->str */
+static int grid_add_filter(struct cmp_datagrid_model *model,
+                           const grid_filter_t *filter) {
+  grid_filter_t *grown;
+  if (CMP_MALLOC((model->filter_count + 1) * sizeof(grid_filter_t),
+                 (void **)&grown) != CMP_SUCCESS) {
+    if (filter->str)
+      CMP_FREE(filter->str);
+    return CMP_ERROR_OOM;
+  }
+  if (model->filters) {
+    memcpy(grown, model->filters, model->filter_count * sizeof(grid_filter_t));
+    CMP_FREE(model->filters);
+  }
+  grown[model->filter_count++] = *filter;
+  model->filters = grown;
+  return CMP_SUCCESS;
+}
+
+static int grid_filter_check(const struct cmp_datagrid_model *model,
+                             size_t column, cmp_column_type_t type,
+                             cmp_datagrid_filter_op_t op) {
+  if (!model || column >= model->column_count ||
+      model->columns[column].type != type || op < CMP_DATAGRID_FILTER_EQ ||
+      op > CMP_DATAGRID_FILTER_GE)
+    return CMP_ERROR_INVALID_ARG;
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_model_add_filter_int64(cmp_datagrid_model_t *model_opaque,
+                                        size_t column,
+                                        cmp_datagrid_filter_op_t op,
+                                        int64_t value) {
+  struct cmp_datagrid_model *model =
+      (struct cmp_datagrid_model *)model_opaque;
+  grid_filter_t f;
+  int res = grid_filter_check(model, column, CMP_COLUMN_INT64, op);
+  if (res != CMP_SUCCESS)
+    return res;
+  memset(&f, 0, sizeof(f));
+  f.column = column;
+  f.op = op;
+  f.i64 = value;
+  return grid_add_filter(model, &f);
+}
+
+int cmp_datagrid_model_add_filter_double(cmp_datagrid_model_t *model_opaque,
+                                         size_t column,
+                                         cmp_datagrid_filter_op_t op,
+                                         double value) {
+  struct cmp_datagrid_model *model =
+      (struct cmp_datagrid_model *)model_opaque;
+  grid_filter_t f;
+  int res = grid_filter_check(model, column, CMP_COLUMN_DOUBLE, op);
+  if (res != CMP_SUCCESS)
+    return res;
+  memset(&f, 0, sizeof(f));
+  f.column = column;
+  f.op = op;
+  f.f64 = value;
+  return grid_add_filter(model, &f);
+}
+
+int cmp_datagrid_model_add_filter_string(cmp_datagrid_model_t *model_opaque,
+                                         size_t column,
+                                         cmp_datagrid_filter_op_t op,
+                                         const char *value) {
+  struct cmp_datagrid_model *model =
+      (struct cmp_datagrid_model *)model_opaque;
+  grid_filter_t f;
+  size_t len;
+  int res = grid_filter_check(model, column, CMP_COLUMN_STRING, op);
+  if (res != CMP_SUCCESS)
+    return res;
+  if (!value || (op != CMP_DATAGRID_FILTER_EQ && op != CMP_DATAGRID_FILTER_NE))
+    return CMP_ERROR_INVALID_ARG;
+  memset(&f, 0, sizeof(f));
+  f.column = column;
+  f.op = op;
+  len = strlen(value);
+  if (CMP_MALLOC(len + 1, (void **)&f.str) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memcpy(f.str, value, len + 1);
+  return grid_add_filter(model, &f);
+}
+
+int cmp_datagrid_model_clear_filters(cmp_datagrid_model_t *model_opaque) {
+  struct cmp_datagrid_model *model =
+      (struct cmp_datagrid_model *)model_opaque;
+  if (!model)
+    return CMP_ERROR_INVALID_ARG;
+  grid_filters_free(model->filters, model->filter_count);
+  model->filters = NULL;
+  model->filter_count = 0;
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_model_set_sort(cmp_datagrid_model_t *model_opaque,
+                                const cmp_datagrid_sort_key_t *keys,
+                                size_t count) {
+  struct cmp_datagrid_model *model =
+      (struct cmp_datagrid_model *)model_opaque;
+  cmp_datagrid_sort_key_t *copy = NULL;
+  size_t i;
+  if (!model || (!keys && count > 0))
+    return CMP_ERROR_INVALID_ARG;
+  for (i = 0; i < count; ++i)
+    if (keys[i].column >= model->column_count)
+      return CMP_ERROR_INVALID_ARG;
+  if (count > 0) {
+    if (CMP_MALLOC(count * sizeof(cmp_datagrid_sort_key_t),
+                   (void **)&copy) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    memcpy(copy, keys, count * sizeof(cmp_datagrid_sort_key_t));
+  }
+  if (model->keys)
+    CMP_FREE(model->keys);
+  model->keys = copy;
+  model->key_count = count;
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_model_set_workers(cmp_datagrid_model_t *model_opaque,
+                                   cmp_modality_t *workers,
+                                   cmp_modality_t *ui) {
+  struct cmp_datagrid_model *model =
+      (struct cmp_datagrid_model *)model_opaque;
+  if (!model || (workers && (workers->type != CMP_MODALITY_THREADED || !ui)))
+    return CMP_ERROR_INVALID_ARG;
+  model->workers = workers;
+  model->ui = ui;
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_model_refresh(cmp_datagrid_model_t *model_opaque,
+                               cmp_datagrid_refresh_cb_t cb,
+                               void *user_data) {
+  struct cmp_datagrid_model *model =
+      (struct cmp_datagrid_model *)model_opaque;
+  grid_job_t *job;
+  size_t i, len;
+  int res;
+
+  if (!model)
+    return CMP_ERROR_INVALID_ARG;
+  if (CMP_MALLOC(sizeof(grid_job_t), (void **)&job) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(job, 0, sizeof(grid_job_t));
+  job->model = model;
+  job->generation = ++model->generation;
+  job->row_count = grid_row_count(model);
+  job->cb = cb;
+  job->user_data = user_data;
+
+  /* The job works from its own copy of filters and keys */
+  if (model->filter_count > 0) {
+    if (CMP_MALLOC(model->filter_count * sizeof(grid_filter_t),
+                   (void **)&job->filters) != CMP_SUCCESS) {
+      grid_job_free(job);
+      return CMP_ERROR_OOM;
+    }
+    memcpy(job->filters, model->filters,
+           model->filter_count * sizeof(grid_filter_t));
+    for (i = 0; i < model->filter_count; ++i) {
+      job->filters[i].str = NULL;
+      job->filter_count++;
+      if (!model->filters[i].str)
+        continue;
+      len = strlen(model->filters[i].str);
+      if (CMP_MALLOC(len + 1, (void **)&job->filters[i].str) != CMP_SUCCESS) {
+        grid_job_free(job);
+        return CMP_ERROR_OOM;
+      }
+      memcpy(job->filters[i].str, model->filters[i].str, len + 1);
+    }
+  }
+  if (model->key_count > 0) {
+    if (CMP_MALLOC(model->key_count * sizeof(cmp_datagrid_sort_key_t),
+                   (void **)&job->keys) != CMP_SUCCESS) {
+      grid_job_free(job);
+      return CMP_ERROR_OOM;
+    }
+    memcpy(job->keys, model->keys,
+           model->key_count * sizeof(cmp_datagrid_sort_key_t));
+    job->key_count = model->key_count;
+  }
+
+  job->next = model->jobs;
+  model->jobs = job;
+  if (model->workers &&
+      cmp_modality_queue_task(model->workers, grid_job_task, job) ==
+          CMP_SUCCESS)
+    return CMP_SUCCESS;
+  grid_job_run(job);
+  res = job->res;
+  grid_job_deliver(job);
+  return res;
+}
+
+int cmp_datagrid_model_is_refreshing(const cmp_datagrid_model_t *model_opaque,
+                                     int *out_refreshing) {
+  const struct cmp_datagrid_model *model =
+      (const struct cmp_datagrid_model *)model_opaque;
+  if (!model || !out_refreshing)
+    return CMP_ERROR_INVALID_ARG;
+  *out_refreshing = model->jobs != NULL;
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_model_get_view(const cmp_datagrid_model_t *model_opaque,
+                                const uint32_t **out_rows,
+                                size_t *out_count) {
+  const struct cmp_datagrid_model *model =
+      (const struct cmp_datagrid_model *)model_opaque;
+  if (!model || !out_rows || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  *out_rows = model->has_view ? model->rows : NULL;
+  *out_count = model->has_view ? model->rows_count : grid_row_count(model);
+  return CMP_SUCCESS;
+}
+
+/* Model row shown at view position index */
+static size_t grid_view_row(const struct cmp_datagrid_model *model,
+                            size_t index) {
+  return model->has_view ? model->rows[index] : index;
+}
+
+/* ------------------------------------------------------------------------ */
+/* 2D view                                                                  */
+/* ------------------------------------------------------------------------ */
+
+struct cmp_datagrid_view {
+  struct cmp_datagrid_model *model;
+  cmp_ui_node_t *container;
+  float row_height;
+  float default_width;
+  float *widths;
+  double *offsets; /* offsets[c] = left edge of column c, widths_count + 1 */
+  size_t widths_count;
+
+  float width;
+  float height;
+  double scroll_x;
+  double scroll_y;
+  size_t overscan;
+
+  /* Cells for view rows [row0, row0 + rows) x columns [col0, col0 + cols),
+   * row-major */
+  size_t row0, rows, col0, cols;
+  cmp_ui_node_t **cells;
+
+  cmp_ui_node_t **pool;
+  size_t pool_count;
+  size_t pool_cap;
+};
+
+static int grid_view_columns(struct cmp_datagrid_view *view) {
+  size_t n = view->model->column_count, i;
+  float *widths;
+  double *offsets;
+  if (n == view->widths_count && view->offsets)
+    return CMP_SUCCESS;
+  if (CMP_MALLOC((n ? n : 1) * sizeof(float), (void **)&widths) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  if (CMP_MALLOC((n + 1) * sizeof(double), (void **)&offsets) !=
+      CMP_SUCCESS) {
+    CMP_FREE(widths);
+    return CMP_ERROR_OOM;
+  }
+  for (i = 0; i < n; ++i)
+    widths[i] = i < view->widths_count ? view->widths[i] : view->default_width;
+  if (view->widths)
+    CMP_FREE(view->widths);
+  if (view->offsets)
+    CMP_FREE(view->offsets);
+  view->widths = widths;
+  view->offsets = offsets;
+  view->widths_count = n;
+  offsets[0] = 0.0;
+  for (i = 0; i < n; ++i)
+    offsets[i + 1] = offsets[i] + widths[i];
+  return CMP_SUCCESS;
+}
+
+/* Column containing x, clamped */
+static size_t grid_view_column_at(const struct cmp_datagrid_view *view,
+                                  double x) {
+  size_t lo = 0, hi = view->widths_count, mid;
+  while (lo + 1 < hi) {
+    mid = (lo + hi) / 2;
+    if (view->offsets[mid] <= x)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static int grid_set_text(cmp_ui_node_t *node, const char *text) {
+  size_t len = strlen(text);
+  char *copy;
+  if (node->properties && strcmp((const char *)node->properties, text) == 0)
+    return CMP_SUCCESS;
+  if (CMP_MALLOC(len + 1, (void **)&copy) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memcpy(copy, text, len + 1);
+  if (node->properties)
+    CMP_FREE(node->properties);
+  node->properties = copy;
+  return CMP_SUCCESS;
+}
+
+static void grid_view_release(struct cmp_datagrid_view *view,
+                              cmp_ui_node_t *cell) {
+  cmp_ui_node_remove_child(view->container, cell);
+  if (grid_reserve((void **)&view->pool, &view->pool_cap,
+                   view->pool_count + 1,
+                   sizeof(cmp_ui_node_t *)) != CMP_SUCCESS) {
+    cmp_ui_node_destroy(cell);
+    return;
+  }
+  view->pool[view->pool_count++] = cell;
+}
+
+static int grid_view_bind(struct cmp_datagrid_view *view, size_t index,
+                          size_t column, cmp_ui_node_t **io_cell) {
+  char text[256];
+  int res;
+  if (!*io_cell) {
+    if (view->pool_count > 0) {
+      *io_cell = view->pool[--view->pool_count];
+    } else {
+      res = cmp_ui_text_create(io_cell, "", -1);
+      if (res != CMP_SUCCESS)
+        return res;
+    }
+    res = cmp_ui_node_add_child(view->container, *io_cell);
+    if (res != CMP_SUCCESS) {
+      cmp_ui_node_destroy(*io_cell);
+      *io_cell = NULL;
+      return res;
+    }
+  }
+  if (cmp_datagrid_model_format_cell(
+          (const cmp_datagrid_model_t *)view->model, column,
+          grid_view_row(view->model, index), text,
+          sizeof(text)) != CMP_SUCCESS)
+    text[0] = '\0';
+  return grid_set_text(*io_cell, text);
+}
+
+/* Moves the cell window to the scroll position; rebind also refreshes the
+ * text of cells that stay */
+static int grid_view_update(struct cmp_datagrid_view *view, int rebind) {
+  cmp_ui_node_t **cells = NULL;
+  const uint32_t *rows_ptr;
+  size_t count, row0, row1, col0, col1, r, c, nr, nc;
+  int res = CMP_SUCCESS;
+
+  if (grid_view_columns(view) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  cmp_datagrid_model_get_view((const cmp_datagrid_model_t *)view->model,
+                              &rows_ptr, &count);
+
+  row0 = (size_t)(view->scroll_y / view->row_height);
+  row1 = (size_t)((view->scroll_y + view->height) / view->row_height) + 1;
+  row0 = row0 > view->overscan ? row0 - view->overscan : 0;
+  row1 += view->overscan;
+  if (row1 > count)
+    row1 = count;
+  if (row0 > row1)
+    row0 = row1;
+  col0 = 0;
+  col1 = 0;
+  if (view->widths_count > 0 && view->width > 0.0f) {
+    col0 = grid_view_column_at(view, view->scroll_x);
+    col1 = grid_view_column_at(view, view->scroll_x + view->width) + 1;
+  }
+  nr = row1 - row0;
+  nc = col1 - col0;
+
+  if (nr * nc > 0) {
+    if (CMP_MALLOC(nr * nc * sizeof(cmp_ui_node_t *), (void **)&cells) !=
+        CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    memset(cells, 0, nr * nc * sizeof(cmp_ui_node_t *));
+  }
+  /* Keep the cells that stay in the window, recycle the rest */
+  for (r = 0; r < view->rows; ++r) {
+    for (c = 0; c < view->cols; ++c) {
+      size_t vr = view->row0 + r, vc = view->col0 + c;
+      cmp_ui_node_t *cell = view->cells[r * view->cols + c];
+      if (!cell)
+        continue;
+      if (vr >= row0 && vr < row1 && vc >= col0 && vc < col1)
+        cells[(vr - row0) * nc + (vc - col0)] = cell;
+      else
+        grid_view_release(view, cell);
+    }
+  }
+  if (view->cells)
+    CMP_FREE(view->cells);
+  view->cells = cells;
+  view->row0 = row0;
+  view->rows = nr;
+  view->col0 = col0;
+  view->cols = nc;
+
+  for (r = 0; r < nr; ++r) {
+    for (c = 0; c < nc; ++c) {
+      cmp_ui_node_t **slot = &cells[r * nc + c];
+      cmp_layout_node_t *layout;
+      if (!*slot || rebind) {
+        if (res == CMP_SUCCESS)
+          res = grid_view_bind(view, row0 + r, col0 + c, slot);
+        if (!*slot)
+          continue;
+      }
+      layout = (*slot)->layout;
+      layout->position_type = CMP_POSITION_ABSOLUTE;
+      layout->position[0] =
+          (float)((double)(row0 + r) * view->row_height - view->scroll_y);
+      layout->position[3] = (float)(view->offsets[col0 + c] - view->scroll_x);
+      layout->width = view->widths[col0 + c];
+      layout->height = view->row_height;
+    }
+  }
+  return res;
+}
+
+int cmp_datagrid_view_create(cmp_datagrid_view_t **out_view,
+                             cmp_datagrid_model_t *model,
+                             cmp_ui_node_t *container, float row_height) {
+  struct cmp_datagrid_view *view;
+  if (!out_view || !model || !container || row_height <= 0.0f)
+    return CMP_ERROR_INVALID_ARG;
+  if (CMP_MALLOC(sizeof(struct cmp_datagrid_view), (void **)&view) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(view, 0, sizeof(struct cmp_datagrid_view));
+  view->model = (struct cmp_datagrid_model *)model;
+  view->container = container;
+  view->row_height = row_height;
+  view->default_width = 120.0f;
+  view->overscan = 1;
+  *out_view = view;
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_view_destroy(cmp_datagrid_view_t *view) {
+  size_t i;
+  if (!view)
+    return CMP_ERROR_INVALID_ARG;
+  for (i = 0; i < view->rows * view->cols; ++i) {
+    if (!view->cells[i])
+      continue;
+    cmp_ui_node_remove_child(view->container, view->cells[i]);
+    cmp_ui_node_destroy(view->cells[i]);
+  }
+  for (i = 0; i < view->pool_count; ++i)
+    cmp_ui_node_destroy(view->pool[i]);
+  if (view->cells)
+    CMP_FREE(view->cells);
+  if (view->pool)
+    CMP_FREE(view->pool);
+  if (view->widths)
+    CMP_FREE(view->widths);
+  if (view->offsets)
+    CMP_FREE(view->offsets);
+  CMP_FREE(view);
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_view_set_column_width(cmp_datagrid_view_t *view,
+                                       size_t column, float width) {
+  size_t i;
+  if (!view || width < 0.0f)
+    return CMP_ERROR_INVALID_ARG;
+  if (grid_view_columns(view) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  if (column >= view->widths_count)
+    return CMP_ERROR_BOUNDS;
+  view->widths[column] = width;
+  for (i = column; i < view->widths_count; ++i)
+    view->offsets[i + 1] = view->offsets[i] + view->widths[i];
+  return grid_view_update(view, 0);
+}
+
+int cmp_datagrid_view_set_viewport(cmp_datagrid_view_t *view, float width,
+                                   float height) {
+  if (!view || width < 0.0f || height < 0.0f)
+    return CMP_ERROR_INVALID_ARG;
+  view->width = width;
+  view->height = height;
+  return grid_view_update(view, 0);
+}
+
+int cmp_datagrid_view_scroll_to(cmp_datagrid_view_t *view, double x,
+                                double y) {
+  if (!view)
+    return CMP_ERROR_INVALID_ARG;
+  view->scroll_x = x > 0.0 ? x : 0.0;
+  view->scroll_y = y > 0.0 ? y : 0.0;
+  return grid_view_update(view, 0);
+}
+
+int cmp_datagrid_view_sync(cmp_datagrid_view_t *view) {
+  if (!view)
+    return CMP_ERROR_INVALID_ARG;
+  return grid_view_update(view, 1);
+}
+
+int cmp_datagrid_view_get_window(const cmp_datagrid_view_t *view,
+                                 size_t *out_first_row, size_t *out_rows,
+                                 size_t *out_first_column,
+                                 size_t *out_columns) {
+  if (!view || !out_first_row || !out_rows || !out_first_column ||
+      !out_columns)
+    return CMP_ERROR_INVALID_ARG;
+  *out_first_row = view->row0;
+  *out_rows = view->rows;
+  *out_first_column = view->col0;
+  *out_columns = view->cols;
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_view_get_cell(const cmp_datagrid_view_t *view, size_t row,
+                               size_t column, cmp_ui_node_t **out_cell) {
+  if (!view || !out_cell)
+    return CMP_ERROR_INVALID_ARG;
+  if (row < view->row0 || row >= view->row0 + view->rows ||
+      column < view->col0 || column >= view->col0 + view->cols ||
+      !view->cells[(row - view->row0) * view->cols + (column - view->col0)])
+    return CMP_ERROR_NOT_FOUND;
+  *out_cell =
+      view->cells[(row - view->row0) * view->cols + (column - view->col0)];
+  return CMP_SUCCESS;
+}
+
+int cmp_datagrid_view_get_content_size(const cmp_datagrid_view_t *view,
+                                       double *out_width,
+                                       double *out_height) {
+  const uint32_t *rows;
+  size_t count, i;
+  double width = 0.0;
+  if (!view || !out_width || !out_height)
+    return CMP_ERROR_INVALID_ARG;
+  cmp_datagrid_model_get_view((const cmp_datagrid_model_t *)view->model,
+                              &rows, &count);
+  for (i = 0; i < view->model->column_count; ++i)
+    width += i < view->widths_count ? view->widths[i] : view->default_width;
+  *out_width = width;
+  *out_height = (double)count * view->row_height;
+  return CMP_SUCCESS;
+}
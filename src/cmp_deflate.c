@@ -0,0 +1,652 @@
+/* clang-format off */
+#include "cmp.h"
+#include <string.h>
+/* clang-format on */
+
+/* Streaming RFC 1950/1951 encoder.
+ * Input is appended to a two-window buffer and matched greedily against a
+ * hash chain of earlier 3-byte sequences. Symbols are collected per block;
+ * each block is emitted with whichever of the fixed code, a freshly built
+ * dynamic code or a stored copy is smallest. Output leaves through the write
+ * callback in small chunks, so memory use does not depend on the stream
+ * length. */
+
+#define DEF_WSIZE 32768
+#define DEF_WMASK (DEF_WSIZE - 1)
+#define DEF_HASH_BITS 15
+#define DEF_HASH_SIZE (1 << DEF_HASH_BITS)
+#define DEF_MIN_MATCH 3
+#define DEF_MAX_MATCH 258
+#define DEF_MIN_LOOKAHEAD (DEF_MAX_MATCH + DEF_MIN_MATCH + 1)
+#define DEF_MAX_DIST (DEF_WSIZE - DEF_MIN_LOOKAHEAD)
+#define DEF_MAX_CHAIN 128
+#define DEF_NICE_MATCH 128
+#define DEF_BLOCK_SYMBOLS 16384
+#define DEF_LCODES 286
+#define DEF_FIXED_LCODES 288 /* 286 and 287 take part in the fixed code */
+#define DEF_DCODES 30
+#define DEF_BLCODES 19
+#define DEF_OUT_SIZE 4096
+
+struct cmp_deflate {
+  int zlib_wrapped;
+  int header_written;
+  int finished;
+
+  unsigned char window[2 * DEF_WSIZE];
+  size_t win_len;
+  size_t pos;
+  int head[DEF_HASH_SIZE];
+  int prev[DEF_WSIZE];
+
+  /* Pending block: dist == 0 marks a literal. */
+  unsigned short sym_litlen[DEF_BLOCK_SYMBOLS];
+  unsigned short sym_dist[DEF_BLOCK_SYMBOLS];
+  size_t sym_count;
+  long block_start; /* Window offset of the block's first byte; < 0 once
+                       slid out, which rules out a stored block */
+  unsigned int lfreq[DEF_LCODES];
+  unsigned int dfreq[DEF_DCODES];
+
+  unsigned long bitbuf;
+  int bitcnt;
+  unsigned char out[DEF_OUT_SIZE];
+  size_t out_len;
+
+  unsigned long adler_a;
+  unsigned long adler_b;
+
+  cmp_deflate_write_cb_t write_cb;
+  void *user_data;
+  int error;
+};
+
+static const unsigned short k_def_len_base[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned char k_def_len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                                  1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                                  4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const unsigned short k_def_dist_base[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned char k_def_dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const unsigned char k_def_blorder[DEF_BLCODES] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static int def_len_code(unsigned int len) {
+  int c = 28;
+  while (k_def_len_base[c] > len)
+    c--;
+  return c;
+}
+
+static int def_dist_code(unsigned int dist) {
+  int c = 29;
+  while (k_def_dist_base[c] > dist)
+    c--;
+  return c;
+}
+
+static void def_flush_out(cmp_deflate_t *d) {
+  if (d->out_len == 0 || d->error != CMP_SUCCESS)
+    return;
+  if (d->write_cb(d->user_data, d->out, d->out_len) != 0)
+    d->error = CMP_ERROR_INVALID_STATE;
+  d->out_len = 0;
+}
+
+static void def_put_byte(cmp_deflate_t *d, unsigned char b) {
+  if (d->out_len == DEF_OUT_SIZE)
+    def_flush_out(d);
+  d->out[d->out_len++] = b;
+}
+
+static void def_put_bits(cmp_deflate_t *d, unsigned long value, int count) {
+  d->bitbuf |= value << d->bitcnt;
+  d->bitcnt += count;
+  while (d->bitcnt >= 8) {
+    def_put_byte(d, (unsigned char)(d->bitbuf & 0xFF));
+    d->bitbuf >>= 8;
+    d->bitcnt -= 8;
+  }
+}
+
+static void def_align(cmp_deflate_t *d) {
+  if (d->bitcnt > 0)
+    def_put_bits(d, 0, 8 - d->bitcnt);
+}
+
+static unsigned int def_reverse(unsigned int code, int len) {
+  unsigned int r = 0;
+  while (len-- > 0) {
+    r = (r << 1) | (code & 1);
+    code >>= 1;
+  }
+  return r;
+}
+
+/* Length-limited Huffman code lengths. Builds an unrestricted tree with the
+ * two-queue method over frequency-sorted leaves, then folds over-long codes
+ * back under max_len and hands the resulting lengths out again in
+ * frequency order. */
+static void def_build_lengths(const unsigned int *freq, int n, int max_len,
+                              unsigned char *lens) {
+  int order[DEF_LCODES];
+  unsigned long weight[2 * DEF_LCODES];
+  int parent[2 * DEF_LCODES];
+  int bl_count[33];
+  int used = 0, i, j, leaf, node, next;
+  unsigned long total;
+
+  memset(lens, 0, (size_t)n);
+  for (i = 0; i < n; ++i) {
+    if (freq[i] == 0)
+      continue;
+    /* Insertion sort by ascending frequency. */
+    j = used++;
+    while (j > 0 && freq[order[j - 1]] > freq[i]) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+  }
+  if (used == 0)
+    return;
+  if (used == 1) {
+    lens[order[0]] = 1;
+    return;
+  }
+
+  for (i = 0; i < used; ++i)
+    weight[i] = freq[order[i]];
+  leaf = 0;
+  node = used;
+  next = used;
+  while (next < 2 * used - 1) {
+    int pick[2], k;
+    for (k = 0; k < 2; ++k) {
+      if (leaf < used && (node >= next || weight[leaf] <= weight[node]))
+        pick[k] = leaf++;
+      else
+        pick[k] = node++;
+    }
+    weight[next] = weight[pick[0]] + weight[pick[1]];
+    parent[pick[0]] = next;
+    parent[pick[1]] = next;
+    next++;
+  }
+
+  /* Depths, root first. */
+  memset(bl_count, 0, sizeof(bl_count));
+  weight[2 * used - 2] = 0;
+  for (i = 2 * used - 3; i >= 0; --i) {
+    weight[i] = weight[parent[i]] + 1;
+    if (i < used)
+      bl_count[weight[i] > 32 ? 32 : weight[i]]++;
+  }
+
+  for (i = max_len + 1; i <= 32; ++i) {
+    bl_count[max_len] += bl_count[i];
+    bl_count[i] = 0;
+  }
+  total = 0;
+  for (i = max_len; i > 0; --i)
+    total += (unsigned long)bl_count[i] << (max_len - i);
+  while (total != (1UL << max_len)) {
+    bl_count[max_len]--;
+    for (i = max_len - 1; i > 0; --i) {
+      if (bl_count[i]) {
+        bl_count[i]--;
+        bl_count[i + 1] += 2;
+        break;
+      }
+    }
+    total--;
+  }
+
+  /* Least frequent symbols take the longest codes. */
+  j = 0;
+  for (i = max_len; i > 0; --i) {
+    int k;
+    for (k = 0; k < bl_count[i]; ++k)
+      lens[order[j++]] = (unsigned char)i;
+  }
+}
+
+static void def_assign_codes(const unsigned char *lens, int n,
+                             unsigned short *codes) {
+  int bl_count[16], next_code[16];
+  int i, code = 0;
+
+  memset(bl_count, 0, sizeof(bl_count));
+  for (i = 0; i < n; ++i)
+    bl_count[lens[i]]++;
+  bl_count[0] = 0;
+  for (i = 1; i < 16; ++i) {
+    code = (code + bl_count[i - 1]) << 1;
+    next_code[i] = code;
+  }
+  for (i = 0; i < n; ++i) {
+    if (lens[i])
+      codes[i] =
+          (unsigned short)def_reverse((unsigned)next_code[lens[i]]++, lens[i]);
+    else
+      codes[i] = 0;
+  }
+}
+
+static void def_fixed_lengths(unsigned char *llens, unsigned char *dlens) {
+  int i;
+  for (i = 0; i < 144; ++i)
+    llens[i] = 8;
+  for (; i < 256; ++i)
+    llens[i] = 9;
+  for (; i < 280; ++i)
+    llens[i] = 7;
+  for (; i < DEF_FIXED_LCODES; ++i)
+    llens[i] = 8;
+  for (i = 0; i < DEF_DCODES; ++i)
+    dlens[i] = 5;
+}
+
+static unsigned long def_data_cost(const cmp_deflate_t *d,
+                                   const unsigned char *llens,
+                                   const unsigned char *dlens) {
+  unsigned long bits = 0;
+  int i;
+  for (i = 0; i < DEF_LCODES; ++i) {
+    bits += (unsigned long)d->lfreq[i] * llens[i];
+    if (i >= 257)
+      bits += (unsigned long)d->lfreq[i] * k_def_len_extra[i - 257];
+  }
+  for (i = 0; i < DEF_DCODES; ++i)
+    bits += (unsigned long)d->dfreq[i] * (dlens[i] + k_def_dist_extra[i]);
+  return bits;
+}
+
+/* Run-length encodes the concatenated code lengths with symbols 16-18. */
+static int def_rle_lengths(const unsigned char *lens, int n,
+                           unsigned char *syms, unsigned char *extra) {
+  int i = 0, count = 0;
+  while (i < n) {
+    int run = 1;
+    while (i + run < n && lens[i + run] == lens[i])
+      run++;
+    if (lens[i] == 0 && run >= 3) {
+      int r = run > 138 ? 138 : run;
+      if (r <= 10) {
+        syms[count] = 17;
+        extra[count++] = (unsigned char)(r - 3);
+      } else {
+        syms[count] = 18;
+        extra[count++] = (unsigned char)(r - 11);
+      }
+      i += r;
+    } else if (lens[i] != 0 && run >= 4) {
+      int r = run - 1 > 6 ? 6 : run - 1;
+      syms[count] = lens[i];
+      extra[count++] = 0;
+      syms[count] = 16;
+      extra[count++] = (unsigned char)(r - 3);
+      i += r + 1;
+    } else {
+      syms[count] = lens[i];
+      extra[count++] = 0;
+      i++;
+    }
+  }
+  return count;
+}
+
+static void def_block_reset(cmp_deflate_t *d) {
+  d->sym_count = 0;
+  d->block_start = (long)d->pos;
+  memset(d->lfreq, 0, sizeof(d->lfreq));
+  memset(d->dfreq, 0, sizeof(d->dfreq));
+}
+
+static void def_emit_block(cmp_deflate_t *d, int is_final) {
+  unsigned char llens[DEF_LCODES], dlens[DEF_DCODES];
+  unsigned char fl[DEF_FIXED_LCODES], fd[DEF_DCODES];
+  unsigned short lcodes[DEF_FIXED_LCODES], dcodes[DEF_DCODES];
+  unsigned char all[DEF_LCODES + DEF_DCODES];
+  unsigned char rle[DEF_LCODES + DEF_DCODES], rle_extra[DEF_LCODES + DEF_DCODES];
+  unsigned int blfreq[DEF_BLCODES];
+  unsigned char bllens[DEF_BLCODES];
+  unsigned short blcodes[DEF_BLCODES];
+  unsigned long dyn_bits, fixed_bits;
+  int hlit, hdist, hclen, rle_count, i, used_d = 0;
+  size_t s;
+
+  d->lfreq[256]++;
+  def_build_lengths(d->lfreq, DEF_LCODES, 15, llens);
+  def_build_lengths(d->dfreq, DEF_DCODES, 15, dlens);
+  /* Some decoders reject a distance code with fewer than two entries. */
+  for (i = 0; i < DEF_DCODES; ++i)
+    used_d += dlens[i] != 0;
+  if (used_d < 2) {
+    if (!dlens[0])
+      dlens[0] = 1;
+    else
+      dlens[1] = 1;
+    if (used_d == 0)
+      dlens[1] = 1;
+  }
+
+  for (hlit = DEF_LCODES; hlit > 257 && llens[hlit - 1] == 0; --hlit)
+    ;
+  for (hdist = DEF_DCODES; hdist > 1 && dlens[hdist - 1] == 0; --hdist)
+    ;
+  memcpy(all, llens, (size_t)hlit);
+  memcpy(all + hlit, dlens, (size_t)hdist);
+  rle_count = def_rle_lengths(all, hlit + hdist, rle, rle_extra);
+  memset(blfreq, 0, sizeof(blfreq));
+  for (i = 0; i < rle_count; ++i)
+    blfreq[rle[i]]++;
+  def_build_lengths(blfreq, DEF_BLCODES, 7, bllens);
+  for (hclen = DEF_BLCODES; hclen > 4 && bllens[k_def_blorder[hclen - 1]] == 0;
+       --hclen)
+    ;
+
+  dyn_bits = 14 + 3 * (unsigned long)hclen + def_data_cost(d, llens, dlens);
+  for (i = 0; i < rle_count; ++i) {
+    dyn_bits += bllens[rle[i]];
+    dyn_bits += rle[i] == 16 ? 2 : (rle[i] == 17 ? 3 : (rle[i] == 18 ? 7 : 0));
+  }
+  def_fixed_lengths(fl, fd);
+  fixed_bits = def_data_cost(d, fl, fd);
+
+  if (d->block_start >= 0) {
+    size_t raw = d->pos - (size_t)d->block_start;
+    unsigned long stored_bits = (unsigned long)raw * 8 + 40 * (raw / 65535 + 1);
+    if (stored_bits < dyn_bits && stored_bits < fixed_bits) {
+      const unsigned char *p = d->window + d->block_start;
+      do {
+        size_t n = raw > 65535 ? 65535 : raw;
+        raw -= n;
+        def_put_bits(d, (unsigned long)(is_final && raw == 0), 1);
+        def_put_bits(d, 0, 2);
+        def_align(d);
+        def_put_byte(d, (unsigned char)(n & 0xFF));
+        def_put_byte(d, (unsigned char)(n >> 8));
+        def_put_byte(d, (unsigned char)(~n & 0xFF));
+        def_put_byte(d, (unsigned char)((~n >> 8) & 0xFF));
+        while (n-- > 0)
+          def_put_byte(d, *p++);
+      } while (raw > 0);
+      def_block_reset(d);
+      return;
+    }
+  }
+
+  def_put_bits(d, (unsigned long)is_final, 1);
+  if (fixed_bits <= dyn_bits) {
+    def_put_bits(d, 1, 2);
+    memcpy(llens, fl, sizeof(llens));
+    memcpy(dlens, fd, sizeof(fd));
+    def_assign_codes(fl, DEF_FIXED_LCODES, lcodes);
+  } else {
+    def_put_bits(d, 2, 2);
+    def_put_bits(d, (unsigned long)(hlit - 257), 5);
+    def_put_bits(d, (unsigned long)(hdist - 1), 5);
+    def_put_bits(d, (unsigned long)(hclen - 4), 4);
+    for (i = 0; i < hclen; ++i)
+      def_put_bits(d, bllens[k_def_blorder[i]], 3);
+    def_assign_codes(bllens, DEF_BLCODES, blcodes);
+    for (i = 0; i < rle_count; ++i) {
+      def_put_bits(d, blcodes[rle[i]], bllens[rle[i]]);
+      if (rle[i] == 16)
+        def_put_bits(d, rle_extra[i], 2);
+      else if (rle[i] == 17)
+        def_put_bits(d, rle_extra[i], 3);
+      else if (rle[i] == 18)
+        def_put_bits(d, rle_extra[i], 7);
+    }
+  }
+  if (fixed_bits > dyn_bits)
+    def_assign_codes(llens, DEF_LCODES, lcodes);
+  def_assign_codes(dlens, DEF_DCODES, dcodes);
+
+  for (s = 0; s < d->sym_count; ++s) {
+    unsigned int lit = d->sym_litlen[s];
+    unsigned int dist = d->sym_dist[s];
+    if (dist == 0) {
+      def_put_bits(d, lcodes[lit], llens[lit]);
+    } else {
+      int lc = def_len_code(lit);
+      int dc = def_dist_code(dist);
+      def_put_bits(d, lcodes[257 + lc], llens[257 + lc]);
+      def_put_bits(d, lit - k_def_len_base[lc], k_def_len_extra[lc]);
+      def_put_bits(d, dcodes[dc], dlens[dc]);
+      def_put_bits(d, dist - k_def_dist_base[dc], k_def_dist_extra[dc]);
+    }
+  }
+  def_put_bits(d, lcodes[256], llens[256]);
+  def_block_reset(d);
+}
+
+static void def_record(cmp_deflate_t *d, unsigned int litlen,
+                       unsigned int dist) {
+  d->sym_litlen[d->sym_count] = (unsigned short)litlen;
+  d->sym_dist[d->sym_count] = (unsigned short)dist;
+  d->sym_count++;
+  if (dist == 0) {
+    d->lfreq[litlen]++;
+  } else {
+    d->lfreq[257 + def_len_code(litlen)]++;
+    d->dfreq[def_dist_code(dist)]++;
+  }
+}
+
+static unsigned int def_hash(const unsigned char *p) {
+  return ((unsigned int)p[0] << 10 ^ (unsigned int)p[1] << 5 ^ p[2]) &
+         (DEF_HASH_SIZE - 1);
+}
+
+static void def_insert(cmp_deflate_t *d, size_t at) {
+  unsigned int h = def_hash(d->window + at);
+  d->prev[at & DEF_WMASK] = d->head[h];
+  d->head[h] = (int)at;
+}
+
+static unsigned int def_longest_match(cmp_deflate_t *d, unsigned int *dist) {
+  const unsigned char *scan = d->window + d->pos;
+  size_t avail = d->win_len - d->pos;
+  unsigned int max_len = avail < DEF_MAX_MATCH ? (unsigned)avail : DEF_MAX_MATCH;
+  unsigned int best = 0;
+  int limit = d->pos > DEF_MAX_DIST ? (int)(d->pos - DEF_MAX_DIST) : 0;
+  int cur = d->head[def_hash(scan)];
+  int chain = DEF_MAX_CHAIN;
+
+  while (cur >= limit && cur < (int)d->pos && chain-- > 0) {
+    const unsigned char *m = d->window + cur;
+    if (m[best] == scan[best] && m[0] == scan[0] && m[1] == scan[1]) {
+      unsigned int len = 2;
+      while (len < max_len && m[len] == scan[len])
+        len++;
+      if (len > best) {
+        best = len;
+        *dist = (unsigned int)(d->pos - (size_t)cur);
+        if (len >= DEF_NICE_MATCH || len == max_len)
+          break;
+      }
+    }
+    cur = d->prev[cur & DEF_WMASK];
+  }
+  return best >= DEF_MIN_MATCH ? best : 0;
+}
+
+static void def_compress(cmp_deflate_t *d, int flush) {
+  while (d->pos < d->win_len && d->error == CMP_SUCCESS) {
+    size_t avail = d->win_len - d->pos;
+    unsigned int len = 0, dist = 0;
+    if (!flush && avail < DEF_MIN_LOOKAHEAD)
+      break;
+    if (d->sym_count == DEF_BLOCK_SYMBOLS)
+      def_emit_block(d, 0);
+    if (avail >= DEF_MIN_MATCH) {
+      len = def_longest_match(d, &dist);
+      def_insert(d, d->pos);
+    }
+    if (len) {
+      size_t end = d->pos + len;
+      def_record(d, len, dist);
+      d->pos++;
+      while (d->pos < end) {
+        if (d->win_len - d->pos >= DEF_MIN_MATCH)
+          def_insert(d, d->pos);
+        d->pos++;
+      }
+    } else {
+      def_record(d, d->window[d->pos], 0);
+      d->pos++;
+    }
+  }
+}
+
+static void def_slide(cmp_deflate_t *d) {
+  int i;
+  memmove(d->window, d->window + DEF_WSIZE, d->win_len - DEF_WSIZE);
+  d->win_len -= DEF_WSIZE;
+  d->pos -= DEF_WSIZE;
+  d->block_start -= DEF_WSIZE;
+  for (i = 0; i < DEF_HASH_SIZE; ++i)
+    d->head[i] = d->head[i] >= DEF_WSIZE ? d->head[i] - DEF_WSIZE : -1;
+  for (i = 0; i < DEF_WSIZE; ++i)
+    d->prev[i] = d->prev[i] >= DEF_WSIZE ? d->prev[i] - DEF_WSIZE : -1;
+}
+
+static void def_update_adler(cmp_deflate_t *d, const unsigned char *p,
+                             size_t len) {
+  while (len > 0) {
+    size_t n = len > 5552 ? 5552 : len;
+    len -= n;
+    while (n-- > 0) {
+      d->adler_a += *p++;
+      d->adler_b += d->adler_a;
+    }
+    d->adler_a %= 65521UL;
+    d->adler_b %= 65521UL;
+  }
+}
+
+int cmp_deflate_create(int zlib_wrapped, cmp_deflate_write_cb_t write_cb,
+                       void *user_data, cmp_deflate_t **out_deflate) {
+  cmp_deflate_t *d;
+
+  if (out_deflate == NULL || write_cb == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(cmp_deflate_t), (void **)&d) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  d->zlib_wrapped = zlib_wrapped ? 1 : 0;
+  d->write_cb = write_cb;
+  d->user_data = user_data;
+  cmp_deflate_reset(d);
+  *out_deflate = d;
+  return CMP_SUCCESS;
+}
+
+int cmp_deflate_reset(cmp_deflate_t *d) {
+  int i;
+  if (d == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  d->header_written = 0;
+  d->finished = 0;
+  d->win_len = 0;
+  d->pos = 0;
+  for (i = 0; i < DEF_HASH_SIZE; ++i)
+    d->head[i] = -1;
+  for (i = 0; i < DEF_WSIZE; ++i)
+    d->prev[i] = -1;
+  def_block_reset(d);
+  d->bitbuf = 0;
+  d->bitcnt = 0;
+  d->out_len = 0;
+  d->adler_a = 1;
+  d->adler_b = 0;
+  d->error = CMP_SUCCESS;
+  return CMP_SUCCESS;
+}
+
+int cmp_deflate_push(cmp_deflate_t *d, const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *)data;
+
+  if (d == NULL || (data == NULL && len > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (d->finished) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+  if (d->error != CMP_SUCCESS) {
+    return d->error;
+  }
+  if (d->zlib_wrapped && !d->header_written) {
+    /* CM=8, CINFO=7 (32K window), default level, no dictionary. */
+    def_put_byte(d, 0x78);
+    def_put_byte(d, 0x9C);
+  }
+  d->header_written = 1;
+  if (d->zlib_wrapped)
+    def_update_adler(d, p, len);
+
+  while (len > 0 && d->error == CMP_SUCCESS) {
+    size_t n;
+    if (d->win_len == 2 * DEF_WSIZE)
+      def_slide(d);
+    n = 2 * DEF_WSIZE - d->win_len;
+    if (n > len)
+      n = len;
+    memcpy(d->window + d->win_len, p, n);
+    d->win_len += n;
+    p += n;
+    len -= n;
+    def_compress(d, 0);
+  }
+  def_flush_out(d);
+  return d->error;
+}
+
+int cmp_deflate_finish(cmp_deflate_t *d) {
+  if (d == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (d->finished) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+  if (d->error != CMP_SUCCESS) {
+    return d->error;
+  }
+  if (d->zlib_wrapped && !d->header_written) {
+    def_put_byte(d, 0x78);
+    def_put_byte(d, 0x9C);
+  }
+  d->header_written = 1;
+  def_compress(d, 1);
+  def_emit_block(d, 1);
+  def_align(d);
+  if (d->zlib_wrapped) {
+    unsigned long adler = (d->adler_b << 16) | d->adler_a;
+    def_put_byte(d, (unsigned char)(adler >> 24));
+    def_put_byte(d, (unsigned char)(adler >> 16));
+    def_put_byte(d, (unsigned char)(adler >> 8));
+    def_put_byte(d, (unsigned char)adler);
+  }
+  def_flush_out(d);
+  d->finished = 1;
+  return d->error;
+}
+
+int cmp_deflate_destroy(cmp_deflate_t *d) {
+  if (d == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  CMP_FREE(d);
+  return CMP_SUCCESS;
+}
@@ -1,26 +1,91 @@
 /* clang-format off */
+#if !defined(_WIN32) && !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 600 /* posix_openpt and friends */
+#endif
 #include "cmp.h"
 #include <stdlib.h>
 #include <string.h>
 
-/* This is a portable stub. 
-   A real implementation utilizes ConPTY on Windows >= 10, or forkpty/openpty on POSIX. */
+/* POSIX hosts get a real pseudoterminal (posix_openpt + fork). Windows keeps
+   the echoing stand-in until a ConPTY backend lands. */
 
 #if defined(_WIN32)
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
 #endif
 #include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #endif
 /* clang-format on */
 
+#define CMP_PTY_READ_CHUNK 65536
+#define CMP_PTY_TURN_BUDGET (1024 * 1024) /* Bytes per pump task */
+
+/* The pump task's argument. It outlives the pty while a pump is queued, so
+   destroy can free the pty at once; the next turn frees it. */
+typedef struct pty_shared {
+  cmp_mutex_t lock;
+  struct cmp_embedded_pty *pty; /* NULL once destroyed */
+} pty_shared_t;
+
 struct cmp_embedded_pty {
   int is_running;
+  unsigned short cols;
+  unsigned short rows;
+#if defined(_WIN32)
   char mock_buffer[1024];
   size_t mock_len;
   size_t mock_pos;
+#else
+  int master_fd;
+  pid_t child;
+#endif
+
+  /* Pump state, under shared->lock. The pump holds the lock for a whole
+     turn, so once detach or destroy returns it no longer touches vt or the
+     callback. */
+  pty_shared_t *shared;
+  cmp_modality_t *mod;
+  cmp_term_t *vt;
+  cmp_embedded_pty_output_cb callback;
+  void *user_data;
+  int attached;
+  int pump_queued;
+  int parked; /* Drained and off the queue until there is more output */
+#if !defined(_WIN32)
+  /* Watcher thread: polls the master while the pump is parked and queues
+     the pump again once output or a hangup arrives. */
+  pthread_t watcher;
+  int watching;
+  int watch_stop;
+  int wake[2]; /* Self-pipe that interrupts the watcher's poll */
+  cmp_cond_t park_cond;
+#endif
+  char chunk[CMP_PTY_READ_CHUNK];
 };
 
+static void pty_pump(void *arg);
+
+/* Puts a parked pump back on its modality. Called under shared->lock. */
+static void pty_unpark(cmp_embedded_pty_t *pty) {
+  if (!pty->parked)
+    return;
+  pty->parked = 0;
+  if (pty->attached &&
+      cmp_modality_queue_task(pty->mod, pty_pump, pty->shared) == CMP_SUCCESS)
+    pty->pump_queued = 1;
+  else
+    pty->attached = 0;
+}
+
 int cmp_embedded_pty_create(cmp_embedded_pty_t **out_pty) {
   cmp_embedded_pty_t *pty;
   if (!out_pty)
@@ -30,22 +95,159 @@ int cmp_embedded_pty_create(cmp_embedded_pty_t **out_pty) {
   if (!pty)
     return CMP_ERROR_OOM;
 
-  pty->is_running = 0;
-  pty->mock_len = 0;
-  pty->mock_pos = 0;
+  memset(pty, 0, sizeof(cmp_embedded_pty_t));
+  pty->shared = (pty_shared_t *)malloc(sizeof(pty_shared_t));
+  if (!pty->shared) {
+    free(pty);
+    return CMP_ERROR_OOM;
+  }
+  cmp_mutex_init(&pty->shared->lock);
+  pty->shared->pty = pty;
+  pty->cols = 80;
+  pty->rows = 24;
+#if !defined(_WIN32)
+  pty->master_fd = -1;
+  pty->child = -1;
+  pty->wake[0] = pty->wake[1] = -1;
+#endif
 
   *out_pty = pty;
   return CMP_SUCCESS;
 }
 
+#if !defined(_WIN32)
+static void *pty_watch(void *arg) {
+  cmp_embedded_pty_t *pty = (cmp_embedded_pty_t *)arg;
+  cmp_mutex_t *lock = &pty->shared->lock;
+  struct pollfd pfd[2];
+  char drain[64];
+
+  cmp_mutex_lock(lock);
+  while (!pty->watch_stop) {
+    if (!pty->parked) {
+      cmp_cond_wait(&pty->park_cond, lock);
+      continue;
+    }
+    pfd[0].fd = pty->master_fd;
+    pfd[0].events = POLLIN;
+    pfd[0].revents = 0;
+    pfd[1].fd = pty->wake[0];
+    pfd[1].events = POLLIN;
+    pfd[1].revents = 0;
+    cmp_mutex_unlock(lock);
+    poll(pfd, 2, -1);
+    while (read(pty->wake[0], drain, sizeof(drain)) > 0)
+      ;
+    cmp_mutex_lock(lock);
+    if (!pty->watch_stop && pfd[0].revents != 0)
+      pty_unpark(pty);
+  }
+  cmp_mutex_unlock(lock);
+  return NULL;
+}
+
+static int pty_watch_start(cmp_embedded_pty_t *pty) {
+  if (pty->watching)
+    return CMP_SUCCESS;
+  if (pipe(pty->wake) != 0)
+    return CMP_ERROR_IO;
+  fcntl(pty->wake[0], F_SETFL, fcntl(pty->wake[0], F_GETFL) | O_NONBLOCK);
+  fcntl(pty->wake[0], F_SETFD, FD_CLOEXEC);
+  fcntl(pty->wake[1], F_SETFD, FD_CLOEXEC);
+  cmp_cond_init(&pty->park_cond);
+  if (pthread_create(&pty->watcher, NULL, pty_watch, pty) != 0) {
+    cmp_cond_destroy(&pty->park_cond);
+    close(pty->wake[0]);
+    close(pty->wake[1]);
+    pty->wake[0] = pty->wake[1] = -1;
+    return CMP_ERROR_OOM;
+  }
+  pty->watching = 1;
+  return CMP_SUCCESS;
+}
+
+/* Stops the watcher; watch_stop is already set under the lock. */
+static void pty_watch_join(cmp_embedded_pty_t *pty) {
+  if (!pty->watching)
+    return;
+  if (write(pty->wake[1], "", 1) < 0) {
+    /* The pipe is never full enough to refuse the byte */
+  }
+  pthread_join(pty->watcher, NULL);
+  cmp_cond_destroy(&pty->park_cond);
+  close(pty->wake[0]);
+  close(pty->wake[1]);
+  pty->watching = 0;
+}
+
+/* Collects an exited child without waiting for one that is still alive. */
+static void pty_reap(cmp_embedded_pty_t *pty) {
+  int status;
+  if (pty->child > 0 && waitpid(pty->child, &status, WNOHANG) != 0)
+    pty->child = -1;
+}
+#endif
+
+static void pty_close(cmp_embedded_pty_t *pty) {
+#if !defined(_WIN32)
+  if (pty->master_fd >= 0) {
+    close(pty->master_fd);
+    pty->master_fd = -1;
+  }
+  pty_reap(pty);
+  if (pty->child > 0) {
+    kill(pty->child, SIGHUP);
+    pty_reap(pty);
+  }
+  if (pty->child > 0) {
+    int status;
+    /* Still running (or ignoring SIGHUP): SIGKILL bounds the wait */
+    kill(pty->child, SIGKILL);
+    waitpid(pty->child, &status, 0);
+    pty->child = -1;
+  }
+#endif
+  pty->is_running = 0;
+}
+
+static void pty_shared_free(pty_shared_t *shared) {
+  cmp_mutex_destroy(&shared->lock);
+  free(shared);
+}
+
 int cmp_embedded_pty_destroy(cmp_embedded_pty_t *pty) {
+  pty_shared_t *shared;
+  int pump_queued;
+
   if (!pty)
     return CMP_ERROR_INVALID_ARG;
+
+  /* Waits out a running turn. A queued pump finds shared->pty cleared and
+     frees shared itself; if its modality never runs it again only shared
+     is left behind. The watcher queues nothing once watch_stop is set. */
+  shared = pty->shared;
+  cmp_mutex_lock(&shared->lock);
+  shared->pty = NULL;
+  pump_queued = pty->pump_queued;
+#if !defined(_WIN32)
+  pty->watch_stop = 1;
+  if (pty->watching)
+    cmp_cond_signal(&pty->park_cond);
+#endif
+  cmp_mutex_unlock(&shared->lock);
+#if !defined(_WIN32)
+  pty_watch_join(pty);
+#endif
+  if (!pump_queued)
+    pty_shared_free(shared);
+
+  pty_close(pty);
   free(pty);
   return CMP_SUCCESS;
 }
 
 int cmp_embedded_pty_spawn(cmp_embedded_pty_t *pty, const char *command) {
+#if defined(_WIN32)
   const char *welcome = "C:\\> ";
 
   if (!pty || !command)
@@ -58,47 +260,286 @@ int cmp_embedded_pty_spawn(cmp_embedded_pty_t *pty, const char *command) {
   pty->mock_pos = 0;
 
   return CMP_SUCCESS;
-}
+#else
+  struct winsize ws;
+  const char *slave_name;
+  int master;
+  pid_t pid;
 
-int cmp_embedded_pty_write(cmp_embedded_pty_t *pty, const char *input,
-                           size_t length) {
-  if (!pty || (!input && length > 0))
+  if (!pty || !command)
     return CMP_ERROR_INVALID_ARG;
-  if (!pty->is_running)
+  if (pty->is_running)
     return CMP_ERROR_INVALID_STATE;
 
+  master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0)
+    return CMP_ERROR_IO;
+  if (grantpt(master) != 0 || unlockpt(master) != 0 ||
+      (slave_name = ptsname(master)) == NULL) {
+    close(master);
+    return CMP_ERROR_IO;
+  }
+
+  memset(&ws, 0, sizeof(ws));
+  ws.ws_col = pty->cols;
+  ws.ws_row = pty->rows;
+  ioctl(master, TIOCSWINSZ, &ws);
+
+  pid = fork();
+  if (pid < 0) {
+    close(master);
+    return CMP_ERROR_IO;
+  }
+  if (pid == 0) {
+    int slave;
+    setsid();
+    slave = open(slave_name, O_RDWR);
+    if (slave < 0)
+      _exit(127);
+#if defined(TIOCSCTTY)
+    ioctl(slave, TIOCSCTTY, 0);
+#endif
+    dup2(slave, 0);
+    dup2(slave, 1);
+    dup2(slave, 2);
+    if (slave > 2)
+      close(slave);
+    close(master);
+    putenv((char *)"TERM=xterm-256color");
+    execl("/bin/sh", "sh", "-c", command, (char *)NULL);
+    _exit(127);
+  }
+
+  fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+  fcntl(master, F_SETFD, FD_CLOEXEC);
+  pty->master_fd = master;
+  pty->child = pid;
+  pty->is_running = 1;
+  return CMP_SUCCESS;
+#endif
+}
+
+static int pty_write(cmp_embedded_pty_t *pty, const char *input,
+                     size_t length) {
+#if !defined(_WIN32)
+  size_t written = 0;
+#endif
+
+#if defined(_WIN32)
   /* Mock echoing the input back */
   if (pty->mock_len + length < sizeof(pty->mock_buffer)) {
     memcpy(&pty->mock_buffer[pty->mock_len], input, length);
     pty->mock_len += length;
     pty->mock_buffer[pty->mock_len] = '\0';
   }
+#else
+  while (written < length) {
+    ssize_t n = write(pty->master_fd, input + written, length - written);
+    if (n > 0) {
+      written += (size_t)n;
+    } else if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+      struct pollfd pfd;
+      pfd.fd = pty->master_fd;
+      pfd.events = POLLOUT;
+      pfd.revents = 0;
+      poll(&pfd, 1, 10);
+    } else {
+      return CMP_ERROR_IO;
+    }
+  }
+#endif
+
+  return CMP_SUCCESS;
+}
+
+int cmp_embedded_pty_write(cmp_embedded_pty_t *pty, const char *input,
+                           size_t length) {
+  int res;
+  if (!pty || (!input && length > 0))
+    return CMP_ERROR_INVALID_ARG;
+  if (!pty->is_running)
+    return CMP_ERROR_INVALID_STATE;
+
+  res = pty_write(pty, input, length);
+#if defined(_WIN32)
+  /* The echo is the stand-in's only output, so it wakes a parked pump */
+  cmp_mutex_lock(&pty->shared->lock);
+  pty_unpark(pty);
+  cmp_mutex_unlock(&pty->shared->lock);
+#endif
+  return res;
+}
 
+/* Reads what is available without blocking. Sets *out_exited once the
+   child has gone and its output is drained. */
+static int pty_read_some(cmp_embedded_pty_t *pty, char *out_buffer,
+                         size_t max_len, size_t *out_read, int *out_exited) {
+  *out_read = 0;
+  *out_exited = 0;
+  if (!pty->is_running) {
+#if !defined(_WIN32)
+    pty_reap(pty);
+#endif
+    *out_exited = 1;
+    return CMP_SUCCESS;
+  }
+#if defined(_WIN32)
+  {
+    size_t available = pty->mock_len - pty->mock_pos;
+    size_t to_read = (available < max_len) ? available : max_len;
+    memcpy(out_buffer, &pty->mock_buffer[pty->mock_pos], to_read);
+    pty->mock_pos += to_read;
+    *out_read = to_read;
+  }
+#else
+  {
+    ssize_t n = read(pty->master_fd, out_buffer, max_len);
+    if (n > 0) {
+      *out_read = (size_t)n;
+    } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+      /* Linux reports EIO once the slave side is closed. The child may not
+         have exited yet; later reads and destroy reap it. */
+      close(pty->master_fd);
+      pty->master_fd = -1;
+      pty->is_running = 0;
+      pty_reap(pty);
+      *out_exited = 1;
+    }
+  }
+#endif
   return CMP_SUCCESS;
 }
 
 int cmp_embedded_pty_read(cmp_embedded_pty_t *pty, char *out_buffer,
                           size_t max_len, size_t *out_read) {
-  size_t available;
-  size_t to_read;
-
+  int exited;
   if (!pty || !out_buffer || !out_read || max_len == 0)
     return CMP_ERROR_INVALID_ARG;
-  if (!pty->is_running) {
-    *out_read = 0;
-    return CMP_SUCCESS;
+  return pty_read_some(pty, out_buffer, max_len, out_read, &exited);
+}
+
+int cmp_embedded_pty_resize(cmp_embedded_pty_t *pty, unsigned short cols,
+                            unsigned short rows) {
+  if (!pty || cols == 0 || rows == 0)
+    return CMP_ERROR_INVALID_ARG;
+  pty->cols = cols;
+  pty->rows = rows;
+#if !defined(_WIN32)
+  if (pty->master_fd >= 0) {
+    struct winsize ws;
+    memset(&ws, 0, sizeof(ws));
+    ws.ws_col = cols;
+    ws.ws_row = rows;
+    if (ioctl(pty->master_fd, TIOCSWINSZ, &ws) != 0)
+      return CMP_ERROR_IO;
   }
+#endif
+  return CMP_SUCCESS;
+}
 
-  available = pty->mock_len - pty->mock_pos;
-  if (available == 0) {
-    *out_read = 0;
-    return CMP_SUCCESS;
+/* One pump turn: drain up to a byte budget, then requeue so other tasks on
+   the modality get a slice. Once the master is drained the pump parks off
+   the queue instead, so an idle child costs the modality nothing; the
+   watcher queues it again when the master becomes readable. */
+static void pty_pump(void *arg) {
+  pty_shared_t *shared = (pty_shared_t *)arg;
+  cmp_embedded_pty_t *pty;
+  size_t total = 0, got = 0;
+  int exited = 0;
+
+  cmp_mutex_lock(&shared->lock);
+  pty = shared->pty;
+  if (!pty) {
+    cmp_mutex_unlock(&shared->lock);
+    pty_shared_free(shared);
+    return;
+  }
+  if (!pty->attached) {
+    pty->pump_queued = 0;
+    cmp_mutex_unlock(&shared->lock);
+    return;
+  }
+
+  pty_read_some(pty, pty->chunk, sizeof(pty->chunk), &got, &exited);
+  while (got > 0) {
+    if (pty->vt) {
+      char reply[64];
+      size_t reply_len = 0;
+      cmp_term_feed(pty->vt, pty->chunk, got);
+      cmp_term_take_response(pty->vt, reply, sizeof(reply), &reply_len);
+      if (reply_len > 0)
+        pty_write(pty, reply, reply_len);
+    }
+    if (pty->callback)
+      pty->callback(pty->user_data, pty->chunk, got);
+    total += got;
+    if (total >= CMP_PTY_TURN_BUDGET)
+      break;
+    pty_read_some(pty, pty->chunk, sizeof(pty->chunk), &got, &exited);
   }
 
-  to_read = (available < max_len) ? available : max_len;
-  memcpy(out_buffer, &pty->mock_buffer[pty->mock_pos], to_read);
-  pty->mock_pos += to_read;
+  if (exited) {
+    if (pty->callback)
+      pty->callback(pty->user_data, NULL, 0);
+    pty->attached = 0;
+  }
+  pty->pump_queued = 0;
+  if (pty->attached && got == 0) {
+    pty->parked = 1;
+#if !defined(_WIN32)
+    cmp_cond_signal(&pty->park_cond);
+#endif
+  } else if (pty->attached && cmp_modality_queue_task(pty->mod, pty_pump,
+                                                      shared) == CMP_SUCCESS) {
+    pty->pump_queued = 1;
+  } else {
+    pty->attached = 0;
+  }
+  cmp_mutex_unlock(&shared->lock);
+}
 
-  *out_read = to_read;
+int cmp_embedded_pty_attach(cmp_embedded_pty_t *pty, cmp_modality_t *mod,
+                            cmp_term_t *vt, cmp_embedded_pty_output_cb callback,
+                            void *user_data) {
+  int res = CMP_SUCCESS;
+  if (!pty || !mod)
+    return CMP_ERROR_INVALID_ARG;
+
+  cmp_mutex_lock(&pty->shared->lock);
+  if (!pty->is_running || pty->attached) {
+    cmp_mutex_unlock(&pty->shared->lock);
+    return CMP_ERROR_INVALID_STATE;
+  }
+#if !defined(_WIN32)
+  res = pty_watch_start(pty);
+  if (res != CMP_SUCCESS) {
+    cmp_mutex_unlock(&pty->shared->lock);
+    return res;
+  }
+#endif
+  pty->mod = mod;
+  pty->vt = vt;
+  pty->callback = callback;
+  pty->user_data = user_data;
+  pty->attached = 1;
+  pty->parked = 0;
+  if (!pty->pump_queued) {
+    res = cmp_modality_queue_task(mod, pty_pump, pty->shared);
+    if (res == CMP_SUCCESS)
+      pty->pump_queued = 1;
+    else
+      pty->attached = 0;
+  }
+  cmp_mutex_unlock(&pty->shared->lock);
+  return res;
+}
+
+int cmp_embedded_pty_detach(cmp_embedded_pty_t *pty) {
+  if (!pty)
+    return CMP_ERROR_INVALID_ARG;
+  cmp_mutex_lock(&pty->shared->lock);
+  pty->attached = 0;
+  pty->parked = 0;
+  cmp_mutex_unlock(&pty->shared->lock);
   return CMP_SUCCESS;
 }
@@ -243,120 +243,12 @@ int cmp_http_send_multi_with_progress(
   return res;
 }
 
-struct cmp_http_download_ctx {
-  int (*progress_cb)(float percentage, void *user_data);
-  void *user_data;
-  FILE *f;
-};
-
-static int internal_http_download_chunk_cb(void *user_data, const void *chunk,
-                                           size_t chunk_len) {
-  struct cmp_http_download_ctx *ctx = (struct cmp_http_download_ctx *)user_data;
-
-  if (ctx && ctx->f && chunk && chunk_len > 0) {
-    fwrite(chunk, 1, chunk_len, ctx->f);
-  }
-
-  if (ctx && ctx->progress_cb) {
-    /* Dummy progress tick for now */
-    if (ctx->progress_cb(50.0f, ctx->user_data) != 0) {
-      return 1; /* abort */
-    }
-  }
-  return 0;
-}
-
 int cmp_http_download(struct HttpClient *client, const char *url,
                       const char *save_virtual_path,
                       int (*progress_cb)(float percentage, void *user_data),
                       void *user_data) {
-  struct HttpRequest req;
-  struct HttpResponse *res = NULL;
-  struct cmp_http_download_ctx ctx;
-  cmp_string_t resolved_path;
-  const cfs_char_t *native_path;
-  cfs_path p;
-  int err;
-
-  if (client == NULL || url == NULL || save_virtual_path == NULL) {
-    return CMP_ERROR_INVALID_ARG;
-  }
-
-  if (cmp_vfs_resolve_path(save_virtual_path, &resolved_path) != CMP_SUCCESS) {
-    return CMP_ERROR_INVALID_ARG;
-  }
-
-  cfs_path_init(&p);
-#if defined(_WIN32)
-  {
-    wchar_t *wpath = NULL;
-    cfs_size_t req_len = 0;
-    cfs_utf8_to_utf16(resolved_path.data, NULL, 0, &req_len);
-    if (req_len <= 0) {
-      cfs_path_destroy(&p);
-      cmp_string_destroy(&resolved_path);
-      return CMP_ERROR_INVALID_ARG;
-    }
-    if (CMP_MALLOC((size_t)req_len * sizeof(wchar_t), (void **)&wpath) !=
-        CMP_SUCCESS) {
-      cfs_path_destroy(&p);
-      cmp_string_destroy(&resolved_path);
-      return CMP_ERROR_OOM;
-    }
-    cfs_utf8_to_utf16(resolved_path.data, wpath, req_len, NULL);
-    cfs_path_assign(&p, wpath);
-    CMP_FREE(wpath);
-  }
-#else
-  cfs_path_assign(&p, resolved_path.data);
-#endif
-
-  cmp_string_destroy(&resolved_path);
-  cfs_path_c_str(&p, &native_path);
-
-#if defined(_WIN32)
-  ctx.f = _wfopen(native_path, L"wb");
-#else
-  ctx.f = fopen(native_path, "wb");
-#endif
-  cfs_path_destroy(&p);
-
-  if (ctx.f == NULL) {
-    return CMP_ERROR_NOT_FOUND;
-  }
-
-  ctx.progress_cb = progress_cb;
-  ctx.user_data = user_data;
-
-  if (http_request_init(&req) != 0) {
-    fclose(ctx.f);
-    return CMP_ERROR_NOT_FOUND;
-  }
-
-  req.method = HTTP_GET;
-  req.url = (char *)url;
-  req.on_chunk = internal_http_download_chunk_cb;
-  req.on_chunk_user_data = &ctx;
-
-  err = CMP_SUCCESS;
-  if (client->send == NULL ||
-      client->send(client->transport, &req, &res) != 0) {
-    err = CMP_ERROR_NOT_FOUND;
-  }
-
-  if (res != NULL) {
-    http_response_free(res);
-  }
-
-  req.url = NULL; /* Not allocated by us */
-  http_request_free(&req);
-  fclose(ctx.f);
-
-  if (err == CMP_SUCCESS && progress_cb) {
-    progress_cb(100.0f, user_data);
-  }
-
-  return err;
+  return cmp_http_download_ex(client, url, save_virtual_path, NULL,
+                              progress_cb, user_data, NULL);
 }
 
 void cmp_http_response_free(struct HttpResponse *res) {
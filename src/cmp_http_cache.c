@@ -0,0 +1,1665 @@
+/* clang-format off */
+#if !defined(_WIN32) && !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 600 /* mmap, ftruncate */
+#endif
+#include "cmp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+/* clang-format on */
+
+/* The index is a header followed by a fixed open-addressed slot table, in
+   a layout built only from unsigned int and char arrays so it reads the
+   same on every ABI. POSIX hosts map it shared and update it in place;
+   Windows loads it and writes it back on close. */
+
+#define HC_MAGIC "cmphc01"
+#define HC_SLOT_FREE 0
+#define HC_SLOT_USED 1
+#define HC_SLOT_DEAD 2 /* Tombstone, keeps probe chains intact */
+
+#define HC_F_NO_CACHE 1 /* Revalidate before every use */
+#define HC_F_MUST_REVALIDATE 2
+#define HC_F_VARY 4
+
+#define HC_HEURISTIC_MAX 86400UL
+#define HC_LINE_MAX 8192
+
+typedef struct hc_header {
+  char magic[8];
+  unsigned int slot_size;
+  unsigned int slot_count;
+  unsigned int tick; /* LRU clock */
+  unsigned int entries;
+  unsigned int bytes;
+  unsigned int dead;
+} hc_header_t;
+
+typedef struct hc_slot {
+  unsigned char key[32];  /* SHA-256 of the URL */
+  unsigned char body[32]; /* SHA-256 of the body, its file name */
+  unsigned char vary[32]; /* SHA-256 of the request headers Vary names */
+  unsigned int state;
+  unsigned int status;
+  unsigned int body_len;
+  unsigned int stored;      /* Response time, seconds since the epoch */
+  unsigned int initial_age; /* Corrected initial age (RFC 9111 4.2.3) */
+  unsigned int lifetime;    /* Freshness lifetime */
+  unsigned int swr;         /* stale-while-revalidate */
+  unsigned int sie;         /* stale-if-error */
+  unsigned int flags;
+  unsigned int last_used;
+  char etag[96];
+  char last_modified[40];
+} hc_slot_t;
+
+/* Response headers as stored in "h/<key>" */
+typedef struct hc_meta {
+  char **names;
+  char **values;
+  size_t count;
+  size_t capacity;
+} hc_meta_t;
+
+typedef struct hc_cc {
+  long max_age; /* -1 when absent */
+  long max_stale;
+  long swr;
+  long sie;
+  int no_store;
+  int no_cache;
+  int must_revalidate;
+  int only_if_cached;
+} hc_cc_t;
+
+struct cmp_http_cache {
+  cmp_http_cache_config_t config;
+  char *dir;
+  char *index_path;
+  cmp_mutex_t lock; /* Guards everything below and the files */
+  hc_header_t *header;
+  hc_slot_t *slots;
+  void *map;
+  size_t map_len;
+#if !defined(_WIN32)
+  int fd;
+#endif
+  cmp_http_cache_mode_t mode;
+  struct HttpRequest *pending; /* Awaiting a background revalidation */
+  size_t pending_count;
+  size_t pending_capacity;
+  cmp_http_cache_stats_t stats;
+};
+
+static unsigned long hc_now(const cmp_http_cache_t *cache) {
+  double now;
+
+  now = cache->config.now_s != NULL
+            ? cache->config.now_s(cache->config.now_data)
+            : (double)time(NULL);
+  return now > 0.0 ? (unsigned long)now : 0UL;
+}
+
+static char *hc_strdup(const char *s) {
+  size_t len = strlen(s);
+  char *copy;
+
+  if (CMP_MALLOC(len + 1, (void **)&copy) != CMP_SUCCESS) {
+    return NULL;
+  }
+  memcpy(copy, s, len + 1);
+  return copy;
+}
+
+static char hc_lower(char c) {
+  return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+static int hc_ieq(const char *a, const char *b) {
+  while (*a != '\0' && hc_lower(*a) == hc_lower(*b)) {
+    a++;
+    b++;
+  }
+  return hc_lower(*a) == hc_lower(*b);
+}
+
+static void hc_digest(const void *data, size_t len, unsigned char out[32]) {
+  cmp_sha256_t sha;
+
+  cmp_sha256_init(&sha);
+  cmp_sha256_update(&sha, data, len);
+  cmp_sha256_final(&sha, out);
+}
+
+/* "<dir>/<sub>/<hex digest>" */
+static char *hc_file(const cmp_http_cache_t *cache, const char *sub,
+                     const unsigned char digest[32]) {
+  size_t len = strlen(cache->dir);
+  char *path;
+
+  if (CMP_MALLOC(len + strlen(sub) + 67, (void **)&path) != CMP_SUCCESS) {
+    return NULL;
+  }
+  sprintf(path, "%s/%s/", cache->dir, sub);
+  cmp_sha256_hex(digest, path + strlen(path));
+  return path;
+}
+
+static const char *hc_request_header(const struct HttpRequest *req,
+                                     const char *name) {
+  const char *value;
+
+  if (http_headers_get(&req->headers, name, &value) != 0) {
+    return NULL;
+  }
+  return value;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Files                                                                    */
+/* ------------------------------------------------------------------------ */
+
+#if defined(_WIN32)
+static wchar_t *hc_widen(const char *path) {
+  wchar_t *wpath = NULL;
+  cfs_size_t len = 0;
+
+  cfs_utf8_to_utf16(path, NULL, 0, &len);
+  if (len <= 0 || CMP_MALLOC((size_t)len * sizeof(wchar_t),
+                             (void **)&wpath) != CMP_SUCCESS) {
+    return NULL;
+  }
+  cfs_utf8_to_utf16(path, wpath, len, NULL);
+  return wpath;
+}
+
+static FILE *hc_fopen(const char *path, const wchar_t *mode) {
+  wchar_t *wpath = hc_widen(path);
+  FILE *f;
+
+  if (wpath == NULL) {
+    return NULL;
+  }
+  f = _wfopen(wpath, mode);
+  CMP_FREE(wpath);
+  return f;
+}
+#define HC_MODE(m) L##m
+
+static void hc_remove(const char *path) {
+  wchar_t *wpath = hc_widen(path);
+  if (wpath != NULL) {
+    _wremove(wpath);
+    CMP_FREE(wpath);
+  }
+}
+
+static int hc_rename(const char *from, const char *to) {
+  wchar_t *wfrom = hc_widen(from);
+  wchar_t *wto = hc_widen(to);
+  int rc = -1;
+
+  if (wfrom != NULL && wto != NULL) {
+    _wremove(wto);
+    rc = _wrename(wfrom, wto);
+  }
+  if (wfrom != NULL) {
+    CMP_FREE(wfrom);
+  }
+  if (wto != NULL) {
+    CMP_FREE(wto);
+  }
+  return rc;
+}
+
+static void hc_mkdir(const char *path) {
+  wchar_t *wpath = hc_widen(path);
+  if (wpath != NULL) {
+    _wmkdir(wpath);
+    CMP_FREE(wpath);
+  }
+}
+#else
+#define hc_fopen fopen
+#define HC_MODE(m) m
+
+static void hc_remove(const char *path) { remove(path); }
+
+static int hc_rename(const char *from, const char *to) {
+  return rename(from, to);
+}
+
+static void hc_mkdir(const char *path) { mkdir(path, 0755); }
+#endif
+
+static int hc_exists(const char *path) {
+  FILE *f = hc_fopen(path, HC_MODE("rb"));
+  if (f == NULL) {
+    return 0;
+  }
+  fclose(f);
+  return 1;
+}
+
+/* Write through a temporary name so readers never see half a file */
+static int hc_write_file(const char *path, const void *data, size_t len) {
+  char *tmp;
+  FILE *f;
+  int ok = 0;
+
+  if (CMP_MALLOC(strlen(path) + 5, (void **)&tmp) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  sprintf(tmp, "%s.tmp", path);
+  f = hc_fopen(tmp, HC_MODE("wb"));
+  if (f != NULL) {
+    ok = fwrite(data, 1, len, f) == len;
+    ok = fclose(f) == 0 && ok;
+    ok = ok && hc_rename(tmp, path) == 0;
+    if (!ok) {
+      hc_remove(tmp);
+    }
+  }
+  CMP_FREE(tmp);
+  return ok ? CMP_SUCCESS : CMP_ERROR_IO;
+}
+
+static int hc_read_file(const char *path, size_t len, void **out_data) {
+  unsigned char *data;
+  FILE *f;
+  int ok;
+
+  f = hc_fopen(path, HC_MODE("rb"));
+  if (f == NULL) {
+    return CMP_ERROR_NOT_FOUND;
+  }
+  /* Plain malloc: the response is released by http_response_free */
+  data = (unsigned char *)malloc(len > 0 ? len : 1);
+  if (data == NULL) {
+    fclose(f);
+    return CMP_ERROR_OOM;
+  }
+  ok = fread(data, 1, len, f) == len && fgetc(f) == EOF;
+  fclose(f);
+  if (!ok) {
+    free(data);
+    return CMP_ERROR_IO;
+  }
+  *out_data = data;
+  return CMP_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Stored headers                                                           */
+/* ------------------------------------------------------------------------ */
+
+static void hc_meta_free(hc_meta_t *meta) {
+  size_t i;
+
+  for (i = 0; i < meta->count; ++i) {
+    CMP_FREE(meta->names[i]);
+    CMP_FREE(meta->values[i]);
+  }
+  if (meta->names != NULL) {
+    CMP_FREE(meta->names);
+  }
+  if (meta->values != NULL) {
+    CMP_FREE(meta->values);
+  }
+  memset(meta, 0, sizeof(*meta));
+}
+
+static const char *hc_meta_get(const hc_meta_t *meta, const char *name) {
+  size_t i;
+
+  for (i = 0; i < meta->count; ++i) {
+    if (hc_ieq(meta->names[i], name)) {
+      return meta->values[i];
+    }
+  }
+  return NULL;
+}
+
+/* Hop-by-hop fields and Age are not stored; Age is recomputed on use */
+static int hc_meta_skips(const char *name) {
+  static const char *skip[] = {"Connection",        "Keep-Alive",
+                               "Transfer-Encoding", "Upgrade",
+                               "TE",                "Trailer",
+                               "Proxy-Connection",  "Proxy-Authenticate",
+                               "Age"};
+  size_t i;
+
+  for (i = 0; i < sizeof(skip) / sizeof(skip[0]); ++i) {
+    if (hc_ieq(name, skip[i])) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int hc_meta_set(hc_meta_t *meta, const char *name, const char *value) {
+  char **names, **values;
+  char *copy;
+  size_t i, cap;
+
+  if (hc_meta_skips(name) || strchr(name, '\n') != NULL ||
+      strchr(name, ':') != NULL || strchr(value, '\n') != NULL) {
+    return CMP_SUCCESS;
+  }
+  for (i = 0; i < meta->count; ++i) {
+    if (hc_ieq(meta->names[i], name)) {
+      copy = hc_strdup(value);
+      if (copy == NULL) {
+        return CMP_ERROR_OOM;
+      }
+      CMP_FREE(meta->values[i]);
+      meta->values[i] = copy;
+      return CMP_SUCCESS;
+    }
+  }
+  if (meta->count == meta->capacity) {
+    cap = meta->capacity ? meta->capacity * 2 : 16;
+    if (CMP_MALLOC(cap * sizeof(char *), (void **)&names) != CMP_SUCCESS) {
+      return CMP_ERROR_OOM;
+    }
+    if (CMP_MALLOC(cap * sizeof(char *), (void **)&values) != CMP_SUCCESS) {
+      CMP_FREE(names);
+      return CMP_ERROR_OOM;
+    }
+    if (meta->count > 0) {
+      memcpy(names, meta->names, meta->count * sizeof(char *));
+      memcpy(values, meta->values, meta->count * sizeof(char *));
+      CMP_FREE(meta->names);
+      CMP_FREE(meta->values);
+    }
+    meta->names = names;
+    meta->values = values;
+    meta->capacity = cap;
+  }
+  meta->names[meta->count] = hc_strdup(name);
+  meta->values[meta->count] = hc_strdup(value);
+  if (meta->names[meta->count] == NULL || meta->values[meta->count] == NULL) {
+    if (meta->names[meta->count] != NULL) {
+      CMP_FREE(meta->names[meta->count]);
+    }
+    if (meta->values[meta->count] != NULL) {
+      CMP_FREE(meta->values[meta->count]);
+    }
+    return CMP_ERROR_OOM;
+  }
+  meta->count++;
+  return CMP_SUCCESS;
+}
+
+/* Merge a response's fields; a 304 updates the stored ones (4.3.4) */
+static int hc_meta_merge(hc_meta_t *meta, const struct HttpHeaders *headers,
+                         int not_modified) {
+  size_t i;
+  int rc;
+
+  for (i = 0; i < headers->count; ++i) {
+    if (not_modified && hc_ieq(headers->keys[i], "Content-Length")) {
+      continue;
+    }
+    rc = hc_meta_set(meta, headers->keys[i], headers->values[i]);
+    if (rc != CMP_SUCCESS) {
+      return rc;
+    }
+  }
+  return CMP_SUCCESS;
+}
+
+/* The URL on the first line, then "Name: value" lines */
+static int hc_meta_write(const char *path, const char *url,
+                         const hc_meta_t *meta) {
+  size_t i, len = strlen(url) + 2;
+  char *text, *p;
+  int rc;
+
+  for (i = 0; i < meta->count; ++i) {
+    len += strlen(meta->names[i]) + strlen(meta->values[i]) + 3;
+  }
+  if (CMP_MALLOC(len, (void **)&text) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  p = text;
+  p += sprintf(p, "%s\n", url);
+  for (i = 0; i < meta->count; ++i) {
+    p += sprintf(p, "%s: %s\n", meta->names[i], meta->values[i]);
+  }
+  rc = hc_write_file(path, text, (size_t)(p - text));
+  CMP_FREE(text);
+  return rc;
+}
+
+static int hc_meta_read(const char *path, hc_meta_t *meta, char **out_url) {
+  char *line, *colon, *value;
+  size_t len;
+  FILE *f;
+  int rc = CMP_SUCCESS;
+
+  memset(meta, 0, sizeof(*meta));
+  *out_url = NULL;
+  f = hc_fopen(path, HC_MODE("rb"));
+  if (f == NULL) {
+    return CMP_ERROR_NOT_FOUND;
+  }
+  if (CMP_MALLOC(HC_LINE_MAX, (void **)&line) != CMP_SUCCESS) {
+    fclose(f);
+    return CMP_ERROR_OOM;
+  }
+  while (rc == CMP_SUCCESS && fgets(line, HC_LINE_MAX, f) != NULL) {
+    len = strlen(line);
+    if (len == 0 || line[len - 1] != '\n') {
+      rc = CMP_ERROR_IO;
+      break;
+    }
+    line[len - 1] = '\0';
+    if (*out_url == NULL) {
+      *out_url = hc_strdup(line);
+      rc = *out_url != NULL ? CMP_SUCCESS : CMP_ERROR_OOM;
+      continue;
+    }
+    colon = strchr(line, ':');
+    if (colon == NULL) {
+      rc = CMP_ERROR_IO;
+      break;
+    }
+    *colon = '\0';
+    for (value = colon + 1; *value == ' '; ++value) {
+    }
+    rc = hc_meta_set(meta, line, value);
+  }
+  fclose(f);
+  CMP_FREE(line);
+  if (rc == CMP_SUCCESS && *out_url == NULL) {
+    rc = CMP_ERROR_IO;
+  }
+  if (rc != CMP_SUCCESS) {
+    hc_meta_free(meta);
+    if (*out_url != NULL) {
+      CMP_FREE(*out_url);
+      *out_url = NULL;
+    }
+  }
+  return rc;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Directives and dates                                                     */
+/* ------------------------------------------------------------------------ */
+
+static long hc_delta(const char *p) {
+  unsigned long v = 0;
+
+  if (*p == '"') {
+    p++;
+  }
+  if (*p < '0' || *p > '9') {
+    return -1;
+  }
+  while (*p >= '0' && *p <= '9') {
+    v = v * 10 + (unsigned long)(*p - '0');
+    if (v > 0x7fffffffUL) {
+      return 0x7fffffffL; /* RFC 9111 1.2.2: saturate */
+    }
+    p++;
+  }
+  return (long)v;
+}
+
+static void hc_cc_parse(const char *value, hc_cc_t *cc) {
+  const char *p = value, *end, *eq;
+  char name[32];
+  size_t len;
+
+  memset(cc, 0, sizeof(*cc));
+  cc->max_age = -1;
+  cc->max_stale = -1;
+  cc->swr = -1;
+  cc->sie = -1;
+  while (p != NULL && *p != '\0') {
+    while (*p == ' ' || *p == ',') {
+      p++;
+    }
+    end = p;
+    while (*end != '\0' && *end != ',') {
+      end = *end == '"' && strchr(end + 1, '"') != NULL
+                ? strchr(end + 1, '"') + 1
+                : end + 1;
+    }
+    for (eq = p; eq < end && *eq != '=' && *eq != ' '; ++eq) {
+    }
+    len = (size_t)(eq - p);
+    if (len > 0 && len < sizeof(name)) {
+      memcpy(name, p, len);
+      name[len] = '\0';
+      eq = *eq == '=' ? eq + 1 : NULL;
+      if (hc_ieq(name, "max-age") && eq != NULL) {
+        cc->max_age = hc_delta(eq);
+      } else if (hc_ieq(name, "max-stale")) {
+        cc->max_stale = eq != NULL ? hc_delta(eq) : 0x7fffffffL;
+      } else if (hc_ieq(name, "stale-while-revalidate") && eq != NULL) {
+        cc->swr = hc_delta(eq);
+      } else if (hc_ieq(name, "stale-if-error") && eq != NULL) {
+        cc->sie = hc_delta(eq);
+      } else if (hc_ieq(name, "no-store")) {
+        cc->no_store = 1;
+      } else if (hc_ieq(name, "no-cache")) {
+        cc->no_cache = 1;
+      } else if (hc_ieq(name, "must-revalidate")) {
+        cc->must_revalidate = 1;
+      } else if (hc_ieq(name, "only-if-cached")) {
+        cc->only_if_cached = 1;
+      }
+    }
+    p = end;
+  }
+}
+
+/* IMF-fixdate ("Sun, 06 Nov 1994 08:49:37 GMT") to seconds since the
+   epoch; the obsolete formats count as invalid. */
+static int hc_parse_date(const char *s, unsigned long *out) {
+  static const char months[] = "janfebmaraprmayjunjulaugsepoctnovdec";
+  int day, month, year, hour, minute, second, i;
+  long y, era, yoe, doy, doe, days;
+  char mon[4];
+
+  if (s == NULL) {
+    return 0;
+  }
+  s = strchr(s, ',');
+  if (s == NULL ||
+      sscanf(s + 1, "%d %3s %d %d:%d:%d", &day, mon, &year, &hour, &minute,
+             &second) != 6) {
+    return 0;
+  }
+  month = 0;
+  for (i = 0; i < 12; ++i) {
+    if (hc_lower(mon[0]) == months[i * 3] &&
+        hc_lower(mon[1]) == months[i * 3 + 1] &&
+        hc_lower(mon[2]) == months[i * 3 + 2]) {
+      month = i + 1;
+    }
+  }
+  if (month == 0 || day < 1 || day > 31 || year < 1970 || hour > 23 ||
+      minute > 59 || second > 60) {
+    return 0;
+  }
+  /* Days from the civil date (proleptic Gregorian) */
+  y = year - (month <= 2);
+  era = y / 400;
+  yoe = y - era * 400;
+  doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  days = era * 146097L + doe - 719468L;
+  *out = (unsigned long)days * 86400UL + (unsigned long)hour * 3600UL +
+         (unsigned long)minute * 60UL + (unsigned long)second;
+  return 1;
+}
+
+/* Statuses cacheable by heuristic freshness (RFC 9110 15.1) */
+static int hc_heuristic_status(int status) {
+  switch (status) {
+  case 200:
+  case 203:
+  case 204:
+  case 300:
+  case 301:
+  case 308:
+  case 404:
+  case 405:
+  case 410:
+  case 414:
+  case 501:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+static void hc_copy_validator(char *dst, size_t cap, const char *value) {
+  if (value == NULL || strlen(value) >= cap) {
+    dst[0] = '\0';
+    return;
+  }
+  strcpy(dst, value);
+}
+
+/* Fill a slot's freshness from its stored headers. Returns 0 when the
+   response must not be stored. */
+static int hc_freshness(hc_slot_t *slot, const hc_meta_t *meta,
+                        unsigned long response_time, long age_header) {
+  unsigned long date, expires, modified;
+  unsigned long lifetime = 0, apparent = 0;
+  hc_cc_t cc;
+  const char *value;
+
+  value = hc_meta_get(meta, "Cache-Control");
+  hc_cc_parse(value != NULL ? value : "", &cc);
+  value = hc_meta_get(meta, "Vary");
+  if (cc.no_store || (value != NULL && strchr(value, '*') != NULL)) {
+    return 0;
+  }
+  if (!hc_parse_date(hc_meta_get(meta, "Date"), &date)) {
+    date = response_time;
+  }
+  if (cc.max_age >= 0) {
+    lifetime = (unsigned long)cc.max_age;
+  } else if (hc_meta_get(meta, "Expires") != NULL) {
+    /* An unparseable Expires means already expired */
+    if (hc_parse_date(hc_meta_get(meta, "Expires"), &expires) &&
+        expires > date) {
+      lifetime = expires - date;
+    }
+  } else if (hc_heuristic_status((int)slot->status) &&
+             hc_parse_date(hc_meta_get(meta, "Last-Modified"), &modified) &&
+             modified < date) {
+    lifetime = (date - modified) / 10;
+    lifetime = lifetime < HC_HEURISTIC_MAX ? lifetime : HC_HEURISTIC_MAX;
+  } else if (!hc_heuristic_status((int)slot->status)) {
+    return 0;
+  }
+
+  hc_copy_validator(slot->etag, sizeof(slot->etag),
+                    hc_meta_get(meta, "ETag"));
+  hc_copy_validator(slot->last_modified, sizeof(slot->last_modified),
+                    hc_meta_get(meta, "Last-Modified"));
+  if (lifetime == 0 && slot->etag[0] == '\0' &&
+      slot->last_modified[0] == '\0') {
+    return 0; /* Could never be used */
+  }
+  if (response_time > date) {
+    apparent = response_time - date;
+  }
+  if (age_header > 0 && (unsigned long)age_header > apparent) {
+    apparent = (unsigned long)age_header;
+  }
+  slot->stored = (unsigned int)response_time;
+  slot->initial_age = (unsigned int)apparent;
+  slot->lifetime = (unsigned int)lifetime;
+  slot->swr = cc.swr > 0 ? (unsigned int)cc.swr : 0;
+  slot->sie = cc.sie > 0 ? (unsigned int)cc.sie : 0;
+  slot->flags = (cc.no_cache ? HC_F_NO_CACHE : 0) |
+                (cc.must_revalidate ? HC_F_MUST_REVALIDATE : 0) |
+                (value != NULL ? HC_F_VARY : 0);
+  return 1;
+}
+
+static unsigned long hc_age(const hc_slot_t *slot, unsigned long now) {
+  return (unsigned long)slot->initial_age +
+         (now > slot->stored ? now - slot->stored : 0UL);
+}
+
+/* Fingerprint the request fields a response varies on */
+static void hc_vary_digest(const hc_meta_t *meta,
+                           const struct HttpRequest *req,
+                           unsigned char out[32]) {
+  const char *vary = hc_meta_get(meta, "Vary");
+  const char *p, *end, *value;
+  char name[64];
+  size_t len, i;
+  cmp_sha256_t sha;
+
+  cmp_sha256_init(&sha);
+  for (p = vary; p != NULL && *p != '\0'; p = end) {
+    while (*p == ' ' || *p == ',') {
+      p++;
+    }
+    for (end = p; *end != '\0' && *end != ',' && *end != ' '; ++end) {
+    }
+    len = (size_t)(end - p);
+    if (len == 0 || len >= sizeof(name)) {
+      continue;
+    }
+    for (i = 0; i < len; ++i) {
+      name[i] = hc_lower(p[i]);
+    }
+    name[len] = '\0';
+    value = hc_request_header(req, name);
+    cmp_sha256_update(&sha, name, len);
+    cmp_sha256_update(&sha, ":", 1);
+    if (value != NULL) {
+      cmp_sha256_update(&sha, value, strlen(value));
+    }
+    cmp_sha256_update(&sha, "\n", 1);
+  }
+  cmp_sha256_final(&sha, out);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Index                                                                    */
+/* ------------------------------------------------------------------------ */
+
+static size_t hc_home(const cmp_http_cache_t *cache,
+                      const unsigned char key[32]) {
+  unsigned long h = ((unsigned long)key[0] << 24) |
+                    ((unsigned long)key[1] << 16) |
+                    ((unsigned long)key[2] << 8) | (unsigned long)key[3];
+  return (size_t)(h % cache->header->slot_count);
+}
+
+static hc_slot_t *hc_find(cmp_http_cache_t *cache,
+                          const unsigned char key[32]) {
+  size_t n = cache->header->slot_count;
+  size_t i, at = hc_home(cache, key);
+  hc_slot_t *slot;
+
+  for (i = 0; i < n; ++i) {
+    slot = &cache->slots[(at + i) % n];
+    if (slot->state == HC_SLOT_FREE) {
+      return NULL;
+    }
+    if (slot->state == HC_SLOT_USED && memcmp(slot->key, key, 32) == 0) {
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+/* Remove an entry and whichever of its files nothing else uses */
+static void hc_drop(cmp_http_cache_t *cache, hc_slot_t *slot) {
+  unsigned int i;
+  char *path;
+  int shared = 0;
+
+  slot->state = HC_SLOT_DEAD;
+  cache->header->entries--;
+  cache->header->bytes -= slot->body_len;
+  cache->header->dead++;
+  path = hc_file(cache, "h", slot->key);
+  if (path != NULL) {
+    hc_remove(path);
+    CMP_FREE(path);
+  }
+  for (i = 0; i < cache->header->slot_count && !shared; ++i) {
+    shared = cache->slots[i].state == HC_SLOT_USED &&
+             memcmp(cache->slots[i].body, slot->body, 32) == 0;
+  }
+  if (!shared) {
+    path = hc_file(cache, "b", slot->body);
+    if (path != NULL) {
+      hc_remove(path);
+      CMP_FREE(path);
+    }
+  }
+}
+
+static void hc_evict_lru(cmp_http_cache_t *cache) {
+  hc_slot_t *victim = NULL;
+  unsigned int i;
+
+  for (i = 0; i < cache->header->slot_count; ++i) {
+    hc_slot_t *slot = &cache->slots[i];
+    if (slot->state == HC_SLOT_USED &&
+        (victim == NULL || slot->last_used < victim->last_used)) {
+      victim = slot;
+    }
+  }
+  if (victim != NULL) {
+    hc_drop(cache, victim);
+    cache->stats.evictions++;
+  }
+}
+
+/* Reinsert live slots once tombstones crowd the table */
+static int hc_rehash(cmp_http_cache_t *cache) {
+  size_t n = cache->header->slot_count;
+  size_t i, j, at;
+  hc_slot_t *copy;
+
+  if (CMP_MALLOC(n * sizeof(hc_slot_t), (void **)&copy) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memcpy(copy, cache->slots, n * sizeof(hc_slot_t));
+  memset(cache->slots, 0, n * sizeof(hc_slot_t));
+  for (i = 0; i < n; ++i) {
+    if (copy[i].state != HC_SLOT_USED) {
+      continue;
+    }
+    at = hc_home(cache, copy[i].key);
+    for (j = 0; cache->slots[(at + j) % n].state != HC_SLOT_FREE; ++j) {
+    }
+    cache->slots[(at + j) % n] = copy[i];
+  }
+  cache->header->dead = 0;
+  CMP_FREE(copy);
+  return CMP_SUCCESS;
+}
+
+/* A slot for a new entry, evicting to stay within the limits */
+static hc_slot_t *hc_claim(cmp_http_cache_t *cache,
+                           const unsigned char key[32], size_t body_len) {
+  size_t n = cache->header->slot_count;
+  size_t i, at;
+  hc_slot_t *slot;
+
+  slot = hc_find(cache, key);
+  if (slot != NULL) {
+    hc_drop(cache, slot);
+  }
+  while (cache->header->entries > 0 &&
+         (cache->header->entries >= cache->config.max_entries ||
+          cache->header->bytes + body_len > cache->config.max_bytes)) {
+    hc_evict_lru(cache);
+  }
+  if (cache->header->entries + cache->header->dead >= n * 3 / 4 &&
+      hc_rehash(cache) != CMP_SUCCESS) {
+    return NULL;
+  }
+  at = hc_home(cache, key);
+  for (i = 0; i < n; ++i) {
+    slot = &cache->slots[(at + i) % n];
+    if (slot->state != HC_SLOT_USED) {
+      if (slot->state == HC_SLOT_DEAD) {
+        cache->header->dead--;
+      }
+      memset(slot, 0, sizeof(*slot));
+      memcpy(slot->key, key, 32);
+      return slot;
+    }
+  }
+  return NULL;
+}
+
+static void hc_index_reset(cmp_http_cache_t *cache) {
+  memset(cache->header, 0, sizeof(hc_header_t));
+  memcpy(cache->header->magic, HC_MAGIC, sizeof(HC_MAGIC));
+  cache->header->slot_size = (unsigned int)sizeof(hc_slot_t);
+  cache->header->slot_count = (unsigned int)(cache->config.max_entries * 2);
+  memset(cache->slots, 0, cache->header->slot_count * sizeof(hc_slot_t));
+}
+
+static int hc_index_valid(const cmp_http_cache_t *cache) {
+  return memcmp(cache->header->magic, HC_MAGIC, sizeof(HC_MAGIC)) == 0 &&
+         cache->header->slot_size == sizeof(hc_slot_t) &&
+         cache->header->slot_count == cache->config.max_entries * 2;
+}
+
+static int hc_index_open(cmp_http_cache_t *cache) {
+  size_t len = sizeof(hc_header_t) +
+               cache->config.max_entries * 2 * sizeof(hc_slot_t);
+#if defined(_WIN32)
+  FILE *f;
+  int loaded = 0;
+
+  if (CMP_MALLOC(len, &cache->map) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  f = hc_fopen(cache->index_path, HC_MODE("rb"));
+  if (f != NULL) {
+    loaded = fread(cache->map, 1, len, f) == len && fgetc(f) == EOF;
+    fclose(f);
+  }
+  cache->map_len = len;
+  cache->header = (hc_header_t *)cache->map;
+  cache->slots = (hc_slot_t *)(cache->header + 1);
+  if (!loaded || !hc_index_valid(cache)) {
+    hc_index_reset(cache);
+  }
+  return CMP_SUCCESS;
+#else
+  struct stat st;
+  void *map;
+  int fresh;
+
+  cache->fd = open(cache->index_path, O_RDWR | O_CREAT, 0644);
+  if (cache->fd < 0) {
+    return CMP_ERROR_NOT_FOUND;
+  }
+  fresh = fstat(cache->fd, &st) != 0 || (size_t)st.st_size != len;
+  if (fresh && (ftruncate(cache->fd, 0) != 0 ||
+                ftruncate(cache->fd, (off_t)len) != 0)) {
+    close(cache->fd);
+    return CMP_ERROR_IO;
+  }
+  map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, cache->fd, 0);
+  if (map == MAP_FAILED) {
+    close(cache->fd);
+    return CMP_ERROR_IO;
+  }
+  cache->map = map;
+  cache->map_len = len;
+  cache->header = (hc_header_t *)map;
+  cache->slots = (hc_slot_t *)(cache->header + 1);
+  if (fresh || !hc_index_valid(cache)) {
+    hc_index_reset(cache);
+  }
+  return CMP_SUCCESS;
+#endif
+}
+
+static void hc_index_close(cmp_http_cache_t *cache) {
+#if defined(_WIN32)
+  FILE *f = hc_fopen(cache->index_path, HC_MODE("wb"));
+  if (f != NULL) {
+    fwrite(cache->map, 1, cache->map_len, f);
+    fclose(f);
+  }
+  CMP_FREE(cache->map);
+#else
+  msync(cache->map, cache->map_len, MS_SYNC);
+  munmap(cache->map, cache->map_len);
+  close(cache->fd);
+#endif
+}
+
+/* ------------------------------------------------------------------------ */
+/* Lookup and storage                                                       */
+/* ------------------------------------------------------------------------ */
+
+/* Copy out the entry for a request under the lock, honouring Vary */
+static int hc_lookup(cmp_http_cache_t *cache, const struct HttpRequest *req,
+                     const unsigned char key[32], hc_slot_t *out_entry) {
+  unsigned char vary[32];
+  hc_slot_t *slot;
+  hc_meta_t meta;
+  char *path, *url;
+  int found = 0;
+
+  slot = hc_find(cache, key);
+  if (slot == NULL) {
+    return 0;
+  }
+  if ((slot->flags & HC_F_VARY) == 0) {
+    found = 1;
+  } else if ((path = hc_file(cache, "h", key)) != NULL) {
+    if (hc_meta_read(path, &meta, &url) == CMP_SUCCESS) {
+      hc_vary_digest(&meta, req, vary);
+      found = memcmp(vary, slot->vary, 32) == 0;
+      hc_meta_free(&meta);
+      CMP_FREE(url);
+    }
+    CMP_FREE(path);
+  }
+  if (found) {
+    *out_entry = *slot;
+  }
+  return found;
+}
+
+/* Rebuild a response from disk and mark the entry used */
+static int hc_serve(cmp_http_cache_t *cache, const hc_slot_t *entry,
+                    unsigned long now, struct HttpResponse **out_res) {
+  struct HttpResponse *res;
+  hc_slot_t *slot;
+  hc_meta_t meta;
+  char *path, *url = NULL;
+  char age[24];
+  size_t i;
+  int rc;
+
+  res = (struct HttpResponse *)calloc(1, sizeof(struct HttpResponse));
+  if (res == NULL) {
+    return CMP_ERROR_OOM;
+  }
+  res->status_code = (int)entry->status;
+  path = hc_file(cache, "h", entry->key);
+  rc = path != NULL ? hc_meta_read(path, &meta, &url) : CMP_ERROR_OOM;
+  if (path != NULL) {
+    CMP_FREE(path);
+  }
+  if (rc != CMP_SUCCESS) {
+    free(res);
+    return rc;
+  }
+  CMP_FREE(url);
+  for (i = 0; rc == CMP_SUCCESS && i < meta.count; ++i) {
+    if (http_headers_add(&res->headers, meta.names[i], meta.values[i]) != 0) {
+      rc = CMP_ERROR_OOM;
+    }
+  }
+  hc_meta_free(&meta);
+  sprintf(age, "%lu", hc_age(entry, now));
+  if (rc == CMP_SUCCESS && http_headers_add(&res->headers, "Age", age) != 0) {
+    rc = CMP_ERROR_OOM;
+  }
+  if (rc == CMP_SUCCESS) {
+    path = hc_file(cache, "b", entry->body);
+    rc = path != NULL ? hc_read_file(path, entry->body_len, &res->body)
+                      : CMP_ERROR_OOM;
+    if (path != NULL) {
+      CMP_FREE(path);
+    }
+    res->body_len = rc == CMP_SUCCESS ? entry->body_len : 0;
+  }
+  if (rc != CMP_SUCCESS) {
+    http_response_free(res);
+    return rc;
+  }
+  slot = hc_find(cache, entry->key);
+  if (slot != NULL) {
+    slot->last_used = ++cache->header->tick;
+  }
+  *out_res = res;
+  return CMP_SUCCESS;
+}
+
+/* Store a network response if RFC 9111 allows it */
+static void hc_store(cmp_http_cache_t *cache, const struct HttpRequest *req,
+                     const unsigned char key[32],
+                     const struct HttpResponse *res, unsigned long now) {
+  hc_slot_t entry, *slot;
+  hc_meta_t meta;
+  const char *age;
+  char *path, *body;
+  long age_header = 0;
+  int ok, wrote;
+
+  memset(&entry, 0, sizeof(entry));
+  memset(&meta, 0, sizeof(meta));
+  entry.status = (unsigned int)res->status_code;
+  if (res->status_code == 206 ||
+      http_headers_get(&res->headers, "Age", &age) != 0) {
+    age = NULL;
+  }
+  if (age != NULL) {
+    age_header = hc_delta(age);
+  }
+  ok = res->status_code != 206 &&
+       res->body_len <= cache->config.max_bytes / 4 &&
+       (res->body != NULL || res->body_len == 0) &&
+       hc_meta_merge(&meta, &res->headers, 0) == CMP_SUCCESS &&
+       hc_freshness(&entry, &meta, now, age_header);
+
+  cmp_mutex_lock(&cache->lock);
+  if (!ok) {
+    /* A newer answer outdates what was stored; server errors do not */
+    slot = res->status_code < 500 ? hc_find(cache, key) : NULL;
+    if (slot != NULL) {
+      hc_drop(cache, slot);
+    }
+    cmp_mutex_unlock(&cache->lock);
+    hc_meta_free(&meta);
+    return;
+  }
+  hc_digest(res->body, res->body_len, entry.body);
+  if (entry.flags & HC_F_VARY) {
+    hc_vary_digest(&meta, req, entry.vary);
+  }
+  /* Claim first: replacing an entry may drop the body file it shares */
+  slot = hc_claim(cache, key, res->body_len);
+  body = slot != NULL ? hc_file(cache, "b", entry.body) : NULL;
+  wrote = body != NULL && !hc_exists(body);
+  ok = body != NULL &&
+       (!wrote ||
+        hc_write_file(body, res->body, res->body_len) == CMP_SUCCESS);
+  path = ok ? hc_file(cache, "h", key) : NULL;
+  if (path != NULL && hc_meta_write(path, req->url, &meta) == CMP_SUCCESS) {
+    memcpy(entry.key, key, 32);
+    entry.state = HC_SLOT_USED;
+    entry.body_len = (unsigned int)res->body_len;
+    entry.last_used = ++cache->header->tick;
+    *slot = entry;
+    cache->header->entries++;
+    cache->header->bytes += entry.body_len;
+    cache->stats.stored++;
+  } else if (slot != NULL) {
+    /* Leave a tombstone so probe chains stay intact */
+    slot->state = HC_SLOT_DEAD;
+    cache->header->dead++;
+    if (ok && wrote) {
+      hc_remove(body);
+    }
+  }
+  if (path != NULL) {
+    CMP_FREE(path);
+  }
+  if (body != NULL) {
+    CMP_FREE(body);
+  }
+  cmp_mutex_unlock(&cache->lock);
+  hc_meta_free(&meta);
+}
+
+/* Fold a 304 into the stored entry (RFC 9111 4.3.4) */
+static int hc_refresh(cmp_http_cache_t *cache, const hc_slot_t *entry,
+                      const struct HttpResponse *res, unsigned long now) {
+  hc_slot_t updated;
+  hc_slot_t *slot;
+  hc_meta_t meta;
+  const char *age;
+  char *path, *url = NULL;
+  long age_header = 0;
+  int rc;
+
+  if (http_headers_get(&res->headers, "Age", &age) == 0) {
+    age_header = hc_delta(age);
+  }
+  cmp_mutex_lock(&cache->lock);
+  slot = hc_find(cache, entry->key);
+  path = hc_file(cache, "h", entry->key);
+  rc = slot == NULL || memcmp(slot->body, entry->body, 32) != 0 ||
+               path == NULL
+           ? CMP_ERROR_NOT_FOUND
+           : hc_meta_read(path, &meta, &url);
+  if (rc == CMP_SUCCESS) {
+    updated = *slot;
+    rc = hc_meta_merge(&meta, &res->headers, 1);
+    if (rc == CMP_SUCCESS) {
+      rc = hc_freshness(&updated, &meta, now, age_header)
+               ? hc_meta_write(path, url, &meta)
+               : CMP_ERROR_INVALID_STATE;
+    }
+    if (rc == CMP_SUCCESS) {
+      updated.last_used = ++cache->header->tick;
+      *slot = updated;
+    } else {
+      hc_drop(cache, slot);
+    }
+    hc_meta_free(&meta);
+    CMP_FREE(url);
+  }
+  if (path != NULL) {
+    CMP_FREE(path);
+  }
+  cmp_mutex_unlock(&cache->lock);
+  return rc;
+}
+
+static int hc_copy_request(const struct HttpRequest *req,
+                           const hc_slot_t *entry, struct HttpRequest *out) {
+  size_t i;
+
+  memset(out, 0, sizeof(*out));
+  if (http_request_init(out) != 0) {
+    return CMP_ERROR_OOM;
+  }
+  out->method = req->method;
+  out->url = req->url;
+  out->body = req->body;
+  out->body_len = req->body_len;
+  for (i = 0; i < req->headers.count; ++i) {
+    if (http_request_set_header(out, req->headers.keys[i],
+                                req->headers.values[i]) != 0) {
+      return CMP_ERROR_OOM;
+    }
+  }
+  if (entry != NULL && entry->etag[0] != '\0' &&
+      http_request_set_header(out, "If-None-Match", entry->etag) != 0) {
+    return CMP_ERROR_OOM;
+  }
+  if (entry != NULL && entry->last_modified[0] != '\0' &&
+      http_request_set_header(out, "If-Modified-Since",
+                              entry->last_modified) != 0) {
+    return CMP_ERROR_OOM;
+  }
+  return CMP_SUCCESS;
+}
+
+static void hc_release_request(struct HttpRequest *req) {
+  req->url = NULL; /* Borrowed from the caller */
+  req->body = NULL;
+  req->body_len = 0;
+  http_request_free(req);
+}
+
+/* Serve a stored entry; on failure forget it so the caller refetches */
+static int hc_serve_entry(cmp_http_cache_t *cache, const hc_slot_t *entry,
+                          unsigned long now, int stale,
+                          struct HttpResponse **out_res) {
+  hc_slot_t *slot;
+  int rc;
+
+  cmp_mutex_lock(&cache->lock);
+  rc = hc_serve(cache, entry, now, out_res);
+  if (rc == CMP_SUCCESS && stale) {
+    cache->stats.stale++;
+  } else if (rc == CMP_SUCCESS) {
+    cache->stats.hits++;
+  } else if ((slot = hc_find(cache, entry->key)) != NULL &&
+             memcmp(slot->body, entry->body, 32) == 0) {
+    hc_drop(cache, slot);
+  }
+  cmp_mutex_unlock(&cache->lock);
+  return rc;
+}
+
+/* Go to the origin, conditionally when a usable entry is stored. Without
+   out_res this is a background revalidation that only updates the entry. */
+static int hc_fetch(cmp_http_cache_t *cache, struct HttpClient *client,
+                    const struct HttpRequest *req, const unsigned char key[32],
+                    const hc_slot_t *entry, unsigned long now,
+                    struct HttpResponse **out_res,
+                    cmp_http_cache_result_t *out_result) {
+  struct HttpRequest copy;
+  struct HttpResponse *res = NULL;
+  hc_slot_t refreshed;
+  unsigned long after;
+  int validators, rc, failed;
+
+  validators = entry != NULL &&
+               (entry->etag[0] != '\0' || entry->last_modified[0] != '\0');
+  rc = hc_copy_request(req, validators ? entry : NULL, &copy);
+  if (rc == CMP_SUCCESS &&
+      (client->send == NULL ||
+       client->send(client->transport, &copy, &res) != 0 || res == NULL)) {
+    rc = CMP_ERROR_NOT_FOUND;
+  }
+  hc_release_request(&copy);
+  after = hc_now(cache);
+  now = after > now ? after : now;
+
+  failed = rc != CMP_SUCCESS || res->status_code >= 500;
+  if (failed && out_res != NULL && entry != NULL &&
+      (entry->flags & (HC_F_NO_CACHE | HC_F_MUST_REVALIDATE)) == 0 &&
+      hc_age(entry, now) < (unsigned long)entry->lifetime + entry->sie) {
+    /* stale-if-error */
+    if (hc_serve_entry(cache, entry, now, 1, out_res) == CMP_SUCCESS) {
+      if (res != NULL) {
+        http_response_free(res);
+      }
+      *out_result = CMP_HTTP_CACHE_STALE;
+      return CMP_SUCCESS;
+    }
+  }
+  if (rc != CMP_SUCCESS) {
+    return rc;
+  }
+
+  if (res->status_code == 304 && validators) {
+    rc = hc_refresh(cache, entry, res, now);
+    http_response_free(res);
+    cmp_mutex_lock(&cache->lock);
+    if (rc == CMP_SUCCESS && out_res != NULL) {
+      rc = hc_lookup(cache, req, key, &refreshed)
+               ? hc_serve(cache, &refreshed, now, out_res)
+               : CMP_ERROR_NOT_FOUND;
+    }
+    if (rc == CMP_SUCCESS) {
+      cache->stats.revalidated++;
+    }
+    cmp_mutex_unlock(&cache->lock);
+    if (rc != CMP_SUCCESS && out_res != NULL) {
+      /* The entry went away underneath; ask for the full response */
+      return hc_fetch(cache, client, req, key, NULL, now, out_res,
+                      out_result);
+    }
+    if (out_result != NULL) {
+      *out_result = CMP_HTTP_CACHE_REVALIDATED;
+    }
+    return rc;
+  }
+
+  hc_store(cache, req, key, res, now);
+  if (out_res == NULL) {
+    http_response_free(res);
+    return CMP_SUCCESS;
+  }
+  cmp_mutex_lock(&cache->lock);
+  cache->stats.misses++;
+  cmp_mutex_unlock(&cache->lock);
+  *out_res = res;
+  *out_result = CMP_HTTP_CACHE_MISS;
+  return CMP_SUCCESS;
+}
+
+/* Send straight to the origin, invalidating the URL after a successful
+   unsafe method (RFC 9111 4.4) */
+static int hc_pass(cmp_http_cache_t *cache, struct HttpClient *client,
+                   const struct HttpRequest *req, const unsigned char key[32],
+                   struct HttpResponse **out_res) {
+  hc_slot_t *slot;
+  int unsafe;
+
+  if (client->send == NULL ||
+      client->send(client->transport, req, out_res) != 0 || *out_res == NULL) {
+    *out_res = NULL;
+    return CMP_ERROR_NOT_FOUND;
+  }
+  unsafe = req->method == HTTP_POST || req->method == HTTP_PUT ||
+           req->method == HTTP_DELETE;
+  cmp_mutex_lock(&cache->lock);
+  cache->stats.misses++;
+  slot = unsafe && (*out_res)->status_code < 400 ? hc_find(cache, key) : NULL;
+  if (slot != NULL) {
+    hc_drop(cache, slot);
+  }
+  cmp_mutex_unlock(&cache->lock);
+  return CMP_SUCCESS;
+}
+
+/* Remember a request for cmp_http_cache_revalidate */
+static void hc_queue(cmp_http_cache_t *cache, const struct HttpRequest *req) {
+  struct HttpRequest *pending, *copy;
+  size_t i, cap;
+
+  cmp_mutex_lock(&cache->lock);
+  for (i = 0; i < cache->pending_count; ++i) {
+    if (strcmp(cache->pending[i].url, req->url) == 0) {
+      cmp_mutex_unlock(&cache->lock);
+      return;
+    }
+  }
+  if (cache->pending_count == cache->pending_capacity) {
+    cap = cache->pending_capacity ? cache->pending_capacity * 2 : 8;
+    if (CMP_MALLOC(cap * sizeof(struct HttpRequest), (void **)&pending) !=
+        CMP_SUCCESS) {
+      cmp_mutex_unlock(&cache->lock);
+      return;
+    }
+    if (cache->pending_count > 0) {
+      memcpy(pending, cache->pending,
+             cache->pending_count * sizeof(struct HttpRequest));
+      CMP_FREE(cache->pending);
+    }
+    cache->pending = pending;
+    cache->pending_capacity = cap;
+  }
+  copy = &cache->pending[cache->pending_count];
+  if (hc_copy_request(req, NULL, copy) != CMP_SUCCESS) {
+    hc_release_request(copy);
+    cmp_mutex_unlock(&cache->lock);
+    return;
+  }
+  copy->url = hc_strdup(req->url);
+  copy->body = NULL;
+  copy->body_len = 0;
+  if (copy->url == NULL) {
+    hc_release_request(copy);
+  } else {
+    cache->pending_count++;
+  }
+  cmp_mutex_unlock(&cache->lock);
+}
+
+static void hc_unqueue(struct HttpRequest *req) {
+  CMP_FREE(req->url);
+  hc_release_request(req);
+}
+
+int cmp_http_cache_config_init(cmp_http_cache_config_t *config) {
+  if (config == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  memset(config, 0, sizeof(*config));
+  config->max_bytes = 64UL * 1024UL * 1024UL;
+  config->max_entries = 4096;
+  return CMP_SUCCESS;
+}
+
+int cmp_http_cache_open(const cmp_http_cache_config_t *config,
+                        cmp_http_cache_t **out_cache) {
+  cmp_http_cache_t *cache;
+  cmp_string_t base;
+  char *sub;
+  size_t len;
+  int rc;
+
+  if (out_cache == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(*cache), (void **)&cache) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(cache, 0, sizeof(*cache));
+  if (config != NULL) {
+    cache->config = *config;
+  } else {
+    cmp_http_cache_config_init(&cache->config);
+  }
+  /* Index fields are 32-bit */
+  if (cache->config.max_entries == 0 || cache->config.max_bytes == 0 ||
+      cache->config.max_entries > 0x3fffffffUL ||
+      cache->config.max_bytes > 0xffffffffUL) {
+    CMP_FREE(cache);
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  rc = cache->config.directory != NULL
+           ? cmp_vfs_resolve_path(cache->config.directory, &base)
+           : cmp_vfs_get_standard_path(3, &base);
+  if (rc != CMP_SUCCESS) {
+    CMP_FREE(cache);
+    return rc;
+  }
+  len = strlen(base.data);
+  if (CMP_MALLOC(len + 32, (void **)&cache->dir) != CMP_SUCCESS) {
+    cmp_string_destroy(&base);
+    CMP_FREE(cache);
+    return CMP_ERROR_OOM;
+  }
+  hc_mkdir(base.data);
+  sprintf(cache->dir,
+          cache->config.directory != NULL ? "%s" : "%s/cmp_http_cache",
+          base.data);
+  cmp_string_destroy(&base);
+  cache->config.directory = NULL; /* Not owned */
+
+  len = strlen(cache->dir);
+  if (CMP_MALLOC(len + 8, (void **)&sub) != CMP_SUCCESS) {
+    CMP_FREE(cache->dir);
+    CMP_FREE(cache);
+    return CMP_ERROR_OOM;
+  }
+  hc_mkdir(cache->dir);
+  sprintf(sub, "%s/h", cache->dir);
+  hc_mkdir(sub);
+  sprintf(sub, "%s/b", cache->dir);
+  hc_mkdir(sub);
+  sprintf(sub, "%s/index", cache->dir);
+  cache->index_path = sub;
+
+  rc = cmp_mutex_init(&cache->lock);
+  if (rc == CMP_SUCCESS) {
+    rc = hc_index_open(cache);
+    if (rc != CMP_SUCCESS) {
+      cmp_mutex_destroy(&cache->lock);
+    }
+  }
+  if (rc != CMP_SUCCESS) {
+    CMP_FREE(cache->index_path);
+    CMP_FREE(cache->dir);
+    CMP_FREE(cache);
+    return rc;
+  }
+  *out_cache = cache;
+  return CMP_SUCCESS;
+}
+
+int cmp_http_cache_close(cmp_http_cache_t *cache) {
+  size_t i;
+
+  if (cache == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  for (i = 0; i < cache->pending_count; ++i) {
+    hc_unqueue(&cache->pending[i]);
+  }
+  if (cache->pending != NULL) {
+    CMP_FREE(cache->pending);
+  }
+  hc_index_close(cache);
+  cmp_mutex_destroy(&cache->lock);
+  CMP_FREE(cache->index_path);
+  CMP_FREE(cache->dir);
+  CMP_FREE(cache);
+  return CMP_SUCCESS;
+}
+
+int cmp_http_cache_send(cmp_http_cache_t *cache, struct HttpClient *client,
+                        const struct HttpRequest *req,
+                        struct HttpResponse **out_res,
+                        cmp_http_cache_result_t *out_result) {
+  cmp_http_cache_result_t result = CMP_HTTP_CACHE_MISS;
+  cmp_http_cache_mode_t mode;
+  unsigned char key[32];
+  unsigned long now, age, lifetime;
+  hc_slot_t entry;
+  hc_cc_t cc;
+  const char *value;
+  int found, may_stale, fresh, rc;
+
+  if (out_result != NULL) {
+    *out_result = CMP_HTTP_CACHE_MISS;
+  }
+  if (cache == NULL || client == NULL || req == NULL || req->url == NULL ||
+      out_res == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  *out_res = NULL;
+  hc_digest(req->url, strlen(req->url), key);
+  value = hc_request_header(req, "Cache-Control");
+  hc_cc_parse(value != NULL ? value : "", &cc);
+  if (value == NULL && (value = hc_request_header(req, "Pragma")) != NULL &&
+      hc_ieq(value, "no-cache")) {
+    cc.no_cache = 1;
+  }
+  cmp_mutex_lock(&cache->lock);
+  mode = cache->mode;
+  cmp_mutex_unlock(&cache->lock);
+
+  if (req->method != HTTP_GET || req->on_chunk != NULL || cc.no_store ||
+      hc_request_header(req, "Range") != NULL ||
+      hc_request_header(req, "If-None-Match") != NULL ||
+      hc_request_header(req, "If-Modified-Since") != NULL) {
+    if (mode == CMP_HTTP_CACHE_OFFLINE || cc.only_if_cached) {
+      return CMP_ERROR_NOT_FOUND;
+    }
+    return hc_pass(cache, client, req, key, out_res);
+  }
+
+  cmp_mutex_lock(&cache->lock);
+  found = hc_lookup(cache, req, key, &entry);
+  cmp_mutex_unlock(&cache->lock);
+  now = hc_now(cache);
+  if (found) {
+    age = hc_age(&entry, now);
+    lifetime = entry.lifetime;
+    may_stale = (entry.flags & (HC_F_NO_CACHE | HC_F_MUST_REVALIDATE)) == 0 &&
+                !cc.no_cache;
+    fresh = age < lifetime && (entry.flags & HC_F_NO_CACHE) == 0 &&
+            !cc.no_cache &&
+            (cc.max_age < 0 || age <= (unsigned long)cc.max_age);
+    if (!fresh && may_stale && cc.max_stale >= 0 &&
+        age < lifetime + (unsigned long)cc.max_stale) {
+      fresh = 1; /* The client accepts this much staleness */
+    }
+    if (fresh) {
+      result = CMP_HTTP_CACHE_HIT;
+    } else if (may_stale &&
+               (mode != CMP_HTTP_CACHE_ONLINE || cc.only_if_cached)) {
+      result = CMP_HTTP_CACHE_STALE;
+    } else if (may_stale && age < lifetime + entry.swr) {
+      hc_queue(cache, req);
+      result = CMP_HTTP_CACHE_STALE;
+    }
+    if (result != CMP_HTTP_CACHE_MISS) {
+      rc = hc_serve_entry(cache, &entry, now,
+                          result == CMP_HTTP_CACHE_STALE, out_res);
+      if (rc == CMP_SUCCESS) {
+        if (out_result != NULL) {
+          *out_result = result;
+        }
+        return CMP_SUCCESS;
+      }
+      found = 0;
+    }
+  }
+  if (mode == CMP_HTTP_CACHE_OFFLINE || cc.only_if_cached) {
+    return CMP_ERROR_NOT_FOUND;
+  }
+  return hc_fetch(cache, client, req, key, found ? &entry : NULL, now,
+                  out_res, out_result != NULL ? out_result : &result);
+}
+
+int cmp_http_cache_revalidate(cmp_http_cache_t *cache,
+                              struct HttpClient *client, size_t max_count) {
+  struct HttpRequest req;
+  unsigned char key[32];
+  hc_slot_t entry;
+  int found, count = 0;
+
+  if (cache == NULL || client == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  while (max_count == 0 || (size_t)count < max_count) {
+    cmp_mutex_lock(&cache->lock);
+    if (cache->pending_count == 0 || cache->mode == CMP_HTTP_CACHE_OFFLINE) {
+      cmp_mutex_unlock(&cache->lock);
+      break;
+    }
+    req = cache->pending[0];
+    cache->pending_count--;
+    memmove(cache->pending, cache->pending + 1,
+            cache->pending_count * sizeof(struct HttpRequest));
+    hc_digest(req.url, strlen(req.url), key);
+    found = hc_lookup(cache, &req, key, &entry);
+    cmp_mutex_unlock(&cache->lock);
+
+    hc_fetch(cache, client, &req, key, found ? &entry : NULL, hc_now(cache),
+             NULL, NULL);
+    hc_unqueue(&req);
+    count++;
+  }
+  return count;
+}
+
+int cmp_http_cache_set_mode(cmp_http_cache_t *cache,
+                            cmp_http_cache_mode_t mode) {
+  if (cache == NULL ||
+      (mode != CMP_HTTP_CACHE_ONLINE && mode != CMP_HTTP_CACHE_LOW_DATA &&
+       mode != CMP_HTTP_CACHE_OFFLINE)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  cmp_mutex_lock(&cache->lock);
+  cache->mode = mode;
+  cmp_mutex_unlock(&cache->lock);
+  return CMP_SUCCESS;
+}
+
+int cmp_http_cache_clear(cmp_http_cache_t *cache) {
+  unsigned int i;
+  hc_slot_t *slot;
+  char *path;
+
+  if (cache == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  cmp_mutex_lock(&cache->lock);
+  for (i = 0; i < cache->header->slot_count; ++i) {
+    slot = &cache->slots[i];
+    if (slot->state != HC_SLOT_USED) {
+      continue;
+    }
+    path = hc_file(cache, "h", slot->key);
+    if (path != NULL) {
+      hc_remove(path);
+      CMP_FREE(path);
+    }
+    path = hc_file(cache, "b", slot->body);
+    if (path != NULL) {
+      hc_remove(path);
+      CMP_FREE(path);
+    }
+  }
+  hc_index_reset(cache);
+  cmp_mutex_unlock(&cache->lock);
+  return CMP_SUCCESS;
+}
+
+int cmp_http_cache_get_stats(cmp_http_cache_t *cache,
+                             cmp_http_cache_stats_t *out_stats) {
+  if (cache == NULL || out_stats == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  cmp_mutex_lock(&cache->lock);
+  *out_stats = cache->stats;
+  out_stats->pending = cache->pending_count;
+  out_stats->entries = cache->header->entries;
+  out_stats->bytes = cache->header->bytes;
+  cmp_mutex_unlock(&cache->lock);
+  return CMP_SUCCESS;
+}
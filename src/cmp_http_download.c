@@ -0,0 +1,1210 @@
+/* clang-format off */
+#if !defined(_WIN32) && !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 600 /* pread, pwrite, ftruncate, clock_gettime */
+#endif
+#include "cmp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+/* clang-format on */
+
+/* Files are written in place with pwrite(2) on POSIX hosts. Windows has no
+   positional I/O in its C runtime, so there each write seeks under the
+   download lock. */
+
+extern int transport_factory_init_client(struct HttpClient *client);
+
+#define DL_MANIFEST_SUFFIX ".cmpdl"
+#define DL_MANIFEST_MAGIC "cmp-download 1"
+#define DL_MANIFEST_INTERVAL_MS 1000.0
+#define DL_LINE_MAX 4096
+#define DL_HASH_CHUNK 65536
+#define DL_MAX_RETRIES 2
+
+typedef struct dl_range {
+  size_t start;
+  size_t end;  /* Exclusive */
+  size_t done; /* Bytes on disk from start */
+  int taken;   /* Claimed by a fetcher */
+  int tries;
+} dl_range_t;
+
+typedef struct dl_download {
+  cmp_http_download_config_t config;
+  const char *url;
+  char *origin;
+  char *path;
+  char *manifest;
+  char validator[256];
+  char validator_kind; /* 'E' for an ETag, 'L' for Last-Modified, 0 none */
+#if defined(_WIN32)
+  FILE *file;
+#else
+  int fd;
+#endif
+  int total_known;
+  size_t total;
+  size_t range_size;
+  dl_range_t *ranges;
+  size_t range_count;
+  size_t streamed; /* Bytes written by a whole-body GET */
+
+  cmp_mutex_t lock; /* Guards ranges, streamed, running, error, stop, stats */
+  cmp_cond_t cond;
+  size_t running; /* Worker tasks not yet finished */
+  int error;      /* First fatal failure */
+  int stop;
+  int changed; /* The resource no longer matches the validator */
+  double last_signal;
+
+  /* Calling thread only */
+  int (*progress_cb)(float percentage, void *user_data);
+  void *user_data;
+  double last_report;
+  double last_save;
+  float last_percentage;
+  cmp_sha256_t sha;
+  size_t hashed;
+  unsigned char *hash_buf;
+
+  cmp_http_download_stats_t stats;
+} dl_download_t;
+
+typedef struct dl_fetch {
+  dl_download_t *dl;
+  dl_range_t *range; /* NULL when streaming the whole body */
+  size_t offset;     /* Where the next chunk lands */
+  size_t end;        /* Exclusive bound, 0 when unbounded */
+  int caller;
+  int chunked;
+  int overrun;
+  int io_error;
+} dl_fetch_t;
+
+static double dl_now(const dl_download_t *dl) {
+  if (dl->config.now_ms != NULL) {
+    return dl->config.now_ms(dl->config.now_data);
+  }
+#if defined(_WIN32)
+  return (double)GetTickCount();
+#else
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+  }
+#endif
+}
+
+static char *dl_strdup(const char *s, size_t len) {
+  char *copy;
+
+  if (CMP_MALLOC(len + 1, (void **)&copy) != CMP_SUCCESS) {
+    return NULL;
+  }
+  memcpy(copy, s, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+static char *dl_concat(const char *a, const char *b) {
+  size_t len = strlen(a);
+  char *joined;
+
+  if (CMP_MALLOC(len + strlen(b) + 1, (void **)&joined) != CMP_SUCCESS) {
+    return NULL;
+  }
+  memcpy(joined, a, len);
+  strcpy(joined + len, b);
+  return joined;
+}
+
+static int dl_parse_size(const char *s, size_t *out) {
+  size_t v = 0;
+  int digits = 0;
+
+  while (*s == ' ' || *s == '\t') {
+    s++;
+  }
+  while (*s >= '0' && *s <= '9') {
+    if (v > ((size_t)-1 - (size_t)(*s - '0')) / 10) {
+      return 0;
+    }
+    v = v * 10 + (size_t)(*s - '0');
+    s++;
+    digits++;
+  }
+  *out = v;
+  return digits > 0;
+}
+
+static int dl_ieq_prefix(const char *s, const char *prefix) {
+  while (*prefix != '\0') {
+    char a = *s, b = *prefix;
+    if (a >= 'A' && a <= 'Z') {
+      a = (char)(a - 'A' + 'a');
+    }
+    if (a != b) {
+      return 0;
+    }
+    s++;
+    prefix++;
+  }
+  return 1;
+}
+
+static const char *dl_header(const struct HttpResponse *res,
+                             const char *name) {
+  const char *value;
+
+  if (http_headers_get(&res->headers, name, &value) != 0) {
+    return NULL;
+  }
+  return value;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Files                                                                    */
+/* ------------------------------------------------------------------------ */
+
+#if defined(_WIN32)
+static wchar_t *dl_widen(const char *path) {
+  wchar_t *wpath = NULL;
+  cfs_size_t len = 0;
+
+  cfs_utf8_to_utf16(path, NULL, 0, &len);
+  if (len <= 0 || CMP_MALLOC((size_t)len * sizeof(wchar_t),
+                             (void **)&wpath) != CMP_SUCCESS) {
+    return NULL;
+  }
+  cfs_utf8_to_utf16(path, wpath, len, NULL);
+  return wpath;
+}
+
+static FILE *dl_fopen(const char *path, const wchar_t *mode) {
+  wchar_t *wpath = dl_widen(path);
+  FILE *f;
+
+  if (wpath == NULL) {
+    return NULL;
+  }
+  f = _wfopen(wpath, mode);
+  CMP_FREE(wpath);
+  return f;
+}
+#define DL_MODE(m) L##m
+
+static void dl_remove(const char *path) {
+  wchar_t *wpath = dl_widen(path);
+  if (wpath != NULL) {
+    _wremove(wpath);
+    CMP_FREE(wpath);
+  }
+}
+
+static int dl_rename(const char *from, const char *to) {
+  wchar_t *wfrom = dl_widen(from);
+  wchar_t *wto = dl_widen(to);
+  int rc = -1;
+
+  if (wfrom != NULL && wto != NULL) {
+    _wremove(wto);
+    rc = _wrename(wfrom, wto);
+  }
+  if (wfrom != NULL) {
+    CMP_FREE(wfrom);
+  }
+  if (wto != NULL) {
+    CMP_FREE(wto);
+  }
+  return rc;
+}
+#else
+#define dl_fopen fopen
+#define DL_MODE(m) m
+
+static void dl_remove(const char *path) { remove(path); }
+
+static int dl_rename(const char *from, const char *to) {
+  return rename(from, to);
+}
+#endif
+
+static int dl_file_open(dl_download_t *dl, int truncate) {
+#if defined(_WIN32)
+  dl->file = truncate ? NULL : dl_fopen(dl->path, DL_MODE("r+b"));
+  if (dl->file == NULL) {
+    dl->file = dl_fopen(dl->path, DL_MODE("w+b"));
+  }
+  return dl->file != NULL ? CMP_SUCCESS : CMP_ERROR_NOT_FOUND;
+#else
+  dl->fd = open(dl->path, O_RDWR | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+  return dl->fd >= 0 ? CMP_SUCCESS : CMP_ERROR_NOT_FOUND;
+#endif
+}
+
+static void dl_file_close(dl_download_t *dl) {
+#if defined(_WIN32)
+  if (dl->file != NULL) {
+    fclose(dl->file);
+    dl->file = NULL;
+  }
+#else
+  if (dl->fd >= 0) {
+    close(dl->fd);
+    dl->fd = -1;
+  }
+#endif
+}
+
+static int dl_file_size(dl_download_t *dl, size_t *out_size) {
+#if defined(_WIN32)
+  __int64 end;
+  cmp_mutex_lock(&dl->lock);
+  end = _fseeki64(dl->file, 0, SEEK_END) == 0 ? _ftelli64(dl->file) : -1;
+  cmp_mutex_unlock(&dl->lock);
+  if (end < 0) {
+    return CMP_ERROR_IO;
+  }
+  *out_size = (size_t)end;
+#else
+  struct stat st;
+  if (fstat(dl->fd, &st) != 0) {
+    return CMP_ERROR_IO;
+  }
+  *out_size = (size_t)st.st_size;
+#endif
+  return CMP_SUCCESS;
+}
+
+/* Reserve the whole file up front so ranges land in place */
+static int dl_file_allocate(dl_download_t *dl, size_t size) {
+#if defined(_WIN32)
+  return _chsize_s(_fileno(dl->file), (__int64)size) == 0 ? CMP_SUCCESS
+                                                          : CMP_ERROR_IO;
+#else
+  return ftruncate(dl->fd, (off_t)size) == 0 ? CMP_SUCCESS : CMP_ERROR_IO;
+#endif
+}
+
+static int dl_file_write_at(dl_download_t *dl, size_t offset,
+                            const void *data, size_t len) {
+#if defined(_WIN32)
+  int ok;
+  cmp_mutex_lock(&dl->lock);
+  ok = _fseeki64(dl->file, (__int64)offset, SEEK_SET) == 0 &&
+       fwrite(data, 1, len, dl->file) == len;
+  cmp_mutex_unlock(&dl->lock);
+  return ok ? CMP_SUCCESS : CMP_ERROR_IO;
+#else
+  const char *p = (const char *)data;
+  ssize_t n;
+
+  while (len > 0) {
+    n = pwrite(dl->fd, p, len, (off_t)offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return CMP_ERROR_IO;
+    }
+    p += n;
+    len -= (size_t)n;
+    offset += (size_t)n;
+  }
+  return CMP_SUCCESS;
+#endif
+}
+
+static int dl_file_read_at(dl_download_t *dl, size_t offset, void *data,
+                           size_t len) {
+#if defined(_WIN32)
+  int ok;
+  cmp_mutex_lock(&dl->lock);
+  ok = _fseeki64(dl->file, (__int64)offset, SEEK_SET) == 0 &&
+       fread(data, 1, len, dl->file) == len;
+  cmp_mutex_unlock(&dl->lock);
+  return ok ? CMP_SUCCESS : CMP_ERROR_IO;
+#else
+  char *p = (char *)data;
+  ssize_t n;
+
+  while (len > 0) {
+    n = pread(dl->fd, p, len, (off_t)offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return CMP_ERROR_IO;
+    }
+    p += n;
+    len -= (size_t)n;
+    offset += (size_t)n;
+  }
+  return CMP_SUCCESS;
+#endif
+}
+
+/* ------------------------------------------------------------------------ */
+/* Manifest                                                                 */
+/* ------------------------------------------------------------------------ */
+
+/* A text sidecar: magic, URL, validator, "total range_size count", then
+   the finished byte count of each range. Replaced atomically by rename. */
+static void dl_manifest_save(dl_download_t *dl) {
+  size_t *done = NULL;
+  size_t i;
+  char *tmp;
+  FILE *f;
+  int ok;
+
+  if (dl->validator_kind == 0 || dl->range_count == 0) {
+    return;
+  }
+  if (CMP_MALLOC(dl->range_count * sizeof(size_t), (void **)&done) !=
+      CMP_SUCCESS) {
+    return;
+  }
+  tmp = dl_concat(dl->manifest, ".tmp");
+  if (tmp == NULL) {
+    CMP_FREE(done);
+    return;
+  }
+
+  cmp_mutex_lock(&dl->lock);
+  for (i = 0; i < dl->range_count; ++i) {
+    done[i] = dl->ranges[i].done;
+  }
+  cmp_mutex_unlock(&dl->lock);
+
+  f = dl_fopen(tmp, DL_MODE("w"));
+  if (f != NULL) {
+    ok = fprintf(f, "%s\n%s\n%c %s\n%lu %lu %lu\n", DL_MANIFEST_MAGIC,
+                 dl->url, dl->validator_kind, dl->validator,
+                 (unsigned long)dl->total, (unsigned long)dl->range_size,
+                 (unsigned long)dl->range_count) > 0;
+    for (i = 0; ok && i < dl->range_count; ++i) {
+      ok = fprintf(f, "%lu\n", (unsigned long)done[i]) > 0;
+    }
+    ok = fclose(f) == 0 && ok;
+    if (!ok || dl_rename(tmp, dl->manifest) != 0) {
+      dl_remove(tmp);
+    }
+  }
+  CMP_FREE(tmp);
+  CMP_FREE(done);
+}
+
+static int dl_read_line(FILE *f, char *line) {
+  size_t len;
+
+  if (fgets(line, DL_LINE_MAX, f) == NULL) {
+    return 0;
+  }
+  len = strlen(line);
+  if (len == 0 || line[len - 1] != '\n') {
+    return 0;
+  }
+  line[len - 1] = '\0';
+  return 1;
+}
+
+/* Adopt the recorded progress when the manifest describes this URL at the
+   validator and length the server just reported */
+static int dl_manifest_load(dl_download_t *dl) {
+  char *line;
+  const char *p;
+  size_t total, range_size, count, i;
+  FILE *f;
+  int ok = 0;
+
+  if (CMP_MALLOC(DL_LINE_MAX, (void **)&line) != CMP_SUCCESS) {
+    return 0;
+  }
+  f = dl_fopen(dl->manifest, DL_MODE("r"));
+  if (f == NULL) {
+    CMP_FREE(line);
+    return 0;
+  }
+  if (!dl_read_line(f, line) || strcmp(line, DL_MANIFEST_MAGIC) != 0 ||
+      !dl_read_line(f, line) || strcmp(line, dl->url) != 0 ||
+      !dl_read_line(f, line) || line[0] != dl->validator_kind ||
+      line[1] != ' ' || strcmp(line + 2, dl->validator) != 0 ||
+      !dl_read_line(f, line)) {
+    goto done;
+  }
+  p = line;
+  if (!dl_parse_size(p, &total) || total != dl->total) {
+    goto done;
+  }
+  p = strchr(p, ' ');
+  if (p == NULL || !dl_parse_size(p, &range_size) ||
+      range_size != dl->range_size) {
+    goto done;
+  }
+  p = strchr(p + 1, ' ');
+  if (p == NULL || !dl_parse_size(p, &count) ||
+      count != (total + range_size - 1) / range_size ||
+      count != dl->range_count) {
+    goto done;
+  }
+  for (i = 0; i < count; ++i) {
+    dl_range_t *r = &dl->ranges[i];
+    r->start = i * range_size;
+    r->end = r->start + range_size < total ? r->start + range_size : total;
+    if (!dl_read_line(f, line) || !dl_parse_size(line, &r->done) ||
+        r->done > r->end - r->start) {
+      goto done;
+    }
+  }
+  ok = 1;
+
+done:
+  fclose(f);
+  CMP_FREE(line);
+  return ok;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Progress and digest                                                      */
+/* ------------------------------------------------------------------------ */
+
+static size_t dl_done_locked(const dl_download_t *dl) {
+  size_t done = dl->streamed;
+  size_t i;
+
+  for (i = 0; i < dl->range_count; ++i) {
+    done += dl->ranges[i].done;
+  }
+  return done;
+}
+
+/* Bytes on disk without a gap from the start of the file */
+static size_t dl_prefix_locked(const dl_download_t *dl) {
+  size_t i;
+
+  if (dl->range_count == 0) {
+    return dl->streamed;
+  }
+  for (i = 0; i < dl->range_count; ++i) {
+    const dl_range_t *r = &dl->ranges[i];
+    if (r->start + r->done < r->end) {
+      return r->start + r->done;
+    }
+  }
+  return dl->total;
+}
+
+/* Digest whatever has become contiguous, re-reading it from the page
+   cache, so verifying at the end only covers the tail */
+static int dl_hash_advance(dl_download_t *dl) {
+  size_t prefix, n;
+  int rc;
+
+  if (dl->hash_buf == NULL) {
+    return CMP_SUCCESS;
+  }
+  cmp_mutex_lock(&dl->lock);
+  prefix = dl_prefix_locked(dl);
+  cmp_mutex_unlock(&dl->lock);
+  while (dl->hashed < prefix) {
+    n = prefix - dl->hashed;
+    n = n < DL_HASH_CHUNK ? n : DL_HASH_CHUNK;
+    rc = dl_file_read_at(dl, dl->hashed, dl->hash_buf, n);
+    if (rc != CMP_SUCCESS) {
+      return rc;
+    }
+    cmp_sha256_update(&dl->sha, dl->hash_buf, n);
+    dl->hashed += n;
+  }
+  return CMP_SUCCESS;
+}
+
+static void dl_fail_locked(dl_download_t *dl, int error) {
+  if (dl->error == CMP_SUCCESS) {
+    dl->error = error;
+  }
+  dl->stop = 1;
+  cmp_cond_broadcast(&dl->cond);
+}
+
+/* Calling thread only. Returns non-zero once the download is stopping. */
+static int dl_report(dl_download_t *dl) {
+  double now = dl_now(dl);
+  size_t done;
+  float percentage;
+  int stop;
+
+  if (now - dl->last_report < dl->config.progress_interval_ms) {
+    cmp_mutex_lock(&dl->lock);
+    stop = dl->stop;
+    cmp_mutex_unlock(&dl->lock);
+    return stop;
+  }
+  dl->last_report = now;
+  if (dl_hash_advance(dl) != CMP_SUCCESS) {
+    cmp_mutex_lock(&dl->lock);
+    dl_fail_locked(dl, CMP_ERROR_IO);
+    cmp_mutex_unlock(&dl->lock);
+  }
+  if (now - dl->last_save >= DL_MANIFEST_INTERVAL_MS) {
+    dl->last_save = now;
+    dl_manifest_save(dl);
+  }
+
+  cmp_mutex_lock(&dl->lock);
+  done = dl_done_locked(dl);
+  stop = dl->stop;
+  cmp_mutex_unlock(&dl->lock);
+  /* 100 is reserved for the verified end */
+  if (stop || dl->progress_cb == NULL || dl->total == 0 ||
+      done >= dl->total) {
+    return stop;
+  }
+  percentage = (float)((double)done * 100.0 / (double)dl->total);
+  if (percentage < dl->last_percentage) {
+    percentage = dl->last_percentage; /* Failed ranges are refetched */
+  }
+  dl->last_percentage = percentage;
+  dl->stats.progress_calls++;
+  if (dl->progress_cb(percentage, dl->user_data) != 0) {
+    cmp_mutex_lock(&dl->lock);
+    dl_fail_locked(dl, CMP_ERROR_INVALID_STATE);
+    cmp_mutex_unlock(&dl->lock);
+    return 1;
+  }
+  return 0;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Requests                                                                 */
+/* ------------------------------------------------------------------------ */
+
+static int dl_on_chunk(void *user_data, const void *chunk, size_t chunk_len) {
+  dl_fetch_t *fetch = (dl_fetch_t *)user_data;
+  dl_download_t *dl = fetch->dl;
+  double now;
+  int stop;
+
+  fetch->chunked = 1;
+  if (chunk_len == 0) {
+    return 0;
+  }
+  if (fetch->end != 0 && chunk_len > fetch->end - fetch->offset) {
+    fetch->overrun = 1;
+    return 1;
+  }
+  if (dl_file_write_at(dl, fetch->offset, chunk, chunk_len) != CMP_SUCCESS) {
+    fetch->io_error = 1;
+    return 1;
+  }
+  fetch->offset += chunk_len;
+  now = fetch->caller ? 0.0 : dl_now(dl);
+
+  cmp_mutex_lock(&dl->lock);
+  if (fetch->range != NULL) {
+    fetch->range->done += chunk_len;
+  } else {
+    dl->streamed += chunk_len;
+  }
+  dl->stats.fetched += chunk_len;
+  stop = dl->stop;
+  if (!fetch->caller &&
+      now - dl->last_signal >= dl->config.progress_interval_ms) {
+    dl->last_signal = now;
+    cmp_cond_broadcast(&dl->cond);
+  }
+  cmp_mutex_unlock(&dl->lock);
+
+  if (fetch->caller && !stop) {
+    stop = dl_report(dl);
+  }
+  return stop ? 1 : 0;
+}
+
+/* Deliver a body the transport buffered instead of streaming */
+static int dl_take_body(dl_fetch_t *fetch, const struct HttpResponse *res) {
+  if (fetch->chunked || res->body == NULL || res->body_len == 0) {
+    return 0;
+  }
+  return dl_on_chunk(fetch, res->body, res->body_len);
+}
+
+/* HEAD the URL for its length, range support and validator. Any failure
+   just means the body is streamed in one GET. */
+static void dl_probe(dl_download_t *dl, struct HttpClient *client,
+                     int *out_ranged) {
+  struct HttpRequest req;
+  struct HttpResponse *res = NULL;
+  const char *value;
+  size_t len;
+
+  *out_ranged = 0;
+  if (http_request_init(&req) != 0) {
+    return;
+  }
+  req.method = HTTP_HEAD;
+  req.url = (char *)dl->url;
+  if (client->send(client->transport, &req, &res) == 0 && res != NULL &&
+      res->status_code >= 200 && res->status_code < 300) {
+    value = dl_header(res, "Content-Length");
+    if (value != NULL && dl_parse_size(value, &dl->total)) {
+      dl->total_known = 1;
+    }
+    value = dl_header(res, "Accept-Ranges");
+    *out_ranged = dl->total_known && dl->total > 0 && value != NULL &&
+                  dl_ieq_prefix(value, "bytes");
+    /* Weak ETags cannot guard a range request */
+    value = dl_header(res, "ETag");
+    if (value != NULL && value[0] == '"') {
+      dl->validator_kind = 'E';
+    } else {
+      value = dl_header(res, "Last-Modified");
+      dl->validator_kind = value != NULL ? 'L' : 0;
+    }
+    if (dl->validator_kind != 0) {
+      len = strlen(value);
+      if (len >= sizeof(dl->validator) || strchr(value, '\n') != NULL) {
+        dl->validator_kind = 0;
+      } else {
+        memcpy(dl->validator, value, len + 1);
+      }
+    }
+  }
+  if (res != NULL) {
+    http_response_free(res);
+  }
+  req.url = NULL; /* Not allocated by us */
+  http_request_free(&req);
+}
+
+/* Check a ranged reply really is the requested slice of the same entity */
+static int dl_check_partial(dl_download_t *dl, const struct HttpResponse *res,
+                            size_t start) {
+  const char *value;
+  size_t first, total;
+
+  if (res->status_code != 206) {
+    if (res->status_code == 200) {
+      return 0; /* If-Range failed: the entity changed */
+    }
+    return -1;
+  }
+  value = dl_header(res, "Content-Range");
+  if (value == NULL || !dl_ieq_prefix(value, "bytes ") ||
+      !dl_parse_size(value + 6, &first) || first != start) {
+    return 0;
+  }
+  value = strchr(value, '/');
+  if (value != NULL && value[1] != '*' &&
+      (!dl_parse_size(value + 1, &total) || total != dl->total)) {
+    return 0;
+  }
+  if (dl->validator_kind != 0) {
+    value = dl_header(res, dl->validator_kind == 'E' ? "ETag"
+                                                     : "Last-Modified");
+    if (value != NULL && strcmp(value, dl->validator) != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int dl_fetch_range(dl_download_t *dl, struct HttpClient *client,
+                          dl_range_t *range, int caller) {
+  struct HttpRequest req;
+  struct HttpResponse *res = NULL;
+  dl_fetch_t fetch;
+  char spec[64];
+  size_t before;
+  int rc = CMP_SUCCESS;
+  int valid = -1;
+
+  cmp_mutex_lock(&dl->lock);
+  before = range->done;
+  dl->stats.requests++;
+  cmp_mutex_unlock(&dl->lock);
+
+  memset(&fetch, 0, sizeof(fetch));
+  fetch.dl = dl;
+  fetch.range = range;
+  fetch.offset = range->start + before;
+  fetch.end = range->end;
+  fetch.caller = caller;
+
+  if (http_request_init(&req) != 0) {
+    return CMP_ERROR_OOM;
+  }
+  req.method = HTTP_GET;
+  req.url = (char *)dl->url;
+  req.on_chunk = dl_on_chunk;
+  req.on_chunk_user_data = &fetch;
+  sprintf(spec, "bytes=%lu-%lu", (unsigned long)fetch.offset,
+          (unsigned long)(range->end - 1));
+  if (http_request_set_header(&req, "Range", spec) != 0 ||
+      (dl->validator_kind != 0 &&
+       http_request_set_header(&req, "If-Range", dl->validator) != 0)) {
+    rc = CMP_ERROR_OOM;
+  } else if (client->send(client->transport, &req, &res) != 0 ||
+             res == NULL) {
+    rc = CMP_ERROR_NOT_FOUND;
+  } else {
+    valid = dl_check_partial(dl, res, range->start + before);
+    if (valid <= 0) {
+      rc = CMP_ERROR_NOT_FOUND;
+      if (valid == 0) {
+        cmp_mutex_lock(&dl->lock);
+        dl->changed = 1;
+        cmp_mutex_unlock(&dl->lock);
+      }
+    } else {
+      dl_take_body(&fetch, res);
+      if (fetch.offset != range->end) {
+        rc = CMP_ERROR_NOT_FOUND; /* Short reply */
+      }
+    }
+  }
+  if (fetch.io_error) {
+    rc = CMP_ERROR_IO;
+  } else if (fetch.overrun && rc == CMP_SUCCESS) {
+    rc = CMP_ERROR_NOT_FOUND;
+  }
+
+  cmp_mutex_lock(&dl->lock);
+  if (rc != CMP_SUCCESS) {
+    if (dl->stop) {
+      rc = dl->error;
+    }
+    /* Nothing from a reply that was not a valid slice counts as on disk */
+    if (valid <= 0 || fetch.overrun) {
+      range->done = before;
+    }
+  }
+  cmp_mutex_unlock(&dl->lock);
+
+  if (res != NULL) {
+    http_response_free(res);
+  }
+  req.url = NULL; /* Not allocated by us */
+  http_request_free(&req);
+  return rc;
+}
+
+static int dl_has_free_locked(const dl_download_t *dl) {
+  size_t i;
+
+  if (dl->stop) {
+    return 0;
+  }
+  for (i = 0; i < dl->range_count; ++i) {
+    const dl_range_t *r = &dl->ranges[i];
+    if (!r->taken && r->start + r->done < r->end) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Claim and fetch ranges until none are left. A worker gives up its
+   connection on the first failure; the caller keeps retrying on its own. */
+static void dl_run_ranges(dl_download_t *dl, struct HttpClient *client,
+                          int caller) {
+  dl_range_t *range;
+  size_t i;
+  int rc;
+
+  for (;;) {
+    range = NULL;
+    cmp_mutex_lock(&dl->lock);
+    for (i = 0; !dl->stop && i < dl->range_count; ++i) {
+      dl_range_t *r = &dl->ranges[i];
+      if (!r->taken && r->start + r->done < r->end) {
+        range = r;
+        range->taken = 1;
+        break;
+      }
+    }
+    cmp_mutex_unlock(&dl->lock);
+    if (range == NULL) {
+      return;
+    }
+
+    rc = dl_fetch_range(dl, client, range, caller);
+
+    cmp_mutex_lock(&dl->lock);
+    range->taken = 0;
+    if (rc == CMP_ERROR_NOT_FOUND && !dl->changed && !dl->stop &&
+        range->tries < DL_MAX_RETRIES) {
+      range->tries++;
+      dl->stats.retries++;
+    } else if (rc != CMP_SUCCESS) {
+      dl_fail_locked(dl, rc);
+    }
+    cmp_cond_broadcast(&dl->cond);
+    cmp_mutex_unlock(&dl->lock);
+    if (rc != CMP_SUCCESS && !caller) {
+      return;
+    }
+  }
+}
+
+static void dl_worker_task(void *arg) {
+  dl_download_t *dl = (dl_download_t *)arg;
+  struct HttpClient *client = NULL;
+  int rc;
+
+  if (dl->config.connect != NULL) {
+    rc = dl->config.connect(dl->origin, &client, dl->config.connect_data);
+  } else if (CMP_MALLOC(sizeof(struct HttpClient), (void **)&client) !=
+             CMP_SUCCESS) {
+    rc = CMP_ERROR_OOM;
+  } else if (http_client_init(client) != 0) {
+    CMP_FREE(client);
+    rc = CMP_ERROR_NOT_FOUND;
+  } else if (transport_factory_init_client(client) != 0 ||
+             client->send == NULL) {
+    http_client_free(client);
+    CMP_FREE(client);
+    rc = CMP_ERROR_NOT_FOUND;
+  } else {
+    /* Parallelism comes from the workers; each connection sends blocking */
+    client->config.modality = MODALITY_SYNC;
+    rc = CMP_SUCCESS;
+  }
+
+  /* Without a connection the caller and other workers take the ranges */
+  if (rc == CMP_SUCCESS) {
+    cmp_mutex_lock(&dl->lock);
+    dl->stats.connections++;
+    cmp_mutex_unlock(&dl->lock);
+    dl_run_ranges(dl, client, 0);
+    if (dl->config.connect != NULL) {
+      dl->config.disconnect(client, dl->config.connect_data);
+    } else {
+      http_client_free(client);
+      CMP_FREE(client);
+    }
+  }
+
+  cmp_mutex_lock(&dl->lock);
+  dl->running--;
+  cmp_cond_broadcast(&dl->cond);
+  cmp_mutex_unlock(&dl->lock);
+}
+
+static int dl_ranged(dl_download_t *dl, struct HttpClient *client) {
+  cmp_modality_t own;
+  cmp_modality_t *workers = dl->config.workers;
+  size_t i, pending = 0, tasks;
+  int resumed, again, rc;
+
+  dl->range_size = dl->config.range_size;
+  dl->range_count = (dl->total + dl->range_size - 1) / dl->range_size;
+  if (CMP_MALLOC(dl->range_count * sizeof(dl_range_t),
+                 (void **)&dl->ranges) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(dl->ranges, 0, dl->range_count * sizeof(dl_range_t));
+
+  resumed = dl->config.resume && dl->validator_kind != 0 &&
+            dl_manifest_load(dl);
+  rc = dl_file_open(dl, !resumed);
+  if (rc != CMP_SUCCESS) {
+    return rc;
+  }
+  if (resumed) {
+    size_t size = 0;
+    /* The file must still be the one the manifest describes */
+    if (dl_file_size(dl, &size) != CMP_SUCCESS || size != dl->total) {
+      resumed = 0;
+      dl_file_close(dl);
+      rc = dl_file_open(dl, 1);
+      if (rc != CMP_SUCCESS) {
+        return rc;
+      }
+    }
+  }
+  if (!resumed) {
+    for (i = 0; i < dl->range_count; ++i) {
+      dl->ranges[i].start = i * dl->range_size;
+      dl->ranges[i].end = dl->ranges[i].start + dl->range_size < dl->total
+                              ? dl->ranges[i].start + dl->range_size
+                              : dl->total;
+      dl->ranges[i].done = 0;
+    }
+    rc = dl_file_allocate(dl, dl->total);
+    if (rc != CMP_SUCCESS) {
+      return rc;
+    }
+  }
+  dl->stats.ranges = dl->range_count;
+  for (i = 0; i < dl->range_count; ++i) {
+    dl->stats.resumed += dl->ranges[i].done;
+    pending += dl->ranges[i].done < dl->ranges[i].end - dl->ranges[i].start;
+  }
+
+  /* The calling client is one connection; workers add the rest */
+  tasks = pending > 0 ? dl->config.parallel - 1 : 0;
+  tasks = tasks > pending - 1 ? pending - 1 : tasks;
+  if (tasks > 0 && workers == NULL) {
+    if (cmp_modality_threaded_init(&own, (int)tasks) != CMP_SUCCESS) {
+      tasks = 0;
+    } else {
+      workers = &own;
+    }
+  }
+  for (i = 0; i < tasks; ++i) {
+    cmp_mutex_lock(&dl->lock);
+    dl->running++;
+    cmp_mutex_unlock(&dl->lock);
+    if (cmp_modality_queue_task(workers, dl_worker_task, dl) != CMP_SUCCESS) {
+      cmp_mutex_lock(&dl->lock);
+      dl->running--;
+      cmp_mutex_unlock(&dl->lock);
+      break;
+    }
+  }
+
+  do {
+    dl_run_ranges(dl, client, 1);
+    cmp_mutex_lock(&dl->lock);
+    while (dl->running > 0 && !dl_has_free_locked(dl)) {
+      cmp_cond_wait(&dl->cond, &dl->lock);
+      cmp_mutex_unlock(&dl->lock);
+      dl_report(dl);
+      cmp_mutex_lock(&dl->lock);
+    }
+    again = dl_has_free_locked(dl);
+    cmp_mutex_unlock(&dl->lock);
+  } while (again);
+
+  if (workers == &own) {
+    cmp_modality_destroy(&own);
+  }
+
+  cmp_mutex_lock(&dl->lock);
+  rc = dl->error;
+  if (rc == CMP_SUCCESS && dl_done_locked(dl) != dl->total) {
+    rc = CMP_ERROR_NOT_FOUND;
+  }
+  cmp_mutex_unlock(&dl->lock);
+  return rc;
+}
+
+/* One GET for servers without ranges or a known length */
+static int dl_stream(dl_download_t *dl, struct HttpClient *client) {
+  struct HttpRequest req;
+  struct HttpResponse *res = NULL;
+  dl_fetch_t fetch;
+  int rc;
+
+  rc = dl_file_open(dl, 1);
+  if (rc != CMP_SUCCESS) {
+    return rc;
+  }
+  if (dl->total_known && dl->total > 0) {
+    rc = dl_file_allocate(dl, dl->total);
+    if (rc != CMP_SUCCESS) {
+      return rc;
+    }
+  }
+  memset(&fetch, 0, sizeof(fetch));
+  fetch.dl = dl;
+  fetch.caller = 1;
+  fetch.end = dl->total_known ? dl->total : 0;
+  if (http_request_init(&req) != 0) {
+    return CMP_ERROR_OOM;
+  }
+  req.method = HTTP_GET;
+  req.url = (char *)dl->url;
+  req.on_chunk = dl_on_chunk;
+  req.on_chunk_user_data = &fetch;
+  dl->stats.requests++;
+
+  if (client->send(client->transport, &req, &res) != 0 || res == NULL ||
+      res->status_code < 200 || res->status_code >= 300) {
+    rc = CMP_ERROR_NOT_FOUND;
+  } else {
+    dl_take_body(&fetch, res);
+  }
+  if (fetch.io_error) {
+    rc = CMP_ERROR_IO;
+  } else if (dl->stop) {
+    rc = dl->error;
+  } else if (rc == CMP_SUCCESS &&
+             (fetch.overrun ||
+              (dl->total_known && dl->streamed != dl->total))) {
+    rc = CMP_ERROR_NOT_FOUND;
+  }
+  if (rc == CMP_SUCCESS) {
+    dl->total = dl->streamed;
+  }
+
+  if (res != NULL) {
+    http_response_free(res);
+  }
+  req.url = NULL; /* Not allocated by us */
+  http_request_free(&req);
+  return rc;
+}
+
+static int dl_verify(dl_download_t *dl) {
+  unsigned char digest[32];
+  char hex[65];
+  size_t i;
+  int rc;
+
+  rc = dl_hash_advance(dl);
+  if (rc != CMP_SUCCESS) {
+    return rc;
+  }
+  cmp_sha256_final(&dl->sha, digest);
+  cmp_sha256_hex(digest, hex);
+  for (i = 0; i < 64; ++i) {
+    char c = dl->config.sha256[i];
+    if (c >= 'A' && c <= 'F') {
+      c = (char)(c - 'A' + 'a');
+    }
+    if (c != hex[i]) {
+      return CMP_ERROR_IO;
+    }
+  }
+  return dl->config.sha256[64] == '\0' ? CMP_SUCCESS : CMP_ERROR_IO;
+}
+
+int cmp_http_download_config_init(cmp_http_download_config_t *config) {
+  if (config == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  memset(config, 0, sizeof(*config));
+  config->parallel = 4;
+  config->range_size = 1024 * 1024;
+  config->progress_interval_ms = 100.0;
+  config->resume = 1;
+  return CMP_SUCCESS;
+}
+
+int cmp_http_download_ex(struct HttpClient *client, const char *url,
+                         const char *save_virtual_path,
+                         const cmp_http_download_config_t *config,
+                         int (*progress_cb)(float percentage,
+                                            void *user_data),
+                         void *user_data,
+                         cmp_http_download_stats_t *out_stats) {
+  dl_download_t dl;
+  cmp_string_t resolved;
+  const char *host;
+  int ranged, rc, mismatch = 0;
+
+  if (client == NULL || client->send == NULL || url == NULL ||
+      save_virtual_path == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  memset(&dl, 0, sizeof(dl));
+  if (config != NULL) {
+    dl.config = *config;
+  } else {
+    cmp_http_download_config_init(&dl.config);
+  }
+  if (dl.config.parallel == 0 || dl.config.range_size == 0 ||
+      (dl.config.workers != NULL &&
+       dl.config.workers->type != CMP_MODALITY_THREADED) ||
+      ((dl.config.connect == NULL) != (dl.config.disconnect == NULL))) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (cmp_vfs_resolve_path(save_virtual_path, &resolved) != CMP_SUCCESS) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  dl.url = url;
+#if !defined(_WIN32)
+  dl.fd = -1;
+#endif
+  dl.progress_cb = progress_cb;
+  dl.user_data = user_data;
+  dl.last_report = dl_now(&dl);
+  dl.last_save = dl.last_report;
+  dl.last_signal = dl.last_report;
+
+  dl.path = dl_strdup(resolved.data, strlen(resolved.data));
+  dl.manifest = dl_concat(resolved.data, DL_MANIFEST_SUFFIX);
+  cmp_string_destroy(&resolved);
+  host = strstr(url, "://");
+  host = host != NULL ? strchr(host + 3, '/') : NULL;
+  dl.origin = dl_strdup(url, host != NULL ? (size_t)(host - url)
+                                          : strlen(url));
+  if (dl.path == NULL || dl.manifest == NULL || dl.origin == NULL) {
+    rc = CMP_ERROR_OOM;
+    goto cleanup_paths;
+  }
+  if (dl.config.sha256 != NULL) {
+    cmp_sha256_init(&dl.sha);
+    if (CMP_MALLOC(DL_HASH_CHUNK, (void **)&dl.hash_buf) != CMP_SUCCESS) {
+      rc = CMP_ERROR_OOM;
+      goto cleanup_paths;
+    }
+  }
+  if (cmp_mutex_init(&dl.lock) != CMP_SUCCESS) {
+    rc = CMP_ERROR_GENERAL;
+    goto cleanup_paths;
+  }
+  if (cmp_cond_init(&dl.cond) != CMP_SUCCESS) {
+    cmp_mutex_destroy(&dl.lock);
+    rc = CMP_ERROR_GENERAL;
+    goto cleanup_paths;
+  }
+
+  dl_probe(&dl, client, &ranged);
+  rc = ranged ? dl_ranged(&dl, client) : dl_stream(&dl, client);
+  if (rc == CMP_SUCCESS && dl.config.sha256 != NULL) {
+    rc = dl_verify(&dl);
+    mismatch = rc != CMP_SUCCESS;
+  }
+  dl_file_close(&dl);
+
+  if (rc == CMP_SUCCESS || mismatch || dl.changed) {
+    dl_remove(dl.manifest);
+  } else if (ranged) {
+    dl_manifest_save(&dl); /* Resume from here next time */
+  }
+  dl.stats.total = dl.total;
+  if (rc == CMP_SUCCESS && progress_cb != NULL) {
+    dl.stats.progress_calls++;
+    progress_cb(100.0f, user_data);
+  }
+
+  cmp_cond_destroy(&dl.cond);
+  cmp_mutex_destroy(&dl.lock);
+  if (dl.ranges != NULL) {
+    CMP_FREE(dl.ranges);
+  }
+
+cleanup_paths:
+  if (dl.hash_buf != NULL) {
+    CMP_FREE(dl.hash_buf);
+  }
+  if (dl.origin != NULL) {
+    CMP_FREE(dl.origin);
+  }
+  if (dl.manifest != NULL) {
+    CMP_FREE(dl.manifest);
+  }
+  if (dl.path != NULL) {
+    CMP_FREE(dl.path);
+  }
+  if (out_stats != NULL) {
+    *out_stats = dl.stats;
+  }
+  return rc;
+}
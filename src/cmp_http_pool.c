@@ -0,0 +1,969 @@
+/* clang-format off */
+#if !defined(_WIN32) && !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 600 /* clock_gettime */
+#endif
+#include "cmp.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+/* clang-format on */
+
+extern int transport_factory_init_client(struct HttpClient *client);
+
+/* One caller of a fetch; coalesced GETs share a fetch */
+typedef struct http_waiter {
+  size_t ticket;
+  int priority;
+  cmp_http_pool_cb_t cb;
+  void *user_data;
+  struct http_waiter *next;
+} http_waiter_t;
+
+/* A kept-alive transport bound to one origin */
+typedef struct http_conn {
+  struct HttpClient *client;
+  double idle_since;
+  struct http_conn *next; /* Idle stack, most recently used first */
+} http_conn_t;
+
+struct http_origin;
+
+typedef struct http_fetch {
+  struct cmp_http_pool *pool;
+  struct http_origin *origin;
+  struct http_fetch *prev; /* Priority queue or in-flight list */
+  struct http_fetch *next;
+  struct HttpRequest req; /* Pool-owned copy of the caller's request */
+  char *url;
+  void *body;
+  http_waiter_t *waiters;
+  int priority; /* Most urgent of the waiters */
+  int coalescable;
+  int queued;
+  int reused;
+  int retried;
+  double queued_ms;
+  http_conn_t *conn;
+  struct HttpResponse *response;
+  int res;
+} http_fetch_t;
+
+typedef struct http_origin {
+  char *name; /* scheme://host:port, lower-cased */
+  http_conn_t *idle;
+  size_t idle_count;
+  size_t active;
+  http_fetch_t *head[CMP_HTTP_PRIORITY_COUNT];
+  http_fetch_t *tail[CMP_HTTP_PRIORITY_COUNT];
+  size_t queued;
+  struct http_origin *next;
+} http_origin_t;
+
+struct cmp_http_pool {
+  cmp_http_pool_config_t config;
+  cmp_http_connect_fn_t connect;
+  cmp_http_disconnect_fn_t disconnect;
+  void *connect_data;
+  cmp_modality_t *workers;
+  cmp_modality_t *ui;
+  http_origin_t *origins;
+  http_fetch_t *in_flight;
+  size_t active;
+  size_t next_ticket;
+  cmp_http_pool_stats_t stats;
+  int pumping;
+  int destroyed;
+};
+
+static double http_default_now(void *user_data) {
+  (void)user_data;
+#if defined(_WIN32)
+  return (double)GetTickCount();
+#else
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+  }
+#endif
+}
+
+static double http_now(const struct cmp_http_pool *pool) {
+  return pool->config.now_ms(pool->config.now_data);
+}
+
+static int http_default_connect(const char *origin,
+                                struct HttpClient **out_client,
+                                void *user_data) {
+  struct HttpClient *client;
+  (void)origin;
+  (void)user_data;
+
+  if (CMP_MALLOC(sizeof(struct HttpClient), (void **)&client) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  if (http_client_init(client) != 0) {
+    CMP_FREE(client);
+    return CMP_ERROR_NOT_FOUND;
+  }
+  if (transport_factory_init_client(client) != 0) {
+    http_client_free(client);
+    CMP_FREE(client);
+    return CMP_ERROR_NOT_FOUND;
+  }
+  /* The pool supplies the concurrency; each connection sends blocking */
+  client->config.modality = MODALITY_SYNC;
+  *out_client = client;
+  return CMP_SUCCESS;
+}
+
+static void http_default_disconnect(struct HttpClient *client,
+                                    void *user_data) {
+  (void)user_data;
+  http_client_free(client);
+  CMP_FREE(client);
+}
+
+static char *http_strdup(const char *s, size_t len) {
+  char *copy;
+
+  if (CMP_MALLOC(len + 1, (void **)&copy) != CMP_SUCCESS) {
+    return NULL;
+  }
+  memcpy(copy, s, len);
+  copy[len] = '\0';
+  return copy;
+}
+
+/* Reduce a URL to scheme://host:port so equivalent spellings share a pool */
+static char *http_origin_of(const char *url) {
+  const char *scheme_end, *host, *end, *at, *p;
+  const char *port = "";
+  char *name;
+  size_t scheme_len, host_len, port_len, i;
+  int has_port = 0;
+
+  scheme_end = strstr(url, "://");
+  if (scheme_end == NULL || scheme_end == url) {
+    return NULL;
+  }
+  scheme_len = (size_t)(scheme_end - url);
+  host = scheme_end + 3;
+  end = host;
+  while (*end != '\0' && *end != '/' && *end != '?' && *end != '#') {
+    end++;
+  }
+  at = NULL;
+  for (p = host; p < end; ++p) {
+    if (*p == '@') {
+      at = p;
+    }
+  }
+  if (at != NULL) {
+    host = at + 1;
+  }
+  if (host == end) {
+    return NULL;
+  }
+  for (p = end; p > host && p[-1] != ']'; --p) {
+    if (p[-1] == ':') {
+      has_port = 1;
+      break;
+    }
+  }
+  if (!has_port) {
+    if (scheme_len == 5 && (strncmp(url, "https", 5) == 0 ||
+                            strncmp(url, "HTTPS", 5) == 0)) {
+      port = ":443";
+    } else if (scheme_len == 3 && (strncmp(url, "wss", 3) == 0 ||
+                                   strncmp(url, "WSS", 3) == 0)) {
+      port = ":443";
+    } else {
+      port = ":80";
+    }
+  }
+  host_len = (size_t)(end - host);
+  port_len = strlen(port);
+  if (CMP_MALLOC(scheme_len + 3 + host_len + port_len + 1, (void **)&name) !=
+      CMP_SUCCESS) {
+    return NULL;
+  }
+  memcpy(name, url, scheme_len);
+  memcpy(name + scheme_len, "://", 3);
+  memcpy(name + scheme_len + 3, host, host_len);
+  memcpy(name + scheme_len + 3 + host_len, port, port_len + 1);
+  for (i = 0; name[i] != '\0'; ++i) {
+    name[i] = (char)tolower((unsigned char)name[i]);
+  }
+  return name;
+}
+
+static http_origin_t *http_origin_find(struct cmp_http_pool *pool,
+                                       const char *name) {
+  http_origin_t *origin;
+
+  for (origin = pool->origins; origin != NULL; origin = origin->next) {
+    if (strcmp(origin->name, name) == 0) {
+      return origin;
+    }
+  }
+  if (CMP_MALLOC(sizeof(http_origin_t), (void **)&origin) != CMP_SUCCESS) {
+    return NULL;
+  }
+  memset(origin, 0, sizeof(http_origin_t));
+  origin->name = http_strdup(name, strlen(name));
+  if (origin->name == NULL) {
+    CMP_FREE(origin);
+    return NULL;
+  }
+  origin->next = pool->origins;
+  pool->origins = origin;
+  return origin;
+}
+
+static void http_conn_close(struct cmp_http_pool *pool, http_conn_t *conn) {
+  pool->disconnect(conn->client, pool->connect_data);
+  CMP_FREE(conn);
+  pool->stats.connections_closed++;
+}
+
+static void http_fetch_free(http_fetch_t *fetch) {
+  http_waiter_t *waiter;
+
+  while (fetch->waiters != NULL) {
+    waiter = fetch->waiters;
+    fetch->waiters = waiter->next;
+    CMP_FREE(waiter);
+  }
+  if (fetch->response != NULL) {
+    http_response_free(fetch->response);
+  }
+  /* The url and body are ours, not the request's */
+  fetch->req.url = NULL;
+  fetch->req.body = NULL;
+  fetch->req.body_len = 0;
+  http_request_free(&fetch->req);
+  if (fetch->url != NULL) {
+    CMP_FREE(fetch->url);
+  }
+  if (fetch->body != NULL) {
+    CMP_FREE(fetch->body);
+  }
+  CMP_FREE(fetch);
+}
+
+static int http_copy_request(http_fetch_t *fetch,
+                             const struct HttpRequest *req) {
+  size_t i;
+
+  if (http_request_init(&fetch->req) != 0) {
+    return CMP_ERROR_NOT_FOUND;
+  }
+  fetch->url = http_strdup(req->url, strlen(req->url));
+  if (fetch->url == NULL) {
+    return CMP_ERROR_OOM;
+  }
+  if (req->body_len > 0) {
+    if (CMP_MALLOC(req->body_len, &fetch->body) != CMP_SUCCESS) {
+      return CMP_ERROR_OOM;
+    }
+    memcpy(fetch->body, req->body, req->body_len);
+  }
+  for (i = 0; i < req->headers.count; ++i) {
+    if (http_request_set_header(&fetch->req, req->headers.keys[i],
+                                req->headers.values[i]) != 0) {
+      return CMP_ERROR_OOM;
+    }
+  }
+  fetch->req.method = req->method;
+  fetch->req.url = fetch->url;
+  fetch->req.body = fetch->body;
+  fetch->req.body_len = req->body_len;
+  fetch->req.on_chunk = req->on_chunk;
+  fetch->req.on_chunk_user_data = req->on_chunk_user_data;
+  return CMP_SUCCESS;
+}
+
+static int http_same_headers(const struct HttpHeaders *a,
+                             const struct HttpHeaders *b) {
+  const char *value;
+  size_t i;
+
+  if (a->count != b->count) {
+    return 0;
+  }
+  for (i = 0; i < a->count; ++i) {
+    if (http_headers_get(b, a->keys[i], &value) != 0 ||
+        strcmp(value, a->values[i]) != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int http_fetch_matches(const http_fetch_t *fetch,
+                              const struct HttpRequest *req) {
+  return fetch->coalescable && fetch->waiters != NULL &&
+         strcmp(fetch->url, req->url) == 0 &&
+         fetch->req.on_chunk == req->on_chunk &&
+         fetch->req.on_chunk_user_data == req->on_chunk_user_data &&
+         http_same_headers(&fetch->req.headers, &req->headers);
+}
+
+static void http_queue_push(http_fetch_t *fetch, int front) {
+  http_origin_t *origin = fetch->origin;
+  int p = fetch->priority;
+
+  fetch->prev = NULL;
+  fetch->next = NULL;
+  if (origin->head[p] == NULL) {
+    origin->head[p] = fetch;
+    origin->tail[p] = fetch;
+  } else if (front) {
+    fetch->next = origin->head[p];
+    origin->head[p]->prev = fetch;
+    origin->head[p] = fetch;
+  } else {
+    fetch->prev = origin->tail[p];
+    origin->tail[p]->next = fetch;
+    origin->tail[p] = fetch;
+  }
+  fetch->queued = 1;
+  origin->queued++;
+}
+
+static void http_queue_remove(http_fetch_t *fetch) {
+  http_origin_t *origin = fetch->origin;
+  int p = fetch->priority;
+
+  if (fetch->prev != NULL) {
+    fetch->prev->next = fetch->next;
+  } else {
+    origin->head[p] = fetch->next;
+  }
+  if (fetch->next != NULL) {
+    fetch->next->prev = fetch->prev;
+  } else {
+    origin->tail[p] = fetch->prev;
+  }
+  fetch->prev = NULL;
+  fetch->next = NULL;
+  fetch->queued = 0;
+  origin->queued--;
+}
+
+static void http_flight_link(struct cmp_http_pool *pool,
+                             http_fetch_t *fetch) {
+  fetch->prev = NULL;
+  fetch->next = pool->in_flight;
+  if (pool->in_flight != NULL) {
+    pool->in_flight->prev = fetch;
+  }
+  pool->in_flight = fetch;
+}
+
+static void http_flight_unlink(struct cmp_http_pool *pool,
+                               http_fetch_t *fetch) {
+  if (fetch->prev != NULL) {
+    fetch->prev->next = fetch->next;
+  } else {
+    pool->in_flight = fetch->next;
+  }
+  if (fetch->next != NULL) {
+    fetch->next->prev = fetch->prev;
+  }
+  fetch->prev = NULL;
+  fetch->next = NULL;
+}
+
+static void http_waiter_add(http_fetch_t *fetch, http_waiter_t *waiter) {
+  http_waiter_t **link = &fetch->waiters;
+
+  while (*link != NULL) {
+    link = &(*link)->next;
+  }
+  waiter->next = NULL;
+  *link = waiter;
+}
+
+/* Re-file a queued fetch under the most urgent priority of its waiters */
+static void http_fetch_reprioritize(http_fetch_t *fetch) {
+  http_waiter_t *waiter;
+  int priority = CMP_HTTP_PRIORITY_COUNT - 1;
+
+  for (waiter = fetch->waiters; waiter != NULL; waiter = waiter->next) {
+    if (waiter->priority < priority) {
+      priority = waiter->priority;
+    }
+  }
+  if (priority == fetch->priority) {
+    return;
+  }
+  if (!fetch->queued) {
+    fetch->priority = priority;
+    return;
+  }
+  http_queue_remove(fetch);
+  fetch->priority = priority;
+  http_queue_push(fetch, 0);
+}
+
+static void http_pool_free(struct cmp_http_pool *pool) {
+  http_origin_t *origin;
+  http_fetch_t *fetch;
+  http_conn_t *conn;
+  int p;
+
+  while (pool->origins != NULL) {
+    origin = pool->origins;
+    pool->origins = origin->next;
+    for (p = 0; p < CMP_HTTP_PRIORITY_COUNT; ++p) {
+      while (origin->head[p] != NULL) {
+        fetch = origin->head[p];
+        origin->head[p] = fetch->next;
+        http_fetch_free(fetch);
+      }
+    }
+    while (origin->idle != NULL) {
+      conn = origin->idle;
+      origin->idle = conn->next;
+      http_conn_close(pool, conn);
+    }
+    CMP_FREE(origin->name);
+    CMP_FREE(origin);
+  }
+  CMP_FREE(pool);
+}
+
+static void http_pump(struct cmp_http_pool *pool);
+
+static void http_fetch_run(http_fetch_t *fetch) {
+  struct HttpClient *client = fetch->conn->client;
+
+  fetch->res = CMP_ERROR_NOT_FOUND;
+  if (client->send != NULL &&
+      client->send(client->transport, &fetch->req, &fetch->response) == 0) {
+    fetch->res = CMP_SUCCESS;
+  }
+}
+
+static int http_is_idempotent(enum HttpMethod method) {
+  return method == HTTP_GET || method == HTTP_HEAD || method == HTTP_PUT ||
+         method == HTTP_DELETE;
+}
+
+static int http_wants_close(const struct HttpResponse *response) {
+  const char *value;
+  return response != NULL &&
+         http_headers_get(&response->headers, "Connection", &value) == 0 &&
+         value != NULL && (strcmp(value, "close") == 0 ||
+                           strcmp(value, "Close") == 0);
+}
+
+static void http_fetch_deliver(void *arg) {
+  http_fetch_t *fetch = (http_fetch_t *)arg;
+  struct cmp_http_pool *pool = fetch->pool;
+  http_origin_t *origin = fetch->origin;
+  http_conn_t *conn = fetch->conn;
+  http_waiter_t *waiter;
+
+  http_flight_unlink(pool, fetch);
+  origin->active--;
+  pool->active--;
+  fetch->conn = NULL;
+
+  if (fetch->res != CMP_SUCCESS || pool->destroyed ||
+      http_wants_close(fetch->response) ||
+      origin->idle_count >= pool->config.max_idle_per_origin) {
+    http_conn_close(pool, conn);
+  } else {
+    conn->idle_since = http_now(pool);
+    conn->next = origin->idle;
+    origin->idle = conn;
+    origin->idle_count++;
+  }
+
+  /* A kept-alive connection may have been closed by the server while it
+   * sat idle; idempotent requests get one more try on a fresh one */
+  if (fetch->res != CMP_SUCCESS && fetch->reused && !fetch->retried &&
+      !pool->destroyed && fetch->waiters != NULL &&
+      http_is_idempotent(fetch->req.method)) {
+    fetch->retried = 1;
+    fetch->queued_ms = http_now(pool);
+    if (fetch->response != NULL) {
+      http_response_free(fetch->response);
+      fetch->response = NULL;
+    }
+    pool->stats.retries++;
+    http_queue_push(fetch, 1);
+    http_pump(pool);
+    return;
+  }
+
+  if (!pool->destroyed) {
+    if (fetch->res == CMP_SUCCESS) {
+      pool->stats.completed++;
+    } else {
+      pool->stats.failed++;
+    }
+    for (waiter = fetch->waiters; waiter != NULL; waiter = waiter->next) {
+      if (waiter->cb != NULL) {
+        waiter->cb(fetch->res, fetch->response, waiter->user_data);
+      }
+    }
+  }
+  http_fetch_free(fetch);
+
+  if (pool->destroyed) {
+    if (pool->in_flight == NULL) {
+      http_pool_free(pool);
+    }
+    return;
+  }
+  http_pump(pool);
+}
+
+static void http_fetch_task(void *arg) {
+  http_fetch_t *fetch = (http_fetch_t *)arg;
+  http_fetch_run(fetch);
+  cmp_modality_queue_task(fetch->pool->ui, http_fetch_deliver, fetch);
+}
+
+/* Report a fetch that never got a connection */
+static void http_fetch_fail(struct cmp_http_pool *pool, http_fetch_t *fetch) {
+  http_waiter_t *waiter;
+
+  pool->stats.failed++;
+  for (waiter = fetch->waiters; waiter != NULL; waiter = waiter->next) {
+    if (waiter->cb != NULL) {
+      waiter->cb(CMP_ERROR_NOT_FOUND, NULL, waiter->user_data);
+    }
+  }
+  http_fetch_free(fetch);
+}
+
+static void http_dispatch(struct cmp_http_pool *pool, http_fetch_t *fetch) {
+  http_origin_t *origin = fetch->origin;
+  http_conn_t *conn = NULL;
+  double waited;
+
+  waited = http_now(pool) - fetch->queued_ms;
+  if (waited < 0.0) {
+    waited = 0.0;
+  }
+  pool->stats.dispatched++;
+  pool->stats.queue_wait_total_ms += waited;
+  if (waited > pool->stats.queue_wait_max_ms) {
+    pool->stats.queue_wait_max_ms = waited;
+  }
+
+  fetch->reused = 0;
+  if (origin->idle != NULL) {
+    conn = origin->idle;
+    origin->idle = conn->next;
+    origin->idle_count--;
+    fetch->reused = 1;
+    pool->stats.pool_hits++;
+  } else if (CMP_MALLOC(sizeof(http_conn_t), (void **)&conn) == CMP_SUCCESS) {
+    memset(conn, 0, sizeof(http_conn_t));
+    if (pool->connect(origin->name, &conn->client, pool->connect_data) !=
+        CMP_SUCCESS) {
+      CMP_FREE(conn);
+      conn = NULL;
+    } else {
+      pool->stats.connections_opened++;
+    }
+  }
+
+  if (conn == NULL) {
+    http_fetch_fail(pool, fetch);
+    return;
+  }
+  fetch->conn = conn;
+  origin->active++;
+  pool->active++;
+  http_flight_link(pool, fetch);
+
+  if (pool->workers != NULL &&
+      cmp_modality_queue_task(pool->workers, http_fetch_task, fetch) ==
+          CMP_SUCCESS) {
+    return;
+  }
+  http_fetch_run(fetch);
+  http_fetch_deliver(fetch);
+}
+
+/* Start queued fetches while there is capacity: the most urgent priority
+ * first, oldest first within a priority, across origins */
+static void http_pump(struct cmp_http_pool *pool) {
+  http_origin_t *origin;
+  http_fetch_t *best, *head;
+  int p;
+
+  if (pool->pumping) {
+    return;
+  }
+  pool->pumping = 1;
+  while (pool->active < pool->config.max_total) {
+    best = NULL;
+    for (origin = pool->origins; origin != NULL; origin = origin->next) {
+      if (origin->queued == 0 ||
+          origin->active >= pool->config.max_per_origin) {
+        continue;
+      }
+      for (p = 0; p < CMP_HTTP_PRIORITY_COUNT; ++p) {
+        head = origin->head[p];
+        if (head == NULL) {
+          continue;
+        }
+        if (best == NULL || p < best->priority ||
+            (p == best->priority && head->queued_ms < best->queued_ms)) {
+          best = head;
+        }
+        break;
+      }
+    }
+    if (best == NULL) {
+      break;
+    }
+    http_queue_remove(best);
+    http_dispatch(pool, best);
+  }
+  pool->pumping = 0;
+}
+
+static void http_prune(struct cmp_http_pool *pool, double max_idle_ms) {
+  http_origin_t *origin;
+  http_conn_t **link, *conn;
+  double now = http_now(pool);
+
+  for (origin = pool->origins; origin != NULL; origin = origin->next) {
+    link = &origin->idle;
+    while (*link != NULL) {
+      conn = *link;
+      if (now - conn->idle_since >= max_idle_ms) {
+        *link = conn->next;
+        origin->idle_count--;
+        http_conn_close(pool, conn);
+      } else {
+        link = &conn->next;
+      }
+    }
+  }
+}
+
+static http_waiter_t *http_find_ticket(struct cmp_http_pool *pool,
+                                       size_t ticket,
+                                       http_fetch_t **out_fetch) {
+  http_origin_t *origin;
+  http_fetch_t *fetch;
+  http_waiter_t *waiter;
+  int p;
+
+  for (fetch = pool->in_flight; fetch != NULL; fetch = fetch->next) {
+    for (waiter = fetch->waiters; waiter != NULL; waiter = waiter->next) {
+      if (waiter->ticket == ticket) {
+        *out_fetch = fetch;
+        return waiter;
+      }
+    }
+  }
+  for (origin = pool->origins; origin != NULL; origin = origin->next) {
+    for (p = 0; p < CMP_HTTP_PRIORITY_COUNT; ++p) {
+      for (fetch = origin->head[p]; fetch != NULL; fetch = fetch->next) {
+        for (waiter = fetch->waiters; waiter != NULL;
+             waiter = waiter->next) {
+          if (waiter->ticket == ticket) {
+            *out_fetch = fetch;
+            return waiter;
+          }
+        }
+      }
+    }
+  }
+  return NULL;
+}
+
+static http_fetch_t *http_find_coalescable(struct cmp_http_pool *pool,
+                                           http_origin_t *origin,
+                                           const struct HttpRequest *req) {
+  http_fetch_t *fetch;
+  int p;
+
+  for (fetch = pool->in_flight; fetch != NULL; fetch = fetch->next) {
+    if (fetch->origin == origin && http_fetch_matches(fetch, req)) {
+      return fetch;
+    }
+  }
+  for (p = 0; p < CMP_HTTP_PRIORITY_COUNT; ++p) {
+    for (fetch = origin->head[p]; fetch != NULL; fetch = fetch->next) {
+      if (http_fetch_matches(fetch, req)) {
+        return fetch;
+      }
+    }
+  }
+  return NULL;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Public API                                                               */
+/* ------------------------------------------------------------------------ */
+
+int cmp_http_pool_config_init(cmp_http_pool_config_t *config) {
+  if (config == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  memset(config, 0, sizeof(cmp_http_pool_config_t));
+  config->max_per_origin = 6;
+  config->max_total = 16;
+  config->max_idle_per_origin = 6;
+  config->keep_alive_ms = 30000.0;
+  config->coalesce_gets = 1;
+  return CMP_SUCCESS;
+}
+
+int cmp_http_pool_create(const cmp_http_pool_config_t *config,
+                         cmp_http_pool_t **out_pool) {
+  struct cmp_http_pool *pool;
+
+  if (out_pool == NULL ||
+      (config != NULL &&
+       (config->max_per_origin == 0 || config->max_total == 0 ||
+        config->keep_alive_ms < 0.0))) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(struct cmp_http_pool), (void **)&pool) !=
+      CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(pool, 0, sizeof(struct cmp_http_pool));
+  if (config != NULL) {
+    pool->config = *config;
+  } else {
+    cmp_http_pool_config_init(&pool->config);
+  }
+  if (pool->config.now_ms == NULL) {
+    pool->config.now_ms = http_default_now;
+  }
+  pool->connect = http_default_connect;
+  pool->disconnect = http_default_disconnect;
+  *out_pool = pool;
+  return CMP_SUCCESS;
+}
+
+int cmp_http_pool_destroy(cmp_http_pool_t *pool) {
+  http_origin_t *origin;
+  http_fetch_t *fetch;
+  http_conn_t *conn;
+  int p;
+
+  if (pool == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (pool->in_flight == NULL) {
+    http_pool_free(pool);
+    return CMP_SUCCESS;
+  }
+
+  /* Sends in flight still use their connections; the last delivery
+   * releases the pool. Queued work and idle connections go now. */
+  pool->destroyed = 1;
+  for (origin = pool->origins; origin != NULL; origin = origin->next) {
+    for (p = 0; p < CMP_HTTP_PRIORITY_COUNT; ++p) {
+      while (origin->head[p] != NULL) {
+        fetch = origin->head[p];
+        http_queue_remove(fetch);
+        http_fetch_free(fetch);
+      }
+    }
+    while (origin->idle != NULL) {
+      conn = origin->idle;
+      origin->idle = conn->next;
+      http_conn_close(pool, conn);
+    }
+    origin->idle_count = 0;
+  }
+  return CMP_SUCCESS;
+}
+
+int cmp_http_pool_set_connector(cmp_http_pool_t *pool,
+                                cmp_http_connect_fn_t connect,
+                                cmp_http_disconnect_fn_t disconnect,
+                                void *user_data) {
+  if (pool == NULL || (connect == NULL) != (disconnect == NULL)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (pool->in_flight != NULL) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+  /* Idle connections came from the previous connector */
+  http_prune(pool, 0.0);
+  pool->connect = connect != NULL ? connect : http_default_connect;
+  pool->disconnect = disconnect != NULL ? disconnect : http_default_disconnect;
+  pool->connect_data = user_data;
+  return CMP_SUCCESS;
+}
+
+int cmp_http_pool_set_workers(cmp_http_pool_t *pool, cmp_modality_t *workers,
+                              cmp_modality_t *ui) {
+  if (pool == NULL ||
+      (workers != NULL &&
+       (workers->type != CMP_MODALITY_THREADED || ui == NULL))) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  pool->workers = workers;
+  pool->ui = ui;
+  return CMP_SUCCESS;
+}
+
+int cmp_http_pool_submit(cmp_http_pool_t *pool, const struct HttpRequest *req,
+                         cmp_http_priority_t priority, cmp_http_pool_cb_t cb,
+                         void *user_data, size_t *out_ticket) {
+  http_origin_t *origin;
+  http_fetch_t *fetch = NULL;
+  http_waiter_t *waiter;
+  char *name;
+  int res;
+
+  if (pool == NULL || req == NULL || req->url == NULL ||
+      (int)priority < 0 || priority >= CMP_HTTP_PRIORITY_COUNT ||
+      (req->body == NULL && req->body_len > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  name = http_origin_of(req->url);
+  if (name == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  origin = http_origin_find(pool, name);
+  CMP_FREE(name);
+  if (origin == NULL) {
+    return CMP_ERROR_OOM;
+  }
+  if (CMP_MALLOC(sizeof(http_waiter_t), (void **)&waiter) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(waiter, 0, sizeof(http_waiter_t));
+  waiter->ticket = ++pool->next_ticket;
+  waiter->priority = (int)priority;
+  waiter->cb = cb;
+  waiter->user_data = user_data;
+  pool->stats.requests++;
+
+  /* Identical GETs share one fetch and its response */
+  if (pool->config.coalesce_gets && req->method == HTTP_GET &&
+      req->body_len == 0) {
+    fetch = http_find_coalescable(pool, origin, req);
+  }
+  if (fetch != NULL) {
+    http_waiter_add(fetch, waiter);
+    http_fetch_reprioritize(fetch);
+    pool->stats.coalesced++;
+  } else {
+    if (CMP_MALLOC(sizeof(http_fetch_t), (void **)&fetch) != CMP_SUCCESS) {
+      CMP_FREE(waiter);
+      return CMP_ERROR_OOM;
+    }
+    memset(fetch, 0, sizeof(http_fetch_t));
+    res = http_copy_request(fetch, req);
+    if (res != CMP_SUCCESS) {
+      http_fetch_free(fetch);
+      CMP_FREE(waiter);
+      return res;
+    }
+    fetch->pool = pool;
+    fetch->origin = origin;
+    fetch->priority = (int)priority;
+    fetch->coalescable = req->method == HTTP_GET && req->body_len == 0;
+    fetch->queued_ms = http_now(pool);
+    http_waiter_add(fetch, waiter);
+    http_queue_push(fetch, 0);
+  }
+
+  if (out_ticket != NULL) {
+    *out_ticket = waiter->ticket;
+  }
+  if (pool->workers != NULL) {
+    http_pump(pool);
+  }
+  return CMP_SUCCESS;
+}
+
+int cmp_http_pool_cancel(cmp_http_pool_t *pool, size_t ticket) {
+  http_fetch_t *fetch;
+  http_waiter_t *waiter, **link;
+
+  if (pool == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  waiter = http_find_ticket(pool, ticket, &fetch);
+  if (waiter == NULL) {
+    return CMP_ERROR_NOT_FOUND;
+  }
+  link = &fetch->waiters;
+  while (*link != waiter) {
+    link = &(*link)->next;
+  }
+  *link = waiter->next;
+  CMP_FREE(waiter);
+  pool->stats.cancelled++;
+
+  /* A send in flight completes unobserved and still returns its
+   * connection to the pool */
+  if (fetch->waiters == NULL && fetch->queued) {
+    http_queue_remove(fetch);
+    http_fetch_free(fetch);
+  } else if (fetch->waiters != NULL) {
+    http_fetch_reprioritize(fetch);
+  }
+  return CMP_SUCCESS;
+}
+
+int cmp_http_pool_set_priority(cmp_http_pool_t *pool, size_t ticket,
+                               cmp_http_priority_t priority) {
+  http_fetch_t *fetch;
+  http_waiter_t *waiter;
+
+  if (pool == NULL || (int)priority < 0 ||
+      priority >= CMP_HTTP_PRIORITY_COUNT) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  waiter = http_find_ticket(pool, ticket, &fetch);
+  if (waiter == NULL) {
+    return CMP_ERROR_NOT_FOUND;
+  }
+  waiter->priority = (int)priority;
+  http_fetch_reprioritize(fetch);
+  return CMP_SUCCESS;
+}
+
+int cmp_http_pool_poll(cmp_http_pool_t *pool) {
+  if (pool == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  http_prune(pool, pool->config.keep_alive_ms);
+  http_pump(pool);
+  return CMP_SUCCESS;
+}
+
+int cmp_http_pool_get_stats(const cmp_http_pool_t *pool,
+                            cmp_http_pool_stats_t *out_stats) {
+  const http_origin_t *origin;
+
+  if (pool == NULL || out_stats == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  *out_stats = pool->stats;
+  out_stats->in_flight = pool->active;
+  out_stats->queued = 0;
+  out_stats->idle_connections = 0;
+  for (origin = pool->origins; origin != NULL; origin = origin->next) {
+    out_stats->queued += origin->queued;
+    out_stats->idle_connections += origin->idle_count;
+  }
+  return CMP_SUCCESS;
+}
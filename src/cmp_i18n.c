@@ -5,18 +5,86 @@
 #include <string.h>
 /* clang-format on */
 
+/* Strings are found through open-addressed tables keyed by an FNV-1a hash
+ * of (locale, key), both for strings added at runtime and for compiled
+ * catalogs. A compiled catalog is used in place from its file mapping:
+ *
+ *   0   "CMPI18N" NUL      magic
+ *   8   u32 version        CMP_I18N_CATALOG_VERSION
+ *   12  u32 entry_count
+ *   16  u32 bucket_count   power of two, 0 when there are no entries
+ *   20  u32 strings_size
+ *   24  u32 buckets[bucket_count]   entry index + 1, 0 for an empty slot
+ *   ..  entries[entry_count]        u32 hash, locale, key, value, value_len
+ *   ..  char strings[strings_size]  NUL-terminated, addressed by offset
+ *
+ * All integers are little-endian. Offsets are validated once at load so
+ * lookups can trust them. */
+
+#define CMP_I18N_CATALOG_VERSION 1
+#define CMP_I18N_HEADER_SIZE 24
+#define CMP_I18N_ENTRY_SIZE 20
+#define CMP_I18N_CHUNK_SIZE 16384
+
+/* Runtime strings live in chunks that never move, so lookups can hand out
+ * pointers and destroy frees a handful of blocks instead of every string. */
+typedef struct cmp_i18n_chunk {
+  struct cmp_i18n_chunk *next;
+  size_t used;
+  size_t capacity;
+} cmp_i18n_chunk_t;
+
 typedef struct cmp_i18n_entry {
   char *locale;
   char *key;
   char *value;
+  size_t value_len;
+  unsigned long hash;
 } cmp_i18n_entry_t;
 
+typedef struct cmp_i18n_catalog {
+  cmp_vfs_mapping_t *map;
+  const unsigned char *buckets;
+  const unsigned char *entries;
+  const char *strings;
+  unsigned long entry_count;
+  unsigned long bucket_count;
+  struct cmp_i18n_catalog *next; /* Older catalog, searched after this one */
+} cmp_i18n_catalog_t;
+
 struct cmp_i18n {
   cmp_i18n_entry_t *entries;
   size_t count;
   size_t capacity;
+  size_t *buckets; /* Entry index + 1, 0 for an empty slot */
+  size_t bucket_count;
+  cmp_i18n_chunk_t *chunks;      /* Current chunk first */
+  cmp_i18n_catalog_t *catalogs; /* Most recently loaded first */
 };
 
+static unsigned long i18n_hash(const char *locale, const char *key) {
+  unsigned long h = 2166136261ul;
+  const unsigned char *p;
+  for (p = (const unsigned char *)locale; *p; ++p)
+    h = ((h ^ *p) * 16777619ul) & 0xFFFFFFFFul;
+  h = ((h ^ 0xFFu) * 16777619ul) & 0xFFFFFFFFul;
+  for (p = (const unsigned char *)key; *p; ++p)
+    h = ((h ^ *p) * 16777619ul) & 0xFFFFFFFFul;
+  return h;
+}
+
+static unsigned long read_u32(const unsigned char *p) {
+  return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+         ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static void write_u32(unsigned char *p, unsigned long v) {
+  p[0] = (unsigned char)(v & 0xFF);
+  p[1] = (unsigned char)((v >> 8) & 0xFF);
+  p[2] = (unsigned char)((v >> 16) & 0xFF);
+  p[3] = (unsigned char)((v >> 24) & 0xFF);
+}
+
 int cmp_i18n_create(cmp_i18n_t **out_i18n) {
   cmp_i18n_t *i18n;
   if (!out_i18n) {
@@ -31,47 +99,117 @@ int cmp_i18n_create(cmp_i18n_t **out_i18n) {
 }
 
 int cmp_i18n_destroy(cmp_i18n_t *i18n) {
-  size_t i;
   if (!i18n) {
     return CMP_ERROR_INVALID_ARG;
   }
+  while (i18n->catalogs) {
+    cmp_i18n_catalog_t *catalog = i18n->catalogs;
+    i18n->catalogs = catalog->next;
+    cmp_vfs_unmap_file(catalog->map);
+    CMP_FREE(catalog);
+  }
+  while (i18n->chunks) {
+    cmp_i18n_chunk_t *chunk = i18n->chunks;
+    i18n->chunks = chunk->next;
+    CMP_FREE(chunk);
+  }
   if (i18n->entries) {
-    for (i = 0; i < i18n->count; i++) {
-      if (i18n->entries[i].locale) {
-        CMP_FREE(i18n->entries[i].locale);
-      }
-      if (i18n->entries[i].key) {
-        CMP_FREE(i18n->entries[i].key);
-      }
-      if (i18n->entries[i].value) {
-        CMP_FREE(i18n->entries[i].value);
-      }
-    }
     CMP_FREE(i18n->entries);
   }
+  if (i18n->buckets) {
+    CMP_FREE(i18n->buckets);
+  }
   CMP_FREE(i18n);
   return CMP_SUCCESS;
 }
 
-static int str_duplicate(const char *src, char **out_dst) {
-  size_t len = strlen(src);
-  if (CMP_MALLOC(len + 1, (void **)out_dst) != CMP_SUCCESS) {
+/* Copies a string into the current chunk, starting a new one if needed. */
+static char *str_store(cmp_i18n_t *i18n, const char *src) {
+  size_t len = strlen(src) + 1;
+  cmp_i18n_chunk_t *chunk = i18n->chunks;
+  char *dst;
+  if (!chunk || chunk->capacity - chunk->used < len) {
+    size_t cap = len > CMP_I18N_CHUNK_SIZE ? len : CMP_I18N_CHUNK_SIZE;
+    if (CMP_MALLOC(sizeof(cmp_i18n_chunk_t) + cap, (void **)&chunk) !=
+        CMP_SUCCESS) {
+      return NULL;
+    }
+    chunk->used = 0;
+    chunk->capacity = cap;
+    chunk->next = i18n->chunks;
+    i18n->chunks = chunk;
+  }
+  dst = (char *)(chunk + 1) + chunk->used;
+  memcpy(dst, src, len);
+  chunk->used += len;
+  return dst;
+}
+
+/* Returns the runtime entry for (locale, key), or NULL. */
+static const cmp_i18n_entry_t *find_entry(const cmp_i18n_t *i18n,
+                                          unsigned long hash,
+                                          const char *locale,
+                                          const char *key) {
+  size_t mask, i;
+  if (i18n->bucket_count == 0) {
+    return NULL;
+  }
+  mask = i18n->bucket_count - 1;
+  for (i = hash & mask; i18n->buckets[i] != 0; i = (i + 1) & mask) {
+    const cmp_i18n_entry_t *e = &i18n->entries[i18n->buckets[i] - 1];
+    if (e->hash == hash && strcmp(e->key, key) == 0 &&
+        strcmp(e->locale, locale) == 0) {
+      return e;
+    }
+  }
+  return NULL;
+}
+
+/* Keeps the table at most half full. */
+static int grow_buckets(cmp_i18n_t *i18n) {
+  size_t cap = i18n->bucket_count ? i18n->bucket_count * 2 : 16, i;
+  size_t *buckets;
+  if (CMP_MALLOC(cap * sizeof(size_t), (void **)&buckets) != CMP_SUCCESS) {
     return CMP_ERROR_OOM;
   }
-#if defined(_MSC_VER)
-  strcpy_s(*out_dst, len + 1, src);
-#else
-  strcpy(*out_dst, src);
-#endif
+  memset(buckets, 0, cap * sizeof(size_t));
+  for (i = 0; i < i18n->count; ++i) {
+    size_t slot = i18n->entries[i].hash & (cap - 1);
+    while (buckets[slot] != 0) {
+      slot = (slot + 1) & (cap - 1);
+    }
+    buckets[slot] = i + 1;
+  }
+  if (i18n->buckets) {
+    CMP_FREE(i18n->buckets);
+  }
+  i18n->buckets = buckets;
+  i18n->bucket_count = cap;
   return CMP_SUCCESS;
 }
 
 int cmp_i18n_add_string(cmp_i18n_t *i18n, const char *locale, const char *key,
                         const char *value) {
+  cmp_i18n_entry_t *entry;
+  unsigned long hash;
+  size_t slot;
+
   if (!i18n || !locale || !key || !value) {
     return CMP_ERROR_INVALID_ARG;
   }
 
+  /* The first string added for a (locale, key) pair wins */
+  hash = i18n_hash(locale, key);
+  if (find_entry(i18n, hash, locale, key)) {
+    return CMP_SUCCESS;
+  }
+
+  if ((i18n->count + 1) * 2 > i18n->bucket_count) {
+    if (grow_buckets(i18n) != CMP_SUCCESS) {
+      return CMP_ERROR_OOM;
+    }
+  }
+
   if (i18n->count >= i18n->capacity) {
     size_t new_cap = i18n->capacity == 0 ? 8 : i18n->capacity * 2;
     cmp_i18n_entry_t *new_entries;
@@ -88,38 +226,285 @@ int cmp_i18n_add_string(cmp_i18n_t *i18n, const char *locale, const char *key,
     i18n->capacity = new_cap;
   }
 
-  if (str_duplicate(locale, &i18n->entries[i18n->count].locale) !=
-      CMP_SUCCESS) {
-    return CMP_ERROR_OOM;
-  }
-  if (str_duplicate(key, &i18n->entries[i18n->count].key) != CMP_SUCCESS) {
-    CMP_FREE(i18n->entries[i18n->count].locale);
-    return CMP_ERROR_OOM;
-  }
-  if (str_duplicate(value, &i18n->entries[i18n->count].value) != CMP_SUCCESS) {
-    CMP_FREE(i18n->entries[i18n->count].locale);
-    CMP_FREE(i18n->entries[i18n->count].key);
+  entry = &i18n->entries[i18n->count];
+  entry->locale = str_store(i18n, locale);
+  entry->key = entry->locale ? str_store(i18n, key) : NULL;
+  entry->value = entry->key ? str_store(i18n, value) : NULL;
+  if (!entry->value) {
     return CMP_ERROR_OOM;
   }
+  entry->value_len = strlen(value);
+  entry->hash = hash;
 
+  slot = hash & (i18n->bucket_count - 1);
+  while (i18n->buckets[slot] != 0) {
+    slot = (slot + 1) & (i18n->bucket_count - 1);
+  }
+  i18n->buckets[slot] = i18n->count + 1;
   i18n->count++;
   return CMP_SUCCESS;
 }
 
-int cmp_i18n_get_string(const cmp_i18n_t *i18n, const char *locale,
-                        const char *key, char **out_value) {
-  size_t i;
+static int catalog_lookup(const cmp_i18n_catalog_t *catalog,
+                          unsigned long hash, const char *locale,
+                          const char *key, const char **out_value,
+                          size_t *out_len) {
+  unsigned long mask, i, probes;
+  if (catalog->bucket_count == 0) {
+    return 0;
+  }
+  mask = catalog->bucket_count - 1;
+  for (i = hash & mask, probes = 0; probes < catalog->bucket_count;
+       i = (i + 1) & mask, ++probes) {
+    unsigned long slot = read_u32(catalog->buckets + i * 4);
+    const unsigned char *e;
+    if (slot == 0) {
+      return 0;
+    }
+    e = catalog->entries + (slot - 1) * CMP_I18N_ENTRY_SIZE;
+    if (read_u32(e) == hash &&
+        strcmp(catalog->strings + read_u32(e + 8), key) == 0 &&
+        strcmp(catalog->strings + read_u32(e + 4), locale) == 0) {
+      *out_value = catalog->strings + read_u32(e + 12);
+      *out_len = (size_t)read_u32(e + 16);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int cmp_i18n_lookup(const cmp_i18n_t *i18n, const char *locale,
+                    const char *key, const char **out_value,
+                    size_t *out_len) {
+  const cmp_i18n_entry_t *entry;
+  const cmp_i18n_catalog_t *catalog;
+  unsigned long hash;
+  size_t len;
+
   if (!i18n || !locale || !key || !out_value) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  for (i = 0; i < i18n->count; i++) {
-    if (strcmp(i18n->entries[i].locale, locale) == 0 &&
-        strcmp(i18n->entries[i].key, key) == 0) {
-      return str_duplicate(i18n->entries[i].value, out_value);
+  hash = i18n_hash(locale, key);
+  entry = find_entry(i18n, hash, locale, key);
+  if (entry) {
+    *out_value = entry->value;
+    if (out_len) {
+      *out_len = entry->value_len;
+    }
+    return CMP_SUCCESS;
+  }
+  for (catalog = i18n->catalogs; catalog; catalog = catalog->next) {
+    if (catalog_lookup(catalog, hash, locale, key, out_value, &len)) {
+      if (out_len) {
+        *out_len = len;
+      }
+      return CMP_SUCCESS;
     }
   }
 
   *out_value = NULL;
   return CMP_ERROR_NOT_FOUND;
 }
+
+int cmp_i18n_get_string(const cmp_i18n_t *i18n, const char *locale,
+                        const char *key, char **out_value) {
+  const char *value;
+  size_t len;
+  int res;
+
+  if (!i18n || !locale || !key || !out_value) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  res = cmp_i18n_lookup(i18n, locale, key, &value, &len);
+  if (res != CMP_SUCCESS) {
+    *out_value = NULL;
+    return res;
+  }
+  if (CMP_MALLOC(len + 1, (void **)out_value) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memcpy(*out_value, value, len + 1);
+  return CMP_SUCCESS;
+}
+
+/* Appends s to the string pool unless an equal string is already there at
+ * one of the offsets in seen (used to share locale names). */
+static unsigned long pool_add(char *pool, unsigned long *pool_len,
+                              const char *s, const unsigned long *seen,
+                              size_t seen_count) {
+  size_t len = strlen(s), i;
+  unsigned long at;
+  for (i = 0; i < seen_count; ++i) {
+    if (strcmp(pool + seen[i], s) == 0) {
+      return seen[i];
+    }
+  }
+  at = *pool_len;
+  memcpy(pool + at, s, len + 1);
+  *pool_len += (unsigned long)len + 1;
+  return at;
+}
+
+int cmp_i18n_save_catalog(const cmp_i18n_t *i18n, const char *virtual_path) {
+  unsigned long bucket_count = 0, strings_size = 0, pool_len = 0;
+  unsigned long locales[64];
+  size_t locale_count = 0, i, total;
+  unsigned char *out, *buckets, *entries;
+  char *pool;
+  cmp_vfs_writer_t *writer;
+  int res;
+
+  if (!i18n || !virtual_path) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  if (i18n->count > 0) {
+    bucket_count = 1;
+    while (bucket_count < i18n->count * 2) {
+      bucket_count *= 2;
+    }
+  }
+  for (i = 0; i < i18n->count; ++i) {
+    strings_size += (unsigned long)(strlen(i18n->entries[i].locale) +
+                                    strlen(i18n->entries[i].key) +
+                                    i18n->entries[i].value_len + 3);
+  }
+
+  total = CMP_I18N_HEADER_SIZE + bucket_count * 4 +
+          i18n->count * CMP_I18N_ENTRY_SIZE + strings_size;
+  if (CMP_MALLOC(total, (void **)&out) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(out, 0, total);
+  buckets = out + CMP_I18N_HEADER_SIZE;
+  entries = buckets + bucket_count * 4;
+  pool = (char *)(entries + i18n->count * CMP_I18N_ENTRY_SIZE);
+
+  for (i = 0; i < i18n->count; ++i) {
+    const cmp_i18n_entry_t *e = &i18n->entries[i];
+    unsigned char *rec = entries + i * CMP_I18N_ENTRY_SIZE;
+    unsigned long before = pool_len, locale_at, slot;
+    locale_at = pool_add(pool, &pool_len, e->locale, locales, locale_count);
+    if (locale_at == before &&
+        locale_count < sizeof(locales) / sizeof(locales[0])) {
+      locales[locale_count++] = locale_at;
+    }
+    write_u32(rec, e->hash);
+    write_u32(rec + 4, locale_at);
+    write_u32(rec + 8, pool_add(pool, &pool_len, e->key, NULL, 0));
+    write_u32(rec + 12, pool_add(pool, &pool_len, e->value, NULL, 0));
+    write_u32(rec + 16, (unsigned long)e->value_len);
+
+    slot = e->hash & (bucket_count - 1);
+    while (read_u32(buckets + slot * 4) != 0) {
+      slot = (slot + 1) & (bucket_count - 1);
+    }
+    write_u32(buckets + slot * 4, (unsigned long)i + 1);
+  }
+
+  memcpy(out, "CMPI18N", 8);
+  write_u32(out + 8, CMP_I18N_CATALOG_VERSION);
+  write_u32(out + 12, (unsigned long)i18n->count);
+  write_u32(out + 16, bucket_count);
+  write_u32(out + 20, pool_len);
+  total -= strings_size - pool_len; /* Shared locale names saved space */
+
+  res = cmp_vfs_writer_open(virtual_path, &writer);
+  if (res == CMP_SUCCESS) {
+    int close_res;
+    res = cmp_vfs_writer_write(writer, out, total);
+    close_res = cmp_vfs_writer_close(writer);
+    if (res == CMP_SUCCESS) {
+      res = close_res;
+    }
+  }
+  CMP_FREE(out);
+  return res;
+}
+
+/* Checks every offset once so lookups never leave the mapping. */
+static int catalog_validate(const unsigned char *data, size_t size,
+                            cmp_i18n_catalog_t *catalog) {
+  unsigned long count, bucket_count, strings_size, i;
+  size_t need;
+
+  if (size < CMP_I18N_HEADER_SIZE || memcmp(data, "CMPI18N", 8) != 0 ||
+      read_u32(data + 8) != CMP_I18N_CATALOG_VERSION) {
+    return 0;
+  }
+  count = read_u32(data + 12);
+  bucket_count = read_u32(data + 16);
+  strings_size = read_u32(data + 20);
+  if ((bucket_count & (bucket_count - 1)) != 0 || bucket_count < count ||
+      (count > 0 && bucket_count == count)) {
+    return 0; /* A full table would never terminate a miss */
+  }
+  if (bucket_count > size / 4 || count > size / CMP_I18N_ENTRY_SIZE ||
+      strings_size > size) {
+    return 0;
+  }
+  need = CMP_I18N_HEADER_SIZE + (size_t)bucket_count * 4 +
+         (size_t)count * CMP_I18N_ENTRY_SIZE + strings_size;
+  if (need != size || (count > 0 && strings_size == 0)) {
+    return 0;
+  }
+
+  catalog->buckets = data + CMP_I18N_HEADER_SIZE;
+  catalog->entries = catalog->buckets + bucket_count * 4;
+  catalog->strings = (const char *)(catalog->entries +
+                                    count * CMP_I18N_ENTRY_SIZE);
+  catalog->entry_count = count;
+  catalog->bucket_count = bucket_count;
+
+  if (strings_size > 0 && catalog->strings[strings_size - 1] != '\0') {
+    return 0;
+  }
+  for (i = 0; i < bucket_count; ++i) {
+    if (read_u32(catalog->buckets + i * 4) > count) {
+      return 0;
+    }
+  }
+  for (i = 0; i < count; ++i) {
+    const unsigned char *e = catalog->entries + i * CMP_I18N_ENTRY_SIZE;
+    unsigned long value = read_u32(e + 12), len = read_u32(e + 16);
+    if (read_u32(e + 4) >= strings_size || read_u32(e + 8) >= strings_size ||
+        value >= strings_size || len >= strings_size - value ||
+        catalog->strings[value + len] != '\0') {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+int cmp_i18n_load_compiled(cmp_i18n_t *i18n, const char *virtual_path) {
+  cmp_i18n_catalog_t *catalog;
+  const void *data;
+  size_t size;
+  int res;
+
+  if (!i18n || !virtual_path) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(cmp_i18n_catalog_t), (void **)&catalog) !=
+      CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(catalog, 0, sizeof(cmp_i18n_catalog_t));
+
+  res = cmp_vfs_map_file(virtual_path, &catalog->map, &data, &size);
+  if (res != CMP_SUCCESS) {
+    CMP_FREE(catalog);
+    return res;
+  }
+  if (!catalog_validate((const unsigned char *)data, size, catalog)) {
+    cmp_vfs_unmap_file(catalog->map);
+    CMP_FREE(catalog);
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  catalog->next = i18n->catalogs;
+  i18n->catalogs = catalog;
+  return CMP_SUCCESS;
+}
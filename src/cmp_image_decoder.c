@@ -0,0 +1,564 @@
+/* clang-format off */
+#include "cmp.h"
+#include <string.h>
+/* clang-format on */
+
+#define IMG_SNIFF_BYTES 12
+#define IMG_FILE_CHUNK 16384
+
+struct cmp_image_decoder {
+  int target_width;
+  int target_height;
+  cmp_image_info_t info;
+  int header_done;
+  int error;
+
+  unsigned char sniff[IMG_SNIFF_BYTES];
+  size_t sniff_len;
+  cmp_png_decoder_t *png;
+  cmp_jpeg_decoder_t *jpeg;
+  cmp_webp_decoder_t *webp;
+
+  cmp_image_header_cb_t header_cb;
+  cmp_image_rows_cb_t rows_cb;
+  void *user_data;
+
+  unsigned char *pixels;
+  size_t stride;
+  int owns_pixels;
+
+  /* Row-streaming box filter from codec resolution to output resolution.
+   * Colour is accumulated alpha-weighted so transparent pixels do not bleed
+   * into their neighbours. */
+  int src_width;
+  int src_height;
+  int *xmap;
+  unsigned long *hcount;
+  unsigned long *acc;
+  int acc_row;
+  int acc_rows;
+  int next_src_row;
+  int dirty_first;
+  int dirty_last;
+};
+
+int cmp_image_decoder_create(int target_width, int target_height,
+                             cmp_image_decoder_t **out_decoder) {
+  cmp_image_decoder_t *dec;
+
+  if (out_decoder == NULL || target_width < 0 || target_height < 0) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(cmp_image_decoder_t), (void **)&dec) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(dec, 0, sizeof(cmp_image_decoder_t));
+  dec->target_width = target_width;
+  dec->target_height = target_height;
+  dec->acc_row = -1;
+  dec->dirty_first = -1;
+
+  *out_decoder = dec;
+  return CMP_SUCCESS;
+}
+
+int cmp_image_decoder_destroy(cmp_image_decoder_t *dec) {
+  if (dec == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (dec->png != NULL) {
+    cmp_png_decoder_destroy(dec->png);
+  }
+  if (dec->jpeg != NULL) {
+    cmp_jpeg_decoder_destroy(dec->jpeg);
+  }
+  if (dec->webp != NULL) {
+    cmp_webp_decoder_destroy(dec->webp);
+  }
+  if (dec->owns_pixels && dec->pixels != NULL) {
+    CMP_FREE(dec->pixels);
+  }
+  if (dec->xmap != NULL) {
+    CMP_FREE(dec->xmap);
+  }
+  if (dec->hcount != NULL) {
+    CMP_FREE(dec->hcount);
+  }
+  if (dec->acc != NULL) {
+    CMP_FREE(dec->acc);
+  }
+  CMP_FREE(dec);
+  return CMP_SUCCESS;
+}
+
+int cmp_image_decoder_set_callbacks(cmp_image_decoder_t *dec,
+                                    cmp_image_header_cb_t header_cb,
+                                    cmp_image_rows_cb_t rows_cb,
+                                    void *user_data) {
+  if (dec == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (dec->sniff_len > 0) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+  dec->header_cb = header_cb;
+  dec->rows_cb = rows_cb;
+  dec->user_data = user_data;
+  return CMP_SUCCESS;
+}
+
+int cmp_image_decoder_set_output(cmp_image_decoder_t *dec,
+                                 unsigned char *pixels, size_t stride) {
+  if (dec == NULL || pixels == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (dec->header_done) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+  dec->pixels = pixels;
+  dec->stride = stride;
+  dec->owns_pixels = 0;
+  return CMP_SUCCESS;
+}
+
+static void img_fit_output(const cmp_image_decoder_t *dec, int nw, int nh,
+                           int *out_w, int *out_h) {
+  double ow = (double)dec->target_width;
+  double oh = (double)dec->target_height;
+
+  if (ow <= 0.0 && oh <= 0.0) {
+    ow = (double)nw;
+    oh = (double)nh;
+  } else if (ow <= 0.0) {
+    ow = oh * (double)nw / (double)nh;
+  } else if (oh <= 0.0) {
+    oh = ow * (double)nh / (double)nw;
+  }
+  if (ow > (double)nw || oh > (double)nh) {
+    double f = (double)nw / ow;
+    if ((double)nh / oh < f) {
+      f = (double)nh / oh;
+    }
+    ow *= f;
+    oh *= f;
+  }
+  *out_w = (int)(ow + 0.5);
+  *out_h = (int)(oh + 0.5);
+  if (*out_w < 1)
+    *out_w = 1;
+  if (*out_h < 1)
+    *out_h = 1;
+  if (*out_w > nw)
+    *out_w = nw;
+  if (*out_h > nh)
+    *out_h = nh;
+}
+
+int cmp_image_decoder_begin_frame(cmp_image_decoder_t *dec, int native_width,
+                                  int native_height, int is_progressive,
+                                  int max_scale, int *out_scale) {
+  int ow, oh, s, x;
+
+  if (dec == NULL || out_scale == NULL || native_width <= 0 ||
+      native_height <= 0) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (dec->header_done) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+
+  img_fit_output(dec, native_width, native_height, &ow, &oh);
+  s = 1;
+  while (s < 8 && s * 2 <= max_scale &&
+         (native_width + s * 2 - 1) / (s * 2) >= ow &&
+         (native_height + s * 2 - 1) / (s * 2) >= oh) {
+    s *= 2;
+  }
+
+  dec->info.native_width = native_width;
+  dec->info.native_height = native_height;
+  dec->info.decode_scale = s;
+  dec->info.width = ow;
+  dec->info.height = oh;
+  dec->info.is_progressive = is_progressive;
+  dec->info.passes_completed = 0;
+  dec->src_width = (native_width + s - 1) / s;
+  dec->src_height = (native_height + s - 1) / s;
+
+  if (dec->header_cb != NULL) {
+    unsigned char *pixels = dec->pixels;
+    size_t stride = dec->stride;
+    if (dec->header_cb(dec->user_data, &dec->info, &pixels, &stride) != 0) {
+      return CMP_ERROR_INVALID_STATE;
+    }
+    if (pixels != dec->pixels) {
+      dec->pixels = pixels;
+      dec->stride = stride;
+    }
+  }
+  if (dec->pixels == NULL) {
+    dec->stride = (size_t)ow * 4;
+    if (CMP_MALLOC(dec->stride * (size_t)oh, (void **)&dec->pixels) !=
+        CMP_SUCCESS) {
+      return CMP_ERROR_OOM;
+    }
+    memset(dec->pixels, 0, dec->stride * (size_t)oh);
+    dec->owns_pixels = 1;
+  } else if (dec->stride < (size_t)ow * 4) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  if (dec->src_width != ow || dec->src_height != oh) {
+    if (CMP_MALLOC((size_t)dec->src_width * sizeof(int),
+                   (void **)&dec->xmap) != CMP_SUCCESS ||
+        CMP_MALLOC((size_t)ow * sizeof(unsigned long),
+                   (void **)&dec->hcount) != CMP_SUCCESS ||
+        CMP_MALLOC((size_t)ow * 4 * sizeof(unsigned long),
+                   (void **)&dec->acc) != CMP_SUCCESS) {
+      return CMP_ERROR_OOM;
+    }
+    memset(dec->hcount, 0, (size_t)ow * sizeof(unsigned long));
+    memset(dec->acc, 0, (size_t)ow * 4 * sizeof(unsigned long));
+    for (x = 0; x < dec->src_width; x++) {
+      dec->xmap[x] = (int)((double)x * ow / dec->src_width);
+      dec->hcount[dec->xmap[x]]++;
+    }
+  }
+
+  dec->header_done = 1;
+  *out_scale = s;
+  return CMP_SUCCESS;
+}
+
+static void img_mark_dirty(cmp_image_decoder_t *dec, int row) {
+  if (dec->dirty_first < 0) {
+    dec->dirty_first = row;
+  }
+  dec->dirty_last = row;
+}
+
+static void img_flush_dirty(cmp_image_decoder_t *dec) {
+  if (dec->dirty_first >= 0 && dec->rows_cb != NULL) {
+    dec->rows_cb(dec->user_data, dec->dirty_first,
+                 dec->dirty_last - dec->dirty_first + 1,
+                 dec->info.passes_completed);
+  }
+  dec->dirty_first = -1;
+}
+
+static void img_flush_acc(cmp_image_decoder_t *dec) {
+  unsigned char *out;
+  int x;
+
+  if (dec->acc_rows == 0) {
+    return;
+  }
+  out = dec->pixels + (size_t)dec->acc_row * dec->stride;
+  for (x = 0; x < dec->info.width; x++) {
+    unsigned long *a = dec->acc + (size_t)x * 4;
+    double n = (double)dec->hcount[x] * (double)dec->acc_rows;
+    if (a[3] == 0) {
+      out[0] = out[1] = out[2] = out[3] = 0;
+    } else {
+      double inv = 255.0 / (double)a[3];
+      double c;
+      int i;
+      for (i = 0; i < 3; i++) {
+        c = (double)a[i] * inv + 0.5;
+        out[i] = (unsigned char)(c > 255.0 ? 255.0 : c);
+      }
+      out[3] = (unsigned char)((double)a[3] / n + 0.5);
+    }
+    a[0] = a[1] = a[2] = a[3] = 0;
+    out += 4;
+  }
+  img_mark_dirty(dec, dec->acc_row);
+  dec->acc_rows = 0;
+}
+
+int cmp_image_decoder_write_rows(cmp_image_decoder_t *dec, int first_row,
+                                 int row_count, const unsigned char *rgba,
+                                 size_t stride) {
+  int r;
+
+  if (dec == NULL || rgba == NULL || first_row < 0 ||
+      first_row + row_count > dec->src_height) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (!dec->header_done) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+
+  for (r = 0; r < row_count; r++) {
+    int y = first_row + r;
+    const unsigned char *src = rgba + (size_t)r * stride;
+
+    if (dec->xmap == NULL) {
+      memcpy(dec->pixels + (size_t)y * dec->stride, src,
+             (size_t)dec->src_width * 4);
+      img_mark_dirty(dec, y);
+      continue;
+    }
+
+    {
+      int dy = (int)((double)y * dec->info.height / dec->src_height);
+      int x;
+      if (y < dec->next_src_row || dy != dec->acc_row) {
+        /* New output row, or a progressive pass restarting at the top. */
+        if (y >= dec->next_src_row) {
+          img_flush_acc(dec);
+        } else {
+          memset(dec->acc, 0,
+                 (size_t)dec->info.width * 4 * sizeof(unsigned long));
+          dec->acc_rows = 0;
+        }
+        dec->acc_row = dy;
+      }
+      for (x = 0; x < dec->src_width; x++) {
+        unsigned long *a = dec->acc + (size_t)dec->xmap[x] * 4;
+        unsigned long alpha = src[3];
+        /* Premultiply to 8 bits so the sums cannot overflow 32-bit longs. */
+        a[0] += (src[0] * alpha + 127) / 255;
+        a[1] += (src[1] * alpha + 127) / 255;
+        a[2] += (src[2] * alpha + 127) / 255;
+        a[3] += alpha;
+        src += 4;
+      }
+      dec->acc_rows++;
+      if (y == dec->src_height - 1 ||
+          (int)((double)(y + 1) * dec->info.height / dec->src_height) != dy) {
+        img_flush_acc(dec);
+      }
+    }
+    dec->next_src_row = y + 1;
+  }
+
+  img_flush_dirty(dec);
+  return CMP_SUCCESS;
+}
+
+int cmp_image_decoder_end_pass(cmp_image_decoder_t *dec) {
+  if (dec == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (!dec->header_done) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+  img_flush_acc(dec);
+  img_flush_dirty(dec);
+  dec->info.passes_completed++;
+  dec->next_src_row = 0;
+  return CMP_SUCCESS;
+}
+
+static int img_backend_push(cmp_image_decoder_t *dec,
+                            const unsigned char *data, size_t len) {
+  switch (dec->info.format) {
+  case CMP_IMAGE_FORMAT_PNG:
+    return cmp_png_decoder_push(dec->png, data, len);
+  case CMP_IMAGE_FORMAT_JPEG:
+    return cmp_jpeg_decoder_push(dec->jpeg, data, len);
+  case CMP_IMAGE_FORMAT_WEBP:
+    return cmp_webp_decoder_push(dec->webp, data, len);
+  default:
+    return CMP_ERROR_INVALID_STATE;
+  }
+}
+
+static cmp_image_format_t img_sniff(const unsigned char *b, size_t len,
+                                    int *out_need_more) {
+  static const unsigned char k_png[8] = {0x89, 'P',  'N',  'G',
+                                         0x0D, 0x0A, 0x1A, 0x0A};
+  *out_need_more = 0;
+  if (len >= 3 && b[0] == 0xFF && b[1] == 0xD8 && b[2] == 0xFF) {
+    return CMP_IMAGE_FORMAT_JPEG;
+  }
+  if (len >= 8 && memcmp(b, k_png, 8) == 0) {
+    return CMP_IMAGE_FORMAT_PNG;
+  }
+  if (len >= 12 && memcmp(b, "RIFF", 4) == 0 && memcmp(b + 8, "WEBP", 4) == 0) {
+    return CMP_IMAGE_FORMAT_WEBP;
+  }
+  *out_need_more = len < IMG_SNIFF_BYTES;
+  return CMP_IMAGE_FORMAT_UNKNOWN;
+}
+
+int cmp_image_decoder_push(cmp_image_decoder_t *dec, const void *data,
+                           size_t len) {
+  const unsigned char *bytes = (const unsigned char *)data;
+
+  if (dec == NULL || (data == NULL && len > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (dec->error != CMP_SUCCESS) {
+    return dec->error;
+  }
+
+  if (dec->info.format == CMP_IMAGE_FORMAT_UNKNOWN) {
+    size_t take = IMG_SNIFF_BYTES - dec->sniff_len;
+    int need_more;
+    int res;
+    if (take > len) {
+      take = len;
+    }
+    memcpy(dec->sniff + dec->sniff_len, bytes, take);
+    dec->sniff_len += take;
+    bytes += take;
+    len -= take;
+
+    dec->info.format = img_sniff(dec->sniff, dec->sniff_len, &need_more);
+    switch (dec->info.format) {
+    case CMP_IMAGE_FORMAT_PNG:
+      res = cmp_png_decoder_create(dec, &dec->png);
+      break;
+    case CMP_IMAGE_FORMAT_JPEG:
+      res = cmp_jpeg_decoder_create(dec, &dec->jpeg);
+      break;
+    case CMP_IMAGE_FORMAT_WEBP:
+      res = cmp_webp_decoder_create(dec, &dec->webp);
+      break;
+    default:
+      res = need_more ? CMP_SUCCESS : CMP_ERROR_INVALID_ARG;
+      break;
+    }
+    if (res != CMP_SUCCESS || dec->info.format == CMP_IMAGE_FORMAT_UNKNOWN) {
+      dec->error = res;
+      return res;
+    }
+    res = img_backend_push(dec, dec->sniff, dec->sniff_len);
+    if (res != CMP_SUCCESS) {
+      dec->error = res;
+      return res;
+    }
+  }
+
+  if (len > 0) {
+    dec->error = img_backend_push(dec, bytes, len);
+  }
+  return dec->error;
+}
+
+int cmp_image_decoder_finish(cmp_image_decoder_t *dec) {
+  if (dec == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (dec->error != CMP_SUCCESS) {
+    return dec->error;
+  }
+  switch (dec->info.format) {
+  case CMP_IMAGE_FORMAT_PNG:
+    dec->error = cmp_png_decoder_finish(dec->png);
+    break;
+  case CMP_IMAGE_FORMAT_JPEG:
+    dec->error = cmp_jpeg_decoder_finish(dec->jpeg);
+    break;
+  case CMP_IMAGE_FORMAT_WEBP:
+    dec->error = cmp_webp_decoder_finish(dec->webp);
+    break;
+  default:
+    dec->error = CMP_ERROR_INVALID_STATE;
+    break;
+  }
+  if (dec->error == CMP_SUCCESS && !dec->header_done) {
+    dec->error = CMP_ERROR_INVALID_STATE;
+  }
+  return dec->error;
+}
+
+int cmp_image_decoder_get_info(const cmp_image_decoder_t *dec,
+                               cmp_image_info_t *out_info) {
+  if (dec == NULL || out_info == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (!dec->header_done) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+  *out_info = dec->info;
+  return CMP_SUCCESS;
+}
+
+int cmp_image_decoder_get_pixels(const cmp_image_decoder_t *dec,
+                                 unsigned char **out_pixels,
+                                 size_t *out_stride) {
+  if (dec == NULL || out_pixels == NULL || out_stride == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (!dec->header_done) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+  *out_pixels = dec->pixels;
+  *out_stride = dec->stride;
+  return CMP_SUCCESS;
+}
+
+int cmp_image_decoder_http_on_chunk(void *user_data, const void *chunk,
+                                    size_t chunk_len) {
+  cmp_image_decoder_t *dec = (cmp_image_decoder_t *)user_data;
+  if (dec == NULL) {
+    return 1;
+  }
+  return cmp_image_decoder_push(dec, chunk, chunk_len) != CMP_SUCCESS;
+}
+
+typedef struct {
+  char *virtual_path;
+  cmp_image_decoder_t *dec;
+  cmp_image_decode_cb_t callback;
+  void *user_data;
+} cmp_image_decode_task_t;
+
+static int img_file_chunk_cb(void *user_data, const void *chunk, size_t len) {
+  return cmp_image_decoder_push((cmp_image_decoder_t *)user_data, chunk, len);
+}
+
+static void img_decode_file_worker(void *arg) {
+  cmp_image_decode_task_t *task = (cmp_image_decode_task_t *)arg;
+  int res;
+
+  if (task == NULL) {
+    return;
+  }
+  res = cmp_vfs_read_file_chunked(task->virtual_path, IMG_FILE_CHUNK,
+                                  img_file_chunk_cb, task->dec);
+  if (res == CMP_SUCCESS) {
+    res = cmp_image_decoder_finish(task->dec);
+  }
+  if (task->callback != NULL) {
+    task->callback(res, task->dec, task->user_data);
+  }
+  CMP_FREE(task->virtual_path);
+  CMP_FREE(task);
+}
+
+int cmp_image_decode_file_async(cmp_modality_t *mod, const char *virtual_path,
+                                cmp_image_decoder_t *dec,
+                                cmp_image_decode_cb_t callback,
+                                void *user_data) {
+  cmp_image_decode_task_t *task;
+  size_t path_len;
+  int res;
+
+  if (mod == NULL || virtual_path == NULL || dec == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(cmp_image_decode_task_t), (void **)&task) !=
+      CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  path_len = strlen(virtual_path);
+  if (CMP_MALLOC(path_len + 1, (void **)&task->virtual_path) != CMP_SUCCESS) {
+    CMP_FREE(task);
+    return CMP_ERROR_OOM;
+  }
+  memcpy(task->virtual_path, virtual_path, path_len + 1);
+  task->dec = dec;
+  task->callback = callback;
+  task->user_data = user_data;
+
+  res = cmp_modality_queue_task(mod, img_decode_file_worker, task);
+  if (res != CMP_SUCCESS) {
+    CMP_FREE(task->virtual_path);
+    CMP_FREE(task);
+  }
+  return res;
+}
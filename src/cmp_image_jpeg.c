@@ -0,0 +1,1030 @@
+/* clang-format off */
+#include "cmp.h"
+#include <math.h>
+#include <string.h>
+/* clang-format on */
+
+/* Streaming JPEG decoder (baseline, extended-sequential and progressive
+ * Huffman, 8-bit, grayscale or YCbCr/RGB).
+ *
+ * Downscaling happens in the DCT domain: at 1/2, 1/4 and 1/8 only the
+ * top-left 4x4, 2x2 or DC coefficient of each block is kept and run through
+ * a correspondingly smaller inverse DCT. Fully interleaved sequential scans
+ * are converted an MCU row at a time; progressive (and non-interleaved
+ * sequential) images keep only those reduced coefficients, plus a 64-bit
+ * "nonzero" mask per block for successive-approximation refinement, and are
+ * repainted after every scan.
+ *
+ * Entropy-coded data is only consumed when the worst case for an MCU is
+ * buffered or the end of the scan has arrived, so decoding never has to be
+ * rolled back mid-block. */
+
+#define JPG_BLOCK_WORST_BYTES 512
+
+typedef enum {
+  JPG_ST_SOI = 0,
+  JPG_ST_MARKER,
+  JPG_ST_SCAN,
+  JPG_ST_DONE
+} jpg_state_t;
+
+typedef struct jpg_huffman {
+  unsigned char fast_len[512];
+  unsigned char fast_sym[512];
+  unsigned char symbols[256];
+  long maxcode[18];
+  int valptr[17];
+  unsigned short mincode[17];
+  int defined;
+} jpg_huffman_t;
+
+typedef struct jpg_component {
+  int id;
+  int h;
+  int v;
+  int tq;
+  int td;
+  int ta;
+  int bw; /* Blocks per row, padded to whole MCUs. */
+  int bh;
+  int bw_real; /* Blocks actually covering the component. */
+  int bh_real;
+  int dc_pred;
+  unsigned char *strip;
+  int strip_width;
+  short *coefs;
+  unsigned int *nonzero;
+} jpg_component_t;
+
+static const unsigned char k_zigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+struct cmp_jpeg_decoder {
+  cmp_image_decoder_t *sink;
+  jpg_state_t state;
+  int finishing;
+  int seen_eoi;
+  int error;
+
+  unsigned char *buf;
+  size_t len;
+  size_t pos;
+  size_t cap;
+
+  unsigned short quant[4][64];
+  jpg_huffman_t dc[4];
+  jpg_huffman_t ac[4];
+
+  int width;
+  int height;
+  int ncomp;
+  int progressive;
+  int frame_ready;
+  int hmax;
+  int vmax;
+  int mcux;
+  int mcuy;
+  int restart_interval;
+  int adobe_transform;
+  jpg_component_t comp[4];
+
+  int scale;
+  int n;
+  float idct[64];
+  int out_width;
+  int out_height;
+  unsigned char *rgba;
+  int coef_mode;
+
+  int scan_ncomp;
+  int scan_comp[4];
+  int ss;
+  int se;
+  int ah;
+  int al;
+  unsigned long eobrun;
+  unsigned long mcu;
+  unsigned long scan_mcus;
+  int mcus_per_row;
+  size_t mcu_worst;
+  size_t scan_search;
+  int scan_end_known;
+
+  unsigned long bitbuf;
+  int bitcnt;
+};
+
+/* ---- Bit reader ---- */
+
+static void jpg_fill(cmp_jpeg_decoder_t *j) {
+  while (j->bitcnt <= 24) {
+    unsigned int b = 0;
+    if (j->pos < j->len) {
+      b = j->buf[j->pos];
+      if (b == 0xFF) {
+        if (j->pos + 1 < j->len && j->buf[j->pos + 1] == 0x00) {
+          j->pos += 2;
+        } else {
+          b = 0; /* Marker (or end of data): pad with zeros. */
+        }
+      } else {
+        j->pos++;
+      }
+    }
+    j->bitbuf = ((j->bitbuf << 8) | b) & 0xFFFFFFFFUL;
+    j->bitcnt += 8;
+  }
+}
+
+static int jpg_bits(cmp_jpeg_decoder_t *j, int n) {
+  int v;
+  if (n == 0)
+    return 0;
+  jpg_fill(j);
+  v = (int)((j->bitbuf >> (j->bitcnt - n)) & ((1UL << n) - 1UL));
+  j->bitcnt -= n;
+  return v;
+}
+
+static int jpg_extend(int v, int s) {
+  return v < (1 << (s - 1)) ? v - ((1 << s) - 1) : v;
+}
+
+static void jpg_reset_bits(cmp_jpeg_decoder_t *j) {
+  j->bitbuf = 0;
+  j->bitcnt = 0;
+}
+
+/* ---- Huffman tables ---- */
+
+static int jpg_build_huffman(jpg_huffman_t *h, const unsigned char *counts,
+                             const unsigned char *symbols, int total) {
+  unsigned int code = 0;
+  int len, i, k = 0;
+
+  memset(h->fast_len, 0, sizeof(h->fast_len));
+  memcpy(h->symbols, symbols, (size_t)total);
+  for (len = 1; len <= 16; len++) {
+    h->valptr[len] = k;
+    h->mincode[len] = (unsigned short)code;
+    for (i = 0; i < counts[len - 1]; i++, k++, code++) {
+      if (code >= (1U << len))
+        return -1; /* Over-subscribed. */
+      if (len <= 9) {
+        unsigned int first = code << (9 - len);
+        unsigned int fill;
+        for (fill = 0; fill < (1U << (9 - len)); fill++) {
+          h->fast_len[first + fill] = (unsigned char)len;
+          h->fast_sym[first + fill] = symbols[k];
+        }
+      }
+    }
+    h->maxcode[len] = counts[len - 1] ? (long)code - 1 : -1;
+    code <<= 1;
+  }
+  h->defined = 1;
+  return 0;
+}
+
+static int jpg_decode(cmp_jpeg_decoder_t *j, const jpg_huffman_t *h) {
+  unsigned int peek;
+  int len;
+
+  jpg_fill(j);
+  peek = (unsigned int)((j->bitbuf >> (j->bitcnt - 16)) & 0xFFFFUL);
+  len = h->fast_len[peek >> 7];
+  if (len != 0) {
+    j->bitcnt -= len;
+    return h->fast_sym[peek >> 7];
+  }
+  for (len = 10; len <= 16; len++) {
+    long code = (long)(peek >> (16 - len));
+    if (code <= h->maxcode[len]) {
+      j->bitcnt -= len;
+      return h->symbols[h->valptr[len] + (int)(code - h->mincode[len])];
+    }
+  }
+  return -1;
+}
+
+/* ---- Coefficient decoding ---- */
+
+static void jpg_store(const cmp_jpeg_decoder_t *j, short *win, int k,
+                      int value) {
+  int nat = k_zigzag[k];
+  int r = nat >> 3, c = nat & 7;
+  if (r < j->n && c < j->n)
+    win[r * j->n + c] = (short)value;
+}
+
+static short *jpg_window(const cmp_jpeg_decoder_t *j, short *win, int k) {
+  int nat = k_zigzag[k];
+  int r = nat >> 3, c = nat & 7;
+  return (r < j->n && c < j->n) ? &win[r * j->n + c] : NULL;
+}
+
+static int jpg_block_sequential(cmp_jpeg_decoder_t *j, jpg_component_t *c,
+                                short *win) {
+  int t, k;
+
+  t = jpg_decode(j, &j->dc[c->td]);
+  if (t < 0 || t > 11)
+    return -1;
+  c->dc_pred += t ? jpg_extend(jpg_bits(j, t), t) : 0;
+  win[0] = (short)c->dc_pred;
+
+  for (k = 1; k < 64;) {
+    int rs = jpg_decode(j, &j->ac[c->ta]);
+    int r, s;
+    if (rs < 0)
+      return -1;
+    r = rs >> 4;
+    s = rs & 15;
+    if (s == 0) {
+      if (r != 15)
+        break;
+      k += 16;
+      continue;
+    }
+    k += r;
+    if (k > 63)
+      return -1;
+    jpg_store(j, win, k, jpg_extend(jpg_bits(j, s), s));
+    k++;
+  }
+  return 0;
+}
+
+static int jpg_block_dc_progressive(cmp_jpeg_decoder_t *j,
+                                    jpg_component_t *c, short *win) {
+  if (j->ah == 0) {
+    int t = jpg_decode(j, &j->dc[c->td]);
+    if (t < 0 || t > 11)
+      return -1;
+    c->dc_pred += t ? jpg_extend(jpg_bits(j, t), t) : 0;
+    win[0] = (short)(c->dc_pred * (1 << j->al));
+  } else if (jpg_bits(j, 1)) {
+    win[0] = (short)(win[0] | (1 << j->al));
+  }
+  return 0;
+}
+
+#define JPG_NZ_TEST(nz, k) (((nz)[(k) >> 5] >> ((k)&31)) & 1U)
+#define JPG_NZ_SET(nz, k) ((nz)[(k) >> 5] |= 1U << ((k)&31))
+
+static void jpg_refine(cmp_jpeg_decoder_t *j, short *win, int k, int p1) {
+  short *coef;
+  if (!jpg_bits(j, 1))
+    return;
+  coef = jpg_window(j, win, k);
+  if (coef != NULL && (*coef & p1) == 0)
+    *coef = (short)(*coef >= 0 ? *coef + p1 : *coef - p1);
+}
+
+static int jpg_block_ac_progressive(cmp_jpeg_decoder_t *j,
+                                    jpg_component_t *c, short *win,
+                                    unsigned int *nz) {
+  int k = j->ss;
+
+  if (j->ah == 0) {
+    if (j->eobrun > 0) {
+      j->eobrun--;
+      return 0;
+    }
+    while (k <= j->se) {
+      int rs = jpg_decode(j, &j->ac[c->ta]);
+      int r, s;
+      if (rs < 0)
+        return -1;
+      r = rs >> 4;
+      s = rs & 15;
+      if (s == 0) {
+        if (r < 15) {
+          j->eobrun = (1UL << r) - 1UL;
+          if (r)
+            j->eobrun += (unsigned long)jpg_bits(j, r);
+          break;
+        }
+        k += 16;
+        continue;
+      }
+      k += r;
+      if (k > 63)
+        return -1;
+      jpg_store(j, win, k, jpg_extend(jpg_bits(j, s), s) * (1 << j->al));
+      JPG_NZ_SET(nz, k);
+      k++;
+    }
+    return 0;
+  }
+
+  /* Successive-approximation refinement (ITU T.81 G.1.2.3). */
+  {
+    int p1 = 1 << j->al;
+    if (j->eobrun == 0) {
+      for (; k <= j->se; k++) {
+        int rs = jpg_decode(j, &j->ac[c->ta]);
+        int r, s;
+        if (rs < 0)
+          return -1;
+        r = rs >> 4;
+        s = rs & 15;
+        if (s != 0) {
+          s = jpg_bits(j, 1) ? p1 : -p1;
+        } else if (r != 15) {
+          j->eobrun = 1UL << r;
+          if (r)
+            j->eobrun += (unsigned long)jpg_bits(j, r);
+          break;
+        }
+        do {
+          if (JPG_NZ_TEST(nz, k)) {
+            jpg_refine(j, win, k, p1);
+          } else {
+            if (--r < 0)
+              break;
+          }
+          k++;
+        } while (k <= j->se);
+        if (s != 0 && k <= j->se) {
+          jpg_store(j, win, k, s);
+          JPG_NZ_SET(nz, k);
+        }
+      }
+    }
+    if (j->eobrun > 0) {
+      for (; k <= j->se; k++) {
+        if (JPG_NZ_TEST(nz, k))
+          jpg_refine(j, win, k, p1);
+      }
+      j->eobrun--;
+    }
+  }
+  return 0;
+}
+
+/* ---- Reduced inverse DCT and colour conversion ---- */
+
+static void jpg_setup_idct(cmp_jpeg_decoder_t *j) {
+  const double pi = 3.14159265358979323846;
+  int x, u;
+  for (x = 0; x < j->n; x++) {
+    for (u = 0; u < j->n; u++) {
+      double cu = u == 0 ? 0.70710678118654752440 : 1.0;
+      j->idct[x * j->n + u] =
+          (float)(cu * cos((2.0 * x + 1.0) * u * pi / (2.0 * j->n)) / 2.0);
+    }
+  }
+}
+
+static void jpg_idct_block(const cmp_jpeg_decoder_t *j, const short *win,
+                           const unsigned short *q, unsigned char *out,
+                           int stride) {
+  float coef[64];
+  float tmp[64];
+  int n = j->n;
+  int x, y, u;
+
+  for (y = 0; y < n; y++)
+    for (x = 0; x < n; x++)
+      coef[y * n + x] = (float)win[y * n + x] * (float)q[y * 8 + x];
+
+  for (y = 0; y < n; y++) {
+    for (x = 0; x < n; x++) {
+      float sum = 0.0f;
+      for (u = 0; u < n; u++)
+        sum += coef[y * n + u] * j->idct[x * n + u];
+      tmp[y * n + x] = sum;
+    }
+  }
+  for (y = 0; y < n; y++) {
+    for (x = 0; x < n; x++) {
+      float sum = 128.5f;
+      int v;
+      for (u = 0; u < n; u++)
+        sum += j->idct[y * n + u] * tmp[u * n + x];
+      v = sum <= 0.0f ? 0 : (int)sum;
+      out[y * stride + x] = (unsigned char)(v > 255 ? 255 : v);
+    }
+  }
+}
+
+static unsigned char jpg_clamp(long v) {
+  return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+static int jpg_emit_mcu_row(cmp_jpeg_decoder_t *j, int mrow) {
+  int lines = j->vmax * j->n;
+  int y0 = mrow * lines;
+  int count = j->out_height - y0;
+  int y, x;
+
+  if (count > lines)
+    count = lines;
+  if (count <= 0)
+    return CMP_SUCCESS;
+
+  for (y = 0; y < count; y++) {
+    unsigned char *out = j->rgba + (size_t)y * j->out_width * 4;
+    if (j->ncomp == 1) {
+      const unsigned char *yrow = j->comp[0].strip +
+                                  (size_t)y * j->comp[0].strip_width;
+      for (x = 0; x < j->out_width; x++, out += 4) {
+        out[0] = out[1] = out[2] = yrow[x];
+        out[3] = 255;
+      }
+    } else {
+      const jpg_component_t *c0 = &j->comp[0];
+      const jpg_component_t *c1 = &j->comp[1];
+      const jpg_component_t *c2 = &j->comp[2];
+      const unsigned char *r0 =
+          c0->strip + (size_t)(y * c0->v / j->vmax) * c0->strip_width;
+      const unsigned char *r1 =
+          c1->strip + (size_t)(y * c1->v / j->vmax) * c1->strip_width;
+      const unsigned char *r2 =
+          c2->strip + (size_t)(y * c2->v / j->vmax) * c2->strip_width;
+      for (x = 0; x < j->out_width; x++, out += 4) {
+        long yy = r0[x * c0->h / j->hmax];
+        long cb = (long)r1[x * c1->h / j->hmax] - 128;
+        long cr = (long)r2[x * c2->h / j->hmax] - 128;
+        if (j->adobe_transform == 0) {
+          out[0] = (unsigned char)yy;
+          out[1] = (unsigned char)(cb + 128);
+          out[2] = (unsigned char)(cr + 128);
+        } else {
+          /* 16.16 fixed point; the bias keeps the shifted value positive. */
+          long base = (yy << 16) + 32768L + (512L << 16);
+          out[0] = jpg_clamp(((base + 91881L * cr) >> 16) - 512);
+          out[1] = jpg_clamp(((base - 22554L * cb - 46802L * cr) >> 16) - 512);
+          out[2] = jpg_clamp(((base + 116130L * cb) >> 16) - 512);
+        }
+        out[3] = 255;
+      }
+    }
+  }
+  return cmp_image_decoder_write_rows(j->sink, y0, count, j->rgba,
+                                      (size_t)j->out_width * 4);
+}
+
+static int jpg_render_coefficients(cmp_jpeg_decoder_t *j) {
+  int nn = j->n * j->n;
+  int mrow, i, bx, by;
+  int res;
+
+  for (mrow = 0; mrow < j->mcuy; mrow++) {
+    for (i = 0; i < j->ncomp; i++) {
+      jpg_component_t *c = &j->comp[i];
+      const unsigned short *q = j->quant[c->tq];
+      for (by = 0; by < c->v; by++) {
+        const short *row = c->coefs + (size_t)(mrow * c->v + by) * c->bw * nn;
+        for (bx = 0; bx < c->bw; bx++) {
+          jpg_idct_block(j, row + (size_t)bx * nn, q,
+                         c->strip + (size_t)by * j->n * c->strip_width +
+                             (size_t)bx * j->n,
+                         c->strip_width);
+        }
+      }
+    }
+    res = jpg_emit_mcu_row(j, mrow);
+    if (res != CMP_SUCCESS)
+      return res;
+  }
+  return cmp_image_decoder_end_pass(j->sink);
+}
+
+/* ---- Scan decoding ---- */
+
+static int jpg_decode_mcu(cmp_jpeg_decoder_t *j) {
+  int nn = j->n * j->n;
+  short win[64];
+  int i, bx, by;
+
+  if (j->scan_ncomp == 1) {
+    jpg_component_t *c = &j->comp[j->scan_comp[0]];
+    int col = (int)(j->mcu % (unsigned long)c->bw_real);
+    int row = (int)(j->mcu / (unsigned long)c->bw_real);
+    short *dst;
+    unsigned int *nz = NULL;
+    int err;
+
+    if (j->coef_mode) {
+      dst = c->coefs + ((size_t)row * c->bw + col) * nn;
+      if (c->nonzero != NULL)
+        nz = c->nonzero + ((size_t)row * c->bw + col) * 2;
+    } else {
+      memset(win, 0, sizeof(short) * (size_t)nn);
+      dst = win;
+    }
+    if (!j->progressive)
+      err = jpg_block_sequential(j, c, dst);
+    else if (j->ss == 0)
+      err = jpg_block_dc_progressive(j, c, dst);
+    else
+      err = jpg_block_ac_progressive(j, c, dst, nz);
+    if (err != 0)
+      return CMP_ERROR_INVALID_ARG;
+    if (!j->coef_mode) {
+      jpg_idct_block(j, win, j->quant[c->tq], c->strip + (size_t)col * j->n,
+                     c->strip_width);
+    }
+    return CMP_SUCCESS;
+  }
+
+  {
+    int mx = (int)(j->mcu % (unsigned long)j->mcux);
+    int my = (int)(j->mcu / (unsigned long)j->mcux);
+    for (i = 0; i < j->scan_ncomp; i++) {
+      jpg_component_t *c = &j->comp[j->scan_comp[i]];
+      for (by = 0; by < c->v; by++) {
+        for (bx = 0; bx < c->h; bx++) {
+          short *dst;
+          int err;
+          if (j->coef_mode) {
+            dst = c->coefs +
+                  ((size_t)(my * c->v + by) * c->bw + mx * c->h + bx) * nn;
+          } else {
+            memset(win, 0, sizeof(short) * (size_t)nn);
+            dst = win;
+          }
+          err = j->progressive ? jpg_block_dc_progressive(j, c, dst)
+                               : jpg_block_sequential(j, c, dst);
+          if (err != 0)
+            return CMP_ERROR_INVALID_ARG;
+          if (!j->coef_mode) {
+            jpg_idct_block(j, win, j->quant[c->tq],
+                           c->strip + (size_t)by * j->n * c->strip_width +
+                               (size_t)(mx * c->h + bx) * j->n,
+                           c->strip_width);
+          }
+        }
+      }
+    }
+  }
+  return CMP_SUCCESS;
+}
+
+/* Locates the marker terminating the current scan, if it has arrived. */
+static void jpg_find_scan_end(cmp_jpeg_decoder_t *j) {
+  size_t i = j->scan_search > j->pos ? j->scan_search : j->pos;
+  for (; i + 1 < j->len; i++) {
+    unsigned char m = j->buf[i + 1];
+    if (j->buf[i] == 0xFF && m != 0x00 && m != 0xFF &&
+        !(m >= 0xD0 && m <= 0xD7)) {
+      j->scan_end_known = 1;
+      return;
+    }
+  }
+  j->scan_search = i;
+}
+
+static void jpg_skip_restart(cmp_jpeg_decoder_t *j) {
+  int i;
+  jpg_reset_bits(j);
+  while (j->pos + 1 < j->len && j->buf[j->pos] == 0xFF &&
+         j->buf[j->pos + 1] == 0xFF)
+    j->pos++;
+  if (j->pos + 1 < j->len && j->buf[j->pos] == 0xFF &&
+      j->buf[j->pos + 1] >= 0xD0 && j->buf[j->pos + 1] <= 0xD7)
+    j->pos += 2;
+  for (i = 0; i < j->ncomp; i++)
+    j->comp[i].dc_pred = 0;
+  j->eobrun = 0;
+}
+
+static int jpg_decode_scan(cmp_jpeg_decoder_t *j) {
+  int res;
+
+  while (j->mcu < j->scan_mcus) {
+    if (!j->finishing && !j->scan_end_known) {
+      jpg_find_scan_end(j);
+      if (!j->scan_end_known && j->len - j->pos < j->mcu_worst)
+        return CMP_SUCCESS;
+    }
+    if (j->restart_interval > 0 && j->mcu > 0 &&
+        j->mcu % (unsigned long)j->restart_interval == 0) {
+      jpg_skip_restart(j);
+    }
+    res = jpg_decode_mcu(j);
+    if (res != CMP_SUCCESS)
+      return res;
+    j->mcu++;
+    if (!j->coef_mode && j->mcu % (unsigned long)j->mcus_per_row == 0) {
+      res = jpg_emit_mcu_row(j, (int)(j->mcu / j->mcus_per_row) - 1);
+      if (res != CMP_SUCCESS)
+        return res;
+    }
+  }
+
+  jpg_reset_bits(j);
+  j->state = JPG_ST_MARKER;
+  if (j->coef_mode)
+    return jpg_render_coefficients(j);
+  return cmp_image_decoder_end_pass(j->sink);
+}
+
+/* ---- Marker segments ---- */
+
+static int jpg_parse_dqt(cmp_jpeg_decoder_t *j, const unsigned char *p,
+                         size_t len) {
+  while (len > 0) {
+    int pq = p[0] >> 4, tq = p[0] & 15, k;
+    size_t need = 1 + (pq ? 128 : 64);
+    if (tq > 3 || pq > 1 || len < need)
+      return CMP_ERROR_INVALID_ARG;
+    for (k = 0; k < 64; k++) {
+      j->quant[tq][k_zigzag[k]] =
+          pq ? (unsigned short)((p[1 + k * 2] << 8) | p[2 + k * 2])
+             : p[1 + k];
+    }
+    p += need;
+    len -= need;
+  }
+  return CMP_SUCCESS;
+}
+
+static int jpg_parse_dht(cmp_jpeg_decoder_t *j, const unsigned char *p,
+                         size_t len) {
+  while (len > 0) {
+    int tc, th, total = 0, i;
+    if (len < 17)
+      return CMP_ERROR_INVALID_ARG;
+    tc = p[0] >> 4;
+    th = p[0] & 15;
+    for (i = 0; i < 16; i++)
+      total += p[1 + i];
+    if (tc > 1 || th > 3 || total > 256 || len < (size_t)(17 + total))
+      return CMP_ERROR_INVALID_ARG;
+    if (jpg_build_huffman(tc ? &j->ac[th] : &j->dc[th], p + 1, p + 17,
+                          total) != 0)
+      return CMP_ERROR_INVALID_ARG;
+    p += 17 + total;
+    len -= (size_t)(17 + total);
+  }
+  return CMP_SUCCESS;
+}
+
+static int jpg_alloc_coefficients(cmp_jpeg_decoder_t *j) {
+  size_t nn = (size_t)j->n * j->n;
+  int i;
+
+  for (i = 0; i < j->ncomp; i++) {
+    jpg_component_t *c = &j->comp[i];
+    size_t blocks = (size_t)c->bw * c->bh;
+    if (CMP_MALLOC(blocks * nn * sizeof(short), (void **)&c->coefs) !=
+        CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    memset(c->coefs, 0, blocks * nn * sizeof(short));
+    if (j->progressive) {
+      if (CMP_MALLOC(blocks * 2 * sizeof(unsigned int),
+                     (void **)&c->nonzero) != CMP_SUCCESS)
+        return CMP_ERROR_OOM;
+      memset(c->nonzero, 0, blocks * 2 * sizeof(unsigned int));
+    }
+  }
+  j->coef_mode = 1;
+  return CMP_SUCCESS;
+}
+
+static int jpg_parse_sof(cmp_jpeg_decoder_t *j, const unsigned char *p,
+                         size_t len) {
+  int i, res;
+
+  if (j->frame_ready || len < 6 || p[0] != 8)
+    return CMP_ERROR_INVALID_ARG;
+  j->height = (p[1] << 8) | p[2];
+  j->width = (p[3] << 8) | p[4];
+  j->ncomp = p[5];
+  if (j->width == 0 || j->height == 0 ||
+      (j->ncomp != 1 && j->ncomp != 3) || len < (size_t)(6 + j->ncomp * 3))
+    return CMP_ERROR_INVALID_ARG;
+
+  j->hmax = j->vmax = 1;
+  for (i = 0; i < j->ncomp; i++) {
+    jpg_component_t *c = &j->comp[i];
+    c->id = p[6 + i * 3];
+    c->h = p[7 + i * 3] >> 4;
+    c->v = p[7 + i * 3] & 15;
+    c->tq = p[8 + i * 3];
+    if (c->h < 1 || c->h > 4 || c->v < 1 || c->v > 4 || c->tq > 3)
+      return CMP_ERROR_INVALID_ARG;
+    if (j->ncomp == 1)
+      c->h = c->v = 1; /* A lone component is always non-interleaved. */
+    if (c->h > j->hmax)
+      j->hmax = c->h;
+    if (c->v > j->vmax)
+      j->vmax = c->v;
+  }
+  if (j->ncomp == 3 && j->adobe_transform < 0 && j->comp[0].id == 'R' &&
+      j->comp[1].id == 'G' && j->comp[2].id == 'B')
+    j->adobe_transform = 0;
+
+  res = cmp_image_decoder_begin_frame(j->sink, j->width, j->height,
+                                      j->progressive, 8, &j->scale);
+  if (res != CMP_SUCCESS)
+    return res;
+  j->n = 8 / j->scale;
+  j->out_width = (j->width + j->scale - 1) / j->scale;
+  j->out_height = (j->height + j->scale - 1) / j->scale;
+  jpg_setup_idct(j);
+
+  j->mcux = (j->width + 8 * j->hmax - 1) / (8 * j->hmax);
+  j->mcuy = (j->height + 8 * j->vmax - 1) / (8 * j->vmax);
+  for (i = 0; i < j->ncomp; i++) {
+    jpg_component_t *c = &j->comp[i];
+    int cw = (j->width * c->h + j->hmax - 1) / j->hmax;
+    int ch = (j->height * c->v + j->vmax - 1) / j->vmax;
+    c->bw = j->mcux * c->h;
+    c->bh = j->mcuy * c->v;
+    c->bw_real = (cw + 7) / 8;
+    c->bh_real = (ch + 7) / 8;
+    c->strip_width = c->bw * j->n;
+    if (CMP_MALLOC((size_t)c->strip_width * c->v * j->n,
+                   (void **)&c->strip) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+  }
+  if (CMP_MALLOC((size_t)j->out_width * 4 * j->vmax * j->n,
+                 (void **)&j->rgba) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+
+  if (j->progressive) {
+    res = jpg_alloc_coefficients(j);
+    if (res != CMP_SUCCESS)
+      return res;
+  }
+  j->frame_ready = 1;
+  return CMP_SUCCESS;
+}
+
+static int jpg_parse_sos(cmp_jpeg_decoder_t *j, const unsigned char *p,
+                         size_t len) {
+  int i, k, blocks = 0;
+
+  if (!j->frame_ready || len < 1)
+    return CMP_ERROR_INVALID_ARG;
+  j->scan_ncomp = p[0];
+  if (j->scan_ncomp < 1 || j->scan_ncomp > j->ncomp ||
+      len < (size_t)(4 + j->scan_ncomp * 2))
+    return CMP_ERROR_INVALID_ARG;
+
+  for (i = 0; i < j->scan_ncomp; i++) {
+    int id = p[1 + i * 2];
+    for (k = 0; k < j->ncomp; k++) {
+      if (j->comp[k].id == id)
+        break;
+    }
+    if (k == j->ncomp)
+      return CMP_ERROR_INVALID_ARG;
+    j->scan_comp[i] = k;
+    j->comp[k].td = p[2 + i * 2] >> 4;
+    j->comp[k].ta = p[2 + i * 2] & 15;
+    if (j->comp[k].td > 3 || j->comp[k].ta > 3)
+      return CMP_ERROR_INVALID_ARG;
+    blocks += j->comp[k].h * j->comp[k].v;
+  }
+  p += 1 + j->scan_ncomp * 2;
+  j->ss = p[0];
+  j->se = p[1];
+  j->ah = p[2] >> 4;
+  j->al = p[2] & 15;
+
+  if (j->progressive) {
+    if (j->ss > j->se || j->se > 63 || j->al > 13 ||
+        (j->ss == 0 && j->se != 0) || (j->ss > 0 && j->scan_ncomp != 1))
+      return CMP_ERROR_INVALID_ARG;
+  } else if (j->ss != 0 || j->se != 63 || j->ah != 0 || j->al != 0) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  for (i = 0; i < j->scan_ncomp; i++) {
+    jpg_component_t *c = &j->comp[j->scan_comp[i]];
+    int needs_dc = !j->progressive || (j->ss == 0 && j->ah == 0);
+    int needs_ac = !j->progressive || j->ss > 0;
+    if ((needs_dc && !j->dc[c->td].defined) ||
+        (needs_ac && !j->ac[c->ta].defined))
+      return CMP_ERROR_INVALID_ARG;
+    c->dc_pred = 0;
+  }
+
+  /* Sequential frames split into per-component scans need the whole
+   * coefficient plane before any pixel can be produced. */
+  if (!j->coef_mode && j->scan_ncomp != j->ncomp) {
+    int res = jpg_alloc_coefficients(j);
+    if (res != CMP_SUCCESS)
+      return res;
+  }
+
+  if (j->scan_ncomp == 1) {
+    jpg_component_t *c = &j->comp[j->scan_comp[0]];
+    j->scan_mcus = (unsigned long)c->bw_real * (unsigned long)c->bh_real;
+    j->mcus_per_row = c->bw_real;
+    blocks = 1;
+  } else {
+    j->scan_mcus = (unsigned long)j->mcux * (unsigned long)j->mcuy;
+    j->mcus_per_row = j->mcux;
+  }
+  j->mcu_worst = (size_t)blocks * JPG_BLOCK_WORST_BYTES + 4;
+  j->mcu = 0;
+  j->eobrun = 0;
+  j->scan_end_known = 0;
+  j->scan_search = 0;
+  jpg_reset_bits(j);
+  j->state = JPG_ST_SCAN;
+  return CMP_SUCCESS;
+}
+
+static int jpg_handle_segment(cmp_jpeg_decoder_t *j, int marker,
+                              const unsigned char *p, size_t len) {
+  switch (marker) {
+  case 0xC0:
+  case 0xC1:
+    j->progressive = 0;
+    return jpg_parse_sof(j, p, len);
+  case 0xC2:
+    j->progressive = 1;
+    return jpg_parse_sof(j, p, len);
+  case 0xC3:
+  case 0xC5:
+  case 0xC6:
+  case 0xC7:
+  case 0xC9:
+  case 0xCA:
+  case 0xCB:
+  case 0xCD:
+  case 0xCE:
+  case 0xCF:
+    return CMP_ERROR_INVALID_ARG; /* Lossless, hierarchical, arithmetic. */
+  case 0xC4:
+    return jpg_parse_dht(j, p, len);
+  case 0xDB:
+    return jpg_parse_dqt(j, p, len);
+  case 0xDD:
+    if (len < 2)
+      return CMP_ERROR_INVALID_ARG;
+    j->restart_interval = (p[0] << 8) | p[1];
+    return CMP_SUCCESS;
+  case 0xDA:
+    return jpg_parse_sos(j, p, len);
+  case 0xEE:
+    if (len >= 12 && memcmp(p, "Adobe", 5) == 0)
+      j->adobe_transform = p[11];
+    return CMP_SUCCESS;
+  default:
+    return CMP_SUCCESS;
+  }
+}
+
+static int jpg_run(cmp_jpeg_decoder_t *j) {
+  int res = CMP_SUCCESS;
+
+  while (res == CMP_SUCCESS && j->state != JPG_ST_DONE) {
+    if (j->state == JPG_ST_SOI) {
+      if (j->len - j->pos < 2)
+        break;
+      if (j->buf[j->pos] != 0xFF || j->buf[j->pos + 1] != 0xD8)
+        return CMP_ERROR_INVALID_ARG;
+      j->pos += 2;
+      j->state = JPG_ST_MARKER;
+    } else if (j->state == JPG_ST_SCAN) {
+      res = jpg_decode_scan(j);
+      if (j->state == JPG_ST_SCAN)
+        break;
+    } else {
+      int marker;
+      size_t seg;
+      while (j->pos < j->len && j->buf[j->pos] != 0xFF)
+        j->pos++;
+      if (j->len - j->pos < 2)
+        break;
+      marker = j->buf[j->pos + 1];
+      if (marker == 0xFF) {
+        j->pos++;
+        continue;
+      }
+      if (marker == 0x00 || marker == 0x01 || marker == 0xD8 ||
+          (marker >= 0xD0 && marker <= 0xD7)) {
+        j->pos += 2;
+        continue;
+      }
+      if (marker == 0xD9) {
+        j->pos += 2;
+        j->seen_eoi = 1;
+        j->state = JPG_ST_DONE;
+        break;
+      }
+      if (j->len - j->pos < 4)
+        break;
+      seg = ((size_t)j->buf[j->pos + 2] << 8) | j->buf[j->pos + 3];
+      if (seg < 2)
+        return CMP_ERROR_INVALID_ARG;
+      if (j->len - j->pos < 2 + seg)
+        break;
+      j->pos += 2 + seg;
+      res = jpg_handle_segment(j, marker, j->buf + j->pos - seg + 2, seg - 2);
+    }
+  }
+  return res;
+}
+
+int cmp_jpeg_decoder_create(cmp_image_decoder_t *sink,
+                            cmp_jpeg_decoder_t **out_jpeg) {
+  cmp_jpeg_decoder_t *j;
+
+  if (sink == NULL || out_jpeg == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(cmp_jpeg_decoder_t), (void **)&j) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(j, 0, sizeof(cmp_jpeg_decoder_t));
+  j->sink = sink;
+  j->state = JPG_ST_SOI;
+  j->adobe_transform = -1;
+
+  *out_jpeg = j;
+  return CMP_SUCCESS;
+}
+
+int cmp_jpeg_decoder_push(cmp_jpeg_decoder_t *j, const unsigned char *data,
+                          size_t len) {
+  if (j == NULL || (data == NULL && len > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (j->error != CMP_SUCCESS) {
+    return j->error;
+  }
+  if (j->state == JPG_ST_DONE) {
+    return CMP_SUCCESS;
+  }
+
+  if (j->pos > 0) {
+    memmove(j->buf, j->buf + j->pos, j->len - j->pos);
+    j->len -= j->pos;
+    j->scan_search = j->scan_search > j->pos ? j->scan_search - j->pos : 0;
+    j->pos = 0;
+  }
+  if (j->len + len > j->cap) {
+    size_t cap = j->cap ? j->cap : 8192;
+    unsigned char *grown;
+    while (cap < j->len + len)
+      cap *= 2;
+    if (CMP_MALLOC(cap, (void **)&grown) != CMP_SUCCESS) {
+      return CMP_ERROR_OOM;
+    }
+    if (j->len > 0)
+      memcpy(grown, j->buf, j->len);
+    if (j->buf != NULL)
+      CMP_FREE(j->buf);
+    j->buf = grown;
+    j->cap = cap;
+  }
+  if (len > 0) {
+    memcpy(j->buf + j->len, data, len);
+    j->len += len;
+  }
+
+  j->error = jpg_run(j);
+  return j->error;
+}
+
+int cmp_jpeg_decoder_finish(cmp_jpeg_decoder_t *j) {
+  if (j == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (j->error != CMP_SUCCESS) {
+    return j->error;
+  }
+  /* Let a truncated final scan decode against zero padding so whatever
+   * arrived is still shown, but report the truncation. */
+  j->finishing = 1;
+  j->error = jpg_run(j);
+  if (j->error == CMP_SUCCESS && !j->seen_eoi) {
+    j->error = CMP_ERROR_INVALID_STATE;
+  }
+  return j->error;
+}
+
+int cmp_jpeg_decoder_destroy(cmp_jpeg_decoder_t *j) {
+  int i;
+
+  if (j == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  for (i = 0; i < 4; i++) {
+    if (j->comp[i].strip != NULL)
+      CMP_FREE(j->comp[i].strip);
+    if (j->comp[i].coefs != NULL)
+      CMP_FREE(j->comp[i].coefs);
+    if (j->comp[i].nonzero != NULL)
+      CMP_FREE(j->comp[i].nonzero);
+  }
+  if (j->rgba != NULL) {
+    CMP_FREE(j->rgba);
+  }
+  if (j->buf != NULL) {
+    CMP_FREE(j->buf);
+  }
+  CMP_FREE(j);
+  return CMP_SUCCESS;
+}
@@ -0,0 +1,580 @@
+/* clang-format off */
+#include "cmp.h"
+#include <string.h>
+/* clang-format on */
+
+/* Streaming PNG decoder. IDAT bytes go straight into a cmp_inflate_t and
+ * scanlines are unfiltered as soon as they are complete, so a non-interlaced
+ * image never holds more than two rows. Interlaced images are assembled in a
+ * frame at the reduced resolution chosen by the sink: each Adam7 pass fills
+ * the rectangle its pixels stand for, and passes that only add detail below
+ * that resolution are never inflated at all. Chunk CRCs are not checked;
+ * the zlib Adler-32 already covers the pixel data. */
+
+#define PNG_SMALL_CHUNK 768
+
+typedef enum {
+  PNG_ST_SIGNATURE = 0,
+  PNG_ST_CHUNK_HEADER,
+  PNG_ST_CHUNK_DATA,
+  PNG_ST_CHUNK_CRC,
+  PNG_ST_DONE
+} png_state_t;
+
+/* x0, y0, dx, dy, fill width, fill height */
+static const int k_adam7[7][6] = {{0, 0, 8, 8, 8, 8}, {4, 0, 8, 8, 4, 8},
+                                  {0, 4, 4, 8, 4, 4}, {2, 0, 4, 4, 2, 4},
+                                  {0, 2, 2, 4, 2, 2}, {1, 0, 2, 2, 1, 2},
+                                  {0, 1, 1, 2, 1, 1}};
+
+struct cmp_png_decoder {
+  cmp_image_decoder_t *sink;
+  png_state_t state;
+  unsigned char header[8];
+  size_t header_len;
+  unsigned long chunk_left;
+  unsigned char chunk_type[4];
+  unsigned char small[PNG_SMALL_CHUNK];
+  size_t small_len;
+  int seen_ihdr;
+  int seen_iend;
+
+  int width;
+  int height;
+  int bit_depth;
+  int color_type;
+  int interlace;
+  int channels;
+  int pixel_bits;
+  int filter_bpp;
+
+  unsigned char palette[256 * 4];
+  int has_trns;
+  unsigned int trns_key[3];
+
+  cmp_inflate_t *inf;
+  unsigned char *cur;
+  unsigned char *prev;
+  size_t row_fill;
+  unsigned char *rgba_row;
+
+  int scale;
+  int pass;
+  int last_pass;
+  int pass_width;
+  int pass_height;
+  int pass_y;
+  unsigned char *frame;
+  int frame_width;
+  int frame_height;
+  int image_done;
+  int error;
+};
+
+static unsigned long png_be32(const unsigned char *b) {
+  return ((unsigned long)b[0] << 24) | ((unsigned long)b[1] << 16) |
+         ((unsigned long)b[2] << 8) | (unsigned long)b[3];
+}
+
+static size_t png_row_bytes(const cmp_png_decoder_t *png, int pixels) {
+  return ((size_t)pixels * (size_t)png->pixel_bits + 7) / 8;
+}
+
+/* Advance to the next non-empty pass; the image is done after last_pass. */
+static void png_start_pass(cmp_png_decoder_t *png, int pass) {
+  png->pass_y = 0;
+  png->row_fill = 0;
+  while (pass <= png->last_pass) {
+    if (png->interlace) {
+      const int *p = k_adam7[pass];
+      png->pass_width = (png->width - p[0] + p[2] - 1) / p[2];
+      png->pass_height = (png->height - p[1] + p[3] - 1) / p[3];
+      if (png->width <= p[0])
+        png->pass_width = 0;
+      if (png->height <= p[1])
+        png->pass_height = 0;
+    } else {
+      png->pass_width = png->width;
+      png->pass_height = png->height;
+    }
+    if (png->pass_width > 0 && png->pass_height > 0)
+      break;
+    pass++;
+  }
+  png->pass = pass;
+  if (pass > png->last_pass) {
+    png->image_done = 1;
+    return;
+  }
+  memset(png->prev, 0, png_row_bytes(png, png->pass_width));
+}
+
+static void png_unfilter(cmp_png_decoder_t *png, size_t len) {
+  unsigned char *row = png->cur + 1;
+  const unsigned char *up = png->prev;
+  size_t bpp = (size_t)png->filter_bpp;
+  size_t i;
+
+  switch (png->cur[0]) {
+  case 1:
+    for (i = bpp; i < len; i++)
+      row[i] = (unsigned char)(row[i] + row[i - bpp]);
+    break;
+  case 2:
+    for (i = 0; i < len; i++)
+      row[i] = (unsigned char)(row[i] + up[i]);
+    break;
+  case 3:
+    for (i = 0; i < len; i++) {
+      unsigned int left = i >= bpp ? row[i - bpp] : 0;
+      row[i] = (unsigned char)(row[i] + ((left + up[i]) >> 1));
+    }
+    break;
+  case 4:
+    for (i = 0; i < len; i++) {
+      int a = i >= bpp ? row[i - bpp] : 0;
+      int b = up[i];
+      int c = i >= bpp ? up[i - bpp] : 0;
+      int p = a + b - c;
+      int pa = p > a ? p - a : a - p;
+      int pb = p > b ? p - b : b - p;
+      int pc = p > c ? p - c : c - p;
+      int pred = (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+      row[i] = (unsigned char)(row[i] + pred);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+static unsigned int png_sample(const unsigned char *row, int depth, int idx) {
+  switch (depth) {
+  case 16:
+    return ((unsigned int)row[idx * 2] << 8) | row[idx * 2 + 1];
+  case 8:
+    return row[idx];
+  default: {
+    int per_byte = 8 / depth;
+    int shift = 8 - depth * (idx % per_byte + 1);
+    return (row[idx / per_byte] >> shift) & ((1U << depth) - 1U);
+  }
+  }
+}
+
+static void png_to_rgba(cmp_png_decoder_t *png, const unsigned char *row,
+                        int count) {
+  unsigned char *out = png->rgba_row;
+  int depth = png->bit_depth;
+  unsigned int max = (1U << depth) - 1U;
+  int i;
+
+  for (i = 0; i < count; i++, out += 4) {
+    unsigned int s[4];
+    int c;
+    for (c = 0; c < png->channels; c++)
+      s[c] = png_sample(row, depth, i * png->channels + c);
+
+    switch (png->color_type) {
+    case 0:
+      out[0] = out[1] = out[2] = (unsigned char)(s[0] * 255U / max);
+      out[3] = (png->has_trns && s[0] == png->trns_key[0]) ? 0 : 255;
+      break;
+    case 2:
+      out[0] = (unsigned char)(s[0] * 255U / max);
+      out[1] = (unsigned char)(s[1] * 255U / max);
+      out[2] = (unsigned char)(s[2] * 255U / max);
+      out[3] = (png->has_trns && s[0] == png->trns_key[0] &&
+                s[1] == png->trns_key[1] && s[2] == png->trns_key[2])
+                   ? 0
+                   : 255;
+      break;
+    case 3:
+      memcpy(out, png->palette + (s[0] & 0xFF) * 4, 4);
+      break;
+    case 4:
+      out[0] = out[1] = out[2] = (unsigned char)(s[0] * 255U / max);
+      out[3] = (unsigned char)(s[1] * 255U / max);
+      break;
+    default:
+      out[0] = (unsigned char)(s[0] * 255U / max);
+      out[1] = (unsigned char)(s[1] * 255U / max);
+      out[2] = (unsigned char)(s[2] * 255U / max);
+      out[3] = (unsigned char)(s[3] * 255U / max);
+      break;
+    }
+  }
+}
+
+static int png_finish_row(cmp_png_decoder_t *png) {
+  size_t len = png_row_bytes(png, png->pass_width);
+  unsigned char *swap;
+  int res = CMP_SUCCESS;
+
+  if (png->cur[0] > 4) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  png_unfilter(png, len);
+  png_to_rgba(png, png->cur + 1, png->pass_width);
+
+  if (!png->interlace) {
+    res = cmp_image_decoder_write_rows(png->sink, png->pass_y, 1,
+                                       png->rgba_row,
+                                       (size_t)png->width * 4);
+  } else {
+    const int *p = k_adam7[png->pass];
+    int y = p[1] + png->pass_y * p[3];
+    int fw = p[4] / png->scale > 0 ? p[4] / png->scale : 1;
+    int fh = p[5] / png->scale > 0 ? p[5] / png->scale : 1;
+    int cy = y / png->scale;
+    int i;
+    for (i = 0; i < png->pass_width; i++) {
+      int x = p[0] + i * p[2];
+      int cx = x / png->scale;
+      int bx, by;
+      if (x % png->scale != 0 || y % png->scale != 0)
+        continue;
+      for (by = cy; by < cy + fh && by < png->frame_height; by++) {
+        unsigned char *dst =
+            png->frame + ((size_t)by * png->frame_width + cx) * 4;
+        for (bx = cx; bx < cx + fw && bx < png->frame_width; bx++) {
+          memcpy(dst, png->rgba_row + (size_t)i * 4, 4);
+          dst += 4;
+        }
+      }
+    }
+  }
+
+  swap = png->prev;
+  png->prev = png->cur + 1;
+  png->cur = swap - 1;
+  png->row_fill = 0;
+  png->pass_y++;
+
+  if (res == CMP_SUCCESS && png->pass_y == png->pass_height) {
+    if (png->interlace) {
+      res = cmp_image_decoder_write_rows(png->sink, 0, png->frame_height,
+                                         png->frame,
+                                         (size_t)png->frame_width * 4);
+    }
+    if (res == CMP_SUCCESS && (png->interlace || png->pass == png->last_pass))
+      res = cmp_image_decoder_end_pass(png->sink);
+    png_start_pass(png, png->pass + 1);
+  }
+  return res;
+}
+
+static int png_inflate_cb(void *user_data, const unsigned char *data,
+                          size_t len) {
+  cmp_png_decoder_t *png = (cmp_png_decoder_t *)user_data;
+
+  while (len > 0 && !png->image_done) {
+    size_t need = 1 + png_row_bytes(png, png->pass_width) - png->row_fill;
+    size_t take = len < need ? len : need;
+    memcpy(png->cur + png->row_fill, data, take);
+    png->row_fill += take;
+    data += take;
+    len -= take;
+    if (take == need) {
+      png->error = png_finish_row(png);
+      if (png->error != CMP_SUCCESS)
+        return 1;
+    }
+  }
+  return 0;
+}
+
+static int png_handle_ihdr(cmp_png_decoder_t *png) {
+  const unsigned char *b = png->small;
+  unsigned long w, h;
+  size_t row_alloc;
+  int depth_ok;
+  int res;
+
+  if (png->small_len != 13 || png->seen_ihdr) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  w = png_be32(b);
+  h = png_be32(b + 4);
+  png->bit_depth = b[8];
+  png->color_type = b[9];
+  png->interlace = b[12];
+  if (w == 0 || h == 0 || w > 0x7FFFFFFUL / 8 || h > 0x7FFFFFFUL ||
+      b[10] != 0 || b[11] != 0 || png->interlace > 1) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  switch (png->color_type) {
+  case 0:
+    png->channels = 1;
+    depth_ok = png->bit_depth == 1 || png->bit_depth == 2 ||
+               png->bit_depth == 4 || png->bit_depth == 8 ||
+               png->bit_depth == 16;
+    break;
+  case 3:
+    png->channels = 1;
+    depth_ok = png->bit_depth == 1 || png->bit_depth == 2 ||
+               png->bit_depth == 4 || png->bit_depth == 8;
+    break;
+  case 2:
+    png->channels = 3;
+    depth_ok = png->bit_depth == 8 || png->bit_depth == 16;
+    break;
+  case 4:
+    png->channels = 2;
+    depth_ok = png->bit_depth == 8 || png->bit_depth == 16;
+    break;
+  case 6:
+    png->channels = 4;
+    depth_ok = png->bit_depth == 8 || png->bit_depth == 16;
+    break;
+  default:
+    depth_ok = 0;
+    break;
+  }
+  if (!depth_ok) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  png->width = (int)w;
+  png->height = (int)h;
+  png->pixel_bits = png->channels * png->bit_depth;
+  png->filter_bpp = png->pixel_bits >= 8 ? png->pixel_bits / 8 : 1;
+  png->seen_ihdr = 1;
+
+  res = cmp_image_decoder_begin_frame(png->sink, png->width, png->height,
+                                      png->interlace, png->interlace ? 8 : 1,
+                                      &png->scale);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  png->last_pass = 0;
+  if (png->interlace) {
+    png->last_pass = png->scale == 8 ? 0 : (png->scale == 4 ? 2 :
+                     (png->scale == 2 ? 4 : 6));
+    png->frame_width = (png->width + png->scale - 1) / png->scale;
+    png->frame_height = (png->height + png->scale - 1) / png->scale;
+    if (CMP_MALLOC((size_t)png->frame_width * png->frame_height * 4,
+                   (void **)&png->frame) != CMP_SUCCESS) {
+      return CMP_ERROR_OOM;
+    }
+    memset(png->frame, 0, (size_t)png->frame_width * png->frame_height * 4);
+  }
+
+  /* cur keeps the filter byte in front of the row; prev shares the layout so
+   * the two can be swapped after each row. */
+  row_alloc = 1 + png_row_bytes(png, png->width);
+  if (CMP_MALLOC(row_alloc, (void **)&png->cur) != CMP_SUCCESS ||
+      CMP_MALLOC(row_alloc, (void **)&png->prev) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  png->prev += 1;
+  if (CMP_MALLOC((size_t)png->width * 4, (void **)&png->rgba_row) !=
+      CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+
+  res = cmp_inflate_create(1, png_inflate_cb, png, &png->inf);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  png_start_pass(png, 0);
+  return CMP_SUCCESS;
+}
+
+static int png_handle_small_chunk(cmp_png_decoder_t *png) {
+  size_t i;
+
+  if (memcmp(png->chunk_type, "IHDR", 4) == 0) {
+    return png_handle_ihdr(png);
+  }
+  if (!png->seen_ihdr) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (memcmp(png->chunk_type, "PLTE", 4) == 0) {
+    if (png->small_len % 3 != 0) {
+      return CMP_ERROR_INVALID_ARG;
+    }
+    for (i = 0; i < png->small_len / 3; i++) {
+      png->palette[i * 4 + 0] = png->small[i * 3 + 0];
+      png->palette[i * 4 + 1] = png->small[i * 3 + 1];
+      png->palette[i * 4 + 2] = png->small[i * 3 + 2];
+      png->palette[i * 4 + 3] = 255;
+    }
+  } else if (memcmp(png->chunk_type, "tRNS", 4) == 0) {
+    if (png->color_type == 3) {
+      for (i = 0; i < png->small_len && i < 256; i++)
+        png->palette[i * 4 + 3] = png->small[i];
+    } else if (png->color_type == 0 && png->small_len >= 2) {
+      png->trns_key[0] = ((unsigned int)png->small[0] << 8) | png->small[1];
+      png->has_trns = 1;
+    } else if (png->color_type == 2 && png->small_len >= 6) {
+      for (i = 0; i < 3; i++)
+        png->trns_key[i] =
+            ((unsigned int)png->small[i * 2] << 8) | png->small[i * 2 + 1];
+      png->has_trns = 1;
+    }
+  }
+  return CMP_SUCCESS;
+}
+
+static int png_is_small_chunk(const unsigned char *type) {
+  return memcmp(type, "IHDR", 4) == 0 || memcmp(type, "PLTE", 4) == 0 ||
+         memcmp(type, "tRNS", 4) == 0;
+}
+
+int cmp_png_decoder_create(cmp_image_decoder_t *sink,
+                           cmp_png_decoder_t **out_png) {
+  cmp_png_decoder_t *png;
+
+  if (sink == NULL || out_png == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(cmp_png_decoder_t), (void **)&png) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(png, 0, sizeof(cmp_png_decoder_t));
+  png->sink = sink;
+  png->state = PNG_ST_SIGNATURE;
+  memset(png->palette, 255, sizeof(png->palette));
+
+  *out_png = png;
+  return CMP_SUCCESS;
+}
+
+int cmp_png_decoder_push(cmp_png_decoder_t *png, const unsigned char *data,
+                         size_t len) {
+  static const unsigned char k_sig[8] = {0x89, 'P',  'N',  'G',
+                                         0x0D, 0x0A, 0x1A, 0x0A};
+
+  if (png == NULL || (data == NULL && len > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  while (len > 0 && png->error == CMP_SUCCESS && png->state != PNG_ST_DONE) {
+    size_t take;
+
+    switch (png->state) {
+    case PNG_ST_SIGNATURE:
+    case PNG_ST_CHUNK_HEADER:
+    case PNG_ST_CHUNK_CRC: {
+      size_t want = png->state == PNG_ST_CHUNK_CRC ? 4 : 8;
+      take = want - png->header_len;
+      if (take > len)
+        take = len;
+      memcpy(png->header + png->header_len, data, take);
+      png->header_len += take;
+      data += take;
+      len -= take;
+      if (png->header_len < want)
+        break;
+      png->header_len = 0;
+
+      if (png->state == PNG_ST_SIGNATURE) {
+        if (memcmp(png->header, k_sig, 8) != 0) {
+          png->error = CMP_ERROR_INVALID_ARG;
+          break;
+        }
+        png->state = PNG_ST_CHUNK_HEADER;
+      } else if (png->state == PNG_ST_CHUNK_CRC) {
+        if (png->seen_iend) {
+          png->state = PNG_ST_DONE;
+        } else {
+          png->state = PNG_ST_CHUNK_HEADER;
+        }
+      } else {
+        png->chunk_left = png_be32(png->header);
+        memcpy(png->chunk_type, png->header + 4, 4);
+        png->small_len = 0;
+        if (png->chunk_left > 0x7FFFFFFFUL ||
+            (png_is_small_chunk(png->chunk_type) &&
+             png->chunk_left > PNG_SMALL_CHUNK) ||
+            (!png->seen_ihdr && memcmp(png->chunk_type, "IHDR", 4) != 0)) {
+          png->error = CMP_ERROR_INVALID_ARG;
+          break;
+        }
+        if (memcmp(png->chunk_type, "IEND", 4) == 0) {
+          png->seen_iend = 1;
+        }
+        png->state = PNG_ST_CHUNK_DATA;
+        if (png->chunk_left == 0 && png_is_small_chunk(png->chunk_type)) {
+          png->error = png_handle_small_chunk(png);
+          png->state = PNG_ST_CHUNK_CRC;
+        } else if (png->chunk_left == 0) {
+          png->state = PNG_ST_CHUNK_CRC;
+        }
+      }
+      break;
+    }
+
+    case PNG_ST_CHUNK_DATA:
+      take = png->chunk_left < len ? (size_t)png->chunk_left : len;
+      if (png_is_small_chunk(png->chunk_type)) {
+        memcpy(png->small + png->small_len, data, take);
+        png->small_len += take;
+      } else if (memcmp(png->chunk_type, "IDAT", 4) == 0 &&
+                 !png->image_done) {
+        int res = cmp_inflate_push(png->inf, data, take);
+        if (png->error == CMP_SUCCESS && res != CMP_SUCCESS)
+          png->error = res;
+      }
+      png->chunk_left -= take;
+      data += take;
+      len -= take;
+      if (png->chunk_left == 0) {
+        if (png_is_small_chunk(png->chunk_type))
+          png->error = png_handle_small_chunk(png);
+        png->state = PNG_ST_CHUNK_CRC;
+      }
+      break;
+
+    case PNG_ST_DONE:
+      break;
+    }
+  }
+  return png->error;
+}
+
+int cmp_png_decoder_finish(cmp_png_decoder_t *png) {
+  if (png == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (png->error != CMP_SUCCESS) {
+    return png->error;
+  }
+  if (png->inf == NULL) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+  if (!png->image_done) {
+    /* Flush the tail the inflater holds back while waiting for input. */
+    int res = cmp_inflate_finish(png->inf);
+    if (png->error == CMP_SUCCESS && res != CMP_SUCCESS && !png->image_done)
+      png->error = res;
+  }
+  if (png->error == CMP_SUCCESS && !png->image_done) {
+    png->error = CMP_ERROR_INVALID_STATE;
+  }
+  return png->error;
+}
+
+int cmp_png_decoder_destroy(cmp_png_decoder_t *png) {
+  if (png == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (png->inf != NULL) {
+    cmp_inflate_destroy(png->inf);
+  }
+  if (png->cur != NULL) {
+    CMP_FREE(png->cur);
+  }
+  if (png->prev != NULL) {
+    CMP_FREE(png->prev - 1);
+  }
+  if (png->rgba_row != NULL) {
+    CMP_FREE(png->rgba_row);
+  }
+  if (png->frame != NULL) {
+    CMP_FREE(png->frame);
+  }
+  CMP_FREE(png);
+  return CMP_SUCCESS;
+}
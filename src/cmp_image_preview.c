@@ -1,6 +1,7 @@
 /* clang-format off */
 #include "cmp.h"
 #include <stdlib.h>
+#include <string.h>
 /* clang-format on */
 
 struct cmp_image_preview {
@@ -31,36 +32,132 @@ int cmp_image_preview_destroy(cmp_image_preview_t *preview) {
   return CMP_SUCCESS;
 }
 
+static int preview_base64_value(int c) {
+  if (c >= 'A' && c <= 'Z')
+    return c - 'A';
+  if (c >= 'a' && c <= 'z')
+    return c - 'a' + 26;
+  if (c >= '0' && c <= '9')
+    return c - '0' + 52;
+  if (c == '+' || c == '-')
+    return 62;
+  if (c == '/' || c == '_')
+    return 63;
+  return -1;
+}
+
+/* Decodes standard or URL-safe base64, skipping whitespace and padding. */
+static int preview_base64_decode(const char *text, unsigned char **out_data,
+                                 size_t *out_len) {
+  size_t text_len = strlen(text);
+  unsigned char *data;
+  unsigned long acc = 0;
+  int bits = 0;
+  size_t len = 0;
+  size_t i;
+
+  data = (unsigned char *)malloc(text_len / 4 * 3 + 3);
+  if (!data) {
+    return CMP_ERROR_OOM;
+  }
+  for (i = 0; i < text_len; i++) {
+    int c = (unsigned char)text[i];
+    int v;
+    if (c == '=' || c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+      continue;
+    }
+    v = preview_base64_value(c);
+    if (v < 0) {
+      free(data);
+      return CMP_ERROR_INVALID_ARG;
+    }
+    acc = (acc << 6) | (unsigned long)v;
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      data[len++] = (unsigned char)((acc >> bits) & 0xFF);
+    }
+  }
+
+  *out_data = data;
+  *out_len = len;
+  return CMP_SUCCESS;
+}
+
+static int preview_header_cb(void *user_data, const cmp_image_info_t *info,
+                             unsigned char **io_pixels, size_t *io_stride) {
+  unsigned char **out_pixels = (unsigned char **)user_data;
+
+  /* Allocate with malloc so cmp_image_preview_free_pixels can release it. */
+  *io_stride = (size_t)info->width * 4;
+  *io_pixels = (unsigned char *)malloc(*io_stride * (size_t)info->height);
+  if (!*io_pixels) {
+    return 1;
+  }
+  memset(*io_pixels, 0, *io_stride * (size_t)info->height);
+  *out_pixels = *io_pixels;
+  return 0;
+}
+
 int cmp_image_preview_load_base64(cmp_image_preview_t *preview,
                                   const char *base64_data,
                                   unsigned char **out_raw_pixels,
                                   int *out_width, int *out_height) {
-  unsigned char *pixels;
+  const char *comma;
+  unsigned char *encoded = NULL;
+  size_t encoded_len = 0;
+  unsigned char *pixels = NULL;
+  cmp_image_decoder_t *dec = NULL;
+  cmp_image_info_t info;
+  int res;
 
   if (!preview || !base64_data || !out_raw_pixels || !out_width ||
       !out_height) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  /* Stub: Decode base64 to RGBA logic. For now, generate a tiny red 4x4 square
-   */
-  *out_width = 4;
-  *out_height = 4;
-  pixels = (unsigned char *)malloc(16 * 4); /* 16 pixels * 4 bytes/pixel */
-  if (!pixels) {
-    return CMP_ERROR_OOM;
+  /* Accept both bare payloads and data: URIs. */
+  if (strncmp(base64_data, "data:", 5) == 0) {
+    comma = strchr(base64_data, ',');
+    if (!comma) {
+      return CMP_ERROR_INVALID_ARG;
+    }
+    base64_data = comma + 1;
+  }
+
+  res = preview_base64_decode(base64_data, &encoded, &encoded_len);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+
+  res = cmp_image_decoder_create(0, 0, &dec);
+  if (res == CMP_SUCCESS) {
+    res = cmp_image_decoder_set_callbacks(dec, preview_header_cb, NULL,
+                                          &pixels);
+  }
+  if (res == CMP_SUCCESS) {
+    res = cmp_image_decoder_push(dec, encoded, encoded_len);
+  }
+  if (res == CMP_SUCCESS) {
+    res = cmp_image_decoder_finish(dec);
+  }
+  if (res == CMP_SUCCESS) {
+    res = cmp_image_decoder_get_info(dec, &info);
+  }
+  if (dec) {
+    cmp_image_decoder_destroy(dec);
   }
+  free(encoded);
 
-  {
-    int i;
-    for (i = 0; i < 16; i++) {
-      pixels[i * 4 + 0] = 255; /* R */
-      pixels[i * 4 + 1] = 0;   /* G */
-      pixels[i * 4 + 2] = 0;   /* B */
-      pixels[i * 4 + 3] = 255; /* A */
+  if (res != CMP_SUCCESS) {
+    if (pixels) {
+      free(pixels);
     }
+    return res;
   }
 
+  *out_width = info.width;
+  *out_height = info.height;
   *out_raw_pixels = pixels;
   return CMP_SUCCESS;
 }
@@ -0,0 +1,883 @@
+/* clang-format off */
+#include "cmp.h"
+#include <string.h>
+/* clang-format on */
+
+/* WebP lossless (VP8L) decoder.
+ * The RIFF container is parsed as it streams in and non-image chunks are
+ * skipped without buffering. VP8L backward references and transforms may
+ * reach anywhere earlier in the image, so the VP8L chunk is collected and
+ * decoded once it is complete; rows are then streamed to the sink, which
+ * downsamples them to the requested size. Lossy VP8 is not supported. */
+
+#define VP8L_MAX_BITS 15
+#define VP8L_FAST_BITS 8
+#define VP8L_NUM_LENGTH_CODES 24
+#define VP8L_NUM_DISTANCE_CODES 40
+#define VP8L_CODE_LENGTH_CODES 19
+
+typedef enum {
+  WEBP_ST_RIFF = 0,
+  WEBP_ST_CHUNK_HEADER,
+  WEBP_ST_SKIP,
+  WEBP_ST_VP8L,
+  WEBP_ST_DONE
+} webp_state_t;
+
+typedef struct vp8l_huffman {
+  int single; /* Symbol of a zero-length code, or -1. */
+  unsigned short fast[1 << VP8L_FAST_BITS];
+  unsigned short count[VP8L_MAX_BITS + 1];
+  unsigned short *symbol;
+} vp8l_huffman_t;
+
+typedef struct vp8l_group {
+  vp8l_huffman_t codes[5]; /* green, red, blue, alpha, distance */
+} vp8l_group_t;
+
+typedef struct vp8l_transform {
+  int type;
+  int bits;
+  int xsize;
+  uint32_t *data;
+} vp8l_transform_t;
+
+typedef struct vp8l_reader {
+  const unsigned char *data;
+  size_t len;
+  size_t pos;
+  unsigned long bitbuf;
+  int bitcnt;
+  int eos;
+} vp8l_reader_t;
+
+struct cmp_webp_decoder {
+  cmp_image_decoder_t *sink;
+  webp_state_t state;
+  unsigned char header[12];
+  size_t header_len;
+  unsigned long chunk_left;
+  int chunk_pad;
+  unsigned char *vp8l;
+  size_t vp8l_len;
+  size_t vp8l_size;
+  int error;
+};
+
+static const unsigned char k_code_length_order[VP8L_CODE_LENGTH_CODES] = {
+    17, 18, 0, 1, 2, 3, 4, 5, 16, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+/* (dx, dy) pairs for the 120 short distance codes. */
+static const signed char k_distance_map[120][2] = {
+    {0, 1},  {1, 0},  {1, 1},  {-1, 1}, {0, 2},  {2, 0},  {1, 2},  {-1, 2},
+    {2, 1},  {-2, 1}, {2, 2},  {-2, 2}, {0, 3},  {3, 0},  {1, 3},  {-1, 3},
+    {3, 1},  {-3, 1}, {2, 3},  {-2, 3}, {3, 2},  {-3, 2}, {0, 4},  {4, 0},
+    {1, 4},  {-1, 4}, {4, 1},  {-4, 1}, {3, 3},  {-3, 3}, {2, 4},  {-2, 4},
+    {4, 2},  {-4, 2}, {0, 5},  {3, 4},  {-3, 4}, {4, 3},  {-4, 3}, {5, 0},
+    {1, 5},  {-1, 5}, {5, 1},  {-5, 1}, {2, 5},  {-2, 5}, {5, 2},  {-5, 2},
+    {4, 4},  {-4, 4}, {3, 5},  {-3, 5}, {5, 3},  {-5, 3}, {0, 6},  {6, 0},
+    {1, 6},  {-1, 6}, {6, 1},  {-6, 1}, {2, 6},  {-2, 6}, {6, 2},  {-6, 2},
+    {4, 5},  {-4, 5}, {5, 4},  {-5, 4}, {3, 6},  {-3, 6}, {6, 3},  {-6, 3},
+    {0, 7},  {7, 0},  {1, 7},  {-1, 7}, {5, 5},  {-5, 5}, {7, 1},  {-7, 1},
+    {4, 6},  {-4, 6}, {6, 4},  {-6, 4}, {2, 7},  {-2, 7}, {7, 2},  {-7, 2},
+    {3, 7},  {-3, 7}, {7, 3},  {-7, 3}, {5, 6},  {-5, 6}, {6, 5},  {-6, 5},
+    {8, 0},  {4, 7},  {-4, 7}, {7, 4},  {-7, 4}, {8, 1},  {8, 2},  {6, 6},
+    {-6, 6}, {8, 3},  {5, 7},  {-5, 7}, {7, 5},  {-7, 5}, {8, 4},  {6, 7},
+    {-6, 7}, {7, 6},  {-7, 6}, {8, 5},  {7, 7},  {-7, 7}, {8, 6},  {8, 7}};
+
+/* ---- Bit reader (LSB first) ---- */
+
+static unsigned int vp8l_bits(vp8l_reader_t *br, int n) {
+  unsigned int v;
+  if (n == 0)
+    return 0;
+  while (br->bitcnt < n) {
+    unsigned long b = 0;
+    if (br->pos < br->len)
+      b = br->data[br->pos++];
+    else
+      br->eos = 1;
+    br->bitbuf |= b << br->bitcnt;
+    br->bitcnt += 8;
+  }
+  v = (unsigned int)(br->bitbuf & ((1UL << n) - 1UL));
+  br->bitbuf >>= n;
+  br->bitcnt -= n;
+  return v;
+}
+
+/* ---- Prefix codes ---- */
+
+static void vp8l_free_huffman(vp8l_huffman_t *h) {
+  if (h->symbol != NULL) {
+    CMP_FREE(h->symbol);
+    h->symbol = NULL;
+  }
+}
+
+static int vp8l_build_huffman(vp8l_huffman_t *h, const unsigned char *lengths,
+                              int n) {
+  unsigned short offs[VP8L_MAX_BITS + 1];
+  int len, sym, left, nonzero = 0, last = 0;
+  unsigned int code;
+
+  memset(h->count, 0, sizeof(h->count));
+  memset(h->fast, 0, sizeof(h->fast));
+  h->single = -1;
+  for (sym = 0; sym < n; sym++) {
+    h->count[lengths[sym]]++;
+    if (lengths[sym] != 0) {
+      nonzero++;
+      last = sym;
+    }
+  }
+  if (nonzero == 0)
+    return -1;
+  if (nonzero == 1) {
+    h->single = last;
+    return 0;
+  }
+
+  left = 1;
+  for (len = 1; len <= VP8L_MAX_BITS; len++) {
+    left <<= 1;
+    left -= h->count[len];
+    if (left < 0)
+      return -1;
+  }
+  if (left != 0)
+    return -1; /* VP8L codes must be complete. */
+
+  if (CMP_MALLOC((size_t)n * sizeof(unsigned short), (void **)&h->symbol) !=
+      CMP_SUCCESS)
+    return -1;
+  offs[1] = 0;
+  for (len = 1; len < VP8L_MAX_BITS; len++)
+    offs[len + 1] = (unsigned short)(offs[len] + h->count[len]);
+  for (sym = 0; sym < n; sym++) {
+    if (lengths[sym] != 0)
+      h->symbol[offs[lengths[sym]]++] = (unsigned short)sym;
+  }
+
+  code = 0;
+  for (len = 1; len <= VP8L_FAST_BITS; len++) {
+    int first = 0, i;
+    for (i = 1; i < len; i++)
+      first += h->count[i];
+    for (i = 0; i < h->count[len]; i++) {
+      unsigned int rev = 0, c = code + (unsigned int)i, fill;
+      int b;
+      for (b = 0; b < len; b++)
+        rev |= ((c >> b) & 1U) << (len - 1 - b);
+      for (fill = rev; fill < (1U << VP8L_FAST_BITS); fill += 1U << len)
+        h->fast[fill] =
+            (unsigned short)((h->symbol[first + i] << 4) | (unsigned)len);
+    }
+    code = (code + h->count[len]) << 1;
+  }
+  return 0;
+}
+
+static int vp8l_decode(vp8l_reader_t *br, const vp8l_huffman_t *h) {
+  int code = 0, first = 0, index = 0, len;
+
+  if (h->single >= 0)
+    return h->single;
+  while (br->bitcnt < VP8L_FAST_BITS && br->pos < br->len) {
+    br->bitbuf |= (unsigned long)br->data[br->pos++] << br->bitcnt;
+    br->bitcnt += 8;
+  }
+  if (br->bitcnt >= VP8L_FAST_BITS) {
+    unsigned short e =
+        h->fast[br->bitbuf & ((1UL << VP8L_FAST_BITS) - 1UL)];
+    if (e != 0) {
+      br->bitbuf >>= (e & 15);
+      br->bitcnt -= (e & 15);
+      return e >> 4;
+    }
+  }
+  for (len = 1; len <= VP8L_MAX_BITS; len++) {
+    int count = h->count[len];
+    code |= (int)vp8l_bits(br, 1);
+    if (code - count < first)
+      return h->symbol[index + (code - first)];
+    index += count;
+    first += count;
+    first <<= 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+static int vp8l_read_code(vp8l_reader_t *br, int alphabet,
+                          vp8l_huffman_t *out) {
+  unsigned char *lengths;
+  int res = -1;
+
+  if (CMP_MALLOC((size_t)alphabet, (void **)&lengths) != CMP_SUCCESS)
+    return -1;
+  memset(lengths, 0, (size_t)alphabet);
+
+  if (vp8l_bits(br, 1)) {
+    int num_symbols = (int)vp8l_bits(br, 1) + 1;
+    int first_is_8bits = (int)vp8l_bits(br, 1);
+    int s0 = (int)vp8l_bits(br, first_is_8bits ? 8 : 1);
+    if (s0 < alphabet) {
+      lengths[s0] = 1;
+      res = 0;
+      if (num_symbols == 2) {
+        int s1 = (int)vp8l_bits(br, 8);
+        if (s1 < alphabet && s1 != s0)
+          lengths[s1] = 1;
+        else
+          res = -1;
+      }
+    }
+  } else {
+    unsigned char clc_lengths[VP8L_CODE_LENGTH_CODES];
+    vp8l_huffman_t clc;
+    int num_codes = (int)vp8l_bits(br, 4) + 4;
+    int max_symbol = alphabet;
+    int prev = 8, sym = 0, i;
+
+    memset(clc_lengths, 0, sizeof(clc_lengths));
+    memset(&clc, 0, sizeof(clc));
+    for (i = 0; i < num_codes; i++)
+      clc_lengths[k_code_length_order[i]] = (unsigned char)vp8l_bits(br, 3);
+    if (vp8l_build_huffman(&clc, clc_lengths, VP8L_CODE_LENGTH_CODES) == 0) {
+      res = 0;
+      if (vp8l_bits(br, 1)) {
+        int nbits = 2 + 2 * (int)vp8l_bits(br, 3);
+        max_symbol = 2 + (int)vp8l_bits(br, nbits);
+        if (max_symbol > alphabet)
+          res = -1;
+      }
+      while (res == 0 && sym < alphabet && max_symbol-- > 0) {
+        int c = vp8l_decode(br, &clc);
+        if (c < 0) {
+          res = -1;
+        } else if (c < 16) {
+          lengths[sym++] = (unsigned char)c;
+          if (c != 0)
+            prev = c;
+        } else {
+          int repeat, value = 0;
+          if (c == 16) {
+            repeat = 3 + (int)vp8l_bits(br, 2);
+            value = prev;
+          } else if (c == 17) {
+            repeat = 3 + (int)vp8l_bits(br, 3);
+          } else {
+            repeat = 11 + (int)vp8l_bits(br, 7);
+          }
+          if (sym + repeat > alphabet) {
+            res = -1;
+          } else {
+            while (repeat-- > 0)
+              lengths[sym++] = (unsigned char)value;
+          }
+        }
+      }
+    }
+    vp8l_free_huffman(&clc);
+  }
+
+  if (res == 0 && !br->eos)
+    res = vp8l_build_huffman(out, lengths, alphabet);
+  else
+    res = -1;
+  CMP_FREE(lengths);
+  return res;
+}
+
+/* ---- Entropy-coded images ---- */
+
+static int vp8l_prefix_value(vp8l_reader_t *br, int code) {
+  int extra;
+  if (code < 4)
+    return code + 1;
+  extra = (code - 2) >> 1;
+  return ((2 + (code & 1)) << extra) + (int)vp8l_bits(br, extra) + 1;
+}
+
+static void vp8l_free_groups(vp8l_group_t *groups, int count) {
+  int i, k;
+  if (groups == NULL)
+    return;
+  for (i = 0; i < count; i++)
+    for (k = 0; k < 5; k++)
+      vp8l_free_huffman(&groups[i].codes[k]);
+  CMP_FREE(groups);
+}
+
+static int vp8l_decode_image(vp8l_reader_t *br, int xsize, int ysize,
+                             int is_main, uint32_t **out);
+
+static int vp8l_decode_pixels(vp8l_reader_t *br, int xsize, int ysize,
+                              const vp8l_group_t *groups,
+                              const uint32_t *meta, int meta_bits,
+                              int cache_bits, uint32_t *out) {
+  uint32_t cache[1 << 11];
+  size_t total = (size_t)xsize * ysize;
+  size_t pos = 0;
+  size_t last_cached = 0;
+  int meta_width = meta_bits ? (xsize + (1 << meta_bits) - 1) >> meta_bits : 0;
+  int x = 0, y = 0;
+
+  if (cache_bits > 0)
+    memset(cache, 0, sizeof(uint32_t) * ((size_t)1 << cache_bits));
+
+  while (pos < total) {
+    const vp8l_group_t *g = groups;
+    int sym;
+
+    if (meta != NULL) {
+      uint32_t m = meta[(y >> meta_bits) * meta_width + (x >> meta_bits)];
+      g = &groups[(m >> 8) & 0xFFFF];
+    }
+    sym = vp8l_decode(br, &g->codes[0]);
+    if (sym < 0 || br->eos)
+      return CMP_ERROR_INVALID_ARG;
+
+    if (sym < 256) {
+      int r = vp8l_decode(br, &g->codes[1]);
+      int b = vp8l_decode(br, &g->codes[2]);
+      int a = vp8l_decode(br, &g->codes[3]);
+      if (r < 0 || b < 0 || a < 0)
+        return CMP_ERROR_INVALID_ARG;
+      out[pos++] = ((uint32_t)a << 24) | ((uint32_t)r << 16) |
+                   ((uint32_t)sym << 8) | (uint32_t)b;
+      if (++x == xsize) {
+        x = 0;
+        y++;
+      }
+    } else if (sym < 256 + VP8L_NUM_LENGTH_CODES) {
+      int length = vp8l_prefix_value(br, sym - 256);
+      int dsym = vp8l_decode(br, &g->codes[4]);
+      long dist;
+      int i;
+      if (dsym < 0)
+        return CMP_ERROR_INVALID_ARG;
+      dist = vp8l_prefix_value(br, dsym);
+      if (dist > 120) {
+        dist -= 120;
+      } else {
+        dist = k_distance_map[dist - 1][0] +
+               (long)k_distance_map[dist - 1][1] * xsize;
+        if (dist < 1)
+          dist = 1;
+      }
+      if ((size_t)dist > pos || pos + (size_t)length > total)
+        return CMP_ERROR_INVALID_ARG;
+      for (i = 0; i < length; i++, pos++)
+        out[pos] = out[pos - (size_t)dist];
+      x += length;
+      while (x >= xsize) {
+        x -= xsize;
+        y++;
+      }
+    } else {
+      int index = sym - 256 - VP8L_NUM_LENGTH_CODES;
+      if (cache_bits == 0 || index >= (1 << cache_bits))
+        return CMP_ERROR_INVALID_ARG;
+      out[pos++] = cache[index];
+      if (++x == xsize) {
+        x = 0;
+        y++;
+      }
+    }
+    /* Keep the colour cache current with every emitted pixel. */
+    if (cache_bits > 0) {
+      while (last_cached < pos) {
+        uint32_t c = out[last_cached++];
+        cache[(0x1E35A7BDUL * c & 0xFFFFFFFFUL) >> (32 - cache_bits)] = c;
+      }
+    }
+  }
+  return br->eos ? CMP_ERROR_INVALID_ARG : CMP_SUCCESS;
+}
+
+static int vp8l_decode_image(vp8l_reader_t *br, int xsize, int ysize,
+                             int is_main, uint32_t **out) {
+  vp8l_group_t *groups = NULL;
+  uint32_t *meta = NULL;
+  uint32_t *pixels = NULL;
+  int cache_bits = 0, meta_bits = 0, num_groups = 1;
+  int i, k, res;
+
+  if (vp8l_bits(br, 1)) {
+    cache_bits = (int)vp8l_bits(br, 4);
+    if (cache_bits < 1 || cache_bits > 11)
+      return CMP_ERROR_INVALID_ARG;
+  }
+  if (is_main && vp8l_bits(br, 1)) {
+    int mw, mh;
+    meta_bits = (int)vp8l_bits(br, 3) + 2;
+    mw = (xsize + (1 << meta_bits) - 1) >> meta_bits;
+    mh = (ysize + (1 << meta_bits) - 1) >> meta_bits;
+    res = vp8l_decode_image(br, mw, mh, 0, &meta);
+    if (res != CMP_SUCCESS)
+      return res;
+    for (i = 0; i < mw * mh; i++) {
+      int g = (int)((meta[i] >> 8) & 0xFFFF);
+      if (g + 1 > num_groups)
+        num_groups = g + 1;
+    }
+  }
+
+  res = CMP_SUCCESS;
+  if (CMP_MALLOC((size_t)num_groups * sizeof(vp8l_group_t),
+                 (void **)&groups) != CMP_SUCCESS) {
+    res = CMP_ERROR_OOM;
+  } else {
+    memset(groups, 0, (size_t)num_groups * sizeof(vp8l_group_t));
+    for (i = 0; i < num_groups && res == CMP_SUCCESS; i++) {
+      for (k = 0; k < 5 && res == CMP_SUCCESS; k++) {
+        int alphabet = 256;
+        if (k == 0)
+          alphabet = 256 + VP8L_NUM_LENGTH_CODES +
+                     (cache_bits > 0 ? 1 << cache_bits : 0);
+        else if (k == 4)
+          alphabet = VP8L_NUM_DISTANCE_CODES;
+        if (vp8l_read_code(br, alphabet, &groups[i].codes[k]) != 0)
+          res = CMP_ERROR_INVALID_ARG;
+      }
+    }
+  }
+  if (res == CMP_SUCCESS &&
+      CMP_MALLOC((size_t)xsize * ysize * sizeof(uint32_t),
+                 (void **)&pixels) != CMP_SUCCESS) {
+    res = CMP_ERROR_OOM;
+  }
+  if (res == CMP_SUCCESS) {
+    res = vp8l_decode_pixels(br, xsize, ysize, groups, meta, meta_bits,
+                             cache_bits, pixels);
+  }
+
+  vp8l_free_groups(groups, num_groups);
+  if (meta != NULL)
+    CMP_FREE(meta);
+  if (res != CMP_SUCCESS) {
+    if (pixels != NULL)
+      CMP_FREE(pixels);
+    return res;
+  }
+  *out = pixels;
+  return CMP_SUCCESS;
+}
+
+/* ---- Inverse transforms ---- */
+
+static uint32_t vp8l_add(uint32_t a, uint32_t b) {
+  return (((a & 0xFF00FF00UL) + (b & 0xFF00FF00UL)) & 0xFF00FF00UL) |
+         (((a & 0x00FF00FFUL) + (b & 0x00FF00FFUL)) & 0x00FF00FFUL);
+}
+
+static uint32_t vp8l_avg(uint32_t a, uint32_t b) {
+  return (((a ^ b) & 0xFEFEFEFEUL) >> 1) + (a & b);
+}
+
+static int vp8l_clamp(int v) { return v < 0 ? 0 : (v > 255 ? 255 : v); }
+
+static int vp8l_abs(int v) { return v < 0 ? -v : v; }
+
+static uint32_t vp8l_select(uint32_t l, uint32_t t, uint32_t tl) {
+  int pl = 0, pt = 0, shift;
+  for (shift = 0; shift < 32; shift += 8) {
+    int cl = (int)((l >> shift) & 0xFF);
+    int ct = (int)((t >> shift) & 0xFF);
+    int ctl = (int)((tl >> shift) & 0xFF);
+    int p = cl + ct - ctl;
+    pl += vp8l_abs(p - cl);
+    pt += vp8l_abs(p - ct);
+  }
+  return pl < pt ? l : t;
+}
+
+static uint32_t vp8l_clamp_full(uint32_t a, uint32_t b, uint32_t c) {
+  uint32_t out = 0;
+  int shift;
+  for (shift = 0; shift < 32; shift += 8) {
+    int v = (int)((a >> shift) & 0xFF) + (int)((b >> shift) & 0xFF) -
+            (int)((c >> shift) & 0xFF);
+    out |= (uint32_t)vp8l_clamp(v) << shift;
+  }
+  return out;
+}
+
+static uint32_t vp8l_clamp_half(uint32_t a, uint32_t b) {
+  uint32_t out = 0;
+  int shift;
+  for (shift = 0; shift < 32; shift += 8) {
+    int ca = (int)((a >> shift) & 0xFF);
+    int cb = (int)((b >> shift) & 0xFF);
+    out |= (uint32_t)vp8l_clamp(ca + (ca - cb) / 2) << shift;
+  }
+  return out;
+}
+
+static uint32_t vp8l_predict(int mode, const uint32_t *cur, int w) {
+  uint32_t l = cur[-1], t = cur[-w], tr = cur[-w + 1], tl = cur[-w - 1];
+  switch (mode) {
+  case 0:
+    return 0xFF000000UL;
+  case 1:
+    return l;
+  case 2:
+    return t;
+  case 3:
+    return tr;
+  case 4:
+    return tl;
+  case 5:
+    return vp8l_avg(vp8l_avg(l, tr), t);
+  case 6:
+    return vp8l_avg(l, tl);
+  case 7:
+    return vp8l_avg(l, t);
+  case 8:
+    return vp8l_avg(tl, t);
+  case 9:
+    return vp8l_avg(t, tr);
+  case 10:
+    return vp8l_avg(vp8l_avg(l, tl), vp8l_avg(t, tr));
+  case 11:
+    return vp8l_select(l, t, tl);
+  case 12:
+    return vp8l_clamp_full(l, t, tl);
+  default:
+    return vp8l_clamp_half(vp8l_avg(l, t), tl);
+  }
+}
+
+static void vp8l_inverse_predictor(const vp8l_transform_t *t, uint32_t *px,
+                                   int w, int h) {
+  int tw = (w + (1 << t->bits) - 1) >> t->bits;
+  int x, y;
+
+  px[0] = vp8l_add(px[0], 0xFF000000UL);
+  for (x = 1; x < w; x++)
+    px[x] = vp8l_add(px[x], px[x - 1]);
+  for (y = 1; y < h; y++) {
+    uint32_t *row = px + (size_t)y * w;
+    const uint32_t *modes = t->data + (size_t)(y >> t->bits) * tw;
+    row[0] = vp8l_add(row[0], row[-w]);
+    for (x = 1; x < w; x++) {
+      int mode = (int)((modes[x >> t->bits] >> 8) & 0x0F);
+      row[x] = vp8l_add(row[x], vp8l_predict(mode, row + x, w));
+    }
+  }
+}
+
+static int vp8l_delta(uint32_t t, uint32_t c) {
+  int st = (int)(t & 0xFF), sc = (int)(c & 0xFF);
+  int p;
+  if (st >= 128)
+    st -= 256;
+  if (sc >= 128)
+    sc -= 256;
+  p = st * sc;
+  return p >= 0 ? p >> 5 : -((-p + 31) >> 5);
+}
+
+static void vp8l_inverse_color(const vp8l_transform_t *t, uint32_t *px, int w,
+                               int h) {
+  int tw = (w + (1 << t->bits) - 1) >> t->bits;
+  int x, y;
+
+  for (y = 0; y < h; y++) {
+    uint32_t *row = px + (size_t)y * w;
+    const uint32_t *elems = t->data + (size_t)(y >> t->bits) * tw;
+    for (x = 0; x < w; x++) {
+      uint32_t e = elems[x >> t->bits];
+      uint32_t argb = row[x];
+      uint32_t green = (argb >> 8) & 0xFF;
+      int red = (int)((argb >> 16) & 0xFF);
+      int blue = (int)(argb & 0xFF);
+      red = (red + vp8l_delta(e, green)) & 0xFF;              /* g2r */
+      blue = (blue + vp8l_delta(e >> 8, green)) & 0xFF;       /* g2b */
+      blue = (blue + vp8l_delta(e >> 16, (uint32_t)red)) & 0xFF; /* r2b */
+      row[x] = (argb & 0xFF00FF00UL) | ((uint32_t)red << 16) | (uint32_t)blue;
+    }
+  }
+}
+
+static void vp8l_inverse_subtract_green(uint32_t *px, size_t count) {
+  size_t i;
+  for (i = 0; i < count; i++) {
+    uint32_t g = (px[i] >> 8) & 0xFF;
+    px[i] = vp8l_add(px[i], (g << 16) | g);
+  }
+}
+
+static int vp8l_inverse_index(const vp8l_transform_t *t, uint32_t **io_px,
+                              int packed_w, int h) {
+  int w = t->xsize;
+  int per_pixel = 8 >> t->bits;
+  unsigned int mask = (1U << per_pixel) - 1U;
+  uint32_t *src = *io_px;
+  uint32_t *dst;
+  int x, y;
+
+  if (CMP_MALLOC((size_t)w * h * sizeof(uint32_t), (void **)&dst) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  for (y = 0; y < h; y++) {
+    const uint32_t *srow = src + (size_t)y * packed_w;
+    uint32_t *drow = dst + (size_t)y * w;
+    for (x = 0; x < w; x++) {
+      uint32_t packed = (srow[x >> t->bits] >> 8) & 0xFF;
+      unsigned int idx = (unsigned int)(packed >> ((x & ((1 << t->bits) - 1)) *
+                                                   per_pixel)) & mask;
+      drow[x] = t->data[idx];
+    }
+  }
+  CMP_FREE(src);
+  *io_px = dst;
+  return CMP_SUCCESS;
+}
+
+static int vp8l_decode_all(cmp_webp_decoder_t *webp) {
+  vp8l_reader_t br;
+  vp8l_transform_t transforms[4];
+  int num_transforms = 0;
+  int seen = 0;
+  int width, height, xsize, scale, res, i, y;
+  uint32_t *px = NULL;
+  unsigned char *row = NULL;
+
+  memset(&br, 0, sizeof(br));
+  memset(transforms, 0, sizeof(transforms));
+  br.data = webp->vp8l;
+  br.len = webp->vp8l_len;
+
+  if (vp8l_bits(&br, 8) != 0x2F)
+    return CMP_ERROR_INVALID_ARG;
+  width = (int)vp8l_bits(&br, 14) + 1;
+  height = (int)vp8l_bits(&br, 14) + 1;
+  vp8l_bits(&br, 1); /* alpha_is_used: a hint only. */
+  if (vp8l_bits(&br, 3) != 0)
+    return CMP_ERROR_INVALID_ARG;
+
+  res = cmp_image_decoder_begin_frame(webp->sink, width, height, 0, 1, &scale);
+  if (res != CMP_SUCCESS)
+    return res;
+
+  xsize = width;
+  while (res == CMP_SUCCESS && vp8l_bits(&br, 1)) {
+    vp8l_transform_t *t = &transforms[num_transforms];
+    t->type = (int)vp8l_bits(&br, 2);
+    t->xsize = xsize;
+    if (seen & (1 << t->type)) {
+      res = CMP_ERROR_INVALID_ARG;
+      break;
+    }
+    seen |= 1 << t->type;
+    num_transforms++;
+    if (t->type == 0 || t->type == 1) {
+      t->bits = (int)vp8l_bits(&br, 3) + 2;
+      res = vp8l_decode_image(&br, (xsize + (1 << t->bits) - 1) >> t->bits,
+                              (height + (1 << t->bits) - 1) >> t->bits, 0,
+                              &t->data);
+    } else if (t->type == 3) {
+      int size = (int)vp8l_bits(&br, 8) + 1;
+      uint32_t *table = NULL;
+      t->bits = size > 16 ? 0 : (size > 4 ? 1 : (size > 2 ? 2 : 3));
+      res = vp8l_decode_image(&br, size, 1, 0, &table);
+      if (res == CMP_SUCCESS &&
+          CMP_MALLOC(256 * sizeof(uint32_t), (void **)&t->data) !=
+              CMP_SUCCESS) {
+        res = CMP_ERROR_OOM;
+      }
+      if (res == CMP_SUCCESS) {
+        memset(t->data, 0, 256 * sizeof(uint32_t));
+        t->data[0] = table[0];
+        for (i = 1; i < size; i++)
+          t->data[i] = vp8l_add(table[i], t->data[i - 1]);
+      }
+      if (table != NULL)
+        CMP_FREE(table);
+      xsize = (xsize + (1 << t->bits) - 1) >> t->bits;
+    }
+  }
+
+  if (res == CMP_SUCCESS)
+    res = vp8l_decode_image(&br, xsize, height, 1, &px);
+
+  for (i = num_transforms - 1; res == CMP_SUCCESS && i >= 0; i--) {
+    vp8l_transform_t *t = &transforms[i];
+    switch (t->type) {
+    case 0:
+      vp8l_inverse_predictor(t, px, t->xsize, height);
+      break;
+    case 1:
+      vp8l_inverse_color(t, px, t->xsize, height);
+      break;
+    case 2:
+      vp8l_inverse_subtract_green(px, (size_t)t->xsize * height);
+      break;
+    default:
+      res = vp8l_inverse_index(t, &px, xsize, height);
+      xsize = t->xsize;
+      break;
+    }
+  }
+
+  if (res == CMP_SUCCESS &&
+      CMP_MALLOC((size_t)width * 4, (void **)&row) != CMP_SUCCESS) {
+    res = CMP_ERROR_OOM;
+  }
+  for (y = 0; res == CMP_SUCCESS && y < height; y++) {
+    const uint32_t *src = px + (size_t)y * width;
+    for (i = 0; i < width; i++) {
+      row[i * 4 + 0] = (unsigned char)(src[i] >> 16);
+      row[i * 4 + 1] = (unsigned char)(src[i] >> 8);
+      row[i * 4 + 2] = (unsigned char)src[i];
+      row[i * 4 + 3] = (unsigned char)(src[i] >> 24);
+    }
+    res = cmp_image_decoder_write_rows(webp->sink, y, 1, row,
+                                       (size_t)width * 4);
+  }
+  if (res == CMP_SUCCESS)
+    res = cmp_image_decoder_end_pass(webp->sink);
+
+  if (row != NULL)
+    CMP_FREE(row);
+  if (px != NULL)
+    CMP_FREE(px);
+  for (i = 0; i < num_transforms; i++) {
+    if (transforms[i].data != NULL)
+      CMP_FREE(transforms[i].data);
+  }
+  return res;
+}
+
+/* ---- Container ---- */
+
+static unsigned long webp_le32(const unsigned char *b) {
+  return (unsigned long)b[0] | ((unsigned long)b[1] << 8) |
+         ((unsigned long)b[2] << 16) | ((unsigned long)b[3] << 24);
+}
+
+int cmp_webp_decoder_create(cmp_image_decoder_t *sink,
+                            cmp_webp_decoder_t **out_webp) {
+  cmp_webp_decoder_t *webp;
+
+  if (sink == NULL || out_webp == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(cmp_webp_decoder_t), (void **)&webp) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(webp, 0, sizeof(cmp_webp_decoder_t));
+  webp->sink = sink;
+  webp->state = WEBP_ST_RIFF;
+
+  *out_webp = webp;
+  return CMP_SUCCESS;
+}
+
+int cmp_webp_decoder_push(cmp_webp_decoder_t *webp, const unsigned char *data,
+                          size_t len) {
+  if (webp == NULL || (data == NULL && len > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  while (len > 0 && webp->error == CMP_SUCCESS &&
+         webp->state != WEBP_ST_DONE) {
+    size_t take;
+
+    switch (webp->state) {
+    case WEBP_ST_RIFF:
+    case WEBP_ST_CHUNK_HEADER: {
+      size_t want = webp->state == WEBP_ST_RIFF ? 12 : 8;
+      take = want - webp->header_len;
+      if (take > len)
+        take = len;
+      memcpy(webp->header + webp->header_len, data, take);
+      webp->header_len += take;
+      data += take;
+      len -= take;
+      if (webp->header_len < want)
+        break;
+      webp->header_len = 0;
+
+      if (webp->state == WEBP_ST_RIFF) {
+        if (memcmp(webp->header, "RIFF", 4) != 0 ||
+            memcmp(webp->header + 8, "WEBP", 4) != 0)
+          webp->error = CMP_ERROR_INVALID_ARG;
+        webp->state = WEBP_ST_CHUNK_HEADER;
+        break;
+      }
+      webp->chunk_left = webp_le32(webp->header + 4);
+      webp->chunk_pad = (int)(webp->chunk_left & 1);
+      if (memcmp(webp->header, "VP8 ", 4) == 0) {
+        webp->error = CMP_ERROR_INVALID_ARG; /* Lossy is not supported. */
+      } else if (memcmp(webp->header, "VP8L", 4) == 0) {
+        if (webp->chunk_left < 5 || webp->chunk_left > 0x7FFFFFFFUL ||
+            CMP_MALLOC((size_t)webp->chunk_left, (void **)&webp->vp8l) !=
+                CMP_SUCCESS) {
+          webp->error = CMP_ERROR_INVALID_ARG;
+          break;
+        }
+        webp->vp8l_size = (size_t)webp->chunk_left;
+        webp->state = WEBP_ST_VP8L;
+      } else {
+        webp->chunk_left += (unsigned long)webp->chunk_pad;
+        webp->state = WEBP_ST_SKIP;
+      }
+      break;
+    }
+
+    case WEBP_ST_SKIP:
+      take = webp->chunk_left < len ? (size_t)webp->chunk_left : len;
+      webp->chunk_left -= take;
+      data += take;
+      len -= take;
+      if (webp->chunk_left == 0)
+        webp->state = WEBP_ST_CHUNK_HEADER;
+      break;
+
+    case WEBP_ST_VP8L:
+      take = webp->vp8l_size - webp->vp8l_len;
+      if (take > len)
+        take = len;
+      memcpy(webp->vp8l + webp->vp8l_len, data, take);
+      webp->vp8l_len += take;
+      data += take;
+      len -= take;
+      if (webp->vp8l_len == webp->vp8l_size) {
+        webp->error = vp8l_decode_all(webp);
+        CMP_FREE(webp->vp8l);
+        webp->vp8l = NULL;
+        webp->state = WEBP_ST_DONE;
+      }
+      break;
+
+    case WEBP_ST_DONE:
+      break;
+    }
+  }
+  return webp->error;
+}
+
+int cmp_webp_decoder_finish(cmp_webp_decoder_t *webp) {
+  if (webp == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (webp->error == CMP_SUCCESS && webp->state != WEBP_ST_DONE) {
+    webp->error = CMP_ERROR_INVALID_STATE;
+  }
+  return webp->error;
+}
+
+int cmp_webp_decoder_destroy(cmp_webp_decoder_t *webp) {
+  if (webp == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (webp->vp8l != NULL) {
+    CMP_FREE(webp->vp8l);
+  }
+  CMP_FREE(webp);
+  return CMP_SUCCESS;
+}
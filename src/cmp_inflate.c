@@ -0,0 +1,583 @@
+/* clang-format off */
+#include "cmp.h"
+#include <string.h>
+/* clang-format on */
+
+/* Streaming RFC 1950/1951 decoder.
+ * Compressed bytes are appended to an input buffer; decoding only starts a
+ * step (block header, literal/length + distance pair, stored run) once enough
+ * bits for its worst case are buffered, so no step is ever left half-done
+ * between pushes. cmp_inflate_finish() relaxes that requirement for the tail
+ * of the stream. */
+
+#define INF_WINDOW_SIZE 32768
+#define INF_WINDOW_MASK (INF_WINDOW_SIZE - 1)
+#define INF_MAX_BITS 15
+#define INF_FAST_BITS 9
+#define INF_MAX_LCODES 286
+#define INF_FIXED_LCODES 288 /* 286 and 287 take part in the fixed code */
+#define INF_MAX_DCODES 30
+/* Worst case for one length/distance pair: 15 + 5 + 15 + 13 bits. */
+#define INF_PAIR_BITS 48
+/* Worst case for a dynamic block header (5+5+4 + 19*3 + 316*(7+7) bits). */
+#define INF_DYN_HEADER_BYTES 600
+
+typedef enum {
+  INF_ST_ZLIB_HEADER = 0,
+  INF_ST_BLOCK_HEADER,
+  INF_ST_STORED_HEADER,
+  INF_ST_STORED,
+  INF_ST_CODES,
+  INF_ST_TRAILER,
+  INF_ST_DONE
+} inf_state_t;
+
+typedef struct inf_huffman {
+  unsigned short fast[1 << INF_FAST_BITS]; /* (symbol << 4) | length */
+  unsigned short count[INF_MAX_BITS + 1];
+  unsigned short symbol[INF_FIXED_LCODES];
+} inf_huffman_t;
+
+struct cmp_inflate {
+  int zlib_wrapped;
+  inf_state_t state;
+  int last_block;
+  int finishing;
+  size_t stored_remaining;
+
+  unsigned char *in;
+  size_t in_len;
+  size_t in_pos;
+  size_t in_cap;
+  unsigned long bitbuf;
+  int bitcnt;
+
+  unsigned char window[INF_WINDOW_SIZE];
+  size_t wpos;
+  size_t flushed;
+  size_t total_out;
+  unsigned long adler_a;
+  unsigned long adler_b;
+
+  inf_huffman_t lencode;
+  inf_huffman_t distcode;
+
+  cmp_inflate_write_cb_t write_cb;
+  void *user_data;
+  int error;
+};
+
+static const unsigned short k_len_base[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const unsigned short k_len_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                               1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                               4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const unsigned short k_dist_base[30] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,  25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513, 769,
+    1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const unsigned short k_dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+static const unsigned char k_clen_order[19] = {
+    16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+static size_t inf_avail_bits(const cmp_inflate_t *inf) {
+  return (inf->in_len - inf->in_pos) * 8 + (size_t)inf->bitcnt;
+}
+
+/* Callers guarantee availability, so an underflow means a truncated stream. */
+static int inf_bits(cmp_inflate_t *inf, int need, unsigned long *out) {
+  while (inf->bitcnt < need) {
+    if (inf->in_pos >= inf->in_len) {
+      inf->error = CMP_ERROR_INVALID_STATE;
+      return 0;
+    }
+    inf->bitbuf |= (unsigned long)inf->in[inf->in_pos++] << inf->bitcnt;
+    inf->bitcnt += 8;
+  }
+  *out = inf->bitbuf & ((1UL << need) - 1UL);
+  inf->bitbuf >>= need;
+  inf->bitcnt -= need;
+  return 1;
+}
+
+static int inf_build(inf_huffman_t *h, const unsigned char *lengths, int n) {
+  unsigned short offs[INF_MAX_BITS + 1];
+  int left;
+  int len, sym;
+  unsigned int code;
+
+  memset(h->count, 0, sizeof(h->count));
+  memset(h->fast, 0, sizeof(h->fast));
+  for (sym = 0; sym < n; sym++)
+    h->count[lengths[sym]]++;
+  if (h->count[0] == n)
+    return 0; /* Empty code (allowed for distances). */
+
+  left = 1;
+  for (len = 1; len <= INF_MAX_BITS; len++) {
+    left <<= 1;
+    left -= h->count[len];
+    if (left < 0)
+      return -1; /* Over-subscribed. */
+  }
+
+  offs[1] = 0;
+  for (len = 1; len < INF_MAX_BITS; len++)
+    offs[len + 1] = (unsigned short)(offs[len] + h->count[len]);
+  for (sym = 0; sym < n; sym++) {
+    if (lengths[sym] != 0)
+      h->symbol[offs[lengths[sym]]++] = (unsigned short)sym;
+  }
+
+  /* Canonical codes are assigned in symbol order per length; mirror that to
+   * fill the bit-reversed fast table. */
+  code = 0;
+  for (len = 1; len <= INF_FAST_BITS; len++) {
+    int first = 0;
+    int i;
+    for (i = 1; i < len; i++)
+      first += h->count[i];
+    for (i = 0; i < h->count[len]; i++) {
+      unsigned int rev = 0;
+      unsigned int c = code + (unsigned int)i;
+      int b;
+      unsigned int fill;
+      for (b = 0; b < len; b++)
+        rev |= ((c >> b) & 1U) << (len - 1 - b);
+      for (fill = rev; fill < (1U << INF_FAST_BITS); fill += 1U << len) {
+        h->fast[fill] =
+            (unsigned short)((h->symbol[first + i] << 4) | (unsigned)len);
+      }
+    }
+    code = (code + h->count[len]) << 1;
+  }
+  return left > 0 ? 1 : 0; /* 1 = incomplete code. */
+}
+
+static int inf_decode(cmp_inflate_t *inf, const inf_huffman_t *h) {
+  int code = 0, first = 0, index = 0;
+  int len;
+  unsigned long bit;
+
+  while (inf->bitcnt < INF_FAST_BITS && inf->in_pos < inf->in_len) {
+    inf->bitbuf |= (unsigned long)inf->in[inf->in_pos++] << inf->bitcnt;
+    inf->bitcnt += 8;
+  }
+  if (inf->bitcnt >= INF_FAST_BITS) {
+    unsigned short e = h->fast[inf->bitbuf & ((1UL << INF_FAST_BITS) - 1UL)];
+    if (e != 0) {
+      inf->bitbuf >>= (e & 15);
+      inf->bitcnt -= (e & 15);
+      return e >> 4;
+    }
+  }
+
+  for (len = 1; len <= INF_MAX_BITS; len++) {
+    int count;
+    if (!inf_bits(inf, 1, &bit))
+      return -1;
+    code |= (int)bit;
+    count = h->count[len];
+    if (code - count < first)
+      return h->symbol[index + (code - first)];
+    index += count;
+    first += count;
+    first <<= 1;
+    code <<= 1;
+  }
+  inf->error = CMP_ERROR_INVALID_ARG;
+  return -1;
+}
+
+static void inf_flush(cmp_inflate_t *inf) {
+  const unsigned char *p = inf->window + inf->flushed;
+  size_t n = inf->wpos - inf->flushed;
+  size_t i;
+
+  if (n == 0)
+    return;
+  for (i = 0; i < n; i++) {
+    inf->adler_a = (inf->adler_a + p[i]) % 65521UL;
+    inf->adler_b = (inf->adler_b + inf->adler_a) % 65521UL;
+  }
+  if (inf->write_cb != NULL && inf->error == CMP_SUCCESS) {
+    if (inf->write_cb(inf->user_data, p, n) != 0)
+      inf->error = CMP_ERROR_INVALID_STATE;
+  }
+  inf->flushed = inf->wpos & INF_WINDOW_MASK;
+}
+
+static void inf_put(cmp_inflate_t *inf, unsigned char byte) {
+  inf->window[inf->wpos++] = byte;
+  inf->total_out++;
+  if (inf->wpos == INF_WINDOW_SIZE) {
+    inf_flush(inf);
+    inf->wpos = 0;
+    inf->flushed = 0;
+  }
+}
+
+static int inf_fixed_tables(cmp_inflate_t *inf) {
+  unsigned char lengths[288];
+  int i;
+  for (i = 0; i < 144; i++)
+    lengths[i] = 8;
+  for (; i < 256; i++)
+    lengths[i] = 9;
+  for (; i < 280; i++)
+    lengths[i] = 7;
+  for (; i < 288; i++)
+    lengths[i] = 8;
+  inf_build(&inf->lencode, lengths, INF_FIXED_LCODES);
+  for (i = 0; i < 30; i++)
+    lengths[i] = 5;
+  inf_build(&inf->distcode, lengths, INF_MAX_DCODES);
+  return 0;
+}
+
+static int inf_dynamic_tables(cmp_inflate_t *inf) {
+  unsigned char lengths[INF_MAX_LCODES + INF_MAX_DCODES];
+  unsigned long v;
+  int nlen, ndist, ncode, index, err;
+
+  if (!inf_bits(inf, 5, &v))
+    return -1;
+  nlen = (int)v + 257;
+  if (!inf_bits(inf, 5, &v))
+    return -1;
+  ndist = (int)v + 1;
+  if (!inf_bits(inf, 4, &v))
+    return -1;
+  ncode = (int)v + 4;
+  if (nlen > INF_MAX_LCODES || ndist > INF_MAX_DCODES)
+    return -1;
+
+  memset(lengths, 0, 19);
+  for (index = 0; index < ncode; index++) {
+    if (!inf_bits(inf, 3, &v))
+      return -1;
+    lengths[k_clen_order[index]] = (unsigned char)v;
+  }
+  if (inf_build(&inf->lencode, lengths, 19) != 0)
+    return -1; /* Code-length code must be complete. */
+
+  index = 0;
+  while (index < nlen + ndist) {
+    int sym = inf_decode(inf, &inf->lencode);
+    int len = 0;
+    int rep;
+    if (sym < 0)
+      return -1;
+    if (sym < 16) {
+      lengths[index++] = (unsigned char)sym;
+      continue;
+    }
+    if (sym == 16) {
+      if (index == 0)
+        return -1;
+      len = lengths[index - 1];
+      if (!inf_bits(inf, 2, &v))
+        return -1;
+      rep = 3 + (int)v;
+    } else if (sym == 17) {
+      if (!inf_bits(inf, 3, &v))
+        return -1;
+      rep = 3 + (int)v;
+    } else {
+      if (!inf_bits(inf, 7, &v))
+        return -1;
+      rep = 11 + (int)v;
+    }
+    if (index + rep > nlen + ndist)
+      return -1;
+    while (rep--)
+      lengths[index++] = (unsigned char)len;
+  }
+  if (lengths[256] == 0)
+    return -1;
+
+  err = inf_build(&inf->lencode, lengths, nlen);
+  if (err < 0 || (err > 0 && nlen - inf->lencode.count[0] != 1))
+    return -1;
+  err = inf_build(&inf->distcode, lengths + nlen, ndist);
+  if (err < 0 || (err > 0 && ndist - inf->distcode.count[0] != 1))
+    return -1;
+  return 0;
+}
+
+/* Decodes literal/length symbols until the block ends or input runs low. */
+static int inf_codes(cmp_inflate_t *inf) {
+  unsigned long v;
+
+  for (;;) {
+    int sym;
+    size_t len, dist;
+
+    if (!inf->finishing && inf_avail_bits(inf) < INF_PAIR_BITS)
+      return 0;
+
+    sym = inf_decode(inf, &inf->lencode);
+    if (sym < 0)
+      return -1;
+    if (sym < 256) {
+      inf_put(inf, (unsigned char)sym);
+      continue;
+    }
+    if (sym == 256) {
+      inf->state = inf->last_block
+                       ? (inf->zlib_wrapped ? INF_ST_TRAILER : INF_ST_DONE)
+                       : INF_ST_BLOCK_HEADER;
+      return 0;
+    }
+    sym -= 257;
+    if (sym >= 29)
+      return -1;
+    if (!inf_bits(inf, k_len_extra[sym], &v))
+      return -1;
+    len = k_len_base[sym] + (size_t)v;
+
+    sym = inf_decode(inf, &inf->distcode);
+    if (sym < 0 || sym >= 30)
+      return -1;
+    if (!inf_bits(inf, k_dist_extra[sym], &v))
+      return -1;
+    dist = k_dist_base[sym] + (size_t)v;
+    if (dist > inf->total_out)
+      return -1;
+
+    while (len--)
+      inf_put(inf, inf->window[(inf->wpos - dist) & INF_WINDOW_MASK]);
+  }
+}
+
+static void inf_run(cmp_inflate_t *inf) {
+  unsigned long v;
+
+  while (inf->error == CMP_SUCCESS && inf->state != INF_ST_DONE) {
+    switch (inf->state) {
+    case INF_ST_ZLIB_HEADER:
+      if (inf_avail_bits(inf) < 16)
+        return;
+      inf_bits(inf, 16, &v);
+      /* CMF/FLG: deflate method, no preset dictionary, valid check bits. */
+      if ((v & 0x0F) != 8 || (((v & 0xFF) << 8) | (v >> 8)) % 31 != 0 ||
+          (v & 0x2000) != 0) {
+        inf->error = CMP_ERROR_INVALID_ARG;
+        return;
+      }
+      inf->state = INF_ST_BLOCK_HEADER;
+      break;
+
+    case INF_ST_BLOCK_HEADER:
+      if (inf_avail_bits(inf) < 3)
+        return;
+      /* A dynamic header is decoded in one go, so wait for its worst case. */
+      if (!inf->finishing && inf->in_len - inf->in_pos < INF_DYN_HEADER_BYTES)
+        return;
+      inf_bits(inf, 1, &v);
+      inf->last_block = (int)v;
+      inf_bits(inf, 2, &v);
+      if (v == 0) {
+        inf->state = INF_ST_STORED_HEADER;
+      } else if (v == 1) {
+        inf_fixed_tables(inf);
+        inf->state = INF_ST_CODES;
+      } else if (v == 2) {
+        if (inf_dynamic_tables(inf) != 0) {
+          if (inf->error == CMP_SUCCESS)
+            inf->error = CMP_ERROR_INVALID_ARG;
+          return;
+        }
+        inf->state = INF_ST_CODES;
+      } else {
+        inf->error = CMP_ERROR_INVALID_ARG;
+        return;
+      }
+      break;
+
+    case INF_ST_STORED_HEADER: {
+      unsigned long len, nlen;
+      /* Discard to the byte boundary, then LEN/NLEN. */
+      if (inf_avail_bits(inf) < (size_t)(inf->bitcnt & 7) + 32)
+        return;
+      inf->bitbuf >>= (inf->bitcnt & 7);
+      inf->bitcnt -= (inf->bitcnt & 7);
+      inf_bits(inf, 16, &len);
+      inf_bits(inf, 16, &nlen);
+      if ((len ^ 0xFFFFUL) != nlen) {
+        inf->error = CMP_ERROR_INVALID_ARG;
+        return;
+      }
+      inf->stored_remaining = (size_t)len;
+      inf->state = INF_ST_STORED;
+      break;
+    }
+
+    case INF_ST_STORED:
+      /* The bit buffer is byte aligned and holds at most whole bytes. */
+      while (inf->stored_remaining > 0 && inf->bitcnt >= 8) {
+        inf_put(inf, (unsigned char)(inf->bitbuf & 0xFF));
+        inf->bitbuf >>= 8;
+        inf->bitcnt -= 8;
+        inf->stored_remaining--;
+      }
+      while (inf->stored_remaining > 0 && inf->in_pos < inf->in_len) {
+        inf_put(inf, inf->in[inf->in_pos++]);
+        inf->stored_remaining--;
+      }
+      if (inf->stored_remaining > 0)
+        return;
+      inf->state = inf->last_block
+                       ? (inf->zlib_wrapped ? INF_ST_TRAILER : INF_ST_DONE)
+                       : INF_ST_BLOCK_HEADER;
+      break;
+
+    case INF_ST_CODES:
+      if (inf_codes(inf) != 0) {
+        if (inf->error == CMP_SUCCESS)
+          inf->error = CMP_ERROR_INVALID_ARG;
+        return;
+      }
+      if (inf->state == INF_ST_CODES)
+        return; /* Waiting for more input. */
+      break;
+
+    case INF_ST_TRAILER: {
+      unsigned long b0, b1, b2, b3;
+      if (inf_avail_bits(inf) < (size_t)(inf->bitcnt & 7) + 32)
+        return;
+      inf->bitbuf >>= (inf->bitcnt & 7);
+      inf->bitcnt -= (inf->bitcnt & 7);
+      inf_flush(inf);
+      inf_bits(inf, 8, &b0);
+      inf_bits(inf, 8, &b1);
+      inf_bits(inf, 8, &b2);
+      inf_bits(inf, 8, &b3);
+      if (((b0 << 24) | (b1 << 16) | (b2 << 8) | b3) !=
+          ((inf->adler_b << 16) | inf->adler_a)) {
+        inf->error = CMP_ERROR_INVALID_ARG;
+        return;
+      }
+      inf->state = INF_ST_DONE;
+      break;
+    }
+
+    case INF_ST_DONE:
+      break;
+    }
+  }
+}
+
+int cmp_inflate_create(int zlib_wrapped, cmp_inflate_write_cb_t write_cb,
+                       void *user_data, cmp_inflate_t **out_inflate) {
+  cmp_inflate_t *inf;
+
+  if (out_inflate == NULL || write_cb == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(cmp_inflate_t), (void **)&inf) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(inf, 0, sizeof(cmp_inflate_t));
+  inf->zlib_wrapped = zlib_wrapped;
+  inf->state = zlib_wrapped ? INF_ST_ZLIB_HEADER : INF_ST_BLOCK_HEADER;
+  inf->adler_a = 1;
+  inf->write_cb = write_cb;
+  inf->user_data = user_data;
+  inf->error = CMP_SUCCESS;
+
+  *out_inflate = inf;
+  return CMP_SUCCESS;
+}
+
+int cmp_inflate_push(cmp_inflate_t *inf, const void *data, size_t len) {
+  if (inf == NULL || (data == NULL && len > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (inf->error != CMP_SUCCESS) {
+    return inf->error;
+  }
+
+  /* Compact consumed input before growing. */
+  if (inf->in_pos > 0) {
+    memmove(inf->in, inf->in + inf->in_pos, inf->in_len - inf->in_pos);
+    inf->in_len -= inf->in_pos;
+    inf->in_pos = 0;
+  }
+  if (inf->in_len + len > inf->in_cap) {
+    size_t cap = inf->in_cap ? inf->in_cap : 4096;
+    unsigned char *grown;
+    while (cap < inf->in_len + len)
+      cap *= 2;
+    if (CMP_MALLOC(cap, (void **)&grown) != CMP_SUCCESS) {
+      return CMP_ERROR_OOM;
+    }
+    if (inf->in_len > 0)
+      memcpy(grown, inf->in, inf->in_len);
+    if (inf->in != NULL)
+      CMP_FREE(inf->in);
+    inf->in = grown;
+    inf->in_cap = cap;
+  }
+  if (len > 0) {
+    memcpy(inf->in + inf->in_len, data, len);
+    inf->in_len += len;
+  }
+
+  inf_run(inf);
+  inf_flush(inf);
+  return inf->error;
+}
+
+int cmp_inflate_finish(cmp_inflate_t *inf) {
+  if (inf == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (inf->error != CMP_SUCCESS) {
+    return inf->error;
+  }
+  inf->finishing = 1;
+  inf_run(inf);
+  inf_flush(inf);
+  if (inf->error == CMP_SUCCESS && inf->state != INF_ST_DONE) {
+    inf->error = CMP_ERROR_INVALID_STATE;
+  }
+  return inf->error;
+}
+
+int cmp_inflate_sync(cmp_inflate_t *inf) {
+  if (inf == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (inf->error != CMP_SUCCESS) {
+    return inf->error;
+  }
+  /* The input ends at a flush point, so the look-ahead waits can go. */
+  inf->finishing = 1;
+  inf_run(inf);
+  inf->finishing = 0;
+  inf_flush(inf);
+  return inf->error;
+}
+
+int cmp_inflate_is_done(const cmp_inflate_t *inf, int *out_done) {
+  if (inf == NULL || out_done == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  *out_done = inf->state == INF_ST_DONE;
+  return CMP_SUCCESS;
+}
+
+int cmp_inflate_destroy(cmp_inflate_t *inf) {
+  if (inf == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (inf->in != NULL) {
+    CMP_FREE(inf->in);
+  }
+  CMP_FREE(inf);
+  return CMP_SUCCESS;
+}
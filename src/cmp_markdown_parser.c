@@ -4,73 +4,1465 @@
 #include <string.h>
 /* clang-format on */
 
-struct cmp_markdown_parser {
-  int flags;
+/* CommonMark block and inline parsing with GFM tables and strikethrough.
+ * Blocks follow the spec's two-phase design: each line first walks the open
+ * container chain (block quotes, list items), then may open new blocks, and
+ * whatever is left goes to the open leaf. Inline content is parsed when a
+ * tree is built, using the delimiter-stack algorithm for emphasis and links.
+ * Everything lives in arenas: the parse scratch is thrown away per run and a
+ * built tree is one arena freed with its root. Link reference definitions
+ * and raw HTML blocks are not recognised; they parse as paragraphs. */
+
+#define MD_ARENA_CHUNK 65536
+/* Containers nest at most this deep; further quote and list markers are
+ * paragraph text, as cmark caps list nesting. Keeps tree building's
+ * recursion bounded. */
+#define MD_MAX_DEPTH 100
+/* Parentheses a bare link destination may nest, cmark's limit */
+#define MD_MAX_LINK_PARENS 32
+
+typedef struct md_arena_chunk {
+  struct md_arena_chunk *next;
+  size_t cap;
+  size_t used;
+} md_arena_chunk_t;
+
+typedef struct md_arena {
+  md_arena_chunk_t *head;
+  int failed;
+} md_arena_t;
+
+static void *md_alloc(md_arena_t *a, size_t size) {
+  md_arena_chunk_t *c = a->head;
+  void *p;
+  size = (size + 7u) & ~(size_t)7u;
+  if (!c || c->cap - c->used < size) {
+    size_t cap = size > MD_ARENA_CHUNK ? size : MD_ARENA_CHUNK;
+    if (CMP_MALLOC(sizeof(md_arena_chunk_t) + cap, (void **)&c) !=
+        CMP_SUCCESS) {
+      a->failed = 1;
+      return NULL;
+    }
+    c->cap = cap;
+    c->used = 0;
+    c->next = a->head;
+    a->head = c;
+  }
+  p = (char *)(c + 1) + c->used;
+  c->used += size;
+  return p;
+}
+
+static void md_arena_free(md_arena_t *a) {
+  while (a->head) {
+    md_arena_chunk_t *c = a->head;
+    a->head = c->next;
+    CMP_FREE(c);
+  }
+  a->failed = 0;
+}
+
+/* Keeps one chunk around so that per-push reparses do not churn. */
+static void md_arena_reset(md_arena_t *a) {
+  if (a->head) {
+    while (a->head->next) {
+      md_arena_chunk_t *c = a->head->next;
+      a->head->next = c->next;
+      CMP_FREE(c);
+    }
+    a->head->used = 0;
+  }
+  a->failed = 0;
+}
+
+static char *md_strdup(md_arena_t *a, const char *s, size_t len) {
+  char *out = (char *)md_alloc(a, len + 1);
+  if (!out)
+    return NULL;
+  memcpy(out, s, len);
+  out[len] = '\0';
+  return out;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Character classes                                                         */
+/* ------------------------------------------------------------------------ */
+
+static int md_is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' ||
+         c == '\v';
+}
+
+static int md_is_punct(char c) {
+  return (c >= '!' && c <= '/') || (c >= ':' && c <= '@') ||
+         (c >= '[' && c <= '`') || (c >= '{' && c <= '~');
+}
+
+static int md_is_digit(char c) { return c >= '0' && c <= '9'; }
+
+static int md_is_alpha(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+/* ------------------------------------------------------------------------ */
+/* Block structure                                                           */
+/* ------------------------------------------------------------------------ */
+
+enum {
+  MB_DOC,
+  MB_QUOTE,
+  MB_LIST,
+  MB_ITEM,
+  MB_PARA,
+  MB_HEADING,
+  MB_FENCE,
+  MB_ICODE,
+  MB_HR,
+  MB_TABLE
 };
 
-int cmp_md_node_destroy(cmp_md_node_t *node) {
-  size_t i;
-  if (!node) {
-    return CMP_ERROR_INVALID_ARG;
+typedef struct md_line {
+  struct md_line *next;
+  const char *s;
+  size_t len;
+} md_line_t;
+
+typedef struct md_block {
+  int kind;
+  int open;
+  struct md_block *parent;
+  struct md_block *first;
+  struct md_block *last;
+  struct md_block *next;
+  md_line_t *lines;
+  md_line_t *lines_tail;
+  size_t line_count;
+  int level;      /* Heading level, or ordered list start */
+  int ordered;    /* Lists */
+  char marker;    /* Bullet character, or '.' / ')' for ordered lists */
+  size_t content_indent; /* List items */
+  char fence_char;
+  size_t fence_len;
+  size_t fence_indent;
+  size_t src_start; /* Source range, tracked for top-level blocks */
+  size_t src_end;
+  size_t depth; /* Containers above this block */
+} md_block_t;
+
+typedef struct md_parser {
+  md_arena_t *scratch;
+  md_block_t *doc;
+  md_block_t *tip;
+  char *line; /* Current line, tabs expanded, without the newline */
+  size_t line_len;
+  size_t line_cap;
+  size_t pos;
+  size_t line_start; /* Source offset of the current line */
+  size_t line_end;   /* Source offset just past its newline */
+} md_parser_t;
+
+static int md_can_contain(int parent, int child) {
+  if (parent == MB_LIST)
+    return child == MB_ITEM;
+  if (parent == MB_DOC || parent == MB_QUOTE || parent == MB_ITEM)
+    return child != MB_ITEM;
+  return 0;
+}
+
+static void md_finalize(md_parser_t *p, md_block_t *b) {
+  (void)p;
+  b->open = 0;
+  if (b->kind == MB_ICODE) {
+    /* Trailing blank lines are not part of indented code */
+    md_line_t *l, *last_text = NULL;
+    size_t count = 0, kept = 0;
+    for (l = b->lines; l; l = l->next) {
+      size_t i;
+      count++;
+      for (i = 0; i < l->len && l->s[i] == ' '; ++i) {
+      }
+      if (i < l->len) {
+        last_text = l;
+        kept = count;
+      }
+    }
+    if (last_text) {
+      last_text->next = NULL;
+      b->lines_tail = last_text;
+    }
+    b->line_count = kept;
   }
+}
 
-  if (node->content) {
-    free(node->content);
+static void md_close_to(md_parser_t *p, md_block_t *container) {
+  while (p->tip != container) {
+    md_finalize(p, p->tip);
+    p->tip = p->tip->parent;
   }
+}
 
-  for (i = 0; i < node->child_count; ++i) {
-    cmp_md_node_destroy(node->children[i]);
+static md_block_t *md_add_block(md_parser_t *p, md_block_t *parent,
+                                int kind) {
+  md_block_t *b;
+  md_close_to(p, parent);
+  while (!md_can_contain(parent->kind, kind)) {
+    md_finalize(p, parent);
+    parent = parent->parent;
+  }
+  p->tip = parent;
+  b = (md_block_t *)md_alloc(p->scratch, sizeof(md_block_t));
+  if (!b)
+    return NULL;
+  memset(b, 0, sizeof(md_block_t));
+  b->kind = kind;
+  b->open = 1;
+  b->parent = parent;
+  b->depth = parent->depth + 1;
+  if (parent->last)
+    parent->last->next = b;
+  else
+    parent->first = b;
+  parent->last = b;
+  if (parent == p->doc) {
+    b->src_start = p->line_start;
+    b->src_end = p->line_end;
+  }
+  p->tip = b;
+  return b;
+}
+
+static void md_add_line(md_parser_t *p, md_block_t *b, size_t from) {
+  md_line_t *l = (md_line_t *)md_alloc(p->scratch, sizeof(md_line_t));
+  if (!l)
+    return;
+  if (from > p->line_len)
+    from = p->line_len;
+  l->len = p->line_len - from;
+  l->s = md_strdup(p->scratch, p->line + from, l->len);
+  l->next = NULL;
+  if (!l->s)
+    return;
+  if (b->lines_tail)
+    b->lines_tail->next = l;
+  else
+    b->lines = l;
+  b->lines_tail = l;
+  b->line_count++;
+}
+
+static size_t md_next_nonspace(const md_parser_t *p) {
+  size_t i = p->pos;
+  while (i < p->line_len && p->line[i] == ' ')
+    i++;
+  return i;
+}
+
+/* Thematic break: three or more of the same -, * or _, spaces allowed. */
+static int md_is_hr(const char *s, size_t len) {
+  size_t i, count = 0;
+  char c = 0;
+  for (i = 0; i < len; ++i) {
+    if (s[i] == ' ')
+      continue;
+    if (s[i] != '-' && s[i] != '*' && s[i] != '_')
+      return 0;
+    if (c && s[i] != c)
+      return 0;
+    c = s[i];
+    count++;
   }
+  return count >= 3;
+}
 
-  if (node->children) {
-    free(node->children);
+/* Setext underline: a run of = or -, trailing spaces allowed. */
+static int md_setext_level(const char *s, size_t len) {
+  size_t i = 0;
+  char c;
+  if (len == 0 || (s[0] != '=' && s[0] != '-'))
+    return 0;
+  c = s[0];
+  while (i < len && s[i] == c)
+    i++;
+  while (i < len && s[i] == ' ')
+    i++;
+  if (i != len)
+    return 0;
+  return c == '=' ? 1 : 2;
+}
+
+/* Splits a table row into cells; returns the cell count. */
+static size_t md_split_row(const char *s, size_t len, const char **cells,
+                           size_t *lens, size_t max) {
+  size_t i = 0, count = 0, start;
+  while (i < len && s[i] == ' ')
+    i++;
+  while (len > i && s[len - 1] == ' ')
+    len--;
+  if (i < len && s[i] == '|')
+    i++;
+  if (len > i && s[len - 1] == '|' && (len < 2 || s[len - 2] != '\\'))
+    len--;
+  start = i;
+  for (;; ++i) {
+    if (i == len || (s[i] == '|' && (i == 0 || s[i - 1] != '\\'))) {
+      size_t a = start, b = i;
+      while (a < b && s[a] == ' ')
+        a++;
+      while (b > a && s[b - 1] == ' ')
+        b--;
+      if (cells && count < max) {
+        cells[count] = s + a;
+        lens[count] = b - a;
+      }
+      count++;
+      if (i == len)
+        break;
+      start = i + 1;
+    }
   }
+  return count;
+}
 
-  free(node);
+static int md_is_delimiter_row(const char *s, size_t len, size_t *out_cells) {
+  size_t i, has_dash = 0, has_pipe = 0;
+  for (i = 0; i < len; ++i) {
+    char c = s[i];
+    if (c == '-')
+      has_dash = 1;
+    else if (c == '|')
+      has_pipe = 1;
+    else if (c != ':' && c != ' ')
+      return 0;
+  }
+  if (!has_dash)
+    return 0;
+  *out_cells = md_split_row(s, len, NULL, NULL, 0);
+  return has_pipe || *out_cells > 1;
+}
+
+/* Parses a list marker at pos; fills the item geometry. */
+static int md_parse_marker(const md_parser_t *p, size_t at, int interrupting,
+                           int *out_ordered, char *out_marker, int *out_start,
+                           size_t *out_width) {
+  const char *s = p->line;
+  size_t len = p->line_len, i = at;
+  if (i >= len)
+    return 0;
+  if (s[i] == '-' || s[i] == '+' || s[i] == '*') {
+    *out_ordered = 0;
+    *out_marker = s[i];
+    *out_start = 0;
+    i++;
+  } else if (md_is_digit(s[i])) {
+    int start = 0;
+    size_t digits = 0;
+    while (i < len && md_is_digit(s[i]) && digits < 9) {
+      start = start * 10 + (s[i] - '0');
+      i++;
+      digits++;
+    }
+    if (i >= len || (s[i] != '.' && s[i] != ')'))
+      return 0;
+    if (interrupting && start != 1)
+      return 0;
+    *out_ordered = 1;
+    *out_marker = s[i];
+    *out_start = start;
+    i++;
+  } else {
+    return 0;
+  }
+  if (i < len && s[i] != ' ')
+    return 0;
+  if (interrupting) {
+    size_t j = i;
+    while (j < len && s[j] == ' ')
+      j++;
+    if (j == len)
+      return 0; /* An empty item cannot interrupt a paragraph */
+  }
+  *out_width = i - at;
+  return 1;
+}
+
+static int md_process_line(md_parser_t *p) {
+  md_block_t *container = p->doc, *last_matched;
+  int all_matched = 1;
+  size_t nns, indent;
+  int blank;
+
+  p->pos = 0;
+
+  /* 1. Walk the open blocks this line continues */
+  while (container->last && container->last->open) {
+    md_block_t *child = container->last;
+    int matched = 1;
+    nns = md_next_nonspace(p);
+    indent = nns - p->pos;
+    blank = nns == p->line_len;
+    switch (child->kind) {
+    case MB_QUOTE:
+      if (indent <= 3 && nns < p->line_len && p->line[nns] == '>') {
+        p->pos = nns + 1;
+        if (p->pos < p->line_len && p->line[p->pos] == ' ')
+          p->pos++;
+      } else {
+        matched = 0;
+      }
+      break;
+    case MB_ITEM:
+      if (blank) {
+        if (!child->first)
+          matched = 0; /* Empty items end at a blank line */
+        else
+          p->pos = nns;
+      } else if (indent >= child->content_indent) {
+        p->pos += child->content_indent;
+      } else {
+        matched = 0;
+      }
+      break;
+    case MB_ICODE:
+      if (indent >= 4)
+        p->pos += 4;
+      else if (blank)
+        p->pos = nns;
+      else
+        matched = 0;
+      break;
+    case MB_PARA:
+      matched = !blank;
+      break;
+    case MB_TABLE:
+      matched = !blank && memchr(p->line + p->pos, '|',
+                                 p->line_len - p->pos) != NULL;
+      break;
+    case MB_HEADING:
+    case MB_HR:
+      matched = 0;
+      break;
+    default: /* Lists and fences */
+      break;
+    }
+    if (!matched) {
+      all_matched = 0;
+      break;
+    }
+    container = child;
+  }
+  last_matched = container;
+
+  /* Fenced code takes lines verbatim until its closing fence */
+  if (container->kind == MB_FENCE) {
+    size_t i, run = 0;
+    nns = md_next_nonspace(p);
+    for (i = nns; i < p->line_len && p->line[i] == container->fence_char; ++i)
+      run++;
+    while (i < p->line_len && p->line[i] == ' ')
+      i++;
+    if (nns - p->pos <= 3 && run >= container->fence_len &&
+        i == p->line_len) {
+      md_close_to(p, container);
+      md_finalize(p, container);
+      p->tip = container->parent;
+    } else {
+      size_t strip = 0;
+      while (strip < container->fence_indent &&
+             p->pos + strip < p->line_len && p->line[p->pos + strip] == ' ')
+        strip++;
+      md_add_line(p, container, p->pos + strip);
+    }
+    return p->scratch->failed ? CMP_ERROR_OOM : CMP_SUCCESS;
+  }
+
+  /* 2. Open new blocks */
+  while (container->kind != MB_ICODE && container->kind != MB_HEADING &&
+         container->kind != MB_HR && container->kind != MB_TABLE &&
+         container->kind != MB_FENCE) {
+    char c;
+    int ordered, start, level;
+    char marker;
+    size_t width, cells;
+    int interrupting = container->kind == MB_PARA;
+
+    nns = md_next_nonspace(p);
+    indent = nns - p->pos;
+    blank = nns == p->line_len;
+    if (blank)
+      break;
+    c = p->line[nns];
+
+    if (indent >= 4) {
+      if (p->tip->kind == MB_PARA)
+        break; /* Paragraph continuation, not code */
+      container = md_add_block(p, container, MB_ICODE);
+      if (!container)
+        return CMP_ERROR_OOM;
+      p->pos += 4;
+      break;
+    }
+    if (c == '>' && container->depth < MD_MAX_DEPTH) {
+      container = md_add_block(p, container, MB_QUOTE);
+      if (!container)
+        return CMP_ERROR_OOM;
+      p->pos = nns + 1;
+      if (p->pos < p->line_len && p->line[p->pos] == ' ')
+        p->pos++;
+      continue;
+    }
+    if (c == '#') {
+      size_t i = nns, a, b;
+      while (i < p->line_len && p->line[i] == '#')
+        i++;
+      level = (int)(i - nns);
+      if (level <= 6 && (i == p->line_len || p->line[i] == ' ')) {
+        container = md_add_block(p, container, MB_HEADING);
+        if (!container)
+          return CMP_ERROR_OOM;
+        container->level = level;
+        a = i;
+        while (a < p->line_len && p->line[a] == ' ')
+          a++;
+        b = p->line_len;
+        while (b > a && p->line[b - 1] == ' ')
+          b--;
+        /* Optional closing sequence */
+        {
+          size_t h = b;
+          while (h > a && p->line[h - 1] == '#')
+            h--;
+          if (h < b && (h == a || p->line[h - 1] == ' ')) {
+            b = h;
+            while (b > a && p->line[b - 1] == ' ')
+              b--;
+          }
+        }
+        p->line_len = b;
+        md_add_line(p, container, a);
+        p->pos = p->line_len;
+        break;
+      }
+    }
+    if (c == '`' || c == '~') {
+      size_t i = nns;
+      while (i < p->line_len && p->line[i] == c)
+        i++;
+      if (i - nns >= 3 &&
+          (c == '~' || !memchr(p->line + i, '`', p->line_len - i))) {
+        md_block_t *fence = md_add_block(p, container, MB_FENCE);
+        if (!fence)
+          return CMP_ERROR_OOM;
+        fence->fence_char = c;
+        fence->fence_len = i - nns;
+        fence->fence_indent = indent;
+        p->pos = p->line_len;
+        return p->scratch->failed ? CMP_ERROR_OOM : CMP_SUCCESS;
+      }
+    }
+    if (interrupting && all_matched &&
+        (level = md_setext_level(p->line + nns, p->line_len - nns)) != 0) {
+      container->kind = MB_HEADING;
+      container->level = level;
+      md_finalize(p, container);
+      p->tip = container->parent;
+      return CMP_SUCCESS;
+    }
+    if (md_is_hr(p->line + nns, p->line_len - nns)) {
+      container = md_add_block(p, container, MB_HR);
+      if (!container)
+        return CMP_ERROR_OOM;
+      p->pos = p->line_len;
+      break;
+    }
+    if (interrupting && all_matched && container->line_count == 1 &&
+        memchr(container->lines->s, '|', container->lines->len) &&
+        md_is_delimiter_row(p->line + nns, p->line_len - nns, &cells) &&
+        cells == md_split_row(container->lines->s, container->lines->len,
+                              NULL, NULL, 0)) {
+      container->kind = MB_TABLE;
+      return CMP_SUCCESS;
+    }
+    if (container->depth < MD_MAX_DEPTH &&
+        md_parse_marker(p, nns, interrupting, &ordered, &marker, &start,
+                        &width)) {
+      size_t after = nns + width, pad = 0;
+      md_block_t *list = container;
+      while (after + pad < p->line_len && p->line[after + pad] == ' ')
+        pad++;
+      if (after + pad == p->line_len || pad > 4)
+        pad = 1; /* Blank after marker, or indented code inside the item */
+      if (list->kind != MB_LIST || list->ordered != ordered ||
+          list->marker != marker) {
+        list = md_add_block(p, container, MB_LIST);
+        if (!list)
+          return CMP_ERROR_OOM;
+        list->ordered = ordered;
+        list->marker = marker;
+        list->level = start;
+      }
+      container = md_add_block(p, list, MB_ITEM);
+      if (!container)
+        return CMP_ERROR_OOM;
+      container->content_indent = indent + width + pad;
+      p->pos = after + pad > p->line_len ? p->line_len : after + pad;
+      continue;
+    }
+    break;
+  }
+
+  /* 3. The rest of the line goes to a leaf */
+  nns = md_next_nonspace(p);
+  blank = nns == p->line_len;
+  if (container == last_matched && !all_matched && !blank &&
+      p->tip->kind == MB_PARA) {
+    md_add_line(p, p->tip, nns); /* Lazy paragraph continuation */
+  } else {
+    md_close_to(p, container);
+    switch (container->kind) {
+    case MB_PARA:
+    case MB_TABLE:
+      md_add_line(p, container, nns);
+      break;
+    case MB_ICODE:
+      md_add_line(p, container, p->pos);
+      break;
+    case MB_HEADING:
+    case MB_HR:
+      md_finalize(p, container);
+      p->tip = container->parent;
+      break;
+    case MB_FENCE:
+      break;
+    default:
+      if (!blank) {
+        md_block_t *para = md_add_block(p, container, MB_PARA);
+        if (!para)
+          return CMP_ERROR_OOM;
+        md_add_line(p, para, nns);
+      }
+      break;
+    }
+  }
+  return p->scratch->failed ? CMP_ERROR_OOM : CMP_SUCCESS;
+}
+
+/* Parses the block structure of text; offsets are reported relative to
+ * base. Blocks still open at the end are left open. */
+static int md_parse_blocks(md_parser_t *p, const char *text, size_t len,
+                           size_t base) {
+  size_t i = 0;
+  p->doc = (md_block_t *)md_alloc(p->scratch, sizeof(md_block_t));
+  if (!p->doc)
+    return CMP_ERROR_OOM;
+  memset(p->doc, 0, sizeof(md_block_t));
+  p->doc->kind = MB_DOC;
+  p->doc->open = 1;
+  p->tip = p->doc;
+
+  while (i < len) {
+    const char *nl = (const char *)memchr(text + i, '\n', len - i);
+    size_t end = nl ? (size_t)(nl - text) : len, k, col = 0;
+    md_block_t *top;
+    int res, indenting = 1;
+
+    /* Tabs in the indentation expand to the next multiple of four
+     * columns; later ones are content and stay literal */
+    p->line_len = 0;
+    for (k = i; k < end; ++k) {
+      int expand = text[k] == '\t' && indenting;
+      size_t need = expand ? 4 : 1;
+      if (p->line_len + need > p->line_cap) {
+        char *buf;
+        size_t cap = p->line_cap ? p->line_cap * 2 : 256;
+        while (cap < p->line_len + need)
+          cap *= 2;
+        if (CMP_MALLOC(cap, (void **)&buf) != CMP_SUCCESS)
+          return CMP_ERROR_OOM;
+        if (p->line_len)
+          memcpy(buf, p->line, p->line_len);
+        if (p->line)
+          CMP_FREE(p->line);
+        p->line = buf;
+        p->line_cap = cap;
+      }
+      if (text[k] != ' ' && text[k] != '\t' && text[k] != '>')
+        indenting = 0;
+      if (text[k] == '\t' && indenting) {
+        size_t spaces = 4 - col % 4;
+        memset(p->line + p->line_len, ' ', spaces);
+        p->line_len += spaces;
+        col += spaces;
+      } else if (text[k] != '\r' || k + 1 != end) {
+        p->line[p->line_len++] = text[k];
+        col++;
+      }
+    }
+    p->line_start = base + i;
+    p->line_end = base + (nl ? end + 1 : end);
+    top = p->doc->last && p->doc->last->open ? p->doc->last : NULL;
+    res = md_process_line(p);
+    if (res != CMP_SUCCESS)
+      return res;
+    /* A line that closes a block (fence end, setext underline) is part of
+     * it unless it started a new one */
+    if (top && p->doc->last == top)
+      top->src_end = p->line_end;
+    i = nl ? end + 1 : end;
+  }
   return CMP_SUCCESS;
 }
 
-static cmp_md_node_t *create_node(cmp_md_node_type_t type,
-                                  const char *content) {
-  cmp_md_node_t *node = (cmp_md_node_t *)malloc(sizeof(cmp_md_node_t));
-  if (!node)
+static void md_parser_release(md_parser_t *p) {
+  if (p->line)
+    CMP_FREE(p->line);
+  p->line = NULL;
+  p->line_cap = 0;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Inline content                                                            */
+/* ------------------------------------------------------------------------ */
+
+enum {
+  MI_ROOT,
+  MI_TEXT,
+  MI_CODE,
+  MI_EMPH,
+  MI_STRONG,
+  MI_STRIKE,
+  MI_LINK,
+  MI_IMAGE,
+  MI_BREAK
+};
+
+typedef struct md_inl {
+  int type;
+  const char *s; /* Literal text, or the destination of links and images */
+  size_t len;
+  struct md_inl *parent;
+  struct md_inl *prev;
+  struct md_inl *next;
+  struct md_inl *first;
+  struct md_inl *last;
+} md_inl_t;
+
+typedef struct md_delim {
+  md_inl_t *node;
+  struct md_delim *prev;
+  struct md_delim *next;
+  char ch; /* '*', '_', '~', or '[' / '!' for link and image openers */
+  size_t count;
+  size_t orig;
+  int can_open;
+  int can_close;
+  int active;
+} md_delim_t;
+
+typedef struct md_inline {
+  md_arena_t *scratch;
+  md_inl_t *root;
+  md_delim_t *top;
+  /* Per title delimiter (", ', parenthesis), the span of the last title
+   * whose link failed; titles opened inside it end the same way. */
+  size_t title_from[3];
+  size_t title_to[3];
+} md_inline_t;
+
+static md_inl_t *md_inl_new(md_inline_t *c, int type, const char *s,
+                            size_t len) {
+  md_inl_t *n = (md_inl_t *)md_alloc(c->scratch, sizeof(md_inl_t));
+  if (!n)
+    return NULL;
+  memset(n, 0, sizeof(md_inl_t));
+  n->type = type;
+  n->s = s;
+  n->len = len;
+  return n;
+}
+
+static void md_inl_append(md_inl_t *parent, md_inl_t *n) {
+  n->parent = parent;
+  n->next = NULL;
+  n->prev = parent->last;
+  if (parent->last)
+    parent->last->next = n;
+  else
+    parent->first = n;
+  parent->last = n;
+}
+
+static void md_inl_unlink(md_inl_t *n) {
+  md_inl_t *parent = n->parent;
+  if (n->prev)
+    n->prev->next = n->next;
+  else
+    parent->first = n->next;
+  if (n->next)
+    n->next->prev = n->prev;
+  else
+    parent->last = n->prev;
+  n->prev = n->next = NULL;
+}
+
+static void md_inl_insert_after(md_inl_t *at, md_inl_t *n) {
+  md_inl_t *parent = at->parent;
+  n->parent = parent;
+  n->prev = at;
+  n->next = at->next;
+  if (at->next)
+    at->next->prev = n;
+  else
+    parent->last = n;
+  at->next = n;
+}
+
+/* Moves the siblings strictly between from and to (to may be NULL for the
+ * end of the list) under dest. */
+static void md_inl_adopt(md_inl_t *dest, md_inl_t *from, md_inl_t *to) {
+  md_inl_t *n = from->next;
+  while (n && n != to) {
+    md_inl_t *next = n->next;
+    md_inl_unlink(n);
+    md_inl_append(dest, n);
+    n = next;
+  }
+}
+
+static md_inl_t *md_text(md_inline_t *c, const char *s, size_t len) {
+  md_inl_t *n = md_inl_new(c, MI_TEXT, s, len);
+  if (n)
+    md_inl_append(c->root, n);
+  return n;
+}
+
+static void md_delim_remove(md_inline_t *c, md_delim_t *d) {
+  if (d->prev)
+    d->prev->next = d->next;
+  if (d->next)
+    d->next->prev = d->prev;
+  else
+    c->top = d->prev;
+}
+
+static md_delim_t *md_delim_push(md_inline_t *c, md_inl_t *node, char ch,
+                                 size_t count, int can_open, int can_close) {
+  md_delim_t *d = (md_delim_t *)md_alloc(c->scratch, sizeof(md_delim_t));
+  if (!d)
     return NULL;
+  d->node = node;
+  d->ch = ch;
+  d->count = count;
+  d->orig = count;
+  d->can_open = can_open;
+  d->can_close = can_close;
+  d->active = 1;
+  d->next = NULL;
+  d->prev = c->top;
+  if (c->top)
+    c->top->next = d;
+  c->top = d;
+  return d;
+}
+
+static int md_emph_index(char ch) {
+  return ch == '*' ? 0 : ch == '_' ? 1 : ch == '~' ? 2 : -1;
+}
 
-  node->type = type;
-  node->level = 0;
-  node->child_count = 0;
-  node->child_capacity = 0;
-  node->children = NULL;
+/* Pairs emphasis delimiters above bottom (the spec's "process emphasis"). */
+static void md_process_emphasis(md_inline_t *c, md_delim_t *bottom) {
+  md_delim_t *openers_bottom[3][3][2];
+  md_delim_t *closer = c->top;
+  int a, b, k;
 
-  if (content) {
-    size_t len = strlen(content);
-    node->content = (char *)malloc(len + 1);
-    if (node->content) {
-      strncpy(node->content, content, len + 1);
+  for (a = 0; a < 3; ++a)
+    for (b = 0; b < 3; ++b)
+      for (k = 0; k < 2; ++k)
+        openers_bottom[a][b][k] = bottom;
+
+  while (closer && closer->prev != bottom)
+    closer = closer->prev;
+  if (closer == bottom)
+    closer = NULL;
+
+  while (closer) {
+    int idx = md_emph_index(closer->ch);
+    md_delim_t *opener, *floor;
+    int found = 0;
+    if (!closer->can_close || idx < 0) {
+      closer = closer->next;
+      continue;
+    }
+    floor = openers_bottom[idx][closer->orig % 3][closer->can_open ? 1 : 0];
+    for (opener = closer->prev; opener && opener != bottom && opener != floor;
+         opener = opener->prev) {
+      if (opener->ch != closer->ch || !opener->can_open)
+        continue;
+      if (closer->ch == '~') {
+        found = opener->count == closer->count;
+      } else {
+        found = !((opener->can_close || closer->can_open) &&
+                  (opener->orig + closer->orig) % 3 == 0 &&
+                  !(opener->orig % 3 == 0 && closer->orig % 3 == 0));
+      }
+      if (found)
+        break;
     }
+    if (found) {
+      size_t use = closer->ch == '~'
+                       ? closer->count
+                       : (closer->count >= 2 && opener->count >= 2 ? 2 : 1);
+      int type = closer->ch == '~' ? MI_STRIKE : use == 2 ? MI_STRONG
+                                                          : MI_EMPH;
+      md_inl_t *emph = md_inl_new(c, type, NULL, 0);
+      md_delim_t *d;
+      if (!emph)
+        return;
+      opener->count -= use;
+      closer->count -= use;
+      opener->node->len -= use;
+      closer->node->s += use;
+      closer->node->len -= use;
+      md_inl_adopt(emph, opener->node, closer->node);
+      md_inl_insert_after(opener->node, emph);
+      for (d = closer->prev; d && d != opener;) {
+        md_delim_t *prev = d->prev;
+        md_delim_remove(c, d);
+        d = prev;
+      }
+      if (opener->count == 0) {
+        md_inl_unlink(opener->node);
+        md_delim_remove(c, opener);
+      }
+      if (closer->count == 0) {
+        md_delim_t *next = closer->next;
+        md_inl_unlink(closer->node);
+        md_delim_remove(c, closer);
+        closer = next;
+      }
+    } else {
+      md_delim_t *next = closer->next;
+      openers_bottom[idx][closer->orig % 3][closer->can_open ? 1 : 0] =
+          closer->prev;
+      if (!closer->can_open)
+        md_delim_remove(c, closer);
+      closer = next;
+    }
+  }
+  while (c->top && c->top != bottom)
+    md_delim_remove(c, c->top);
+}
+
+/* Parses "(destination "title")" after a closing bracket at s[i]. Bare
+ * destinations nest at most MD_MAX_LINK_PARENS parentheses and the last
+ * failed title scan is remembered, so a run of unclosed "](" does not
+ * rescan the rest of the text for every bracket. */
+static size_t md_parse_link_tail(md_inline_t *c, const char *s, size_t len,
+                                 size_t i, const char **out_url,
+                                 size_t *out_url_len) {
+  size_t j = i, url_start, url_end;
+  if (j >= len || s[j] != '(')
+    return 0;
+  j++;
+  while (j < len && md_is_space(s[j]))
+    j++;
+  if (j < len && s[j] == '<') {
+    url_start = ++j;
+    while (j < len && s[j] != '>' && s[j] != '\n' && s[j] != '<')
+      j++;
+    if (j >= len || s[j] != '>')
+      return 0;
+    url_end = j++;
   } else {
-    node->content = NULL;
+    int depth = 0;
+    url_start = j;
+    while (j < len && !md_is_space(s[j])) {
+      if (s[j] == '\\' && j + 1 < len && md_is_punct(s[j + 1])) {
+        j += 2;
+        continue;
+      }
+      if (s[j] == '(' && ++depth > MD_MAX_LINK_PARENS)
+        return 0;
+      if (s[j] == ')') {
+        if (depth == 0)
+          break;
+        depth--;
+      }
+      j++;
+    }
+    url_end = j;
   }
+  while (j < len && md_is_space(s[j]))
+    j++;
+  if (j < len && (s[j] == '"' || s[j] == '\'' || s[j] == '(')) {
+    char close = s[j] == '(' ? ')' : s[j];
+    int k = close == '"' ? 0 : close == '\'' ? 1 : 2;
+    size_t from = j++, to;
+    if (from >= c->title_from[k] && from < c->title_to[k])
+      return 0;
+    while (j < len && s[j] != close) {
+      if (s[j] == '\\' && j + 1 < len)
+        j++;
+      j++;
+    }
+    to = j++;
+    while (j < len && md_is_space(s[j]))
+      j++;
+    if (j >= len || s[j] != ')') {
+      c->title_from[k] = from;
+      c->title_to[k] = to;
+      return 0;
+    }
+  }
+  if (j >= len || s[j] != ')')
+    return 0;
+  *out_url = s + url_start;
+  *out_url_len = url_end - url_start;
+  return j + 1;
+}
 
-  return node;
+static void md_parse_inlines(md_inline_t *c, const char *s, size_t len) {
+  size_t i = 0;
+  memset(c->title_from, 0, sizeof(c->title_from));
+  memset(c->title_to, 0, sizeof(c->title_to));
+  while (i < len && !c->scratch->failed) {
+    char ch = s[i];
+    if (ch == '`') {
+      size_t run = 0, j, close = 0;
+      while (i + run < len && s[i + run] == '`')
+        run++;
+      /* Find a closing run of exactly the same length */
+      for (j = i + run; j < len; j += close) {
+        while (j < len && s[j] != '`')
+          j++;
+        close = 0;
+        while (j + close < len && s[j + close] == '`')
+          close++;
+        if (close == run)
+          break;
+      }
+      if (j < len) {
+        /* Code span: newlines become spaces, one padding space stripped */
+        size_t a = i + run, n = j - a, m;
+        char *code = (char *)md_alloc(c->scratch, n + 1);
+        md_inl_t *node;
+        if (!code)
+          return;
+        for (m = 0; m < n; ++m)
+          code[m] = s[a + m] == '\n' ? ' ' : s[a + m];
+        if (n >= 2 && code[0] == ' ' && code[n - 1] == ' ') {
+          for (m = 0; m < n && code[m] == ' '; ++m) {
+          }
+          if (m < n) {
+            code++;
+            n -= 2;
+          }
+        }
+        node = md_inl_new(c, MI_CODE, code, n);
+        if (node)
+          md_inl_append(c->root, node);
+        i = j + run;
+      } else {
+        md_text(c, s + i, run);
+        i += run;
+      }
+    } else if (ch == '\\') {
+      if (i + 1 < len && s[i + 1] == '\n') {
+        md_inl_t *br = md_inl_new(c, MI_BREAK, NULL, 0);
+        if (br)
+          md_inl_append(c->root, br);
+        i += 2;
+      } else if (i + 1 < len && md_is_punct(s[i + 1])) {
+        md_text(c, s + i + 1, 1);
+        i += 2;
+      } else {
+        md_text(c, s + i, 1);
+        i++;
+      }
+    } else if (ch == '*' || ch == '_' || ch == '~') {
+      size_t run = 0;
+      char before, after;
+      int left, right, can_open, can_close;
+      md_inl_t *node;
+      while (i + run < len && s[i + run] == ch)
+        run++;
+      before = i > 0 ? s[i - 1] : '\n';
+      after = i + run < len ? s[i + run] : '\n';
+      left = !md_is_space(after) &&
+             (!md_is_punct(after) || md_is_space(before) ||
+              md_is_punct(before));
+      right = !md_is_space(before) &&
+              (!md_is_punct(before) || md_is_space(after) ||
+               md_is_punct(after));
+      if (ch == '_') {
+        can_open = left && (!right || md_is_punct(before));
+        can_close = right && (!left || md_is_punct(after));
+      } else {
+        can_open = left;
+        can_close = right;
+      }
+      node = md_text(c, s + i, run);
+      if (node && (ch != '~' || run <= 2))
+        md_delim_push(c, node, ch, run, can_open, can_close);
+      i += run;
+    } else if (ch == '[' || (ch == '!' && i + 1 < len && s[i + 1] == '[')) {
+      size_t n = ch == '!' ? 2 : 1;
+      md_inl_t *node = md_text(c, s + i, n);
+      if (node)
+        md_delim_push(c, node, ch, 1, 0, 0);
+      i += n;
+    } else if (ch == ']') {
+      md_delim_t *opener = c->top;
+      const char *url;
+      size_t url_len, end;
+      while (opener && opener->ch != '[' && opener->ch != '!')
+        opener = opener->prev;
+      if (!opener) {
+        md_text(c, s + i, 1);
+        i++;
+        continue;
+      }
+      if (!opener->active ||
+          (end = md_parse_link_tail(c, s, len, i + 1, &url, &url_len)) ==
+              0) {
+        md_delim_remove(c, opener);
+        md_text(c, s + i, 1);
+        i++;
+        continue;
+      }
+      {
+        int image = opener->ch == '!';
+        md_inl_t *link = md_inl_new(c, image ? MI_IMAGE : MI_LINK, url,
+                                    url_len);
+        md_inl_t *opener_node = opener->node;
+        if (!link)
+          return;
+        md_process_emphasis(c, opener);
+        md_inl_adopt(link, opener_node, NULL);
+        md_inl_insert_after(opener_node, link);
+        md_inl_unlink(opener_node);
+        md_delim_remove(c, opener);
+        if (!image) {
+          /* No links inside links */
+          md_delim_t *d;
+          for (d = c->top; d; d = d->prev) {
+            if (d->ch == '[')
+              d->active = 0;
+          }
+        }
+        i = end;
+      }
+    } else if (ch == '<') {
+      /* Autolink: <scheme:...> */
+      size_t j = i + 1, scheme = 0;
+      while (j < len && (md_is_alpha(s[j]) || md_is_digit(s[j]) ||
+                         s[j] == '+' || s[j] == '.' || s[j] == '-'))
+        j++, scheme++;
+      if (scheme >= 2 && scheme <= 32 && md_is_alpha(s[i + 1]) && j < len &&
+          s[j] == ':') {
+        while (j < len && s[j] != '>' && s[j] != '<' && !md_is_space(s[j]))
+          j++;
+        if (j < len && s[j] == '>') {
+          md_inl_t *link = md_inl_new(c, MI_LINK, s + i + 1, j - i - 1);
+          md_inl_t *text = md_inl_new(c, MI_TEXT, s + i + 1, j - i - 1);
+          if (!link || !text)
+            return;
+          md_inl_append(c->root, link);
+          md_inl_append(link, text);
+          i = j + 1;
+          continue;
+        }
+      }
+      md_text(c, s + i, 1);
+      i++;
+    } else if (ch == '\n') {
+      /* Two trailing spaces make a hard break; others are dropped */
+      md_inl_t *last = c->root->last;
+      size_t spaces = 0;
+      if (last && last->type == MI_TEXT) {
+        while (spaces < last->len && last->s[last->len - spaces - 1] == ' ')
+          spaces++;
+        last->len -= spaces;
+      }
+      if (spaces >= 2) {
+        md_inl_t *br = md_inl_new(c, MI_BREAK, NULL, 0);
+        if (br)
+          md_inl_append(c->root, br);
+      } else {
+        md_text(c, s + i, 1);
+      }
+      i++;
+    } else {
+      size_t j = i + 1;
+      while (j < len && s[j] != '`' && s[j] != '\\' && s[j] != '*' &&
+             s[j] != '_' && s[j] != '~' && s[j] != '[' && s[j] != ']' &&
+             s[j] != '!' && s[j] != '<' && s[j] != '\n')
+        j++;
+      md_text(c, s + i, j - i);
+      i = j;
+    }
+  }
+  md_process_emphasis(c, NULL);
 }
 
-static int add_child(cmp_md_node_t *parent, cmp_md_node_t *child) {
-  if (!parent || !child)
-    return CMP_ERROR_INVALID_ARG;
+/* ------------------------------------------------------------------------ */
+/* Tree building                                                             */
+/* ------------------------------------------------------------------------ */
 
+typedef struct md_builder {
+  md_arena_t *out;
+  md_arena_t *scratch;
+} md_builder_t;
+
+static cmp_md_node_t *md_node(md_builder_t *b, cmp_md_node_type_t type) {
+  cmp_md_node_t *n = (cmp_md_node_t *)md_alloc(b->out, sizeof(cmp_md_node_t));
+  if (!n)
+    return NULL;
+  memset(n, 0, sizeof(cmp_md_node_t));
+  n->type = type;
+  return n;
+}
+
+static void md_node_add(md_builder_t *b, cmp_md_node_t *parent,
+                        cmp_md_node_t *child) {
+  if (!child)
+    return;
   if (parent->child_count == parent->child_capacity) {
-    size_t new_cap =
-        parent->child_capacity == 0 ? 4 : parent->child_capacity * 2;
-    cmp_md_node_t **new_arr = (cmp_md_node_t **)realloc(
-        parent->children, new_cap * sizeof(cmp_md_node_t *));
-    if (!new_arr)
-      return CMP_ERROR_OOM;
-    parent->children = new_arr;
-    parent->child_capacity = new_cap;
+    size_t cap = parent->child_capacity ? parent->child_capacity * 2 : 4;
+    cmp_md_node_t **arr = (cmp_md_node_t **)md_alloc(
+        b->out, cap * sizeof(cmp_md_node_t *));
+    if (!arr)
+      return;
+    if (parent->child_count)
+      memcpy(arr, parent->children,
+             parent->child_count * sizeof(cmp_md_node_t *));
+    parent->children = arr;
+    parent->child_capacity = cap;
   }
-
   parent->children[parent->child_count++] = child;
+}
+
+static void md_build_inl_children(md_builder_t *b, cmp_md_node_t *parent,
+                                  const md_inl_t *first);
+
+static cmp_md_node_t *md_build_inl(md_builder_t *b, const md_inl_t *n) {
+  cmp_md_node_t *out = NULL;
+  switch (n->type) {
+  case MI_CODE:
+    out = md_node(b, CMP_MD_NODE_INLINE_CODE);
+    if (out)
+      out->content = md_strdup(b->out, n->s, n->len);
+    break;
+  case MI_EMPH:
+    out = md_node(b, CMP_MD_NODE_ITALIC);
+    break;
+  case MI_STRONG:
+    out = md_node(b, CMP_MD_NODE_BOLD);
+    break;
+  case MI_STRIKE:
+    out = md_node(b, CMP_MD_NODE_STRIKETHROUGH);
+    break;
+  case MI_LINK:
+  case MI_IMAGE:
+    out = md_node(b, n->type == MI_LINK ? CMP_MD_NODE_LINK
+                                        : CMP_MD_NODE_IMAGE);
+    if (out)
+      out->content = md_strdup(b->out, n->s, n->len);
+    break;
+  case MI_BREAK:
+    out = md_node(b, CMP_MD_NODE_LINE_BREAK);
+    break;
+  default:
+    break;
+  }
+  if (out && n->first)
+    md_build_inl_children(b, out, n->first);
+  return out;
+}
+
+/* Adjacent text pieces are merged into one TEXT node. */
+static void md_build_inl_children(md_builder_t *b, cmp_md_node_t *parent,
+                                  const md_inl_t *n) {
+  while (n) {
+    if (n->type == MI_TEXT) {
+      const md_inl_t *m;
+      size_t total = 0;
+      char *text, *at;
+      cmp_md_node_t *node;
+      for (m = n; m && m->type == MI_TEXT; m = m->next)
+        total += m->len;
+      if (total > 0) {
+        text = (char *)md_alloc(b->out, total + 1);
+        node = md_node(b, CMP_MD_NODE_TEXT);
+        if (!text || !node)
+          return;
+        for (at = text; n != m; n = n->next) {
+          memcpy(at, n->s, n->len);
+          at += n->len;
+        }
+        *at = '\0';
+        node->content = text;
+        md_node_add(b, parent, node);
+      }
+      n = m;
+    } else {
+      md_node_add(b, parent, md_build_inl(b, n));
+      n = n->next;
+    }
+  }
+}
+
+static void md_build_inline(md_builder_t *b, cmp_md_node_t *parent,
+                            const char *s, size_t len) {
+  md_inline_t c;
+  c.scratch = b->scratch;
+  c.top = NULL;
+  c.root = md_inl_new(&c, MI_ROOT, NULL, 0);
+  if (!c.root)
+    return;
+  md_parse_inlines(&c, s, len);
+  md_build_inl_children(b, parent, c.root->first);
+}
+
+/* Joins leaf lines with newlines; paragraphs drop trailing spaces. */
+static char *md_join_lines(md_arena_t *a, const md_block_t *blk,
+                           int trailing_newline, size_t *out_len) {
+  const md_line_t *l;
+  size_t total = 0;
+  char *out, *at;
+  for (l = blk->lines; l; l = l->next)
+    total += l->len + 1;
+  out = (char *)md_alloc(a, total + 1);
+  if (!out)
+    return NULL;
+  at = out;
+  for (l = blk->lines; l; l = l->next) {
+    memcpy(at, l->s, l->len);
+    at += l->len;
+    if (l->next || trailing_newline)
+      *at++ = '\n';
+  }
+  if (!trailing_newline) {
+    while (at > out && (at[-1] == ' ' || at[-1] == '\n'))
+      at--;
+  }
+  *at = '\0';
+  *out_len = (size_t)(at - out);
+  return out;
+}
+
+static cmp_md_node_t *md_build_block(md_builder_t *b, const md_block_t *blk) {
+  cmp_md_node_t *n = NULL;
+  const md_block_t *child;
+  size_t len;
+  char *text;
+
+  switch (blk->kind) {
+  case MB_DOC:
+    n = md_node(b, CMP_MD_NODE_DOCUMENT);
+    break;
+  case MB_QUOTE:
+    n = md_node(b, CMP_MD_NODE_BLOCKQUOTE);
+    break;
+  case MB_LIST:
+    n = md_node(b, CMP_MD_NODE_LIST);
+    if (n)
+      n->level = blk->ordered ? blk->level : 0;
+    break;
+  case MB_ITEM:
+    n = md_node(b, CMP_MD_NODE_LIST_ITEM);
+    break;
+  case MB_HR:
+    return md_node(b, CMP_MD_NODE_THEMATIC_BREAK);
+  case MB_FENCE:
+  case MB_ICODE:
+    n = md_node(b, CMP_MD_NODE_CODE_BLOCK);
+    if (n)
+      n->content = md_join_lines(b->out, blk, blk->line_count > 0, &len);
+    return n;
+  case MB_PARA:
+  case MB_HEADING:
+    n = md_node(b, blk->kind == MB_PARA ? CMP_MD_NODE_PARAGRAPH
+                                        : CMP_MD_NODE_HEADER);
+    if (!n)
+      return NULL;
+    n->level = blk->kind == MB_HEADING ? blk->level : 0;
+    text = md_join_lines(b->scratch, blk, 0, &len);
+    if (text)
+      md_build_inline(b, n, text, len);
+    return n;
+  case MB_TABLE: {
+    const md_line_t *l;
+    const char *cells[64];
+    size_t lens[64], columns = 0;
+    n = md_node(b, CMP_MD_NODE_TABLE);
+    if (!n)
+      return NULL;
+    for (l = blk->lines; l; l = l->next) {
+      cmp_md_node_t *row = md_node(b, CMP_MD_NODE_TABLE_ROW);
+      size_t count = md_split_row(l->s, l->len, cells, lens, 64), c;
+      if (!row)
+        return n;
+      if (count > 64)
+        count = 64;
+      if (l == blk->lines)
+        columns = count;
+      for (c = 0; c < columns; ++c) {
+        cmp_md_node_t *cell = md_node(b, CMP_MD_NODE_TABLE_CELL);
+        if (!cell)
+          return n;
+        if (c < count)
+          md_build_inline(b, cell, cells[c], lens[c]);
+        md_node_add(b, row, cell);
+      }
+      md_node_add(b, n, row);
+    }
+    return n;
+  }
+  default:
+    break;
+  }
+  if (!n)
+    return NULL;
+  for (child = blk->first; child; child = child->next)
+    md_node_add(b, n, md_build_block(b, child));
+  return n;
+}
+
+/* ------------------------------------------------------------------------ */
+/* One-shot API                                                              */
+/* ------------------------------------------------------------------------ */
+
+struct cmp_markdown_parser {
+  int flags;
+};
+
+int cmp_md_node_destroy(cmp_md_node_t *node) {
+  size_t i;
+  if (!node) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  if (node->arena) {
+    /* Parser-built tree: every node lives in the root's arena */
+    md_arena_t *arena = (md_arena_t *)node->arena;
+    md_arena_free(arena);
+    CMP_FREE(arena);
+    return CMP_SUCCESS;
+  }
+
+  if (node->content) {
+    free(node->content);
+  }
+
+  for (i = 0; i < node->child_count; ++i) {
+    cmp_md_node_destroy(node->children[i]);
+  }
+
+  if (node->children) {
+    free(node->children);
+  }
+
+  free(node);
   return CMP_SUCCESS;
 }
 
@@ -79,8 +1471,8 @@ int cmp_markdown_parser_create(cmp_markdown_parser_t **out_parser) {
   if (!out_parser)
     return CMP_ERROR_INVALID_ARG;
 
-  parser = (cmp_markdown_parser_t *)malloc(sizeof(cmp_markdown_parser_t));
-  if (!parser)
+  if (CMP_MALLOC(sizeof(cmp_markdown_parser_t), (void **)&parser) !=
+      CMP_SUCCESS)
     return CMP_ERROR_OOM;
 
   parser->flags = 0;
@@ -91,42 +1483,281 @@ int cmp_markdown_parser_create(cmp_markdown_parser_t **out_parser) {
 int cmp_markdown_parser_destroy(cmp_markdown_parser_t *parser) {
   if (!parser)
     return CMP_ERROR_INVALID_ARG;
-  free(parser);
+  CMP_FREE(parser);
   return CMP_SUCCESS;
 }
 
 int cmp_markdown_parser_parse(cmp_markdown_parser_t *parser,
                               const char *markdown_text,
                               cmp_md_node_t **out_root) {
-  cmp_md_node_t *root;
-  cmp_md_node_t *p_node;
+  md_arena_t scratch;
+  md_arena_t *out;
+  md_parser_t p;
+  md_builder_t b;
+  cmp_md_node_t *root = NULL;
+  int res;
 
   if (!parser || !markdown_text || !out_root)
     return CMP_ERROR_INVALID_ARG;
 
-  /* Basic naive parsing strategy returning a root document element.
-     In full implementation, parses markdown into AST blocks and inlines. */
-  root = create_node(CMP_MD_NODE_PARAGRAPH, NULL);
-  if (!root)
+  if (CMP_MALLOC(sizeof(md_arena_t), (void **)&out) != CMP_SUCCESS)
     return CMP_ERROR_OOM;
+  memset(out, 0, sizeof(md_arena_t));
+  memset(&scratch, 0, sizeof(scratch));
+  memset(&p, 0, sizeof(p));
+  p.scratch = &scratch;
 
-  /* Very naive parsing just to ensure symbols map and logic holds for test */
-  if (markdown_text[0] == '#') {
-    p_node = create_node(CMP_MD_NODE_HEADER, markdown_text + 2);
-    p_node->level = 1;
-    add_child(root, p_node);
-  } else if (markdown_text[0] == '*') {
-    p_node = create_node(CMP_MD_NODE_LIST, NULL);
-    add_child(p_node, create_node(CMP_MD_NODE_LIST_ITEM, markdown_text + 2));
-    add_child(root, p_node);
-  } else if (markdown_text[0] == '>') {
-    p_node = create_node(CMP_MD_NODE_BLOCKQUOTE, markdown_text + 2);
-    add_child(root, p_node);
-  } else {
-    p_node = create_node(CMP_MD_NODE_TEXT, markdown_text);
-    add_child(root, p_node);
+  res = md_parse_blocks(&p, markdown_text, strlen(markdown_text), 0);
+  if (res == CMP_SUCCESS) {
+    md_close_to(&p, p.doc);
+    b.out = out;
+    b.scratch = &scratch;
+    root = md_build_block(&b, p.doc);
+    if (!root || out->failed || scratch.failed)
+      res = CMP_ERROR_OOM;
+  }
+  md_parser_release(&p);
+  md_arena_free(&scratch);
+  if (res != CMP_SUCCESS) {
+    md_arena_free(out);
+    CMP_FREE(out);
+    return res;
   }
 
+  root->arena = out;
   *out_root = root;
   return CMP_SUCCESS;
 }
+
+/* ------------------------------------------------------------------------ */
+/* Streaming API                                                             */
+/* ------------------------------------------------------------------------ */
+
+typedef struct md_stream_block {
+  size_t start;
+  size_t end;
+  cmp_md_node_t *node; /* Built on first request */
+} md_stream_block_t;
+
+struct cmp_md_stream {
+  char *text;
+  size_t len;
+  size_t cap;
+  size_t open_start; /* Where the trailing, still-open block begins */
+
+  md_stream_block_t *blocks; /* Closed top-level blocks */
+  size_t count;
+  size_t capacity;
+  md_arena_t nodes;
+
+  /* Blocks parsed from open_start to the end, rebuilt after each push */
+  int tail_valid;
+  cmp_md_node_t *tail; /* DOCUMENT node holding the open blocks */
+  md_arena_t tail_nodes;
+  md_arena_t scratch;
+  md_parser_t parser;
+  int finished;
+};
+
+static int md_stream_commit(struct cmp_md_stream *s, size_t start,
+                            size_t end) {
+  if (s->count == s->capacity) {
+    size_t cap = s->capacity ? s->capacity * 2 : 64;
+    md_stream_block_t *blocks;
+    if (CMP_MALLOC(cap * sizeof(md_stream_block_t), (void **)&blocks) !=
+        CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    if (s->count)
+      memcpy(blocks, s->blocks, s->count * sizeof(md_stream_block_t));
+    if (s->blocks)
+      CMP_FREE(s->blocks);
+    s->blocks = blocks;
+    s->capacity = cap;
+  }
+  s->blocks[s->count].start = start;
+  s->blocks[s->count].end = end;
+  s->blocks[s->count].node = NULL;
+  s->count++;
+  return CMP_SUCCESS;
+}
+
+/* Re-parses from the open block to the last complete line (or the end when
+ * finishing) and commits every top-level block that can no longer change. */
+static int md_stream_scan(struct cmp_md_stream *s, int finish) {
+  size_t end = s->len;
+  md_block_t *blk;
+  int res;
+
+  if (!finish) {
+    while (end > s->open_start && s->text[end - 1] != '\n')
+      end--;
+  }
+  if (end == s->open_start)
+    return CMP_SUCCESS;
+
+  md_arena_reset(&s->scratch);
+  res = md_parse_blocks(&s->parser, s->text + s->open_start,
+                        end - s->open_start, s->open_start);
+  if (res != CMP_SUCCESS)
+    return res;
+  if (finish)
+    md_close_to(&s->parser, s->parser.doc);
+
+  for (blk = s->parser.doc->first; blk; blk = blk->next) {
+    if (blk->open) {
+      s->open_start = blk->src_start;
+      return CMP_SUCCESS;
+    }
+    res = md_stream_commit(s, blk->src_start, blk->src_end);
+    if (res != CMP_SUCCESS)
+      return res;
+  }
+  s->open_start = end; /* Only blank lines remain */
+  return CMP_SUCCESS;
+}
+
+/* Builds a tree for text[start, end) into out; returns its DOCUMENT node. */
+static cmp_md_node_t *md_stream_build(struct cmp_md_stream *s, size_t start,
+                                      size_t end, md_arena_t *out) {
+  md_builder_t b;
+  md_arena_reset(&s->scratch);
+  if (md_parse_blocks(&s->parser, s->text ? s->text + start : "",
+                      end - start, start) !=
+      CMP_SUCCESS)
+    return NULL;
+  md_close_to(&s->parser, s->parser.doc);
+  b.out = out;
+  b.scratch = &s->scratch;
+  return md_build_block(&b, s->parser.doc);
+}
+
+static int md_stream_tail(struct cmp_md_stream *s) {
+  if (s->tail_valid)
+    return CMP_SUCCESS;
+  md_arena_reset(&s->tail_nodes);
+  s->tail = md_stream_build(s, s->open_start, s->len, &s->tail_nodes);
+  if (!s->tail || s->tail_nodes.failed || s->scratch.failed)
+    return CMP_ERROR_OOM;
+  s->tail_valid = 1;
+  return CMP_SUCCESS;
+}
+
+int cmp_md_stream_create(cmp_md_stream_t **out_stream) {
+  struct cmp_md_stream *s;
+  if (!out_stream)
+    return CMP_ERROR_INVALID_ARG;
+  if (CMP_MALLOC(sizeof(struct cmp_md_stream), (void **)&s) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(s, 0, sizeof(struct cmp_md_stream));
+  s->parser.scratch = &s->scratch;
+  *out_stream = (cmp_md_stream_t *)s;
+  return CMP_SUCCESS;
+}
+
+int cmp_md_stream_destroy(cmp_md_stream_t *stream) {
+  struct cmp_md_stream *s = (struct cmp_md_stream *)stream;
+  if (!s)
+    return CMP_ERROR_INVALID_ARG;
+  md_parser_release(&s->parser);
+  md_arena_free(&s->scratch);
+  md_arena_free(&s->nodes);
+  md_arena_free(&s->tail_nodes);
+  if (s->blocks)
+    CMP_FREE(s->blocks);
+  if (s->text)
+    CMP_FREE(s->text);
+  CMP_FREE(s);
+  return CMP_SUCCESS;
+}
+
+int cmp_md_stream_push(cmp_md_stream_t *stream, const char *chunk,
+                       size_t len) {
+  struct cmp_md_stream *s = (struct cmp_md_stream *)stream;
+  if (!s || (!chunk && len > 0))
+    return CMP_ERROR_INVALID_ARG;
+  if (s->finished)
+    return CMP_ERROR_INVALID_STATE;
+  if (len == 0)
+    return CMP_SUCCESS;
+  if (s->len + len > s->cap) {
+    char *text;
+    size_t cap = s->cap ? s->cap * 2 : 4096;
+    while (cap < s->len + len)
+      cap *= 2;
+    if (CMP_MALLOC(cap, (void **)&text) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    if (s->len)
+      memcpy(text, s->text, s->len);
+    if (s->text)
+      CMP_FREE(s->text);
+    s->text = text;
+    s->cap = cap;
+  }
+  memcpy(s->text + s->len, chunk, len);
+  s->len += len;
+  s->tail_valid = 0;
+
+  /* Nothing can close until a chunk completes a line */
+  if (!memchr(chunk, '\n', len))
+    return CMP_SUCCESS;
+  return md_stream_scan(s, 0);
+}
+
+int cmp_md_stream_finish(cmp_md_stream_t *stream) {
+  struct cmp_md_stream *s = (struct cmp_md_stream *)stream;
+  int res;
+  if (!s)
+    return CMP_ERROR_INVALID_ARG;
+  if (s->finished)
+    return CMP_SUCCESS;
+  res = md_stream_scan(s, 1);
+  if (res != CMP_SUCCESS)
+    return res;
+  s->open_start = s->len;
+  s->tail_valid = 0;
+  s->finished = 1;
+  return CMP_SUCCESS;
+}
+
+int cmp_md_stream_get_block_count(cmp_md_stream_t *stream, size_t *out_count) {
+  struct cmp_md_stream *s = (struct cmp_md_stream *)stream;
+  int res;
+  if (!s || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  res = md_stream_tail(s);
+  if (res != CMP_SUCCESS)
+    return res;
+  *out_count = s->count + s->tail->child_count;
+  return CMP_SUCCESS;
+}
+
+int cmp_md_stream_get_block(cmp_md_stream_t *stream, size_t index,
+                            const cmp_md_node_t **out_node, int *out_closed) {
+  struct cmp_md_stream *s = (struct cmp_md_stream *)stream;
+  int res;
+  if (!s || !out_node)
+    return CMP_ERROR_INVALID_ARG;
+  if (index < s->count) {
+    md_stream_block_t *blk = &s->blocks[index];
+    if (!blk->node) {
+      cmp_md_node_t *doc = md_stream_build(s, blk->start, blk->end, &s->nodes);
+      if (!doc || s->nodes.failed || s->scratch.failed ||
+          doc->child_count == 0)
+        return CMP_ERROR_OOM;
+      blk->node = doc->children[0];
+    }
+    *out_node = blk->node;
+    if (out_closed)
+      *out_closed = 1;
+    return CMP_SUCCESS;
+  }
+  res = md_stream_tail(s);
+  if (res != CMP_SUCCESS)
+    return res;
+  if (index - s->count >= s->tail->child_count)
+    return CMP_ERROR_BOUNDS;
+  *out_node = s->tail->children[index - s->count];
+  if (out_closed)
+    *out_closed = 0;
+  return CMP_SUCCESS;
+}
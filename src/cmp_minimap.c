@@ -4,14 +4,312 @@
 #include <string.h>
 /* clang-format on */
 
+#define MINIMAP_TAB_SIZE 4
+#define MINIMAP_MIN_SLOTS 4
+#define MINIMAP_DEFAULT_WIDTH 120
+
+/* Word-at-a-time byte tests: a word of spaces, and whether any byte of a
+ * word is a control/space (< 0x21) or non-ASCII (>= 0x80). */
+#define MINIMAP_ONES ((unsigned long)-1 / 0xFF)
+#define MINIMAP_HIGHS (MINIMAP_ONES * 0x80)
+#define MINIMAP_SPACES (MINIMAP_ONES * 0x20)
+
+typedef struct cmp_minimap_tile {
+  size_t index; /* First line / CMP_MINIMAP_TILE_LINES */
+  size_t rows;  /* Pixel rows holding data */
+  unsigned long version;
+  unsigned long last_used;
+  int valid;
+  unsigned char *pixels;
+} cmp_minimap_tile_t;
+
 struct cmp_minimap {
-  char *text;
+  cmp_text_buffer_t *own_buffer; /* Backs cmp_minimap_set_text */
+  const cmp_text_buffer_t *buffer;
+  cmp_syntax_document_t *syntax;
+  size_t width;
+  size_t height;
+  size_t line_px;
+  size_t chars_per_px;
+  cmp_minimap_tile_t *tiles;
+  size_t tile_count;
+  unsigned long clock; /* Source of LRU stamps and tile versions */
+  unsigned int *ink;   /* Per-column ink counts for the row being built */
+  unsigned char *cls;  /* Per-column token of the first inked byte */
+  cmp_minimap_layout_t layout;
   float viewport_y;
   float viewport_height;
   float total_height;
   float scroll_ratio; /* Calculated ratio [0.0 - 1.0] */
 };
 
+static void minimap_free_tiles(cmp_minimap_t *minimap) {
+  size_t i;
+  for (i = 0; i < minimap->tile_count; ++i) {
+    free(minimap->tiles[i].pixels);
+  }
+  free(minimap->tiles);
+  free(minimap->ink);
+  free(minimap->cls);
+  minimap->tiles = NULL;
+  minimap->tile_count = 0;
+  minimap->ink = NULL;
+  minimap->cls = NULL;
+}
+
+/* Sizes the tile cache so the visible lines plus one tile of slack on each
+ * side stay resident while scrolling. */
+static int minimap_alloc_tiles(cmp_minimap_t *minimap) {
+  size_t visible = minimap->height / minimap->line_px + 1;
+  size_t count = visible / CMP_MINIMAP_TILE_LINES + 4;
+  size_t bytes = CMP_MINIMAP_TILE_LINES * minimap->line_px * minimap->width;
+  size_t i;
+
+  if (count < MINIMAP_MIN_SLOTS) {
+    count = MINIMAP_MIN_SLOTS;
+  }
+  minimap->tiles =
+      (cmp_minimap_tile_t *)calloc(count, sizeof(cmp_minimap_tile_t));
+  minimap->ink = (unsigned int *)calloc(minimap->width, sizeof(unsigned int));
+  minimap->cls = (unsigned char *)malloc(minimap->width);
+  if (!minimap->tiles || !minimap->ink || !minimap->cls) {
+    minimap_free_tiles(minimap);
+    return CMP_ERROR_OOM;
+  }
+  minimap->tile_count = count;
+  for (i = 0; i < count; ++i) {
+    minimap->tiles[i].pixels = (unsigned char *)malloc(bytes);
+    if (!minimap->tiles[i].pixels) {
+      minimap_free_tiles(minimap);
+      return CMP_ERROR_OOM;
+    }
+  }
+  return CMP_SUCCESS;
+}
+
+static void minimap_invalidate_all(cmp_minimap_t *minimap) {
+  size_t i;
+  for (i = 0; i < minimap->tile_count; ++i) {
+    minimap->tiles[i].valid = 0;
+  }
+}
+
+static size_t minimap_line_count(const cmp_minimap_t *minimap) {
+  size_t count = 0;
+  if (!minimap->buffer ||
+      cmp_text_buffer_get_line_count(minimap->buffer, &count) != CMP_SUCCESS) {
+    return 0;
+  }
+  return count;
+}
+
+/* Turns the accumulated ink of one line into pixels and resets the scratch
+ * columns it used. */
+static void minimap_emit_row(cmp_minimap_t *minimap, unsigned char *row,
+                             size_t used) {
+  size_t cpp = minimap->chars_per_px;
+  size_t x;
+
+  for (x = 0; x < used; ++x) {
+    unsigned int ink = minimap->ink[x];
+    if (ink) {
+      unsigned int level = (unsigned int)((ink * 15 + cpp - 1) / cpp);
+      row[x] = (unsigned char)((level > 15 ? 15 : level) << 4 |
+                               (minimap->cls[x] & 0x0F));
+      minimap->ink[x] = 0;
+    }
+  }
+  if (minimap->line_px == 2) {
+    memcpy(row + minimap->width, row, minimap->width);
+  }
+}
+
+/* Offset where the token class of the byte at off stops being constant. */
+static size_t minimap_run_end(const cmp_highlight_span_t *spans, size_t count,
+                              size_t *cursor, size_t off, unsigned char *cls) {
+  size_t s = *cursor;
+  while (s < count && spans[s].start_offset + spans[s].length <= off) {
+    s++;
+  }
+  *cursor = s;
+  if (s >= count) {
+    *cls = CMP_TOKEN_NORMAL;
+    return (size_t)-1;
+  }
+  if (spans[s].start_offset > off) {
+    *cls = CMP_TOKEN_NORMAL;
+    return spans[s].start_offset;
+  }
+  *cls = (unsigned char)spans[s].type;
+  return spans[s].start_offset + spans[s].length;
+}
+
+static int minimap_rasterize(cmp_minimap_t *minimap, cmp_minimap_tile_t *tile,
+                             size_t index, size_t line_count) {
+  const cmp_highlight_span_t *spans = NULL;
+  size_t span_count = 0, cursor = 0;
+  size_t first = index * CMP_MINIMAP_TILE_LINES;
+  size_t lines = line_count - first;
+  size_t row_bytes = minimap->line_px * minimap->width;
+  size_t limit = minimap->width * minimap->chars_per_px;
+  size_t cpp = minimap->chars_per_px;
+  size_t pos, end, col = 0, used = 0, row = 0;
+  size_t run_end = 0;
+  unsigned char cls = CMP_TOKEN_NORMAL;
+  int res;
+
+  if (lines > CMP_MINIMAP_TILE_LINES) {
+    lines = CMP_MINIMAP_TILE_LINES;
+  }
+  res = cmp_text_buffer_line_to_offset(minimap->buffer, first, &pos);
+  if (res == CMP_SUCCESS) {
+    res = first + lines < line_count
+              ? cmp_text_buffer_line_to_offset(minimap->buffer, first + lines,
+                                               &end)
+              : cmp_text_buffer_get_length(minimap->buffer, &end);
+  }
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  if (minimap->syntax &&
+      cmp_syntax_document_highlight(minimap->syntax, first, lines, &spans,
+                                    &span_count) != CMP_SUCCESS) {
+    span_count = 0;
+  }
+  memset(tile->pixels, 0, CMP_MINIMAP_TILE_LINES * row_bytes);
+
+  while (pos < end) {
+    const char *data;
+    const unsigned char *p, *stop, *base;
+    size_t len;
+
+    res = cmp_text_buffer_get_chunk(minimap->buffer, pos, &data, &len);
+    if (res != CMP_SUCCESS) {
+      return res;
+    }
+    if (len == 0) {
+      break;
+    }
+    if (len > end - pos) {
+      len = end - pos;
+    }
+    base = p = (const unsigned char *)data;
+    stop = p + len;
+
+    while (p < stop) {
+      size_t off = pos + (size_t)(p - base);
+      unsigned char c = *p;
+
+      if (c == '\n') {
+        minimap_emit_row(minimap, tile->pixels + row * row_bytes, used);
+        row++;
+        col = used = 0;
+        p++;
+        continue;
+      }
+      if (col >= limit) {
+        /* Past the right edge: the rest of the line cannot draw. */
+        const unsigned char *nl =
+            (const unsigned char *)memchr(p, '\n', (size_t)(stop - p));
+        p = nl ? nl : stop;
+        continue;
+      }
+      if (off >= run_end) {
+        run_end = minimap_run_end(spans, span_count, &cursor, off, &cls);
+      }
+      if ((size_t)(stop - p) >= sizeof(unsigned long) &&
+          run_end - off >= sizeof(unsigned long) &&
+          col + sizeof(unsigned long) <= limit) {
+        unsigned long w;
+        memcpy(&w, p, sizeof(w));
+        if (w == MINIMAP_SPACES) {
+          col += sizeof(w);
+          p += sizeof(w);
+          continue;
+        }
+        if (!(((w - MINIMAP_ONES * 0x21) | w) & MINIMAP_HIGHS)) {
+          /* A word of printable ASCII in one token: all ink. */
+          size_t k;
+          for (k = 0; k < sizeof(w); ++k, ++col) {
+            size_t x = col / cpp;
+            if (!minimap->ink[x]++) {
+              minimap->cls[x] = cls;
+            }
+          }
+          used = col / cpp;
+          if (used * cpp < col) {
+            used++;
+          }
+          p += sizeof(w);
+          continue;
+        }
+      }
+      if (c == '\t') {
+        col = (col / MINIMAP_TAB_SIZE + 1) * MINIMAP_TAB_SIZE;
+      } else if (c > 0x20 && c != 0x7F && (c & 0xC0) != 0x80) {
+        size_t x = col / cpp;
+        if (!minimap->ink[x]++) {
+          minimap->cls[x] = cls;
+        }
+        col++;
+        if (x + 1 > used) {
+          used = x + 1;
+        }
+      } else if (c == ' ') {
+        col++;
+      }
+      p++;
+    }
+    pos += len;
+  }
+  if (row < lines) {
+    minimap_emit_row(minimap, tile->pixels + row * row_bytes, used);
+  }
+
+  tile->index = index;
+  tile->rows = lines * minimap->line_px;
+  tile->version = ++minimap->clock;
+  tile->valid = 1;
+  return CMP_SUCCESS;
+}
+
+/* Returns the cached tile, rasterizing it into the least recently used slot
+ * when missing or stale. */
+static int minimap_fetch_tile(cmp_minimap_t *minimap, size_t index,
+                              size_t line_count, cmp_minimap_tile_t **out) {
+  cmp_minimap_tile_t *victim = NULL;
+  size_t i;
+  int res;
+
+  if (!minimap->tiles) {
+    res = minimap_alloc_tiles(minimap);
+    if (res != CMP_SUCCESS) {
+      return res;
+    }
+  }
+  for (i = 0; i < minimap->tile_count; ++i) {
+    cmp_minimap_tile_t *tile = &minimap->tiles[i];
+    if (tile->valid && tile->index == index) {
+      tile->last_used = ++minimap->clock;
+      *out = tile;
+      return CMP_SUCCESS;
+    }
+    if (!victim || (victim->valid && !tile->valid) ||
+        (victim->valid == tile->valid &&
+         tile->last_used < victim->last_used)) {
+      victim = tile;
+    }
+  }
+  victim->valid = 0;
+  res = minimap_rasterize(minimap, victim, index, line_count);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  victim->last_used = ++minimap->clock;
+  *out = victim;
+  return CMP_SUCCESS;
+}
+
 int cmp_minimap_create(cmp_minimap_t **out_minimap) {
   cmp_minimap_t *minimap;
   if (!out_minimap) {
@@ -23,7 +321,10 @@ int cmp_minimap_create(cmp_minimap_t **out_minimap) {
     return CMP_ERROR_OOM;
   }
 
-  minimap->text = NULL;
+  memset(minimap, 0, sizeof(*minimap));
+  minimap->width = MINIMAP_DEFAULT_WIDTH;
+  minimap->line_px = 2;
+  minimap->chars_per_px = 1;
   minimap->viewport_y = 0.0f;
   minimap->viewport_height = 0.0f;
   minimap->total_height = 0.0f;
@@ -38,33 +339,99 @@ int cmp_minimap_destroy(cmp_minimap_t *minimap) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  if (minimap->text) {
-    free(minimap->text);
+  minimap_free_tiles(minimap);
+  if (minimap->own_buffer) {
+    cmp_text_buffer_destroy(minimap->own_buffer);
   }
   free(minimap);
   return CMP_SUCCESS;
 }
 
 int cmp_minimap_set_text(cmp_minimap_t *minimap, const char *text) {
-  size_t len;
+  int res;
   if (!minimap || !text) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  if (minimap->text) {
-    free(minimap->text);
-    minimap->text = NULL;
+  if (!minimap->own_buffer) {
+    res = cmp_text_buffer_create(&minimap->own_buffer);
+    if (res != CMP_SUCCESS) {
+      return res;
+    }
+  }
+  res = cmp_text_buffer_set_text(minimap->own_buffer, text, strlen(text));
+  if (res != CMP_SUCCESS) {
+    return res;
   }
 
-  len = strlen(text);
-  minimap->text = (char *)malloc(len + 1);
-  if (!minimap->text) {
-    return CMP_ERROR_OOM;
+  minimap->buffer = minimap->own_buffer;
+  minimap->syntax = NULL;
+  minimap_invalidate_all(minimap);
+  return CMP_SUCCESS;
+}
+
+int cmp_minimap_set_buffer(cmp_minimap_t *minimap,
+                           const cmp_text_buffer_t *buffer) {
+  if (!minimap) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  minimap->buffer = buffer;
+  minimap->syntax = NULL;
+  minimap_invalidate_all(minimap);
+  return CMP_SUCCESS;
+}
+
+int cmp_minimap_set_syntax(cmp_minimap_t *minimap,
+                           cmp_syntax_document_t *doc) {
+  if (!minimap) {
+    return CMP_ERROR_INVALID_ARG;
   }
 
-  strncpy(minimap->text, text, len);
-  minimap->text[len] = '\0';
+  minimap->syntax = doc;
+  minimap_invalidate_all(minimap);
+  return CMP_SUCCESS;
+}
 
+int cmp_minimap_edit(cmp_minimap_t *minimap, size_t start_line,
+                     size_t old_end_line, size_t new_end_line) {
+  size_t i;
+  int shifted;
+  if (!minimap || old_end_line < start_line || new_end_line < start_line) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  /* Lines below a resizing edit move, and a token state change (e.g. an
+   * opened comment) can recolor them, so those tiles go too. */
+  shifted = old_end_line != new_end_line || minimap->syntax != NULL;
+  for (i = 0; i < minimap->tile_count; ++i) {
+    cmp_minimap_tile_t *tile = &minimap->tiles[i];
+    size_t first = tile->index * CMP_MINIMAP_TILE_LINES;
+    size_t last = first + CMP_MINIMAP_TILE_LINES - 1;
+    if (tile->valid && last >= start_line &&
+        (shifted || first <= new_end_line)) {
+      tile->valid = 0;
+    }
+  }
+  return CMP_SUCCESS;
+}
+
+int cmp_minimap_set_size(cmp_minimap_t *minimap, size_t width_px,
+                         size_t height_px, size_t line_px,
+                         size_t chars_per_px) {
+  if (!minimap || width_px == 0 || (line_px != 1 && line_px != 2) ||
+      chars_per_px == 0) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  if (width_px != minimap->width || height_px != minimap->height ||
+      line_px != minimap->line_px || chars_per_px != minimap->chars_per_px) {
+    minimap_free_tiles(minimap);
+  }
+  minimap->width = width_px;
+  minimap->height = height_px;
+  minimap->line_px = line_px;
+  minimap->chars_per_px = chars_per_px;
   return CMP_SUCCESS;
 }
 
@@ -93,11 +460,94 @@ int cmp_minimap_update_viewport(cmp_minimap_t *minimap, float viewport_y,
 }
 
 int cmp_minimap_compute_layout(cmp_minimap_t *minimap) {
+  cmp_minimap_layout_t *layout;
+  size_t lines, tile, last_tile;
+  float line_px, content, scroll;
+  int res;
+
   if (!minimap) {
     return CMP_ERROR_INVALID_ARG;
   }
-  /* In a full implementation, this parses minimap->text, mapping line lengths
-     to 2-pixel wide dense blocks, and calculates the highlighted region via
-     scroll_ratio. */
+
+  layout = &minimap->layout;
+  memset(layout, 0, sizeof(*layout));
+  lines = minimap_line_count(minimap);
+  if (lines == 0 || minimap->height == 0) {
+    return CMP_SUCCESS;
+  }
+
+  /* A minimap taller than its pane scrolls in step with the editor. */
+  line_px = (float)minimap->line_px;
+  content = (float)lines * line_px;
+  scroll = 0.0f;
+  if (content > (float)minimap->height) {
+    scroll = minimap->scroll_ratio * (content - (float)minimap->height);
+  }
+  layout->first_line = (size_t)(scroll / line_px);
+  if (layout->first_line >= lines) {
+    layout->first_line = lines - 1;
+  }
+  layout->offset_y = scroll - (float)layout->first_line * line_px;
+  layout->line_count =
+      (size_t)(((float)minimap->height + layout->offset_y) / line_px) + 1;
+  if (layout->line_count > lines - layout->first_line) {
+    layout->line_count = lines - layout->first_line;
+  }
+  if (minimap->total_height > 0.0f) {
+    layout->slider_y =
+        minimap->viewport_y / minimap->total_height * content - scroll;
+    layout->slider_height =
+        minimap->viewport_height / minimap->total_height * content;
+  }
+
+  /* Only tiles under the pane are rasterized. */
+  last_tile =
+      (layout->first_line + layout->line_count - 1) / CMP_MINIMAP_TILE_LINES;
+  for (tile = layout->first_line / CMP_MINIMAP_TILE_LINES; tile <= last_tile;
+       ++tile) {
+    cmp_minimap_tile_t *unused;
+    res = minimap_fetch_tile(minimap, tile, lines, &unused);
+    if (res != CMP_SUCCESS) {
+      return res;
+    }
+  }
+  return CMP_SUCCESS;
+}
+
+int cmp_minimap_get_layout(const cmp_minimap_t *minimap,
+                           cmp_minimap_layout_t *out_layout) {
+  if (!minimap || !out_layout) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  *out_layout = minimap->layout;
+  return CMP_SUCCESS;
+}
+
+int cmp_minimap_get_tile(cmp_minimap_t *minimap, size_t tile_index,
+                         const unsigned char **out_pixels, size_t *out_rows,
+                         unsigned long *out_version) {
+  cmp_minimap_tile_t *tile;
+  size_t lines;
+  int res;
+
+  if (!minimap || !out_pixels || !out_rows) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  lines = minimap_line_count(minimap);
+  if (tile_index >= (lines + CMP_MINIMAP_TILE_LINES - 1) /
+                        CMP_MINIMAP_TILE_LINES) {
+    return CMP_ERROR_BOUNDS;
+  }
+  res = minimap_fetch_tile(minimap, tile_index, lines, &tile);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  *out_pixels = tile->pixels;
+  *out_rows = tile->rows;
+  if (out_version) {
+    *out_version = tile->version;
+  }
   return CMP_SUCCESS;
 }
@@ -21,6 +21,7 @@ typedef struct cmp_task_node {
 typedef struct cmp_modality_single_state {
   cmp_task_node_t *head;
   cmp_task_node_t *tail;
+  cmp_mutex_t lock; /* Workers may queue results back to the loop thread */
 } cmp_modality_single_state_t;
 
 typedef struct cmp_modality_threaded_state {
@@ -135,6 +136,10 @@ int cmp_modality_single_init(cmp_modality_t *mod) {
 
   state->head = NULL;
   state->tail = NULL;
+  if (cmp_mutex_init(&state->lock) != CMP_SUCCESS) {
+    CMP_FREE(state);
+    return CMP_ERROR_GENERAL;
+  }
 
   mod->type = CMP_MODALITY_SINGLE;
   mod->internal_state = state;
@@ -165,6 +170,7 @@ int cmp_modality_queue_task(cmp_modality_t *mod, cmp_task_fn_t task,
     node->arg = arg;
     node->next = NULL;
 
+    cmp_mutex_lock(&state->lock);
     if (state->tail == NULL) {
       state->head = node;
       state->tail = node;
@@ -172,6 +178,7 @@ int cmp_modality_queue_task(cmp_modality_t *mod, cmp_task_fn_t task,
       state->tail->next = node;
       state->tail = node;
     }
+    cmp_mutex_unlock(&state->lock);
   } else if (mod->type == CMP_MODALITY_THREADED) {
     cmp_modality_threaded_state_t *tstate =
         (cmp_modality_threaded_state_t *)mod->internal_state;
@@ -219,13 +226,17 @@ int cmp_modality_run(cmp_modality_t *mod) {
   mod->is_running = 1;
 
   while (mod->is_running) {
-    if (state->head != NULL) {
-      node = state->head;
+    cmp_mutex_lock(&state->lock);
+    node = state->head;
+    if (node != NULL) {
       state->head = node->next;
       if (state->head == NULL) {
         state->tail = NULL;
       }
+    }
+    cmp_mutex_unlock(&state->lock);
 
+    if (node != NULL) {
       node->fn(node->arg);
       CMP_FREE(node);
     } else {
@@ -267,6 +278,7 @@ int cmp_modality_destroy(cmp_modality_t *mod) {
       curr = next;
     }
 
+    cmp_mutex_destroy(&state->lock);
     CMP_FREE(state);
   } else if (mod->type == CMP_MODALITY_THREADED) {
     cmp_modality_threaded_state_t *state =
@@ -1,19 +1,553 @@
 /* clang-format off */
 #include "cmp.h"
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 /* clang-format on */
 
+#define MSAA_MAX_SAMPLES 16
+#define MSAA_MAX_CORNER_SEGMENTS 64
+
+/* Standard sample patterns in 1/16 pixel offsets from the pixel centre. */
+static const signed char msaa_pattern_1[1][2] = {{0, 0}};
+static const signed char msaa_pattern_2[2][2] = {{4, 4}, {-4, -4}};
+static const signed char msaa_pattern_4[4][2] = {
+    {-2, -6}, {6, -2}, {-6, 2}, {2, 6}};
+static const signed char msaa_pattern_8[8][2] = {
+    {1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}};
+static const signed char msaa_pattern_16[16][2] = {
+    {1, 1},  {-1, -3}, {-3, 2}, {4, -1}, {-5, -2}, {2, 5},  {5, 3},  {3, -5},
+    {-2, 6}, {0, -7},  {-4, -6}, {-6, 4}, {-8, 0},  {7, -4}, {6, 7}, {-7, -8}};
+
+typedef struct msaa_edge {
+  float x0, y0, x1, y1; /* y0 < y1 */
+  int dir;              /* +1 downward in the source, -1 upward */
+} msaa_edge_t;
+
+typedef struct msaa_crossing {
+  float x;
+  int dir;
+} msaa_crossing_t;
+
 struct cmp_msaa {
   uint8_t sample_count;
   uint32_t width;
   uint32_t height;
-  void *internal_renderbuffer;
+  cmp_msaa_mode_t mode;
+
+  /* Premultiplied RGBA8 for every pixel. Edge pixels additionally own a
+   * block of sample_count samples; edge_slot holds 1 + the block index. */
+  unsigned char *color;
+  uint32_t *edge_slot;
+  unsigned char *samples;
+  size_t sample_blocks;
+  size_t sample_block_cap;
+
+  /* Per-fill scratch, reused between calls. */
+  msaa_edge_t *edges;
+  size_t edge_cap;
+  size_t *active; /* Edges overlapping the current row, indices into edges */
+  size_t active_cap;
+  msaa_crossing_t *crossings;
+  size_t crossing_cap;
+  float *spans;
+  size_t span_cap;
+  int *counts;
+  float *acc;
+  size_t acc_cap;
+
+  size_t pixels_filled;
 };
 
+static int msaa_reserve(void **buf, size_t *cap, size_t need, size_t elem) {
+  void *grown;
+  size_t n;
+  if (need <= *cap)
+    return CMP_SUCCESS;
+  n = *cap ? *cap : 64;
+  while (n < need)
+    n *= 2;
+  if (CMP_MALLOC(n * elem, &grown) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  if (*buf) {
+    memcpy(grown, *buf, *cap * elem);
+    CMP_FREE(*buf);
+  }
+  *buf = grown;
+  *cap = n;
+  return CMP_SUCCESS;
+}
+
+static const signed char (*msaa_pattern(int count))[2] {
+  switch (count) {
+  case 1:
+    return msaa_pattern_1;
+  case 2:
+    return msaa_pattern_2;
+  case 4:
+    return msaa_pattern_4;
+  case 8:
+    return msaa_pattern_8;
+  default:
+    return msaa_pattern_16;
+  }
+}
+
+static void msaa_premultiply(const cmp_color_t *c, unsigned char out[4]) {
+  float a = c->a < 0.0f ? 0.0f : (c->a > 1.0f ? 1.0f : c->a);
+  float r = c->r < 0.0f ? 0.0f : (c->r > 1.0f ? 1.0f : c->r);
+  float g = c->g < 0.0f ? 0.0f : (c->g > 1.0f ? 1.0f : c->g);
+  float b = c->b < 0.0f ? 0.0f : (c->b > 1.0f ? 1.0f : c->b);
+  out[0] = (unsigned char)(r * a * 255.0f + 0.5f);
+  out[1] = (unsigned char)(g * a * 255.0f + 0.5f);
+  out[2] = (unsigned char)(b * a * 255.0f + 0.5f);
+  out[3] = (unsigned char)(a * 255.0f + 0.5f);
+}
+
+/* Source-over of a premultiplied color scaled by cov (0..256). */
+static void msaa_blend(unsigned char *dst, const unsigned char *src,
+                       unsigned int cov) {
+  unsigned int inv;
+  int i;
+  if (cov >= 256 && src[3] == 255) {
+    memcpy(dst, src, 4);
+    return;
+  }
+  inv = 255 - ((src[3] * cov + 128) >> 8);
+  for (i = 0; i < 4; ++i)
+    dst[i] = (unsigned char)(((src[i] * cov + 128) >> 8) +
+                             (dst[i] * inv + 127) / 255);
+}
+
+/* Blend into a pixel, including every stored sample if it is an edge pixel. */
+static void msaa_blend_pixel(cmp_msaa_t *msaa, size_t idx,
+                             const unsigned char *src, unsigned int cov) {
+  msaa_blend(msaa->color + idx * 4, src, cov);
+  if (msaa->edge_slot && msaa->edge_slot[idx]) {
+    unsigned char *s = msaa->samples + (size_t)(msaa->edge_slot[idx] - 1) *
+                                           msaa->sample_count * 4;
+    int i;
+    for (i = 0; i < msaa->sample_count; ++i)
+      msaa_blend(s + i * 4, src, cov);
+  }
+  msaa->pixels_filled++;
+}
+
+static unsigned char *msaa_edge_samples(cmp_msaa_t *msaa, size_t idx) {
+  size_t block_bytes = (size_t)msaa->sample_count * 4;
+  unsigned char *s;
+  int i;
+
+  if (!msaa->edge_slot) {
+    size_t n = (size_t)msaa->width * msaa->height;
+    if (CMP_MALLOC(n * sizeof(uint32_t), (void **)&msaa->edge_slot) !=
+        CMP_SUCCESS) {
+      msaa->edge_slot = NULL;
+      return NULL;
+    }
+    memset(msaa->edge_slot, 0, n * sizeof(uint32_t));
+  }
+  if (msaa->edge_slot[idx])
+    return msaa->samples + (size_t)(msaa->edge_slot[idx] - 1) * block_bytes;
+
+  if (msaa_reserve((void **)&msaa->samples, &msaa->sample_block_cap,
+                   msaa->sample_blocks + 1, block_bytes) != CMP_SUCCESS)
+    return NULL;
+  s = msaa->samples + msaa->sample_blocks * block_bytes;
+  for (i = 0; i < msaa->sample_count; ++i)
+    memcpy(s + i * 4, msaa->color + idx * 4, 4);
+  msaa->sample_blocks++;
+  msaa->edge_slot[idx] = (uint32_t)msaa->sample_blocks;
+  return s;
+}
+
+static int msaa_build_edges(cmp_msaa_t *msaa, const float *points,
+                            const size_t *contour_counts, size_t contour_count,
+                            size_t *out_count, float bounds[4]) {
+  size_t c, i, base = 0, n = 0, total = 0;
+
+  for (c = 0; c < contour_count; ++c)
+    total += contour_counts[c];
+  if (msaa_reserve((void **)&msaa->edges, &msaa->edge_cap, total + 1,
+                   sizeof(msaa_edge_t)) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+
+  bounds[0] = bounds[1] = 1e30f;
+  bounds[2] = bounds[3] = -1e30f;
+  for (c = 0; c < contour_count; ++c) {
+    size_t cnt = contour_counts[c];
+    for (i = 0; i < cnt; ++i) {
+      const float *p0 = points + (base + i) * 2;
+      const float *p1 = points + (base + (i + 1) % cnt) * 2;
+      msaa_edge_t *e = &msaa->edges[n];
+      if (p0[0] < bounds[0])
+        bounds[0] = p0[0];
+      if (p0[1] < bounds[1])
+        bounds[1] = p0[1];
+      if (p0[0] > bounds[2])
+        bounds[2] = p0[0];
+      if (p0[1] > bounds[3])
+        bounds[3] = p0[1];
+      if (p0[1] == p1[1])
+        continue;
+      if (p0[1] < p1[1]) {
+        e->x0 = p0[0];
+        e->y0 = p0[1];
+        e->x1 = p1[0];
+        e->y1 = p1[1];
+        e->dir = 1;
+      } else {
+        e->x0 = p1[0];
+        e->y0 = p1[1];
+        e->x1 = p0[0];
+        e->y1 = p0[1];
+        e->dir = -1;
+      }
+      n++;
+    }
+    base += cnt;
+  }
+  *out_count = n;
+  return CMP_SUCCESS;
+}
+
+static int msaa_edge_cmp(const void *a, const void *b) {
+  float ya = ((const msaa_edge_t *)a)->y0;
+  float yb = ((const msaa_edge_t *)b)->y0;
+  return ya < yb ? -1 : (ya > yb ? 1 : 0);
+}
+
+static int msaa_crossing_cmp(const void *a, const void *b) {
+  float xa = ((const msaa_crossing_t *)a)->x;
+  float xb = ((const msaa_crossing_t *)b)->x;
+  return xa < xb ? -1 : (xa > xb ? 1 : 0);
+}
+
+/* Intervals [a, b) on the horizontal line y that are inside the path. */
+static int msaa_scan_spans(cmp_msaa_t *msaa, size_t active_count, float y,
+                           int fill_rule, size_t span_base,
+                           size_t *out_spans) {
+  size_t i, n = 0, spans = 0;
+  int winding = 0;
+  float start = 0.0f;
+
+  for (i = 0; i < active_count; ++i) {
+    const msaa_edge_t *e = &msaa->edges[msaa->active[i]];
+    if (y < e->y0 || y >= e->y1)
+      continue;
+    if (msaa_reserve((void **)&msaa->crossings, &msaa->crossing_cap, n + 1,
+                     sizeof(msaa_crossing_t)) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    msaa->crossings[n].x =
+        e->x0 + (y - e->y0) * (e->x1 - e->x0) / (e->y1 - e->y0);
+    msaa->crossings[n].dir = e->dir;
+    n++;
+  }
+  if (n > 1)
+    qsort(msaa->crossings, n, sizeof(msaa_crossing_t), msaa_crossing_cmp);
+
+  for (i = 0; i < n; ++i) {
+    int was_inside = fill_rule ? (winding & 1) : winding != 0;
+    int inside;
+    winding += msaa->crossings[i].dir;
+    inside = fill_rule ? (winding & 1) : winding != 0;
+    if (!was_inside && inside) {
+      start = msaa->crossings[i].x;
+    } else if (was_inside && !inside) {
+      if (msaa_reserve((void **)&msaa->spans, &msaa->span_cap,
+                       span_base + (spans + 1) * 2, sizeof(float)) !=
+          CMP_SUCCESS)
+        return CMP_ERROR_OOM;
+      msaa->spans[span_base + spans * 2] = start;
+      msaa->spans[span_base + spans * 2 + 1] = msaa->crossings[i].x;
+      spans++;
+    }
+  }
+  *out_spans = spans;
+  return CMP_SUCCESS;
+}
+
+/* Point-sampled fill. Each sample position yields interior spans for the
+ * row; a difference array counts how many samples cover each pixel, so
+ * interior pixels cost the same as an aliased fill and only pixels with a
+ * partial count have their individual samples resolved and stored. */
+static int msaa_fill_sampled(cmp_msaa_t *msaa, size_t edge_count,
+                             const float bounds[4], int fill_rule,
+                             const unsigned char *src) {
+  int n = msaa->mode == CMP_MSAA_MODE_SPARSE ? msaa->sample_count : 1;
+  const signed char(*pattern)[2] = msaa_pattern(n);
+  size_t span_start[MSAA_MAX_SAMPLES + 1];
+  size_t next_edge = 0, active_count = 0, i;
+  int y, y_begin, y_end, s;
+  int w = (int)msaa->width;
+
+  qsort(msaa->edges, edge_count, sizeof(msaa_edge_t), msaa_edge_cmp);
+  if (msaa_reserve((void **)&msaa->active, &msaa->active_cap, edge_count,
+                   sizeof(size_t)) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+
+  y_begin = (int)floor(bounds[1]) - 1;
+  y_end = (int)ceil(bounds[3]) + 1;
+  if (y_begin < 0)
+    y_begin = 0;
+  if (y_end > (int)msaa->height)
+    y_end = (int)msaa->height;
+
+  span_start[0] = 0;
+  for (y = y_begin; y < y_end; ++y) {
+    int min_x = w, max_x = -1, x, running = 0;
+    size_t kept = 0;
+
+    /* Retire edges that ended above this row, then admit those starting in
+     * it; edges are sorted by their top. */
+    for (i = 0; i < active_count; ++i) {
+      if (msaa->edges[msaa->active[i]].y1 > (float)y)
+        msaa->active[kept++] = msaa->active[i];
+    }
+    active_count = kept;
+    while (next_edge < edge_count &&
+           msaa->edges[next_edge].y0 < (float)(y + 1)) {
+      if (msaa->edges[next_edge].y1 > (float)y)
+        msaa->active[active_count++] = next_edge;
+      next_edge++;
+    }
+
+    for (s = 0; s < n; ++s) {
+      size_t spans, k;
+      float sy = (float)y + 0.5f + pattern[s][1] / 16.0f;
+      float ox = 0.5f + pattern[s][0] / 16.0f;
+      if (msaa_scan_spans(msaa, active_count, sy, fill_rule, span_start[s] * 2,
+                          &spans) != CMP_SUCCESS)
+        return CMP_ERROR_OOM;
+      span_start[s + 1] = span_start[s] + spans;
+      for (k = 0; k < spans; ++k) {
+        float a = msaa->spans[(span_start[s] + k) * 2];
+        float b = msaa->spans[(span_start[s] + k) * 2 + 1];
+        int xa = (int)ceil(a - ox);
+        int xb = (int)ceil(b - ox); /* Exclusive. */
+        if (xa < 0)
+          xa = 0;
+        if (xb > w)
+          xb = w;
+        if (xa >= xb)
+          continue;
+        msaa->counts[xa]++;
+        msaa->counts[xb]--;
+        if (xa < min_x)
+          min_x = xa;
+        if (xb > max_x)
+          max_x = xb;
+      }
+    }
+
+    for (x = min_x; x <= max_x && x <= w; ++x) {
+      size_t idx = (size_t)y * msaa->width + (size_t)x;
+      running += msaa->counts[x];
+      msaa->counts[x] = 0;
+      if (x == w || running == 0)
+        continue;
+      if (running == n) {
+        msaa_blend_pixel(msaa, idx, src, 256);
+        continue;
+      }
+      {
+        /* Partial pixel: find which samples are inside. */
+        unsigned char *samples = msaa_edge_samples(msaa, idx);
+        unsigned int covered = 0;
+        if (!samples)
+          return CMP_ERROR_OOM;
+        for (s = 0; s < n; ++s) {
+          float px = (float)x + 0.5f + pattern[s][0] / 16.0f;
+          size_t k;
+          for (k = span_start[s]; k < span_start[s + 1]; ++k) {
+            if (px >= msaa->spans[k * 2] && px < msaa->spans[k * 2 + 1]) {
+              msaa_blend(samples + s * 4, src, 256);
+              covered++;
+              break;
+            }
+          }
+        }
+        msaa_blend(msaa->color + idx * 4, src, (covered * 256) / (unsigned)n);
+        msaa->pixels_filled++;
+      }
+    }
+  }
+  return CMP_SUCCESS;
+}
+
+static float msaa_clampf(float v, float hi) {
+  return v < 0.0f ? 0.0f : (v > hi ? hi : v);
+}
+
+/* Signed-area accumulation of one edge into a row-major buffer. */
+static void msaa_accumulate_line(float *acc, int aw, int ah, float x0,
+                                 float y0, float x1, float y1) {
+  float dir, dxdy, x, xmax = (float)(aw - 2);
+  int y, y_start, y_end;
+
+  if (y0 == y1)
+    return;
+  if (y0 < y1) {
+    dir = 1.0f;
+  } else {
+    float t;
+    dir = -1.0f;
+    t = x0;
+    x0 = x1;
+    x1 = t;
+    t = y0;
+    y0 = y1;
+    y1 = t;
+  }
+  dxdy = (x1 - x0) / (y1 - y0);
+  x = x0;
+  if (y0 < 0.0f) {
+    x -= y0 * dxdy;
+    y_start = 0;
+  } else {
+    y_start = (int)y0;
+  }
+  y_end = (int)ceil(y1);
+  if (y_end > ah)
+    y_end = ah;
+
+  for (y = y_start; y < y_end; ++y) {
+    float *row = acc + (size_t)y * aw;
+    float top = (float)y > y0 ? (float)y : y0;
+    float bottom = (float)(y + 1) < y1 ? (float)(y + 1) : y1;
+    float dy = bottom - top;
+    float xnext = x + dxdy * dy;
+    float d = dy * dir;
+    /* Rounding can step just outside [0, aw - 2]; coverage left of 0
+     * folds into column 0 and the last column stays in the row. */
+    float cx = msaa_clampf(x, xmax);
+    float cn = msaa_clampf(xnext, xmax);
+    float xa = cx < cn ? cx : cn;
+    float xb = cx < cn ? cn : cx;
+    float xa_floor = (float)floor(xa);
+    float xb_ceil = (float)ceil(xb);
+    int xai = (int)xa_floor;
+    int xbi = (int)xb_ceil;
+
+    if (xbi <= xai + 1) {
+      float xmf = 0.5f * (cx + cn) - xa_floor;
+      row[xai] += d - d * xmf;
+      row[xai + 1] += d * xmf;
+    } else {
+      float inv = 1.0f / (xb - xa);
+      float xaf = xa - xa_floor;
+      float a0 = 0.5f * inv * (1.0f - xaf) * (1.0f - xaf);
+      float xbf = xb - xb_ceil + 1.0f;
+      float am = 0.5f * inv * xbf * xbf;
+      row[xai] += d * a0;
+      if (xbi == xai + 2) {
+        row[xai + 1] += d * (1.0f - a0 - am);
+      } else {
+        float a1 = inv * (1.5f - xaf);
+        float a2;
+        int xi;
+        row[xai + 1] += d * (a1 - a0);
+        for (xi = xai + 2; xi < xbi - 1; ++xi)
+          row[xi] += d * inv;
+        a2 = a1 + (float)(xbi - xai - 3) * inv;
+        row[xbi - 1] += d * (1.0f - a2 - am);
+      }
+      row[xbi] += d * am;
+    }
+    x = xnext;
+  }
+}
+
+/* Splits an edge where it crosses x = 0 or x = span_w, then clamps each
+ * piece: the parts outside become vertical runs on the border, which is
+ * exact because an edge only affects coverage on its right. */
+static void msaa_accumulate_clipped(float *acc, int aw, int ah, float span_w,
+                                    float x0, float y0, float x1, float y1) {
+  float ts[2], px = x0, py = y0;
+  int n = 0, i;
+
+  if ((x0 < 0.0f) != (x1 < 0.0f))
+    ts[n++] = -x0 / (x1 - x0);
+  if ((x0 > span_w) != (x1 > span_w))
+    ts[n++] = (span_w - x0) / (x1 - x0);
+  if (n == 2 && ts[0] > ts[1]) {
+    float t = ts[0];
+    ts[0] = ts[1];
+    ts[1] = t;
+  }
+  for (i = 0; i <= n; ++i) {
+    float qx = i < n ? x0 + (x1 - x0) * ts[i] : x1;
+    float qy = i < n ? y0 + (y1 - y0) * ts[i] : y1;
+    msaa_accumulate_line(acc, aw, ah, msaa_clampf(px, span_w), py,
+                         msaa_clampf(qx, span_w), qy);
+    px = qx;
+    py = qy;
+  }
+}
+
+static int msaa_fill_analytic(cmp_msaa_t *msaa, const float *points,
+                              const size_t *contour_counts,
+                              size_t contour_count, const float bounds[4],
+                              int fill_rule, const unsigned char *src) {
+  int bx0, by0, bx1, by1, aw, ah, x, y;
+  size_t c, i, base = 0;
+  float span_w;
+
+  bx0 = (int)floor(bounds[0] < 0.0f ? 0.0f : bounds[0]);
+  by0 = (int)floor(bounds[1] < 0.0f ? 0.0f : bounds[1]);
+  bx1 = (int)ceil(bounds[2] > (float)msaa->width ? (float)msaa->width
+                                                 : bounds[2]);
+  by1 = (int)ceil(bounds[3] > (float)msaa->height ? (float)msaa->height
+                                                  : bounds[3]);
+  if (bx1 <= bx0 || by1 <= by0)
+    return CMP_SUCCESS;
+  aw = bx1 - bx0 + 2;
+  ah = by1 - by0;
+  span_w = (float)(bx1 - bx0);
+  if (msaa_reserve((void **)&msaa->acc, &msaa->acc_cap, (size_t)aw * ah,
+                   sizeof(float)) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(msaa->acc, 0, (size_t)aw * ah * sizeof(float));
+
+  for (c = 0; c < contour_count; ++c) {
+    size_t cnt = contour_counts[c];
+    for (i = 0; i < cnt; ++i) {
+      const float *p0 = points + (base + i) * 2;
+      const float *p1 = points + (base + (i + 1) % cnt) * 2;
+      msaa_accumulate_clipped(msaa->acc, aw, ah, span_w, p0[0] - (float)bx0,
+                              p0[1] - (float)by0, p1[0] - (float)bx0,
+                              p1[1] - (float)by0);
+    }
+    base += cnt;
+  }
+
+  for (y = 0; y < ah; ++y) {
+    const float *row = msaa->acc + (size_t)y * aw;
+    size_t line = (size_t)(by0 + y) * msaa->width + (size_t)bx0;
+    float sum = 0.0f;
+    for (x = 0; x < bx1 - bx0; ++x) {
+      float cov;
+      sum += row[x];
+      cov = sum < 0.0f ? -sum : sum;
+      if (fill_rule) {
+        cov -= 2.0f * (float)floor(cov * 0.5f);
+        if (cov > 1.0f)
+          cov = 2.0f - cov;
+      } else if (cov > 1.0f) {
+        cov = 1.0f;
+      }
+      if (cov >= 1.0f / 512.0f)
+        msaa_blend_pixel(msaa, line + (size_t)x, src,
+                         (unsigned int)(cov * 256.0f + 0.5f));
+    }
+  }
+  return CMP_SUCCESS;
+}
+
 int cmp_msaa_create(uint8_t sample_count, uint32_t width, uint32_t height,
                     cmp_msaa_t **out_msaa) {
   cmp_msaa_t *msaa;
+  uint8_t samples = 1;
   if (!out_msaa)
     return CMP_ERROR_INVALID_ARG;
   if (sample_count == 0 || width == 0 || height == 0)
@@ -22,20 +556,32 @@ int cmp_msaa_create(uint8_t sample_count, uint32_t width, uint32_t height,
   if (CMP_MALLOC(sizeof(cmp_msaa_t), (void **)&msaa) != CMP_SUCCESS)
     return CMP_ERROR_OOM;
 
+  /* Round down to a supported pattern. */
+  while (samples * 2 <= sample_count && samples < MSAA_MAX_SAMPLES)
+    samples = (uint8_t)(samples * 2);
+
   memset(msaa, 0, sizeof(cmp_msaa_t));
-  msaa->sample_count = sample_count;
+  msaa->sample_count = samples;
   msaa->width = width;
   msaa->height = height;
+  msaa->mode = CMP_MSAA_MODE_ANALYTIC;
 
-  /* Mock allocation for the internal renderbuffer based on samples */
-  if (CMP_MALLOC(width * height * 4 * sample_count,
-                 &msaa->internal_renderbuffer) != CMP_SUCCESS) {
+  /* Samples are only stored for edge pixels, so the resident target is a
+   * single RGBA8 plane regardless of sample_count. */
+  if (CMP_MALLOC((size_t)width * height * 4, (void **)&msaa->color) !=
+      CMP_SUCCESS) {
     CMP_FREE(msaa);
     return CMP_ERROR_OOM;
   }
+  memset(msaa->color, 0, (size_t)width * height * 4);
 
-  /* Initialize the mock buffer to zero */
-  memset(msaa->internal_renderbuffer, 0, width * height * 4 * sample_count);
+  if (CMP_MALLOC(((size_t)width + 1) * sizeof(int), (void **)&msaa->counts) !=
+      CMP_SUCCESS) {
+    CMP_FREE(msaa->color);
+    CMP_FREE(msaa);
+    return CMP_ERROR_OOM;
+  }
+  memset(msaa->counts, 0, ((size_t)width + 1) * sizeof(int));
 
   *out_msaa = msaa;
   return CMP_SUCCESS;
@@ -44,12 +590,171 @@ int cmp_msaa_create(uint8_t sample_count, uint32_t width, uint32_t height,
 int cmp_msaa_destroy(cmp_msaa_t *msaa) {
   if (!msaa)
     return CMP_ERROR_INVALID_ARG;
-  if (msaa->internal_renderbuffer)
-    CMP_FREE(msaa->internal_renderbuffer);
+  CMP_FREE(msaa->color);
+  CMP_FREE(msaa->counts);
+  if (msaa->edge_slot)
+    CMP_FREE(msaa->edge_slot);
+  if (msaa->samples)
+    CMP_FREE(msaa->samples);
+  if (msaa->edges)
+    CMP_FREE(msaa->edges);
+  if (msaa->active)
+    CMP_FREE(msaa->active);
+  if (msaa->crossings)
+    CMP_FREE(msaa->crossings);
+  if (msaa->spans)
+    CMP_FREE(msaa->spans);
+  if (msaa->acc)
+    CMP_FREE(msaa->acc);
   CMP_FREE(msaa);
   return CMP_SUCCESS;
 }
 
+int cmp_msaa_set_mode(cmp_msaa_t *msaa, cmp_msaa_mode_t mode) {
+  if (!msaa || (int)mode < (int)CMP_MSAA_MODE_NONE ||
+      (int)mode > (int)CMP_MSAA_MODE_SPARSE)
+    return CMP_ERROR_INVALID_ARG;
+  msaa->mode = mode;
+  return CMP_SUCCESS;
+}
+
+int cmp_msaa_clear(cmp_msaa_t *msaa, const cmp_color_t *color) {
+  unsigned char px[4];
+  size_t i, n;
+  if (!msaa || !color)
+    return CMP_ERROR_INVALID_ARG;
+
+  msaa_premultiply(color, px);
+  n = (size_t)msaa->width * msaa->height;
+  for (i = 0; i < n; ++i)
+    memcpy(msaa->color + i * 4, px, 4);
+  if (msaa->edge_slot)
+    memset(msaa->edge_slot, 0, n * sizeof(uint32_t));
+  msaa->sample_blocks = 0;
+  return CMP_SUCCESS;
+}
+
+int cmp_msaa_fill_path(cmp_msaa_t *msaa, const float *points,
+                       const size_t *contour_counts, size_t contour_count,
+                       int fill_rule, const cmp_color_t *color) {
+  unsigned char src[4];
+  float bounds[4];
+  size_t edge_count;
+  int res;
+  if (!msaa || !points || !contour_counts || !color ||
+      (fill_rule != 0 && fill_rule != 1))
+    return CMP_ERROR_INVALID_ARG;
+
+  msaa_premultiply(color, src);
+  if (src[3] == 0 || contour_count == 0)
+    return CMP_SUCCESS;
+
+  res = msaa_build_edges(msaa, points, contour_counts, contour_count,
+                         &edge_count, bounds);
+  if (res != CMP_SUCCESS || edge_count == 0)
+    return res;
+
+  if (msaa->mode == CMP_MSAA_MODE_ANALYTIC)
+    return msaa_fill_analytic(msaa, points, contour_counts, contour_count,
+                              bounds, fill_rule, src);
+  return msaa_fill_sampled(msaa, edge_count, bounds, fill_rule, src);
+}
+
+int cmp_msaa_fill_rounded_rect(cmp_msaa_t *msaa, float x, float y, float width,
+                               float height, float radius,
+                               const cmp_color_t *color) {
+  float pts[(MSAA_MAX_CORNER_SEGMENTS + 1) * 4 * 2];
+  float cx[4], cy[4];
+  size_t count = 0;
+  int segments = 1, corner, i;
+  if (!msaa || !color || width <= 0.0f || height <= 0.0f || radius < 0.0f)
+    return CMP_ERROR_INVALID_ARG;
+
+  if (radius > width * 0.5f)
+    radius = width * 0.5f;
+  if (radius > height * 0.5f)
+    radius = height * 0.5f;
+  if (radius > 0.25f) {
+    /* Enough segments per quarter arc to keep the chord error under 1/4 px. */
+    double step = 2.0 * acos(1.0 - 0.25 / radius);
+    segments = (int)ceil((3.14159265358979 * 0.5) / step);
+    if (segments > MSAA_MAX_CORNER_SEGMENTS)
+      segments = MSAA_MAX_CORNER_SEGMENTS;
+  } else {
+    radius = 0.0f;
+  }
+
+  cx[0] = x + width - radius;
+  cy[0] = y + height - radius;
+  cx[1] = x + radius;
+  cy[1] = y + height - radius;
+  cx[2] = x + radius;
+  cy[2] = y + radius;
+  cx[3] = x + width - radius;
+  cy[3] = y + radius;
+  for (corner = 0; corner < 4; ++corner) {
+    for (i = 0; i <= segments; ++i) {
+      double a = 3.14159265358979 * 0.5 * (corner + (double)i / segments);
+      pts[count * 2] = cx[corner] + radius * (float)cos(a);
+      pts[count * 2 + 1] = cy[corner] + radius * (float)sin(a);
+      count++;
+      if (radius == 0.0f)
+        break;
+    }
+  }
+  return cmp_msaa_fill_path(msaa, pts, &count, 1, 0, color);
+}
+
+int cmp_msaa_resolve_to_buffer(cmp_msaa_t *msaa, unsigned char *pixels,
+                               size_t stride) {
+  uint32_t x, y;
+  unsigned int shift = 0;
+  if (!msaa || !pixels || stride < (size_t)msaa->width * 4)
+    return CMP_ERROR_INVALID_ARG;
+
+  while ((1u << shift) < msaa->sample_count)
+    shift++;
+
+  for (y = 0; y < msaa->height; ++y) {
+    const unsigned char *src = msaa->color + (size_t)y * msaa->width * 4;
+    const uint32_t *slots =
+        msaa->edge_slot ? msaa->edge_slot + (size_t)y * msaa->width : NULL;
+    unsigned char *dst = pixels + (size_t)y * stride;
+
+    if (!slots || msaa->sample_blocks == 0) {
+      memcpy(dst, src, (size_t)msaa->width * 4);
+      continue;
+    }
+    x = 0;
+    while (x < msaa->width) {
+      uint32_t run = x;
+      while (run < msaa->width && slots[run] == 0)
+        run++;
+      if (run > x)
+        memcpy(dst + x * 4, src + x * 4, (size_t)(run - x) * 4);
+      x = run;
+      while (x < msaa->width && slots[x] != 0) {
+        const unsigned char *s = msaa->samples +
+                                 (size_t)(slots[x] - 1) * msaa->sample_count * 4;
+        unsigned int sum[4];
+        int i;
+        sum[0] = sum[1] = sum[2] = sum[3] = 0;
+        for (i = 0; i < msaa->sample_count; ++i) {
+          sum[0] += s[i * 4];
+          sum[1] += s[i * 4 + 1];
+          sum[2] += s[i * 4 + 2];
+          sum[3] += s[i * 4 + 3];
+        }
+        for (i = 0; i < 4; ++i)
+          dst[x * 4 + i] =
+              (unsigned char)((sum[i] + (msaa->sample_count >> 1)) >> shift);
+        x++;
+      }
+    }
+  }
+  return CMP_SUCCESS;
+}
+
 int cmp_msaa_resolve(cmp_msaa_t *msaa, cmp_texture_t *target_texture) {
   if (!msaa || !target_texture)
     return CMP_ERROR_INVALID_ARG;
@@ -60,18 +765,21 @@ int cmp_msaa_resolve(cmp_msaa_t *msaa, cmp_texture_t *target_texture) {
     return CMP_ERROR_BOUNDS;
   }
 
-  /* In a real implementation, this would trigger a GPU blit or software
-   * multisample resolve */
-  /* Here we simply mock a successful resolve by validating the inputs */
-
-  /* Pretend we resolved the multisampled renderbuffer into the target texture
-   */
-  if (!target_texture->internal_handle) {
-    /* If the target texture doesn't have an internal handle, it's not a valid
-     * target */
-    /* Wait, the test might just pass a mocked target. Let's just return success
-     * for the abstraction. */
+  /* CPU textures receive the resolved pixels directly; GPU handles are
+   * uploaded by their backend. */
+  if (target_texture->format == CMP_TEXTURE_FORMAT_RGBA8_PREMULTIPLIED &&
+      target_texture->pixels) {
+    return cmp_msaa_resolve_to_buffer(msaa, target_texture->pixels,
+                                      (size_t)msaa->width * 4);
   }
+  return CMP_SUCCESS;
+}
 
+int cmp_msaa_get_stats(const cmp_msaa_t *msaa, cmp_msaa_stats_t *out_stats) {
+  if (!msaa || !out_stats)
+    return CMP_ERROR_INVALID_ARG;
+  out_stats->pixels_filled = msaa->pixels_filled;
+  out_stats->edge_pixels = msaa->sample_blocks;
+  out_stats->stored_samples = msaa->sample_blocks * msaa->sample_count;
   return CMP_SUCCESS;
 }
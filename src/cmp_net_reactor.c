@@ -0,0 +1,2165 @@
+/* clang-format off */
+#if !defined(_WIN32) && !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 600 /* poll, clock_gettime */
+#endif
+#include "cmp.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Sockets are multiplexed with epoll on Linux and poll(2) on other POSIX
+   hosts. Windows keeps the frame codec but has no reactor until a WSAPoll
+   backend lands. */
+
+#if !defined(_WIN32)
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+#endif
+/* clang-format on */
+
+#define NET_WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define NET_READ_CHUNK 65536
+#define NET_READ_BUDGET (256 * 1024) /* Bytes per stream per wake */
+#define NET_HEADER_LIMIT 16384
+#define NET_MAX_MESSAGE (16UL * 1024 * 1024)
+#define NET_ZERO_COPY_MIN 1024 /* Smaller messages are copied */
+#define NET_COMPRESS_MIN 64
+#define NET_CLOSE_TIMEOUT_MS 3000.0
+#define NET_EPOLL_EVENTS 64
+
+/* ------------------------------------------------------------------------ */
+/* Frame codec                                                              */
+/* ------------------------------------------------------------------------ */
+
+void cmp_ws_mask(unsigned char *data, size_t len, const unsigned char *mask,
+                 size_t offset) {
+  unsigned char wide[sizeof(unsigned long)];
+  unsigned long key, word;
+  size_t i;
+
+  if (data == NULL || mask == NULL) {
+    return;
+  }
+  /* A word is a whole number of key repeats, so one rotated key serves the
+   * entire payload. memcpy keeps the loads unaligned-safe. */
+  for (i = 0; i < sizeof(wide); ++i) {
+    wide[i] = mask[(offset + i) & 3];
+  }
+  memcpy(&key, wide, sizeof(key));
+  for (i = 0; i + sizeof(key) <= len; i += sizeof(key)) {
+    memcpy(&word, data + i, sizeof(word));
+    word ^= key;
+    memcpy(data + i, &word, sizeof(word));
+  }
+  for (; i < len; ++i) {
+    data[i] ^= mask[(offset + i) & 3];
+  }
+}
+
+int cmp_ws_frame_parse(unsigned char *data, size_t len,
+                       cmp_ws_frame_t *out_frame, size_t *out_consumed) {
+  size_t payload_len, need, count, i;
+  int opcode, masked;
+
+  if ((data == NULL && len > 0) || out_frame == NULL ||
+      out_consumed == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  *out_consumed = 0;
+  if (len < 2) {
+    return CMP_SUCCESS;
+  }
+
+  opcode = data[0] & 0x0F;
+  if ((data[0] & 0x30) != 0 || (opcode > CMP_WS_OP_BINARY &&
+                                opcode < CMP_WS_OP_CLOSE) ||
+      opcode > CMP_WS_OP_PONG) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  payload_len = data[1] & 0x7F;
+  /* Control frames are short, whole and never compressed */
+  if (opcode >= CMP_WS_OP_CLOSE &&
+      (payload_len > 125 || (data[0] & 0xC0) != 0x80)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  masked = (data[1] & 0x80) != 0;
+  count = payload_len == 126 ? 2 : (payload_len == 127 ? 8 : 0);
+  need = 2 + count + (masked ? 4 : 0);
+  if (len < need) {
+    return CMP_SUCCESS;
+  }
+  if (count > 0) {
+    if (count == 8 && (data[2] & 0x80) != 0) {
+      return CMP_ERROR_INVALID_ARG;
+    }
+    payload_len = 0;
+    for (i = 0; i < count; ++i) {
+      if ((payload_len >> (sizeof(size_t) * 8 - 8)) != 0) {
+        return CMP_ERROR_BOUNDS;
+      }
+      payload_len = (payload_len << 8) | data[2 + i];
+    }
+    /* Lengths use the shortest encoding */
+    if (payload_len < 126 || (count == 8 && payload_len <= 0xFFFF)) {
+      return CMP_ERROR_INVALID_ARG;
+    }
+  }
+  if (payload_len > len - need) {
+    return CMP_SUCCESS;
+  }
+
+  out_frame->fin = (data[0] & 0x80) != 0;
+  out_frame->compressed = (data[0] & 0x40) != 0;
+  out_frame->opcode = opcode;
+  out_frame->payload = data + need;
+  out_frame->payload_len = payload_len;
+  if (masked) {
+    cmp_ws_mask(data + need, payload_len, data + need - 4, 0);
+  }
+  *out_consumed = need + payload_len;
+  return CMP_SUCCESS;
+}
+
+size_t cmp_ws_frame_header(unsigned char *out, int fin, int compressed,
+                           int opcode, size_t payload_len,
+                           const unsigned char *mask) {
+  size_t n = 2, v;
+  int i;
+
+  if (out == NULL) {
+    return 0;
+  }
+  out[0] = (unsigned char)((fin ? 0x80 : 0) | (compressed ? 0x40 : 0) |
+                           (opcode & 0x0F));
+  if (payload_len < 126) {
+    out[1] = (unsigned char)payload_len;
+  } else if (payload_len <= 0xFFFF) {
+    out[1] = 126;
+    out[2] = (unsigned char)(payload_len >> 8);
+    out[3] = (unsigned char)(payload_len & 0xFF);
+    n = 4;
+  } else {
+    out[1] = 127;
+    v = payload_len;
+    for (i = 7; i >= 0; --i) {
+      out[2 + i] = (unsigned char)(v & 0xFF);
+      v >>= 8;
+    }
+    n = 10;
+  }
+  if (mask != NULL) {
+    out[1] |= 0x80;
+    memcpy(out + n, mask, 4);
+    n += 4;
+  }
+  return n;
+}
+
+#define NET_ROL(v, n) ((((v) << (n)) | ((v) >> (32 - (n)))) & 0xFFFFFFFFUL)
+
+static void net_sha1_block(unsigned long *h, const unsigned char *p) {
+  unsigned long w[80], a, b, c, d, e, f, k, t;
+  int i;
+
+  for (i = 0; i < 16; ++i) {
+    w[i] = ((unsigned long)p[4 * i] << 24) |
+           ((unsigned long)p[4 * i + 1] << 16) |
+           ((unsigned long)p[4 * i + 2] << 8) | (unsigned long)p[4 * i + 3];
+  }
+  for (i = 16; i < 80; ++i) {
+    w[i] = NET_ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+  }
+  a = h[0];
+  b = h[1];
+  c = h[2];
+  d = h[3];
+  e = h[4];
+  for (i = 0; i < 80; ++i) {
+    if (i < 20) {
+      f = (b & c) | (~b & d);
+      k = 0x5A827999UL;
+    } else if (i < 40) {
+      f = b ^ c ^ d;
+      k = 0x6ED9EBA1UL;
+    } else if (i < 60) {
+      f = (b & c) | (b & d) | (c & d);
+      k = 0x8F1BBCDCUL;
+    } else {
+      f = b ^ c ^ d;
+      k = 0xCA62C1D6UL;
+    }
+    t = (NET_ROL(a, 5) + (f & 0xFFFFFFFFUL) + e + k + w[i]) & 0xFFFFFFFFUL;
+    e = d;
+    d = c;
+    c = NET_ROL(b, 30);
+    b = a;
+    a = t;
+  }
+  h[0] = (h[0] + a) & 0xFFFFFFFFUL;
+  h[1] = (h[1] + b) & 0xFFFFFFFFUL;
+  h[2] = (h[2] + c) & 0xFFFFFFFFUL;
+  h[3] = (h[3] + d) & 0xFFFFFFFFUL;
+  h[4] = (h[4] + e) & 0xFFFFFFFFUL;
+}
+
+/* One-shot SHA-1, only used for the handshake's accept key */
+static void net_sha1(const unsigned char *data, size_t len,
+                     unsigned char *out) {
+  unsigned long h[5], bits;
+  unsigned char tail[128];
+  size_t full = len & ~(size_t)63, rest = len - full, tail_len, i;
+
+  h[0] = 0x67452301UL;
+  h[1] = 0xEFCDAB89UL;
+  h[2] = 0x98BADCFEUL;
+  h[3] = 0x10325476UL;
+  h[4] = 0xC3D2E1F0UL;
+  for (i = 0; i < full; i += 64) {
+    net_sha1_block(h, data + i);
+  }
+  memset(tail, 0, sizeof(tail));
+  memcpy(tail, data + full, rest);
+  tail[rest] = 0x80;
+  tail_len = rest + 9 <= 64 ? 64 : 128;
+  /* Big-endian bit count; inputs here are far below 2^29 bytes */
+  bits = (unsigned long)len << 3;
+  tail[tail_len - 1] = (unsigned char)(bits & 0xFF);
+  tail[tail_len - 2] = (unsigned char)((bits >> 8) & 0xFF);
+  tail[tail_len - 3] = (unsigned char)((bits >> 16) & 0xFF);
+  tail[tail_len - 4] = (unsigned char)((bits >> 24) & 0xFF);
+  net_sha1_block(h, tail);
+  if (tail_len == 128) {
+    net_sha1_block(h, tail + 64);
+  }
+  for (i = 0; i < 20; ++i) {
+    out[i] = (unsigned char)((h[i / 4] >> (24 - 8 * (i % 4))) & 0xFF);
+  }
+}
+
+static size_t net_base64(const unsigned char *in, size_t len, char *out) {
+  static const char k_alphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t i, n = 0;
+  unsigned long v;
+
+  for (i = 0; i < len; i += 3) {
+    v = (unsigned long)in[i] << 16;
+    if (i + 1 < len) {
+      v |= (unsigned long)in[i + 1] << 8;
+    }
+    if (i + 2 < len) {
+      v |= in[i + 2];
+    }
+    out[n++] = k_alphabet[(v >> 18) & 0x3F];
+    out[n++] = k_alphabet[(v >> 12) & 0x3F];
+    out[n++] = i + 1 < len ? k_alphabet[(v >> 6) & 0x3F] : '=';
+    out[n++] = i + 2 < len ? k_alphabet[v & 0x3F] : '=';
+  }
+  out[n] = '\0';
+  return n;
+}
+
+int cmp_ws_accept_key(const char *key, char *out) {
+  unsigned char digest[20];
+  unsigned char joined[128];
+  size_t key_len;
+
+  if (key == NULL || out == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  key_len = strlen(key);
+  if (key_len + sizeof(NET_WS_GUID) > sizeof(joined)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  memcpy(joined, key, key_len);
+  memcpy(joined + key_len, NET_WS_GUID, sizeof(NET_WS_GUID) - 1);
+  net_sha1(joined, key_len + sizeof(NET_WS_GUID) - 1, digest);
+  net_base64(digest, sizeof(digest), out);
+  return CMP_SUCCESS;
+}
+
+int cmp_net_stream_config_init(cmp_net_stream_config_t *config) {
+  if (config == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  memset(config, 0, sizeof(cmp_net_stream_config_t));
+  config->kind = CMP_NET_STREAM_WEBSOCKET;
+  config->max_message = NET_MAX_MESSAGE;
+  return CMP_SUCCESS;
+}
+
+#if !defined(_WIN32)
+
+/* ------------------------------------------------------------------------ */
+/* Reactor                                                                  */
+/* ------------------------------------------------------------------------ */
+
+typedef struct net_buf {
+  unsigned char *data;
+  size_t len;
+  size_t cap;
+} net_buf_t;
+
+typedef struct net_msg {
+  int opcode;
+  const unsigned char *data; /* Zero-copy into a handed-over read buffer */
+  size_t off;                /* Into the batch arena when data is NULL */
+  size_t len;
+  size_t event_off; /* SSE strings in the arena; (size_t)-1 for WebSocket */
+  size_t id_off;
+} net_msg_t;
+
+/* What one wake read from one stream, delivered as a single task */
+typedef struct net_batch {
+  struct cmp_net_stream *stream;
+  unsigned char **buffers; /* Read buffers the zero-copy messages use */
+  size_t buffer_count;
+  size_t buffer_cap;
+  net_buf_t arena; /* Copied, reassembled, inflated and SSE messages */
+  net_msg_t *msgs;
+  size_t count;
+  size_t cap;
+  int final;
+  int result;
+  int code;
+} net_batch_t;
+
+typedef enum {
+  NET_ST_HANDSHAKE = 0,
+  NET_ST_OPEN,
+  NET_ST_DONE
+} net_state_t;
+
+typedef enum {
+  NET_CHUNK_SIZE = 0,
+  NET_CHUNK_EXT,
+  NET_CHUNK_DATA,
+  NET_CHUNK_DATA_END,
+  NET_CHUNK_TRAILER
+} net_chunk_state_t;
+
+struct cmp_net_stream {
+  struct cmp_net_reactor *reactor;
+  struct cmp_net_stream *prev; /* Reactor thread's list */
+  struct cmp_net_stream *next;
+  struct cmp_net_stream *queue_next; /* Adding or dirty list, under lock */
+  int fd;
+  cmp_net_stream_kind_t kind;
+  net_state_t state;
+  size_t max_message;
+  cmp_net_batch_cb_t on_batch;
+  cmp_net_close_cb_t on_close;
+  void *user_data;
+  int offered_deflate;
+  int deflate;
+  char accept[29];
+
+  /* Reactor thread */
+  unsigned char *in;
+  size_t in_len;
+  size_t in_cap;
+  int want_write;
+  int peer_closed; /* Close frame received; finish once ours is out */
+  int close_code;
+  double close_deadline; /* Our close frame went out; 0 when not closing */
+  int in_message;
+  int msg_opcode;
+  int msg_compressed;
+  net_buf_t frag;
+  cmp_inflate_t *inflater;
+  size_t inflated;
+  int inflate_overflow;
+  net_batch_t *batch;
+  net_batch_t *spare; /* Guarantees the final batch */
+  int chunked;
+  net_chunk_state_t chunk_state;
+  size_t chunk_left;
+  net_buf_t line;
+  net_buf_t sse_data;
+  net_buf_t sse_event;
+  net_buf_t sse_id;
+  int sse_data_seen;
+  int sse_started;
+  int last_cr;
+
+  /* Under the reactor lock */
+  net_buf_t out;
+  size_t out_pos;
+  size_t out_gate; /* Bytes sendable before the handshake completes */
+  int accepting;
+  int close_requested;
+  int dirty;
+  cmp_deflate_t *deflater;
+  net_buf_t zbuf;
+
+  /* Delivery modality */
+  size_t pending;
+  int orphaned;
+};
+
+struct cmp_net_reactor {
+  cmp_modality_t *deliver;
+  cmp_mutex_t lock;
+  cmp_thread_t thread;
+  int wake[2];
+#if defined(__linux__)
+  int epfd;
+#else
+  struct pollfd *pfds;
+  size_t pfd_cap;
+#endif
+  cmp_net_stream_t **ready;
+  int *ready_flags;
+  size_t ready_cap;
+  cmp_net_stream_t *streams; /* Reactor thread */
+  size_t closing;
+  cmp_net_stream_t *adding; /* Under lock */
+  cmp_net_stream_t *dirty;  /* Under lock */
+  int stopping;
+  int destroyed;
+  size_t pending; /* Batches queued, not yet delivered */
+  unsigned long rng;
+  cmp_net_reactor_stats_t stats;
+};
+
+#define NET_READY_READ 1
+#define NET_READY_WRITE 2
+
+static double net_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+static int net_buf_reserve(net_buf_t *b, size_t extra) {
+  unsigned char *grown;
+  size_t cap;
+
+  if (b->len + extra <= b->cap) {
+    return CMP_SUCCESS;
+  }
+  cap = b->cap ? b->cap : 256;
+  while (cap < b->len + extra) {
+    cap *= 2;
+  }
+  if (CMP_MALLOC(cap, (void **)&grown) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  if (b->len > 0) {
+    memcpy(grown, b->data, b->len);
+  }
+  if (b->data != NULL) {
+    CMP_FREE(b->data);
+  }
+  b->data = grown;
+  b->cap = cap;
+  return CMP_SUCCESS;
+}
+
+static int net_buf_append(net_buf_t *b, const void *data, size_t len) {
+  if (net_buf_reserve(b, len) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  if (len > 0) {
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+  }
+  return CMP_SUCCESS;
+}
+
+static void net_buf_free(net_buf_t *b) {
+  if (b->data != NULL) {
+    CMP_FREE(b->data);
+  }
+  memset(b, 0, sizeof(net_buf_t));
+}
+
+/* xorshift32 seeded from /dev/urandom; masking keys only need to be
+ * unpredictable to intermediaries, not cryptographically strong. */
+static unsigned long net_random(struct cmp_net_reactor *r) {
+  unsigned long x = r->rng;
+  x ^= (x << 13) & 0xFFFFFFFFUL;
+  x ^= x >> 17;
+  x ^= (x << 5) & 0xFFFFFFFFUL;
+  r->rng = x;
+  return x;
+}
+
+static void net_random_bytes(struct cmp_net_reactor *r, unsigned char *out,
+                             size_t len) {
+  unsigned long v = 0;
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    if ((i & 3) == 0) {
+      v = net_random(r);
+    }
+    out[i] = (unsigned char)(v & 0xFF);
+    v >>= 8;
+  }
+}
+
+static void net_wake(struct cmp_net_reactor *r) {
+  unsigned char b = 1;
+  /* A full pipe already guarantees a wake */
+  if (write(r->wake[1], &b, 1) < 0) {
+    return;
+  }
+}
+
+static void net_batch_free(net_batch_t *batch) {
+  size_t i;
+
+  for (i = 0; i < batch->buffer_count; ++i) {
+    CMP_FREE(batch->buffers[i]);
+  }
+  if (batch->buffers != NULL) {
+    CMP_FREE(batch->buffers);
+  }
+  if (batch->msgs != NULL) {
+    CMP_FREE(batch->msgs);
+  }
+  net_buf_free(&batch->arena);
+  CMP_FREE(batch);
+}
+
+static net_batch_t *net_batch_get(cmp_net_stream_t *s) {
+  net_batch_t *batch;
+
+  if (s->batch == NULL) {
+    if (CMP_MALLOC(sizeof(net_batch_t), (void **)&batch) != CMP_SUCCESS) {
+      return NULL;
+    }
+    memset(batch, 0, sizeof(net_batch_t));
+    batch->stream = s;
+    s->batch = batch;
+  }
+  return s->batch;
+}
+
+static net_msg_t *net_batch_push(cmp_net_stream_t *s, int opcode) {
+  net_batch_t *batch = net_batch_get(s);
+  net_msg_t *grown, *msg;
+  size_t cap;
+
+  if (batch == NULL) {
+    return NULL;
+  }
+  if (batch->count == batch->cap) {
+    cap = batch->cap ? batch->cap * 2 : 16;
+    if (CMP_MALLOC(cap * sizeof(net_msg_t), (void **)&grown) !=
+        CMP_SUCCESS) {
+      return NULL;
+    }
+    if (batch->count > 0) {
+      memcpy(grown, batch->msgs, batch->count * sizeof(net_msg_t));
+    }
+    if (batch->msgs != NULL) {
+      CMP_FREE(batch->msgs);
+    }
+    batch->msgs = grown;
+    batch->cap = cap;
+  }
+  msg = &batch->msgs[batch->count++];
+  memset(msg, 0, sizeof(net_msg_t));
+  msg->opcode = opcode;
+  msg->off = batch->arena.len;
+  msg->event_off = (size_t)-1;
+  msg->id_off = (size_t)-1;
+  return msg;
+}
+
+static int net_batch_adopt(cmp_net_stream_t *s, unsigned char *buffer) {
+  net_batch_t *batch = net_batch_get(s);
+  unsigned char **grown;
+  size_t cap;
+
+  if (batch == NULL) {
+    return CMP_ERROR_OOM;
+  }
+  if (batch->buffer_count == batch->buffer_cap) {
+    cap = batch->buffer_cap ? batch->buffer_cap * 2 : 4;
+    if (CMP_MALLOC(cap * sizeof(unsigned char *), (void **)&grown) !=
+        CMP_SUCCESS) {
+      return CMP_ERROR_OOM;
+    }
+    if (batch->buffer_count > 0) {
+      memcpy(grown, batch->buffers,
+             batch->buffer_count * sizeof(unsigned char *));
+    }
+    if (batch->buffers != NULL) {
+      CMP_FREE(batch->buffers);
+    }
+    batch->buffers = grown;
+    batch->buffer_cap = cap;
+  }
+  batch->buffers[batch->buffer_count++] = buffer;
+  return CMP_SUCCESS;
+}
+
+static void net_stream_free(cmp_net_stream_t *s) {
+  if (s->fd >= 0) {
+    close(s->fd);
+  }
+  if (s->in != NULL) {
+    CMP_FREE(s->in);
+  }
+  if (s->inflater != NULL) {
+    cmp_inflate_destroy(s->inflater);
+  }
+  if (s->deflater != NULL) {
+    cmp_deflate_destroy(s->deflater);
+  }
+  if (s->batch != NULL) {
+    net_batch_free(s->batch);
+  }
+  if (s->spare != NULL) {
+    net_batch_free(s->spare);
+  }
+  net_buf_free(&s->frag);
+  net_buf_free(&s->line);
+  net_buf_free(&s->sse_data);
+  net_buf_free(&s->sse_event);
+  net_buf_free(&s->sse_id);
+  net_buf_free(&s->out);
+  net_buf_free(&s->zbuf);
+  CMP_FREE(s);
+}
+
+static void net_reactor_free(struct cmp_net_reactor *r) {
+  close(r->wake[0]);
+  close(r->wake[1]);
+#if defined(__linux__)
+  close(r->epfd);
+#else
+  if (r->pfds != NULL) {
+    CMP_FREE(r->pfds);
+  }
+#endif
+  if (r->ready != NULL) {
+    CMP_FREE(r->ready);
+    CMP_FREE(r->ready_flags);
+  }
+  cmp_mutex_destroy(&r->lock);
+  CMP_FREE(r);
+}
+
+/* --- Delivery ----------------------------------------------------------- */
+
+static void net_deliver(void *arg) {
+  net_batch_t *batch = (net_batch_t *)arg;
+  cmp_net_stream_t *s = batch->stream;
+  struct cmp_net_reactor *r = s->reactor;
+  cmp_net_message_t *messages = NULL;
+  size_t i;
+  int destroyed, free_stream, free_reactor;
+
+  cmp_mutex_lock(&r->lock);
+  destroyed = r->destroyed;
+  cmp_mutex_unlock(&r->lock);
+
+  if (!destroyed && batch->count > 0 && s->on_batch != NULL &&
+      CMP_MALLOC(batch->count * sizeof(cmp_net_message_t),
+                 (void **)&messages) == CMP_SUCCESS) {
+    for (i = 0; i < batch->count; ++i) {
+      const net_msg_t *msg = &batch->msgs[i];
+      messages[i].opcode = msg->opcode;
+      messages[i].data =
+          msg->data != NULL ? msg->data : batch->arena.data + msg->off;
+      messages[i].len = msg->len;
+      messages[i].event =
+          msg->event_off == (size_t)-1
+              ? NULL
+              : (const char *)batch->arena.data + msg->event_off;
+      messages[i].id = msg->id_off == (size_t)-1
+                           ? NULL
+                           : (const char *)batch->arena.data + msg->id_off;
+    }
+    s->on_batch(s, messages, batch->count, s->user_data);
+    CMP_FREE(messages);
+  }
+  if (!destroyed && batch->final && s->on_close != NULL) {
+    s->on_close(s, batch->result, batch->code, s->user_data);
+  }
+
+  cmp_mutex_lock(&r->lock);
+  r->pending--;
+  s->pending--;
+  free_stream = batch->final || (s->orphaned && s->pending == 0);
+  free_reactor = r->destroyed && r->pending == 0;
+  cmp_mutex_unlock(&r->lock);
+
+  net_batch_free(batch);
+  if (free_stream) {
+    net_stream_free(s);
+  }
+  if (free_reactor) {
+    net_reactor_free(r);
+  }
+}
+
+/* Hands the stream's batch to the delivery modality; after a final batch
+ * the stream belongs to the delivery side. */
+static void net_dispatch(cmp_net_stream_t *s) {
+  struct cmp_net_reactor *r = s->reactor;
+  net_batch_t *batch = s->batch;
+  int final;
+
+  if (batch == NULL) {
+    return;
+  }
+  s->batch = NULL;
+  final = batch->final;
+  cmp_mutex_lock(&r->lock);
+  r->pending++;
+  s->pending++;
+  r->stats.batches++;
+  r->stats.messages += batch->count;
+  cmp_mutex_unlock(&r->lock);
+  if (cmp_modality_queue_task(r->deliver, net_deliver, batch) !=
+      CMP_SUCCESS) {
+    cmp_mutex_lock(&r->lock);
+    r->pending--;
+    s->pending--;
+    cmp_mutex_unlock(&r->lock);
+    net_batch_free(batch);
+    if (final) {
+      net_stream_free(s);
+    }
+  }
+}
+
+/* --- Poller ------------------------------------------------------------- */
+
+static int net_ready_reserve(struct cmp_net_reactor *r, size_t count) {
+  cmp_net_stream_t **ready;
+  int *flags;
+
+  if (count <= r->ready_cap) {
+    return CMP_SUCCESS;
+  }
+  if (CMP_MALLOC(count * sizeof(cmp_net_stream_t *), (void **)&ready) !=
+      CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  if (CMP_MALLOC(count * sizeof(int), (void **)&flags) != CMP_SUCCESS) {
+    CMP_FREE(ready);
+    return CMP_ERROR_OOM;
+  }
+  if (r->ready != NULL) {
+    CMP_FREE(r->ready);
+    CMP_FREE(r->ready_flags);
+  }
+  r->ready = ready;
+  r->ready_flags = flags;
+  r->ready_cap = count;
+  return CMP_SUCCESS;
+}
+
+#if defined(__linux__)
+
+static int net_poller_open(struct cmp_net_reactor *r) {
+  struct epoll_event ev;
+
+  r->epfd = epoll_create(NET_EPOLL_EVENTS);
+  if (r->epfd < 0) {
+    return CMP_ERROR_IO;
+  }
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->wake[0], &ev) != 0) {
+    close(r->epfd);
+    return CMP_ERROR_IO;
+  }
+  return net_ready_reserve(r, NET_EPOLL_EVENTS);
+}
+
+static int net_poller_add(struct cmp_net_reactor *r, cmp_net_stream_t *s) {
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = s;
+  return epoll_ctl(r->epfd, EPOLL_CTL_ADD, s->fd, &ev) == 0 ? CMP_SUCCESS
+                                                           : CMP_ERROR_IO;
+}
+
+static void net_poller_want_write(struct cmp_net_reactor *r,
+                                  cmp_net_stream_t *s, int on) {
+  struct epoll_event ev;
+
+  if (s->want_write == on) {
+    return;
+  }
+  s->want_write = on;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN | (on ? EPOLLOUT : 0);
+  ev.data.ptr = s;
+  epoll_ctl(r->epfd, EPOLL_CTL_MOD, s->fd, &ev);
+}
+
+static void net_poller_remove(struct cmp_net_reactor *r,
+                              cmp_net_stream_t *s) {
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  epoll_ctl(r->epfd, EPOLL_CTL_DEL, s->fd, &ev);
+}
+
+static int net_poller_wait(struct cmp_net_reactor *r, int timeout_ms) {
+  struct epoll_event events[NET_EPOLL_EVENTS];
+  int n, i;
+
+  n = epoll_wait(r->epfd, events, NET_EPOLL_EVENTS, timeout_ms);
+  for (i = 0; i < n; ++i) {
+    r->ready[i] = (cmp_net_stream_t *)events[i].data.ptr;
+    r->ready_flags[i] =
+        ((events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0
+             ? NET_READY_READ
+             : 0) |
+        ((events[i].events & EPOLLOUT) != 0 ? NET_READY_WRITE : 0);
+  }
+  return n < 0 ? 0 : n;
+}
+
+#else
+
+static int net_poller_open(struct cmp_net_reactor *r) {
+  (void)r;
+  return CMP_SUCCESS;
+}
+
+static int net_poller_add(struct cmp_net_reactor *r, cmp_net_stream_t *s) {
+  (void)r;
+  (void)s;
+  return CMP_SUCCESS;
+}
+
+static void net_poller_want_write(struct cmp_net_reactor *r,
+                                  cmp_net_stream_t *s, int on) {
+  (void)r;
+  s->want_write = on;
+}
+
+static void net_poller_remove(struct cmp_net_reactor *r,
+                              cmp_net_stream_t *s) {
+  (void)r;
+  (void)s;
+}
+
+/* Rebuilds the set each wait; poll(2) keeps no registrations */
+static int net_poller_wait(struct cmp_net_reactor *r, int timeout_ms) {
+  cmp_net_stream_t *s;
+  struct pollfd *grown;
+  size_t count = 1, i, cap;
+  int n, ready = 0;
+
+  for (s = r->streams; s != NULL; s = s->next) {
+    count++;
+  }
+  if (count > r->pfd_cap) {
+    cap = r->pfd_cap ? r->pfd_cap : 16;
+    while (cap < count) {
+      cap *= 2;
+    }
+    if (CMP_MALLOC(cap * sizeof(struct pollfd), (void **)&grown) !=
+            CMP_SUCCESS ||
+        net_ready_reserve(r, cap) != CMP_SUCCESS) {
+      return 0;
+    }
+    if (r->pfds != NULL) {
+      CMP_FREE(r->pfds);
+    }
+    r->pfds = grown;
+    r->pfd_cap = cap;
+  }
+  r->pfds[0].fd = r->wake[0];
+  r->pfds[0].events = POLLIN;
+  r->ready[0] = NULL;
+  for (s = r->streams, i = 1; s != NULL; s = s->next, ++i) {
+    r->pfds[i].fd = s->fd;
+    r->pfds[i].events = (short)(POLLIN | (s->want_write ? POLLOUT : 0));
+    r->ready[i] = s;
+  }
+  n = poll(r->pfds, (unsigned long)count, timeout_ms);
+  if (n <= 0) {
+    return 0;
+  }
+  for (i = 0; i < count; ++i) {
+    if (r->pfds[i].revents == 0) {
+      continue;
+    }
+    r->ready[ready] = r->ready[i];
+    r->ready_flags[ready] =
+        ((r->pfds[i].revents & (POLLIN | POLLERR | POLLHUP)) != 0
+             ? NET_READY_READ
+             : 0) |
+        ((r->pfds[i].revents & POLLOUT) != 0 ? NET_READY_WRITE : 0);
+    ready++;
+  }
+  return ready;
+}
+
+#endif
+
+/* --- Stream state ------------------------------------------------------- */
+
+/* Ends a stream on the reactor thread; its final batch carries on_close. */
+static void net_finish(cmp_net_stream_t *s, int result, int code) {
+  struct cmp_net_reactor *r = s->reactor;
+  cmp_net_stream_t **link;
+  net_batch_t *batch;
+
+  if (s->state == NET_ST_DONE) {
+    return;
+  }
+  s->state = NET_ST_DONE;
+  net_poller_remove(r, s);
+  close(s->fd);
+  s->fd = -1;
+  if (s->prev != NULL) {
+    s->prev->next = s->next;
+  } else {
+    r->streams = s->next;
+  }
+  if (s->next != NULL) {
+    s->next->prev = s->prev;
+  }
+  if (s->close_deadline > 0.0) {
+    r->closing--;
+  }
+
+  cmp_mutex_lock(&r->lock);
+  s->accepting = 0;
+  if (s->dirty) {
+    for (link = &r->dirty; *link != NULL; link = &(*link)->queue_next) {
+      if (*link == s) {
+        *link = s->queue_next;
+        break;
+      }
+    }
+    s->dirty = 0;
+  }
+  r->stats.streams--;
+  cmp_mutex_unlock(&r->lock);
+
+  if (s->batch == NULL) {
+    s->batch = s->spare;
+    s->spare = NULL;
+  }
+  batch = s->batch;
+  batch->final = 1;
+  batch->result = result;
+  batch->code = code;
+}
+
+/* Appends a masked client frame; lock held */
+static int net_queue_frame(cmp_net_stream_t *s, int opcode, int compressed,
+                           const void *payload, size_t len) {
+  unsigned char header[14];
+  unsigned char mask[4];
+  size_t header_len;
+
+  net_random_bytes(s->reactor, mask, sizeof(mask));
+  header_len = cmp_ws_frame_header(header, 1, compressed, opcode, len, mask);
+  if (net_buf_reserve(&s->out, header_len + len) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  net_buf_append(&s->out, header, header_len);
+  net_buf_append(&s->out, payload, len);
+  cmp_ws_mask(s->out.data + s->out.len - len, len, mask, 0);
+  return CMP_SUCCESS;
+}
+
+/* Marks a stream for the reactor's next pass; lock held */
+static void net_mark_dirty(cmp_net_stream_t *s) {
+  struct cmp_net_reactor *r = s->reactor;
+
+  if (!s->dirty) {
+    s->dirty = 1;
+    s->queue_next = r->dirty;
+    r->dirty = s;
+    net_wake(r);
+  }
+}
+
+static void net_fail(cmp_net_stream_t *s, int result, int code) {
+  unsigned char payload[2];
+
+  if (s->kind == CMP_NET_STREAM_WEBSOCKET && s->state == NET_ST_OPEN &&
+      code != 1006) {
+    /* Best effort; the socket closes right after */
+    payload[0] = (unsigned char)(code >> 8);
+    payload[1] = (unsigned char)(code & 0xFF);
+    cmp_mutex_lock(&s->reactor->lock);
+    if (net_queue_frame(s, CMP_WS_OP_CLOSE, 0, payload, 2) == CMP_SUCCESS) {
+      if (send(s->fd, s->out.data + s->out_pos, s->out.len - s->out_pos,
+#if defined(MSG_NOSIGNAL)
+               MSG_NOSIGNAL
+#else
+               0
+#endif
+               ) < 0) {
+        s->out_pos = s->out.len;
+      }
+    }
+    cmp_mutex_unlock(&s->reactor->lock);
+  }
+  net_finish(s, result, code);
+}
+
+/* Writes queued output; returns non-zero if the stream finished. */
+static int net_flush(cmp_net_stream_t *s) {
+  struct cmp_net_reactor *r = s->reactor;
+  size_t limit;
+  long n;
+  int failed = 0, pending, close_requested;
+
+  cmp_mutex_lock(&r->lock);
+  limit = s->out.len < s->out_gate ? s->out.len : s->out_gate;
+  while (s->out_pos < limit) {
+    n = (long)send(s->fd, s->out.data + s->out_pos, limit - s->out_pos,
+#if defined(MSG_NOSIGNAL)
+                   MSG_NOSIGNAL
+#else
+                   0
+#endif
+    );
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        failed = 1;
+      }
+      break;
+    }
+    s->out_pos += (size_t)n;
+    r->stats.bytes_out += (size_t)n;
+  }
+  if (s->out_pos == s->out.len) {
+    s->out.len = 0;
+    s->out_pos = 0;
+  } else if (s->out_pos > 0 && s->out_pos == limit) {
+    /* Frames held back by the handshake gate move to the front */
+    memmove(s->out.data, s->out.data + s->out_pos, s->out.len - s->out_pos);
+    s->out.len -= s->out_pos;
+    if (s->out_gate != (size_t)-1) {
+      s->out_gate -= s->out_pos;
+    }
+    s->out_pos = 0;
+  }
+  pending = s->out_pos < s->out.len && s->out_pos < s->out_gate;
+  close_requested = s->close_requested;
+  cmp_mutex_unlock(&r->lock);
+
+  if (failed) {
+    net_finish(s, CMP_ERROR_IO, 1006);
+    return 1;
+  }
+  net_poller_want_write(r, s, pending);
+  if (pending) {
+    return 0;
+  }
+  if (s->peer_closed) {
+    net_finish(s, CMP_SUCCESS, s->close_code);
+    return 1;
+  }
+  if (close_requested) {
+    if (s->kind == CMP_NET_STREAM_SSE || s->state != NET_ST_OPEN) {
+      net_finish(s, CMP_SUCCESS, s->kind == CMP_NET_STREAM_SSE ? 0 : 1000);
+      return 1;
+    }
+    if (s->close_deadline == 0.0) {
+      s->close_deadline = net_now() + NET_CLOSE_TIMEOUT_MS;
+      r->closing++;
+    }
+  }
+  return 0;
+}
+
+/* --- Handshake ---------------------------------------------------------- */
+
+static int net_ci_equal(const char *a, size_t a_len, const char *b) {
+  size_t i;
+
+  if (strlen(b) != a_len) {
+    return 0;
+  }
+  for (i = 0; i < a_len; ++i) {
+    if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int net_ci_contains(const char *s, size_t len, const char *word) {
+  size_t n = strlen(word), i;
+
+  for (i = 0; i + n <= len; ++i) {
+    if (net_ci_equal(s + i, n, word)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Finds a header in a response head; trims the value */
+static int net_header(const char *head, size_t len, const char *name,
+                      const char **out_value, size_t *out_len) {
+  const char *line = head, *end = head + len, *eol, *colon;
+
+  while (line < end) {
+    eol = line;
+    while (eol < end && *eol != '\n') {
+      eol++;
+    }
+    colon = line;
+    while (colon < eol && *colon != ':') {
+      colon++;
+    }
+    if (line != head && colon < eol &&
+        net_ci_equal(line, (size_t)(colon - line), name)) {
+      colon++;
+      while (colon < eol && (*colon == ' ' || *colon == '\t')) {
+        colon++;
+      }
+      *out_value = colon;
+      *out_len = (size_t)(eol - colon);
+      while (*out_len > 0 && (colon[*out_len - 1] == '\r' ||
+                              colon[*out_len - 1] == ' ' ||
+                              colon[*out_len - 1] == '\t')) {
+        (*out_len)--;
+      }
+      return 1;
+    }
+    line = eol + 1;
+  }
+  return 0;
+}
+
+static int net_build_request(cmp_net_stream_t *s,
+                             const cmp_net_stream_config_t *config) {
+  unsigned char nonce[16];
+  char key[25];
+  char *request;
+  const char *path = config->path != NULL ? config->path : "/";
+  size_t cap = strlen(config->host) + strlen(path) + 320;
+  int res;
+
+  if (CMP_MALLOC(cap, (void **)&request) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  if (s->kind == CMP_NET_STREAM_WEBSOCKET) {
+    net_random_bytes(s->reactor, nonce, sizeof(nonce));
+    net_base64(nonce, sizeof(nonce), key);
+    cmp_ws_accept_key(key, s->accept);
+    sprintf(request,
+            "GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\n"
+            "Connection: Upgrade\r\nSec-WebSocket-Key: %s\r\n"
+            "Sec-WebSocket-Version: 13\r\n%s\r\n",
+            path, config->host, key,
+            s->offered_deflate ? "Sec-WebSocket-Extensions: "
+                                 "permessage-deflate; "
+                                 "client_no_context_takeover\r\n"
+                               : "");
+  } else {
+    sprintf(request,
+            "GET %s HTTP/1.1\r\nHost: %s\r\nAccept: text/event-stream\r\n"
+            "Cache-Control: no-cache\r\n\r\n",
+            path, config->host);
+  }
+  res = net_buf_append(&s->out, request, strlen(request));
+  s->out_gate = s->out.len;
+  CMP_FREE(request);
+  return res;
+}
+
+/* Checks the response head; returns non-zero if the stream finished. */
+static int net_handshake(cmp_net_stream_t *s) {
+  const char *head = (const char *)s->in, *value;
+  size_t head_len = 0, i, value_len;
+  int status, deflate = 0;
+
+  for (i = 3; i < s->in_len; ++i) {
+    if (memcmp(s->in + i - 3, "\r\n\r\n", 4) == 0) {
+      head_len = i + 1;
+      break;
+    }
+  }
+  if (head_len == 0) {
+    if (s->in_len > NET_HEADER_LIMIT) {
+      net_finish(s, CMP_ERROR_INVALID_ARG, 0);
+      return 1;
+    }
+    return 0;
+  }
+  if (head_len < 12 || memcmp(head, "HTTP/1.", 7) != 0) {
+    net_finish(s, CMP_ERROR_INVALID_ARG, 0);
+    return 1;
+  }
+  status = atoi(head + 9);
+
+  if (s->kind == CMP_NET_STREAM_WEBSOCKET) {
+    if (status != 101) {
+      net_finish(s, CMP_ERROR_INVALID_STATE, status);
+      return 1;
+    }
+    if (!net_header(head, head_len, "upgrade", &value, &value_len) ||
+        !net_ci_contains(value, value_len, "websocket") ||
+        !net_header(head, head_len, "sec-websocket-accept", &value,
+                    &value_len) ||
+        value_len != 28 || memcmp(value, s->accept, 28) != 0) {
+      net_finish(s, CMP_ERROR_INVALID_ARG, status);
+      return 1;
+    }
+    if (net_header(head, head_len, "sec-websocket-extensions", &value,
+                   &value_len)) {
+      /* Only what was offered may come back */
+      if (!s->offered_deflate ||
+          !net_ci_contains(value, value_len, "permessage-deflate") ||
+          net_ci_contains(value, value_len, ",")) {
+        net_finish(s, CMP_ERROR_INVALID_ARG, status);
+        return 1;
+      }
+      deflate = 1;
+    }
+  } else {
+    if (status != 200) {
+      net_finish(s, CMP_ERROR_INVALID_STATE, status);
+      return 1;
+    }
+    if (net_header(head, head_len, "transfer-encoding", &value,
+                   &value_len) &&
+        net_ci_contains(value, value_len, "chunked")) {
+      s->chunked = 1;
+    }
+  }
+
+  memmove(s->in, s->in + head_len, s->in_len - head_len);
+  s->in_len -= head_len;
+  s->state = NET_ST_OPEN;
+  cmp_mutex_lock(&s->reactor->lock);
+  s->deflate = deflate;
+  s->out_gate = (size_t)-1;
+  net_mark_dirty(s);
+  cmp_mutex_unlock(&s->reactor->lock);
+  return 0;
+}
+
+/* --- WebSocket reader --------------------------------------------------- */
+
+static int net_inflate_write(void *user_data, const unsigned char *data,
+                             size_t len) {
+  cmp_net_stream_t *s = (cmp_net_stream_t *)user_data;
+
+  s->inflated += len;
+  if (s->inflated > s->max_message) {
+    s->inflate_overflow = 1;
+    return 1;
+  }
+  return net_buf_append(&s->batch->arena, data, len) == CMP_SUCCESS ? 0 : 1;
+}
+
+/* Adds one complete message; refs counts zero-copy uses of the read
+ * buffer, or is NULL when the payload lives elsewhere. */
+static int net_ws_message(cmp_net_stream_t *s, unsigned char *payload,
+                          size_t len, size_t *refs) {
+  static const unsigned char k_tail[4] = {0x00, 0x00, 0xFF, 0xFF};
+  net_msg_t *msg = net_batch_push(s, s->msg_opcode);
+  int done = 0, res;
+
+  if (msg == NULL) {
+    net_fail(s, CMP_ERROR_OOM, 1011);
+    return 1;
+  }
+  if (s->msg_compressed) {
+    if (s->inflater == NULL &&
+        cmp_inflate_create(0, net_inflate_write, s, &s->inflater) !=
+            CMP_SUCCESS) {
+      net_fail(s, CMP_ERROR_OOM, 1011);
+      return 1;
+    }
+    s->inflated = 0;
+    s->inflate_overflow = 0;
+    res = cmp_inflate_push(s->inflater, payload, len);
+    if (res == CMP_SUCCESS) {
+      res = cmp_inflate_push(s->inflater, k_tail, sizeof(k_tail));
+    }
+    if (res == CMP_SUCCESS) {
+      res = cmp_inflate_sync(s->inflater);
+    }
+    if (res != CMP_SUCCESS) {
+      if (s->inflate_overflow) {
+        net_fail(s, CMP_ERROR_BOUNDS, 1009);
+      } else {
+        net_fail(s, CMP_ERROR_INVALID_ARG, 1007);
+      }
+      return 1;
+    }
+    msg->len = s->batch->arena.len - msg->off;
+    /* A peer ending its message with a final block starts over */
+    cmp_inflate_is_done(s->inflater, &done);
+    if (done) {
+      cmp_inflate_destroy(s->inflater);
+      s->inflater = NULL;
+    }
+  } else if (refs != NULL && len >= NET_ZERO_COPY_MIN) {
+    msg->data = payload;
+    msg->len = len;
+    (*refs)++;
+  } else {
+    if (net_buf_append(&s->batch->arena, payload, len) != CMP_SUCCESS) {
+      net_fail(s, CMP_ERROR_OOM, 1011);
+      return 1;
+    }
+    msg->len = len;
+  }
+  return 0;
+}
+
+/* Handles a control frame; returns non-zero if the stream finished. */
+static int net_ws_control(cmp_net_stream_t *s, const cmp_ws_frame_t *f) {
+  struct cmp_net_reactor *r = s->reactor;
+  int code = 1005;
+
+  if (f->opcode == CMP_WS_OP_PING) {
+    cmp_mutex_lock(&r->lock);
+    if (s->accepting) {
+      net_queue_frame(s, CMP_WS_OP_PONG, 0, f->payload, f->payload_len);
+      net_mark_dirty(s);
+    }
+    cmp_mutex_unlock(&r->lock);
+  } else if (f->opcode == CMP_WS_OP_CLOSE) {
+    if (f->payload_len == 1) {
+      net_fail(s, CMP_ERROR_INVALID_ARG, 1002);
+      return 1;
+    }
+    if (f->payload_len >= 2) {
+      code = (f->payload[0] << 8) | f->payload[1];
+    }
+    s->peer_closed = 1;
+    s->close_code = code;
+    cmp_mutex_lock(&r->lock);
+    if (!s->close_requested) {
+      /* Echo the close, then finish once it is written */
+      s->close_requested = 1;
+      s->accepting = 0;
+      net_queue_frame(s, CMP_WS_OP_CLOSE, 0, f->payload,
+                      f->payload_len >= 2 ? 2 : 0);
+      net_mark_dirty(s);
+      cmp_mutex_unlock(&r->lock);
+      return 0;
+    }
+    cmp_mutex_unlock(&r->lock);
+    net_finish(s, CMP_SUCCESS, code);
+    return 1;
+  }
+  return 0;
+}
+
+static void net_ws_process(cmp_net_stream_t *s) {
+  cmp_ws_frame_t f;
+  unsigned char *fresh;
+  size_t pos = 0, used, refs = 0, rest, cap;
+  int res;
+
+  while (s->state == NET_ST_OPEN && !s->peer_closed) {
+    res = cmp_ws_frame_parse(s->in + pos, s->in_len - pos, &f, &used);
+    if (res != CMP_SUCCESS) {
+      net_fail(s, CMP_ERROR_INVALID_ARG,
+               res == CMP_ERROR_BOUNDS ? 1009 : 1002);
+      return;
+    }
+    if (used == 0) {
+      if (s->in_len - pos > s->max_message + 14) {
+        net_fail(s, CMP_ERROR_BOUNDS, 1009);
+        return;
+      }
+      break;
+    }
+    /* Server frames are never masked */
+    if ((s->in[pos + 1] & 0x80) != 0) {
+      net_fail(s, CMP_ERROR_INVALID_ARG, 1002);
+      return;
+    }
+    pos += used;
+
+    if (f.opcode >= CMP_WS_OP_CLOSE) {
+      if (net_ws_control(s, &f)) {
+        return;
+      }
+      continue;
+    }
+    if (f.opcode == CMP_WS_OP_CONTINUATION) {
+      if (!s->in_message || f.compressed) {
+        net_fail(s, CMP_ERROR_INVALID_ARG, 1002);
+        return;
+      }
+    } else {
+      if (s->in_message || (f.compressed && !s->deflate)) {
+        net_fail(s, CMP_ERROR_INVALID_ARG, 1002);
+        return;
+      }
+      s->in_message = 1;
+      s->msg_opcode = f.opcode;
+      s->msg_compressed = f.compressed;
+      s->frag.len = 0;
+    }
+    if (f.payload_len > s->max_message - s->frag.len) {
+      net_fail(s, CMP_ERROR_BOUNDS, 1009);
+      return;
+    }
+    if (f.fin && s->frag.len == 0) {
+      if (net_ws_message(s, f.payload, f.payload_len, &refs)) {
+        return;
+      }
+    } else {
+      if (net_buf_append(&s->frag, f.payload, f.payload_len) !=
+          CMP_SUCCESS) {
+        net_fail(s, CMP_ERROR_OOM, 1011);
+        return;
+      }
+      if (f.fin && net_ws_message(s, s->frag.data, s->frag.len, NULL)) {
+        return;
+      }
+    }
+    if (f.fin) {
+      s->in_message = 0;
+      s->frag.len = 0;
+    }
+  }
+  if (s->state == NET_ST_DONE) {
+    return;
+  }
+
+  /* Payloads referenced by the batch travel with it; only the partial
+   * frame at the end is copied into a fresh read buffer. */
+  rest = s->in_len - pos;
+  if (refs > 0) {
+    cap = rest > NET_READ_CHUNK ? rest * 2 : NET_READ_CHUNK;
+    if (CMP_MALLOC(cap, (void **)&fresh) != CMP_SUCCESS ||
+        net_batch_adopt(s, s->in) != CMP_SUCCESS) {
+      net_fail(s, CMP_ERROR_OOM, 1011);
+      return;
+    }
+    memcpy(fresh, s->in + pos, rest);
+    s->in = fresh;
+    s->in_cap = cap;
+  } else if (pos > 0) {
+    memmove(s->in, s->in + pos, rest);
+  }
+  s->in_len = rest;
+}
+
+/* --- SSE reader --------------------------------------------------------- */
+
+static int net_sse_dispatch(cmp_net_stream_t *s) {
+  static const char k_default[] = "message";
+  net_msg_t *msg;
+  net_buf_t *arena;
+  size_t data_len;
+
+  if (!s->sse_data_seen) {
+    s->sse_event.len = 0;
+    return 0;
+  }
+  msg = net_batch_push(s, CMP_WS_OP_TEXT);
+  if (msg == NULL) {
+    return 1;
+  }
+  arena = &s->batch->arena;
+  /* The last data line's newline is not part of the event */
+  data_len = s->sse_data.len > 0 ? s->sse_data.len - 1 : 0;
+  if (net_buf_append(arena, s->sse_data.data, data_len) != CMP_SUCCESS ||
+      net_buf_append(arena, "", 1) != CMP_SUCCESS) {
+    return 1;
+  }
+  msg->len = data_len;
+  msg->event_off = arena->len;
+  if ((s->sse_event.len > 0
+           ? net_buf_append(arena, s->sse_event.data, s->sse_event.len)
+           : net_buf_append(arena, k_default, sizeof(k_default) - 1)) !=
+          CMP_SUCCESS ||
+      net_buf_append(arena, "", 1) != CMP_SUCCESS) {
+    return 1;
+  }
+  msg->id_off = arena->len;
+  if (net_buf_append(arena, s->sse_id.data, s->sse_id.len) != CMP_SUCCESS ||
+      net_buf_append(arena, "", 1) != CMP_SUCCESS) {
+    return 1;
+  }
+  s->sse_data.len = 0;
+  s->sse_event.len = 0;
+  s->sse_data_seen = 0;
+  return 0;
+}
+
+static int net_sse_line(cmp_net_stream_t *s, const char *line, size_t len) {
+  const char *value;
+  size_t name_len = 0, value_len;
+
+  if (len == 0) {
+    return net_sse_dispatch(s);
+  }
+  if (line[0] == ':') {
+    return 0; /* Comment, often a keep-alive */
+  }
+  while (name_len < len && line[name_len] != ':') {
+    name_len++;
+  }
+  value = line + name_len;
+  value_len = len - name_len;
+  if (value_len > 0) {
+    value++;
+    value_len--;
+    if (value_len > 0 && *value == ' ') {
+      value++;
+      value_len--;
+    }
+  }
+  if (name_len == 4 && memcmp(line, "data", 4) == 0) {
+    s->sse_data_seen = 1;
+    if (s->sse_data.len + value_len + 1 > s->max_message) {
+      return 1;
+    }
+    return net_buf_append(&s->sse_data, value, value_len) != CMP_SUCCESS ||
+           net_buf_append(&s->sse_data, "\n", 1) != CMP_SUCCESS;
+  }
+  if (name_len == 5 && memcmp(line, "event", 5) == 0) {
+    s->sse_event.len = 0;
+    return net_buf_append(&s->sse_event, value, value_len) != CMP_SUCCESS;
+  }
+  if (name_len == 2 && memcmp(line, "id", 2) == 0 &&
+      memchr(value, '\0', value_len) == NULL) {
+    s->sse_id.len = 0;
+    return net_buf_append(&s->sse_id, value, value_len) != CMP_SUCCESS;
+  }
+  /* retry and unknown fields are ignored; reconnecting is the caller's */
+  return 0;
+}
+
+/* Splits body bytes into lines ending in CR, LF or CRLF. */
+static int net_sse_feed(cmp_net_stream_t *s, const unsigned char *data,
+                        size_t len) {
+  size_t i = 0, start;
+
+  if (!s->sse_started && len > 0) {
+    /* A leading byte order mark is dropped */
+    s->sse_started = 1;
+    if (len >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+      i = 3;
+    }
+  }
+  while (i < len) {
+    if (s->last_cr && data[i] == '\n') {
+      s->last_cr = 0;
+      i++;
+      continue;
+    }
+    start = i;
+    while (i < len && data[i] != '\r' && data[i] != '\n') {
+      i++;
+    }
+    if (s->line.len + (i - start) > s->max_message) {
+      return 1;
+    }
+    if (net_buf_append(&s->line, data + start, i - start) != CMP_SUCCESS) {
+      return 1;
+    }
+    if (i == len) {
+      break;
+    }
+    s->last_cr = data[i] == '\r';
+    i++;
+    if (net_sse_line(s, (const char *)s->line.data, s->line.len)) {
+      return 1;
+    }
+    s->line.len = 0;
+  }
+  return 0;
+}
+
+/* Undoes chunked transfer coding; returns non-zero if the stream ended. */
+static int net_sse_process(cmp_net_stream_t *s) {
+  const unsigned char *p = s->in;
+  size_t len = s->in_len, i = 0, n;
+  int c, digit;
+
+  s->in_len = 0;
+  if (!s->chunked) {
+    if (net_sse_feed(s, p, len)) {
+      net_finish(s, CMP_ERROR_BOUNDS, 0);
+      return 1;
+    }
+    return 0;
+  }
+  while (i < len) {
+    c = p[i];
+    switch (s->chunk_state) {
+    case NET_CHUNK_SIZE:
+    case NET_CHUNK_EXT:
+      i++;
+      if (c == '\n') {
+        s->chunk_state = s->chunk_left == 0 ? NET_CHUNK_TRAILER
+                                            : NET_CHUNK_DATA;
+        break;
+      }
+      if (s->chunk_state == NET_CHUNK_EXT || c == '\r') {
+        break;
+      }
+      if (c == ';' || c == ' ') {
+        s->chunk_state = NET_CHUNK_EXT;
+        break;
+      }
+      digit = isdigit(c) ? c - '0'
+                         : (isxdigit(c) ? tolower(c) - 'a' + 10 : -1);
+      if (digit < 0 || s->chunk_left > s->max_message) {
+        net_finish(s, CMP_ERROR_INVALID_ARG, 0);
+        return 1;
+      }
+      s->chunk_left = s->chunk_left * 16 + (size_t)digit;
+      break;
+    case NET_CHUNK_DATA:
+      n = len - i < s->chunk_left ? len - i : s->chunk_left;
+      if (net_sse_feed(s, p + i, n)) {
+        net_finish(s, CMP_ERROR_BOUNDS, 0);
+        return 1;
+      }
+      i += n;
+      s->chunk_left -= n;
+      if (s->chunk_left == 0) {
+        s->chunk_state = NET_CHUNK_DATA_END;
+      }
+      break;
+    case NET_CHUNK_DATA_END:
+      i++;
+      if (c == '\n') {
+        s->chunk_state = NET_CHUNK_SIZE;
+      }
+      break;
+    case NET_CHUNK_TRAILER:
+      /* The zero-size chunk ends the stream */
+      net_finish(s, CMP_SUCCESS, 0);
+      return 1;
+    }
+  }
+  if (s->chunk_state == NET_CHUNK_TRAILER) {
+    net_finish(s, CMP_SUCCESS, 0);
+    return 1;
+  }
+  return 0;
+}
+
+/* --- Reactor thread ----------------------------------------------------- */
+
+static void net_process(cmp_net_stream_t *s) {
+  if (s->state == NET_ST_HANDSHAKE && net_handshake(s)) {
+    return;
+  }
+  if (s->state != NET_ST_OPEN) {
+    return;
+  }
+  if (s->kind == CMP_NET_STREAM_WEBSOCKET) {
+    net_ws_process(s);
+  } else {
+    net_sse_process(s);
+  }
+}
+
+static void net_read(cmp_net_stream_t *s) {
+  struct cmp_net_reactor *r = s->reactor;
+  unsigned char *grown;
+  size_t budget = NET_READ_BUDGET, cap;
+  long n;
+
+  while (budget > 0 && s->state != NET_ST_DONE) {
+    if (s->in_cap - s->in_len < NET_READ_CHUNK / 4) {
+      cap = s->in_cap ? s->in_cap * 2 : NET_READ_CHUNK;
+      if (CMP_MALLOC(cap, (void **)&grown) != CMP_SUCCESS) {
+        net_fail(s, CMP_ERROR_OOM, 1011);
+        return;
+      }
+      if (s->in_len > 0) {
+        memcpy(grown, s->in, s->in_len);
+      }
+      if (s->in != NULL) {
+        CMP_FREE(s->in);
+      }
+      s->in = grown;
+      s->in_cap = cap;
+    }
+    n = (long)read(s->fd, s->in + s->in_len, s->in_cap - s->in_len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        net_finish(s, CMP_ERROR_IO, 1006);
+      }
+      return;
+    }
+    if (n == 0) {
+      /* A WebSocket that closed cleanly finished on its close frame */
+      if (s->kind == CMP_NET_STREAM_SSE && s->state == NET_ST_OPEN &&
+          !s->chunked) {
+        net_finish(s, CMP_SUCCESS, 0);
+      } else {
+        net_finish(s, CMP_ERROR_IO, 1006);
+      }
+      return;
+    }
+    cmp_mutex_lock(&r->lock);
+    r->stats.bytes_in += (size_t)n;
+    cmp_mutex_unlock(&r->lock);
+    s->in_len += (size_t)n;
+    budget = (size_t)n < budget ? budget - (size_t)n : 0;
+    net_process(s);
+  }
+}
+
+static void net_adopt(struct cmp_net_reactor *r) {
+  cmp_net_stream_t *s, *next;
+
+  cmp_mutex_lock(&r->lock);
+  s = r->adding;
+  r->adding = NULL;
+  cmp_mutex_unlock(&r->lock);
+
+  for (; s != NULL; s = next) {
+    next = s->queue_next;
+    s->queue_next = NULL;
+    s->prev = NULL;
+    s->next = r->streams;
+    if (r->streams != NULL) {
+      r->streams->prev = s;
+    }
+    r->streams = s;
+    if (net_poller_add(r, s) != CMP_SUCCESS) {
+      net_finish(s, CMP_ERROR_IO, 1006);
+    } else {
+      if (s->in_len > 0) {
+        net_process(s);
+      }
+      if (s->state != NET_ST_DONE) {
+        net_flush(s);
+      }
+    }
+    net_dispatch(s);
+  }
+}
+
+static void net_drain_dirty(struct cmp_net_reactor *r) {
+  cmp_net_stream_t *s, *next;
+
+  cmp_mutex_lock(&r->lock);
+  s = r->dirty;
+  r->dirty = NULL;
+  for (next = s; next != NULL; next = next->queue_next) {
+    next->dirty = 0;
+  }
+  cmp_mutex_unlock(&r->lock);
+
+  for (; s != NULL; s = next) {
+    next = s->queue_next;
+    net_flush(s);
+    net_dispatch(s);
+  }
+}
+
+static void net_expire(struct cmp_net_reactor *r) {
+  cmp_net_stream_t *s, *next;
+  double now = net_now();
+
+  for (s = r->streams; s != NULL; s = next) {
+    next = s->next;
+    if (s->close_deadline > 0.0 && now >= s->close_deadline) {
+      net_finish(s, CMP_ERROR_IO, 1006);
+      net_dispatch(s);
+    }
+  }
+}
+
+static void *net_thread(void *arg) {
+  struct cmp_net_reactor *r = (struct cmp_net_reactor *)arg;
+  unsigned char drain[64];
+  cmp_net_stream_t *s;
+  int n, i, stopping;
+
+  for (;;) {
+    cmp_mutex_lock(&r->lock);
+    stopping = r->stopping;
+    cmp_mutex_unlock(&r->lock);
+    if (stopping) {
+      break;
+    }
+    net_adopt(r);
+    net_drain_dirty(r);
+
+    n = net_poller_wait(r, r->closing > 0 ? 100 : -1);
+    cmp_mutex_lock(&r->lock);
+    r->stats.wakeups++;
+    cmp_mutex_unlock(&r->lock);
+    for (i = 0; i < n; ++i) {
+      s = r->ready[i];
+      if (s == NULL) {
+        while (read(r->wake[0], drain, sizeof(drain)) > 0) {
+        }
+        continue;
+      }
+      if ((r->ready_flags[i] & NET_READY_WRITE) != 0 && net_flush(s)) {
+        net_dispatch(s);
+        continue;
+      }
+      if ((r->ready_flags[i] & NET_READY_READ) != 0) {
+        net_read(s);
+        if (s->state != NET_ST_DONE && (s->peer_closed || s->want_write)) {
+          net_flush(s);
+        }
+      }
+      net_dispatch(s);
+    }
+    if (r->closing > 0) {
+      net_expire(r);
+    }
+  }
+  return 0;
+}
+
+static int net_set_nonblocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+    return CMP_ERROR_IO;
+  }
+  return CMP_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------ */
+
+int cmp_net_reactor_create(cmp_modality_t *deliver,
+                           cmp_net_reactor_t **out_reactor) {
+  struct cmp_net_reactor *r;
+  int fd;
+
+  if (deliver == NULL || out_reactor == NULL ||
+      deliver->type == CMP_MODALITY_THREADED) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(struct cmp_net_reactor), (void **)&r) !=
+      CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(r, 0, sizeof(struct cmp_net_reactor));
+  r->deliver = deliver;
+  if (pipe(r->wake) != 0) {
+    CMP_FREE(r);
+    return CMP_ERROR_IO;
+  }
+  if (net_set_nonblocking(r->wake[0]) != CMP_SUCCESS ||
+      net_set_nonblocking(r->wake[1]) != CMP_SUCCESS ||
+      net_poller_open(r) != CMP_SUCCESS) {
+    close(r->wake[0]);
+    close(r->wake[1]);
+    if (r->ready != NULL) {
+      CMP_FREE(r->ready);
+      CMP_FREE(r->ready_flags);
+    }
+    CMP_FREE(r);
+    return CMP_ERROR_IO;
+  }
+  fd = open("/dev/urandom", O_RDONLY);
+  if (fd < 0 || read(fd, &r->rng, sizeof(r->rng)) != (long)sizeof(r->rng)) {
+    r->rng = (unsigned long)time(NULL) ^ (unsigned long)(size_t)r;
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  r->rng &= 0xFFFFFFFFUL;
+  if (r->rng == 0) {
+    r->rng = 0x9E3779B9UL;
+  }
+  cmp_mutex_init(&r->lock);
+  if (pthread_create(&r->thread, NULL, net_thread, r) != 0) {
+    net_reactor_free(r);
+    return CMP_ERROR_OOM;
+  }
+  *out_reactor = r;
+  return CMP_SUCCESS;
+}
+
+int cmp_net_reactor_destroy(cmp_net_reactor_t *reactor) {
+  struct cmp_net_reactor *r = reactor;
+  cmp_net_stream_t *s, *next, *lists[2];
+  int i, free_now;
+
+  if (r == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  cmp_mutex_lock(&r->lock);
+  r->stopping = 1;
+  cmp_mutex_unlock(&r->lock);
+  net_wake(r);
+  pthread_join(r->thread, NULL);
+
+  /* The thread is gone; what it did not finish is closed here */
+  lists[0] = r->streams;
+  lists[1] = r->adding;
+  cmp_mutex_lock(&r->lock);
+  r->destroyed = 1;
+  for (i = 0; i < 2; ++i) {
+    for (s = lists[i]; s != NULL; s = next) {
+      next = i == 0 ? s->next : s->queue_next;
+      if (s->batch != NULL) {
+        net_batch_free(s->batch);
+        s->batch = NULL;
+      }
+      if (s->pending > 0) {
+        s->orphaned = 1;
+        close(s->fd);
+        s->fd = -1;
+      } else {
+        cmp_mutex_unlock(&r->lock);
+        net_stream_free(s);
+        cmp_mutex_lock(&r->lock);
+      }
+    }
+  }
+  r->streams = NULL;
+  r->adding = NULL;
+  free_now = r->pending == 0;
+  cmp_mutex_unlock(&r->lock);
+  if (free_now) {
+    net_reactor_free(r);
+  }
+  return CMP_SUCCESS;
+}
+
+int cmp_net_reactor_add(cmp_net_reactor_t *reactor, int fd,
+                        const cmp_net_stream_config_t *config,
+                        cmp_net_stream_t **out_stream) {
+  struct cmp_net_reactor *r = reactor;
+  cmp_net_stream_t *s;
+  int res;
+
+  if (r == NULL || fd < 0 || config == NULL ||
+      (config->initial == NULL && config->initial_len > 0) ||
+      (config->kind != CMP_NET_STREAM_WEBSOCKET &&
+       config->kind != CMP_NET_STREAM_SSE)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (net_set_nonblocking(fd) != CMP_SUCCESS) {
+    return CMP_ERROR_IO;
+  }
+  if (CMP_MALLOC(sizeof(cmp_net_stream_t), (void **)&s) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(s, 0, sizeof(cmp_net_stream_t));
+  s->reactor = r;
+  s->fd = -1;
+  s->kind = config->kind;
+  s->max_message =
+      config->max_message > 0 ? config->max_message : NET_MAX_MESSAGE;
+  s->on_batch = config->on_batch;
+  s->on_close = config->on_close;
+  s->user_data = config->user_data;
+  s->offered_deflate =
+      config->kind == CMP_NET_STREAM_WEBSOCKET && config->permessage_deflate;
+  s->out_gate = (size_t)-1;
+  s->accepting = 1;
+  s->state = NET_ST_OPEN;
+  s->deflate = config->host == NULL && s->offered_deflate;
+
+  if (CMP_MALLOC(sizeof(net_batch_t), (void **)&s->spare) != CMP_SUCCESS) {
+    CMP_FREE(s);
+    return CMP_ERROR_OOM;
+  }
+  memset(s->spare, 0, sizeof(net_batch_t));
+  s->spare->stream = s;
+  cmp_mutex_lock(&r->lock);
+  res = config->host != NULL ? net_build_request(s, config) : CMP_SUCCESS;
+  cmp_mutex_unlock(&r->lock);
+  if (res == CMP_SUCCESS && config->initial_len > 0) {
+    res = CMP_MALLOC(config->initial_len + NET_READ_CHUNK, (void **)&s->in);
+    if (res == CMP_SUCCESS) {
+      memcpy(s->in, config->initial, config->initial_len);
+      s->in_len = config->initial_len;
+      s->in_cap = config->initial_len + NET_READ_CHUNK;
+    }
+  }
+  if (res != CMP_SUCCESS) {
+    net_stream_free(s);
+    return res;
+  }
+  if (config->host != NULL) {
+    s->state = NET_ST_HANDSHAKE;
+  }
+  s->fd = fd;
+
+  cmp_mutex_lock(&r->lock);
+  if (r->stopping) {
+    cmp_mutex_unlock(&r->lock);
+    s->fd = -1;
+    net_stream_free(s);
+    return CMP_ERROR_INVALID_STATE;
+  }
+  s->queue_next = r->adding;
+  r->adding = s;
+  r->stats.streams++;
+  cmp_mutex_unlock(&r->lock);
+  net_wake(r);
+  if (out_stream != NULL) {
+    *out_stream = s;
+  }
+  return CMP_SUCCESS;
+}
+
+int cmp_net_reactor_get_stats(cmp_net_reactor_t *reactor,
+                              cmp_net_reactor_stats_t *out_stats) {
+  if (reactor == NULL || out_stats == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  cmp_mutex_lock(&reactor->lock);
+  *out_stats = reactor->stats;
+  cmp_mutex_unlock(&reactor->lock);
+  return CMP_SUCCESS;
+}
+
+static int net_zbuf_write(void *user_data, const unsigned char *data,
+                          size_t len) {
+  cmp_net_stream_t *s = (cmp_net_stream_t *)user_data;
+  return net_buf_append(&s->zbuf, data, len) == CMP_SUCCESS ? 0 : 1;
+}
+
+int cmp_net_stream_send(cmp_net_stream_t *stream, int opcode,
+                        const void *data, size_t len) {
+  struct cmp_net_reactor *r;
+  int res = CMP_SUCCESS, compressed = 0;
+
+  if (stream == NULL || (data == NULL && len > 0) ||
+      (opcode != CMP_WS_OP_TEXT && opcode != CMP_WS_OP_BINARY &&
+       opcode != CMP_WS_OP_PING) ||
+      (opcode == CMP_WS_OP_PING && len > 125)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  r = stream->reactor;
+  cmp_mutex_lock(&r->lock);
+  if (!stream->accepting || stream->kind != CMP_NET_STREAM_WEBSOCKET) {
+    cmp_mutex_unlock(&r->lock);
+    return CMP_ERROR_INVALID_STATE;
+  }
+  /* The offer asked for client_no_context_takeover, so every message is a
+   * self-contained deflate stream ending in a final block (RFC 7692
+   * 7.2.3.4). Messages that do not shrink, and messages queued before the
+   * handshake agreed on the extension, go out plain. */
+  if (stream->deflate && opcode != CMP_WS_OP_PING &&
+      len >= NET_COMPRESS_MIN) {
+    if (stream->deflater == NULL) {
+      res = cmp_deflate_create(0, net_zbuf_write, stream, &stream->deflater);
+    } else {
+      res = cmp_deflate_reset(stream->deflater);
+    }
+    stream->zbuf.len = 0;
+    if (res == CMP_SUCCESS) {
+      res = cmp_deflate_push(stream->deflater, data, len);
+    }
+    if (res == CMP_SUCCESS) {
+      res = cmp_deflate_finish(stream->deflater);
+    }
+    compressed = res == CMP_SUCCESS && stream->zbuf.len < len;
+  }
+  res = compressed ? net_queue_frame(stream, opcode, 1, stream->zbuf.data,
+                                     stream->zbuf.len)
+                   : net_queue_frame(stream, opcode, 0, data, len);
+  if (res == CMP_SUCCESS) {
+    net_mark_dirty(stream);
+  }
+  cmp_mutex_unlock(&r->lock);
+  return res;
+}
+
+int cmp_net_stream_close(cmp_net_stream_t *stream, int code) {
+  struct cmp_net_reactor *r;
+  unsigned char payload[2];
+
+  if (stream == NULL || code < 0 || code > 4999) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (code == 0) {
+    code = 1000;
+  }
+  r = stream->reactor;
+  cmp_mutex_lock(&r->lock);
+  if (!stream->accepting) {
+    cmp_mutex_unlock(&r->lock);
+    return CMP_ERROR_INVALID_STATE;
+  }
+  stream->accepting = 0;
+  stream->close_requested = 1;
+  if (stream->kind == CMP_NET_STREAM_WEBSOCKET) {
+    payload[0] = (unsigned char)(code >> 8);
+    payload[1] = (unsigned char)(code & 0xFF);
+    net_queue_frame(stream, CMP_WS_OP_CLOSE, 0, payload, 2);
+  }
+  net_mark_dirty(stream);
+  cmp_mutex_unlock(&r->lock);
+  return CMP_SUCCESS;
+}
+
+#else
+
+int cmp_net_reactor_create(cmp_modality_t *deliver,
+                           cmp_net_reactor_t **out_reactor) {
+  if (deliver == NULL || out_reactor == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  return CMP_ERROR_INVALID_STATE;
+}
+
+int cmp_net_reactor_destroy(cmp_net_reactor_t *reactor) {
+  (void)reactor;
+  return CMP_ERROR_INVALID_ARG;
+}
+
+int cmp_net_reactor_add(cmp_net_reactor_t *reactor, int fd,
+                        const cmp_net_stream_config_t *config,
+                        cmp_net_stream_t **out_stream) {
+  (void)reactor;
+  (void)fd;
+  (void)config;
+  (void)out_stream;
+  return CMP_ERROR_INVALID_ARG;
+}
+
+int cmp_net_reactor_get_stats(cmp_net_reactor_t *reactor,
+                              cmp_net_reactor_stats_t *out_stats) {
+  (void)reactor;
+  (void)out_stats;
+  return CMP_ERROR_INVALID_ARG;
+}
+
+int cmp_net_stream_send(cmp_net_stream_t *stream, int opcode,
+                        const void *data, size_t len) {
+  (void)stream;
+  (void)opcode;
+  (void)data;
+  (void)len;
+  return CMP_ERROR_INVALID_ARG;
+}
+
+int cmp_net_stream_close(cmp_net_stream_t *stream, int code) {
+  (void)stream;
+  (void)code;
+  return CMP_ERROR_INVALID_ARG;
+}
+
+#endif
@@ -1,11 +1,15 @@
 /* clang-format off */
 #include "cmp.h"
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 /* clang-format on */
 
 static int g_orm_initialized = 0;
 
+static void orm_tables_free(void);
+static void orm_notify_sql(c_orm_db_t *db, const char *sql);
+
 int cmp_orm_init(void) {
   if (g_orm_initialized) {
     return CMP_SUCCESS;
@@ -18,6 +22,7 @@ int cmp_orm_shutdown(void) {
   if (!g_orm_initialized) {
     return CMP_SUCCESS;
   }
+  orm_tables_free();
   g_orm_initialized = 0;
   return CMP_SUCCESS;
 }
@@ -103,6 +108,8 @@ int cmp_orm_execute(c_orm_db_t *db, const char *sql) {
     return CMP_ERROR_NOT_FOUND;
   }
 
+  /* Observables re-query on the next tick rather than per statement */
+  orm_notify_sql(db, sql);
   return CMP_SUCCESS;
 }
 
@@ -124,17 +131,681 @@ int cmp_orm_set_encryption_key(c_orm_db_t *db, const char *key) {
   return CMP_SUCCESS;
 }
 
+/* ------------------------------------------------------------------------ */
+/* Reactive observables                                                     */
+/* ------------------------------------------------------------------------ */
+
+/* Result rows: contiguous identifiers (the diff input) plus a content hash
+ * and a slice of the shared payload buffer per row */
+typedef struct orm_row {
+  uint64_t hash;
+  size_t offset;
+  size_t size;
+} orm_row_t;
+
+struct cmp_orm_rows {
+  uint64_t *ids;
+  orm_row_t *rows;
+  size_t count;
+  size_t ids_cap;
+  size_t cap;
+  unsigned char *data;
+  size_t data_len;
+  size_t data_cap;
+};
+
+typedef struct orm_binding {
+  cmp_ui_node_t *node;
+  char *property;
+  int dirty;
+} orm_binding_t;
+
+/* Observers of one table, shared by every connection */
+typedef struct orm_table {
+  char *name; /* Lower-cased */
+  size_t len;
+  uint32_t hash;
+  cmp_orm_observable_t **observers;
+  size_t count;
+  size_t cap;
+} orm_table_t;
+
+typedef struct orm_job {
+  cmp_orm_observable_t *obs;
+  c_orm_db_t *db;
+  const char *query;
+  cmp_orm_fetch_cb_t fetch;
+  void *fetch_data;
+  cmp_orm_rows_t rows;
+  int res;
+} orm_job_t;
+
 struct cmp_orm_observable {
   c_orm_db_t *db;
   char *query;
-  cmp_ui_node_t *bound_node;
-  char *bound_property;
+  orm_binding_t *bindings;
+  size_t binding_count;
+  size_t binding_cap;
+  orm_table_t **tables;
+  size_t table_count;
+  size_t table_cap;
+  cmp_orm_observable_t *prev; /* Live observables */
+  cmp_orm_observable_t *next;
+  cmp_orm_fetch_cb_t fetch;
+  void *fetch_data;
+  cmp_orm_change_cb_t on_change;
+  void *change_data;
+  cmp_modality_t *workers;
+  cmp_modality_t *ui;
+  cmp_orm_rows_t rows;
+  orm_job_t *job; /* At most one re-query in flight */
+  double debounce_ms;
+  double first_change_ms;
+  double last_change_ms;
+  int changed; /* Written to since the last tick */
+  int stale;   /* Waiting out the debounce */
+  int loaded;
+  int destroyed;
 };
 
+static orm_table_t **g_orm_tables = NULL; /* Open addressing, power of two */
+static size_t g_orm_table_cap = 0;
+static size_t g_orm_table_count = 0;
+static cmp_orm_observable_t *g_orm_live = NULL;
+
+static int orm_reserve(void **data, size_t *cap, size_t need, size_t size) {
+  void *grown;
+  size_t new_cap;
+
+  if (need <= *cap) {
+    return CMP_SUCCESS;
+  }
+  new_cap = *cap > 0 ? *cap : 16;
+  while (new_cap < need) {
+    new_cap *= 2;
+  }
+  if (CMP_MALLOC(new_cap * size, &grown) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  if (*data != NULL) {
+    memcpy(grown, *data, *cap * size);
+    CMP_FREE(*data);
+  }
+  *data = grown;
+  *cap = new_cap;
+  return CMP_SUCCESS;
+}
+
+static char *orm_strdup(const char *s) {
+  char *copy;
+  size_t len = strlen(s);
+
+  if (CMP_MALLOC(len + 1, (void **)&copy) != CMP_SUCCESS) {
+    return NULL;
+  }
+  memcpy(copy, s, len + 1);
+  return copy;
+}
+
+static uint64_t orm_hash_bytes(const void *data, size_t size) {
+  const unsigned char *p = (const unsigned char *)data;
+  uint64_t h = ((uint64_t)0xcbf29ce4UL << 32) | 0x84222325UL;
+  const uint64_t prime = ((uint64_t)0x100UL << 32) | 0x1b3UL;
+  size_t i;
+
+  for (i = 0; i < size; ++i) {
+    h ^= p[i];
+    h *= prime;
+  }
+  return h;
+}
+
+static void orm_rows_free(cmp_orm_rows_t *rows) {
+  if (rows->ids != NULL) {
+    CMP_FREE(rows->ids);
+  }
+  if (rows->rows != NULL) {
+    CMP_FREE(rows->rows);
+  }
+  if (rows->data != NULL) {
+    CMP_FREE(rows->data);
+  }
+  memset(rows, 0, sizeof(cmp_orm_rows_t));
+}
+
+int cmp_orm_rows_append(cmp_orm_rows_t *rows, uint64_t id, const void *data,
+                        size_t size) {
+  orm_row_t *row;
+
+  if (rows == NULL || (data == NULL && size > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (orm_reserve((void **)&rows->ids, &rows->ids_cap, rows->count + 1,
+                  sizeof(uint64_t)) != CMP_SUCCESS ||
+      orm_reserve((void **)&rows->rows, &rows->cap, rows->count + 1,
+                  sizeof(orm_row_t)) != CMP_SUCCESS ||
+      orm_reserve((void **)&rows->data, &rows->data_cap,
+                  rows->data_len + size, 1) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  if (size > 0) {
+    memcpy(rows->data + rows->data_len, data, size);
+  }
+  row = &rows->rows[rows->count];
+  row->hash = orm_hash_bytes(data, size);
+  row->offset = rows->data_len;
+  row->size = size;
+  rows->ids[rows->count++] = id;
+  rows->data_len += size;
+  return CMP_SUCCESS;
+}
+
+int cmp_orm_rows_get_count(const cmp_orm_rows_t *rows, size_t *out_count) {
+  if (rows == NULL || out_count == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  *out_count = rows->count;
+  return CMP_SUCCESS;
+}
+
+int cmp_orm_rows_get(const cmp_orm_rows_t *rows, size_t index,
+                     uint64_t *out_id, const void **out_data,
+                     size_t *out_size) {
+  if (rows == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (index >= rows->count) {
+    return CMP_ERROR_BOUNDS;
+  }
+  if (out_id != NULL) {
+    *out_id = rows->ids[index];
+  }
+  if (out_data != NULL) {
+    *out_data =
+        rows->data != NULL ? rows->data + rows->rows[index].offset : NULL;
+  }
+  if (out_size != NULL) {
+    *out_size = rows->rows[index].size;
+  }
+  return CMP_SUCCESS;
+}
+
+/* Table registry */
+
+static uint32_t orm_name_hash(const char *name, size_t len) {
+  uint32_t h = 2166136261UL;
+  size_t i;
+
+  for (i = 0; i < len; ++i) {
+    h ^= (uint32_t)tolower((unsigned char)name[i]);
+    h *= 16777619UL;
+  }
+  return h;
+}
+
+static int orm_name_equal(const orm_table_t *table, const char *name,
+                          size_t len) {
+  size_t i;
+
+  if (table->len != len) {
+    return 0;
+  }
+  for (i = 0; i < len; ++i) {
+    if (table->name[i] != (char)tolower((unsigned char)name[i])) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static orm_table_t **orm_table_slot(orm_table_t **slots, size_t cap,
+                                    const char *name, size_t len,
+                                    uint32_t hash) {
+  size_t i = hash & (cap - 1);
+
+  while (slots[i] != NULL &&
+         (slots[i]->hash != hash || !orm_name_equal(slots[i], name, len))) {
+    i = (i + 1) & (cap - 1);
+  }
+  return &slots[i];
+}
+
+static orm_table_t *orm_table_find(const char *name, size_t len, int create) {
+  orm_table_t **slot, **grown, *table;
+  uint32_t hash = orm_name_hash(name, len);
+  size_t i, cap;
+
+  if (g_orm_table_cap > 0) {
+    slot = orm_table_slot(g_orm_tables, g_orm_table_cap, name, len, hash);
+    if (*slot != NULL || !create) {
+      return *slot;
+    }
+  } else if (!create) {
+    return NULL;
+  }
+
+  /* Keep the load at or below one half */
+  if ((g_orm_table_count + 1) * 2 > g_orm_table_cap) {
+    cap = g_orm_table_cap > 0 ? g_orm_table_cap * 2 : 32;
+    if (CMP_MALLOC(cap * sizeof(orm_table_t *), (void **)&grown) !=
+        CMP_SUCCESS) {
+      return NULL;
+    }
+    memset(grown, 0, cap * sizeof(orm_table_t *));
+    for (i = 0; i < g_orm_table_cap; ++i) {
+      table = g_orm_tables[i];
+      if (table != NULL) {
+        *orm_table_slot(grown, cap, table->name, table->len, table->hash) =
+            table;
+      }
+    }
+    if (g_orm_tables != NULL) {
+      CMP_FREE(g_orm_tables);
+    }
+    g_orm_tables = grown;
+    g_orm_table_cap = cap;
+  }
+
+  if (CMP_MALLOC(sizeof(orm_table_t), (void **)&table) != CMP_SUCCESS) {
+    return NULL;
+  }
+  memset(table, 0, sizeof(orm_table_t));
+  if (CMP_MALLOC(len + 1, (void **)&table->name) != CMP_SUCCESS) {
+    CMP_FREE(table);
+    return NULL;
+  }
+  for (i = 0; i < len; ++i) {
+    table->name[i] = (char)tolower((unsigned char)name[i]);
+  }
+  table->name[len] = '\0';
+  table->len = len;
+  table->hash = hash;
+  *orm_table_slot(g_orm_tables, g_orm_table_cap, name, len, hash) = table;
+  g_orm_table_count++;
+  return table;
+}
+
+static void orm_tables_free(void) {
+  cmp_orm_observable_t *obs;
+  orm_table_t *table;
+  size_t i;
+
+  for (i = 0; i < g_orm_table_cap; ++i) {
+    table = g_orm_tables[i];
+    if (table == NULL) {
+      continue;
+    }
+    if (table->observers != NULL) {
+      CMP_FREE(table->observers);
+    }
+    CMP_FREE(table->name);
+    CMP_FREE(table);
+  }
+  if (g_orm_tables != NULL) {
+    CMP_FREE(g_orm_tables);
+  }
+  g_orm_tables = NULL;
+  g_orm_table_cap = 0;
+  g_orm_table_count = 0;
+
+  /* Surviving observables keep their rows but no longer track writes */
+  for (obs = g_orm_live; obs != NULL; obs = obs->next) {
+    obs->table_count = 0;
+  }
+}
+
+static int orm_observe_table(cmp_orm_observable_t *obs, const char *name,
+                             size_t len) {
+  orm_table_t *table;
+  size_t i;
+
+  if (len == 0) {
+    return CMP_SUCCESS;
+  }
+  table = orm_table_find(name, len, 1);
+  if (table == NULL) {
+    return CMP_ERROR_OOM;
+  }
+  for (i = 0; i < obs->table_count; ++i) {
+    if (obs->tables[i] == table) {
+      return CMP_SUCCESS;
+    }
+  }
+  if (orm_reserve((void **)&obs->tables, &obs->table_cap,
+                  obs->table_count + 1,
+                  sizeof(orm_table_t *)) != CMP_SUCCESS ||
+      orm_reserve((void **)&table->observers, &table->cap, table->count + 1,
+                  sizeof(cmp_orm_observable_t *)) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  obs->tables[obs->table_count++] = table;
+  table->observers[table->count++] = obs;
+  return CMP_SUCCESS;
+}
+
+static void orm_unobserve_tables(cmp_orm_observable_t *obs) {
+  orm_table_t *table;
+  size_t i, j;
+
+  for (i = 0; i < obs->table_count; ++i) {
+    table = obs->tables[i];
+    for (j = 0; j < table->count; ++j) {
+      if (table->observers[j] == obs) {
+        table->observers[j] = table->observers[--table->count];
+        break;
+      }
+    }
+  }
+  obs->table_count = 0;
+}
+
+static void orm_mark_changed(c_orm_db_t *db, const char *name, size_t len) {
+  cmp_orm_observable_t *obs;
+  orm_table_t *table;
+  size_t i;
+
+  if (name == NULL) {
+    for (obs = g_orm_live; obs != NULL; obs = obs->next) {
+      if (obs->db == db) {
+        obs->changed = 1;
+      }
+    }
+    return;
+  }
+  table = orm_table_find(name, len, 0);
+  if (table == NULL) {
+    return;
+  }
+  for (i = 0; i < table->count; ++i) {
+    if (table->observers[i]->db == db) {
+      table->observers[i]->changed = 1;
+    }
+  }
+}
+
+/* SQL scanning: just enough of SQLite's grammar to find the tables a
+ * statement reads or writes */
+
+typedef enum orm_token_kind {
+  ORM_TOKEN_END = 0,
+  ORM_TOKEN_WORD,   /* Keyword or bare identifier */
+  ORM_TOKEN_NAME,   /* Quoted identifier, without its quotes */
+  ORM_TOKEN_STRING, /* String or blob literal */
+  ORM_TOKEN_PUNCT
+} orm_token_kind_t;
+
+typedef struct orm_lexer {
+  const char *p;
+  orm_token_kind_t kind;
+  const char *s;
+  size_t len;
+} orm_lexer_t;
+
+static int orm_is_word_char(char c) {
+  return isalnum((unsigned char)c) || c == '_' || c == '$' ||
+         (unsigned char)c >= 0x80;
+}
+
+static void orm_lex(orm_lexer_t *lx) {
+  const char *p = lx->p;
+  char close;
+
+  for (;;) {
+    while (*p != '\0' && isspace((unsigned char)*p)) {
+      p++;
+    }
+    if (p[0] == '-' && p[1] == '-') {
+      while (*p != '\0' && *p != '\n') {
+        p++;
+      }
+    } else if (p[0] == '/' && p[1] == '*') {
+      p += 2;
+      while (*p != '\0' && !(p[0] == '*' && p[1] == '/')) {
+        p++;
+      }
+      if (*p != '\0') {
+        p += 2;
+      }
+    } else {
+      break;
+    }
+  }
+
+  lx->s = p;
+  lx->len = 0;
+  if (*p == '\0') {
+    lx->kind = ORM_TOKEN_END;
+  } else if (*p == '\'' || *p == '"' || *p == '`' || *p == '[') {
+    /* Doubled quotes escape themselves */
+    close = *p == '[' ? ']' : *p;
+    lx->kind = *p == '\'' ? ORM_TOKEN_STRING : ORM_TOKEN_NAME;
+    lx->s = ++p;
+    while (*p != '\0') {
+      if (*p == close && (close == ']' || p[1] != close)) {
+        break;
+      }
+      p += *p == close ? 2 : 1;
+    }
+    lx->len = (size_t)(p - lx->s);
+    if (*p != '\0') {
+      p++;
+    }
+  } else if (orm_is_word_char(*p)) {
+    lx->kind = ORM_TOKEN_WORD;
+    while (orm_is_word_char(*p)) {
+      p++;
+    }
+    lx->len = (size_t)(p - lx->s);
+  } else {
+    lx->kind = ORM_TOKEN_PUNCT;
+    lx->len = 1;
+    p++;
+  }
+  lx->p = p;
+}
+
+static int orm_is(const orm_lexer_t *lx, const char *word) {
+  size_t i;
+
+  if (lx->kind != ORM_TOKEN_WORD) {
+    return 0;
+  }
+  for (i = 0; i < lx->len; ++i) {
+    if (word[i] == '\0' ||
+        toupper((unsigned char)lx->s[i]) != (unsigned char)word[i]) {
+      return 0;
+    }
+  }
+  return word[i] == '\0';
+}
+
+static int orm_is_any(const orm_lexer_t *lx, const char *const *words) {
+  for (; *words != NULL; ++words) {
+    if (orm_is(lx, *words)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+static int orm_is_punct(const orm_lexer_t *lx, char c) {
+  return lx->kind == ORM_TOKEN_PUNCT && *lx->s == c;
+}
+
+/* Read a possibly schema-qualified table name, leaving the lexer after it */
+static int orm_read_table(orm_lexer_t *lx, const char **out_name,
+                          size_t *out_len) {
+  if (lx->kind != ORM_TOKEN_WORD && lx->kind != ORM_TOKEN_NAME) {
+    return 0;
+  }
+  *out_name = lx->s;
+  *out_len = lx->len;
+  orm_lex(lx);
+  if (orm_is_punct(lx, '.')) {
+    orm_lex(lx);
+    if (lx->kind != ORM_TOKEN_WORD && lx->kind != ORM_TOKEN_NAME) {
+      return 0;
+    }
+    *out_name = lx->s;
+    *out_len = lx->len;
+    orm_lex(lx);
+  }
+  return 1;
+}
+
+static const char *const orm_clause_words[] = {
+    "WHERE", "JOIN",      "ON",     "USING",  "GROUP",   "ORDER",   "LIMIT",
+    "LEFT",  "RIGHT",     "INNER",  "OUTER",  "CROSS",   "NATURAL", "FULL",
+    "UNION", "INTERSECT", "EXCEPT", "HAVING", "WINDOW",  "INDEXED", "NOT",
+    "SET",   "VALUES",    "SELECT", "RETURNING", NULL};
+
+/* Statements that never change rows an observable could have read */
+static const char *const orm_read_only_words[] = {
+    "SELECT",  "VALUES",  "CREATE", "PRAGMA", "BEGIN",   "COMMIT",
+    "END",     "SAVEPOINT", "RELEASE", "EXPLAIN", "ANALYZE", "VACUUM",
+    "REINDEX", "ATTACH",  "DETACH", NULL};
+
+/* Ends the table list of a FROM clause at the same nesting depth */
+static const char *const orm_from_end_words[] = {
+    "WHERE",  "GROUP",     "ORDER",  "LIMIT",     "HAVING", "WINDOW",
+    "UNION",  "INTERSECT", "EXCEPT", "RETURNING", NULL};
+
+static int orm_parse_query_tables(cmp_orm_observable_t *obs,
+                                  const char *query) {
+  orm_lexer_t lx;
+  const char *name;
+  size_t len;
+  unsigned long in_from = 0; /* One bit per parenthesis depth */
+  unsigned long bit;
+  int depth = 0, res;
+
+  lx.p = query;
+  orm_lex(&lx);
+  while (lx.kind != ORM_TOKEN_END) {
+    bit = depth < 32 ? 1UL << depth : 0;
+    if (orm_is(&lx, "FROM") || orm_is(&lx, "JOIN") ||
+        ((in_from & bit) && orm_is_punct(&lx, ','))) {
+      /* A comma list of tables, each with an optional alias; subqueries
+       * are picked up by the outer scan */
+      in_from |= bit;
+      orm_lex(&lx);
+      while (orm_read_table(&lx, &name, &len)) {
+        res = orm_observe_table(obs, name, len);
+        if (res != CMP_SUCCESS) {
+          return res;
+        }
+        if (orm_is(&lx, "AS")) {
+          orm_lex(&lx);
+        }
+        if ((lx.kind == ORM_TOKEN_WORD &&
+             !orm_is_any(&lx, orm_clause_words)) ||
+            lx.kind == ORM_TOKEN_NAME) {
+          orm_lex(&lx);
+        }
+        if (!orm_is_punct(&lx, ',')) {
+          break;
+        }
+        orm_lex(&lx);
+      }
+      continue;
+    }
+    if (orm_is_punct(&lx, '(')) {
+      depth++;
+    } else if (orm_is_punct(&lx, ')') && depth > 0) {
+      in_from &= ~bit;
+      depth--;
+    } else if (orm_is_any(&lx, orm_from_end_words)) {
+      in_from &= ~bit;
+    }
+    orm_lex(&lx);
+  }
+  return CMP_SUCCESS;
+}
+
+/* Mark the observers of every table a batch of statements writes. Anything
+ * not understood (ROLLBACK included) invalidates the whole connection. */
+static void orm_notify_sql(c_orm_db_t *db, const char *sql) {
+  orm_lexer_t lx;
+  const char *name;
+  size_t len;
+  int depth, done;
+
+  if (g_orm_live == NULL) {
+    return;
+  }
+  lx.p = sql;
+  orm_lex(&lx);
+  while (lx.kind != ORM_TOKEN_END) {
+    if (orm_is_punct(&lx, ';')) {
+      orm_lex(&lx);
+      continue;
+    }
+    depth = 0;
+    done = orm_is_any(&lx, orm_read_only_words);
+    if (!done && !orm_is(&lx, "WITH") && !orm_is(&lx, "INSERT") &&
+        !orm_is(&lx, "REPLACE") && !orm_is(&lx, "UPDATE") &&
+        !orm_is(&lx, "DELETE") && !orm_is(&lx, "DROP") &&
+        !orm_is(&lx, "ALTER")) {
+      orm_mark_changed(db, NULL, 0);
+      done = 1;
+    }
+    while (lx.kind != ORM_TOKEN_END &&
+           !(depth == 0 && orm_is_punct(&lx, ';'))) {
+      if (orm_is_punct(&lx, '(')) {
+        depth++;
+      } else if (orm_is_punct(&lx, ')') && depth > 0) {
+        depth--;
+      } else if (!done && depth == 0 &&
+                 (orm_is(&lx, "INSERT") || orm_is(&lx, "REPLACE") ||
+                  orm_is(&lx, "UPDATE") || orm_is(&lx, "DELETE") ||
+                  orm_is(&lx, "DROP") || orm_is(&lx, "ALTER"))) {
+        done = 1;
+        if (orm_is(&lx, "DROP") || orm_is(&lx, "ALTER")) {
+          orm_lex(&lx);
+          if (!orm_is(&lx, "TABLE")) {
+            continue; /* Indexes, views and triggers hold no rows */
+          }
+          orm_lex(&lx);
+          if (orm_is(&lx, "IF")) {
+            orm_lex(&lx);
+            orm_lex(&lx);
+          }
+        } else {
+          orm_lex(&lx);
+          if (orm_is(&lx, "OR")) {
+            orm_lex(&lx);
+            orm_lex(&lx);
+          }
+          if (orm_is(&lx, "INTO") || orm_is(&lx, "FROM")) {
+            orm_lex(&lx);
+          }
+        }
+        if (orm_read_table(&lx, &name, &len)) {
+          orm_mark_changed(db, name, len);
+        } else {
+          orm_mark_changed(db, NULL, 0);
+        }
+        continue;
+      }
+      orm_lex(&lx);
+    }
+  }
+}
+
+int cmp_orm_notify_changed(c_orm_db_t *db, const char *table) {
+  if (db == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  orm_mark_changed(db, table, table != NULL ? strlen(table) : 0);
+  return CMP_SUCCESS;
+}
+
+/* Observables */
+
 int cmp_orm_observable_create(c_orm_db_t *db, const char *query,
                               cmp_orm_observable_t **out_obs) {
   cmp_orm_observable_t *obs;
-  size_t len;
+  int res;
 
   if (db == NULL || query == NULL || out_obs == NULL) {
     return CMP_ERROR_INVALID_ARG;
@@ -143,68 +814,360 @@ int cmp_orm_observable_create(c_orm_db_t *db, const char *query,
   if (CMP_MALLOC(sizeof(cmp_orm_observable_t), (void **)&obs) != CMP_SUCCESS) {
     return CMP_ERROR_OOM;
   }
+  memset(obs, 0, sizeof(cmp_orm_observable_t));
 
-  len = strlen(query);
-  if (CMP_MALLOC(len + 1, (void **)&obs->query) != CMP_SUCCESS) {
+  obs->query = orm_strdup(query);
+  if (obs->query == NULL) {
     CMP_FREE(obs);
     return CMP_ERROR_OOM;
   }
+  obs->db = db;
 
-#if defined(_MSC_VER)
-  strcpy_s(obs->query, len + 1, query);
-#else
-  strcpy(obs->query, query);
-#endif
+  obs->next = g_orm_live;
+  if (g_orm_live != NULL) {
+    g_orm_live->prev = obs;
+  }
+  g_orm_live = obs;
 
-  obs->db = db;
-  obs->bound_node = NULL;
-  obs->bound_property = NULL;
+  res = orm_parse_query_tables(obs, query);
+  if (res != CMP_SUCCESS) {
+    cmp_orm_observable_destroy(obs);
+    return res;
+  }
 
   *out_obs = obs;
   return CMP_SUCCESS;
 }
 
-int cmp_ui_node_bind(cmp_ui_node_t *node, cmp_orm_observable_t *obs,
-                     const char *property_name) {
-  size_t len;
+int cmp_orm_observable_add_table(cmp_orm_observable_t *obs,
+                                 const char *table) {
+  if (obs == NULL || table == NULL || table[0] == '\0') {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  return orm_observe_table(obs, table, strlen(table));
+}
 
-  if (node == NULL || obs == NULL || property_name == NULL) {
+int cmp_orm_observable_set_fetch(cmp_orm_observable_t *obs,
+                                 cmp_orm_fetch_cb_t fetch, void *user_data) {
+  if (obs == NULL) {
     return CMP_ERROR_INVALID_ARG;
   }
+  obs->fetch = fetch;
+  obs->fetch_data = user_data;
+  obs->changed = fetch != NULL;
+  return CMP_SUCCESS;
+}
 
-  obs->bound_node = node;
+int cmp_orm_observable_set_change_handler(cmp_orm_observable_t *obs,
+                                          cmp_orm_change_cb_t handler,
+                                          void *user_data) {
+  if (obs == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  obs->on_change = handler;
+  obs->change_data = user_data;
+  return CMP_SUCCESS;
+}
 
-  if (obs->bound_property != NULL) {
-    CMP_FREE(obs->bound_property);
+int cmp_orm_observable_set_debounce(cmp_orm_observable_t *obs,
+                                    double debounce_ms) {
+  if (obs == NULL || debounce_ms < 0.0) {
+    return CMP_ERROR_INVALID_ARG;
   }
+  obs->debounce_ms = debounce_ms;
+  return CMP_SUCCESS;
+}
 
-  len = strlen(property_name);
-  if (CMP_MALLOC(len + 1, (void **)&obs->bound_property) != CMP_SUCCESS) {
-    return CMP_ERROR_OOM;
+int cmp_orm_observable_set_workers(cmp_orm_observable_t *obs,
+                                   cmp_modality_t *workers,
+                                   cmp_modality_t *ui) {
+  if (obs == NULL ||
+      (workers != NULL &&
+       (workers->type != CMP_MODALITY_THREADED || ui == NULL))) {
+    return CMP_ERROR_INVALID_ARG;
   }
+  obs->workers = workers;
+  obs->ui = ui;
+  return CMP_SUCCESS;
+}
 
-#if defined(_MSC_VER)
-  strcpy_s(obs->bound_property, len + 1, property_name);
-#else
-  strcpy(obs->bound_property, property_name);
-#endif
+int cmp_orm_observable_get_rows(const cmp_orm_observable_t *obs,
+                                const cmp_orm_rows_t **out_rows) {
+  if (obs == NULL || out_rows == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  *out_rows = &obs->rows;
+  return CMP_SUCCESS;
+}
 
+int cmp_orm_observable_is_refreshing(const cmp_orm_observable_t *obs,
+                                     int *out_refreshing) {
+  if (obs == NULL || out_refreshing == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  *out_refreshing = obs->job != NULL;
   return CMP_SUCCESS;
 }
 
+int cmp_ui_node_bind(cmp_ui_node_t *node, cmp_orm_observable_t *obs,
+                     const char *property_name) {
+  orm_binding_t *binding = NULL;
+  char *property;
+  size_t i;
+
+  if (node == NULL || obs == NULL || property_name == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  property = orm_strdup(property_name);
+  if (property == NULL) {
+    return CMP_ERROR_OOM;
+  }
+  for (i = 0; i < obs->binding_count; ++i) {
+    if (obs->bindings[i].node == node) {
+      binding = &obs->bindings[i];
+      CMP_FREE(binding->property);
+      break;
+    }
+  }
+  if (binding == NULL) {
+    if (orm_reserve((void **)&obs->bindings, &obs->binding_cap,
+                    obs->binding_count + 1,
+                    sizeof(orm_binding_t)) != CMP_SUCCESS) {
+      CMP_FREE(property);
+      return CMP_ERROR_OOM;
+    }
+    binding = &obs->bindings[obs->binding_count++];
+    binding->node = node;
+  }
+  binding->property = property;
+  binding->dirty = obs->loaded;
+  return CMP_SUCCESS;
+}
+
+int cmp_ui_node_unbind(cmp_ui_node_t *node, cmp_orm_observable_t *obs) {
+  size_t i;
+
+  if (node == NULL || obs == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  for (i = 0; i < obs->binding_count; ++i) {
+    if (obs->bindings[i].node == node) {
+      CMP_FREE(obs->bindings[i].property);
+      obs->bindings[i] = obs->bindings[--obs->binding_count];
+      return CMP_SUCCESS;
+    }
+  }
+  return CMP_ERROR_NOT_FOUND;
+}
+
+static void orm_observable_free(cmp_orm_observable_t *obs) {
+  orm_rows_free(&obs->rows);
+  if (obs->tables != NULL) {
+    CMP_FREE(obs->tables);
+  }
+  CMP_FREE(obs->query);
+  CMP_FREE(obs);
+}
+
 int cmp_orm_observable_destroy(cmp_orm_observable_t *obs) {
+  size_t i;
+
   if (obs == NULL) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  if (obs->query != NULL) {
-    CMP_FREE(obs->query);
+  orm_unobserve_tables(obs);
+  if (obs->prev != NULL) {
+    obs->prev->next = obs->next;
+  } else {
+    g_orm_live = obs->next;
+  }
+  if (obs->next != NULL) {
+    obs->next->prev = obs->prev;
   }
 
-  if (obs->bound_property != NULL) {
-    CMP_FREE(obs->bound_property);
+  for (i = 0; i < obs->binding_count; ++i) {
+    CMP_FREE(obs->bindings[i].property);
+  }
+  if (obs->bindings != NULL) {
+    CMP_FREE(obs->bindings);
   }
+  obs->bindings = NULL;
+  obs->binding_count = 0;
 
-  CMP_FREE(obs);
+  /* A re-query in flight still reads the query; its delivery on the ui
+   * modality releases the observable */
+  if (obs->job != NULL) {
+    obs->destroyed = 1;
+  } else {
+    orm_observable_free(obs);
+  }
   return CMP_SUCCESS;
 }
+
+/* Diff the new result against the current one by row identifier and add a
+ * reload for every kept row whose content hash changed */
+static int orm_apply_rows(cmp_orm_observable_t *obs, cmp_orm_rows_t *rows) {
+  cmp_diff_result_t r;
+  cmp_diff_change_t *changes;
+  cmp_orm_rows_t old;
+  size_t i, j, reloads = 0;
+  int res;
+
+  res = cmp_diff_identifiers(obs->rows.ids, obs->rows.count, rows->ids,
+                             rows->count, &r);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  for (j = 0; j < rows->count; ++j) {
+    i = r.new_to_old[j];
+    if (i != CMP_DIFF_NONE &&
+        obs->rows.rows[i].hash != rows->rows[j].hash) {
+      reloads++;
+    }
+  }
+  if (reloads > 0) {
+    if (CMP_MALLOC((r.change_count + reloads) * sizeof(cmp_diff_change_t),
+                   (void **)&changes) != CMP_SUCCESS) {
+      cmp_diff_result_free(&r);
+      return CMP_ERROR_OOM;
+    }
+    if (r.changes != NULL) {
+      memcpy(changes, r.changes, r.change_count * sizeof(cmp_diff_change_t));
+      CMP_FREE(r.changes);
+    }
+    r.changes = changes;
+    for (j = 0; j < rows->count; ++j) {
+      i = r.new_to_old[j];
+      if (i != CMP_DIFF_NONE &&
+          obs->rows.rows[i].hash != rows->rows[j].hash) {
+        changes[r.change_count].op = CMP_DIFF_RELOAD;
+        changes[r.change_count].from = i;
+        changes[r.change_count].to = j;
+        changes[r.change_count].id = rows->ids[j];
+        r.change_count++;
+      }
+    }
+    r.reload_count = reloads;
+  }
+
+  old = obs->rows;
+  obs->rows = *rows;
+  *rows = old;
+
+  /* An unchanged result leaves the bound nodes alone */
+  if (r.change_count > 0 || !obs->loaded) {
+    obs->loaded = 1;
+    for (i = 0; i < obs->binding_count; ++i) {
+      obs->bindings[i].dirty = 1;
+    }
+    if (obs->on_change != NULL) {
+      obs->on_change(obs, &r, &obs->rows, obs->change_data);
+    }
+  }
+  cmp_diff_result_free(&r);
+  return CMP_SUCCESS;
+}
+
+static void orm_job_deliver(void *arg) {
+  orm_job_t *job = (orm_job_t *)arg;
+  cmp_orm_observable_t *obs = job->obs;
+
+  obs->job = NULL;
+  /* A failed fetch keeps the previous rows */
+  if (!obs->destroyed && job->res == CMP_SUCCESS) {
+    job->res = orm_apply_rows(obs, &job->rows);
+  }
+  orm_rows_free(&job->rows);
+  CMP_FREE(job);
+
+  if (obs->destroyed) {
+    orm_observable_free(obs);
+  }
+}
+
+static void orm_job_task(void *arg) {
+  orm_job_t *job = (orm_job_t *)arg;
+  job->res = job->fetch(job->db, job->query, &job->rows, job->fetch_data);
+  cmp_modality_queue_task(job->obs->ui, orm_job_deliver, job);
+}
+
+static int orm_refresh(cmp_orm_observable_t *obs) {
+  orm_job_t *job;
+  int res;
+
+  if (CMP_MALLOC(sizeof(orm_job_t), (void **)&job) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(job, 0, sizeof(orm_job_t));
+  job->obs = obs;
+  job->db = obs->db;
+  job->query = obs->query;
+  job->fetch = obs->fetch;
+  job->fetch_data = obs->fetch_data;
+
+  obs->job = job;
+  if (obs->workers != NULL &&
+      cmp_modality_queue_task(obs->workers, orm_job_task, job) ==
+          CMP_SUCCESS) {
+    return CMP_SUCCESS;
+  }
+  job->res = job->fetch(job->db, job->query, &job->rows, job->fetch_data);
+  res = job->res;
+  orm_job_deliver(job);
+  return res;
+}
+
+int cmp_orm_tick(double now_ms, cmp_orm_invalidate_cb_t invalidate,
+                 void *user_data) {
+  cmp_orm_observable_t *obs, *next;
+  orm_binding_t *binding;
+  double quiet, waited;
+  size_t i;
+  int res = CMP_SUCCESS, err;
+
+  for (obs = g_orm_live; obs != NULL; obs = next) {
+    next = obs->next;
+    if (obs->changed) {
+      obs->changed = 0;
+      if (!obs->stale) {
+        obs->stale = 1;
+        obs->first_change_ms = now_ms;
+      }
+      obs->last_change_ms = now_ms;
+    }
+    if (!obs->stale || obs->job != NULL || obs->fetch == NULL) {
+      continue;
+    }
+    /* Trailing edge of the debounce; a steady stream of writes still
+     * refreshes every few intervals */
+    quiet = now_ms - obs->last_change_ms;
+    waited = now_ms - obs->first_change_ms;
+    if (quiet < obs->debounce_ms &&
+        waited < obs->debounce_ms * CMP_ORM_DEBOUNCE_MAX_INTERVALS) {
+      continue;
+    }
+    obs->stale = 0;
+    err = orm_refresh(obs);
+    if (err != CMP_SUCCESS) {
+      res = err;
+    }
+  }
+
+  /* Coalesced: each binding is invalidated at most once per tick however
+   * many results landed since the last one */
+  for (obs = g_orm_live; obs != NULL; obs = obs->next) {
+    for (i = 0; i < obs->binding_count; ++i) {
+      binding = &obs->bindings[i];
+      if (!binding->dirty) {
+        continue;
+      }
+      binding->dirty = 0;
+      if (invalidate != NULL) {
+        invalidate(binding->node, binding->property, obs, user_data);
+      }
+    }
+  }
+  return res;
+}
@@ -1,15 +1,970 @@
 /* clang-format off */
 #include "cmp.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 /* clang-format on */
 
+/* Streaming PDF 1.7 writer.
+ * Objects are written as soon as they are complete: a page's content stream
+ * is deflated straight to the output while it is drawn, and its images,
+ * length object and page dictionary follow at end_page. Only xref offsets,
+ * page object numbers and image hashes outlive a page. Fonts are subset and
+ * written at save, once every glyph in use is known. Object 1 is the
+ * catalog and object 2 the page tree root; both are written last. */
+
+#define PDF_CATALOG_OBJ 1
+#define PDF_PAGES_OBJ 2
+#define PDF_FIRST_OBJ 3
+#define PDF_DEFAULT_WIDTH 595.0f
+#define PDF_DEFAULT_HEIGHT 842.0f
+#define PDF_CONTENT_BUF 4096
+#define PDF_MAX_COMPONENT_DEPTH 16
+
+/* TrueType tables. The ones before PDF_TT_CMAP are embedded, in tag order. */
+enum {
+  PDF_TT_CVT,
+  PDF_TT_FPGM,
+  PDF_TT_GLYF,
+  PDF_TT_HEAD,
+  PDF_TT_HHEA,
+  PDF_TT_HMTX,
+  PDF_TT_LOCA,
+  PDF_TT_MAXP,
+  PDF_TT_PREP,
+  PDF_TT_CMAP,
+  PDF_TT_NAME,
+  PDF_TT_COUNT
+};
+
+static const char *const k_pdf_tt_tags[PDF_TT_COUNT] = {
+    "cvt ", "fpgm", "glyf", "head", "hhea", "hmtx",
+    "loca", "maxp", "prep", "cmap", "name"};
+
+typedef struct pdf_membuf {
+  unsigned char *data;
+  size_t len;
+  size_t cap;
+  int error;
+} pdf_membuf_t;
+
+typedef struct pdf_font {
+  unsigned char *data;
+  size_t size;
+  unsigned long table_off[PDF_TT_COUNT];
+  unsigned long table_len[PDF_TT_COUNT];
+  unsigned long cmap_sub; /* Absolute offset of the chosen subtable */
+  unsigned long cmap_len; /* Its length, checked against the cmap table */
+  int cmap_format;
+  unsigned int num_glyphs;
+  unsigned int num_hmetrics;
+  unsigned int upem;
+  int long_loca;
+  unsigned char *used;    /* Per glyph: drawn in the current document */
+  unsigned long *unicode; /* Per glyph: first code point drawn with it */
+  int obj;                /* Type0 font object, 0 until first drawn */
+  int page_stamp;         /* Last page the font was drawn on */
+} pdf_font_t;
+
+typedef struct pdf_image_ref {
+  unsigned long h1;
+  unsigned long h2;
+  int width;
+  int height;
+  int obj; /* 0 marks an empty slot */
+  int page_stamp;
+} pdf_image_ref_t;
+
+typedef struct pdf_pending_image {
+  int obj;
+  int smask_obj;
+  int width;
+  int height;
+  pdf_membuf_t rgb;
+  pdf_membuf_t alpha;
+} pdf_pending_image_t;
+
 struct cmp_print_ctx {
   int is_printing;
   int current_page;
+  float next_width;
+  float next_height;
+  float page_width;
+  float page_height;
+
+  int started;
+  int error;
+  cmp_vfs_writer_t *writer; /* Streaming mode */
+  char *path;
+  pdf_membuf_t mem; /* Buffered mode */
+  unsigned long offset;
+
+  unsigned long *xref;
+  size_t xref_cap;
+  int next_obj;
+  int *page_objs;
+  size_t page_cap;
+
+  cmp_deflate_t *content;
+  cmp_deflate_t *aux; /* Images and font files, compressed to memory */
+  pdf_membuf_t *aux_target;
+  int content_obj;
+  int length_obj;
+  unsigned long content_start;
+  char cbuf[PDF_CONTENT_BUF];
+  size_t cbuf_len;
+  unsigned char alpha_used[256];
+
+  pdf_font_t *fonts;
+  size_t font_count;
+  size_t font_cap;
+
+  pdf_image_ref_t *images;
+  size_t image_cap;
+  size_t image_count;
+  pdf_pending_image_t *pending;
+  size_t pending_count;
+  size_t pending_cap;
+  int *page_images;
+  size_t page_image_count;
+  size_t page_image_cap;
+
+  cmp_print_stats_t stats;
 };
 
+/* ------------------------------------------------------------------------ */
+/* Buffers and output                                                        */
+/* ------------------------------------------------------------------------ */
+
+static int pdf_grow(void **buf, size_t *cap, size_t need, size_t elem) {
+  size_t new_cap;
+  void *p;
+  if (need <= *cap)
+    return CMP_SUCCESS;
+  new_cap = *cap ? *cap : 16;
+  while (new_cap < need)
+    new_cap *= 2;
+  if (CMP_MALLOC(new_cap * elem, &p) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  if (*buf) {
+    memcpy(p, *buf, *cap * elem);
+    CMP_FREE(*buf);
+  }
+  *buf = p;
+  *cap = new_cap;
+  return CMP_SUCCESS;
+}
+
+static void pdf_membuf_append(pdf_membuf_t *m, const void *data, size_t len) {
+  if (m->error != CMP_SUCCESS)
+    return;
+  if (pdf_grow((void **)&m->data, &m->cap, m->len + len, 1) != CMP_SUCCESS) {
+    m->error = CMP_ERROR_OOM;
+    return;
+  }
+  memcpy(m->data + m->len, data, len);
+  m->len += len;
+}
+
+static void pdf_membuf_free(pdf_membuf_t *m) {
+  if (m->data)
+    CMP_FREE(m->data);
+  memset(m, 0, sizeof(*m));
+}
+
+static void pdf_write(cmp_print_ctx_t *ctx, const void *data, size_t len) {
+  if (ctx->error != CMP_SUCCESS || len == 0)
+    return;
+  if (ctx->writer) {
+    ctx->error = cmp_vfs_writer_write(ctx->writer, data, len);
+  } else {
+    pdf_membuf_append(&ctx->mem, data, len);
+    ctx->error = ctx->mem.error;
+  }
+  ctx->offset += (unsigned long)len;
+}
+
+static void pdf_puts(cmp_print_ctx_t *ctx, const char *s) {
+  pdf_write(ctx, s, strlen(s));
+}
+
+static int pdf_content_sink(void *user_data, const unsigned char *data,
+                            size_t len) {
+  cmp_print_ctx_t *ctx = (cmp_print_ctx_t *)user_data;
+  pdf_write(ctx, data, len);
+  return ctx->error;
+}
+
+/* Shortest decimal with at most three fractional digits. */
+static void pdf_fmt_num(char *out, double v) {
+  char *p;
+  if (v != v)
+    v = 0.0;
+  if (v > 1e7)
+    v = 1e7;
+  if (v < -1e7)
+    v = -1e7;
+  sprintf(out, "%.3f", v);
+  p = out + strlen(out) - 1;
+  while (*p == '0')
+    *p-- = '\0';
+  if (*p == '.')
+    *p = '\0';
+  if (strcmp(out, "-0") == 0)
+    strcpy(out, "0");
+}
+
+static int pdf_reserve_obj(cmp_print_ctx_t *ctx) {
+  size_t id = (size_t)ctx->next_obj;
+  if (pdf_grow((void **)&ctx->xref, &ctx->xref_cap, id + 1,
+               sizeof(unsigned long)) != CMP_SUCCESS) {
+    ctx->error = CMP_ERROR_OOM;
+    return 0;
+  }
+  ctx->xref[id] = 0;
+  ctx->next_obj++;
+  ctx->stats.objects = (size_t)ctx->next_obj - 1;
+  return (int)id;
+}
+
+static void pdf_begin_obj(cmp_print_ctx_t *ctx, int id) {
+  char buf[32];
+  if (ctx->error != CMP_SUCCESS || id <= 0)
+    return;
+  ctx->xref[id] = ctx->offset;
+  sprintf(buf, "%d 0 obj\n", id);
+  pdf_puts(ctx, buf);
+}
+
+/* Writes a complete stream object from an already encoded buffer. */
+static void pdf_write_stream_obj(cmp_print_ctx_t *ctx, int id,
+                                 const char *dict_entries,
+                                 const pdf_membuf_t *data) {
+  char buf[64];
+  pdf_begin_obj(ctx, id);
+  pdf_puts(ctx, "<< ");
+  pdf_puts(ctx, dict_entries);
+  sprintf(buf, " /Filter /FlateDecode /Length %lu >>\nstream\n",
+          (unsigned long)data->len);
+  pdf_puts(ctx, buf);
+  pdf_write(ctx, data->data, data->len);
+  pdf_puts(ctx, "\nendstream\nendobj\n");
+}
+
+static int pdf_aux_sink(void *user_data, const unsigned char *data,
+                        size_t len) {
+  cmp_print_ctx_t *ctx = (cmp_print_ctx_t *)user_data;
+  pdf_membuf_append(ctx->aux_target, data, len);
+  return ctx->aux_target->error;
+}
+
+/* Points the shared off-page compressor at a memory buffer. */
+static int pdf_get_aux(cmp_print_ctx_t *ctx, pdf_membuf_t *target) {
+  ctx->aux_target = target;
+  if (!ctx->aux)
+    return cmp_deflate_create(1, pdf_aux_sink, ctx, &ctx->aux);
+  return cmp_deflate_reset(ctx->aux);
+}
+
+static int pdf_deflate_to(cmp_print_ctx_t *ctx, const void *data, size_t len,
+                          pdf_membuf_t *out) {
+  int res = pdf_get_aux(ctx, out);
+  if (res == CMP_SUCCESS)
+    res = cmp_deflate_push(ctx->aux, data, len);
+  if (res == CMP_SUCCESS)
+    res = cmp_deflate_finish(ctx->aux);
+  if (res == CMP_SUCCESS)
+    res = out->error;
+  return res;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Page content                                                              */
+/* ------------------------------------------------------------------------ */
+
+static void pdf_cflush(cmp_print_ctx_t *ctx) {
+  if (ctx->cbuf_len > 0 && ctx->error == CMP_SUCCESS) {
+    int res = cmp_deflate_push(ctx->content, ctx->cbuf, ctx->cbuf_len);
+    if (res != CMP_SUCCESS && ctx->error == CMP_SUCCESS)
+      ctx->error = res;
+  }
+  ctx->cbuf_len = 0;
+}
+
+static void pdf_cput(cmp_print_ctx_t *ctx, const char *s) {
+  size_t n = strlen(s);
+  if (ctx->cbuf_len + n > PDF_CONTENT_BUF)
+    pdf_cflush(ctx);
+  if (n > PDF_CONTENT_BUF) {
+    if (ctx->error == CMP_SUCCESS)
+      ctx->error = cmp_deflate_push(ctx->content, s, n);
+    return;
+  }
+  memcpy(ctx->cbuf + ctx->cbuf_len, s, n);
+  ctx->cbuf_len += n;
+}
+
+static void pdf_cnum(cmp_print_ctx_t *ctx, double v) {
+  char buf[48];
+  pdf_fmt_num(buf, v);
+  strcat(buf, " ");
+  pdf_cput(ctx, buf);
+}
+
+static void pdf_cpoint(cmp_print_ctx_t *ctx, double x, double y,
+                       const char *op) {
+  pdf_cnum(ctx, x);
+  pdf_cnum(ctx, (double)ctx->page_height - y);
+  pdf_cput(ctx, op);
+}
+
+static double pdf_clamp01(float v) {
+  if (!(v > 0.0f))
+    return 0.0;
+  if (v > 1.0f)
+    return 1.0;
+  return (double)v;
+}
+
+/* Emits the color operator and, for translucent colors, opens a q block
+ * with the matching ExtGState. Returns non-zero if a Q is owed. */
+static int pdf_cset_color(cmp_print_ctx_t *ctx, const cmp_color_t *color,
+                          int stroke) {
+  int alpha = (int)(pdf_clamp01(color->a) * 255.0 + 0.5);
+  int opened = 0;
+  if (alpha < 255) {
+    char buf[32];
+    sprintf(buf, "q /GA%d gs\n", alpha);
+    pdf_cput(ctx, buf);
+    ctx->alpha_used[alpha] = 1;
+    opened = 1;
+  }
+  pdf_cnum(ctx, pdf_clamp01(color->r));
+  pdf_cnum(ctx, pdf_clamp01(color->g));
+  pdf_cnum(ctx, pdf_clamp01(color->b));
+  pdf_cput(ctx, stroke ? "RG\n" : "rg\n");
+  return opened;
+}
+
+static int pdf_check_drawing(const cmp_print_ctx_t *ctx) {
+  if (!ctx->is_printing)
+    return CMP_ERROR_INVALID_STATE;
+  return ctx->error;
+}
+
+/* ------------------------------------------------------------------------ */
+/* TrueType parsing and subsetting                                           */
+/* ------------------------------------------------------------------------ */
+
+static unsigned int pdf_u16(const unsigned char *p) {
+  return ((unsigned int)p[0] << 8) | p[1];
+}
+
+static int pdf_s16(const unsigned char *p) {
+  unsigned int v = pdf_u16(p);
+  return v >= 0x8000u ? (int)v - 0x10000 : (int)v;
+}
+
+static unsigned long pdf_u32(const unsigned char *p) {
+  return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) |
+         ((unsigned long)p[2] << 8) | p[3];
+}
+
+static void pdf_put_u16(unsigned char *p, unsigned int v) {
+  p[0] = (unsigned char)((v >> 8) & 0xFF);
+  p[1] = (unsigned char)(v & 0xFF);
+}
+
+static void pdf_put_u32(unsigned char *p, unsigned long v) {
+  p[0] = (unsigned char)((v >> 24) & 0xFF);
+  p[1] = (unsigned char)((v >> 16) & 0xFF);
+  p[2] = (unsigned char)((v >> 8) & 0xFF);
+  p[3] = (unsigned char)(v & 0xFF);
+}
+
+static int pdf_font_cmap_pick(pdf_font_t *f) {
+  const unsigned char *d = f->data;
+  unsigned long base = f->table_off[PDF_TT_CMAP];
+  unsigned long len = f->table_len[PDF_TT_CMAP];
+  unsigned int count, i;
+  int best_score = 0;
+
+  if (len < 4)
+    return 0;
+  count = pdf_u16(d + base + 2);
+  if (4 + (unsigned long)count * 8 > len)
+    return 0;
+  for (i = 0; i < count; ++i) {
+    const unsigned char *rec = d + base + 4 + i * 8;
+    unsigned int platform = pdf_u16(rec);
+    unsigned int encoding = pdf_u16(rec + 2);
+    unsigned long sub = pdf_u32(rec + 4);
+    unsigned int format;
+    unsigned long sub_len;
+    int score;
+
+    if (sub + 8 > len)
+      continue;
+    format = pdf_u16(d + base + sub);
+    if (format == 4) {
+      sub_len = pdf_u16(d + base + sub + 2);
+      if (sub_len < 16)
+        continue;
+      score = (platform == 3 && encoding == 1) ? 2 : (platform == 0 ? 1 : 0);
+    } else if (format == 12) {
+      if (sub + 16 > len)
+        continue;
+      sub_len = pdf_u32(d + base + sub + 4);
+      if (sub_len < 16)
+        continue;
+      score = (platform == 3 && encoding == 10) ? 4 : (platform == 0 ? 3 : 0);
+    } else {
+      continue;
+    }
+    if (score == 0 || sub_len > len - sub)
+      continue;
+    if (score > best_score) {
+      best_score = score;
+      f->cmap_sub = base + sub;
+      f->cmap_len = sub_len;
+      f->cmap_format = (int)format;
+    }
+  }
+  return best_score > 0;
+}
+
+static unsigned int pdf_font_glyph(const pdf_font_t *f, unsigned long cp) {
+  const unsigned char *s = f->data + f->cmap_sub;
+  unsigned long gid = 0;
+
+  if (f->cmap_format == 4) {
+    unsigned long sub_len = f->cmap_len;
+    unsigned int seg_x2 = pdf_u16(s + 6);
+    unsigned int i;
+    if (cp > 0xFFFF || 16 + 4 * (unsigned long)seg_x2 > sub_len)
+      return 0;
+    for (i = 0; i < seg_x2; i += 2) {
+      unsigned int end = pdf_u16(s + 14 + i);
+      unsigned int start, delta, range_off;
+      if (end < cp)
+        continue;
+      start = pdf_u16(s + 16 + seg_x2 + i);
+      if (start > cp)
+        break;
+      delta = pdf_u16(s + 16 + 2 * seg_x2 + i);
+      range_off = pdf_u16(s + 16 + 3 * seg_x2 + i);
+      if (range_off == 0) {
+        gid = (cp + delta) & 0xFFFF;
+      } else {
+        unsigned long at = 16 + 3 * (unsigned long)seg_x2 + i + range_off +
+                           2 * (cp - start);
+        if (at + 2 > sub_len)
+          return 0;
+        gid = pdf_u16(s + at);
+        if (gid != 0)
+          gid = (gid + delta) & 0xFFFF;
+      }
+      break;
+    }
+  } else if (f->cmap_format == 12) {
+    /* cmap_len >= 16 and lies inside the cmap table (pdf_font_cmap_pick) */
+    unsigned long groups = pdf_u32(s + 12);
+    unsigned long lo = 0, hi;
+    if (groups > (f->cmap_len - 16) / 12)
+      groups = (f->cmap_len - 16) / 12;
+    hi = groups;
+    while (lo < hi) {
+      unsigned long mid = lo + (hi - lo) / 2;
+      const unsigned char *g = s + 16 + mid * 12;
+      if (cp < pdf_u32(g)) {
+        hi = mid;
+      } else if (cp > pdf_u32(g + 4)) {
+        lo = mid + 1;
+      } else {
+        gid = pdf_u32(g + 8) + (cp - pdf_u32(g));
+        break;
+      }
+    }
+  }
+  return gid < f->num_glyphs ? (unsigned int)gid : 0;
+}
+
+static int pdf_font_glyph_range(const pdf_font_t *f, unsigned int gid,
+                                unsigned long *out_start,
+                                unsigned long *out_end) {
+  const unsigned char *loca = f->data + f->table_off[PDF_TT_LOCA];
+  unsigned long start, end;
+  if (f->long_loca) {
+    start = pdf_u32(loca + 4 * gid);
+    end = pdf_u32(loca + 4 * gid + 4);
+  } else {
+    start = 2 * (unsigned long)pdf_u16(loca + 2 * gid);
+    end = 2 * (unsigned long)pdf_u16(loca + 2 * gid + 2);
+  }
+  if (start > end || end > f->table_len[PDF_TT_GLYF])
+    return 0;
+  *out_start = start;
+  *out_end = end;
+  return 1;
+}
+
+static unsigned int pdf_font_advance(const pdf_font_t *f, unsigned int gid) {
+  const unsigned char *hmtx = f->data + f->table_off[PDF_TT_HMTX];
+  if (gid >= f->num_hmetrics)
+    gid = f->num_hmetrics - 1;
+  return pdf_u16(hmtx + 4 * gid);
+}
+
+/* Composite glyphs reference their components by id; those are kept too. */
+static void pdf_font_mark_components(pdf_font_t *f, unsigned int gid,
+                                     int depth) {
+  const unsigned char *glyf = f->data + f->table_off[PDF_TT_GLYF];
+  unsigned long start, end, p;
+  unsigned int flags;
+
+  if (depth > PDF_MAX_COMPONENT_DEPTH ||
+      !pdf_font_glyph_range(f, gid, &start, &end) || end - start < 10 ||
+      pdf_s16(glyf + start) >= 0)
+    return;
+  p = start + 10;
+  do {
+    unsigned int component;
+    if (p + 4 > end)
+      return;
+    flags = pdf_u16(glyf + p);
+    component = pdf_u16(glyf + p + 2);
+    p += 4 + ((flags & 0x0001) ? 4 : 2);
+    if (flags & 0x0008)
+      p += 2;
+    else if (flags & 0x0040)
+      p += 4;
+    else if (flags & 0x0080)
+      p += 8;
+    if (component < f->num_glyphs && !f->used[component]) {
+      f->used[component] = 1;
+      pdf_font_mark_components(f, component, depth + 1);
+    }
+  } while (flags & 0x0020);
+}
+
+static int pdf_font_parse(pdf_font_t *f) {
+  const unsigned char *d = f->data;
+  unsigned int num_tables, i, t;
+  unsigned long loca_need;
+
+  if (f->size < 12)
+    return CMP_ERROR_INVALID_ARG;
+  num_tables = pdf_u16(d + 4);
+  if (12 + (unsigned long)num_tables * 16 > f->size)
+    return CMP_ERROR_INVALID_ARG;
+  for (i = 0; i < num_tables; ++i) {
+    const unsigned char *rec = d + 12 + i * 16;
+    unsigned long off = pdf_u32(rec + 8);
+    unsigned long len = pdf_u32(rec + 12);
+    if (off > f->size || len > f->size - off)
+      return CMP_ERROR_INVALID_ARG;
+    for (t = 0; t < PDF_TT_COUNT; ++t) {
+      if (memcmp(rec, k_pdf_tt_tags[t], 4) == 0) {
+        f->table_off[t] = off;
+        f->table_len[t] = len;
+      }
+    }
+  }
+  if (f->table_len[PDF_TT_HEAD] < 54 || f->table_len[PDF_TT_HHEA] < 36 ||
+      f->table_len[PDF_TT_MAXP] < 6 || f->table_off[PDF_TT_GLYF] == 0 ||
+      f->table_off[PDF_TT_LOCA] == 0 || f->table_off[PDF_TT_HMTX] == 0 ||
+      f->table_off[PDF_TT_CMAP] == 0)
+    return CMP_ERROR_INVALID_ARG;
+
+  f->upem = pdf_u16(d + f->table_off[PDF_TT_HEAD] + 18);
+  f->long_loca = pdf_s16(d + f->table_off[PDF_TT_HEAD] + 50) != 0;
+  f->num_glyphs = pdf_u16(d + f->table_off[PDF_TT_MAXP] + 4);
+  f->num_hmetrics = pdf_u16(d + f->table_off[PDF_TT_HHEA] + 34);
+  loca_need = ((unsigned long)f->num_glyphs + 1) * (f->long_loca ? 4 : 2);
+  if (f->upem == 0 || f->num_glyphs == 0 || f->num_hmetrics == 0 ||
+      f->num_hmetrics > f->num_glyphs ||
+      f->table_len[PDF_TT_HMTX] < 4 * (unsigned long)f->num_hmetrics ||
+      f->table_len[PDF_TT_LOCA] < loca_need || !pdf_font_cmap_pick(f))
+    return CMP_ERROR_INVALID_ARG;
+  return CMP_SUCCESS;
+}
+
+static unsigned long pdf_tt_checksum(const unsigned char *p,
+                                     unsigned long len) {
+  unsigned long sum = 0, i;
+  for (i = 0; i + 4 <= len; i += 4)
+    sum = (sum + pdf_u32(p + i)) & 0xFFFFFFFFUL;
+  if (i < len) {
+    unsigned char tail[4] = {0, 0, 0, 0};
+    memcpy(tail, p + i, len - i);
+    sum = (sum + pdf_u32(tail)) & 0xFFFFFFFFUL;
+  }
+  return sum;
+}
+
+/* Builds a font with the same glyph ids in which unused glyph outlines are
+ * empty. Keeping ids means content streams need no remapping and the
+ * CIDToGIDMap stays Identity. */
+static int pdf_font_subset(const pdf_font_t *f, pdf_membuf_t *out) {
+  static const unsigned char zeros[4] = {0, 0, 0, 0};
+  const unsigned char *d = f->data;
+  unsigned char *loca = NULL, *glyf = NULL, *head = NULL;
+  unsigned long glyf_len = 0, pos, loca_len;
+  const unsigned char *src[PDF_TT_CMAP];
+  unsigned long len[PDF_TT_CMAP];
+  unsigned int num_tables = 0, entry_selector = 0, t, g;
+  unsigned long dir_at, data_at, adjust;
+  int res = CMP_ERROR_OOM;
+
+  for (g = 0; g < f->num_glyphs; ++g) {
+    unsigned long s, e;
+    if (f->used[g] && pdf_font_glyph_range(f, g, &s, &e))
+      glyf_len += (e - s + 3) & ~3UL;
+  }
+  loca_len = ((unsigned long)f->num_glyphs + 1) * 4;
+  if (CMP_MALLOC(loca_len, (void **)&loca) != CMP_SUCCESS)
+    goto done;
+  if (CMP_MALLOC(glyf_len + 4, (void **)&glyf) != CMP_SUCCESS)
+    goto done;
+  if (CMP_MALLOC(f->table_len[PDF_TT_HEAD], (void **)&head) != CMP_SUCCESS)
+    goto done;
+
+  pos = 0;
+  for (g = 0; g < f->num_glyphs; ++g) {
+    unsigned long s, e;
+    pdf_put_u32(loca + 4 * g, pos);
+    if (f->used[g] && pdf_font_glyph_range(f, g, &s, &e) && e > s) {
+      unsigned long n = e - s;
+      memcpy(glyf + pos, d + f->table_off[PDF_TT_GLYF] + s, n);
+      memset(glyf + pos + n, 0, ((n + 3) & ~3UL) - n);
+      pos += (n + 3) & ~3UL;
+    }
+  }
+  pdf_put_u32(loca + 4 * f->num_glyphs, pos);
+
+  memcpy(head, d + f->table_off[PDF_TT_HEAD], f->table_len[PDF_TT_HEAD]);
+  pdf_put_u32(head + 8, 0);
+  pdf_put_u16(head + 50, 1);
+
+  for (t = 0; t < PDF_TT_CMAP; ++t) {
+    src[t] = d + f->table_off[t];
+    len[t] = f->table_len[t];
+  }
+  src[PDF_TT_GLYF] = glyf;
+  len[PDF_TT_GLYF] = pos;
+  src[PDF_TT_LOCA] = loca;
+  len[PDF_TT_LOCA] = loca_len;
+  src[PDF_TT_HEAD] = head;
+  for (t = 0; t < PDF_TT_CMAP; ++t) {
+    if (len[t] > 0 || t == PDF_TT_GLYF)
+      num_tables++;
+  }
+  while ((2u << entry_selector) <= num_tables)
+    entry_selector++;
+
+  {
+    unsigned char hdr[12];
+    pdf_put_u32(hdr, 0x00010000UL);
+    pdf_put_u16(hdr + 4, num_tables);
+    pdf_put_u16(hdr + 6, 16u << entry_selector);
+    pdf_put_u16(hdr + 8, entry_selector);
+    pdf_put_u16(hdr + 10, num_tables * 16 - (16u << entry_selector));
+    pdf_membuf_append(out, hdr, 12);
+  }
+  dir_at = out->len;
+  data_at = dir_at + (unsigned long)num_tables * 16;
+  for (t = 0; t < PDF_TT_CMAP; ++t) {
+    unsigned char rec[16];
+    if (len[t] == 0 && t != PDF_TT_GLYF)
+      continue;
+    memcpy(rec, k_pdf_tt_tags[t], 4);
+    pdf_put_u32(rec + 4, pdf_tt_checksum(src[t], len[t]));
+    pdf_put_u32(rec + 8, data_at);
+    pdf_put_u32(rec + 12, len[t]);
+    pdf_membuf_append(out, rec, 16);
+    data_at += (len[t] + 3) & ~3UL;
+  }
+  for (t = 0; t < PDF_TT_CMAP; ++t) {
+    if (len[t] == 0)
+      continue;
+    pdf_membuf_append(out, src[t], len[t]);
+    pdf_membuf_append(out, zeros, ((len[t] + 3) & ~3UL) - len[t]);
+  }
+  if (out->error != CMP_SUCCESS)
+    goto done;
+
+  /* head follows cvt, fpgm and glyf in the table data. */
+  adjust = (0xB1B0AFBAUL - pdf_tt_checksum(out->data, out->len)) & 0xFFFFFFFFUL;
+  for (t = 0, pos = dir_at + (unsigned long)num_tables * 16; t < PDF_TT_HEAD;
+       ++t)
+    pos += (len[t] + 3) & ~3UL;
+  pdf_put_u32(out->data + pos + 8, adjust);
+  res = CMP_SUCCESS;
+
+done:
+  if (loca)
+    CMP_FREE(loca);
+  if (glyf)
+    CMP_FREE(glyf);
+  if (head)
+    CMP_FREE(head);
+  return res;
+}
+
+/* PostScript name (name id 6), restricted to characters safe in a PDF name. */
+static void pdf_font_name(const pdf_font_t *f, char *out, size_t cap) {
+  const unsigned char *d = f->data + f->table_off[PDF_TT_NAME];
+  unsigned long tlen = f->table_len[PDF_TT_NAME];
+  unsigned int count, i;
+  unsigned long strings;
+  size_t n = 0;
+
+  out[0] = '\0';
+  if (tlen >= 6) {
+    count = pdf_u16(d + 2);
+    strings = pdf_u16(d + 4);
+    for (i = 0; i < count && 6 + (unsigned long)(i + 1) * 12 <= tlen; ++i) {
+      const unsigned char *rec = d + 6 + i * 12;
+      unsigned int platform = pdf_u16(rec);
+      unsigned long slen = pdf_u16(rec + 8);
+      unsigned long soff = strings + pdf_u16(rec + 10);
+      unsigned long k, step = platform == 1 ? 1 : 2;
+      if (pdf_u16(rec + 6) != 6 || soff + slen > tlen ||
+          (platform != 1 && platform != 3))
+        continue;
+      for (k = step - 1; k < slen && n + 1 < cap; k += step) {
+        unsigned char c = d[soff + k];
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+            (c >= '0' && c <= '9') || c == '-' || c == '_')
+          out[n++] = (char)c;
+      }
+      out[n] = '\0';
+      if (n > 0)
+        return;
+    }
+  }
+  strcpy(out, "Font");
+}
+
+static void pdf_write_font(cmp_print_ctx_t *ctx, size_t index) {
+  pdf_font_t *f = &ctx->fonts[index];
+  pdf_membuf_t raw, packed;
+  char name[80], buf[256], num[4][48];
+  unsigned long tag_hash = 2166136261UL;
+  unsigned int g, run_start;
+  int cid_obj, desc_obj, file_obj, cmap_obj, entries, t;
+  const unsigned char *head = f->data + f->table_off[PDF_TT_HEAD];
+  const unsigned char *hhea = f->data + f->table_off[PDF_TT_HHEA];
+  double scale = 1000.0 / (double)f->upem;
+
+  memset(&raw, 0, sizeof(raw));
+  memset(&packed, 0, sizeof(packed));
+
+  f->used[0] = 1;
+  for (g = 0; g < f->num_glyphs; ++g) {
+    if (f->used[g])
+      pdf_font_mark_components(f, g, 0);
+  }
+
+  /* Subset tag: six capitals derived from the glyph set. */
+  for (g = 0; g < f->num_glyphs; ++g) {
+    if (f->used[g])
+      tag_hash = ((tag_hash ^ g) * 16777619UL) & 0xFFFFFFFFUL;
+  }
+  for (t = 0; t < 6; ++t) {
+    name[t] = (char)('A' + tag_hash % 26);
+    tag_hash = (tag_hash * 1103515245UL + 12345UL) & 0xFFFFFFFFUL;
+    tag_hash ^= tag_hash >> 16;
+  }
+  name[6] = '+';
+  pdf_font_name(f, name + 7, sizeof(name) - 7);
+
+  cid_obj = pdf_reserve_obj(ctx);
+  desc_obj = pdf_reserve_obj(ctx);
+  file_obj = pdf_reserve_obj(ctx);
+  cmap_obj = pdf_reserve_obj(ctx);
+
+  pdf_begin_obj(ctx, f->obj);
+  pdf_puts(ctx, "<< /Type /Font /Subtype /Type0 /BaseFont /");
+  pdf_puts(ctx, name);
+  sprintf(buf,
+          " /Encoding /Identity-H /DescendantFonts [%d 0 R] /ToUnicode %d 0 "
+          "R >>\nendobj\n",
+          cid_obj, cmap_obj);
+  pdf_puts(ctx, buf);
+
+  pdf_begin_obj(ctx, cid_obj);
+  pdf_puts(ctx, "<< /Type /Font /Subtype /CIDFontType2 /BaseFont /");
+  pdf_puts(ctx, name);
+  sprintf(buf,
+          " /CIDSystemInfo << /Registry (Adobe) /Ordering (Identity) "
+          "/Supplement 0 >> /FontDescriptor %d 0 R /CIDToGIDMap /Identity "
+          "/W [",
+          desc_obj);
+  pdf_puts(ctx, buf);
+  for (g = 0; g < f->num_glyphs;) {
+    if (!f->used[g]) {
+      g++;
+      continue;
+    }
+    run_start = g;
+    sprintf(buf, "%u [", run_start);
+    pdf_puts(ctx, buf);
+    while (g < f->num_glyphs && f->used[g]) {
+      pdf_fmt_num(num[0], (double)pdf_font_advance(f, g) * scale);
+      pdf_puts(ctx, g == run_start ? "" : " ");
+      pdf_puts(ctx, num[0]);
+      g++;
+    }
+    pdf_puts(ctx, "] ");
+  }
+  pdf_puts(ctx, "] >>\nendobj\n");
+
+  pdf_begin_obj(ctx, desc_obj);
+  pdf_puts(ctx, "<< /Type /FontDescriptor /FontName /");
+  pdf_puts(ctx, name);
+  for (t = 0; t < 4; ++t)
+    pdf_fmt_num(num[t], pdf_s16(head + 36 + 2 * t) * scale);
+  sprintf(buf, " /Flags 4 /FontBBox [%s %s %s %s] /ItalicAngle 0", num[0],
+          num[1], num[2], num[3]);
+  pdf_puts(ctx, buf);
+  pdf_fmt_num(num[0], pdf_s16(hhea + 4) * scale);
+  pdf_fmt_num(num[1], pdf_s16(hhea + 6) * scale);
+  sprintf(buf,
+          " /Ascent %s /Descent %s /CapHeight %s /StemV 80 /FontFile2 %d 0 R "
+          ">>\nendobj\n",
+          num[0], num[1], num[0], file_obj);
+  pdf_puts(ctx, buf);
+
+  if (pdf_font_subset(f, &raw) != CMP_SUCCESS || raw.error != CMP_SUCCESS ||
+      pdf_deflate_to(ctx, raw.data, raw.len, &packed) != CMP_SUCCESS) {
+    if (ctx->error == CMP_SUCCESS)
+      ctx->error = CMP_ERROR_OOM;
+    goto done;
+  }
+  sprintf(buf, "/Length1 %lu", (unsigned long)raw.len);
+  pdf_write_stream_obj(ctx, file_obj, buf, &packed);
+
+  /* ToUnicode CMap, in bfchar blocks of at most 100 entries. */
+  raw.len = 0;
+  packed.len = 0;
+  strcpy(buf, "/CIDInit /ProcSet findresource begin\n12 dict begin\n"
+              "begincmap\n/CIDSystemInfo << /Registry (Adobe) /Ordering "
+              "(UCS) /Supplement 0 >> def\n");
+  pdf_membuf_append(&raw, buf, strlen(buf));
+  strcpy(buf, "/CMapName /Adobe-Identity-UCS def\n/CMapType 2 def\n"
+              "1 begincodespacerange\n<0000> <FFFF>\nendcodespacerange\n");
+  pdf_membuf_append(&raw, buf, strlen(buf));
+  entries = 0;
+  for (g = 0; g <= f->num_glyphs; ++g) {
+    int flush = (g == f->num_glyphs) || entries == 100;
+    if (flush && entries > 0) {
+      pdf_membuf_append(&raw, "endbfchar\n", 10);
+      entries = 0;
+    }
+    if (g == f->num_glyphs)
+      break;
+    if (!f->unicode[g])
+      continue;
+    if (entries == 0) {
+      unsigned int left = 0, k;
+      for (k = g; k < f->num_glyphs && left < 100; ++k)
+        left += f->unicode[k] != 0;
+      sprintf(buf, "%u beginbfchar\n", left);
+      pdf_membuf_append(&raw, buf, strlen(buf));
+    }
+    if (f->unicode[g] >= 0x10000UL) {
+      unsigned long v = f->unicode[g] - 0x10000UL;
+      sprintf(buf, "<%04X> <%04lX%04lX>\n", g, 0xD800UL + (v >> 10),
+              0xDC00UL + (v & 0x3FF));
+    } else {
+      sprintf(buf, "<%04X> <%04lX>\n", g, f->unicode[g]);
+    }
+    pdf_membuf_append(&raw, buf, strlen(buf));
+    entries++;
+  }
+  strcpy(buf, "endcmap\nCMapName currentdict /CMap defineresource pop\n"
+              "end\nend\n");
+  pdf_membuf_append(&raw, buf, strlen(buf));
+  if (raw.error != CMP_SUCCESS ||
+      pdf_deflate_to(ctx, raw.data, raw.len, &packed) != CMP_SUCCESS) {
+    if (ctx->error == CMP_SUCCESS)
+      ctx->error = CMP_ERROR_OOM;
+    goto done;
+  }
+  pdf_write_stream_obj(ctx, cmap_obj, "", &packed);
+
+done:
+  pdf_membuf_free(&raw);
+  pdf_membuf_free(&packed);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Document lifecycle                                                        */
+/* ------------------------------------------------------------------------ */
+
+static void pdf_start(cmp_print_ctx_t *ctx) {
+  ctx->started = 1;
+  ctx->error = CMP_SUCCESS;
+  ctx->offset = 0;
+  ctx->next_obj = PDF_FIRST_OBJ;
+  memset(&ctx->stats, 0, sizeof(ctx->stats));
+  if (pdf_grow((void **)&ctx->xref, &ctx->xref_cap, 64,
+               sizeof(unsigned long)) != CMP_SUCCESS) {
+    ctx->error = CMP_ERROR_OOM;
+    return;
+  }
+  ctx->stats.objects = PDF_FIRST_OBJ - 1;
+  pdf_puts(ctx, "%PDF-1.7\n%\xE2\xE3\xCF\xD3\n");
+}
+
+static void pdf_reset_document(cmp_print_ctx_t *ctx) {
+  size_t i;
+
+  if (ctx->writer) {
+    cmp_vfs_writer_close(ctx->writer);
+    ctx->writer = NULL;
+  }
+  if (ctx->path) {
+    CMP_FREE(ctx->path);
+    ctx->path = NULL;
+  }
+  pdf_membuf_free(&ctx->mem);
+  if (ctx->xref)
+    CMP_FREE(ctx->xref);
+  ctx->xref = NULL;
+  ctx->xref_cap = 0;
+  if (ctx->page_objs)
+    CMP_FREE(ctx->page_objs);
+  ctx->page_objs = NULL;
+  ctx->page_cap = 0;
+  if (ctx->images)
+    CMP_FREE(ctx->images);
+  ctx->images = NULL;
+  ctx->image_cap = 0;
+  ctx->image_count = 0;
+  for (i = 0; i < ctx->pending_count; ++i) {
+    pdf_membuf_free(&ctx->pending[i].rgb);
+    pdf_membuf_free(&ctx->pending[i].alpha);
+  }
+  ctx->pending_count = 0;
+  ctx->page_image_count = 0;
+  for (i = 0; i < ctx->font_count; ++i) {
+    pdf_font_t *f = &ctx->fonts[i];
+    memset(f->used, 0, f->num_glyphs);
+    memset(f->unicode, 0, f->num_glyphs * sizeof(unsigned long));
+    f->obj = 0;
+    f->page_stamp = 0;
+  }
+  ctx->started = 0;
+  ctx->error = CMP_SUCCESS;
+  ctx->is_printing = 0;
+  ctx->current_page = 0;
+  ctx->offset = 0;
+  ctx->cbuf_len = 0;
+}
+
 int cmp_print_ctx_create(cmp_print_ctx_t **out_ctx) {
   cmp_print_ctx_t *ctx;
   if (!out_ctx) {
@@ -19,31 +974,140 @@ int cmp_print_ctx_create(cmp_print_ctx_t **out_ctx) {
     return CMP_ERROR_OOM;
   }
   memset(ctx, 0, sizeof(cmp_print_ctx_t));
+  ctx->next_width = PDF_DEFAULT_WIDTH;
+  ctx->next_height = PDF_DEFAULT_HEIGHT;
   *out_ctx = ctx;
   return CMP_SUCCESS;
 }
 
 int cmp_print_ctx_destroy(cmp_print_ctx_t *ctx) {
+  size_t i;
   if (!ctx) {
     return CMP_ERROR_INVALID_ARG;
   }
+  pdf_reset_document(ctx);
+  for (i = 0; i < ctx->font_count; ++i) {
+    CMP_FREE(ctx->fonts[i].data);
+    CMP_FREE(ctx->fonts[i].used);
+    CMP_FREE(ctx->fonts[i].unicode);
+  }
+  if (ctx->fonts)
+    CMP_FREE(ctx->fonts);
+  if (ctx->pending)
+    CMP_FREE(ctx->pending);
+  if (ctx->page_images)
+    CMP_FREE(ctx->page_images);
+  if (ctx->content)
+    cmp_deflate_destroy(ctx->content);
+  if (ctx->aux)
+    cmp_deflate_destroy(ctx->aux);
   CMP_FREE(ctx);
   return CMP_SUCCESS;
 }
 
+int cmp_print_ctx_begin_document(cmp_print_ctx_t *ctx, const char *file_path) {
+  int res;
+  if (!ctx || !file_path) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (ctx->started) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+  if (CMP_MALLOC(strlen(file_path) + 1, (void **)&ctx->path) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  strcpy(ctx->path, file_path);
+  res = cmp_vfs_writer_open(file_path, &ctx->writer);
+  if (res != CMP_SUCCESS) {
+    CMP_FREE(ctx->path);
+    ctx->path = NULL;
+    return res;
+  }
+  pdf_start(ctx);
+  return ctx->error;
+}
+
+int cmp_print_ctx_set_page_size(cmp_print_ctx_t *ctx, float width,
+                                float height) {
+  if (!ctx || !(width > 0.0f) || !(height > 0.0f) || width > 14400.0f ||
+      height > 14400.0f) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  ctx->next_width = width;
+  ctx->next_height = height;
+  return CMP_SUCCESS;
+}
+
 int cmp_print_ctx_begin_page(cmp_print_ctx_t *ctx) {
+  char buf[80];
   if (!ctx) {
     return CMP_ERROR_INVALID_ARG;
   }
   if (ctx->is_printing) {
     return CMP_ERROR_INVALID_STATE; /* Already in a page */
   }
+  if (!ctx->started) {
+    pdf_start(ctx);
+  }
+  if (!ctx->content && ctx->error == CMP_SUCCESS) {
+    ctx->error =
+        cmp_deflate_create(1, pdf_content_sink, ctx, &ctx->content);
+  } else if (ctx->error == CMP_SUCCESS) {
+    ctx->error = cmp_deflate_reset(ctx->content);
+  }
+  if (ctx->error != CMP_SUCCESS) {
+    return ctx->error;
+  }
+
+  ctx->page_width = ctx->next_width;
+  ctx->page_height = ctx->next_height;
+  ctx->content_obj = pdf_reserve_obj(ctx);
+  ctx->length_obj = pdf_reserve_obj(ctx);
+  pdf_begin_obj(ctx, ctx->content_obj);
+  sprintf(buf, "<< /Length %d 0 R /Filter /FlateDecode >>\nstream\n",
+          ctx->length_obj);
+  pdf_puts(ctx, buf);
+  ctx->content_start = ctx->offset;
+  ctx->cbuf_len = 0;
+  ctx->page_image_count = 0;
+  memset(ctx->alpha_used, 0, sizeof(ctx->alpha_used));
+
   ctx->is_printing = 1;
   ctx->current_page++;
-  return CMP_SUCCESS;
+  return ctx->error;
+}
+
+static void pdf_write_pending_images(cmp_print_ctx_t *ctx) {
+  char buf[256];
+  size_t i;
+  for (i = 0; i < ctx->pending_count; ++i) {
+    pdf_pending_image_t *img = &ctx->pending[i];
+    char smask[32] = "";
+    if (img->smask_obj) {
+      sprintf(buf,
+              "/Type /XObject /Subtype /Image /Width %d /Height %d "
+              "/ColorSpace /DeviceGray /BitsPerComponent 8",
+              img->width, img->height);
+      pdf_write_stream_obj(ctx, img->smask_obj, buf, &img->alpha);
+      sprintf(smask, " /SMask %d 0 R", img->smask_obj);
+    }
+    sprintf(buf,
+            "/Type /XObject /Subtype /Image /Width %d /Height %d /ColorSpace "
+            "/DeviceRGB /BitsPerComponent 8%s",
+            img->width, img->height, smask);
+    pdf_write_stream_obj(ctx, img->obj, buf, &img->rgb);
+    pdf_membuf_free(&img->rgb);
+    pdf_membuf_free(&img->alpha);
+  }
+  ctx->pending_count = 0;
 }
 
 int cmp_print_ctx_end_page(cmp_print_ctx_t *ctx) {
+  char buf[256], w[48], h[48];
+  unsigned long length;
+  size_t i;
+  int page_obj, k, any;
+
   if (!ctx) {
     return CMP_ERROR_INVALID_ARG;
   }
@@ -51,10 +1115,80 @@ int cmp_print_ctx_end_page(cmp_print_ctx_t *ctx) {
     return CMP_ERROR_INVALID_STATE; /* Not currently in a page */
   }
   ctx->is_printing = 0;
-  return CMP_SUCCESS;
+
+  pdf_cflush(ctx);
+  if (ctx->error == CMP_SUCCESS) {
+    ctx->error = cmp_deflate_finish(ctx->content);
+  }
+  length = ctx->offset - ctx->content_start;
+  pdf_puts(ctx, "\nendstream\nendobj\n");
+  pdf_begin_obj(ctx, ctx->length_obj);
+  sprintf(buf, "%lu\nendobj\n", length);
+  pdf_puts(ctx, buf);
+
+  pdf_write_pending_images(ctx);
+
+  page_obj = pdf_reserve_obj(ctx);
+  pdf_begin_obj(ctx, page_obj);
+  pdf_fmt_num(w, ctx->page_width);
+  pdf_fmt_num(h, ctx->page_height);
+  sprintf(buf,
+          "<< /Type /Page /Parent %d 0 R /MediaBox [0 0 %s %s] /Contents %d "
+          "0 R /Resources <<",
+          PDF_PAGES_OBJ, w, h, ctx->content_obj);
+  pdf_puts(ctx, buf);
+
+  any = 0;
+  for (i = 0; i < ctx->font_count; ++i) {
+    if (ctx->fonts[i].page_stamp != ctx->current_page)
+      continue;
+    pdf_puts(ctx, any ? "" : " /Font <<");
+    sprintf(buf, " /F%lu %d 0 R", (unsigned long)i, ctx->fonts[i].obj);
+    pdf_puts(ctx, buf);
+    any = 1;
+  }
+  if (any)
+    pdf_puts(ctx, " >>");
+  if (ctx->page_image_count > 0) {
+    pdf_puts(ctx, " /XObject <<");
+    for (i = 0; i < ctx->page_image_count; ++i) {
+      sprintf(buf, " /Im%d %d 0 R", ctx->page_images[i], ctx->page_images[i]);
+      pdf_puts(ctx, buf);
+    }
+    pdf_puts(ctx, " >>");
+  }
+  any = 0;
+  for (k = 0; k < 255; ++k) {
+    if (!ctx->alpha_used[k])
+      continue;
+    pdf_puts(ctx, any ? "" : " /ExtGState <<");
+    pdf_fmt_num(w, k / 255.0);
+    sprintf(buf, " /GA%d << /ca %s /CA %s >>", k, w, w);
+    pdf_puts(ctx, buf);
+    any = 1;
+  }
+  if (any)
+    pdf_puts(ctx, " >>");
+  pdf_puts(ctx, " >> >>\nendobj\n");
+
+  if (ctx->error == CMP_SUCCESS &&
+      pdf_grow((void **)&ctx->page_objs, &ctx->page_cap,
+               ctx->stats.pages + 1, sizeof(int)) != CMP_SUCCESS) {
+    ctx->error = CMP_ERROR_OOM;
+  }
+  if (ctx->error == CMP_SUCCESS) {
+    ctx->page_objs[ctx->stats.pages++] = page_obj;
+  }
+  ctx->stats.bytes_written = ctx->offset;
+  return ctx->error;
 }
 
 int cmp_print_ctx_save_pdf(cmp_print_ctx_t *ctx, const char *file_path) {
+  char buf[64];
+  unsigned long xref_at;
+  size_t i;
+  int res;
+
   if (!ctx || !file_path) {
     return CMP_ERROR_INVALID_ARG;
   }
@@ -64,6 +1198,420 @@ int cmp_print_ctx_save_pdf(cmp_print_ctx_t *ctx, const char *file_path) {
   if (ctx->current_page == 0) {
     return CMP_ERROR_INVALID_STATE; /* Cannot save empty document */
   }
-  /* Native PDF generation OS APIs would go here */
+  if (ctx->path && strcmp(ctx->path, file_path) != 0) {
+    return CMP_ERROR_INVALID_ARG; /* Streaming to a different file */
+  }
+
+  for (i = 0; i < ctx->font_count; ++i) {
+    if (ctx->fonts[i].obj)
+      pdf_write_font(ctx, i);
+  }
+
+  pdf_begin_obj(ctx, PDF_PAGES_OBJ);
+  pdf_puts(ctx, "<< /Type /Pages /Kids [");
+  for (i = 0; i < ctx->stats.pages; ++i) {
+    sprintf(buf, i ? " %d 0 R" : "%d 0 R", ctx->page_objs[i]);
+    pdf_puts(ctx, buf);
+  }
+  sprintf(buf, "] /Count %lu >>\nendobj\n", (unsigned long)ctx->stats.pages);
+  pdf_puts(ctx, buf);
+  pdf_begin_obj(ctx, PDF_CATALOG_OBJ);
+  sprintf(buf, "<< /Type /Catalog /Pages %d 0 R >>\nendobj\n", PDF_PAGES_OBJ);
+  pdf_puts(ctx, buf);
+
+  xref_at = ctx->offset;
+  sprintf(buf, "xref\n0 %d\n0000000000 65535 f \n", ctx->next_obj);
+  pdf_puts(ctx, buf);
+  for (i = 1; i < (size_t)ctx->next_obj; ++i) {
+    sprintf(buf, "%010lu 00000 n \n", ctx->xref ? ctx->xref[i] : 0UL);
+    pdf_puts(ctx, buf);
+  }
+  sprintf(buf, "trailer\n<< /Size %d /Root %d 0 R >>\nstartxref\n",
+          ctx->next_obj, PDF_CATALOG_OBJ);
+  pdf_puts(ctx, buf);
+  sprintf(buf, "%lu\n%%%%EOF\n", xref_at);
+  pdf_puts(ctx, buf);
+
+  res = ctx->error;
+  if (ctx->writer) {
+    int close_res = cmp_vfs_writer_close(ctx->writer);
+    ctx->writer = NULL;
+    if (res == CMP_SUCCESS)
+      res = close_res;
+  } else if (res == CMP_SUCCESS) {
+    cmp_vfs_writer_t *w;
+    res = cmp_vfs_writer_open(file_path, &w);
+    if (res == CMP_SUCCESS) {
+      int close_res;
+      res = cmp_vfs_writer_write(w, ctx->mem.data, ctx->mem.len);
+      close_res = cmp_vfs_writer_close(w);
+      if (res == CMP_SUCCESS)
+        res = close_res;
+    }
+  }
+  pdf_reset_document(ctx);
+  return res;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Drawing                                                                   */
+/* ------------------------------------------------------------------------ */
+
+int cmp_print_ctx_fill_rect(cmp_print_ctx_t *ctx, float x, float y,
+                            float width, float height,
+                            const cmp_color_t *color) {
+  int res, opened;
+  if (!ctx || !color) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  res = pdf_check_drawing(ctx);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  opened = pdf_cset_color(ctx, color, 0);
+  pdf_cnum(ctx, x);
+  pdf_cnum(ctx, (double)ctx->page_height - y - height);
+  pdf_cnum(ctx, width);
+  pdf_cnum(ctx, height);
+  pdf_cput(ctx, opened ? "re f Q\n" : "re f\n");
+  return ctx->error;
+}
+
+int cmp_print_ctx_fill_path(cmp_print_ctx_t *ctx, const float *points,
+                            const size_t *contour_counts,
+                            size_t contour_count, int fill_rule,
+                            const cmp_color_t *color) {
+  size_t c, i, at = 0;
+  int res, opened;
+  if (!ctx || !color || (contour_count > 0 && (!points || !contour_counts))) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  res = pdf_check_drawing(ctx);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  opened = pdf_cset_color(ctx, color, 0);
+  for (c = 0; c < contour_count; ++c) {
+    for (i = 0; i < contour_counts[c]; ++i, ++at) {
+      pdf_cpoint(ctx, points[2 * at], points[2 * at + 1], i ? "l\n" : "m\n");
+    }
+    if (contour_counts[c] > 0) {
+      pdf_cput(ctx, "h\n");
+    }
+  }
+  pdf_cput(ctx, fill_rule == 1 ? "f*" : "f");
+  pdf_cput(ctx, opened ? " Q\n" : "\n");
+  return ctx->error;
+}
+
+int cmp_print_ctx_stroke_path(cmp_print_ctx_t *ctx, const float *points,
+                              size_t point_count, int closed,
+                              float line_width, const cmp_color_t *color) {
+  size_t i;
+  int res, opened;
+  if (!ctx || !color || !points || point_count < 2 || !(line_width > 0.0f)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  res = pdf_check_drawing(ctx);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  opened = pdf_cset_color(ctx, color, 1);
+  pdf_cnum(ctx, line_width);
+  pdf_cput(ctx, "w\n");
+  for (i = 0; i < point_count; ++i) {
+    pdf_cpoint(ctx, points[2 * i], points[2 * i + 1], i ? "l\n" : "m\n");
+  }
+  pdf_cput(ctx, closed ? "s" : "S");
+  pdf_cput(ctx, opened ? " Q\n" : "\n");
+  return ctx->error;
+}
+
+int cmp_print_ctx_add_font(cmp_print_ctx_t *ctx, const void *ttf_data,
+                           size_t ttf_size, int *out_font_id) {
+  pdf_font_t f;
+  int res;
+  if (!ctx || !ttf_data || !out_font_id) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  memset(&f, 0, sizeof(f));
+  f.data = (unsigned char *)ttf_data;
+  f.size = ttf_size;
+  res = pdf_font_parse(&f);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  if (pdf_grow((void **)&ctx->fonts, &ctx->font_cap, ctx->font_count + 1,
+               sizeof(pdf_font_t)) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  f.data = NULL;
+  if (CMP_MALLOC(ttf_size, (void **)&f.data) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  if (CMP_MALLOC(f.num_glyphs, (void **)&f.used) != CMP_SUCCESS) {
+    CMP_FREE(f.data);
+    return CMP_ERROR_OOM;
+  }
+  if (CMP_MALLOC(f.num_glyphs * sizeof(unsigned long), (void **)&f.unicode) !=
+      CMP_SUCCESS) {
+    CMP_FREE(f.used);
+    CMP_FREE(f.data);
+    return CMP_ERROR_OOM;
+  }
+  memcpy(f.data, ttf_data, ttf_size);
+  memset(f.used, 0, f.num_glyphs);
+  memset(f.unicode, 0, f.num_glyphs * sizeof(unsigned long));
+  ctx->fonts[ctx->font_count] = f;
+  *out_font_id = (int)ctx->font_count++;
+  return CMP_SUCCESS;
+}
+
+/* Decodes one UTF-8 sequence; malformed input yields U+FFFD. */
+static unsigned long pdf_utf8_next(const unsigned char **s) {
+  const unsigned char *p = *s;
+  unsigned long cp;
+  int extra, i;
+  if (p[0] < 0x80) {
+    *s = p + 1;
+    return p[0];
+  }
+  if ((p[0] & 0xE0) == 0xC0) {
+    cp = p[0] & 0x1F;
+    extra = 1;
+  } else if ((p[0] & 0xF0) == 0xE0) {
+    cp = p[0] & 0x0F;
+    extra = 2;
+  } else if ((p[0] & 0xF8) == 0xF0) {
+    cp = p[0] & 0x07;
+    extra = 3;
+  } else {
+    *s = p + 1;
+    return 0xFFFD;
+  }
+  for (i = 1; i <= extra; ++i) {
+    if ((p[i] & 0xC0) != 0x80) {
+      *s = p + i;
+      return 0xFFFD;
+    }
+    cp = (cp << 6) | (p[i] & 0x3F);
+  }
+  *s = p + extra + 1;
+  return cp > 0x10FFFF ? 0xFFFD : cp;
+}
+
+int cmp_print_ctx_draw_text(cmp_print_ctx_t *ctx, int font_id, float size,
+                            float x, float baseline_y, const char *utf8,
+                            const cmp_color_t *color) {
+  const unsigned char *p;
+  pdf_font_t *f;
+  char buf[32];
+  int res, opened;
+
+  if (!ctx || !utf8 || !color || font_id < 0 ||
+      (size_t)font_id >= ctx->font_count || !(size > 0.0f)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  res = pdf_check_drawing(ctx);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  f = &ctx->fonts[font_id];
+  if (!f->obj) {
+    f->obj = pdf_reserve_obj(ctx);
+  }
+  f->page_stamp = ctx->current_page;
+
+  opened = pdf_cset_color(ctx, color, 0);
+  sprintf(buf, "BT /F%d ", font_id);
+  pdf_cput(ctx, buf);
+  pdf_cnum(ctx, size);
+  pdf_cput(ctx, "Tf ");
+  pdf_cpoint(ctx, x, baseline_y, "Td <");
+  p = (const unsigned char *)utf8;
+  while (*p) {
+    unsigned long cp = pdf_utf8_next(&p);
+    unsigned int gid = pdf_font_glyph(f, cp);
+    f->used[gid] = 1;
+    if (gid != 0 && !f->unicode[gid]) {
+      f->unicode[gid] = cp;
+    }
+    sprintf(buf, "%04X", gid);
+    pdf_cput(ctx, buf);
+  }
+  pdf_cput(ctx, "> Tj ET");
+  pdf_cput(ctx, opened ? " Q\n" : "\n");
+  return ctx->error;
+}
+
+static pdf_image_ref_t *pdf_image_slot(cmp_print_ctx_t *ctx, unsigned long h1,
+                                       unsigned long h2, int width,
+                                       int height) {
+  size_t mask = ctx->image_cap - 1;
+  size_t at = (size_t)(h1 ^ (h2 << 7)) & mask;
+  for (;;) {
+    pdf_image_ref_t *e = &ctx->images[at];
+    if (!e->obj || (e->h1 == h1 && e->h2 == h2 && e->width == width &&
+                    e->height == height))
+      return e;
+    at = (at + 1) & mask;
+  }
+}
+
+static int pdf_image_table_grow(cmp_print_ctx_t *ctx) {
+  pdf_image_ref_t *old = ctx->images;
+  size_t old_cap = ctx->image_cap, i;
+  size_t cap = old_cap ? old_cap * 2 : 64;
+  if (CMP_MALLOC(cap * sizeof(pdf_image_ref_t), (void **)&ctx->images) !=
+      CMP_SUCCESS) {
+    ctx->images = old;
+    return CMP_ERROR_OOM;
+  }
+  memset(ctx->images, 0, cap * sizeof(pdf_image_ref_t));
+  ctx->image_cap = cap;
+  for (i = 0; i < old_cap; ++i) {
+    if (old[i].obj) {
+      *pdf_image_slot(ctx, old[i].h1, old[i].h2, old[i].width,
+                      old[i].height) = old[i];
+    }
+  }
+  if (old)
+    CMP_FREE(old);
+  return CMP_SUCCESS;
+}
+
+/* Splits RGBA rows into compressed RGB and alpha planes. */
+static int pdf_encode_image(cmp_print_ctx_t *ctx, const unsigned char *rgba,
+                            int width, int height, size_t stride,
+                            pdf_pending_image_t *img) {
+  unsigned char *row;
+  int x, y, plane, res = CMP_SUCCESS;
+
+  if (CMP_MALLOC((size_t)width * 3, (void **)&row) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  for (plane = 0; plane < (img->smask_obj ? 2 : 1) && res == CMP_SUCCESS;
+       ++plane) {
+    pdf_membuf_t *out = plane ? &img->alpha : &img->rgb;
+    res = pdf_get_aux(ctx, out);
+    for (y = 0; y < height && res == CMP_SUCCESS; ++y) {
+      const unsigned char *src = rgba + (size_t)y * stride;
+      size_t n = 0;
+      for (x = 0; x < width; ++x, src += 4) {
+        if (plane) {
+          row[n++] = src[3];
+        } else {
+          row[n++] = src[0];
+          row[n++] = src[1];
+          row[n++] = src[2];
+        }
+      }
+      res = cmp_deflate_push(ctx->aux, row, n);
+    }
+    if (res == CMP_SUCCESS)
+      res = cmp_deflate_finish(ctx->aux);
+    if (res == CMP_SUCCESS)
+      res = out->error;
+  }
+  CMP_FREE(row);
+  return res;
+}
+
+int cmp_print_ctx_draw_image(cmp_print_ctx_t *ctx, const unsigned char *rgba,
+                             int width, int height, size_t stride, float x,
+                             float y, float dest_width, float dest_height) {
+  unsigned long h1 = 2166136261UL, h2 = 0x9E3779B9UL;
+  pdf_image_ref_t *ref;
+  int has_alpha = 0, xi, yi, obj, res;
+  char buf[32];
+
+  if (!ctx || !rgba || width <= 0 || height <= 0 ||
+      stride < (size_t)width * 4) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  res = pdf_check_drawing(ctx);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+
+  for (yi = 0; yi < height; ++yi) {
+    const unsigned char *p = rgba + (size_t)yi * stride;
+    for (xi = 0; xi < width * 4; ++xi) {
+      h1 = ((h1 ^ p[xi]) * 16777619UL) & 0xFFFFFFFFUL;
+      h2 = (((h2 << 5) | (h2 >> 27)) ^ p[xi]) & 0xFFFFFFFFUL;
+      h2 = (h2 * 0x85EBCA6BUL) & 0xFFFFFFFFUL;
+    }
+    for (xi = 3; xi < width * 4; xi += 4) {
+      has_alpha |= p[xi] != 255;
+    }
+  }
+
+  if (ctx->image_count * 2 >= ctx->image_cap &&
+      pdf_image_table_grow(ctx) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  ref = pdf_image_slot(ctx, h1, h2, width, height);
+  if (ref->obj) {
+    ctx->stats.images_deduplicated++;
+  } else {
+    pdf_pending_image_t img;
+    if (pdf_grow((void **)&ctx->pending, &ctx->pending_cap,
+                 ctx->pending_count + 1,
+                 sizeof(pdf_pending_image_t)) != CMP_SUCCESS) {
+      return CMP_ERROR_OOM;
+    }
+    memset(&img, 0, sizeof(img));
+    img.width = width;
+    img.height = height;
+    img.smask_obj = has_alpha; /* Numbered once encoding succeeded */
+    res = pdf_encode_image(ctx, rgba, width, height, stride, &img);
+    if (res != CMP_SUCCESS) {
+      pdf_membuf_free(&img.rgb);
+      pdf_membuf_free(&img.alpha);
+      return res;
+    }
+    img.obj = pdf_reserve_obj(ctx);
+    if (has_alpha) {
+      img.smask_obj = pdf_reserve_obj(ctx);
+    }
+    ctx->pending[ctx->pending_count++] = img;
+    ref->h1 = h1;
+    ref->h2 = h2;
+    ref->width = width;
+    ref->height = height;
+    ref->obj = img.obj;
+    ref->page_stamp = 0;
+    ctx->image_count++;
+    ctx->stats.images_written++;
+  }
+
+  obj = ref->obj;
+  if (ref->page_stamp != ctx->current_page) {
+    ref->page_stamp = ctx->current_page;
+    if (pdf_grow((void **)&ctx->page_images, &ctx->page_image_cap,
+                 ctx->page_image_count + 1, sizeof(int)) != CMP_SUCCESS) {
+      ctx->error = CMP_ERROR_OOM;
+      return ctx->error;
+    }
+    ctx->page_images[ctx->page_image_count++] = obj;
+  }
+
+  pdf_cput(ctx, "q ");
+  pdf_cnum(ctx, dest_width);
+  pdf_cput(ctx, "0 0 ");
+  pdf_cnum(ctx, dest_height);
+  pdf_cnum(ctx, x);
+  pdf_cnum(ctx, (double)ctx->page_height - y - dest_height);
+  sprintf(buf, "cm /Im%d Do Q\n", obj);
+  pdf_cput(ctx, buf);
+  return ctx->error;
+}
+
+int cmp_print_ctx_get_stats(const cmp_print_ctx_t *ctx,
+                            cmp_print_stats_t *out_stats) {
+  if (!ctx || !out_stats) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  *out_stats = ctx->stats;
+  out_stats->bytes_written = ctx->offset;
   return CMP_SUCCESS;
 }
@@ -12,16 +12,40 @@
 #endif
 /* clang-format on */
 
-typedef struct cmp_route_entry {
+/*
+ * Routes are compiled into a trie of path segments. A node keeps its
+ * static children in an open-addressing hash keyed by segment, then at
+ * most one ":name" child and one "*name" child that takes the rest of the
+ * URI. Matching tries them in that order and backtracks when a deeper
+ * segment fails. It walks the URI in place: nothing is copied or
+ * allocated, and parameter values are slices of the URI.
+ */
+typedef struct cmp_route_node {
+  /* Static segment leading here */
+  char *segment;
+  size_t segment_len;
+  unsigned long hash;
+
+  /* Static children; the table size is a power of two */
+  struct cmp_route_node **children;
+  size_t child_count;
+  size_t child_cap;
+  struct cmp_route_node *param;
+  struct cmp_route_node *wildcard;
+
+  /* Route ending at this node; path is NULL when there is none */
   char *path;
   cmp_route_builder_cb builder;
   cmp_route_guard_cb guard;
   void *guard_data;
-  struct cmp_route_entry *next;
-} cmp_route_entry_t;
+  /* Parameter names in URI order, as slices of path */
+  const char *param_names[CMP_ROUTE_MAX_PARAMS];
+  size_t param_name_lens[CMP_ROUTE_MAX_PARAMS];
+  size_t param_count;
+} cmp_route_node_t;
 
 struct cmp_router {
-  cmp_route_entry_t *routes;
+  cmp_route_node_t *root;
 
   /* Stack of active routes, stored dynamically */
   char **stack;
@@ -30,10 +54,175 @@ struct cmp_router {
 
   /* Currently active view */
   void *active_view;
+
+  /* Match of the active route; values point into the top of the stack */
+  cmp_route_match_t match;
+  int has_match;
 };
 
 static int g_router_initialized = 0;
 
+/* FNV-1a */
+static unsigned long route_hash(const char *segment, size_t len) {
+  unsigned long hash = 2166136261UL;
+  size_t i;
+  for (i = 0; i < len; ++i) {
+    hash ^= (unsigned char)segment[i];
+    hash = (hash * 16777619UL) & 0xFFFFFFFFUL;
+  }
+  return hash;
+}
+
+/* Next non-empty segment at or after p; repeated slashes are ignored */
+static const char *route_segment(const char *p, size_t *out_len) {
+  while (*p == '/')
+    ++p;
+  *out_len = strcspn(p, "/");
+  return p;
+}
+
+static int route_node_create(cmp_route_node_t **out_node, const char *segment,
+                             size_t len) {
+  cmp_route_node_t *node;
+  if (CMP_MALLOC(sizeof(cmp_route_node_t), (void **)&node) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(node, 0, sizeof(cmp_route_node_t));
+  if (CMP_MALLOC(len + 1, (void **)&node->segment) != CMP_SUCCESS) {
+    CMP_FREE(node);
+    return CMP_ERROR_OOM;
+  }
+  memcpy(node->segment, segment, len);
+  node->segment[len] = '\0';
+  node->segment_len = len;
+  node->hash = route_hash(segment, len);
+  *out_node = node;
+  return CMP_SUCCESS;
+}
+
+static void route_node_destroy(cmp_route_node_t *node) {
+  size_t i;
+  if (node == NULL)
+    return;
+  for (i = 0; i < node->child_cap; ++i)
+    route_node_destroy(node->children[i]);
+  if (node->children)
+    CMP_FREE(node->children);
+  route_node_destroy(node->param);
+  route_node_destroy(node->wildcard);
+  if (node->path)
+    CMP_FREE(node->path);
+  CMP_FREE(node->segment);
+  CMP_FREE(node);
+}
+
+static cmp_route_node_t *route_find_static(const cmp_route_node_t *node,
+                                           const char *segment, size_t len) {
+  cmp_route_node_t *child;
+  unsigned long hash;
+  size_t i, mask;
+  if (node->child_count == 0)
+    return NULL;
+  hash = route_hash(segment, len);
+  mask = node->child_cap - 1;
+  for (i = hash & mask; node->children[i] != NULL; i = (i + 1) & mask) {
+    child = node->children[i];
+    if (child->hash == hash && child->segment_len == len &&
+        memcmp(child->segment, segment, len) == 0)
+      return child;
+  }
+  return NULL;
+}
+
+static int route_insert_static(cmp_route_node_t *node,
+                               cmp_route_node_t *child) {
+  cmp_route_node_t **table;
+  size_t cap, i, k;
+
+  /* Keep the table at most half full */
+  if ((node->child_count + 1) * 2 > node->child_cap) {
+    cap = node->child_cap ? node->child_cap * 2 : 4;
+    if (CMP_MALLOC(cap * sizeof(cmp_route_node_t *), (void **)&table) !=
+        CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    memset(table, 0, cap * sizeof(cmp_route_node_t *));
+    for (i = 0; i < node->child_cap; ++i) {
+      if (node->children[i] == NULL)
+        continue;
+      k = node->children[i]->hash & (cap - 1);
+      while (table[k] != NULL)
+        k = (k + 1) & (cap - 1);
+      table[k] = node->children[i];
+    }
+    if (node->children)
+      CMP_FREE(node->children);
+    node->children = table;
+    node->child_cap = cap;
+  }
+  k = child->hash & (node->child_cap - 1);
+  while (node->children[k] != NULL)
+    k = (k + 1) & (node->child_cap - 1);
+  node->children[k] = child;
+  node->child_count++;
+  return CMP_SUCCESS;
+}
+
+/* Depth-first match of the URI from p; parameters are appended to match */
+static const cmp_route_node_t *route_match(const cmp_route_node_t *node,
+                                           const char *p,
+                                           cmp_route_match_t *match) {
+  const cmp_route_node_t *child, *found;
+  const char *segment;
+  size_t len, depth = match->param_count;
+
+  segment = route_segment(p, &len);
+  if (len == 0)
+    return node->path ? node : NULL;
+
+  child = route_find_static(node, segment, len);
+  if (child != NULL) {
+    found = route_match(child, segment + len, match);
+    if (found != NULL)
+      return found;
+  }
+  if (node->param != NULL && depth < CMP_ROUTE_MAX_PARAMS) {
+    match->params[depth].value = segment;
+    match->params[depth].value_len = len;
+    match->param_count = depth + 1;
+    found = route_match(node->param, segment + len, match);
+    if (found != NULL)
+      return found;
+    match->param_count = depth;
+  }
+  if (node->wildcard != NULL && node->wildcard->path != NULL &&
+      depth < CMP_ROUTE_MAX_PARAMS) {
+    len = strlen(segment);
+    while (segment[len - 1] == '/')
+      --len;
+    match->params[depth].value = segment;
+    match->params[depth].value_len = len;
+    match->param_count = depth + 1;
+    return node->wildcard;
+  }
+  return NULL;
+}
+
+static const cmp_route_node_t *route_lookup(const cmp_router_t *router,
+                                            const char *uri,
+                                            cmp_route_match_t *match) {
+  const cmp_route_node_t *route;
+  size_t i;
+  match->param_count = 0;
+  route = route_match(router->root, uri, match);
+  if (route == NULL)
+    return NULL;
+  match->pattern = route->path;
+  for (i = 0; i < match->param_count; ++i) {
+    match->params[i].name = route->param_names[i];
+    match->params[i].name_len = route->param_name_lens[i];
+  }
+  return route;
+}
+
 int cmp_router_create(cmp_router_t **out_router) {
   cmp_router_t *router;
 
@@ -44,12 +233,12 @@ int cmp_router_create(cmp_router_t **out_router) {
   if (CMP_MALLOC(sizeof(cmp_router_t), (void **)&router) != CMP_SUCCESS) {
     return CMP_ERROR_OOM;
   }
+  memset(router, 0, sizeof(cmp_router_t));
 
-  router->routes = NULL;
-  router->stack = NULL;
-  router->stack_count = 0;
-  router->stack_capacity = 0;
-  router->active_view = NULL;
+  if (route_node_create(&router->root, "", 0) != CMP_SUCCESS) {
+    CMP_FREE(router);
+    return CMP_ERROR_OOM;
+  }
 
   *out_router = router;
   g_router_initialized = 1;
@@ -57,21 +246,13 @@ int cmp_router_create(cmp_router_t **out_router) {
 }
 
 int cmp_router_destroy(cmp_router_t *router) {
-  cmp_route_entry_t *curr, *next;
   size_t i;
 
   if (router == NULL) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  /* Free routes */
-  curr = router->routes;
-  while (curr != NULL) {
-    next = curr->next;
-    CMP_FREE(curr->path);
-    CMP_FREE(curr);
-    curr = next;
-  }
+  route_node_destroy(router->root);
 
   /* Free stack */
   for (i = 0; i < router->stack_count; i++) {
@@ -88,175 +269,163 @@ int cmp_router_destroy(cmp_router_t *router) {
 int cmp_router_register(cmp_router_t *router, const char *path,
                         cmp_route_builder_cb builder, cmp_route_guard_cb guard,
                         void *guard_data) {
-  cmp_route_entry_t *entry;
-  size_t len;
+  cmp_route_node_t *node, *child;
+  size_t name_offsets[CMP_ROUTE_MAX_PARAMS];
+  size_t name_lens[CMP_ROUTE_MAX_PARAMS];
+  size_t count = 0, len, next_len, i;
+  const char *segment;
+  char *path_copy;
 
   if (router == NULL || path == NULL || builder == NULL) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  if (CMP_MALLOC(sizeof(cmp_route_entry_t), (void **)&entry) != CMP_SUCCESS) {
-    return CMP_ERROR_OOM;
+  /* Validate before touching the trie: a wildcard must come last */
+  for (segment = route_segment(path, &len); len > 0;
+       segment = route_segment(segment + len, &len)) {
+    if (segment[0] != ':' && segment[0] != '*')
+      continue;
+    if (count == CMP_ROUTE_MAX_PARAMS)
+      return CMP_ERROR_INVALID_ARG;
+    route_segment(segment + len, &next_len);
+    if (segment[0] == '*' && next_len > 0)
+      return CMP_ERROR_INVALID_ARG;
+    name_offsets[count] = (size_t)(segment + 1 - path);
+    name_lens[count] = len - 1;
+    count++;
+  }
+
+  node = router->root;
+  for (segment = route_segment(path, &len); len > 0;
+       segment = route_segment(segment + len, &len)) {
+    if (segment[0] == ':' || segment[0] == '*') {
+      cmp_route_node_t **slot =
+          segment[0] == ':' ? &node->param : &node->wildcard;
+      if (*slot == NULL && route_node_create(slot, "", 0) != CMP_SUCCESS)
+        return CMP_ERROR_OOM;
+      node = *slot;
+      continue;
+    }
+    child = route_find_static(node, segment, len);
+    if (child == NULL) {
+      if (route_node_create(&child, segment, len) != CMP_SUCCESS)
+        return CMP_ERROR_OOM;
+      if (route_insert_static(node, child) != CMP_SUCCESS) {
+        route_node_destroy(child);
+        return CMP_ERROR_OOM;
+      }
+    }
+    node = child;
   }
 
   len = strlen(path);
-  if (CMP_MALLOC(len + 1, (void **)&entry->path) != CMP_SUCCESS) {
-    CMP_FREE(entry);
+  if (CMP_MALLOC(len + 1, (void **)&path_copy) != CMP_SUCCESS) {
     return CMP_ERROR_OOM;
   }
+  memcpy(path_copy, path, len + 1);
 
-#if defined(_MSC_VER)
-  strcpy_s(entry->path, len + 1, path);
-#else
-  strcpy(entry->path, path);
-#endif
-
-  entry->builder = builder;
-  entry->guard = guard;
-  entry->guard_data = guard_data;
-
-  entry->next = router->routes;
-  router->routes = entry;
+  /* Registering a path again replaces its route */
+  if (node->path) {
+    CMP_FREE(node->path);
+  }
+  node->path = path_copy;
+  node->builder = builder;
+  node->guard = guard;
+  node->guard_data = guard_data;
+  node->param_count = count;
+  for (i = 0; i < count; ++i) {
+    node->param_names[i] = path_copy + name_offsets[i];
+    node->param_name_lens[i] = name_lens[i];
+  }
 
   return CMP_SUCCESS;
 }
 
-/* C89 safe implementation of string tokenization with saved state */
-static char *cmp_strtok_r(char *str, const char *delim, char **saveptr) {
-  char *token;
-  if (str == NULL) {
-    str = *saveptr;
+int cmp_router_match(const cmp_router_t *router, const char *uri,
+                     cmp_route_match_t *out_match) {
+  if (router == NULL || uri == NULL || out_match == NULL) {
+    return CMP_ERROR_INVALID_ARG;
   }
-  if (str == NULL) {
-    return NULL;
+  return route_lookup(router, uri, out_match) != NULL ? CMP_SUCCESS
+                                                      : CMP_ERROR_NOT_FOUND;
+}
+
+int cmp_router_get_match(const cmp_router_t *router,
+                         const cmp_route_match_t **out_match) {
+  if (router == NULL || out_match == NULL) {
+    return CMP_ERROR_INVALID_ARG;
   }
-  str += strspn(str, delim);
-  if (*str == '\0') {
-    *saveptr = NULL;
-    return NULL;
+  if (!router->has_match) {
+    return CMP_ERROR_NOT_FOUND;
   }
-  token = str;
-  str = strpbrk(token, delim);
-  if (str == NULL) {
-    *saveptr = NULL;
-  } else {
-    *str = '\0';
-    *saveptr = str + 1;
+  *out_match = &router->match;
+  return CMP_SUCCESS;
+}
+
+int cmp_route_match_get_param(const cmp_route_match_t *match,
+                              const char *name, const char **out_value,
+                              size_t *out_len) {
+  size_t i, len;
+
+  if (match == NULL || name == NULL || out_value == NULL || out_len == NULL) {
+    return CMP_ERROR_INVALID_ARG;
   }
-  return token;
+  len = strlen(name);
+  for (i = 0; i < match->param_count; ++i) {
+    if (match->params[i].name_len == len &&
+        memcmp(match->params[i].name, name, len) == 0) {
+      *out_value = match->params[i].value;
+      *out_len = match->params[i].value_len;
+      return CMP_SUCCESS;
+    }
+  }
+  return CMP_ERROR_NOT_FOUND;
 }
 
+/* Runs the guard and builder of the route matching uri. The match keeps
+ * pointing into uri, so it must outlive the route (the stack copy). */
 static int internal_execute_route(cmp_router_t *router, const char *uri) {
-  cmp_route_entry_t *curr = router->routes;
-  char *uri_mutable;
-  char *saveptr_uri = NULL;
-  size_t uri_len;
+  const cmp_route_node_t *route;
+  cmp_route_match_t match;
 
   if (router == NULL || uri == NULL) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  uri_len = strlen(uri);
-  if (CMP_MALLOC(uri_len + 1, (void **)&uri_mutable) != CMP_SUCCESS) {
-    return CMP_ERROR_OOM;
+  route = route_lookup(router, uri, &match);
+  if (route == NULL) {
+    return CMP_ERROR_NOT_FOUND;
   }
-#if defined(_MSC_VER)
-  strcpy_s(uri_mutable, uri_len + 1, uri);
-#else
-  strcpy(uri_mutable, uri);
-#endif
-
-  while (curr != NULL) {
-    int match = 1;
-    char *path_mutable;
-    char *saveptr_path = NULL;
-    char *u_tok, *p_tok;
-    size_t path_len = strlen(curr->path);
-
-    /* Quick exact match optimization */
-    if (strcmp(curr->path, uri) == 0) {
-      match = 1;
-      goto check_guard;
-    }
-
-    if (CMP_MALLOC(path_len + 1, (void **)&path_mutable) != CMP_SUCCESS) {
-      CMP_FREE(uri_mutable);
-      return CMP_ERROR_OOM;
-    }
-#if defined(_MSC_VER)
-    strcpy_s(path_mutable, path_len + 1, curr->path);
-#else
-    strcpy(path_mutable, curr->path);
-#endif
-
-    /* Re-copy URI for each route check since strtok modifies it */
-#if defined(_MSC_VER)
-    strcpy_s(uri_mutable, uri_len + 1, uri);
-#else
-    strcpy(uri_mutable, uri);
-#endif
-
-    u_tok = cmp_strtok_r(uri_mutable, "/", &saveptr_uri);
-    p_tok = cmp_strtok_r(path_mutable, "/", &saveptr_path);
-
-    while (u_tok != NULL || p_tok != NULL) {
-      if (u_tok == NULL || p_tok == NULL) {
-        match = 0; /* Different number of segments */
-        break;
-      }
 
-      if (p_tok[0] == ':') {
-        /* Dynamic parameter, matches anything in this segment.
-           In a full implementation, we'd extract the value here and pass it
-           in a structured way to the builder/guard. Phase 14 requests param
-           mapping mechanics. */
-      } else if (strcmp(u_tok, p_tok) != 0) {
-        match = 0; /* Static segment mismatch */
-        break;
-      }
-
-      u_tok = cmp_strtok_r(NULL, "/", &saveptr_uri);
-      p_tok = cmp_strtok_r(NULL, "/", &saveptr_path);
-    }
-
-    CMP_FREE(path_mutable);
-
-  check_guard:
-    if (match) {
-      /* Check guard first */
-      if (curr->guard != NULL) {
-        if (!curr->guard(uri, curr->guard_data)) {
-          CMP_FREE(uri_mutable);
-          return CMP_ERROR_NOT_FOUND; /* Guard blocked navigation */
-        }
-      }
+  /* Check guard first */
+  if (route->guard != NULL && !route->guard(uri, route->guard_data)) {
+    return CMP_ERROR_NOT_FOUND; /* Guard blocked navigation */
+  }
 
-      /* Build view */
-      router->active_view = curr->builder(uri);
-      CMP_FREE(uri_mutable);
-      return CMP_SUCCESS;
-    }
+  /* Build view */
+  router->match = match;
+  router->has_match = 1;
+  router->active_view = route->builder(uri);
+  return CMP_SUCCESS;
+}
 
-    curr = curr->next;
+static int router_copy_uri(const char *uri, char **out_copy) {
+  size_t len = strlen(uri);
+  if (CMP_MALLOC(len + 1, (void **)out_copy) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
   }
-
-  CMP_FREE(uri_mutable);
-  return CMP_ERROR_NOT_FOUND;
+  memcpy(*out_copy, uri, len + 1);
+  return CMP_SUCCESS;
 }
 
 int cmp_router_push(cmp_router_t *router, const char *uri) {
-  size_t len;
   char *uri_copy;
 
   if (router == NULL || uri == NULL) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  if (internal_execute_route(router, uri) != CMP_SUCCESS) {
-    return CMP_ERROR_NOT_FOUND;
-  }
-
-  /* Push to stack */
+  /* Make room first so a built route always lands on the stack */
   if (router->stack_count >= router->stack_capacity) {
     size_t new_cap =
         router->stack_capacity == 0 ? 4 : router->stack_capacity * 2;
@@ -275,23 +444,19 @@ int cmp_router_push(cmp_router_t *router, const char *uri) {
     router->stack_capacity = new_cap;
   }
 
-  len = strlen(uri);
-  if (CMP_MALLOC(len + 1, (void **)&uri_copy) != CMP_SUCCESS) {
+  if (router_copy_uri(uri, &uri_copy) != CMP_SUCCESS) {
     return CMP_ERROR_OOM;
   }
-
-#if defined(_MSC_VER)
-  strcpy_s(uri_copy, len + 1, uri);
-#else
-  strcpy(uri_copy, uri);
-#endif
+  if (internal_execute_route(router, uri_copy) != CMP_SUCCESS) {
+    CMP_FREE(uri_copy);
+    return CMP_ERROR_NOT_FOUND;
+  }
 
   router->stack[router->stack_count++] = uri_copy;
   return CMP_SUCCESS;
 }
 
 int cmp_router_replace(cmp_router_t *router, const char *uri) {
-  size_t len;
   char *uri_copy;
 
   if (router == NULL || uri == NULL) {
@@ -302,20 +467,13 @@ int cmp_router_replace(cmp_router_t *router, const char *uri) {
     return cmp_router_push(router, uri);
   }
 
-  if (internal_execute_route(router, uri) != CMP_SUCCESS) {
-    return CMP_ERROR_NOT_FOUND;
-  }
-
-  len = strlen(uri);
-  if (CMP_MALLOC(len + 1, (void **)&uri_copy) != CMP_SUCCESS) {
+  if (router_copy_uri(uri, &uri_copy) != CMP_SUCCESS) {
     return CMP_ERROR_OOM;
   }
-
-#if defined(_MSC_VER)
-  strcpy_s(uri_copy, len + 1, uri);
-#else
-  strcpy(uri_copy, uri);
-#endif
+  if (internal_execute_route(router, uri_copy) != CMP_SUCCESS) {
+    CMP_FREE(uri_copy);
+    return CMP_ERROR_NOT_FOUND;
+  }
 
   CMP_FREE(router->stack[router->stack_count - 1]);
   router->stack[router->stack_count - 1] = uri_copy;
@@ -336,6 +494,7 @@ int cmp_router_pop(cmp_router_t *router) {
   /* Remove top */
   CMP_FREE(router->stack[router->stack_count - 1]);
   router->stack_count--;
+  router->has_match = 0;
 
   /* Re-execute the new top */
   return internal_execute_route(router, router->stack[router->stack_count - 1]);
@@ -480,6 +639,7 @@ int cmp_router_switch_tab(cmp_router_t *router, const char *tab_uri) {
     CMP_FREE(r->stack[i]);
   }
   r->stack_count = 0; /* Flush all */
+  r->has_match = 0;
 
   return cmp_router_push(router, tab_uri);
 }
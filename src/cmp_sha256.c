@@ -0,0 +1,167 @@
+/* clang-format off */
+#include "cmp.h"
+#include <string.h>
+/* clang-format on */
+
+/* FIPS 180-4 SHA-256. Words live in unsigned long, which is only
+   guaranteed 32 bits wide, so every sum is masked back down. */
+
+#define SHA_MASK 0xffffffffUL
+#define SHA_ROTR(x, n) ((((x) >> (n)) | ((x) << (32 - (n)))) & SHA_MASK)
+
+static const unsigned long sha_k[64] = {
+    0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL, 0x3956c25bUL,
+    0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL, 0xd807aa98UL, 0x12835b01UL,
+    0x243185beUL, 0x550c7dc3UL, 0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL,
+    0xc19bf174UL, 0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL,
+    0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL, 0x983e5152UL,
+    0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL, 0xc6e00bf3UL, 0xd5a79147UL,
+    0x06ca6351UL, 0x14292967UL, 0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL,
+    0x53380d13UL, 0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+    0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL, 0xd192e819UL,
+    0xd6990624UL, 0xf40e3585UL, 0x106aa070UL, 0x19a4c116UL, 0x1e376c08UL,
+    0x2748774cUL, 0x34b0bcb5UL, 0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL,
+    0x682e6ff3UL, 0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL,
+    0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL};
+
+static void sha_block(cmp_sha256_t *sha, const unsigned char *p) {
+  unsigned long w[64];
+  unsigned long a, b, c, d, e, f, g, h, t1, t2, s0, s1;
+  int i;
+
+  for (i = 0; i < 16; ++i) {
+    w[i] = ((unsigned long)p[i * 4] << 24) |
+           ((unsigned long)p[i * 4 + 1] << 16) |
+           ((unsigned long)p[i * 4 + 2] << 8) | (unsigned long)p[i * 4 + 3];
+  }
+  for (i = 16; i < 64; ++i) {
+    s0 = SHA_ROTR(w[i - 15], 7) ^ SHA_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+    s1 = SHA_ROTR(w[i - 2], 17) ^ SHA_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+    w[i] = (w[i - 16] + s0 + w[i - 7] + s1) & SHA_MASK;
+  }
+  a = sha->h[0];
+  b = sha->h[1];
+  c = sha->h[2];
+  d = sha->h[3];
+  e = sha->h[4];
+  f = sha->h[5];
+  g = sha->h[6];
+  h = sha->h[7];
+  for (i = 0; i < 64; ++i) {
+    s1 = SHA_ROTR(e, 6) ^ SHA_ROTR(e, 11) ^ SHA_ROTR(e, 25);
+    t1 = (h + s1 + ((e & f) ^ (~e & g)) + sha_k[i] + w[i]) & SHA_MASK;
+    s0 = SHA_ROTR(a, 2) ^ SHA_ROTR(a, 13) ^ SHA_ROTR(a, 22);
+    t2 = (s0 + ((a & b) ^ (a & c) ^ (b & c))) & SHA_MASK;
+    h = g;
+    g = f;
+    f = e;
+    e = (d + t1) & SHA_MASK;
+    d = c;
+    c = b;
+    b = a;
+    a = (t1 + t2) & SHA_MASK;
+  }
+  sha->h[0] = (sha->h[0] + a) & SHA_MASK;
+  sha->h[1] = (sha->h[1] + b) & SHA_MASK;
+  sha->h[2] = (sha->h[2] + c) & SHA_MASK;
+  sha->h[3] = (sha->h[3] + d) & SHA_MASK;
+  sha->h[4] = (sha->h[4] + e) & SHA_MASK;
+  sha->h[5] = (sha->h[5] + f) & SHA_MASK;
+  sha->h[6] = (sha->h[6] + g) & SHA_MASK;
+  sha->h[7] = (sha->h[7] + h) & SHA_MASK;
+}
+
+void cmp_sha256_init(cmp_sha256_t *sha) {
+  static const unsigned long iv[8] = {0x6a09e667UL, 0xbb67ae85UL,
+                                      0x3c6ef372UL, 0xa54ff53aUL,
+                                      0x510e527fUL, 0x9b05688cUL,
+                                      0x1f83d9abUL, 0x5be0cd19UL};
+  if (sha == NULL) {
+    return;
+  }
+  memcpy(sha->h, iv, sizeof(iv));
+  sha->bits_hi = 0;
+  sha->bits_lo = 0;
+  sha->used = 0;
+}
+
+void cmp_sha256_update(cmp_sha256_t *sha, const void *data, size_t len) {
+  const unsigned char *p = (const unsigned char *)data;
+  unsigned long lo;
+  size_t take;
+
+  if (sha == NULL || (data == NULL && len > 0)) {
+    return;
+  }
+  while (len > 0) {
+    /* Count bits in 29-bit slices so the shift never overflows */
+    take = len > 0x1fffffffUL ? 0x1fffffffUL : len;
+    lo = (sha->bits_lo + ((unsigned long)take << 3)) & SHA_MASK;
+    if (lo < sha->bits_lo) {
+      sha->bits_hi = (sha->bits_hi + 1) & SHA_MASK;
+    }
+    sha->bits_lo = lo;
+    len -= take;
+
+    if (sha->used > 0) {
+      size_t room = 64 - sha->used;
+      size_t n = take < room ? take : room;
+      memcpy(sha->block + sha->used, p, n);
+      sha->used += n;
+      p += n;
+      take -= n;
+      if (sha->used < 64) {
+        continue;
+      }
+      sha_block(sha, sha->block);
+      sha->used = 0;
+    }
+    while (take >= 64) {
+      sha_block(sha, p);
+      p += 64;
+      take -= 64;
+    }
+    if (take > 0) {
+      memcpy(sha->block, p, take);
+      sha->used = take;
+      p += take;
+    }
+  }
+}
+
+void cmp_sha256_final(cmp_sha256_t *sha, unsigned char out_digest[32]) {
+  int i;
+
+  if (sha == NULL || out_digest == NULL) {
+    return;
+  }
+  sha->block[sha->used++] = 0x80;
+  if (sha->used > 56) {
+    memset(sha->block + sha->used, 0, 64 - sha->used);
+    sha_block(sha, sha->block);
+    sha->used = 0;
+  }
+  memset(sha->block + sha->used, 0, 56 - sha->used);
+  for (i = 0; i < 4; ++i) {
+    sha->block[56 + i] = (unsigned char)(sha->bits_hi >> (24 - i * 8));
+    sha->block[60 + i] = (unsigned char)(sha->bits_lo >> (24 - i * 8));
+  }
+  sha_block(sha, sha->block);
+  for (i = 0; i < 32; ++i) {
+    out_digest[i] = (unsigned char)(sha->h[i / 4] >> (24 - (i % 4) * 8));
+  }
+}
+
+void cmp_sha256_hex(const unsigned char digest[32], char out_hex[65]) {
+  static const char digits[] = "0123456789abcdef";
+  int i;
+
+  if (digest == NULL || out_hex == NULL) {
+    return;
+  }
+  for (i = 0; i < 32; ++i) {
+    out_hex[i * 2] = digits[digest[i] >> 4];
+    out_hex[i * 2 + 1] = digits[digest[i] & 15];
+  }
+  out_hex[64] = '\0';
+}
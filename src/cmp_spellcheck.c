@@ -4,10 +4,588 @@
 #include <string.h>
 /* clang-format on */
 
+/*
+ * Dictionaries are minimal acyclic automata (DAWGs): words sharing a prefix
+ * share a path and words sharing a suffix share their tail, so a word list
+ * shrinks to a few bytes per word. The compiled image is what gets saved
+ * and mapped back, so loading is a validation pass and nothing else.
+ *
+ * Image layout (little endian):
+ *   "CMPDAWG\0" | u32 version | u32 word count | u32 edge count | u32 root
+ *   | edges
+ * Each edge is a u32: bits 0-7 label byte, bit 8 last edge of its node,
+ * bit 9 the target node accepts, bits 10-31 index of the target node's
+ * first edge (0 for a node without edges; edge 0 is a placeholder).
+ */
+#define SPELL_VERSION 1
+#define SPELL_HEADER_SIZE 24
+#define SPELL_EDGE_LAST 0x100UL
+#define SPELL_EDGE_FINAL 0x200UL
+#define SPELL_TARGET_SHIFT 10
+#define SPELL_MAX_EDGES (1UL << 22)
+#define SPELL_PENDING ((unsigned long)-1)
+#define SPELL_CHUNK_SIZE 4096
+
+typedef struct spell_chunk {
+  struct spell_chunk *next;
+  size_t used;
+  char data[SPELL_CHUNK_SIZE];
+} spell_chunk_t;
+
 struct cmp_spellcheck {
   int enabled;
+
+  /* Dictionary image, built in memory (owned) or mapped from the VFS */
+  unsigned char *owned;
+  cmp_vfs_mapping_t *map;
+  const unsigned char *image;
+  size_t image_size;
+  const unsigned char *edges;
+  unsigned long edge_count;
+  unsigned long root;
+
+  /* Words added at runtime; checks on worker threads read them too */
+  cmp_mutex_t lock;
+  const char **user_slots;
+  size_t user_cap;
+  size_t user_count;
+  spell_chunk_t *chunks;
 };
 
+static unsigned long read_u32(const unsigned char *p) {
+  return (unsigned long)p[0] | (unsigned long)p[1] << 8 |
+         (unsigned long)p[2] << 16 | (unsigned long)p[3] << 24;
+}
+
+static void write_u32(unsigned char *p, unsigned long v) {
+  p[0] = (unsigned char)(v & 0xFF);
+  p[1] = (unsigned char)((v >> 8) & 0xFF);
+  p[2] = (unsigned char)((v >> 16) & 0xFF);
+  p[3] = (unsigned char)((v >> 24) & 0xFF);
+}
+
+static unsigned long hash_bytes(unsigned long h, const void *data,
+                                size_t len) {
+  const unsigned char *p = (const unsigned char *)data;
+  size_t i;
+  for (i = 0; i < len; ++i) {
+    h = ((h ^ p[i]) * 16777619UL) & 0xFFFFFFFFUL;
+  }
+  return h;
+}
+
+static void release_dictionary(struct cmp_spellcheck *sc) {
+  if (sc->owned) {
+    CMP_FREE(sc->owned);
+  }
+  if (sc->map) {
+    cmp_vfs_unmap_file(sc->map);
+  }
+  sc->owned = NULL;
+  sc->map = NULL;
+  sc->image = NULL;
+  sc->image_size = 0;
+  sc->edges = NULL;
+  sc->edge_count = 0;
+  sc->root = 0;
+}
+
+/* ---- Lookup ---- */
+
+static int dawg_contains(const struct cmp_spellcheck *sc,
+                         const unsigned char *word, size_t len) {
+  unsigned long node = sc->root, e = 0;
+  size_t i;
+
+  if (!sc->edges || len == 0) {
+    return 0;
+  }
+  for (i = 0; i < len; ++i) {
+    if (node == 0) {
+      return 0;
+    }
+    for (;;) {
+      unsigned long label;
+      e = read_u32(sc->edges + node * 4);
+      label = e & 0xFF;
+      if (label == word[i]) {
+        break;
+      }
+      /* Edges of a node are sorted by label */
+      if (label > word[i] || (e & SPELL_EDGE_LAST) ||
+          node + 1 >= sc->edge_count) {
+        return 0;
+      }
+      node++;
+    }
+    node = e >> SPELL_TARGET_SHIFT;
+  }
+  return (e & SPELL_EDGE_FINAL) != 0;
+}
+
+static int user_contains(struct cmp_spellcheck *sc, const char *word,
+                         size_t len) {
+  size_t slot;
+  int found = 0;
+
+  cmp_mutex_lock(&sc->lock);
+  if (sc->user_count > 0) {
+    slot = hash_bytes(2166136261UL, word, len) & (sc->user_cap - 1);
+    while (sc->user_slots[slot]) {
+      if (strncmp(sc->user_slots[slot], word, len) == 0 &&
+          sc->user_slots[slot][len] == '\0') {
+        found = 1;
+        break;
+      }
+      slot = (slot + 1) & (sc->user_cap - 1);
+    }
+  }
+  cmp_mutex_unlock(&sc->lock);
+  return found;
+}
+
+static int spell_known(struct cmp_spellcheck *sc, const char *word,
+                       size_t len) {
+  return dawg_contains(sc, (const unsigned char *)word, len) ||
+         user_contains(sc, word, len);
+}
+
+/* 0: as written, 1: Capitalized, 2: ALL CAPS (ASCII letters only). */
+static int case_form(const char *word, size_t len) {
+  size_t i, upper = 0, letters = 0;
+  for (i = 0; i < len; ++i) {
+    unsigned char c = (unsigned char)word[i];
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+      letters++;
+      if (c <= 'Z') {
+        upper++;
+      }
+    }
+  }
+  if (letters > 1 && upper == letters) {
+    return 2;
+  }
+  if (upper == 1 && word[0] >= 'A' && word[0] <= 'Z') {
+    return 1;
+  }
+  return 0;
+}
+
+/* Lowercases the ASCII letters a case form allows into buf. */
+static void fold_case(const char *word, size_t len, int form, char *buf) {
+  size_t i;
+  memcpy(buf, word, len);
+  for (i = 0; i < len && form != 0; ++i) {
+    if (buf[i] >= 'A' && buf[i] <= 'Z') {
+      buf[i] = (char)(buf[i] - 'A' + 'a');
+    }
+    if (form == 1) {
+      break;
+    }
+  }
+  buf[len] = '\0';
+}
+
+static int spell_check_word(struct cmp_spellcheck *sc, const char *word,
+                            size_t len) {
+  char folded[CMP_SPELLCHECK_MAX_WORD];
+  int form;
+
+  if (len == 0 || len >= CMP_SPELLCHECK_MAX_WORD || !sc->edges) {
+    return 1; /* Nothing to check against */
+  }
+  if (spell_known(sc, word, len)) {
+    return 1;
+  }
+  form = case_form(word, len);
+  if (form == 0) {
+    return 0;
+  }
+  fold_case(word, len, form, folded);
+  if (spell_known(sc, folded, len)) {
+    return 1;
+  }
+  if (form == 2) {
+    /* "PARIS" is spelled right when "Paris" is */
+    folded[0] = word[0];
+    return spell_known(sc, folded, len);
+  }
+  return 0;
+}
+
+/* ---- Construction ---- */
+
+typedef struct spell_edge {
+  unsigned long target;
+  unsigned char label;
+} spell_edge_t;
+
+typedef struct spell_node {
+  unsigned long first; /* Into the builder's edge array */
+  unsigned long hash;
+  unsigned int count;
+  int final;
+} spell_node_t;
+
+/* A node on the path of the last word, not yet registered. */
+typedef struct spell_pending {
+  unsigned long targets[256];
+  unsigned char labels[256];
+  unsigned int count;
+  int final;
+} spell_pending_t;
+
+typedef struct spell_builder {
+  spell_edge_t *edges;
+  unsigned long edge_count, edge_cap;
+  spell_node_t *nodes;
+  unsigned long node_count, node_cap;
+  unsigned long *table; /* Node id + 1, open addressed by node hash */
+  unsigned long table_cap;
+  spell_pending_t *path;
+} spell_builder_t;
+
+static int grow_array(void **items, unsigned long *cap, unsigned long need,
+                      size_t elem) {
+  unsigned long new_cap = *cap ? *cap : 64;
+  void *fresh;
+  if (need <= *cap) {
+    return CMP_SUCCESS;
+  }
+  while (new_cap < need) {
+    new_cap *= 2;
+  }
+  if (CMP_MALLOC(new_cap * elem, &fresh) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  if (*items) {
+    memcpy(fresh, *items, *cap * elem);
+    CMP_FREE(*items);
+  }
+  *items = fresh;
+  *cap = new_cap;
+  return CMP_SUCCESS;
+}
+
+static unsigned long pending_hash(const spell_pending_t *p) {
+  unsigned long h = hash_bytes(2166136261UL, &p->final, sizeof(p->final));
+  unsigned int i;
+  for (i = 0; i < p->count; ++i) {
+    h = hash_bytes(h, &p->labels[i], 1);
+    h = hash_bytes(h, &p->targets[i], sizeof(p->targets[i]));
+  }
+  return h;
+}
+
+static int pending_equals(const spell_builder_t *b, unsigned long id,
+                          const spell_pending_t *p) {
+  const spell_node_t *n = &b->nodes[id];
+  unsigned int i;
+  if (n->final != p->final || n->count != p->count) {
+    return 0;
+  }
+  for (i = 0; i < p->count; ++i) {
+    const spell_edge_t *e = &b->edges[n->first + i];
+    if (e->label != p->labels[i] || e->target != p->targets[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+static int table_grow(spell_builder_t *b) {
+  unsigned long cap = b->table_cap ? b->table_cap * 2 : 1024, i;
+  unsigned long *table;
+  if (CMP_MALLOC(cap * sizeof(unsigned long), (void **)&table) !=
+      CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(table, 0, cap * sizeof(unsigned long));
+  for (i = 0; i < b->node_count; ++i) {
+    unsigned long slot = b->nodes[i].hash & (cap - 1);
+    while (table[slot]) {
+      slot = (slot + 1) & (cap - 1);
+    }
+    table[slot] = i + 1;
+  }
+  if (b->table) {
+    CMP_FREE(b->table);
+  }
+  b->table = table;
+  b->table_cap = cap;
+  return CMP_SUCCESS;
+}
+
+/* Replaces the pending node at depth with an equivalent registered node,
+ * registering it first if it is new. */
+static int register_node(spell_builder_t *b, size_t depth,
+                         unsigned long *out_id) {
+  spell_pending_t *p = &b->path[depth];
+  unsigned long h = pending_hash(p), slot, id;
+  spell_node_t *n;
+  unsigned int i;
+  int res;
+
+  slot = h & (b->table_cap - 1);
+  while (b->table[slot]) {
+    id = b->table[slot] - 1;
+    if (b->nodes[id].hash == h && pending_equals(b, id, p)) {
+      p->count = 0;
+      p->final = 0;
+      *out_id = id;
+      return CMP_SUCCESS;
+    }
+    slot = (slot + 1) & (b->table_cap - 1);
+  }
+
+  res = grow_array((void **)&b->edges, &b->edge_cap, b->edge_count + p->count,
+                   sizeof(spell_edge_t));
+  if (res == CMP_SUCCESS) {
+    res = grow_array((void **)&b->nodes, &b->node_cap, b->node_count + 1,
+                     sizeof(spell_node_t));
+  }
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  id = b->node_count++;
+  n = &b->nodes[id];
+  n->first = b->edge_count;
+  n->hash = h;
+  n->count = p->count;
+  n->final = p->final;
+  for (i = 0; i < p->count; ++i) {
+    b->edges[b->edge_count].label = p->labels[i];
+    b->edges[b->edge_count].target = p->targets[i];
+    b->edge_count++;
+  }
+  b->table[slot] = id + 1;
+  if (b->node_count * 2 > b->table_cap) {
+    res = table_grow(b);
+    if (res != CMP_SUCCESS) {
+      return res;
+    }
+  }
+
+  p->count = 0;
+  p->final = 0;
+  *out_id = id;
+  return CMP_SUCCESS;
+}
+
+/* Registers the path below depth, deepest first, linking each node into
+ * its parent's last edge. */
+static int collapse_path(spell_builder_t *b, size_t from_depth,
+                         size_t to_depth) {
+  size_t d;
+  for (d = from_depth; d > to_depth; --d) {
+    spell_pending_t *parent = &b->path[d - 1];
+    unsigned long id;
+    int res = register_node(b, d, &id);
+    if (res != CMP_SUCCESS) {
+      return res;
+    }
+    parent->targets[parent->count - 1] = id;
+  }
+  return CMP_SUCCESS;
+}
+
+static int compare_words(const void *a, const void *b) {
+  return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+static int builder_emit(const spell_builder_t *b, unsigned long root,
+                        unsigned long word_count, unsigned char **out_image,
+                        size_t *out_size) {
+  unsigned long *first, total = 1, i;
+  unsigned char *image, *edges;
+  size_t size;
+
+  if (CMP_MALLOC(b->node_count * sizeof(unsigned long), (void **)&first) !=
+      CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  for (i = 0; i < b->node_count; ++i) {
+    first[i] = b->nodes[i].count ? total : 0;
+    total += b->nodes[i].count;
+  }
+  if (total > SPELL_MAX_EDGES) {
+    CMP_FREE(first);
+    return CMP_ERROR_BOUNDS;
+  }
+
+  size = SPELL_HEADER_SIZE + (size_t)total * 4;
+  if (CMP_MALLOC(size, (void **)&image) != CMP_SUCCESS) {
+    CMP_FREE(first);
+    return CMP_ERROR_OOM;
+  }
+  memcpy(image, "CMPDAWG", 8);
+  write_u32(image + 8, SPELL_VERSION);
+  write_u32(image + 12, word_count);
+  write_u32(image + 16, total);
+  write_u32(image + 20, first[root]);
+  edges = image + SPELL_HEADER_SIZE;
+  write_u32(edges, SPELL_EDGE_LAST);
+  for (i = 0; i < b->node_count; ++i) {
+    const spell_node_t *n = &b->nodes[i];
+    unsigned int k;
+    for (k = 0; k < n->count; ++k) {
+      const spell_edge_t *e = &b->edges[n->first + k];
+      unsigned long v = e->label | first[e->target] << SPELL_TARGET_SHIFT;
+      if (k + 1 == n->count) {
+        v |= SPELL_EDGE_LAST;
+      }
+      if (b->nodes[e->target].final) {
+        v |= SPELL_EDGE_FINAL;
+      }
+      write_u32(edges + (first[i] + k) * 4, v);
+    }
+  }
+
+  CMP_FREE(first);
+  *out_image = image;
+  *out_size = size;
+  return CMP_SUCCESS;
+}
+
+static void builder_free(spell_builder_t *b) {
+  if (b->edges) {
+    CMP_FREE(b->edges);
+  }
+  if (b->nodes) {
+    CMP_FREE(b->nodes);
+  }
+  if (b->table) {
+    CMP_FREE(b->table);
+  }
+  if (b->path) {
+    CMP_FREE(b->path);
+  }
+}
+
+/* Every edge must stay inside the image and every node run must be
+ * terminated, so lookups need no bounds checks beyond the edge count. */
+static int image_valid(const unsigned char *data, size_t size) {
+  unsigned long count, root, i;
+
+  if (size < SPELL_HEADER_SIZE || memcmp(data, "CMPDAWG", 8) != 0 ||
+      read_u32(data + 8) != SPELL_VERSION) {
+    return 0;
+  }
+  count = read_u32(data + 16);
+  root = read_u32(data + 20);
+  if (count == 0 || count > SPELL_MAX_EDGES ||
+      (size - SPELL_HEADER_SIZE) / 4 != count ||
+      (size - SPELL_HEADER_SIZE) % 4 != 0 || root >= count) {
+    return 0;
+  }
+  for (i = 0; i < count; ++i) {
+    if ((read_u32(data + SPELL_HEADER_SIZE + i * 4) >> SPELL_TARGET_SHIFT) >=
+        count) {
+      return 0;
+    }
+  }
+  return (read_u32(data + SPELL_HEADER_SIZE + (count - 1) * 4) &
+          SPELL_EDGE_LAST) != 0;
+}
+
+static void use_image(struct cmp_spellcheck *sc, const unsigned char *data,
+                      size_t size) {
+  sc->image = data;
+  sc->image_size = size;
+  sc->edges = data + SPELL_HEADER_SIZE;
+  sc->edge_count = read_u32(data + 16);
+  sc->root = read_u32(data + 20);
+}
+
+/* ---- Suggestions ---- */
+
+/* Walks the dictionary with the rows of a Levenshtein automaton (with
+ * adjacent transpositions) for the query, pruning every branch whose best
+ * cell already exceeds the allowed distance. */
+typedef struct spell_search {
+  const struct cmp_spellcheck *sc;
+  const unsigned char *word;
+  size_t len;
+  size_t max_distance;
+  unsigned char rows[CMP_SPELLCHECK_MAX_WORD][CMP_SPELLCHECK_MAX_WORD];
+  unsigned char prefix[CMP_SPELLCHECK_MAX_WORD];
+  cmp_spell_suggestion_t *out;
+  size_t max_results;
+  size_t count;
+} spell_search_t;
+
+static void search_add(spell_search_t *s, size_t len, size_t distance) {
+  size_t at = s->count;
+  if (s->count == s->max_results) {
+    if (distance >= s->out[s->count - 1].distance) {
+      return;
+    }
+    at = --s->count;
+  }
+  /* Stable by distance; equal distances stay in dictionary order */
+  while (at > 0 && s->out[at - 1].distance > distance) {
+    s->out[at] = s->out[at - 1];
+    at--;
+  }
+  memcpy(s->out[at].word, s->prefix, len);
+  s->out[at].word[len] = '\0';
+  s->out[at].distance = distance;
+  s->count++;
+}
+
+static void search_node(spell_search_t *s, unsigned long node, size_t depth) {
+  const unsigned char *w = s->word;
+  size_t n = s->len;
+
+  if (node == 0 || depth + 1 >= CMP_SPELLCHECK_MAX_WORD) {
+    return;
+  }
+  for (;;) {
+    unsigned long e = read_u32(s->sc->edges + node * 4);
+    unsigned char c = (unsigned char)(e & 0xFF);
+    unsigned char *row = s->rows[depth + 1];
+    const unsigned char *prev = s->rows[depth];
+    size_t j, best, limit = s->max_distance;
+
+    if (s->count == s->max_results && s->out[s->count - 1].distance <= limit) {
+      limit = s->out[s->count - 1].distance - 1;
+    }
+    row[0] = (unsigned char)(depth + 1);
+    best = row[0];
+    for (j = 1; j <= n; ++j) {
+      size_t v = prev[j - 1] + (w[j - 1] != c);
+      if ((size_t)prev[j] + 1 < v) {
+        v = prev[j] + 1;
+      }
+      if ((size_t)row[j - 1] + 1 < v) {
+        v = row[j - 1] + 1;
+      }
+      if (depth > 0 && j > 1 && w[j - 1] == s->prefix[depth - 1] &&
+          w[j - 2] == c && (size_t)s->rows[depth - 1][j - 2] + 1 < v) {
+        v = s->rows[depth - 1][j - 2] + 1;
+      }
+      row[j] = (unsigned char)v;
+      if (v < best) {
+        best = v;
+      }
+    }
+    s->prefix[depth] = c;
+
+    if ((e & SPELL_EDGE_FINAL) && row[n] > 0 && row[n] <= limit) {
+      search_add(s, depth + 1, row[n]);
+    }
+    if (best <= limit) {
+      search_node(s, e >> SPELL_TARGET_SHIFT, depth + 1);
+    }
+    if ((e & SPELL_EDGE_LAST) || node + 1 >= s->sc->edge_count) {
+      break;
+    }
+    node++;
+  }
+}
+
+/* ---- Public API ---- */
+
 int cmp_spellcheck_create(cmp_spellcheck_t **out_spellcheck) {
   struct cmp_spellcheck *spellcheck;
 
@@ -20,6 +598,10 @@ int cmp_spellcheck_create(cmp_spellcheck_t **out_spellcheck) {
 
   memset(spellcheck, 0, sizeof(struct cmp_spellcheck));
   spellcheck->enabled = 1;
+  if (cmp_mutex_init(&spellcheck->lock) != CMP_SUCCESS) {
+    CMP_FREE(spellcheck);
+    return CMP_ERROR_GENERAL;
+  }
 
   *out_spellcheck = (cmp_spellcheck_t *)spellcheck;
   return CMP_SUCCESS;
@@ -31,6 +613,16 @@ int cmp_spellcheck_destroy(cmp_spellcheck_t *spellcheck) {
   if (!internal_spellcheck)
     return CMP_ERROR_INVALID_ARG;
 
+  release_dictionary(internal_spellcheck);
+  while (internal_spellcheck->chunks) {
+    spell_chunk_t *next = internal_spellcheck->chunks->next;
+    CMP_FREE(internal_spellcheck->chunks);
+    internal_spellcheck->chunks = next;
+  }
+  if (internal_spellcheck->user_slots) {
+    CMP_FREE((void *)internal_spellcheck->user_slots);
+  }
+  cmp_mutex_destroy(&internal_spellcheck->lock);
   CMP_FREE(internal_spellcheck);
   return CMP_SUCCESS;
 }
@@ -48,12 +640,339 @@ int cmp_spellcheck_verify_word(cmp_spellcheck_t *spellcheck, const char *word,
     return CMP_SUCCESS;
   }
 
-  /* Dummy logic: anything with 'x' is misspelled */
-  if (strchr(word, 'x') != NULL || strchr(word, 'X') != NULL) {
-    *out_is_correct = 0;
-  } else {
-    *out_is_correct = 1;
+  *out_is_correct =
+      spell_check_word(internal_spellcheck, word, strlen(word));
+  return CMP_SUCCESS;
+}
+
+int cmp_spellcheck_build_dictionary(cmp_spellcheck_t *spellcheck,
+                                    const char *const *words, size_t count) {
+  struct cmp_spellcheck *sc = (struct cmp_spellcheck *)spellcheck;
+  spell_builder_t b;
+  const char **sorted = NULL;
+  const char *prev = "";
+  size_t prev_len = 0, i, accepted = 0;
+  unsigned long root;
+  unsigned char *image = NULL;
+  size_t size = 0;
+  int res;
+
+  if (!sc || (!words && count > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  memset(&b, 0, sizeof(b));
+  if (count > 0 &&
+      CMP_MALLOC(count * sizeof(const char *), (void **)&sorted) !=
+          CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  if (count > 0) {
+    memcpy((void *)sorted, words, count * sizeof(const char *));
+    qsort((void *)sorted, count, sizeof(const char *), compare_words);
+  }
+
+  res = CMP_MALLOC(CMP_SPELLCHECK_MAX_WORD * sizeof(spell_pending_t),
+                   (void **)&b.path);
+  if (res == CMP_SUCCESS) {
+    memset(b.path, 0, CMP_SPELLCHECK_MAX_WORD * sizeof(spell_pending_t));
+    res = table_grow(&b);
+  }
+
+  /* Words arrive sorted, so everything below the prefix shared with the
+   * next word is final and can be merged with its equivalent right away
+   * (Daciuk et al.'s incremental construction). */
+  for (i = 0; i < count && res == CMP_SUCCESS; ++i) {
+    const char *w = sorted[i];
+    size_t len = strlen(w), common = 0, d;
+    if (len == 0 || len >= CMP_SPELLCHECK_MAX_WORD) {
+      continue;
+    }
+    while (common < len && common < prev_len && w[common] == prev[common]) {
+      common++;
+    }
+    if (common == len && len == prev_len) {
+      continue; /* Duplicate */
+    }
+    res = collapse_path(&b, prev_len, common);
+    for (d = common; d < len && res == CMP_SUCCESS; ++d) {
+      spell_pending_t *p = &b.path[d];
+      p->labels[p->count] = (unsigned char)w[d];
+      p->targets[p->count] = SPELL_PENDING;
+      p->count++;
+      b.path[d + 1].count = 0;
+      b.path[d + 1].final = 0;
+    }
+    b.path[len].final = 1;
+    prev = w;
+    prev_len = len;
+    accepted++;
+  }
+  if (res == CMP_SUCCESS) {
+    res = collapse_path(&b, prev_len, 0);
+  }
+  if (res == CMP_SUCCESS) {
+    res = register_node(&b, 0, &root);
+  }
+  if (res == CMP_SUCCESS) {
+    res = builder_emit(&b, root, (unsigned long)accepted, &image, &size);
+  }
+
+  builder_free(&b);
+  if (sorted) {
+    CMP_FREE((void *)sorted);
+  }
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  release_dictionary(sc);
+  sc->owned = image;
+  use_image(sc, image, size);
+  return CMP_SUCCESS;
+}
+
+int cmp_spellcheck_save_dictionary(const cmp_spellcheck_t *spellcheck,
+                                   const char *virtual_path) {
+  const struct cmp_spellcheck *sc = (const struct cmp_spellcheck *)spellcheck;
+  cmp_vfs_writer_t *writer;
+  int res;
+
+  if (!sc || !virtual_path) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (!sc->image) {
+    return CMP_ERROR_INVALID_STATE;
+  }
+  res = cmp_vfs_writer_open(virtual_path, &writer);
+  if (res == CMP_SUCCESS) {
+    cmp_vfs_writer_write(writer, sc->image, sc->image_size);
+    res = cmp_vfs_writer_close(writer);
+  }
+  return res;
+}
+
+int cmp_spellcheck_load_dictionary(cmp_spellcheck_t *spellcheck,
+                                   const char *virtual_path) {
+  struct cmp_spellcheck *sc = (struct cmp_spellcheck *)spellcheck;
+  cmp_vfs_mapping_t *map;
+  const void *data;
+  size_t size;
+  int res;
+
+  if (!sc || !virtual_path) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  res = cmp_vfs_map_file(virtual_path, &map, &data, &size);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+
+  if (!image_valid((const unsigned char *)data, size)) {
+    cmp_vfs_unmap_file(map);
+    return CMP_ERROR_INVALID_ARG;
+  }
+  release_dictionary(sc);
+  sc->map = map;
+  use_image(sc, (const unsigned char *)data, size);
+  return CMP_SUCCESS;
+}
+
+int cmp_spellcheck_add_word(cmp_spellcheck_t *spellcheck, const char *word) {
+  struct cmp_spellcheck *sc = (struct cmp_spellcheck *)spellcheck;
+  size_t len, slot;
+  char *copy;
+  int res = CMP_SUCCESS;
+
+  if (!sc || !word) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  len = strlen(word);
+  if (len == 0 || len >= CMP_SPELLCHECK_MAX_WORD) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (user_contains(sc, word, len)) {
+    return CMP_SUCCESS;
+  }
+
+  cmp_mutex_lock(&sc->lock);
+  if ((sc->user_count + 1) * 2 > sc->user_cap) {
+    size_t cap = sc->user_cap ? sc->user_cap * 2 : 64, i;
+    const char **slots;
+    res = CMP_MALLOC(cap * sizeof(const char *), (void **)&slots);
+    if (res == CMP_SUCCESS) {
+      memset((void *)slots, 0, cap * sizeof(const char *));
+      for (i = 0; i < sc->user_cap; ++i) {
+        const char *s = sc->user_slots[i];
+        if (s) {
+          slot = hash_bytes(2166136261UL, s, strlen(s)) & (cap - 1);
+          while (slots[slot]) {
+            slot = (slot + 1) & (cap - 1);
+          }
+          slots[slot] = s;
+        }
+      }
+      if (sc->user_slots) {
+        CMP_FREE((void *)sc->user_slots);
+      }
+      sc->user_slots = slots;
+      sc->user_cap = cap;
+    }
+  }
+  if (res == CMP_SUCCESS &&
+      (!sc->chunks || SPELL_CHUNK_SIZE - sc->chunks->used < len + 1)) {
+    spell_chunk_t *chunk;
+    res = CMP_MALLOC(sizeof(spell_chunk_t), (void **)&chunk);
+    if (res == CMP_SUCCESS) {
+      chunk->used = 0;
+      chunk->next = sc->chunks;
+      sc->chunks = chunk;
+    }
+  }
+  if (res == CMP_SUCCESS) {
+    copy = sc->chunks->data + sc->chunks->used;
+    memcpy(copy, word, len + 1);
+    sc->chunks->used += len + 1;
+    slot = hash_bytes(2166136261UL, word, len) & (sc->user_cap - 1);
+    while (sc->user_slots[slot]) {
+      slot = (slot + 1) & (sc->user_cap - 1);
+    }
+    sc->user_slots[slot] = copy;
+    sc->user_count++;
+  }
+  cmp_mutex_unlock(&sc->lock);
+  return res;
+}
+
+int cmp_spellcheck_suggest(cmp_spellcheck_t *spellcheck, const char *word,
+                           size_t max_distance,
+                           cmp_spell_suggestion_t *out_suggestions,
+                           size_t max_results, size_t *out_count) {
+  struct cmp_spellcheck *sc = (struct cmp_spellcheck *)spellcheck;
+  spell_search_t *s;
+  char folded[CMP_SPELLCHECK_MAX_WORD];
+  size_t len, i, j;
+  int form;
+
+  if (!sc || !word || !out_count || (!out_suggestions && max_results > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  *out_count = 0;
+  len = strlen(word);
+  if (!sc->edges || max_results == 0 || len == 0 ||
+      len >= CMP_SPELLCHECK_MAX_WORD) {
+    return CMP_SUCCESS;
+  }
+  if (max_distance > CMP_SPELLCHECK_MAX_WORD / 2) {
+    max_distance = CMP_SPELLCHECK_MAX_WORD / 2;
+  }
+  if (CMP_MALLOC(sizeof(spell_search_t), (void **)&s) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+
+  form = case_form(word, len);
+  fold_case(word, len, form, folded);
+  s->sc = sc;
+  s->word = (const unsigned char *)folded;
+  s->len = len;
+  s->max_distance = max_distance;
+  s->out = out_suggestions;
+  s->max_results = max_results;
+  s->count = 0;
+  for (j = 0; j <= len; ++j) {
+    s->rows[0][j] = (unsigned char)j;
+  }
+  search_node(s, sc->root, 0);
+
+  /* Suggestions follow the case the word was typed in */
+  for (i = 0; i < s->count && form != 0; ++i) {
+    char *w = out_suggestions[i].word;
+    for (j = 0; w[j] && (form == 2 || j == 0); ++j) {
+      if (w[j] >= 'a' && w[j] <= 'z') {
+        w[j] = (char)(w[j] - 'a' + 'A');
+      }
+    }
+  }
+  *out_count = s->count;
+  CMP_FREE(s);
+  return CMP_SUCCESS;
+}
+
+enum { SPELL_SEPARATOR, SPELL_LETTER, SPELL_DIGIT, SPELL_APOSTROPHE };
+
+/* Classifies the text unit at p and returns its length. Letters are ASCII
+ * letters and anything non-ASCII except general punctuation
+ * (U+2000-U+206F), which separates words apart from the right single quote
+ * used as an apostrophe. */
+static size_t text_unit(const unsigned char *p, size_t avail, int *out_kind) {
+  *out_kind = SPELL_SEPARATOR;
+  if ((*p | 0x20) >= 'a' && (*p | 0x20) <= 'z') {
+    *out_kind = SPELL_LETTER;
+  } else if (*p >= '0' && *p <= '9') {
+    *out_kind = SPELL_DIGIT;
+  } else if (*p == '\'') {
+    *out_kind = SPELL_APOSTROPHE;
+  } else if (*p == 0xE2 && avail >= 3 && (p[1] == 0x80 || p[1] == 0x81)) {
+    if (p[1] == 0x80 && p[2] == 0x99) {
+      *out_kind = SPELL_APOSTROPHE;
+    }
+    return 3;
+  } else if (*p >= 0x80) {
+    *out_kind = SPELL_LETTER;
+  }
+  return 1;
+}
+
+int cmp_spellcheck_check_text(cmp_spellcheck_t *spellcheck, const char *text,
+                              size_t len, cmp_spell_range_t *out_ranges,
+                              size_t max_ranges, size_t *out_count) {
+  struct cmp_spellcheck *sc = (struct cmp_spellcheck *)spellcheck;
+  const unsigned char *t = (const unsigned char *)text;
+  size_t i = 0, count = 0;
+
+  if (!sc || (!text && len > 0) || !out_count ||
+      (!out_ranges && max_ranges > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  while (i < len && count < max_ranges && sc->enabled) {
+    size_t start, step;
+    int kind, digits = 0;
+
+    /* Skip to the next word (digits glue onto words, e.g. "h264") */
+    while (i < len) {
+      step = text_unit(t + i, len - i, &kind);
+      if (kind == SPELL_LETTER || kind == SPELL_DIGIT) {
+        break;
+      }
+      i += step;
+    }
+    start = i;
+    while (i < len) {
+      step = text_unit(t + i, len - i, &kind);
+      if (kind == SPELL_SEPARATOR) {
+        break;
+      }
+      if (kind == SPELL_DIGIT) {
+        digits = 1;
+      } else if (kind == SPELL_APOSTROPHE) {
+        /* Only inside a word: "don't", not "'quoted'" */
+        int next = SPELL_SEPARATOR;
+        if (i + step < len) {
+          text_unit(t + i + step, len - i - step, &next);
+        }
+        if (next != SPELL_LETTER) {
+          break;
+        }
+      }
+      i += step;
+    }
+    if (i > start && !digits && !spell_check_word(sc, text + start,
+                                                  i - start)) {
+      out_ranges[count].offset = start;
+      out_ranges[count].length = i - start;
+      count++;
+    }
   }
 
+  *out_count = count;
   return CMP_SUCCESS;
 }
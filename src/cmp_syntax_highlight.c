@@ -5,6 +5,374 @@
 #include <ctype.h>
 /* clang-format on */
 
+/* Line-oriented, table-driven lexing.
+ * Every grammar is lexed one line at a time from a small start state (inside
+ * a block comment, a multi-line string, a fenced code block...). A document
+ * caches the start state of each line, so after an edit only the edited
+ * lines are re-lexed, plus successors until the state coming out of a line
+ * matches what was cached before the edit. Spans are produced only for the
+ * lines a caller asks for, into an array the document reuses. */
+
+#define SH_STATE_NORMAL 0
+#define SH_STATE_BLOCK_COMMENT 1
+#define SH_STATE_STRING 2 /* Plus the delimiter's index in string_delims */
+#define SH_STATE_FENCE 1  /* Markdown: inside a fenced code block */
+
+typedef struct sh_grammar {
+  const char *const *names;    /* Language identifiers, NULL-terminated */
+  const char *const *keywords; /* Sorted for binary search, NULL-terminated */
+  const char *line_comment;
+  const char *block_open;
+  const char *block_close;
+  const char *string_delims;
+  const char *multiline_delims; /* Subset of string_delims */
+  const char *operators;
+  int ident_dollar; /* '$' may appear in identifiers */
+  int markdown;     /* Lexed by sh_lex_markdown instead */
+} sh_grammar_t;
+
+static const char *const k_c_names[] = {"c", "h", NULL};
+static const char *const k_c_keywords[] = {
+    "auto",     "break",    "case",     "char",   "const",    "continue",
+    "default",  "do",       "double",   "else",   "enum",     "extern",
+    "float",    "for",      "goto",     "if",     "inline",   "int",
+    "long",     "register", "restrict", "return", "short",    "signed",
+    "sizeof",   "static",   "struct",   "switch", "typedef",  "union",
+    "unsigned", "void",     "volatile", "while",  NULL};
+
+static const char *const k_js_names[] = {"js", "javascript", "mjs", "jsx",
+                                         NULL};
+static const char *const k_js_keywords[] = {
+    "async",  "await",   "break",     "case",       "catch",
+    "class",  "const",   "continue",  "debugger",   "default",
+    "delete", "do",      "else",      "export",     "extends",
+    "false",  "finally", "for",       "from",       "function",
+    "if",     "import",  "in",        "instanceof", "let",
+    "new",    "null",    "of",        "return",     "static",
+    "super",  "switch",  "this",      "throw",      "true",
+    "try",    "typeof",  "undefined", "var",        "void",
+    "while",  "with",    "yield",     NULL};
+
+static const char *const k_json_names[] = {"json", NULL};
+static const char *const k_json_keywords[] = {"false", "null", "true", NULL};
+
+static const char *const k_md_names[] = {"md", "markdown", NULL};
+static const char *const k_no_names[] = {NULL};
+static const char *const k_no_keywords[] = {NULL};
+
+static const sh_grammar_t k_grammars[] = {
+    {k_c_names, k_c_keywords, "//", "/*", "*/", "\"'", "",
+     "+-*/%=<>!&|^~?:", 0, 0},
+    {k_js_names, k_js_keywords, "//", "/*", "*/", "\"'`", "`",
+     "+-*/%=<>!&|^~?:", 1, 0},
+    {k_json_names, k_json_keywords, NULL, NULL, NULL, "\"", "", ":", 0, 0},
+    {k_md_names, k_no_keywords, NULL, NULL, NULL, "", "", "", 0, 1}};
+
+/* Unknown languages still get strings and numbers. */
+static const sh_grammar_t k_plain_grammar = {
+    k_no_names, k_no_keywords, NULL, NULL, NULL, "\"", "", "", 0, 0};
+
+static const sh_grammar_t *sh_find_grammar(const char *language) {
+  size_t g, n;
+  if (!language)
+    return &k_plain_grammar;
+  for (g = 0; g < sizeof(k_grammars) / sizeof(k_grammars[0]); ++g) {
+    for (n = 0; k_grammars[g].names[n]; ++n) {
+      if (strcmp(k_grammars[g].names[n], language) == 0)
+        return &k_grammars[g];
+    }
+  }
+  return &k_plain_grammar;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Span arena                                                                */
+/* ------------------------------------------------------------------------ */
+
+typedef struct sh_spans {
+  cmp_highlight_span_t *items;
+  size_t count;
+  size_t capacity;
+  int failed; /* Sticky OOM so lexers need not check every push */
+} sh_spans_t;
+
+static void sh_emit(sh_spans_t *out, size_t start, size_t length,
+                    cmp_token_type_t type) {
+  if (!out || length == 0 || out->failed)
+    return;
+  /* Adjacent operators read better as one span */
+  if (out->count > 0 && type == CMP_TOKEN_OPERATOR) {
+    cmp_highlight_span_t *last = &out->items[out->count - 1];
+    if (last->type == type && last->start_offset + last->length == start) {
+      last->length += length;
+      return;
+    }
+  }
+  if (out->count == out->capacity) {
+    size_t cap = out->capacity ? out->capacity * 2 : 64;
+    cmp_highlight_span_t *items;
+    if (CMP_MALLOC(cap * sizeof(cmp_highlight_span_t), (void **)&items) !=
+        CMP_SUCCESS) {
+      out->failed = 1;
+      return;
+    }
+    if (out->count)
+      memcpy(items, out->items, out->count * sizeof(cmp_highlight_span_t));
+    if (out->items)
+      CMP_FREE(out->items);
+    out->items = items;
+    out->capacity = cap;
+  }
+  out->items[out->count].start_offset = start;
+  out->items[out->count].length = length;
+  out->items[out->count].type = type;
+  out->count++;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Lexers                                                                    */
+/* ------------------------------------------------------------------------ */
+
+static int sh_starts_with(const char *s, size_t len, size_t i,
+                          const char *prefix) {
+  size_t n;
+  if (!prefix)
+    return 0;
+  n = strlen(prefix);
+  return n > 0 && len - i >= n && memcmp(s + i, prefix, n) == 0;
+}
+
+static int sh_is_keyword(const sh_grammar_t *g, const char *word,
+                         size_t len) {
+  size_t lo = 0, hi = 0;
+  while (g->keywords[hi])
+    hi++;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    const char *k = g->keywords[mid];
+    int cmp = strncmp(word, k, len);
+    if (cmp == 0)
+      cmp = k[len] == '\0' ? 0 : -1;
+    if (cmp == 0)
+      return 1;
+    if (cmp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  return 0;
+}
+
+/* Scans a string body from i to its closing delimiter. Returns the index
+ * past the delimiter, or len with *out_closed = 0. */
+static size_t sh_scan_string(const char *s, size_t len, size_t i, char delim,
+                             int *out_closed) {
+  while (i < len) {
+    if (s[i] == '\\') {
+      i += 2;
+      continue;
+    }
+    if (s[i] == delim) {
+      *out_closed = 1;
+      return i + 1;
+    }
+    i++;
+  }
+  *out_closed = 0;
+  return len;
+}
+
+/* Lexes one line (without its newline) of a C-like grammar. base is the
+ * line's document offset. Returns the state at the start of the next line. */
+static int sh_lex_generic(const sh_grammar_t *g, const char *s, size_t len,
+                          size_t base, int state, sh_spans_t *out) {
+  size_t i = 0;
+
+  if (state == SH_STATE_BLOCK_COMMENT) {
+    const char *close = g->block_close;
+    size_t n = strlen(close);
+    while (i < len && !sh_starts_with(s, len, i, close))
+      i++;
+    if (i >= len) {
+      sh_emit(out, base, len, CMP_TOKEN_COMMENT);
+      return SH_STATE_BLOCK_COMMENT;
+    }
+    i += n;
+    sh_emit(out, base, i, CMP_TOKEN_COMMENT);
+  } else if (state >= SH_STATE_STRING) {
+    int closed;
+    char delim = g->string_delims[state - SH_STATE_STRING];
+    i = sh_scan_string(s, len, 0, delim, &closed);
+    sh_emit(out, base, i, CMP_TOKEN_STRING);
+    if (!closed)
+      return state;
+  }
+
+  while (i < len) {
+    unsigned char c = (unsigned char)s[i];
+    const char *delim;
+    size_t start = i;
+
+    if (c == ' ' || c == '\t' || c == '\r') {
+      i++;
+    } else if (sh_starts_with(s, len, i, g->line_comment)) {
+      sh_emit(out, base + i, len - i, CMP_TOKEN_COMMENT);
+      return SH_STATE_NORMAL;
+    } else if (sh_starts_with(s, len, i, g->block_open)) {
+      i += strlen(g->block_open);
+      while (i < len && !sh_starts_with(s, len, i, g->block_close))
+        i++;
+      if (i >= len) {
+        sh_emit(out, base + start, len - start, CMP_TOKEN_COMMENT);
+        return SH_STATE_BLOCK_COMMENT;
+      }
+      i += strlen(g->block_close);
+      sh_emit(out, base + start, i - start, CMP_TOKEN_COMMENT);
+    } else if (c != '\0' && (delim = strchr(g->string_delims, c)) != NULL) {
+      int closed;
+      i = sh_scan_string(s, len, i + 1, (char)c, &closed);
+      sh_emit(out, base + start, i - start, CMP_TOKEN_STRING);
+      if (!closed && strchr(g->multiline_delims, c))
+        return SH_STATE_STRING + (int)(delim - g->string_delims);
+    } else if (isdigit(c) ||
+               (c == '.' && i + 1 < len && isdigit((unsigned char)s[i + 1]))) {
+      while (i < len) {
+        unsigned char d = (unsigned char)s[i];
+        if (isalnum(d) || d == '.' || d == '_') {
+          i++;
+        } else if ((d == '+' || d == '-') &&
+                   (s[i - 1] == 'e' || s[i - 1] == 'E') &&
+                   !(s[start] == '0' && start + 1 < len &&
+                     (s[start + 1] == 'x' || s[start + 1] == 'X'))) {
+          i++;
+        } else {
+          break;
+        }
+      }
+      sh_emit(out, base + start, i - start, CMP_TOKEN_NUMBER);
+    } else if (isalpha(c) || c == '_' || (c == '$' && g->ident_dollar)) {
+      size_t j;
+      while (i < len &&
+             (isalnum((unsigned char)s[i]) || s[i] == '_' ||
+              (s[i] == '$' && g->ident_dollar)))
+        i++;
+      if (sh_is_keyword(g, s + start, i - start)) {
+        sh_emit(out, base + start, i - start, CMP_TOKEN_KEYWORD);
+      } else {
+        for (j = i; j < len && (s[j] == ' ' || s[j] == '\t'); ++j) {
+        }
+        if (j < len && s[j] == '(')
+          sh_emit(out, base + start, i - start, CMP_TOKEN_FUNCTION);
+      }
+    } else if (c != '\0' && strchr(g->operators, c)) {
+      i++;
+      sh_emit(out, base + start, 1, CMP_TOKEN_OPERATOR);
+    } else {
+      i++;
+    }
+  }
+  return SH_STATE_NORMAL;
+}
+
+/* Markdown is block-structured, so most constructs are whole lines. */
+static int sh_lex_markdown(const char *s, size_t len, size_t base, int state,
+                           sh_spans_t *out) {
+  size_t i = 0, j;
+
+  while (i < len && i < 3 && s[i] == ' ')
+    i++;
+  if (len - i >= 3 && (memcmp(s + i, "```", 3) == 0 ||
+                       memcmp(s + i, "~~~", 3) == 0)) {
+    sh_emit(out, base, len, CMP_TOKEN_STRING);
+    return state == SH_STATE_FENCE ? SH_STATE_NORMAL : SH_STATE_FENCE;
+  }
+  if (state == SH_STATE_FENCE) {
+    sh_emit(out, base, len, CMP_TOKEN_STRING);
+    return SH_STATE_FENCE;
+  }
+  if (i < len && s[i] == '#') {
+    for (j = i; j < len && s[j] == '#'; ++j) {
+    }
+    if (j - i <= 6 && (j == len || s[j] == ' ' || s[j] == '\t')) {
+      sh_emit(out, base, len, CMP_TOKEN_KEYWORD);
+      return SH_STATE_NORMAL;
+    }
+  }
+  if (i < len && s[i] == '>') {
+    sh_emit(out, base, len, CMP_TOKEN_COMMENT);
+    return SH_STATE_NORMAL;
+  }
+
+  /* List markers */
+  while (i < len && (s[i] == ' ' || s[i] == '\t'))
+    i++;
+  if (i + 1 < len && (s[i] == '-' || s[i] == '*' || s[i] == '+') &&
+      s[i + 1] == ' ') {
+    sh_emit(out, base + i, 1, CMP_TOKEN_OPERATOR);
+    i += 2;
+  } else {
+    for (j = i; j < len && isdigit((unsigned char)s[j]); ++j) {
+    }
+    if (j > i && j + 1 < len && (s[j] == '.' || s[j] == ')') &&
+        s[j + 1] == ' ') {
+      sh_emit(out, base + i, j + 1 - i, CMP_TOKEN_OPERATOR);
+      i = j + 2;
+    }
+  }
+
+  /* Inline code spans and links */
+  while (i < len) {
+    if (s[i] == '`') {
+      size_t start = i, ticks, k;
+      for (j = i; j < len && s[j] == '`'; ++j) {
+      }
+      ticks = j - i;
+      for (k = j; k < len; ++k) {
+        size_t run = 0;
+        while (k + run < len && s[k + run] == '`')
+          run++;
+        if (run == ticks)
+          break;
+        k += run;
+      }
+      if (k < len) {
+        sh_emit(out, base + start, k + ticks - start, CMP_TOKEN_STRING);
+        i = k + ticks;
+      } else {
+        i = j;
+      }
+    } else if (s[i] == '[') {
+      size_t close;
+      for (close = i + 1; close < len && s[close] != ']'; ++close) {
+      }
+      if (close + 1 < len && s[close + 1] == '(') {
+        for (j = close + 2; j < len && s[j] != ')'; ++j) {
+        }
+        if (j < len) {
+          sh_emit(out, base + i, j + 1 - i, CMP_TOKEN_FUNCTION);
+          i = j + 1;
+          continue;
+        }
+      }
+      i++;
+    } else {
+      i++;
+    }
+  }
+  return SH_STATE_NORMAL;
+}
+
+static int sh_lex_line(const sh_grammar_t *g, const char *s, size_t len,
+                       size_t base, int state, sh_spans_t *out) {
+  if (g->markdown)
+    return sh_lex_markdown(s, len, base, state, out);
+  return sh_lex_generic(g, s, len, base, state, out);
+}
+
+/* ------------------------------------------------------------------------ */
+/* One-shot API                                                              */
+/* ------------------------------------------------------------------------ */
+
 struct cmp_syntax_highlighter {
   int is_initialized;
 };
@@ -16,8 +384,8 @@ int cmp_syntax_highlighter_create(cmp_syntax_highlighter_t **out_hl) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  hl = (cmp_syntax_highlighter_t *)malloc(sizeof(cmp_syntax_highlighter_t));
-  if (!hl) {
+  if (CMP_MALLOC(sizeof(cmp_syntax_highlighter_t), (void **)&hl) !=
+      CMP_SUCCESS) {
     return CMP_ERROR_OOM;
   }
 
@@ -31,7 +399,7 @@ int cmp_syntax_highlighter_destroy(cmp_syntax_highlighter_t *hl) {
   if (!hl) {
     return CMP_ERROR_INVALID_ARG;
   }
-  free(hl);
+  CMP_FREE(hl);
   return CMP_SUCCESS;
 }
 
@@ -39,73 +407,318 @@ int cmp_syntax_highlighter_parse(cmp_syntax_highlighter_t *hl,
                                  const char *source_code, const char *language,
                                  cmp_highlight_span_t **out_spans,
                                  size_t *out_count) {
-  cmp_highlight_span_t *spans;
-  size_t capacity;
-  size_t count;
-  size_t i;
-  size_t len;
+  const sh_grammar_t *g;
+  sh_spans_t spans;
+  size_t line_start = 0;
+  int state = SH_STATE_NORMAL;
 
   if (!hl || !source_code || !out_spans || !out_count) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  /* Dummy language ignore */
-  (void)language;
+  g = sh_find_grammar(language);
+  memset(&spans, 0, sizeof(spans));
+  for (;;) {
+    const char *nl = strchr(source_code + line_start, '\n');
+    size_t line_len = nl ? (size_t)(nl - (source_code + line_start))
+                         : strlen(source_code + line_start);
+    state = sh_lex_line(g, source_code + line_start, line_len, line_start,
+                        state, &spans);
+    if (!nl)
+      break;
+    line_start += line_len + 1;
+  }
+
+  if (spans.failed) {
+    if (spans.items)
+      CMP_FREE(spans.items);
+    return CMP_ERROR_OOM;
+  }
+  if (!spans.items &&
+      CMP_MALLOC(sizeof(cmp_highlight_span_t), (void **)&spans.items) !=
+          CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+
+  *out_spans = spans.items;
+  *out_count = spans.count;
+  return CMP_SUCCESS;
+}
+
+int cmp_syntax_highlighter_free_spans(cmp_highlight_span_t *spans) {
+  if (spans) {
+    CMP_FREE(spans);
+  }
+  return CMP_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Incremental documents                                                     */
+/* ------------------------------------------------------------------------ */
 
-  len = strlen(source_code);
-  capacity = 16;
-  count = 0;
-  spans =
-      (cmp_highlight_span_t *)malloc(capacity * sizeof(cmp_highlight_span_t));
+struct cmp_syntax_document {
+  const cmp_text_buffer_t *buffer;
+  const sh_grammar_t *grammar;
 
-  if (!spans) {
+  unsigned char *states; /* Start state of each line */
+  size_t line_count;
+  size_t states_cap;
+  size_t valid; /* Lines [0, valid] have correct start states */
+  size_t known; /* Lines [0, known] had correct states before recent edits */
+  size_t dirty_end; /* First line after the edited region */
+
+  char *line_buf;
+  size_t line_cap;
+  sh_spans_t spans;
+  size_t lines_lexed;
+};
+
+static int sh_doc_resize(struct cmp_syntax_document *doc, size_t lines) {
+  unsigned char *states;
+  size_t cap;
+  if (lines <= doc->states_cap)
+    return CMP_SUCCESS;
+  cap = doc->states_cap ? doc->states_cap : 256;
+  while (cap < lines)
+    cap *= 2;
+  if (CMP_MALLOC(cap, (void **)&states) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  if (doc->line_count)
+    memcpy(states, doc->states, doc->line_count);
+  if (doc->states)
+    CMP_FREE(doc->states);
+  doc->states = states;
+  doc->states_cap = cap;
+  return CMP_SUCCESS;
+}
+
+/* Forgets all cached states, e.g. when the buffer was replaced wholesale. */
+static int sh_doc_reset(struct cmp_syntax_document *doc) {
+  size_t lines;
+  cmp_text_buffer_get_line_count(doc->buffer, &lines);
+  if (sh_doc_resize(doc, lines) != CMP_SUCCESS)
     return CMP_ERROR_OOM;
+  doc->line_count = lines;
+  doc->states[0] = SH_STATE_NORMAL;
+  doc->valid = 0;
+  doc->known = 0;
+  doc->dirty_end = 0;
+  return CMP_SUCCESS;
+}
+
+/* Reads line (without its newline) into the scratch buffer. */
+static int sh_doc_read_line(struct cmp_syntax_document *doc, size_t line,
+                            size_t *out_offset, size_t *out_len) {
+  size_t start, off, len = 0;
+  const char *chunk;
+  size_t chunk_len;
+
+  cmp_text_buffer_line_to_offset(doc->buffer, line, &start);
+  off = start;
+  while (cmp_text_buffer_get_chunk(doc->buffer, off, &chunk, &chunk_len) ==
+         CMP_SUCCESS) {
+    const char *nl = (const char *)memchr(chunk, '\n', chunk_len);
+    size_t take = nl ? (size_t)(nl - chunk) : chunk_len;
+    if (len + take > doc->line_cap) {
+      char *buf;
+      size_t cap = doc->line_cap ? doc->line_cap : 256;
+      while (cap < len + take)
+        cap *= 2;
+      if (CMP_MALLOC(cap, (void **)&buf) != CMP_SUCCESS)
+        return CMP_ERROR_OOM;
+      if (len)
+        memcpy(buf, doc->line_buf, len);
+      if (doc->line_buf)
+        CMP_FREE(doc->line_buf);
+      doc->line_buf = buf;
+      doc->line_cap = cap;
+    }
+    if (take)
+      memcpy(doc->line_buf + len, chunk, take);
+    len += take;
+    if (nl)
+      break;
+    off += chunk_len;
   }
+  *out_offset = start;
+  *out_len = len;
+  return CMP_SUCCESS;
+}
 
-  /* Naive lexer stub for basic string testing.
-     A real integration bridges to Tree-sitter here. */
-  for (i = 0; i < len; i++) {
-    if (source_code[i] == '"') {
-      size_t start = i;
-      i++;
-      while (i < len && source_code[i] != '"') {
-        i++;
-      }
-      if (count >= capacity) {
-        capacity *= 2;
-        spans = (cmp_highlight_span_t *)realloc(
-            spans, capacity * sizeof(cmp_highlight_span_t));
-      }
-      spans[count].start_offset = start;
-      spans[count].length = (i - start) + 1;
-      spans[count].type = CMP_TOKEN_STRING;
-      count++;
-    } else if (isdigit((unsigned char)source_code[i])) {
-      size_t start = i;
-      while (i < len && isdigit((unsigned char)source_code[i])) {
-        i++;
-      }
-      if (count >= capacity) {
-        capacity *= 2;
-        spans = (cmp_highlight_span_t *)realloc(
-            spans, capacity * sizeof(cmp_highlight_span_t));
-      }
-      spans[count].start_offset = start;
-      spans[count].length = (i - start);
-      spans[count].type = CMP_TOKEN_NUMBER;
-      count++;
-      i--; /* Backtrack one */
+/* Makes the start states of lines [0, line] correct, lexing forward from
+ * the first unverified line. Stops early once the state flowing out of the
+ * edited region agrees with what was cached before the edit. */
+static int sh_doc_settle(struct cmp_syntax_document *doc, size_t line) {
+  while (doc->valid < line) {
+    size_t i = doc->valid, offset, len;
+    int next;
+    if (sh_doc_read_line(doc, i, &offset, &len) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    next = sh_lex_line(doc->grammar, doc->line_buf, len, offset,
+                       doc->states[i], NULL);
+    doc->lines_lexed++;
+    if (i + 1 >= doc->dirty_end && i + 1 <= doc->known &&
+        doc->states[i + 1] == next) {
+      doc->valid = doc->known;
+      doc->dirty_end = 0;
+      continue;
     }
+    doc->states[i + 1] = (unsigned char)next;
+    doc->valid = i + 1;
+    if (doc->valid > doc->known)
+      doc->known = doc->valid;
   }
+  return CMP_SUCCESS;
+}
 
-  *out_spans = spans;
-  *out_count = count;
+int cmp_syntax_document_create(const cmp_text_buffer_t *buffer,
+                               const char *language,
+                               cmp_syntax_document_t **out_doc) {
+  struct cmp_syntax_document *doc;
+  if (!buffer || !out_doc)
+    return CMP_ERROR_INVALID_ARG;
+  if (CMP_MALLOC(sizeof(struct cmp_syntax_document), (void **)&doc) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(doc, 0, sizeof(struct cmp_syntax_document));
+  doc->buffer = buffer;
+  doc->grammar = sh_find_grammar(language);
+  if (sh_doc_reset(doc) != CMP_SUCCESS) {
+    CMP_FREE(doc);
+    return CMP_ERROR_OOM;
+  }
+  *out_doc = (cmp_syntax_document_t *)doc;
   return CMP_SUCCESS;
 }
 
-int cmp_syntax_highlighter_free_spans(cmp_highlight_span_t *spans) {
-  if (spans) {
-    free(spans);
+int cmp_syntax_document_destroy(cmp_syntax_document_t *doc_opaque) {
+  struct cmp_syntax_document *doc = (struct cmp_syntax_document *)doc_opaque;
+  if (!doc)
+    return CMP_ERROR_INVALID_ARG;
+  if (doc->states)
+    CMP_FREE(doc->states);
+  if (doc->line_buf)
+    CMP_FREE(doc->line_buf);
+  if (doc->spans.items)
+    CMP_FREE(doc->spans.items);
+  CMP_FREE(doc);
+  return CMP_SUCCESS;
+}
+
+int cmp_syntax_document_edit(cmp_syntax_document_t *doc_opaque,
+                             size_t start_line, size_t old_end_line,
+                             size_t new_end_line) {
+  struct cmp_syntax_document *doc = (struct cmp_syntax_document *)doc_opaque;
+  size_t lines, tail;
+  if (!doc || old_end_line < start_line || new_end_line < start_line)
+    return CMP_ERROR_INVALID_ARG;
+
+  cmp_text_buffer_get_line_count(doc->buffer, &lines);
+  if (old_end_line >= doc->line_count ||
+      lines != doc->line_count - old_end_line + new_end_line) {
+    /* The edit does not describe the buffer; start over */
+    return sh_doc_reset(doc);
   }
+  if (sh_doc_resize(doc, lines) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+
+  /* Lines after the edit keep their cached states, shifted into place */
+  tail = doc->line_count - old_end_line - 1;
+  if (new_end_line != old_end_line && tail > 0)
+    memmove(doc->states + new_end_line + 1, doc->states + old_end_line + 1,
+            tail);
+  doc->line_count = lines;
+
+  if (doc->known > old_end_line)
+    doc->known = doc->known - old_end_line + new_end_line;
+  else if (doc->known > start_line)
+    doc->known = start_line;
+  if (doc->dirty_end > old_end_line)
+    doc->dirty_end = doc->dirty_end - old_end_line + new_end_line;
+  if (doc->dirty_end < new_end_line + 1)
+    doc->dirty_end = new_end_line + 1;
+  if (doc->valid > start_line)
+    doc->valid = start_line;
+  return CMP_SUCCESS;
+}
+
+int cmp_syntax_document_invalidate(cmp_syntax_document_t *doc_opaque) {
+  struct cmp_syntax_document *doc = (struct cmp_syntax_document *)doc_opaque;
+  if (!doc)
+    return CMP_ERROR_INVALID_ARG;
+  return sh_doc_reset(doc);
+}
+
+int cmp_syntax_document_highlight(cmp_syntax_document_t *doc_opaque,
+                                  size_t first_line, size_t line_count,
+                                  const cmp_highlight_span_t **out_spans,
+                                  size_t *out_count) {
+  struct cmp_syntax_document *doc = (struct cmp_syntax_document *)doc_opaque;
+  size_t line, end;
+  if (!doc || !out_spans || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  if (first_line >= doc->line_count)
+    return CMP_ERROR_BOUNDS;
+
+  end = doc->line_count - first_line < line_count ? doc->line_count
+                                                  : first_line + line_count;
+  if (sh_doc_settle(doc, first_line) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+
+  doc->spans.count = 0;
+  doc->spans.failed = 0;
+  for (line = first_line; line < end; ++line) {
+    size_t offset, len;
+    int next;
+    if (sh_doc_read_line(doc, line, &offset, &len) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    next = sh_lex_line(doc->grammar, doc->line_buf, len, offset,
+                       doc->states[line], &doc->spans);
+    doc->lines_lexed++;
+    /* Visible lines also advance the cache */
+    if (line + 1 < doc->line_count && doc->valid == line) {
+      if (line + 1 >= doc->dirty_end && line + 1 <= doc->known &&
+          doc->states[line + 1] == next) {
+        doc->valid = doc->known;
+        doc->dirty_end = 0;
+      } else {
+        doc->states[line + 1] = (unsigned char)next;
+        doc->valid = line + 1;
+        if (doc->valid > doc->known)
+          doc->known = doc->valid;
+      }
+    }
+  }
+  if (doc->spans.failed)
+    return CMP_ERROR_OOM;
+
+  *out_spans = doc->spans.items;
+  *out_count = doc->spans.count;
+  return CMP_SUCCESS;
+}
+
+int cmp_syntax_document_advance(cmp_syntax_document_t *doc_opaque,
+                                size_t max_lines, int *out_done) {
+  struct cmp_syntax_document *doc = (struct cmp_syntax_document *)doc_opaque;
+  size_t target;
+  int res;
+  if (!doc)
+    return CMP_ERROR_INVALID_ARG;
+  target = doc->line_count - 1;
+  if (target - doc->valid > max_lines)
+    target = doc->valid + max_lines;
+  res = sh_doc_settle(doc, target);
+  if (out_done)
+    *out_done = doc->valid >= doc->line_count - 1;
+  return res;
+}
+
+int cmp_syntax_document_get_lexed_line_count(
+    const cmp_syntax_document_t *doc_opaque, size_t *out_count) {
+  const struct cmp_syntax_document *doc =
+      (const struct cmp_syntax_document *)doc_opaque;
+  if (!doc || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  *out_count = doc->lines_lexed;
   return CMP_SUCCESS;
 }
@@ -0,0 +1,1226 @@
+/* clang-format off */
+#include "cmp.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* clang-format on */
+
+/* A VT500-series parser after Paul Williams' state diagram, driving a
+ * cell grid. The visible screen is a ring of rows so a full-screen scroll
+ * is a pointer bump; rows leaving the top are compressed into scrollback
+ * blocks. Each visible row carries a damage flag, and full-screen scrolls
+ * are counted separately so a renderer can blit instead of repainting. */
+
+enum {
+  VT_GROUND,
+  VT_ESCAPE,
+  VT_ESCAPE_INTERMEDIATE,
+  VT_CSI_ENTRY,
+  VT_CSI_PARAM,
+  VT_CSI_INTERMEDIATE,
+  VT_CSI_IGNORE,
+  VT_DCS_ENTRY,
+  VT_DCS_PARAM,
+  VT_DCS_INTERMEDIATE,
+  VT_DCS_PASSTHROUGH,
+  VT_DCS_IGNORE,
+  VT_OSC_STRING,
+  VT_SOS_PM_APC_STRING,
+  VT_STATE_COUNT
+};
+
+/* Table entries pack the action in the low nibble, next state above it. */
+enum {
+  VT_ACT_NONE,
+  VT_ACT_PRINT,
+  VT_ACT_EXECUTE,
+  VT_ACT_CLEAR,
+  VT_ACT_COLLECT,
+  VT_ACT_PARAM,
+  VT_ACT_ESC_DISPATCH,
+  VT_ACT_CSI_DISPATCH
+};
+
+#define VT_MAX_PARAMS 16
+#define VT_BLOCK_SIZE 65536
+#define VT_STYLE_MARK 0x01 /* Followed by fg, bg (4 bytes) and attrs (2) */
+#define VT_EMPTY_MARK 0x02 /* An empty cell */
+
+typedef struct vt_block {
+  struct vt_block *next;
+  size_t used;
+  size_t capacity;
+  size_t live_lines;
+} vt_block_t;
+
+typedef struct vt_line {
+  vt_block_t *block;
+  size_t offset;
+  size_t length;
+} vt_line_t;
+
+typedef struct vt_cursor {
+  size_t x, y;
+  cmp_term_cell_t pen;
+} vt_cursor_t;
+
+struct cmp_term {
+  size_t cols, rows;
+  cmp_term_cell_t *cells; /* rows * cols, indexed by physical row */
+  unsigned char *dirty; /* Per physical row */
+  size_t *extent;       /* Per physical row; cells past it are blank */
+  size_t top;           /* Physical index of screen row 0 */
+  size_t scrolled;      /* Full-screen scrolls since the last take */
+
+  vt_cursor_t cursor, saved;
+  int pending_wrap;
+  int autowrap;
+  int cursor_visible;
+  size_t margin_top, margin_bottom;
+
+  unsigned char table[VT_STATE_COUNT][128];
+  int state;
+  unsigned long params[VT_MAX_PARAMS];
+  size_t param_count;
+  char marker;       /* Private parameter marker, e.g. '?' */
+  char intermediate; /* Last intermediate byte */
+  unsigned long utf8_cp;
+  int utf8_left;
+
+  vt_line_t *lines; /* Scrollback ring, oldest at line_head */
+  size_t line_head, line_count, line_capacity, line_limit;
+  vt_block_t *first_block, *last_block;
+  unsigned char *scratch;
+
+  char response[64];
+  size_t response_len;
+};
+
+static void table_set(cmp_term_t *vt, int state, int lo, int hi, int action,
+                      int next) {
+  int c;
+  for (c = lo; c <= hi; ++c) {
+    vt->table[state][c] = (unsigned char)(action | (next << 4));
+  }
+}
+
+/* C0 controls other than CAN, SUB and ESC, which are handled anywhere. */
+static void table_c0(cmp_term_t *vt, int state, int action) {
+  table_set(vt, state, 0x00, 0x17, action, state);
+  table_set(vt, state, 0x19, 0x19, action, state);
+  table_set(vt, state, 0x1C, 0x1F, action, state);
+}
+
+static void build_table(cmp_term_t *vt) {
+  int s;
+  memset(vt->table, 0, sizeof(vt->table));
+  for (s = 0; s < VT_STATE_COUNT; ++s) {
+    table_set(vt, s, 0x00, 0x7F, VT_ACT_NONE, s);
+  }
+
+  table_c0(vt, VT_GROUND, VT_ACT_EXECUTE);
+  table_set(vt, VT_GROUND, 0x20, 0x7E, VT_ACT_PRINT, VT_GROUND);
+
+  table_c0(vt, VT_ESCAPE, VT_ACT_EXECUTE);
+  table_set(vt, VT_ESCAPE, 0x20, 0x2F, VT_ACT_COLLECT, VT_ESCAPE_INTERMEDIATE);
+  table_set(vt, VT_ESCAPE, 0x30, 0x7E, VT_ACT_ESC_DISPATCH, VT_GROUND);
+  table_set(vt, VT_ESCAPE, 0x50, 0x50, VT_ACT_CLEAR, VT_DCS_ENTRY);
+  table_set(vt, VT_ESCAPE, 0x58, 0x58, VT_ACT_NONE, VT_SOS_PM_APC_STRING);
+  table_set(vt, VT_ESCAPE, 0x5B, 0x5B, VT_ACT_CLEAR, VT_CSI_ENTRY);
+  table_set(vt, VT_ESCAPE, 0x5D, 0x5D, VT_ACT_NONE, VT_OSC_STRING);
+  table_set(vt, VT_ESCAPE, 0x5E, 0x5F, VT_ACT_NONE, VT_SOS_PM_APC_STRING);
+
+  table_c0(vt, VT_ESCAPE_INTERMEDIATE, VT_ACT_EXECUTE);
+  table_set(vt, VT_ESCAPE_INTERMEDIATE, 0x20, 0x2F, VT_ACT_COLLECT,
+            VT_ESCAPE_INTERMEDIATE);
+  table_set(vt, VT_ESCAPE_INTERMEDIATE, 0x30, 0x7E, VT_ACT_ESC_DISPATCH,
+            VT_GROUND);
+
+  table_c0(vt, VT_CSI_ENTRY, VT_ACT_EXECUTE);
+  table_set(vt, VT_CSI_ENTRY, 0x20, 0x2F, VT_ACT_COLLECT,
+            VT_CSI_INTERMEDIATE);
+  table_set(vt, VT_CSI_ENTRY, 0x30, 0x39, VT_ACT_PARAM, VT_CSI_PARAM);
+  table_set(vt, VT_CSI_ENTRY, 0x3A, 0x3A, VT_ACT_NONE, VT_CSI_IGNORE);
+  table_set(vt, VT_CSI_ENTRY, 0x3B, 0x3B, VT_ACT_PARAM, VT_CSI_PARAM);
+  table_set(vt, VT_CSI_ENTRY, 0x3C, 0x3F, VT_ACT_COLLECT, VT_CSI_PARAM);
+  table_set(vt, VT_CSI_ENTRY, 0x40, 0x7E, VT_ACT_CSI_DISPATCH, VT_GROUND);
+
+  table_c0(vt, VT_CSI_PARAM, VT_ACT_EXECUTE);
+  table_set(vt, VT_CSI_PARAM, 0x20, 0x2F, VT_ACT_COLLECT,
+            VT_CSI_INTERMEDIATE);
+  table_set(vt, VT_CSI_PARAM, 0x30, 0x39, VT_ACT_PARAM, VT_CSI_PARAM);
+  table_set(vt, VT_CSI_PARAM, 0x3A, 0x3A, VT_ACT_NONE, VT_CSI_IGNORE);
+  table_set(vt, VT_CSI_PARAM, 0x3B, 0x3B, VT_ACT_PARAM, VT_CSI_PARAM);
+  table_set(vt, VT_CSI_PARAM, 0x3C, 0x3F, VT_ACT_NONE, VT_CSI_IGNORE);
+  table_set(vt, VT_CSI_PARAM, 0x40, 0x7E, VT_ACT_CSI_DISPATCH, VT_GROUND);
+
+  table_c0(vt, VT_CSI_INTERMEDIATE, VT_ACT_EXECUTE);
+  table_set(vt, VT_CSI_INTERMEDIATE, 0x20, 0x2F, VT_ACT_COLLECT,
+            VT_CSI_INTERMEDIATE);
+  table_set(vt, VT_CSI_INTERMEDIATE, 0x30, 0x3F, VT_ACT_NONE, VT_CSI_IGNORE);
+  table_set(vt, VT_CSI_INTERMEDIATE, 0x40, 0x7E, VT_ACT_CSI_DISPATCH,
+            VT_GROUND);
+
+  table_c0(vt, VT_CSI_IGNORE, VT_ACT_EXECUTE);
+  table_set(vt, VT_CSI_IGNORE, 0x40, 0x7E, VT_ACT_NONE, VT_GROUND);
+
+  /* Device control strings are recognised so they can be skipped */
+  table_set(vt, VT_DCS_ENTRY, 0x20, 0x2F, VT_ACT_NONE, VT_DCS_INTERMEDIATE);
+  table_set(vt, VT_DCS_ENTRY, 0x30, 0x39, VT_ACT_NONE, VT_DCS_PARAM);
+  table_set(vt, VT_DCS_ENTRY, 0x3A, 0x3A, VT_ACT_NONE, VT_DCS_IGNORE);
+  table_set(vt, VT_DCS_ENTRY, 0x3B, 0x3F, VT_ACT_NONE, VT_DCS_PARAM);
+  table_set(vt, VT_DCS_ENTRY, 0x40, 0x7E, VT_ACT_NONE, VT_DCS_PASSTHROUGH);
+  table_set(vt, VT_DCS_PARAM, 0x20, 0x2F, VT_ACT_NONE, VT_DCS_INTERMEDIATE);
+  table_set(vt, VT_DCS_PARAM, 0x3A, 0x3A, VT_ACT_NONE, VT_DCS_IGNORE);
+  table_set(vt, VT_DCS_PARAM, 0x3C, 0x3F, VT_ACT_NONE, VT_DCS_IGNORE);
+  table_set(vt, VT_DCS_PARAM, 0x40, 0x7E, VT_ACT_NONE, VT_DCS_PASSTHROUGH);
+  table_set(vt, VT_DCS_INTERMEDIATE, 0x30, 0x3F, VT_ACT_NONE, VT_DCS_IGNORE);
+  table_set(vt, VT_DCS_INTERMEDIATE, 0x40, 0x7E, VT_ACT_NONE,
+            VT_DCS_PASSTHROUGH);
+
+  /* xterm also ends an OSC string with BEL */
+  table_set(vt, VT_OSC_STRING, 0x07, 0x07, VT_ACT_NONE, VT_GROUND);
+
+  for (s = 0; s < VT_STATE_COUNT; ++s) {
+    table_set(vt, s, 0x18, 0x18, VT_ACT_EXECUTE, VT_GROUND);
+    table_set(vt, s, 0x1A, 0x1A, VT_ACT_EXECUTE, VT_GROUND);
+    table_set(vt, s, 0x1B, 0x1B, VT_ACT_CLEAR, VT_ESCAPE);
+  }
+}
+
+static cmp_term_cell_t *vt_row(cmp_term_t *vt, size_t row) {
+  return vt->cells + ((vt->top + row) % vt->rows) * vt->cols;
+}
+
+static void mark_dirty(cmp_term_t *vt, size_t row) {
+  vt->dirty[(vt->top + row) % vt->rows] = 1;
+}
+
+static size_t *row_extent(cmp_term_t *vt, size_t row) {
+  return &vt->extent[(vt->top + row) % vt->rows];
+}
+
+static void grow_extent(cmp_term_t *vt, size_t row, size_t end) {
+  size_t *extent = row_extent(vt, row);
+  if (*extent < end) {
+    *extent = end;
+  }
+}
+
+/* Blanks count cells of a row from column from. Erased cells keep the
+ * pen's background, as xterm does; with the default background only the
+ * written part of the row needs touching. */
+static void clear_span(cmp_term_t *vt, size_t row, size_t from,
+                       size_t count) {
+  cmp_term_cell_t *cells = vt_row(vt, row);
+  size_t *extent = row_extent(vt, row);
+  size_t end = from + count, i;
+  if (vt->cursor.pen.bg == CMP_TERM_COLOR_DEFAULT) {
+    if (end >= *extent) {
+      end = *extent;
+      if (from < *extent) {
+        *extent = from;
+      }
+    }
+  } else if (*extent < end) {
+    *extent = end;
+  }
+  for (i = from; i < end; ++i) {
+    cells[i].codepoint = 0;
+    cells[i].fg = CMP_TERM_COLOR_DEFAULT;
+    cells[i].bg = vt->cursor.pen.bg;
+    cells[i].attrs = 0;
+  }
+}
+
+static void copy_row(cmp_term_t *vt, size_t dst, size_t src) {
+  size_t *dst_extent = row_extent(vt, dst), *src_extent = row_extent(vt, src);
+  size_t n = *dst_extent > *src_extent ? *dst_extent : *src_extent;
+  memcpy(vt_row(vt, dst), vt_row(vt, src), n * sizeof(cmp_term_cell_t));
+  *dst_extent = *src_extent;
+}
+
+static void put_u32(unsigned char *p, unsigned long v) {
+  p[0] = (unsigned char)(v & 0xFF);
+  p[1] = (unsigned char)((v >> 8) & 0xFF);
+  p[2] = (unsigned char)((v >> 16) & 0xFF);
+  p[3] = (unsigned char)((v >> 24) & 0xFF);
+}
+
+static unsigned long get_u32(const unsigned char *p) {
+  return (unsigned long)p[0] | ((unsigned long)p[1] << 8) |
+         ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static size_t encode_utf8(unsigned long cp, unsigned char *out) {
+  if (cp < 0x80) {
+    out[0] = (unsigned char)cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = (unsigned char)(0xC0 | (cp >> 6));
+    out[1] = (unsigned char)(0x80 | (cp & 0x3F));
+    return 2;
+  }
+  if (cp < 0x10000) {
+    out[0] = (unsigned char)(0xE0 | (cp >> 12));
+    out[1] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+    out[2] = (unsigned char)(0x80 | (cp & 0x3F));
+    return 3;
+  }
+  out[0] = (unsigned char)(0xF0 | (cp >> 18));
+  out[1] = (unsigned char)(0x80 | ((cp >> 12) & 0x3F));
+  out[2] = (unsigned char)(0x80 | ((cp >> 6) & 0x3F));
+  out[3] = (unsigned char)(0x80 | (cp & 0x3F));
+  return 4;
+}
+
+/* Encodes a row as UTF-8 text with inline style changes, dropping the
+ * trailing run of blank default cells. */
+static size_t compress_row(const cmp_term_cell_t *cells, size_t n,
+                           unsigned char *out) {
+  size_t i, len = 0;
+  unsigned long fg = CMP_TERM_COLOR_DEFAULT, bg = CMP_TERM_COLOR_DEFAULT;
+  unsigned int attrs = 0;
+  while (n > 0 && cells[n - 1].codepoint == 0 &&
+         cells[n - 1].bg == CMP_TERM_COLOR_DEFAULT && cells[n - 1].attrs == 0) {
+    n--;
+  }
+  for (i = 0; i < n; ++i) {
+    const cmp_term_cell_t *c = &cells[i];
+    if (c->fg != fg || c->bg != bg || c->attrs != attrs) {
+      fg = c->fg;
+      bg = c->bg;
+      attrs = c->attrs;
+      out[len++] = VT_STYLE_MARK;
+      put_u32(out + len, fg);
+      put_u32(out + len + 4, bg);
+      out[len + 8] = (unsigned char)(attrs & 0xFF);
+      out[len + 9] = (unsigned char)((attrs >> 8) & 0xFF);
+      len += 10;
+    }
+    if (c->codepoint == 0) {
+      out[len++] = VT_EMPTY_MARK;
+    } else if (c->codepoint < 0x80) {
+      out[len++] = (unsigned char)c->codepoint;
+    } else {
+      len += encode_utf8(c->codepoint, out + len);
+    }
+  }
+  return len;
+}
+
+static void drop_oldest_line(cmp_term_t *vt) {
+  vt_line_t *line = &vt->lines[vt->line_head];
+  line->block->live_lines--;
+  vt->line_head = (vt->line_head + 1) % vt->line_capacity;
+  vt->line_count--;
+  while (vt->first_block != vt->last_block &&
+         vt->first_block->live_lines == 0) {
+    vt_block_t *block = vt->first_block;
+    vt->first_block = block->next;
+    CMP_FREE(block);
+  }
+}
+
+static int grow_lines(cmp_term_t *vt) {
+  size_t cap = vt->line_capacity ? vt->line_capacity * 2 : 256, i;
+  vt_line_t *lines;
+  if (cap > vt->line_limit) {
+    cap = vt->line_limit;
+  }
+  if (CMP_MALLOC(cap * sizeof(vt_line_t), (void **)&lines) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  for (i = 0; i < vt->line_count; ++i) {
+    lines[i] = vt->lines[(vt->line_head + i) % vt->line_capacity];
+  }
+  if (vt->lines) {
+    CMP_FREE(vt->lines);
+  }
+  vt->lines = lines;
+  vt->line_head = 0;
+  vt->line_capacity = cap;
+  return CMP_SUCCESS;
+}
+
+/* Moves a row into scrollback. Out of memory only costs history. */
+static void push_scrollback(cmp_term_t *vt, size_t row) {
+  size_t len;
+  vt_block_t *block = vt->last_block;
+  vt_line_t *line;
+
+  if (vt->line_limit == 0) {
+    return;
+  }
+  if (vt->line_count == vt->line_limit) {
+    drop_oldest_line(vt);
+  } else if (vt->line_count == vt->line_capacity &&
+             grow_lines(vt) != CMP_SUCCESS) {
+    return;
+  }
+
+  len = compress_row(vt_row(vt, row), *row_extent(vt, row), vt->scratch);
+  if (!block || block->capacity - block->used < len) {
+    size_t cap = len > VT_BLOCK_SIZE ? len : VT_BLOCK_SIZE;
+    if (block && block->live_lines == 0) {
+      /* Only the current block can be empty; reuse it if it fits */
+      if (block->capacity >= len) {
+        block->used = 0;
+        cap = 0;
+      }
+    }
+    if (cap != 0) {
+      if (CMP_MALLOC(sizeof(vt_block_t) + cap, (void **)&block) !=
+          CMP_SUCCESS) {
+        return;
+      }
+      block->next = NULL;
+      block->used = 0;
+      block->capacity = cap;
+      block->live_lines = 0;
+      if (vt->last_block) {
+        vt->last_block->next = block;
+      } else {
+        vt->first_block = block;
+      }
+      vt->last_block = block;
+      while (vt->first_block != block && vt->first_block->live_lines == 0) {
+        vt_block_t *old = vt->first_block;
+        vt->first_block = old->next;
+        CMP_FREE(old);
+      }
+    }
+  }
+
+  line = &vt->lines[(vt->line_head + vt->line_count) % vt->line_capacity];
+  line->block = block;
+  line->offset = block->used;
+  line->length = len;
+  memcpy((unsigned char *)(block + 1) + block->used, vt->scratch, len);
+  block->used += len;
+  block->live_lines++;
+  vt->line_count++;
+}
+
+static void scroll_up(cmp_term_t *vt, size_t top, size_t bottom, size_t n,
+                      int to_scrollback) {
+  size_t r;
+  if (n > bottom - top + 1) {
+    n = bottom - top + 1;
+  }
+  if (top == 0 && bottom == vt->rows - 1) {
+    /* Whole screen: rotate the ring */
+    for (r = 0; r < n; ++r) {
+      if (to_scrollback) {
+        push_scrollback(vt, 0);
+      }
+      clear_span(vt, 0, 0, vt->cols);
+      vt->top = (vt->top + 1) % vt->rows;
+      mark_dirty(vt, vt->rows - 1);
+    }
+    vt->scrolled += n;
+    return;
+  }
+  for (r = top; r + n <= bottom; ++r) {
+    copy_row(vt, r, r + n);
+    mark_dirty(vt, r);
+  }
+  for (r = bottom + 1 - n; r <= bottom; ++r) {
+    clear_span(vt, r, 0, vt->cols);
+    mark_dirty(vt, r);
+  }
+}
+
+static void scroll_down(cmp_term_t *vt, size_t top, size_t bottom, size_t n) {
+  size_t r;
+  if (n > bottom - top + 1) {
+    n = bottom - top + 1;
+  }
+  for (r = bottom; r >= top + n; --r) {
+    copy_row(vt, r, r - n);
+    mark_dirty(vt, r);
+  }
+  for (r = top; r < top + n; ++r) {
+    clear_span(vt, r, 0, vt->cols);
+    mark_dirty(vt, r);
+  }
+}
+
+static void linefeed(cmp_term_t *vt) {
+  if (vt->cursor.y == vt->margin_bottom) {
+    scroll_up(vt, vt->margin_top, vt->margin_bottom, 1, 1);
+  } else if (vt->cursor.y + 1 < vt->rows) {
+    vt->cursor.y++;
+  }
+}
+
+static void reverse_index(cmp_term_t *vt) {
+  if (vt->cursor.y == vt->margin_top) {
+    scroll_down(vt, vt->margin_top, vt->margin_bottom, 1);
+  } else if (vt->cursor.y > 0) {
+    vt->cursor.y--;
+  }
+}
+
+static void wrap_if_pending(cmp_term_t *vt) {
+  if (vt->pending_wrap) {
+    vt->pending_wrap = 0;
+    vt->cursor.x = 0;
+    linefeed(vt);
+  }
+}
+
+static void print_cp(cmp_term_t *vt, unsigned long cp) {
+  cmp_term_cell_t *cell;
+  wrap_if_pending(vt);
+  cell = vt_row(vt, vt->cursor.y) + vt->cursor.x;
+  *cell = vt->cursor.pen;
+  cell->codepoint = cp;
+  grow_extent(vt, vt->cursor.y, vt->cursor.x + 1);
+  mark_dirty(vt, vt->cursor.y);
+  if (vt->cursor.x + 1 < vt->cols) {
+    vt->cursor.x++;
+  } else if (vt->autowrap) {
+    vt->pending_wrap = 1;
+  }
+}
+
+/* The common case for build logs: a run of printable ASCII. */
+static void print_ascii(cmp_term_t *vt, const unsigned char *s, size_t len) {
+  while (len > 0) {
+    cmp_term_cell_t *cells;
+    size_t room, n, i;
+    wrap_if_pending(vt);
+    room = vt->cols - vt->cursor.x;
+    n = len < room ? len : room;
+    if (!vt->autowrap && n == room && len > room) {
+      /* Without autowrap the last column keeps being overwritten */
+      n = room - 1;
+      if (n == 0) {
+        print_cp(vt, s[len - 1]);
+        return;
+      }
+    }
+    cells = vt_row(vt, vt->cursor.y) + vt->cursor.x;
+    for (i = 0; i < n; ++i) {
+      cells[i] = vt->cursor.pen;
+      cells[i].codepoint = s[i];
+    }
+    grow_extent(vt, vt->cursor.y, vt->cursor.x + n);
+    mark_dirty(vt, vt->cursor.y);
+    vt->cursor.x += n;
+    if (vt->cursor.x == vt->cols) {
+      vt->cursor.x = vt->cols - 1;
+      vt->pending_wrap = vt->autowrap;
+    }
+    s += n;
+    len -= n;
+  }
+}
+
+static void reset_state(cmp_term_t *vt) {
+  size_t r;
+  memset(&vt->cursor, 0, sizeof(vt->cursor));
+  vt->saved = vt->cursor;
+  vt->pending_wrap = 0;
+  vt->autowrap = 1;
+  vt->cursor_visible = 1;
+  vt->margin_top = 0;
+  vt->margin_bottom = vt->rows - 1;
+  vt->state = VT_GROUND;
+  vt->utf8_left = 0;
+  for (r = 0; r < vt->rows; ++r) {
+    clear_span(vt, r, 0, vt->cols);
+    mark_dirty(vt, r);
+  }
+}
+
+static void respond(cmp_term_t *vt, const char *text) {
+  size_t len = strlen(text);
+  if (vt->response_len + len <= sizeof(vt->response)) {
+    memcpy(vt->response + vt->response_len, text, len);
+    vt->response_len += len;
+  }
+}
+
+static void execute(cmp_term_t *vt, unsigned char c) {
+  switch (c) {
+  case 0x08: /* BS */
+    if (vt->cursor.x > 0) {
+      vt->cursor.x--;
+    }
+    vt->pending_wrap = 0;
+    break;
+  case 0x09: /* HT, fixed stops every eight columns */
+    vt->cursor.x = (vt->cursor.x / 8 + 1) * 8;
+    if (vt->cursor.x >= vt->cols) {
+      vt->cursor.x = vt->cols - 1;
+    }
+    break;
+  case 0x0A: /* LF */
+  case 0x0B: /* VT */
+  case 0x0C: /* FF */
+    vt->pending_wrap = 0;
+    linefeed(vt);
+    break;
+  case 0x0D: /* CR */
+    vt->cursor.x = 0;
+    vt->pending_wrap = 0;
+    break;
+  default:
+    break;
+  }
+}
+
+static void esc_dispatch(cmp_term_t *vt, unsigned char c) {
+  if (vt->intermediate != 0) {
+    return; /* Character set designations and the like */
+  }
+  switch (c) {
+  case '7':
+    vt->saved = vt->cursor;
+    break;
+  case '8':
+    vt->cursor = vt->saved;
+    vt->pending_wrap = 0;
+    break;
+  case 'D':
+    linefeed(vt);
+    break;
+  case 'E':
+    vt->cursor.x = 0;
+    linefeed(vt);
+    break;
+  case 'M':
+    reverse_index(vt);
+    break;
+  case 'c':
+    reset_state(vt);
+    break;
+  default:
+    break;
+  }
+}
+
+static unsigned long param(const cmp_term_t *vt, size_t index,
+                           unsigned long fallback) {
+  if (index >= vt->param_count || vt->params[index] == 0) {
+    return fallback;
+  }
+  return vt->params[index];
+}
+
+static size_t clamp(unsigned long v, size_t max) {
+  return v > (unsigned long)max ? max : (size_t)v;
+}
+
+static unsigned long sgr_color(const cmp_term_t *vt, size_t *i) {
+  unsigned long mode = *i + 1 < vt->param_count ? vt->params[*i + 1] : 0;
+  if (mode == 5 && *i + 2 < vt->param_count) {
+    *i += 2;
+    return CMP_TERM_COLOR_PALETTE | (vt->params[*i] & 0xFF);
+  }
+  if (mode == 2 && *i + 4 < vt->param_count) {
+    unsigned long rgb = ((vt->params[*i + 2] & 0xFF) << 16) |
+                        ((vt->params[*i + 3] & 0xFF) << 8) |
+                        (vt->params[*i + 4] & 0xFF);
+    *i += 4;
+    return CMP_TERM_COLOR_RGB | rgb;
+  }
+  *i = vt->param_count;
+  return CMP_TERM_COLOR_DEFAULT;
+}
+
+static void sgr(cmp_term_t *vt) {
+  cmp_term_cell_t *pen = &vt->cursor.pen;
+  size_t i;
+  if (vt->param_count == 0) {
+    memset(pen, 0, sizeof(*pen));
+    return;
+  }
+  for (i = 0; i < vt->param_count; ++i) {
+    unsigned long p = vt->params[i];
+    if (p == 0) {
+      memset(pen, 0, sizeof(*pen));
+    } else if (p == 1) {
+      pen->attrs |= CMP_TERM_ATTR_BOLD;
+    } else if (p == 2) {
+      pen->attrs |= CMP_TERM_ATTR_DIM;
+    } else if (p == 3) {
+      pen->attrs |= CMP_TERM_ATTR_ITALIC;
+    } else if (p == 4 || p == 21) {
+      pen->attrs |= CMP_TERM_ATTR_UNDERLINE;
+    } else if (p == 5) {
+      pen->attrs |= CMP_TERM_ATTR_BLINK;
+    } else if (p == 7) {
+      pen->attrs |= CMP_TERM_ATTR_INVERSE;
+    } else if (p == 8) {
+      pen->attrs |= CMP_TERM_ATTR_HIDDEN;
+    } else if (p == 9) {
+      pen->attrs |= CMP_TERM_ATTR_STRIKETHROUGH;
+    } else if (p == 22) {
+      pen->attrs &= ~(unsigned int)(CMP_TERM_ATTR_BOLD | CMP_TERM_ATTR_DIM);
+    } else if (p == 23) {
+      pen->attrs &= ~(unsigned int)CMP_TERM_ATTR_ITALIC;
+    } else if (p == 24) {
+      pen->attrs &= ~(unsigned int)CMP_TERM_ATTR_UNDERLINE;
+    } else if (p == 25) {
+      pen->attrs &= ~(unsigned int)CMP_TERM_ATTR_BLINK;
+    } else if (p == 27) {
+      pen->attrs &= ~(unsigned int)CMP_TERM_ATTR_INVERSE;
+    } else if (p == 28) {
+      pen->attrs &= ~(unsigned int)CMP_TERM_ATTR_HIDDEN;
+    } else if (p == 29) {
+      pen->attrs &= ~(unsigned int)CMP_TERM_ATTR_STRIKETHROUGH;
+    } else if (p >= 30 && p <= 37) {
+      pen->fg = CMP_TERM_COLOR_PALETTE | (p - 30);
+    } else if (p == 38) {
+      pen->fg = sgr_color(vt, &i);
+    } else if (p == 39) {
+      pen->fg = CMP_TERM_COLOR_DEFAULT;
+    } else if (p >= 40 && p <= 47) {
+      pen->bg = CMP_TERM_COLOR_PALETTE | (p - 40);
+    } else if (p == 48) {
+      pen->bg = sgr_color(vt, &i);
+    } else if (p == 49) {
+      pen->bg = CMP_TERM_COLOR_DEFAULT;
+    } else if (p >= 90 && p <= 97) {
+      pen->fg = CMP_TERM_COLOR_PALETTE | (p - 90 + 8);
+    } else if (p >= 100 && p <= 107) {
+      pen->bg = CMP_TERM_COLOR_PALETTE | (p - 100 + 8);
+    }
+  }
+}
+
+static void erase_display(cmp_term_t *vt, unsigned long mode) {
+  size_t r, first = 0, last = vt->rows;
+  if (mode == 0) {
+    clear_span(vt, vt->cursor.y, vt->cursor.x, vt->cols - vt->cursor.x);
+    mark_dirty(vt, vt->cursor.y);
+    first = vt->cursor.y + 1;
+  } else if (mode == 1) {
+    clear_span(vt, vt->cursor.y, 0, vt->cursor.x + 1);
+    mark_dirty(vt, vt->cursor.y);
+    last = vt->cursor.y;
+  } else if (mode == 3) {
+    while (vt->line_count > 0) {
+      drop_oldest_line(vt);
+    }
+    return;
+  }
+  for (r = first; r < last; ++r) {
+    clear_span(vt, r, 0, vt->cols);
+    mark_dirty(vt, r);
+  }
+}
+
+static void erase_line(cmp_term_t *vt, unsigned long mode) {
+  if (mode == 0) {
+    clear_span(vt, vt->cursor.y, vt->cursor.x, vt->cols - vt->cursor.x);
+  } else if (mode == 1) {
+    clear_span(vt, vt->cursor.y, 0, vt->cursor.x + 1);
+  } else {
+    clear_span(vt, vt->cursor.y, 0, vt->cols);
+  }
+  mark_dirty(vt, vt->cursor.y);
+}
+
+static void set_mode(cmp_term_t *vt, int on) {
+  size_t i;
+  if (vt->marker != '?') {
+    return;
+  }
+  for (i = 0; i < vt->param_count; ++i) {
+    if (vt->params[i] == 7) {
+      vt->autowrap = on;
+    } else if (vt->params[i] == 25) {
+      vt->cursor_visible = on;
+    }
+  }
+}
+
+static void csi_dispatch(cmp_term_t *vt, unsigned char c) {
+  size_t n = clamp(param(vt, 0, 1), vt->rows > vt->cols ? vt->rows : vt->cols);
+  cmp_term_cell_t *row = vt_row(vt, vt->cursor.y);
+  size_t x = vt->cursor.x, y = vt->cursor.y;
+  char buf[48];
+
+  if (vt->intermediate != 0 || (vt->marker != 0 && c != 'h' && c != 'l')) {
+    return;
+  }
+  vt->pending_wrap = 0;
+  switch (c) {
+  case '@': /* ICH */
+    n = n < vt->cols - x ? n : vt->cols - x;
+    memmove(row + x + n, row + x, (vt->cols - x - n) * sizeof(cmp_term_cell_t));
+    grow_extent(vt, y, clamp(*row_extent(vt, y) + n, vt->cols));
+    clear_span(vt, y, x, n);
+    mark_dirty(vt, y);
+    break;
+  case 'P': /* DCH */
+    n = n < vt->cols - x ? n : vt->cols - x;
+    memmove(row + x, row + x + n, (vt->cols - x - n) * sizeof(cmp_term_cell_t));
+    clear_span(vt, y, vt->cols - n, n);
+    mark_dirty(vt, y);
+    break;
+  case 'X': /* ECH */
+    clear_span(vt, y, x, n < vt->cols - x ? n : vt->cols - x);
+    mark_dirty(vt, y);
+    break;
+  case 'L': /* IL */
+    if (y >= vt->margin_top && y <= vt->margin_bottom) {
+      scroll_down(vt, y, vt->margin_bottom, n);
+      vt->cursor.x = 0;
+    }
+    break;
+  case 'M': /* DL */
+    if (y >= vt->margin_top && y <= vt->margin_bottom) {
+      scroll_up(vt, y, vt->margin_bottom, n, 0);
+      vt->cursor.x = 0;
+    }
+    break;
+  case 'S': /* SU */
+    scroll_up(vt, vt->margin_top, vt->margin_bottom, n, 1);
+    break;
+  case 'T': /* SD */
+    scroll_down(vt, vt->margin_top, vt->margin_bottom, n);
+    break;
+  case 'A': { /* CUU, stopping at the top margin when below it */
+    size_t limit = y >= vt->margin_top ? vt->margin_top : 0;
+    vt->cursor.y = y - limit > n ? y - n : limit;
+    break;
+  }
+  case 'B': /* CUD */
+  case 'e': {
+    size_t limit = y <= vt->margin_bottom ? vt->margin_bottom : vt->rows - 1;
+    vt->cursor.y = limit - y > n ? y + n : limit;
+    break;
+  }
+  case 'C': /* CUF */
+  case 'a':
+    vt->cursor.x = clamp(x + n, vt->cols - 1);
+    break;
+  case 'D': /* CUB */
+    vt->cursor.x = x >= n ? x - n : 0;
+    break;
+  case 'E': /* CNL */
+    vt->cursor.y = clamp(y + n, vt->rows - 1);
+    vt->cursor.x = 0;
+    break;
+  case 'F': /* CPL */
+    vt->cursor.y = y >= n ? y - n : 0;
+    vt->cursor.x = 0;
+    break;
+  case 'G': /* CHA */
+  case '`':
+    vt->cursor.x = clamp(param(vt, 0, 1) - 1, vt->cols - 1);
+    break;
+  case 'd': /* VPA */
+    vt->cursor.y = clamp(param(vt, 0, 1) - 1, vt->rows - 1);
+    break;
+  case 'H': /* CUP */
+  case 'f':
+    vt->cursor.y = clamp(param(vt, 0, 1) - 1, vt->rows - 1);
+    vt->cursor.x = clamp(param(vt, 1, 1) - 1, vt->cols - 1);
+    break;
+  case 'J':
+    erase_display(vt, param(vt, 0, 0));
+    break;
+  case 'K':
+    erase_line(vt, param(vt, 0, 0));
+    break;
+  case 'm':
+    sgr(vt);
+    break;
+  case 'r': { /* DECSTBM */
+    size_t top = clamp(param(vt, 0, 1) - 1, vt->rows - 1);
+    size_t bottom = clamp(param(vt, 1, (unsigned long)vt->rows) - 1,
+                          vt->rows - 1);
+    if (top < bottom) {
+      vt->margin_top = top;
+      vt->margin_bottom = bottom;
+      vt->cursor.x = 0;
+      vt->cursor.y = 0;
+    }
+    break;
+  }
+  case 's':
+    vt->saved = vt->cursor;
+    break;
+  case 'u':
+    vt->cursor = vt->saved;
+    break;
+  case 'h':
+    set_mode(vt, 1);
+    break;
+  case 'l':
+    set_mode(vt, 0);
+    break;
+  case 'n': /* DSR */
+    if (param(vt, 0, 0) == 5) {
+      respond(vt, "\033[0n");
+    } else if (param(vt, 0, 0) == 6) {
+      sprintf(buf, "\033[%lu;%luR", (unsigned long)vt->cursor.y + 1,
+              (unsigned long)vt->cursor.x + 1);
+      respond(vt, buf);
+    }
+    break;
+  case 'c': /* DA: report a VT220-class terminal */
+    respond(vt, "\033[?62;22c");
+    break;
+  default:
+    break;
+  }
+}
+
+static void apply(cmp_term_t *vt, int action, unsigned char c) {
+  switch (action) {
+  case VT_ACT_PRINT:
+    print_cp(vt, c);
+    break;
+  case VT_ACT_EXECUTE:
+    execute(vt, c);
+    break;
+  case VT_ACT_CLEAR:
+    vt->param_count = 0;
+    vt->params[0] = 0;
+    vt->marker = 0;
+    vt->intermediate = 0;
+    break;
+  case VT_ACT_COLLECT:
+    if (c >= 0x3C && c <= 0x3F) {
+      vt->marker = (char)c;
+    } else {
+      vt->intermediate = (char)c;
+    }
+    break;
+  case VT_ACT_PARAM:
+    if (vt->param_count == 0) {
+      vt->param_count = 1;
+      vt->params[0] = 0;
+    }
+    if (c == ';') {
+      if (vt->param_count < VT_MAX_PARAMS) {
+        vt->params[vt->param_count++] = 0;
+      }
+    } else {
+      unsigned long *p = &vt->params[vt->param_count - 1];
+      *p = *p * 10 + (unsigned long)(c - '0');
+      if (*p > 65535ul) {
+        *p = 65535ul;
+      }
+    }
+    break;
+  case VT_ACT_ESC_DISPATCH:
+    esc_dispatch(vt, c);
+    break;
+  case VT_ACT_CSI_DISPATCH:
+    csi_dispatch(vt, c);
+    break;
+  default:
+    break;
+  }
+}
+
+/* Decodes one byte of a UTF-8 sequence in the ground state. Malformed
+ * input prints U+FFFD. */
+static void feed_utf8(cmp_term_t *vt, unsigned char c) {
+  if (vt->utf8_left > 0) {
+    if ((c & 0xC0) == 0x80) {
+      vt->utf8_cp = (vt->utf8_cp << 6) | (c & 0x3F);
+      if (--vt->utf8_left == 0) {
+        print_cp(vt, vt->utf8_cp);
+      }
+      return;
+    }
+    vt->utf8_left = 0;
+    print_cp(vt, 0xFFFD);
+    if (c < 0x80) {
+      return; /* Caller handles it as a fresh byte */
+    }
+  }
+  if ((c & 0xE0) == 0xC0) {
+    vt->utf8_cp = c & 0x1F;
+    vt->utf8_left = 1;
+  } else if ((c & 0xF0) == 0xE0) {
+    vt->utf8_cp = c & 0x0F;
+    vt->utf8_left = 2;
+  } else if ((c & 0xF8) == 0xF0) {
+    vt->utf8_cp = c & 0x07;
+    vt->utf8_left = 3;
+  } else {
+    print_cp(vt, 0xFFFD);
+  }
+}
+
+int cmp_term_create(cmp_term_t **out_vt, size_t cols, size_t rows,
+                    size_t scrollback_lines) {
+  cmp_term_t *vt;
+  if (!out_vt || cols == 0 || rows == 0) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(cmp_term_t), (void **)&vt) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(vt, 0, sizeof(cmp_term_t));
+  vt->cols = cols;
+  vt->rows = rows;
+  vt->line_limit = scrollback_lines;
+  if (CMP_MALLOC(cols * rows * sizeof(cmp_term_cell_t), (void **)&vt->cells) !=
+      CMP_SUCCESS) {
+    CMP_FREE(vt);
+    return CMP_ERROR_OOM;
+  }
+  /* Row extents and damage flags share one block */
+  if (CMP_MALLOC(rows * (sizeof(size_t) + 1), (void **)&vt->extent) !=
+      CMP_SUCCESS) {
+    CMP_FREE(vt->cells);
+    CMP_FREE(vt);
+    return CMP_ERROR_OOM;
+  }
+  vt->dirty = (unsigned char *)(vt->extent + rows);
+  memset(vt->cells, 0, cols * rows * sizeof(cmp_term_cell_t));
+  memset(vt->extent, 0, rows * sizeof(size_t));
+  /* Worst case per cell: a style change plus a 4-byte sequence */
+  if (CMP_MALLOC(cols * 15, (void **)&vt->scratch) != CMP_SUCCESS) {
+    CMP_FREE(vt->extent);
+    CMP_FREE(vt->cells);
+    CMP_FREE(vt);
+    return CMP_ERROR_OOM;
+  }
+  build_table(vt);
+  reset_state(vt);
+  *out_vt = vt;
+  return CMP_SUCCESS;
+}
+
+int cmp_term_destroy(cmp_term_t *vt) {
+  if (!vt) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  while (vt->first_block) {
+    vt_block_t *block = vt->first_block;
+    vt->first_block = block->next;
+    CMP_FREE(block);
+  }
+  if (vt->lines) {
+    CMP_FREE(vt->lines);
+  }
+  CMP_FREE(vt->scratch);
+  CMP_FREE(vt->extent);
+  CMP_FREE(vt->cells);
+  CMP_FREE(vt);
+  return CMP_SUCCESS;
+}
+
+int cmp_term_feed(cmp_term_t *vt, const char *data, size_t length) {
+  const unsigned char *p = (const unsigned char *)data;
+  const unsigned char *end = p + length;
+
+  if (!vt || (!data && length > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  while (p < end) {
+    unsigned char c = *p, entry;
+    if (vt->state == VT_GROUND) {
+      if (c >= 0x20 && c < 0x7F && vt->utf8_left == 0) {
+        const unsigned char *run = p;
+        while (p < end && *p >= 0x20 && *p < 0x7F) {
+          p++;
+        }
+        print_ascii(vt, run, (size_t)(p - run));
+        continue;
+      }
+      if (c >= 0x80 || vt->utf8_left > 0) {
+        feed_utf8(vt, c);
+        if (c >= 0x80) {
+          p++;
+          continue;
+        }
+      }
+    } else if (c >= 0x80) {
+      p++; /* C1 and string payload bytes are not interpreted */
+      continue;
+    }
+    entry = vt->table[vt->state][c];
+    apply(vt, entry & 0x0F, c);
+    vt->state = entry >> 4;
+    p++;
+  }
+  return CMP_SUCCESS;
+}
+
+int cmp_term_resize(cmp_term_t *vt, size_t cols, size_t rows) {
+  cmp_term_cell_t *cells;
+  unsigned char *scratch;
+  size_t *extent, r, keep_rows, keep_cols, shift;
+
+  if (!vt || cols == 0 || rows == 0) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(cols * rows * sizeof(cmp_term_cell_t), (void **)&cells) !=
+      CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  if (CMP_MALLOC(rows * (sizeof(size_t) + 1), (void **)&extent) !=
+      CMP_SUCCESS) {
+    CMP_FREE(cells);
+    return CMP_ERROR_OOM;
+  }
+  if (CMP_MALLOC(cols * 15, (void **)&scratch) != CMP_SUCCESS) {
+    CMP_FREE(extent);
+    CMP_FREE(cells);
+    return CMP_ERROR_OOM;
+  }
+
+  /* Keep the rows around the cursor; rows cut from the top scroll back */
+  shift = vt->cursor.y >= rows ? vt->cursor.y + 1 - rows : 0;
+  for (r = 0; r < shift; ++r) {
+    push_scrollback(vt, r);
+  }
+  keep_rows = vt->rows - shift < rows ? vt->rows - shift : rows;
+  keep_cols = vt->cols < cols ? vt->cols : cols;
+  for (r = 0; r < rows; ++r) {
+    cmp_term_cell_t *dst = cells + r * cols;
+    memset(dst, 0, cols * sizeof(cmp_term_cell_t));
+    extent[r] = 0;
+    if (r < keep_rows) {
+      memcpy(dst, vt_row(vt, r + shift), keep_cols * sizeof(cmp_term_cell_t));
+      extent[r] = clamp(*row_extent(vt, r + shift), keep_cols);
+    }
+  }
+  memset(extent + rows, 1, rows);
+
+  CMP_FREE(vt->cells);
+  CMP_FREE(vt->extent);
+  CMP_FREE(vt->scratch);
+  vt->cells = cells;
+  vt->extent = extent;
+  vt->dirty = (unsigned char *)(extent + rows);
+  vt->scratch = scratch;
+  vt->cols = cols;
+  vt->rows = rows;
+  vt->top = 0;
+  vt->scrolled = 0;
+  vt->cursor.y -= shift;
+  vt->cursor.x = clamp(vt->cursor.x, cols - 1);
+  vt->saved.y = clamp(vt->saved.y, rows - 1);
+  vt->saved.x = clamp(vt->saved.x, cols - 1);
+  vt->pending_wrap = 0;
+  vt->margin_top = 0;
+  vt->margin_bottom = rows - 1;
+  return CMP_SUCCESS;
+}
+
+int cmp_term_get_row(const cmp_term_t *vt, size_t row,
+                     const cmp_term_cell_t **out_cells) {
+  if (!vt || !out_cells) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (row >= vt->rows) {
+    return CMP_ERROR_BOUNDS;
+  }
+  *out_cells = vt->cells + ((vt->top + row) % vt->rows) * vt->cols;
+  return CMP_SUCCESS;
+}
+
+int cmp_term_get_cursor(const cmp_term_t *vt, size_t *out_row, size_t *out_col,
+                        int *out_visible) {
+  if (!vt || !out_row || !out_col) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  *out_row = vt->cursor.y;
+  *out_col = vt->cursor.x;
+  if (out_visible) {
+    *out_visible = vt->cursor_visible;
+  }
+  return CMP_SUCCESS;
+}
+
+int cmp_term_take_damage(cmp_term_t *vt, unsigned char *out_dirty,
+                         size_t *out_scrolled) {
+  size_t r;
+  if (!vt) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  for (r = 0; r < vt->rows; ++r) {
+    unsigned char *flag = &vt->dirty[(vt->top + r) % vt->rows];
+    if (out_dirty) {
+      out_dirty[r] = *flag;
+    }
+    *flag = 0;
+  }
+  if (out_scrolled) {
+    *out_scrolled = vt->scrolled;
+  }
+  vt->scrolled = 0;
+  return CMP_SUCCESS;
+}
+
+int cmp_term_take_response(cmp_term_t *vt, char *out_buffer, size_t max_len,
+                           size_t *out_len) {
+  size_t n;
+  if (!vt || !out_buffer || !out_len) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  n = vt->response_len < max_len ? vt->response_len : max_len;
+  memcpy(out_buffer, vt->response, n);
+  memmove(vt->response, vt->response + n, vt->response_len - n);
+  vt->response_len -= n;
+  *out_len = n;
+  return CMP_SUCCESS;
+}
+
+size_t cmp_term_get_scrollback_count(const cmp_term_t *vt) {
+  return vt ? vt->line_count : 0;
+}
+
+int cmp_term_get_scrollback_line(const cmp_term_t *vt, size_t index,
+                                 cmp_term_cell_t *out_cells, size_t max_cells,
+                                 size_t *out_count) {
+  const vt_line_t *line;
+  const unsigned char *p, *end;
+  cmp_term_cell_t pen;
+  size_t n = 0;
+
+  if (!vt || !out_count || (!out_cells && max_cells > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (index >= vt->line_count) {
+    return CMP_ERROR_BOUNDS;
+  }
+  line = &vt->lines[(vt->line_head + index) % vt->line_capacity];
+  p = (const unsigned char *)(line->block + 1) + line->offset;
+  end = p + line->length;
+  memset(&pen, 0, sizeof(pen));
+
+  while (p < end && n < max_cells) {
+    if (*p == VT_STYLE_MARK) {
+      pen.fg = get_u32(p + 1);
+      pen.bg = get_u32(p + 5);
+      pen.attrs = (unsigned int)p[9] | ((unsigned int)p[10] << 8);
+      p += 11;
+      continue;
+    }
+    out_cells[n] = pen;
+    if (*p == VT_EMPTY_MARK) {
+      out_cells[n].codepoint = 0;
+      p++;
+    } else if (*p < 0x80) {
+      out_cells[n].codepoint = *p++;
+    } else {
+      int extra = *p >= 0xF0 ? 3 : *p >= 0xE0 ? 2 : 1;
+      unsigned long cp = *p++ & (0x3F >> extra);
+      while (extra-- > 0) {
+        cp = (cp << 6) | (*p++ & 0x3F);
+      }
+      out_cells[n].codepoint = cp;
+    }
+    n++;
+  }
+  *out_count = n;
+  return CMP_SUCCESS;
+}
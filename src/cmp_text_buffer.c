@@ -0,0 +1,713 @@
+/* clang-format off */
+#include "cmp.h"
+#include <string.h>
+/* clang-format on */
+
+/* Piece tree text storage.
+ * Text lives in append-only chunks that are never moved or rewritten. The
+ * document is a sequence of pieces (runs of chunk bytes) held in a treap
+ * ordered by position; every node caches the byte, newline and code point
+ * totals of its subtree, so positional lookups and edits walk one root path.
+ * Nodes are reference counted and copied only when shared, which makes a
+ * snapshot a single root reference: edits after it copy the nodes on their
+ * path and leave the snapshot's tree intact. */
+
+#define TB_PIECE_MAX 4096        /* Bounds the scan when a piece is split */
+#define TB_CHUNK_SIZE 65536
+#define TB_RESERVE_NODES 512     /* Upper bound on nodes one split/merge pass
+                                    can copy; treap depth stays far below */
+#define TB_SLAB_NODES 256
+
+typedef struct tb_node {
+  struct tb_node *left;
+  struct tb_node *right;
+  size_t refs;
+  unsigned long prio;
+  const char *data;
+  size_t len;
+  size_t lines; /* '\n' bytes in the piece */
+  size_t cps;   /* Code point lead bytes in the piece */
+  size_t sum_len;
+  size_t sum_lines;
+  size_t sum_cps;
+} tb_node_t;
+
+/* Nodes come from slabs so that documents with many pieces cost few
+ * allocations; slabs are only returned when the store dies. */
+typedef struct tb_slab {
+  struct tb_slab *next;
+  tb_node_t nodes[TB_SLAB_NODES];
+} tb_slab_t;
+
+typedef struct tb_chunk {
+  struct tb_chunk *next;
+  char *data;
+  size_t cap;
+  size_t used;
+} tb_chunk_t;
+
+/* Shared by a buffer and all of its snapshots. */
+typedef struct tb_store {
+  size_t refs;
+  tb_chunk_t *chunks; /* Newest first; the head takes appends */
+  tb_slab_t *slabs;
+  tb_node_t *free_nodes;
+  size_t free_count;
+  unsigned long seed;
+} tb_store_t;
+
+struct cmp_text_buffer {
+  tb_store_t *store;
+  tb_node_t *root;
+};
+
+struct cmp_text_snapshot {
+  tb_store_t *store;
+  tb_node_t *root;
+};
+
+/* ------------------------------------------------------------------------ */
+/* Store                                                                     */
+/* ------------------------------------------------------------------------ */
+
+static int tb_store_create(tb_store_t **out) {
+  tb_store_t *s;
+  if (CMP_MALLOC(sizeof(tb_store_t), (void **)&s) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(s, 0, sizeof(tb_store_t));
+  s->refs = 1;
+  s->seed = 0x2545F491UL;
+  *out = s;
+  return CMP_SUCCESS;
+}
+
+static void tb_store_release(tb_store_t *s) {
+  tb_chunk_t *c;
+  tb_slab_t *slab;
+  if (--s->refs > 0)
+    return;
+  while ((c = s->chunks) != NULL) {
+    s->chunks = c->next;
+    CMP_FREE(c);
+  }
+  while ((slab = s->slabs) != NULL) {
+    s->slabs = slab->next;
+    CMP_FREE(slab);
+  }
+  CMP_FREE(s);
+}
+
+static int tb_reserve(tb_store_t *s, size_t count) {
+  while (s->free_count < count) {
+    tb_slab_t *slab;
+    size_t i;
+    if (CMP_MALLOC(sizeof(tb_slab_t), (void **)&slab) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    slab->next = s->slabs;
+    s->slabs = slab;
+    for (i = 0; i < TB_SLAB_NODES; ++i) {
+      slab->nodes[i].left = s->free_nodes;
+      s->free_nodes = &slab->nodes[i];
+    }
+    s->free_count += TB_SLAB_NODES;
+  }
+  return CMP_SUCCESS;
+}
+
+/* Callers reserve first, so taking a node cannot fail. */
+static tb_node_t *tb_take(tb_store_t *s) {
+  tb_node_t *n = s->free_nodes;
+  s->free_nodes = n->left;
+  s->free_count--;
+  return n;
+}
+
+static void tb_give(tb_store_t *s, tb_node_t *n) {
+  n->left = s->free_nodes;
+  s->free_nodes = n;
+  s->free_count++;
+}
+
+static unsigned long tb_random(tb_store_t *s) {
+  unsigned long x = s->seed;
+  x ^= (x << 13) & 0xFFFFFFFFUL;
+  x ^= x >> 17;
+  x ^= (x << 5) & 0xFFFFFFFFUL;
+  s->seed = x;
+  return x;
+}
+
+/* Copies text to the head chunk, starting a new one if it does not fit. */
+static const char *tb_store_append(tb_store_t *s, const char *text,
+                                   size_t len) {
+  tb_chunk_t *c = s->chunks;
+  char *at;
+  if (!c || c->cap - c->used < len) {
+    size_t cap = len > TB_CHUNK_SIZE ? len : TB_CHUNK_SIZE;
+    if (CMP_MALLOC(sizeof(tb_chunk_t) + cap, (void **)&c) != CMP_SUCCESS)
+      return NULL;
+    c->data = (char *)(c + 1);
+    c->cap = cap;
+    c->used = 0;
+    c->next = s->chunks;
+    s->chunks = c;
+  }
+  at = c->data + c->used;
+  memcpy(at, text, len);
+  c->used += len;
+  return at;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Treap                                                                     */
+/* ------------------------------------------------------------------------ */
+
+static void tb_count(const char *p, size_t len, size_t *lines, size_t *cps) {
+  size_t i, nl = 0, cp = 0;
+  for (i = 0; i < len; ++i) {
+    nl += p[i] == '\n';
+    cp += ((unsigned char)p[i] & 0xC0) != 0x80;
+  }
+  *lines = nl;
+  *cps = cp;
+}
+
+static size_t tb_len(const tb_node_t *n) { return n ? n->sum_len : 0; }
+static size_t tb_lines(const tb_node_t *n) { return n ? n->sum_lines : 0; }
+static size_t tb_cps(const tb_node_t *n) { return n ? n->sum_cps : 0; }
+
+static void tb_update(tb_node_t *n) {
+  n->sum_len = tb_len(n->left) + n->len + tb_len(n->right);
+  n->sum_lines = tb_lines(n->left) + n->lines + tb_lines(n->right);
+  n->sum_cps = tb_cps(n->left) + n->cps + tb_cps(n->right);
+}
+
+static tb_node_t *tb_retain(tb_node_t *n) {
+  if (n)
+    n->refs++;
+  return n;
+}
+
+static void tb_release(tb_store_t *s, tb_node_t *n) {
+  while (n && --n->refs == 0) {
+    tb_node_t *right = n->right;
+    tb_release(s, n->left);
+    tb_give(s, n);
+    n = right;
+  }
+}
+
+/* Returns a node the caller may modify: n itself when unshared, otherwise
+ * a copy (the caller's reference moves to the copy). */
+static tb_node_t *tb_own(tb_store_t *s, tb_node_t *n) {
+  tb_node_t *c;
+  if (n->refs == 1)
+    return n;
+  c = tb_take(s);
+  *c = *n;
+  c->refs = 1;
+  tb_retain(c->left);
+  tb_retain(c->right);
+  n->refs--;
+  return c;
+}
+
+static tb_node_t *tb_new_piece(tb_store_t *s, const char *data, size_t len) {
+  tb_node_t *n = tb_take(s);
+  n->left = NULL;
+  n->right = NULL;
+  n->refs = 1;
+  n->prio = tb_random(s);
+  n->data = data;
+  n->len = len;
+  tb_count(data, len, &n->lines, &n->cps);
+  tb_update(n);
+  return n;
+}
+
+/* Consumes a and b. */
+static tb_node_t *tb_merge(tb_store_t *s, tb_node_t *a, tb_node_t *b) {
+  if (!a)
+    return b;
+  if (!b)
+    return a;
+  if (a->prio > b->prio) {
+    a = tb_own(s, a);
+    a->right = tb_merge(s, a->right, b);
+    tb_update(a);
+    return a;
+  }
+  b = tb_own(s, b);
+  b->left = tb_merge(s, a, b->left);
+  tb_update(b);
+  return b;
+}
+
+/* Consumes t; *l receives the first off bytes and *r the rest. A piece
+ * straddling off is cut in two. */
+static void tb_split(tb_store_t *s, tb_node_t *t, size_t off, tb_node_t **l,
+                     tb_node_t **r) {
+  size_t left_len;
+  if (!t) {
+    *l = NULL;
+    *r = NULL;
+    return;
+  }
+  if (off == 0) {
+    *l = NULL;
+    *r = t;
+    return;
+  }
+  if (off >= t->sum_len) {
+    *l = t;
+    *r = NULL;
+    return;
+  }
+  t = tb_own(s, t);
+  left_len = tb_len(t->left);
+  if (off <= left_len) {
+    tb_split(s, t->left, off, l, &t->left);
+    tb_update(t);
+    *r = t;
+  } else if (off >= left_len + t->len) {
+    tb_split(s, t->right, off - left_len - t->len, &t->right, r);
+    tb_update(t);
+    *l = t;
+  } else {
+    size_t k = off - left_len;
+    tb_node_t *tail = tb_take(s);
+    tb_node_t *rest = t->right;
+    size_t head_lines, head_cps;
+
+    /* Count whichever side is shorter and derive the other. */
+    if (k <= t->len - k) {
+      tb_count(t->data, k, &head_lines, &head_cps);
+    } else {
+      size_t tl, tc;
+      tb_count(t->data + k, t->len - k, &tl, &tc);
+      head_lines = t->lines - tl;
+      head_cps = t->cps - tc;
+    }
+    tail->left = NULL;
+    tail->right = NULL;
+    tail->refs = 1;
+    tail->prio = tb_random(s);
+    tail->data = t->data + k;
+    tail->len = t->len - k;
+    tail->lines = t->lines - head_lines;
+    tail->cps = t->cps - head_cps;
+    tb_update(tail);
+
+    t->len = k;
+    t->lines = head_lines;
+    t->cps = head_cps;
+    t->right = NULL;
+    tb_update(t);
+    *l = t;
+    *r = tb_merge(s, tail, rest);
+  }
+}
+
+/* Grows the last piece of t by len bytes that were appended directly after
+ * it in the store. Consumes t. */
+static tb_node_t *tb_extend_last(tb_store_t *s, tb_node_t *t, size_t len) {
+  size_t lines, cps;
+  t = tb_own(s, t);
+  if (t->right) {
+    t->right = tb_extend_last(s, t->right, len);
+  } else {
+    tb_count(t->data + t->len, len, &lines, &cps);
+    t->len += len;
+    t->lines += lines;
+    t->cps += cps;
+  }
+  tb_update(t);
+  return t;
+}
+
+static const tb_node_t *tb_last(const tb_node_t *t) {
+  while (t && t->right)
+    t = t->right;
+  return t;
+}
+
+/* Builds the pieces for len bytes of stored text. */
+static tb_node_t *tb_pieces(tb_store_t *s, const char *data, size_t len) {
+  tb_node_t *t = NULL;
+  while (len > 0) {
+    size_t n = len > TB_PIECE_MAX ? TB_PIECE_MAX : len;
+    t = tb_merge(s, t, tb_new_piece(s, data, n));
+    data += n;
+    len -= n;
+  }
+  return t;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Lookups                                                                   */
+/* ------------------------------------------------------------------------ */
+
+/* Finds the piece holding byte off (off < total length). */
+static const tb_node_t *tb_find(const tb_node_t *t, size_t off,
+                                size_t *out_base, size_t *out_lines,
+                                size_t *out_cps) {
+  size_t base = 0, lines = 0, cps = 0;
+  while (t) {
+    size_t left_len = tb_len(t->left);
+    if (off < left_len) {
+      t = t->left;
+      continue;
+    }
+    off -= left_len;
+    base += left_len;
+    lines += tb_lines(t->left);
+    cps += tb_cps(t->left);
+    if (off < t->len)
+      break;
+    off -= t->len;
+    base += t->len;
+    lines += t->lines;
+    cps += t->cps;
+    t = t->right;
+  }
+  *out_base = base;
+  *out_lines = lines;
+  *out_cps = cps;
+  return t;
+}
+
+static size_t tb_line_start(const tb_node_t *t, size_t line) {
+  size_t base = 0;
+  if (line == 0)
+    return 0;
+  while (t) {
+    size_t left_lines = tb_lines(t->left);
+    if (line <= left_lines) {
+      t = t->left;
+      continue;
+    }
+    line -= left_lines;
+    base += tb_len(t->left);
+    if (line <= t->lines) {
+      size_t i;
+      for (i = 0; i < t->len; ++i) {
+        if (t->data[i] == '\n' && --line == 0)
+          return base + i + 1;
+      }
+    }
+    line -= t->lines;
+    base += t->len;
+    t = t->right;
+  }
+  return base;
+}
+
+static int tb_read(const tb_node_t *t, size_t off, size_t len, char *out) {
+  while (len > 0) {
+    size_t base, lines, cps, at, n;
+    const tb_node_t *p = tb_find(t, off, &base, &lines, &cps);
+    if (!p)
+      return CMP_ERROR_BOUNDS;
+    at = off - base;
+    n = p->len - at < len ? p->len - at : len;
+    memcpy(out, p->data + at, n);
+    out += n;
+    off += n;
+    len -= n;
+  }
+  return CMP_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Public API                                                                */
+/* ------------------------------------------------------------------------ */
+
+int cmp_text_buffer_create(cmp_text_buffer_t **out_buffer) {
+  cmp_text_buffer_t *tb;
+  if (!out_buffer)
+    return CMP_ERROR_INVALID_ARG;
+  if (CMP_MALLOC(sizeof(cmp_text_buffer_t), (void **)&tb) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  tb->root = NULL;
+  if (tb_store_create(&tb->store) != CMP_SUCCESS) {
+    CMP_FREE(tb);
+    return CMP_ERROR_OOM;
+  }
+  *out_buffer = tb;
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_destroy(cmp_text_buffer_t *buffer) {
+  if (!buffer)
+    return CMP_ERROR_INVALID_ARG;
+  tb_release(buffer->store, buffer->root);
+  tb_store_release(buffer->store);
+  CMP_FREE(buffer);
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_insert(cmp_text_buffer_t *buffer, size_t offset,
+                           const char *text, size_t len) {
+  tb_store_t *s;
+  tb_node_t *l, *r;
+  const tb_node_t *last;
+  const tb_chunk_t *head;
+  const char *stored;
+  int extend;
+
+  if (!buffer || (!text && len > 0))
+    return CMP_ERROR_INVALID_ARG;
+  if (offset > tb_len(buffer->root))
+    return CMP_ERROR_BOUNDS;
+  if (len == 0)
+    return CMP_SUCCESS;
+  s = buffer->store;
+  if (tb_reserve(s, TB_RESERVE_NODES + len / TB_PIECE_MAX + 1) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+
+  tb_split(s, buffer->root, offset, &l, &r);
+
+  /* Typing appends to the store right after the previous keystroke, so the
+   * piece before the caret can usually just grow. */
+  last = tb_last(l);
+  head = s->chunks;
+  extend = last && head && last->data + last->len == head->data + head->used &&
+           head->cap - head->used >= len && last->len + len <= TB_PIECE_MAX;
+
+  stored = tb_store_append(s, text, len);
+  if (!stored) {
+    buffer->root = tb_merge(s, l, r);
+    return CMP_ERROR_OOM;
+  }
+  if (extend)
+    l = tb_extend_last(s, l, len);
+  else
+    l = tb_merge(s, l, tb_pieces(s, stored, len));
+  buffer->root = tb_merge(s, l, r);
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_delete(cmp_text_buffer_t *buffer, size_t offset,
+                           size_t len) {
+  tb_store_t *s;
+  tb_node_t *l, *m, *r;
+  if (!buffer)
+    return CMP_ERROR_INVALID_ARG;
+  if (offset > tb_len(buffer->root) || len > tb_len(buffer->root) - offset)
+    return CMP_ERROR_BOUNDS;
+  if (len == 0)
+    return CMP_SUCCESS;
+  s = buffer->store;
+  if (tb_reserve(s, TB_RESERVE_NODES) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  tb_split(s, buffer->root, offset, &l, &r);
+  tb_split(s, r, len, &m, &r);
+  tb_release(s, m);
+  buffer->root = tb_merge(s, l, r);
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_set_text(cmp_text_buffer_t *buffer, const char *text,
+                             size_t len) {
+  tb_store_t *s;
+  const char *stored;
+  if (!buffer || (!text && len > 0))
+    return CMP_ERROR_INVALID_ARG;
+  s = buffer->store;
+  if (tb_reserve(s, len / TB_PIECE_MAX + 1) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  stored = len > 0 ? tb_store_append(s, text, len) : NULL;
+  if (len > 0 && !stored)
+    return CMP_ERROR_OOM;
+  tb_release(s, buffer->root);
+  buffer->root = tb_pieces(s, stored, len);
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_get_length(const cmp_text_buffer_t *buffer,
+                               size_t *out_len) {
+  if (!buffer || !out_len)
+    return CMP_ERROR_INVALID_ARG;
+  *out_len = tb_len(buffer->root);
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_get_line_count(const cmp_text_buffer_t *buffer,
+                                   size_t *out_count) {
+  if (!buffer || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  *out_count = tb_lines(buffer->root) + 1;
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_get_codepoint_count(const cmp_text_buffer_t *buffer,
+                                        size_t *out_count) {
+  if (!buffer || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  *out_count = tb_cps(buffer->root);
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_offset_to_line(const cmp_text_buffer_t *buffer,
+                                   size_t offset, size_t *out_line,
+                                   size_t *out_column) {
+  size_t line, base, cps, i;
+  const tb_node_t *p;
+  if (!buffer || !out_line)
+    return CMP_ERROR_INVALID_ARG;
+  if (offset > tb_len(buffer->root))
+    return CMP_ERROR_BOUNDS;
+  if (offset == tb_len(buffer->root)) {
+    line = tb_lines(buffer->root);
+  } else {
+    p = tb_find(buffer->root, offset, &base, &line, &cps);
+    for (i = 0; i < offset - base; ++i)
+      line += p->data[i] == '\n';
+  }
+  *out_line = line;
+  if (out_column)
+    *out_column = offset - tb_line_start(buffer->root, line);
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_line_to_offset(const cmp_text_buffer_t *buffer,
+                                   size_t line, size_t *out_offset) {
+  if (!buffer || !out_offset)
+    return CMP_ERROR_INVALID_ARG;
+  if (line > tb_lines(buffer->root))
+    return CMP_ERROR_BOUNDS;
+  *out_offset = tb_line_start(buffer->root, line);
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_offset_to_codepoint(const cmp_text_buffer_t *buffer,
+                                        size_t offset, size_t *out_index) {
+  size_t base, lines, cps, i;
+  const tb_node_t *p;
+  if (!buffer || !out_index)
+    return CMP_ERROR_INVALID_ARG;
+  if (offset > tb_len(buffer->root))
+    return CMP_ERROR_BOUNDS;
+  if (offset == tb_len(buffer->root)) {
+    *out_index = tb_cps(buffer->root);
+    return CMP_SUCCESS;
+  }
+  p = tb_find(buffer->root, offset, &base, &lines, &cps);
+  for (i = 0; i < offset - base; ++i)
+    cps += ((unsigned char)p->data[i] & 0xC0) != 0x80;
+  *out_index = cps;
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_codepoint_to_offset(const cmp_text_buffer_t *buffer,
+                                        size_t index, size_t *out_offset) {
+  const tb_node_t *t;
+  size_t base = 0;
+  if (!buffer || !out_offset)
+    return CMP_ERROR_INVALID_ARG;
+  if (index > tb_cps(buffer->root))
+    return CMP_ERROR_BOUNDS;
+  if (index == tb_cps(buffer->root)) {
+    *out_offset = tb_len(buffer->root);
+    return CMP_SUCCESS;
+  }
+  t = buffer->root;
+  while (t) {
+    size_t left_cps = tb_cps(t->left);
+    if (index < left_cps) {
+      t = t->left;
+      continue;
+    }
+    index -= left_cps;
+    base += tb_len(t->left);
+    if (index < t->cps) {
+      size_t i;
+      for (i = 0; i < t->len; ++i) {
+        if (((unsigned char)t->data[i] & 0xC0) != 0x80 && index-- == 0)
+          break;
+      }
+      *out_offset = base + i;
+      return CMP_SUCCESS;
+    }
+    index -= t->cps;
+    base += t->len;
+    t = t->right;
+  }
+  return CMP_ERROR_BOUNDS;
+}
+
+int cmp_text_buffer_read(const cmp_text_buffer_t *buffer, size_t offset,
+                         size_t len, char *out) {
+  if (!buffer || (!out && len > 0))
+    return CMP_ERROR_INVALID_ARG;
+  if (offset > tb_len(buffer->root) || len > tb_len(buffer->root) - offset)
+    return CMP_ERROR_BOUNDS;
+  return tb_read(buffer->root, offset, len, out);
+}
+
+int cmp_text_buffer_get_chunk(const cmp_text_buffer_t *buffer, size_t offset,
+                              const char **out_data, size_t *out_len) {
+  size_t base, lines, cps;
+  const tb_node_t *p;
+  if (!buffer || !out_data || !out_len)
+    return CMP_ERROR_INVALID_ARG;
+  if (offset >= tb_len(buffer->root))
+    return CMP_ERROR_BOUNDS;
+  p = tb_find(buffer->root, offset, &base, &lines, &cps);
+  *out_data = p->data + (offset - base);
+  *out_len = p->len - (offset - base);
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_snapshot(const cmp_text_buffer_t *buffer,
+                             cmp_text_snapshot_t **out_snapshot) {
+  cmp_text_snapshot_t *snap;
+  if (!buffer || !out_snapshot)
+    return CMP_ERROR_INVALID_ARG;
+  if (CMP_MALLOC(sizeof(cmp_text_snapshot_t), (void **)&snap) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  snap->store = buffer->store;
+  snap->store->refs++;
+  snap->root = tb_retain(buffer->root);
+  *out_snapshot = snap;
+  return CMP_SUCCESS;
+}
+
+int cmp_text_buffer_restore(cmp_text_buffer_t *buffer,
+                            const cmp_text_snapshot_t *snapshot) {
+  if (!buffer || !snapshot)
+    return CMP_ERROR_INVALID_ARG;
+  if (snapshot->store != buffer->store)
+    return CMP_ERROR_INVALID_ARG;
+  tb_retain(snapshot->root);
+  tb_release(buffer->store, buffer->root);
+  buffer->root = snapshot->root;
+  return CMP_SUCCESS;
+}
+
+int cmp_text_snapshot_get_length(const cmp_text_snapshot_t *snapshot,
+                                 size_t *out_len) {
+  if (!snapshot || !out_len)
+    return CMP_ERROR_INVALID_ARG;
+  *out_len = tb_len(snapshot->root);
+  return CMP_SUCCESS;
+}
+
+int cmp_text_snapshot_read(const cmp_text_snapshot_t *snapshot, size_t offset,
+                           size_t len, char *out) {
+  if (!snapshot || (!out && len > 0))
+    return CMP_ERROR_INVALID_ARG;
+  if (offset > tb_len(snapshot->root) ||
+      len > tb_len(snapshot->root) - offset)
+    return CMP_ERROR_BOUNDS;
+  return tb_read(snapshot->root, offset, len, out);
+}
+
+int cmp_text_snapshot_release(cmp_text_snapshot_t *snapshot) {
+  if (!snapshot)
+    return CMP_ERROR_INVALID_ARG;
+  tb_release(snapshot->store, snapshot->root);
+  tb_store_release(snapshot->store);
+  CMP_FREE(snapshot);
+  return CMP_SUCCESS;
+}
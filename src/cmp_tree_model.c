@@ -0,0 +1,361 @@
+/* clang-format off */
+#include "cmp.h"
+#include <stdlib.h>
+#include <string.h>
+/* clang-format on */
+
+/*
+ * The tree is flattened into rows on demand instead of keeping a node per
+ * item. Every node owns a 1-based Fenwick tree over the visible row counts
+ * of its children (children of one load are contiguous ids), so
+ * row <-> node conversions descend or climb one O(log k) prefix sum per
+ * level and expanding or collapsing a node, however many children it has,
+ * is one point update per ancestor. Views only bind the rows they show.
+ */
+
+#define TREE_EXPANDED 1
+#define TREE_HAS_CHILDREN 2
+#define TREE_LOADED 4
+#define TREE_LOADING 8
+
+typedef struct tree_node {
+  const char *label;
+  size_t parent;
+  size_t index; /* Among the parent's children */
+  size_t depth;
+  size_t first_child;
+  size_t child_count;
+  size_t *counts; /* Fenwick tree of the children's visible rows */
+  size_t below;   /* Rows under this node while it is expanded */
+  int flags;
+} tree_node_t;
+
+struct cmp_tree_model {
+  tree_node_t *nodes;
+  size_t count;
+  size_t cap;
+
+  char **arenas; /* Label storage, one block per load */
+  size_t arena_count;
+
+  cmp_tree_load_cb_t load;
+  void *load_data;
+  cmp_tree_change_cb_t on_change;
+  void *change_data;
+};
+
+/* ------------------------------------------------------------------------ */
+/* Child Fenwick trees                                                      */
+/* ------------------------------------------------------------------------ */
+
+/* Rows of children [0, k) */
+static size_t tree_prefix(const tree_node_t *node, size_t k) {
+  size_t sum = 0;
+  for (; k > 0; k &= k - 1)
+    sum += node->counts[k];
+  return sum;
+}
+
+/* Wraps around for shrinking, which the sums absorb */
+static void tree_add(tree_node_t *node, size_t k, size_t delta) {
+  for (++k; k <= node->child_count; k += k & (~k + 1))
+    node->counts[k] += delta;
+}
+
+/* Child whose rows contain row (relative to the first child); *io_row is
+ * left as the offset into that child's rows */
+static size_t tree_find(const tree_node_t *node, size_t *io_row) {
+  size_t pos = 0, step = 1;
+  while (step <= node->child_count / 2)
+    step <<= 1;
+  for (; step > 0; step >>= 1) {
+    if (pos + step <= node->child_count &&
+        node->counts[pos + step] <= *io_row) {
+      pos += step;
+      *io_row -= node->counts[pos];
+    }
+  }
+  return pos;
+}
+
+static size_t tree_rows(const tree_node_t *node) {
+  return 1 + ((node->flags & TREE_EXPANDED) ? node->below : 0);
+}
+
+/* Adds delta rows under node and carries them up while they show */
+static void tree_propagate(struct cmp_tree_model *model, size_t id,
+                           size_t delta) {
+  tree_node_t *node;
+  while (id != CMP_TREE_ROOT) {
+    node = &model->nodes[model->nodes[id].parent];
+    tree_add(node, model->nodes[id].index, delta);
+    node->below += delta;
+    id = model->nodes[id].parent;
+    if (id != CMP_TREE_ROOT && !(node->flags & TREE_EXPANDED))
+      break;
+  }
+}
+
+/* Row of a node, or CMP_ERROR_NOT_FOUND under a collapsed ancestor */
+static int tree_row_of(const struct cmp_tree_model *model, size_t id,
+                       size_t *out_row) {
+  const tree_node_t *parent;
+  size_t row = 0;
+  while (id != CMP_TREE_ROOT) {
+    parent = &model->nodes[model->nodes[id].parent];
+    if (model->nodes[id].parent != CMP_TREE_ROOT &&
+        !(parent->flags & TREE_EXPANDED))
+      return CMP_ERROR_NOT_FOUND;
+    row += 1 + tree_prefix(parent, model->nodes[id].index);
+    id = model->nodes[id].parent;
+  }
+  *out_row = row - 1;
+  return CMP_SUCCESS;
+}
+
+static void tree_notify(struct cmp_tree_model *model, size_t id,
+                        size_t removed, size_t inserted) {
+  size_t row = CMP_TREE_NONE;
+  if (!model->on_change)
+    return;
+  if (id != CMP_TREE_ROOT && tree_row_of(model, id, &row) != CMP_SUCCESS)
+    return;
+  model->on_change(model, row, id == CMP_TREE_ROOT ? 0 : row + 1, removed,
+                   inserted, model->change_data);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Public API                                                               */
+/* ------------------------------------------------------------------------ */
+
+int cmp_tree_model_create(cmp_tree_model_t **out_model,
+                          cmp_tree_load_cb_t load, void *user_data) {
+  struct cmp_tree_model *model;
+  if (!out_model)
+    return CMP_ERROR_INVALID_ARG;
+  if (CMP_MALLOC(sizeof(struct cmp_tree_model), (void **)&model) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(model, 0, sizeof(struct cmp_tree_model));
+  if (CMP_MALLOC(16 * sizeof(tree_node_t), (void **)&model->nodes) !=
+      CMP_SUCCESS) {
+    CMP_FREE(model);
+    return CMP_ERROR_OOM;
+  }
+  memset(model->nodes, 0, sizeof(tree_node_t));
+  model->nodes[0].label = "";
+  model->nodes[0].parent = CMP_TREE_NONE;
+  model->nodes[0].flags = TREE_EXPANDED | TREE_HAS_CHILDREN;
+  model->count = 1;
+  model->cap = 16;
+  model->load = load;
+  model->load_data = user_data;
+  *out_model = model;
+  return CMP_SUCCESS;
+}
+
+int cmp_tree_model_destroy(cmp_tree_model_t *model) {
+  size_t i;
+  if (!model)
+    return CMP_ERROR_INVALID_ARG;
+  for (i = 0; i < model->count; ++i)
+    if (model->nodes[i].counts)
+      CMP_FREE(model->nodes[i].counts);
+  for (i = 0; i < model->arena_count; ++i)
+    CMP_FREE(model->arenas[i]);
+  if (model->arenas)
+    CMP_FREE(model->arenas);
+  CMP_FREE(model->nodes);
+  CMP_FREE(model);
+  return CMP_SUCCESS;
+}
+
+int cmp_tree_model_set_change_handler(cmp_tree_model_t *model,
+                                      cmp_tree_change_cb_t on_change,
+                                      void *user_data) {
+  if (!model)
+    return CMP_ERROR_INVALID_ARG;
+  model->on_change = on_change;
+  model->change_data = user_data;
+  return CMP_SUCCESS;
+}
+
+int cmp_tree_model_set_children(cmp_tree_model_t *model, size_t parent,
+                                const char *const *labels,
+                                const int *has_children, size_t count,
+                                size_t *out_first) {
+  tree_node_t *node;
+  char *arena = NULL;
+  char **arenas = NULL;
+  size_t i, k, bytes = 0, cap;
+
+  if (!model || parent >= model->count || (count > 0 && !labels))
+    return CMP_ERROR_INVALID_ARG;
+  if (model->nodes[parent].flags & TREE_LOADED)
+    return CMP_ERROR_INVALID_STATE;
+
+  /* Reserve everything first so failure leaves the model untouched */
+  for (i = 0; i < count; ++i)
+    bytes += strlen(labels[i] ? labels[i] : "") + 1;
+  for (cap = model->cap; cap - model->count < count;)
+    cap *= 2;
+  if (cap != model->cap) {
+    tree_node_t *grown;
+    if (CMP_MALLOC(cap * sizeof(tree_node_t), (void **)&grown) !=
+        CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    memcpy(grown, model->nodes, model->count * sizeof(tree_node_t));
+    CMP_FREE(model->nodes);
+    model->nodes = grown;
+    model->cap = cap;
+  }
+  node = &model->nodes[parent];
+  if (count > 0) {
+    if (CMP_MALLOC((count + 1) * sizeof(size_t), (void **)&node->counts) !=
+        CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    if (CMP_MALLOC((model->arena_count + 1) * sizeof(char *),
+                   (void **)&arenas) != CMP_SUCCESS)
+      arenas = NULL;
+    if (!arenas || CMP_MALLOC(bytes, (void **)&arena) != CMP_SUCCESS) {
+      if (arenas)
+        CMP_FREE(arenas);
+      CMP_FREE(node->counts);
+      node->counts = NULL;
+      return CMP_ERROR_OOM;
+    }
+    if (model->arenas) {
+      memcpy(arenas, model->arenas, model->arena_count * sizeof(char *));
+      CMP_FREE(model->arenas);
+    }
+    model->arenas = arenas;
+    model->arenas[model->arena_count++] = arena;
+  }
+
+  /* Every new child is one collapsed row */
+  node->first_child = model->count;
+  node->child_count = count;
+  node->below = count;
+  node->flags = (node->flags & ~(TREE_LOADING | TREE_HAS_CHILDREN)) |
+                TREE_LOADED | (count > 0 ? TREE_HAS_CHILDREN : 0);
+  if (count > 0)
+    node->counts[0] = 0;
+  for (k = 1; k <= count; ++k)
+    node->counts[k] = k & (~k + 1);
+  for (i = 0; i < count; ++i) {
+    tree_node_t *child = &model->nodes[model->count + i];
+    size_t len = strlen(labels[i] ? labels[i] : "");
+    memcpy(arena, labels[i] ? labels[i] : "", len + 1);
+    memset(child, 0, sizeof(tree_node_t));
+    child->label = arena;
+    child->parent = parent;
+    child->index = i;
+    child->depth = parent == CMP_TREE_ROOT ? 0 : node->depth + 1;
+    child->flags = has_children && has_children[i] ? TREE_HAS_CHILDREN : 0;
+    arena += len + 1;
+  }
+  model->count += count;
+  if (out_first)
+    *out_first = node->first_child;
+
+  if (parent == CMP_TREE_ROOT || (node->flags & TREE_EXPANDED)) {
+    tree_propagate(model, parent, count);
+    tree_notify(model, parent, 0, count);
+  } else {
+    tree_notify(model, parent, 0, 0); /* Lost its loading state */
+  }
+  return CMP_SUCCESS;
+}
+
+int cmp_tree_model_set_expanded(cmp_tree_model_t *model, size_t id,
+                                int is_expanded) {
+  tree_node_t *node;
+  size_t rows;
+  int res;
+
+  if (!model || id >= model->count || id == CMP_TREE_ROOT)
+    return CMP_ERROR_INVALID_ARG;
+  node = &model->nodes[id];
+  if (!is_expanded == !(node->flags & TREE_EXPANDED))
+    return CMP_SUCCESS;
+  rows = node->below;
+
+  if (!is_expanded) {
+    node->flags &= ~TREE_EXPANDED;
+    tree_propagate(model, id, 0 - rows);
+    tree_notify(model, id, rows, 0);
+    return CMP_SUCCESS;
+  }
+
+  node->flags |= TREE_EXPANDED;
+  tree_propagate(model, id, rows);
+  tree_notify(model, id, 0, rows);
+
+  /* Children arrive through cmp_tree_model_set_children, possibly from
+   * inside the callback */
+  if ((node->flags & (TREE_HAS_CHILDREN | TREE_LOADED | TREE_LOADING)) ==
+          TREE_HAS_CHILDREN &&
+      model->load) {
+    node->flags |= TREE_LOADING;
+    res = model->load(model->load_data, model, id);
+    node = &model->nodes[id];
+    if (res != CMP_SUCCESS) {
+      node->flags &= ~TREE_LOADING;
+      return res;
+    }
+  }
+  return CMP_SUCCESS;
+}
+
+int cmp_tree_model_get_row_count(const cmp_tree_model_t *model,
+                                 size_t *out_count) {
+  if (!model || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  *out_count = model->nodes[CMP_TREE_ROOT].below;
+  return CMP_SUCCESS;
+}
+
+int cmp_tree_model_get_node_at_row(const cmp_tree_model_t *model, size_t row,
+                                   size_t *out_node) {
+  const tree_node_t *node;
+  size_t id = CMP_TREE_ROOT, k;
+  if (!model || !out_node)
+    return CMP_ERROR_INVALID_ARG;
+  if (row >= model->nodes[CMP_TREE_ROOT].below)
+    return CMP_ERROR_BOUNDS;
+  for (;;) {
+    node = &model->nodes[id];
+    k = tree_find(node, &row);
+    id = node->first_child + k;
+    if (row == 0)
+      break;
+    row--; /* Skip the child's own row */
+  }
+  *out_node = id;
+  return CMP_SUCCESS;
+}
+
+int cmp_tree_model_get_row_of_node(const cmp_tree_model_t *model, size_t node,
+                                   size_t *out_row) {
+  if (!model || !out_row || node >= model->count || node == CMP_TREE_ROOT)
+    return CMP_ERROR_INVALID_ARG;
+  return tree_row_of(model, node, out_row);
+}
+
+int cmp_tree_model_get_info(const cmp_tree_model_t *model, size_t node,
+                            cmp_tree_node_info_t *out_info) {
+  const tree_node_t *n;
+  if (!model || !out_info || node >= model->count)
+    return CMP_ERROR_INVALID_ARG;
+  n = &model->nodes[node];
+  out_info->label = n->label;
+  out_info->parent = n->parent;
+  out_info->depth = n->depth;
+  out_info->first_child = n->child_count ? n->first_child : CMP_TREE_NONE;
+  out_info->child_count = n->child_count;
+  out_info->visible_rows = node == CMP_TREE_ROOT ? n->below : tree_rows(n);
+  out_info->has_children = (n->flags & TREE_HAS_CHILDREN) != 0;
+  out_info->is_expanded = (n->flags & TREE_EXPANDED) != 0;
+  out_info->is_loading = (n->flags & TREE_LOADING) != 0;
+  return CMP_SUCCESS;
+}
@@ -4,12 +4,260 @@
 #include <string.h>
 /* clang-format on */
 
+/* History is a list of edit records rather than document copies. A record
+ * replaces del_len bytes at offset with ins_len bytes and keeps both byte
+ * runs, so it can be applied in either direction. Records that arrive
+ * within the grouping window share a group and undo as one step. The
+ * total size of all records is held under a byte budget by dropping the
+ * oldest groups, so depth is limited only by how much text was edited. */
+
+#define UR_DEFAULT_BUDGET (4u * 1024u * 1024u)
+#define UR_DEFAULT_WINDOW_MS 500.0
+
+typedef struct ur_record {
+  struct ur_record *prev; /* Older record (undo list only) */
+  struct ur_record *next; /* Newer record, or next one down the redo stack */
+  unsigned long group;
+  size_t offset;
+  size_t del_len;
+  size_t ins_len;
+  size_t cap;
+  char *text; /* Deleted bytes followed by inserted bytes */
+} ur_record_t;
+
 struct cmp_undo_redo {
-  char *stack[10];
-  int count;
-  int position;
+  ur_record_t *oldest;
+  ur_record_t *newest;
+  ur_record_t *redo; /* Top of the redo stack */
+  size_t bytes;      /* Records on both stacks */
+  size_t budget;
+  size_t undo_groups;
+  size_t redo_groups;
+  double window_ms;
+  double last_time_ms;
+  unsigned long next_group;
+  int group_open; /* The newest group may still take edits */
+
+  /* Document for the state-based push/undo/redo calls */
+  cmp_text_buffer_t *states;
 };
 
+static size_t ur_cost(const ur_record_t *r) {
+  return sizeof(ur_record_t) + r->cap;
+}
+
+static void ur_free(struct cmp_undo_redo *ur, ur_record_t *r) {
+  ur->bytes -= ur_cost(r);
+  CMP_FREE(r);
+}
+
+static void ur_clear_redo(struct cmp_undo_redo *ur) {
+  while (ur->redo) {
+    ur_record_t *r = ur->redo;
+    ur->redo = r->next;
+    ur_free(ur, r);
+  }
+  ur->redo_groups = 0;
+}
+
+/* Drops whole groups from the old end until the history fits the budget.
+ * The newest group always survives so the latest edit can be undone. */
+static void ur_enforce_budget(struct cmp_undo_redo *ur) {
+  while (ur->bytes > ur->budget && ur->oldest &&
+         ur->oldest->group != ur->newest->group) {
+    unsigned long group = ur->oldest->group;
+    while (ur->oldest->group == group) {
+      ur_record_t *r = ur->oldest;
+      ur->oldest = r->next;
+      ur->oldest->prev = NULL;
+      ur_free(ur, r);
+    }
+    ur->undo_groups--;
+  }
+}
+
+static ur_record_t *ur_alloc(size_t cap) {
+  ur_record_t *r;
+  if (CMP_MALLOC(sizeof(ur_record_t) + cap, (void **)&r) != CMP_SUCCESS)
+    return NULL;
+  memset(r, 0, sizeof(ur_record_t));
+  r->cap = cap;
+  r->text = (char *)(r + 1);
+  return r;
+}
+
+/* Grows the newest record so it can hold extra more bytes. The record may
+ * move; list links are fixed up. */
+static int ur_grow_newest(struct cmp_undo_redo *ur, size_t extra) {
+  ur_record_t *old = ur->newest;
+  ur_record_t *r;
+  size_t need = old->del_len + old->ins_len + extra;
+  size_t cap;
+  if (need <= old->cap)
+    return CMP_SUCCESS;
+  cap = old->cap * 2;
+  if (cap < need)
+    cap = need;
+  r = ur_alloc(cap);
+  if (!r)
+    return CMP_ERROR_OOM;
+  r->prev = old->prev;
+  r->group = old->group;
+  r->offset = old->offset;
+  r->del_len = old->del_len;
+  r->ins_len = old->ins_len;
+  memcpy(r->text, old->text, old->del_len + old->ins_len);
+  if (r->prev)
+    r->prev->next = r;
+  else
+    ur->oldest = r;
+  ur->newest = r;
+  ur->bytes += ur_cost(r);
+  ur_free(ur, old);
+  return CMP_SUCCESS;
+}
+
+/* Extends the newest record when the edit continues it: typing right after
+ * an insert, or forward-deleting at the same offset. */
+static int ur_try_coalesce(struct cmp_undo_redo *ur, size_t offset,
+                           const char *removed, size_t del_len,
+                           const char *inserted, size_t ins_len) {
+  ur_record_t *r = ur->newest;
+  if (!r || !ur->group_open)
+    return 0;
+  if (del_len == 0 && r->del_len == 0 && offset == r->offset + r->ins_len) {
+    if (ur_grow_newest(ur, ins_len) != CMP_SUCCESS)
+      return 0;
+    r = ur->newest;
+    memcpy(r->text + r->ins_len, inserted, ins_len);
+    r->ins_len += ins_len;
+    return 1;
+  }
+  if (ins_len == 0 && r->ins_len == 0 && offset == r->offset) {
+    if (ur_grow_newest(ur, del_len) != CMP_SUCCESS)
+      return 0;
+    r = ur->newest;
+    memcpy(r->text + r->del_len, removed, del_len);
+    r->del_len += del_len;
+    return 1;
+  }
+  return 0;
+}
+
+static int ur_record(struct cmp_undo_redo *ur, size_t offset,
+                     const char *removed, size_t del_len,
+                     const char *inserted, size_t ins_len, double time_ms) {
+  ur_record_t *r;
+
+  ur_clear_redo(ur);
+  if (ur->group_open && time_ms - ur->last_time_ms > ur->window_ms)
+    ur->group_open = 0;
+  ur->last_time_ms = time_ms;
+
+  if (!ur_try_coalesce(ur, offset, removed, del_len, inserted, ins_len)) {
+    r = ur_alloc(del_len + ins_len);
+    if (!r)
+      return CMP_ERROR_OOM;
+    r->offset = offset;
+    r->del_len = del_len;
+    r->ins_len = ins_len;
+    if (del_len)
+      memcpy(r->text, removed, del_len);
+    if (ins_len)
+      memcpy(r->text + del_len, inserted, ins_len);
+    if (!ur->group_open) {
+      r->group = ur->next_group++;
+      ur->undo_groups++;
+      ur->group_open = 1;
+    } else {
+      r->group = ur->newest->group;
+    }
+    r->prev = ur->newest;
+    if (ur->newest)
+      ur->newest->next = r;
+    else
+      ur->oldest = r;
+    ur->newest = r;
+    ur->bytes += ur_cost(r);
+  }
+  ur_enforce_budget(ur);
+  return CMP_SUCCESS;
+}
+
+/* Applies a record forwards (redo) or backwards (undo). */
+static int ur_apply(cmp_text_buffer_t *buffer, const ur_record_t *r,
+                    int forward, size_t *out_caret) {
+  size_t remove = forward ? r->del_len : r->ins_len;
+  size_t add = forward ? r->ins_len : r->del_len;
+  const char *bytes = forward ? r->text + r->del_len : r->text;
+  int res = cmp_text_buffer_delete(buffer, r->offset, remove);
+  if (res != CMP_SUCCESS)
+    return res;
+  res = cmp_text_buffer_insert(buffer, r->offset, bytes, add);
+  if (res != CMP_SUCCESS)
+    return res;
+  *out_caret = r->offset + add;
+  return CMP_SUCCESS;
+}
+
+static int ur_undo(struct cmp_undo_redo *ur, cmp_text_buffer_t *buffer,
+                   size_t *out_caret) {
+  unsigned long group;
+  size_t caret = 0;
+  if (!ur->newest)
+    return CMP_ERROR_INVALID_STATE;
+  group = ur->newest->group;
+  while (ur->newest && ur->newest->group == group) {
+    ur_record_t *r = ur->newest;
+    int res = ur_apply(buffer, r, 0, &caret);
+    if (res != CMP_SUCCESS)
+      return res;
+    ur->newest = r->prev;
+    if (ur->newest)
+      ur->newest->next = NULL;
+    else
+      ur->oldest = NULL;
+    r->prev = NULL;
+    r->next = ur->redo;
+    ur->redo = r;
+  }
+  ur->undo_groups--;
+  ur->redo_groups++;
+  ur->group_open = 0;
+  if (out_caret)
+    *out_caret = caret;
+  return CMP_SUCCESS;
+}
+
+static int ur_redo(struct cmp_undo_redo *ur, cmp_text_buffer_t *buffer,
+                   size_t *out_caret) {
+  unsigned long group;
+  size_t caret = 0;
+  if (!ur->redo)
+    return CMP_ERROR_INVALID_STATE;
+  group = ur->redo->group;
+  while (ur->redo && ur->redo->group == group) {
+    ur_record_t *r = ur->redo;
+    int res = ur_apply(buffer, r, 1, &caret);
+    if (res != CMP_SUCCESS)
+      return res;
+    ur->redo = r->next;
+    r->next = NULL;
+    r->prev = ur->newest;
+    if (ur->newest)
+      ur->newest->next = r;
+    else
+      ur->oldest = r;
+    ur->newest = r;
+  }
+  ur->redo_groups--;
+  ur->undo_groups++;
+  ur->group_open = 0;
+  if (out_caret)
+    *out_caret = caret;
+  return CMP_SUCCESS;
+}
+
 int cmp_undo_redo_create(cmp_undo_redo_t **out_stack) {
   struct cmp_undo_redo *stack;
 
@@ -20,6 +268,8 @@ int cmp_undo_redo_create(cmp_undo_redo_t **out_stack) {
     return CMP_ERROR_OOM;
 
   memset(stack, 0, sizeof(struct cmp_undo_redo));
+  stack->budget = UR_DEFAULT_BUDGET;
+  stack->window_ms = UR_DEFAULT_WINDOW_MS;
 
   *out_stack = (cmp_undo_redo_t *)stack;
   return CMP_SUCCESS;
@@ -27,69 +277,205 @@ int cmp_undo_redo_create(cmp_undo_redo_t **out_stack) {
 
 int cmp_undo_redo_destroy(cmp_undo_redo_t *stack) {
   struct cmp_undo_redo *internal_stack = (struct cmp_undo_redo *)stack;
-  int i;
   if (!internal_stack)
     return CMP_ERROR_INVALID_ARG;
 
-  for (i = 0; i < internal_stack->count; ++i) {
-    if (internal_stack->stack[i]) {
-      CMP_FREE(internal_stack->stack[i]);
-    }
+  ur_clear_redo(internal_stack);
+  while (internal_stack->oldest) {
+    ur_record_t *r = internal_stack->oldest;
+    internal_stack->oldest = r->next;
+    ur_free(internal_stack, r);
   }
+  if (internal_stack->states)
+    cmp_text_buffer_destroy(internal_stack->states);
 
   CMP_FREE(internal_stack);
   return CMP_SUCCESS;
 }
 
-int cmp_undo_redo_push(cmp_undo_redo_t *stack, const char *state) {
+int cmp_undo_redo_set_budget(cmp_undo_redo_t *stack, size_t max_bytes) {
+  struct cmp_undo_redo *internal_stack = (struct cmp_undo_redo *)stack;
+  if (!internal_stack || max_bytes == 0)
+    return CMP_ERROR_INVALID_ARG;
+  internal_stack->budget = max_bytes;
+  if (internal_stack->newest)
+    ur_enforce_budget(internal_stack);
+  return CMP_SUCCESS;
+}
+
+int cmp_undo_redo_set_group_window(cmp_undo_redo_t *stack, double window_ms) {
+  struct cmp_undo_redo *internal_stack = (struct cmp_undo_redo *)stack;
+  if (!internal_stack || window_ms < 0.0)
+    return CMP_ERROR_INVALID_ARG;
+  internal_stack->window_ms = window_ms;
+  return CMP_SUCCESS;
+}
+
+int cmp_undo_redo_break_group(cmp_undo_redo_t *stack) {
+  struct cmp_undo_redo *internal_stack = (struct cmp_undo_redo *)stack;
+  if (!internal_stack)
+    return CMP_ERROR_INVALID_ARG;
+  internal_stack->group_open = 0;
+  return CMP_SUCCESS;
+}
+
+int cmp_undo_redo_record_insert(cmp_undo_redo_t *stack, size_t offset,
+                                const char *text, size_t len,
+                                double time_ms) {
+  struct cmp_undo_redo *internal_stack = (struct cmp_undo_redo *)stack;
+  if (!internal_stack || (!text && len > 0))
+    return CMP_ERROR_INVALID_ARG;
+  if (len == 0)
+    return CMP_SUCCESS;
+  return ur_record(internal_stack, offset, NULL, 0, text, len, time_ms);
+}
+
+int cmp_undo_redo_record_delete(cmp_undo_redo_t *stack, size_t offset,
+                                const char *removed, size_t len,
+                                double time_ms) {
   struct cmp_undo_redo *internal_stack = (struct cmp_undo_redo *)stack;
+  if (!internal_stack || (!removed && len > 0))
+    return CMP_ERROR_INVALID_ARG;
+  if (len == 0)
+    return CMP_SUCCESS;
+  return ur_record(internal_stack, offset, removed, len, NULL, 0, time_ms);
+}
+
+int cmp_undo_redo_undo_edits(cmp_undo_redo_t *stack,
+                             cmp_text_buffer_t *buffer, size_t *out_caret) {
+  struct cmp_undo_redo *internal_stack = (struct cmp_undo_redo *)stack;
+  if (!internal_stack || !buffer)
+    return CMP_ERROR_INVALID_ARG;
+  return ur_undo(internal_stack, buffer, out_caret);
+}
+
+int cmp_undo_redo_redo_edits(cmp_undo_redo_t *stack,
+                             cmp_text_buffer_t *buffer, size_t *out_caret) {
+  struct cmp_undo_redo *internal_stack = (struct cmp_undo_redo *)stack;
+  if (!internal_stack || !buffer)
+    return CMP_ERROR_INVALID_ARG;
+  return ur_redo(internal_stack, buffer, out_caret);
+}
+
+int cmp_undo_redo_get_stats(const cmp_undo_redo_t *stack,
+                            size_t *out_undo_steps, size_t *out_redo_steps,
+                            size_t *out_bytes) {
+  const struct cmp_undo_redo *internal_stack =
+      (const struct cmp_undo_redo *)stack;
+  if (!internal_stack)
+    return CMP_ERROR_INVALID_ARG;
+  if (out_undo_steps)
+    *out_undo_steps = internal_stack->undo_groups;
+  if (out_redo_steps)
+    *out_redo_steps = internal_stack->redo_groups;
+  if (out_bytes)
+    *out_bytes = internal_stack->bytes;
+  return CMP_SUCCESS;
+}
+
+/* Copies the tracked document into a caller buffer, truncating if needed. */
+static int ur_copy_state(struct cmp_undo_redo *ur, char *out_buffer,
+                         size_t out_capacity) {
   size_t len;
-  char *new_state = NULL;
+  cmp_text_buffer_get_length(ur->states, &len);
+  if (len > out_capacity - 1)
+    len = out_capacity - 1;
+  cmp_text_buffer_read(ur->states, 0, len, out_buffer);
+  out_buffer[len] = '\0';
+  return CMP_SUCCESS;
+}
+
+int cmp_undo_redo_push(cmp_undo_redo_t *stack, const char *state) {
+  struct cmp_undo_redo *internal_stack = (struct cmp_undo_redo *)stack;
+  cmp_text_buffer_t *doc;
+  size_t len, cur_len, prefix = 0, suffix = 0, del_len, ins_len, off;
+  char *removed = NULL;
+  int res;
 
   if (!internal_stack || !state)
     return CMP_ERROR_INVALID_ARG;
 
-  if (internal_stack->count >= 10) {
-    /* Simple drop oldest for stub */
-    if (internal_stack->stack[0]) {
-      CMP_FREE(internal_stack->stack[0]);
-    }
-    memmove(&internal_stack->stack[0], &internal_stack->stack[1],
-            9 * sizeof(char *));
-    internal_stack->count--;
-  }
+  if (!internal_stack->states &&
+      cmp_text_buffer_create(&internal_stack->states) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  doc = internal_stack->states;
 
+  /* Only the span between the common prefix and suffix is recorded */
   len = strlen(state);
-  if (CMP_MALLOC(len + 1, (void **)&new_state) != CMP_SUCCESS)
-    return CMP_ERROR_OOM;
+  cmp_text_buffer_get_length(doc, &cur_len);
+  off = 0;
+  while (off < cur_len && prefix == off) {
+    const char *chunk;
+    size_t chunk_len, i;
+    cmp_text_buffer_get_chunk(doc, off, &chunk, &chunk_len);
+    for (i = 0; i < chunk_len && prefix < len && chunk[i] == state[prefix];
+         ++i)
+      prefix++;
+    off += chunk_len;
+  }
+  while (suffix < cur_len - prefix && suffix < len - prefix) {
+    char c;
+    cmp_text_buffer_read(doc, cur_len - suffix - 1, 1, &c);
+    if (c != state[len - suffix - 1])
+      break;
+    suffix++;
+  }
+  del_len = cur_len - prefix - suffix;
+  ins_len = len - prefix - suffix;
+
+  if (del_len > 0) {
+    if (CMP_MALLOC(del_len, (void **)&removed) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    cmp_text_buffer_read(doc, prefix, del_len, removed);
+  }
 
-  strcpy(new_state, state);
-  internal_stack->stack[internal_stack->count++] = new_state;
-  internal_stack->position = internal_stack->count;
+  /* Each pushed state is its own undo step, even an unchanged one */
+  internal_stack->group_open = 0;
+  res = ur_record(internal_stack, prefix, removed, del_len, state + prefix,
+                  ins_len, 0.0);
+  internal_stack->group_open = 0;
+  if (removed)
+    CMP_FREE(removed);
+  if (res != CMP_SUCCESS)
+    return res;
 
-  return CMP_SUCCESS;
+  res = cmp_text_buffer_delete(doc, prefix, del_len);
+  if (res == CMP_SUCCESS)
+    res = cmp_text_buffer_insert(doc, prefix, state + prefix, ins_len);
+  return res;
 }
 
 int cmp_undo_redo_undo(cmp_undo_redo_t *stack, char *out_buffer,
                        size_t out_capacity) {
   struct cmp_undo_redo *internal_stack = (struct cmp_undo_redo *)stack;
+  int res;
 
   if (!internal_stack || !out_buffer || out_capacity == 0)
     return CMP_ERROR_INVALID_ARG;
 
-  if (internal_stack->position <= 0) {
+  if (!internal_stack->states || !internal_stack->newest) {
     return CMP_ERROR_INVALID_STATE; /* Nothing to undo */
   }
 
-  internal_stack->position--;
+  res = ur_undo(internal_stack, internal_stack->states, NULL);
+  if (res != CMP_SUCCESS)
+    return res;
+  return ur_copy_state(internal_stack, out_buffer, out_capacity);
+}
 
-  if (internal_stack->position > 0) {
-    strncpy(out_buffer, internal_stack->stack[internal_stack->position - 1],
-            out_capacity - 1);
-    out_buffer[out_capacity - 1] = '\0';
-  } else {
-    out_buffer[0] = '\0';
-  }
+int cmp_undo_redo_redo(cmp_undo_redo_t *stack, char *out_buffer,
+                       size_t out_capacity) {
+  struct cmp_undo_redo *internal_stack = (struct cmp_undo_redo *)stack;
+  int res;
 
-  return CMP_SUCCESS;
+  if (!internal_stack || !out_buffer || out_capacity == 0)
+    return CMP_ERROR_INVALID_ARG;
+
+  if (!internal_stack->states || !internal_stack->redo)
+    return CMP_ERROR_INVALID_STATE; /* Nothing to redo */
+
+  res = ur_redo(internal_stack, internal_stack->states, NULL);
+  if (res != CMP_SUCCESS)
+    return res;
+  return ur_copy_state(internal_stack, out_buffer, out_capacity);
 }
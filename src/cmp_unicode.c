@@ -0,0 +1,781 @@
+/* clang-format off */
+#include "cmp.h"
+#include <string.h>
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define UTF8_SSE2 1
+#endif
+/* clang-format on */
+
+/*
+ * UTF-8 validation and counting run 16 bytes at a time (SSE2) or a word at
+ * a time elsewhere. Segmentation follows UAX #29 (grapheme clusters, word
+ * boundaries) and UAX #14 (line breaks) with the property lookups from
+ * cmp_unicode_data.c. Break tests are stateless functions of a position
+ * and its neighbours, so moving backwards needs no rescan from the start.
+ * Malformed bytes are segmented as U+FFFD.
+ */
+
+extern const unsigned short cmp_unicode_combos[];
+extern const unsigned char cmp_unicode_stage1[];
+extern const unsigned char cmp_unicode_stage2[];
+
+#define UC_BLOCK_SHIFT 7
+#define UC_BLOCK_MASK 127UL
+#define UC_PICTOGRAPHIC 0x200
+#define UC_GB(p) ((p)&0xF)
+#define UC_WB(p) (((p) >> 4) & 0x1F)
+#define UC_LB(p) (((p) >> 10) & 0x1F)
+
+#define UTF8_INVALID 0x110000UL
+#define UTF8_ONES ((size_t)-1 / 0xFF)
+#define UTF8_HIGHS (UTF8_ONES * 0x80)
+
+/* Property values, in the order the tables were generated with */
+enum {
+  GB_OTHER,
+  GB_CR,
+  GB_LF,
+  GB_CONTROL,
+  GB_EXTEND,
+  GB_ZWJ,
+  GB_RI,
+  GB_PREPEND,
+  GB_SPACING_MARK,
+  GB_L,
+  GB_V,
+  GB_T,
+  GB_LV,
+  GB_LVT
+};
+
+enum {
+  WB_OTHER,
+  WB_CR,
+  WB_LF,
+  WB_NEWLINE,
+  WB_EXTEND,
+  WB_ZWJ,
+  WB_RI,
+  WB_FORMAT,
+  WB_KATAKANA,
+  WB_HEBREW_LETTER,
+  WB_ALETTER,
+  WB_SINGLE_QUOTE,
+  WB_DOUBLE_QUOTE,
+  WB_MIDNUMLET,
+  WB_MIDLETTER,
+  WB_MIDNUM,
+  WB_NUMERIC,
+  WB_EXTENDNUMLET,
+  WB_WSEGSPACE
+};
+
+enum {
+  LB_AL,
+  LB_BK,
+  LB_CR,
+  LB_LF,
+  LB_NL,
+  LB_SP,
+  LB_ZW,
+  LB_ZWJ,
+  LB_CM,
+  LB_GL,
+  LB_WJ,
+  LB_CL,
+  LB_CP,
+  LB_EX,
+  LB_IS,
+  LB_SY,
+  LB_OP,
+  LB_QU,
+  LB_NS,
+  LB_BA,
+  LB_HY,
+  LB_BB,
+  LB_B2,
+  LB_ID,
+  LB_EB,
+  LB_EM,
+  LB_HL,
+  LB_NU,
+  LB_PR,
+  LB_PO,
+  LB_RI,
+  LB_IN
+};
+
+static unsigned int uc_props(unsigned long cp) {
+  size_t i;
+  if (cp < 0x40000UL)
+    i = (size_t)cp;
+  else if (cp >= 0xE0000UL && cp < 0xE1000UL)
+    i = (size_t)(cp - 0xA0000UL);
+  else
+    return cmp_unicode_combos[0];
+  return cmp_unicode_combos[cmp_unicode_stage2
+                                [((size_t)cmp_unicode_stage1[i >>
+                                                             UC_BLOCK_SHIFT]
+                                  << UC_BLOCK_SHIFT) |
+                                 (i & UC_BLOCK_MASK)]];
+}
+
+/* ------------------------------------------------------------------------ */
+/* Decoding and validation                                                  */
+/* ------------------------------------------------------------------------ */
+
+/* Decodes the sequence starting at s. Malformed input yields UTF8_INVALID
+ * with *out_n covering the longest prefix that could have started a valid
+ * sequence (at least one byte). */
+static unsigned long utf8_decode(const unsigned char *s, size_t len,
+                                 size_t *out_n) {
+  unsigned long cp;
+  unsigned char lo = 0x80, hi = 0xBF, c = s[0];
+  size_t need, i;
+  *out_n = 1;
+  if (c < 0x80)
+    return c;
+  if (c < 0xC2 || c > 0xF4)
+    return UTF8_INVALID;
+  if (c < 0xE0) {
+    need = 1;
+    cp = c & 0x1F;
+  } else if (c < 0xF0) {
+    need = 2;
+    cp = c & 0x0F;
+    if (c == 0xE0)
+      lo = 0xA0;
+    else if (c == 0xED)
+      hi = 0x9F;
+  } else {
+    need = 3;
+    cp = c & 0x07;
+    if (c == 0xF0)
+      lo = 0x90;
+    else if (c == 0xF4)
+      hi = 0x8F;
+  }
+  for (i = 1; i <= need; ++i) {
+    if (i >= len || s[i] < lo || s[i] > hi) {
+      *out_n = i;
+      return UTF8_INVALID;
+    }
+    cp = (cp << 6) | (s[i] & 0x3F);
+    lo = 0x80;
+    hi = 0xBF;
+  }
+  *out_n = need + 1;
+  return cp;
+}
+
+/* Returns the start of the code point (or malformed byte) ending at pos. */
+static size_t utf8_back(const unsigned char *s, size_t pos) {
+  size_t i = pos - 1, n;
+  while (i > 0 && pos - i < 4 && (s[i] & 0xC0) == 0x80)
+    --i;
+  utf8_decode(s + i, pos - i, &n);
+  return n == pos - i ? i : pos - 1;
+}
+
+static size_t utf8_validate_scalar(const unsigned char *s, size_t len,
+                                   size_t i) {
+  size_t word, n;
+  while (i < len) {
+    if (s[i] < 0x80) {
+      while (i + sizeof(word) <= len) {
+        memcpy(&word, s + i, sizeof(word));
+        if (word & UTF8_HIGHS)
+          break;
+        i += sizeof(word);
+      }
+      while (i < len && s[i] < 0x80)
+        ++i;
+      continue;
+    }
+    if (utf8_decode(s + i, len - i, &n) == UTF8_INVALID)
+      return i;
+    i += n;
+  }
+  return len;
+}
+
+#ifdef UTF8_SSE2
+/* Per-byte unsigned a >= k, and a == k */
+#define UTF8_GE(a, k)                                                          \
+  _mm_cmpeq_epi8(_mm_max_epu8((a), _mm_set1_epi8((char)(k))), (a))
+#define UTF8_EQ(a, k) _mm_cmpeq_epi8((a), _mm_set1_epi8((char)(k)))
+
+/* Flags bytes of v that break UTF-8, given the previous 16 bytes: every
+ * byte one to three places after a lead must be a continuation and no
+ * other byte may be; leads C0, C1 and F5-FF never occur; and the byte
+ * after E0, ED, F0 and F4 is range-limited (overlongs, surrogates and code
+ * points above U+10FFFF). */
+static __m128i utf8_block_errors(__m128i v, __m128i prev) {
+  __m128i p1 = _mm_or_si128(_mm_slli_si128(v, 1), _mm_srli_si128(prev, 15));
+  __m128i p2 = _mm_or_si128(_mm_slli_si128(v, 2), _mm_srli_si128(prev, 14));
+  __m128i p3 = _mm_or_si128(_mm_slli_si128(v, 3), _mm_srli_si128(prev, 13));
+  __m128i cont = _mm_cmplt_epi8(v, _mm_set1_epi8((char)0xC0));
+  __m128i ge_a0 = UTF8_GE(v, 0xA0), ge_90 = UTF8_GE(v, 0x90);
+  __m128i need, err;
+  need = _mm_or_si128(UTF8_GE(p1, 0xC0),
+                      _mm_or_si128(UTF8_GE(p2, 0xE0), UTF8_GE(p3, 0xF0)));
+  err = _mm_xor_si128(need, cont);
+  err = _mm_or_si128(err, UTF8_GE(v, 0xF5));
+  err = _mm_or_si128(err, UTF8_EQ(_mm_and_si128(v, _mm_set1_epi8((char)0xFE)),
+                                  0xC0));
+  err = _mm_or_si128(err, _mm_andnot_si128(ge_a0, UTF8_EQ(p1, 0xE0)));
+  err = _mm_or_si128(err, _mm_and_si128(ge_a0, UTF8_EQ(p1, 0xED)));
+  err = _mm_or_si128(err, _mm_andnot_si128(ge_90, UTF8_EQ(p1, 0xF0)));
+  return _mm_or_si128(err, _mm_and_si128(ge_90, UTF8_EQ(p1, 0xF4)));
+}
+
+static size_t utf8_validate(const unsigned char *s, size_t len) {
+  /* Last three bytes of a block that leave a sequence open */
+  const __m128i open = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                     -1, -1, -1, (char)0xF0, (char)0xE0,
+                                     (char)0xC0);
+  __m128i prev = _mm_setzero_si128(), v;
+  size_t i, k;
+  for (i = 0; i + 16 <= len; i += 16) {
+    v = _mm_loadu_si128((const __m128i *)(const void *)(s + i));
+    if (_mm_movemask_epi8(v) == 0 &&
+        _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(prev, open), prev)) ==
+            0) {
+      prev = v;
+      continue;
+    }
+    if (_mm_movemask_epi8(utf8_block_errors(v, prev)))
+      break;
+    prev = v;
+  }
+  /* Locate the error, or check the tail, from the start of any sequence
+   * still open at i */
+  for (k = 1; k <= 3 && k <= i; ++k) {
+    if (s[i - k] >= 0xC0) {
+      i -= k;
+      break;
+    }
+    if (s[i - k] < 0x80)
+      break;
+  }
+  return utf8_validate_scalar(s, len, i);
+}
+
+static size_t utf8_count(const unsigned char *s, size_t len) {
+  const __m128i cont_max = _mm_set1_epi8((char)0xBF);
+  __m128i acc, zero = _mm_setzero_si128();
+  size_t i = 0, count = 0, n;
+  while (i + 16 <= len) {
+    acc = zero;
+    /* Each lane counts up to 255 lead bytes before it is folded */
+    for (n = 0; n < 255 && i + 16 <= len; ++n, i += 16)
+      acc = _mm_sub_epi8(
+          acc, _mm_cmpgt_epi8(_mm_loadu_si128((const __m128i *)(const void *)(
+                                  s + i)),
+                              cont_max));
+    acc = _mm_sad_epu8(acc, zero);
+    count += (size_t)_mm_cvtsi128_si32(acc) +
+             (size_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+  }
+  for (; i < len; ++i)
+    count += (s[i] & 0xC0) != 0x80;
+  return count;
+}
+#else
+static size_t utf8_validate(const unsigned char *s, size_t len) {
+  return utf8_validate_scalar(s, len, 0);
+}
+
+static size_t utf8_count(const unsigned char *s, size_t len) {
+  size_t i = 0, count = 0, word, cont;
+  for (; i + sizeof(word) <= len; i += sizeof(word)) {
+    memcpy(&word, s + i, sizeof(word));
+    /* Continuation bytes have the top bit set and the next one clear */
+    cont = ((word & ~(word << 1)) & UTF8_HIGHS) >> 7;
+    count += sizeof(word) -
+             (size_t)((cont * UTF8_ONES) >> ((sizeof(word) - 1) * 8));
+  }
+  for (; i < len; ++i)
+    count += (s[i] & 0xC0) != 0x80;
+  return count;
+}
+#endif
+
+/* ------------------------------------------------------------------------ */
+/* Property access by position                                              */
+/* ------------------------------------------------------------------------ */
+
+static unsigned int uc_at(const unsigned char *s, size_t len, size_t pos,
+                          size_t *out_n) {
+  return uc_props(utf8_decode(s + pos, len - pos, out_n));
+}
+
+/* Properties of the code point ending at pos; *out_start gets its start */
+static unsigned int uc_before(const unsigned char *s, size_t pos,
+                              size_t *out_start) {
+  size_t n;
+  *out_start = utf8_back(s, pos);
+  return uc_props(utf8_decode(s + *out_start, pos - *out_start, &n));
+}
+
+/* ------------------------------------------------------------------------ */
+/* Grapheme clusters (UAX #29)                                              */
+/* ------------------------------------------------------------------------ */
+
+/* emoji: 2 when prev is a ZWJ after Extended_Pictographic Extend*.
+ * ri: number of regional indicators in the run ending at prev. */
+static int grapheme_break(int prev, unsigned int next, int emoji, size_t ri) {
+  int cls = (int)UC_GB(next);
+  if (prev == GB_CR && cls == GB_LF)
+    return 0; /* GB3 */
+  if (prev == GB_CR || prev == GB_LF || prev == GB_CONTROL)
+    return 1; /* GB4 */
+  if (cls == GB_CR || cls == GB_LF || cls == GB_CONTROL)
+    return 1; /* GB5 */
+  if (prev == GB_L &&
+      (cls == GB_L || cls == GB_V || cls == GB_LV || cls == GB_LVT))
+    return 0; /* GB6 */
+  if ((prev == GB_LV || prev == GB_V) && (cls == GB_V || cls == GB_T))
+    return 0; /* GB7 */
+  if ((prev == GB_LVT || prev == GB_T) && cls == GB_T)
+    return 0; /* GB8 */
+  if (cls == GB_EXTEND || cls == GB_ZWJ || cls == GB_SPACING_MARK)
+    return 0; /* GB9, GB9a */
+  if (prev == GB_PREPEND)
+    return 0; /* GB9b */
+  if (emoji == 2 && (next & UC_PICTOGRAPHIC))
+    return 0; /* GB11 */
+  if (prev == GB_RI && cls == GB_RI)
+    return (ri & 1) == 0; /* GB12, GB13 */
+  return 1;
+}
+
+static size_t grapheme_next(const unsigned char *s, size_t len, size_t pos) {
+  unsigned int p;
+  size_t n, ri;
+  int prev, emoji;
+  /* Printable ASCII and LF followed by ASCII form a cluster of their own */
+  if (s[pos] < 0x80 && s[pos] != '\r' && (pos + 1 == len || s[pos + 1] < 0x80))
+    return pos + 1;
+  p = uc_at(s, len, pos, &n);
+  prev = (int)UC_GB(p);
+  emoji = (p & UC_PICTOGRAPHIC) ? 1 : 0;
+  ri = prev == GB_RI;
+  for (pos += n; pos < len; pos += n) {
+    p = uc_at(s, len, pos, &n);
+    if (grapheme_break(prev, p, emoji, ri))
+      break;
+    if (UC_GB(p) == GB_EXTEND && emoji == 1)
+      emoji = 1;
+    else if (UC_GB(p) == GB_ZWJ && emoji == 1)
+      emoji = 2;
+    else
+      emoji = (p & UC_PICTOGRAPHIC) ? 1 : 0;
+    prev = (int)UC_GB(p);
+    ri = prev == GB_RI ? ri + 1 : 0;
+  }
+  return pos;
+}
+
+/* Whether a cluster boundary falls at 0 < pos < len, looking back as far
+ * as GB11 and GB12/13 need. */
+static int grapheme_break_at(const unsigned char *s, size_t len,
+                             size_t pos) {
+  unsigned int next, p;
+  size_t n, at, ri = 0;
+  int prev, emoji = 0;
+  next = uc_at(s, len, pos, &n);
+  p = uc_before(s, pos, &at);
+  prev = (int)UC_GB(p);
+  if (prev == GB_ZWJ && (next & UC_PICTOGRAPHIC)) {
+    while (at > 0) {
+      p = uc_before(s, at, &at);
+      if (UC_GB(p) != GB_EXTEND) {
+        emoji = (p & UC_PICTOGRAPHIC) ? 2 : 0;
+        break;
+      }
+    }
+  } else if (prev == GB_RI && UC_GB(next) == GB_RI) {
+    ri = 1;
+    while (at > 0 && UC_GB(uc_before(s, at, &at)) == GB_RI)
+      ++ri;
+  }
+  return grapheme_break(prev, next, emoji, ri);
+}
+
+/* ------------------------------------------------------------------------ */
+/* Word boundaries (UAX #29)                                                */
+/* ------------------------------------------------------------------------ */
+
+#define WB_IGNORED(c) ((c) == WB_EXTEND || (c) == WB_FORMAT || (c) == WB_ZWJ)
+#define WB_AHLETTER(c) ((c) == WB_ALETTER || (c) == WB_HEBREW_LETTER)
+#define WB_MIDNUMLETQ(c) ((c) == WB_MIDNUMLET || (c) == WB_SINGLE_QUOTE)
+
+/* Word class of the last character before pos, skipping Extend, Format and
+ * ZWJ (WB4); *io_pos moves to its start. Returns WB_OTHER at the start of
+ * the text or when only ignorables follow a line break. */
+static int word_class_before(const unsigned char *s, size_t *io_pos) {
+  int cls;
+  while (*io_pos > 0) {
+    cls = (int)UC_WB(uc_before(s, *io_pos, io_pos));
+    if (!WB_IGNORED(cls))
+      return cls == WB_CR || cls == WB_LF || cls == WB_NEWLINE ? WB_OTHER
+                                                               : cls;
+  }
+  return WB_OTHER;
+}
+
+/* Word class of the first character at or after pos, skipping ignorables */
+static int word_class_after(const unsigned char *s, size_t len, size_t pos) {
+  size_t n;
+  int cls;
+  for (; pos < len; pos += n) {
+    cls = (int)UC_WB(uc_at(s, len, pos, &n));
+    if (!WB_IGNORED(cls))
+      return cls;
+  }
+  return WB_OTHER;
+}
+
+static int word_break_at(const unsigned char *s, size_t len, size_t pos) {
+  unsigned int a, b;
+  size_t n, at;
+  int A, B, A2, B2, ri;
+  if (pos == 0 || pos >= len)
+    return 1;
+  a = uc_at(s, len, pos, &n);
+  b = uc_before(s, pos, &at);
+  A = (int)UC_WB(a);
+  B = (int)UC_WB(b);
+  if (B == WB_CR && A == WB_LF)
+    return 0; /* WB3 */
+  if (B == WB_CR || B == WB_LF || B == WB_NEWLINE || A == WB_CR ||
+      A == WB_LF || A == WB_NEWLINE)
+    return 1; /* WB3a, WB3b */
+  if (B == WB_ZWJ && (a & UC_PICTOGRAPHIC))
+    return 0; /* WB3c */
+  if (B == WB_WSEGSPACE && A == WB_WSEGSPACE)
+    return 0; /* WB3d */
+  if (WB_IGNORED(A))
+    return 0; /* WB4 */
+
+  at = pos;
+  B = word_class_before(s, &at);
+  B2 = word_class_before(s, &at);
+  A2 = word_class_after(s, len, pos + n);
+  if (WB_AHLETTER(B) && WB_AHLETTER(A))
+    return 0; /* WB5 */
+  if (WB_AHLETTER(B) && (A == WB_MIDLETTER || WB_MIDNUMLETQ(A)) &&
+      WB_AHLETTER(A2))
+    return 0; /* WB6 */
+  if (WB_AHLETTER(B2) && (B == WB_MIDLETTER || WB_MIDNUMLETQ(B)) &&
+      WB_AHLETTER(A))
+    return 0; /* WB7 */
+  if (B == WB_HEBREW_LETTER && A == WB_SINGLE_QUOTE)
+    return 0; /* WB7a */
+  if (B == WB_HEBREW_LETTER && A == WB_DOUBLE_QUOTE &&
+      A2 == WB_HEBREW_LETTER)
+    return 0; /* WB7b */
+  if (B2 == WB_HEBREW_LETTER && B == WB_DOUBLE_QUOTE &&
+      A == WB_HEBREW_LETTER)
+    return 0; /* WB7c */
+  if ((B == WB_NUMERIC || WB_AHLETTER(B)) &&
+      (A == WB_NUMERIC || WB_AHLETTER(A)))
+    return 0; /* WB8, WB9, WB10 */
+  if (B2 == WB_NUMERIC && (B == WB_MIDNUM || WB_MIDNUMLETQ(B)) &&
+      A == WB_NUMERIC)
+    return 0; /* WB11 */
+  if (B == WB_NUMERIC && (A == WB_MIDNUM || WB_MIDNUMLETQ(A)) &&
+      A2 == WB_NUMERIC)
+    return 0; /* WB12 */
+  if (B == WB_KATAKANA && A == WB_KATAKANA)
+    return 0; /* WB13 */
+  if ((WB_AHLETTER(B) || B == WB_NUMERIC || B == WB_KATAKANA ||
+       B == WB_EXTENDNUMLET) &&
+      A == WB_EXTENDNUMLET)
+    return 0; /* WB13a */
+  if (B == WB_EXTENDNUMLET &&
+      (WB_AHLETTER(A) || A == WB_NUMERIC || A == WB_KATAKANA))
+    return 0; /* WB13b */
+  if (B == WB_RI && A == WB_RI) {
+    at = pos;
+    ri = 0;
+    while (word_class_before(s, &at) == WB_RI)
+      ++ri;
+    return (ri & 1) == 0; /* WB15, WB16 */
+  }
+  return 1;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Line breaks (UAX #14)                                                    */
+/* ------------------------------------------------------------------------ */
+
+#define LB_HARD(c)                                                             \
+  ((c) == LB_BK || (c) == LB_CR || (c) == LB_LF || (c) == LB_NL)
+#define LB_ALPHA(c) ((c) == LB_AL || (c) == LB_HL)
+
+/* Line class of the character ending at pos with combining marks resolved
+ * to their base (LB9) or to AL when they have none (LB10). *io_pos moves to
+ * the start of the base. */
+static int line_class_before(const unsigned char *s, size_t *io_pos) {
+  size_t at = *io_pos;
+  int cls = LB_AL;
+  if (at == 0)
+    return -1;
+  cls = (int)UC_LB(uc_before(s, at, &at));
+  *io_pos = at;
+  if (cls != LB_CM && cls != LB_ZWJ)
+    return cls;
+  while (at > 0) {
+    cls = (int)UC_LB(uc_before(s, at, &at));
+    if (cls == LB_CM || cls == LB_ZWJ)
+      continue;
+    if (LB_HARD(cls) || cls == LB_SP || cls == LB_ZW)
+      return LB_AL;
+    *io_pos = at;
+    return cls;
+  }
+  return LB_AL;
+}
+
+static int line_break_at(const unsigned char *s, size_t len, size_t pos,
+                         int *out_mandatory) {
+  size_t n, at = pos;
+  int A, B, Bs, raw, before, ri;
+  *out_mandatory = 0;
+  A = (int)UC_LB(uc_at(s, len, pos, &n));
+  raw = (int)UC_LB(uc_before(s, pos, &at));
+  if (raw == LB_CR && A == LB_LF)
+    return 0; /* LB5 */
+  if (LB_HARD(raw)) {
+    *out_mandatory = 1;
+    return 1; /* LB4, LB5 */
+  }
+  if (LB_HARD(A) || A == LB_SP || A == LB_ZW)
+    return 0; /* LB6, LB7 */
+  at = pos;
+  B = line_class_before(s, &at);
+  Bs = B;
+  while (Bs == LB_SP)
+    Bs = line_class_before(s, &at);
+  if (Bs == LB_ZW)
+    return 1; /* LB8 */
+  if (raw == LB_ZWJ)
+    return 0; /* LB8a */
+  if (A == LB_CM || A == LB_ZWJ) {
+    if (B != LB_SP)
+      return 0; /* LB9 */
+    A = LB_AL;  /* LB10 */
+  }
+  if (A == LB_WJ || B == LB_WJ)
+    return 0; /* LB11 */
+  if (B == LB_GL)
+    return 0; /* LB12 */
+  if (A == LB_GL && B != LB_SP && B != LB_BA && B != LB_HY)
+    return 0; /* LB12a */
+  if (A == LB_CL || A == LB_CP || A == LB_EX || A == LB_IS || A == LB_SY)
+    return 0; /* LB13 */
+  if (Bs == LB_OP)
+    return 0; /* LB14 */
+  if (Bs == LB_QU && A == LB_OP)
+    return 0; /* LB15 */
+  if ((Bs == LB_CL || Bs == LB_CP) && A == LB_NS)
+    return 0; /* LB16 */
+  if (Bs == LB_B2 && A == LB_B2)
+    return 0; /* LB17 */
+  if (B == LB_SP)
+    return 1; /* LB18 */
+  if (A == LB_QU || B == LB_QU)
+    return 0; /* LB19 */
+  if (A == LB_BA || A == LB_HY || A == LB_NS || B == LB_BB)
+    return 0; /* LB21 */
+  at = pos;
+  line_class_before(s, &at);
+  before = line_class_before(s, &at);
+  if ((B == LB_HY || B == LB_BA) && before == LB_HL)
+    return 0; /* LB21a */
+  if (B == LB_SY && A == LB_HL)
+    return 0; /* LB21b */
+  if (A == LB_IN)
+    return 0; /* LB22 */
+  if ((LB_ALPHA(B) && A == LB_NU) || (B == LB_NU && LB_ALPHA(A)))
+    return 0; /* LB23 */
+  if ((B == LB_PR && (A == LB_ID || A == LB_EB || A == LB_EM)) ||
+      ((B == LB_ID || B == LB_EB || B == LB_EM) && A == LB_PO))
+    return 0; /* LB23a */
+  if (((B == LB_PR || B == LB_PO) && LB_ALPHA(A)) ||
+      (LB_ALPHA(B) && (A == LB_PR || A == LB_PO)))
+    return 0; /* LB24 */
+  if (((B == LB_CL || B == LB_CP || B == LB_NU) &&
+       (A == LB_PO || A == LB_PR)) ||
+      ((B == LB_PO || B == LB_PR) && (A == LB_OP || A == LB_NU)) ||
+      ((B == LB_HY || B == LB_IS || B == LB_NU || B == LB_SY) &&
+       A == LB_NU))
+    return 0; /* LB25, pair form */
+  if (LB_ALPHA(B) && LB_ALPHA(A))
+    return 0; /* LB28 */
+  if (B == LB_IS && LB_ALPHA(A))
+    return 0; /* LB29 */
+  if (((LB_ALPHA(B) || B == LB_NU) && A == LB_OP) ||
+      (B == LB_CP && (LB_ALPHA(A) || A == LB_NU)))
+    return 0; /* LB30 */
+  if (B == LB_RI && A == LB_RI) {
+    at = pos;
+    ri = 0;
+    while (line_class_before(s, &at) == LB_RI)
+      ++ri;
+    return (ri & 1) == 0; /* LB30a */
+  }
+  if (B == LB_EB && A == LB_EM)
+    return 0; /* LB30b */
+  return 1;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Public API                                                               */
+/* ------------------------------------------------------------------------ */
+
+int cmp_utf8_validate(const char *text, size_t len, size_t *out_valid_len) {
+  if ((!text && len) || !out_valid_len)
+    return CMP_ERROR_INVALID_ARG;
+  *out_valid_len = len ? utf8_validate((const unsigned char *)text, len) : 0;
+  return CMP_SUCCESS;
+}
+
+int cmp_utf8_count_codepoints(const char *text, size_t len,
+                              size_t *out_count) {
+  if ((!text && len) || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  *out_count = len ? utf8_count((const unsigned char *)text, len) : 0;
+  return CMP_SUCCESS;
+}
+
+int cmp_utf8_decode(const char *text, size_t len, size_t offset,
+                    unsigned long *out_codepoint, size_t *out_next) {
+  unsigned long cp;
+  size_t n;
+  if (!text || !out_codepoint || !out_next)
+    return CMP_ERROR_INVALID_ARG;
+  if (offset >= len)
+    return CMP_ERROR_BOUNDS;
+  cp = utf8_decode((const unsigned char *)text + offset, len - offset, &n);
+  *out_codepoint = cp == UTF8_INVALID ? 0xFFFDUL : cp;
+  *out_next = offset + n;
+  return CMP_SUCCESS;
+}
+
+int cmp_utf8_next_grapheme(const char *text, size_t len, size_t offset,
+                           size_t *out_offset) {
+  if ((!text && len) || !out_offset)
+    return CMP_ERROR_INVALID_ARG;
+  if (offset > len)
+    return CMP_ERROR_BOUNDS;
+  *out_offset = offset == len ? len
+                              : grapheme_next((const unsigned char *)text,
+                                              len, offset);
+  return CMP_SUCCESS;
+}
+
+int cmp_utf8_prev_grapheme(const char *text, size_t len, size_t offset,
+                           size_t *out_offset) {
+  const unsigned char *s = (const unsigned char *)text;
+  size_t pos;
+  if ((!text && len) || !out_offset)
+    return CMP_ERROR_INVALID_ARG;
+  if (offset > len)
+    return CMP_ERROR_BOUNDS;
+  pos = offset;
+  if (pos > 0)
+    pos = utf8_back(s, pos);
+  while (pos > 0 && !grapheme_break_at(s, len, pos))
+    pos = utf8_back(s, pos);
+  *out_offset = pos;
+  return CMP_SUCCESS;
+}
+
+int cmp_utf8_count_graphemes(const char *text, size_t len,
+                             size_t *out_count) {
+  const unsigned char *s = (const unsigned char *)text;
+  size_t pos = 0, count = 0;
+  if ((!text && len) || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  while (pos < len) {
+    pos = grapheme_next(s, len, pos);
+    ++count;
+  }
+  *out_count = count;
+  return CMP_SUCCESS;
+}
+
+int cmp_utf8_next_word_boundary(const char *text, size_t len, size_t offset,
+                                size_t *out_offset, int *out_is_word) {
+  const unsigned char *s = (const unsigned char *)text;
+  unsigned int p;
+  size_t n, pos;
+  int cls;
+  if ((!text && len) || !out_offset)
+    return CMP_ERROR_INVALID_ARG;
+  if (offset > len)
+    return CMP_ERROR_BOUNDS;
+  if (out_is_word)
+    *out_is_word = 0;
+  if (offset == len) {
+    *out_offset = len;
+    return CMP_SUCCESS;
+  }
+  p = uc_at(s, len, offset, &n);
+  if (out_is_word) {
+    cls = (int)UC_WB(p);
+    *out_is_word = WB_AHLETTER(cls) || cls == WB_NUMERIC ||
+                   cls == WB_KATAKANA || cls == WB_EXTENDNUMLET ||
+                   UC_LB(p) == LB_ID;
+  }
+  for (pos = offset + n; pos < len && !word_break_at(s, len, pos); pos += n)
+    uc_at(s, len, pos, &n);
+  *out_offset = pos;
+  return CMP_SUCCESS;
+}
+
+int cmp_utf8_prev_word_boundary(const char *text, size_t len, size_t offset,
+                                size_t *out_offset) {
+  const unsigned char *s = (const unsigned char *)text;
+  size_t pos;
+  if ((!text && len) || !out_offset)
+    return CMP_ERROR_INVALID_ARG;
+  if (offset > len)
+    return CMP_ERROR_BOUNDS;
+  pos = offset;
+  if (pos > 0)
+    pos = utf8_back(s, pos);
+  while (pos > 0 && !word_break_at(s, len, pos))
+    pos = utf8_back(s, pos);
+  *out_offset = pos;
+  return CMP_SUCCESS;
+}
+
+int cmp_utf8_next_line_break(const char *text, size_t len, size_t offset,
+                             size_t *out_offset, int *out_mandatory) {
+  const unsigned char *s = (const unsigned char *)text;
+  size_t pos, n;
+  int mandatory = 1;
+  if ((!text && len) || !out_offset)
+    return CMP_ERROR_INVALID_ARG;
+  if (offset > len)
+    return CMP_ERROR_BOUNDS;
+  pos = offset;
+  if (pos < len) {
+    uc_at(s, len, pos, &n);
+    for (pos += n; pos < len && !line_break_at(s, len, pos, &mandatory);
+         pos += n)
+      uc_at(s, len, pos, &n);
+    if (pos == len)
+      mandatory = 1; /* LB3 */
+  }
+  if (out_mandatory)
+    *out_mandatory = mandatory;
+  *out_offset = pos;
+  return CMP_SUCCESS;
+}
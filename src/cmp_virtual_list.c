@@ -0,0 +1,722 @@
+/* clang-format off */
+#include "cmp.h"
+#include <stdlib.h>
+#include <string.h>
+/* clang-format on */
+
+/*
+ * Only the rows inside the viewport (plus overscan) have nodes. Rows are
+ * laid out from prefix sums of their heights: every row starts at the
+ * data source's estimate and a Fenwick tree over rows holds the measured
+ * difference, so offset <-> row conversions are O(log n) and a list whose
+ * rows all match the estimate never allocates it. Cells leaving the
+ * window go to a pool and are rebound by the next row of the same type.
+ */
+
+typedef struct vlist_cell {
+  cmp_ui_node_t *node;
+  int type;
+} vlist_cell_t;
+
+/* A still-attached cell carried across a diff under its new index */
+typedef struct vlist_kept {
+  vlist_cell_t cell;
+  size_t index;
+  int stale; /* Reloaded, needs binding again */
+} vlist_kept_t;
+
+struct cmp_virtual_list {
+  cmp_ui_node_t *container;
+  cmp_virtual_list_source_t source;
+  size_t columns;
+  size_t count; /* Items */
+  size_t rows;
+  size_t top_bit; /* Largest power of two <= rows */
+  float estimate;
+  double *deltas; /* 1-based Fenwick tree of height - estimate per row */
+  int remeasured;  /* A row height changed since the window was computed */
+
+  float width;
+  float height;
+  double scroll;
+  size_t overscan; /* Rows kept on each side of the viewport */
+
+  /* Bound cells for items [first, first + active_count) */
+  size_t first;
+  vlist_cell_t *active;
+  size_t active_count;
+  size_t active_cap;
+
+  vlist_cell_t *pool;
+  size_t pool_count;
+  size_t pool_cap;
+
+  vlist_kept_t *kept; /* Only set while a diff is applied */
+  size_t kept_count;
+};
+
+/* ------------------------------------------------------------------------ */
+/* Row heights                                                              */
+/* ------------------------------------------------------------------------ */
+
+/* Height of rows [0, row) */
+static double vlist_offset(const struct cmp_virtual_list *list, size_t row) {
+  double sum = (double)row * list->estimate;
+  if (list->deltas)
+    for (; row > 0; row &= row - 1)
+      sum += list->deltas[row];
+  return sum;
+}
+
+static float vlist_row_height(const struct cmp_virtual_list *list,
+                              size_t row) {
+  return (float)(vlist_offset(list, row + 1) - vlist_offset(list, row));
+}
+
+static int vlist_set_row_height(struct cmp_virtual_list *list, size_t row,
+                                float height) {
+  double diff = (double)height - vlist_row_height(list, row);
+  size_t i;
+  if (diff == 0.0)
+    return CMP_SUCCESS;
+  list->remeasured = 1;
+  if (!list->deltas) {
+    if (CMP_MALLOC((list->rows + 1) * sizeof(double),
+                   (void **)&list->deltas) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    memset(list->deltas, 0, (list->rows + 1) * sizeof(double));
+  }
+  for (i = row + 1; i <= list->rows; i += i & (~i + 1))
+    list->deltas[i] += diff;
+  return CMP_SUCCESS;
+}
+
+/* Row containing offset, clamped to the content */
+static size_t vlist_row_at(const struct cmp_virtual_list *list,
+                           double offset) {
+  size_t pos = 0, step;
+  double width;
+  if (list->rows == 0 || offset <= 0.0)
+    return 0;
+  /* Binary lifting: deltas[pos + step] covers rows (pos, pos + step] */
+  for (step = list->top_bit; step > 0; step >>= 1) {
+    if (pos + step > list->rows)
+      continue;
+    width = (double)step * list->estimate +
+            (list->deltas ? list->deltas[pos + step] : 0.0);
+    if (width <= offset) {
+      pos += step;
+      offset -= width;
+    }
+  }
+  return pos < list->rows ? pos : list->rows - 1;
+}
+
+static void vlist_set_count(struct cmp_virtual_list *list, size_t count) {
+  list->count = count;
+  list->rows = (list->count + list->columns - 1) / list->columns;
+  for (list->top_bit = 1; list->top_bit <= list->rows / 2;)
+    list->top_bit <<= 1;
+}
+
+static int vlist_reset_rows(struct cmp_virtual_list *list) {
+  vlist_set_count(list, list->source.count(list->source.user_data));
+  if (list->deltas) {
+    CMP_FREE(list->deltas);
+    list->deltas = NULL;
+  }
+  return CMP_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Cells                                                                    */
+/* ------------------------------------------------------------------------ */
+
+static int vlist_grow(vlist_cell_t **cells, size_t *cap, size_t need) {
+  vlist_cell_t *grown;
+  size_t new_cap = *cap ? *cap : 16;
+  if (need <= *cap)
+    return CMP_SUCCESS;
+  while (new_cap < need)
+    new_cap *= 2;
+  if (CMP_MALLOC(new_cap * sizeof(vlist_cell_t), (void **)&grown) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  if (*cells) {
+    memcpy(grown, *cells, *cap * sizeof(vlist_cell_t));
+    CMP_FREE(*cells);
+  }
+  *cells = grown;
+  *cap = new_cap;
+  return CMP_SUCCESS;
+}
+
+static void vlist_destroy_cell(struct cmp_virtual_list *list,
+                               cmp_ui_node_t *node) {
+  if (list->source.destroy_cell)
+    list->source.destroy_cell(list->source.user_data, node);
+  cmp_ui_node_destroy(node);
+}
+
+static int vlist_release(struct cmp_virtual_list *list, vlist_cell_t cell) {
+  cmp_ui_node_remove_child(list->container, cell.node);
+  if (vlist_grow(&list->pool, &list->pool_cap, list->pool_count + 1) !=
+      CMP_SUCCESS) {
+    vlist_destroy_cell(list, cell.node);
+    return CMP_ERROR_OOM;
+  }
+  list->pool[list->pool_count++] = cell;
+  return CMP_SUCCESS;
+}
+
+/* Takes a pooled cell of the item's type (or creates one) and binds it */
+static int vlist_bind(struct cmp_virtual_list *list, size_t item,
+                      vlist_cell_t *out_cell) {
+  vlist_cell_t cell;
+  vlist_kept_t kept;
+  size_t i, row = item / list->columns;
+  float height = vlist_row_height(list, row);
+  int res, attached = 0;
+
+  cell.type = list->source.cell_type
+                  ? list->source.cell_type(list->source.user_data, item)
+                  : 0;
+  cell.node = NULL;
+  for (i = 0; i < list->kept_count; ++i) {
+    if (list->kept[i].index != item)
+      continue;
+    kept = list->kept[i];
+    list->kept[i] = list->kept[--list->kept_count];
+    if (kept.cell.type == cell.type && !kept.stale) {
+      *out_cell = kept.cell;
+      return CMP_SUCCESS;
+    }
+    if (kept.cell.type == cell.type) {
+      cell = kept.cell;
+      attached = 1;
+    } else if (vlist_release(list, kept.cell) != CMP_SUCCESS) {
+      return CMP_ERROR_OOM;
+    }
+    break;
+  }
+  for (i = list->pool_count; !cell.node && i-- > 0;) {
+    if (list->pool[i].type == cell.type) {
+      cell = list->pool[i];
+      list->pool[i] = list->pool[--list->pool_count];
+      break;
+    }
+  }
+  if (!cell.node) {
+    res = list->source.create_cell(list->source.user_data, cell.type,
+                                   &cell.node);
+    if (res != CMP_SUCCESS)
+      return res;
+    if (!cell.node)
+      return CMP_ERROR_GENERAL;
+  }
+  res = list->source.bind_cell(list->source.user_data, cell.node, item,
+                               &height);
+  if (res == CMP_SUCCESS && !attached)
+    res = cmp_ui_node_add_child(list->container, cell.node);
+  if (res != CMP_SUCCESS) {
+    if (attached)
+      cmp_ui_node_remove_child(list->container, cell.node);
+    vlist_destroy_cell(list, cell.node);
+    return res;
+  }
+  /* A grid row is as tall as the tallest cell bound into it */
+  if (list->columns == 1 || height > vlist_row_height(list, row)) {
+    res = vlist_set_row_height(list, row, height);
+    if (res != CMP_SUCCESS)
+      return res;
+  }
+  *out_cell = cell;
+  return CMP_SUCCESS;
+}
+
+/* Brings the bound window in line with the scroll offset */
+static int vlist_sync_window(struct cmp_virtual_list *list) {
+  size_t first_row, end_row, new_first, new_end, ov_first, ov_end, i;
+  size_t anchor;
+  double anchor_shift;
+  vlist_cell_t cell;
+  int res = CMP_SUCCESS;
+
+  first_row = vlist_row_at(list, list->scroll);
+  anchor = first_row;
+  anchor_shift = list->scroll - vlist_offset(list, anchor);
+  end_row = list->rows ? vlist_row_at(list, list->scroll + list->height) + 1
+                       : 0;
+  first_row = first_row > list->overscan ? first_row - list->overscan : 0;
+  end_row = list->rows - end_row > list->overscan ? end_row + list->overscan
+                                                  : list->rows;
+  new_first = first_row * list->columns;
+  new_end = end_row * list->columns < list->count ? end_row * list->columns
+                                                  : list->count;
+  if (new_end < new_first)
+    new_end = new_first;
+
+  /* Recycle cells that left the window, keep the overlap in place */
+  ov_first = list->first > new_first ? list->first : new_first;
+  ov_end = list->first + list->active_count < new_end
+               ? list->first + list->active_count
+               : new_end;
+  if (ov_end < ov_first)
+    ov_end = ov_first;
+  for (i = 0; i < list->active_count; ++i) {
+    if (list->first + i < ov_first || list->first + i >= ov_end)
+      if (vlist_release(list, list->active[i]) != CMP_SUCCESS)
+        res = CMP_ERROR_OOM;
+  }
+  if (vlist_grow(&list->active, &list->active_cap, new_end - new_first) !=
+      CMP_SUCCESS) {
+    list->active_count = 0;
+    return CMP_ERROR_OOM;
+  }
+  if (ov_end > ov_first)
+    memmove(list->active + (ov_first - new_first),
+            list->active + (ov_first - list->first),
+            (ov_end - ov_first) * sizeof(vlist_cell_t));
+
+  /* Bind the rows that came into view. On failure the window shrinks to
+   * the cells bound so far. */
+  list->first = new_first;
+  for (i = new_first; i < new_end && res == CMP_SUCCESS; ++i) {
+    if (i >= ov_first && i < ov_end)
+      continue;
+    res = vlist_bind(list, i, &cell);
+    if (res == CMP_SUCCESS)
+      list->active[i - new_first] = cell;
+  }
+  if (res != CMP_SUCCESS) {
+    size_t bound = i - 1 - new_first, k;
+    for (k = bound; k < new_end - new_first; ++k)
+      if (new_first + k >= ov_first && new_first + k < ov_end)
+        vlist_release(list, list->active[k]);
+    list->active_count = bound;
+    return res;
+  }
+  list->active_count = new_end - new_first;
+
+  /* Rows above the viewport may have been measured just now; keep the row
+   * at the top of the viewport where it was */
+  if (list->rows)
+    list->scroll = vlist_offset(list, anchor) + anchor_shift;
+  return CMP_SUCCESS;
+}
+
+/* Syncs the window until the bound rows' measured heights stop moving it,
+ * then positions every bound cell relative to the viewport. */
+static int vlist_update(struct cmp_virtual_list *list) {
+  size_t i, row;
+  double row_top;
+  float cell_width;
+  int pass, res;
+
+  for (pass = 0; pass < 4; ++pass) {
+    list->remeasured = 0;
+    res = vlist_sync_window(list);
+    if (res != CMP_SUCCESS)
+      return res;
+    if (!list->remeasured)
+      break;
+  }
+
+  cell_width = list->width / (float)list->columns;
+  row = (size_t)-1;
+  row_top = 0.0;
+  for (i = 0; i < list->active_count; ++i) {
+    cmp_layout_node_t *layout = list->active[i].node->layout;
+    if ((list->first + i) / list->columns != row) {
+      row = (list->first + i) / list->columns;
+      row_top = vlist_offset(list, row) - list->scroll;
+    }
+    layout->position_type = CMP_POSITION_ABSOLUTE;
+    layout->position[0] = (float)row_top;
+    layout->position[3] =
+        cell_width * (float)((list->first + i) % list->columns);
+    layout->width = cell_width;
+    layout->height = vlist_row_height(list, row);
+  }
+  return CMP_SUCCESS;
+}
+
+/* ------------------------------------------------------------------------ */
+/* Public API                                                               */
+/* ------------------------------------------------------------------------ */
+
+int cmp_virtual_list_create(cmp_virtual_list_t **out_list,
+                            cmp_ui_node_t *container,
+                            const cmp_virtual_list_source_t *source,
+                            size_t columns) {
+  struct cmp_virtual_list *list;
+  if (!out_list || !container || !source || !source->count ||
+      !source->create_cell || !source->bind_cell || columns == 0 ||
+      source->estimated_height <= 0.0f)
+    return CMP_ERROR_INVALID_ARG;
+  if (CMP_MALLOC(sizeof(struct cmp_virtual_list), (void **)&list) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(list, 0, sizeof(struct cmp_virtual_list));
+  list->container = container;
+  list->source = *source;
+  list->columns = columns;
+  list->estimate = source->estimated_height;
+  list->overscan = 2;
+  vlist_reset_rows(list);
+  *out_list = list;
+  return CMP_SUCCESS;
+}
+
+int cmp_virtual_list_destroy(cmp_virtual_list_t *list) {
+  size_t i;
+  if (!list)
+    return CMP_ERROR_INVALID_ARG;
+  for (i = 0; i < list->active_count; ++i) {
+    cmp_ui_node_remove_child(list->container, list->active[i].node);
+    vlist_destroy_cell(list, list->active[i].node);
+  }
+  for (i = 0; i < list->pool_count; ++i)
+    vlist_destroy_cell(list, list->pool[i].node);
+  if (list->active)
+    CMP_FREE(list->active);
+  if (list->pool)
+    CMP_FREE(list->pool);
+  if (list->deltas)
+    CMP_FREE(list->deltas);
+  CMP_FREE(list);
+  return CMP_SUCCESS;
+}
+
+int cmp_virtual_list_set_viewport(cmp_virtual_list_t *list, float width,
+                                  float height) {
+  if (!list || width < 0.0f || height < 0.0f)
+    return CMP_ERROR_INVALID_ARG;
+  list->width = width;
+  list->height = height;
+  return vlist_update(list);
+}
+
+int cmp_virtual_list_set_overscan(cmp_virtual_list_t *list, size_t rows) {
+  if (!list)
+    return CMP_ERROR_INVALID_ARG;
+  list->overscan = rows;
+  return vlist_update(list);
+}
+
+int cmp_virtual_list_scroll_to(cmp_virtual_list_t *list, double offset) {
+  if (!list)
+    return CMP_ERROR_INVALID_ARG;
+  list->scroll = offset > 0.0 ? offset : 0.0;
+  return vlist_update(list);
+}
+
+int cmp_virtual_list_scroll_to_item(cmp_virtual_list_t *list, size_t index) {
+  if (!list)
+    return CMP_ERROR_INVALID_ARG;
+  if (index >= list->count)
+    return CMP_ERROR_BOUNDS;
+  list->scroll = vlist_offset(list, index / list->columns);
+  return vlist_update(list);
+}
+
+int cmp_virtual_list_get_scroll_offset(const cmp_virtual_list_t *list,
+                                       double *out_offset) {
+  if (!list || !out_offset)
+    return CMP_ERROR_INVALID_ARG;
+  *out_offset = list->scroll;
+  return CMP_SUCCESS;
+}
+
+int cmp_virtual_list_reload(cmp_virtual_list_t *list) {
+  size_t i;
+  int res = CMP_SUCCESS;
+  if (!list)
+    return CMP_ERROR_INVALID_ARG;
+  for (i = 0; i < list->active_count; ++i)
+    if (vlist_release(list, list->active[i]) != CMP_SUCCESS)
+      res = CMP_ERROR_OOM;
+  list->active_count = 0;
+  list->first = 0;
+  vlist_reset_rows(list);
+  if (res != CMP_SUCCESS)
+    return res;
+  return vlist_update(list);
+}
+
+int cmp_virtual_list_reload_item(cmp_virtual_list_t *list, size_t index) {
+  vlist_cell_t *cell;
+  size_t row;
+  float height;
+  int res;
+  if (!list)
+    return CMP_ERROR_INVALID_ARG;
+  if (index >= list->count)
+    return CMP_ERROR_BOUNDS;
+  if (index < list->first || index >= list->first + list->active_count)
+    return CMP_SUCCESS; /* Bound when it scrolls into view */
+  cell = &list->active[index - list->first];
+  row = index / list->columns;
+  height = vlist_row_height(list, row);
+  res = list->source.bind_cell(list->source.user_data, cell->node, index,
+                               &height);
+  if (res != CMP_SUCCESS)
+    return res;
+  if (list->columns == 1 || height > vlist_row_height(list, row)) {
+    res = vlist_set_row_height(list, row, height);
+    if (res != CMP_SUCCESS)
+      return res;
+  }
+  return vlist_update(list);
+}
+
+/* Turns a Fenwick tree over n rows into per-row values, in place */
+static void vlist_fenwick_unbuild(double *tree, size_t n) {
+  size_t i, parent;
+  for (i = n; i > 0; --i) {
+    parent = i + (i & (~i + 1));
+    if (parent <= n)
+      tree[parent] -= tree[i];
+  }
+}
+
+static void vlist_fenwick_build(double *tree, size_t n) {
+  size_t i, parent;
+  for (i = 1; i <= n; ++i) {
+    parent = i + (i & (~i + 1));
+    if (parent <= n)
+      tree[parent] += tree[i];
+  }
+}
+
+/* Old item index -> new index, or CMP_DIFF_NONE for removed items */
+typedef size_t (*vlist_map_fn)(const void *ctx, size_t index);
+
+/* Stashes the attached cells under their new indices for vlist_bind and
+ * recycles the cells of removed items */
+static int vlist_keep_cells(struct cmp_virtual_list *list, vlist_map_fn map,
+                            const void *ctx) {
+  size_t i, k;
+  int res = CMP_SUCCESS;
+  if (list->active_count > 0 &&
+      CMP_MALLOC(list->active_count * sizeof(vlist_kept_t),
+                 (void **)&list->kept) != CMP_SUCCESS) {
+    list->kept = NULL;
+    res = CMP_ERROR_OOM;
+  }
+  list->kept_count = 0;
+  for (i = 0; i < list->active_count; ++i) {
+    k = map(ctx, list->first + i);
+    if (k == CMP_DIFF_NONE || !list->kept) {
+      if (vlist_release(list, list->active[i]) != CMP_SUCCESS)
+        res = CMP_ERROR_OOM;
+      continue;
+    }
+    list->kept[list->kept_count].cell = list->active[i];
+    list->kept[list->kept_count].index = k;
+    list->kept[list->kept_count].stale = 0;
+    list->kept_count++;
+  }
+  list->active_count = 0;
+  list->first = 0;
+  return res;
+}
+
+/* Switches to the new item count with the anchor item (CMP_DIFF_NONE for
+ * none) at the top of the viewport again, binds the window and releases
+ * kept cells that did not come back into it */
+static int vlist_finish_remap(struct cmp_virtual_list *list, size_t count,
+                              size_t anchor, double anchor_shift, int res) {
+  size_t i;
+  vlist_set_count(list, count);
+  if (anchor != CMP_DIFF_NONE)
+    list->scroll = vlist_offset(list, anchor / list->columns) + anchor_shift;
+  if (res == CMP_SUCCESS)
+    res = vlist_update(list);
+  for (i = 0; i < list->kept_count; ++i)
+    if (vlist_release(list, list->kept[i].cell) != CMP_SUCCESS)
+      res = CMP_ERROR_OOM;
+  if (list->kept)
+    CMP_FREE(list->kept);
+  list->kept = NULL;
+  list->kept_count = 0;
+  return res;
+}
+
+/* First item of the row at the top of the viewport */
+static size_t vlist_anchor(const struct cmp_virtual_list *list,
+                           double *out_shift) {
+  size_t row;
+  *out_shift = 0.0;
+  if (!list->rows)
+    return CMP_DIFF_NONE;
+  row = vlist_row_at(list, list->scroll);
+  *out_shift = list->scroll - vlist_offset(list, row);
+  return row * list->columns;
+}
+
+static size_t vlist_diff_map(const void *ctx, size_t index) {
+  return ((const cmp_diff_result_t *)ctx)->old_to_new[index];
+}
+
+int cmp_virtual_list_apply_diff(cmp_virtual_list_t *list,
+                                const cmp_diff_result_t *diff) {
+  double *deltas = NULL;
+  double anchor_shift;
+  size_t anchor, i, k;
+  int res;
+
+  if (!list || !diff)
+    return CMP_ERROR_INVALID_ARG;
+  if (diff->old_count != list->count ||
+      list->source.count(list->source.user_data) != diff->new_count)
+    return CMP_ERROR_INVALID_STATE;
+
+  /* Keep the first visible item where it is on screen */
+  anchor = vlist_anchor(list, &anchor_shift);
+  if (anchor != CMP_DIFF_NONE)
+    anchor = anchor < diff->old_count ? diff->old_to_new[anchor]
+                                      : CMP_DIFF_NONE;
+
+  /* Measured heights follow their items. Grid rows regroup, so they fall
+   * back to the estimate and are measured again when bound. */
+  if (list->deltas && list->columns == 1 && diff->new_count > 0) {
+    if (CMP_MALLOC((diff->new_count + 1) * sizeof(double),
+                   (void **)&deltas) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    vlist_fenwick_unbuild(list->deltas, list->rows);
+    deltas[0] = 0.0;
+    for (i = 0; i < diff->new_count; ++i)
+      deltas[i + 1] = diff->new_to_old[i] != CMP_DIFF_NONE
+                          ? list->deltas[diff->new_to_old[i] + 1]
+                          : 0.0;
+    vlist_fenwick_build(deltas, diff->new_count);
+  }
+  if (list->deltas)
+    CMP_FREE(list->deltas);
+  list->deltas = deltas;
+
+  /* Surviving cells stay attached and are picked up by vlist_bind */
+  res = vlist_keep_cells(list, vlist_diff_map, diff);
+  for (i = 0; i < diff->change_count; ++i) {
+    if (diff->changes[i].op != CMP_DIFF_RELOAD)
+      continue;
+    for (k = 0; k < list->kept_count; ++k)
+      if (list->kept[k].index == diff->changes[i].to)
+        list->kept[k].stale = 1;
+  }
+  return vlist_finish_remap(list, diff->new_count, anchor, anchor_shift, res);
+}
+
+typedef struct vlist_splice {
+  size_t at;
+  size_t removed;
+  size_t inserted;
+} vlist_splice_t;
+
+static size_t vlist_splice_map(const void *ctx, size_t index) {
+  const vlist_splice_t *splice = (const vlist_splice_t *)ctx;
+  if (index < splice->at)
+    return index;
+  if (index < splice->at + splice->removed)
+    return CMP_DIFF_NONE;
+  return index - splice->removed + splice->inserted;
+}
+
+int cmp_virtual_list_splice(cmp_virtual_list_t *list, size_t index,
+                            size_t removed, size_t inserted) {
+  vlist_splice_t splice;
+  double *deltas = NULL;
+  double anchor_shift;
+  size_t anchor, count, tail;
+  int res;
+
+  if (!list)
+    return CMP_ERROR_INVALID_ARG;
+  if (index > list->count || removed > list->count - index)
+    return CMP_ERROR_BOUNDS;
+  count = list->count - removed + inserted;
+  if (list->source.count(list->source.user_data) != count)
+    return CMP_ERROR_INVALID_STATE;
+  splice.at = index;
+  splice.removed = removed;
+  splice.inserted = inserted;
+
+  /* A removed anchor hands its place to whatever now starts there */
+  anchor = vlist_anchor(list, &anchor_shift);
+  if (anchor != CMP_DIFF_NONE) {
+    anchor = vlist_splice_map(&splice, anchor);
+    if (anchor == CMP_DIFF_NONE) {
+      anchor = index < count ? index : CMP_DIFF_NONE;
+      anchor_shift = 0.0;
+    }
+  }
+
+  /* Only measured heights cost a pass over the rows; inserted rows start
+   * at the estimate */
+  if (list->deltas && list->columns == 1 && count > 0) {
+    if (CMP_MALLOC((count + 1) * sizeof(double), (void **)&deltas) !=
+        CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    vlist_fenwick_unbuild(list->deltas, list->rows);
+    tail = list->count - index - removed;
+    memcpy(deltas, list->deltas, (index + 1) * sizeof(double));
+    memset(deltas + index + 1, 0, inserted * sizeof(double));
+    memcpy(deltas + index + inserted + 1, list->deltas + index + removed + 1,
+           tail * sizeof(double));
+    vlist_fenwick_build(deltas, count);
+  }
+  if (list->deltas)
+    CMP_FREE(list->deltas);
+  list->deltas = deltas;
+
+  res = vlist_keep_cells(list, vlist_splice_map, &splice);
+  return vlist_finish_remap(list, count, anchor, anchor_shift, res);
+}
+
+int cmp_virtual_list_get_item_offset(const cmp_virtual_list_t *list,
+                                     size_t index, double *out_offset) {
+  if (!list || !out_offset)
+    return CMP_ERROR_INVALID_ARG;
+  if (index > list->count)
+    return CMP_ERROR_BOUNDS;
+  *out_offset = vlist_offset(list, index / list->columns);
+  return CMP_SUCCESS;
+}
+
+int cmp_virtual_list_get_item_at(const cmp_virtual_list_t *list,
+                                 double offset, size_t *out_index) {
+  if (!list || !out_index)
+    return CMP_ERROR_INVALID_ARG;
+  if (list->count == 0)
+    return CMP_ERROR_NOT_FOUND;
+  *out_index = vlist_row_at(list, offset) * list->columns;
+  return CMP_SUCCESS;
+}
+
+int cmp_virtual_list_get_content_height(const cmp_virtual_list_t *list,
+                                        double *out_height) {
+  if (!list || !out_height)
+    return CMP_ERROR_INVALID_ARG;
+  *out_height = vlist_offset(list, list->rows);
+  return CMP_SUCCESS;
+}
+
+int cmp_virtual_list_get_visible_range(const cmp_virtual_list_t *list,
+                                       size_t *out_first, size_t *out_count) {
+  if (!list || !out_first || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  *out_first = list->first;
+  *out_count = list->active_count;
+  return CMP_SUCCESS;
+}
+
+int cmp_virtual_list_get_cell(const cmp_virtual_list_t *list, size_t index,
+                              cmp_ui_node_t **out_cell) {
+  if (!list || !out_cell)
+    return CMP_ERROR_INVALID_ARG;
+  if (index < list->first || index >= list->first + list->active_count)
+    return CMP_ERROR_NOT_FOUND;
+  *out_cell = list->active[index - list->first].node;
+  return CMP_SUCCESS;
+}
@@ -1134,6 +1134,8 @@ int cmp_texture_create(cmp_renderer_t *renderer, int width, int height,
   texture->internal_handle = NULL;
   texture->width = width;
   texture->height = height;
+  texture->format = 0;
+  texture->pixels = NULL;
   (void)pixels;
 
   *out_texture = texture;
@@ -83,6 +83,26 @@ int cmp_layout_node_add_child(cmp_layout_node_t *parent,
   return CMP_SUCCESS;
 }
 
+int cmp_layout_node_remove_child(cmp_layout_node_t *parent,
+                                 cmp_layout_node_t *child) {
+  size_t i;
+
+  if (parent == NULL || child == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  for (i = 0; i < parent->child_count; i++) {
+    if (parent->children[i] == child) {
+      memmove(parent->children + i, parent->children + i + 1,
+              sizeof(cmp_layout_node_t *) * (parent->child_count - i - 1));
+      parent->child_count--;
+      child->parent = NULL;
+      return CMP_SUCCESS;
+    }
+  }
+  return CMP_ERROR_NOT_FOUND;
+}
+
 typedef struct {
   size_t start;
   size_t count;
@@ -1,14 +1,258 @@
 /* clang-format off */
 #include "cmp.h"
 #include <stdlib.h>
+#include <string.h>
 /* clang-format on */
 
+#define RM_DEFAULT_CPU_BUDGET ((size_t)64 * 1024 * 1024)
+#define RM_DEFAULT_GPU_BUDGET ((size_t)128 * 1024 * 1024)
+#define RM_MIN_BUCKETS 64
+#define RM_POOL_COUNT 2
+
+/* A cached payload. Entries live in a hash chain for lookup and in a
+ * circular per-pool ring that the CLOCK hand sweeps for eviction. */
+typedef struct rm_entry {
+  struct rm_entry *hash_next;
+  struct rm_entry *ring_prev;
+  struct rm_entry *ring_next;
+  unsigned long hash;
+  char *source;
+  int width;
+  int height;
+  int color_space;
+  int pool;
+  int referenced;
+  void *payload;
+  size_t bytes;
+  cmp_resource_release_cb_t release;
+  void *release_user_data;
+} rm_entry_t;
+
+typedef struct rm_pool {
+  rm_entry_t *hand; /* Next entry the CLOCK hand inspects; NULL if empty */
+  size_t bytes;
+  size_t budget; /* Nominal budget before scaling */
+} rm_pool_t;
+
+typedef struct rm_offscreen {
+  struct rm_offscreen *next;
+  size_t bytes;
+} rm_offscreen_t;
+
+/* The caller's HTTP client. A client is not safe for concurrent sends, so
+ * workers take the lock around each one. Held by the manager and by every
+ * fetch in flight; refs only change on the ui modality. */
+typedef struct rm_client {
+  cmp_mutex_t lock;
+  struct HttpClient *client;
+  size_t refs;
+} rm_client_t;
+
+/* A remote image in flight: fetched and decoded on a worker, then handed
+ * to the cache on the ui modality. */
+typedef struct rm_load {
+  struct rm_load *next;
+  struct cmp_resource_manager *ctx; /* NULL once the manager is destroyed */
+  cmp_modality_t *ui;
+  rm_client_t *client; /* NULL to read source as a VFS path */
+  char *source;
+  int width;
+  int height;
+  cmp_image_decoder_t *dec;
+  cmp_texture_t *bitmap; /* Decoded pixels follow the header */
+  size_t bytes;
+  int error;
+} rm_load_t;
+
 struct cmp_resource_manager {
   int is_backgrounded;
   int is_low_data_mode;
   int thermal_state; /* 0=nominal, 1=fair, 2=serious, 3=critical */
+  int memory_pressure; /* 0=none, 1=warning, 2=critical */
+
+  rm_pool_t pools[RM_POOL_COUNT];
+  rm_entry_t **buckets;
+  size_t bucket_count;
+  size_t entry_count;
+
+  rm_offscreen_t *offscreen; /* Live offscreen bitmaps (header + pixels) */
+  size_t offscreen_bytes;
+
+  cmp_modality_t *workers; /* Fetch and decode remote images */
+  cmp_modality_t *ui;      /* Runs the inserts */
+  rm_client_t *client;
+  rm_load_t *loads; /* In flight, owned by their completion task */
+
+  unsigned long hits;
+  unsigned long misses;
+  unsigned long insertions;
+  unsigned long evictions;
+  unsigned long rejections;
 };
 
+static void rm_client_release(rm_client_t *client) {
+  if (client && --client->refs == 0) {
+    cmp_mutex_destroy(&client->lock);
+    CMP_FREE(client);
+  }
+}
+
+static unsigned long rm_hash_key(const cmp_resource_key_t *key) {
+  /* FNV-1a over the source string, then the geometry and color space. */
+  unsigned long h = 2166136261UL;
+  const unsigned char *p = (const unsigned char *)key->source;
+  unsigned long extra[3];
+  int i;
+
+  while (*p) {
+    h ^= *p++;
+    h = (h * 16777619UL) & 0xFFFFFFFFUL;
+  }
+  extra[0] = (unsigned long)key->width;
+  extra[1] = (unsigned long)key->height;
+  extra[2] = (unsigned long)key->color_space;
+  for (i = 0; i < 3; ++i) {
+    h ^= extra[i] & 0xFFFFFFFFUL;
+    h = (h * 16777619UL) & 0xFFFFFFFFUL;
+  }
+  return h;
+}
+
+static int rm_entry_matches(const rm_entry_t *e, unsigned long hash,
+                            const cmp_resource_key_t *key) {
+  return e->hash == hash && e->width == key->width &&
+         e->height == key->height && e->color_space == (int)key->color_space &&
+         strcmp(e->source, key->source) == 0;
+}
+
+static int rm_key_valid(const cmp_resource_key_t *key) {
+  return key && key->source && key->width > 0 && key->height > 0;
+}
+
+static rm_entry_t **rm_find_slot(struct cmp_resource_manager *ctx,
+                                 unsigned long hash,
+                                 const cmp_resource_key_t *key) {
+  rm_entry_t **slot = &ctx->buckets[hash & (ctx->bucket_count - 1)];
+  while (*slot && !rm_entry_matches(*slot, hash, key))
+    slot = &(*slot)->hash_next;
+  return slot;
+}
+
+static size_t rm_effective_budget(const struct cmp_resource_manager *ctx,
+                                  int pool) {
+  size_t budget = ctx->pools[pool].budget;
+
+  if (ctx->memory_pressure >= 2)
+    return 0;
+  if (ctx->memory_pressure == 1)
+    budget /= 2;
+  if (ctx->thermal_state == 3)
+    budget /= 4;
+  else if (ctx->thermal_state == 2)
+    budget /= 2;
+  if (ctx->is_backgrounded) {
+    /* Textures are rebuilt on resume; keep a small warm set of bitmaps. */
+    budget = pool == CMP_RESOURCE_POOL_GPU ? 0 : budget / 4;
+  }
+  if (pool == CMP_RESOURCE_POOL_CPU) {
+    /* Offscreen bitmaps are not evictable but still spend CPU memory. */
+    budget = budget > ctx->offscreen_bytes ? budget - ctx->offscreen_bytes : 0;
+  }
+  return budget;
+}
+
+static void rm_ring_insert(rm_pool_t *pool, rm_entry_t *e) {
+  if (!pool->hand) {
+    e->ring_prev = e;
+    e->ring_next = e;
+    pool->hand = e;
+    return;
+  }
+  /* Just behind the hand: the newest entry is the last one swept. */
+  e->ring_next = pool->hand;
+  e->ring_prev = pool->hand->ring_prev;
+  e->ring_prev->ring_next = e;
+  pool->hand->ring_prev = e;
+}
+
+static void rm_ring_unlink(rm_pool_t *pool, rm_entry_t *e) {
+  if (e->ring_next == e) {
+    pool->hand = NULL;
+  } else {
+    e->ring_prev->ring_next = e->ring_next;
+    e->ring_next->ring_prev = e->ring_prev;
+    if (pool->hand == e)
+      pool->hand = e->ring_next;
+  }
+  e->ring_prev = NULL;
+  e->ring_next = NULL;
+}
+
+static void rm_entry_free(struct cmp_resource_manager *ctx, rm_entry_t *e) {
+  rm_pool_t *pool = &ctx->pools[e->pool];
+  rm_entry_t **slot = &ctx->buckets[e->hash & (ctx->bucket_count - 1)];
+
+  while (*slot != e)
+    slot = &(*slot)->hash_next;
+  *slot = e->hash_next;
+  rm_ring_unlink(pool, e);
+  pool->bytes -= e->bytes;
+  ctx->entry_count--;
+
+  if (e->release)
+    e->release(e->release_user_data, e->payload, e->bytes);
+  CMP_FREE(e->source);
+  CMP_FREE(e);
+}
+
+/* Second-chance CLOCK: referenced entries get their bit cleared and one
+ * more lap; unreferenced entries under the hand are evicted. */
+static void rm_pool_shrink(struct cmp_resource_manager *ctx, int pool_index,
+                           size_t target) {
+  rm_pool_t *pool = &ctx->pools[pool_index];
+
+  while (pool->bytes > target && pool->hand) {
+    rm_entry_t *e = pool->hand;
+    if (e->referenced) {
+      e->referenced = 0;
+      pool->hand = e->ring_next;
+    } else {
+      rm_entry_free(ctx, e);
+      ctx->evictions++;
+    }
+  }
+}
+
+static void rm_enforce_budgets(struct cmp_resource_manager *ctx) {
+  int i;
+  for (i = 0; i < RM_POOL_COUNT; ++i)
+    rm_pool_shrink(ctx, i, rm_effective_budget(ctx, i));
+}
+
+static int rm_grow_buckets(struct cmp_resource_manager *ctx) {
+  size_t count = ctx->bucket_count * 2;
+  rm_entry_t **buckets;
+  size_t i;
+
+  if (CMP_MALLOC(count * sizeof(rm_entry_t *), (void **)&buckets) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(buckets, 0, count * sizeof(rm_entry_t *));
+  for (i = 0; i < ctx->bucket_count; ++i) {
+    rm_entry_t *e = ctx->buckets[i];
+    while (e) {
+      rm_entry_t *next = e->hash_next;
+      e->hash_next = buckets[e->hash & (count - 1)];
+      buckets[e->hash & (count - 1)] = e;
+      e = next;
+    }
+  }
+  CMP_FREE(ctx->buckets);
+  ctx->buckets = buckets;
+  ctx->bucket_count = count;
+  return CMP_SUCCESS;
+}
+
 int cmp_resource_manager_create(cmp_resource_manager_t **out_rm) {
   struct cmp_resource_manager *ctx;
   if (!out_rm)
@@ -16,18 +260,49 @@ int cmp_resource_manager_create(cmp_resource_manager_t **out_rm) {
   if (CMP_MALLOC(sizeof(struct cmp_resource_manager), (void **)&ctx) !=
       CMP_SUCCESS)
     return CMP_ERROR_OOM;
+  memset(ctx, 0, sizeof(struct cmp_resource_manager));
 
   ctx->is_backgrounded = 0;
   ctx->is_low_data_mode = 0;
   ctx->thermal_state = 0;
+  ctx->memory_pressure = 0;
+  ctx->pools[CMP_RESOURCE_POOL_CPU].budget = RM_DEFAULT_CPU_BUDGET;
+  ctx->pools[CMP_RESOURCE_POOL_GPU].budget = RM_DEFAULT_GPU_BUDGET;
+
+  ctx->bucket_count = RM_MIN_BUCKETS;
+  if (CMP_MALLOC(ctx->bucket_count * sizeof(rm_entry_t *),
+                 (void **)&ctx->buckets) != CMP_SUCCESS) {
+    CMP_FREE(ctx);
+    return CMP_ERROR_OOM;
+  }
+  memset(ctx->buckets, 0, ctx->bucket_count * sizeof(rm_entry_t *));
 
   *out_rm = (cmp_resource_manager_t *)ctx;
   return CMP_SUCCESS;
 }
 
 int cmp_resource_manager_destroy(cmp_resource_manager_t *rm_opaque) {
-  if (rm_opaque)
-    CMP_FREE(rm_opaque);
+  struct cmp_resource_manager *ctx = (struct cmp_resource_manager *)rm_opaque;
+  if (!ctx)
+    return CMP_SUCCESS;
+
+  while (ctx->pools[CMP_RESOURCE_POOL_CPU].hand)
+    rm_entry_free(ctx, ctx->pools[CMP_RESOURCE_POOL_CPU].hand);
+  while (ctx->pools[CMP_RESOURCE_POOL_GPU].hand)
+    rm_entry_free(ctx, ctx->pools[CMP_RESOURCE_POOL_GPU].hand);
+  while (ctx->offscreen) {
+    rm_offscreen_t *next = ctx->offscreen->next;
+    CMP_FREE(ctx->offscreen);
+    ctx->offscreen = next;
+  }
+  /* Loads still in flight finish without a cache to insert into. */
+  while (ctx->loads) {
+    ctx->loads->ctx = NULL;
+    ctx->loads = ctx->loads->next;
+  }
+  rm_client_release(ctx->client);
+  CMP_FREE(ctx->buckets);
+  CMP_FREE(ctx);
   return CMP_SUCCESS;
 }
 
@@ -38,7 +313,9 @@ int cmp_resources_set_thermal_state(cmp_resource_manager_t *rm_opaque,
     return CMP_ERROR_INVALID_ARG;
 
   ctx->thermal_state = state;
-  /* ProcessInfo.thermalState: if >= 2, scale down animations and frame rates */
+  /* ProcessInfo.thermalState: if >= 2, scale down animations and frame rates
+   * and shrink the decoded cache so fewer bitmaps are kept resident */
+  rm_enforce_budgets(ctx);
   return CMP_SUCCESS;
 }
 
@@ -49,7 +326,20 @@ int cmp_resources_set_background_state(cmp_resource_manager_t *rm_opaque,
     return CMP_ERROR_INVALID_ARG;
 
   ctx->is_backgrounded = is_backgrounded;
-  /* Instantly pause render loops, animations, non-essential timers */
+  /* Instantly pause render loops, animations, non-essential timers and drop
+   * textures */
+  rm_enforce_budgets(ctx);
+  return CMP_SUCCESS;
+}
+
+int cmp_resources_set_memory_pressure(cmp_resource_manager_t *rm_opaque,
+                                      int level) {
+  struct cmp_resource_manager *ctx = (struct cmp_resource_manager *)rm_opaque;
+  if (!ctx || level < 0 || level > 2)
+    return CMP_ERROR_INVALID_ARG;
+
+  ctx->memory_pressure = level;
+  rm_enforce_budgets(ctx);
   return CMP_SUCCESS;
 }
 
@@ -74,14 +364,206 @@ int cmp_resources_set_low_data_mode(cmp_resource_manager_t *rm_opaque,
   return CMP_SUCCESS;
 }
 
+static int rm_is_remote(const char *url) {
+  return strncmp(url, "http://", 7) == 0 || strncmp(url, "https://", 8) == 0;
+}
+
+static void rm_release_bitmap(void *user_data, void *payload, size_t bytes) {
+  (void)user_data;
+  (void)bytes;
+  CMP_FREE(payload);
+}
+
+/* Decoder header callback (worker): decode straight into the bitmap that
+ * will be cached, so the pixels are never copied. */
+static int rm_load_header(void *user_data, const cmp_image_info_t *info,
+                          unsigned char **io_pixels, size_t *io_stride) {
+  rm_load_t *load = (rm_load_t *)user_data;
+  size_t stride = (size_t)info->width * 4;
+
+  if (info->width <= 0 || info->height <= 0 ||
+      (size_t)info->height >
+          ((size_t)-1 - sizeof(cmp_texture_t)) / stride)
+    return 1;
+  load->bytes = sizeof(cmp_texture_t) + stride * (size_t)info->height;
+  if (CMP_MALLOC(load->bytes, (void **)&load->bitmap) != CMP_SUCCESS)
+    return 1;
+  load->bitmap->internal_handle = NULL;
+  load->bitmap->width = info->width;
+  load->bitmap->height = info->height;
+  load->bitmap->format = 0;
+  load->bitmap->pixels = (unsigned char *)(load->bitmap + 1);
+  *io_pixels = load->bitmap->pixels;
+  *io_stride = stride;
+  return 0;
+}
+
+static void rm_load_free(rm_load_t *load) {
+  rm_client_release(load->client);
+  if (load->bitmap)
+    CMP_FREE(load->bitmap);
+  cmp_image_decoder_destroy(load->dec);
+  CMP_FREE(load->source);
+  CMP_FREE(load);
+}
+
+/* Runs on the ui modality, the only thread that touches the cache. */
+static void rm_load_finish(void *arg) {
+  rm_load_t *load = (rm_load_t *)arg;
+  struct cmp_resource_manager *ctx = load->ctx;
+  cmp_resource_key_t key;
+  rm_load_t **link;
+
+  if (ctx) {
+    for (link = &ctx->loads; *link != load; link = &(*link)->next)
+      ;
+    *link = load->next;
+  }
+  if (ctx && !load->error && load->bitmap) {
+    key.source = load->source;
+    key.width = load->width;
+    key.height = load->height;
+    key.color_space = CMP_COLOR_SPACE_SRGB;
+    if (cmp_resources_cache_insert((cmp_resource_manager_t *)ctx,
+                                   CMP_RESOURCE_POOL_CPU, &key, load->bitmap,
+                                   load->bytes, rm_release_bitmap,
+                                   NULL) == CMP_SUCCESS)
+      load->bitmap = NULL;
+  }
+  rm_load_free(load);
+}
+
+static void rm_load_done(int error, cmp_image_decoder_t *dec,
+                         void *user_data) {
+  rm_load_t *load = (rm_load_t *)user_data;
+  (void)dec;
+  load->error = error;
+  cmp_modality_queue_task(load->ui, rm_load_finish, load);
+}
+
+/* Worker task: stream the response body through the decoder. */
+static void rm_load_fetch(void *arg) {
+  rm_load_t *load = (rm_load_t *)arg;
+  struct HttpClient *client = load->client->client;
+  struct HttpRequest req;
+  struct HttpResponse *res = NULL;
+  int error = CMP_ERROR_NOT_FOUND;
+
+  if (http_request_init(&req) == 0) {
+    req.method = HTTP_GET;
+    req.url = load->source;
+    req.on_chunk = cmp_image_decoder_http_on_chunk;
+    req.on_chunk_user_data = load->dec;
+    cmp_mutex_lock(&load->client->lock);
+    if (client->send && client->send(client->transport, &req, &res) == 0 &&
+        res && res->status_code == 200)
+      error = cmp_image_decoder_finish(load->dec);
+    cmp_mutex_unlock(&load->client->lock);
+    if (res)
+      http_response_free(res);
+    req.url = NULL;
+    http_request_free(&req);
+  }
+  rm_load_done(error, load->dec, load);
+}
+
+int cmp_resources_set_image_loader(cmp_resource_manager_t *rm_opaque,
+                                   cmp_modality_t *workers,
+                                   cmp_modality_t *ui,
+                                   struct HttpClient *client) {
+  struct cmp_resource_manager *ctx = (struct cmp_resource_manager *)rm_opaque;
+  rm_client_t *shared = NULL;
+  if (!ctx || (workers == NULL) != (ui == NULL) ||
+      (workers && workers->type != CMP_MODALITY_THREADED))
+    return CMP_ERROR_INVALID_ARG;
+
+  if (client) {
+    if (CMP_MALLOC(sizeof(rm_client_t), (void **)&shared) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    if (cmp_mutex_init(&shared->lock) != CMP_SUCCESS) {
+      CMP_FREE(shared);
+      return CMP_ERROR_GENERAL;
+    }
+    shared->client = client;
+    shared->refs = 1;
+  }
+  rm_client_release(ctx->client);
+  ctx->workers = workers;
+  ctx->ui = ui;
+  ctx->client = shared;
+  return CMP_SUCCESS;
+}
+
 int cmp_resources_cache_remote_image(cmp_resource_manager_t *rm_opaque,
                                      const char *url, float target_width,
                                      float target_height) {
   struct cmp_resource_manager *ctx = (struct cmp_resource_manager *)rm_opaque;
+  cmp_resource_key_t key;
+  rm_entry_t *resident;
+  rm_load_t *load;
+  size_t len;
+  int res;
   if (!ctx || !url || target_width <= 0.0f || target_height <= 0.0f)
     return CMP_ERROR_INVALID_ARG;
 
-  /* Decodes async, resizes to exact geometry, aggressively caches */
+  key.source = url;
+  key.width = (int)(target_width + 0.999f);
+  key.height = (int)(target_height + 0.999f);
+  key.color_space = CMP_COLOR_SPACE_SRGB;
+
+  /* Already resident or on its way: only mark it recently used, without
+   * counting a lookup. */
+  resident = *rm_find_slot(ctx, rm_hash_key(&key), &key);
+  if (resident) {
+    resident->referenced = 1;
+    return CMP_SUCCESS;
+  }
+  for (load = ctx->loads; load; load = load->next) {
+    if (load->width == key.width && load->height == key.height &&
+        strcmp(load->source, url) == 0)
+      return CMP_SUCCESS;
+  }
+  /* Low Data Mode skips prefetching over the network. */
+  if (ctx->is_low_data_mode && rm_is_remote(url))
+    return CMP_SUCCESS;
+  if (!ctx->workers || (rm_is_remote(url) && !ctx->client))
+    return CMP_ERROR_INVALID_STATE;
+
+  if (CMP_MALLOC(sizeof(rm_load_t), (void **)&load) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(load, 0, sizeof(rm_load_t));
+  len = strlen(url);
+  if (CMP_MALLOC(len + 1, (void **)&load->source) != CMP_SUCCESS) {
+    CMP_FREE(load);
+    return CMP_ERROR_OOM;
+  }
+  memcpy(load->source, url, len + 1);
+  load->ctx = ctx;
+  load->ui = ctx->ui;
+  if (rm_is_remote(url)) {
+    load->client = ctx->client;
+    load->client->refs++;
+  }
+  load->width = key.width;
+  load->height = key.height;
+
+  /* The decoder fits the image inside the target while it streams, so the
+   * full-resolution bitmap is never held. */
+  res = cmp_image_decoder_create(key.width, key.height, &load->dec);
+  if (res == CMP_SUCCESS)
+    res = cmp_image_decoder_set_callbacks(load->dec, rm_load_header, NULL,
+                                          load);
+  if (res == CMP_SUCCESS)
+    res = load->client
+              ? cmp_modality_queue_task(ctx->workers, rm_load_fetch, load)
+              : cmp_image_decode_file_async(ctx->workers, url, load->dec,
+                                            rm_load_done, load);
+  if (res != CMP_SUCCESS) {
+    rm_load_free(load);
+    return res;
+  }
+  load->next = ctx->loads;
+  ctx->loads = load;
   return CMP_SUCCESS;
 }
 
@@ -89,11 +571,187 @@ int cmp_resources_allocate_offscreen_bitmap(cmp_resource_manager_t *rm_opaque,
                                             float width, float height,
                                             void **out_bitmap) {
   struct cmp_resource_manager *ctx = (struct cmp_resource_manager *)rm_opaque;
+  rm_offscreen_t *block;
+  size_t w, h, bytes;
   if (!ctx || width <= 0.0f || height <= 0.0f || !out_bitmap)
     return CMP_ERROR_INVALID_ARG;
 
   /* Monitored equivalent to drawRect that avoids massive allocations unless
-   * necessary */
-  *out_bitmap = (void *)1;
+   * necessary: an RGBA8 surface, charged against the CPU budget so cached
+   * bitmaps are evicted to make room */
+  w = (size_t)(width + 0.999f);
+  h = (size_t)(height + 0.999f);
+  if (w > ((size_t)-1 - sizeof(rm_offscreen_t)) / 4 / h)
+    return CMP_ERROR_OOM;
+  bytes = w * h * 4;
+  if (CMP_MALLOC(sizeof(rm_offscreen_t) + bytes, (void **)&block) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(block + 1, 0, bytes);
+  block->bytes = bytes;
+  block->next = ctx->offscreen;
+  ctx->offscreen = block;
+  ctx->offscreen_bytes += bytes;
+  rm_pool_shrink(ctx, CMP_RESOURCE_POOL_CPU,
+                 rm_effective_budget(ctx, CMP_RESOURCE_POOL_CPU));
+
+  *out_bitmap = (void *)(block + 1);
+  return CMP_SUCCESS;
+}
+
+int cmp_resources_release_offscreen_bitmap(cmp_resource_manager_t *rm_opaque,
+                                           void *bitmap) {
+  struct cmp_resource_manager *ctx = (struct cmp_resource_manager *)rm_opaque;
+  rm_offscreen_t **link;
+  if (!ctx || !bitmap)
+    return CMP_ERROR_INVALID_ARG;
+
+  for (link = &ctx->offscreen; *link; link = &(*link)->next) {
+    if ((void *)(*link + 1) == bitmap) {
+      rm_offscreen_t *block = *link;
+      *link = block->next;
+      ctx->offscreen_bytes -= block->bytes;
+      CMP_FREE(block);
+      return CMP_SUCCESS;
+    }
+  }
+  return CMP_ERROR_NOT_FOUND;
+}
+
+int cmp_resources_set_cache_budget(cmp_resource_manager_t *rm_opaque,
+                                   cmp_resource_pool_t pool, size_t bytes) {
+  struct cmp_resource_manager *ctx = (struct cmp_resource_manager *)rm_opaque;
+  if (!ctx || (int)pool < 0 || (int)pool >= RM_POOL_COUNT)
+    return CMP_ERROR_INVALID_ARG;
+
+  ctx->pools[pool].budget = bytes;
+  rm_pool_shrink(ctx, (int)pool, rm_effective_budget(ctx, (int)pool));
+  return CMP_SUCCESS;
+}
+
+int cmp_resources_cache_insert(cmp_resource_manager_t *rm_opaque,
+                               cmp_resource_pool_t pool,
+                               const cmp_resource_key_t *key, void *payload,
+                               size_t bytes, cmp_resource_release_cb_t release,
+                               void *release_user_data) {
+  struct cmp_resource_manager *ctx = (struct cmp_resource_manager *)rm_opaque;
+  unsigned long hash;
+  rm_entry_t **slot;
+  rm_entry_t *e;
+  size_t budget, len;
+  if (!ctx || (int)pool < 0 || (int)pool >= RM_POOL_COUNT ||
+      !rm_key_valid(key) || !payload)
+    return CMP_ERROR_INVALID_ARG;
+
+  budget = rm_effective_budget(ctx, (int)pool);
+  if (bytes > budget) {
+    ctx->rejections++;
+    return CMP_ERROR_OOM;
+  }
+
+  hash = rm_hash_key(key);
+  slot = rm_find_slot(ctx, hash, key);
+  if (*slot)
+    rm_entry_free(ctx, *slot);
+
+  if (CMP_MALLOC(sizeof(rm_entry_t), (void **)&e) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(e, 0, sizeof(rm_entry_t));
+  len = strlen(key->source);
+  if (CMP_MALLOC(len + 1, (void **)&e->source) != CMP_SUCCESS) {
+    CMP_FREE(e);
+    return CMP_ERROR_OOM;
+  }
+  memcpy(e->source, key->source, len + 1);
+  e->hash = hash;
+  e->width = key->width;
+  e->height = key->height;
+  e->color_space = (int)key->color_space;
+  e->pool = (int)pool;
+  e->payload = payload;
+  e->bytes = bytes;
+  e->release = release;
+  e->release_user_data = release_user_data;
+
+  /* Make room first so the new entry is never its own victim. */
+  rm_pool_shrink(ctx, (int)pool, budget - bytes);
+
+  if (ctx->entry_count >= ctx->bucket_count)
+    rm_grow_buckets(ctx); /* A failed grow only lengthens the chains. */
+  e->hash_next = ctx->buckets[hash & (ctx->bucket_count - 1)];
+  ctx->buckets[hash & (ctx->bucket_count - 1)] = e;
+  rm_ring_insert(&ctx->pools[pool], e);
+  ctx->pools[pool].bytes += bytes;
+  ctx->entry_count++;
+  ctx->insertions++;
+  return CMP_SUCCESS;
+}
+
+int cmp_resources_cache_lookup(cmp_resource_manager_t *rm_opaque,
+                               const cmp_resource_key_t *key,
+                               void **out_payload) {
+  struct cmp_resource_manager *ctx = (struct cmp_resource_manager *)rm_opaque;
+  rm_entry_t *e;
+  if (!ctx || !rm_key_valid(key) || !out_payload)
+    return CMP_ERROR_INVALID_ARG;
+
+  e = *rm_find_slot(ctx, rm_hash_key(key), key);
+  if (!e) {
+    ctx->misses++;
+    *out_payload = NULL;
+    return CMP_ERROR_NOT_FOUND;
+  }
+  e->referenced = 1;
+  ctx->hits++;
+  *out_payload = e->payload;
+  return CMP_SUCCESS;
+}
+
+int cmp_resources_cache_remove(cmp_resource_manager_t *rm_opaque,
+                               const cmp_resource_key_t *key) {
+  struct cmp_resource_manager *ctx = (struct cmp_resource_manager *)rm_opaque;
+  rm_entry_t *e;
+  if (!ctx || !rm_key_valid(key))
+    return CMP_ERROR_INVALID_ARG;
+
+  e = *rm_find_slot(ctx, rm_hash_key(key), key);
+  if (!e)
+    return CMP_ERROR_NOT_FOUND;
+  rm_entry_free(ctx, e);
+  return CMP_SUCCESS;
+}
+
+int cmp_resources_cache_trim(cmp_resource_manager_t *rm_opaque,
+                             cmp_resource_pool_t pool, size_t target_bytes) {
+  struct cmp_resource_manager *ctx = (struct cmp_resource_manager *)rm_opaque;
+  if (!ctx || (int)pool < 0 || (int)pool >= RM_POOL_COUNT)
+    return CMP_ERROR_INVALID_ARG;
+
+  rm_pool_shrink(ctx, (int)pool, target_bytes);
+  return CMP_SUCCESS;
+}
+
+int cmp_resources_get_cache_stats(const cmp_resource_manager_t *rm_opaque,
+                                  cmp_resource_cache_stats_t *out_stats) {
+  const struct cmp_resource_manager *ctx =
+      (const struct cmp_resource_manager *)rm_opaque;
+  const rm_load_t *load;
+  if (!ctx || !out_stats)
+    return CMP_ERROR_INVALID_ARG;
+
+  out_stats->cpu_bytes = ctx->pools[CMP_RESOURCE_POOL_CPU].bytes;
+  out_stats->gpu_bytes = ctx->pools[CMP_RESOURCE_POOL_GPU].bytes;
+  out_stats->cpu_budget = rm_effective_budget(ctx, CMP_RESOURCE_POOL_CPU);
+  out_stats->gpu_budget = rm_effective_budget(ctx, CMP_RESOURCE_POOL_GPU);
+  out_stats->offscreen_bytes = ctx->offscreen_bytes;
+  out_stats->entry_count = ctx->entry_count;
+  out_stats->hits = ctx->hits;
+  out_stats->misses = ctx->misses;
+  out_stats->insertions = ctx->insertions;
+  out_stats->evictions = ctx->evictions;
+  out_stats->rejections = ctx->rejections;
+  out_stats->pending_loads = 0;
+  for (load = ctx->loads; load; load = load->next)
+    out_stats->pending_loads++;
   return CMP_SUCCESS;
 }
@@ -16,6 +16,8 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #if defined(__linux__)
 #include <sys/inotify.h>
 #include <sys/select.h>
@@ -165,66 +167,79 @@ int cmp_vfs_resolve_path(const char *virtual_path, cmp_string_t *out_path) {
   return CMP_SUCCESS;
 }
 
-int cmp_vfs_read_file_sync(const char *virtual_path, void **out_buffer,
-                           size_t *out_size) {
-  cfs_path p;
+static int cmp_vfs_open_native(const char *virtual_path, int for_write,
+                               cfs_path *p, FILE **out_f) {
   cmp_string_t resolved_path;
   const cfs_char_t *native_path;
   FILE *f;
-  cfs_uintmax_t file_size = 0;
-  void *buf = NULL;
-  int res;
-  size_t read_bytes;
-
-  if (virtual_path == NULL || out_buffer == NULL || out_size == NULL ||
-      !g_vfs_initialized) {
-    return CMP_ERROR_INVALID_ARG;
-  }
 
   if (cmp_vfs_resolve_path(virtual_path, &resolved_path) != CMP_SUCCESS) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  cfs_path_init(&p);
+  cfs_path_init(p);
 #if defined(_WIN32)
   {
     wchar_t *wpath = NULL;
     cfs_size_t req_len = 0;
     cfs_utf8_to_utf16(resolved_path.data, NULL, 0, &req_len);
     if (req_len <= 0) {
-      cfs_path_destroy(&p);
+      cfs_path_destroy(p);
       cmp_string_destroy(&resolved_path);
       return CMP_ERROR_INVALID_ARG;
     }
     if (CMP_MALLOC((size_t)req_len * sizeof(wchar_t), (void **)&wpath) !=
         CMP_SUCCESS) {
-      cfs_path_destroy(&p);
+      cfs_path_destroy(p);
       cmp_string_destroy(&resolved_path);
       return CMP_ERROR_OOM;
     }
     cfs_utf8_to_utf16(resolved_path.data, wpath, req_len, NULL);
-    cfs_path_assign(&p, wpath);
+    cfs_path_assign(p, wpath);
     CMP_FREE(wpath);
   }
 #else
-  cfs_path_assign(&p, resolved_path.data);
+  cfs_path_assign(p, resolved_path.data);
 #endif
 
   cmp_string_destroy(&resolved_path);
 
-  cfs_path_c_str(&p, &native_path);
+  cfs_path_c_str(p, &native_path);
 
 #if defined(_WIN32)
-  f = _wfopen(native_path, L"rb");
+  f = _wfopen(native_path, for_write ? L"wb" : L"rb");
 #else
-  f = fopen(native_path, "rb");
+  f = fopen(native_path, for_write ? "wb" : "rb");
 #endif
 
   if (!f) {
-    cfs_path_destroy(&p);
+    cfs_path_destroy(p);
     return CMP_ERROR_NOT_FOUND;
   }
 
+  *out_f = f;
+  return CMP_SUCCESS;
+}
+
+int cmp_vfs_read_file_sync(const char *virtual_path, void **out_buffer,
+                           size_t *out_size) {
+  cfs_path p;
+  FILE *f;
+  cfs_uintmax_t file_size = 0;
+  void *buf = NULL;
+  int res;
+  size_t read_bytes;
+
+  if (virtual_path == NULL || out_buffer == NULL || out_size == NULL ||
+      !g_vfs_initialized) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  res = cmp_vfs_open_native(virtual_path, 0, &p, &f);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+
   res = cfs_file_size(&p, &file_size, NULL);
   if (res != 0) {
     fclose(f);
@@ -257,6 +272,185 @@ int cmp_vfs_read_file_sync(const char *virtual_path, void **out_buffer,
   return CMP_SUCCESS;
 }
 
+int cmp_vfs_read_file_chunked(const char *virtual_path, size_t chunk_size,
+                              cmp_vfs_chunk_cb_t callback, void *user_data) {
+  cfs_path p;
+  FILE *f;
+  unsigned char *chunk;
+  size_t n;
+  int res;
+
+  if (virtual_path == NULL || callback == NULL || chunk_size == 0 ||
+      !g_vfs_initialized) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  res = cmp_vfs_open_native(virtual_path, 0, &p, &f);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+
+  if (CMP_MALLOC(chunk_size, (void **)&chunk) != CMP_SUCCESS) {
+    fclose(f);
+    cfs_path_destroy(&p);
+    return CMP_ERROR_OOM;
+  }
+
+  res = CMP_SUCCESS;
+  while ((n = fread(chunk, 1, chunk_size, f)) > 0) {
+    res = callback(user_data, chunk, n);
+    if (res != 0) {
+      break;
+    }
+  }
+  if (res == CMP_SUCCESS && ferror(f)) {
+    res = CMP_ERROR_NOT_FOUND;
+  }
+
+  CMP_FREE(chunk);
+  fclose(f);
+  cfs_path_destroy(&p);
+  return res;
+}
+
+struct cmp_vfs_writer {
+  FILE *f;
+  cfs_path p;
+  int error;
+};
+
+int cmp_vfs_writer_open(const char *virtual_path,
+                        cmp_vfs_writer_t **out_writer) {
+  cmp_vfs_writer_t *w;
+  int res;
+
+  if (virtual_path == NULL || out_writer == NULL || !g_vfs_initialized) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(cmp_vfs_writer_t), (void **)&w) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(w, 0, sizeof(cmp_vfs_writer_t));
+
+  res = cmp_vfs_open_native(virtual_path, 1, &w->p, &w->f);
+  if (res != CMP_SUCCESS) {
+    CMP_FREE(w);
+    return res;
+  }
+
+  *out_writer = w;
+  return CMP_SUCCESS;
+}
+
+int cmp_vfs_writer_write(cmp_vfs_writer_t *writer, const void *data,
+                         size_t len) {
+  if (writer == NULL || (data == NULL && len > 0)) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (writer->error != CMP_SUCCESS) {
+    return writer->error;
+  }
+  if (len > 0 && fwrite(data, 1, len, writer->f) != len) {
+    writer->error = CMP_ERROR_INVALID_STATE;
+  }
+  return writer->error;
+}
+
+int cmp_vfs_writer_close(cmp_vfs_writer_t *writer) {
+  int res;
+
+  if (writer == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  res = writer->error;
+  if (fclose(writer->f) != 0 && res == CMP_SUCCESS) {
+    res = CMP_ERROR_INVALID_STATE;
+  }
+  cfs_path_destroy(&writer->p);
+  CMP_FREE(writer);
+  return res;
+}
+
+struct cmp_vfs_mapping {
+  void *data;
+  size_t size;
+  int mapped; /* 1 when data is an mmap view, 0 when it was read */
+};
+
+int cmp_vfs_map_file(const char *virtual_path, cmp_vfs_mapping_t **out_map,
+                     const void **out_data, size_t *out_size) {
+  cmp_vfs_mapping_t *map;
+  int res;
+
+  if (virtual_path == NULL || out_map == NULL || out_data == NULL ||
+      out_size == NULL || !g_vfs_initialized) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+  if (CMP_MALLOC(sizeof(cmp_vfs_mapping_t), (void **)&map) != CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  memset(map, 0, sizeof(cmp_vfs_mapping_t));
+
+#if !defined(_WIN32)
+  {
+    cmp_string_t resolved_path;
+    struct stat st;
+    int fd;
+
+    if (cmp_vfs_resolve_path(virtual_path, &resolved_path) != CMP_SUCCESS) {
+      CMP_FREE(map);
+      return CMP_ERROR_INVALID_ARG;
+    }
+    fd = open(resolved_path.data, O_RDONLY);
+    cmp_string_destroy(&resolved_path);
+    if (fd < 0) {
+      CMP_FREE(map);
+      return CMP_ERROR_NOT_FOUND;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *view = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd,
+                        0);
+      if (view != MAP_FAILED) {
+        map->data = view;
+        map->size = (size_t)st.st_size;
+        map->mapped = 1;
+      }
+    }
+    close(fd);
+  }
+#endif
+
+  /* Empty files, failed mappings and platforms without mmap read instead */
+  if (!map->mapped) {
+    res = cmp_vfs_read_file_sync(virtual_path, &map->data, &map->size);
+    if (res != CMP_SUCCESS) {
+      CMP_FREE(map);
+      return res;
+    }
+  }
+
+  *out_map = map;
+  *out_data = map->data;
+  *out_size = map->size;
+  return CMP_SUCCESS;
+}
+
+int cmp_vfs_unmap_file(cmp_vfs_mapping_t *map) {
+  if (map == NULL) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+#if !defined(_WIN32)
+  if (map->mapped) {
+    munmap(map->data, map->size);
+  } else
+#endif
+  if (map->data != NULL) {
+    CMP_FREE(map->data);
+  }
+  CMP_FREE(map);
+  return CMP_SUCCESS;
+}
+
 typedef struct {
   char *virtual_path;
   cmp_vfs_read_cb_t callback;
@@ -3,6 +3,7 @@
 #include "themes/cmp_f2_data_display.h"
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 /* clang-format on */
 
 CMP_API int cmp_f2_avatar_create(cmp_ui_node_t **out_node,
@@ -234,6 +235,7 @@ CMP_API int cmp_f2_datagrid_create(cmp_ui_node_t **out_node) {
 
   data->header_row_node = NULL;
   data->rows_container_node = NULL;
+  data->view = NULL;
 
   (*out_node)->properties = (void *)data;
   return CMP_SUCCESS;
@@ -254,6 +256,49 @@ CMP_API int cmp_f2_datagrid_row_create(cmp_ui_node_t **out_node,
   return res;
 }
 
+CMP_API int cmp_f2_datagrid_set_model(cmp_ui_node_t *node,
+                                      cmp_datagrid_model_t *model,
+                                      float row_height) {
+  cmp_f2_datagrid_t *data;
+  int res;
+
+  if (!node || !node->properties || (model && row_height <= 0.0f))
+    return CMP_ERROR_INVALID_ARG;
+  data = (cmp_f2_datagrid_t *)node->properties;
+
+  if (data->view) {
+    cmp_datagrid_view_destroy(data->view);
+    data->view = NULL;
+  }
+  if (!model)
+    return CMP_SUCCESS;
+
+  if (!data->rows_container_node) {
+    res = cmp_ui_box_create(&data->rows_container_node);
+    if (res != CMP_SUCCESS)
+      return res;
+    data->rows_container_node->layout->flex_grow = 1.0f;
+    data->rows_container_node->layout->overflow_x = 1;
+    data->rows_container_node->layout->overflow_y = 1;
+    res = cmp_ui_node_add_child(node, data->rows_container_node);
+    if (res != CMP_SUCCESS) {
+      cmp_ui_node_destroy(data->rows_container_node);
+      data->rows_container_node = NULL;
+      return res;
+    }
+  }
+  return cmp_datagrid_view_create(&data->view, model,
+                                  data->rows_container_node, row_height);
+}
+
+CMP_API int cmp_f2_datagrid_get_view(cmp_ui_node_t *node,
+                                     cmp_datagrid_view_t **out_view) {
+  if (!node || !node->properties || !out_view)
+    return CMP_ERROR_INVALID_ARG;
+  *out_view = ((cmp_f2_datagrid_t *)node->properties)->view;
+  return CMP_SUCCESS;
+}
+
 CMP_API int cmp_f2_tree_create(cmp_ui_node_t **out_node) {
   int res;
   if (!out_node)
@@ -290,6 +335,8 @@ CMP_API int cmp_f2_tree_item_create(cmp_ui_node_t **out_node,
   data->chevron_node = NULL;
   data->content_node = NULL;
   data->children_container_node = NULL;
+  data->model = NULL;
+  data->model_node = 0;
 
   if (label) {
     res = cmp_ui_text_create(&data->content_node, label, -1);
@@ -309,6 +356,9 @@ CMP_API int cmp_f2_tree_item_set_expanded(cmp_ui_node_t *node,
     return CMP_ERROR_INVALID_ARG;
   data = (cmp_f2_tree_item_t *)node->properties;
   data->is_expanded = is_expanded ? 1 : 0;
+  if (data->model)
+    return cmp_tree_model_set_expanded(data->model, data->model_node,
+                                       is_expanded);
   return CMP_SUCCESS;
 }
 
@@ -321,3 +371,113 @@ CMP_API int cmp_f2_tree_item_set_selected(cmp_ui_node_t *node,
   data->is_selected = is_selected ? 1 : 0;
   return CMP_SUCCESS;
 }
+
+static size_t f2_tree_count(void *user_data) {
+  size_t count = 0;
+  cmp_tree_model_get_row_count(((cmp_f2_tree_t *)user_data)->model, &count);
+  return count;
+}
+
+static int f2_tree_create_cell(void *user_data, int cell_type,
+                               cmp_ui_node_t **out_cell) {
+  (void)user_data;
+  (void)cell_type;
+  return cmp_f2_tree_item_create(out_cell, "");
+}
+
+static void f2_tree_destroy_cell(void *user_data, cmp_ui_node_t *cell) {
+  (void)user_data;
+  free(cell->properties);
+  cell->properties = NULL;
+}
+
+static int f2_tree_bind_cell(void *user_data, cmp_ui_node_t *cell,
+                             size_t index, float *io_height) {
+  cmp_f2_tree_t *tree = (cmp_f2_tree_t *)user_data;
+  cmp_f2_tree_item_t *item = (cmp_f2_tree_item_t *)cell->properties;
+  cmp_ui_node_t *label = item->content_node;
+  cmp_tree_node_info_t info;
+  size_t id, len;
+  char *copy;
+  int res;
+
+  (void)io_height;
+  res = cmp_tree_model_get_node_at_row(tree->model, index, &id);
+  if (res == CMP_SUCCESS)
+    res = cmp_tree_model_get_info(tree->model, id, &info);
+  if (res != CMP_SUCCESS)
+    return res;
+  if (label && strcmp((const char *)label->properties, info.label) != 0) {
+    len = strlen(info.label);
+    if (CMP_MALLOC(len + 1, (void **)&copy) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    memcpy(copy, info.label, len + 1);
+    CMP_FREE(label->properties);
+    label->properties = copy;
+  }
+  item->model = tree->model;
+  item->model_node = id;
+  item->is_expanded = info.is_expanded;
+  cell->layout->padding[3] = tree->indent * (float)info.depth;
+  return CMP_SUCCESS;
+}
+
+static void f2_tree_changed(cmp_tree_model_t *model, size_t parent_row,
+                            size_t at, size_t removed, size_t inserted,
+                            void *user_data) {
+  cmp_f2_tree_t *tree = (cmp_f2_tree_t *)user_data;
+  (void)model;
+  cmp_virtual_list_splice(tree->list, at, removed, inserted);
+  if (parent_row != CMP_TREE_NONE)
+    cmp_virtual_list_reload_item(tree->list, parent_row);
+}
+
+CMP_API int cmp_f2_tree_set_model(cmp_ui_node_t *node, cmp_tree_model_t *model,
+                                  float row_height) {
+  cmp_f2_tree_t *tree;
+  cmp_virtual_list_source_t source;
+  int res;
+
+  if (!node || (model && row_height <= 0.0f))
+    return CMP_ERROR_INVALID_ARG;
+  tree = (cmp_f2_tree_t *)node->properties;
+  if (tree) {
+    cmp_tree_model_set_change_handler(tree->model, NULL, NULL);
+    cmp_virtual_list_destroy(tree->list);
+    free(tree);
+    node->properties = NULL;
+  }
+  if (!model)
+    return CMP_SUCCESS;
+
+  tree = (cmp_f2_tree_t *)malloc(sizeof(cmp_f2_tree_t));
+  if (!tree)
+    return CMP_ERROR_OOM;
+  tree->model = model;
+  tree->list = NULL;
+  tree->indent = 16.0f;
+
+  memset(&source, 0, sizeof(source));
+  source.count = f2_tree_count;
+  source.create_cell = f2_tree_create_cell;
+  source.bind_cell = f2_tree_bind_cell;
+  source.destroy_cell = f2_tree_destroy_cell;
+  source.estimated_height = row_height;
+  source.user_data = tree;
+  res = cmp_virtual_list_create(&tree->list, node, &source, 1);
+  if (res != CMP_SUCCESS) {
+    free(tree);
+    return res;
+  }
+  node->properties = (void *)tree;
+  return cmp_tree_model_set_change_handler(model, f2_tree_changed, tree);
+}
+
+CMP_API int cmp_f2_tree_get_list(cmp_ui_node_t *node,
+                                 cmp_virtual_list_t **out_list) {
+  if (!node || !out_list)
+    return CMP_ERROR_INVALID_ARG;
+  *out_list = node->properties ? ((cmp_f2_tree_t *)node->properties)->list
+                               : NULL;
+  return CMP_SUCCESS;
+}
@@ -2,6 +2,7 @@
 #include "cmp.h"
 #include "themes/cmp_material3_color.h"
 #include <math.h>
+#include <string.h>
 /* clang-format on */
 
 #ifndef M_PI
@@ -309,4 +310,340 @@ int cmp_m3_scheme_content(float hue, float chroma, float tone, int is_dark,
   cmp_m3_hct_to_srgb(hue, chroma, is_dark ? 80.0f : 40.0f,
                      &out_palette->primary);
   return CMP_SUCCESS;
-}
\ No newline at end of file
+}
+
+/* Batch conversion kernels.
+ * Colors are processed in blocks of CMP_M3_BATCH_LANES laid out as structure
+ * of arrays; every stage is a straight loop over the lanes of a block so the
+ * compiler can vectorise it. The arithmetic per lane matches the scalar path
+ * exactly. */
+
+static void m3_lab_to_srgb_lanes(const float *l, const float *a,
+                                 const float *b, size_t n,
+                                 cmp_color_t *out_colors) {
+  float x[CMP_M3_BATCH_LANES], y[CMP_M3_BATCH_LANES], z[CMP_M3_BATCH_LANES];
+  float r[CMP_M3_BATCH_LANES], g[CMP_M3_BATCH_LANES], bl[CMP_M3_BATCH_LANES];
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    float fy = (l[i] + 16.0f) / 116.0f;
+    float fx = (a[i] / 500.0f) + fy;
+    float fz = fy - (b[i] / 200.0f);
+    x[i] = WHITE_X * lab_inv_f(fx);
+    y[i] = WHITE_Y * lab_inv_f(fy);
+    z[i] = WHITE_Z * lab_inv_f(fz);
+  }
+
+  for (i = 0; i < n; i++) {
+    r[i] = x[i] * 3.2406f + y[i] * -1.5372f + z[i] * -0.4986f;
+    g[i] = x[i] * -0.9689f + y[i] * 1.8758f + z[i] * 0.0415f;
+    bl[i] = x[i] * 0.0557f + y[i] * -0.2040f + z[i] * 1.0570f;
+  }
+
+  for (i = 0; i < n; i++) {
+    r[i] = delinearize(r[i]);
+    g[i] = delinearize(g[i]);
+    bl[i] = delinearize(bl[i]);
+  }
+
+  for (i = 0; i < n; i++) {
+    r[i] = r[i] < 0.0f ? 0.0f : (r[i] > 1.0f ? 1.0f : r[i]);
+    g[i] = g[i] < 0.0f ? 0.0f : (g[i] > 1.0f ? 1.0f : g[i]);
+    bl[i] = bl[i] < 0.0f ? 0.0f : (bl[i] > 1.0f ? 1.0f : bl[i]);
+  }
+
+  for (i = 0; i < n; i++) {
+    out_colors[i].r = r[i];
+    out_colors[i].g = g[i];
+    out_colors[i].b = bl[i];
+    out_colors[i].a = 1.0f;
+    out_colors[i].space = CMP_COLOR_SPACE_SRGB;
+  }
+}
+
+int cmp_m3_srgb_to_hct_batch(const cmp_color_t *in_colors, size_t count,
+                             float *out_hue, float *out_chroma,
+                             float *out_tone) {
+  float r[CMP_M3_BATCH_LANES], g[CMP_M3_BATCH_LANES], bl[CMP_M3_BATCH_LANES];
+  float fx[CMP_M3_BATCH_LANES], fy[CMP_M3_BATCH_LANES], fz[CMP_M3_BATCH_LANES];
+  size_t base, n, i;
+
+  if (count == 0)
+    return CMP_SUCCESS;
+  if (!in_colors || !out_hue || !out_chroma || !out_tone)
+    return CMP_ERROR_INVALID_ARG;
+
+  for (base = 0; base < count; base += n) {
+    n = count - base;
+    if (n > CMP_M3_BATCH_LANES)
+      n = CMP_M3_BATCH_LANES;
+
+    for (i = 0; i < n; i++) {
+      r[i] = linearize(in_colors[base + i].r);
+      g[i] = linearize(in_colors[base + i].g);
+      bl[i] = linearize(in_colors[base + i].b);
+    }
+
+    for (i = 0; i < n; i++) {
+      float x = r[i] * 0.4124f + g[i] * 0.3576f + bl[i] * 0.1805f;
+      float y = r[i] * 0.2126f + g[i] * 0.7152f + bl[i] * 0.0722f;
+      float z = r[i] * 0.0193f + g[i] * 0.1192f + bl[i] * 0.9505f;
+      fx[i] = x / WHITE_X;
+      fy[i] = y / WHITE_Y;
+      fz[i] = z / WHITE_Z;
+    }
+
+    for (i = 0; i < n; i++) {
+      fx[i] = lab_f(fx[i]);
+      fy[i] = lab_f(fy[i]);
+      fz[i] = lab_f(fz[i]);
+    }
+
+    for (i = 0; i < n; i++) {
+      float a = 500.0f * (fx[i] - fy[i]);
+      float b = 200.0f * (fy[i] - fz[i]);
+      float hue = (float)(atan2(b, a) * 180.0f / M_PI);
+      if (hue < 0.0f)
+        hue += 360.0f;
+      out_hue[base + i] = hue;
+      out_chroma[base + i] = (float)sqrt(a * a + b * b);
+      out_tone[base + i] = (116.0f * fy[i]) - 16.0f;
+    }
+  }
+
+  return CMP_SUCCESS;
+}
+
+int cmp_m3_hct_to_srgb_batch(const float *hue, const float *chroma,
+                             const float *tone, size_t count,
+                             cmp_color_t *out_colors) {
+  float a[CMP_M3_BATCH_LANES], b[CMP_M3_BATCH_LANES];
+  size_t base, n, i;
+
+  if (count == 0)
+    return CMP_SUCCESS;
+  if (!hue || !chroma || !tone || !out_colors)
+    return CMP_ERROR_INVALID_ARG;
+
+  for (base = 0; base < count; base += n) {
+    n = count - base;
+    if (n > CMP_M3_BATCH_LANES)
+      n = CMP_M3_BATCH_LANES;
+
+    for (i = 0; i < n; i++) {
+      a[i] = chroma[base + i] * (float)cos(hue[base + i] * M_PI / 180.0f);
+      b[i] = chroma[base + i] * (float)sin(hue[base + i] * M_PI / 180.0f);
+    }
+    m3_lab_to_srgb_lanes(tone + base, a, b, n, out_colors + base);
+  }
+
+  return CMP_SUCCESS;
+}
+
+/* Converts the given integer tones of a single (hue, chroma) palette. The
+ * hue's trigonometry is shared by every lane. */
+static void m3_palette_fill_tones(cmp_m3_tonal_palette_t *palette,
+                                  const int *tone_idx, size_t count) {
+  float l[CMP_M3_BATCH_LANES], a[CMP_M3_BATCH_LANES], b[CMP_M3_BATCH_LANES];
+  cmp_color_t out[CMP_M3_BATCH_LANES];
+  float pa, pb;
+  size_t base, n, i;
+
+  pa = palette->chroma * (float)cos(palette->hue * M_PI / 180.0f);
+  pb = palette->chroma * (float)sin(palette->hue * M_PI / 180.0f);
+
+  for (base = 0; base < count; base += n) {
+    n = count - base;
+    if (n > CMP_M3_BATCH_LANES)
+      n = CMP_M3_BATCH_LANES;
+
+    for (i = 0; i < n; i++) {
+      l[i] = (float)tone_idx[base + i];
+      a[i] = pa;
+      b[i] = pb;
+    }
+    m3_lab_to_srgb_lanes(l, a, b, n, out);
+    for (i = 0; i < n; i++) {
+      palette->tones[tone_idx[base + i]] = out[i];
+      palette->computed[tone_idx[base + i]] = 1;
+    }
+  }
+}
+
+int cmp_m3_tonal_palette_build(float hue, float chroma,
+                               cmp_m3_tonal_palette_t *out_palette) {
+  int idx[CMP_M3_TONE_COUNT];
+  int i;
+
+  if (!out_palette)
+    return CMP_ERROR_INVALID_ARG;
+
+  out_palette->hue = hue;
+  out_palette->chroma = chroma;
+  for (i = 0; i < CMP_M3_TONE_COUNT; i++)
+    idx[i] = i;
+  m3_palette_fill_tones(out_palette, idx, CMP_M3_TONE_COUNT);
+
+  return CMP_SUCCESS;
+}
+
+#define M3_CACHE_WAYS 4
+
+typedef struct m3_palette_slot {
+  long hue_key;
+  long chroma_key;
+  unsigned long last_used;
+  int in_use;
+  cmp_m3_tonal_palette_t palette;
+} m3_palette_slot_t;
+
+struct cmp_m3_palette_cache {
+  m3_palette_slot_t *slots;
+  size_t set_count;
+  unsigned long clock;
+  size_t hits;
+  size_t misses;
+};
+
+int cmp_m3_palette_cache_create(size_t capacity,
+                                cmp_m3_palette_cache_t **out_cache) {
+  cmp_m3_palette_cache_t *cache;
+  size_t sets = 1;
+
+  if (!out_cache || capacity == 0)
+    return CMP_ERROR_INVALID_ARG;
+
+  /* Power-of-two set count so the set index is a mask. */
+  while (sets * M3_CACHE_WAYS < capacity)
+    sets <<= 1;
+
+  if (CMP_MALLOC(sizeof(cmp_m3_palette_cache_t), (void **)&cache) !=
+      CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  if (CMP_MALLOC(sizeof(m3_palette_slot_t) * sets * M3_CACHE_WAYS,
+                 (void **)&cache->slots) != CMP_SUCCESS) {
+    CMP_FREE(cache);
+    return CMP_ERROR_OOM;
+  }
+  memset(cache->slots, 0, sizeof(m3_palette_slot_t) * sets * M3_CACHE_WAYS);
+  cache->set_count = sets;
+  cache->clock = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+
+  *out_cache = cache;
+  return CMP_SUCCESS;
+}
+
+int cmp_m3_palette_cache_destroy(cmp_m3_palette_cache_t *cache) {
+  if (!cache)
+    return CMP_ERROR_INVALID_ARG;
+  CMP_FREE(cache->slots);
+  CMP_FREE(cache);
+  return CMP_SUCCESS;
+}
+
+static m3_palette_slot_t *m3_palette_cache_lookup(cmp_m3_palette_cache_t *cache,
+                                                  float hue, float chroma) {
+  m3_palette_slot_t *set;
+  m3_palette_slot_t *victim;
+  unsigned long hash;
+  long hue_key, chroma_key;
+  size_t i;
+
+  hue = (float)fmod(hue, 360.0);
+  if (hue < 0.0f)
+    hue += 360.0f;
+  hue_key = (long)floor(hue * 100.0f + 0.5f);
+  chroma_key = (long)floor(chroma * 100.0f + 0.5f);
+
+  hash = (unsigned long)hue_key * 2654435761UL ^
+         (unsigned long)chroma_key * 40503UL;
+  set = cache->slots + (hash & (cache->set_count - 1)) * M3_CACHE_WAYS;
+
+  cache->clock++;
+  victim = set;
+  for (i = 0; i < M3_CACHE_WAYS; i++) {
+    if (set[i].in_use && set[i].hue_key == hue_key &&
+        set[i].chroma_key == chroma_key) {
+      set[i].last_used = cache->clock;
+      cache->hits++;
+      return &set[i];
+    }
+    if (!set[i].in_use) {
+      if (victim->in_use)
+        victim = &set[i];
+    } else if (victim->in_use && set[i].last_used < victim->last_used) {
+      victim = &set[i];
+    }
+  }
+
+  cache->misses++;
+  victim->in_use = 1;
+  victim->hue_key = hue_key;
+  victim->chroma_key = chroma_key;
+  victim->last_used = cache->clock;
+  victim->palette.hue = (float)hue_key / 100.0f;
+  victim->palette.chroma = (float)chroma_key / 100.0f;
+  memset(victim->palette.computed, 0, sizeof(victim->palette.computed));
+  return victim;
+}
+
+/* Returns the palette index for an integer tone in [0, 100], else -1. */
+static int m3_integer_tone(float tone) {
+  int ti;
+  if (!(tone >= 0.0f && tone <= 100.0f))
+    return -1;
+  ti = (int)tone;
+  return (float)ti == tone ? ti : -1;
+}
+
+int cmp_m3_palette_cache_tones(cmp_m3_palette_cache_t *cache, float hue,
+                               float chroma, const float *tones, size_t count,
+                               cmp_color_t *out_colors) {
+  m3_palette_slot_t *slot;
+  cmp_m3_tonal_palette_t *palette;
+  int missing[CMP_M3_TONE_COUNT];
+  size_t missing_count = 0;
+  size_t i;
+
+  if (!cache || (count > 0 && (!tones || !out_colors)))
+    return CMP_ERROR_INVALID_ARG;
+
+  slot = m3_palette_cache_lookup(cache, hue, chroma);
+  palette = &slot->palette;
+
+  for (i = 0; i < count; i++) {
+    int ti = m3_integer_tone(tones[i]);
+    if (ti >= 0 && !palette->computed[ti]) {
+      /* Mark now so duplicates in the request are only converted once. */
+      palette->computed[ti] = 1;
+      missing[missing_count++] = ti;
+    }
+  }
+  if (missing_count > 0)
+    m3_palette_fill_tones(palette, missing, missing_count);
+
+  for (i = 0; i < count; i++) {
+    int ti = m3_integer_tone(tones[i]);
+    if (ti >= 0) {
+      out_colors[i] = palette->tones[ti];
+    } else {
+      cmp_m3_hct_to_srgb(palette->hue, palette->chroma, tones[i],
+                         &out_colors[i]);
+    }
+  }
+
+  return CMP_SUCCESS;
+}
+
+int cmp_m3_palette_cache_get_stats(const cmp_m3_palette_cache_t *cache,
+                                   size_t *out_hits, size_t *out_misses) {
+  if (!cache)
+    return CMP_ERROR_INVALID_ARG;
+  if (out_hits)
+    *out_hits = cache->hits;
+  if (out_misses)
+    *out_misses = cache->misses;
+  return CMP_SUCCESS;
+}
@@ -5,173 +5,182 @@
 #include <stddef.h>
 /* clang-format on */
 
+/* Source palettes derived from the seed's hue (h) and chroma (c). */
+enum {
+  M3_PAL_PRIMARY = 0,         /* (h, c) */
+  M3_PAL_SECONDARY = 1,       /* (h, c / 3) */
+  M3_PAL_TERTIARY = 2,        /* (h + 60, c / 2) */
+  M3_PAL_ERROR = 3,           /* (25, 84) */
+  M3_PAL_NEUTRAL = 4,         /* (h, 4) */
+  M3_PAL_NEUTRAL_VARIANT = 5, /* (h, 8) */
+  M3_PAL_COUNT = 6
+};
+
+typedef struct m3_sys_role {
+  size_t offset;
+  int palette;
+  float light_tone;
+  float dark_tone;
+} m3_sys_role_t;
+
+#define M3_ROLE(field, pal, light, dark)                                       \
+  { offsetof(cmp_m3_sys_colors_t, field), pal, light, dark }
+
+/* Role table grouped by palette. The first entry (primary) has its tone
+ * replaced according to the contrast profile. */
+static const m3_sys_role_t k_m3_sys_roles[] = {
+    M3_ROLE(primary, M3_PAL_PRIMARY, 40.0f, 80.0f),
+    M3_ROLE(on_primary, M3_PAL_PRIMARY, 100.0f, 20.0f),
+    M3_ROLE(primary_container, M3_PAL_PRIMARY, 90.0f, 30.0f),
+    M3_ROLE(on_primary_container, M3_PAL_PRIMARY, 10.0f, 90.0f),
+    M3_ROLE(inverse_primary, M3_PAL_PRIMARY, 80.0f, 40.0f),
+    M3_ROLE(surface_tint, M3_PAL_PRIMARY, 40.0f, 80.0f),
+    M3_ROLE(primary_fixed, M3_PAL_PRIMARY, 90.0f, 90.0f),
+    M3_ROLE(primary_fixed_dim, M3_PAL_PRIMARY, 80.0f, 80.0f),
+    M3_ROLE(on_primary_fixed, M3_PAL_PRIMARY, 10.0f, 10.0f),
+    M3_ROLE(on_primary_fixed_variant, M3_PAL_PRIMARY, 30.0f, 30.0f),
+
+    M3_ROLE(secondary, M3_PAL_SECONDARY, 40.0f, 80.0f),
+    M3_ROLE(on_secondary, M3_PAL_SECONDARY, 100.0f, 20.0f),
+    M3_ROLE(secondary_container, M3_PAL_SECONDARY, 90.0f, 30.0f),
+    M3_ROLE(on_secondary_container, M3_PAL_SECONDARY, 10.0f, 90.0f),
+    M3_ROLE(secondary_fixed, M3_PAL_SECONDARY, 90.0f, 90.0f),
+    M3_ROLE(secondary_fixed_dim, M3_PAL_SECONDARY, 80.0f, 80.0f),
+    M3_ROLE(on_secondary_fixed, M3_PAL_SECONDARY, 10.0f, 10.0f),
+    M3_ROLE(on_secondary_fixed_variant, M3_PAL_SECONDARY, 30.0f, 30.0f),
+
+    M3_ROLE(tertiary, M3_PAL_TERTIARY, 40.0f, 80.0f),
+    M3_ROLE(on_tertiary, M3_PAL_TERTIARY, 100.0f, 20.0f),
+    M3_ROLE(tertiary_container, M3_PAL_TERTIARY, 90.0f, 30.0f),
+    M3_ROLE(on_tertiary_container, M3_PAL_TERTIARY, 10.0f, 90.0f),
+    M3_ROLE(tertiary_fixed, M3_PAL_TERTIARY, 90.0f, 90.0f),
+    M3_ROLE(tertiary_fixed_dim, M3_PAL_TERTIARY, 80.0f, 80.0f),
+    M3_ROLE(on_tertiary_fixed, M3_PAL_TERTIARY, 10.0f, 10.0f),
+    M3_ROLE(on_tertiary_fixed_variant, M3_PAL_TERTIARY, 30.0f, 30.0f),
+
+    M3_ROLE(error, M3_PAL_ERROR, 40.0f, 80.0f),
+    M3_ROLE(on_error, M3_PAL_ERROR, 100.0f, 20.0f),
+    M3_ROLE(error_container, M3_PAL_ERROR, 90.0f, 30.0f),
+    M3_ROLE(on_error_container, M3_PAL_ERROR, 10.0f, 90.0f),
+
+    M3_ROLE(surface_dim, M3_PAL_NEUTRAL, 87.0f, 6.0f),
+    M3_ROLE(surface, M3_PAL_NEUTRAL, 98.0f, 6.0f),
+    M3_ROLE(surface_bright, M3_PAL_NEUTRAL, 98.0f, 24.0f),
+    M3_ROLE(surface_container_lowest, M3_PAL_NEUTRAL, 100.0f, 4.0f),
+    M3_ROLE(surface_container_low, M3_PAL_NEUTRAL, 96.0f, 10.0f),
+    M3_ROLE(surface_container, M3_PAL_NEUTRAL, 94.0f, 12.0f),
+    M3_ROLE(surface_container_high, M3_PAL_NEUTRAL, 92.0f, 17.0f),
+    M3_ROLE(surface_container_highest, M3_PAL_NEUTRAL, 90.0f, 22.0f),
+    M3_ROLE(on_surface, M3_PAL_NEUTRAL, 10.0f, 90.0f),
+    M3_ROLE(inverse_surface, M3_PAL_NEUTRAL, 20.0f, 90.0f),
+    M3_ROLE(inverse_on_surface, M3_PAL_NEUTRAL, 95.0f, 20.0f),
+    M3_ROLE(scrim, M3_PAL_NEUTRAL, 0.0f, 0.0f),
+    M3_ROLE(shadow, M3_PAL_NEUTRAL, 0.0f, 0.0f),
+
+    M3_ROLE(on_surface_variant, M3_PAL_NEUTRAL_VARIANT, 30.0f, 80.0f),
+    M3_ROLE(outline, M3_PAL_NEUTRAL_VARIANT, 50.0f, 60.0f),
+    M3_ROLE(outline_variant, M3_PAL_NEUTRAL_VARIANT, 80.0f, 30.0f)};
+
+#define M3_SYS_ROLE_COUNT (sizeof(k_m3_sys_roles) / sizeof(k_m3_sys_roles[0]))
+
+/* Resolves hue/chroma per palette and the tone of every role for the mode. */
+static void m3_sys_resolve(cmp_color_t seed, int is_dark,
+                           cmp_m3_contrast_profile_t contrast,
+                           float *pal_hue, float *pal_chroma, float *tones) {
+  float h, c, t;
+  size_t i;
+
+  cmp_m3_srgb_to_hct(&seed, &h, &c, &t);
+
+  pal_hue[M3_PAL_PRIMARY] = h;
+  pal_chroma[M3_PAL_PRIMARY] = c;
+  pal_hue[M3_PAL_SECONDARY] = h;
+  pal_chroma[M3_PAL_SECONDARY] = c / 3.0f;
+  pal_hue[M3_PAL_TERTIARY] = h + 60.0f;
+  pal_chroma[M3_PAL_TERTIARY] = c / 2.0f;
+  pal_hue[M3_PAL_ERROR] = 25.0f;
+  pal_chroma[M3_PAL_ERROR] = 84.0f;
+  pal_hue[M3_PAL_NEUTRAL] = h;
+  pal_chroma[M3_PAL_NEUTRAL] = 4.0f;
+  pal_hue[M3_PAL_NEUTRAL_VARIANT] = h;
+  pal_chroma[M3_PAL_NEUTRAL_VARIANT] = 8.0f;
+
+  for (i = 0; i < M3_SYS_ROLE_COUNT; i++) {
+    tones[i] = is_dark ? k_m3_sys_roles[i].dark_tone
+                       : k_m3_sys_roles[i].light_tone;
+  }
+
+  if (contrast == CMP_M3_CONTRAST_HIGH) {
+    tones[0] = is_dark ? 100.0f : 20.0f;
+  } else if (contrast == CMP_M3_CONTRAST_MEDIUM) {
+    tones[0] = is_dark ? 90.0f : 30.0f;
+  }
+}
+
 int cmp_m3_sys_colors_generate(cmp_color_t seed, int is_dark,
                                cmp_m3_contrast_profile_t contrast,
                                cmp_m3_sys_colors_t *out_sys_colors) {
-  float h, c, t;
+  float pal_hue[M3_PAL_COUNT], pal_chroma[M3_PAL_COUNT];
+  float hue[M3_SYS_ROLE_COUNT], chroma[M3_SYS_ROLE_COUNT];
+  float tones[M3_SYS_ROLE_COUNT];
+  cmp_color_t colors[M3_SYS_ROLE_COUNT];
+  size_t i;
+
   if (!out_sys_colors) {
     return CMP_ERROR_INVALID_ARG;
   }
 
-  cmp_m3_srgb_to_hct(&seed, &h, &c, &t);
+  m3_sys_resolve(seed, is_dark, contrast, pal_hue, pal_chroma, tones);
+  for (i = 0; i < M3_SYS_ROLE_COUNT; i++) {
+    hue[i] = pal_hue[k_m3_sys_roles[i].palette];
+    chroma[i] = pal_chroma[k_m3_sys_roles[i].palette];
+  }
 
-  if (is_dark) {
-    if (contrast == CMP_M3_CONTRAST_HIGH) {
-      cmp_m3_hct_to_srgb(h, c, 100.0f, &out_sys_colors->primary);
-    } else if (contrast == CMP_M3_CONTRAST_MEDIUM) {
-      cmp_m3_hct_to_srgb(h, c, 90.0f, &out_sys_colors->primary);
-    } else {
-      cmp_m3_hct_to_srgb(h, c, 80.0f, &out_sys_colors->primary);
+  /* Every role in one batch conversion. */
+  cmp_m3_hct_to_srgb_batch(hue, chroma, tones, M3_SYS_ROLE_COUNT, colors);
+
+  for (i = 0; i < M3_SYS_ROLE_COUNT; i++) {
+    *(cmp_color_t *)((char *)out_sys_colors + k_m3_sys_roles[i].offset) =
+        colors[i];
+  }
+
+  return CMP_SUCCESS;
+}
+
+int cmp_m3_sys_colors_generate_cached(cmp_m3_palette_cache_t *cache,
+                                      cmp_color_t seed, int is_dark,
+                                      cmp_m3_contrast_profile_t contrast,
+                                      cmp_m3_sys_colors_t *out_sys_colors) {
+  float pal_hue[M3_PAL_COUNT], pal_chroma[M3_PAL_COUNT];
+  float tones[M3_SYS_ROLE_COUNT];
+  cmp_color_t colors[M3_SYS_ROLE_COUNT];
+  size_t start, end, i;
+  int res;
+
+  if (!cache || !out_sys_colors) {
+    return CMP_ERROR_INVALID_ARG;
+  }
+
+  m3_sys_resolve(seed, is_dark, contrast, pal_hue, pal_chroma, tones);
+
+  /* Roles are grouped by palette, so each run is one cache lookup. */
+  for (start = 0; start < M3_SYS_ROLE_COUNT; start = end) {
+    int pal = k_m3_sys_roles[start].palette;
+    end = start + 1;
+    while (end < M3_SYS_ROLE_COUNT && k_m3_sys_roles[end].palette == pal) {
+      end++;
     }
-    cmp_m3_hct_to_srgb(h, c, 20.0f, &out_sys_colors->on_primary);
-    cmp_m3_hct_to_srgb(h, c, 30.0f, &out_sys_colors->primary_container);
-    cmp_m3_hct_to_srgb(h, c, 90.0f, &out_sys_colors->on_primary_container);
-
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 80.0f, &out_sys_colors->secondary);
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 20.0f, &out_sys_colors->on_secondary);
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 30.0f,
-                       &out_sys_colors->secondary_container);
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 90.0f,
-                       &out_sys_colors->on_secondary_container);
-
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 80.0f, &out_sys_colors->tertiary);
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 20.0f,
-                       &out_sys_colors->on_tertiary);
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 30.0f,
-                       &out_sys_colors->tertiary_container);
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 90.0f,
-                       &out_sys_colors->on_tertiary_container);
-
-    cmp_m3_hct_to_srgb(25.0f, 84.0f, 80.0f, &out_sys_colors->error);
-    cmp_m3_hct_to_srgb(25.0f, 84.0f, 20.0f, &out_sys_colors->on_error);
-    cmp_m3_hct_to_srgb(25.0f, 84.0f, 30.0f, &out_sys_colors->error_container);
-    cmp_m3_hct_to_srgb(25.0f, 84.0f, 90.0f,
-                       &out_sys_colors->on_error_container);
-
-    cmp_m3_hct_to_srgb(h, 4.0f, 6.0f, &out_sys_colors->surface_dim);
-    cmp_m3_hct_to_srgb(h, 4.0f, 6.0f, &out_sys_colors->surface);
-    cmp_m3_hct_to_srgb(h, 4.0f, 24.0f, &out_sys_colors->surface_bright);
-
-    cmp_m3_hct_to_srgb(h, 4.0f, 4.0f,
-                       &out_sys_colors->surface_container_lowest);
-    cmp_m3_hct_to_srgb(h, 4.0f, 10.0f, &out_sys_colors->surface_container_low);
-    cmp_m3_hct_to_srgb(h, 4.0f, 12.0f, &out_sys_colors->surface_container);
-    cmp_m3_hct_to_srgb(h, 4.0f, 17.0f, &out_sys_colors->surface_container_high);
-    cmp_m3_hct_to_srgb(h, 4.0f, 22.0f,
-                       &out_sys_colors->surface_container_highest);
-
-    cmp_m3_hct_to_srgb(h, 4.0f, 90.0f, &out_sys_colors->on_surface);
-    cmp_m3_hct_to_srgb(h, 8.0f, 80.0f, &out_sys_colors->on_surface_variant);
-    cmp_m3_hct_to_srgb(h, 8.0f, 60.0f, &out_sys_colors->outline);
-    cmp_m3_hct_to_srgb(h, 8.0f, 30.0f, &out_sys_colors->outline_variant);
-
-    cmp_m3_hct_to_srgb(h, 4.0f, 90.0f, &out_sys_colors->inverse_surface);
-    cmp_m3_hct_to_srgb(h, 4.0f, 20.0f, &out_sys_colors->inverse_on_surface);
-    cmp_m3_hct_to_srgb(h, c, 40.0f, &out_sys_colors->inverse_primary);
-
-    cmp_m3_hct_to_srgb(h, 4.0f, 0.0f, &out_sys_colors->scrim);
-    cmp_m3_hct_to_srgb(h, 4.0f, 0.0f, &out_sys_colors->shadow);
-    cmp_m3_hct_to_srgb(h, c, 80.0f, &out_sys_colors->surface_tint);
-
-    cmp_m3_hct_to_srgb(h, c, 90.0f, &out_sys_colors->primary_fixed);
-    cmp_m3_hct_to_srgb(h, c, 80.0f, &out_sys_colors->primary_fixed_dim);
-    cmp_m3_hct_to_srgb(h, c, 10.0f, &out_sys_colors->on_primary_fixed);
-    cmp_m3_hct_to_srgb(h, c, 30.0f, &out_sys_colors->on_primary_fixed_variant);
-
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 90.0f, &out_sys_colors->secondary_fixed);
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 80.0f,
-                       &out_sys_colors->secondary_fixed_dim);
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 10.0f, &out_sys_colors->on_secondary_fixed);
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 30.0f,
-                       &out_sys_colors->on_secondary_fixed_variant);
-
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 90.0f,
-                       &out_sys_colors->tertiary_fixed);
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 80.0f,
-                       &out_sys_colors->tertiary_fixed_dim);
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 10.0f,
-                       &out_sys_colors->on_tertiary_fixed);
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 30.0f,
-                       &out_sys_colors->on_tertiary_fixed_variant);
-
-  } else {
-    if (contrast == CMP_M3_CONTRAST_HIGH) {
-      cmp_m3_hct_to_srgb(h, c, 20.0f, &out_sys_colors->primary);
-    } else if (contrast == CMP_M3_CONTRAST_MEDIUM) {
-      cmp_m3_hct_to_srgb(h, c, 30.0f, &out_sys_colors->primary);
-    } else {
-      cmp_m3_hct_to_srgb(h, c, 40.0f, &out_sys_colors->primary);
+    res = cmp_m3_palette_cache_tones(cache, pal_hue[pal], pal_chroma[pal],
+                                     tones + start, end - start,
+                                     colors + start);
+    if (res != CMP_SUCCESS) {
+      return res;
     }
-    cmp_m3_hct_to_srgb(h, c, 100.0f, &out_sys_colors->on_primary);
-    cmp_m3_hct_to_srgb(h, c, 90.0f, &out_sys_colors->primary_container);
-    cmp_m3_hct_to_srgb(h, c, 10.0f, &out_sys_colors->on_primary_container);
-
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 40.0f, &out_sys_colors->secondary);
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 100.0f, &out_sys_colors->on_secondary);
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 90.0f,
-                       &out_sys_colors->secondary_container);
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 10.0f,
-                       &out_sys_colors->on_secondary_container);
-
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 40.0f, &out_sys_colors->tertiary);
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 100.0f,
-                       &out_sys_colors->on_tertiary);
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 90.0f,
-                       &out_sys_colors->tertiary_container);
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 10.0f,
-                       &out_sys_colors->on_tertiary_container);
-
-    cmp_m3_hct_to_srgb(25.0f, 84.0f, 40.0f, &out_sys_colors->error);
-    cmp_m3_hct_to_srgb(25.0f, 84.0f, 100.0f, &out_sys_colors->on_error);
-    cmp_m3_hct_to_srgb(25.0f, 84.0f, 90.0f, &out_sys_colors->error_container);
-    cmp_m3_hct_to_srgb(25.0f, 84.0f, 10.0f,
-                       &out_sys_colors->on_error_container);
-
-    cmp_m3_hct_to_srgb(h, 4.0f, 87.0f, &out_sys_colors->surface_dim);
-    cmp_m3_hct_to_srgb(h, 4.0f, 98.0f, &out_sys_colors->surface);
-    cmp_m3_hct_to_srgb(h, 4.0f, 98.0f, &out_sys_colors->surface_bright);
-
-    cmp_m3_hct_to_srgb(h, 4.0f, 100.0f,
-                       &out_sys_colors->surface_container_lowest);
-    cmp_m3_hct_to_srgb(h, 4.0f, 96.0f, &out_sys_colors->surface_container_low);
-    cmp_m3_hct_to_srgb(h, 4.0f, 94.0f, &out_sys_colors->surface_container);
-    cmp_m3_hct_to_srgb(h, 4.0f, 92.0f, &out_sys_colors->surface_container_high);
-    cmp_m3_hct_to_srgb(h, 4.0f, 90.0f,
-                       &out_sys_colors->surface_container_highest);
-
-    cmp_m3_hct_to_srgb(h, 4.0f, 10.0f, &out_sys_colors->on_surface);
-    cmp_m3_hct_to_srgb(h, 8.0f, 30.0f, &out_sys_colors->on_surface_variant);
-    cmp_m3_hct_to_srgb(h, 8.0f, 50.0f, &out_sys_colors->outline);
-    cmp_m3_hct_to_srgb(h, 8.0f, 80.0f, &out_sys_colors->outline_variant);
-
-    cmp_m3_hct_to_srgb(h, 4.0f, 20.0f, &out_sys_colors->inverse_surface);
-    cmp_m3_hct_to_srgb(h, 4.0f, 95.0f, &out_sys_colors->inverse_on_surface);
-    cmp_m3_hct_to_srgb(h, c, 80.0f, &out_sys_colors->inverse_primary);
-
-    cmp_m3_hct_to_srgb(h, 4.0f, 0.0f, &out_sys_colors->scrim);
-    cmp_m3_hct_to_srgb(h, 4.0f, 0.0f, &out_sys_colors->shadow);
-    cmp_m3_hct_to_srgb(h, c, 40.0f, &out_sys_colors->surface_tint);
-
-    cmp_m3_hct_to_srgb(h, c, 90.0f, &out_sys_colors->primary_fixed);
-    cmp_m3_hct_to_srgb(h, c, 80.0f, &out_sys_colors->primary_fixed_dim);
-    cmp_m3_hct_to_srgb(h, c, 10.0f, &out_sys_colors->on_primary_fixed);
-    cmp_m3_hct_to_srgb(h, c, 30.0f, &out_sys_colors->on_primary_fixed_variant);
-
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 90.0f, &out_sys_colors->secondary_fixed);
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 80.0f,
-                       &out_sys_colors->secondary_fixed_dim);
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 10.0f, &out_sys_colors->on_secondary_fixed);
-    cmp_m3_hct_to_srgb(h, c / 3.0f, 30.0f,
-                       &out_sys_colors->on_secondary_fixed_variant);
-
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 90.0f,
-                       &out_sys_colors->tertiary_fixed);
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 80.0f,
-                       &out_sys_colors->tertiary_fixed_dim);
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 10.0f,
-                       &out_sys_colors->on_tertiary_fixed);
-    cmp_m3_hct_to_srgb(h + 60.0f, c / 2.0f, 30.0f,
-                       &out_sys_colors->on_tertiary_fixed_variant);
+  }
+
+  for (i = 0; i < M3_SYS_ROLE_COUNT; i++) {
+    *(cmp_color_t *)((char *)out_sys_colors + k_m3_sys_roles[i].offset) =
+        colors[i];
   }
 
   return CMP_SUCCESS;
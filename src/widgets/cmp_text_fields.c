@@ -4,6 +4,26 @@
 #include <string.h>
 /* clang-format on */
 
+/* Bytes of text on each side of the caret that caret movement looks at */
+#define TEXT_FIELD_CONTEXT 256
+
+/* One paragraph checked off the ui thread. The worker only reads the copy
+ * of the text and the checker; everything else is touched on the ui
+ * thread. */
+typedef struct text_field_spell_job {
+  struct text_field_spell_job *next;
+  struct cmp_text_field *field;
+  cmp_spellcheck_t *checker;
+  cmp_modality_t *ui;
+  size_t start; /* Paragraph offset, kept current by later edits */
+  size_t len;
+  int stale;    /* The paragraph was edited again while in flight */
+  int res;
+  cmp_spell_range_t *found;
+  size_t found_count;
+  char *text;
+} text_field_spell_job_t;
+
 struct cmp_text_field {
   cmp_keyboard_type_t keyboard_type;
   cmp_return_key_type_t return_key_type;
@@ -13,10 +33,20 @@ struct cmp_text_field {
   cmp_ui_node_t *accessory_node; /* ref to custom toolbar node */
 
   /* Text Editing State */
-  char *text_buffer;
-  size_t text_capacity;
-  size_t text_length;
+  cmp_text_buffer_t *text;
+  char *flat;       /* NUL-terminated copy handed out by get_text */
+  size_t flat_cap;
   size_t caret_position;
+
+  /* Spellchecking */
+  cmp_spellcheck_t *checker;
+  cmp_modality_t *spell_workers;
+  cmp_modality_t *spell_ui;
+  cmp_spell_range_t *misspellings; /* Sorted by offset */
+  size_t misspelling_count;
+  size_t misspelling_cap;
+  text_field_spell_job_t *jobs;
+  int destroyed; /* Freed by the last job delivered */
 };
 
 struct cmp_rich_text_view {
@@ -38,15 +68,21 @@ int cmp_text_field_create(cmp_text_field_t **out_field) {
   ctx->accessory_node = NULL;
 
   /* Initialize empty text buffer */
-  ctx->text_capacity = 32;
-  if (CMP_MALLOC(ctx->text_capacity, (void **)&ctx->text_buffer) !=
-      CMP_SUCCESS) {
+  if (cmp_text_buffer_create(&ctx->text) != CMP_SUCCESS) {
     CMP_FREE(ctx);
     return CMP_ERROR_OOM;
   }
-  ctx->text_buffer[0] = '\0';
-  ctx->text_length = 0;
+  ctx->flat = NULL;
+  ctx->flat_cap = 0;
   ctx->caret_position = 0;
+  ctx->checker = NULL;
+  ctx->spell_workers = NULL;
+  ctx->spell_ui = NULL;
+  ctx->misspellings = NULL;
+  ctx->misspelling_count = 0;
+  ctx->misspelling_cap = 0;
+  ctx->jobs = NULL;
+  ctx->destroyed = 0;
 
   *out_field = (cmp_text_field_t *)ctx;
   return CMP_SUCCESS;
@@ -57,20 +93,229 @@ int cmp_text_field_destroy(cmp_text_field_t *field_opaque) {
   if (!ctx)
     return CMP_SUCCESS;
 
-  if (ctx->text_buffer) {
-    CMP_FREE(ctx->text_buffer);
+  cmp_text_buffer_destroy(ctx->text);
+  if (ctx->flat) {
+    CMP_FREE(ctx->flat);
+  }
+  if (ctx->misspellings) {
+    CMP_FREE(ctx->misspellings);
   }
 
   /* Accessory node lifecycle is managed by layout engine */
+  if (ctx->jobs) {
+    ctx->destroyed = 1;
+    return CMP_SUCCESS;
+  }
   CMP_FREE(ctx);
   return CMP_SUCCESS;
 }
 
+static int spell_active(const struct cmp_text_field *ctx) {
+  return ctx->checker && ctx->spellcheck_enabled && !ctx->is_secure;
+}
+
+static void spell_job_free(text_field_spell_job_t *job) {
+  if (job->found)
+    CMP_FREE(job->found);
+  CMP_FREE(job);
+}
+
+static void spell_forget_jobs(struct cmp_text_field *ctx) {
+  text_field_spell_job_t *job;
+  for (job = ctx->jobs; job; job = job->next)
+    job->stale = 1;
+}
+
+static void spell_clear(struct cmp_text_field *ctx) {
+  spell_forget_jobs(ctx);
+  ctx->misspelling_count = 0;
+}
+
+/* Replaces the ranges inside [start, end] with found, which is relative to
+ * start. */
+static int spell_replace(struct cmp_text_field *ctx, size_t start, size_t end,
+                         const cmp_spell_range_t *found, size_t count) {
+  size_t lo = 0, hi, total, i;
+  while (lo < ctx->misspelling_count &&
+         ctx->misspellings[lo].offset < start)
+    lo++;
+  hi = lo;
+  while (hi < ctx->misspelling_count && ctx->misspellings[hi].offset <= end)
+    hi++;
+
+  total = ctx->misspelling_count - (hi - lo) + count;
+  if (total > ctx->misspelling_cap) {
+    cmp_spell_range_t *grown;
+    size_t cap = ctx->misspelling_cap * 2;
+    if (cap < total)
+      cap = total;
+    if (CMP_MALLOC(cap * sizeof(cmp_spell_range_t), (void **)&grown) !=
+        CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    if (ctx->misspellings) {
+      memcpy(grown, ctx->misspellings,
+             ctx->misspelling_count * sizeof(cmp_spell_range_t));
+      CMP_FREE(ctx->misspellings);
+    }
+    ctx->misspellings = grown;
+    ctx->misspelling_cap = cap;
+  }
+  memmove(ctx->misspellings + lo + count, ctx->misspellings + hi,
+          (ctx->misspelling_count - hi) * sizeof(cmp_spell_range_t));
+  for (i = 0; i < count; ++i) {
+    ctx->misspellings[lo + i].offset = start + found[i].offset;
+    ctx->misspellings[lo + i].length = found[i].length;
+  }
+  ctx->misspelling_count = total;
+  return CMP_SUCCESS;
+}
+
+static void spell_job_check(text_field_spell_job_t *job) {
+  cmp_spell_range_t batch[64];
+  size_t pos = 0, n, cap = 0, i;
+
+  job->res = CMP_SUCCESS;
+  do {
+    cmp_spellcheck_check_text(job->checker, job->text + pos, job->len - pos,
+                              batch, 64, &n);
+    if (job->found_count + n > cap) {
+      cmp_spell_range_t *grown;
+      size_t new_cap = cap ? cap * 2 : 64;
+      if (CMP_MALLOC(new_cap * sizeof(cmp_spell_range_t), (void **)&grown) !=
+          CMP_SUCCESS) {
+        job->res = CMP_ERROR_OOM;
+        return;
+      }
+      if (job->found) {
+        memcpy(grown, job->found, job->found_count * sizeof(*grown));
+        CMP_FREE(job->found);
+      }
+      job->found = grown;
+      cap = new_cap;
+    }
+    for (i = 0; i < n; ++i) {
+      job->found[job->found_count].offset = pos + batch[i].offset;
+      job->found[job->found_count].length = batch[i].length;
+      job->found_count++;
+    }
+    if (n > 0)
+      pos += batch[n - 1].offset + batch[n - 1].length;
+  } while (n == 64);
+}
+
+static void spell_job_deliver(void *arg) {
+  text_field_spell_job_t *job = (text_field_spell_job_t *)arg;
+  struct cmp_text_field *ctx = job->field;
+  text_field_spell_job_t **link = &ctx->jobs;
+
+  while (*link && *link != job)
+    link = &(*link)->next;
+  if (*link)
+    *link = job->next;
+
+  if (!ctx->destroyed && !job->stale && job->res == CMP_SUCCESS)
+    spell_replace(ctx, job->start, job->start + job->len, job->found,
+                  job->found_count);
+  spell_job_free(job);
+
+  if (ctx->destroyed && !ctx->jobs)
+    CMP_FREE(ctx);
+}
+
+static void spell_job_task(void *arg) {
+  text_field_spell_job_t *job = (text_field_spell_job_t *)arg;
+  spell_job_check(job);
+  /* Fails only when out of memory; the job then stays listed in flight and
+   * its paragraph keeps its previous ranges. */
+  cmp_modality_queue_task(job->ui, spell_job_deliver, job);
+}
+
+/* Checks the paragraphs overlapping [from, to]. */
+static int spell_schedule(struct cmp_text_field *ctx, size_t from, size_t to) {
+  text_field_spell_job_t *job;
+  size_t line, last_line, lines, start, end;
+  int res;
+
+  cmp_text_buffer_offset_to_line(ctx->text, from, &line, NULL);
+  cmp_text_buffer_offset_to_line(ctx->text, to, &last_line, NULL);
+  cmp_text_buffer_get_line_count(ctx->text, &lines);
+  cmp_text_buffer_line_to_offset(ctx->text, line, &start);
+  if (last_line + 1 < lines) {
+    cmp_text_buffer_line_to_offset(ctx->text, last_line + 1, &end);
+    end--; /* The paragraph stops before its newline */
+  } else {
+    cmp_text_buffer_get_length(ctx->text, &end);
+  }
+
+  if (CMP_MALLOC(sizeof(text_field_spell_job_t) + (end - start) + 1,
+                 (void **)&job) != CMP_SUCCESS)
+    return CMP_ERROR_OOM;
+  memset(job, 0, sizeof(text_field_spell_job_t));
+  job->field = ctx;
+  job->checker = ctx->checker;
+  job->ui = ctx->spell_ui;
+  job->start = start;
+  job->len = end - start;
+  job->text = (char *)(job + 1);
+  cmp_text_buffer_read(ctx->text, start, job->len, job->text);
+
+  job->next = ctx->jobs;
+  ctx->jobs = job;
+  if (ctx->spell_workers) {
+    res = cmp_modality_queue_task(ctx->spell_workers, spell_job_task, job);
+    if (res == CMP_SUCCESS)
+      return CMP_SUCCESS;
+  }
+  spell_job_check(job);
+  spell_job_deliver(job);
+  return CMP_SUCCESS;
+}
+
+/* Keeps ranges and in-flight checks in step with an edit of the buffer at
+ * offset, then rechecks the touched paragraph. */
+static int spell_edit(struct cmp_text_field *ctx, size_t offset,
+                      size_t removed, size_t inserted) {
+  text_field_spell_job_t *job;
+  size_t i, kept = 0;
+
+  if (!spell_active(ctx))
+    return CMP_SUCCESS;
+
+  for (i = 0; i < ctx->misspelling_count; ++i) {
+    cmp_spell_range_t r = ctx->misspellings[i];
+    if (r.offset >= offset + removed) {
+      r.offset = r.offset - removed + inserted;
+    } else if (r.offset + r.length > offset) {
+      continue; /* The edit landed inside the word */
+    }
+    ctx->misspellings[kept++] = r;
+  }
+  ctx->misspelling_count = kept;
+
+  for (job = ctx->jobs; job; job = job->next) {
+    if (offset <= job->start + job->len && offset + removed >= job->start)
+      job->stale = 1;
+    else if (job->start >= offset + removed)
+      job->start = job->start - removed + inserted;
+  }
+
+  return spell_schedule(ctx, offset, offset + inserted);
+}
+
+/* Clamps the caret after edits made directly on the backing buffer. */
+static size_t text_field_caret(struct cmp_text_field *ctx) {
+  size_t len;
+  cmp_text_buffer_get_length(ctx->text, &len);
+  if (ctx->caret_position > len)
+    ctx->caret_position = len;
+  return ctx->caret_position;
+}
+
 int cmp_text_field_insert_text(cmp_text_field_t *field_opaque,
                                const char *text) {
   struct cmp_text_field *ctx = (struct cmp_text_field *)field_opaque;
   size_t insert_len;
-  size_t new_len;
+  int res;
   if (!ctx || !text)
     return CMP_ERROR_INVALID_ARG;
 
@@ -78,48 +323,84 @@ int cmp_text_field_insert_text(cmp_text_field_t *field_opaque,
   if (insert_len == 0)
     return CMP_SUCCESS;
 
-  new_len = ctx->text_length + insert_len;
-  if (new_len + 1 > ctx->text_capacity) {
-    size_t new_cap = ctx->text_capacity * 2;
-    char *new_buf;
-    if (new_cap < new_len + 1)
-      new_cap = new_len + 1;
-    if (CMP_MALLOC(new_cap, (void **)&new_buf) != CMP_SUCCESS)
-      return CMP_ERROR_OOM;
-    memcpy(new_buf, ctx->text_buffer, ctx->text_length + 1);
-    CMP_FREE(ctx->text_buffer);
-    ctx->text_buffer = new_buf;
-    ctx->text_capacity = new_cap;
-  }
-
-  /* Shift text forward to make room for insertion */
-  memmove(ctx->text_buffer + ctx->caret_position + insert_len,
-          ctx->text_buffer + ctx->caret_position,
-          ctx->text_length - ctx->caret_position + 1);
+  res = cmp_text_buffer_insert(ctx->text, text_field_caret(ctx), text,
+                               insert_len);
+  if (res != CMP_SUCCESS)
+    return res;
+  ctx->caret_position += insert_len;
 
-  /* Copy new text */
-  memcpy(ctx->text_buffer + ctx->caret_position, text, insert_len);
+  return spell_edit(ctx, ctx->caret_position - insert_len, 0, insert_len);
+}
 
-  ctx->text_length = new_len;
-  ctx->caret_position += insert_len;
+/* Resolves a caret movement against the text around the caret. Clusters
+ * and words longer than TEXT_FIELD_CONTEXT are crossed in steps. */
+static size_t text_field_move(struct cmp_text_field *ctx,
+                              cmp_text_field_move_t move) {
+  char window[2 * TEXT_FIELD_CONTEXT];
+  const char *text;
+  size_t caret = text_field_caret(ctx), len, base, end, pos, word_end;
+  int word = 0;
+
+  cmp_text_buffer_get_length(ctx->text, &len);
+  base = caret > TEXT_FIELD_CONTEXT ? caret - TEXT_FIELD_CONTEXT : 0;
+  end = len - caret > TEXT_FIELD_CONTEXT ? caret + TEXT_FIELD_CONTEXT : len;
+  cmp_text_buffer_read(ctx->text, base, end - base, window);
+  /* Start the window on a code point */
+  text = window;
+  while (base < caret && ((unsigned char)*text & 0xC0) == 0x80) {
+    ++text;
+    ++base;
+  }
+  len = end - base;
+  pos = caret - base;
+
+  switch (move) {
+  case CMP_TEXT_FIELD_MOVE_BACKWARD:
+    cmp_utf8_prev_grapheme(text, len, pos, &pos);
+    break;
+  case CMP_TEXT_FIELD_MOVE_FORWARD:
+    cmp_utf8_next_grapheme(text, len, pos, &pos);
+    break;
+  case CMP_TEXT_FIELD_MOVE_WORD_BACKWARD:
+    /* Back over spaces and punctuation to the start of a word */
+    while (pos > 0 && !word) {
+      cmp_utf8_prev_word_boundary(text, len, pos, &pos);
+      cmp_utf8_next_word_boundary(text, len, pos, &word_end, &word);
+    }
+    break;
+  case CMP_TEXT_FIELD_MOVE_WORD_FORWARD:
+    while (pos < len && !word)
+      cmp_utf8_next_word_boundary(text, len, pos, &pos, &word);
+    break;
+  }
+  return base + pos;
+}
 
+int cmp_text_field_move_caret(cmp_text_field_t *field_opaque,
+                              cmp_text_field_move_t move) {
+  struct cmp_text_field *ctx = (struct cmp_text_field *)field_opaque;
+  if (!ctx || move < CMP_TEXT_FIELD_MOVE_BACKWARD ||
+      move > CMP_TEXT_FIELD_MOVE_WORD_FORWARD)
+    return CMP_ERROR_INVALID_ARG;
+  ctx->caret_position = text_field_move(ctx, move);
   return CMP_SUCCESS;
 }
 
 int cmp_text_field_delete_backward(cmp_text_field_t *field_opaque) {
   struct cmp_text_field *ctx = (struct cmp_text_field *)field_opaque;
+  size_t caret, start;
+  int res;
   if (!ctx)
     return CMP_ERROR_INVALID_ARG;
 
-  if (ctx->caret_position > 0) {
-    /* Basic 1-byte deletion. Real implementation needs UTF-8 cluster analysis
-     */
-    size_t del_len = 1;
-    ctx->caret_position -= del_len;
-    memmove(ctx->text_buffer + ctx->caret_position,
-            ctx->text_buffer + ctx->caret_position + del_len,
-            ctx->text_length - ctx->caret_position - del_len + 1);
-    ctx->text_length -= del_len;
+  caret = text_field_caret(ctx);
+  if (caret > 0) {
+    start = text_field_move(ctx, CMP_TEXT_FIELD_MOVE_BACKWARD);
+    res = cmp_text_buffer_delete(ctx->text, start, caret - start);
+    if (res != CMP_SUCCESS)
+      return res;
+    ctx->caret_position = start;
+    return spell_edit(ctx, start, caret - start, 0);
   }
   return CMP_SUCCESS;
 }
@@ -127,10 +408,12 @@ int cmp_text_field_delete_backward(cmp_text_field_t *field_opaque) {
 int cmp_text_field_set_caret_position(cmp_text_field_t *field_opaque,
                                       size_t pos) {
   struct cmp_text_field *ctx = (struct cmp_text_field *)field_opaque;
+  size_t len;
   if (!ctx)
     return CMP_ERROR_INVALID_ARG;
-  if (pos > ctx->text_length)
-    pos = ctx->text_length;
+  cmp_text_buffer_get_length(ctx->text, &len);
+  if (pos > len)
+    pos = len;
   ctx->caret_position = pos;
   return CMP_SUCCESS;
 }
@@ -140,16 +423,43 @@ int cmp_text_field_get_caret_position(const cmp_text_field_t *field_opaque,
   struct cmp_text_field *ctx = (struct cmp_text_field *)field_opaque;
   if (!ctx || !out_pos)
     return CMP_ERROR_INVALID_ARG;
-  *out_pos = ctx->caret_position;
+  *out_pos = text_field_caret(ctx);
   return CMP_SUCCESS;
 }
 
 int cmp_text_field_get_text(const cmp_text_field_t *field_opaque,
                             const char **out_text) {
   struct cmp_text_field *ctx = (struct cmp_text_field *)field_opaque;
+  size_t len;
   if (!ctx || !out_text)
     return CMP_ERROR_INVALID_ARG;
-  *out_text = ctx->text_buffer;
+
+  /* Editing never touches a flat copy; build one only when asked. */
+  cmp_text_buffer_get_length(ctx->text, &len);
+  if (!ctx->flat || ctx->flat_cap < len + 1) {
+    char *flat;
+    size_t cap = ctx->flat_cap * 2;
+    if (cap < len + 1)
+      cap = len + 1;
+    if (CMP_MALLOC(cap, (void **)&flat) != CMP_SUCCESS)
+      return CMP_ERROR_OOM;
+    if (ctx->flat)
+      CMP_FREE(ctx->flat);
+    ctx->flat = flat;
+    ctx->flat_cap = cap;
+  }
+  cmp_text_buffer_read(ctx->text, 0, len, ctx->flat);
+  ctx->flat[len] = '\0';
+  *out_text = ctx->flat;
+  return CMP_SUCCESS;
+}
+
+int cmp_text_field_get_buffer(cmp_text_field_t *field_opaque,
+                              cmp_text_buffer_t **out_buffer) {
+  struct cmp_text_field *ctx = (struct cmp_text_field *)field_opaque;
+  if (!ctx || !out_buffer)
+    return CMP_ERROR_INVALID_ARG;
+  *out_buffer = ctx->text;
   return CMP_SUCCESS;
 }
 
@@ -202,6 +512,7 @@ int cmp_text_field_set_secure_text_entry(cmp_text_field_t *field_opaque,
     /* HIG overrides when secure is active */
     ctx->auto_cap = CMP_AUTO_CAPITALIZATION_NONE;
     ctx->spellcheck_enabled = 0;
+    spell_clear(ctx);
   }
 
   return CMP_SUCCESS;
@@ -221,7 +532,46 @@ int cmp_text_field_set_spellcheck_enabled(cmp_text_field_t *field_opaque,
   struct cmp_text_field *ctx = (struct cmp_text_field *)field_opaque;
   if (!ctx)
     return CMP_ERROR_INVALID_ARG;
+  if (ctx->spellcheck_enabled == enabled)
+    return CMP_SUCCESS;
   ctx->spellcheck_enabled = enabled;
+  return cmp_text_field_recheck_spelling(field_opaque);
+}
+
+int cmp_text_field_set_spellchecker(cmp_text_field_t *field_opaque,
+                                    cmp_spellcheck_t *checker,
+                                    cmp_modality_t *workers,
+                                    cmp_modality_t *ui) {
+  struct cmp_text_field *ctx = (struct cmp_text_field *)field_opaque;
+  if (!ctx || (workers && (workers->type != CMP_MODALITY_THREADED || !ui)))
+    return CMP_ERROR_INVALID_ARG;
+  ctx->checker = checker;
+  ctx->spell_workers = workers;
+  ctx->spell_ui = ui;
+  return cmp_text_field_recheck_spelling(field_opaque);
+}
+
+int cmp_text_field_recheck_spelling(cmp_text_field_t *field_opaque) {
+  struct cmp_text_field *ctx = (struct cmp_text_field *)field_opaque;
+  size_t len;
+  if (!ctx)
+    return CMP_ERROR_INVALID_ARG;
+  spell_clear(ctx);
+  if (!spell_active(ctx))
+    return CMP_SUCCESS;
+  cmp_text_buffer_get_length(ctx->text, &len);
+  return spell_schedule(ctx, 0, len);
+}
+
+int cmp_text_field_get_misspellings(const cmp_text_field_t *field_opaque,
+                                    const cmp_spell_range_t **out_ranges,
+                                    size_t *out_count) {
+  const struct cmp_text_field *ctx =
+      (const struct cmp_text_field *)field_opaque;
+  if (!ctx || !out_ranges || !out_count)
+    return CMP_ERROR_INVALID_ARG;
+  *out_ranges = ctx->misspellings;
+  *out_count = ctx->misspelling_count;
   return CMP_SUCCESS;
 }
 
@@ -1,8 +1,31 @@
 /* clang-format off */
 #include "cmp.h"
 #include "greatest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 /* clang-format on */
 
+static int g_released;
+static size_t g_released_bytes;
+
+static void count_release(void *user_data, void *payload, size_t bytes) {
+  (void)user_data;
+  (void)payload;
+  g_released++;
+  g_released_bytes += bytes;
+}
+
+static cmp_resource_key_t make_key(const char *source, int w, int h) {
+  cmp_resource_key_t key;
+  key.source = source;
+  key.width = w;
+  key.height = h;
+  key.color_space = CMP_COLOR_SPACE_SRGB;
+  return key;
+}
+
 TEST test_resource_manager_features(void) {
   cmp_resource_manager_t *ctx = NULL;
   void *node = (void *)1;
@@ -19,6 +42,11 @@ TEST test_resource_manager_features(void) {
                              ctx, "https://a.com/img.png", 100.0f, 100.0f));
   ASSERT_EQ(CMP_SUCCESS, cmp_resources_allocate_offscreen_bitmap(
                              ctx, 200.0f, 200.0f, &bitmap));
+  ASSERT(bitmap != NULL);
+  ((unsigned char *)bitmap)[200 * 200 * 4 - 1] = 0xFF;
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_release_offscreen_bitmap(ctx, bitmap));
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND,
+            cmp_resources_release_offscreen_bitmap(ctx, bitmap));
 
   ASSERT_EQ(CMP_SUCCESS, cmp_resource_manager_destroy(ctx));
   PASS();
@@ -67,9 +95,353 @@ TEST test_resource_manager_null_args(void) {
   PASS();
 }
 
+TEST test_resource_cache_keys_and_counters(void) {
+  cmp_resource_manager_t *rm = NULL;
+  cmp_resource_cache_stats_t stats;
+  cmp_resource_key_t small = make_key("img://a", 64, 64);
+  cmp_resource_key_t large = make_key("img://a", 128, 128);
+  cmp_resource_key_t p3 = make_key("img://a", 64, 64);
+  void *payload = NULL;
+  int a = 1, b = 2;
+
+  g_released = 0;
+  p3.color_space = CMP_COLOR_SPACE_DISPLAY_P3;
+  ASSERT_EQ(CMP_SUCCESS, cmp_resource_manager_create(&rm));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_cache_insert(rm, CMP_RESOURCE_POOL_CPU, &small, &a,
+                                       100, count_release, NULL));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_cache_insert(rm, CMP_RESOURCE_POOL_GPU, &large, &b,
+                                       400, count_release, NULL));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_cache_lookup(rm, &small, &payload));
+  ASSERT_EQ(&a, payload);
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_cache_lookup(rm, &large, &payload));
+  ASSERT_EQ(&b, payload);
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND, cmp_resources_cache_lookup(rm, &p3, &payload));
+
+  /* Re-inserting a key replaces and releases the old payload. */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_cache_insert(rm, CMP_RESOURCE_POOL_CPU, &small, &b,
+                                       150, count_release, NULL));
+  ASSERT_EQ(1, g_released);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_get_cache_stats(rm, &stats));
+  ASSERT_EQ(150, (int)stats.cpu_bytes);
+  ASSERT_EQ(400, (int)stats.gpu_bytes);
+  ASSERT_EQ(2, (int)stats.entry_count);
+  ASSERT_EQ(2, (int)stats.hits);
+  ASSERT_EQ(1, (int)stats.misses);
+  ASSERT_EQ(3, (int)stats.insertions);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_cache_remove(rm, &large));
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND, cmp_resources_cache_remove(rm, &large));
+  ASSERT_EQ(CMP_SUCCESS, cmp_resource_manager_destroy(rm));
+  ASSERT_EQ(3, g_released);
+  PASS();
+}
+
+TEST test_resource_cache_clock_eviction(void) {
+  cmp_resource_manager_t *rm = NULL;
+  cmp_resource_cache_stats_t stats;
+  cmp_resource_key_t keys[4];
+  void *payload = NULL;
+  int tokens[4];
+  int i;
+
+  keys[0] = make_key("k0", 1, 1);
+  keys[1] = make_key("k1", 1, 1);
+  keys[2] = make_key("k2", 1, 1);
+  keys[3] = make_key("k3", 1, 1);
+  ASSERT_EQ(CMP_SUCCESS, cmp_resource_manager_create(&rm));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_set_cache_budget(rm, CMP_RESOURCE_POOL_CPU, 300));
+  for (i = 0; i < 3; ++i) {
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_resources_cache_insert(rm, CMP_RESOURCE_POOL_CPU, &keys[i],
+                                         &tokens[i], 100, NULL, NULL));
+  }
+  /* k0 is referenced, so the hand skips it and evicts k1. */
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_cache_lookup(rm, &keys[0], &payload));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_cache_insert(rm, CMP_RESOURCE_POOL_CPU, &keys[3],
+                                       &tokens[3], 100, NULL, NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_cache_lookup(rm, &keys[0], &payload));
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND,
+            cmp_resources_cache_lookup(rm, &keys[1], &payload));
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_cache_lookup(rm, &keys[2], &payload));
+
+  /* Larger than the whole budget: refused, caller keeps ownership. */
+  ASSERT_EQ(CMP_ERROR_OOM,
+            cmp_resources_cache_insert(rm, CMP_RESOURCE_POOL_CPU, &keys[1],
+                                       &tokens[1], 301, NULL, NULL));
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_cache_trim(rm, CMP_RESOURCE_POOL_CPU, 100));
+  cmp_resources_get_cache_stats(rm, &stats);
+  ASSERT_EQ(100, (int)stats.cpu_bytes);
+  ASSERT_EQ(3, (int)stats.evictions);
+  ASSERT_EQ(1, (int)stats.rejections);
+  cmp_resource_manager_destroy(rm);
+  PASS();
+}
+
+TEST test_resource_cache_budget_scaling(void) {
+  cmp_resource_manager_t *rm = NULL;
+  cmp_resource_cache_stats_t stats;
+  cmp_resource_key_t tex = make_key("tex", 8, 8);
+  cmp_resource_key_t bmp = make_key("bmp", 8, 8);
+  void *bitmap = NULL;
+  int token = 0;
+
+  g_released = 0;
+  ASSERT_EQ(CMP_SUCCESS, cmp_resource_manager_create(&rm));
+  cmp_resources_set_cache_budget(rm, CMP_RESOURCE_POOL_CPU, 4000);
+  cmp_resources_set_cache_budget(rm, CMP_RESOURCE_POOL_GPU, 4000);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_cache_insert(rm, CMP_RESOURCE_POOL_GPU, &tex, &token,
+                                       3000, count_release, NULL));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_cache_insert(rm, CMP_RESOURCE_POOL_CPU, &bmp, &token,
+                                       1500, count_release, NULL));
+
+  /* Serious thermal state halves the budgets. */
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_set_thermal_state(rm, 2));
+  cmp_resources_get_cache_stats(rm, &stats);
+  ASSERT_EQ(2000, (int)stats.gpu_budget);
+  ASSERT_EQ(0, (int)stats.gpu_bytes);
+  ASSERT_EQ(1500, (int)stats.cpu_bytes);
+  cmp_resources_set_thermal_state(rm, 0);
+
+  /* Backgrounding drops textures and keeps a quarter of the bitmaps. */
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_set_background_state(rm, 1));
+  cmp_resources_get_cache_stats(rm, &stats);
+  ASSERT_EQ(0, (int)stats.gpu_budget);
+  ASSERT_EQ(1000, (int)stats.cpu_budget);
+  ASSERT_EQ(0, (int)stats.cpu_bytes);
+  ASSERT_EQ(2, g_released);
+  cmp_resources_set_background_state(rm, 0);
+
+  /* Offscreen bitmaps are charged against the CPU budget. */
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_allocate_offscreen_bitmap(
+                             rm, 10.0f, 10.0f, &bitmap));
+  cmp_resources_get_cache_stats(rm, &stats);
+  ASSERT_EQ(400, (int)stats.offscreen_bytes);
+  ASSERT_EQ(3600, (int)stats.cpu_budget);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_set_memory_pressure(rm, 2));
+  cmp_resources_get_cache_stats(rm, &stats);
+  ASSERT_EQ(0, (int)stats.cpu_budget);
+  ASSERT_EQ(CMP_ERROR_OOM,
+            cmp_resources_cache_insert(rm, CMP_RESOURCE_POOL_CPU, &bmp, &token,
+                                       1, NULL, NULL));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_resources_set_memory_pressure(rm, 3));
+  cmp_resource_manager_destroy(rm);
+  PASS();
+}
+
+/* 8x8 opaque RGB(200, 100, 50) PNG */
+static const unsigned char k_png_8x8[75] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d,
+    0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x08,
+    0x08, 0x06, 0x00, 0x00, 0x00, 0xc4, 0x0f, 0xbe, 0x8b, 0x00, 0x00, 0x00,
+    0x12, 0x49, 0x44, 0x41, 0x54, 0x78, 0xda, 0x63, 0x38, 0x91, 0x62, 0xf4,
+    0x1f, 0x1f, 0x66, 0x18, 0x19, 0x0a, 0x00, 0xf4, 0x2b, 0x97, 0x41, 0xa9,
+    0xfc, 0x51, 0x6d, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4e, 0x44, 0xae,
+    0x42, 0x60, 0x82
+};
+
+typedef struct image_origin {
+  int requests;
+  int status;
+  cmp_mutex_t lock; /* Guards the counters below */
+  int in_send;
+  int max_in_send;
+} image_origin_t;
+
+static int image_send(void *transport, const struct HttpRequest *req,
+                      struct HttpResponse **out_res) {
+  image_origin_t *origin = (image_origin_t *)transport;
+  struct HttpResponse *res;
+  volatile long spin;
+  size_t pos;
+
+  res = (struct HttpResponse *)calloc(1, sizeof(struct HttpResponse));
+  if (res == NULL)
+    return -1;
+  cmp_mutex_lock(&origin->lock);
+  if (++origin->in_send > origin->max_in_send)
+    origin->max_in_send = origin->in_send;
+  cmp_mutex_unlock(&origin->lock);
+  for (spin = 0; spin < 5000000; ++spin)
+    ;
+  cmp_mutex_lock(&origin->lock);
+  origin->in_send--;
+  cmp_mutex_unlock(&origin->lock);
+  origin->requests++;
+  res->status_code = origin->status;
+  for (pos = 0; origin->status == 200 && pos < sizeof(k_png_8x8); pos += 16) {
+    size_t n = sizeof(k_png_8x8) - pos < 16 ? sizeof(k_png_8x8) - pos : 16;
+    req->on_chunk(req->on_chunk_user_data, k_png_8x8 + pos, n);
+  }
+  *out_res = res;
+  return 0;
+}
+
+typedef struct image_wait {
+  cmp_modality_t *ui;
+  cmp_resource_manager_t *rm;
+  clock_t deadline;
+} image_wait_t;
+
+/* Polls until the worker's result has been handed back to the ui loop. */
+static void image_wait_task(void *arg) {
+  image_wait_t *wait = (image_wait_t *)arg;
+  cmp_resource_cache_stats_t stats;
+
+  cmp_resources_get_cache_stats(wait->rm, &stats);
+  if (stats.pending_loads == 0 || clock() > wait->deadline) {
+    cmp_modality_stop(wait->ui);
+    return;
+  }
+  cmp_modality_queue_task(wait->ui, image_wait_task, wait);
+}
+
+TEST test_resource_cache_remote_image(void) {
+  cmp_resource_manager_t *rm = NULL;
+  cmp_resource_cache_stats_t stats;
+  cmp_resource_key_t key = make_key("https://img.test/a.png", 4, 4);
+  cmp_modality_t ui, workers;
+  image_origin_t origin;
+  struct HttpClient client;
+  image_wait_t wait;
+  cmp_texture_t *bitmap;
+  void *payload = NULL;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_resource_manager_create(&rm));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&ui));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_threaded_init(&workers, 1));
+  memset(&origin, 0, sizeof(origin));
+  cmp_mutex_init(&origin.lock);
+  origin.status = 200;
+  memset(&client, 0, sizeof(client));
+  client.transport = &origin;
+  client.send = image_send;
+
+  /* Without a loader nothing is fetched and nothing is counted */
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE,
+            cmp_resources_cache_remote_image(rm, key.source, 4.0f, 4.0f));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_resources_set_image_loader(rm, &ui, &ui, &client));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_set_image_loader(rm, &workers, &ui, &client));
+
+  /* A second request for the same geometry joins the one in flight */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_cache_remote_image(rm, key.source, 3.2f, 4.0f));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_cache_remote_image(rm, key.source, 4.0f, 4.0f));
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_get_cache_stats(rm, &stats));
+  ASSERT_EQ(1, stats.pending_loads);
+  wait.ui = &ui;
+  wait.rm = rm;
+  wait.deadline = clock() + 10 * CLOCKS_PER_SEC;
+  cmp_modality_queue_task(&ui, image_wait_task, &wait);
+  cmp_modality_run(&ui);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_get_cache_stats(rm, &stats));
+  ASSERT_EQ(1, stats.insertions);
+  ASSERT_EQ(0, stats.hits);
+  ASSERT_EQ(0, stats.misses);
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_cache_lookup(rm, &key, &payload));
+  bitmap = (cmp_texture_t *)payload;
+  ASSERT_EQ(4, bitmap->width);
+  ASSERT_EQ(4, bitmap->height);
+  ASSERT_EQ(200, bitmap->pixels[0]);
+  ASSERT_EQ(50, bitmap->pixels[4 * 4 * 4 - 2]);
+  ASSERT_EQ(sizeof(cmp_texture_t) + 4 * 4 * 4, stats.cpu_bytes);
+
+  /* Resident images are not fetched again */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_cache_remote_image(rm, key.source, 4.0f, 4.0f));
+  ASSERT_EQ(1, origin.requests);
+
+  /* A failed fetch inserts nothing */
+  origin.status = 404;
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_cache_remote_image(
+                             rm, "https://img.test/missing.png", 4.0f, 4.0f));
+  wait.deadline = clock() + 10 * CLOCKS_PER_SEC;
+  cmp_modality_queue_task(&ui, image_wait_task, &wait);
+  cmp_modality_run(&ui);
+  ASSERT_EQ(2, origin.requests);
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_get_cache_stats(rm, &stats));
+  ASSERT_EQ(0, stats.pending_loads);
+  ASSERT_EQ(1, stats.insertions);
+
+  cmp_modality_destroy(&workers);
+  cmp_modality_destroy(&ui);
+  ASSERT_EQ(CMP_SUCCESS, cmp_resource_manager_destroy(rm));
+  cmp_mutex_destroy(&origin.lock);
+  PASS();
+}
+
+TEST test_resource_cache_remote_serialized(void) {
+  cmp_resource_manager_t *rm = NULL;
+  cmp_resource_cache_stats_t stats;
+  cmp_modality_t ui, workers;
+  image_origin_t origin;
+  struct HttpClient client;
+  image_wait_t wait;
+  char url[64];
+  int i;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_resource_manager_create(&rm));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&ui));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_threaded_init(&workers, 4));
+  memset(&origin, 0, sizeof(origin));
+  cmp_mutex_init(&origin.lock);
+  origin.status = 200;
+  memset(&client, 0, sizeof(client));
+  client.transport = &origin;
+  client.send = image_send;
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_set_image_loader(rm, &workers, &ui, &client));
+
+  /* Four workers share one client, which takes one send at a time */
+  for (i = 0; i < 8; ++i) {
+    sprintf(url, "https://img.test/%d.png", i);
+    ASSERT_EQ(CMP_SUCCESS, cmp_resources_cache_remote_image(rm, url, 4, 4));
+  }
+  wait.ui = &ui;
+  wait.rm = rm;
+  wait.deadline = clock() + 10 * CLOCKS_PER_SEC;
+  cmp_modality_queue_task(&ui, image_wait_task, &wait);
+  cmp_modality_run(&ui);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_resources_get_cache_stats(rm, &stats));
+  ASSERT_EQ(8, stats.insertions);
+  ASSERT_EQ(8, origin.requests);
+  ASSERT_EQ(1, origin.max_in_send);
+
+  /* Loads outlive the manager; the client lock goes with the last one */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_resources_cache_remote_image(rm, "https://img.test/x.png", 4,
+                                             4));
+  ASSERT_EQ(CMP_SUCCESS, cmp_resource_manager_destroy(rm));
+  cmp_modality_destroy(&workers);
+  cmp_modality_destroy(&ui);
+  cmp_mutex_destroy(&origin.lock);
+  PASS();
+}
+
 SUITE(resource_manager_suite) {
   RUN_TEST(test_resource_manager_features);
   RUN_TEST(test_resource_manager_null_args);
+  RUN_TEST(test_resource_cache_keys_and_counters);
+  RUN_TEST(test_resource_cache_clock_eviction);
+  RUN_TEST(test_resource_cache_budget_scaling);
+  RUN_TEST(test_resource_cache_remote_image);
+  RUN_TEST(test_resource_cache_remote_serialized);
 }
 
 GREATEST_MAIN_DEFS();
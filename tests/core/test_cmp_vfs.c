@@ -50,6 +50,36 @@ TEST test_vfs_read_sync(void) {
   PASS();
 }
 
+TEST test_vfs_map_file(void) {
+  cmp_vfs_mapping_t *map = NULL;
+  const void *data = NULL;
+  size_t size = 0;
+  FILE *f;
+
+  cmp_vfs_init();
+
+  f = fopen("dummy_map.txt", "wb");
+  ASSERT(f != NULL);
+  fwrite("Mapped VFS", 1, 10, f);
+  fclose(f);
+
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                cmp_vfs_map_file("dummy_map.txt", &map, &data, &size), "%d");
+  ASSERT_EQ_FMT((size_t)10, size, "%zd");
+  ASSERT_STRN_EQ("Mapped VFS", (const char *)data, 10);
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_vfs_unmap_file(map), "%d");
+
+  ASSERT(cmp_vfs_map_file("missing_map.txt", &map, &data, &size) !=
+         CMP_SUCCESS);
+  ASSERT_EQ_FMT(CMP_ERROR_INVALID_ARG,
+                cmp_vfs_map_file(NULL, &map, &data, &size), "%d");
+  ASSERT_EQ_FMT(CMP_ERROR_INVALID_ARG, cmp_vfs_unmap_file(NULL), "%d");
+
+  remove("dummy_map.txt");
+  cmp_vfs_shutdown();
+  PASS();
+}
+
 typedef struct {
   cmp_modality_t *mod;
   int error;
@@ -232,6 +262,7 @@ TEST test_vfs_watch(void) {
 SUITE(vfs_suite) {
   RUN_TEST(test_vfs_lifecycle);
   RUN_TEST(test_vfs_read_sync);
+  RUN_TEST(test_vfs_map_file);
   RUN_TEST(test_vfs_read_async);
   RUN_TEST(test_vfs_mount);
   RUN_TEST(test_vfs_standard_paths);
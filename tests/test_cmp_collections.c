@@ -1,6 +1,7 @@
 /* clang-format off */
 #include "cmp.h"
 #include "greatest.h"
+#include <string.h>
 /* clang-format on */
 
 TEST test_compositional_layout(void) {
@@ -26,17 +27,183 @@ TEST test_compositional_layout(void) {
   PASS();
 }
 
+typedef struct diff_capture {
+  size_t batches;
+  size_t deletes;
+  size_t inserts;
+  size_t moves;
+  size_t reloads;
+  cmp_diff_change_t first;
+} diff_capture_t;
+
+static int capture_update(const cmp_diff_result_t *diff, void *user_data) {
+  diff_capture_t *cap = (diff_capture_t *)user_data;
+  cap->batches++;
+  cap->deletes += diff->delete_count;
+  cap->inserts += diff->insert_count;
+  cap->moves += diff->move_count;
+  cap->reloads += diff->reload_count;
+  if (diff->change_count > 0)
+    cap->first = diff->changes[0];
+  return CMP_SUCCESS;
+}
+
+/* Replays an edit script the way a list applies it: deletes and move
+ * sources leave, the remaining items keep their order, and inserts and
+ * move targets land at their new index. */
+static int diff_replays(const uint64_t *old_items, size_t old_count,
+                        const uint64_t *new_items, size_t new_count,
+                        const cmp_diff_result_t *diff) {
+  static uint64_t rest[200000], placed[200000];
+  static unsigned char removed[200000], targeted[200000];
+  size_t i, n = 0, k = 0;
+  memset(removed, 0, old_count);
+  memset(targeted, 0, new_count);
+  for (i = 0; i < diff->change_count; ++i) {
+    const cmp_diff_change_t *c = &diff->changes[i];
+    if (c->op == CMP_DIFF_DELETE || c->op == CMP_DIFF_MOVE)
+      removed[c->from] = 1;
+    if (c->op == CMP_DIFF_INSERT || c->op == CMP_DIFF_MOVE) {
+      targeted[c->to] = 1;
+      placed[c->to] = c->id;
+    }
+  }
+  for (i = 0; i < old_count; ++i)
+    if (!removed[i])
+      rest[n++] = old_items[i];
+  for (i = 0; i < new_count; ++i) {
+    uint64_t id = targeted[i] ? placed[i] : (k < n ? rest[k++] : 0);
+    if (id != new_items[i])
+      return 0;
+  }
+  return k == n;
+}
+
+TEST test_diff_identifiers(void) {
+  const uint64_t old_items[] = {1, 2, 3, 4, 5, 6};
+  const uint64_t moved[] = {1, 5, 2, 3, 4, 6};
+  const uint64_t mixed[] = {7, 6, 2, 3, 8, 1};
+  const uint64_t dup_old[] = {1, 9, 9, 2, 9};
+  const uint64_t dup_new[] = {9, 1, 9, 9, 2, 9};
+  cmp_diff_result_t diff;
+
+  /* A single moved item is one move, not a shuffle */
+  ASSERT_EQ(CMP_SUCCESS, cmp_diff_identifiers(old_items, 6, moved, 6, &diff));
+  ASSERT_EQ(1, diff.change_count);
+  ASSERT_EQ(CMP_DIFF_MOVE, diff.changes[0].op);
+  ASSERT_EQ(4, diff.changes[0].from);
+  ASSERT_EQ(1, diff.changes[0].to);
+  ASSERT_EQ(5, diff.changes[0].id);
+  ASSERT(diff_replays(old_items, 6, moved, 6, &diff));
+  cmp_diff_result_free(&diff);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_diff_identifiers(old_items, 6, mixed, 6, &diff));
+  ASSERT_EQ(2, diff.delete_count);
+  ASSERT_EQ(2, diff.insert_count);
+  ASSERT_EQ(CMP_DIFF_DELETE, diff.changes[0].op);
+  ASSERT_EQ(4, diff.changes[0].from); /* Deletes run back to front */
+  ASSERT_EQ(3, diff.old_to_new[2]);
+  ASSERT_EQ(CMP_DIFF_NONE, diff.new_to_old[0]);
+  ASSERT(diff_replays(old_items, 6, mixed, 6, &diff));
+  cmp_diff_result_free(&diff);
+
+  /* Repeated identifiers match next to anchors and otherwise churn */
+  ASSERT_EQ(CMP_SUCCESS, cmp_diff_identifiers(dup_old, 5, dup_new, 6, &diff));
+  ASSERT_EQ(3, diff.new_to_old[4]);
+  ASSERT(diff_replays(dup_old, 5, dup_new, 6, &diff));
+  cmp_diff_result_free(&diff);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_diff_identifiers(NULL, 0, moved, 6, &diff));
+  ASSERT_EQ(6, diff.insert_count);
+  cmp_diff_result_free(&diff);
+  ASSERT_EQ(CMP_SUCCESS, cmp_diff_identifiers(moved, 6, NULL, 0, &diff));
+  ASSERT_EQ(6, diff.delete_count);
+  cmp_diff_result_free(&diff);
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_diff_identifiers(NULL, 2, moved, 6, &diff));
+  PASS();
+}
+
+TEST test_diff_large_snapshot(void) {
+  static uint64_t old_items[100000], new_items[100000];
+  cmp_diff_result_t diff;
+  unsigned long seed = 12345;
+  size_t i, n = 100000, a, b;
+  uint64_t t;
+
+  for (i = 0; i < n; ++i)
+    old_items[i] = new_items[i] = (uint64_t)i * 2654435761UL + 17;
+  /* 20 scattered edits: swaps, a replacement and a delete + insert */
+  for (i = 0; i < 18; ++i) {
+    seed = seed * 1103515245UL + 12345UL;
+    a = (size_t)(seed >> 8) % n;
+    seed = seed * 1103515245UL + 12345UL;
+    b = (size_t)(seed >> 8) % n;
+    t = new_items[a];
+    new_items[a] = new_items[b];
+    new_items[b] = t;
+  }
+  new_items[500] = 1;
+  memmove(new_items + 70000, new_items + 70001,
+          (n - 70001) * sizeof(uint64_t));
+  new_items[n - 1] = 3;
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_diff_identifiers(old_items, n, new_items, n, &diff));
+  ASSERT_EQ(2, diff.delete_count);
+  ASSERT_EQ(2, diff.insert_count);
+  ASSERT(diff.move_count <= 36);
+  ASSERT(diff_replays(old_items, n, new_items, n, &diff));
+  cmp_diff_result_free(&diff);
+  PASS();
+}
+
 TEST test_diffable_datasource(void) {
   cmp_diffable_datasource_t *ds = NULL;
   const uint64_t state_v1[] = {0xA1, 0xB2, 0xC3};
   const uint64_t state_v2[] = {0xA1, 0xC3, 0xD4}; /* B2 deleted, D4 inserted */
+  const uint64_t reload[] = {0xC3};
+  const uint64_t missing[] = {0xB2};
+  const uint64_t *snapshot = NULL;
+  size_t count = 0;
+  diff_capture_t cap;
 
+  memset(&cap, 0, sizeof(cap));
   ASSERT_EQ(CMP_SUCCESS, cmp_diffable_datasource_create(&ds));
+  ASSERT_EQ(CMP_SUCCESS, cmp_diffable_datasource_set_update_handler(
+                             ds, capture_update, &cap));
 
   ASSERT_EQ(CMP_SUCCESS,
             cmp_diffable_datasource_apply_snapshot(ds, state_v1, 3));
+  ASSERT_EQ(1, cap.batches);
+  ASSERT_EQ(3, cap.inserts);
   ASSERT_EQ(CMP_SUCCESS,
             cmp_diffable_datasource_apply_snapshot(ds, state_v2, 3));
+  ASSERT_EQ(2, cap.batches);
+  ASSERT_EQ(1, cap.deletes);
+  ASSERT_EQ(4, cap.inserts);
+  ASSERT_EQ(0, cap.moves);
+  ASSERT_EQ(CMP_DIFF_DELETE, cap.first.op);
+  ASSERT_EQ(1, cap.first.from);
+  ASSERT_EQ(0xB2, cap.first.id);
+
+  /* Unchanged snapshots emit nothing */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_diffable_datasource_apply_snapshot(ds, state_v2, 3));
+  ASSERT_EQ(2, cap.batches);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_diffable_datasource_reload_items(ds, reload, 1));
+  ASSERT_EQ(3, cap.batches);
+  ASSERT_EQ(1, cap.reloads);
+  ASSERT_EQ(CMP_DIFF_RELOAD, cap.first.op);
+  ASSERT_EQ(1, cap.first.to);
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND,
+            cmp_diffable_datasource_reload_items(ds, missing, 1));
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_diffable_datasource_get_snapshot(ds, &snapshot, &count));
+  ASSERT_EQ(3, count);
+  ASSERT_EQ(0xD4, snapshot[2]);
 
   ASSERT_EQ(CMP_SUCCESS, cmp_diffable_datasource_destroy(ds));
   PASS();
@@ -86,6 +253,8 @@ TEST test_null_args(void) {
 SUITE(collections_suite) {
   RUN_TEST(test_compositional_layout);
   RUN_TEST(test_diffable_datasource);
+  RUN_TEST(test_diff_identifiers);
+  RUN_TEST(test_diff_large_snapshot);
   RUN_TEST(test_null_args);
 }
 
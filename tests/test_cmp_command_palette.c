@@ -0,0 +1,249 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* clang-format on */
+
+/* The original scan-everything scorer, kept as the reference ranking. */
+static int reference_score(const char *text, const char *query) {
+  const char *t = text;
+  const char *q = query;
+  int score = 0, consecutive = 0;
+  if (!*q)
+    return 1;
+  if (strcmp(text, query) == 0)
+    return 1000;
+  while (*t && *q) {
+    if (tolower((unsigned char)*t) == tolower((unsigned char)*q)) {
+      score += 10 + consecutive * 5;
+      if (t == text || strchr("/\\ _.", *(t - 1)))
+        score += 20;
+      consecutive++;
+      q++;
+    } else {
+      consecutive = 0;
+    }
+    t++;
+  }
+  if (*q)
+    return 0;
+  if (!*t)
+    score += 50;
+  else
+    score -= (int)strlen(t);
+  return score > 0 ? score : 1;
+}
+
+static void make_name(unsigned long seed, char *out, size_t cap) {
+  static const char *const words[] = {
+      "open",  "file",   "close", "window", "git",    "commit", "push",
+      "view",  "toggle", "panel", "search", "replace", "format", "document",
+      "src",   "main",   "test",  "cmp",    "widget", "layout"};
+  static const char *const seps[] = {" ", "_", "/", ".", ": "};
+  size_t n = 2 + seed % 3, i, len = 0;
+  out[0] = '\0';
+  for (i = 0; i < n; ++i) {
+    const char *w = words[(seed >> (i * 5 + 2)) % 20];
+    const char *sep = i + 1 < n ? seps[(seed >> (i * 3 + 1)) % 5] : "";
+    if (len + strlen(w) + strlen(sep) + 1 >= cap)
+      break;
+    strcat(out, w);
+    strcat(out, sep);
+    len = strlen(out);
+  }
+  if (seed % 7 == 0)
+    out[0] = (char)toupper((unsigned char)out[0]);
+}
+
+static int fill(cmp_command_palette_t *palette, size_t count) {
+  size_t i;
+  char id[32], name[128], sub[128];
+  for (i = 0; i < count; ++i) {
+    unsigned long seed = (unsigned long)(i * 2654435761u) ^ (i >> 3);
+    sprintf(id, "item%lu", (unsigned long)i);
+    make_name(seed, name, sizeof(name));
+    make_name(seed * 31u + 7u, sub, sizeof(sub));
+    if (cmp_command_palette_add_item(palette, id, name, sub) != CMP_SUCCESS)
+      return 0;
+  }
+  return 1;
+}
+
+TEST test_palette_ranking(void) {
+  cmp_command_palette_t *palette = NULL;
+  cmp_command_item_t *results[4];
+  cmp_modality_t single;
+  size_t count = 0, i;
+  char id[16];
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_create(&palette));
+  /* Many weak hits registered before the best one */
+  for (i = 0; i < 100; ++i) {
+    sprintf(id, "weak%lu", (unsigned long)i);
+    ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_add_item(
+                               palette, id, "preferences: open keyboard file",
+                               NULL));
+  }
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_command_palette_add_item(palette, "open", "Open File", NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_add_item(palette, "sub", "Quit",
+                                                      "file.open"));
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_command_palette_search(palette, "of", results, 2, &count));
+  ASSERT_EQ(2, count);
+  ASSERT_STR_EQ("open", results[0]->id);
+  ASSERT(results[0]->score >= results[1]->score);
+
+  /* Narrowing keystrokes, then matching on the subtext only */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_command_palette_search(palette, "fil", results, 4, &count));
+  ASSERT_EQ(4, count);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_command_palette_search(palette, "file.op", results, 4, &count));
+  ASSERT_EQ(1, count);
+  ASSERT_STR_EQ("sub", results[0]->id);
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_command_palette_search(palette, "Open File", results, 4,
+                                       &count));
+  ASSERT_EQ(1000, results[0]->score);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_command_palette_search(palette, "zzz", results, 4, &count));
+  ASSERT_EQ(0, count);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_command_palette_search(palette, "", results, 0, &count));
+  ASSERT_EQ(0, count);
+
+  /* Only a threaded modality can take search slices */
+  memset(&single, 0, sizeof(single));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&single));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_command_palette_set_workers(palette, &single, 4));
+  ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_set_workers(palette, NULL, 4));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_destroy(&single));
+  ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_destroy(palette));
+  PASS();
+}
+
+typedef struct ref_hit {
+  int score;
+  size_t len;
+  size_t index;
+} ref_hit_t;
+
+static int compare_ref(const void *a, const void *b) {
+  const ref_hit_t *x = (const ref_hit_t *)a, *y = (const ref_hit_t *)b;
+  if (x->score != y->score)
+    return x->score > y->score ? -1 : 1;
+  if (x->len != y->len)
+    return x->len < y->len ? -1 : 1;
+  return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/* Typing a query one key at a time must give the same top results as
+ * scoring every item from scratch with the reference scorer. */
+TEST test_palette_incremental_matches_reference(void) {
+  static const char *const queries[] = {"s", "sr", "src", "srcm", "srcma",
+                                        "f",  "fo", "fmt", "g",   "gc",
+                                        "gcm", "w", "wl",  "wlt"};
+  enum { ITEMS = 20000, K = 25 };
+  cmp_command_palette_t *palette = NULL;
+  cmp_command_item_t *results[K];
+  static cmp_command_item_t *all[ITEMS];
+  ref_hit_t *ref;
+  size_t q, i, count;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_create(&palette));
+  ASSERT(fill(palette, ITEMS));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_command_palette_search(palette, "", all, ITEMS, &count));
+  ASSERT_EQ(ITEMS, count);
+  ref = (ref_hit_t *)malloc(ITEMS * sizeof(ref_hit_t));
+  ASSERT(ref != NULL);
+
+  for (q = 0; q < sizeof(queries) / sizeof(queries[0]); ++q) {
+    size_t hits = 0;
+    for (i = 0; i < ITEMS; ++i) {
+      /* Items come back in insertion order for the empty query */
+      int score = reference_score(all[i]->display_text, queries[q]);
+      if (score == 0 && all[i]->subtext[0])
+        score = reference_score(all[i]->subtext, queries[q]);
+      if (score > 0) {
+        ref[hits].score = score;
+        ref[hits].len = strlen(all[i]->display_text);
+        ref[hits].index = i;
+        hits++;
+      }
+    }
+    qsort(ref, hits, sizeof(ref_hit_t), compare_ref);
+    ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_search(palette, queries[q],
+                                                      results, K, &count));
+    ASSERT_EQ(hits < K ? hits : K, count);
+    for (i = 0; i < count; ++i) {
+      ASSERT_EQ(all[ref[i].index], results[i]);
+      ASSERT_EQ(ref[i].score, results[i]->score);
+    }
+  }
+
+  free(ref);
+  ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_destroy(palette));
+  PASS();
+}
+
+/* 100k items typed key by key, once on the calling thread and once split
+ * over a worker pool; both must rank identically. */
+TEST test_palette_large_corpus_workers(void) {
+  static const char *const keys = "srcmaintest";
+  enum { ITEMS = 100000, K = 50 };
+  cmp_command_palette_t *serial = NULL, *parallel = NULL;
+  cmp_command_item_t *a[K], *b[K];
+  cmp_modality_t pool;
+  size_t n, i, count_a, count_b;
+  char query[16];
+
+  memset(&pool, 0, sizeof(pool));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_threaded_init(&pool, 3));
+  ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_create(&serial));
+  ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_create(&parallel));
+  ASSERT(fill(serial, ITEMS));
+  ASSERT(fill(parallel, ITEMS));
+  ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_set_workers(parallel, &pool, 4));
+
+  for (n = 1; n <= strlen(keys); ++n) {
+    memcpy(query, keys, n);
+    query[n] = '\0';
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_command_palette_search(serial, query, a, K, &count_a));
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_command_palette_search(parallel, query, b, K, &count_b));
+    ASSERT_EQ(count_a, count_b);
+    for (i = 0; i < count_a; ++i) {
+      ASSERT_STR_EQ(a[i]->id, b[i]->id);
+      ASSERT_EQ(a[i]->score, b[i]->score);
+    }
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_destroy(serial));
+  ASSERT_EQ(CMP_SUCCESS, cmp_command_palette_destroy(parallel));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_destroy(&pool));
+  PASS();
+}
+
+SUITE(command_palette_suite) {
+  RUN_TEST(test_palette_ranking);
+  RUN_TEST(test_palette_incremental_matches_reference);
+  RUN_TEST(test_palette_large_corpus_workers);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(command_palette_suite);
+  GREATEST_MAIN_END();
+}
@@ -0,0 +1,509 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+#include <string.h>
+#include <time.h>
+/* clang-format on */
+
+static unsigned long grid_seed = 1;
+
+static unsigned long grid_rand(void) {
+  grid_seed = grid_seed * 1103515245UL + 12345UL;
+  return (grid_seed >> 8) & 0xFFFFFF;
+}
+
+static const char *const grid_cities[] = {"Oslo", "Lima", "Kyiv", "Bern",
+                                          "Rome", "Doha", "Baku", "Apia"};
+
+/* id int64, score double, city string */
+static cmp_datagrid_model_t *make_model(size_t rows) {
+  cmp_datagrid_model_t *model = NULL;
+  static int64_t ids[4096];
+  static double scores[4096];
+  static const char *cities[4096];
+  size_t i, done, n;
+
+  cmp_datagrid_model_create(&model);
+  cmp_datagrid_model_add_column(model, "id", CMP_COLUMN_INT64, NULL);
+  cmp_datagrid_model_add_column(model, "score", CMP_COLUMN_DOUBLE, NULL);
+  cmp_datagrid_model_add_column(model, "city", CMP_COLUMN_STRING, NULL);
+  for (done = 0; done < rows; done += n) {
+    n = rows - done < 4096 ? rows - done : 4096;
+    for (i = 0; i < n; ++i) {
+      ids[i] = (int64_t)grid_rand() - 0x800000;
+      scores[i] = (double)(grid_rand() % 1000) / 8.0 - 50.0;
+      cities[i] = grid_cities[grid_rand() % 8];
+    }
+    cmp_datagrid_model_append_int64(model, 0, ids, n);
+    cmp_datagrid_model_append_double(model, 1, scores, n);
+    cmp_datagrid_model_append_strings(model, 2, cities, n);
+  }
+  return model;
+}
+
+TEST test_datagrid_columns(void) {
+  cmp_datagrid_model_t *model = NULL;
+  const char *names[] = {"b", "a", "b", NULL};
+  int64_t ids[] = {-42, 7, 0};
+  double vals[] = {1.5, -2.25};
+  size_t col, rows, count;
+  int64_t i64;
+  double f64;
+  const char *s;
+  char buf[32];
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_create(&model));
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_add_column(
+                             model, "id", CMP_COLUMN_INT64, &col));
+  ASSERT_EQ(0, (int)col);
+  cmp_datagrid_model_add_column(model, "value", CMP_COLUMN_DOUBLE, &col);
+  cmp_datagrid_model_add_column(model, "name", CMP_COLUMN_STRING, &col);
+  ASSERT_EQ(2, (int)col);
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_datagrid_model_add_column(model, NULL, CMP_COLUMN_INT64,
+                                          NULL));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_append_int64(model, 0, ids, 3));
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_append_double(model, 1, vals, 2));
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_append_strings(model, 2, names, 4));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_datagrid_model_append_double(model, 0, vals, 2));
+
+  /* Ragged columns: the shortest one decides */
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_get_row_count(model, &rows));
+  ASSERT_EQ(2, (int)rows);
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_get_column_count(model, &count));
+  ASSERT_EQ(3, (int)count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_get_column_name(model, 1, &s));
+  ASSERT_STR_EQ("value", s);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_get_int64(model, 0, 0, &i64));
+  ASSERT(i64 == -42);
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_get_double(model, 1, 1, &f64));
+  ASSERT_EQ(-2.25, f64);
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_get_string(model, 2, 2, &s));
+  ASSERT_STR_EQ("b", s);
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_get_string(model, 2, 3, &s));
+  ASSERT_STR_EQ("", s);
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_datagrid_model_get_int64(model, 0, 3, &i64));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_datagrid_model_get_double(model, 0, 0, &f64));
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_datagrid_model_format_cell(model, 0, 0, buf, sizeof(buf)));
+  ASSERT_STR_EQ("-42", buf);
+  cmp_datagrid_model_format_cell(model, 1, 0, buf, sizeof(buf));
+  ASSERT_STR_EQ("1.5", buf);
+  cmp_datagrid_model_format_cell(model, 2, 1, buf, 1);
+  ASSERT_STR_EQ("", buf);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_destroy(model));
+  PASS();
+}
+
+TEST test_datagrid_filters(void) {
+  cmp_datagrid_model_t *model = make_model(10007);
+  cmp_datagrid_filter_op_t op;
+  const uint32_t *rows;
+  size_t count, expected, i;
+  int64_t id;
+  double score;
+  const char *city;
+
+  /* Every op against a scalar scan, on both numeric kernels */
+  for (op = CMP_DATAGRID_FILTER_EQ; op <= CMP_DATAGRID_FILTER_GE; ++op) {
+    cmp_datagrid_model_clear_filters(model);
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_datagrid_model_add_filter_double(model, 1, op, 0.5));
+    ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_refresh(model, NULL, NULL));
+    cmp_datagrid_model_get_view(model, &rows, &count);
+    for (i = 0, expected = 0; i < 10007; ++i) {
+      cmp_datagrid_model_get_double(model, 1, i, &score);
+      expected += op == CMP_DATAGRID_FILTER_EQ   ? score == 0.5
+                  : op == CMP_DATAGRID_FILTER_NE ? score != 0.5
+                  : op == CMP_DATAGRID_FILTER_LT ? score < 0.5
+                  : op == CMP_DATAGRID_FILTER_LE ? score <= 0.5
+                  : op == CMP_DATAGRID_FILTER_GT ? score > 0.5
+                                                 : score >= 0.5;
+    }
+    ASSERT_EQ(expected, count);
+    ASSERT(expected > 0);
+    for (i = 1; i < count; ++i)
+      ASSERT(rows[i - 1] < rows[i]);
+
+    cmp_datagrid_model_clear_filters(model);
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_datagrid_model_add_filter_int64(model, 0, op, 1000));
+    cmp_datagrid_model_refresh(model, NULL, NULL);
+    cmp_datagrid_model_get_view(model, &rows, &count);
+    for (i = 0, expected = 0; i < 10007; ++i) {
+      cmp_datagrid_model_get_int64(model, 0, i, &id);
+      expected += op == CMP_DATAGRID_FILTER_EQ   ? id == 1000
+                  : op == CMP_DATAGRID_FILTER_NE ? id != 1000
+                  : op == CMP_DATAGRID_FILTER_LT ? id < 1000
+                  : op == CMP_DATAGRID_FILTER_LE ? id <= 1000
+                  : op == CMP_DATAGRID_FILTER_GT ? id > 1000
+                                                 : id >= 1000;
+    }
+    ASSERT_EQ(expected, count);
+  }
+
+  /* Filters combine; strings compare by dictionary code */
+  cmp_datagrid_model_clear_filters(model);
+  cmp_datagrid_model_add_filter_string(model, 2, CMP_DATAGRID_FILTER_EQ,
+                                       "Rome");
+  cmp_datagrid_model_add_filter_double(model, 1, CMP_DATAGRID_FILTER_GE,
+                                       0.0);
+  cmp_datagrid_model_refresh(model, NULL, NULL);
+  cmp_datagrid_model_get_view(model, &rows, &count);
+  for (i = 0, expected = 0; i < 10007; ++i) {
+    cmp_datagrid_model_get_string(model, 2, i, &city);
+    cmp_datagrid_model_get_double(model, 1, i, &score);
+    expected += strcmp(city, "Rome") == 0 && score >= 0.0;
+  }
+  ASSERT_EQ(expected, count);
+  for (i = 0; i < count; ++i) {
+    cmp_datagrid_model_get_string(model, 2, rows[i], &city);
+    ASSERT_STR_EQ("Rome", city);
+  }
+
+  cmp_datagrid_model_clear_filters(model);
+  cmp_datagrid_model_add_filter_string(model, 2, CMP_DATAGRID_FILTER_NE,
+                                       "Atlantis");
+  cmp_datagrid_model_refresh(model, NULL, NULL);
+  cmp_datagrid_model_get_view(model, &rows, &count);
+  ASSERT_EQ(10007, (int)count);
+  cmp_datagrid_model_add_filter_string(model, 2, CMP_DATAGRID_FILTER_EQ,
+                                       "Atlantis");
+  cmp_datagrid_model_refresh(model, NULL, NULL);
+  cmp_datagrid_model_get_view(model, &rows, &count);
+  ASSERT_EQ(0, (int)count);
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_datagrid_model_add_filter_string(model, 2,
+                                                 CMP_DATAGRID_FILTER_LT, "A"));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_datagrid_model_add_filter_int64(model, 1,
+                                                CMP_DATAGRID_FILTER_LT, 0));
+
+  cmp_datagrid_model_destroy(model);
+  PASS();
+}
+
+/* Checks the view is ordered by city asc, score desc, then model order */
+static int view_sorted(const cmp_datagrid_model_t *model) {
+  const uint32_t *rows;
+  size_t count, i;
+  const char *c0, *c1;
+  double s0, s1;
+  int cmp;
+  cmp_datagrid_model_get_view(model, &rows, &count);
+  for (i = 1; i < count; ++i) {
+    cmp_datagrid_model_get_string(model, 2, rows[i - 1], &c0);
+    cmp_datagrid_model_get_string(model, 2, rows[i], &c1);
+    cmp_datagrid_model_get_double(model, 1, rows[i - 1], &s0);
+    cmp_datagrid_model_get_double(model, 1, rows[i], &s1);
+    cmp = strcmp(c0, c1);
+    if (cmp > 0 || (cmp == 0 && s0 < s1) ||
+        (cmp == 0 && s0 == s1 && rows[i - 1] > rows[i]))
+      return 0;
+  }
+  return 1;
+}
+
+TEST test_datagrid_sort(void) {
+  cmp_datagrid_model_t *model = make_model(5000);
+  cmp_datagrid_model_t *numbers = NULL;
+  cmp_datagrid_sort_key_t keys[2];
+  int64_t ints[] = {5, -1, 0, -9000000000 / 3, 5, 3};
+  double reals[] = {0.5, -0.0, -2.0, 1e300, -1e-300, 0.0};
+  const uint32_t *rows;
+  size_t count;
+
+  keys[0].column = 2;
+  keys[0].descending = 0;
+  keys[1].column = 1;
+  keys[1].descending = 1;
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_set_sort(model, keys, 2));
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_refresh(model, NULL, NULL));
+  cmp_datagrid_model_get_view(model, &rows, &count);
+  ASSERT_EQ(5000, (int)count);
+  ASSERT(view_sorted(model));
+  keys[0].column = 7;
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_datagrid_model_set_sort(model, keys, 1));
+  cmp_datagrid_model_destroy(model);
+
+  /* Signed integers and doubles of every sign order numerically */
+  cmp_datagrid_model_create(&numbers);
+  cmp_datagrid_model_add_column(numbers, "i", CMP_COLUMN_INT64, NULL);
+  cmp_datagrid_model_add_column(numbers, "d", CMP_COLUMN_DOUBLE, NULL);
+  cmp_datagrid_model_append_int64(numbers, 0, ints, 6);
+  cmp_datagrid_model_append_double(numbers, 1, reals, 6);
+  keys[0].column = 0;
+  keys[0].descending = 0;
+  cmp_datagrid_model_set_sort(numbers, keys, 1);
+  cmp_datagrid_model_refresh(numbers, NULL, NULL);
+  cmp_datagrid_model_get_view(numbers, &rows, &count);
+  ASSERT_EQ(3, (int)rows[0]);
+  ASSERT_EQ(1, (int)rows[1]);
+  ASSERT_EQ(2, (int)rows[2]);
+  ASSERT_EQ(5, (int)rows[3]);
+  ASSERT_EQ(0, (int)rows[4]); /* Equal keys keep model order */
+  ASSERT_EQ(4, (int)rows[5]);
+  keys[0].column = 1;
+  keys[0].descending = 1;
+  cmp_datagrid_model_set_sort(numbers, keys, 1);
+  cmp_datagrid_model_refresh(numbers, NULL, NULL);
+  cmp_datagrid_model_get_view(numbers, &rows, &count);
+  ASSERT_EQ(3, (int)rows[0]);
+  ASSERT_EQ(0, (int)rows[1]);
+  ASSERT_EQ(1, (int)rows[2]); /* -0.0 and 0.0 tie */
+  ASSERT_EQ(5, (int)rows[3]);
+  ASSERT_EQ(4, (int)rows[4]);
+  ASSERT_EQ(2, (int)rows[5]);
+  cmp_datagrid_model_destroy(numbers);
+  PASS();
+}
+
+TEST test_datagrid_sort_signed_zero(void) {
+  cmp_datagrid_model_t *model = NULL;
+  cmp_datagrid_sort_key_t keys[2];
+  double reals[] = {0.0, -0.0, 0.0, -0.0, 1.0, -1.0};
+  int64_t ints[] = {4, 3, 2, 1, 0, 5};
+  const uint32_t *rows;
+  size_t count;
+
+  /* Both zeros are one key, so the secondary key decides among them */
+  cmp_datagrid_model_create(&model);
+  cmp_datagrid_model_add_column(model, "d", CMP_COLUMN_DOUBLE, NULL);
+  cmp_datagrid_model_add_column(model, "i", CMP_COLUMN_INT64, NULL);
+  cmp_datagrid_model_append_double(model, 0, reals, 6);
+  cmp_datagrid_model_append_int64(model, 1, ints, 6);
+  keys[0].column = 0;
+  keys[0].descending = 0;
+  keys[1].column = 1;
+  keys[1].descending = 0;
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_set_sort(model, keys, 2));
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_refresh(model, NULL, NULL));
+  cmp_datagrid_model_get_view(model, &rows, &count);
+  ASSERT_EQ(6, (int)count);
+  ASSERT_EQ(5, (int)rows[0]);
+  ASSERT_EQ(3, (int)rows[1]);
+  ASSERT_EQ(2, (int)rows[2]);
+  ASSERT_EQ(1, (int)rows[3]);
+  ASSERT_EQ(0, (int)rows[4]);
+  ASSERT_EQ(4, (int)rows[5]);
+  cmp_datagrid_model_destroy(model);
+  PASS();
+}
+
+TEST test_datagrid_million_rows(void) {
+  cmp_datagrid_model_t *model = make_model(1000000);
+  cmp_datagrid_sort_key_t keys[2];
+  const uint32_t *rows;
+  size_t count;
+
+  cmp_datagrid_model_add_filter_double(model, 1, CMP_DATAGRID_FILTER_GT,
+                                       10.0);
+  cmp_datagrid_model_add_filter_string(model, 2, CMP_DATAGRID_FILTER_NE,
+                                       "Oslo");
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_refresh(model, NULL, NULL));
+  cmp_datagrid_model_get_view(model, &rows, &count);
+  ASSERT(count > 300000 && count < 500000);
+
+  keys[0].column = 2;
+  keys[0].descending = 0;
+  keys[1].column = 1;
+  keys[1].descending = 1;
+  cmp_datagrid_model_set_sort(model, keys, 2);
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_refresh(model, NULL, NULL));
+  ASSERT(view_sorted(model));
+  cmp_datagrid_model_destroy(model);
+  PASS();
+}
+
+typedef struct refresh_wait {
+  cmp_modality_t *ui;
+  int calls;
+  int error;
+  cmp_datagrid_model_t *model;
+  clock_t deadline;
+} refresh_wait_t;
+
+static void on_refreshed(cmp_datagrid_model_t *model, int error,
+                         void *user_data) {
+  refresh_wait_t *wait = (refresh_wait_t *)user_data;
+  (void)model;
+  wait->calls++;
+  wait->error = error;
+}
+
+/* Runs the ui loop until no refresh is in flight */
+static void refresh_wait_task(void *arg) {
+  refresh_wait_t *wait = (refresh_wait_t *)arg;
+  int refreshing = 1;
+  cmp_datagrid_model_is_refreshing(wait->model, &refreshing);
+  if (!refreshing || clock() > wait->deadline) {
+    cmp_modality_stop(wait->ui);
+    return;
+  }
+  cmp_modality_queue_task(wait->ui, refresh_wait_task, wait);
+}
+
+TEST test_datagrid_background_refresh(void) {
+  cmp_datagrid_model_t *model = make_model(200000);
+  cmp_datagrid_sort_key_t key;
+  cmp_modality_t workers, ui;
+  refresh_wait_t wait, stale;
+  const uint32_t *rows;
+  size_t count;
+  int refreshing = 0;
+  int64_t one = 1;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_threaded_init(&workers, 2));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&ui));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_datagrid_model_set_workers(model, &ui, &ui));
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_set_workers(model, &workers, &ui));
+  memset(&wait, 0, sizeof(wait));
+  memset(&stale, 0, sizeof(stale));
+  wait.ui = &ui;
+  wait.model = model;
+  wait.deadline = clock() + 10 * CLOCKS_PER_SEC;
+
+  key.column = 2;
+  key.descending = 0;
+  cmp_datagrid_model_set_sort(model, &key, 1);
+  cmp_datagrid_model_add_filter_double(model, 1, CMP_DATAGRID_FILTER_LT, 0.0);
+
+  /* Both return at once; only the newer one lands */
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_refresh(model, on_refreshed,
+                                                    &stale));
+  key.column = 1;
+  key.descending = 1;
+  cmp_datagrid_model_set_sort(model, &key, 1);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_datagrid_model_refresh(model, on_refreshed, &wait));
+  cmp_datagrid_model_is_refreshing(model, &refreshing);
+  ASSERT_EQ(1, refreshing);
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE,
+            cmp_datagrid_model_append_int64(model, 0, &one, 1));
+  cmp_datagrid_model_get_view(model, &rows, &count);
+  ASSERT(rows == NULL); /* Still the unfiltered view */
+
+  cmp_modality_queue_task(&ui, refresh_wait_task, &wait);
+  cmp_modality_run(&ui);
+  ASSERT_EQ(1, wait.calls);
+  ASSERT_EQ(CMP_SUCCESS, wait.error);
+  ASSERT_EQ(0, stale.calls);
+  cmp_datagrid_model_get_view(model, &rows, &count);
+  ASSERT(rows != NULL);
+  ASSERT(count > 80000 && count < 120000);
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_append_int64(model, 0, &one, 1));
+
+  /* Destroying with a refresh in flight defers the release to ui */
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_refresh(model, NULL, NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_destroy(model));
+  wait.model = NULL;
+  stale.ui = &ui;
+  stale.deadline = clock() + CLOCKS_PER_SEC / 4;
+  cmp_modality_queue_task(&ui, refresh_wait_task, &stale);
+  cmp_modality_run(&ui);
+
+  cmp_modality_destroy(&workers);
+  cmp_modality_destroy(&ui);
+  PASS();
+}
+
+TEST test_datagrid_view(void) {
+  cmp_datagrid_model_t *model = make_model(100000);
+  cmp_datagrid_view_t *view = NULL;
+  cmp_ui_node_t *container = NULL, *cell = NULL;
+  cmp_datagrid_sort_key_t key;
+  size_t first_row, rows, first_col, cols, i;
+  const uint32_t *order;
+  size_t count;
+  char expect[32];
+  double w, h, y;
+
+  cmp_ui_box_create(&container);
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_datagrid_view_create(&view, model, container, 0.0f));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_datagrid_view_create(&view, model, container, 20.0f));
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_view_set_column_width(view, 0, 80.0f));
+  ASSERT_EQ(CMP_ERROR_BOUNDS,
+            cmp_datagrid_view_set_column_width(view, 3, 80.0f));
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_view_set_viewport(view, 150, 100));
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_view_get_content_size(view, &w, &h));
+  ASSERT_EQ(320.0, w);
+  ASSERT_EQ(2000000.0, h);
+
+  /* Rows 0-5 touch the viewport (+1 overscan), columns 0 and 1 */
+  cmp_datagrid_view_get_window(view, &first_row, &rows, &first_col, &cols);
+  ASSERT_EQ(0, (int)first_row);
+  ASSERT_EQ(7, (int)rows);
+  ASSERT_EQ(0, (int)first_col);
+  ASSERT_EQ(2, (int)cols);
+  ASSERT_EQ(14, (int)container->child_count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_view_get_cell(view, 3, 1, &cell));
+  ASSERT_EQ(60.0f, cell->layout->position[0]);
+  ASSERT_EQ(80.0f, cell->layout->position[3]);
+  ASSERT_EQ(120.0f, cell->layout->width);
+  cmp_datagrid_model_format_cell(model, 1, 3, expect, sizeof(expect));
+  ASSERT_STR_EQ(expect, (const char *)cell->properties);
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND,
+            cmp_datagrid_view_get_cell(view, 3, 2, &cell));
+
+  /* Scrolling both ways keeps the cell count to the window */
+  for (y = 0.0; y < 2000000.0; y += 7919.0) {
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_datagrid_view_scroll_to(view, (y / 10000.0), y));
+    ASSERT(container->child_count <= 24);
+  }
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_view_scroll_to(view, 170.0, 400010.0));
+  cmp_datagrid_view_get_window(view, &first_row, &rows, &first_col, &cols);
+  ASSERT_EQ(19999, (int)first_row);
+  ASSERT_EQ(1, (int)first_col);
+  ASSERT_EQ(2, (int)cols);
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_view_get_cell(view, 20000, 2, &cell));
+  ASSERT_EQ(-10.0f, cell->layout->position[0]);
+  ASSERT_EQ(30.0f, cell->layout->position[3]);
+
+  /* After a sort the visible cells show the new order */
+  key.column = 0;
+  key.descending = 0;
+  cmp_datagrid_model_set_sort(model, &key, 1);
+  cmp_datagrid_model_refresh(model, NULL, NULL);
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_view_sync(view));
+  cmp_datagrid_model_get_view(model, &order, &count);
+  for (i = first_row; i < first_row + rows; ++i) {
+    ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_view_get_cell(view, i, 1, &cell));
+    cmp_datagrid_model_format_cell(model, 1, order[i], expect,
+                                   sizeof(expect));
+    ASSERT_STR_EQ(expect, (const char *)cell->properties);
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_view_destroy(view));
+  ASSERT_EQ(0, (int)container->child_count);
+  cmp_ui_node_destroy(container);
+  cmp_datagrid_model_destroy(model);
+  PASS();
+}
+
+SUITE(datagrid_suite) {
+  RUN_TEST(test_datagrid_columns);
+  RUN_TEST(test_datagrid_filters);
+  RUN_TEST(test_datagrid_sort);
+  RUN_TEST(test_datagrid_sort_signed_zero);
+  RUN_TEST(test_datagrid_million_rows);
+  RUN_TEST(test_datagrid_background_refresh);
+  RUN_TEST(test_datagrid_view);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(datagrid_suite);
+  GREATEST_MAIN_END();
+}
@@ -0,0 +1,243 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+
+#include <string.h>
+#include <time.h>
+/* clang-format on */
+
+typedef struct pty_sink {
+  cmp_modality_t *mod;
+  size_t bytes;
+  int exited;
+} pty_sink_t;
+
+static void on_output(void *user_data, const char *data, size_t length) {
+  pty_sink_t *sink = (pty_sink_t *)user_data;
+  (void)data;
+  sink->bytes += length;
+  if (length == 0) {
+    sink->exited = 1;
+    cmp_modality_stop(sink->mod);
+  }
+}
+
+TEST test_pty_args(void) {
+  cmp_embedded_pty_t *pty = NULL;
+  cmp_modality_t mod;
+  char buf[16];
+  size_t got;
+
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_embedded_pty_create(NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_create(&pty));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_embedded_pty_spawn(pty, NULL));
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE, cmp_embedded_pty_write(pty, "x", 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_read(pty, buf, sizeof(buf), &got));
+  ASSERT_EQ(0, got);
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_embedded_pty_resize(pty, 0, 24));
+
+  memset(&mod, 0, sizeof(mod));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&mod));
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE,
+            cmp_embedded_pty_attach(pty, &mod, NULL, NULL, NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_destroy(&mod));
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_destroy(pty));
+  PASS();
+}
+
+#if !defined(_WIN32)
+/* A real child's escape sequences land in the grid, and it sees the
+ * window size set on the pty. */
+TEST test_pty_child_into_grid(void) {
+  cmp_embedded_pty_t *pty = NULL;
+  cmp_term_t *term = NULL;
+  const cmp_term_cell_t *cells;
+  cmp_modality_t mod;
+  pty_sink_t sink;
+
+  memset(&mod, 0, sizeof(mod));
+  memset(&sink, 0, sizeof(sink));
+  sink.mod = &mod;
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&mod));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_create(&term, 20, 4, 100));
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_create(&pty));
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_resize(pty, 20, 4));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_embedded_pty_spawn(pty, "stty -echo; printf 'hi \\033[1mB"
+                                        "\\033[0m'; stty size"));
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE, cmp_embedded_pty_spawn(pty, "true"));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_embedded_pty_attach(pty, &mod, term, on_output, &sink));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_run(&mod));
+
+  ASSERT_EQ(1, sink.exited);
+  ASSERT(sink.bytes > 0);
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_get_row(term, 0, &cells));
+  ASSERT_EQ('h', cells[0].codepoint);
+  ASSERT_EQ('B', cells[3].codepoint);
+  ASSERT_EQ(CMP_TERM_ATTR_BOLD, cells[3].attrs);
+  /* stty reports the size set before the spawn */
+  ASSERT_EQ('4', cells[4].codepoint);
+  ASSERT_EQ('2', cells[6].codepoint);
+  ASSERT_EQ('0', cells[7].codepoint);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_destroy(pty));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_destroy(term));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_destroy(&mod));
+  PASS();
+}
+
+/* A `cat`-sized stream through the pty into the grid. */
+TEST test_pty_bulk_output(void) {
+  cmp_embedded_pty_t *pty = NULL;
+  cmp_term_t *term = NULL;
+  cmp_modality_t mod;
+  pty_sink_t sink;
+
+  memset(&mod, 0, sizeof(mod));
+  memset(&sink, 0, sizeof(sink));
+  sink.mod = &mod;
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&mod));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_create(&term, 80, 24, 1000));
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_create(&pty));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_embedded_pty_spawn(
+                pty, "stty -echo -onlcr; yes 'building target 0123456789' | "
+                     "head -n 100000"));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_embedded_pty_attach(pty, &mod, term, on_output, &sink));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_run(&mod));
+
+  ASSERT_EQ(1, sink.exited);
+  ASSERT_EQ(100000 * 27, sink.bytes);
+  ASSERT_EQ(1000, cmp_term_get_scrollback_count(term));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_destroy(pty));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_destroy(term));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_destroy(&mod));
+  PASS();
+}
+
+/* Output that arrives after the pump has parked still lands,
+ * and the loop keeps running other tasks meanwhile. */
+typedef struct pty_ticker {
+  cmp_modality_t *mod;
+  const pty_sink_t *sink;
+  size_t turns;
+} pty_ticker_t;
+
+static void ticker_task(void *arg) {
+  pty_ticker_t *ticker = (pty_ticker_t *)arg;
+  ++ticker->turns;
+  if (!ticker->sink->exited)
+    cmp_modality_queue_task(ticker->mod, ticker_task, ticker);
+}
+
+TEST test_pty_late_output(void) {
+  cmp_embedded_pty_t *pty = NULL;
+  cmp_term_t *term = NULL;
+  const cmp_term_cell_t *cells;
+  cmp_modality_t mod;
+  pty_sink_t sink;
+  pty_ticker_t ticker;
+
+  memset(&mod, 0, sizeof(mod));
+  memset(&sink, 0, sizeof(sink));
+  memset(&ticker, 0, sizeof(ticker));
+  sink.mod = &mod;
+  ticker.mod = &mod;
+  ticker.sink = &sink;
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&mod));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_create(&term, 20, 4, 10));
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_create(&pty));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_embedded_pty_spawn(pty, "stty -echo; sleep 0.2; printf late"));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_embedded_pty_attach(pty, &mod, term, on_output, &sink));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_queue_task(&mod, ticker_task, &ticker));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_run(&mod));
+
+  ASSERT_EQ(1, sink.exited);
+  ASSERT(ticker.turns > 1);
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_get_row(term, 0, &cells));
+  ASSERT_EQ('l', cells[0].codepoint);
+  ASSERT_EQ('e', cells[3].codepoint);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_destroy(pty));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_destroy(term));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_destroy(&mod));
+  PASS();
+}
+
+/* An idle child leaves the serial loop free to sleep. */
+TEST test_pty_idle_cpu(void) {
+  cmp_embedded_pty_t *pty = NULL;
+  cmp_modality_t mod;
+  pty_sink_t sink;
+  clock_t start;
+  clock_t spent;
+
+  memset(&mod, 0, sizeof(mod));
+  memset(&sink, 0, sizeof(sink));
+  sink.mod = &mod;
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&mod));
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_create(&pty));
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_spawn(pty, "sleep 1"));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_embedded_pty_attach(pty, &mod, NULL, on_output, &sink));
+  start = clock();
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_run(&mod));
+  spent = clock() - start;
+
+  ASSERT_EQ(1, sink.exited);
+  ASSERT(spent < CLOCKS_PER_SEC / 5);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_destroy(pty));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_destroy(&mod));
+  PASS();
+}
+
+static void stop_task(void *arg) { cmp_modality_stop((cmp_modality_t *)arg); }
+
+/* Destroy frees the pty at once; the pump still queued finds it gone. */
+TEST test_pty_destroy_while_queued(void) {
+  cmp_embedded_pty_t *pty = NULL;
+  cmp_modality_t mod;
+  pty_sink_t sink;
+
+  memset(&mod, 0, sizeof(mod));
+  memset(&sink, 0, sizeof(sink));
+  sink.mod = &mod;
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&mod));
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_create(&pty));
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_spawn(pty, "sleep 10"));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_embedded_pty_attach(pty, &mod, NULL, on_output, &sink));
+  ASSERT_EQ(CMP_SUCCESS, cmp_embedded_pty_destroy(pty));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_queue_task(&mod, stop_task, &mod));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_run(&mod));
+
+  ASSERT_EQ(0, sink.exited);
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_destroy(&mod));
+  PASS();
+}
+#endif
+
+SUITE(embedded_pty_suite) {
+  RUN_TEST(test_pty_args);
+#if !defined(_WIN32)
+  RUN_TEST(test_pty_child_into_grid);
+  RUN_TEST(test_pty_bulk_output);
+  RUN_TEST(test_pty_late_output);
+  RUN_TEST(test_pty_idle_cpu);
+  RUN_TEST(test_pty_destroy_while_queued);
+#endif
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(embedded_pty_suite);
+  GREATEST_MAIN_END();
+}
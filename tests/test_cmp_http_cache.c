@@ -0,0 +1,433 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* clang-format on */
+
+static int file_exists(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    return 0;
+  }
+  fclose(f);
+  return 1;
+}
+
+typedef struct cache_origin {
+  const char *cache_control;
+  const char *body; /* NULL to answer with the URL */
+  char etag[16];
+  int status;
+  int fail;
+  int gets;
+  int conditionals;
+  int not_modified;
+} cache_origin_t;
+
+static int origin_send(void *transport, const struct HttpRequest *req,
+                       struct HttpResponse **out_res) {
+  cache_origin_t *origin = (cache_origin_t *)transport;
+  const char *body = origin->body != NULL ? origin->body : req->url;
+  struct HttpResponse *res;
+  const char *value;
+  char text[32];
+
+  if (origin->fail) {
+    return -1;
+  }
+  res = (struct HttpResponse *)calloc(1, sizeof(struct HttpResponse));
+  if (res == NULL) {
+    return -1;
+  }
+  if (req->method == HTTP_GET) {
+    origin->gets++;
+  }
+  res->status_code = origin->status;
+  if (http_headers_get(&req->headers, "If-None-Match", &value) == 0) {
+    origin->conditionals++;
+    if (strcmp(value, origin->etag) == 0) {
+      res->status_code = 304;
+      origin->not_modified++;
+    }
+  }
+  if (origin->cache_control != NULL) {
+    http_headers_add(&res->headers, "Cache-Control", origin->cache_control);
+  }
+  http_headers_add(&res->headers, "ETag", origin->etag);
+  http_headers_add(&res->headers, "Connection", "keep-alive");
+  if (res->status_code != 304) {
+    sprintf(text, "%lu", (unsigned long)strlen(body));
+    http_headers_add(&res->headers, "Content-Length", text);
+    res->body = malloc(strlen(body) + 1);
+    if (res->body == NULL) {
+      http_response_free(res);
+      return -1;
+    }
+    memcpy(res->body, body, strlen(body));
+    res->body_len = strlen(body);
+  }
+  *out_res = res;
+  return 0;
+}
+
+static void hash_hex(const char *text, char hex[65]) {
+  unsigned char digest[32];
+  cmp_sha256_t sha;
+
+  cmp_sha256_init(&sha);
+  cmp_sha256_update(&sha, text, strlen(text));
+  cmp_sha256_final(&sha, digest);
+  cmp_sha256_hex(digest, hex);
+}
+
+static double cache_now(void *user_data) { return *(double *)user_data; }
+
+static void cache_origin_init(cache_origin_t *origin,
+                              struct HttpClient *client) {
+  memset(origin, 0, sizeof(*origin));
+  strcpy(origin->etag, "\"a1\"");
+  origin->status = 200;
+  memset(client, 0, sizeof(*client));
+  client->transport = origin;
+  client->send = origin_send;
+}
+
+static int cache_get(cmp_http_cache_t *cache, struct HttpClient *client,
+                     const char *url, const char *cache_control,
+                     const char *expect, cmp_http_cache_result_t *result) {
+  struct HttpRequest req;
+  struct HttpResponse *res = NULL;
+  int rc;
+
+  http_request_init(&req);
+  req.method = HTTP_GET;
+  req.url = (char *)url;
+  if (cache_control != NULL) {
+    http_request_set_header(&req, "Cache-Control", cache_control);
+  }
+  rc = cmp_http_cache_send(cache, client, &req, &res, result);
+  req.url = NULL;
+  http_request_free(&req);
+  if (rc == CMP_SUCCESS &&
+      (res->status_code != 200 || res->body_len != strlen(expect) ||
+       memcmp(res->body, expect, res->body_len) != 0)) {
+    rc = CMP_ERROR_GENERAL;
+  }
+  if (res != NULL) {
+    cmp_http_response_free(res);
+  }
+  return rc;
+}
+
+static int cache_age_is(cmp_http_cache_t *cache, struct HttpClient *client,
+                        const char *url, const char *age) {
+  struct HttpRequest req;
+  struct HttpResponse *res = NULL;
+  const char *value;
+  int ok;
+
+  http_request_init(&req);
+  req.method = HTTP_GET;
+  req.url = (char *)url;
+  ok = cmp_http_cache_send(cache, client, &req, &res, NULL) == CMP_SUCCESS &&
+       http_headers_get(&res->headers, "Age", &value) == 0 &&
+       strcmp(value, age) == 0 &&
+       http_headers_get(&res->headers, "Connection", &value) != 0;
+  req.url = NULL;
+  http_request_free(&req);
+  if (res != NULL) {
+    cmp_http_response_free(res);
+  }
+  return ok;
+}
+
+static int cache_post(cmp_http_cache_t *cache, struct HttpClient *client,
+                      const char *url) {
+  struct HttpRequest req;
+  struct HttpResponse *res = NULL;
+  int rc;
+
+  http_request_init(&req);
+  req.method = HTTP_POST;
+  req.url = (char *)url;
+  rc = cmp_http_cache_send(cache, client, &req, &res, NULL);
+  req.url = NULL;
+  http_request_free(&req);
+  if (res != NULL) {
+    cmp_http_response_free(res);
+  }
+  return rc;
+}
+
+static void cache_config(cmp_http_cache_config_t *config, double *clock) {
+  cmp_http_cache_config_init(config);
+  config->directory = "test_http_cache_dir";
+  config->now_s = cache_now;
+  config->now_data = clock;
+}
+
+TEST test_http_cache_freshness(void) {
+  static const char *url = "http://files.test/a";
+  cmp_http_cache_config_t config;
+  cmp_http_cache_stats_t stats;
+  cmp_http_cache_result_t result;
+  cmp_http_cache_t *cache;
+  cache_origin_t origin;
+  struct HttpClient client;
+  double clock = 1.7e9;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_init());
+  cache_origin_init(&origin, &client);
+  origin.cache_control = "max-age=60";
+  cache_config(&config, &clock);
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_open(&config, &cache));
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_clear(cache));
+
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_MISS, result);
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_HIT, result);
+  ASSERT_EQ(1, origin.gets);
+
+  /* Age grows with the clock; hop-by-hop fields are not replayed */
+  clock += 30.0;
+  ASSERT(cache_age_is(cache, &client, url, "30"));
+  ASSERT_EQ(1, origin.gets);
+
+  /* Once stale, a matching ETag is confirmed with a 304 */
+  clock += 31.0;
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_REVALIDATED, result);
+  ASSERT_EQ(1, origin.not_modified);
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_HIT, result);
+
+  /* A request no-cache forces the round trip */
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, url, "no-cache", url, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_REVALIDATED, result);
+
+  /* A changed entity replaces the stored one */
+  clock += 61.0;
+  strcpy(origin.etag, "\"a2\"");
+  origin.body = "changed";
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, url, NULL, "changed", &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_MISS, result);
+  ASSERT_EQ(3, origin.conditionals);
+
+  /* Entries survive reopening */
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_close(cache));
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_open(&config, &cache));
+  origin.gets = 0;
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, url, NULL, "changed", &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_HIT, result);
+  ASSERT_EQ(0, origin.gets);
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_get_stats(cache, &stats));
+  ASSERT_EQ(1, stats.entries);
+  ASSERT_EQ(7, stats.bytes);
+
+  /* Unsafe methods invalidate; no-store responses are not kept */
+  ASSERT_EQ(CMP_SUCCESS, cache_post(cache, &client, url));
+  origin.cache_control = "no-store";
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, url, NULL, "changed", &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_MISS, result);
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, url, NULL, "changed", &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_MISS, result);
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_get_stats(cache, &stats));
+  ASSERT_EQ(0, stats.entries);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_close(cache));
+  cmp_vfs_shutdown();
+  PASS();
+}
+
+TEST test_http_cache_stale(void) {
+  static const char *url = "http://files.test/s";
+  static const char *strict = "http://files.test/strict";
+  cmp_http_cache_config_t config;
+  cmp_http_cache_stats_t stats;
+  cmp_http_cache_result_t result;
+  cmp_http_cache_t *cache;
+  cache_origin_t origin;
+  struct HttpClient client;
+  double clock = 1.7e9;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_init());
+  cache_origin_init(&origin, &client);
+  cache_config(&config, &clock);
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_open(&config, &cache));
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_clear(cache));
+
+  /* stale-while-revalidate answers at once and refreshes later */
+  origin.cache_control = "max-age=10, stale-while-revalidate=30";
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  clock += 20.0;
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_STALE, result);
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  ASSERT_EQ(1, origin.gets);
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_get_stats(cache, &stats));
+  ASSERT_EQ(1, stats.pending);
+  ASSERT_EQ(1, cmp_http_cache_revalidate(cache, &client, 0));
+  ASSERT_EQ(1, origin.not_modified);
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_HIT, result);
+  ASSERT_EQ(0, cmp_http_cache_revalidate(cache, &client, 0));
+
+  /* Offline serves whatever is stored and never reaches the origin */
+  clock += 100.0;
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_http_cache_set_mode(cache, CMP_HTTP_CACHE_OFFLINE));
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_STALE, result);
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND,
+            cache_get(cache, &client, strict, NULL, strict, &result));
+  ASSERT_EQ(2, origin.gets);
+
+  /* Low-data mode serves stale entries but still fetches misses */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_http_cache_set_mode(cache, CMP_HTTP_CACHE_LOW_DATA));
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_STALE, result);
+  origin.cache_control = "max-age=10, must-revalidate";
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, strict, NULL, strict, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_MISS, result);
+
+  /* must-revalidate entries are never served stale */
+  clock += 20.0;
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_http_cache_set_mode(cache, CMP_HTTP_CACHE_OFFLINE));
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND,
+            cache_get(cache, &client, strict, NULL, strict, &result));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_http_cache_set_mode(cache, CMP_HTTP_CACHE_ONLINE));
+  origin.fail = 1;
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND,
+            cache_get(cache, &client, strict, NULL, strict, &result));
+
+  /* stale-if-error covers an unreachable or failing origin */
+  origin.fail = 0;
+  origin.cache_control = "max-age=10, stale-if-error=600";
+  strcpy(origin.etag, "\"b1\"");
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_MISS, result);
+  clock += 60.0;
+  origin.fail = 1;
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_STALE, result);
+  origin.fail = 0;
+  origin.status = 503;
+  strcpy(origin.etag, "\"b2\"");
+  ASSERT_EQ(CMP_SUCCESS, cache_get(cache, &client, url, NULL, url, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_STALE, result);
+  clock += 600.0;
+  ASSERT_EQ(CMP_ERROR_GENERAL,
+            cache_get(cache, &client, url, NULL, url, &result));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_get_stats(cache, &stats));
+  ASSERT_EQ(6, stats.stale);
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_clear(cache));
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_close(cache));
+  cmp_vfs_shutdown();
+  PASS();
+}
+
+TEST test_http_cache_eviction(void) {
+  static const char *urls[] = {"http://files.test/0", "http://files.test/1",
+                               "http://files.test/2", "http://files.test/3"};
+  cmp_http_cache_config_t config;
+  cmp_http_cache_stats_t stats;
+  cmp_http_cache_result_t result;
+  cmp_http_cache_t *cache;
+  cache_origin_t origin;
+  struct HttpClient client;
+  cmp_string_t dir;
+  char blob[512], hex[65];
+  double clock = 1.7e9;
+  int i;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_init());
+  cache_origin_init(&origin, &client);
+  origin.cache_control = "max-age=600";
+  cache_config(&config, &clock);
+  config.max_entries = 3;
+  config.max_bytes = 4096;
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_open(&config, &cache));
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_clear(cache));
+
+  /* The least recently used entry goes first */
+  for (i = 0; i < 3; ++i) {
+    ASSERT_EQ(CMP_SUCCESS,
+              cache_get(cache, &client, urls[i], NULL, urls[i], &result));
+  }
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, urls[0], NULL, urls[0], &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_HIT, result);
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, urls[3], NULL, urls[3], &result));
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, urls[0], NULL, urls[0], &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_HIT, result);
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, urls[1], NULL, urls[1], &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_MISS, result);
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_get_stats(cache, &stats));
+  ASSERT_EQ(2, stats.evictions);
+  ASSERT_EQ(3, stats.entries);
+
+  /* Identical bodies share one file, kept while any entry uses it */
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_clear(cache));
+  origin.body = "shared body";
+  hash_hex("shared body", hex);
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_resolve_path(config.directory, &dir));
+  sprintf(blob, "%s/b/%s", dir.data, hex);
+  cmp_string_destroy(&dir);
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, urls[0], NULL, "shared body", NULL));
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, urls[1], NULL, "shared body", NULL));
+  ASSERT(file_exists(blob));
+  ASSERT_EQ(CMP_SUCCESS, cache_post(cache, &client, urls[0]));
+  ASSERT(file_exists(blob));
+  ASSERT_EQ(CMP_SUCCESS, cache_post(cache, &client, urls[1]));
+  ASSERT(!file_exists(blob));
+
+  /* Bodies over a quarter of the byte budget pass through */
+  memset(blob, 'x', sizeof(blob) - 1);
+  blob[sizeof(blob) - 1] = '\0';
+  origin.body = blob;
+  config.max_bytes = 1024;
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_close(cache));
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_open(&config, &cache));
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, urls[2], NULL, blob, &result));
+  ASSERT_EQ(CMP_SUCCESS,
+            cache_get(cache, &client, urls[2], NULL, blob, &result));
+  ASSERT_EQ(CMP_HTTP_CACHE_MISS, result);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_clear(cache));
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_cache_close(cache));
+  cmp_vfs_shutdown();
+  PASS();
+}
+
+SUITE(http_cache_suite) {
+  RUN_TEST(test_http_cache_freshness);
+  RUN_TEST(test_http_cache_stale);
+  RUN_TEST(test_http_cache_eviction);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(http_cache_suite);
+  GREATEST_MAIN_END();
+}
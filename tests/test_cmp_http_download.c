@@ -0,0 +1,438 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* clang-format on */
+
+static double test_now(void *user_data) { return *(double *)user_data; }
+
+/* In-process file server for downloads: answers HEAD, Range and If-Range
+ * and streams bodies through on_chunk in 16 KiB pieces */
+typedef struct range_server {
+  cmp_mutex_t lock;
+  unsigned char *body;
+  size_t len;
+  char etag[16];
+  int accept_ranges;
+  int buffered; /* Return the body whole instead of streaming it */
+  int heads;
+  int gets;
+  int partials;
+  int connections;
+  int closed;
+  int serving; /* Connections that served a range */
+  long spin;
+  double *clock; /* Advanced 10 ms per chunk when set */
+} range_server_t;
+
+typedef struct range_conn {
+  range_server_t *server;
+  int served;
+} range_conn_t;
+
+static int range_send(void *transport, const struct HttpRequest *req,
+                      struct HttpResponse **out_res) {
+  range_conn_t *conn = (range_conn_t *)transport;
+  range_server_t *server = conn->server;
+  struct HttpResponse *res;
+  const char *value, *if_range;
+  unsigned long first, last;
+  size_t start = 0, end = server->len, pos, n;
+  char text[64];
+  int partial = 0;
+  volatile long i;
+
+  res = (struct HttpResponse *)calloc(1, sizeof(struct HttpResponse));
+  if (res == NULL) {
+    return -1;
+  }
+  cmp_mutex_lock(&server->lock);
+  if (req->method == HTTP_HEAD) {
+    server->heads++;
+  } else {
+    server->gets++;
+  }
+  if (req->method == HTTP_GET && server->accept_ranges &&
+      http_headers_get(&req->headers, "Range", &value) == 0 &&
+      (http_headers_get(&req->headers, "If-Range", &if_range) != 0 ||
+       strcmp(if_range, server->etag) == 0) &&
+      sscanf(value, "bytes=%lu-%lu", &first, &last) == 2) {
+    start = first;
+    end = last + 1 < server->len ? last + 1 : server->len;
+    partial = 1;
+    server->partials++;
+    if (!conn->served) {
+      conn->served = 1;
+      server->serving++;
+    }
+  }
+  cmp_mutex_unlock(&server->lock);
+
+  res->status_code = partial ? 206 : 200;
+  sprintf(text, "%lu", (unsigned long)(end - start));
+  http_headers_add(&res->headers, "Content-Length", text);
+  http_headers_add(&res->headers, "ETag", server->etag);
+  if (server->accept_ranges) {
+    http_headers_add(&res->headers, "Accept-Ranges", "bytes");
+  }
+  if (partial) {
+    sprintf(text, "bytes %lu-%lu/%lu", (unsigned long)start,
+            (unsigned long)end - 1, (unsigned long)server->len);
+    http_headers_add(&res->headers, "Content-Range", text);
+  }
+  if (req->method == HTTP_GET && server->buffered) {
+    res->body = malloc(end - start);
+    if (res->body == NULL) {
+      http_response_free(res);
+      return -1;
+    }
+    memcpy(res->body, server->body + start, end - start);
+    res->body_len = end - start;
+  } else if (req->method == HTTP_GET) {
+    for (pos = start; pos < end; pos += n) {
+      n = end - pos < 16384 ? end - pos : 16384;
+      for (i = 0; i < server->spin; ++i) {
+      }
+      if (server->clock != NULL) {
+        *server->clock += 10.0;
+      }
+      if (req->on_chunk(req->on_chunk_user_data, server->body + pos, n) !=
+          0) {
+        http_response_free(res);
+        return -1;
+      }
+    }
+  }
+  *out_res = res;
+  return 0;
+}
+
+static int range_connect(const char *origin, struct HttpClient **out_client,
+                         void *user_data) {
+  range_server_t *server = (range_server_t *)user_data;
+  struct HttpClient *client;
+  range_conn_t *conn;
+
+  if (strcmp(origin, "http://files.test") != 0 ||
+      CMP_MALLOC(sizeof(struct HttpClient), (void **)&client) !=
+          CMP_SUCCESS) {
+    return CMP_ERROR_NOT_FOUND;
+  }
+  if (CMP_MALLOC(sizeof(range_conn_t), (void **)&conn) != CMP_SUCCESS) {
+    CMP_FREE(client);
+    return CMP_ERROR_OOM;
+  }
+  memset(client, 0, sizeof(struct HttpClient));
+  conn->server = server;
+  conn->served = 0;
+  client->transport = conn;
+  client->send = range_send;
+  cmp_mutex_lock(&server->lock);
+  server->connections++;
+  cmp_mutex_unlock(&server->lock);
+  *out_client = client;
+  return CMP_SUCCESS;
+}
+
+static void range_disconnect(struct HttpClient *client, void *user_data) {
+  range_server_t *server = (range_server_t *)user_data;
+  cmp_mutex_lock(&server->lock);
+  server->closed++;
+  cmp_mutex_unlock(&server->lock);
+  CMP_FREE(client->transport);
+  CMP_FREE(client);
+}
+
+static void range_server_init(range_server_t *server, size_t len,
+                              unsigned long seed) {
+  size_t i;
+
+  memset(server, 0, sizeof(*server));
+  cmp_mutex_init(&server->lock);
+  server->body = (unsigned char *)malloc(len);
+  server->len = len;
+  strcpy(server->etag, "\"v1\"");
+  server->accept_ranges = 1;
+  for (i = 0; server->body != NULL && i < len; ++i) {
+    seed = seed * 1103515245UL + 12345UL;
+    server->body[i] = (unsigned char)(seed >> 16);
+  }
+}
+
+static void range_body_sha256(const range_server_t *server, char hex[65]) {
+  unsigned char digest[32];
+  cmp_sha256_t sha;
+
+  cmp_sha256_init(&sha);
+  cmp_sha256_update(&sha, server->body, server->len);
+  cmp_sha256_final(&sha, digest);
+  cmp_sha256_hex(digest, hex);
+}
+
+static int file_matches(const char *path, const unsigned char *data,
+                        size_t len) {
+  unsigned char buf[4096];
+  size_t pos = 0, n;
+  FILE *f = fopen(path, "rb");
+  int same = f != NULL;
+
+  while (same && (n = fread(buf, 1, sizeof(buf), f)) > 0) {
+    same = pos + n <= len && memcmp(buf, data + pos, n) == 0;
+    pos += n;
+  }
+  if (f != NULL) {
+    fclose(f);
+  }
+  return same && pos == len;
+}
+
+static int file_exists(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (f == NULL) {
+    return 0;
+  }
+  fclose(f);
+  return 1;
+}
+
+typedef struct progress_log {
+  int calls;
+  int monotonic;
+  float last;
+  float abort_at; /* Abort once reached, 0 never */
+} progress_log_t;
+
+static int record_progress(float percentage, void *user_data) {
+  progress_log_t *log = (progress_log_t *)user_data;
+  log->calls++;
+  if (percentage < log->last || percentage > 100.0f) {
+    log->monotonic = 0;
+  }
+  log->last = percentage;
+  return log->abort_at > 0.0f && percentage >= log->abort_at;
+}
+
+static void progress_log_init(progress_log_t *log, float abort_at) {
+  memset(log, 0, sizeof(*log));
+  log->monotonic = 1;
+  log->abort_at = abort_at;
+}
+
+static void range_client(range_server_t *server, struct HttpClient *client,
+                         range_conn_t *conn) {
+  memset(client, 0, sizeof(*client));
+  conn->server = server;
+  conn->served = 0;
+  client->transport = conn;
+  client->send = range_send;
+}
+
+TEST test_http_download_parallel(void) {
+  static const char *path = "test_http_download_parallel.bin";
+  range_server_t server;
+  range_conn_t conn;
+  struct HttpClient client;
+  cmp_http_download_config_t config;
+  cmp_http_download_stats_t stats;
+  progress_log_t log;
+  char sha[65];
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_init());
+  range_server_init(&server, 1024 * 1024 + 123, 7);
+  ASSERT(server.body != NULL);
+  server.spin = 50000;
+  range_body_sha256(&server, sha);
+  range_client(&server, &client, &conn);
+  progress_log_init(&log, 0.0f);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_download_config_init(&config));
+  config.range_size = 64 * 1024;
+  config.progress_interval_ms = 0.0;
+  config.sha256 = sha;
+  config.connect = range_connect;
+  config.disconnect = range_disconnect;
+  config.connect_data = &server;
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_http_download_ex(&client, "http://files.test/big.bin", path,
+                                 &config, record_progress, &log, &stats));
+
+  ASSERT(file_matches(path, server.body, server.len));
+  ASSERT(!file_exists("test_http_download_parallel.bin.cmpdl"));
+  ASSERT_EQ(server.len, stats.total);
+  ASSERT_EQ(server.len, stats.fetched);
+  ASSERT_EQ(17, stats.ranges);
+  ASSERT_EQ(17, stats.requests);
+  ASSERT_EQ(0, stats.retries);
+  ASSERT_EQ(1, server.heads);
+  ASSERT_EQ(17, server.partials);
+  /* Three extra connections, all closed, and more than one busy */
+  ASSERT_EQ(3, stats.connections);
+  ASSERT_EQ(3, server.connections);
+  ASSERT_EQ(3, server.closed);
+  ASSERT(server.serving >= 2);
+  ASSERT(log.monotonic);
+  ASSERT_EQ(stats.progress_calls, (size_t)log.calls);
+  ASSERT(log.calls >= 2);
+  ASSERT(log.last == 100.0f);
+
+  /* The plain entry point; extra connections come from c-abstract-http,
+   * which cannot reach this server, so stream instead */
+  server.accept_ranges = 0;
+  progress_log_init(&log, 0.0f);
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_download(&client, "http://files.test/a",
+                                           path, record_progress, &log));
+  ASSERT(file_matches(path, server.body, server.len));
+  ASSERT(log.last == 100.0f);
+
+  remove(path);
+  free(server.body);
+  cmp_mutex_destroy(&server.lock);
+  cmp_vfs_shutdown();
+  PASS();
+}
+
+TEST test_http_download_resume(void) {
+  static const char *path = "test_http_download_resume.bin";
+  static const char *manifest = "test_http_download_resume.bin.cmpdl";
+  range_server_t server;
+  range_conn_t conn;
+  struct HttpClient client;
+  cmp_http_download_config_t config;
+  cmp_http_download_stats_t stats;
+  progress_log_t log;
+  double now = 0.0;
+  char sha[65];
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_init());
+  range_server_init(&server, 1024 * 1024, 11);
+  ASSERT(server.body != NULL);
+  server.clock = &now;
+  range_body_sha256(&server, sha);
+  range_client(&server, &client, &conn);
+  remove(manifest);
+
+  /* One connection, so the clock and progress are deterministic */
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_download_config_init(&config));
+  config.parallel = 1;
+  config.range_size = 64 * 1024;
+  config.progress_interval_ms = 50.0;
+  config.sha256 = sha;
+  config.now_ms = test_now;
+  config.now_data = &now;
+  progress_log_init(&log, 40.0f);
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE,
+            cmp_http_download_ex(&client, "http://files.test/big.bin", path,
+                                 &config, record_progress, &log, &stats));
+  ASSERT(log.last >= 40.0f && log.last < 50.0f);
+  ASSERT(file_exists(manifest));
+  /* Only whole ranges survive an abort */
+  ASSERT(stats.fetched > 6 * 64 * 1024);
+
+  /* The second call fetches only what is missing */
+  progress_log_init(&log, 0.0f);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_http_download_ex(&client, "http://files.test/big.bin", path,
+                                 &config, record_progress, &log, &stats));
+  ASSERT(file_matches(path, server.body, server.len));
+  ASSERT(!file_exists(manifest));
+  ASSERT(stats.resumed >= 6 * 64 * 1024);
+  ASSERT_EQ(0, stats.resumed % (64 * 1024));
+  ASSERT_EQ(server.len - stats.resumed, stats.fetched);
+  ASSERT_EQ(stats.fetched / (64 * 1024), stats.requests);
+  ASSERT_EQ(0, stats.connections);
+  ASSERT(log.monotonic);
+  ASSERT(log.last == 100.0f);
+  /* A report per 50 ms of 10 ms chunks, and the final 100 */
+  ASSERT(log.calls >= 2);
+  ASSERT((size_t)log.calls <= stats.fetched / 16384 / 5 + 2);
+
+  remove(path);
+  free(server.body);
+  cmp_mutex_destroy(&server.lock);
+  cmp_vfs_shutdown();
+  PASS();
+}
+
+TEST test_http_download_validation(void) {
+  static const char *path = "test_http_download_validation.bin";
+  static const char *manifest = "test_http_download_validation.bin.cmpdl";
+  range_server_t server;
+  range_conn_t conn;
+  struct HttpClient client;
+  cmp_http_download_config_t config;
+  cmp_http_download_stats_t stats;
+  progress_log_t log;
+  char sha[65];
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_init());
+  range_server_init(&server, 300 * 1000, 3);
+  ASSERT(server.body != NULL);
+  range_client(&server, &client, &conn);
+  remove(manifest);
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_download_config_init(&config));
+  config.parallel = 1;
+  config.range_size = 32 * 1024;
+  config.progress_interval_ms = 0.0;
+
+  /* A wrong digest fails and leaves nothing to resume */
+  config.sha256 =
+      "0000000000000000000000000000000000000000000000000000000000000000";
+  ASSERT_EQ(CMP_ERROR_IO,
+            cmp_http_download_ex(&client, "http://files.test/f", path,
+                                 &config, NULL, NULL, &stats));
+  ASSERT(!file_exists(manifest));
+
+  /* A changed entity restarts instead of splicing old and new bytes */
+  config.sha256 = NULL;
+  progress_log_init(&log, 50.0f);
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE,
+            cmp_http_download_ex(&client, "http://files.test/f", path,
+                                 &config, record_progress, &log, &stats));
+  ASSERT(file_exists(manifest));
+  server.body[server.len - 1] ^= 0xff;
+  strcpy(server.etag, "\"v2\"");
+  range_body_sha256(&server, sha);
+  config.sha256 = sha;
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_http_download_ex(&client, "http://files.test/f", path,
+                                 &config, NULL, NULL, &stats));
+  ASSERT_EQ(0, stats.resumed);
+  ASSERT(file_matches(path, server.body, server.len));
+  ASSERT(!file_exists(manifest));
+
+  /* Without range support the body streams in one GET */
+  server.accept_ranges = 0;
+  server.buffered = 1;
+  progress_log_init(&log, 0.0f);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_http_download_ex(&client, "http://files.test/f", path,
+                                 &config, record_progress, &log, &stats));
+  ASSERT(file_matches(path, server.body, server.len));
+  ASSERT_EQ(0, stats.ranges);
+  ASSERT_EQ(1, stats.requests);
+  ASSERT_EQ(server.len, stats.total);
+  ASSERT(log.last == 100.0f);
+  ASSERT(!file_exists(manifest));
+
+  remove(path);
+  free(server.body);
+  cmp_mutex_destroy(&server.lock);
+  cmp_vfs_shutdown();
+  PASS();
+}
+
+SUITE(http_download_suite) {
+  RUN_TEST(test_http_download_parallel);
+  RUN_TEST(test_http_download_resume);
+  RUN_TEST(test_http_download_validation);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(http_download_suite);
+  GREATEST_MAIN_END();
+}
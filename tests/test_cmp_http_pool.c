@@ -0,0 +1,539 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_WIN32)
+__declspec(dllimport) void __stdcall Sleep(unsigned long dwMilliseconds);
+#else
+#include <unistd.h>
+#endif
+/* clang-format on */
+
+/* In-process loopback server: every connection the pool opens is a
+ * transport whose send is served here, so reuse and concurrency can be
+ * observed without sockets */
+typedef struct loopback_server {
+  cmp_mutex_t lock;
+  int connections;
+  int closed;
+  int requests;
+  int active[2];
+  int max_active[2];
+  int total_active;
+  int max_total_active;
+  int fail_reused; /* Fail the next send on a used connection */
+  long spin;
+  char served[16][32];
+  int served_count;
+} loopback_server_t;
+
+typedef struct loopback_conn {
+  loopback_server_t *server;
+  int origin;
+  int sends;
+} loopback_conn_t;
+
+static int loopback_send(void *transport, const struct HttpRequest *req,
+                         struct HttpResponse **out_res) {
+  loopback_conn_t *conn = (loopback_conn_t *)transport;
+  loopback_server_t *server = conn->server;
+  struct HttpResponse *res;
+  const char *path;
+  volatile long i;
+  int fail = 0;
+
+  cmp_mutex_lock(&server->lock);
+  server->requests++;
+  if (++server->active[conn->origin] > server->max_active[conn->origin]) {
+    server->max_active[conn->origin] = server->active[conn->origin];
+  }
+  if (++server->total_active > server->max_total_active) {
+    server->max_total_active = server->total_active;
+  }
+  if (server->fail_reused && conn->sends > 0) {
+    server->fail_reused = 0;
+    fail = 1;
+  }
+  path = strstr(req->url, ".test");
+  path = path != NULL ? strchr(path, '/') : NULL;
+  if (path != NULL && server->served_count < 16) {
+    strncpy(server->served[server->served_count], path, 31);
+    server->served[server->served_count++][31] = '\0';
+  }
+  cmp_mutex_unlock(&server->lock);
+
+  for (i = 0; i < server->spin; ++i) {
+  }
+
+  cmp_mutex_lock(&server->lock);
+  server->active[conn->origin]--;
+  server->total_active--;
+  cmp_mutex_unlock(&server->lock);
+  conn->sends++;
+  if (fail) {
+    return -1;
+  }
+  res = (struct HttpResponse *)calloc(1, sizeof(struct HttpResponse));
+  if (res == NULL) {
+    return -1;
+  }
+  res->status_code = req->method == HTTP_POST ? 201 : 200;
+  *out_res = res;
+  return 0;
+}
+
+static int loopback_connect(const char *origin, struct HttpClient **out_client,
+                            void *user_data) {
+  loopback_server_t *server = (loopback_server_t *)user_data;
+  struct HttpClient *client;
+  loopback_conn_t *conn;
+
+  if (CMP_MALLOC(sizeof(struct HttpClient), (void **)&client) !=
+      CMP_SUCCESS) {
+    return CMP_ERROR_OOM;
+  }
+  if (CMP_MALLOC(sizeof(loopback_conn_t), (void **)&conn) != CMP_SUCCESS) {
+    CMP_FREE(client);
+    return CMP_ERROR_OOM;
+  }
+  memset(client, 0, sizeof(struct HttpClient));
+  conn->server = server;
+  conn->origin = strstr(origin, "b.test") != NULL;
+  conn->sends = 0;
+  client->transport = conn;
+  client->send = loopback_send;
+  server->connections++;
+  *out_client = client;
+  return CMP_SUCCESS;
+}
+
+static void loopback_disconnect(struct HttpClient *client, void *user_data) {
+  loopback_server_t *server = (loopback_server_t *)user_data;
+  cmp_mutex_lock(&server->lock);
+  server->closed++;
+  cmp_mutex_unlock(&server->lock);
+  CMP_FREE(client->transport);
+  CMP_FREE(client);
+}
+
+static double test_now(void *user_data) { return *(double *)user_data; }
+
+typedef struct fetch_log {
+  int calls;
+  int failures;
+  int last_status;
+} fetch_log_t;
+
+static void on_fetched(int result, const struct HttpResponse *response,
+                       void *user_data) {
+  fetch_log_t *log = (fetch_log_t *)user_data;
+  log->calls++;
+  if (result != CMP_SUCCESS) {
+    log->failures++;
+    log->last_status = 0;
+  } else {
+    log->last_status = response->status_code;
+  }
+}
+
+static cmp_http_pool_t *make_pool(loopback_server_t *server, double *clock,
+                                  size_t max_per_origin, size_t max_total) {
+  cmp_http_pool_config_t config;
+  cmp_http_pool_t *pool = NULL;
+
+  memset(server, 0, sizeof(loopback_server_t));
+  cmp_mutex_init(&server->lock);
+  cmp_http_pool_config_init(&config);
+  config.max_per_origin = max_per_origin;
+  config.max_total = max_total;
+  config.keep_alive_ms = 1000.0;
+  if (clock != NULL) {
+    config.now_ms = test_now;
+    config.now_data = clock;
+  }
+  if (cmp_http_pool_create(&config, &pool) != CMP_SUCCESS) {
+    return NULL;
+  }
+  cmp_http_pool_set_connector(pool, loopback_connect, loopback_disconnect,
+                              server);
+  return pool;
+}
+
+static int submit_get(cmp_http_pool_t *pool, const char *url,
+                      cmp_http_priority_t priority, fetch_log_t *log,
+                      size_t *out_ticket) {
+  struct HttpRequest req;
+  int res;
+
+  cmp_http_request_init(&req);
+  req.method = HTTP_GET;
+  req.url = (char *)url;
+  res = cmp_http_pool_submit(pool, &req, priority, on_fetched, log,
+                             out_ticket);
+  req.url = NULL;
+  cmp_http_request_free(&req);
+  return res;
+}
+
+TEST test_http_pool_keep_alive(void) {
+  loopback_server_t server;
+  cmp_http_pool_stats_t stats;
+  cmp_http_pool_t *pool;
+  fetch_log_t log;
+  double now = 0.0;
+  char url[64];
+  int i;
+
+  pool = make_pool(&server, &now, 6, 16);
+  ASSERT(pool != NULL);
+  memset(&log, 0, sizeof(log));
+
+  /* Sequential requests to one origin share a single connection, however
+   * the origin is spelled */
+  for (i = 0; i < 5; ++i) {
+    sprintf(url, "http://a.test/img/%d.png", i);
+    ASSERT_EQ(CMP_SUCCESS,
+              submit_get(pool, url, CMP_HTTP_PRIORITY_NORMAL, &log, NULL));
+  }
+  ASSERT_EQ(CMP_SUCCESS, submit_get(pool, "HTTP://A.test:80/x",
+                                    CMP_HTTP_PRIORITY_NORMAL, &log, NULL));
+  ASSERT_EQ(CMP_SUCCESS, submit_get(pool, "http://user@a.test?q=1",
+                                    CMP_HTTP_PRIORITY_NORMAL, &log, NULL));
+  ASSERT_EQ(0, server.requests); /* Nothing runs before the poll */
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_pool_poll(pool));
+  ASSERT_EQ(7, log.calls);
+  ASSERT_EQ(200, log.last_status);
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT_EQ(1, stats.connections_opened);
+  ASSERT_EQ(6, stats.pool_hits);
+  ASSERT_EQ(7, stats.completed);
+  ASSERT_EQ(1, stats.idle_connections);
+
+  /* Another scheme is another origin */
+  submit_get(pool, "https://a.test/z", CMP_HTTP_PRIORITY_NORMAL, &log, NULL);
+  cmp_http_pool_poll(pool);
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT_EQ(2, stats.connections_opened);
+  ASSERT_EQ(2, stats.idle_connections);
+
+  /* Idle connections close after keep_alive_ms */
+  now = 999.0;
+  cmp_http_pool_poll(pool);
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT_EQ(2, stats.idle_connections);
+  now = 2000.0;
+  cmp_http_pool_poll(pool);
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT_EQ(0, stats.idle_connections);
+  ASSERT_EQ(2, server.closed);
+  submit_get(pool, "http://a.test/again", CMP_HTTP_PRIORITY_NORMAL, &log,
+             NULL);
+  cmp_http_pool_poll(pool);
+  ASSERT_EQ(3, server.connections);
+
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            submit_get(pool, "a.test/relative", CMP_HTTP_PRIORITY_NORMAL,
+                       &log, NULL));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            submit_get(pool, "http://a.test/", CMP_HTTP_PRIORITY_COUNT, &log,
+                       NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_pool_destroy(pool));
+  ASSERT_EQ(server.connections, server.closed);
+  cmp_mutex_destroy(&server.lock);
+  PASS();
+}
+
+TEST test_http_pool_default_clock(void) {
+  loopback_server_t server;
+  cmp_http_pool_config_t config;
+  cmp_http_pool_stats_t stats;
+  cmp_http_pool_t *pool = NULL;
+  fetch_log_t log;
+
+  /* Without now_ms the pool keeps wall time: a sleeping process still
+   * expires its idle connections */
+  memset(&server, 0, sizeof(server));
+  memset(&log, 0, sizeof(log));
+  cmp_mutex_init(&server.lock);
+  cmp_http_pool_config_init(&config);
+  config.keep_alive_ms = 50.0;
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_pool_create(&config, &pool));
+  cmp_http_pool_set_connector(pool, loopback_connect, loopback_disconnect,
+                              &server);
+  submit_get(pool, "http://a.test/", CMP_HTTP_PRIORITY_NORMAL, &log, NULL);
+  cmp_http_pool_poll(pool);
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT_EQ(1, stats.idle_connections);
+#if defined(_WIN32)
+  Sleep(150);
+#else
+  usleep(150000);
+#endif
+  cmp_http_pool_poll(pool);
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT_EQ(0, stats.idle_connections);
+  ASSERT_EQ(1, server.closed);
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_pool_destroy(pool));
+  cmp_mutex_destroy(&server.lock);
+  PASS();
+}
+
+TEST test_http_pool_priority(void) {
+  loopback_server_t server;
+  cmp_http_pool_stats_t stats;
+  cmp_http_pool_t *pool;
+  fetch_log_t log;
+  size_t prefetch, api, hero;
+  double now = 0.0;
+
+  pool = make_pool(&server, &now, 6, 1);
+  ASSERT(pool != NULL);
+  memset(&log, 0, sizeof(log));
+  submit_get(pool, "http://a.test/prefetch", CMP_HTTP_PRIORITY_LOW, &log,
+             &prefetch);
+  submit_get(pool, "http://a.test/api", CMP_HTTP_PRIORITY_NORMAL, &log, &api);
+  submit_get(pool, "http://b.test/hero", CMP_HTTP_PRIORITY_VISIBLE, &log,
+             &hero);
+  submit_get(pool, "http://a.test/thumb", CMP_HTTP_PRIORITY_VISIBLE, &log,
+             NULL);
+
+  /* The prefetched image scrolled into view; the api call is abandoned */
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_pool_set_priority(
+                             pool, prefetch, CMP_HTTP_PRIORITY_VISIBLE));
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_pool_cancel(pool, api));
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND, cmp_http_pool_cancel(pool, api));
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT_EQ(3, stats.queued);
+
+  now = 10.0;
+  cmp_http_pool_poll(pool);
+  ASSERT_EQ(3, log.calls);
+  ASSERT_EQ(3, server.served_count);
+  ASSERT_STR_EQ("/hero", server.served[0]);
+  ASSERT_STR_EQ("/thumb", server.served[1]);
+  ASSERT_STR_EQ("/prefetch", server.served[2]);
+  ASSERT_EQ(1, server.max_total_active);
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND, cmp_http_pool_set_priority(
+                                     pool, hero, CMP_HTTP_PRIORITY_LOW));
+
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT_EQ(4, stats.requests);
+  ASSERT_EQ(1, stats.cancelled);
+  ASSERT_EQ(3, stats.dispatched);
+  ASSERT_EQ(0, stats.queued);
+  ASSERT_EQ(3, stats.completed);
+
+  cmp_http_pool_destroy(pool);
+  cmp_mutex_destroy(&server.lock);
+  PASS();
+}
+
+TEST test_http_pool_coalescing(void) {
+  loopback_server_t server;
+  cmp_http_pool_stats_t stats;
+  cmp_http_pool_t *pool;
+  struct HttpRequest post;
+  fetch_log_t a, b, c, d;
+  size_t ticket_b;
+  char body[] = "{}";
+
+  pool = make_pool(&server, NULL, 6, 16);
+  ASSERT(pool != NULL);
+  memset(&a, 0, sizeof(a));
+  memset(&b, 0, sizeof(b));
+  memset(&c, 0, sizeof(c));
+  memset(&d, 0, sizeof(d));
+  submit_get(pool, "http://a.test/logo.png", CMP_HTTP_PRIORITY_LOW, &a, NULL);
+  submit_get(pool, "http://a.test/logo.png", CMP_HTTP_PRIORITY_NORMAL, &b,
+             &ticket_b);
+  submit_get(pool, "http://a.test/logo.png", CMP_HTTP_PRIORITY_VISIBLE, &c,
+             NULL);
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_pool_cancel(pool, ticket_b));
+
+  /* Writes are never shared */
+  cmp_http_request_init(&post);
+  post.method = HTTP_POST;
+  post.url = (char *)"http://a.test/logo.png";
+  post.body = body;
+  post.body_len = 2;
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_pool_submit(pool, &post,
+                                              CMP_HTTP_PRIORITY_NORMAL,
+                                              on_fetched, &d, NULL));
+  post.url = NULL;
+  post.body = NULL;
+  post.body_len = 0;
+  cmp_http_request_free(&post);
+
+  cmp_http_pool_poll(pool);
+  ASSERT_EQ(2, server.requests);
+  ASSERT_EQ(1, a.calls);
+  ASSERT_EQ(0, b.calls);
+  ASSERT_EQ(1, c.calls);
+  ASSERT_EQ(200, c.last_status);
+  ASSERT_EQ(1, d.calls);
+  ASSERT_EQ(201, d.last_status);
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT_EQ(2, stats.coalesced);
+  ASSERT_EQ(2, stats.dispatched);
+
+  cmp_http_pool_destroy(pool);
+  cmp_mutex_destroy(&server.lock);
+  PASS();
+}
+
+TEST test_http_pool_stale_retry(void) {
+  loopback_server_t server;
+  cmp_http_pool_stats_t stats;
+  cmp_http_pool_t *pool;
+  struct HttpRequest post;
+  fetch_log_t log, post_log;
+
+  pool = make_pool(&server, NULL, 6, 16);
+  ASSERT(pool != NULL);
+  memset(&log, 0, sizeof(log));
+  memset(&post_log, 0, sizeof(post_log));
+  submit_get(pool, "http://a.test/1", CMP_HTTP_PRIORITY_NORMAL, &log, NULL);
+  cmp_http_pool_poll(pool);
+
+  /* The kept-alive connection went away: the GET is resent once */
+  server.fail_reused = 1;
+  submit_get(pool, "http://a.test/2", CMP_HTTP_PRIORITY_NORMAL, &log, NULL);
+  cmp_http_pool_poll(pool);
+  ASSERT_EQ(2, log.calls);
+  ASSERT_EQ(0, log.failures);
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT_EQ(1, stats.retries);
+  ASSERT_EQ(2, stats.connections_opened);
+  ASSERT_EQ(1, stats.connections_closed);
+
+  /* A POST may have been applied, so it fails instead */
+  server.fail_reused = 1;
+  cmp_http_request_init(&post);
+  post.method = HTTP_POST;
+  post.url = (char *)"http://a.test/orders";
+  cmp_http_pool_submit(pool, &post, CMP_HTTP_PRIORITY_HIGH, on_fetched,
+                       &post_log, NULL);
+  post.url = NULL;
+  cmp_http_request_free(&post);
+  cmp_http_pool_poll(pool);
+  ASSERT_EQ(1, post_log.calls);
+  ASSERT_EQ(1, post_log.failures);
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT_EQ(1, stats.retries);
+  ASSERT_EQ(1, stats.failed);
+
+  cmp_http_pool_destroy(pool);
+  cmp_mutex_destroy(&server.lock);
+  PASS();
+}
+
+typedef struct pool_wait {
+  cmp_modality_t *ui;
+  cmp_http_pool_t *pool;
+  loopback_server_t *server;
+  clock_t deadline;
+} pool_wait_t;
+
+static void pool_wait_task(void *arg) {
+  pool_wait_t *wait = (pool_wait_t *)arg;
+  cmp_http_pool_stats_t stats;
+  int done;
+
+  if (wait->pool != NULL) {
+    cmp_http_pool_get_stats(wait->pool, &stats);
+    done = stats.in_flight == 0 && stats.queued == 0;
+  } else {
+    cmp_mutex_lock(&wait->server->lock);
+    done = wait->server->closed == wait->server->connections;
+    cmp_mutex_unlock(&wait->server->lock);
+  }
+  if (done || clock() > wait->deadline) {
+    cmp_modality_stop(wait->ui);
+    return;
+  }
+  cmp_modality_queue_task(wait->ui, pool_wait_task, wait);
+}
+
+TEST test_http_pool_workers(void) {
+  loopback_server_t server;
+  cmp_http_pool_stats_t stats;
+  cmp_http_pool_t *pool;
+  cmp_modality_t workers, ui;
+  fetch_log_t log;
+  pool_wait_t wait;
+  char url[64];
+  int i;
+
+  pool = make_pool(&server, NULL, 2, 3);
+  ASSERT(pool != NULL);
+  server.spin = 200000;
+  memset(&log, 0, sizeof(log));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_threaded_init(&workers, 4));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&ui));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_http_pool_set_workers(pool, &ui, &ui));
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_pool_set_workers(pool, &workers, &ui));
+
+  /* Sends start at submission, within the limits */
+  for (i = 0; i < 18; ++i) {
+    sprintf(url, "http://%s.test/tile/%d", i % 3 == 0 ? "b" : "a", i);
+    submit_get(pool, url, CMP_HTTP_PRIORITY_NORMAL, &log, NULL);
+  }
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT_EQ(3, stats.in_flight);
+  ASSERT_EQ(15, stats.queued);
+  memset(&wait, 0, sizeof(wait));
+  wait.ui = &ui;
+  wait.pool = pool;
+  wait.deadline = clock() + 10 * CLOCKS_PER_SEC;
+  cmp_modality_queue_task(&ui, pool_wait_task, &wait);
+  cmp_modality_run(&ui);
+
+  ASSERT_EQ(18, log.calls);
+  ASSERT_EQ(0, log.failures);
+  ASSERT(server.max_active[0] <= 2);
+  ASSERT(server.max_active[1] <= 2);
+  ASSERT(server.max_total_active <= 3);
+  cmp_http_pool_get_stats(pool, &stats);
+  ASSERT(stats.connections_opened <= 4);
+  ASSERT_EQ(18, stats.pool_hits + stats.connections_opened);
+
+  /* Destroying with sends in flight defers the release to ui */
+  submit_get(pool, "http://a.test/late/1", CMP_HTTP_PRIORITY_NORMAL, &log,
+             NULL);
+  submit_get(pool, "http://a.test/late/2", CMP_HTTP_PRIORITY_NORMAL, &log,
+             NULL);
+  ASSERT_EQ(CMP_SUCCESS, cmp_http_pool_destroy(pool));
+  wait.pool = NULL;
+  wait.server = &server;
+  wait.deadline = clock() + 10 * CLOCKS_PER_SEC;
+  cmp_modality_queue_task(&ui, pool_wait_task, &wait);
+  cmp_modality_run(&ui);
+  ASSERT_EQ(18, log.calls);
+  ASSERT_EQ(server.connections, server.closed);
+
+  cmp_modality_destroy(&workers);
+  cmp_modality_destroy(&ui);
+  cmp_mutex_destroy(&server.lock);
+  PASS();
+}
+
+SUITE(http_pool_suite) {
+  RUN_TEST(test_http_pool_keep_alive);
+  RUN_TEST(test_http_pool_default_clock);
+  RUN_TEST(test_http_pool_priority);
+  RUN_TEST(test_http_pool_coalescing);
+  RUN_TEST(test_http_pool_stale_retry);
+  RUN_TEST(test_http_pool_workers);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(http_pool_suite);
+  GREATEST_MAIN_END();
+}
@@ -1,7 +1,9 @@
 /* clang-format off */
 #include <cmp.h>
 #include <greatest.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 /* clang-format on */
 
 SUITE(cmp_i18n_suite);
@@ -67,9 +69,120 @@ TEST test_cmp_i18n_strings(void) {
   PASS();
 }
 
+TEST test_cmp_i18n_compiled_catalog(void) {
+  cmp_i18n_t *i18n = NULL;
+  const char *value;
+  size_t len = 0;
+  char *copy = NULL;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_init());
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_create(&i18n));
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_add_string(i18n, "en", "hello", "Hello"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_add_string(i18n, "fr", "hello", "Bonjour"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_add_string(i18n, "en", "empty", ""));
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_save_catalog(i18n, "test_i18n.cat"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_destroy(i18n));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_create(&i18n));
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_load_compiled(i18n, "test_i18n.cat"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_lookup(i18n, "fr", "hello", &value, &len));
+  ASSERT_EQ(7, len);
+  ASSERT_STR_EQ("Bonjour", value);
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_lookup(i18n, "en", "empty", &value, &len));
+  ASSERT_EQ(0, len);
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND,
+            cmp_i18n_lookup(i18n, "de", "hello", &value, &len));
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND,
+            cmp_i18n_lookup(i18n, "en", "missing", &value, &len));
+
+  /* Runtime strings take precedence over catalogs */
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_add_string(i18n, "en", "hello", "Hi"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_get_string(i18n, "en", "hello", &copy));
+  ASSERT_STR_EQ("Hi", copy);
+  CMP_FREE(copy);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_destroy(i18n));
+  remove("test_i18n.cat");
+  cmp_vfs_shutdown();
+  PASS();
+}
+
+TEST test_cmp_i18n_malformed_catalog(void) {
+  static const char *const blobs[] = {"", "CMPI18N", "NOTACATALOG0000000000",
+                                      "CMPI18N\0\1\0\0\0\xff\xff\xff\x7f"
+                                      "\0\0\0\0\0\0\0\0"};
+  static const size_t sizes[] = {0, 7, 21, 24};
+  cmp_i18n_t *i18n = NULL;
+  const char *value;
+  size_t i, len;
+  FILE *f;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_init());
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_create(&i18n));
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    f = fopen("test_i18n_bad.cat", "wb");
+    ASSERT(f != NULL);
+    fwrite(blobs[i], 1, sizes[i], f);
+    fclose(f);
+    ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+              cmp_i18n_load_compiled(i18n, "test_i18n_bad.cat"));
+  }
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND,
+            cmp_i18n_lookup(i18n, "en", "k", &value, &len));
+  ASSERT(cmp_i18n_load_compiled(i18n, "test_i18n_missing.cat") !=
+         CMP_SUCCESS);
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_i18n_load_compiled(i18n, NULL));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_destroy(i18n));
+  remove("test_i18n_bad.cat");
+  cmp_vfs_shutdown();
+  PASS();
+}
+
+/* 50k keys across two locales, looked up through the compiled index. */
+TEST test_cmp_i18n_large_catalog(void) {
+  enum { KEYS = 50000 };
+  cmp_i18n_t *i18n = NULL;
+  char key[32], expect[32];
+  const char *value;
+  size_t i, len;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_init());
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_create(&i18n));
+  for (i = 0; i < KEYS; ++i) {
+    sprintf(key, "app.key.%lu", (unsigned long)i);
+    sprintf(expect, "%s value %lu", i & 1 ? "de" : "en", (unsigned long)i);
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_i18n_add_string(i18n, i & 1 ? "de" : "en", key, expect));
+  }
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_save_catalog(i18n, "test_i18n_big.cat"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_destroy(i18n));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_create(&i18n));
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_load_compiled(i18n, "test_i18n_big.cat"));
+  for (i = 0; i < KEYS; ++i) {
+    sprintf(key, "app.key.%lu", (unsigned long)i);
+    sprintf(expect, "%s value %lu", i & 1 ? "de" : "en", (unsigned long)i);
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_i18n_lookup(i18n, i & 1 ? "de" : "en", key, &value, &len));
+    ASSERT_EQ(strlen(expect), len);
+    ASSERT_STRN_EQ(expect, value, len);
+    ASSERT_EQ(CMP_ERROR_NOT_FOUND,
+              cmp_i18n_lookup(i18n, i & 1 ? "en" : "de", key, &value, &len));
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_i18n_destroy(i18n));
+  remove("test_i18n_big.cat");
+  cmp_vfs_shutdown();
+  PASS();
+}
+
 SUITE(cmp_i18n_suite) {
   RUN_TEST(test_cmp_i18n_create_destroy);
   RUN_TEST(test_cmp_i18n_strings);
+  RUN_TEST(test_cmp_i18n_compiled_catalog);
+  RUN_TEST(test_cmp_i18n_malformed_catalog);
+  RUN_TEST(test_cmp_i18n_large_catalog);
 }
 
 GREATEST_MAIN_DEFS();
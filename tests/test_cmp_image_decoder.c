@@ -0,0 +1,724 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+
+#include <stdlib.h>
+#include <string.h>
+/* clang-format on */
+
+/* Fixtures are 16x16 images. The PNG and WebP ones hold
+ * (x*16, y*16, (x^y)*16, (x+y)%5 ? 255 : 128); the JPEG ones hold
+ * four flat quadrants. */
+static const unsigned char k_png_plain[631] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d,
+    0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x10,
+    0x08, 0x06, 0x00, 0x00, 0x00, 0x1f, 0xf3, 0xff, 0x61, 0x00, 0x00, 0x02,
+    0x3e, 0x49, 0x44, 0x41, 0x54, 0x78, 0xda, 0x15, 0xd2, 0x51, 0x11, 0x45,
+    0x21, 0x08, 0x45, 0x51, 0x23, 0x10, 0xc1, 0x08, 0x46, 0x30, 0x02, 0x11,
+    0x88, 0x60, 0x04, 0x22, 0x18, 0xc1, 0x08, 0x44, 0x30, 0x02, 0x11, 0x88,
+    0x60, 0x83, 0xfd, 0xee, 0xfb, 0x66, 0x66, 0x0d, 0x9c, 0x43, 0x6b, 0xad,
+    0xb9, 0x34, 0xa1, 0xb7, 0xce, 0x68, 0x83, 0xd9, 0x26, 0xda, 0xd4, 0xad,
+    0x19, 0xab, 0x2d, 0xbc, 0x39, 0xbb, 0x6d, 0x4e, 0x3b, 0x1e, 0x2d, 0xb8,
+    0xed, 0x92, 0x2d, 0xa9, 0x56, 0xbc, 0xf6, 0xbc, 0x35, 0x11, 0x44, 0x1a,
+    0x5d, 0x06, 0x43, 0x3a, 0x53, 0xd4, 0x55, 0x26, 0x26, 0x8b, 0x25, 0x86,
+    0xcb, 0x66, 0x8b, 0xfb, 0x91, 0x20, 0xe4, 0x70, 0x25, 0x49, 0xb9, 0x94,
+    0x3c, 0x7f, 0x52, 0xb4, 0xd6, 0x3b, 0xd2, 0x07, 0xbd, 0x37, 0x46, 0x17,
+    0x9f, 0xdd, 0xd0, 0xbe, 0xb0, 0x3e, 0x59, 0x5d, 0xf1, 0x7e, 0x7c, 0xf7,
+    0xe0, 0x74, 0x27, 0xfa, 0xe6, 0xf6, 0x22, 0xfb, 0xf3, 0xea, 0x97, 0xd7,
+    0xf3, 0x03, 0xc6, 0x40, 0x46, 0xa7, 0x0f, 0xf1, 0x31, 0x1a, 0x73, 0x2c,
+    0x74, 0x18, 0x36, 0x94, 0x35, 0xa6, 0xfb, 0x08, 0xf6, 0x38, 0x9c, 0xb1,
+    0x89, 0xe1, 0xdc, 0xf1, 0x3c, 0x47, 0x51, 0x23, 0x79, 0xe3, 0x7e, 0xc0,
+    0x9c, 0xc8, 0x54, 0xef, 0xd3, 0x18, 0x73, 0x31, 0x67, 0x43, 0xa7, 0x60,
+    0xb3, 0xfb, 0x9a, 0x03, 0x9f, 0x97, 0x3d, 0x93, 0x33, 0x8b, 0x98, 0xcf,
+    0xef, 0x74, 0x72, 0x6e, 0x6a, 0x1e, 0xde, 0x8c, 0x0f, 0x50, 0x75, 0xd1,
+    0x49, 0xd7, 0xc5, 0x50, 0x63, 0xaa, 0xa0, 0xda, 0xdc, 0x74, 0xb0, 0xb4,
+    0xe3, 0x9a, 0x6c, 0xbd, 0x1c, 0x7d, 0x1e, 0x5a, 0x5c, 0xdd, 0xa4, 0x3a,
+    0xa5, 0xc1, 0xd3, 0xf3, 0x85, 0x68, 0x86, 0xd8, 0xa2, 0xdb, 0x64, 0x98,
+    0x32, 0xad, 0xbb, 0xda, 0xc0, 0xac, 0xb1, 0x4c, 0x70, 0x2b, 0xb6, 0x3d,
+    0x3f, 0x76, 0x09, 0x4b, 0xae, 0x1d, 0xd2, 0x82, 0x32, 0xf7, 0x67, 0xfb,
+    0xdb, 0x60, 0x2d, 0x64, 0x19, 0x7d, 0x29, 0x63, 0x4d, 0x9f, 0x6b, 0xa0,
+    0xab, 0x63, 0x4b, 0x58, 0xab, 0xe1, 0xeb, 0xf9, 0x5e, 0xc5, 0x59, 0x49,
+    0xac, 0xcb, 0x5d, 0x41, 0xae, 0xe3, 0xb5, 0x36, 0x6f, 0xf9, 0x07, 0xb8,
+    0x23, 0xbe, 0xe9, 0x7e, 0x7c, 0x78, 0x30, 0xfd, 0xa2, 0x9e, 0x98, 0x17,
+    0xcb, 0x9f, 0xbb, 0x37, 0xb6, 0x0b, 0xc7, 0x3b, 0xe1, 0x83, 0xeb, 0xd3,
+    0xd3, 0x95, 0x72, 0xe3, 0xf9, 0xfa, 0x80, 0xbd, 0x91, 0xed, 0xde, 0x77,
+    0x30, 0xf6, 0x61, 0xee, 0x44, 0xf7, 0xc5, 0xf6, 0x37, 0xde, 0x85, 0x6f,
+    0x61, 0xef, 0xc6, 0xd9, 0x83, 0xd8, 0xdd, 0xef, 0x56, 0x72, 0x4f, 0x6a,
+    0x2f, 0xde, 0xb6, 0x0f, 0x38, 0xc7, 0xe5, 0x04, 0x5f, 0xdd, 0x8c, 0xb3,
+    0x99, 0xa7, 0xd0, 0xf3, 0xdc, 0xce, 0x65, 0x9d, 0xc4, 0x4f, 0x67, 0x9f,
+    0xc1, 0x39, 0xcd, 0xe3, 0x08, 0xf7, 0x18, 0x79, 0x16, 0x75, 0x26, 0xef,
+    0xe8, 0x17, 0x62, 0x04, 0x12, 0x87, 0x1e, 0x9b, 0x11, 0xce, 0x8c, 0xe7,
+    0x1a, 0x85, 0x45, 0xb2, 0xe2, 0xe2, 0x31, 0xd8, 0xf1, 0x1d, 0x18, 0x42,
+    0x44, 0xe3, 0xc6, 0x22, 0xc3, 0xa8, 0x50, 0x7f, 0x31, 0xbf, 0x0d, 0xee,
+    0x45, 0x6e, 0xd2, 0x6f, 0x31, 0xee, 0xfb, 0x6a, 0x77, 0xf4, 0x6e, 0xec,
+    0x1e, 0xd6, 0x0d, 0xfe, 0xc5, 0xef, 0xab, 0x9c, 0x6b, 0xc4, 0x5d, 0xdc,
+    0xdb, 0xc8, 0x2b, 0x5e, 0xb7, 0xf3, 0xee, 0xf8, 0x80, 0x4c, 0x24, 0x2f,
+    0x3d, 0x9f, 0x8f, 0x2c, 0x66, 0x6e, 0x34, 0x1d, 0xcb, 0x60, 0xe5, 0x71,
+    0x4f, 0x65, 0xe7, 0xe4, 0xe4, 0x22, 0xd2, 0xb8, 0x29, 0x9e, 0xd9, 0xa8,
+    0x1c, 0xbc, 0xec, 0x1f, 0x50, 0x85, 0xd4, 0xf3, 0x5e, 0x97, 0x51, 0xc9,
+    0xac, 0x83, 0x56, 0x60, 0xe5, 0xbe, 0x6a, 0xe3, 0x65, 0xec, 0x5a, 0x9c,
+    0x9a, 0x44, 0xa9, 0xdf, 0xea, 0x64, 0x0d, 0xaa, 0x1a, 0xaf, 0xe4, 0x03,
+    0xde, 0x73, 0x79, 0x45, 0x7f, 0xc9, 0x78, 0x97, 0xf9, 0x02, 0x7d, 0xc7,
+    0xed, 0x6d, 0xbe, 0x17, 0xc0, 0xdf, 0x62, 0x3f, 0xe3, 0x3c, 0xf5, 0x78,
+    0x93, 0xfb, 0x06, 0xf9, 0x3a, 0xf5, 0x84, 0xf7, 0x9a, 0xff, 0x00, 0xce,
+    0x92, 0x4d, 0x53, 0x0b, 0x12, 0xc1, 0x22, 0x00, 0x00, 0x00, 0x00, 0x49,
+    0x45, 0x4e, 0x44, 0xae, 0x42, 0x60, 0x82,
+};
+
+static const unsigned char k_png_interlaced[663] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d,
+    0x49, 0x48, 0x44, 0x52, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x10,
+    0x08, 0x06, 0x00, 0x00, 0x01, 0x68, 0xf4, 0xcf, 0xf7, 0x00, 0x00, 0x02,
+    0x5e, 0x49, 0x44, 0x41, 0x54, 0x78, 0xda, 0x15, 0x93, 0x61, 0x19, 0xc0,
+    0x20, 0x08, 0x44, 0x89, 0x40, 0x04, 0x23, 0x10, 0x81, 0x08, 0x44, 0x30,
+    0x82, 0x11, 0x88, 0x60, 0x04, 0x22, 0x18, 0xc1, 0x08, 0x46, 0x30, 0x82,
+    0x0d, 0x6e, 0xb7, 0x5f, 0xdb, 0xfc, 0xd4, 0xc1, 0xbd, 0x87, 0x88, 0x48,
+    0xa6, 0x24, 0xfe, 0x07, 0xf8, 0x06, 0x71, 0x71, 0x6c, 0xd9, 0x7c, 0xc9,
+    0x8d, 0x9d, 0x9e, 0x22, 0xee, 0x70, 0x17, 0xa4, 0x73, 0xc1, 0xff, 0xbd,
+    0x7b, 0xc3, 0x37, 0xf7, 0xf3, 0x6b, 0x6f, 0x9e, 0x69, 0xd2, 0xd0, 0xa5,
+    0xa3, 0xa4, 0xf2, 0xca, 0xe5, 0x82, 0x77, 0x74, 0x6f, 0x59, 0x7e, 0x71,
+    0xbd, 0xb8, 0x90, 0x95, 0x3d, 0x2f, 0x2a, 0x1b, 0x6e, 0x76, 0x2e, 0xec,
+    0x8b, 0xbe, 0x0b, 0xb5, 0x3b, 0xee, 0x6e, 0xbc, 0xb4, 0x35, 0xb4, 0x26,
+    0xf0, 0xc6, 0xa3, 0xcd, 0x91, 0xad, 0xb2, 0x5a, 0x62, 0x37, 0x5e, 0xd1,
+    0x58, 0x8f, 0xf4, 0x8e, 0xd6, 0x59, 0x4a, 0x6f, 0xd9, 0x3b, 0xcb, 0xe9,
+    0xbc, 0xae, 0xb3, 0xa4, 0x5e, 0xb8, 0x9d, 0xb5, 0x4b, 0xd5, 0x7f, 0x08,
+    0x5e, 0xbc, 0xba, 0x36, 0x78, 0x1c, 0x55, 0x92, 0xbb, 0xf8, 0x8b, 0x72,
+    0xde, 0x70, 0x2f, 0xda, 0x65, 0xed, 0xb7, 0xd0, 0x6f, 0x66, 0x5e, 0x96,
+    0x7c, 0xd9, 0xee, 0x65, 0x51, 0x97, 0x7d, 0xa8, 0x28, 0x4c, 0x0c, 0x21,
+    0x91, 0x43, 0x06, 0xa6, 0x4c, 0x2c, 0x59, 0x38, 0x72, 0xf0, 0xe4, 0xa5,
+    0x68, 0x33, 0x58, 0xd3, 0x8c, 0x36, 0x30, 0x5a, 0x60, 0xb6, 0x85, 0xd5,
+    0x26, 0x4e, 0x7b, 0xf9, 0xda, 0xe1, 0x0d, 0x1e, 0x69, 0x3e, 0x10, 0xae,
+    0x18, 0x6e, 0x98, 0x7e, 0xb0, 0xfc, 0xe5, 0xf1, 0x89, 0xe7, 0x8b, 0x1b,
+    0xfa, 0x80, 0xf5, 0x40, 0x74, 0xc3, 0xe8, 0x8a, 0xd9, 0x5f, 0xae, 0x7e,
+    0x70, 0xfa, 0xc2, 0xeb, 0x93, 0x1b, 0x72, 0xc2, 0x72, 0x21, 0xf2, 0x60,
+    0xe4, 0xcb, 0x99, 0x8a, 0x95, 0x86, 0x93, 0x81, 0x97, 0x83, 0x1b, 0x6a,
+    0xc1, 0x6a, 0x22, 0x8a, 0x9f, 0x75, 0x30, 0xcb, 0xb0, 0x4a, 0x71, 0x6a,
+    0xe0, 0x55, 0xb0, 0xc8, 0x7d, 0x60, 0xfb, 0x65, 0xec, 0x89, 0xb1, 0x17,
+    0xe6, 0x0e, 0xac, 0x3d, 0x70, 0xb6, 0xe6, 0xdb, 0xc6, 0x1b, 0xee, 0x4b,
+    0xbb, 0x07, 0x71, 0x17, 0xc6, 0x9d, 0x98, 0x77, 0x60, 0x5d, 0xfe, 0xf0,
+    0x1a, 0xde, 0x55, 0x06, 0xa5, 0x0a, 0x55, 0x41, 0x53, 0xb6, 0xab, 0x0d,
+    0xae, 0x91, 0xa1, 0x8e, 0xae, 0x6c, 0x5b, 0x3b, 0x52, 0x79, 0x48, 0x33,
+    0x4b, 0xd9, 0xbe, 0x16, 0xb6, 0xb2, 0x01, 0xdd, 0xb8, 0xca, 0x18, 0x94,
+    0xfc, 0xc5, 0x0c, 0x6a, 0x04, 0x6a, 0x9a, 0x66, 0x84, 0x6a, 0x8c, 0xc4,
+    0x08, 0xd6, 0x02, 0xc3, 0x3c, 0xd3, 0x58, 0x96, 0x91, 0xbe, 0x31, 0x60,
+    0x23, 0x64, 0x63, 0x44, 0x46, 0xd0, 0xc6, 0xa0, 0xed, 0x87, 0x1d, 0x91,
+    0x1a, 0x8e, 0x16, 0x8c, 0x2b, 0x3a, 0x3c, 0x14, 0x11, 0x92, 0x3d, 0x18,
+    0x5b, 0x34, 0x64, 0xb0, 0xf1, 0xd8, 0xa8, 0x60, 0x7c, 0x71, 0xb1, 0x83,
+    0x10, 0x22, 0x71, 0x83, 0x31, 0x46, 0x51, 0x86, 0x31, 0xa0, 0x83, 0xc6,
+    0x8c, 0x80, 0x0d, 0x4f, 0x1f, 0xc4, 0x3a, 0xa8, 0xe9, 0x20, 0x98, 0x41,
+    0x7b, 0x06, 0xa3, 0x1d, 0x34, 0x68, 0x10, 0xd0, 0xa0, 0x45, 0x83, 0x98,
+    0x07, 0xf5, 0x1d, 0x04, 0x35, 0x7e, 0xc9, 0xe7, 0x84, 0xce, 0xcc, 0x36,
+    0x19, 0xf7, 0x2c, 0xf8, 0x64, 0x60, 0x73, 0xa3, 0x4f, 0xc6, 0x3e, 0x2f,
+    0x72, 0x12, 0xde, 0x14, 0xd4, 0x64, 0xfc, 0xb3, 0xe5, 0x9e, 0x81, 0x33,
+    0x1d, 0x77, 0x12, 0xc3, 0xa4, 0xe1, 0xb2, 0x16, 0x74, 0x15, 0xda, 0x22,
+    0xd0, 0x45, 0x2d, 0x17, 0x91, 0x2c, 0xaa, 0xb9, 0x08, 0x76, 0x51, 0xcf,
+    0x45, 0x3d, 0x16, 0x07, 0x63, 0x11, 0xf0, 0x12, 0xec, 0x45, 0x44, 0x8b,
+    0xaa, 0xae, 0xc8, 0xb7, 0x7e, 0x5d, 0xcf, 0x81, 0x9e, 0x8d, 0x76, 0x88,
+    0xeb, 0x5c, 0xf8, 0x21, 0xf4, 0x93, 0xe8, 0x87, 0xd8, 0x4e, 0x65, 0x1e,
+    0x0a, 0x78, 0x1c, 0x75, 0x88, 0xef, 0x74, 0xec, 0xa3, 0x79, 0x8e, 0xe0,
+    0x1e, 0x62, 0x3c, 0xff, 0x48, 0xbd, 0x97, 0xfa, 0xe8, 0xfc, 0xa3, 0x10,
+    0x8f, 0xde, 0x3f, 0x6a, 0xf5, 0x38, 0x88, 0x8f, 0x62, 0x3c, 0xce, 0xef,
+    0xa3, 0xe2, 0x8f, 0x33, 0xf0, 0x22, 0xd7, 0xe3, 0x1c, 0x3c, 0x6a, 0xf6,
+    0x38, 0x0b, 0x4f, 0xf1, 0x9e, 0xe4, 0x07, 0x1c, 0x6a, 0x4d, 0x53, 0x6d,
+    0x4d, 0xc1, 0xe2, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4e, 0x44, 0xae,
+    0x42, 0x60, 0x82,
+};
+
+static const unsigned char k_jpeg_baseline[659] = {
+    0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00, 0x01,
+    0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0xff, 0xdb, 0x00, 0x43,
+    0x00, 0x03, 0x02, 0x02, 0x03, 0x02, 0x02, 0x03, 0x03, 0x03, 0x03, 0x04,
+    0x03, 0x03, 0x04, 0x05, 0x08, 0x05, 0x05, 0x04, 0x04, 0x05, 0x0a, 0x07,
+    0x07, 0x06, 0x08, 0x0c, 0x0a, 0x0c, 0x0c, 0x0b, 0x0a, 0x0b, 0x0b, 0x0d,
+    0x0e, 0x12, 0x10, 0x0d, 0x0e, 0x11, 0x0e, 0x0b, 0x0b, 0x10, 0x16, 0x10,
+    0x11, 0x13, 0x14, 0x15, 0x15, 0x15, 0x0c, 0x0f, 0x17, 0x18, 0x16, 0x14,
+    0x18, 0x12, 0x14, 0x15, 0x14, 0xff, 0xdb, 0x00, 0x43, 0x01, 0x03, 0x04,
+    0x04, 0x05, 0x04, 0x05, 0x09, 0x05, 0x05, 0x09, 0x14, 0x0d, 0x0b, 0x0d,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0xff, 0xc0, 0x00, 0x11, 0x08, 0x00, 0x10, 0x00, 0x10, 0x03,
+    0x01, 0x22, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01, 0xff, 0xc4, 0x00,
+    0x1f, 0x00, 0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05,
+    0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x10, 0x00,
+    0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00,
+    0x00, 0x01, 0x7d, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21,
+    0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81,
+    0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24,
+    0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25,
+    0x26, 0x27, 0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a,
+    0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56,
+    0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86,
+    0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
+    0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3,
+    0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6,
+    0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9,
+    0xda, 0xe1, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1,
+    0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xc4, 0x00,
+    0x1f, 0x01, 0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05,
+    0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x11, 0x00,
+    0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04, 0x07, 0x05, 0x04, 0x04, 0x00,
+    0x01, 0x02, 0x77, 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31,
+    0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08,
+    0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15,
+    0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18,
+    0x19, 0x1a, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39,
+    0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55,
+    0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84,
+    0x85, 0x86, 0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+    0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa,
+    0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4,
+    0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7,
+    0xd8, 0xd9, 0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea,
+    0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xda, 0x00,
+    0x0c, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3f, 0x00, 0xc4,
+    0xaf, 0x9f, 0xeb, 0xd4, 0x2b, 0xe7, 0xfa, 0xfb, 0x4c, 0x9f, 0xc4, 0x9f,
+    0xe2, 0x7f, 0xb2, 0x76, 0xfb, 0x7e, 0xbf, 0xdc, 0x3f, 0x44, 0xf1, 0x27,
+    0x07, 0xfe, 0xe9, 0xef, 0x7f, 0x3f, 0x4f, 0xf0, 0x1f, 0xff, 0xd9,
+};
+
+static const unsigned char k_jpeg_progressive[534] = {
+    0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00, 0x01,
+    0x01, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0xff, 0xdb, 0x00, 0x43,
+    0x00, 0x03, 0x02, 0x02, 0x03, 0x02, 0x02, 0x03, 0x03, 0x03, 0x03, 0x04,
+    0x03, 0x03, 0x04, 0x05, 0x08, 0x05, 0x05, 0x04, 0x04, 0x05, 0x0a, 0x07,
+    0x07, 0x06, 0x08, 0x0c, 0x0a, 0x0c, 0x0c, 0x0b, 0x0a, 0x0b, 0x0b, 0x0d,
+    0x0e, 0x12, 0x10, 0x0d, 0x0e, 0x11, 0x0e, 0x0b, 0x0b, 0x10, 0x16, 0x10,
+    0x11, 0x13, 0x14, 0x15, 0x15, 0x15, 0x0c, 0x0f, 0x17, 0x18, 0x16, 0x14,
+    0x18, 0x12, 0x14, 0x15, 0x14, 0xff, 0xdb, 0x00, 0x43, 0x01, 0x03, 0x04,
+    0x04, 0x05, 0x04, 0x05, 0x09, 0x05, 0x05, 0x09, 0x14, 0x0d, 0x0b, 0x0d,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14, 0x14,
+    0x14, 0x14, 0xff, 0xc2, 0x00, 0x11, 0x08, 0x00, 0x10, 0x00, 0x10, 0x03,
+    0x01, 0x11, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01, 0xff, 0xc4, 0x00,
+    0x16, 0x00, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x04, 0x06, 0xff, 0xc4, 0x00,
+    0x16, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x06, 0x08, 0xff, 0xda, 0x00,
+    0x0c, 0x03, 0x01, 0x00, 0x02, 0x10, 0x03, 0x10, 0x00, 0x00, 0x01, 0x86,
+    0xf5, 0x38, 0xfe, 0x90, 0x57, 0x51, 0x9c, 0x1f, 0x0f, 0xe9, 0x05, 0x3f,
+    0xff, 0xc4, 0x00, 0x14, 0x10, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0xff, 0xda,
+    0x00, 0x08, 0x01, 0x01, 0x00, 0x01, 0x05, 0x02, 0x1f, 0xff, 0xc4, 0x00,
+    0x14, 0x11, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0xff, 0xda, 0x00, 0x08, 0x01,
+    0x03, 0x01, 0x01, 0x3f, 0x01, 0x1f, 0xff, 0xc4, 0x00, 0x14, 0x11, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x20, 0xff, 0xda, 0x00, 0x08, 0x01, 0x02, 0x01, 0x01,
+    0x3f, 0x01, 0x1f, 0xff, 0xc4, 0x00, 0x14, 0x10, 0x01, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x20, 0xff, 0xda, 0x00, 0x08, 0x01, 0x01, 0x00, 0x06, 0x3f, 0x02, 0x1f,
+    0xff, 0xc4, 0x00, 0x14, 0x10, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0xff, 0xda,
+    0x00, 0x08, 0x01, 0x01, 0x00, 0x01, 0x3f, 0x21, 0x1f, 0xff, 0xda, 0x00,
+    0x0c, 0x03, 0x01, 0x00, 0x02, 0x00, 0x03, 0x00, 0x00, 0x00, 0x10, 0xfb,
+    0x7f, 0xff, 0xc4, 0x00, 0x14, 0x11, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0xff,
+    0xda, 0x00, 0x08, 0x01, 0x03, 0x01, 0x01, 0x3f, 0x10, 0x1f, 0xff, 0xc4,
+    0x00, 0x14, 0x11, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0xff, 0xda, 0x00, 0x08,
+    0x01, 0x02, 0x01, 0x01, 0x3f, 0x10, 0x1f, 0xff, 0xc4, 0x00, 0x14, 0x10,
+    0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x20, 0xff, 0xda, 0x00, 0x08, 0x01, 0x01, 0x00,
+    0x01, 0x3f, 0x10, 0x1f, 0xff, 0xd9,
+};
+
+static const unsigned char k_webp_lossless[204] = {
+    0x52, 0x49, 0x46, 0x46, 0xc4, 0x00, 0x00, 0x00, 0x57, 0x45, 0x42, 0x50,
+    0x56, 0x50, 0x38, 0x4c, 0xb7, 0x00, 0x00, 0x00, 0x2f, 0x0f, 0xc0, 0x03,
+    0x10, 0xcd, 0x65, 0x44, 0xff, 0x63, 0x17, 0x85, 0x2f, 0x78, 0xff, 0x43,
+    0xc2, 0x30, 0x6d, 0x23, 0x49, 0x2e, 0x61, 0xfa, 0x2f, 0xf7, 0xde, 0x1a,
+    0x86, 0x25, 0xc7, 0xcc, 0x85, 0x65, 0x06, 0xc2, 0x34, 0x24, 0x2b, 0x61,
+    0x1c, 0xca, 0x43, 0x09, 0x25, 0x94, 0x50, 0x42, 0x09, 0xe5, 0x3e, 0x05,
+    0x24, 0x49, 0xcf, 0xc3, 0xe7, 0x6a, 0xd3, 0x36, 0x60, 0x76, 0x3b, 0xe5,
+    0x0d, 0x14, 0x32, 0x49, 0x22, 0x9e, 0xb8, 0xe0, 0x34, 0x26, 0x33, 0xe8,
+    0xe9, 0xa4, 0x98, 0x9d, 0x56, 0x05, 0x23, 0xf1, 0x23, 0xd8, 0x6b, 0xc4,
+    0x46, 0x1e, 0xb1, 0x2b, 0xfe, 0x6a, 0x1a, 0x45, 0xe7, 0x64, 0x0f, 0x67,
+    0xdb, 0x1c, 0x65, 0x37, 0x91, 0xe2, 0xa6, 0xca, 0x4f, 0x2a, 0xee, 0x92,
+    0x82, 0xe8, 0x4c, 0xe6, 0x35, 0xcc, 0x5e, 0x66, 0xd4, 0x72, 0x4e, 0xf0,
+    0xc3, 0xe0, 0x23, 0x8f, 0xe6, 0x30, 0x46, 0x2b, 0x9b, 0x66, 0x8a, 0xee,
+    0x27, 0xae, 0x9f, 0x4f, 0xa7, 0xd4, 0xb3, 0x5f, 0x9e, 0x07, 0xdd, 0x7a,
+    0xb7, 0x56, 0x6e, 0x4d, 0x7d, 0xb7, 0xde, 0x9f, 0x2a, 0xff, 0x9e, 0xea,
+    0x5b, 0x2f, 0x57, 0x4a, 0xdc, 0x2a, 0xd5, 0xb7, 0x5e, 0xde, 0x4e, 0xf3,
+    0x54, 0xba, 0x09, 0xfe, 0x2f, 0xcf, 0x83, 0x9e, 0x4f, 0xdb, 0x03, 0x00,
+};
+
+static const unsigned char k_zlib_stream[247] = {
+    0x78, 0xda, 0xed, 0xcf, 0x61, 0x82, 0xc1, 0x30, 0x10, 0x40, 0xe1, 0xab,
+    0x44, 0x14, 0x83, 0xa2, 0xa2, 0x08, 0x82, 0x11, 0x45, 0x10, 0x44, 0x14,
+    0x45, 0x70, 0xff, 0x5b, 0xec, 0xee, 0x29, 0xf6, 0xcf, 0xbc, 0x77, 0x82,
+    0x8f, 0x31, 0x56, 0xe2, 0xe5, 0xa8, 0x0a, 0x8d, 0xb8, 0x23, 0xfa, 0x52,
+    0x61, 0x66, 0x0e, 0xfe, 0x1e, 0x38, 0xb4, 0xd3, 0x89, 0xde, 0xba, 0x82,
+    0x41, 0x32, 0xd2, 0xfb, 0xfc, 0x03, 0x42, 0x6d, 0xfc, 0x1b, 0x52, 0xb4,
+    0x45, 0x45, 0xcc, 0xed, 0x13, 0x06, 0xd9, 0x85, 0x77, 0xd1, 0xb1, 0x04,
+    0xcf, 0xbc, 0x97, 0xdd, 0x60, 0x6c, 0xbf, 0x62, 0x55, 0xc4, 0x98, 0xc3,
+    0xd4, 0xd7, 0x94, 0x87, 0x59, 0xde, 0xd4, 0x8f, 0xc4, 0x30, 0xe9, 0xea,
+    0xfa, 0x95, 0x1e, 0x41, 0x87, 0xa1, 0x6f, 0x99, 0x08, 0x83, 0xbc, 0x8a,
+    0x53, 0xbc, 0x83, 0x75, 0xb4, 0xe4, 0x0b, 0x86, 0xbf, 0x2f, 0xf8, 0x32,
+    0x5a, 0xc3, 0x2e, 0x3e, 0x89, 0xab, 0x0c, 0x18, 0x99, 0x96, 0x1f, 0x06,
+    0x0d, 0xc7, 0xf4, 0xa5, 0xeb, 0x4e, 0x32, 0x93, 0x3c, 0x74, 0x33, 0x9f,
+    0x81, 0x57, 0x35, 0x3f, 0x85, 0x1c, 0xe3, 0x62, 0x25, 0xbe, 0x76, 0x0c,
+    0xb7, 0xac, 0xc7, 0xcf, 0x98, 0x30, 0x87, 0x5d, 0x7e, 0xc9, 0x06, 0xf0,
+    0xb4, 0x73, 0x51, 0x29, 0x2c, 0xa6, 0xf0, 0xf6, 0x1b, 0x25, 0xe0, 0x93,
+    0xef, 0xf5, 0x28, 0x01, 0x56, 0xb8, 0xad, 0x9e, 0xa4, 0x6d, 0xe0, 0xe1,
+    0xee, 0x0f, 0x26, 0x43, 0x25, 0xfb, 0xa2, 0x13, 0x37, 0xa0, 0x1a, 0x95,
+    0x79, 0x89, 0xfd, 0x45, 0x7e, 0xf2, 0x93, 0x9f, 0xfc, 0xe4, 0x27, 0x3f,
+    0xf9, 0xc9, 0x4f, 0x7e, 0xf2, 0x93, 0x9f, 0xfc, 0xe4, 0x27, 0xff, 0xbf,
+    0xfb, 0x7f, 0x00, 0xbc, 0x62, 0xa9, 0xbe,
+};
+
+static const char k_webp_data_url[] =
+    "data:image/webp;base64,UklGRsQAAABXRUJQVlA4TLcAAAAvD8ADEM1lRP9jF"
+    "4UveP9DwjBtI0kuYfov994ahiXHzIVlBsI0JCthHMpDCSWUUEIJ5T4FJEnPw+dq0"
+    "zZgdjvlDRQySSKeuOA0JjPo6aSYnVYFI/Ej2GvERh6xK/5qGkXnZA9n2xxlN5Hip"
+    "spPKu6SguhM5jXMXmbUck7ww+Ajj+YwRiubZoruJ66fT6fUs1+eB916t1ZuTX233"
+    "p8q/57qWy9XStwq1bde3k7zVLoJ/i/Pg55P2wMA";
+
+typedef struct inflate_sink {
+  unsigned char buf[4096];
+  size_t len;
+} inflate_sink_t;
+
+static int inflate_sink_write(void *user_data, const unsigned char *data,
+                              size_t len) {
+  inflate_sink_t *sink = (inflate_sink_t *)user_data;
+  if (sink->len + len > sizeof(sink->buf)) {
+    return 1;
+  }
+  memcpy(sink->buf + sink->len, data, len);
+  sink->len += len;
+  return 0;
+}
+
+typedef struct rows_log {
+  int calls;
+  int last_pass;
+  int rows;
+} rows_log_t;
+
+static void rows_log_cb(void *user_data, int first_row, int row_count,
+                        int pass) {
+  rows_log_t *log = (rows_log_t *)user_data;
+  (void)first_row;
+  log->calls++;
+  log->last_pass = pass;
+  log->rows += row_count;
+}
+
+static int decode_all(const unsigned char *data, size_t len, int tw, int th,
+                      size_t step, cmp_image_decoder_t **out_dec) {
+  cmp_image_decoder_t *dec = NULL;
+  size_t off = 0;
+  int res = cmp_image_decoder_create(tw, th, &dec);
+  if (res != CMP_SUCCESS) {
+    return res;
+  }
+  while (off < len) {
+    size_t n = len - off < step ? len - off : step;
+    res = cmp_image_decoder_push(dec, data + off, n);
+    if (res != CMP_SUCCESS) {
+      break;
+    }
+    off += n;
+  }
+  if (res == CMP_SUCCESS) {
+    res = cmp_image_decoder_finish(dec);
+  }
+  *out_dec = dec;
+  return res;
+}
+
+static int near(int a, int b, int tol) { return abs(a - b) <= tol; }
+
+TEST test_inflate_byte_at_a_time(void) {
+  cmp_inflate_t *inf = NULL;
+  inflate_sink_t sink;
+  size_t i;
+  int done = 0;
+
+  sink.len = 0;
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                cmp_inflate_create(1, inflate_sink_write, &sink, &inf), "%d");
+  for (i = 0; i < sizeof(k_zlib_stream); ++i) {
+    ASSERT_EQ_FMT(CMP_SUCCESS, cmp_inflate_push(inf, k_zlib_stream + i, 1),
+                  "%d");
+  }
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_inflate_finish(inf), "%d");
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_inflate_is_done(inf, &done), "%d");
+  ASSERT(done);
+  ASSERT_EQ_FMT((size_t)4000, sink.len, "%lu");
+  for (i = 0; i < sink.len; ++i) {
+    ASSERT_EQ_FMT((int)((((i * i) >> 3) & 0x3f) + 0x20), (int)sink.buf[i],
+                  "%d");
+  }
+  cmp_inflate_destroy(inf);
+  PASS();
+}
+
+TEST test_inflate_rejects_bad_checksum(void) {
+  cmp_inflate_t *inf = NULL;
+  inflate_sink_t sink;
+  unsigned char copy[sizeof(k_zlib_stream)];
+
+  sink.len = 0;
+  memcpy(copy, k_zlib_stream, sizeof(copy));
+  copy[sizeof(copy) - 1] ^= 0xFF;
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                cmp_inflate_create(1, inflate_sink_write, &sink, &inf), "%d");
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_inflate_push(inf, copy, sizeof(copy)), "%d");
+  ASSERT_EQ_FMT(CMP_ERROR_INVALID_ARG, cmp_inflate_finish(inf), "%d");
+  cmp_inflate_destroy(inf);
+  PASS();
+}
+
+/* RFC 7692 7.2.3.2: "Hello" twice on one sync-flushed raw stream, the
+ * second a back-reference into the first. */
+TEST test_inflate_sync_flush(void) {
+  static const unsigned char k_first[11] = {
+      0xf2, 0x48, 0xcd, 0xc9, 0xc9, 0x07, 0x00, 0x00, 0x00, 0xff, 0xff};
+  static const unsigned char k_second[9] = {0xf2, 0x00, 0x11, 0x00, 0x00,
+                                            0x00, 0x00, 0xff, 0xff};
+  cmp_inflate_t *inf = NULL;
+  inflate_sink_t sink;
+  int done = 1;
+
+  sink.len = 0;
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                cmp_inflate_create(0, inflate_sink_write, &sink, &inf), "%d");
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_inflate_push(inf, k_first, sizeof(k_first)),
+                "%d");
+  ASSERT_EQ_FMT((size_t)0, sink.len, "%lu");
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_inflate_sync(inf), "%d");
+  ASSERT_EQ_FMT((size_t)5, sink.len, "%lu");
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                cmp_inflate_push(inf, k_second, sizeof(k_second)), "%d");
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_inflate_sync(inf), "%d");
+  ASSERT_EQ_FMT((size_t)10, sink.len, "%lu");
+  ASSERT_MEM_EQ("HelloHello", sink.buf, sink.len);
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_inflate_is_done(inf, &done), "%d");
+  ASSERT(!done);
+  cmp_inflate_destroy(inf);
+  PASS();
+}
+
+/* zlib's own fixed-Huffman encoding of UTF-8 text; bytes 0xC3 and 0xE2 use
+ * the 9-bit literal codes, which sit after the 8-bit codes for 280-287. */
+TEST test_inflate_fixed_codes(void) {
+  static const unsigned char k_fixed[19] = {
+      0x78, 0xda, 0x7b, 0x34, 0x67, 0xb2, 0xc2, 0xe1, 0x95, 0x25,
+      0x87, 0x57, 0x42, 0x48, 0x00, 0x47, 0x50, 0x08, 0xea};
+  static const char k_text[] = "\xe2\x9c\x93 \xc3\xa9t\xc3\xa9 \xc3\xa9t\xc3\xa9";
+  cmp_inflate_t *inf = NULL;
+  inflate_sink_t sink;
+
+  sink.len = 0;
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                cmp_inflate_create(1, inflate_sink_write, &sink, &inf), "%d");
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_inflate_push(inf, k_fixed, sizeof(k_fixed)),
+                "%d");
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_inflate_finish(inf), "%d");
+  ASSERT_EQ_FMT(sizeof(k_text) - 1, sink.len, "%lu");
+  ASSERT_MEM_EQ(k_text, sink.buf, sink.len);
+  cmp_inflate_destroy(inf);
+  PASS();
+}
+
+static enum greatest_test_res check_gradient(cmp_image_decoder_t *dec) {
+  unsigned char *px = NULL;
+  size_t stride = 0;
+  int x, y;
+
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_image_decoder_get_pixels(dec, &px, &stride),
+                "%d");
+  ASSERT(px != NULL);
+  for (y = 0; y < 16; ++y) {
+    for (x = 0; x < 16; ++x) {
+      const unsigned char *p = px + (size_t)y * stride + (size_t)x * 4;
+      ASSERT_EQ_FMT(x * 16, (int)p[0], "%d");
+      ASSERT_EQ_FMT(y * 16, (int)p[1], "%d");
+      ASSERT_EQ_FMT(((x ^ y) * 16) & 255, (int)p[2], "%d");
+      ASSERT_EQ_FMT((x + y) % 5 ? 255 : 128, (int)p[3], "%d");
+    }
+  }
+  PASS();
+}
+
+TEST test_png_plain_streaming(void) {
+  cmp_image_decoder_t *dec = NULL;
+  cmp_image_info_t info;
+  rows_log_t log;
+  int res;
+
+  memset(&log, 0, sizeof(log));
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_image_decoder_create(0, 0, &dec), "%d");
+  cmp_image_decoder_set_callbacks(dec, NULL, rows_log_cb, &log);
+  res = cmp_image_decoder_push(dec, k_png_plain, sizeof(k_png_plain));
+  ASSERT_EQ_FMT(CMP_SUCCESS, res, "%d");
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_image_decoder_finish(dec), "%d");
+
+  cmp_image_decoder_get_info(dec, &info);
+  ASSERT_EQ_FMT((int)CMP_IMAGE_FORMAT_PNG, (int)info.format, "%d");
+  ASSERT_EQ_FMT(16, info.width, "%d");
+  ASSERT_EQ_FMT(1, info.decode_scale, "%d");
+  ASSERT_EQ_FMT(0, info.is_progressive, "%d");
+  ASSERT_EQ_FMT(16, log.rows, "%d");
+  CHECK_CALL(check_gradient(dec));
+  cmp_image_decoder_destroy(dec);
+  PASS();
+}
+
+TEST test_png_interlaced_full(void) {
+  cmp_image_decoder_t *dec = NULL;
+  cmp_image_info_t info;
+
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                decode_all(k_png_interlaced, sizeof(k_png_interlaced), 0, 0, 7,
+                           &dec),
+                "%d");
+  cmp_image_decoder_get_info(dec, &info);
+  ASSERT(info.is_progressive);
+  ASSERT_EQ_FMT(7, info.passes_completed, "%d");
+  CHECK_CALL(check_gradient(dec));
+  cmp_image_decoder_destroy(dec);
+  PASS();
+}
+
+TEST test_png_interlaced_downscaled_skips_passes(void) {
+  cmp_image_decoder_t *dec = NULL;
+  cmp_image_info_t info;
+  unsigned char *px = NULL;
+  size_t stride = 0;
+
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                decode_all(k_png_interlaced, sizeof(k_png_interlaced), 4, 4,
+                           sizeof(k_png_interlaced), &dec),
+                "%d");
+  cmp_image_decoder_get_info(dec, &info);
+  ASSERT_EQ_FMT(4, info.decode_scale, "%d");
+  ASSERT_EQ_FMT(4, info.width, "%d");
+  ASSERT_EQ_FMT(4, info.height, "%d");
+  ASSERT(info.passes_completed < 7);
+  cmp_image_decoder_get_pixels(dec, &px, &stride);
+  /* Output pixel (1, 1) samples source pixel (4, 4). */
+  ASSERT_EQ_FMT(64, (int)px[stride + 4], "%d");
+  ASSERT_EQ_FMT(64, (int)px[stride + 5], "%d");
+  cmp_image_decoder_destroy(dec);
+  PASS();
+}
+
+TEST test_png_box_filter_without_interlace(void) {
+  cmp_image_decoder_t *dec = NULL;
+  cmp_image_info_t info;
+  unsigned char *px = NULL;
+  size_t stride = 0;
+
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                decode_all(k_png_plain, sizeof(k_png_plain), 8, 8, 13, &dec),
+                "%d");
+  cmp_image_decoder_get_info(dec, &info);
+  ASSERT_EQ_FMT(1, info.decode_scale, "%d");
+  ASSERT_EQ_FMT(8, info.width, "%d");
+  cmp_image_decoder_get_pixels(dec, &px, &stride);
+  /* Box of source columns 0..1 averages red 0 and 16. */
+  ASSERT(near(8, (int)px[0], 1));
+  cmp_image_decoder_destroy(dec);
+  PASS();
+}
+
+static enum greatest_test_res check_quadrants(cmp_image_decoder_t *dec,
+                                              int size) {
+  unsigned char *px = NULL;
+  size_t stride = 0;
+  int q;
+
+  cmp_image_decoder_get_pixels(dec, &px, &stride);
+  for (q = 0; q < 4; ++q) {
+    int x = (q & 1) ? size - 1 : 0;
+    int y = (q & 2) ? size - 1 : 0;
+    const unsigned char *p = px + (size_t)y * stride + (size_t)x * 4;
+    ASSERT(near((q & 1) ? 40 : 200, (int)p[0], 12));
+    ASSERT(near(60, (int)p[1], 12));
+    ASSERT(near((q & 2) ? 40 : 200, (int)p[2], 12));
+    ASSERT_EQ_FMT(255, (int)p[3], "%d");
+  }
+  PASS();
+}
+
+TEST test_jpeg_baseline(void) {
+  cmp_image_decoder_t *dec = NULL;
+  cmp_image_info_t info;
+
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                decode_all(k_jpeg_baseline, sizeof(k_jpeg_baseline), 0, 0, 5,
+                           &dec),
+                "%d");
+  cmp_image_decoder_get_info(dec, &info);
+  ASSERT_EQ_FMT((int)CMP_IMAGE_FORMAT_JPEG, (int)info.format, "%d");
+  ASSERT_EQ_FMT(16, info.width, "%d");
+  ASSERT_EQ_FMT(0, info.is_progressive, "%d");
+  CHECK_CALL(check_quadrants(dec, 16));
+  cmp_image_decoder_destroy(dec);
+  PASS();
+}
+
+TEST test_jpeg_progressive_dc_only_scale(void) {
+  cmp_image_decoder_t *dec = NULL;
+  cmp_image_info_t info;
+  rows_log_t log;
+
+  memset(&log, 0, sizeof(log));
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_image_decoder_create(2, 2, &dec), "%d");
+  cmp_image_decoder_set_callbacks(dec, NULL, rows_log_cb, &log);
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                cmp_image_decoder_push(dec, k_jpeg_progressive,
+                                       sizeof(k_jpeg_progressive)),
+                "%d");
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_image_decoder_finish(dec), "%d");
+  cmp_image_decoder_get_info(dec, &info);
+  ASSERT(info.is_progressive);
+  ASSERT_EQ_FMT(8, info.decode_scale, "%d");
+  ASSERT_EQ_FMT(2, info.width, "%d");
+  ASSERT(info.passes_completed > 1);
+  ASSERT(log.calls >= info.passes_completed);
+  CHECK_CALL(check_quadrants(dec, 2));
+  cmp_image_decoder_destroy(dec);
+  PASS();
+}
+
+TEST test_jpeg_progressive_full(void) {
+  cmp_image_decoder_t *dec = NULL;
+
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                decode_all(k_jpeg_progressive, sizeof(k_jpeg_progressive), 0,
+                           0, 3, &dec),
+                "%d");
+  CHECK_CALL(check_quadrants(dec, 16));
+  cmp_image_decoder_destroy(dec);
+  PASS();
+}
+
+TEST test_webp_lossless(void) {
+  cmp_image_decoder_t *dec = NULL;
+  cmp_image_info_t info;
+
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                decode_all(k_webp_lossless, sizeof(k_webp_lossless), 0, 0, 9,
+                           &dec),
+                "%d");
+  cmp_image_decoder_get_info(dec, &info);
+  ASSERT_EQ_FMT((int)CMP_IMAGE_FORMAT_WEBP, (int)info.format, "%d");
+  CHECK_CALL(check_gradient(dec));
+  cmp_image_decoder_destroy(dec);
+  PASS();
+}
+
+TEST test_caller_supplied_buffer(void) {
+  cmp_image_decoder_t *dec = NULL;
+  unsigned char pixels[16 * 16 * 4];
+  unsigned char *px = NULL;
+  size_t stride = 0;
+
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_image_decoder_create(0, 0, &dec), "%d");
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                cmp_image_decoder_set_output(dec, pixels, 16 * 4), "%d");
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                cmp_image_decoder_push(dec, k_png_plain, sizeof(k_png_plain)),
+                "%d");
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_image_decoder_finish(dec), "%d");
+  cmp_image_decoder_get_pixels(dec, &px, &stride);
+  ASSERT(px == pixels);
+  ASSERT_EQ_FMT(5 * 16, (int)pixels[(5 * 16 + 1) * 4 + 1], "%d");
+  cmp_image_decoder_destroy(dec);
+  PASS();
+}
+
+TEST test_malformed_and_truncated(void) {
+  static const unsigned char gif[] = {'G', 'I', 'F', '8', '9', 'a',
+                                      0,   0,   0,   0,   0,   0};
+  unsigned char bad_sof[sizeof(k_jpeg_baseline)];
+  cmp_image_decoder_t *dec = NULL;
+  size_t i;
+
+  ASSERT_EQ_FMT(CMP_ERROR_INVALID_ARG,
+                decode_all(gif, sizeof(gif), 0, 0, 12, &dec), "%d");
+  cmp_image_decoder_destroy(dec);
+
+  ASSERT_EQ_FMT(CMP_ERROR_INVALID_STATE,
+                decode_all(k_png_plain, sizeof(k_png_plain) / 2, 0, 0, 64,
+                           &dec),
+                "%d");
+  cmp_image_decoder_destroy(dec);
+
+  ASSERT_EQ_FMT(CMP_ERROR_INVALID_STATE,
+                decode_all(k_jpeg_baseline, sizeof(k_jpeg_baseline) - 40, 0,
+                           0, 64, &dec),
+                "%d");
+  cmp_image_decoder_destroy(dec);
+
+  /* Turn SOF0 into SOF3 (lossless), which is not supported. */
+  memcpy(bad_sof, k_jpeg_baseline, sizeof(bad_sof));
+  for (i = 2; i + 1 < sizeof(bad_sof); ++i) {
+    if (bad_sof[i] == 0xFF && bad_sof[i + 1] == 0xC0) {
+      bad_sof[i + 1] = 0xC3;
+      break;
+    }
+  }
+  ASSERT_EQ_FMT(CMP_ERROR_INVALID_ARG,
+                decode_all(bad_sof, sizeof(bad_sof), 0, 0, 64, &dec), "%d");
+  cmp_image_decoder_destroy(dec);
+  PASS();
+}
+
+TEST test_preview_base64(void) {
+  cmp_image_preview_t *preview = NULL;
+  unsigned char *pixels = NULL;
+  int w = 0, h = 0;
+
+  ASSERT_EQ_FMT(CMP_SUCCESS, cmp_image_preview_create(&preview), "%d");
+  ASSERT_EQ_FMT(CMP_SUCCESS,
+                cmp_image_preview_load_base64(preview, k_webp_data_url,
+                                              &pixels, &w, &h),
+                "%d");
+  ASSERT_EQ_FMT(16, w, "%d");
+  ASSERT_EQ_FMT(16, h, "%d");
+  ASSERT_EQ_FMT(3 * 16, (int)pixels[(3 * 16 + 2) * 4 + 1], "%d");
+  cmp_image_preview_free_pixels(pixels);
+
+  ASSERT(cmp_image_preview_load_base64(preview, "bm90IGFuIGltYWdl", &pixels,
+                                       &w, &h) != CMP_SUCCESS);
+  cmp_image_preview_destroy(preview);
+  PASS();
+}
+
+SUITE(image_decoder_suite) {
+  RUN_TEST(test_inflate_byte_at_a_time);
+  RUN_TEST(test_inflate_rejects_bad_checksum);
+  RUN_TEST(test_inflate_fixed_codes);
+  RUN_TEST(test_inflate_sync_flush);
+  RUN_TEST(test_png_plain_streaming);
+  RUN_TEST(test_png_interlaced_full);
+  RUN_TEST(test_png_interlaced_downscaled_skips_passes);
+  RUN_TEST(test_png_box_filter_without_interlace);
+  RUN_TEST(test_jpeg_baseline);
+  RUN_TEST(test_jpeg_progressive_dc_only_scale);
+  RUN_TEST(test_jpeg_progressive_full);
+  RUN_TEST(test_webp_lossless);
+  RUN_TEST(test_caller_supplied_buffer);
+  RUN_TEST(test_malformed_and_truncated);
+  RUN_TEST(test_preview_base64);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(image_decoder_suite);
+  GREATEST_MAIN_END();
+}
@@ -0,0 +1,346 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+/* clang-format on */
+
+/* Serialises a tree as compact nested tags, e.g. "p(T[hi]em(T[x]))". */
+static void dump(const cmp_md_node_t *n, char *out, size_t cap) {
+  static const char *names[] = {"T",  "p",  "h",  "list", "li",  "strong",
+                                "em", "pre", "code", "quote", "table", "tr",
+                                "td", "doc", "a",  "img",  "hr",  "del",
+                                "br"};
+  size_t i, len = strlen(out);
+  const char *name = names[n->type];
+  if (len + strlen(name) + 16 >= cap)
+    return;
+  strcat(out, name);
+  if (n->type == CMP_MD_NODE_HEADER || n->type == CMP_MD_NODE_LIST) {
+    char level[4];
+    level[0] = (char)('0' + n->level % 10);
+    level[1] = '\0';
+    strcat(out, level);
+  }
+  if (n->content && strlen(out) + strlen(n->content) + 3 < cap) {
+    strcat(out, "[");
+    strcat(out, n->content);
+    strcat(out, "]");
+  }
+  if (n->child_count > 0) {
+    strcat(out, "(");
+    for (i = 0; i < n->child_count; ++i)
+      dump(n->children[i], out, cap);
+    if (strlen(out) + 2 < cap)
+      strcat(out, ")");
+  }
+}
+
+static int parse_dump(const char *src, char *out, size_t cap) {
+  cmp_markdown_parser_t *parser = NULL;
+  cmp_md_node_t *root = NULL;
+  int res = cmp_markdown_parser_create(&parser);
+  if (res != CMP_SUCCESS)
+    return res;
+  res = cmp_markdown_parser_parse(parser, src, &root);
+  out[0] = '\0';
+  if (res == CMP_SUCCESS) {
+    dump(root, out, cap);
+    cmp_md_node_destroy(root);
+  }
+  cmp_markdown_parser_destroy(parser);
+  return res;
+}
+
+#define ASSERT_MD(expected, src)                                               \
+  do {                                                                         \
+    char got_[2048];                                                           \
+    ASSERT_EQ(CMP_SUCCESS, parse_dump((src), got_, sizeof(got_)));             \
+    ASSERT_STR_EQ((expected), got_);                                           \
+  } while (0)
+
+TEST test_blocks(void) {
+  ASSERT_MD("doc(h1(T[Title])p(T[Hello\nworld]))", "# Title\nHello\nworld\n");
+  ASSERT_MD("doc(h2(T[Setext])hr)", "Setext\n------\n\n***\n");
+  ASSERT_MD("doc(h3(T[Closed]))", "### Closed ###");
+  ASSERT_MD("doc(pre[int x;\n\nreturn;\n]p(T[after]))",
+            "```c\nint x;\n\nreturn;\n```\nafter\n");
+  ASSERT_MD("doc(pre[code\n    more\n]p(T[text]))",
+            "    code\n    \tmore\n\ntext\n");
+  ASSERT_MD("doc(quote(p(T[a\nlazy])quote(p(T[b]))))",
+            "> a\nlazy\n>\n> > b\n");
+  ASSERT_MD("doc(list0(li(p(T[one]))li(p(T[two])list0(li(p(T[nested]))))))",
+            "- one\n- two\n  - nested\n");
+  ASSERT_MD("doc(list3(li(p(T[c]))li(p(T[d])))list0(li(p(T[e]))))",
+            "3. c\n4. d\n* e\n");
+  ASSERT_MD("doc(p(T[para\n2. not a list])list1(li(p(T[x]))))",
+            "para\n2. not a list\n\n1) x\n");
+  ASSERT_MD("doc(table(tr(td(T[a])td(T[b]))tr(td(T[1])td(em(T[2])))"
+            "tr(td(T[3])td))p(T[end]))",
+            "| a | b |\n|---|:-:|\n| 1 | *2* |\n| 3 |\n\nend\n");
+  ASSERT_MD("doc(pre[x\tbaz\n])", "\tx\tbaz\n");
+  ASSERT_MD("doc", "");
+  PASS();
+}
+
+TEST test_inlines(void) {
+  ASSERT_MD("doc(p(em(T[a])T[ ]strong(T[b])T[ ]em(strong(T[c]))))",
+            "*a* __b__ ***c***");
+  ASSERT_MD("doc(p(T[snake_case_name and 2 * 3 * 4]))",
+            "snake_case_name and 2 * 3 * 4");
+  ASSERT_MD("doc(p(em(T[foo ]strong(T[bar])T[ baz])))", "*foo **bar** baz*");
+  ASSERT_MD("doc(p(T[*]em(T[x])))", "**x*");
+  ASSERT_MD("doc(p(del(T[gone])T[ ~~~no~~~]))", "~~gone~~ ~~~no~~~");
+  ASSERT_MD("doc(p(code[a ` b]T[ ]code[x]T[ *]))", "`` a ` b `` `x` \\*");
+  ASSERT_MD("doc(p(a[http://x.y/(z)](T[link ]em(T[em]))))",
+            "[link *em*](http://x.y/(z) \"title\")");
+  ASSERT_MD("doc(p(img[i.png](T[alt])T[ ]"
+            "a[https://e.com](T[https://e.com])))",
+            "![alt](<i.png>) <https://e.com>");
+  ASSERT_MD("doc(p(T[[not a link] and [x]]))", "[not a link] and [x]");
+  ASSERT_MD("doc(p(T[a]brT[b]brT[c\nd]))", "a  \nb\\\nc\nd");
+  ASSERT_MD("doc(p(T[*]a[u](T[a*])))", "*[a*](u)");
+  PASS();
+}
+
+static int stream_dump(cmp_md_stream_t *st, char *out, size_t cap) {
+  size_t count, i;
+  int res = cmp_md_stream_get_block_count(st, &count);
+  out[0] = '\0';
+  if (res != CMP_SUCCESS)
+    return res;
+  strcat(out, "doc(");
+  for (i = 0; i < count; ++i) {
+    const cmp_md_node_t *node = NULL;
+    res = cmp_md_stream_get_block(st, i, &node, NULL);
+    if (res != CMP_SUCCESS)
+      return res;
+    dump(node, out, cap);
+  }
+  strcat(out, ")");
+  return CMP_SUCCESS;
+}
+
+TEST test_stream_matches_one_shot(void) {
+  static const char *const docs[] = {
+      "# Title\nHello *world*\nagain\n\n- a\n- b\n\n  more b\n- c\n\n"
+      "```\ncode\n\n```\n> quote\nlazy\n\nSetext\n===\n| h | i |\n|-|-|\n"
+      "| 1 | 2 |\n\n    indented\n\ntail ~~x~~",
+      "1. one\n2. two\n\n\n3. three\npara\n***\n~~~\nunterminated\n",
+      "a\n\n\n\nb\n"};
+  size_t d;
+  for (d = 0; d < sizeof(docs) / sizeof(docs[0]); ++d) {
+    size_t len = strlen(docs[d]), step;
+    char expected[2048];
+    ASSERT_EQ(CMP_SUCCESS, parse_dump(docs[d], expected, sizeof(expected)));
+    for (step = 1; step <= len; step = step * 2 + 1) {
+      cmp_md_stream_t *st = NULL;
+      char got[2048];
+      size_t at;
+      ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_create(&st));
+      for (at = 0; at < len; at += step) {
+        size_t n = len - at < step ? len - at : step;
+        ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_push(st, docs[d] + at, n));
+        /* Intermediate views must be well-formed too */
+        ASSERT_EQ(CMP_SUCCESS, stream_dump(st, got, sizeof(got)));
+      }
+      ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_finish(st));
+      ASSERT_EQ(CMP_SUCCESS, stream_dump(st, got, sizeof(got)));
+      ASSERT_STR_EQ(expected, got);
+      ASSERT_EQ(CMP_ERROR_INVALID_STATE, cmp_md_stream_push(st, "x", 1));
+      ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_destroy(st));
+    }
+  }
+  PASS();
+}
+
+TEST test_stream_closed_blocks(void) {
+  cmp_md_stream_t *st = NULL;
+  const cmp_md_node_t *first = NULL, *again = NULL, *node = NULL;
+  size_t count = 0;
+  int closed = -1;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_create(&st));
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_push(st, "# Head\npara", 11));
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_get_block_count(st, &count));
+  ASSERT_EQ(2, count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_get_block(st, 0, &first, &closed));
+  ASSERT_EQ(1, closed);
+  ASSERT_EQ(CMP_MD_NODE_HEADER, first->type);
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_get_block(st, 1, &node, &closed));
+  ASSERT_EQ(0, closed);
+
+  /* A setext underline turns the open paragraph into a heading */
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_push(st, "graph\n---\n", 10));
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_get_block_count(st, &count));
+  ASSERT_EQ(2, count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_get_block(st, 0, &again, NULL));
+  ASSERT_EQ(first, again); /* Closed trees are built once */
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_get_block(st, 1, &node, &closed));
+  ASSERT_EQ(1, closed);
+  ASSERT_EQ(CMP_MD_NODE_HEADER, node->type);
+  ASSERT_EQ(2, node->level);
+  ASSERT_STR_EQ("paragraph", node->children[0]->content);
+
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_md_stream_get_block(st, 2, &node, NULL));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_md_stream_push(st, NULL, 3));
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_destroy(st));
+  PASS();
+}
+
+/* Streams a few megabytes of mixed markdown in small chunks, touching only
+ * a window of blocks as a scrolling view would, then checks the result
+ * against a one-shot parse of the same text. */
+TEST test_stream_large_document(void) {
+  static const char *const pieces[] = {
+      "## Section heading with `code` and *emphasis*\n\n",
+      "A paragraph with **strong text**, a [link](http://example.com/a_b) "
+      "and\nsome more words that wrap onto a second line_with_underscores.\n\n",
+      "- item one\n- item *two*\n  continued\n- item three\n\n",
+      "```c\nint main(void) {\n  return 0;\n}\n```\n\n",
+      "> quoted ~~text~~\n> spanning lines\n\n",
+      "| col a | col b |\n|-------|-------|\n| 1 | 2 |\n| 3 | 4 |\n\n"};
+  size_t piece_count = sizeof(pieces) / sizeof(pieces[0]);
+  size_t target = 4u * 1024u * 1024u, len = 0, i, at, count = 0, blocks = 0;
+  char *text;
+  cmp_md_stream_t *st = NULL;
+  cmp_markdown_parser_t *parser = NULL;
+  cmp_md_node_t *root = NULL;
+  const cmp_md_node_t *node = NULL;
+
+  text = (char *)malloc(target + 512);
+  ASSERT(text != NULL);
+  for (i = 0; len < target; ++i) {
+    const char *p = pieces[(i * 7) % piece_count];
+    size_t n = strlen(p);
+    memcpy(text + len, p, n);
+    len += n;
+  }
+  text[len] = '\0';
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_create(&st));
+  for (at = 0; at < len; at += 997) {
+    size_t n = len - at < 997 ? len - at : 997;
+    ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_push(st, text + at, n));
+    if ((at / 997) % 64 == 0) {
+      ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_get_block_count(st, &count));
+      ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_get_block(st, count - 1, &node,
+                                                     NULL));
+    }
+  }
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_finish(st));
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_get_block_count(st, &blocks));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_markdown_parser_create(&parser));
+  ASSERT_EQ(CMP_SUCCESS, cmp_markdown_parser_parse(parser, text, &root));
+  ASSERT_EQ(CMP_MD_NODE_DOCUMENT, root->type);
+  ASSERT_EQ(root->child_count, blocks);
+  for (i = blocks / 2; i < blocks / 2 + 200 && i < blocks; ++i) {
+    char a[2048], b[2048];
+    a[0] = b[0] = '\0';
+    ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_get_block(st, i, &node, NULL));
+    dump(node, a, sizeof(a));
+    dump(root->children[i], b, sizeof(b));
+    ASSERT_STR_EQ(b, a);
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_node_destroy(root));
+  ASSERT_EQ(CMP_SUCCESS, cmp_markdown_parser_destroy(parser));
+  ASSERT_EQ(CMP_SUCCESS, cmp_md_stream_destroy(st));
+  free(text);
+  PASS();
+}
+
+static size_t tree_depth(const cmp_md_node_t *n) {
+  size_t i, d, max = 0;
+  for (i = 0; i < n->child_count; ++i) {
+    d = tree_depth(n->children[i]);
+    if (d > max)
+      max = d;
+  }
+  return max + 1;
+}
+
+/* Builds count copies of unit followed by tail */
+static char *repeat(const char *unit, size_t count, const char *tail) {
+  size_t n = strlen(unit), i;
+  char *s = (char *)malloc(n * count + strlen(tail) + 1);
+  if (!s)
+    return NULL;
+  for (i = 0; i < count; ++i)
+    memcpy(s + i * n, unit, n);
+  strcpy(s + n * count, tail);
+  return s;
+}
+
+TEST test_deep_nesting(void) {
+  cmp_markdown_parser_t *parser = NULL;
+  cmp_md_node_t *root = NULL;
+  const cmp_md_node_t *n;
+  char *lists = repeat("- ", 5000, "x"), *quotes = repeat(">", 20000, " x");
+
+  ASSERT(lists != NULL && quotes != NULL);
+  ASSERT_EQ(CMP_SUCCESS, cmp_markdown_parser_create(&parser));
+
+  /* Nesting stops at the cap; the markers past it stay as text */
+  ASSERT_EQ(CMP_SUCCESS, cmp_markdown_parser_parse(parser, lists, &root));
+  ASSERT(tree_depth(root) < 110);
+  for (n = root; n->child_count > 0 && n->type != CMP_MD_NODE_PARAGRAPH;)
+    n = n->children[0];
+  ASSERT_EQ(CMP_MD_NODE_PARAGRAPH, n->type);
+  cmp_md_node_destroy(root);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_markdown_parser_parse(parser, quotes, &root));
+  ASSERT(tree_depth(root) < 110);
+  cmp_md_node_destroy(root);
+
+  cmp_markdown_parser_destroy(parser);
+  free(lists);
+  free(quotes);
+  PASS();
+}
+
+TEST test_unclosed_links(void) {
+  static const char *const units[] = {"[a](", "[a](b", "[a](b (", "[a](<b"};
+  cmp_markdown_parser_t *parser = NULL;
+  cmp_md_node_t *root = NULL;
+  clock_t start;
+  size_t i;
+  char *text;
+
+  /* Runs of "](" that never close must not rescan the rest of the text
+   * for every bracket */
+  ASSERT_EQ(CMP_SUCCESS, cmp_markdown_parser_create(&parser));
+  for (i = 0; i < sizeof(units) / sizeof(units[0]); ++i) {
+    text = repeat(units[i], 40000, ")");
+    ASSERT(text != NULL);
+    start = clock();
+    ASSERT_EQ(CMP_SUCCESS, cmp_markdown_parser_parse(parser, text, &root));
+    ASSERT(clock() - start < CLOCKS_PER_SEC);
+    ASSERT_EQ(CMP_MD_NODE_PARAGRAPH, root->children[0]->type);
+    cmp_md_node_destroy(root);
+    free(text);
+  }
+  cmp_markdown_parser_destroy(parser);
+  PASS();
+}
+
+SUITE(markdown_parser_suite) {
+  RUN_TEST(test_blocks);
+  RUN_TEST(test_inlines);
+  RUN_TEST(test_stream_matches_one_shot);
+  RUN_TEST(test_stream_closed_blocks);
+  RUN_TEST(test_stream_large_document);
+  RUN_TEST(test_deep_nesting);
+  RUN_TEST(test_unclosed_links);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(markdown_parser_suite);
+  GREATEST_MAIN_END();
+}
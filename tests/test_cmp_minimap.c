@@ -0,0 +1,229 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* clang-format on */
+
+#define INK(level, token) ((unsigned char)((level) << 4 | (token)))
+
+TEST test_minimap_density(void) {
+  cmp_minimap_t *minimap = NULL;
+  cmp_minimap_layout_t layout;
+  const unsigned char *px;
+  size_t rows, i;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_create(&minimap));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_minimap_set_size(minimap, 10, 100, 3, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_set_size(minimap, 10, 100, 1, 1));
+  ASSERT_EQ(CMP_ERROR_BOUNDS,
+            cmp_minimap_get_tile(minimap, 0, &px, &rows, NULL));
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_minimap_set_text(minimap, "ab  cd\n\tx\n"
+                                          "                0123456789abcdef\n"
+                                          "\xc3\xa9t\xc3\xa9"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_compute_layout(minimap));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_get_layout(minimap, &layout));
+  ASSERT_EQ(0, layout.first_line);
+  ASSERT_EQ(4, layout.line_count);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_get_tile(minimap, 0, &px, &rows, NULL));
+  ASSERT_EQ(4, rows);
+  ASSERT_EQ(INK(15, 0), px[0]);
+  ASSERT_EQ(INK(15, 0), px[1]);
+  ASSERT_EQ(0, px[2]);
+  ASSERT_EQ(0, px[3]);
+  ASSERT_EQ(INK(15, 0), px[5]);
+  ASSERT_EQ(0, px[6]);
+  /* Tabs advance to the next stop of four columns */
+  ASSERT_EQ(0, px[10 + 3]);
+  ASSERT_EQ(INK(15, 0), px[10 + 4]);
+  /* Indented beyond the 10-column width: nothing drawn */
+  for (i = 0; i < 10; ++i) {
+    ASSERT_EQ(0, px[20 + i]);
+  }
+  /* Multi-byte characters take one column */
+  ASSERT_EQ(INK(15, 0), px[30 + 2]);
+  ASSERT_EQ(0, px[30 + 3]);
+
+  /* Two characters per pixel halve the density of a lone character */
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_set_size(minimap, 40, 100, 2, 2));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_get_tile(minimap, 0, &px, &rows, NULL));
+  ASSERT_EQ(8, rows);
+  ASSERT_EQ(INK(15, 0), px[0]);
+  ASSERT_EQ(0, px[1]);
+  ASSERT_EQ(INK(15, 0), px[2]);
+  ASSERT_EQ(0, memcmp(px, px + 40, 40));
+  ASSERT_EQ(INK(8, 0), px[80 * 1 + 2]);
+  for (i = 8; i < 16; ++i) {
+    ASSERT_EQ(INK(15, 0), px[80 * 2 + i]);
+  }
+  ASSERT_EQ(0, px[80 * 2 + 16]);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_destroy(minimap));
+  PASS();
+}
+
+TEST test_minimap_token_colors(void) {
+  const char *text = "int x = 42; /* note */\nreturn x;";
+  cmp_text_buffer_t *buffer = NULL;
+  cmp_syntax_document_t *doc = NULL;
+  cmp_minimap_t *minimap = NULL;
+  const unsigned char *px;
+  size_t rows;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_create(&buffer));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_set_text(buffer, text, strlen(text)));
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_document_create(buffer, "c", &doc));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_create(&minimap));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_set_size(minimap, 40, 100, 1, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_set_buffer(minimap, buffer));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_set_syntax(minimap, doc));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_get_tile(minimap, 0, &px, &rows, NULL));
+  ASSERT_EQ(2, rows);
+  ASSERT_EQ(INK(15, CMP_TOKEN_KEYWORD), px[0]);
+  ASSERT_EQ(INK(15, CMP_TOKEN_NORMAL), px[4]);
+  ASSERT_EQ(INK(15, CMP_TOKEN_NUMBER), px[8]);
+  ASSERT_EQ(INK(15, CMP_TOKEN_COMMENT), px[12]);
+  ASSERT_EQ(INK(15, CMP_TOKEN_COMMENT), px[15]);
+  ASSERT_EQ(INK(15, CMP_TOKEN_KEYWORD), px[40]);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_set_syntax(minimap, NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_get_tile(minimap, 0, &px, &rows, NULL));
+  ASSERT_EQ(INK(15, CMP_TOKEN_NORMAL), px[0]);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_destroy(minimap));
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_document_destroy(doc));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_destroy(buffer));
+  PASS();
+}
+
+/* Only tiles touched by an edit are redrawn; line shifts redraw below. */
+TEST test_minimap_incremental(void) {
+  cmp_text_buffer_t *buffer = NULL;
+  cmp_minimap_t *minimap = NULL;
+  const unsigned char *px;
+  unsigned long before[3], after[3];
+  size_t rows, i, off;
+  char *text;
+
+  text = (char *)malloc(768 * 2 + 1);
+  ASSERT(text != NULL);
+  for (i = 0; i < 768; ++i) {
+    text[i * 2] = 'a';
+    text[i * 2 + 1] = '\n';
+  }
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_create(&buffer));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_set_text(buffer, text, 768 * 2));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_create(&minimap));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_set_size(minimap, 16, 64, 1, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_set_buffer(minimap, buffer));
+  for (i = 0; i < 3; ++i) {
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_minimap_get_tile(minimap, i, &px, &rows, &before[i]));
+    ASSERT_EQ(256, rows);
+  }
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_get_tile(minimap, 3, &px, &rows, NULL));
+  ASSERT_EQ(1, rows);
+  ASSERT_EQ(CMP_ERROR_BOUNDS,
+            cmp_minimap_get_tile(minimap, 4, &px, &rows, NULL));
+
+  /* Widen line 300 in place */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_line_to_offset(buffer, 300, &off));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_insert(buffer, off, "bbb", 3));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_edit(minimap, 300, 300, 300));
+  for (i = 0; i < 3; ++i) {
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_minimap_get_tile(minimap, i, &px, &rows, &after[i]));
+  }
+  ASSERT_EQ(before[0], after[0]);
+  ASSERT(before[1] != after[1]);
+  ASSERT_EQ(before[2], after[2]);
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_get_tile(minimap, 1, &px, &rows, NULL));
+  ASSERT_EQ(INK(15, 0), px[(300 - 256) * 16 + 3]);
+  ASSERT_EQ(0, px[(301 - 256) * 16 + 3]);
+
+  /* Split line 10: everything from tile 0 on moves */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_line_to_offset(buffer, 10, &off));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_insert(buffer, off, "\n", 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_edit(minimap, 10, 10, 11));
+  for (i = 0; i < 3; ++i) {
+    before[i] = after[i];
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_minimap_get_tile(minimap, i, &px, &rows, &after[i]));
+    ASSERT(before[i] != after[i]);
+  }
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_get_tile(minimap, 1, &px, &rows, NULL));
+  ASSERT_EQ(INK(15, 0), px[(301 - 256) * 16 + 3]);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_destroy(minimap));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_destroy(buffer));
+  free(text);
+  PASS();
+}
+
+/* A million-line file scrolled top to bottom at display rate; asserts the
+ * geometry at both ends. */
+TEST test_minimap_large_document(void) {
+  enum { LINES = 1000000, FRAMES = 240 };
+  cmp_minimap_t *minimap = NULL;
+  cmp_minimap_layout_t layout;
+  char *text;
+  size_t len = 0, i;
+
+  text = (char *)malloc((size_t)LINES * 48);
+  ASSERT(text != NULL);
+  for (i = 0; i < LINES; ++i) {
+    len += (size_t)sprintf(text + len, "%*sif (value_%lu > limit) {\n",
+                           (int)(i % 4) * 4, "", (unsigned long)i);
+  }
+  text[len - 1] = '\0';
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_create(&minimap));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_set_size(minimap, 120, 1000, 2, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_set_text(minimap, text));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_minimap_update_viewport(minimap, 0.0f, 800.0f, 16e6f));
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_compute_layout(minimap));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_get_layout(minimap, &layout));
+  ASSERT_EQ(0, layout.first_line);
+  ASSERT_EQ(501, layout.line_count);
+  ASSERT_IN_RANGE(0.0f, layout.slider_y, 0.001f);
+  ASSERT_IN_RANGE(100.0f, layout.slider_height, 0.01f);
+
+  for (i = 1; i <= FRAMES; ++i) {
+    float y = (16e6f - 800.0f) * (float)i / FRAMES;
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_minimap_update_viewport(minimap, y, 800.0f, 16e6f));
+    ASSERT_EQ(CMP_SUCCESS, cmp_minimap_compute_layout(minimap));
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_get_layout(minimap, &layout));
+  ASSERT_EQ(LINES, layout.first_line + layout.line_count);
+  ASSERT_IN_RANGE(900.0f, layout.slider_y, 0.5f);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_minimap_destroy(minimap));
+  free(text);
+  PASS();
+}
+
+SUITE(minimap_suite) {
+  RUN_TEST(test_minimap_density);
+  RUN_TEST(test_minimap_token_colors);
+  RUN_TEST(test_minimap_incremental);
+  RUN_TEST(test_minimap_large_document);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(minimap_suite);
+  GREATEST_MAIN_END();
+}
@@ -1,9 +1,58 @@
 /* clang-format off */
 #include "greatest.h"
 #include "cmp.h"
+#include <math.h>
 #include <stdlib.h>
+#include <string.h>
 /* clang-format on */
 
+#define CIRCLE_POINTS 256
+
+static void make_circle(float *pts, float cx, float cy, float r) {
+  int i;
+  for (i = 0; i < CIRCLE_POINTS; ++i) {
+    double a = 6.283185307179586 * i / CIRCLE_POINTS;
+    pts[i * 2] = cx + r * (float)cos(a);
+    pts[i * 2 + 1] = cy + r * (float)sin(a);
+  }
+}
+
+static cmp_color_t make_color(float r, float g, float b, float a) {
+  cmp_color_t c;
+  c.r = r;
+  c.g = g;
+  c.b = b;
+  c.a = a;
+  c.space = CMP_COLOR_SPACE_SRGB;
+  return c;
+}
+
+/* Renders a white circle in the given mode and returns the relative error of
+ * its resolved area against the area of the polygon. */
+static double circle_area_error(cmp_msaa_mode_t mode, uint8_t samples,
+                                cmp_msaa_stats_t *out_stats) {
+  static unsigned char pixels[64 * 64 * 4];
+  float pts[CIRCLE_POINTS * 2];
+  size_t count = CIRCLE_POINTS;
+  cmp_msaa_t *msaa = NULL;
+  cmp_color_t white = make_color(1.0f, 1.0f, 1.0f, 1.0f);
+  double area = 0.0, exact;
+  int i;
+
+  exact = 0.5 * CIRCLE_POINTS * 20.3 * 20.3 *
+          sin(6.283185307179586 / CIRCLE_POINTS);
+  make_circle(pts, 31.7f, 32.2f, 20.3f);
+  cmp_msaa_create(samples, 64, 64, &msaa);
+  cmp_msaa_set_mode(msaa, mode);
+  cmp_msaa_fill_path(msaa, pts, &count, 1, 0, &white);
+  cmp_msaa_resolve_to_buffer(msaa, pixels, 64 * 4);
+  cmp_msaa_get_stats(msaa, out_stats);
+  cmp_msaa_destroy(msaa);
+  for (i = 0; i < 64 * 64; ++i)
+    area += pixels[i * 4 + 3] / 255.0;
+  return fabs(area - exact) / exact;
+}
+
 TEST test_msaa_create_destroy(void) {
   cmp_msaa_t *msaa = NULL;
 
@@ -35,6 +84,35 @@ TEST test_msaa_resolve_success(void) {
   PASS();
 }
 
+TEST test_msaa_resolve_cpu_target(void) {
+  static unsigned char pixels[4 * 4 * 4];
+  cmp_msaa_t *msaa = NULL;
+  cmp_texture_t target = {0};
+  cmp_color_t white = make_color(1.0f, 1.0f, 1.0f, 1.0f);
+  float quad[8] = {0.0f, 0.0f, 4.0f, 0.0f, 4.0f, 4.0f, 0.0f, 4.0f};
+  size_t count = 4;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_create(4, 4, 4, &msaa));
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_fill_path(msaa, quad, &count, 1, 0, &white));
+  target.width = 4;
+  target.height = 4;
+
+  /* A compressed texture mounts a mock handle; it is never written */
+  target.format = CMP_TEX_COMPRESSION_ASTC;
+  target.internal_handle = (void *)(size_t)0xCAFEBABE;
+  target.pixels = pixels;
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_resolve(msaa, &target));
+  ASSERT_EQ(0, pixels[3]);
+
+  target.format = CMP_TEXTURE_FORMAT_RGBA8_PREMULTIPLIED;
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_resolve(msaa, &target));
+  ASSERT_EQ(255, pixels[3]);
+  ASSERT_EQ(255, pixels[sizeof(pixels) - 1]);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_destroy(msaa));
+  PASS();
+}
+
 TEST test_msaa_resolve_bounds_error(void) {
   cmp_msaa_t *msaa = NULL;
   cmp_texture_t target;
@@ -82,11 +160,163 @@ TEST test_msaa_edge_cases(void) {
   PASS();
 }
 
+TEST test_msaa_analytic_partial_coverage(void) {
+  unsigned char pixels[16 * 16 * 4];
+  float rect[8] = {4.5f, 2.0f, 12.0f, 2.0f, 12.0f, 10.25f, 4.5f, 10.25f};
+  size_t count = 4;
+  cmp_msaa_t *msaa = NULL;
+  cmp_color_t red = make_color(1.0f, 0.0f, 0.0f, 1.0f);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_create(4, 16, 16, &msaa));
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_fill_path(msaa, rect, &count, 1, 0, &red));
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_resolve_to_buffer(msaa, pixels, 16 * 4));
+
+  /* Interior, half-covered column, quarter-covered row, outside. */
+  ASSERT_EQ(255, pixels[(5 * 16 + 8) * 4 + 3]);
+  ASSERT_EQ(255, pixels[(5 * 16 + 8) * 4 + 0]);
+  ASSERT(abs(pixels[(5 * 16 + 4) * 4 + 3] - 128) <= 1);
+  ASSERT(abs(pixels[(10 * 16 + 8) * 4 + 3] - 64) <= 1);
+  ASSERT_EQ(0, pixels[(5 * 16 + 12) * 4 + 3]);
+  ASSERT_EQ(0, pixels[(1 * 16 + 8) * 4 + 3]);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_destroy(msaa));
+  PASS();
+}
+
+TEST test_msaa_even_odd_hole(void) {
+  unsigned char pixels[32 * 32 * 4];
+  float pts[16] = {2.0f,  2.0f,  30.0f, 2.0f,  30.0f, 30.0f, 2.0f,  30.0f,
+                   10.0f, 10.0f, 22.0f, 10.0f, 22.0f, 22.0f, 10.0f, 22.0f};
+  size_t counts[2] = {4, 4};
+  cmp_color_t blue = make_color(0.0f, 0.0f, 1.0f, 1.0f);
+  cmp_msaa_mode_t modes[3];
+  cmp_msaa_t *msaa = NULL;
+  int m;
+
+  modes[0] = CMP_MSAA_MODE_NONE;
+  modes[1] = CMP_MSAA_MODE_ANALYTIC;
+  modes[2] = CMP_MSAA_MODE_SPARSE;
+  for (m = 0; m < 3; ++m) {
+    ASSERT_EQ(CMP_SUCCESS, cmp_msaa_create(8, 32, 32, &msaa));
+    ASSERT_EQ(CMP_SUCCESS, cmp_msaa_set_mode(msaa, modes[m]));
+    ASSERT_EQ(CMP_SUCCESS, cmp_msaa_fill_path(msaa, pts, counts, 2, 1, &blue));
+    cmp_msaa_resolve_to_buffer(msaa, pixels, 32 * 4);
+    ASSERT_EQ(255, pixels[(5 * 32 + 5) * 4 + 3]);
+    ASSERT_EQ(0, pixels[(16 * 32 + 16) * 4 + 3]);
+
+    /* Same winding on both contours: nonzero fills the hole. */
+    ASSERT_EQ(CMP_SUCCESS, cmp_msaa_fill_path(msaa, pts, counts, 2, 0, &blue));
+    cmp_msaa_resolve_to_buffer(msaa, pixels, 32 * 4);
+    ASSERT_EQ(255, pixels[(16 * 32 + 16) * 4 + 3]);
+    cmp_msaa_destroy(msaa);
+  }
+  PASS();
+}
+
+TEST test_msaa_sparse_stores_edge_samples_only(void) {
+  cmp_msaa_stats_t stats;
+  double err = circle_area_error(CMP_MSAA_MODE_SPARSE, 8, &stats);
+
+  ASSERT(err < 0.01);
+  ASSERT(stats.edge_pixels > 0);
+  /* Roughly the circumference, far from the 64x64 dense footprint. */
+  ASSERT(stats.edge_pixels < 200);
+  ASSERT_EQ(stats.edge_pixels * 8, stats.stored_samples);
+  PASS();
+}
+
+TEST test_msaa_quality_vs_aliased(void) {
+  cmp_msaa_stats_t none_stats, analytic_stats, sparse_stats;
+  double none_err, analytic_err, sparse_err;
+
+  none_err = circle_area_error(CMP_MSAA_MODE_NONE, 1, &none_stats);
+  analytic_err = circle_area_error(CMP_MSAA_MODE_ANALYTIC, 1, &analytic_stats);
+  sparse_err = circle_area_error(CMP_MSAA_MODE_SPARSE, 16, &sparse_stats);
+
+  ASSERT(analytic_err < 0.001);
+  ASSERT(analytic_err < sparse_err);
+  ASSERT(sparse_err < 0.01);
+  ASSERT_EQ(0, (int)none_stats.stored_samples);
+  ASSERT_EQ(0, (int)analytic_stats.stored_samples);
+  /* Fill cost stays per pixel, not per sample. */
+  ASSERT(analytic_stats.pixels_filled < none_stats.pixels_filled + 200);
+  ASSERT(sparse_stats.pixels_filled < none_stats.pixels_filled + 200);
+  (void)none_err;
+  PASS();
+}
+
+/* Edges clipped at x = 0 fold their coverage into column 0 instead of
+ * writing in front of the accumulation buffer. */
+TEST test_msaa_path_crossing_left_edge(void) {
+  static unsigned char pixels[64 * 64 * 4];
+  float tri[6] = {-7.3f, 2.1f, 30.0f, -5.0f, 12.0f, 40.3f};
+  size_t count = 3;
+  cmp_msaa_t *msaa = NULL;
+  cmp_color_t white = make_color(1.0f, 1.0f, 1.0f, 1.0f);
+  double area = 0.0;
+  int i;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_create(4, 64, 64, &msaa));
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_fill_path(msaa, tri, &count, 1, 0, &white));
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_resolve_to_buffer(msaa, pixels, 64 * 4));
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_destroy(msaa));
+  for (i = 0; i < 64 * 64; ++i)
+    area += pixels[i * 4 + 3] / 255.0;
+  /* The triangle clipped to the canvas covers 662.43 pixels */
+  ASSERT(fabs(area - 662.43) < 0.5);
+  ASSERT_EQ(255, pixels[(8 * 64 + 0) * 4 + 3]);
+  ASSERT_EQ(0, pixels[(30 * 64 + 0) * 4 + 3]);
+  PASS();
+}
+
+TEST test_msaa_rounded_rect_resolve_texture(void) {
+  static unsigned char pixels[40 * 40 * 4];
+  cmp_msaa_t *msaa = NULL;
+  cmp_texture_t target;
+  cmp_color_t bg = make_color(0.0f, 0.0f, 0.0f, 1.0f);
+  cmp_color_t fg = make_color(1.0f, 1.0f, 1.0f, 0.5f);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_create(4, 40, 40, &msaa));
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_clear(msaa, &bg));
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_fill_rounded_rect(msaa, 4.0f, 4.0f, 32.0f,
+                                                    32.0f, 10.0f, &fg));
+
+  memset(pixels, 0xAB, sizeof(pixels));
+  target.width = 40;
+  target.height = 40;
+  target.format = CMP_TEXTURE_FORMAT_RGBA8_PREMULTIPLIED;
+  target.internal_handle = NULL;
+  target.pixels = pixels;
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_resolve(msaa, &target));
+
+  /* Opaque black background, half-transparent white on top. */
+  ASSERT_EQ(255, pixels[(20 * 40 + 20) * 4 + 3]);
+  ASSERT(abs(pixels[(20 * 40 + 20) * 4 + 0] - 128) <= 1);
+  /* The corner is cut away by the radius... */
+  ASSERT_EQ(0, pixels[(4 * 40 + 4) * 4 + 0]);
+  /* ...while the straight edge is fully covered. */
+  ASSERT(abs(pixels[(4 * 40 + 20) * 4 + 0] - 128) <= 1);
+
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_msaa_fill_rounded_rect(msaa, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+                                       &fg));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_msaa_set_mode(msaa, (cmp_msaa_mode_t)7));
+  ASSERT_EQ(CMP_SUCCESS, cmp_msaa_destroy(msaa));
+  PASS();
+}
+
 SUITE(cmp_msaa_suite) {
   RUN_TEST(test_msaa_create_destroy);
   RUN_TEST(test_msaa_resolve_success);
+  RUN_TEST(test_msaa_resolve_cpu_target);
   RUN_TEST(test_msaa_resolve_bounds_error);
   RUN_TEST(test_msaa_edge_cases);
+  RUN_TEST(test_msaa_analytic_partial_coverage);
+  RUN_TEST(test_msaa_even_odd_hole);
+  RUN_TEST(test_msaa_sparse_stores_edge_samples_only);
+  RUN_TEST(test_msaa_quality_vs_aliased);
+  RUN_TEST(test_msaa_rounded_rect_resolve_texture);
+  RUN_TEST(test_msaa_path_crossing_left_edge);
 }
 
 GREATEST_MAIN_DEFS();
@@ -0,0 +1,453 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if !defined(_WIN32)
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+/* clang-format on */
+
+#if !defined(_WIN32)
+
+#define NET_ECHO_COUNT 200
+#define NET_ECHO_TEXT 50 /* A compressible 4000-byte message */
+#define NET_ECHO_BINARY 100 /* A 100000-byte message read in place */
+
+static void write_all(int fd, const void *data, size_t len) {
+  const char *p = (const char *)data;
+  long n;
+
+  while (len > 0) {
+    n = (long)write(fd, p, len);
+    if (n <= 0) {
+      return;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+}
+
+/* A blocking WebSocket echo server on one end of a socketpair */
+typedef struct echo_server {
+  int fd;
+  int compressed_frames;
+  int frames;
+} echo_server_t;
+
+static void *echo_server_main(void *arg) {
+  echo_server_t *srv = (echo_server_t *)arg;
+  /* RFC 7692 7.2.3.2: "Hello" twice, sharing the sliding window */
+  static const unsigned char k_hello[] = {0xc1, 0x07, 0xf2, 0x48, 0xcd, 0xc9,
+                                          0xc9, 0x07, 0x00, 0xc1, 0x05, 0xf2,
+                                          0x00, 0x11, 0x00, 0x00};
+  size_t cap = 4 * 1024 * 1024, len = 0, pos, used, head = 0, n;
+  unsigned char *buf = (unsigned char *)malloc(cap);
+  unsigned char *out = (unsigned char *)malloc(cap);
+  size_t out_len;
+  char response[512], accept[29], key[64];
+  const char *k;
+  cmp_ws_frame_t frame;
+  int done = 0, deflate;
+  long got;
+
+  while (head == 0) {
+    got = (long)read(srv->fd, buf + len, cap - len - 1);
+    if (got <= 0) {
+      goto out;
+    }
+    len += (size_t)got;
+    buf[len] = '\0';
+    k = strstr((const char *)buf, "\r\n\r\n");
+    if (k != NULL) {
+      head = (size_t)(k - (const char *)buf) + 4;
+    }
+  }
+  k = strstr((const char *)buf, "Sec-WebSocket-Key: ");
+  if (k == NULL) {
+    goto out;
+  }
+  k += 19;
+  for (n = 0; n + 1 < sizeof(key) && k[n] != '\r'; ++n) {
+    key[n] = k[n];
+  }
+  key[n] = '\0';
+  cmp_ws_accept_key(key, accept);
+  deflate = strstr((const char *)buf, "permessage-deflate") != NULL;
+  sprintf(response,
+          "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\n"
+          "Connection: Upgrade\r\nSec-WebSocket-Accept: %s\r\n%s\r\n",
+          accept,
+          deflate ? "Sec-WebSocket-Extensions: permessage-deflate; "
+                    "client_no_context_takeover\r\n"
+                  : "");
+  write_all(srv->fd, response, strlen(response));
+  if (deflate) {
+    write_all(srv->fd, k_hello, sizeof(k_hello));
+  }
+  memmove(buf, buf + head, len - head);
+  len -= head;
+
+  while (!done) {
+    /* Echo every complete frame of a read in one write */
+    pos = 0;
+    out_len = 0;
+    while (cmp_ws_frame_parse(buf + pos, len - pos, &frame, &used) ==
+               CMP_SUCCESS &&
+           used > 0) {
+      pos += used;
+      srv->frames++;
+      srv->compressed_frames += frame.compressed;
+      if (frame.opcode == CMP_WS_OP_CLOSE) {
+        done = 1;
+      }
+      out_len += cmp_ws_frame_header(
+          out + out_len, frame.fin, frame.compressed,
+          frame.opcode == CMP_WS_OP_PING ? CMP_WS_OP_PONG : frame.opcode,
+          frame.payload_len, NULL);
+      memcpy(out + out_len, frame.payload, frame.payload_len);
+      out_len += frame.payload_len;
+    }
+    write_all(srv->fd, out, out_len);
+    memmove(buf, buf + pos, len - pos);
+    len -= pos;
+    if (done) {
+      break;
+    }
+    got = (long)read(srv->fd, buf + len, cap - len);
+    if (got <= 0) {
+      break;
+    }
+    len += (size_t)got;
+  }
+out:
+  free(buf);
+  free(out);
+  return NULL;
+}
+
+typedef struct net_log {
+  cmp_net_stream_t *stream;
+  int messages;
+  int mismatches;
+  int closes;
+  int result;
+  int code;
+  char text[512]; /* event|data|id; per SSE event */
+} net_log_t;
+
+static size_t echo_payload(int i, unsigned char *out) {
+  size_t k;
+
+  if (i == NET_ECHO_TEXT) {
+    for (k = 0; k < 4000; ++k) {
+      out[k] = (unsigned char)('a' + (k % 7));
+    }
+    return 4000;
+  }
+  if (i == NET_ECHO_BINARY) {
+    unsigned long x = 12345;
+    for (k = 0; k < 100000; ++k) {
+      x = (x * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+      out[k] = (unsigned char)(x >> 16);
+    }
+    return 100000;
+  }
+  sprintf((char *)out, "msg %d", i);
+  return strlen((const char *)out);
+}
+
+static void echo_on_batch(cmp_net_stream_t *stream,
+                          const cmp_net_message_t *messages, size_t count,
+                          void *user_data) {
+  static unsigned char expected[100000];
+  net_log_t *log = (net_log_t *)user_data;
+  size_t i, len;
+  int k, index;
+
+  for (i = 0; i < count; ++i) {
+    index = log->messages++ - 2;
+    if (index < 0) {
+      /* The server's greeting, inflated with context takeover */
+      if (messages[i].len != 5 || memcmp(messages[i].data, "Hello", 5) != 0) {
+        log->mismatches++;
+      }
+      continue;
+    }
+    len = echo_payload(index, expected);
+    if (messages[i].len != len ||
+        memcmp(messages[i].data, expected, len) != 0 ||
+        messages[i].opcode != (index == NET_ECHO_BINARY ? CMP_WS_OP_BINARY
+                                                        : CMP_WS_OP_TEXT) ||
+        messages[i].event != NULL) {
+      log->mismatches++;
+    }
+  }
+  if (log->messages == 2) {
+    /* Open with the extension agreed: send everything at once */
+    for (k = 0; k < NET_ECHO_COUNT; ++k) {
+      len = echo_payload(k, expected);
+      cmp_net_stream_send(stream,
+                          k == NET_ECHO_BINARY ? CMP_WS_OP_BINARY
+                                               : CMP_WS_OP_TEXT,
+                          expected, len);
+    }
+  }
+  if (log->messages == 2 + NET_ECHO_COUNT) {
+    cmp_net_stream_close(stream, 0);
+  }
+}
+
+static void net_on_close(cmp_net_stream_t *stream, int result, int code,
+                         void *user_data) {
+  net_log_t *log = (net_log_t *)user_data;
+  (void)stream;
+  log->closes++;
+  log->result = result;
+  log->code = code;
+}
+
+typedef struct net_wait {
+  cmp_modality_t *ui;
+  net_log_t *logs;
+  int count;
+  clock_t deadline;
+} net_wait_t;
+
+static void net_wait_task(void *arg) {
+  net_wait_t *wait = (net_wait_t *)arg;
+  int i, done = 1;
+
+  for (i = 0; i < wait->count; ++i) {
+    done = done && wait->logs[i].closes > 0;
+  }
+  if (done || clock() > wait->deadline) {
+    cmp_modality_stop(wait->ui);
+    return;
+  }
+  cmp_modality_queue_task(wait->ui, net_wait_task, wait);
+}
+
+static void net_run_until_closed(cmp_modality_t *ui, net_log_t *logs,
+                                 int count) {
+  net_wait_t wait;
+
+  wait.ui = ui;
+  wait.logs = logs;
+  wait.count = count;
+  wait.deadline = clock() + 10 * CLOCKS_PER_SEC;
+  cmp_modality_queue_task(ui, net_wait_task, &wait);
+  cmp_modality_run(ui);
+}
+
+TEST test_net_reactor_ws_echo(void) {
+  cmp_net_stream_config_t config;
+  cmp_net_reactor_stats_t stats;
+  cmp_net_reactor_t *reactor;
+  cmp_modality_t ui;
+  echo_server_t server;
+  pthread_t thread;
+  net_log_t log;
+  int fds[2];
+
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  memset(&server, 0, sizeof(server));
+  server.fd = fds[1];
+  ASSERT_EQ(0, pthread_create(&thread, NULL, echo_server_main, &server));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&ui));
+  ASSERT_EQ(CMP_SUCCESS, cmp_net_reactor_create(&ui, &reactor));
+
+  memset(&log, 0, sizeof(log));
+  cmp_net_stream_config_init(&config);
+  config.host = "localhost";
+  config.path = "/echo";
+  config.permessage_deflate = 1;
+  config.on_batch = echo_on_batch;
+  config.on_close = net_on_close;
+  config.user_data = &log;
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_net_reactor_add(reactor, fds[0], &config, &log.stream));
+  net_run_until_closed(&ui, &log, 1);
+  pthread_join(thread, NULL);
+  close(fds[1]);
+
+  ASSERT_EQ(2 + NET_ECHO_COUNT, log.messages);
+  ASSERT_EQ(0, log.mismatches);
+  ASSERT_EQ(1, log.closes);
+  ASSERT_EQ(CMP_SUCCESS, log.result);
+  ASSERT_EQ(1000, log.code);
+  /* Only the compressible message shrank enough to go out deflated */
+  ASSERT_EQ(1, server.compressed_frames);
+  ASSERT_EQ(NET_ECHO_COUNT + 1, server.frames);
+  cmp_net_reactor_get_stats(reactor, &stats);
+  ASSERT_EQ(0, stats.streams);
+  ASSERT(stats.batches < stats.messages);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_net_reactor_destroy(reactor));
+  cmp_modality_destroy(&ui);
+  PASS();
+}
+
+static void sse_on_batch(cmp_net_stream_t *stream,
+                         const cmp_net_message_t *messages, size_t count,
+                         void *user_data) {
+  net_log_t *log = (net_log_t *)user_data;
+  size_t i;
+  (void)stream;
+
+  for (i = 0; i < count; ++i) {
+    log->messages++;
+    if (strlen(log->text) + messages[i].len + 64 < sizeof(log->text)) {
+      sprintf(log->text + strlen(log->text), "%s|%.*s|%s;",
+              messages[i].event, (int)messages[i].len,
+              (const char *)messages[i].data, messages[i].id);
+    }
+  }
+}
+
+TEST test_net_reactor_sse(void) {
+  static const char k_response[] =
+      "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\n"
+      "Transfer-Encoding: chunked\r\n\r\n"
+      "b\r\ndata: one\n\n\r\n"
+      "12\r\n: keep-alive\nevent\r\n"
+      "1c\r\n: tick\ndata: a\ndata: b\nid: 7\r\n"
+      "2\r\n\n\n\r\n"
+      "e\r\ndata: crlf\r\n\r\n\r\n"
+      "0\r\n\r\n";
+  cmp_net_stream_config_t config;
+  cmp_net_reactor_t *reactor;
+  cmp_modality_t ui;
+  net_log_t logs[33];
+  char request[256], event[64];
+  int fds[33][2], i;
+  long n;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&ui));
+  ASSERT_EQ(CMP_SUCCESS, cmp_net_reactor_create(&ui, &reactor));
+  memset(logs, 0, sizeof(logs));
+
+  /* A chunked response with events split across chunks */
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds[0]));
+  write_all(fds[0][1], k_response, sizeof(k_response) - 1);
+  cmp_net_stream_config_init(&config);
+  config.kind = CMP_NET_STREAM_SSE;
+  config.host = "localhost";
+  config.path = "/events";
+  config.on_batch = sse_on_batch;
+  config.on_close = net_on_close;
+  config.user_data = &logs[0];
+  ASSERT_EQ(CMP_SUCCESS, cmp_net_reactor_add(reactor, fds[0][0], &config,
+                                             NULL));
+
+  /* Dozens of subscriptions past their handshake share the one thread */
+  for (i = 1; i < 33; ++i) {
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds[i]));
+    sprintf(event, "data: %d\n\n", i);
+    cmp_net_stream_config_init(&config);
+    config.kind = CMP_NET_STREAM_SSE;
+    config.initial = "data: hi\n\n";
+    config.initial_len = 10;
+    config.on_batch = sse_on_batch;
+    config.on_close = net_on_close;
+    config.user_data = &logs[i];
+    ASSERT_EQ(CMP_SUCCESS, cmp_net_reactor_add(reactor, fds[i][0], &config,
+                                               NULL));
+    write_all(fds[i][1], event, strlen(event));
+    close(fds[i][1]);
+  }
+  net_run_until_closed(&ui, logs, 33);
+
+  n = (long)read(fds[0][1], request, sizeof(request) - 1);
+  ASSERT(n > 0);
+  request[n] = '\0';
+  ASSERT(strstr(request, "GET /events HTTP/1.1\r\n") == request);
+  ASSERT(strstr(request, "Accept: text/event-stream\r\n") != NULL);
+  close(fds[0][1]);
+
+  ASSERT_EQ(3, logs[0].messages);
+  ASSERT_STR_EQ("message|one|;tick|a\nb|7;message|crlf|7;", logs[0].text);
+  ASSERT_EQ(CMP_SUCCESS, logs[0].result);
+  for (i = 1; i < 33; ++i) {
+    sprintf(event, "message|hi|;message|%d|;", i);
+    ASSERT_STR_EQ(event, logs[i].text);
+    ASSERT_EQ(1, logs[i].closes);
+    ASSERT_EQ(CMP_SUCCESS, logs[i].result);
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_net_reactor_destroy(reactor));
+  cmp_modality_destroy(&ui);
+  PASS();
+}
+
+TEST test_net_reactor_protocol_errors(void) {
+  static const unsigned char k_masked[] = {0x81, 0x81, 1, 2, 3, 4, 'x'};
+  static const char k_refused[] = "HTTP/1.1 403 Forbidden\r\n\r\n";
+  cmp_net_stream_config_t config;
+  cmp_net_reactor_t *reactor;
+  cmp_net_stream_t *stream;
+  cmp_modality_t ui;
+  net_log_t logs[2];
+  unsigned char reply[64];
+  int fds[2][2];
+  long n;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&ui));
+  ASSERT_EQ(CMP_SUCCESS, cmp_net_reactor_create(&ui, &reactor));
+  memset(logs, 0, sizeof(logs));
+
+  /* Servers never mask; the client answers with 1002 */
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds[0]));
+  write_all(fds[0][1], k_masked, sizeof(k_masked));
+  cmp_net_stream_config_init(&config);
+  config.on_close = net_on_close;
+  config.user_data = &logs[0];
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_net_reactor_add(reactor, fds[0][0], &config, &stream));
+
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds[1]));
+  write_all(fds[1][1], k_refused, sizeof(k_refused) - 1);
+  config.host = "localhost";
+  config.user_data = &logs[1];
+  ASSERT_EQ(CMP_SUCCESS, cmp_net_reactor_add(reactor, fds[1][0], &config,
+                                             NULL));
+  net_run_until_closed(&ui, logs, 2);
+
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, logs[0].result);
+  ASSERT_EQ(1002, logs[0].code);
+  n = (long)read(fds[0][1], reply, sizeof(reply));
+  ASSERT_EQ(8, n);
+  ASSERT_EQ(0x88, reply[0]);
+  cmp_ws_mask(reply + 6, 2, reply + 2, 0);
+  ASSERT_EQ(1002, (reply[6] << 8) | reply[7]);
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE, logs[1].result);
+  ASSERT_EQ(403, logs[1].code);
+  close(fds[0][1]);
+  close(fds[1][1]);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_net_reactor_destroy(reactor));
+  cmp_modality_destroy(&ui);
+  PASS();
+}
+
+#endif
+
+SUITE(net_reactor_suite) {
+#if !defined(_WIN32)
+  RUN_TEST(test_net_reactor_ws_echo);
+  RUN_TEST(test_net_reactor_sse);
+  RUN_TEST(test_net_reactor_protocol_errors);
+#endif
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(net_reactor_suite);
+  GREATEST_MAIN_END();
+}
@@ -2,6 +2,8 @@
 #include "cmp.h"
 #include "greatest.h"
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 /* clang-format on */
 
@@ -127,11 +129,397 @@ TEST test_orm_features(void) {
   PASS();
 }
 
+typedef struct fake_table {
+  uint64_t ids[64];
+  int values[64];
+  size_t count;
+  int calls;
+} fake_table_t;
+
+static int fake_fetch(c_orm_db_t *db, const char *query, cmp_orm_rows_t *rows,
+                      void *user_data) {
+  fake_table_t *table = (fake_table_t *)user_data;
+  size_t i;
+  int res;
+  (void)db;
+  (void)query;
+  table->calls++;
+  for (i = 0; i < table->count; ++i) {
+    res = cmp_orm_rows_append(rows, table->ids[i], &table->values[i],
+                              sizeof(int));
+    if (res != CMP_SUCCESS) {
+      return res;
+    }
+  }
+  return CMP_SUCCESS;
+}
+
+typedef struct change_log {
+  int calls;
+  size_t inserts;
+  size_t deletes;
+  size_t moves;
+  size_t reloads;
+  size_t rows;
+} change_log_t;
+
+static void on_rows_changed(cmp_orm_observable_t *obs,
+                            const cmp_diff_result_t *diff,
+                            const cmp_orm_rows_t *rows, void *user_data) {
+  change_log_t *log = (change_log_t *)user_data;
+  (void)obs;
+  log->calls++;
+  log->inserts = diff->insert_count;
+  log->deletes = diff->delete_count;
+  log->moves = diff->move_count;
+  log->reloads = diff->reload_count;
+  cmp_orm_rows_get_count(rows, &log->rows);
+}
+
+typedef struct invalidation_log {
+  int calls;
+  cmp_ui_node_t *last_node;
+  const char *last_property;
+} invalidation_log_t;
+
+static void on_invalidate(cmp_ui_node_t *node, const char *property_name,
+                          cmp_orm_observable_t *obs, void *user_data) {
+  invalidation_log_t *log = (invalidation_log_t *)user_data;
+  (void)obs;
+  log->calls++;
+  log->last_node = node;
+  log->last_property = property_name;
+}
+
+static c_orm_db_t *open_reactive_db(void) {
+  c_orm_db_t *db = NULL;
+  cmp_vfs_init();
+  cmp_orm_init();
+  cmp_vfs_mount("virt:/test_db", ".");
+  remove("test_reactive.sqlite");
+  if (cmp_orm_connect("virt:/test_db/test_reactive.sqlite", &db) !=
+      CMP_SUCCESS) {
+    return NULL;
+  }
+  cmp_orm_execute(db, "CREATE TABLE items (id INTEGER PRIMARY KEY, v INT);"
+                      "CREATE TABLE tags (id INTEGER PRIMARY KEY, v INT);"
+                      "CREATE TABLE other (id INTEGER PRIMARY KEY, v INT);"
+                      "CREATE TABLE nested (id INTEGER PRIMARY KEY, v INT);"
+                      "CREATE TABLE unrelated (id INTEGER PRIMARY KEY);");
+  return db;
+}
+
+static void close_reactive_db(c_orm_db_t *db) {
+  cmp_orm_disconnect(db);
+  remove("test_reactive.sqlite");
+  cmp_orm_shutdown();
+  cmp_vfs_shutdown();
+}
+
+TEST test_orm_observable_dependencies(void) {
+  c_orm_db_t *db = open_reactive_db();
+  cmp_orm_observable_t *obs = NULL, *tags = NULL;
+  fake_table_t data, tag_data;
+  int before;
+
+  ASSERT(db != NULL);
+  memset(&data, 0, sizeof(data));
+  memset(&tag_data, 0, sizeof(tag_data));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_orm_observable_create(
+                db,
+                "SELECT a.v FROM items AS a JOIN \"Tags\" t ON t.id = a.id, "
+                "main.other o WHERE a.id IN (SELECT id FROM [nested]);",
+                &obs));
+  ASSERT_EQ(CMP_SUCCESS, cmp_orm_observable_set_fetch(obs, fake_fetch, &data));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_orm_observable_create(db, "SELECT v FROM tags", &tags));
+  cmp_orm_observable_set_fetch(tags, fake_fetch, &tag_data);
+
+  /* The first tick loads, later ones only re-query after writes */
+  ASSERT_EQ(CMP_SUCCESS, cmp_orm_tick(0.0, NULL, NULL));
+  ASSERT_EQ(1, data.calls);
+  ASSERT_EQ(1, tag_data.calls);
+  cmp_orm_tick(16.0, NULL, NULL);
+  ASSERT_EQ(1, data.calls);
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_orm_execute(db, "INSERT INTO unrelated (id) VALUES (1);"));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_orm_execute(db, "-- INSERT INTO items\n"
+                                "SELECT 'DELETE FROM items; ' /* ; */;"));
+  cmp_orm_tick(32.0, NULL, NULL);
+  ASSERT_EQ(1, data.calls);
+
+  before = data.calls;
+  cmp_orm_execute(db, "UPDATE OR IGNORE TAGS SET v = 1;");
+  cmp_orm_tick(48.0, NULL, NULL);
+  ASSERT_EQ(before + 1, data.calls);
+  ASSERT_EQ(2, tag_data.calls);
+  cmp_orm_execute(db, "DELETE FROM main.other;");
+  cmp_orm_tick(64.0, NULL, NULL);
+  ASSERT_EQ(before + 2, data.calls);
+  cmp_orm_execute(db, "insert into nested (v) values (2);");
+  cmp_orm_tick(80.0, NULL, NULL);
+  ASSERT_EQ(before + 3, data.calls);
+  cmp_orm_execute(db, "WITH c(x) AS (SELECT 1 FROM unrelated) "
+                      "INSERT OR REPLACE INTO items (v) SELECT x FROM c;");
+  cmp_orm_tick(96.0, NULL, NULL);
+  ASSERT_EQ(before + 4, data.calls);
+  ASSERT_EQ(2, tag_data.calls);
+
+  /* A rollback may undo writes to any table */
+  cmp_orm_execute(db, "BEGIN; DELETE FROM items; ROLLBACK;");
+  cmp_orm_tick(112.0, NULL, NULL);
+  ASSERT_EQ(3, tag_data.calls);
+
+  /* Writes that bypass cmp_orm_execute and hidden dependencies */
+  ASSERT_EQ(CMP_SUCCESS, cmp_orm_notify_changed(db, "ITEMS"));
+  cmp_orm_tick(128.0, NULL, NULL);
+  ASSERT_EQ(3, tag_data.calls);
+  ASSERT_EQ(before + 6, data.calls);
+  ASSERT_EQ(CMP_SUCCESS, cmp_orm_observable_add_table(tags, "audit"));
+  cmp_orm_notify_changed(db, "audit");
+  cmp_orm_tick(144.0, NULL, NULL);
+  ASSERT_EQ(4, tag_data.calls);
+  ASSERT_EQ(before + 6, data.calls);
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_orm_notify_changed(NULL, "items"));
+
+  cmp_orm_observable_destroy(tags);
+  cmp_orm_execute(db, "UPDATE tags SET v = 2;");
+  cmp_orm_tick(160.0, NULL, NULL);
+  ASSERT_EQ(before + 7, data.calls);
+
+  cmp_orm_observable_destroy(obs);
+  close_reactive_db(db);
+  PASS();
+}
+
+TEST test_orm_observable_row_diff(void) {
+  c_orm_db_t *db = open_reactive_db();
+  cmp_orm_observable_t *obs = NULL;
+  const cmp_orm_rows_t *rows = NULL;
+  const void *payload;
+  fake_table_t data;
+  change_log_t log;
+  uint64_t id;
+  size_t i, size, count;
+
+  ASSERT(db != NULL);
+  memset(&data, 0, sizeof(data));
+  memset(&log, 0, sizeof(log));
+  for (i = 0; i < 10; ++i) {
+    data.ids[i] = 100 + i;
+    data.values[i] = (int)i;
+  }
+  data.count = 10;
+  ASSERT_EQ(CMP_SUCCESS, cmp_orm_observable_create(
+                             db, "SELECT id, v FROM items ORDER BY id", &obs));
+  cmp_orm_observable_set_fetch(obs, fake_fetch, &data);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_orm_observable_set_change_handler(obs, on_rows_changed, &log));
+  cmp_orm_tick(0.0, NULL, NULL);
+  ASSERT_EQ(1, log.calls);
+  ASSERT_EQ(10, log.inserts);
+  ASSERT_EQ(10, log.rows);
+
+  /* Delete 103, change 105, append 110 */
+  memmove(&data.ids[3], &data.ids[4], 6 * sizeof(uint64_t));
+  memmove(&data.values[3], &data.values[4], 6 * sizeof(int));
+  data.values[4] = 55;
+  data.ids[9] = 110;
+  data.values[9] = 10;
+  cmp_orm_execute(db, "UPDATE items SET v = v + 1;");
+  cmp_orm_tick(16.0, NULL, NULL);
+  ASSERT_EQ(2, log.calls);
+  ASSERT_EQ(1, log.deletes);
+  ASSERT_EQ(1, log.inserts);
+  ASSERT_EQ(0, log.moves);
+  ASSERT_EQ(1, log.reloads);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_orm_observable_get_rows(obs, &rows));
+  ASSERT_EQ(CMP_SUCCESS, cmp_orm_rows_get_count(rows, &count));
+  ASSERT_EQ(10, count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_orm_rows_get(rows, 4, &id, &payload, &size));
+  ASSERT_EQ(105, id);
+  ASSERT_EQ(sizeof(int), size);
+  ASSERT_EQ(55, *(const int *)payload);
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_orm_rows_get(rows, 10, &id, NULL, NULL));
+
+  /* A write that leaves the result as it was is not reported */
+  cmp_orm_execute(db, "UPDATE items SET v = v;");
+  cmp_orm_tick(32.0, NULL, NULL);
+  ASSERT_EQ(3, data.calls);
+  ASSERT_EQ(2, log.calls);
+
+  cmp_orm_observable_destroy(obs);
+  close_reactive_db(db);
+  PASS();
+}
+
+TEST test_orm_observable_coalesced_invalidation(void) {
+  c_orm_db_t *db = open_reactive_db();
+  cmp_orm_observable_t *obs = NULL;
+  cmp_ui_node_t *label = NULL, *badge = NULL;
+  invalidation_log_t inv;
+  fake_table_t data;
+  char sql[64];
+  double t;
+  int i;
+
+  ASSERT(db != NULL);
+  memset(&data, 0, sizeof(data));
+  memset(&inv, 0, sizeof(inv));
+  ASSERT_EQ(CMP_SUCCESS, cmp_ui_text_input_create(&label));
+  ASSERT_EQ(CMP_SUCCESS, cmp_ui_text_input_create(&badge));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_orm_observable_create(db, "SELECT count(*) FROM items", &obs));
+  cmp_orm_observable_set_fetch(obs, fake_fetch, &data);
+  ASSERT_EQ(CMP_SUCCESS, cmp_orm_observable_set_debounce(obs, 50.0));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_orm_observable_set_debounce(obs, -1.0));
+  ASSERT_EQ(CMP_SUCCESS, cmp_ui_node_bind(label, obs, "text"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_ui_node_bind(badge, obs, "value"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_ui_node_bind(badge, obs, "count"));
+
+  /* The first result waits out the debounce too */
+  cmp_orm_tick(0.0, on_invalidate, &inv);
+  ASSERT_EQ(0, data.calls);
+  cmp_orm_tick(50.0, on_invalidate, &inv);
+  ASSERT_EQ(1, data.calls);
+  ASSERT_EQ(2, inv.calls);
+  cmp_orm_tick(66.0, on_invalidate, &inv);
+  ASSERT_EQ(2, inv.calls);
+
+  /* A bulk insert is one re-query and one invalidation per binding */
+  cmp_orm_execute(db, "BEGIN;");
+  for (i = 0; i < 1000; ++i) {
+    sprintf(sql, "INSERT INTO items (v) VALUES (%d);", i);
+    ASSERT_EQ(CMP_SUCCESS, cmp_orm_execute(db, sql));
+  }
+  cmp_orm_execute(db, "COMMIT;");
+  data.count = 1;
+  data.ids[0] = 1;
+  data.values[0] = 1000;
+  cmp_orm_tick(82.0, on_invalidate, &inv);
+  cmp_orm_tick(98.0, on_invalidate, &inv);
+  ASSERT_EQ(1, data.calls);
+  cmp_orm_tick(132.0, on_invalidate, &inv);
+  ASSERT_EQ(2, data.calls);
+  ASSERT_EQ(4, inv.calls);
+  ASSERT_EQ(CMP_SUCCESS, cmp_ui_node_unbind(badge, obs));
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND, cmp_ui_node_unbind(badge, obs));
+
+  /* A steady stream of writes still refreshes within a few intervals */
+  for (t = 148.0; t < 148.0 + 50.0 * CMP_ORM_DEBOUNCE_MAX_INTERVALS;
+       t += 16.0) {
+    data.values[0]++;
+    cmp_orm_execute(db, "INSERT INTO items (v) VALUES (0);");
+    cmp_orm_tick(t, on_invalidate, &inv);
+    ASSERT_EQ(2, data.calls);
+  }
+  data.values[0]++;
+  cmp_orm_execute(db, "INSERT INTO items (v) VALUES (0);");
+  cmp_orm_tick(t, on_invalidate, &inv);
+  ASSERT_EQ(3, data.calls);
+  ASSERT_EQ(5, inv.calls);
+  ASSERT(inv.last_node == label);
+  ASSERT_STR_EQ("text", inv.last_property);
+
+  cmp_orm_observable_destroy(obs);
+  cmp_ui_node_destroy(label);
+  cmp_ui_node_destroy(badge);
+  close_reactive_db(db);
+  PASS();
+}
+
+typedef struct refresh_wait {
+  cmp_modality_t *ui;
+  cmp_orm_observable_t *obs;
+  clock_t deadline;
+} refresh_wait_t;
+
+static void refresh_wait_task(void *arg) {
+  refresh_wait_t *wait = (refresh_wait_t *)arg;
+  int refreshing = 1;
+  cmp_orm_observable_is_refreshing(wait->obs, &refreshing);
+  if (!refreshing || clock() > wait->deadline) {
+    cmp_modality_stop(wait->ui);
+    return;
+  }
+  cmp_modality_queue_task(wait->ui, refresh_wait_task, wait);
+}
+
+TEST test_orm_observable_workers(void) {
+  c_orm_db_t *db = open_reactive_db();
+  cmp_orm_observable_t *obs = NULL;
+  cmp_ui_node_t *node = NULL;
+  cmp_modality_t workers, ui;
+  invalidation_log_t inv;
+  refresh_wait_t wait;
+  fake_table_t data;
+  change_log_t log;
+  int refreshing = 0;
+
+  ASSERT(db != NULL);
+  memset(&data, 0, sizeof(data));
+  memset(&inv, 0, sizeof(inv));
+  memset(&log, 0, sizeof(log));
+  data.ids[0] = 7;
+  data.count = 1;
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_threaded_init(&workers, 2));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&ui));
+  ASSERT_EQ(CMP_SUCCESS, cmp_ui_text_input_create(&node));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_orm_observable_create(db, "SELECT v FROM items", &obs));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_orm_observable_set_workers(obs, &ui, &ui));
+  ASSERT_EQ(CMP_SUCCESS, cmp_orm_observable_set_workers(obs, &workers, &ui));
+  cmp_orm_observable_set_fetch(obs, fake_fetch, &data);
+  cmp_orm_observable_set_change_handler(obs, on_rows_changed, &log);
+  cmp_ui_node_bind(node, obs, "text");
+
+  /* The tick returns at once and the result lands on ui */
+  ASSERT_EQ(CMP_SUCCESS, cmp_orm_tick(0.0, on_invalidate, &inv));
+  cmp_orm_observable_is_refreshing(obs, &refreshing);
+  ASSERT_EQ(1, refreshing);
+  ASSERT_EQ(0, log.calls);
+  memset(&wait, 0, sizeof(wait));
+  wait.ui = &ui;
+  wait.obs = obs;
+  wait.deadline = clock() + 10 * CLOCKS_PER_SEC;
+  cmp_modality_queue_task(&ui, refresh_wait_task, &wait);
+  cmp_modality_run(&ui);
+  ASSERT_EQ(1, log.calls);
+  ASSERT_EQ(1, log.rows);
+  ASSERT_EQ(0, inv.calls);
+  cmp_orm_tick(16.0, on_invalidate, &inv);
+  ASSERT_EQ(1, inv.calls);
+
+  /* Destroying with a re-query in flight defers the release to ui */
+  cmp_orm_execute(db, "DELETE FROM items;");
+  cmp_orm_tick(32.0, on_invalidate, &inv);
+  ASSERT_EQ(CMP_SUCCESS, cmp_orm_observable_destroy(obs));
+  wait.obs = NULL;
+  wait.deadline = clock() + CLOCKS_PER_SEC / 4;
+  cmp_modality_queue_task(&ui, refresh_wait_task, &wait);
+  cmp_modality_run(&ui);
+
+  cmp_modality_destroy(&workers);
+  cmp_modality_destroy(&ui);
+  cmp_ui_node_destroy(node);
+  close_reactive_db(db);
+  PASS();
+}
+
 SUITE(orm_suite) {
   RUN_TEST(test_orm_lifecycle);
   RUN_TEST(test_orm_db_connection);
   RUN_TEST(test_orm_default_path);
   RUN_TEST(test_orm_features);
+  RUN_TEST(test_orm_observable_dependencies);
+  RUN_TEST(test_orm_observable_row_diff);
+  RUN_TEST(test_orm_observable_coalesced_invalidation);
+  RUN_TEST(test_orm_observable_workers);
 }
 
 GREATEST_MAIN_DEFS();
@@ -2,10 +2,164 @@
 #include <cmp.h>
 #include <greatest.h>
 #include <stdlib.h>
+#include <string.h>
 /* clang-format on */
 
 SUITE(cmp_print_ctx_suite);
 
+/* Five glyphs: .notdef, A, B, C (a composite of A) and space; U+1F600
+ * maps to B through a format 12 cmap. */
+static const unsigned char k_tiny_ttf[676] = {
+    0x00, 0x01, 0x00, 0x00, 0x00, 0x08, 0x00, 0x80, 0x00, 0x03, 0x00, 0x00,
+    0x63, 0x6d, 0x61, 0x70, 0x00, 0x8b, 0xed, 0xbc, 0x00, 0x00, 0x01, 0x1c,
+    0x00, 0x00, 0x00, 0x78, 0x67, 0x6c, 0x79, 0x66, 0x3d, 0x71, 0xfe, 0xc8,
+    0x00, 0x00, 0x01, 0xa0, 0x00, 0x00, 0x00, 0x5c, 0x68, 0x65, 0x61, 0x64,
+    0x2f, 0x96, 0x1b, 0x64, 0x00, 0x00, 0x00, 0x8c, 0x00, 0x00, 0x00, 0x36,
+    0x68, 0x68, 0x65, 0x61, 0x05, 0xac, 0x01, 0xc8, 0x00, 0x00, 0x00, 0xc4,
+    0x00, 0x00, 0x00, 0x24, 0x68, 0x6d, 0x74, 0x78, 0x09, 0xc4, 0x00, 0x64,
+    0x00, 0x00, 0x01, 0x08, 0x00, 0x00, 0x00, 0x14, 0x6c, 0x6f, 0x63, 0x61,
+    0x00, 0x48, 0x00, 0x61, 0x00, 0x00, 0x01, 0x94, 0x00, 0x00, 0x00, 0x0c,
+    0x6d, 0x61, 0x78, 0x70, 0x00, 0x09, 0x00, 0x0a, 0x00, 0x00, 0x00, 0xe8,
+    0x00, 0x00, 0x00, 0x20, 0x6e, 0x61, 0x6d, 0x65, 0xac, 0xb9, 0xa1, 0x33,
+    0x00, 0x00, 0x01, 0xfc, 0x00, 0x00, 0x00, 0xa5, 0x00, 0x01, 0x00, 0x00,
+    0x00, 0x01, 0x00, 0x00, 0x11, 0x3f, 0xec, 0xee, 0x5f, 0x0f, 0x3c, 0xf5,
+    0x00, 0x03, 0x03, 0xe8, 0x00, 0x00, 0x00, 0x00, 0xe6, 0xfa, 0xeb, 0xe2,
+    0x00, 0x00, 0x00, 0x00, 0xe6, 0xfa, 0xeb, 0xe6, 0x00, 0x00, 0x00, 0x00,
+    0x02, 0x8a, 0x02, 0xbc, 0x00, 0x00, 0x00, 0x03, 0x00, 0x02, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x03, 0x20, 0xff, 0x38,
+    0x00, 0x00, 0x02, 0x8a, 0x00, 0x00, 0x00, 0x00, 0x02, 0x8a, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x05, 0x00, 0x01, 0x00, 0x00, 0x00, 0x05, 0x00, 0x04,
+    0x00, 0x01, 0x00, 0x03, 0x00, 0x01, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01,
+    0x01, 0xf4, 0x00, 0x32, 0x02, 0x58, 0x00, 0x00, 0x01, 0xf4, 0x00, 0x00,
+    0x02, 0x8a, 0x00, 0x32, 0x00, 0xfa, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+    0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x1c, 0x00, 0x03, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x1c, 0x00, 0x03, 0x00, 0x0a, 0x00, 0x00, 0x00, 0x44,
+    0x00, 0x04, 0x00, 0x28, 0x00, 0x00, 0x00, 0x06, 0x00, 0x04, 0x00, 0x01,
+    0x00, 0x02, 0x00, 0x20, 0x00, 0x43, 0xff, 0xff, 0x00, 0x00, 0x00, 0x20,
+    0x00, 0x41, 0xff, 0xff, 0xff, 0xe4, 0xff, 0xc0, 0x00, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x34,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x20,
+    0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x41,
+    0x00, 0x00, 0x00, 0x43, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0xf6, 0x00,
+    0x00, 0x01, 0xf6, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x0d,
+    0x00, 0x1a, 0x00, 0x26, 0x00, 0x2e, 0x00, 0x2e, 0x00, 0x01, 0x00, 0x32,
+    0x00, 0x00, 0x01, 0xc2, 0x02, 0xbc, 0x00, 0x03, 0x00, 0x00, 0x33, 0x11,
+    0x21, 0x11, 0x32, 0x01, 0x90, 0x02, 0xbc, 0xfd, 0x44, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x02, 0x58, 0x02, 0xbc, 0x00, 0x02, 0x00, 0x00,
+    0x31, 0x01, 0x01, 0x01, 0x2c, 0x01, 0x2c, 0x02, 0xbc, 0xfd, 0x44, 0x00,
+    0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x01, 0xf4, 0x02, 0xbc, 0x00, 0x03,
+    0x00, 0x00, 0x31, 0x11, 0x21, 0x11, 0x01, 0xf4, 0x02, 0xbc, 0xfd, 0x44,
+    0xff, 0xff, 0x00, 0x32, 0x00, 0x00, 0x02, 0x8a, 0x02, 0xbc, 0x00, 0x06,
+    0x00, 0x01, 0x32, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x4e, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x07, 0x00, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x07, 0x00, 0x07, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x0f, 0x00, 0x0e, 0x00, 0x03,
+    0x00, 0x01, 0x04, 0x09, 0x00, 0x01, 0x00, 0x0e, 0x00, 0x1d, 0x00, 0x03,
+    0x00, 0x01, 0x04, 0x09, 0x00, 0x02, 0x00, 0x0e, 0x00, 0x2b, 0x00, 0x03,
+    0x00, 0x01, 0x04, 0x09, 0x00, 0x06, 0x00, 0x1e, 0x00, 0x39, 0x43, 0x6d,
+    0x70, 0x54, 0x65, 0x73, 0x74, 0x52, 0x65, 0x67, 0x75, 0x6c, 0x61, 0x72,
+    0x43, 0x6d, 0x70, 0x54, 0x65, 0x73, 0x74, 0x2d, 0x52, 0x65, 0x67, 0x75,
+    0x6c, 0x61, 0x72, 0x00, 0x43, 0x00, 0x6d, 0x00, 0x70, 0x00, 0x54, 0x00,
+    0x65, 0x00, 0x73, 0x00, 0x74, 0x00, 0x52, 0x00, 0x65, 0x00, 0x67, 0x00,
+    0x75, 0x00, 0x6c, 0x00, 0x61, 0x00, 0x72, 0x00, 0x43, 0x00, 0x6d, 0x00,
+    0x70, 0x00, 0x54, 0x00, 0x65, 0x00, 0x73, 0x00, 0x74, 0x00, 0x2d, 0x00,
+    0x52, 0x00, 0x65, 0x00, 0x67, 0x00, 0x75, 0x00, 0x6c, 0x00, 0x61, 0x00,
+    0x72, 0x00, 0x00, 0x00};
+
+typedef struct {
+  unsigned char *data;
+  size_t len;
+  size_t cap;
+} test_sink_t;
+
+static int test_sink_write(void *user_data, const unsigned char *data,
+                           size_t len) {
+  test_sink_t *s = (test_sink_t *)user_data;
+  if (s->len + len > s->cap) {
+    return 1;
+  }
+  memcpy(s->data + s->len, data, len);
+  s->len += len;
+  return 0;
+}
+
+static const char *test_find(const char *hay, size_t hay_len,
+                             const char *needle) {
+  size_t n = strlen(needle), i;
+  for (i = 0; i + n <= hay_len; ++i) {
+    if (memcmp(hay + i, needle, n) == 0) {
+      return hay + i;
+    }
+  }
+  return NULL;
+}
+
+/* Inflates the stream whose dictionary starts at or after dict. */
+static int test_inflate_stream(const char *pdf, size_t pdf_len,
+                               const char *dict, test_sink_t *out) {
+  const char *len_at, *data;
+  cmp_inflate_t *inf = NULL;
+  long len;
+  int res;
+
+  len_at = test_find(dict, pdf_len - (size_t)(dict - pdf), "/Length ");
+  data = test_find(dict, pdf_len - (size_t)(dict - pdf), "stream\n");
+  if (!len_at || !data) {
+    return CMP_ERROR_NOT_FOUND;
+  }
+  len = strtol(len_at + 8, NULL, 10);
+  data += 7;
+  if (strncmp(len_at + 8 + strspn(len_at + 8, "0123456789"), " 0 R", 4) ==
+      0) {
+    /* Indirect length: the content stream ends at endstream. */
+    const char *end =
+        test_find(data, pdf_len - (size_t)(data - pdf), "\nendstream");
+    if (!end) {
+      return CMP_ERROR_NOT_FOUND;
+    }
+    len = (long)(end - data);
+  }
+  res = cmp_inflate_create(1, test_sink_write, out, &inf);
+  if (res == CMP_SUCCESS) {
+    res = cmp_inflate_push(inf, data, (size_t)len);
+  }
+  if (res == CMP_SUCCESS) {
+    res = cmp_inflate_finish(inf);
+  }
+  cmp_inflate_destroy(inf);
+  return res;
+}
+
+/* Every xref entry must point at its "N 0 obj" header. */
+static int test_xref_valid(const char *pdf, size_t len) {
+  const char *sx = test_find(pdf, len, "startxref\n");
+  const char *x;
+  long at, count, i;
+  char expect[32];
+
+  if (!sx) {
+    return 0;
+  }
+  at = strtol(sx + 10, NULL, 10);
+  if (at <= 0 || (size_t)at >= len || strncmp(pdf + at, "xref\n0 ", 7) != 0) {
+    return 0;
+  }
+  count = strtol(pdf + at + 7, NULL, 10);
+  x = strchr(pdf + at + 7, '\n') + 1 + 20;
+  for (i = 1; i < count; ++i, x += 20) {
+    long off = strtol(x, NULL, 10);
+    sprintf(expect, "%ld 0 obj\n", i);
+    if (off <= 0 || (size_t)off >= len ||
+        strncmp(pdf + off, expect, strlen(expect)) != 0) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+
 TEST test_cmp_print_ctx_create_destroy(void) {
   cmp_print_ctx_t *ctx = NULL;
 
@@ -57,15 +211,282 @@ TEST test_cmp_print_ctx_lifecycle(void) {
   PASS();
 }
 
+TEST test_cmp_deflate_round_trip(void) {
+  static unsigned char input[70000];
+  test_sink_t packed, unpacked;
+  cmp_deflate_t *d = NULL;
+  cmp_inflate_t *inf = NULL;
+  unsigned long seed = 12345;
+  size_t i, at;
+
+  /* Text-like runs followed by noise, longer than one window. */
+  for (i = 0; i < 40000; ++i) {
+    input[i] = (unsigned char)("0 0 m 10 20 l h f\n"[i % 18]);
+  }
+  for (; i < sizeof(input); ++i) {
+    seed = (seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+    input[i] = (unsigned char)(seed >> 16);
+  }
+
+  packed.cap = sizeof(input) + 1024;
+  packed.len = 0;
+  packed.data = (unsigned char *)malloc(packed.cap);
+  unpacked.cap = sizeof(input);
+  unpacked.len = 0;
+  unpacked.data = (unsigned char *)malloc(unpacked.cap);
+  ASSERT(packed.data != NULL && unpacked.data != NULL);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_deflate_create(1, test_sink_write, &packed, &d));
+  for (at = 0; at < sizeof(input); at += 777) {
+    size_t n = sizeof(input) - at < 777 ? sizeof(input) - at : 777;
+    ASSERT_EQ(CMP_SUCCESS, cmp_deflate_push(d, input + at, n));
+  }
+  ASSERT_EQ(CMP_SUCCESS, cmp_deflate_finish(d));
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE, cmp_deflate_push(d, input, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_deflate_destroy(d));
+
+  /* The repetitive half collapses; the noise costs little over stored. */
+  ASSERT(packed.len < 30000 + 400);
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_inflate_create(1, test_sink_write, &unpacked, &inf));
+  ASSERT_EQ(CMP_SUCCESS, cmp_inflate_push(inf, packed.data, packed.len));
+  ASSERT_EQ(CMP_SUCCESS, cmp_inflate_finish(inf));
+  ASSERT_EQ(CMP_SUCCESS, cmp_inflate_destroy(inf));
+  ASSERT_EQ(sizeof(input), unpacked.len);
+  ASSERT_MEM_EQ(input, unpacked.data, sizeof(input));
+
+  free(packed.data);
+  free(unpacked.data);
+  PASS();
+}
+
+TEST test_cmp_print_ctx_streaming_document(void) {
+  static const char *path = "test_print_stream.pdf";
+  static unsigned char opaque[8 * 8 * 4], translucent[4 * 4 * 4];
+  cmp_print_ctx_t *ctx = NULL;
+  cmp_print_stats_t stats;
+  cmp_color_t red = {1.0f, 0.0f, 0.0f, 1.0f, CMP_COLOR_SPACE_SRGB};
+  cmp_color_t glass = {0.0f, 0.0f, 1.0f, 0.5f, CMP_COLOR_SPACE_SRGB};
+  float tri[6] = {10.0f, 10.0f, 50.0f, 10.0f, 30.0f, 40.0f};
+  size_t tri_count = 3;
+  test_sink_t content;
+  void *file = NULL;
+  size_t file_len = 0;
+  const char *pdf;
+  int font = -1, page;
+  size_t i;
+
+  for (i = 0; i < sizeof(opaque); ++i) {
+    opaque[i] = (unsigned char)((i % 4) == 3 ? 255 : i * 7);
+  }
+  for (i = 0; i < sizeof(translucent); ++i) {
+    translucent[i] = (unsigned char)(i * 13);
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_create(&ctx));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_print_ctx_add_font(ctx, k_tiny_ttf, sizeof(k_tiny_ttf), &font));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_begin_document(ctx, path));
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE, cmp_print_ctx_begin_document(ctx, path));
+
+  for (page = 0; page < 3; ++page) {
+    ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_begin_page(ctx));
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_print_ctx_fill_rect(ctx, 20.0f, 30.0f, 100.0f, 50.0f, &red));
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_print_ctx_fill_path(ctx, tri, &tri_count, 1, 1, &glass));
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_print_ctx_stroke_path(ctx, tri, 3, 1, 2.0f, &red));
+    ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_draw_text(ctx, font, 12.0f, 72.0f,
+                                                   100.0f, "AB", &red));
+    /* The same pixels on every page are written once. */
+    ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_draw_image(ctx, opaque, 8, 8, 32,
+                                                    200.0f, 200.0f, 64.0f,
+                                                    64.0f));
+    ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_draw_image(ctx, translucent, 4, 4, 16,
+                                                    300.0f, 200.0f, 32.0f,
+                                                    32.0f));
+    ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_end_page(ctx));
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_get_stats(ctx, &stats));
+  ASSERT_EQ(3, stats.pages);
+  ASSERT_EQ(2, stats.images_written);
+  ASSERT_EQ(4, stats.images_deduplicated);
+  ASSERT(stats.bytes_written > 0);
+
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_print_ctx_save_pdf(ctx, "other.pdf"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_save_pdf(ctx, path));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_destroy(ctx));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_read_file_sync(path, &file, &file_len));
+  pdf = (const char *)file;
+  ASSERT_EQ(0, strncmp(pdf, "%PDF-1.7\n", 9));
+  ASSERT(test_find(pdf, file_len, "%%EOF\n") != NULL);
+  ASSERT(test_xref_valid(pdf, file_len));
+  ASSERT(test_find(pdf, file_len, "/Count 3") != NULL);
+  ASSERT(test_find(pdf, file_len, "/SMask") != NULL);
+  ASSERT(test_find(pdf, file_len, "+CmpTest-Regular") != NULL);
+  ASSERT(test_find(pdf, file_len, "/GA128 << /ca 0.502 /CA 0.502 >>") != NULL);
+
+  content.cap = 4096;
+  content.len = 0;
+  content.data = (unsigned char *)malloc(content.cap + 1);
+  ASSERT(content.data != NULL);
+  ASSERT_EQ(CMP_SUCCESS, test_inflate_stream(pdf, file_len, pdf, &content));
+  content.data[content.len] = '\0';
+  /* Top-left origin: the rect's bottom edge is 842 - 30 - 50. */
+  ASSERT(strstr((char *)content.data, "1 0 0 rg\n20 762 100 50 re f\n"));
+  ASSERT(strstr((char *)content.data, "f* Q\n"));
+  ASSERT(strstr((char *)content.data, "BT /F0 12 Tf 72 742 Td <00010002> Tj"));
+  ASSERT(strstr((char *)content.data, " Do Q\n"));
+
+  free(content.data);
+  CMP_FREE(file);
+  remove(path);
+  PASS();
+}
+
+TEST test_cmp_print_ctx_font_subset(void) {
+  static const char *path = "test_print_font.pdf";
+  cmp_print_ctx_t *ctx = NULL;
+  cmp_color_t black = {0.0f, 0.0f, 0.0f, 1.0f, CMP_COLOR_SPACE_SRGB};
+  test_sink_t ttf, cmap;
+  void *file = NULL;
+  size_t file_len = 0;
+  const char *pdf, *ff;
+  const unsigned char *loca = NULL;
+  unsigned int tables, t;
+  int font = -1;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_create(&ctx));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_print_ctx_add_font(ctx, k_tiny_ttf, 100, &font));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_print_ctx_add_font(ctx, k_tiny_ttf, sizeof(k_tiny_ttf), &font));
+  ASSERT_EQ(0, font);
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE,
+            cmp_print_ctx_draw_text(ctx, font, 10.0f, 0.0f, 0.0f, "C", &black));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_set_page_size(ctx, 200.0f, 100.0f));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_begin_page(ctx));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_print_ctx_draw_text(ctx, 1, 10.0f, 0.0f, 0.0f, "C", &black));
+  /* C is a composite of A; U+1F600 resolves through the format 12 cmap. */
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_draw_text(ctx, font, 10.0f, 5.0f, 50.0f,
+                                                 "C \xF0\x9F\x98\x80", &black));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_end_page(ctx));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_save_pdf(ctx, path));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_destroy(ctx));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_read_file_sync(path, &file, &file_len));
+  pdf = (const char *)file;
+  ASSERT(test_xref_valid(pdf, file_len));
+  ASSERT(test_find(pdf, file_len, "/MediaBox [0 0 200 100]") != NULL);
+  ASSERT(test_find(pdf, file_len, "/W [0 [500 600 500 650 250] ]") != NULL);
+
+  /* The embedded font keeps glyph ids; only drawn glyphs (and the
+   * components they use) have outlines. */
+  ff = test_find(pdf, file_len, "/Length1 ");
+  ASSERT(ff != NULL);
+  ttf.cap = 4096;
+  ttf.len = 0;
+  ttf.data = (unsigned char *)malloc(ttf.cap);
+  ASSERT(ttf.data != NULL);
+  ASSERT_EQ(CMP_SUCCESS, test_inflate_stream(pdf, file_len, ff, &ttf));
+  ASSERT_EQ((size_t)strtol(ff + 9, NULL, 10), ttf.len);
+  tables = ((unsigned int)ttf.data[4] << 8) | ttf.data[5];
+  for (t = 0; t < tables; ++t) {
+    const unsigned char *rec = ttf.data + 12 + t * 16;
+    if (memcmp(rec, "loca", 4) == 0) {
+      loca = ttf.data + (((unsigned long)rec[10] << 8) | rec[11]);
+    }
+  }
+  ASSERT(loca != NULL);
+  /* Long offsets: glyph g spans loca[g]..loca[g + 1]. */
+#define TEST_LOCA(g)                                                           \
+  (((unsigned long)loca[4 * (g) + 2] << 8) | loca[4 * (g) + 3])
+  ASSERT(TEST_LOCA(1) > TEST_LOCA(0)); /* .notdef */
+  ASSERT(TEST_LOCA(2) > TEST_LOCA(1)); /* A, via C */
+  ASSERT(TEST_LOCA(3) > TEST_LOCA(2)); /* B, via U+1F600 */
+  ASSERT(TEST_LOCA(4) > TEST_LOCA(3)); /* C */
+#undef TEST_LOCA
+
+  cmap.cap = 4096;
+  cmap.len = 0;
+  cmap.data = (unsigned char *)malloc(cmap.cap + 1);
+  ASSERT(cmap.data != NULL);
+  ASSERT_EQ(CMP_SUCCESS,
+            test_inflate_stream(pdf, file_len,
+                                test_find(ff, file_len - (size_t)(ff - pdf),
+                                          "endobj"),
+                                &cmap));
+  cmap.data[cmap.len] = '\0';
+  ASSERT(strstr((char *)cmap.data, "<0002> <D83DDE00>"));
+  ASSERT(strstr((char *)cmap.data, "<0003> <0043>"));
+
+  free(ttf.data);
+  free(cmap.data);
+  CMP_FREE(file);
+  remove(path);
+  PASS();
+}
+
+TEST test_cmp_print_ctx_font_bad_cmap(void) {
+  static const char *path = "test_print_bad_cmap.pdf";
+  cmp_print_ctx_t *ctx = NULL;
+  cmp_color_t black = {0.0f, 0.0f, 0.0f, 1.0f, CMP_COLOR_SPACE_SRGB};
+  unsigned char ttf[sizeof(k_tiny_ttf)];
+  void *file = NULL;
+  size_t file_len = 0;
+  int font = -1;
+
+  /* Format 12 subtable (cmap + 0x44) claiming 8 bytes and 2^24 groups:
+   * it must be skipped for the format 4 one, not searched out of bounds. */
+  memcpy(ttf, k_tiny_ttf, sizeof(ttf));
+  ttf[0x164] = 0;
+  ttf[0x165] = 0;
+  ttf[0x166] = 0;
+  ttf[0x167] = 8;
+  ttf[0x16c] = 1;
+  ttf[0x16d] = 0;
+  ttf[0x16e] = 0;
+  ttf[0x16f] = 0;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_create(&ctx));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_add_font(ctx, ttf, sizeof(ttf), &font));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_begin_page(ctx));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_draw_text(ctx, font, 10.0f, 5.0f, 50.0f,
+                                                 "\xF0\x9F\x98\x80", &black));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_end_page(ctx));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_save_pdf(ctx, path));
+  ASSERT_EQ(CMP_SUCCESS, cmp_print_ctx_destroy(ctx));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_read_file_sync(path, &file, &file_len));
+  ASSERT(test_xref_valid((const char *)file, file_len));
+  /* U+1F600 falls back to .notdef through the format 4 subtable. */
+  ASSERT(test_find((const char *)file, file_len, "/W [0 [500] ]") != NULL);
+  CMP_FREE(file);
+  remove(path);
+  PASS();
+}
+
 SUITE(cmp_print_ctx_suite) {
   RUN_TEST(test_cmp_print_ctx_create_destroy);
   RUN_TEST(test_cmp_print_ctx_lifecycle);
+  RUN_TEST(test_cmp_deflate_round_trip);
+  RUN_TEST(test_cmp_print_ctx_streaming_document);
+  RUN_TEST(test_cmp_print_ctx_font_subset);
+  RUN_TEST(test_cmp_print_ctx_font_bad_cmap);
 }
 
 GREATEST_MAIN_DEFS();
 
 int main(int argc, char **argv) {
   GREATEST_MAIN_BEGIN();
+  cmp_vfs_init();
   RUN_SUITE(cmp_print_ctx_suite);
+  cmp_vfs_shutdown();
   GREATEST_MAIN_END();
 }
@@ -1,6 +1,7 @@
 /* clang-format off */
 #include "cmp.h"
 #include "greatest.h"
+#include <stdio.h>
 #include <string.h>
 /* clang-format on */
 
@@ -208,12 +209,140 @@ TEST test_split_view(void) {
   PASS();
 }
 
+static cmp_router_t *g_param_router = NULL;
+static char g_built_id[32];
+
+/* Reads its parameter while being built, as a view would */
+static void *param_view_builder(const char *uri) {
+  const cmp_route_match_t *match = NULL;
+  const char *value;
+  size_t len;
+  (void)uri;
+  g_built_id[0] = '\0';
+  if (cmp_router_get_match(g_param_router, &match) == CMP_SUCCESS &&
+      cmp_route_match_get_param(match, "id", &value, &len) == CMP_SUCCESS &&
+      len < sizeof(g_built_id)) {
+    memcpy(g_built_id, value, len);
+    g_built_id[len] = '\0';
+  }
+  return NULL;
+}
+
+static int param_is(const cmp_route_match_t *match, const char *name,
+                    const char *expected) {
+  const char *value;
+  size_t len;
+  if (cmp_route_match_get_param(match, name, &value, &len) != CMP_SUCCESS)
+    return 0;
+  return len == strlen(expected) && memcmp(value, expected, len) == 0;
+}
+
+TEST test_router_param_extraction(void) {
+  cmp_router_t *router = NULL;
+  cmp_route_match_t match;
+  const cmp_route_match_t *active = NULL;
+
+  cmp_router_create(&router);
+  g_param_router = router;
+  ASSERT_EQ(CMP_SUCCESS, cmp_router_register(router, "/user/:id",
+                                             param_view_builder, NULL, NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_router_register(router, "/user/new",
+                                             dummy_builder, NULL, NULL));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_router_register(router, "/user/:id/posts/:post",
+                                dummy_builder, NULL, NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_router_register(router, "/user/new/posts/all",
+                                             dummy_builder, NULL, NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_router_register(router, "/files/*path",
+                                             dummy_builder, NULL, NULL));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_router_register(router, "/files/*path/more", dummy_builder,
+                                NULL, NULL));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_router_register(router, "/:a/:b/:c/:d/:e/:f/:g/:h/:i",
+                                dummy_builder, NULL, NULL));
+
+  /* Static beats parameter */
+  ASSERT_EQ(CMP_SUCCESS, cmp_router_match(router, "/user/new", &match));
+  ASSERT_STR_EQ("/user/new", match.pattern);
+  ASSERT_EQ(0, (int)match.param_count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_router_match(router, "/user/42", &match));
+  ASSERT_STR_EQ("/user/:id", match.pattern);
+  ASSERT(param_is(&match, "id", "42"));
+
+  /* A static branch that dead-ends falls back to the parameter */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_router_match(router, "/user/new/posts/7", &match));
+  ASSERT_STR_EQ("/user/:id/posts/:post", match.pattern);
+  ASSERT(param_is(&match, "id", "new"));
+  ASSERT(param_is(&match, "post", "7"));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_router_match(router, "/user/new/posts/all", &match));
+  ASSERT_EQ(0, (int)match.param_count);
+
+  /* Wildcards take the rest; slashes repeat harmlessly */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_router_match(router, "//files/a/b//c.txt/", &match));
+  ASSERT(param_is(&match, "path", "a/b//c.txt"));
+  ASSERT(!param_is(&match, "id", ""));
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND, cmp_router_match(router, "/files", &match));
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND, cmp_router_match(router, "/users", &match));
+
+  /* Builders see the parameters of the route they build */
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND, cmp_router_get_match(router, &active));
+  ASSERT_EQ(CMP_SUCCESS, cmp_router_push(router, "/user/7"));
+  ASSERT_STR_EQ("7", g_built_id);
+  ASSERT_EQ(CMP_SUCCESS, cmp_router_push(router, "/user/1234"));
+  ASSERT_STR_EQ("1234", g_built_id);
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND, cmp_router_push(router, "/nowhere"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_router_get_match(router, &active));
+  ASSERT(param_is(active, "id", "1234"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_router_pop(router));
+  ASSERT_STR_EQ("7", g_built_id);
+  ASSERT_EQ(CMP_SUCCESS, cmp_router_replace(router, "/user/99"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_router_get_match(router, &active));
+  ASSERT(param_is(active, "id", "99"));
+
+  cmp_router_destroy(router);
+  g_param_router = NULL;
+  PASS();
+}
+
+TEST test_router_deep_link_burst(void) {
+  cmp_router_t *router = NULL;
+  cmp_route_match_t match;
+  char path[64];
+  size_t i, hits = 0;
+
+  cmp_router_create(&router);
+  for (i = 0; i < 1000; ++i) {
+    sprintf(path, "/section%lu/item/:id/detail", (unsigned long)i);
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_router_register(router, path, dummy_builder, NULL, NULL));
+  }
+
+  for (i = 0; i < 200000; ++i) {
+    sprintf(path, "/section%lu/item/%lu/detail", (unsigned long)(i % 1000),
+            (unsigned long)i);
+    if (cmp_router_match(router, path, &match) == CMP_SUCCESS)
+      hits++;
+  }
+  ASSERT_EQ(200000, (int)hits);
+  ASSERT(param_is(&match, "id", "199999"));
+  ASSERT_STR_EQ("/section999/item/:id/detail", match.pattern);
+
+  cmp_router_destroy(router);
+  PASS();
+}
+
 SUITE(router_suite) {
   RUN_TEST(test_router_lifecycle);
   RUN_TEST(test_router_navigation);
   RUN_TEST(test_routing_styles);
   RUN_TEST(test_split_view);
   RUN_TEST(test_router_dynamic_params);
+  RUN_TEST(test_router_param_extraction);
+  RUN_TEST(test_router_deep_link_burst);
 }
 
 GREATEST_MAIN_DEFS();
@@ -0,0 +1,55 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+#include <string.h>
+/* clang-format on */
+
+TEST test_sha256_vectors(void) {
+  static const char *abc =
+      "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+  static const char *million =
+      "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+  static const char *empty =
+      "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+  unsigned char digest[32];
+  unsigned char a[997];
+  char hex[65];
+  cmp_sha256_t sha;
+  size_t left, n;
+
+  cmp_sha256_init(&sha);
+  cmp_sha256_update(&sha, "abc", 3);
+  cmp_sha256_final(&sha, digest);
+  cmp_sha256_hex(digest, hex);
+  ASSERT_STR_EQ(abc, hex);
+
+  cmp_sha256_init(&sha);
+  cmp_sha256_final(&sha, digest);
+  cmp_sha256_hex(digest, hex);
+  ASSERT_STR_EQ(empty, hex);
+
+  /* FIPS 180-2 B.3 in uneven pieces */
+  memset(a, 'a', sizeof(a));
+  cmp_sha256_init(&sha);
+  for (left = 1000000; left > 0; left -= n) {
+    n = left < sizeof(a) ? left : sizeof(a);
+    n = n > 63 && left % 2 ? 63 : n;
+    cmp_sha256_update(&sha, a, n);
+  }
+  cmp_sha256_final(&sha, digest);
+  cmp_sha256_hex(digest, hex);
+  ASSERT_STR_EQ(million, hex);
+  PASS();
+}
+
+SUITE(sha256_suite) {
+  RUN_TEST(test_sha256_vectors);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(sha256_suite);
+  GREATEST_MAIN_END();
+}
@@ -1,8 +1,23 @@
 /* clang-format off */
 #include "cmp.h"
 #include "greatest.h"
+
+#include <stdio.h>
+#include <string.h>
 /* clang-format on */
 
+static const char *const g_words[] = {
+    "hello", "world", "the",    "is",   "a",     "of",    "don't", "quoted",
+    "car",   "cars",  "card",   "care", "cart",  "careful", "cat", "Paris",
+    "test",  "text",  "tests",  "car",  "help",  "hell",  "yellow", "words"};
+#define WORD_COUNT (sizeof(g_words) / sizeof(g_words[0]))
+
+static int verify(cmp_spellcheck_t *spellcheck, const char *word) {
+  int ok = -1;
+  cmp_spellcheck_verify_word(spellcheck, word, &ok);
+  return ok;
+}
+
 TEST test_spellcheck_lifecycle(void) {
   cmp_spellcheck_t *spellcheck = NULL;
   int res = cmp_spellcheck_create(&spellcheck);
@@ -45,6 +60,13 @@ TEST test_spellcheck_verify(void) {
 
   cmp_spellcheck_create(&spellcheck);
 
+  /* Without a dictionary nothing is flagged */
+  res = cmp_spellcheck_verify_word(spellcheck, "xylophone", &v);
+  ASSERT_EQ(CMP_SUCCESS, res);
+  ASSERT_EQ(1, v);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_build_dictionary(spellcheck, g_words, WORD_COUNT));
+
   res = cmp_spellcheck_verify_word(spellcheck, "hello", &v);
   ASSERT_EQ(CMP_SUCCESS, res);
   ASSERT_EQ(1, v);
@@ -57,10 +79,241 @@ TEST test_spellcheck_verify(void) {
   PASS();
 }
 
+TEST test_spellcheck_dictionary(void) {
+  cmp_spellcheck_t *spellcheck = NULL;
+  size_t i;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_create(&spellcheck));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_build_dictionary(spellcheck, g_words, WORD_COUNT));
+  for (i = 0; i < WORD_COUNT; ++i) {
+    ASSERT_EQ(1, verify(spellcheck, g_words[i]));
+  }
+  /* Prefixes, extensions and near misses of shared paths */
+  ASSERT_EQ(0, verify(spellcheck, "ca"));
+  ASSERT_EQ(0, verify(spellcheck, "carefu"));
+  ASSERT_EQ(0, verify(spellcheck, "cards"));
+  ASSERT_EQ(0, verify(spellcheck, "hel"));
+  ASSERT_EQ(0, verify(spellcheck, "worlds"));
+  /* Case forms */
+  ASSERT_EQ(1, verify(spellcheck, "Hello"));
+  ASSERT_EQ(1, verify(spellcheck, "HELLO"));
+  ASSERT_EQ(0, verify(spellcheck, "hELLO"));
+  ASSERT_EQ(1, verify(spellcheck, "PARIS"));
+  ASSERT_EQ(0, verify(spellcheck, "paris"));
+  /* Too long to check */
+  ASSERT_EQ(1, verify(spellcheck, "https://example.com/a/very/long/path/that/"
+                                  "is/not/a/word/at/all/really"));
+
+  ASSERT_EQ(0, verify(spellcheck, "cmp"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_add_word(spellcheck, "cmp"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_add_word(spellcheck, "cmp"));
+  ASSERT_EQ(1, verify(spellcheck, "cmp"));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_spellcheck_add_word(spellcheck, ""));
+
+  /* An empty list gives an empty dictionary */
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_build_dictionary(spellcheck, NULL, 0));
+  ASSERT_EQ(0, verify(spellcheck, "hello"));
+  ASSERT_EQ(1, verify(spellcheck, "cmp"));
+
+  cmp_spellcheck_destroy(spellcheck);
+  PASS();
+}
+
+TEST test_spellcheck_compiled(void) {
+  static const char *const blobs[] = {"", "CMPDAWG", "CMPDAWG\0\1\0\0\0"
+                                                    "\0\0\0\0\2\0\0\0"
+                                                    "\0\0\0\0\0\1\0\0"
+                                                    "\0\xfc\0\0"};
+  static const size_t sizes[] = {0, 7, 32};
+  cmp_spellcheck_t *spellcheck = NULL;
+  size_t i;
+  FILE *f;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_vfs_init());
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_create(&spellcheck));
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE,
+            cmp_spellcheck_save_dictionary(spellcheck, "test_spell.dawg"));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_build_dictionary(spellcheck, g_words, WORD_COUNT));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_save_dictionary(spellcheck, "test_spell.dawg"));
+  cmp_spellcheck_destroy(spellcheck);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_create(&spellcheck));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_load_dictionary(spellcheck, "test_spell.dawg"));
+  for (i = 0; i < WORD_COUNT; ++i) {
+    ASSERT_EQ(1, verify(spellcheck, g_words[i]));
+  }
+  ASSERT_EQ(0, verify(spellcheck, "carefu"));
+
+  /* A bad file leaves the loaded dictionary in place */
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    f = fopen("test_spell_bad.dawg", "wb");
+    ASSERT(f != NULL);
+    fwrite(blobs[i], 1, sizes[i], f);
+    fclose(f);
+    ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+              cmp_spellcheck_load_dictionary(spellcheck,
+                                             "test_spell_bad.dawg"));
+  }
+  ASSERT(cmp_spellcheck_load_dictionary(spellcheck, "test_spell_none.dawg") !=
+         CMP_SUCCESS);
+  ASSERT_EQ(1, verify(spellcheck, "careful"));
+  ASSERT_EQ(0, verify(spellcheck, "carefu"));
+
+  cmp_spellcheck_destroy(spellcheck);
+  remove("test_spell.dawg");
+  remove("test_spell_bad.dawg");
+  cmp_vfs_shutdown();
+  PASS();
+}
+
+TEST test_spellcheck_suggest(void) {
+  cmp_spellcheck_t *spellcheck = NULL;
+  cmp_spell_suggestion_t out[4];
+  size_t count;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_create(&spellcheck));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_suggest(spellcheck, "teh", 2, out, 4, &count));
+  ASSERT_EQ(0, count);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_build_dictionary(spellcheck, g_words, WORD_COUNT));
+
+  /* A swap is one edit */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_suggest(spellcheck, "teh", 1, out, 4, &count));
+  ASSERT_EQ(1, count);
+  ASSERT_STR_EQ("the", out[0].word);
+  ASSERT_EQ(1, out[0].distance);
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_suggest(spellcheck, "helo", 2, out, 4, &count));
+  ASSERT_EQ(3, count);
+  ASSERT_STR_EQ("hell", out[0].word);
+  ASSERT_STR_EQ("hello", out[1].word);
+  ASSERT_STR_EQ("help", out[2].word);
+  ASSERT_EQ(1, out[2].distance);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_suggest(spellcheck, "helo", 2, out, 2, &count));
+  ASSERT_EQ(2, count);
+  ASSERT_STR_EQ("hello", out[1].word);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_suggest(spellcheck, "yelo", 2, out, 4, &count));
+  ASSERT_EQ(4, count);
+  ASSERT_STR_EQ("hell", out[0].word);
+  ASSERT_STR_EQ("yellow", out[3].word);
+  ASSERT_EQ(2, out[3].distance);
+
+  /* The word itself is not a suggestion; case follows the input */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_suggest(spellcheck, "Carts", 1, out, 4, &count));
+  ASSERT_EQ(2, count);
+  ASSERT_STR_EQ("Cars", out[0].word);
+  ASSERT_STR_EQ("Cart", out[1].word);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_suggest(spellcheck, "WROLD", 1, out, 4, &count));
+  ASSERT_EQ(1, count);
+  ASSERT_STR_EQ("WORLD", out[0].word);
+
+  cmp_spellcheck_destroy(spellcheck);
+  PASS();
+}
+
+TEST test_spellcheck_check_text(void) {
+  const char *text = "Ths is a tset of don't, h264 and 'quoted' wrds\n"
+                     "car\xe2\x80\x94"
+                     "cart don\xe2\x80\x99t xyz";
+  cmp_spellcheck_t *spellcheck = NULL;
+  cmp_spell_range_t ranges[8];
+  size_t count;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_create(&spellcheck));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_build_dictionary(spellcheck, g_words, WORD_COUNT));
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_add_word(spellcheck,
+                                                 "don\xe2\x80\x99t"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_check_text(spellcheck, text,
+                                                   strlen(text), ranges, 8,
+                                                   &count));
+  ASSERT_EQ(5, count);
+  ASSERT_EQ(0, ranges[0].offset);
+  ASSERT_EQ(3, ranges[0].length);
+  ASSERT_EQ(9, ranges[1].offset);
+  ASSERT_EQ(4, ranges[1].length);
+  ASSERT_EQ(29, ranges[2].offset); /* "and" */
+  ASSERT_EQ(42, ranges[3].offset);
+  ASSERT_EQ(4, ranges[3].length);
+  ASSERT_EQ(strlen(text) - 3, ranges[4].offset);
+
+  /* A full buffer stops early; the caller resumes after the last range */
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_check_text(spellcheck, text,
+                                                   strlen(text), ranges, 2,
+                                                   &count));
+  ASSERT_EQ(2, count);
+  ASSERT_EQ(9, ranges[1].offset);
+
+  cmp_spellcheck_destroy(spellcheck);
+  PASS();
+}
+
+/* A large generated word list: reports build time, image size and lookup
+ * and suggestion rates. */
+TEST test_spellcheck_large_dictionary(void) {
+  static const char *const parts[] = {"con", "pre", "struc", "tion", "al",
+                                      "ing", "er",  "s",     "ize",  "ment",
+                                      "ly",  "re",  "ver",   "sat",  "ab"};
+  enum { PARTS = 15, WORDS = PARTS * PARTS * PARTS * PARTS };
+  cmp_spellcheck_t *spellcheck = NULL;
+  cmp_spell_suggestion_t out[8];
+  const char **words;
+  char *store;
+  size_t i, count, checked = 0;
+
+  words = (const char **)malloc(WORDS * sizeof(*words));
+  store = (char *)malloc(WORDS * 24);
+  ASSERT(words != NULL && store != NULL);
+  for (i = 0; i < WORDS; ++i) {
+    char *w = store + i * 24;
+    sprintf(w, "%s%s%s%s", parts[i % PARTS], parts[i / PARTS % PARTS],
+            parts[i / (PARTS * PARTS) % PARTS],
+            parts[i / (PARTS * PARTS * PARTS)]);
+    words[i] = w;
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_create(&spellcheck));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_spellcheck_build_dictionary(spellcheck, words, WORDS));
+
+  for (i = 0; i < WORDS; ++i) {
+    checked += (size_t)verify(spellcheck, words[i]);
+  }
+  ASSERT_EQ(WORDS, checked);
+  ASSERT_EQ(0, verify(spellcheck, "construcxtion"));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_spellcheck_suggest(spellcheck, "prestructoinly",
+                                                2, out, 8, &count));
+  ASSERT(count > 0);
+  ASSERT_STR_EQ("prestructionly", out[0].word);
+  ASSERT_EQ(1, out[0].distance);
+
+  cmp_spellcheck_destroy(spellcheck);
+  free(store);
+  free((void *)words);
+  PASS();
+}
+
 SUITE(spellcheck_suite) {
   RUN_TEST(test_spellcheck_lifecycle);
   RUN_TEST(test_spellcheck_null_args);
   RUN_TEST(test_spellcheck_verify);
+  RUN_TEST(test_spellcheck_dictionary);
+  RUN_TEST(test_spellcheck_compiled);
+  RUN_TEST(test_spellcheck_suggest);
+  RUN_TEST(test_spellcheck_check_text);
+  RUN_TEST(test_spellcheck_large_dictionary);
 }
 
 GREATEST_MAIN_DEFS();
@@ -0,0 +1,289 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+
+#include <stdlib.h>
+#include <string.h>
+/* clang-format on */
+
+/* Finds the type of the span covering offset, CMP_TOKEN_NORMAL if none. */
+static cmp_token_type_t span_type_at(const cmp_highlight_span_t *spans,
+                                     size_t count, size_t offset) {
+  size_t i;
+  for (i = 0; i < count; ++i) {
+    if (offset >= spans[i].start_offset &&
+        offset < spans[i].start_offset + spans[i].length)
+      return spans[i].type;
+  }
+  return CMP_TOKEN_NORMAL;
+}
+
+static size_t offset_of(const char *src, const char *needle) {
+  return (size_t)(strstr(src, needle) - src);
+}
+
+TEST test_parse_c(void) {
+  cmp_syntax_highlighter_t *hl = NULL;
+  cmp_highlight_span_t *spans = NULL;
+  size_t count = 0;
+  const char *src = "static int f(void) {\n"
+                    "  /* multi\n"
+                    "     line */ return g(\"s\\\"x\", 0x1F) + 1.5e-3; // end\n"
+                    "}\n";
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_highlighter_create(&hl));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_syntax_highlighter_parse(hl, src, "c", &spans, &count));
+  ASSERT_EQ(CMP_TOKEN_KEYWORD, span_type_at(spans, count, 0));
+  ASSERT_EQ(CMP_TOKEN_FUNCTION,
+            span_type_at(spans, count, offset_of(src, "f(")));
+  ASSERT_EQ(CMP_TOKEN_COMMENT,
+            span_type_at(spans, count, offset_of(src, "line")));
+  ASSERT_EQ(CMP_TOKEN_KEYWORD,
+            span_type_at(spans, count, offset_of(src, "return")));
+  ASSERT_EQ(CMP_TOKEN_FUNCTION,
+            span_type_at(spans, count, offset_of(src, "g(")));
+  ASSERT_EQ(CMP_TOKEN_STRING,
+            span_type_at(spans, count, offset_of(src, "x\"")));
+  ASSERT_EQ(CMP_TOKEN_NUMBER, span_type_at(spans, count, offset_of(src, "1F")));
+  ASSERT_EQ(CMP_TOKEN_NUMBER, span_type_at(spans, count, offset_of(src, "-3")));
+  ASSERT_EQ(CMP_TOKEN_OPERATOR,
+            span_type_at(spans, count, offset_of(src, "+")));
+  ASSERT_EQ(CMP_TOKEN_COMMENT,
+            span_type_at(spans, count, offset_of(src, "end")));
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_highlighter_free_spans(spans));
+
+  /* Unknown languages still get strings and numbers */
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_highlighter_parse(hl, "x = \"a\" 42",
+                                                      "cobol", &spans, &count));
+  ASSERT_EQ(2, (int)count);
+  ASSERT_EQ(CMP_TOKEN_STRING, spans[0].type);
+  ASSERT_EQ(CMP_TOKEN_NUMBER, spans[1].type);
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_highlighter_free_spans(spans));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_highlighter_destroy(hl));
+  PASS();
+}
+
+TEST test_parse_js_json_markdown(void) {
+  cmp_syntax_highlighter_t *hl = NULL;
+  cmp_highlight_span_t *spans = NULL;
+  size_t count = 0;
+  const char *js = "const $el = `a\n${b}` ; await load();";
+  const char *json = "{\"k\": [true, null, -1]}";
+  const char *md = "# Title\n"
+                   "- item with `code` and [link](http://x)\n"
+                   "```\n"
+                   "# not a heading\n"
+                   "```\n"
+                   "> quote\n";
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_highlighter_create(&hl));
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_syntax_highlighter_parse(hl, js, "javascript", &spans, &count));
+  ASSERT_EQ(CMP_TOKEN_KEYWORD, span_type_at(spans, count, 0));
+  ASSERT_EQ(CMP_TOKEN_STRING,
+            span_type_at(spans, count, offset_of(js, "${b}")));
+  ASSERT_EQ(CMP_TOKEN_KEYWORD,
+            span_type_at(spans, count, offset_of(js, "await")));
+  ASSERT_EQ(CMP_TOKEN_FUNCTION,
+            span_type_at(spans, count, offset_of(js, "load")));
+  ASSERT_EQ(CMP_TOKEN_NORMAL, span_type_at(spans, count, offset_of(js, "el")));
+  cmp_syntax_highlighter_free_spans(spans);
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_syntax_highlighter_parse(hl, json, "json", &spans, &count));
+  ASSERT_EQ(CMP_TOKEN_STRING, span_type_at(spans, count, 1));
+  ASSERT_EQ(CMP_TOKEN_KEYWORD,
+            span_type_at(spans, count, offset_of(json, "true")));
+  ASSERT_EQ(CMP_TOKEN_KEYWORD,
+            span_type_at(spans, count, offset_of(json, "null")));
+  ASSERT_EQ(CMP_TOKEN_NUMBER,
+            span_type_at(spans, count, offset_of(json, "1]")));
+  cmp_syntax_highlighter_free_spans(spans);
+
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_syntax_highlighter_parse(hl, md, "md", &spans, &count));
+  ASSERT_EQ(CMP_TOKEN_KEYWORD, span_type_at(spans, count, 0));
+  ASSERT_EQ(CMP_TOKEN_OPERATOR,
+            span_type_at(spans, count, offset_of(md, "- ")));
+  ASSERT_EQ(CMP_TOKEN_STRING,
+            span_type_at(spans, count, offset_of(md, "code")));
+  ASSERT_EQ(CMP_TOKEN_FUNCTION,
+            span_type_at(spans, count, offset_of(md, "link")));
+  ASSERT_EQ(CMP_TOKEN_STRING,
+            span_type_at(spans, count, offset_of(md, "# not")));
+  ASSERT_EQ(CMP_TOKEN_COMMENT,
+            span_type_at(spans, count, offset_of(md, "quote")));
+  cmp_syntax_highlighter_free_spans(spans);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_highlighter_destroy(hl));
+  PASS();
+}
+
+/* Highlights a whole buffer from scratch, for comparison. */
+static int fresh_spans(const cmp_text_buffer_t *tb, const char *language,
+                       size_t first, size_t lines, cmp_highlight_span_t **out,
+                       size_t *out_count) {
+  cmp_syntax_document_t *doc = NULL;
+  const cmp_highlight_span_t *spans;
+  int res = cmp_syntax_document_create(tb, language, &doc);
+  if (res != CMP_SUCCESS)
+    return res;
+  res = cmp_syntax_document_highlight(doc, first, lines, &spans, out_count);
+  if (res == CMP_SUCCESS) {
+    *out = (cmp_highlight_span_t *)malloc(*out_count * sizeof(**out) + 1);
+    if (*out_count)
+      memcpy(*out, spans, *out_count * sizeof(**out));
+  }
+  cmp_syntax_document_destroy(doc);
+  return res;
+}
+
+TEST test_document_incremental_matches_fresh(void) {
+  static const char *const k_snippets[] = {"/*", "*/", "\"", "x = 1;\n",
+                                           "\n", "int", "// c\n", "`"};
+  cmp_text_buffer_t *tb = NULL;
+  cmp_syntax_document_t *doc = NULL;
+  unsigned long rng = 7;
+  int step;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_create(&tb));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_set_text(tb, "a\nb\nc\n", 6));
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_document_create(tb, "js", &doc));
+
+  for (step = 0; step < 600; ++step) {
+    size_t len, at, line_a, line_b, lines;
+    const cmp_highlight_span_t *spans;
+    cmp_highlight_span_t *expect = NULL;
+    size_t count, expect_count, first;
+    const char *snip;
+
+    cmp_text_buffer_get_length(tb, &len);
+    rng = (rng * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+    at = (rng >> 8) % (len + 1);
+    cmp_text_buffer_offset_to_line(tb, at, &line_a, NULL);
+    if ((rng & 3) == 0 && at < len) {
+      size_t n = (rng >> 4) % 6 + 1;
+      if (n > len - at)
+        n = len - at;
+      cmp_text_buffer_offset_to_line(tb, at + n, &line_b, NULL);
+      cmp_text_buffer_delete(tb, at, n);
+      ASSERT_EQ(CMP_SUCCESS,
+                cmp_syntax_document_edit(doc, line_a, line_b, line_a));
+    } else {
+      snip = k_snippets[(rng >> 12) % 8];
+      cmp_text_buffer_insert(tb, at, snip, strlen(snip));
+      cmp_text_buffer_offset_to_line(tb, at + strlen(snip), &line_b, NULL);
+      ASSERT_EQ(CMP_SUCCESS,
+                cmp_syntax_document_edit(doc, line_a, line_a, line_b));
+    }
+
+    /* Look at a random window, as a scrolling viewport would */
+    cmp_text_buffer_get_line_count(tb, &lines);
+    first = (rng >> 16) % lines;
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_syntax_document_highlight(doc, first, 5, &spans, &count));
+    ASSERT_EQ(CMP_SUCCESS,
+              fresh_spans(tb, "js", first, 5, &expect, &expect_count));
+    ASSERT_EQ(expect_count, count);
+    if (count > 0)
+      ASSERT_MEM_EQ(expect, spans, count * sizeof(cmp_highlight_span_t));
+    free(expect);
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_document_destroy(doc));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_destroy(tb));
+  PASS();
+}
+
+TEST test_document_large_file_benchmark(void) {
+  /* 100k-line file: a keystroke relexes a handful of lines; opening a block
+   * comment relexes to the viewport, and closing it converges again. */
+  const size_t line_count = 100000;
+  const char *line = "int value = compute(42); // tail\n";
+  size_t line_len = strlen(line), i, lexed_before, lexed_after, count;
+  char *text = (char *)malloc(line_count * line_len);
+  cmp_text_buffer_t *tb = NULL;
+  cmp_syntax_document_t *doc = NULL;
+  const cmp_highlight_span_t *spans;
+  int done = 0;
+
+  ASSERT(text != NULL);
+  for (i = 0; i < line_count; ++i)
+    memcpy(text + i * line_len, line, line_len);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_create(&tb));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_text_buffer_set_text(tb, text, line_count * line_len));
+  free(text);
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_document_create(tb, "c", &doc));
+
+  /* Viewport first: nothing below the viewport is lexed yet */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_syntax_document_highlight(doc, 0, 60, &spans, &count));
+  cmp_syntax_document_get_lexed_line_count(doc, &lexed_after);
+  ASSERT_EQ(60, (int)lexed_after);
+
+  /* Idle-time catch-up in bounded slices */
+  while (!done)
+    ASSERT_EQ(CMP_SUCCESS, cmp_syntax_document_advance(doc, 20000, &done));
+
+  /* Single character edit in the middle of the file */
+  cmp_syntax_document_get_lexed_line_count(doc, &lexed_before);
+  cmp_text_buffer_insert(tb, 50000 * line_len + 4, "x", 1);
+  cmp_syntax_document_edit(doc, 50000, 50000, 50000);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_syntax_document_highlight(doc, 99940, 60, &spans, &count));
+  cmp_syntax_document_get_lexed_line_count(doc, &lexed_after);
+  ASSERT(lexed_after - lexed_before <= 62);
+  ASSERT_EQ(CMP_TOKEN_KEYWORD,
+            span_type_at(spans, count, 99950 * line_len + 1 + 0));
+
+  /* Open a block comment and look only at the top: lines are relexed down
+   * to the viewport, no further. Closing it again converges just below. */
+  cmp_syntax_document_get_lexed_line_count(doc, &lexed_before);
+  cmp_text_buffer_insert(tb, 10 * line_len, "/*\n", 3);
+  cmp_syntax_document_edit(doc, 10, 10, 11);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_syntax_document_highlight(doc, 0, 60, &spans, &count));
+  ASSERT_EQ(CMP_TOKEN_COMMENT, span_type_at(spans, count, 20 * line_len));
+  cmp_text_buffer_delete(tb, 10 * line_len, 3);
+  cmp_syntax_document_edit(doc, 10, 11, 10);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_syntax_document_highlight(doc, 99940, 60, &spans, &count));
+  cmp_syntax_document_get_lexed_line_count(doc, &lexed_after);
+  ASSERT(lexed_after - lexed_before <= 200);
+  ASSERT_EQ(CMP_TOKEN_KEYWORD,
+            span_type_at(spans, count, 99950 * line_len + 1));
+
+  /* Opening it for real changes the state of every following line */
+  cmp_text_buffer_insert(tb, 10 * line_len, "/*\n", 3);
+  cmp_syntax_document_edit(doc, 10, 10, 11);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_syntax_document_highlight(doc, 99941, 60, &spans, &count));
+  ASSERT_EQ(CMP_TOKEN_COMMENT,
+            span_type_at(spans, count, 99950 * line_len + 4));
+
+  ASSERT_EQ(CMP_ERROR_BOUNDS,
+            cmp_syntax_document_highlight(doc, line_count + 5, 1, &spans,
+                                          &count));
+  ASSERT_EQ(CMP_SUCCESS, cmp_syntax_document_destroy(doc));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_destroy(tb));
+  PASS();
+}
+
+SUITE(syntax_highlight_suite) {
+  RUN_TEST(test_parse_c);
+  RUN_TEST(test_parse_js_json_markdown);
+  RUN_TEST(test_document_incremental_matches_fresh);
+  RUN_TEST(test_document_large_file_benchmark);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(syntax_highlight_suite);
+  GREATEST_MAIN_END();
+}
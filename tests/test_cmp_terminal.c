@@ -0,0 +1,257 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+/* clang-format on */
+
+static void feed(cmp_term_t *term, const char *s) {
+  cmp_term_feed(term, s, strlen(s));
+}
+
+/* Visible text of a row with trailing blanks removed; empty cells read as
+ * spaces. */
+static const char *row_text(const cmp_term_t *term, size_t row, size_t cols) {
+  static char buf[256];
+  const cmp_term_cell_t *cells;
+  size_t i, end = 0;
+  cmp_term_get_row(term, row, &cells);
+  for (i = 0; i < cols; ++i) {
+    buf[i] = cells[i].codepoint ? (char)cells[i].codepoint : ' ';
+    if (cells[i].codepoint)
+      end = i + 1;
+  }
+  buf[end] = '\0';
+  return buf;
+}
+
+TEST test_term_print_and_wrap(void) {
+  cmp_term_t *term = NULL;
+  const cmp_term_cell_t *cells;
+  size_t row, col;
+  int visible;
+
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_term_create(&term, 0, 4, 10));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_create(&term, 10, 4, 10));
+
+  feed(term, "hello\r\nworld");
+  ASSERT_STR_EQ("hello", row_text(term, 0, 10));
+  ASSERT_STR_EQ("world", row_text(term, 1, 10));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_get_cursor(term, &row, &col, &visible));
+  ASSERT_EQ(1, row);
+  ASSERT_EQ(5, col);
+  ASSERT_EQ(1, visible);
+
+  /* Writing the last column defers the wrap until the next character */
+  feed(term, "\r\n0123456789");
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_get_cursor(term, &row, &col, NULL));
+  ASSERT_EQ(2, row);
+  ASSERT_EQ(9, col);
+  feed(term, "X\tY\b\bZ");
+  ASSERT_STR_EQ("X      ZY", row_text(term, 3, 10));
+
+  /* Without autowrap the last column is overwritten */
+  feed(term, "\033[?7l\r\nabcdefghijklmn\033[?7h\033[?25l");
+  ASSERT_STR_EQ("abcdefghin", row_text(term, 3, 10));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_get_cursor(term, &row, &col, &visible));
+  ASSERT_EQ(0, visible);
+
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_term_get_row(term, 4, &cells));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_destroy(term));
+  PASS();
+}
+
+TEST test_term_csi_editing(void) {
+  cmp_term_t *term = NULL;
+  const cmp_term_cell_t *cells;
+  char reply[32];
+  size_t len;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_create(&term, 10, 5, 10));
+  feed(term, "aaaa\r\nbbbb\r\ncccc\r\ndddd\r\neeee");
+
+  feed(term, "\033[2;3H\033[K");
+  ASSERT_STR_EQ("bb", row_text(term, 1, 10));
+  feed(term, "\033[1;2H\033[2@");
+  ASSERT_STR_EQ("a  aaa", row_text(term, 0, 10));
+  feed(term, "\033[3P");
+  ASSERT_STR_EQ("aaa", row_text(term, 0, 10));
+
+  /* Delete and insert lines inside a scroll region */
+  feed(term, "\033[2;4r\033[2;1H\033[M");
+  ASSERT_STR_EQ("cccc", row_text(term, 1, 10));
+  ASSERT_STR_EQ("dddd", row_text(term, 2, 10));
+  ASSERT_STR_EQ("", row_text(term, 3, 10));
+  ASSERT_STR_EQ("eeee", row_text(term, 4, 10));
+  feed(term, "\033[L");
+  ASSERT_STR_EQ("", row_text(term, 1, 10));
+  ASSERT_STR_EQ("cccc", row_text(term, 2, 10));
+  /* Region scrolls never reach scrollback */
+  feed(term, "\033[4;1H\n\n\n");
+  ASSERT_EQ(0, cmp_term_get_scrollback_count(term));
+  feed(term, "\033[r");
+
+  /* Sequences split across feeds, and a cursor position report */
+  feed(term, "\033[3");
+  feed(term, ";4");
+  feed(term, "H\033[6n");
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_term_take_response(term, reply, sizeof(reply), &len));
+  reply[len] = '\0';
+  ASSERT_STR_EQ("\033[3;4R", reply);
+
+  /* OSC and DCS strings are skipped */
+  feed(term, "\033[2J\033[H\033]0;title\007A\033P1$qm\033\\B");
+  ASSERT_STR_EQ("AB", row_text(term, 0, 10));
+
+  /* UTF-8, including a sequence split across feeds and a bad byte */
+  feed(term, "\r\n\xC3");
+  feed(term, "\xA9\xE2\x82\xAC\xFFz");
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_get_row(term, 1, &cells));
+  ASSERT_EQ(0xE9, cells[0].codepoint);
+  ASSERT_EQ(0x20AC, cells[1].codepoint);
+  ASSERT_EQ(0xFFFD, cells[2].codepoint);
+  ASSERT_EQ('z', cells[3].codepoint);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_destroy(term));
+  PASS();
+}
+
+TEST test_term_sgr_and_scrollback(void) {
+  cmp_term_t *term = NULL;
+  cmp_term_cell_t line[16];
+  const cmp_term_cell_t *cells;
+  size_t count, i;
+  char buf[32];
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_create(&term, 8, 2, 3));
+  feed(term, "\033[1;31mR\033[0;38;5;200mP"
+             "\033[38;2;1;2;3;4mT\033[m\xE2\x82\xAC");
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_get_row(term, 0, &cells));
+  ASSERT_EQ(CMP_TERM_ATTR_BOLD, cells[0].attrs);
+  ASSERT_EQ(CMP_TERM_COLOR_PALETTE | 1, cells[0].fg);
+  ASSERT_EQ(CMP_TERM_COLOR_PALETTE | 200, cells[1].fg);
+  ASSERT_EQ(0, cells[1].attrs);
+  ASSERT_EQ(CMP_TERM_COLOR_RGB | 0x010203ul, cells[2].fg);
+  ASSERT_EQ(CMP_TERM_ATTR_UNDERLINE, cells[2].attrs);
+  ASSERT_EQ(CMP_TERM_COLOR_DEFAULT, cells[3].fg);
+
+  /* Scroll the styled line off the top and read it back */
+  feed(term, "\r\n\r\n");
+  ASSERT_EQ(1, cmp_term_get_scrollback_count(term));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_term_get_scrollback_line(term, 0, line, 16, &count));
+  ASSERT_EQ(4, count);
+  ASSERT_EQ('R', line[0].codepoint);
+  ASSERT_EQ(CMP_TERM_ATTR_BOLD, line[0].attrs);
+  ASSERT_EQ(CMP_TERM_COLOR_PALETTE | 200, line[1].fg);
+  ASSERT_EQ(CMP_TERM_COLOR_RGB | 0x010203ul, line[2].fg);
+  ASSERT_EQ(0x20AC, line[3].codepoint);
+  ASSERT_EQ(CMP_TERM_COLOR_DEFAULT, line[3].fg);
+
+  /* Only the newest lines are kept */
+  for (i = 0; i < 10; ++i) {
+    sprintf(buf, "line%lu\r\n", (unsigned long)i);
+    feed(term, buf);
+  }
+  ASSERT_EQ(3, cmp_term_get_scrollback_count(term));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_term_get_scrollback_line(term, 2, line, 16, &count));
+  ASSERT_EQ(5, count);
+  ASSERT_EQ('8', line[4].codepoint);
+  ASSERT_EQ(CMP_ERROR_BOUNDS,
+            cmp_term_get_scrollback_line(term, 3, line, 16, &count));
+
+  feed(term, "\033[3J");
+  ASSERT_EQ(0, cmp_term_get_scrollback_count(term));
+
+  /* Resizing below the cursor row pushes the top rows to scrollback */
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_resize(term, 4, 1));
+  ASSERT_EQ(1, cmp_term_get_scrollback_count(term));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_destroy(term));
+  PASS();
+}
+
+TEST test_term_damage(void) {
+  cmp_term_t *term = NULL;
+  unsigned char dirty[4];
+  size_t scrolled;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_create(&term, 10, 4, 100));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_take_damage(term, dirty, &scrolled));
+  ASSERT_EQ(1, dirty[0] && dirty[1] && dirty[2] && dirty[3]);
+
+  feed(term, "\033[3;1Hx");
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_take_damage(term, dirty, &scrolled));
+  ASSERT_EQ(0, dirty[0]);
+  ASSERT_EQ(0, dirty[1]);
+  ASSERT_EQ(1, dirty[2]);
+  ASSERT_EQ(0, dirty[3]);
+  ASSERT_EQ(0, scrolled);
+
+  /* A full-screen scroll marks only the exposed rows plus what changed */
+  feed(term, "\033[4;1H\n\nz");
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_take_damage(term, dirty, &scrolled));
+  ASSERT_EQ(2, scrolled);
+  ASSERT_EQ(0, dirty[0]);
+  ASSERT_EQ(0, dirty[1]);
+  ASSERT_EQ(1, dirty[2]);
+  ASSERT_EQ(1, dirty[3]);
+  ASSERT_STR_EQ("x", row_text(term, 0, 10));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_take_damage(term, NULL, NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_take_damage(term, dirty, &scrolled));
+  ASSERT_EQ(0, dirty[0] | dirty[1] | dirty[2] | dirty[3]);
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_destroy(term));
+  PASS();
+}
+
+/* Build-log shaped input the size of a large `cat`, fed in pipe-sized
+ * chunks; asserts the final screen contents. */
+TEST test_term_bulk_feed(void) {
+  enum { TOTAL = 64 * 1024 * 1024, CHUNK = 65536 };
+  cmp_term_t *term = NULL;
+  char *data;
+  size_t len = 0, off, lines = 0;
+
+  data = (char *)malloc(TOTAL + 256);
+  ASSERT(data != NULL);
+  while (len < TOTAL) {
+    len += (size_t)sprintf(data + len,
+                           "\033[32m[%3lu%%]\033[0m Building C object "
+                           "src/CMakeFiles/cmp.dir/cmp_file_%lu.c.o\r\n",
+                           (unsigned long)(lines % 101),
+                           (unsigned long)lines);
+    lines++;
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_create(&term, 120, 40, 10000));
+  for (off = 0; off < len; off += CHUNK) {
+    cmp_term_feed(term, data + off, len - off < CHUNK ? len - off : CHUNK);
+  }
+
+  ASSERT_EQ(10000, cmp_term_get_scrollback_count(term));
+  ASSERT_STRN_EQ("[", row_text(term, 38, 120), 1);
+  ASSERT_STR_EQ("", row_text(term, 39, 120));
+  free(data);
+  ASSERT_EQ(CMP_SUCCESS, cmp_term_destroy(term));
+  PASS();
+}
+
+SUITE(terminal_suite) {
+  RUN_TEST(test_term_print_and_wrap);
+  RUN_TEST(test_term_csi_editing);
+  RUN_TEST(test_term_sgr_and_scrollback);
+  RUN_TEST(test_term_damage);
+  RUN_TEST(test_term_bulk_feed);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(terminal_suite);
+  GREATEST_MAIN_END();
+}
@@ -0,0 +1,300 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+
+#include <stdlib.h>
+#include <string.h>
+/* clang-format on */
+
+static unsigned long g_rng = 12345UL;
+
+static size_t test_rand(size_t bound) {
+  g_rng = (g_rng * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+  return bound ? (size_t)(g_rng >> 8) % bound : 0;
+}
+
+/* Naive flat string the buffer is checked against. */
+typedef struct shadow {
+  char *data;
+  size_t len;
+  size_t cap;
+} shadow_t;
+
+static void shadow_insert(shadow_t *s, size_t at, const char *text,
+                          size_t len) {
+  if (s->len + len > s->cap) {
+    size_t cap = (s->len + len) * 2;
+    char *data = (char *)malloc(cap);
+    if (s->len)
+      memcpy(data, s->data, s->len);
+    free(s->data);
+    s->data = data;
+    s->cap = cap;
+  }
+  memmove(s->data + at + len, s->data + at, s->len - at);
+  memcpy(s->data + at, text, len);
+  s->len += len;
+}
+
+static void shadow_delete(shadow_t *s, size_t at, size_t len) {
+  memmove(s->data + at, s->data + at + len, s->len - at - len);
+  s->len -= len;
+}
+
+static int buffer_equals(const cmp_text_buffer_t *tb, const char *data,
+                         size_t len) {
+  size_t got, off = 0;
+  if (cmp_text_buffer_get_length(tb, &got) != CMP_SUCCESS || got != len)
+    return 0;
+  while (off < len) {
+    const char *chunk;
+    size_t chunk_len;
+    if (cmp_text_buffer_get_chunk(tb, off, &chunk, &chunk_len) != CMP_SUCCESS)
+      return 0;
+    if (chunk_len > len - off || memcmp(chunk, data + off, chunk_len) != 0)
+      return 0;
+    off += chunk_len;
+  }
+  return 1;
+}
+
+static const char *const k_fragments[] = {"a", "xyz", "\n", "line\n",
+                                          "\xC3\xA9", "\xE2\x82\xAC\n",
+                                          "\xF0\x9F\x98\x80", "  "};
+
+TEST test_text_buffer_basic(void) {
+  cmp_text_buffer_t *tb = NULL;
+  char out[16];
+  size_t v = 0, col = 0;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_create(&tb));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_get_line_count(tb, &v));
+  ASSERT_EQ(1, (int)v);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_insert(tb, 0, "hello\nworld", 11));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_insert(tb, 5, ",", 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_read(tb, 0, 12, out));
+  ASSERT_MEM_EQ("hello,\nworld", out, 12);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_get_line_count(tb, &v));
+  ASSERT_EQ(2, (int)v);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_offset_to_line(tb, 9, &v, &col));
+  ASSERT_EQ(1, (int)v);
+  ASSERT_EQ(2, (int)col);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_line_to_offset(tb, 1, &v));
+  ASSERT_EQ(7, (int)v);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_delete(tb, 0, 7));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_read(tb, 0, 5, out));
+  ASSERT_MEM_EQ("world", out, 5);
+
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_text_buffer_insert(tb, 6, "x", 1));
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_text_buffer_delete(tb, 3, 3));
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_text_buffer_read(tb, 1, 5, out));
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_text_buffer_line_to_offset(tb, 1, &v));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_text_buffer_create(NULL));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_text_buffer_insert(NULL, 0, "x", 1));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_destroy(tb));
+  PASS();
+}
+
+TEST test_text_buffer_utf8_positions(void) {
+  cmp_text_buffer_t *tb = NULL;
+  /* a, e-acute (2 bytes), euro (3 bytes), emoji (4 bytes), b */
+  const char *text = "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80" "b";
+  size_t v = 0;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_create(&tb));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_set_text(tb, text, strlen(text)));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_get_codepoint_count(tb, &v));
+  ASSERT_EQ(5, (int)v);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_codepoint_to_offset(tb, 3, &v));
+  ASSERT_EQ(6, (int)v);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_codepoint_to_offset(tb, 5, &v));
+  ASSERT_EQ(11, (int)v);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_offset_to_codepoint(tb, 10, &v));
+  ASSERT_EQ(4, (int)v);
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_text_buffer_codepoint_to_offset(tb, 6, &v));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_destroy(tb));
+  PASS();
+}
+
+TEST test_text_buffer_random_edits(void) {
+  cmp_text_buffer_t *tb = NULL;
+  shadow_t sh = {NULL, 0, 0};
+  int i;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_create(&tb));
+  for (i = 0; i < 4000; ++i) {
+    size_t at = test_rand(sh.len + 1);
+    if (test_rand(3) != 0 || sh.len == 0) {
+      const char *frag = k_fragments[test_rand(8)];
+      size_t n = strlen(frag);
+      /* Keep code points whole so offsets stay on boundaries */
+      while (at > 0 && at < sh.len && ((unsigned char)sh.data[at] & 0xC0) ==
+                                          0x80)
+        at--;
+      ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_insert(tb, at, frag, n));
+      shadow_insert(&sh, at, frag, n);
+    } else {
+      size_t n = test_rand(sh.len - at + 1);
+      if (n > 64)
+        n = 64;
+      ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_delete(tb, at, n));
+      shadow_delete(&sh, at, n);
+    }
+
+    if (i % 97 == 0) {
+      size_t k, lines = 1, cps = 0, v = 0, col = 0, off = 0;
+      ASSERT(buffer_equals(tb, sh.data, sh.len));
+      for (k = 0; k < sh.len; ++k) {
+        lines += sh.data[k] == '\n';
+        cps += ((unsigned char)sh.data[k] & 0xC0) != 0x80;
+      }
+      ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_get_line_count(tb, &v));
+      ASSERT_EQ(lines, v);
+      ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_get_codepoint_count(tb, &v));
+      ASSERT_EQ(cps, v);
+
+      /* Every offset maps to the line and column a linear scan finds */
+      lines = 0;
+      for (k = 0; k <= sh.len; ++k) {
+        ASSERT_EQ(CMP_SUCCESS,
+                  cmp_text_buffer_offset_to_line(tb, k, &v, &col));
+        ASSERT_EQ(lines, v);
+        ASSERT_EQ(k - off, col);
+        ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_line_to_offset(tb, lines, &v));
+        ASSERT_EQ(off, v);
+        if (k < sh.len && sh.data[k] == '\n') {
+          lines++;
+          off = k + 1;
+        }
+      }
+    }
+  }
+  ASSERT(buffer_equals(tb, sh.data, sh.len));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_destroy(tb));
+  free(sh.data);
+  PASS();
+}
+
+TEST test_text_buffer_snapshots(void) {
+  cmp_text_buffer_t *tb = NULL;
+  cmp_text_buffer_t *other = NULL;
+  cmp_text_snapshot_t *snaps[8];
+  shadow_t shadows[8];
+  shadow_t sh = {NULL, 0, 0};
+  char *out;
+  int i, j;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_create(&tb));
+  for (i = 0; i < 8; ++i) {
+    for (j = 0; j < 200; ++j) {
+      size_t at = test_rand(sh.len + 1);
+      if (test_rand(4) != 0 || sh.len == 0) {
+        ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_insert(tb, at, "abc\n", 4));
+        shadow_insert(&sh, at, "abc\n", 4);
+      } else {
+        size_t n = test_rand(sh.len - at + 1) % 16;
+        ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_delete(tb, at, n));
+        shadow_delete(&sh, at, n);
+      }
+    }
+    ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_snapshot(tb, &snaps[i]));
+    shadows[i].data = (char *)malloc(sh.len + 1);
+    memcpy(shadows[i].data, sh.data, sh.len);
+    shadows[i].len = sh.len;
+  }
+
+  /* Later edits must not leak into earlier snapshots */
+  for (i = 0; i < 8; ++i) {
+    size_t len = 0;
+    ASSERT_EQ(CMP_SUCCESS, cmp_text_snapshot_get_length(snaps[i], &len));
+    ASSERT_EQ(shadows[i].len, len);
+    out = (char *)malloc(len + 1);
+    ASSERT_EQ(CMP_SUCCESS, cmp_text_snapshot_read(snaps[i], 0, len, out));
+    ASSERT_MEM_EQ(shadows[i].data, out, len);
+    free(out);
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_restore(tb, snaps[2]));
+  ASSERT(buffer_equals(tb, shadows[2].data, shadows[2].len));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_insert(tb, 0, "edit", 4));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_restore(tb, snaps[5]));
+  ASSERT(buffer_equals(tb, shadows[5].data, shadows[5].len));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_create(&other));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_text_buffer_restore(other, snaps[0]));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_destroy(other));
+
+  /* Snapshots outlive the buffer that produced them */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_destroy(tb));
+  for (i = 0; i < 8; ++i) {
+    out = (char *)malloc(shadows[i].len + 1);
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_text_snapshot_read(snaps[i], 0, shadows[i].len, out));
+    ASSERT_MEM_EQ(shadows[i].data, out, shadows[i].len);
+    free(out);
+    free(shadows[i].data);
+    ASSERT_EQ(CMP_SUCCESS, cmp_text_snapshot_release(snaps[i]));
+  }
+  free(sh.data);
+  PASS();
+}
+
+TEST test_text_buffer_large_document_benchmark(void) {
+  /* 50 MB document with scattered edits; every edit touches only the root
+   * path, so this stays fast where a flat buffer would memmove megabytes
+   * per keystroke. */
+  cmp_text_buffer_t *tb = NULL;
+  const size_t doc_len = 50u * 1024u * 1024u;
+  char *doc = (char *)malloc(doc_len);
+  size_t i, len = doc_len, lines = 0, v = 0;
+  char probe[8];
+
+  ASSERT(doc != NULL);
+  for (i = 0; i < doc_len; ++i) {
+    doc[i] = (i % 80 == 79) ? '\n' : (char)('a' + i % 26);
+    lines += doc[i] == '\n';
+  }
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_create(&tb));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_set_text(tb, doc, doc_len));
+  free(doc);
+
+  for (i = 0; i < 20000; ++i) {
+    size_t at = test_rand(len);
+    if (i % 3 == 2) {
+      ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_delete(tb, at, 1));
+      len--;
+    } else {
+      /* Type a short run at one caret, as a user would */
+      ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_insert(tb, at, "x", 1));
+      ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_insert(tb, at + 1, "y", 1));
+      len += 2;
+    }
+    ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_offset_to_line(tb, at, &v, NULL));
+  }
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_get_length(tb, &v));
+  ASSERT_EQ(len, v);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_get_line_count(tb, &v));
+  ASSERT(v <= lines + 1);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_read(tb, len - 8, 8, probe));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_destroy(tb));
+  PASS();
+}
+
+SUITE(text_buffer_suite) {
+  RUN_TEST(test_text_buffer_basic);
+  RUN_TEST(test_text_buffer_utf8_positions);
+  RUN_TEST(test_text_buffer_random_edits);
+  RUN_TEST(test_text_buffer_snapshots);
+  RUN_TEST(test_text_buffer_large_document_benchmark);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(text_buffer_suite);
+  GREATEST_MAIN_END();
+}
@@ -0,0 +1,280 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+#include <string.h>
+#include <time.h>
+/* clang-format on */
+
+typedef struct tree_fixture {
+  size_t loads;
+  size_t last_load;
+  int load_now; /* Deliver two children from inside the callback */
+  size_t changes;
+  size_t parent_row, at, removed, inserted;
+} tree_fixture_t;
+
+static int on_load(void *user_data, cmp_tree_model_t *model, size_t node) {
+  tree_fixture_t *f = (tree_fixture_t *)user_data;
+  static const char *const names[] = {"a", "b"};
+  f->loads++;
+  f->last_load = node;
+  if (f->load_now)
+    return cmp_tree_model_set_children(model, node, names, NULL, 2, NULL);
+  return CMP_SUCCESS;
+}
+
+static void on_change(cmp_tree_model_t *model, size_t parent_row, size_t at,
+                      size_t removed, size_t inserted, void *user_data) {
+  tree_fixture_t *f = (tree_fixture_t *)user_data;
+  (void)model;
+  f->changes++;
+  f->parent_row = parent_row;
+  f->at = at;
+  f->removed = removed;
+  f->inserted = inserted;
+}
+
+/* Rows by walking the expanded nodes depth first */
+static size_t flatten(const cmp_tree_model_t *model, size_t node,
+                      size_t *rows, size_t n) {
+  cmp_tree_node_info_t info;
+  size_t i;
+  cmp_tree_model_get_info(model, node, &info);
+  if (node != CMP_TREE_ROOT)
+    rows[n++] = node;
+  if (node == CMP_TREE_ROOT || info.is_expanded)
+    for (i = 0; i < info.child_count; ++i)
+      n = flatten(model, info.first_child + i, rows, n);
+  return n;
+}
+
+static int rows_match(const cmp_tree_model_t *model) {
+  static size_t rows[4096];
+  size_t n = flatten(model, CMP_TREE_ROOT, rows, 0), i, count, id, row;
+  cmp_tree_model_get_row_count(model, &count);
+  if (count != n)
+    return 0;
+  for (i = 0; i < n; ++i) {
+    if (cmp_tree_model_get_node_at_row(model, i, &id) != CMP_SUCCESS ||
+        id != rows[i])
+      return 0;
+    if (cmp_tree_model_get_row_of_node(model, rows[i], &row) !=
+            CMP_SUCCESS ||
+        row != i)
+      return 0;
+  }
+  return 1;
+}
+
+TEST test_tree_model_rows(void) {
+  cmp_tree_model_t *model = NULL;
+  tree_fixture_t f;
+  const char *top[] = {"src", "docs", "README"};
+  const int top_dirs[] = {1, 1, 0};
+  const char *src[] = {"core", "main.c", "util.c"};
+  const int src_dirs[] = {1, 0, 0};
+  const char *core[] = {"a.c", "b.c"};
+  cmp_tree_node_info_t info;
+  size_t first, src_first, core_first, count, id, row, i, pass;
+
+  memset(&f, 0, sizeof(f));
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_create(&model, NULL, NULL));
+  cmp_tree_model_set_change_handler(model, on_change, &f);
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_children(
+                             model, CMP_TREE_ROOT, top, top_dirs, 3, &first));
+  ASSERT_EQ(1, (int)first);
+  ASSERT_EQ(1, (int)f.changes);
+  ASSERT_EQ(CMP_TREE_NONE, f.parent_row);
+  ASSERT_EQ(0, (int)f.at);
+  ASSERT_EQ(3, (int)f.inserted);
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE,
+            cmp_tree_model_set_children(model, CMP_TREE_ROOT, top, NULL, 3,
+                                        NULL));
+
+  /* Children of a collapsed node stay hidden */
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_children(model, 1, src, src_dirs,
+                                                     3, &src_first));
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_children(model, src_first, core,
+                                                     NULL, 2, &core_first));
+  cmp_tree_model_get_row_count(model, &count);
+  ASSERT_EQ(3, (int)count);
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND,
+            cmp_tree_model_get_row_of_node(model, src_first, &row));
+
+  /* Expanding src splices its 3 children after its row */
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_expanded(model, 1, 1));
+  ASSERT_EQ(0, (int)f.parent_row);
+  ASSERT_EQ(1, (int)f.at);
+  ASSERT_EQ(0, (int)f.removed);
+  ASSERT_EQ(3, (int)f.inserted);
+  cmp_tree_model_get_row_count(model, &count);
+  ASSERT_EQ(6, (int)count);
+  ASSERT(rows_match(model));
+
+  /* Nested expansion counts through both levels */
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_expanded(model, src_first, 1));
+  ASSERT_EQ(1, (int)f.parent_row);
+  ASSERT_EQ(2, (int)f.inserted);
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_get_node_at_row(model, 3, &id));
+  ASSERT_EQ(core_first + 1, id);
+  cmp_tree_model_get_info(model, id, &info);
+  ASSERT_STR_EQ("b.c", info.label);
+  ASSERT_EQ(2, (int)info.depth);
+  ASSERT_EQ(src_first, info.parent);
+  ASSERT(rows_match(model));
+
+  /* Collapsing src hides core's rows too and keeps core expanded */
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_expanded(model, 1, 0));
+  ASSERT_EQ(1, (int)f.at);
+  ASSERT_EQ(5, (int)f.removed);
+  cmp_tree_model_get_row_count(model, &count);
+  ASSERT_EQ(3, (int)count);
+  cmp_tree_model_get_info(model, 1, &info);
+  ASSERT_EQ(1, (int)info.visible_rows);
+  ASSERT(rows_match(model));
+  f.changes = 0;
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_expanded(model, src_first, 0));
+  ASSERT_EQ(0, (int)f.changes); /* Nothing visible moved */
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_expanded(model, src_first, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_expanded(model, 1, 1));
+  cmp_tree_model_get_row_count(model, &count);
+  ASSERT_EQ(8, (int)count);
+
+  /* Random toggles agree with a depth-first walk */
+  for (pass = 0; pass < 50; ++pass) {
+    i = 1 + (pass * 7) % 8;
+    cmp_tree_model_get_info(model, i, &info);
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_tree_model_set_expanded(model, i, !info.is_expanded));
+    ASSERT(rows_match(model));
+  }
+
+  ASSERT_EQ(CMP_ERROR_BOUNDS,
+            cmp_tree_model_get_node_at_row(model, 100, &id));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_tree_model_set_expanded(model, CMP_TREE_ROOT, 0));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_tree_model_set_expanded(model, 99, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_destroy(model));
+  PASS();
+}
+
+TEST test_tree_model_lazy_load(void) {
+  cmp_tree_model_t *model = NULL;
+  tree_fixture_t f;
+  const char *top[] = {"remote", "local"};
+  const int dirs[] = {1, 1};
+  const char *late[] = {"x", "y", "z"};
+  cmp_tree_node_info_t info;
+  size_t count, id;
+
+  memset(&f, 0, sizeof(f));
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_create(&model, on_load, &f));
+  cmp_tree_model_set_change_handler(model, on_change, &f);
+  cmp_tree_model_set_children(model, CMP_TREE_ROOT, top, dirs, 2, NULL);
+  ASSERT_EQ(0, (int)f.loads);
+
+  /* Asynchronous: expanded but loading until the children arrive */
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_expanded(model, 1, 1));
+  ASSERT_EQ(1, (int)f.loads);
+  ASSERT_EQ(1, (int)f.last_load);
+  cmp_tree_model_get_info(model, 1, &info);
+  ASSERT_EQ(1, info.is_expanded);
+  ASSERT_EQ(1, info.is_loading);
+  cmp_tree_model_set_expanded(model, 1, 0);
+  cmp_tree_model_set_expanded(model, 1, 1);
+  ASSERT_EQ(1, (int)f.loads); /* Still waiting, no second request */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_tree_model_set_children(model, 1, late, NULL, 3, NULL));
+  ASSERT_EQ(0, (int)f.parent_row);
+  ASSERT_EQ(1, (int)f.at);
+  ASSERT_EQ(3, (int)f.inserted);
+  cmp_tree_model_get_info(model, 1, &info);
+  ASSERT_EQ(0, info.is_loading);
+  cmp_tree_model_get_row_count(model, &count);
+  ASSERT_EQ(5, (int)count);
+  cmp_tree_model_get_node_at_row(model, 4, &id);
+  ASSERT_EQ(2, (int)id);
+
+  /* Synchronous: children delivered inside the callback */
+  f.load_now = 1;
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_expanded(model, 2, 1));
+  ASSERT_EQ(2, (int)f.loads);
+  cmp_tree_model_get_row_count(model, &count);
+  ASSERT_EQ(7, (int)count);
+  cmp_tree_model_get_info(model, 2, &info);
+  ASSERT_EQ(0, info.is_loading);
+  ASSERT_EQ(2, (int)info.child_count);
+  ASSERT(rows_match(model));
+
+  /* Leaves never load */
+  cmp_tree_model_set_expanded(model, info.first_child, 1);
+  ASSERT_EQ(2, (int)f.loads);
+
+  cmp_tree_model_destroy(model);
+  PASS();
+}
+
+TEST test_tree_model_large_fanout(void) {
+  cmp_tree_model_t *model = NULL;
+  static const char *labels[100000];
+  static int dirs[100000];
+  const char *top[] = {"big", "after"};
+  const int top_dirs[] = {1, 0};
+  size_t first, count, id, row, i;
+  cmp_tree_node_info_t info;
+  clock_t start;
+  double toggle_s;
+
+  for (i = 0; i < 100000; ++i) {
+    labels[i] = "file";
+    dirs[i] = (i % 1000) == 0;
+  }
+  cmp_tree_model_create(&model, NULL, NULL);
+  cmp_tree_model_set_children(model, CMP_TREE_ROOT, top, top_dirs, 2, NULL);
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_children(model, 1, labels, dirs,
+                                                     100000, &first));
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_children(model, first + 50000,
+                                                     labels, NULL, 1000,
+                                                     NULL));
+
+  /* Toggling the 100k-child node never walks its children */
+  start = clock();
+  for (i = 0; i < 10000; ++i) {
+    cmp_tree_model_set_expanded(model, 1, 1);
+    cmp_tree_model_set_expanded(model, first + 50000, 1);
+    cmp_tree_model_set_expanded(model, first + 50000, 0);
+    cmp_tree_model_set_expanded(model, 1, 0);
+  }
+  toggle_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+  ASSERT(toggle_s < 1.0);
+
+  cmp_tree_model_set_expanded(model, 1, 1);
+  cmp_tree_model_set_expanded(model, first + 50000, 1);
+  cmp_tree_model_get_row_count(model, &count);
+  ASSERT_EQ(2 + 100000 + 1000, (int)count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_get_node_at_row(model, 50001, &id));
+  ASSERT_EQ(first + 50000, id);
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_get_node_at_row(model, 51001, &id));
+  cmp_tree_model_get_info(model, id, &info);
+  ASSERT_EQ(2, (int)info.depth);
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_get_node_at_row(model, 51002, &id));
+  ASSERT_EQ(first + 50001, id);
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_get_row_of_node(model, 2, &row));
+  ASSERT_EQ(101001, (int)row);
+  cmp_tree_model_destroy(model);
+  PASS();
+}
+
+SUITE(tree_model_suite) {
+  RUN_TEST(test_tree_model_rows);
+  RUN_TEST(test_tree_model_lazy_load);
+  RUN_TEST(test_tree_model_large_fanout);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(tree_model_suite);
+  GREATEST_MAIN_END();
+}
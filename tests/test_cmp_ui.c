@@ -59,6 +59,17 @@ TEST test_ui_hierarchy(void) {
   ASSERT_EQ_FMT((size_t)2, box->layout->child_count, "%zd");
   ASSERT(text1->layout->parent == box->layout);
 
+  /* Detaching keeps the order of the remaining children */
+  res = cmp_ui_node_remove_child(box, text1);
+  ASSERT_EQ_FMT(CMP_SUCCESS, res, "%d");
+  ASSERT_EQ_FMT((size_t)1, box->child_count, "%zd");
+  ASSERT(box->children[0] == text2);
+  ASSERT(box->layout->children[0] == text2->layout);
+  ASSERT(text1->parent == NULL);
+  ASSERT_EQ_FMT(CMP_ERROR_NOT_FOUND, cmp_ui_node_remove_child(box, text1),
+                "%d");
+  cmp_ui_node_destroy(text1);
+
   /* Recursively destroy everything */
   res = cmp_ui_node_destroy(box);
   ASSERT_EQ_FMT(CMP_SUCCESS, res, "%d");
@@ -73,10 +73,155 @@ TEST test_undo_redo_push_undo(void) {
   PASS();
 }
 
+TEST test_undo_redo_redo_states(void) {
+  cmp_undo_redo_t *stack = NULL;
+  char buf[32];
+
+  cmp_undo_redo_create(&stack);
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_push(stack, "hello world"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_push(stack, "hello brave world"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_push(stack, "hello brave world"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_push(stack, "jello world"));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_undo(stack, buf, 32));
+  ASSERT_STR_EQ("hello brave world", buf);
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_undo(stack, buf, 32));
+  ASSERT_STR_EQ("hello brave world", buf);
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_undo(stack, buf, 32));
+  ASSERT_STR_EQ("hello world", buf);
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_redo(stack, buf, 32));
+  ASSERT_STR_EQ("hello brave world", buf);
+
+  /* Truncated to the caller's capacity */
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_redo(stack, buf, 6));
+  ASSERT_STR_EQ("hello", buf);
+
+  /* A new push discards the redo branch */
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_push(stack, "x"));
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE, cmp_undo_redo_redo(stack, buf, 32));
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_undo(stack, buf, 32));
+  ASSERT_STR_EQ("hello brave world", buf);
+
+  cmp_undo_redo_destroy(stack);
+  PASS();
+}
+
+static int buffer_is(const cmp_text_buffer_t *tb, const char *expected) {
+  char out[64];
+  size_t len = 0;
+  cmp_text_buffer_get_length(tb, &len);
+  if (len != strlen(expected) || len >= sizeof(out))
+    return 0;
+  cmp_text_buffer_read(tb, 0, len, out);
+  return memcmp(out, expected, len) == 0;
+}
+
+TEST test_undo_redo_edit_groups(void) {
+  cmp_undo_redo_t *stack = NULL;
+  cmp_text_buffer_t *tb = NULL;
+  size_t undo_steps = 0, redo_steps = 0, caret = 0;
+  const char *word = "hello";
+  int i;
+
+  cmp_undo_redo_create(&stack);
+  cmp_text_buffer_create(&tb);
+
+  /* Typing within the window is one step */
+  for (i = 0; i < 5; ++i) {
+    cmp_text_buffer_insert(tb, (size_t)i, word + i, 1);
+    ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_record_insert(stack, (size_t)i,
+                                                       word + i, 1,
+                                                       100.0 * i));
+  }
+  /* A pause starts a new step: backspace twice */
+  cmp_text_buffer_delete(tb, 4, 1);
+  cmp_undo_redo_record_delete(stack, 4, "o", 1, 2000.0);
+  cmp_text_buffer_delete(tb, 3, 1);
+  cmp_undo_redo_record_delete(stack, 3, "l", 1, 2100.0);
+  ASSERT(buffer_is(tb, "hel"));
+
+  cmp_undo_redo_get_stats(stack, &undo_steps, &redo_steps, NULL);
+  ASSERT_EQ(2, (int)undo_steps);
+  ASSERT_EQ(0, (int)redo_steps);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_undo_edits(stack, tb, &caret));
+  ASSERT(buffer_is(tb, "hello"));
+  ASSERT_EQ(5, (int)caret);
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_undo_edits(stack, tb, &caret));
+  ASSERT(buffer_is(tb, ""));
+  ASSERT_EQ(0, (int)caret);
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE,
+            cmp_undo_redo_undo_edits(stack, tb, NULL));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_redo_edits(stack, tb, &caret));
+  ASSERT(buffer_is(tb, "hello"));
+  ASSERT_EQ(5, (int)caret);
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_redo_edits(stack, tb, &caret));
+  ASSERT(buffer_is(tb, "hel"));
+  ASSERT_EQ(3, (int)caret);
+
+  /* An explicit break splits edits even inside the window */
+  cmp_text_buffer_insert(tb, 3, "p", 1);
+  cmp_undo_redo_record_insert(stack, 3, "p", 1, 2200.0);
+  cmp_undo_redo_break_group(stack);
+  cmp_text_buffer_insert(tb, 4, "!", 1);
+  cmp_undo_redo_record_insert(stack, 4, "!", 1, 2250.0);
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_undo_edits(stack, tb, NULL));
+  ASSERT(buffer_is(tb, "help"));
+
+  cmp_text_buffer_destroy(tb);
+  cmp_undo_redo_destroy(stack);
+  PASS();
+}
+
+TEST test_undo_redo_budget(void) {
+  /* Deep history fits as long as the deltas fit; the oldest steps go first
+   * and the newest one is always kept. */
+  cmp_undo_redo_t *stack = NULL;
+  cmp_text_buffer_t *tb = NULL;
+  size_t undo_steps = 0, bytes = 0, len = 0, budget;
+  char big[1024];
+  int i;
+
+  memset(big, 'z', sizeof(big));
+  cmp_undo_redo_create(&stack);
+  cmp_text_buffer_create(&tb);
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_undo_redo_set_budget(stack, 0));
+
+  for (i = 0; i < 1000; ++i) {
+    cmp_text_buffer_insert(tb, 0, "ab", 2);
+    cmp_undo_redo_record_insert(stack, 0, "ab", 2, 1000.0 * i);
+  }
+  cmp_undo_redo_get_stats(stack, &undo_steps, NULL, &bytes);
+  ASSERT_EQ(1000, (int)undo_steps);
+
+  budget = bytes / 2;
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_set_budget(stack, budget));
+  cmp_undo_redo_get_stats(stack, &undo_steps, NULL, &bytes);
+  ASSERT(undo_steps >= 400 && undo_steps <= 500);
+  ASSERT(bytes <= budget);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_set_budget(stack, 256));
+  cmp_text_buffer_insert(tb, 0, big, sizeof(big));
+  cmp_undo_redo_record_insert(stack, 0, big, sizeof(big), 5e6);
+  cmp_undo_redo_get_stats(stack, &undo_steps, NULL, NULL);
+  ASSERT_EQ(1, (int)undo_steps);
+  ASSERT_EQ(CMP_SUCCESS, cmp_undo_redo_undo_edits(stack, tb, NULL));
+  cmp_text_buffer_get_length(tb, &len);
+  ASSERT_EQ(2000, (int)len);
+
+  cmp_text_buffer_destroy(tb);
+  cmp_undo_redo_destroy(stack);
+  PASS();
+}
+
 SUITE(undo_redo_suite) {
   RUN_TEST(test_undo_redo_lifecycle);
   RUN_TEST(test_undo_redo_null_args);
   RUN_TEST(test_undo_redo_push_undo);
+  RUN_TEST(test_undo_redo_redo_states);
+  RUN_TEST(test_undo_redo_edit_groups);
+  RUN_TEST(test_undo_redo_budget);
 }
 
 GREATEST_MAIN_DEFS();
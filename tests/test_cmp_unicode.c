@@ -0,0 +1,341 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+
+#include <stdlib.h>
+#include <string.h>
+/* clang-format on */
+
+#define FLAG_US "\xF0\x9F\x87\xBA\xF0\x9F\x87\xB8"
+#define FLAG_F "\xF0\x9F\x87\xAB"
+#define FAMILY                                                                 \
+  "\xF0\x9F\x91\xA8\xE2\x80\x8D\xF0\x9F\x91\xA9\xE2\x80\x8D\xF0\x9F\x91\xA7"
+#define THUMBS_TONE "\xF0\x9F\x91\x8D\xF0\x9F\x8F\xBD"
+#define E_ACUTE "e\xCC\x81"
+#define HANGUL_LVT "\xE1\x84\x80\xE1\x85\xA1\xE1\x86\xA8"
+
+/* Byte-at-a-time reference for the validator (Unicode table 3-7) */
+static size_t ref_valid_len(const unsigned char *s, size_t len) {
+  size_t i = 0, n, k;
+  unsigned char lo, hi;
+  while (i < len) {
+    if (s[i] < 0x80) {
+      ++i;
+      continue;
+    }
+    lo = 0x80;
+    hi = 0xBF;
+    if (s[i] >= 0xC2 && s[i] <= 0xDF)
+      n = 1;
+    else if (s[i] >= 0xE0 && s[i] <= 0xEF)
+      n = 2;
+    else if (s[i] >= 0xF0 && s[i] <= 0xF4)
+      n = 3;
+    else
+      return i;
+    if (s[i] == 0xE0)
+      lo = 0xA0;
+    if (s[i] == 0xED)
+      hi = 0x9F;
+    if (s[i] == 0xF0)
+      lo = 0x90;
+    if (s[i] == 0xF4)
+      hi = 0x8F;
+    for (k = 1; k <= n; ++k) {
+      if (i + k >= len || s[i + k] < lo || s[i + k] > hi)
+        return i;
+      lo = 0x80;
+      hi = 0xBF;
+    }
+    i += n + 1;
+  }
+  return len;
+}
+
+static size_t valid_len(const char *s, size_t len) {
+  size_t out = (size_t)-1;
+  cmp_utf8_validate(s, len, &out);
+  return out;
+}
+
+static size_t graphemes(const char *s) {
+  size_t count = 0;
+  cmp_utf8_count_graphemes(s, strlen(s), &count);
+  return count;
+}
+
+TEST test_utf8_validate(void) {
+  char buf[64];
+  const char *bad[] = {"\xC0\x80",         "\xC1\xBF",
+                       "\xE0\x80\x80",     "\xED\xA0\x80",
+                       "\xF0\x80\x80\x80", "\xF4\x90\x80\x80",
+                       "\xF5\x80\x80\x80", "\x80",
+                       "\xE2\x82"};
+  size_t i, at;
+
+  ASSERT_EQ(0, (int)valid_len("", 0));
+  ASSERT_EQ(5, (int)valid_len("hello", 5));
+  ASSERT_EQ(18, (int)valid_len(FAMILY, 18));
+  ASSERT_EQ(3, (int)valid_len("\xEF\xBF\xBF", 3));
+  ASSERT_EQ(4, (int)valid_len("\xF4\x8F\xBF\xBF", 4));
+
+  /* Each malformed sequence, placed at every offset around the 16-byte
+   * blocks the vector path works in */
+  for (i = 0; i < sizeof(bad) / sizeof(bad[0]); ++i) {
+    for (at = 0; at < 40; ++at) {
+      size_t n = strlen(bad[i]);
+      memset(buf, 'a', sizeof(buf));
+      memcpy(buf + at, bad[i], n);
+      ASSERT_EQ(at, valid_len(buf, sizeof(buf)));
+      ASSERT_EQ(at, valid_len(buf, at + n));
+    }
+  }
+  /* Sequences cut off at the end of the input */
+  memset(buf, 'a', sizeof(buf));
+  memcpy(buf + 29, "\xF0\x9F\x98", 3);
+  ASSERT_EQ(29, (int)valid_len(buf, 32));
+  ASSERT_EQ(32, (int)valid_len(buf, 29) + 3);
+  PASS();
+}
+
+TEST test_utf8_validate_random(void) {
+  unsigned char buf[96];
+  unsigned long seed = 12345;
+  size_t round, i, len;
+  for (round = 0; round < 20000; ++round) {
+    len = round % sizeof(buf);
+    for (i = 0; i < len; ++i) {
+      seed = seed * 1103515245UL + 12345UL;
+      /* Mostly well-formed text with occasional damage */
+      buf[i] = (unsigned char)(seed >> 16);
+      if ((seed >> 8) % 4 == 0)
+        buf[i] = (unsigned char)('a' + i % 26);
+    }
+    if (round % 3 == 0 && len >= 4) {
+      /* Plant valid multi-byte sequences so the check gets past them */
+      for (i = 0; i + 4 <= len; i += 7)
+        memcpy(buf + i, "\xE2\x82\xAC", 3);
+    }
+    ASSERT_EQ(ref_valid_len(buf, len), valid_len((const char *)buf, len));
+  }
+  PASS();
+}
+
+TEST test_utf8_count_and_decode(void) {
+  const char *mixed = "a\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80";
+  char big[1000 * 10 + 1];
+  unsigned long cp;
+  size_t i, count, next;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_utf8_count_codepoints(mixed, 10, &count));
+  ASSERT_EQ(4, (int)count);
+  for (i = 0; i < 1000; ++i)
+    memcpy(big + i * 10, mixed, 10);
+  ASSERT_EQ(CMP_SUCCESS, cmp_utf8_count_codepoints(big, 10000, &count));
+  ASSERT_EQ(4000, (int)count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_utf8_count_codepoints(big, 9999, &count));
+  ASSERT_EQ(4000, (int)count);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_utf8_decode(mixed, 10, 1, &cp, &next));
+  ASSERT_EQ(0xE9UL, cp);
+  ASSERT_EQ(3, (int)next);
+  ASSERT_EQ(CMP_SUCCESS, cmp_utf8_decode(mixed, 10, 6, &cp, &next));
+  ASSERT_EQ(0x1F600UL, cp);
+  ASSERT_EQ(10, (int)next);
+  /* Malformed input decodes as U+FFFD and skips the broken prefix */
+  ASSERT_EQ(CMP_SUCCESS, cmp_utf8_decode("\xE2\x82x", 3, 0, &cp, &next));
+  ASSERT_EQ(0xFFFDUL, cp);
+  ASSERT_EQ(2, (int)next);
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_utf8_decode(mixed, 10, 10, &cp, &next));
+  PASS();
+}
+
+TEST test_graphemes(void) {
+  const char *text = "a" E_ACUTE "\r\n" FLAG_US FLAG_F FAMILY THUMBS_TONE
+      HANGUL_LVT "\xE0\xA4\x95\xE0\xA4\xBF"
+                 "z";
+  const size_t expected[] = {0, 1, 4, 6, 14, 18, 36, 44, 53, 59, 60};
+  size_t len = strlen(text), pos, i;
+
+  ASSERT_EQ(1, (int)graphemes(E_ACUTE));
+  ASSERT_EQ(1, (int)graphemes("\r\n"));
+  ASSERT_EQ(2, (int)graphemes("\n\r"));
+  ASSERT_EQ(2, (int)graphemes(FLAG_US FLAG_F));
+  ASSERT_EQ(1, (int)graphemes(FAMILY));
+  ASSERT_EQ(1, (int)graphemes(THUMBS_TONE));
+  ASSERT_EQ(1, (int)graphemes(HANGUL_LVT));
+  ASSERT_EQ(10, (int)graphemes(text));
+
+  /* Forward and backward walks agree */
+  for (i = 0, pos = 0; pos < len; ++i) {
+    ASSERT_EQ(expected[i], pos);
+    ASSERT_EQ(CMP_SUCCESS, cmp_utf8_next_grapheme(text, len, pos, &pos));
+  }
+  ASSERT_EQ(len, pos);
+  for (i = 10; pos > 0;) {
+    ASSERT_EQ(CMP_SUCCESS, cmp_utf8_prev_grapheme(text, len, pos, &pos));
+    ASSERT_EQ(expected[--i], pos);
+  }
+  /* A flag run is paired from its start, even walking backwards */
+  ASSERT_EQ(CMP_SUCCESS, cmp_utf8_prev_grapheme(FLAG_US FLAG_F FLAG_F, 16, 12,
+                                                &pos));
+  ASSERT_EQ(8, (int)pos);
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_utf8_next_grapheme(text, len, len + 1, &pos));
+  PASS();
+}
+
+TEST test_word_boundaries(void) {
+  const char *text =
+      "Hello, world! can't 3.14 foo_bar \xE6\x97\xA5\xE6\x9C\xAC";
+  const char *segments[] = {"Hello",   ",", " ",           "world",
+                            "!",       " ", "can't",       " ",
+                            "3.14",    " ", "foo_bar",     " ",
+                            "\xE6\x97\xA5", "\xE6\x9C\xAC"};
+  const int words[] = {1, 0, 0, 1, 0, 0, 1, 0, 1, 0, 1, 0, 1, 1};
+  size_t len = strlen(text), pos = 0, next, i, starts[14];
+  int is_word;
+
+  for (i = 0; pos < len; ++i, pos = next) {
+    ASSERT(i < 14);
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_utf8_next_word_boundary(text, len, pos, &next, &is_word));
+    ASSERT_EQ(strlen(segments[i]), next - pos);
+    ASSERT_EQ(0, memcmp(text + pos, segments[i], next - pos));
+    ASSERT_EQ(words[i], is_word);
+    starts[i] = pos;
+  }
+  ASSERT_EQ(14, (int)i);
+  while (i-- > 0) {
+    ASSERT_EQ(CMP_SUCCESS, cmp_utf8_prev_word_boundary(text, len, pos, &pos));
+    ASSERT_EQ(starts[i], pos);
+  }
+  ASSERT_EQ(0, (int)pos);
+
+  /* A combining mark stays with its letter; "3.14." ends before the dot */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_utf8_next_word_boundary("caf" E_ACUTE "s x", 9, 0, &next,
+                                        &is_word));
+  ASSERT_EQ(7, (int)next);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_utf8_next_word_boundary("3.14.", 5, 0, &next, &is_word));
+  ASSERT_EQ(4, (int)next);
+  PASS();
+}
+
+static size_t line_breaks(const char *text, size_t *out, int *mandatory) {
+  size_t len = strlen(text), pos = 0, n = 0;
+  while (pos < len) {
+    cmp_utf8_next_line_break(text, len, pos, &pos, &mandatory[n]);
+    out[n++] = pos;
+  }
+  return n;
+}
+
+TEST test_line_breaks(void) {
+  size_t at[16];
+  int hard[16];
+
+  /* Spaces stay at the end of the line; punctuation stays with its word */
+  ASSERT_EQ(4, (int)line_breaks("Hello world, (how) are", at, hard));
+  ASSERT_EQ(6, (int)at[0]);
+  ASSERT_EQ(13, (int)at[1]);
+  ASSERT_EQ(19, (int)at[2]);
+  ASSERT_EQ(22, (int)at[3]);
+  ASSERT_EQ(0, hard[0]);
+  ASSERT_EQ(1, hard[3]);
+
+  ASSERT_EQ(2, (int)line_breaks("co-operate", at, hard));
+  ASSERT_EQ(3, (int)at[0]);
+
+  /* Newlines are mandatory breaks; CR LF is one */
+  ASSERT_EQ(3, (int)line_breaks("a\r\nb\nc", at, hard));
+  ASSERT_EQ(3, (int)at[0]);
+  ASSERT_EQ(1, hard[0]);
+  ASSERT_EQ(5, (int)at[1]);
+  ASSERT_EQ(1, hard[1]);
+
+  /* Ideographs break between each other but not before closing marks */
+  ASSERT_EQ(3, (int)line_breaks("\xE6\x97\xA5\xE6\x9C\xAC\xE3\x80\x82"
+                                "\xE8\xAA\x9E",
+                                at, hard));
+  ASSERT_EQ(3, (int)at[0]);
+  ASSERT_EQ(9, (int)at[1]);
+
+  /* Numbers keep their prefix, separators and suffix */
+  ASSERT_EQ(2, (int)line_breaks("$1,000.50% x", at, hard));
+  ASSERT_EQ(11, (int)at[0]);
+
+  /* Zero width space allows a break, word joiner and NBSP forbid one */
+  ASSERT_EQ(2, (int)line_breaks("ab\xE2\x80\x8B" "cd", at, hard));
+  ASSERT_EQ(5, (int)at[0]);
+  ASSERT_EQ(2, (int)line_breaks("ab\xE2\x81\xA0" "cd e\xC2\xA0" "f", at, hard));
+  ASSERT_EQ(8, (int)at[0]);
+  PASS();
+}
+
+TEST test_null_args(void) {
+  size_t out;
+  unsigned long cp;
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_utf8_validate(NULL, 1, &out));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_utf8_validate("a", 1, NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_utf8_validate(NULL, 0, &out));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_utf8_count_codepoints(NULL, 1, &out));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_utf8_decode(NULL, 1, 0, &cp, &out));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_utf8_next_grapheme("a", 1, 0, NULL));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_utf8_prev_grapheme(NULL, 1, 0, &out));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_utf8_count_graphemes(NULL, 1, &out));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_utf8_next_word_boundary("a", 1, 0, NULL, NULL));
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_utf8_prev_word_boundary("a", 1, 2, &out));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_utf8_next_line_break(NULL, 1, 0, &out, NULL));
+  PASS();
+}
+
+/* Multi-megabyte buffers cross every block boundary of the fast paths. */
+TEST test_utf8_large_buffers(void) {
+  const size_t size = 16u << 20;
+  const char *pattern = "The quick brown fox \xE2\x80\x94 jumps over "
+                        "\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E text. ";
+  size_t plen = strlen(pattern), i, out = 0, count = 0, expect;
+  char *text = (char *)malloc(size);
+  char *ascii = (char *)malloc(size);
+  ASSERT(text && ascii);
+  for (i = 0; i + plen <= size; i += plen)
+    memcpy(text + i, pattern, plen);
+  memset(text + i, ' ', size - i);
+  memset(ascii, 'x', size);
+  /* The dash and the three CJK characters are 3 bytes each */
+  expect = i / plen * (plen - 8) + (size - i);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_utf8_validate(text, size, &out));
+  ASSERT_EQ(size, out);
+  ASSERT_EQ(CMP_SUCCESS, cmp_utf8_validate(ascii, size, &out));
+  ASSERT_EQ(size, out);
+  ASSERT_EQ(CMP_SUCCESS, cmp_utf8_count_codepoints(text, size, &count));
+  ASSERT_EQ(expect, count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_utf8_count_graphemes(text, size, &count));
+  ASSERT_EQ(expect, count);
+  free(text);
+  free(ascii);
+  PASS();
+}
+
+SUITE(unicode_suite) {
+  RUN_TEST(test_utf8_validate);
+  RUN_TEST(test_utf8_validate_random);
+  RUN_TEST(test_utf8_count_and_decode);
+  RUN_TEST(test_graphemes);
+  RUN_TEST(test_word_boundaries);
+  RUN_TEST(test_line_breaks);
+  RUN_TEST(test_null_args);
+  RUN_TEST(test_utf8_large_buffers);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(unicode_suite);
+  GREATEST_MAIN_END();
+}
@@ -0,0 +1,481 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+/* clang-format on */
+
+#define MAX_CELLS 256
+
+typedef struct vl_fixture {
+  size_t count;
+  int measure;     /* Bind reports height 20/30/40 by index */
+  int typed;       /* Odd items use cell type 1 */
+  size_t created;
+  size_t bound;
+  size_t destroyed;
+  int type_mismatch;
+  cmp_ui_node_t *cells[MAX_CELLS];
+  int cell_types[MAX_CELLS];
+} vl_fixture_t;
+
+static size_t vl_count(void *user_data) {
+  return ((vl_fixture_t *)user_data)->count;
+}
+
+static int vl_cell_type(void *user_data, size_t index) {
+  vl_fixture_t *f = (vl_fixture_t *)user_data;
+  return f->typed ? (int)(index & 1) : 0;
+}
+
+static int vl_create(void *user_data, int cell_type, cmp_ui_node_t **out) {
+  vl_fixture_t *f = (vl_fixture_t *)user_data;
+  int res;
+  if (f->created >= MAX_CELLS)
+    return CMP_ERROR_BOUNDS;
+  res = cmp_ui_box_create(out);
+  if (res != CMP_SUCCESS)
+    return res;
+  f->cells[f->created] = *out;
+  f->cell_types[f->created] = cell_type;
+  f->created++;
+  return CMP_SUCCESS;
+}
+
+static int vl_bind(void *user_data, cmp_ui_node_t *cell, size_t index,
+                   float *io_height) {
+  vl_fixture_t *f = (vl_fixture_t *)user_data;
+  size_t i;
+  for (i = 0; i < f->created; ++i)
+    if (f->cells[i] == cell && f->cell_types[i] != vl_cell_type(f, index))
+      f->type_mismatch = 1;
+  if (f->measure)
+    *io_height = 20.0f + 10.0f * (float)(index % 3);
+  f->bound++;
+  return CMP_SUCCESS;
+}
+
+static void vl_destroy(void *user_data, cmp_ui_node_t *cell) {
+  vl_fixture_t *f = (vl_fixture_t *)user_data;
+  size_t i;
+  for (i = 0; i < f->created; ++i)
+    if (f->cells[i] == cell)
+      f->destroyed++;
+}
+
+static void vl_source(vl_fixture_t *f, cmp_virtual_list_source_t *src,
+                      size_t count) {
+  memset(f, 0, sizeof(*f));
+  memset(src, 0, sizeof(*src));
+  f->count = count;
+  src->count = vl_count;
+  src->create_cell = vl_create;
+  src->bind_cell = vl_bind;
+  src->cell_type = vl_cell_type;
+  src->destroy_cell = vl_destroy;
+  src->estimated_height = 20.0f;
+  src->user_data = f;
+}
+
+TEST test_virtual_list_invalid(void) {
+  vl_fixture_t f;
+  cmp_virtual_list_source_t src;
+  cmp_virtual_list_t *list = NULL;
+  cmp_ui_node_t *container = NULL;
+
+  vl_source(&f, &src, 10);
+  cmp_ui_list_view_create(&container);
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_virtual_list_create(&list, NULL, &src, 1));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_virtual_list_create(&list, container, &src, 0));
+  src.estimated_height = 0.0f;
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_virtual_list_create(&list, container, &src, 1));
+  src.estimated_height = 20.0f;
+  src.bind_cell = NULL;
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_virtual_list_create(&list, container, &src, 1));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_virtual_list_destroy(NULL));
+  cmp_ui_node_destroy(container);
+  PASS();
+}
+
+TEST test_virtual_list_million_rows(void) {
+  vl_fixture_t f;
+  cmp_virtual_list_source_t src;
+  cmp_virtual_list_t *list = NULL;
+  cmp_ui_node_t *container = NULL, *cell = NULL;
+  size_t first, count, i, index;
+  double offset, height;
+
+  vl_source(&f, &src, 1000000);
+  ASSERT_EQ(CMP_SUCCESS, cmp_ui_list_view_create(&container));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_create(&list, container, &src, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_set_viewport(list, 320, 200));
+
+  /* 10 visible rows + 2 overscan below */
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_visible_range(list, &first,
+                                                            &count));
+  ASSERT_EQ(0, first);
+  ASSERT_EQ(13, count);
+  ASSERT_EQ(13, container->child_count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_content_height(list, &height));
+  ASSERT_EQ(20000000.0, height);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 3, &cell));
+  ASSERT_EQ(CMP_POSITION_ABSOLUTE, cell->layout->position_type);
+  ASSERT_EQ(60.0f, cell->layout->position[0]);
+  ASSERT_EQ(320.0f, cell->layout->width);
+  ASSERT_EQ(CMP_ERROR_NOT_FOUND, cmp_virtual_list_get_cell(list, 500, &cell));
+
+  /* Scrolling the whole list never creates more than a viewport of cells */
+  for (offset = 0.0; offset < 20000000.0; offset += 997.0)
+    ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to(list, offset));
+  ASSERT(f.created <= 17);
+  ASSERT(container->child_count <= 15);
+  ASSERT_EQ(0, f.type_mismatch);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to_item(list, 500000));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_visible_range(list, &first,
+                                                            &count));
+  ASSERT_EQ(499998, first);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 500000, &cell));
+  ASSERT_EQ(0.0f, cell->layout->position[0]);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_item_at(list, 10000010.0,
+                                                      &index));
+  ASSERT_EQ(500000, index);
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_virtual_list_scroll_to_item(list, 1000000));
+
+  /* Scrolling back reuses pooled cells */
+  i = f.created;
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to(list, 0.0));
+  ASSERT_EQ(i, f.created);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_destroy(list));
+  ASSERT_EQ(0, container->child_count);
+  cmp_ui_node_destroy(container);
+  PASS();
+}
+
+TEST test_virtual_list_measured_heights(void) {
+  vl_fixture_t f;
+  cmp_virtual_list_source_t src;
+  cmp_virtual_list_t *list = NULL;
+  cmp_ui_node_t *container = NULL, *cell = NULL;
+  size_t i, index;
+  double offset, expected, height;
+
+  vl_source(&f, &src, 100000);
+  f.measure = 1;
+  cmp_ui_list_view_create(&container);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_create(&list, container, &src, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_set_overscan(list, 0));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_set_viewport(list, 100, 100));
+
+  /* Rows 0..3 measured as 20, 30, 40, 20 */
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_item_offset(list, 3, &offset));
+  ASSERT_EQ(90.0, offset);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 2, &cell));
+  ASSERT_EQ(50.0f, cell->layout->position[0]);
+  ASSERT_EQ(40.0f, cell->layout->height);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_item_at(list, 89.5, &index));
+  ASSERT_EQ(2, index);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_item_at(list, 90.0, &index));
+  ASSERT_EQ(3, index);
+
+  /* Measure a stretch and check offsets and lookups agree with a scan */
+  for (i = 0; i < 3000; i += 4)
+    ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to_item(list, i));
+  expected = 0.0;
+  for (i = 0; i < 3000; ++i) {
+    ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_item_offset(list, i,
+                                                            &offset));
+    ASSERT_EQ(expected, offset);
+    ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_item_at(list, offset + 1.0,
+                                                        &index));
+    ASSERT_EQ(i, index);
+    expected += 20.0 + 10.0 * (double)(i % 3);
+  }
+  /* Unmeasured rows keep the estimate */
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_content_height(list, &height));
+  ASSERT(height > 100000.0 * 20.0);
+  ASSERT(height < 100000.0 * 30.0);
+
+  /* Rebinding a visible row leaves it in place */
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to_item(list, 10));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_reload_item(list, 10));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 10, &cell));
+  ASSERT_EQ(0.0f, cell->layout->position[0]);
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_virtual_list_reload_item(list, 100000));
+
+  /* Shrinking the data set clamps the bound range */
+  f.count = 5;
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_reload(list));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to(list, 0.0));
+  ASSERT_EQ(4, container->child_count);
+
+  cmp_virtual_list_destroy(list);
+  cmp_ui_node_destroy(container);
+  PASS();
+}
+
+TEST test_virtual_list_cell_types(void) {
+  vl_fixture_t f;
+  cmp_virtual_list_source_t src;
+  cmp_virtual_list_t *list = NULL;
+  cmp_ui_node_t *container = NULL;
+  size_t i, created;
+
+  vl_source(&f, &src, 10000);
+  f.typed = 1;
+  cmp_ui_list_view_create(&container);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_create(&list, container, &src, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_set_viewport(list, 100, 100));
+  for (i = 0; i < 2000; i += 7)
+    ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to_item(list, i));
+  ASSERT_EQ(0, f.type_mismatch);
+  created = f.created;
+  ASSERT(created <= 14);
+  for (i = 2000; i > 0; i -= 5)
+    ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to_item(list, i));
+  ASSERT_EQ(0, f.type_mismatch);
+  ASSERT_EQ(created, f.created);
+
+  cmp_virtual_list_destroy(list);
+  cmp_ui_node_destroy(container);
+  PASS();
+}
+
+TEST test_virtual_list_grid(void) {
+  vl_fixture_t f;
+  cmp_virtual_list_source_t src;
+  cmp_virtual_list_t *list = NULL;
+  cmp_ui_node_t *container = NULL, *cell = NULL;
+  size_t first, count, index;
+  double offset, height;
+
+  vl_source(&f, &src, 1001);
+  f.measure = 1;
+  cmp_ui_list_view_create(&container);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_create(&list, container, &src, 4));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_set_overscan(list, 0));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_set_viewport(list, 400, 100));
+
+  /* Every row holds indices 20/30/40 tall, so each row is 40 tall */
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_visible_range(list, &first,
+                                                            &count));
+  ASSERT_EQ(0, first);
+  ASSERT_EQ(12, count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 6, &cell));
+  ASSERT_EQ(40.0f, cell->layout->position[0]);
+  ASSERT_EQ(200.0f, cell->layout->position[3]);
+  ASSERT_EQ(100.0f, cell->layout->width);
+  ASSERT_EQ(40.0f, cell->layout->height);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_item_offset(list, 9, &offset));
+  ASSERT_EQ(80.0, offset);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_item_at(list, 45.0, &index));
+  ASSERT_EQ(4, index);
+
+  /* The last row is partial */
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to_item(list, 1000));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_visible_range(list, &first,
+                                                            &count));
+  ASSERT_EQ(1000, first);
+  ASSERT_EQ(1, count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_content_height(list, &height));
+  /* Rows 0-4 were bound (and measured 40) while the first rows still used
+   * the estimate, row 250 measured 30, the rest are estimated */
+  ASSERT_EQ(200.0 + 30.0 + 245.0 * 20.0, height);
+
+  cmp_virtual_list_destroy(list);
+  cmp_ui_node_destroy(container);
+  PASS();
+}
+
+static int vl_apply(const cmp_diff_result_t *diff, void *user_data) {
+  return cmp_virtual_list_apply_diff((cmp_virtual_list_t *)user_data, diff);
+}
+
+TEST test_virtual_list_apply_diff(void) {
+  vl_fixture_t f;
+  cmp_virtual_list_source_t src;
+  cmp_virtual_list_t *list = NULL;
+  cmp_ui_node_t *container = NULL, *cell = NULL, *cell5 = NULL;
+  uint64_t old_ids[1000], new_ids[1001];
+  cmp_diff_result_t diff;
+  cmp_diffable_datasource_t *ds = NULL;
+  size_t i, created, bound;
+  double before, after;
+
+  vl_source(&f, &src, 1000);
+  f.measure = 1;
+  cmp_ui_list_view_create(&container);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_create(&list, container, &src, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_set_viewport(list, 100, 200));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to_item(list, 5));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 5, &cell5));
+
+  /* Insert an item at the top, delete item 7 */
+  for (i = 0; i < 1000; ++i)
+    old_ids[i] = 100 + i;
+  new_ids[0] = 1;
+  for (i = 0; i < 1000; ++i)
+    new_ids[i + 1] = old_ids[i];
+  memmove(new_ids + 8, new_ids + 9, (1001 - 9) * sizeof(uint64_t));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_diff_identifiers(old_ids, 1000, new_ids, 1000, &diff));
+  created = f.created;
+  bound = f.bound;
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_apply_diff(list, &diff));
+  cmp_diff_result_free(&diff);
+
+  /* The old item 5 keeps its node, height and place on screen */
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 6, &cell));
+  ASSERT(cell == cell5);
+  ASSERT_EQ(0.0f, cell->layout->position[0]);
+  ASSERT_EQ(40.0f, cell->layout->height);
+  ASSERT_EQ(created, f.created);
+  /* Only the inserted row (above the viewport) and rows shifted in by the
+   * delete were bound */
+  ASSERT(f.bound - bound <= 3);
+
+  /* Driven by a data source, reloads rebind visible cells in place */
+  ASSERT_EQ(CMP_SUCCESS, cmp_diffable_datasource_create(&ds));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_diffable_datasource_apply_snapshot(ds, new_ids, 1000));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_diffable_datasource_set_update_handler(ds, vl_apply, list));
+  bound = f.bound;
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_diffable_datasource_reload_items(ds, &new_ids[6], 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 6, &cell));
+  ASSERT(cell == cell5);
+  /* Rebound as item 6 it measures 20, which lets one more row in below */
+  ASSERT_EQ(20.0f, cell->layout->height);
+  ASSERT_EQ(bound + 2, f.bound);
+
+  /* Moving the top item to the end keeps the viewport on the same items */
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_scroll_offset(list, &before));
+  new_ids[1000] = new_ids[0];
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_diffable_datasource_apply_snapshot(ds, new_ids + 1, 1000));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 5, &cell));
+  ASSERT(cell == cell5);
+  ASSERT_EQ(0.0f, cell->layout->position[0]);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_scroll_offset(list, &after));
+  ASSERT_EQ(before - 20.0, after);
+
+  /* The data source must report the new count before the diff lands */
+  f.count = 5;
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE,
+            cmp_diffable_datasource_apply_snapshot(ds, new_ids, 999));
+  cmp_diffable_datasource_destroy(ds);
+  f.count = 999;
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_reload(list));
+
+  cmp_virtual_list_destroy(list);
+  cmp_ui_node_destroy(container);
+  PASS();
+}
+
+TEST test_virtual_list_splice(void) {
+  vl_fixture_t f;
+  cmp_virtual_list_source_t src;
+  cmp_virtual_list_t *list = NULL;
+  cmp_ui_node_t *container = NULL, *cell = NULL, *kept0 = NULL,
+                *kept9 = NULL;
+  size_t first, count, bound;
+  double offset;
+
+  vl_source(&f, &src, 1000);
+  cmp_ui_list_view_create(&container);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_create(&list, container, &src, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_set_viewport(list, 100, 200));
+  cmp_virtual_list_get_cell(list, 0, &kept0);
+  cmp_virtual_list_get_cell(list, 9, &kept9);
+  bound = f.bound;
+
+  /* The count has to be updated first */
+  ASSERT_EQ(CMP_ERROR_INVALID_STATE, cmp_virtual_list_splice(list, 5, 0, 3));
+  ASSERT_EQ(CMP_ERROR_BOUNDS, cmp_virtual_list_splice(list, 990, 20, 0));
+
+  /* Insert 3 rows at 5: 0-4 stay put, 5-7 are new, 9 moves to 12 */
+  f.count = 1003;
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_splice(list, 5, 0, 3));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 0, &cell));
+  ASSERT(cell == kept0);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 12, &cell));
+  ASSERT(cell == kept9);
+  ASSERT_EQ(240.0f, cell->layout->position[0]);
+  ASSERT_EQ(bound + 3, f.bound);
+  cmp_virtual_list_get_visible_range(list, &first, &count);
+  ASSERT_EQ(0, (int)first);
+  ASSERT_EQ(13, (int)count);
+  ASSERT_EQ((int)count, (int)container->child_count);
+
+  /* Removing the rows above the viewport keeps the top row on screen */
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to_item(list, 500));
+  cmp_virtual_list_get_cell(list, 500, &kept0);
+  f.count = 903;
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_splice(list, 100, 100, 0));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 400, &cell));
+  ASSERT(cell == kept0);
+  ASSERT_EQ(0.0f, cell->layout->position[0]);
+  cmp_virtual_list_get_scroll_offset(list, &offset);
+  ASSERT_EQ(8000.0, offset);
+
+  /* Measured heights stay with their rows */
+  f.measure = 1;
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_reload(list));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to(list, 0.0));
+  f.count = 904;
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_splice(list, 0, 0, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_item_offset(list, 3, &offset));
+  ASSERT_EQ(20.0 + 20.0 + 30.0, offset);
+
+  cmp_virtual_list_destroy(list);
+  cmp_ui_node_destroy(container);
+  PASS();
+}
+
+TEST test_virtual_list_destroy_cell(void) {
+  vl_fixture_t f;
+  cmp_virtual_list_source_t src;
+  cmp_virtual_list_t *list = NULL;
+  cmp_ui_node_t *container = NULL;
+  size_t i;
+
+  vl_source(&f, &src, 1000);
+  f.typed = 1;
+  cmp_ui_list_view_create(&container);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_create(&list, container, &src, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_set_viewport(list, 100, 100));
+  for (i = 0; i < 500; i += 13)
+    ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_scroll_to_item(list, i));
+  ASSERT(f.created > 0);
+  ASSERT_EQ(0, f.destroyed);
+
+  /* Every cell, bound or pooled, goes through the hook exactly once */
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_destroy(list));
+  ASSERT_EQ(f.created, f.destroyed);
+  cmp_ui_node_destroy(container);
+  PASS();
+}
+
+SUITE(virtual_list_suite) {
+  RUN_TEST(test_virtual_list_invalid);
+  RUN_TEST(test_virtual_list_million_rows);
+  RUN_TEST(test_virtual_list_measured_heights);
+  RUN_TEST(test_virtual_list_cell_types);
+  RUN_TEST(test_virtual_list_grid);
+  RUN_TEST(test_virtual_list_apply_diff);
+  RUN_TEST(test_virtual_list_splice);
+  RUN_TEST(test_virtual_list_destroy_cell);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(virtual_list_suite);
+  GREATEST_MAIN_END();
+}
@@ -0,0 +1,94 @@
+/* clang-format off */
+#include "cmp.h"
+#include "greatest.h"
+#include <string.h>
+/* clang-format on */
+
+TEST test_ws_frame_codec(void) {
+  /* RFC 6455 5.7: masked "Hello", then "Hel" + "lo" fragments */
+  unsigned char masked[] = {0x81, 0x85, 0x37, 0xfa, 0x21, 0x3d, 0x7f,
+                            0x9f, 0x4d, 0x51, 0x58};
+  unsigned char fragments[] = {0x01, 0x03, 'H', 'e', 'l', 0x80, 0x02, 'l',
+                               'o'};
+  unsigned char bad[4] = {0xA1, 0x00, 0x89, 0x7E};
+  unsigned char mask[4] = {0x12, 0x34, 0x56, 0x78};
+  unsigned char buf[300], plain[300], header[14];
+  cmp_ws_frame_t frame;
+  size_t used, n, i, off;
+  char accept[29];
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_ws_frame_parse(masked, 6, &frame, &used));
+  ASSERT_EQ(0, used);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_ws_frame_parse(masked, sizeof(masked), &frame, &used));
+  ASSERT_EQ(sizeof(masked), used);
+  ASSERT(frame.fin);
+  ASSERT_EQ(CMP_WS_OP_TEXT, frame.opcode);
+  ASSERT_EQ(5, frame.payload_len);
+  ASSERT_MEM_EQ("Hello", frame.payload, 5);
+  ASSERT(frame.payload == masked + 6);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_ws_frame_parse(fragments, sizeof(fragments),
+                                            &frame, &used));
+  ASSERT_EQ(5, used);
+  ASSERT(!frame.fin);
+  ASSERT_EQ(CMP_SUCCESS, cmp_ws_frame_parse(fragments + used,
+                                            sizeof(fragments) - used, &frame,
+                                            &used));
+  ASSERT(frame.fin);
+  ASSERT_EQ(CMP_WS_OP_CONTINUATION, frame.opcode);
+  ASSERT_MEM_EQ("lo", frame.payload, 2);
+
+  /* RSV2, and a control frame with a 16-bit length */
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_ws_frame_parse(bad, 2, &frame, &used));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_ws_frame_parse(bad + 2, 2, &frame, &used));
+
+  /* Headers round-trip through the parser at every length class */
+  for (i = 0; i < 3; ++i) {
+    size_t len = i == 0 ? 125 : (i == 1 ? 126 : 200);
+    n = cmp_ws_frame_header(buf, 1, i == 2, CMP_WS_OP_BINARY, len, mask);
+    ASSERT_EQ(len < 126 ? 6 : 8, n);
+    for (off = 0; off < len; ++off) {
+      plain[off] = (unsigned char)(off * 7 + i);
+    }
+    memcpy(buf + n, plain, len);
+    cmp_ws_mask(buf + n, len, mask, 0);
+    ASSERT_EQ(CMP_SUCCESS, cmp_ws_frame_parse(buf, n + len, &frame, &used));
+    ASSERT_EQ(n + len, used);
+    ASSERT_EQ(i == 2, frame.compressed);
+    ASSERT_EQ(len, frame.payload_len);
+    ASSERT_MEM_EQ(plain, frame.payload, len);
+  }
+  ASSERT_EQ(10, cmp_ws_frame_header(header, 1, 0, CMP_WS_OP_BINARY, 65536,
+                                    NULL));
+  ASSERT_EQ(127, header[1]);
+  ASSERT_EQ(1, header[7]);
+
+  /* Word-wise masking matches byte-wise at any phase */
+  for (off = 0; off < 4; ++off) {
+    for (i = 0; i < 37; ++i) {
+      buf[i] = plain[i];
+    }
+    cmp_ws_mask(buf, 37, mask, off);
+    for (i = 0; i < 37; ++i) {
+      ASSERT_EQ(plain[i] ^ mask[(off + i) & 3], buf[i]);
+    }
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_ws_accept_key("dGhlIHNhbXBsZSBub25jZQ==", accept));
+  ASSERT_STR_EQ("s3pPLMBiTxaQ9kYGzzhZRbK+xOo=", accept);
+  PASS();
+}
+
+SUITE(ws_codec_suite) {
+  RUN_TEST(test_ws_frame_codec);
+}
+
+GREATEST_MAIN_DEFS();
+
+int main(int argc, char **argv) {
+  GREATEST_MAIN_BEGIN();
+  RUN_SUITE(ws_codec_suite);
+  GREATEST_MAIN_END();
+}
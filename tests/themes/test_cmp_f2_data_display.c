@@ -144,6 +144,46 @@ TEST test_f2_datagrid(void) {
   PASS();
 }
 
+TEST test_f2_datagrid_model(void) {
+  cmp_ui_node_t *grid = NULL, *cell = NULL;
+  cmp_datagrid_model_t *model = NULL;
+  cmp_datagrid_view_t *view = NULL;
+  cmp_f2_datagrid_t *data;
+  const char *names[] = {"alpha", "beta", "gamma", "delta"};
+  int64_t ids[4] = {4, 3, 2, 1};
+  size_t id_col, name_col, first_row, rows, first_col, cols;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_model_create(&model));
+  cmp_datagrid_model_add_column(model, "id", CMP_COLUMN_INT64, &id_col);
+  cmp_datagrid_model_add_column(model, "name", CMP_COLUMN_STRING, &name_col);
+  cmp_datagrid_model_append_int64(model, id_col, ids, 4);
+  cmp_datagrid_model_append_strings(model, name_col, names, 4);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_f2_datagrid_create(&grid));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_f2_datagrid_set_model(grid, model, 0));
+  ASSERT_EQ(CMP_SUCCESS, cmp_f2_datagrid_set_model(grid, model, 32.0f));
+  ASSERT_EQ(CMP_SUCCESS, cmp_f2_datagrid_get_view(grid, &view));
+  ASSERT(view != NULL);
+  data = (cmp_f2_datagrid_t *)grid->properties;
+  ASSERT(data->rows_container_node != NULL);
+
+  /* Two rows fit, the first column is visible */
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_view_set_viewport(view, 100, 64));
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_view_get_window(view, &first_row, &rows,
+                                                      &first_col, &cols));
+  ASSERT_EQ(4, (int)rows); /* Every row, with one of overscan */
+  ASSERT_EQ(1, (int)cols);
+  ASSERT_EQ(4, (int)data->rows_container_node->child_count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_datagrid_view_get_cell(view, 0, 0, &cell));
+  ASSERT_STR_EQ("4", (const char *)cell->properties);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_f2_datagrid_set_model(grid, NULL, 0));
+  ASSERT_EQ(0, (int)data->rows_container_node->child_count);
+  cmp_ui_node_destroy(grid);
+  cmp_datagrid_model_destroy(model);
+  PASS();
+}
+
 TEST test_f2_tree(void) {
   cmp_ui_node_t *tree = NULL;
   cmp_ui_node_t *item = NULL;
@@ -175,6 +215,59 @@ TEST test_f2_tree(void) {
   PASS();
 }
 
+TEST test_f2_tree_model(void) {
+  cmp_ui_node_t *tree = NULL;
+  cmp_ui_node_t *cell = NULL;
+  cmp_tree_model_t *model = NULL;
+  cmp_virtual_list_t *list = NULL;
+  cmp_f2_tree_item_t *item;
+  const char *top[] = {"Documents", "Pictures"};
+  const int dirs[] = {1, 0};
+  const char *docs[] = {"a.txt", "b.txt", "c.txt"};
+  size_t first, count;
+
+  cmp_f2_tree_create(&tree);
+  cmp_tree_model_create(&model, NULL, NULL);
+  cmp_tree_model_set_children(model, CMP_TREE_ROOT, top, dirs, 2, NULL);
+  cmp_tree_model_set_children(model, 1, docs, NULL, 3, NULL);
+  ASSERT_EQ(CMP_SUCCESS, cmp_f2_tree_set_model(tree, model, 24.0f));
+  ASSERT_EQ(CMP_SUCCESS, cmp_f2_tree_get_list(tree, &list));
+  ASSERT(list != NULL);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_set_viewport(list, 200, 240));
+  ASSERT_EQ(2, (int)tree->child_count);
+
+  /* Expanding a bound item splices its children in below it */
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 0, &cell));
+  item = (cmp_f2_tree_item_t *)cell->properties;
+  ASSERT_STR_EQ("Documents", (const char *)item->content_node->properties);
+  ASSERT_EQ(CMP_SUCCESS, cmp_f2_tree_item_set_expanded(cell, 1));
+  ASSERT_EQ(5, (int)tree->child_count);
+  cmp_virtual_list_get_visible_range(list, &first, &count);
+  ASSERT_EQ(5, (int)count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 2, &cell));
+  item = (cmp_f2_tree_item_t *)cell->properties;
+  ASSERT_STR_EQ("b.txt", (const char *)item->content_node->properties);
+  ASSERT_EQ(16.0f, cell->layout->padding[3]);
+  ASSERT_EQ(48.0f, cell->layout->position[0]);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 4, &cell));
+  item = (cmp_f2_tree_item_t *)cell->properties;
+  ASSERT_STR_EQ("Pictures", (const char *)item->content_node->properties);
+
+  /* Collapsing through the model recycles the child rows */
+  ASSERT_EQ(CMP_SUCCESS, cmp_tree_model_set_expanded(model, 1, 0));
+  ASSERT_EQ(2, (int)tree->child_count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_virtual_list_get_cell(list, 0, &cell));
+  ASSERT_EQ(0, ((cmp_f2_tree_item_t *)cell->properties)->is_expanded);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_f2_tree_set_model(tree, NULL, 0.0f));
+  ASSERT_EQ(0, (int)tree->child_count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_f2_tree_get_list(tree, &list));
+  ASSERT(list == NULL);
+  cmp_tree_model_destroy(model);
+  cmp_ui_node_destroy(tree);
+  PASS();
+}
+
 TEST test_f2_data_display_invalid_args(void) {
   int res;
 
@@ -216,7 +309,9 @@ SUITE(cmp_f2_data_display_suite) {
   RUN_TEST(test_f2_badge);
   RUN_TEST(test_f2_tag);
   RUN_TEST(test_f2_datagrid);
+  RUN_TEST(test_f2_datagrid_model);
   RUN_TEST(test_f2_tree);
+  RUN_TEST(test_f2_tree_model);
   RUN_TEST(test_f2_data_display_invalid_args);
 }
 
@@ -53,10 +53,123 @@ TEST test_m3_schemes(void) {
   PASS();
 }
 
+TEST test_m3_batch_matches_scalar(void) {
+  cmp_color_t in[19];
+  cmp_color_t out[19];
+  cmp_color_t scalar;
+  float hue[19], chroma[19], tone[19];
+  float h, c, t;
+  int i;
+
+  for (i = 0; i < 19; i++) {
+    in[i].r = (float)i / 18.0f;
+    in[i].g = (float)((i * 7) % 19) / 18.0f;
+    in[i].b = (float)((i * 11) % 19) / 18.0f;
+    in[i].a = 1.0f;
+    in[i].space = CMP_COLOR_SPACE_SRGB;
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_m3_srgb_to_hct_batch(in, 19, hue, chroma, tone));
+  ASSERT_EQ(CMP_SUCCESS, cmp_m3_hct_to_srgb_batch(hue, chroma, tone, 19, out));
+
+  for (i = 0; i < 19; i++) {
+    ASSERT_EQ(CMP_SUCCESS, cmp_m3_srgb_to_hct(&in[i], &h, &c, &t));
+    ASSERT_EQ(h, hue[i]);
+    ASSERT_EQ(c, chroma[i]);
+    ASSERT_EQ(t, tone[i]);
+    ASSERT_EQ(CMP_SUCCESS, cmp_m3_hct_to_srgb(h, c, t, &scalar));
+    ASSERT_EQ(scalar.r, out[i].r);
+    ASSERT_EQ(scalar.g, out[i].g);
+    ASSERT_EQ(scalar.b, out[i].b);
+  }
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_m3_srgb_to_hct_batch(NULL, 0, NULL, NULL, NULL));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_m3_hct_to_srgb_batch(NULL, chroma, tone, 1, out));
+  PASS();
+}
+
+TEST test_m3_tonal_palette_build(void) {
+  cmp_m3_tonal_palette_t palette;
+  cmp_color_t scalar;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_m3_tonal_palette_build(120.0f, 36.0f, &palette));
+  ASSERT_EQ(1, palette.computed[0]);
+  ASSERT_EQ(1, palette.computed[100]);
+  cmp_m3_hct_to_srgb(120.0f, 36.0f, 40.0f, &scalar);
+  ASSERT_EQ(scalar.r, palette.tones[40].r);
+  ASSERT_EQ(scalar.g, palette.tones[40].g);
+  ASSERT_EQ(scalar.b, palette.tones[40].b);
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_m3_tonal_palette_build(0.0f, 0.0f, NULL));
+  PASS();
+}
+
+TEST test_m3_palette_cache(void) {
+  cmp_m3_palette_cache_t *cache = NULL;
+  float tones[4];
+  cmp_color_t out[4];
+  cmp_color_t scalar;
+  size_t hits, misses;
+
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG, cmp_m3_palette_cache_create(0, &cache));
+  ASSERT_EQ(CMP_SUCCESS, cmp_m3_palette_cache_create(8, &cache));
+
+  tones[0] = 40.0f;
+  tones[1] = 90.0f;
+  tones[2] = 40.0f;
+  tones[3] = 42.5f;
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_m3_palette_cache_tones(cache, 200.0f, 48.0f, tones, 4, out));
+  cmp_m3_hct_to_srgb(200.0f, 48.0f, 40.0f, &scalar);
+  ASSERT_EQ(scalar.r, out[0].r);
+  ASSERT_EQ(out[0].g, out[2].g);
+  cmp_m3_hct_to_srgb(200.0f, 48.0f, 42.5f, &scalar);
+  ASSERT_EQ(scalar.b, out[3].b);
+
+  /* Same palette (hue wraps) is a hit; a new chroma is a miss. */
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_m3_palette_cache_tones(cache, 560.0f, 48.0f, tones, 1, out));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_m3_palette_cache_tones(cache, 200.0f, 16.0f, tones, 1, out));
+  ASSERT_EQ(CMP_SUCCESS, cmp_m3_palette_cache_get_stats(cache, &hits, &misses));
+  ASSERT_EQ(1, (int)hits);
+  ASSERT_EQ(2, (int)misses);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_m3_palette_cache_destroy(cache));
+  PASS();
+}
+
+TEST test_m3_palette_cache_eviction_benchmark(void) {
+  /* Animated seed changes: far more palettes than capacity stay correct. */
+  cmp_m3_palette_cache_t *cache = NULL;
+  float tones[3];
+  cmp_color_t out[3];
+  cmp_color_t scalar;
+  int i;
+
+  tones[0] = 10.0f;
+  tones[1] = 50.0f;
+  tones[2] = 95.0f;
+  ASSERT_EQ(CMP_SUCCESS, cmp_m3_palette_cache_create(4, &cache));
+  for (i = 0; i < 720; i++) {
+    ASSERT_EQ(CMP_SUCCESS, cmp_m3_palette_cache_tones(
+                               cache, (float)i * 0.5f, 36.0f, tones, 3, out));
+  }
+  cmp_m3_hct_to_srgb(359.5f, 36.0f, 50.0f, &scalar);
+  ASSERT_EQ(scalar.g, out[1].g);
+  cmp_m3_palette_cache_destroy(cache);
+  PASS();
+}
+
 SUITE(cmp_material3_color_suite) {
   RUN_TEST(test_m3_color_conversion);
   RUN_TEST(test_m3_tonal_palette);
   RUN_TEST(test_m3_schemes);
+  RUN_TEST(test_m3_batch_matches_scalar);
+  RUN_TEST(test_m3_tonal_palette_build);
+  RUN_TEST(test_m3_palette_cache);
+  RUN_TEST(test_m3_palette_cache_eviction_benchmark);
 }
 
 GREATEST_MAIN_DEFS();
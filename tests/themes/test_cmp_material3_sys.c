@@ -44,6 +44,47 @@ TEST test_m3_sys_colors(void) {
   PASS();
 }
 
+TEST test_m3_sys_colors_cached(void) {
+  cmp_m3_palette_cache_t *cache = NULL;
+  cmp_m3_sys_colors_t direct;
+  cmp_m3_sys_colors_t cached;
+  cmp_color_t seed;
+  size_t hits, misses;
+  int is_dark;
+
+  seed.r = 0.2f;
+  seed.g = 0.4f;
+  seed.b = 0.8f;
+  seed.a = 1.0f;
+  seed.space = CMP_COLOR_SPACE_SRGB;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_m3_palette_cache_create(16, &cache));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_m3_sys_colors_generate_cached(
+                NULL, seed, 0, CMP_M3_CONTRAST_STANDARD, &cached));
+
+  for (is_dark = 0; is_dark < 2; is_dark++) {
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_m3_sys_colors_generate(seed, is_dark,
+                                         CMP_M3_CONTRAST_STANDARD, &direct));
+    ASSERT_EQ(CMP_SUCCESS,
+              cmp_m3_sys_colors_generate_cached(
+                  cache, seed, is_dark, CMP_M3_CONTRAST_STANDARD, &cached));
+    ASSERT_IN_RANGE(direct.primary.r, cached.primary.r, 0.002f);
+    ASSERT_IN_RANGE(direct.tertiary.g, cached.tertiary.g, 0.002f);
+    ASSERT_IN_RANGE(direct.surface.b, cached.surface.b, 0.002f);
+    ASSERT_IN_RANGE(direct.outline.r, cached.outline.r, 0.002f);
+  }
+
+  /* Six palettes, built once on the light pass and reused for dark. */
+  cmp_m3_palette_cache_get_stats(cache, &hits, &misses);
+  ASSERT_EQ(6, (int)misses);
+  ASSERT_EQ(6, (int)hits);
+
+  cmp_m3_palette_cache_destroy(cache);
+  PASS();
+}
+
 TEST test_m3_shape_resolve(void) {
   float tl, tr, bl, br;
   cmp_m3_shape_modifiers_t mods;
@@ -191,6 +232,7 @@ TEST test_m3_state_layer_resolve(void) {
 
 SUITE(cmp_material3_sys_suite) {
   RUN_TEST(test_m3_sys_colors);
+  RUN_TEST(test_m3_sys_colors_cached);
   RUN_TEST(test_m3_shape_resolve);
   RUN_TEST(test_m3_elevation_resolve);
   RUN_TEST(test_m3_state_layer_resolve);
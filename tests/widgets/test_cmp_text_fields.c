@@ -1,8 +1,53 @@
 /* clang-format off */
 #include "cmp.h"
 #include "greatest.h"
+
+#include <time.h>
 /* clang-format on */
 
+static const char *const g_dictionary[] = {"hello", "world", "the", "more",
+                                           "text"};
+
+static cmp_spellcheck_t *make_checker(void) {
+  cmp_spellcheck_t *checker = NULL;
+  cmp_spellcheck_create(&checker);
+  cmp_spellcheck_build_dictionary(checker, g_dictionary, 5);
+  return checker;
+}
+
+typedef struct spell_wait {
+  cmp_modality_t *ui;
+  cmp_text_field_t *field; /* NULL: just let the loop run for a while */
+  size_t want;
+  clock_t deadline;
+} spell_wait_t;
+
+/* Runs on the ui loop until the field reports the wanted number of
+ * misspellings or the deadline passes. */
+static void spell_wait_task(void *arg) {
+  spell_wait_t *wait = (spell_wait_t *)arg;
+  const cmp_spell_range_t *ranges;
+  size_t count = 0;
+  if (wait->field)
+    cmp_text_field_get_misspellings(wait->field, &ranges, &count);
+  if ((wait->field && count == wait->want) || clock() > wait->deadline) {
+    cmp_modality_stop(wait->ui);
+    return;
+  }
+  cmp_modality_queue_task(wait->ui, spell_wait_task, wait);
+}
+
+static void spell_wait(cmp_modality_t *ui, cmp_text_field_t *field,
+                       size_t want, clock_t budget) {
+  spell_wait_t wait;
+  wait.ui = ui;
+  wait.field = field;
+  wait.want = want;
+  wait.deadline = clock() + budget;
+  cmp_modality_queue_task(ui, spell_wait_task, &wait);
+  cmp_modality_run(ui);
+}
+
 TEST test_text_field_configurations(void) {
   cmp_text_field_t *ctx = NULL;
   cmp_ui_node_t dummy_node; /* Assuming opaque pointer is fine for test */
@@ -47,6 +92,199 @@ TEST test_rich_text_detectors(void) {
   PASS();
 }
 
+TEST test_text_field_editing(void) {
+  cmp_text_field_t *tf = NULL;
+  cmp_text_buffer_t *buf = NULL;
+  const char *text = NULL;
+  size_t caret = 0;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_create(&tf));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_insert_text(tf, "ac"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_set_caret_position(tf, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_insert_text(tf, "b\xC3\xA9"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_text(tf, &text));
+  ASSERT_STR_EQ("ab\xC3\xA9" "c", text);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_caret_position(tf, &caret));
+  ASSERT_EQ(4, (int)caret);
+
+  /* Backspace removes the whole two-byte code point */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_delete_backward(tf));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_text(tf, &text));
+  ASSERT_STR_EQ("abc", text);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_caret_position(tf, &caret));
+  ASSERT_EQ(2, (int)caret);
+
+  /* Edits through the backing buffer keep the caret in range */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_buffer(tf, &buf));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_buffer_delete(buf, 0, 2));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_caret_position(tf, &caret));
+  ASSERT_EQ(1, (int)caret);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_delete_backward(tf));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_delete_backward(tf));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_text(tf, &text));
+  ASSERT_STR_EQ("", text);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_destroy(tf));
+  PASS();
+}
+
+TEST test_text_field_graphemes(void) {
+  cmp_text_field_t *tf = NULL;
+  const char *text;
+  size_t caret;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_create(&tf));
+  /* "a", e + combining acute, and a flag made of two regional indicators */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_insert_text(
+                             tf, "ae\xCC\x81\xF0\x9F\x87\xBA\xF0\x9F\x87\xB8"));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_text_field_move_caret(tf, CMP_TEXT_FIELD_MOVE_BACKWARD));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_caret_position(tf, &caret));
+  ASSERT_EQ(4, (int)caret);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_text_field_move_caret(tf, CMP_TEXT_FIELD_MOVE_BACKWARD));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_caret_position(tf, &caret));
+  ASSERT_EQ(1, (int)caret);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_text_field_move_caret(tf, CMP_TEXT_FIELD_MOVE_FORWARD));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_caret_position(tf, &caret));
+  ASSERT_EQ(4, (int)caret);
+
+  /* Deleting removes whole clusters */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_set_caret_position(tf, 12));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_delete_backward(tf));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_text(tf, &text));
+  ASSERT_STR_EQ("ae\xCC\x81", text);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_delete_backward(tf));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_text(tf, &text));
+  ASSERT_STR_EQ("a", text);
+
+  /* Word movement skips spaces and punctuation */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_insert_text(tf, "nd, big world"));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_text_field_move_caret(tf, CMP_TEXT_FIELD_MOVE_WORD_BACKWARD));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_caret_position(tf, &caret));
+  ASSERT_EQ(9, (int)caret);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_text_field_move_caret(tf, CMP_TEXT_FIELD_MOVE_WORD_BACKWARD));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_caret_position(tf, &caret));
+  ASSERT_EQ(5, (int)caret);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_text_field_move_caret(tf, CMP_TEXT_FIELD_MOVE_WORD_BACKWARD));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_caret_position(tf, &caret));
+  ASSERT_EQ(0, (int)caret);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_text_field_move_caret(tf, CMP_TEXT_FIELD_MOVE_WORD_FORWARD));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_caret_position(tf, &caret));
+  ASSERT_EQ(3, (int)caret);
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_text_field_move_caret(tf, CMP_TEXT_FIELD_MOVE_WORD_FORWARD));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_caret_position(tf, &caret));
+  ASSERT_EQ(8, (int)caret);
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_text_field_move_caret(tf, (cmp_text_field_move_t)9));
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_destroy(tf));
+  PASS();
+}
+
+TEST test_text_field_spellcheck(void) {
+  cmp_spellcheck_t *checker = make_checker();
+  cmp_text_field_t *tf = NULL;
+  const cmp_spell_range_t *ranges;
+  size_t count, i;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_create(&tf));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_insert_text(tf, "helo world"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_misspellings(tf, &ranges, &count));
+  ASSERT_EQ(0, (int)count);
+
+  /* Attaching checks the existing text */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_set_spellchecker(tf, checker, NULL,
+                                                         NULL));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_misspellings(tf, &ranges, &count));
+  ASSERT_EQ(1, (int)count);
+  ASSERT_EQ(0, (int)ranges[0].offset);
+  ASSERT_EQ(4, (int)ranges[0].length);
+
+  for (i = 0; i < 4; ++i)
+    ASSERT_EQ(CMP_SUCCESS, cmp_text_field_insert_text(tf, i ? "h"
+                                                            : " te"));
+  /* "helo world tehhh": fixing the first word shifts the second */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_set_caret_position(tf, 3));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_insert_text(tf, "l"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_misspellings(tf, &ranges, &count));
+  ASSERT_EQ(1, (int)count);
+  ASSERT_EQ(12, (int)ranges[0].offset);
+  ASSERT_EQ(5, (int)ranges[0].length);
+
+  /* A new paragraph is checked on its own */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_set_caret_position(tf, 17));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_insert_text(tf, "\nwrold"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_misspellings(tf, &ranges, &count));
+  ASSERT_EQ(2, (int)count);
+  ASSERT_EQ(18, (int)ranges[1].offset);
+  for (i = 0; i < 6; ++i)
+    ASSERT_EQ(CMP_SUCCESS, cmp_text_field_delete_backward(tf));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_misspellings(tf, &ranges, &count));
+  ASSERT_EQ(1, (int)count);
+  ASSERT_EQ(12, (int)ranges[0].offset);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_set_spellcheck_enabled(tf, 0));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_misspellings(tf, &ranges, &count));
+  ASSERT_EQ(0, (int)count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_set_spellcheck_enabled(tf, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_misspellings(tf, &ranges, &count));
+  ASSERT_EQ(1, (int)count);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_set_secure_text_entry(tf, 1));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_misspellings(tf, &ranges, &count));
+  ASSERT_EQ(0, (int)count);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_destroy(tf));
+  cmp_spellcheck_destroy(checker);
+  PASS();
+}
+
+TEST test_text_field_spellcheck_background(void) {
+  cmp_spellcheck_t *checker = make_checker();
+  cmp_modality_t workers, ui;
+  cmp_text_field_t *tf = NULL;
+  const cmp_spell_range_t *ranges;
+  size_t count;
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_threaded_init(&workers, 2));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_single_init(&ui));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_create(&tf));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_text_field_set_spellchecker(tf, checker, &ui, &ui));
+  ASSERT_EQ(CMP_ERROR_INVALID_ARG,
+            cmp_text_field_set_spellchecker(tf, checker, &workers, NULL));
+  ASSERT_EQ(CMP_SUCCESS,
+            cmp_text_field_set_spellchecker(tf, checker, &workers, &ui));
+
+  /* Typing returns at once; the results arrive through the ui loop and
+   * superseded checks are dropped */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_insert_text(tf, "helo wrold"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_insert_text(tf, " teh\nmore txet"));
+  spell_wait(&ui, tf, 4, 5 * CLOCKS_PER_SEC);
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_get_misspellings(tf, &ranges, &count));
+  ASSERT_EQ(4, (int)count);
+  ASSERT_EQ(0, (int)ranges[0].offset);
+  ASSERT_EQ(5, (int)ranges[1].offset);
+  ASSERT_EQ(11, (int)ranges[2].offset);
+  ASSERT_EQ(20, (int)ranges[3].offset);
+
+  /* Destroying with checks in flight hands the field to the ui loop */
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_insert_text(tf, " agian"));
+  ASSERT_EQ(CMP_SUCCESS, cmp_text_field_destroy(tf));
+  spell_wait(&ui, NULL, 0, CLOCKS_PER_SEC / 5);
+
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_destroy(&workers));
+  ASSERT_EQ(CMP_SUCCESS, cmp_modality_destroy(&ui));
+  cmp_spellcheck_destroy(checker);
+  PASS();
+}
+
 TEST test_null_args(void) {
   cmp_text_field_t *tf = NULL;
   cmp_rich_text_view_t *rt = NULL;
@@ -82,6 +320,10 @@ TEST test_null_args(void) {
 SUITE(text_fields_suite) {
   RUN_TEST(test_text_field_configurations);
   RUN_TEST(test_rich_text_detectors);
+  RUN_TEST(test_text_field_editing);
+  RUN_TEST(test_text_field_graphemes);
+  RUN_TEST(test_text_field_spellcheck);
+  RUN_TEST(test_text_field_spellcheck_background);
   RUN_TEST(test_null_args);
 }
 
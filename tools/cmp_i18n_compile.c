@@ -0,0 +1,104 @@
+/* Compiles text translation catalogs into the binary format read by
+ * cmp_i18n_load_compiled, so applications never parse text at startup.
+ *
+ * Usage: cmp_i18n_compile <output> <input>...
+ *
+ * Each input line is "locale<TAB>key<TAB>value". Blank lines and lines
+ * starting with '#' are ignored; values may use \n, \t and \\ escapes.
+ * When a (locale, key) pair repeats, the first occurrence wins. */
+
+/* clang-format off */
+#include "cmp.h"
+
+#include <stdio.h>
+#include <string.h>
+/* clang-format on */
+
+/* Rewrites escapes in place. */
+static void unescape(char *s) {
+  char *out = s;
+  for (; *s; ++s) {
+    if (*s == '\\' && s[1]) {
+      ++s;
+      *out++ = *s == 'n' ? '\n' : *s == 't' ? '\t' : *s;
+    } else {
+      *out++ = *s;
+    }
+  }
+  *out = '\0';
+}
+
+static int add_source(cmp_i18n_t *i18n, const char *path) {
+  void *buffer = NULL;
+  size_t size = 0, line_no = 0;
+  char *line, *end;
+  int res = cmp_vfs_read_file_sync(path, &buffer, &size);
+  if (res != CMP_SUCCESS) {
+    fprintf(stderr, "%s: cannot read (%d)\n", path, res);
+    return res;
+  }
+  ((char *)buffer)[size] = '\0';
+
+  for (line = (char *)buffer; *line; line = end) {
+    char *key, *value;
+    end = strchr(line, '\n');
+    if (end) {
+      *end++ = '\0';
+    } else {
+      end = line + strlen(line);
+    }
+    line_no++;
+    if (*line && line[strlen(line) - 1] == '\r') {
+      line[strlen(line) - 1] = '\0';
+    }
+    if (*line == '\0' || *line == '#') {
+      continue;
+    }
+    key = strchr(line, '\t');
+    value = key ? strchr(key + 1, '\t') : NULL;
+    if (!value) {
+      fprintf(stderr, "%s:%lu: expected locale<TAB>key<TAB>value\n", path,
+              (unsigned long)line_no);
+      res = CMP_ERROR_INVALID_ARG;
+      break;
+    }
+    *key++ = '\0';
+    *value++ = '\0';
+    unescape(value);
+    res = cmp_i18n_add_string(i18n, line, key, value);
+    if (res != CMP_SUCCESS) {
+      break;
+    }
+  }
+
+  CMP_FREE(buffer);
+  return res;
+}
+
+int main(int argc, char **argv) {
+  cmp_i18n_t *i18n = NULL;
+  int i, res;
+
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <output> <input>...\n", argv[0]);
+    return 2;
+  }
+  if (cmp_vfs_init() != CMP_SUCCESS || cmp_i18n_create(&i18n) != CMP_SUCCESS) {
+    return 1;
+  }
+
+  res = CMP_SUCCESS;
+  for (i = 2; i < argc && res == CMP_SUCCESS; ++i) {
+    res = add_source(i18n, argv[i]);
+  }
+  if (res == CMP_SUCCESS) {
+    res = cmp_i18n_save_catalog(i18n, argv[1]);
+    if (res != CMP_SUCCESS) {
+      fprintf(stderr, "%s: cannot write (%d)\n", argv[1], res);
+    }
+  }
+
+  cmp_i18n_destroy(i18n);
+  cmp_vfs_shutdown();
+  return res == CMP_SUCCESS ? 0 : 1;
+}